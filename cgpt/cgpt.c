@@ -6,8 +6,12 @@
  * files for more details.
  */
 
+#include <errno.h>
 #include <stdio.h>
 #include <string.h>
+#ifndef HAVE_MACOS
+#include <sys/random.h>
+#endif
 #include <unistd.h>
 #include <uuid/uuid.h>
 
@@ -16,8 +20,46 @@
 
 const char* progname;
 
+#ifndef HAVE_MACOS
+/* Random bytes for GenerateGuid(), refilled a batch of GUIDs at a time. */
+static uint8_t guid_pool[16 * GUID_SIZE];
+static size_t guid_pool_left;
+
+/*
+ * Make a random (version 4) GUID from the pool, as uuid_generate() would.
+ * Returns 0 on success, or -1 if the kernel has no getrandom().
+ */
+static int GuidFromPool(Guid *newguid)
+{
+  uint8_t *raw = newguid->u.raw;
+
+  if (!guid_pool_left) {
+    ssize_t got;
+
+    do {
+      got = getrandom(guid_pool, sizeof(guid_pool), 0);
+    } while (got == -1 && errno == EINTR);
+    // Up to 256 bytes are never cut short once the pool is initialized.
+    if (got != sizeof(guid_pool))
+      return -1;
+    guid_pool_left = sizeof(guid_pool);
+  }
+
+  guid_pool_left -= GUID_SIZE;
+  memcpy(raw, guid_pool + guid_pool_left, GUID_SIZE);
+  memset(guid_pool + guid_pool_left, 0, GUID_SIZE);
+  raw[6] = (raw[6] & 0x0F) | 0x40;  // Version 4
+  raw[8] = (raw[8] & 0x3F) | 0x80;  // RFC 4122 variant
+  return 0;
+}
+#endif
+
 int GenerateGuid(Guid *newguid)
 {
+#ifndef HAVE_MACOS
+  if (GuidFromPool(newguid) == 0)
+    return CGPT_OK;
+#endif
   /* From libuuid */
   uuid_generate(newguid->u.raw);
   return CGPT_OK;
@@ -37,6 +79,7 @@ struct {
   {"prioritize", cmd_prioritize,
    "Reorder the priority of all kernel partitions"},
   {"legacy", cmd_legacy, "Switch between GPT and Legacy GPT"},
+  {"batch", cmd_batch, "Run a script of commands with one load and save"},
 };
 
 void Usage(void) {
@@ -52,23 +95,12 @@ void Usage(void) {
   printf("\nFor more detailed usage, use %s COMMAND -h\n\n", progname);
 }
 
-int main(int argc, char *argv[]) {
+int RunCommand(int argc, char *argv[]) {
   int i;
   int match_count = 0;
   int match_index = 0;
   char* command;
 
-  progname = strrchr(argv[0], '/');
-  if (progname)
-    progname++;
-  else
-    progname = argv[0];
-
-  if (argc < 2) {
-    Usage();
-    return CGPT_FAILED;
-  }
-
   // increment optind now, so that getopt skips argv[0] in command function
   command = argv[optind++];
 
@@ -95,3 +127,18 @@ int main(int argc, char *argv[]) {
 
   return CGPT_FAILED;
 }
+
+int main(int argc, char *argv[]) {
+  progname = strrchr(argv[0], '/');
+  if (progname)
+    progname++;
+  else
+    progname = argv[0];
+
+  if (argc < 2) {
+    Usage();
+    return CGPT_FAILED;
+  }
+
+  return RunCommand(argc, argv);
+}
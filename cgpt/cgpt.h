@@ -41,12 +41,25 @@ struct pmbr {
 
 void PMBRToStr(struct pmbr *pmbr, char *str, unsigned int buflen);
 
+// Most GPT regions of an image file which are mapped instead of read.
+#define DRIVE_MAX_MAPS 4
+
+// A region of an image file mapped by Load().
+struct drive_map {
+  uint8_t *base;
+  size_t size;
+};
+
 // Handle to the drive storing the GPT.
 struct drive {
   uint64_t size;    /* total size (in bytes) */
   GptData gpt;
   struct pmbr pmbr;
   int fd;       /* file descriptor */
+  uint64_t file_size;  /* size of the image file; 0 if not a regular file */
+  struct drive_map maps[DRIVE_MAX_MAPS];
+  int num_maps;
+  int sparse;   /* save whole entry arrays with SaveSparse() */
 };
 
 // Opens a block device or file, loads raw GPT data from it.
@@ -61,11 +74,29 @@ struct drive {
 int DriveOpen(const char *drive_path, struct drive *drive, int mode,
               uint64_t drive_size);
 int DriveClose(struct drive *drive, int update_as_needed);
+
+// Keeps 'drive_path' open and loaded until DriveBatchEnd(). Meanwhile
+// DriveOpen() of the same path returns the loaded drive, and DriveClose() of
+// it only records whether an update was requested, so a series of commands
+// shares one load and one save.
+//
+// Returns CGPT_FAILED if the drive can't be opened.
+int DriveBatchBegin(const char *drive_path, uint64_t drive_size);
+
+// Ends the batch. If 'save' is set and any command asked for an update, the
+// modified GPT is written back once. Returns the DriveClose() result.
+int DriveBatchEnd(int save);
+
+// Returns non-zero if 'drive' is the drive of the active batch, so anything
+// written to it directly would skip the batch's all-or-nothing save.
+int DriveInBatch(const struct drive *drive);
 int CheckValid(const struct drive *drive);
 
 /* Loads sectors from 'drive'.
  * *buf is pointed to an allocated memory when returned, and should be
- * freed.
+ * freed with DriveFreeBuffer().  For image files, *buf may instead point into
+ * a private mapping of the file; changes to it only reach the file through
+ * Save().
  *
  *   drive -- open drive.
  *   buf -- pointer to buffer pointer
@@ -80,6 +111,9 @@ int Load(struct drive *drive, uint8_t **buf,
                 const uint64_t sector_bytes,
                 const uint64_t sector_count);
 
+/* Frees a buffer returned by Load(). */
+void DriveFreeBuffer(struct drive *drive, uint8_t *buf);
+
 /* Saves sectors to 'drive'.
  *
  *   drive -- open drive
@@ -95,6 +129,15 @@ int Save(struct drive *drive, const uint8_t *buf,
                 const uint64_t sector_bytes,
                 const uint64_t sector_count);
 
+/* Like Save(), but writes sector by sector so that all-zero sectors of an
+ * image file are punched out rather than allocated.  Falls back to writing
+ * zeroes where holes aren't supported.
+ */
+int SaveSparse(struct drive *drive, const uint8_t *buf,
+               const uint64_t sector,
+               const uint64_t sector_bytes,
+               const uint64_t sector_count);
+
 
 /* GUID conversion functions. Accepted format:
  *
@@ -149,6 +192,28 @@ void EntryDetails(GptEntry *entry, uint32_t index, int raw);
 uint32_t GetNumberOfEntries(const struct drive *drive);
 GptEntry *GetEntry(GptData *gpt, int secondary, uint32_t entry_index);
 
+// One copy of the entries, worked out once so that a loop over them needn't
+// find the header and pick the copy again for each entry the way GetEntry()
+// does. It's only good until the headers or entry arrays are replaced, so get
+// it after GptSanityCheck() and again after UpdateAllEntries() and the like.
+// With no valid header, count is 0.
+typedef struct {
+  uint8_t *entries;
+  uint32_t stride;
+  uint32_t count;
+} GptEntriesView;
+
+void GetEntriesView(GptData *gpt, int secondary, GptEntriesView *view);
+
+static inline GptEntry *ViewEntry(const GptEntriesView *view, uint32_t index) {
+  return (GptEntry *)(view->entries + (size_t)view->stride * index);
+}
+
+// Marks whole entry arrays ('modified' is GPT_MODIFIED_ENTRIES1 and/or 2) as
+// changed, so that they're written out in full rather than just the sectors
+// GptEntryModified() recorded.
+void EntriesModified(GptData *gpt, uint8_t modified);
+
 void SetRequired(struct drive *drive, int secondary, uint32_t entry_index,
                  int required);
 int GetRequired(struct drive *drive, int secondary, uint32_t entry_index);
@@ -203,6 +268,11 @@ int cmd_boot(int argc, char *argv[]);
 int cmd_find(int argc, char *argv[]);
 int cmd_prioritize(int argc, char *argv[]);
 int cmd_legacy(int argc, char *argv[]);
+int cmd_batch(int argc, char *argv[]);
+
+// Runs the command named by argv[optind]; getopt continues after it.
+// Returns CGPT_FAILED if no command matches.
+int RunCommand(int argc, char *argv[]);
 
 #define ARRAY_COUNT(array) (sizeof(array)/sizeof((array)[0]))
 const char *GptError(int errnum);
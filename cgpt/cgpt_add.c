@@ -98,6 +98,7 @@ static int GptSetEntryAttributes(struct drive *drive,
       return -1;
     }
   }
+  GptEntryModified(&drive->gpt, entry);
   return 0;
 }
 
@@ -40,10 +40,11 @@ int CgptGetBootPartitionNumber(CgptBootParams *params) {
   char buf[GUID_STRLEN];
   GuidToStr(&drive.pmbr.boot_guid, buf, sizeof(buf));
 
-  int numEntries = GetNumberOfEntries(&drive);
-  int i;
-  for(i = 0; i < numEntries; i++) {
-      GptEntry *entry = GetEntry(&drive.gpt, ANY_VALID, i);
+  GptEntriesView view;
+  uint32_t i;
+  GetEntriesView(&drive.gpt, ANY_VALID, &view);
+  for(i = 0; i < view.count; i++) {
+      GptEntry *entry = ViewEntry(&view, i);
 
       if (GuidEqual(&entry->unique, &drive.pmbr.boot_guid)) {
         params->partition = i + 1;
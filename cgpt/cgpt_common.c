@@ -18,7 +18,9 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/file.h>
 #include <sys/ioctl.h>
+#include <sys/mman.h>
 #include <sys/mount.h>
 #include <sys/stat.h>
 #include <sys/types.h>
@@ -76,6 +78,54 @@ int CheckValid(const struct drive *drive) {
   return CGPT_OK;
 }
 
+/* Points *buf at 'count' bytes of an image file, starting at byte 'offset',
+ * through a private mapping so that loading doesn't need to copy the data.
+ * Writes through the mapping are never carried back to the file; Save() does
+ * that explicitly.
+ *
+ * Returns 0 if successful, non-zero if the caller should read the data
+ * instead.
+ */
+static int MapSectors(struct drive *drive, uint8_t **buf,
+                      uint64_t offset, uint64_t count) {
+  long page_size = sysconf(_SC_PAGESIZE);
+  uint64_t start;
+  size_t len;
+  void *base;
+
+  if (!drive->file_size || drive->num_maps >= DRIVE_MAX_MAPS ||
+      page_size <= 0)
+    return 1;
+  /* Touching a mapping past the end of the file would fault. */
+  if (offset > drive->file_size || count > drive->file_size - offset)
+    return 1;
+
+  start = offset - offset % page_size;
+  len = offset + count - start;
+  base = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE, drive->fd,
+              start);
+  if (base == MAP_FAILED)
+    return 1;
+
+  drive->maps[drive->num_maps].base = base;
+  drive->maps[drive->num_maps].size = len;
+  drive->num_maps++;
+  *buf = (uint8_t *)base + (offset - start);
+  return 0;
+}
+
+void DriveFreeBuffer(struct drive *drive, uint8_t *buf) {
+  int i;
+
+  for (i = 0; i < drive->num_maps; i++) {
+    if (buf >= drive->maps[i].base &&
+        buf < drive->maps[i].base + drive->maps[i].size)
+      return;  /* Unmapped by DriveClose() */
+  }
+
+  free(buf);
+}
+
 int Load(struct drive *drive, uint8_t **buf,
                 const uint64_t sector,
                 const uint64_t sector_bytes,
@@ -96,6 +146,9 @@ int Load(struct drive *drive, uint8_t **buf,
     return CGPT_FAILED;
   }
   count = sector_bytes * sector_count;
+  if (0 == MapSectors(drive, buf, sector * sector_bytes, count))
+    return CGPT_OK;
+
   *buf = malloc(count);
   require(*buf);
 
@@ -161,6 +214,64 @@ int Save(struct drive *drive, const uint8_t *buf,
   return CGPT_OK;
 }
 
+static int IsZeroSector(const uint8_t *buf, uint64_t sector_bytes) {
+  uint64_t i;
+
+  for (i = 0; i < sector_bytes; i++)
+    if (buf[i])
+      return 0;
+  return 1;
+}
+
+/* Replaces 'count' bytes at 'offset' with zeroes by deallocating them, so a
+ * sparse image file stays sparse.  Returns 0 if successful.
+ */
+static int PunchHole(struct drive *drive, uint64_t offset, uint64_t count) {
+#if !defined(HAVE_MACOS) && defined(FALLOC_FL_PUNCH_HOLE)
+  if (drive->file_size)
+    return fallocate(drive->fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+                     offset, count);
+#endif
+  return -1;
+}
+
+int SaveSparse(struct drive *drive, const uint8_t *buf,
+               const uint64_t sector,
+               const uint64_t sector_bytes,
+               const uint64_t sector_count) {
+  uint64_t i = 0;
+
+  require(buf);
+  while (i < sector_count) {
+    int zero = IsZeroSector(buf + i * sector_bytes, sector_bytes);
+    uint64_t offset = (sector + i) * sector_bytes;
+    uint64_t run = 1;
+    const uint8_t *p = buf + i * sector_bytes;
+    uint64_t count;
+
+    /* Write each run of zero or non-zero sectors with a single call. */
+    while (i + run < sector_count &&
+           zero == IsZeroSector(buf + (i + run) * sector_bytes, sector_bytes))
+      run++;
+    count = run * sector_bytes;
+    i += run;
+
+    if (zero && 0 == PunchHole(drive, offset, count))
+      continue;
+
+    while (count) {
+      ssize_t nwrote = pwrite(drive->fd, p, count, offset);
+      if (nwrote <= 0)
+        return CGPT_FAILED;
+      p += nwrote;
+      offset += nwrote;
+      count -= nwrote;
+    }
+  }
+
+  return CGPT_OK;
+}
+
 static int GptLoad(struct drive *drive, uint32_t sector_bytes) {
   drive->gpt.sector_bytes = sector_bytes;
   if (drive->size % drive->gpt.sector_bytes) {
@@ -231,6 +342,38 @@ static int GptLoad(struct drive *drive, uint32_t sector_bytes) {
   return 0;
 }
 
+/* Writes the sectors of an entries array that are marked in 'dirty', a run of
+ * them at a time, or the whole array if 'dirty' is 0 or it's too big to have
+ * its sectors tracked.  A sparse drive always has the whole array written,
+ * with holes punched for the empty sectors.
+ */
+static int SaveEntries(struct drive *drive, const uint8_t *entries,
+                       uint64_t lba, uint64_t sectors, uint32_t dirty) {
+  uint64_t sector_bytes = drive->gpt.sector_bytes;
+  uint64_t start, end;
+
+  if (drive->sparse)
+    return SaveSparse(drive, entries, lba, sector_bytes, sectors);
+
+  if (!dirty || sectors > GPT_MAX_DIRTY_SECTORS)
+    return Save(drive, entries, lba, sector_bytes, sectors);
+
+  for (start = 0; start < sectors; start = end) {
+    end = start + 1;
+    if (!(dirty & (1U << start)))
+      continue;
+
+    while (end < sectors && (dirty & (1U << end)))
+      end++;
+
+    if (CGPT_OK != Save(drive, entries + start * sector_bytes, lba + start,
+                        sector_bytes, end - start))
+      return CGPT_FAILED;
+  }
+
+  return CGPT_OK;
+}
+
 static int GptSave(struct drive *drive) {
   int errors = 0;
 
@@ -245,11 +388,11 @@ static int GptSave(struct drive *drive) {
     }
     GptHeader* primary_header = (GptHeader*)drive->gpt.primary_header;
     if (drive->gpt.modified & GPT_MODIFIED_ENTRIES1) {
-      if (CGPT_OK != Save(drive, drive->gpt.primary_entries,
-                          primary_header->entries_lba,
-                          drive->gpt.sector_bytes,
-                          CalculateEntriesSectors(primary_header,
-                            drive->gpt.sector_bytes))) {
+      if (CGPT_OK != SaveEntries(drive, drive->gpt.primary_entries,
+                                 primary_header->entries_lba,
+                                 CalculateEntriesSectors(primary_header,
+                                   drive->gpt.sector_bytes),
+                                 drive->gpt.dirty_entries1)) {
         errors++;
         Error("Cannot write primary entries: %s\n", strerror(errno));
       }
@@ -275,30 +418,39 @@ static int GptSave(struct drive *drive) {
     }
     GptHeader* secondary_header = (GptHeader*)drive->gpt.secondary_header;
     if (drive->gpt.modified & GPT_MODIFIED_ENTRIES2) {
-      if (CGPT_OK != Save(drive, drive->gpt.secondary_entries,
-                          secondary_header->entries_lba,
-                          drive->gpt.sector_bytes,
-                          CalculateEntriesSectors(secondary_header,
-                            drive->gpt.sector_bytes))) {
+      if (CGPT_OK != SaveEntries(drive, drive->gpt.secondary_entries,
+                                 secondary_header->entries_lba,
+                                 CalculateEntriesSectors(secondary_header,
+                                   drive->gpt.sector_bytes),
+                                 drive->gpt.dirty_entries2)) {
         errors++;
         Error("Cannot write secondary entries: %s\n", strerror(errno));
       }
     }
   }
 
+  return errors ? -1 : 0;
+}
+
+static void GptFree(struct drive *drive) {
+  int i;
+
   if (drive->gpt.primary_header)
-    free(drive->gpt.primary_header);
+    DriveFreeBuffer(drive, drive->gpt.primary_header);
   drive->gpt.primary_header = 0;
   if (drive->gpt.primary_entries)
-    free(drive->gpt.primary_entries);
+    DriveFreeBuffer(drive, drive->gpt.primary_entries);
   drive->gpt.primary_entries = 0;
   if (drive->gpt.secondary_header)
-    free(drive->gpt.secondary_header);
+    DriveFreeBuffer(drive, drive->gpt.secondary_header);
   drive->gpt.secondary_header = 0;
   if (drive->gpt.secondary_entries)
-    free(drive->gpt.secondary_entries);
+    DriveFreeBuffer(drive, drive->gpt.secondary_entries);
   drive->gpt.secondary_entries = 0;
-  return errors ? -1 : 0;
+
+  for (i = 0; i < drive->num_maps; i++)
+    munmap(drive->maps[i].base, drive->maps[i].size);
+  drive->num_maps = 0;
 }
 
 /*
@@ -329,6 +481,32 @@ static int ObtainDriveSize(int fd, uint64_t* size, uint32_t* sector_bytes) {
   return 0;
 }
 
+/*
+ * Take an advisory lock on the drive, so concurrent cgpt callers don't undo
+ * each other's changes: readers share it, and a writer has it to itself until
+ * DriveClose() closes the file. This is the same whole-disk flock() that udev
+ * looks for from partitioning tools. Filesystems which can't lock are used
+ * unlocked, as before.
+ */
+static void LockDrive(int fd, int mode, const char *drive_path) {
+  int op = (mode & O_ACCMODE) == O_RDONLY ? LOCK_SH : LOCK_EX;
+
+  while (flock(fd, op) == -1) {
+    if (errno != EINTR) {
+      Warning("Can't lock %s: %s\n", drive_path, strerror(errno));
+      return;
+    }
+  }
+}
+
+// State for DriveBatchBegin(): the drive that stays loaded between commands.
+static struct {
+  int active;
+  int update;
+  const char *path;
+  struct drive drive;
+} batch;
+
 int DriveOpen(const char *drive_path, struct drive *drive, int mode,
               uint64_t drive_size) {
   uint32_t sector_bytes;
@@ -336,6 +514,11 @@ int DriveOpen(const char *drive_path, struct drive *drive, int mode,
   require(drive_path);
   require(drive);
 
+  if (batch.active && !strcmp(drive_path, batch.path)) {
+    *drive = batch.drive;
+    return CGPT_OK;
+  }
+
   // Clear struct for proper error handling.
   memset(drive, 0, sizeof(struct drive));
 
@@ -348,6 +531,7 @@ int DriveOpen(const char *drive_path, struct drive *drive, int mode,
     Error("Can't open %s: %s\n", drive_path, strerror(errno));
     return CGPT_FAILED;
   }
+  LockDrive(drive->fd, mode, drive_path);
 
   uint64_t gpt_drive_size;
   if (ObtainDriveSize(drive->fd, &gpt_drive_size, &sector_bytes) != 0) {
@@ -356,6 +540,10 @@ int DriveOpen(const char *drive_path, struct drive *drive, int mode,
     goto error_close;
   }
 
+  struct stat st;
+  if (fstat(drive->fd, &st) == 0 && S_ISREG(st.st_mode))
+    drive->file_size = st.st_size;
+
   drive->gpt.gpt_drive_sectors = gpt_drive_size / sector_bytes;
   if (drive_size == 0) {
     drive->size = gpt_drive_size;
@@ -382,6 +570,13 @@ error_close:
 int DriveClose(struct drive *drive, int update_as_needed) {
   int errors = 0;
 
+  // Hand a batch drive back without writing; DriveBatchEnd() saves it.
+  if (DriveInBatch(drive)) {
+    batch.drive = *drive;
+    batch.update |= update_as_needed;
+    return CGPT_OK;
+  }
+
   if (update_as_needed) {
     if (GptSave(drive)) {
         errors++;
@@ -393,11 +588,36 @@ int DriveClose(struct drive *drive, int update_as_needed) {
   // and timeout tests.
   fsync(drive->fd);
 
+  GptFree(drive);
+  // This also drops the lock.
   close(drive->fd);
 
   return errors ? CGPT_FAILED : CGPT_OK;
 }
 
+int DriveBatchBegin(const char *drive_path, uint64_t drive_size) {
+  require(!batch.active);
+
+  if (CGPT_OK != DriveOpen(drive_path, &batch.drive, O_RDWR, drive_size))
+    return CGPT_FAILED;
+
+  batch.path = drive_path;
+  batch.update = 0;
+  batch.active = 1;
+  return CGPT_OK;
+}
+
+int DriveBatchEnd(int save) {
+  require(batch.active);
+
+  batch.active = 0;
+  return DriveClose(&batch.drive, save && batch.update);
+}
+
+int DriveInBatch(const struct drive *drive) {
+  return batch.active && drive->fd == batch.drive.fd;
+}
+
 
 /* GUID conversion functions. Accepted format:
  *
@@ -491,9 +711,16 @@ int UTF16ToUTF8(const uint16_t *utf16, unsigned int maxinput,
 
   maxoutput--;                             /* plan for termination now */
 
-  for (s16idx = s8idx = 0;
-       s16idx < maxinput && utf16[s16idx] && maxoutput;
-       s16idx++) {
+  /* Most names are ASCII, which is copied without decoding. */
+  for (s16idx = s8idx = 0; s16idx < maxinput && maxoutput; s16idx++) {
+    uint16_t codeunit = le16toh(utf16[s16idx]);
+    if (!codeunit || codeunit > 0x7F)
+      break;
+    utf8[s8idx++] = codeunit;
+    maxoutput--;
+  }
+
+  for (; s16idx < maxinput && utf16[s16idx] && maxoutput; s16idx++) {
     uint16_t codeunit = le16toh(utf16[s16idx]);
 
     if (code_point_ready) {
@@ -580,9 +807,15 @@ int UTF8ToUTF16(const uint8_t *utf8, uint16_t *utf16, unsigned int maxoutput)
 
   maxoutput--;                             /* plan for termination */
 
-  for (s8idx = s16idx = 0;
-       utf8[s8idx] && maxoutput;
-       s8idx++) {
+  /* Most names are ASCII, which is copied without decoding. */
+  for (s8idx = s16idx = 0; utf8[s8idx] && maxoutput; s8idx++) {
+    if (utf8[s8idx] > 0x7F)
+      break;
+    utf16[s16idx++] = utf8[s8idx];
+    maxoutput--;
+  }
+
+  for (; utf8[s8idx] && maxoutput; s8idx++) {
     uint8_t code_unit;
     code_unit = utf8[s8idx];
 
@@ -744,28 +977,54 @@ uint32_t GetNumberOfEntries(const struct drive *drive) {
 }
 
 
-GptEntry *GetEntry(GptData *gpt, int secondary, uint32_t entry_index) {
+void GetEntriesView(GptData *gpt, int secondary, GptEntriesView *view) {
   GptHeader *header = GetGptHeader(gpt);
-  uint8_t *entries;
-  uint32_t stride = header->size_of_entry;
-  require(stride);
-  require(entry_index < header->number_of_entries);
+
+  memset(view, 0, sizeof(*view));
+  if (!header)
+    return;
 
   if (secondary == PRIMARY) {
-    entries = gpt->primary_entries;
+    view->entries = gpt->primary_entries;
   } else if (secondary == SECONDARY) {
-    entries = gpt->secondary_entries;
+    view->entries = gpt->secondary_entries;
   } else {  /* ANY_VALID */
     require(secondary == ANY_VALID);
     if (gpt->valid_entries & MASK_PRIMARY) {
-      entries = gpt->primary_entries;
+      view->entries = gpt->primary_entries;
     } else {
       require(gpt->valid_entries & MASK_SECONDARY);
-      entries = gpt->secondary_entries;
+      view->entries = gpt->secondary_entries;
     }
   }
+  view->stride = header->size_of_entry;
+  view->count = header->number_of_entries;
+}
 
-  return (GptEntry*)(&entries[stride * entry_index]);
+GptEntry *GetEntry(GptData *gpt, int secondary, uint32_t entry_index) {
+  GptEntriesView view;
+
+  require(GetGptHeader(gpt));
+  GetEntriesView(gpt, secondary, &view);
+  require(view.stride);
+  require(entry_index < view.count);
+  return ViewEntry(&view, entry_index);
+}
+
+void EntriesModified(GptData *gpt, uint8_t modified) {
+  if (modified & GPT_MODIFIED_ENTRIES1)
+    gpt->dirty_entries1 = 0;
+  if (modified & GPT_MODIFIED_ENTRIES2)
+    gpt->dirty_entries2 = 0;
+  gpt->modified |= modified;
+}
+
+// Records a change to a primary entry, so UpdateAllEntries() can patch the
+// entries CRC instead of recomputing it.
+static void EntryModified(struct drive *drive, int secondary,
+                          const GptEntry *entry) {
+  if (secondary == PRIMARY)
+    GptEntryModified(&drive->gpt, entry);
 }
 
 void SetRequired(struct drive *drive, int secondary, uint32_t entry_index,
@@ -774,6 +1033,7 @@ void SetRequired(struct drive *drive, int secondary, uint32_t entry_index,
   GptEntry *entry;
   entry = GetEntry(&drive->gpt, secondary, entry_index);
   SetEntryRequired(entry, required);
+  EntryModified(drive, secondary, entry);
 }
 
 int GetRequired(struct drive *drive, int secondary, uint32_t entry_index) {
@@ -788,6 +1048,7 @@ void SetLegacyBoot(struct drive *drive, int secondary, uint32_t entry_index,
   GptEntry *entry;
   entry = GetEntry(&drive->gpt, secondary, entry_index);
   SetEntryLegacyBoot(entry, legacy_boot);
+  EntryModified(drive, secondary, entry);
 }
 
 int GetLegacyBoot(struct drive *drive, int secondary, uint32_t entry_index) {
@@ -802,6 +1063,7 @@ void SetPriority(struct drive *drive, int secondary, uint32_t entry_index,
   GptEntry *entry;
   entry = GetEntry(&drive->gpt, secondary, entry_index);
   SetEntryPriority(entry, priority);
+  EntryModified(drive, secondary, entry);
 }
 
 int GetPriority(struct drive *drive, int secondary, uint32_t entry_index) {
@@ -816,6 +1078,7 @@ void SetTries(struct drive *drive, int secondary, uint32_t entry_index,
   GptEntry *entry;
   entry = GetEntry(&drive->gpt, secondary, entry_index);
   SetEntryTries(entry, tries);
+  EntryModified(drive, secondary, entry);
 }
 
 int GetTries(struct drive *drive, int secondary, uint32_t entry_index) {
@@ -830,6 +1093,7 @@ void SetSuccessful(struct drive *drive, int secondary, uint32_t entry_index,
   GptEntry *entry;
   entry = GetEntry(&drive->gpt, secondary, entry_index);
   SetEntrySuccessful(entry, success);
+  EntryModified(drive, secondary, entry);
 }
 
 int GetSuccessful(struct drive *drive, int secondary, uint32_t entry_index) {
@@ -843,15 +1107,52 @@ void SetRaw(struct drive *drive, int secondary, uint32_t entry_index,
   GptEntry *entry;
   entry = GetEntry(&drive->gpt, secondary, entry_index);
   entry->attrs.fields.gpt_att = (uint16_t)raw;
+  EntryModified(drive, secondary, entry);
 }
 
-void UpdateAllEntries(struct drive *drive) {
-  RepairEntries(&drive->gpt, MASK_PRIMARY);
-  RepairHeader(&drive->gpt, MASK_PRIMARY);
+static void UpdateHeaderCrc(GptData *gpt) {
+  GptHeader *primary_header, *secondary_header;
+
+  primary_header = (GptHeader*)gpt->primary_header;
+  secondary_header = (GptHeader*)gpt->secondary_header;
+
+  if (gpt->modified & GPT_MODIFIED_HEADER1) {
+    primary_header->header_crc32 = 0;
+    primary_header->header_crc32 = Crc32(
+        (const uint8_t *)primary_header, sizeof(GptHeader));
+  }
+  if (gpt->modified & GPT_MODIFIED_HEADER2) {
+    secondary_header->header_crc32 = 0;
+    secondary_header->header_crc32 = Crc32(
+        (const uint8_t *)secondary_header, sizeof(GptHeader));
+  }
+}
 
-  drive->gpt.modified |= (GPT_MODIFIED_HEADER1 | GPT_MODIFIED_ENTRIES1 |
-                          GPT_MODIFIED_HEADER2 | GPT_MODIFIED_ENTRIES2);
-  UpdateCrc(&drive->gpt);
+void UpdateAllEntries(struct drive *drive) {
+  GptData *gpt = &drive->gpt;
+  GptHeader *primary_header = (GptHeader *)gpt->primary_header;
+  GptHeader *secondary_header = (GptHeader *)gpt->secondary_header;
+  int patched = 0;
+
+  // Patch the CRC while the secondary entries still hold the old contents.
+  if (memcmp(primary_header, GPT_HEADER_SIGNATURE2, GPT_HEADER_SIGNATURE_SIZE))
+    patched = !GptPatchEntriesCrc(gpt);
+
+  RepairEntries(gpt, MASK_PRIMARY);
+  RepairHeader(gpt, MASK_PRIMARY);
+
+  gpt->modified |= (GPT_MODIFIED_HEADER1 | GPT_MODIFIED_ENTRIES1 |
+                    GPT_MODIFIED_HEADER2 | GPT_MODIFIED_ENTRIES2);
+  if (patched) {
+    // The entry arrays are identical again, so they share the CRC.
+    secondary_header->entries_crc32 = primary_header->entries_crc32;
+    UpdateHeaderCrc(gpt);
+  } else {
+    // Without both copies in sync to begin with, more than the recorded
+    // sectors may differ from what's on the drive.
+    EntriesModified(gpt, GPT_MODIFIED_ENTRIES1 | GPT_MODIFIED_ENTRIES2);
+    UpdateCrc(gpt);
+  }
 }
 
 int IsUnused(struct drive *drive, int secondary, uint32_t index) {
@@ -904,16 +1205,7 @@ void UpdateCrc(GptData *gpt) {
     secondary_header->entries_crc32 =
         Crc32(gpt->secondary_entries, entries_size);
   }
-  if (gpt->modified & GPT_MODIFIED_HEADER1) {
-    primary_header->header_crc32 = 0;
-    primary_header->header_crc32 = Crc32(
-        (const uint8_t *)primary_header, sizeof(GptHeader));
-  }
-  if (gpt->modified & GPT_MODIFIED_HEADER2) {
-    secondary_header->header_crc32 = 0;
-    secondary_header->header_crc32 = Crc32(
-        (const uint8_t *)secondary_header, sizeof(GptHeader));
-  }
+  UpdateHeaderCrc(gpt);
 }
 /* Two headers are NOT bitwise identical. For example, my_lba pointers to header
  * itself so that my_lba in primary and secondary is definitely different.
@@ -1054,11 +1346,11 @@ int CgptGetNumNonEmptyPartitions(CgptShowParams *params) {
   }
 
   params->num_partitions = 0;
-  int numEntries = GetNumberOfEntries(&drive);
-  int i;
-  for(i = 0; i < numEntries; i++) {
-      GptEntry *entry = GetEntry(&drive.gpt, ANY_VALID, i);
-      if (GuidIsZero(&entry->type))
+  GptEntriesView view;
+  uint32_t i;
+  GetEntriesView(&drive.gpt, ANY_VALID, &view);
+  for(i = 0; i < view.count; i++) {
+      if (GuidIsZero(&ViewEntry(&view, i)->type))
         continue;
 
       params->num_partitions++;
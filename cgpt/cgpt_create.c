@@ -2,7 +2,6 @@
 // Use of this source code is governed by a BSD-style license that can be
 // found in the LICENSE file.
 
-
 #include <string.h>
 
 #include "cgpt.h"
@@ -30,8 +29,8 @@ static int GptCreate(struct drive *drive, CgptCreateParams *params) {
   AllocAndClear(&drive->gpt.secondary_header,
                 drive->gpt.sector_bytes * GPT_HEADER_SECTORS);
 
-  drive->gpt.modified |= (GPT_MODIFIED_HEADER1 | GPT_MODIFIED_ENTRIES1 |
-                         GPT_MODIFIED_HEADER2 | GPT_MODIFIED_ENTRIES2);
+  drive->gpt.modified |= (GPT_MODIFIED_HEADER1 | GPT_MODIFIED_HEADER2);
+  EntriesModified(&drive->gpt, GPT_MODIFIED_ENTRIES1 | GPT_MODIFIED_ENTRIES2);
 
   // Initialize a blank set
   if (!params->zap) {
@@ -117,6 +116,11 @@ int CgptCreate(CgptCreateParams *params) {
   if (GptCreate(&drive, params))
     goto bad;
 
+  // Punch out the empty entry sectors instead of writing zeroes over them.
+  // In a batch this only takes effect when the batch is saved.
+  if (params->sparse)
+    drive.sparse = 1;
+
   // Write it all out
   return DriveClose(&drive, 1);
 
@@ -11,26 +11,45 @@
 #include "cgpt.h"
 #include "cgpt_nor.h"
 #include "cgptlib_internal.h"
+#include "host_jobs.h"
+#include "host_misc.h"
 #include "vboot_host.h"
 
 #define BUFSIZE 1024
 
-// fill comparebuf with the data to be examined, returning true on success.
-static int FillBuffer(CgptFindParams *params, int fd, uint64_t pos,
-                       uint64_t count) {
-  uint8_t *bufptr = params->comparebuf;
-
-  if (-1 == lseek(fd, pos, SEEK_SET))
-    return 0;
-
+// A partition which matched the search criteria.
+struct find_match {
+  int partnum;                  // 1-based
+  GptEntry entry;
+};
+
+// The matches found on one drive, in partition order.
+struct find_result {
+  struct find_match *matches;
+  int count;
+
+  // With a cache file, every partition on the drive and what identifies it,
+  // so the cache can be rewritten after a full scan.
+  struct find_match *entries;
+  int num_entries;
+  uint64_t rdev;
+  uint64_t size;
+  uint32_t sector_bytes;
+  GptHeader header;
+  int complete;                 // entries lists every partition
+};
+
+// fill buf with the data to be examined, returning true on success.
+static int FillBuffer(int fd, uint8_t *bufptr, uint64_t pos, uint64_t count) {
   // keep reading until done or error
   while (count) {
-    ssize_t bytes_read = read(fd, bufptr, count);
+    ssize_t bytes_read = pread(fd, bufptr, count, pos);
     // negative means error, 0 means (unexpected) EOF
     if (bytes_read <= 0)
       return 0;
     count -= bytes_read;
     bufptr += bytes_read;
+    pos += bytes_read;
   }
 
   return 1;
@@ -38,7 +57,7 @@ static int FillBuffer(CgptFindParams *params, int fd, uint64_t pos,
 
 // check partition data content. return true for match, 0 for no match or error
 static int match_content(CgptFindParams *params, struct drive *drive,
-                             GptEntry *entry) {
+                         GptEntry *entry, uint8_t *comparebuf) {
   uint64_t part_size;
 
   if (!params->matchlen)
@@ -52,7 +71,7 @@ static int match_content(CgptFindParams *params, struct drive *drive,
   }
 
   // Read the partition data.
-  if (!FillBuffer(params, drive->fd,
+  if (!FillBuffer(drive->fd, comparebuf,
     (drive->gpt.sector_bytes * entry->starting_lba) + params->matchoffset,
                   params->matchlen)) {
     Error("unable to read partition data\n");
@@ -60,7 +79,7 @@ static int match_content(CgptFindParams *params, struct drive *drive,
   }
 
   // Compare it
-  if (0 == memcmp(params->matchbuf, params->comparebuf, params->matchlen)) {
+  if (0 == memcmp(params->matchbuf, comparebuf, params->matchlen)) {
     return 1;
   }
 
@@ -68,6 +87,25 @@ static int match_content(CgptFindParams *params, struct drive *drive,
   return 0;
 }
 
+// Remember a match. Returns true on success.
+static int add_match(struct find_result *result, int partnum,
+                     GptEntry *entry) {
+  struct find_match *matches;
+
+  matches = realloc(result->matches,
+                    (result->count + 1) * sizeof(*result->matches));
+  if (!matches) {
+    Error("unable to allocate memory for matches\n");
+    return 0;
+  }
+
+  result->matches = matches;
+  matches[result->count].partnum = partnum;
+  memcpy(&matches[result->count].entry, entry, sizeof(*entry));
+  result->count++;
+  return 1;
+}
+
 // This needs to handle /dev/mmcblk0 -> /dev/mmcblk0p3, /dev/sda -> /dev/sda3
 static void showmatch(CgptFindParams *params, char *filename,
                       int partnum, GptEntry *entry) {
@@ -108,67 +146,398 @@ static void chromeos_mtd_show(CgptFindParams *params, char *filename,
   }
 }
 
-// This returns true if a GPT partition matches the search criteria. If a match
-// isn't found (or if the file doesn't contain a GPT), it returns false. The
-// filename and partition number that matched is left in a global, since we
-// could have multiple hits.
-static int gpt_search(CgptFindParams *params, struct drive *drive,
-                      char *filename) {
-  int i;
-  GptEntry *entry;
-  int retval = 0;
+// This returns 1 if the partition entry matches the search criteria (not
+// counting content), 0 if it doesn't, or -1 if the label can't be checked.
+static int match_entry(CgptFindParams *params, GptEntry *entry) {
   char partlabel[GPT_PARTNAME_LEN];
 
+  if ((params->set_unique && GuidEqual(&params->unique_guid, &entry->unique))
+      || (params->set_type && GuidEqual(&params->type_guid, &entry->type)))
+    return 1;
+
+  if (params->set_label) {
+    if (CGPT_OK != UTF16ToUTF8(entry->name,
+                               sizeof(entry->name) / sizeof(entry->name[0]),
+                               (uint8_t *)partlabel, sizeof(partlabel))) {
+      Error("The label cannot be converted from UTF16, so abort.\n");
+      return -1;
+    }
+    if (!strncmp(params->label, partlabel, sizeof(partlabel)))
+      return 1;
+  }
+
+  return 0;
+}
+
+// This collects the GPT partitions which match the search criteria into
+// result. If no match is found (or if the file doesn't contain a GPT), result
+// is left empty. It doesn't print anything, so it may be run for several
+// drives at once.
+static void gpt_search(CgptFindParams *params, struct drive *drive,
+                       uint8_t *comparebuf, struct find_result *result) {
+  uint32_t i;
+  GptEntry *entry;
+  GptEntriesView view;
+  int cache_ok = 1;
+  int found;
+
   if (GPT_SUCCESS != GptSanityCheck(&drive->gpt)) {
-    return 0;
+    result->complete = 1;
+    return;
   }
 
-  for (i = 0; i < GetNumberOfEntries(drive); ++i) {
-    entry = GetEntry(&drive->gpt, ANY_VALID, i);
+  GetEntriesView(&drive->gpt, ANY_VALID, &view);
+  for (i = 0; i < view.count; ++i) {
+    entry = ViewEntry(&view, i);
 
     if (GuidIsZero(&entry->type))
       continue;
 
-    int found = 0;
-    if ((params->set_unique && GuidEqual(&params->unique_guid, &entry->unique))
-        || (params->set_type && GuidEqual(&params->type_guid, &entry->type))) {
-      found = 1;
-    } else if (params->set_label) {
-      if (CGPT_OK != UTF16ToUTF8(entry->name,
-                                 sizeof(entry->name) / sizeof(entry->name[0]),
-                                 (uint8_t *)partlabel, sizeof(partlabel))) {
-        Error("The label cannot be converted from UTF16, so abort.\n");
-        return 0;
+    if (params->cache_file) {
+      struct find_match *entries =
+          realloc(result->entries,
+                  (result->num_entries + 1) * sizeof(*result->entries));
+      if (entries) {
+        result->entries = entries;
+        entries[result->num_entries].partnum = i + 1;
+        memcpy(&entries[result->num_entries].entry, entry, sizeof(*entry));
+        result->num_entries++;
+      } else {
+        cache_ok = 0;
       }
-      if (!strncmp(params->label, partlabel, sizeof(partlabel)))
-        found = 1;
     }
-    if (found && match_content(params, drive, entry)) {
-      params->hits++;
-      retval++;
-      showmatch(params, filename, i+1, entry);
-      if (!params->match_partnum)
-        params->match_partnum = i+1;
+
+    found = match_entry(params, entry);
+    if (found < 0)
+      return;
+    if (found && match_content(params, drive, entry, comparebuf)) {
+      if (!add_match(result, i+1, entry))
+        return;
     }
   }
-
-  return retval;
+  result->complete = cache_ok;
 }
 
-static int do_search(CgptFindParams *params, char *fileName) {
-  int retval;
+// Search one drive, collecting its matches into result.
+static void search_drive(CgptFindParams *params, char *fileName,
+                         uint8_t *comparebuf, struct find_result *result) {
   struct drive drive;
 
   if (CGPT_OK != DriveOpen(fileName, &drive, O_RDONLY, params->drive_size))
-    return 0;
+    return;
+
+  if (params->cache_file) {
+    struct stat st;
+
+    if (!fstat(drive.fd, &st))
+      result->rdev = st.st_rdev;
+    result->size = drive.size;
+    result->sector_bytes = drive.gpt.sector_bytes;
+    memcpy(&result->header, drive.gpt.primary_header, sizeof(result->header));
+  }
 
-  retval = gpt_search(params, &drive, fileName);
+  gpt_search(params, &drive, comparebuf, result);
 
   (void) DriveClose(&drive, 0);
+}
+
+// Print the matches found on a drive and record them in params. This returns
+// the number of matches.
+static int show_matches(CgptFindParams *params, char *filename,
+                        struct find_result *result) {
+  int i;
+
+  for (i = 0; i < result->count; i++) {
+    struct find_match *match = &result->matches[i];
+
+    params->hits++;
+    showmatch(params, filename, match->partnum, &match->entry);
+    if (!params->match_partnum)
+      params->match_partnum = match->partnum;
+  }
+
+  return result->count;
+}
+
+// This returns true if a GPT partition on the drive matches the search
+// criteria, printing each match.
+static int do_search(CgptFindParams *params, char *fileName) {
+  struct find_result result = { 0 };
+  int retval;
+
+  search_drive(params, fileName, params->comparebuf, &result);
+  retval = show_matches(params, fileName, &result);
+  free(result.matches);
+  free(result.entries);
 
   return retval;
 }
 
+// The find cache records every partition on every drive from the last full
+// scan, so a lookup only needs to reread the primary GPT header of each
+// drive. Anything unexpected means a full scan, which rewrites it.
+#define FIND_CACHE_MAGIC "CGPTFC01"
+#define FIND_CACHE_PATH_LEN 256
+
+struct find_cache_header {
+  char magic[8];
+  uint32_t num_drives;
+  uint32_t reserved;
+} __attribute__((packed));
+
+// Followed by num_entries struct find_cache_entry.
+struct find_cache_drive {
+  char path[FIND_CACHE_PATH_LEN];
+  uint64_t rdev;
+  uint64_t size;
+  uint32_t sector_bytes;
+  uint32_t num_entries;
+  GptHeader header;
+} __attribute__((packed));
+
+struct find_cache_entry {
+  uint32_t partnum;
+  GptEntry entry;
+} __attribute__((packed));
+
+// Check that a drive still has the primary GPT header it had when it was
+// cached. Returns true if so.
+static int cache_drive_valid(const struct find_cache_drive *d) {
+  struct stat st;
+  uint8_t *buf;
+  int fd;
+  int ok = 0;
+
+  if (d->sector_bytes < sizeof(GptHeader))
+    return 0;
+
+  fd = open(d->path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    return 0;
+
+  buf = malloc(d->sector_bytes);
+  if (buf && !fstat(fd, &st) && st.st_rdev == d->rdev &&
+      lseek(fd, 0, SEEK_END) == d->size &&
+      FillBuffer(fd, buf, d->sector_bytes, d->sector_bytes) &&
+      !memcmp(buf, &d->header, sizeof(d->header)))
+    ok = 1;
+
+  free(buf);
+  close(fd);
+  return ok;
+}
+
+// Search the cache for the drives in paths, filling in one result per drive.
+// This returns the number of drives with at least one match, or -1 if the
+// drives need a full scan.
+static int cache_search(CgptFindParams *params, char **paths, int count,
+                        struct find_result *results) {
+  struct vb2_file_view *view = NULL;
+  const struct find_cache_header *h;
+  const uint8_t *p, *end;
+  int found = 0;
+  int i, j, m;
+
+  // Content and type matches aren't worth caching; neither is -D.
+  if (params->matchlen || params->set_type || params->drive_size)
+    return -1;
+
+  if (vb2_file_view_open(params->cache_file, 0, &view))
+    return -1;
+
+  p = view->data;
+  end = p + view->size;
+  h = (const struct find_cache_header *)p;
+  if (view->size < sizeof(*h) ||
+      memcmp(h->magic, FIND_CACHE_MAGIC, sizeof(h->magic)) ||
+      h->num_drives != count)
+    goto fail;
+  p += sizeof(*h);
+
+  for (i = 0; i < count; i++) {
+    const struct find_cache_drive *d = (const struct find_cache_drive *)p;
+    const struct find_cache_entry *e;
+
+    if (end - p < sizeof(*d))
+      goto fail;
+    p += sizeof(*d);
+    if ((end - p) / sizeof(*e) < d->num_entries)
+      goto fail;
+    e = (const struct find_cache_entry *)p;
+    p += d->num_entries * sizeof(*e);
+
+    // The set of drives must not have changed.
+    if (strncmp(d->path, paths[i], sizeof(d->path)))
+      goto fail;
+
+    // Every drive is checked, not only those with a match: a partition added
+    // or changed on any of them changes its header too.
+    if (!cache_drive_valid(d))
+      goto fail;
+
+    for (j = 0; j < d->num_entries; j++) {
+      GptEntry entry;
+
+      memcpy(&entry, &e[j].entry, sizeof(entry));
+      m = match_entry(params, &entry);
+      if (m < 0)
+        goto fail;
+      if (m && !add_match(&results[i], e[j].partnum, &entry))
+        goto fail;
+    }
+
+    if (results[i].count)
+      found++;
+  }
+
+  // A miss may just be a partition added since the cache was written.
+  if (found) {
+    vb2_file_view_put(view);
+    return found;
+  }
+
+fail:
+  for (i = 0; i < count; i++) {
+    free(results[i].matches);
+    results[i].matches = NULL;
+    results[i].count = 0;
+  }
+  vb2_file_view_put(view);
+  return -1;
+}
+
+// Replace the cache with the drives just scanned. The cache is optional, so
+// this fails quietly.
+static void cache_write(CgptFindParams *params, char **paths, int count,
+                        struct find_result *results) {
+  struct find_cache_header h = { .num_drives = count };
+  char tmpname[BUFSIZE];
+  FILE *fp;
+  int fd;
+  int ok;
+  int i, j;
+
+  // A unique name, so concurrent scans don't write into the same file.
+  if (snprintf(tmpname, sizeof(tmpname), "%s.XXXXXX", params->cache_file) >=
+      sizeof(tmpname))
+    return;
+
+  fd = mkstemp(tmpname);
+  if (fd < 0)
+    return;
+  fp = fdopen(fd, "w");
+  if (!fp || fchmod(fd, 0644)) {
+    if (fp)
+      fclose(fp);
+    else
+      close(fd);
+    unlink(tmpname);
+    return;
+  }
+
+  memcpy(h.magic, FIND_CACHE_MAGIC, sizeof(h.magic));
+  ok = fwrite(&h, sizeof(h), 1, fp) == 1;
+
+  for (i = 0; ok && i < count; i++) {
+    struct find_result *r = &results[i];
+    struct find_cache_drive d;
+
+    // A drive we couldn't read completely is cached with no partitions and
+    // no sector size, so it never passes cache_drive_valid() and any lookup
+    // falls back to a full scan.
+    memset(&d, 0, sizeof(d));
+    if (strlen(paths[i]) >= sizeof(d.path)) {
+      ok = 0;
+      break;
+    }
+    strcpy(d.path, paths[i]);
+    d.rdev = r->rdev;
+    d.size = r->size;
+    d.sector_bytes = r->complete ? r->sector_bytes : 0;
+    d.num_entries = r->complete ? r->num_entries : 0;
+    memcpy(&d.header, &r->header, sizeof(d.header));
+    ok = fwrite(&d, sizeof(d), 1, fp) == 1;
+
+    for (j = 0; ok && j < d.num_entries; j++) {
+      struct find_cache_entry e;
+
+      e.partnum = r->entries[j].partnum;
+      memcpy(&e.entry, &r->entries[j].entry, sizeof(e.entry));
+      ok = fwrite(&e, sizeof(e), 1, fp) == 1;
+    }
+  }
+
+  if (fclose(fp))
+    ok = 0;
+  if (!ok || rename(tmpname, params->cache_file))
+    unlink(tmpname);
+}
+
+// Work shared by the threads searching several drives at once.
+struct find_job {
+  CgptFindParams *params;
+  char **paths;
+  struct find_result *results;
+};
+
+static void find_drive(void *ctx, int i) {
+  struct find_job *job = ctx;
+  uint8_t *comparebuf = NULL;
+
+  // Each search needs its own buffer for content matching.
+  if (job->params->matchlen) {
+    comparebuf = malloc(job->params->matchlen);
+    if (!comparebuf) {
+      Error("Unable to allocate %" PRIu64 " bytes for comparison buffer\n",
+            job->params->matchlen);
+      return;
+    }
+  }
+
+  search_drive(job->params, job->paths[i], comparebuf, &job->results[i]);
+  free(comparebuf);
+}
+
+// Search the drives, using up to params->jobs threads, then print the matches
+// in the order the drives were given. This returns the number of drives with
+// at least one match.
+static int search_drives(CgptFindParams *params, char **paths, int count) {
+  struct find_job job;
+  int found = 0;
+  int i;
+
+  if (!count)
+    return 0;
+
+  job.params = params;
+  job.paths = paths;
+  job.results = calloc(count, sizeof(*job.results));
+  if (!job.results) {
+    Error("unable to allocate memory for search results\n");
+    return 0;
+  }
+
+  if (params->cache_file &&
+      cache_search(params, paths, count, job.results) >= 0)
+    goto show;
+
+  vb2_run_jobs(find_drive, &job, count, params->jobs);
+
+  if (params->cache_file)
+    cache_write(params, paths, count, job.results);
+
+show:
+  for (i = 0; i < count; i++) {
+    if (show_matches(params, paths[i], &job.results[i]))
+      found++;
+    free(job.results[i].matches);
+    free(job.results[i].entries);
+  }
+  free(job.results);
+
+  return found;
+}
+
 
 #define PROC_MTD "/proc/mtd"
 #define PROC_PARTITIONS "/proc/partitions"
@@ -221,6 +590,9 @@ static int scan_real_devs(CgptFindParams *params) {
   char partname_prev[MAX_PARTITION_NAME_LEN];
   FILE *fp;
   char *pathname;
+  char **paths = NULL;
+  int num_paths = 0;
+  int i;
 
   fp = fopen(PROC_PARTITIONS, "re");
   if (!fp) {
@@ -244,8 +616,12 @@ static int scan_real_devs(CgptFindParams *params) {
     if (!strncmp(partname_prev, partname, strlen(partname_prev)) &&
         strlen(partname_prev)) {
       if ((pathname = is_wholedev(partname_prev))) {
-        if (do_search(params, pathname)) {
-          found++;
+        char **p = realloc(paths, (num_paths + 1) * sizeof(*paths));
+        if (p) {
+          paths = p;
+          paths[num_paths] = strdup(pathname);
+          if (paths[num_paths])
+            num_paths++;
         }
       }
     }
@@ -255,6 +631,11 @@ static int scan_real_devs(CgptFindParams *params) {
 
   fclose(fp);
 
+  found += search_drives(params, paths, num_paths);
+  for (i = 0; i < num_paths; i++)
+    free(paths[i]);
+  free(paths);
+
   fp = fopen(PROC_MTD, "re");
   if (!fp) {
     free(line);
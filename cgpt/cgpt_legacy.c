@@ -33,8 +33,8 @@ int CgptLegacy(CgptLegacyParams *params) {
     memcpy(h1->signature, GPT_HEADER_SIGNATURE, GPT_HEADER_SIGNATURE_SIZE);
     memcpy(h2->signature, GPT_HEADER_SIGNATURE, GPT_HEADER_SIGNATURE_SIZE);
     RepairEntries(&drive.gpt, MASK_SECONDARY);
-    drive.gpt.modified |= (GPT_MODIFIED_HEADER1 | GPT_MODIFIED_ENTRIES1 |
-                           GPT_MODIFIED_HEADER2);
+    drive.gpt.modified |= (GPT_MODIFIED_HEADER1 | GPT_MODIFIED_HEADER2);
+    EntriesModified(&drive.gpt, GPT_MODIFIED_ENTRIES1);
   } else if (params->mode == CGPT_LEGACY_MODE_IGNORE_PRIMARY) {
     if (!(drive.gpt.valid_headers & MASK_SECONDARY) ||
         !(drive.gpt.valid_entries & MASK_SECONDARY) ||
@@ -50,8 +50,8 @@ int CgptLegacy(CgptLegacyParams *params) {
     memcpy(h1->signature, GPT_HEADER_SIGNATURE2, GPT_HEADER_SIGNATURE_SIZE);
     memcpy(h2->signature, GPT_HEADER_SIGNATURE2, GPT_HEADER_SIGNATURE_SIZE);
     memset(drive.gpt.primary_entries, 0, drive.gpt.sector_bytes);
-    drive.gpt.modified |= (GPT_MODIFIED_HEADER1 | GPT_MODIFIED_ENTRIES1 |
-                           GPT_MODIFIED_HEADER2);
+    drive.gpt.modified |= (GPT_MODIFIED_HEADER1 | GPT_MODIFIED_HEADER2);
+    EntriesModified(&drive.gpt, GPT_MODIFIED_ENTRIES1);
   }
 
   UpdateCrc(&drive.gpt);
@@ -3,18 +3,21 @@
  * found in the LICENSE file.
  */
 
+#include <dirent.h>
 #include <err.h>
 #include <errno.h>
 #include <fcntl.h>
 #include <ftw.h>
 #include <inttypes.h>
 #include <linux/major.h>
+#include <mtd/mtd-user.h>
 #include <stdbool.h>
 #include <stdarg.h>
 #include <stdlib.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
+#include <sys/ioctl.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <sys/wait.h>
@@ -22,9 +25,25 @@
 
 #include "cgpt.h"
 #include "cgpt_nor.h"
+#include "fmap.h"
 
 static const char FLASHROM_PATH[] = "/usr/sbin/flashrom";
 
+static const char SYSFS_MTD_PATH[] = "/sys/class/mtd";
+
+// Smallest alignment at which to look for the FMAP on a NOR MTD device.
+#define FMAP_MIN_ALIGN 64
+
+// If the NOR flash holding RW_GPT is an MTD device, RW_GPT is read from it
+// directly, and only the erase blocks cgpt changed are written back. Each
+// flashrom run takes seconds to probe the chip, so this is much faster.
+static struct {
+  int fd;  // -1 when flashrom is used instead
+  uint64_t offset;
+  uint32_t size;
+  uint32_t erasesize;
+} nor_gpt = { .fd = -1 };
+
 // Obtain the MTD size from its sysfs node.
 int GetMtdSize(const char *mtd_device, uint64_t *size) {
   mtd_device = strrchr(mtd_device, '/');
@@ -195,6 +214,302 @@ int RemoveDir(const char *dir) {
   return nftw(dir, remove_file_or_dir, 20, FTW_DEPTH | FTW_PHYS);
 }
 
+static int pread_all(int fd, void *buf, size_t size, uint64_t offset) {
+  uint8_t *p = buf;
+  while (size > 0) {
+    ssize_t n = pread(fd, p, size, offset);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      return 1;
+    }
+    p += n;
+    size -= n;
+    offset += n;
+  }
+  return 0;
+}
+
+static int pwrite_all(int fd, const void *buf, size_t size, uint64_t offset) {
+  const uint8_t *p = buf;
+  while (size > 0) {
+    ssize_t n = pwrite(fd, p, size, offset);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      return 1;
+    }
+    p += n;
+    size -= n;
+    offset += n;
+  }
+  return 0;
+}
+
+static bool is_fmap(const FmapHeader *fmap, uint64_t flash_size) {
+  return !memcmp(fmap->fmap_signature, FMAP_SIGNATURE, FMAP_SIGNATURE_SIZE) &&
+      fmap->fmap_ver_major == FMAP_VER_MAJOR &&
+      fmap->fmap_size <= flash_size;
+}
+
+// Find the FMAP on the flash without reading all of it. Like flashrom, try
+// the biggest power-of-2 alignments first, since that's where FMAPs go.
+static int find_fmap(int fd, uint64_t flash_size, FmapHeader *fmap,
+                     uint64_t *fmap_offset) {
+  uint64_t top = FMAP_MIN_ALIGN;
+  while (top * 2 <= flash_size) {
+    top *= 2;
+  }
+
+  uint64_t stride;
+  for (stride = top; stride >= FMAP_MIN_ALIGN; stride /= 2) {
+    // Offsets that are multiples of 2 * stride were tried already.
+    uint64_t offset = stride == top ? 0 : stride;
+    uint64_t step = stride == top ? stride : stride * 2;
+    for (; offset + sizeof(*fmap) <= flash_size; offset += step) {
+      if (pread_all(fd, fmap, sizeof(*fmap), offset) != 0) {
+        return 1;
+      }
+      if (is_fmap(fmap, flash_size)) {
+        *fmap_offset = offset;
+        return 0;
+      }
+    }
+  }
+  return 1;
+}
+
+// Locate the RW_GPT area on an open NOR MTD device, using its FMAP.
+static int find_rw_gpt(int fd, uint64_t flash_size) {
+  FmapHeader fmap;
+  uint64_t fmap_offset;
+  if (find_fmap(fd, flash_size, &fmap, &fmap_offset) != 0) {
+    return 1;
+  }
+
+  int i;
+  for (i = 0; i < fmap.fmap_nareas; ++i) {
+    FmapAreaHeader area;
+    if (pread_all(fd, &area, sizeof(area),
+                  fmap_offset + sizeof(fmap) + i * sizeof(area)) != 0) {
+      return 1;
+    }
+    if (strncmp(area.area_name, "RW_GPT", FMAP_NAMELEN) != 0) {
+      continue;
+    }
+    // Both halves have to be there, and inside the flash.
+    if (area.area_size == 0 || (area.area_size & 1) != 0 ||
+        (uint64_t)area.area_offset + area.area_size > flash_size) {
+      return 1;
+    }
+    nor_gpt.offset = area.area_offset;
+    nor_gpt.size = area.area_size;
+    return 0;
+  }
+  return 1;
+}
+
+// Return true if the MTD device |name| (such as "mtd0") is NOR flash.
+static bool is_nor_mtd(const char *name) {
+  char *type_path;
+  if (asprintf(&type_path, "%s/%s/type", SYSFS_MTD_PATH, name) == -1) {
+    return false;
+  }
+  FILE *fp = fopen(type_path, "r");
+  free(type_path);
+  if (fp == NULL) {
+    return false;
+  }
+  char type[16];
+  bool nor = fgets(type, sizeof(type), fp) && strcmp(type, "nor\n") == 0;
+  fclose(fp);
+  return nor;
+}
+
+static void close_nor_mtd(void) {
+  if (nor_gpt.fd >= 0) {
+    close(nor_gpt.fd);
+    nor_gpt.fd = -1;
+  }
+}
+
+// Find a NOR MTD device with RW_GPT on it, and set up |nor_gpt| to use it.
+// Returns 0 on success; otherwise flashrom has to be used.
+static int open_nor_mtd(void) {
+  close_nor_mtd();
+
+  DIR *dir = opendir(SYSFS_MTD_PATH);
+  if (dir == NULL) {
+    return 1;
+  }
+
+  struct dirent *entry;
+  while ((entry = readdir(dir)) != NULL) {
+    unsigned int index;
+    char end;
+    // Skip the read-only "mtdNro" aliases.
+    if (sscanf(entry->d_name, "mtd%u%c", &index, &end) != 1 ||
+        !is_nor_mtd(entry->d_name)) {
+      continue;
+    }
+
+    char dev[32];
+    snprintf(dev, sizeof(dev), "/dev/mtd%u", index);
+    int fd = open(dev, O_RDWR | O_CLOEXEC);
+    if (fd < 0) {
+      continue;
+    }
+
+    struct mtd_info_user info;
+    if (ioctl(fd, MEMGETINFO, &info) == 0 && info.erasesize > 0 &&
+        find_rw_gpt(fd, info.size) == 0) {
+      nor_gpt.fd = fd;
+      nor_gpt.erasesize = info.erasesize;
+      closedir(dir);
+      return 0;
+    }
+    close(fd);
+  }
+
+  closedir(dir);
+  return 1;
+}
+
+// Read RW_GPT from the NOR MTD device to "rw_gpt" in |dir|.
+static int read_nor_mtd(const char *dir) {
+  int ret = 1;
+  uint8_t *buf = malloc(nor_gpt.size);
+  if (buf == NULL) {
+    return ret;
+  }
+
+  ret++;
+  char *path;
+  if (asprintf(&path, "%s/rw_gpt", dir) == -1) {
+    goto free_buf;
+  }
+
+  ret++;
+  if (pread_all(nor_gpt.fd, buf, nor_gpt.size, nor_gpt.offset) != 0) {
+    goto free_path;
+  }
+
+  ret++;
+  int fd = open(path, O_WRONLY | O_CLOEXEC | O_CREAT | O_TRUNC, 0600);
+  if (fd < 0) {
+    goto free_path;
+  }
+  if (pwrite_all(fd, buf, nor_gpt.size, 0) != 0) {
+    close(fd);
+    goto free_path;
+  }
+  if (close(fd) != 0) {
+    goto free_path;
+  }
+
+  ret = 0;
+free_path:
+  free(path);
+free_buf:
+  free(buf);
+  return ret;
+}
+
+// Write |size| bytes of |data| to the NOR MTD device at |offset|. Erase blocks
+// whose contents are already right are left alone. The others are erased,
+// written and read back to check them, like flashrom --fast-verify.
+static int write_dirty_blocks(uint64_t offset, const uint8_t *data,
+                              uint32_t size) {
+  const uint32_t erasesize = nor_gpt.erasesize;
+  int ret = 1;
+  uint8_t *old = malloc(erasesize);
+  uint8_t *new = malloc(erasesize);
+  if (old == NULL || new == NULL) {
+    goto free_bufs;
+  }
+
+  uint64_t block;
+  for (block = offset - offset % erasesize; block < offset + size;
+       block += erasesize) {
+    // The part of this block the data covers
+    uint64_t start = block > offset ? block : offset;
+    uint64_t end = block + erasesize < offset + size ?
+        block + erasesize : offset + size;
+
+    if (pread_all(nor_gpt.fd, old, erasesize, block) != 0) {
+      goto free_bufs;
+    }
+    memcpy(new, old, erasesize);
+    memcpy(new + (start - block), data + (start - offset), end - start);
+    if (memcmp(old, new, erasesize) == 0) {
+      continue;
+    }
+
+    struct erase_info_user erase = {
+      .start = block,
+      .length = erasesize,
+    };
+    if (ioctl(nor_gpt.fd, MEMERASE, &erase) != 0 ||
+        pwrite_all(nor_gpt.fd, new, erasesize, block) != 0 ||
+        pread_all(nor_gpt.fd, old, erasesize, block) != 0 ||
+        memcmp(old, new, erasesize) != 0) {
+      goto free_bufs;
+    }
+  }
+
+  ret = 0;
+free_bufs:
+  free(old);
+  free(new);
+  return ret;
+}
+
+// Write "rw_gpt" in |dir| back to the NOR MTD device, one half at a time like
+// the flashrom path. Returns the number of halves that couldn't be written,
+// or -1 if "rw_gpt" couldn't be read.
+static int write_nor_mtd(const char *dir) {
+  int nr_fails = -1;
+  uint8_t *buf = malloc(nor_gpt.size);
+  if (buf == NULL) {
+    return nr_fails;
+  }
+
+  char *path;
+  if (asprintf(&path, "%s/rw_gpt", dir) == -1) {
+    goto free_buf;
+  }
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  free(path);
+  if (fd < 0) {
+    goto free_buf;
+  }
+  struct stat stat;
+  if (fstat(fd, &stat) != 0 || stat.st_size != nor_gpt.size ||
+      pread_all(fd, buf, nor_gpt.size, 0) != 0) {
+    close(fd);
+    goto free_buf;
+  }
+  close(fd);
+
+  uint32_t half_size = nor_gpt.size / 2;
+  nr_fails = 0;
+  if (write_dirty_blocks(nor_gpt.offset, buf, half_size) != 0) {
+    Warning("Cannot write the 1st half of rw_gpt back to the MTD device.\n");
+    nr_fails++;
+  }
+  if (write_dirty_blocks(nor_gpt.offset + half_size, buf + half_size,
+                         half_size) != 0) {
+    Warning("Cannot write the 2nd half of rw_gpt back to the MTD device.\n");
+    nr_fails++;
+  }
+
+free_buf:
+  free(buf);
+  return nr_fails;
+}
+
 // Read RW_GPT from NOR flash to "rw_gpt" in a temp dir |temp_dir_template|.
 // |temp_dir_template| is passed to mkdtemp() so it must satisfy all
 // requirements by mkdtemp.
@@ -208,8 +523,16 @@ int ReadNorFlash(char *temp_dir_template) {
     return ret;
   }
 
-  // Read RW_GPT section from NOR flash to "rw_gpt".
+  // Read RW_GPT section from NOR flash to "rw_gpt", straight from the MTD
+  // device if there is one.
   ret++;
+  if (open_nor_mtd() == 0) {
+    if (read_nor_mtd(temp_dir_template) == 0) {
+      return 0;
+    }
+    Warning("Cannot read RW_GPT from the MTD device; trying flashrom.\n");
+    close_nor_mtd();
+  }
   int fd_flags = fcntl(1, F_GETFD);
   // Close stdout on exec so that flashrom does not muck up cgpt's output.
   if (0 != fcntl(1, F_SETFD, FD_CLOEXEC))
@@ -232,6 +555,17 @@ int ReadNorFlash(char *temp_dir_template) {
 int WriteNorFlash(const char *dir) {
   int ret = 0;
   ret++;
+  if (nor_gpt.fd >= 0) {
+    int nr_fails = write_nor_mtd(dir);
+    close_nor_mtd();
+    switch (nr_fails) {
+      case -1: Error("Cannot read rw_gpt to write it back.\n"); break;
+      case 0: ret = 0; break;
+      case 1: Warning("It might still be okay.\n"); break;
+      case 2: Error("Cannot write both parts back to flash.\n"); break;
+    }
+    return ret;
+  }
   if (split_gpt(dir, "rw_gpt") != 0) {
     Error("Cannot split rw_gpt in two.\n");
     return ret;
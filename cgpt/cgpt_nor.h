@@ -2,8 +2,8 @@
  * Use of this source code is governed by a BSD-style license that can be
  * found in the LICENSE file.
  *
- * This module provides some utility functions to use "flashrom" to read from
- * and write to NOR flash.
+ * This module provides some utility functions to read from and write to NOR
+ * flash, through its MTD device if it has one and with "flashrom" otherwise.
  */
 
 #ifndef VBOOT_REFERCENCE_CGPT_CGPT_NOR_H_
@@ -29,6 +29,7 @@ int RemoveDir(const char *dir);
 int ReadNorFlash(char *temp_dir_template);
 
 // Write "rw_gpt" back to NOR flash. We write the file in two parts for safety.
+// On an MTD device, only the erase blocks that changed are rewritten.
 int WriteNorFlash(const char *dir);
 
 #endif  // VBOOT_REFERCENCE_CGPT_CGPT_NOR_H_
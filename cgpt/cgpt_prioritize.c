@@ -9,86 +9,26 @@
 #include "vboot_host.h"
 
 //////////////////////////////////////////////////////////////////////////////
-// We need a sorted list of priority groups, where each element in the list
-// contains an unordered list of GPT partition numbers.
+// Each kernel partition is ranked by its priority. Sorting the kernels from
+// highest to lowest priority lines up the priority groups, so they can be
+// renumbered in a single pass.
 
-#define MAX_GROUPS 17                   // 0-15, plus one "higher"
+#define MOVE_PRIORITY 99                // above any real priority
 
 typedef struct {
-  int priority;                         // priority of this group
-  int num_parts;                        // number of partitions in this group
-  uint32_t *part;                       // array of partitions in this group
-} group_t;
-
-typedef struct {
-  int max_parts;                       // max number of partitions in any group
-  int num_groups;                      // number of non-empty groups
-  group_t group[MAX_GROUPS];           // array of groups
-} group_list_t;
-
-
-static group_list_t *NewGroupList(int max_p) {
-  int i;
-  group_list_t *gl = (group_list_t *)malloc(sizeof(group_list_t));
-  require(gl);
-  gl->max_parts = max_p;
-  gl->num_groups = 0;
-  // reserve space for the maximum number of partitions in every group
-  for (i=0; i<MAX_GROUPS; i++) {
-    gl->group[i].priority = -1;
-    gl->group[i].num_parts = 0;
-    gl->group[i].part = (uint32_t *)malloc(sizeof(uint32_t) * max_p);
-    require(gl->group[i].part);
-  }
-
-  return gl;
-}
-
-static void FreeGroups(group_list_t *gl) {
-  int i;
-  for (i=0; i<MAX_GROUPS; i++)
-    free(gl->group[i].part);
-  free(gl);
-}
-
-static void AddToGroup(group_list_t *gl, int priority, int partition) {
-  int i;
-  // See if I've already got a group with this priority
-  for (i=0; i<gl->num_groups; i++)
-    if (gl->group[i].priority == priority)
-      break;
-  if (i == gl->num_groups) {
-    // no, add a group
-    require(i < MAX_GROUPS);
-    gl->num_groups++;
-    gl->group[i].priority = priority;
-  }
-  // add the partition to it
-  int j = gl->group[i].num_parts;
-  gl->group[i].part[j] = partition;
-  gl->group[i].num_parts++;
-}
-
-static void ChangeGroup(group_list_t *gl, int old_priority, int new_priority) {
-  int i;
-  for (i=0; i<gl->num_groups; i++)
-    if (gl->group[i].priority == old_priority) {
-      gl->group[i].priority = new_priority;
-      break;
-    }
-}
-
-static void SortGroups(group_list_t *gl) {
-  int i, j;
-  group_t tmp;
-
-  // straight insertion sort is fast enough
-  for (i=1; i<gl->num_groups; i++) {
-    tmp = gl->group[i];
-    for (j=i; j && (gl->group[j-1].priority < tmp.priority); j--)
-      gl->group[j] = gl->group[j-1];
-    gl->group[j] = tmp;
-  }
+  int priority;                         // priority used for ranking
+  uint32_t index;                       // partition number - 1
+  GptEntry *entry;                      // the partition's primary entry
+} kernel_t;
+
+static int CompareKernels(const void *a, const void *b) {
+  const kernel_t *ka = (const kernel_t *)a;
+  const kernel_t *kb = (const kernel_t *)b;
+
+  // Highest priority first; the index just keeps the order predictable
+  if (ka->priority != kb->priority)
+    return kb->priority - ka->priority;
+  return ka->index < kb->index ? -1 : ka->index > kb->index;
 }
 
 int CgptPrioritize(CgptPrioritizeParams *params) {
@@ -100,8 +40,10 @@ int CgptPrioritize(CgptPrioritizeParams *params) {
   uint32_t index;
   uint32_t max_part;
   int num_kernels;
-  int i,j;
-  group_list_t *groups;
+  int num_groups;
+  int i;
+  kernel_t *kernels;
+  GptEntriesView view;
 
   if (params == NULL)
     return CGPT_FAILED;
@@ -137,71 +79,69 @@ int CgptPrioritize(CgptPrioritizeParams *params) {
     }
   }
 
-  // How many kernel partitions do I have?
+  // Find the kernels, and what they're ranked by
+  kernels = (kernel_t *)malloc(sizeof(kernel_t) * max_part);
+  require(kernels);
   num_kernels = 0;
-  for (i = 0; i < max_part; i++) {
-    if (IsKernel(&drive, PRIMARY, i))
-      num_kernels++;
-  }
-
-  if (num_kernels) {
-    // Determine the current priority groups
-    groups = NewGroupList(num_kernels);
-    for (i = 0; i < max_part; i++) {
-      if (!IsKernel(&drive, PRIMARY, i))
-        continue;
-
-      priority = GetPriority(&drive, PRIMARY, i);
-
-      // Is this partition special?
-      if (params->set_partition && (i+1 == params->set_partition)) {
-        params->orig_priority = priority;  // remember the original priority
-        if (params->set_friends)
-          AddToGroup(groups, priority, i); // we'll move them all later
-        else
-          AddToGroup(groups, 99, i);       // move only this one
-      } else {
-        AddToGroup(groups, priority, i);   // just remember
-      }
+  GetEntriesView(&drive.gpt, PRIMARY, &view);
+  for (i = 0; i < view.count; i++) {
+    GptEntry *entry = ViewEntry(&view, i);
+    if (!GuidEqual(&entry->type, &guid_chromeos_kernel))
+      continue;
+
+    priority = GetEntryPriority(entry);
+
+    // Is this partition special?
+    if (params->set_partition && (i+1 == params->set_partition)) {
+      params->orig_priority = priority;  // remember the original priority
+      if (!params->set_friends)
+        priority = MOVE_PRIORITY;        // move only this one
     }
+    kernels[num_kernels].priority = priority;
+    kernels[num_kernels].index = i;
+    kernels[num_kernels].entry = entry;
+    num_kernels++;
+  }
 
-    // If we're including friends, then change the original group priority
-    if (params->set_partition && params->set_friends) {
-      ChangeGroup(groups, params->orig_priority, 99);
-    }
+  // If we're including friends, then move the whole original group
+  if (params->set_partition && params->set_friends) {
+    for (i = 0; i < num_kernels; i++)
+      if (kernels[i].priority == params->orig_priority)
+        kernels[i].priority = MOVE_PRIORITY;
+  }
 
-    // Sorting gives the new order. Now we just need to reassign the
-    // priorities.
-    SortGroups(groups);
-
-    // We'll never lower anything to zero, so if the last group is priority zero
-    // we can ignore it.
-    i = groups->num_groups;
-    if (groups->group[i-1].priority == 0)
-      groups->num_groups--;
-
-    // Where do we start?
-    if (params->max_priority)
-      priority = params->max_priority;
-    else
-      priority = groups->num_groups > 15 ? 15 : groups->num_groups;
-
-    // Figure out what the new values should be
-    for (i=0; i<groups->num_groups; i++) {
-      groups->group[i].priority = priority;
-      if (priority > 1)
-        priority--;
+  // Sorting gives the new order. Now we just need to reassign the
+  // priorities.
+  qsort(kernels, num_kernels, sizeof(kernel_t), CompareKernels);
+
+  // We'll never raise anything from zero, so the priority zero group at the
+  // end can be ignored.
+  while (num_kernels && kernels[num_kernels-1].priority == 0)
+    num_kernels--;
+
+  num_groups = 0;
+  for (i = 0; i < num_kernels; i++)
+    if (!i || kernels[i].priority != kernels[i-1].priority)
+      num_groups++;
+
+  // Where do we start?
+  if (params->max_priority)
+    priority = params->max_priority;
+  else
+    priority = num_groups > 15 ? 15 : num_groups;
+
+  // Now apply the ranking to the GPT, one step down for each new group
+  for (i = 0; i < num_kernels; i++) {
+    if (i && kernels[i].priority != kernels[i-1].priority && priority > 1)
+      priority--;
+    if (GetEntryPriority(kernels[i].entry) != priority) {
+      SetEntryPriority(kernels[i].entry, priority);
+      GptEntryModified(&drive.gpt, kernels[i].entry);
     }
-
-    // Now apply the ranking to the GPT
-    for (i=0; i<groups->num_groups; i++)
-      for (j=0; j<groups->group[i].num_parts; j++)
-        SetPriority(&drive, PRIMARY,
-                    groups->group[i].part[j], groups->group[i].priority);
-
-    FreeGroups(groups);
   }
 
+  free(kernels);
+
   // Write it all out
   UpdateAllEntries(&drive);
 
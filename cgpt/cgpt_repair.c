@@ -2,13 +2,70 @@
 // Use of this source code is governed by a BSD-style license that can be
 // found in the LICENSE file.
 
-
+#include <errno.h>
 #include <string.h>
 
 #include "cgpt.h"
 #include "cgptlib_internal.h"
 #include "vboot_host.h"
 
+static void PrintUpdated(GptData *gpt) {
+  if (gpt->modified & GPT_MODIFIED_HEADER1)
+    printf("Primary Header is updated.\n");
+  if (gpt->modified & GPT_MODIFIED_ENTRIES1)
+    printf("Primary Entries is updated.\n");
+  if (gpt->modified & GPT_MODIFIED_ENTRIES2)
+    printf("Secondary Entries is updated.\n");
+  if (gpt->modified & GPT_MODIFIED_HEADER2)
+    printf("Secondary Header is updated.\n");
+}
+
+// Repairs one bad copy of the entries by writing the good copy straight over
+// it, instead of building a second array in memory for GptRepair() to fill.
+// All-zero sectors are punched out so that a sparse image stays sparse.
+static int RepairSparse(CgptRepairParams *params, struct drive *drive) {
+  GptData *gpt = &drive->gpt;
+  uint32_t good = gpt->valid_entries;
+  uint32_t bad = MASK_BOTH & ~good;
+  uint8_t *entries;
+  GptHeader *header;
+
+  // The entries are fixed up on disk below, so only the headers are left for
+  // GptRepair() to do.
+  gpt->valid_entries = MASK_BOTH;
+  GptRepair(gpt);
+
+  if (MASK_PRIMARY == good) {
+    entries = gpt->primary_entries;
+    header = (GptHeader *)gpt->secondary_header;
+    gpt->modified |= GPT_MODIFIED_ENTRIES2;
+  } else {
+    entries = gpt->secondary_entries;
+    header = (GptHeader *)gpt->primary_header;
+    gpt->modified |= GPT_MODIFIED_ENTRIES1;
+  }
+  PrintUpdated(gpt);
+
+  if (!(gpt->ignored & bad)) {
+    uint64_t sectors = CalculateEntriesSectors(header, gpt->sector_bytes);
+    if (params->verbose)
+      printf("Writing %llu entries sectors at LBA %llu\n",
+             (unsigned long long)sectors,
+             (unsigned long long)header->entries_lba);
+    if (CGPT_OK != SaveSparse(drive, entries, header->entries_lba,
+                              gpt->sector_bytes, sectors)) {
+      Error("Cannot write %s entries: %s\n",
+            MASK_PRIMARY == bad ? "primary" : "secondary", strerror(errno));
+      DriveClose(drive, 0);
+      return CGPT_FAILED;
+    }
+  }
+
+  // Leave the headers to DriveClose(); the entries are already on disk.
+  gpt->modified &= ~(GPT_MODIFIED_ENTRIES1 | GPT_MODIFIED_ENTRIES2);
+  return DriveClose(drive, 1);
+}
+
 int CgptRepair(CgptRepairParams *params) {
   struct drive drive;
 
@@ -32,25 +89,26 @@ int CgptRepair(CgptRepairParams *params) {
     header = (GptHeader *)(drive.gpt.secondary_header);
   }
 
+  // In a batch nothing may reach the disk before the batch is saved, so the
+  // entries are repaired in memory and written sparsely by the batch's save.
+  if (params->sparse && DriveInBatch(&drive))
+    drive.sparse = 1;
+  else if (params->sparse && (MASK_PRIMARY == drive.gpt.valid_entries ||
+                              MASK_SECONDARY == drive.gpt.valid_entries))
+    return RepairSparse(params, &drive);
+
   if (MASK_PRIMARY == drive.gpt.valid_entries) {
-    free(drive.gpt.secondary_entries);
+    DriveFreeBuffer(&drive, drive.gpt.secondary_entries);
     drive.gpt.secondary_entries =
         malloc(header->size_of_entry * header->number_of_entries);
   } else if (MASK_SECONDARY == drive.gpt.valid_entries) {
-    free(drive.gpt.primary_entries);
+    DriveFreeBuffer(&drive, drive.gpt.primary_entries);
     drive.gpt.primary_entries =
         malloc(header->size_of_entry * header->number_of_entries);
   }
 
   GptRepair(&drive.gpt);
-  if (drive.gpt.modified & GPT_MODIFIED_HEADER1)
-    printf("Primary Header is updated.\n");
-  if (drive.gpt.modified & GPT_MODIFIED_ENTRIES1)
-    printf("Primary Entries is updated.\n");
-  if (drive.gpt.modified & GPT_MODIFIED_ENTRIES2)
-    printf("Secondary Entries is updated.\n");
-  if (drive.gpt.modified & GPT_MODIFIED_HEADER2)
-    printf("Secondary Header is updated.\n");
+  PrintUpdated(&drive.gpt);
 
   return DriveClose(&drive, 1);
 }
@@ -163,11 +163,12 @@ void EntryDetails(GptEntry *entry, uint32_t index, int raw) {
 }
 
 void EntriesDetails(struct drive *drive, const int secondary, int raw) {
+  GptEntriesView view;
   uint32_t i;
 
-  for (i = 0; i < GetNumberOfEntries(drive); ++i) {
-    GptEntry *entry;
-    entry = GetEntry(&drive->gpt, secondary, i);
+  GetEntriesView(&drive->gpt, secondary, &view);
+  for (i = 0; i < view.count; ++i) {
+    GptEntry *entry = ViewEntry(&view, i);
 
     if (GuidIsZero(&entry->type))
       continue;
@@ -176,6 +177,174 @@ void EntriesDetails(struct drive *drive, const int secondary, int raw) {
   }
 }
 
+/* Machine-readable output, for scripts that would otherwise run cgpt once per
+ * field.  Strings are escaped so that each format stays parseable whatever a
+ * partition label holds. */
+static void PrintJsonString(const char *str) {
+  putchar('"');
+  for (; *str; str++) {
+    if (*str == '"' || *str == '\\')
+      printf("\\%c", *str);
+    else if ((unsigned char)*str < 0x20)
+      printf("\\u%04x", (unsigned char)*str);
+    else
+      putchar(*str);
+  }
+  putchar('"');
+}
+
+static void PrintTsvString(const char *str) {
+  for (; *str; str++) {
+    if (*str == '\t')
+      printf("\\t");
+    else if (*str == '\n')
+      printf("\\n");
+    else if (*str == '\\')
+      printf("\\\\");
+    else
+      putchar(*str);
+  }
+}
+
+static uint64_t EntrySize(const GptEntry *entry) {
+  // If these aren't actually defined, the size is zero
+  if (!entry->ending_lba && !entry->starting_lba)
+    return 0;
+  return entry->ending_lba - entry->starting_lba + 1;
+}
+
+/* Converts the name of a partition to UTF-8.  The name is copied out first,
+ * since it may not be aligned in the packed entry. */
+static void EntryLabel(const GptEntry *entry, uint8_t *label,
+                       unsigned int label_size) {
+  uint16_t name[sizeof(entry->name) / sizeof(entry->name[0])];
+
+  memcpy(name, entry->name, sizeof(name));
+  UTF16ToUTF8(name, sizeof(name) / sizeof(name[0]), label, label_size);
+}
+
+/* Returns the number of the first partition to dump and sets *end to one past
+ * the last, honoring -i. */
+static uint32_t FormatRange(struct drive *drive, CgptShowParams *params,
+                            uint32_t *end) {
+  if (params->partition) {
+    *end = params->partition;
+    return params->partition - 1;
+  }
+  *end = GetNumberOfEntries(drive);
+  return 0;
+}
+
+static void JsonHeader(struct drive *drive, const char *name, int secondary) {
+  uint8_t mask = secondary ? MASK_SECONDARY : MASK_PRIMARY;
+  GptHeader *header = (GptHeader *)(secondary ? drive->gpt.secondary_header :
+                                    drive->gpt.primary_header);
+  char guid[GUID_STRLEN];
+
+  printf("\"%s\": {", name);
+  printf("\"valid\": %s, ",
+         drive->gpt.valid_headers & mask ? "true" : "false");
+  printf("\"ignored\": %s", drive->gpt.ignored & mask ? "true" : "false");
+  if (!(drive->gpt.ignored & mask)) {
+    GuidToStr(&header->disk_uuid, guid, sizeof(guid));
+    printf(", \"revision\": %u, \"size\": %u, \"header_crc32\": %u, "
+           "\"my_lba\": %" PRIu64 ", \"alternate_lba\": %" PRIu64 ", "
+           "\"first_usable_lba\": %" PRIu64 ", "
+           "\"last_usable_lba\": %" PRIu64 ", \"disk_uuid\": \"%s\", "
+           "\"entries_lba\": %" PRIu64 ", \"number_of_entries\": %u, "
+           "\"size_of_entry\": %u, \"entries_crc32\": %u, "
+           "\"entries_valid\": %s",
+           header->revision, header->size, header->header_crc32,
+           header->my_lba, header->alternate_lba, header->first_usable_lba,
+           header->last_usable_lba, guid, header->entries_lba,
+           header->number_of_entries, header->size_of_entry,
+           header->entries_crc32,
+           drive->gpt.valid_entries & mask ? "true" : "false");
+  }
+  printf("}");
+}
+
+static void ShowJson(struct drive *drive, CgptShowParams *params) {
+  GptEntriesView view;
+  uint32_t i, end;
+  int first = 1;
+  char type[GUID_STRLEN], unique[GUID_STRLEN];
+  char name[256];
+  uint8_t label[GPT_PARTNAME_LEN];
+
+  printf("{\"drive\": ");
+  PrintJsonString(params->drive_name);
+  printf(", \"sector_bytes\": %u, \"drive_sectors\": %" PRIu64 ", "
+         "\"gpt_drive_sectors\": %" PRIu64 ", \"valid\": %s, ",
+         drive->gpt.sector_bytes, drive->gpt.streaming_drive_sectors,
+         drive->gpt.gpt_drive_sectors,
+         (drive->gpt.valid_headers == MASK_BOTH &&
+          drive->gpt.valid_entries == MASK_BOTH) ? "true" : "false");
+  JsonHeader(drive, "primary", 0);
+  printf(", ");
+  JsonHeader(drive, "secondary", 1);
+  printf(", \"partitions\": [");
+
+  GetEntriesView(&drive->gpt, ANY_VALID, &view);
+  for (i = FormatRange(drive, params, &end); i < end; i++) {
+    GptEntry *entry = ViewEntry(&view, i);
+
+    if (!params->partition && GuidIsZero(&entry->type))
+      continue;
+
+    GuidToStr(&entry->type, type, sizeof(type));
+    GuidToStr(&entry->unique, unique, sizeof(unique));
+    EntryLabel(entry, label, sizeof(label));
+    printf("%s\n  {\"number\": %u, \"start\": %" PRIu64 ", "
+           "\"size\": %" PRIu64 ", \"label\": ",
+           first ? "" : ",", i + 1, entry->starting_lba, EntrySize(entry));
+    PrintJsonString((const char *)label);
+    printf(", \"type\": \"%s\", \"type_name\": ", type);
+    if (CGPT_OK == ResolveType(&entry->type, name))
+      PrintJsonString(name);
+    else
+      printf("null");
+    printf(", \"unique\": \"%s\", \"attr\": %u, \"priority\": %d, "
+           "\"tries\": %d, \"successful\": %d, \"required\": %d, "
+           "\"legacy_boot\": %d}",
+           unique, entry->attrs.fields.gpt_att,
+           GetEntryPriority(entry), GetEntryTries(entry),
+           GetEntrySuccessful(entry), GetEntryRequired(entry),
+           GetEntryLegacyBoot(entry));
+    first = 0;
+  }
+  printf("%s]}\n", first ? "" : "\n");
+}
+
+static void ShowTsv(struct drive *drive, CgptShowParams *params) {
+  GptEntriesView view;
+  uint32_t i, end;
+  char type[GUID_STRLEN], unique[GUID_STRLEN];
+  uint8_t label[GPT_PARTNAME_LEN];
+
+  printf("part\tstart\tsize\ttype\tunique\tattr\tpriority\ttries\t"
+         "successful\trequired\tlegacy_boot\tlabel\n");
+  GetEntriesView(&drive->gpt, ANY_VALID, &view);
+  for (i = FormatRange(drive, params, &end); i < end; i++) {
+    GptEntry *entry = ViewEntry(&view, i);
+
+    if (!params->partition && GuidIsZero(&entry->type))
+      continue;
+
+    GuidToStr(&entry->type, type, sizeof(type));
+    GuidToStr(&entry->unique, unique, sizeof(unique));
+    EntryLabel(entry, label, sizeof(label));
+    printf("%u\t%" PRIu64 "\t%" PRIu64 "\t%s\t%s\t0x%x\t%d\t%d\t%d\t%d\t%d\t",
+           i + 1, entry->starting_lba, EntrySize(entry), type, unique,
+           entry->attrs.fields.gpt_att,
+           GetEntryPriority(entry), GetEntryTries(entry),
+           GetEntrySuccessful(entry), GetEntryRequired(entry),
+           GetEntryLegacyBoot(entry));
+    PrintTsvString((const char *)label);
+    printf("\n");
+  }
+}
+
 static int GptShow(struct drive *drive, CgptShowParams *params) {
   int gpt_retval;
   if (GPT_SUCCESS != (gpt_retval = GptSanityCheck(&drive->gpt))) {
@@ -184,13 +353,21 @@ static int GptShow(struct drive *drive, CgptShowParams *params) {
     return CGPT_FAILED;
   }
 
-  if (params->partition) {                      // show single partition
+  if (params->partition > GetNumberOfEntries(drive)) {
+    Error("invalid partition number: %d\n", params->partition);
+    return CGPT_FAILED;
+  }
 
-    if (params->partition > GetNumberOfEntries(drive)) {
-      Error("invalid partition number: %d\n", params->partition);
-      return CGPT_FAILED;
-    }
+  if (params->format == CGPT_SHOW_FORMAT_JSON) {
+    // Validity is part of the output, so there's no warning about it
+    ShowJson(drive, params);
+    return CGPT_OK;
+  } else if (params->format == CGPT_SHOW_FORMAT_TSV) {
+    ShowTsv(drive, params);
+    return CGPT_OK;
+  }
 
+  if (params->partition) {                      // show single partition
     uint32_t index = params->partition - 1;
     GptEntry *entry = GetEntry(&drive->gpt, ANY_VALID, index);
     char buf[256];                      // scratch buffer for string conversion
@@ -248,10 +425,12 @@ static int GptShow(struct drive *drive, CgptShowParams *params) {
   } else if (params->quick) {                   // show all partitions, quickly
     uint32_t i;
     GptEntry *entry;
+    GptEntriesView view;
     char type[GUID_STRLEN];
 
-    for (i = 0; i < GetNumberOfEntries(drive); ++i) {
-      entry = GetEntry(&drive->gpt, ANY_VALID, i);
+    GetEntriesView(&drive->gpt, ANY_VALID, &view);
+    for (i = 0; i < view.count; ++i) {
+      entry = ViewEntry(&view, i);
 
       if (GuidIsZero(&entry->type))
         continue;
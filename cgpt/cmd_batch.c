@@ -0,0 +1,198 @@
+// Copyright 2018 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <errno.h>
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cgpt.h"
+#include "vboot_host.h"
+
+extern const char* progname;
+
+#define BATCH_MAX_ARGS 64
+
+static void Usage(void)
+{
+  printf("\nUsage: %s batch [OPTIONS] DRIVE\n\n"
+         "Run a script of cgpt commands against DRIVE, loading its GPT once\n"
+         "and writing it back once after the last command.\n\n"
+         "Options:\n"
+         "  -D NUM       Size (in bytes) of the disk where partitions reside\n"
+         "                 default 0, meaning partitions and GPT structs are\n"
+         "                 both on DRIVE\n"
+         "  -f FILE      Read the script from FILE instead of stdin\n"
+         "\n"
+         "Each line of the script is a command with its options but without\n"
+         "the DRIVE argument, for example:\n"
+         "\n"
+         "    add -i 2 -t kernel -l \"KERN A\" -S 1 -P 15\n"
+         "    prioritize -i 2\n"
+         "\n"
+         "Arguments may be quoted with ' or \". Blank lines and lines\n"
+         "starting with # are ignored. If any command fails, the batch stops\n"
+         "and nothing is written.\n"
+         "\n", progname);
+}
+
+// Splits 'line' in place into arguments. Returns the argument count, or -1 on
+// an unterminated quote or too many arguments.
+static int SplitLine(char *line, char *args[], int max_args) {
+  char *in = line;
+  int count = 0;
+
+  while (1) {
+    char *out;
+    char quote = 0;
+
+    while (*in == ' ' || *in == '\t' || *in == '\n' || *in == '\r')
+      in++;
+    if (!*in || *in == '#')
+      return count;
+    if (count == max_args)
+      return -1;
+
+    // Quotes may appear anywhere in an argument; copy over them in place.
+    args[count++] = out = in;
+    for (; *in; in++) {
+      if (quote) {
+        if (*in == quote)
+          quote = 0;
+        else
+          *out++ = *in;
+      } else if (*in == '\'' || *in == '"') {
+        quote = *in;
+      } else if (*in == ' ' || *in == '\t' || *in == '\n' || *in == '\r') {
+        break;
+      } else {
+        *out++ = *in;
+      }
+    }
+    if (quote)
+      return -1;
+    if (*in)
+      in++;
+    *out = '\0';
+  }
+}
+
+static int RunScript(FILE *script, char *drive_name) {
+  char *args[BATCH_MAX_ARGS + 2];
+  char *line = NULL;
+  size_t line_size = 0;
+  int line_number = 0;
+  int retval = CGPT_OK;
+
+  while (getline(&line, &line_size, script) != -1) {
+    int count;
+
+    line_number++;
+    args[0] = (char *)progname;
+    count = SplitLine(line, args + 1, BATCH_MAX_ARGS);
+    if (count < 0) {
+      Error("line %d: malformed command\n", line_number);
+      retval = CGPT_FAILED;
+      break;
+    }
+    if (count == 0)
+      continue;
+    if (0 == strncmp(args[1], "batch", strlen(args[1]))) {
+      Error("line %d: batch can't be nested\n", line_number);
+      retval = CGPT_FAILED;
+      break;
+    }
+
+    args[count + 1] = drive_name;
+    optind = 1;
+    if (CGPT_OK != RunCommand(count + 2, args)) {
+      Error("line %d: %s failed\n", line_number, args[1]);
+      retval = CGPT_FAILED;
+      break;
+    }
+  }
+
+  if (retval == CGPT_OK && ferror(script)) {
+    Error("Can't read script: %s\n", strerror(errno));
+    retval = CGPT_FAILED;
+  }
+
+  free(line);
+  return retval;
+}
+
+int cmd_batch(int argc, char *argv[]) {
+  const char *script_name = NULL;
+  uint64_t drive_size = 0;
+  char *drive_name;
+  FILE *script = stdin;
+  int retval;
+
+  int c;
+  int errorcnt = 0;
+  char *e = 0;
+
+  opterr = 0;                     // quiet, you
+  while ((c=getopt(argc, argv, ":hD:f:")) != -1)
+  {
+    switch (c)
+    {
+    case 'D':
+      drive_size = strtoull(optarg, &e, 0);
+      errorcnt += check_int_parse(c, e);
+      break;
+    case 'f':
+      script_name = optarg;
+      break;
+
+    case 'h':
+      Usage();
+      return CGPT_OK;
+    case '?':
+      Error("unrecognized option: -%c\n", optopt);
+      errorcnt++;
+      break;
+    case ':':
+      Error("missing argument to -%c\n", optopt);
+      errorcnt++;
+      break;
+    default:
+      errorcnt++;
+      break;
+    }
+  }
+  if (errorcnt)
+  {
+    Usage();
+    return CGPT_FAILED;
+  }
+
+  if (optind >= argc) {
+    Error("missing drive argument\n");
+    return CGPT_FAILED;
+  }
+
+  drive_name = argv[optind];
+
+  if (script_name) {
+    script = fopen(script_name, "r");
+    if (!script) {
+      Error("Can't open %s: %s\n", script_name, strerror(errno));
+      return CGPT_FAILED;
+    }
+  }
+
+  if (CGPT_OK != DriveBatchBegin(drive_name, drive_size)) {
+    retval = CGPT_FAILED;
+  } else {
+    retval = RunScript(script, drive_name);
+    if (CGPT_OK != DriveBatchEnd(retval == CGPT_OK))
+      retval = CGPT_FAILED;
+  }
+
+  if (script != stdin)
+    fclose(script);
+  return retval;
+}
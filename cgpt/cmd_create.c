@@ -21,6 +21,9 @@ static void Usage(void)
          "  -z           Zero the sectors of the GPT table and entries\n"
          "  -p NUM       Size (in blocks) of the disk to pad between the\n"
          "                 primary GPT header and its entries, default 0\n"
+         "  -s           Write only the non-empty sectors of the entries,\n"
+         "                 punching holes for the rest so sparse images stay\n"
+         "                 sparse\n"
          "\n", progname);
 }
 
@@ -33,7 +36,7 @@ int cmd_create(int argc, char *argv[]) {
   char *e = 0;
 
   opterr = 0;                     // quiet, you
-  while ((c=getopt(argc, argv, ":hzp:D:")) != -1)
+  while ((c=getopt(argc, argv, ":hzsp:D:")) != -1)
   {
     switch (c)
     {
@@ -44,6 +47,9 @@ int cmd_create(int argc, char *argv[]) {
     case 'z':
       params.zap = 1;
       break;
+    case 's':
+      params.sparse = 1;
+      break;
     case 'p':
       params.padding = strtoull(optarg, &e, 0);
       errorcnt += check_int_parse(c, e);
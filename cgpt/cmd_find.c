@@ -6,10 +6,14 @@
 #include <string.h>
 
 #include "cgpt.h"
+#include "host_misc.h"
 #include "vboot_host.h"
 
 extern const char* progname;
 
+// Where -c keeps the partitions found by the last scan of all drives.
+#define FIND_CACHE_FILE "/run/cgpt_find.cache"
+
 static void Usage(void)
 {
   printf("\nUsage: %s find [OPTIONS] [DRIVE]\n\n"
@@ -29,49 +33,19 @@ static void Usage(void)
          "      Matching partition data must also contain FILE content\n"
          "  -O NUM"
          "       Byte offset into partition to match content (default 0)\n"
+         "  -j NUM       Scan up to NUM drives in parallel (default 1)\n"
+         "  -c           When scanning all drives, look up -u or -l in the\n"
+         "                 partitions cached by the last scan, and only\n"
+         "                 rescan if the cache is stale\n"
          "\n", progname);
   PrintTypes();
 }
 
-// read a file into a buffer, return buffer and update size
-static uint8_t *ReadFile(const char *filename, uint64_t *size) {
-  FILE *f;
-  uint8_t *buf;
-  long pos;
-
-  f = fopen(filename, "rb");
-  if (!f) {
-    return NULL;
-  }
-
-  fseek(f, 0, SEEK_END);
-  pos = ftell(f);
-  if (pos < 0) {
-    fclose(f);
-    return NULL;
-  }
-  *size = pos;
-  rewind(f);
-
-  buf = malloc(*size);
-  if (!buf) {
-    fclose(f);
-    return NULL;
-  }
-
-  if(1 != fread(buf, *size, 1, f)) {
-    fclose(f);
-    free(buf);
-    return NULL;
-  }
-
-  fclose(f);
-  return buf;
-}
-
 int cmd_find(int argc, char *argv[]) {
 
   CgptFindParams params;
+  struct vb2_file_view *match_view = NULL;
+  int rv;
   memset(&params, 0, sizeof(params));
 
   int i;
@@ -80,7 +54,7 @@ int cmd_find(int argc, char *argv[]) {
   int c;
 
   opterr = 0;                     // quiet, you
-  while ((c=getopt(argc, argv, ":hv1nt:u:l:M:O:D:")) != -1)
+  while ((c=getopt(argc, argv, ":hcv1nt:u:l:M:O:D:j:")) != -1)
   {
     switch (c)
     {
@@ -88,6 +62,9 @@ int cmd_find(int argc, char *argv[]) {
       params.drive_size = strtoull(optarg, &e, 0);
       errorcnt += check_int_parse(c, e);
       break;
+    case 'c':
+      params.cache_file = FIND_CACHE_FILE;
+      break;
     case 'v':
       params.verbose++;
       break;
@@ -117,11 +94,16 @@ int cmd_find(int argc, char *argv[]) {
       }
       break;
     case 'M':
-      params.matchbuf = ReadFile(optarg, &params.matchlen);
-      if (!params.matchbuf || !params.matchlen) {
+      vb2_file_view_put(match_view);
+      match_view = NULL;
+      if (vb2_file_view_open(optarg, 0, &match_view) ||
+          !match_view->size) {
         Error("Unable to read from %s\n", optarg);
         errorcnt++;
+        break;
       }
+      params.matchbuf = match_view->data;
+      params.matchlen = match_view->size;
       // Go ahead and allocate space for the comparison too
       params.comparebuf = (uint8_t *)malloc(params.matchlen);
       if (!params.comparebuf) {
@@ -134,9 +116,18 @@ int cmd_find(int argc, char *argv[]) {
       params.matchoffset = strtoull(optarg, &e, 0);
       errorcnt += check_int_parse(c, e);
       break;
+    case 'j':
+      params.jobs = strtol(optarg, &e, 0);
+      errorcnt += check_int_parse(c, e);
+      if (params.jobs < 1) {
+        Error("invalid argument to -%c: %s\n", c, optarg);
+        errorcnt++;
+      }
+      break;
 
     case 'h':
       Usage();
+      vb2_file_view_put(match_view);
       return CGPT_OK;
     case '?':
       Error("unrecognized option: -%c\n", optopt);
@@ -158,6 +149,7 @@ int cmd_find(int argc, char *argv[]) {
   if (errorcnt)
   {
     Usage();
+    vb2_file_view_put(match_view);
     return CGPT_FAILED;
   }
 
@@ -171,12 +163,13 @@ int cmd_find(int argc, char *argv[]) {
   }
 
   if (params.oneonly && params.hits != 1) {
-    return CGPT_FAILED;
-  }
-
-  if (params.match_partnum) {
-    return CGPT_OK;
+    rv = CGPT_FAILED;
+  } else if (params.match_partnum) {
+    rv = CGPT_OK;
+  } else {
+    rv = CGPT_FAILED;
   }
 
-  return CGPT_FAILED;
+  vb2_file_view_put(match_view);
+  return rv;
 }
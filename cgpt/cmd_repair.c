@@ -18,6 +18,9 @@ static void Usage(void)
          "  -D NUM       Size (in bytes) of the disk where partitions reside\n"
          "                 default 0, meaning partitions and GPT structs are\n"
          "                 both on DRIVE\n"
+         "  -s           Write the repaired entries sector by sector, punching\n"
+         "                 holes for empty sectors so sparse images stay\n"
+         "                 sparse\n"
          "  -v           Verbose\n"
          "\n", progname);
 }
@@ -31,7 +34,7 @@ int cmd_repair(int argc, char *argv[]) {
   int errorcnt = 0;
 
   opterr = 0;                     // quiet, you
-  while ((c=getopt(argc, argv, ":hvD:")) != -1)
+  while ((c=getopt(argc, argv, ":hsvD:")) != -1)
   {
     switch (c)
     {
@@ -39,6 +42,9 @@ int cmd_repair(int argc, char *argv[]) {
       params.drive_size = strtoull(optarg, &e, 0);
       errorcnt += check_int_parse(c, e);
       break;
+    case 's':
+      params.sparse = 1;
+      break;
     case 'v':
       params.verbose++;
       break;
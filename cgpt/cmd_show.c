@@ -36,9 +36,21 @@ static void Usage(void)
          "               -B  Legacy Boot flag\n"
          "               -A  raw 16-bit attribute value (bits 48-63)\n"
          "  -d           Debug output (including invalid headers)\n"
+         "  -f, --format=FMT\n"
+         "               Print every header and partition field at once, in\n"
+         "                 a form meant for scripts - pick one of:\n"
+         "               json  one JSON object for the whole drive\n"
+         "               tsv   a line of tab-separated column names, then a\n"
+         "                       line per partition\n"
+         "               With -i, only that partition is included\n"
          "\n", progname);
 }
 
+static const struct option long_opts[] = {
+  {"format", 1, 0, 'f'},
+  {NULL, 0, 0, 0}
+};
+
 int cmd_show(int argc, char *argv[]) {
   CgptShowParams params;
   memset(&params, 0, sizeof(params));
@@ -48,7 +60,8 @@ int cmd_show(int argc, char *argv[]) {
   char *e = 0;
 
   opterr = 0;                     // quiet, you
-  while ((c=getopt(argc, argv, ":hnvqi:bstulSTPRBAdD:")) != -1)
+  while ((c=getopt_long(argc, argv, ":hnvqi:bstulSTPRBAdD:f:", long_opts,
+                        NULL)) != -1)
   {
     switch (c)
     {
@@ -87,6 +100,17 @@ int cmd_show(int argc, char *argv[]) {
       params.debug = 1;
       break;
 
+    case 'f':
+      if (!strcmp(optarg, "json")) {
+        params.format = CGPT_SHOW_FORMAT_JSON;
+      } else if (!strcmp(optarg, "tsv")) {
+        params.format = CGPT_SHOW_FORMAT_TSV;
+      } else {
+        Error("invalid argument to -%c: \"%s\"\n", c, optarg);
+        errorcnt++;
+      }
+      break;
+
     case 'h':
       Usage();
       return CGPT_OK;
@@ -103,6 +127,10 @@ int cmd_show(int argc, char *argv[]) {
       break;
     }
   }
+  if (params.format && params.single_item) {
+    Error("-f can't be used with a single item option\n");
+    errorcnt++;
+  }
   if (errorcnt)
   {
     Usage();
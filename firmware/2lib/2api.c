@@ -11,6 +11,7 @@
 #include "2common.h"
 #include "2misc.h"
 #include "2nvstorage.h"
+#include "2pipeline.h"
 #include "2secdata.h"
 #include "2sha.h"
 #include "2rsa.h"
@@ -34,12 +35,81 @@ void vb2api_fail(struct vb2_context *ctx, uint8_t reason, uint8_t subcode)
 	vb2_fail(ctx, reason, subcode);
 }
 
+int vb2api_init_read_cache(struct vb2_context *ctx, uint32_t size)
+{
+	struct vb2_shared_data *sd = vb2_get_sd(ctx);
+	struct vb2_workbuf wb;
+	uint8_t *cache;
+	int rv;
+
+	/* Initialize the vboot context if it hasn't been yet */
+	rv = vb2_init_context(ctx);
+	if (rv)
+		return rv;
+
+	/* Anything already in the work buffer would be below the cache */
+	if (ctx->workbuf_used != vb2_wb_round_up(sizeof(*sd)) ||
+	    sd->workbuf_read_cache_size)
+		return VB2_ERROR_API_READ_CACHE_INIT;
+
+	vb2_workbuf_from_ctx(ctx, &wb);
+	cache = vb2_workbuf_alloc(&wb, size);
+	if (!cache)
+		return VB2_ERROR_API_READ_CACHE_WORKBUF;
+
+	sd->workbuf_read_cache_offset = vb2_offset_of(ctx->workbuf, cache);
+	sd->workbuf_read_cache_size = size;
+	sd->read_cache_used = 0;
+
+	/* Cache persists in the work buffer for the rest of the boot */
+	vb2_set_workbuf_used(ctx, sd->workbuf_read_cache_offset + size);
+
+	return VB2_SUCCESS;
+}
+
+int vb2api_get_resume_state(struct vb2_context *ctx, void *buf, uint32_t size)
+{
+	struct vb2_shared_data *sd = vb2_get_sd(ctx);
+
+	if (size < sizeof(sd->resume))
+		return VB2_ERROR_API_RESUME_STATE_SIZE;
+
+	if (sd->resume.magic != VB2_RESUME_STATE_MAGIC ||
+	    sd->resume.flags != VB2_RESUME_ALL)
+		return VB2_ERROR_API_RESUME_STATE_INCOMPLETE;
+
+	memcpy(buf, &sd->resume, sizeof(sd->resume));
+	return VB2_SUCCESS;
+}
+
+int vb2api_set_resume_state(struct vb2_context *ctx, const void *buf,
+			    uint32_t size)
+{
+	struct vb2_shared_data *sd = vb2_get_sd(ctx);
+	const struct vb2_resume_state *rs = buf;
+
+	if (!(ctx->flags & VB2_CONTEXT_S3_RESUME))
+		return VB2_ERROR_API_RESUME_STATE_NOT_RESUME;
+
+	if (size < sizeof(*rs) ||
+	    rs->magic != VB2_RESUME_STATE_MAGIC ||
+	    rs->struct_version != VB2_RESUME_STATE_VERSION ||
+	    rs->flags != VB2_RESUME_ALL || rs->fw_slot > 1)
+		return VB2_ERROR_API_RESUME_STATE_INVALID;
+
+	memcpy(&sd->resume, rs, sizeof(*rs));
+	sd->status |= VB2_SD_STATUS_RESUME_STATE;
+	return VB2_SUCCESS;
+}
+
 int vb2api_fw_phase1(struct vb2_context *ctx)
 {
 	int rv;
 
 	/* Initialize the vboot context if it hasn't been yet */
 	vb2_init_context(ctx);
+	vb2_timestamp(ctx, VB2_TS_FW_PHASE1_ENTER);
+	vb2_workbuf_phase(ctx, VB2_WB_PHASE_FW1);
 
 	/* Initialize NV context */
 	vb2_nv_init(ctx);
@@ -104,6 +174,7 @@ int vb2api_fw_phase1(struct vb2_context *ctx)
 		return VB2_ERROR_API_PHASE1_RECOVERY;
 	}
 
+	vb2_timestamp(ctx, VB2_TS_FW_PHASE1_EXIT);
 	return VB2_SUCCESS;
 }
 
@@ -111,6 +182,9 @@ int vb2api_fw_phase2(struct vb2_context *ctx)
 {
 	int rv;
 
+	vb2_timestamp(ctx, VB2_TS_FW_PHASE2_ENTER);
+	vb2_workbuf_phase(ctx, VB2_WB_PHASE_FW2);
+
 	/*
 	 * Use the slot from the last boot if this is a resume.  Do not set
 	 * VB2_SD_STATUS_CHOSE_SLOT so the try counter is not decremented on
@@ -126,6 +200,7 @@ int vb2api_fw_phase2(struct vb2_context *ctx)
 		if (sd->fw_slot)
 			ctx->flags |= VB2_CONTEXT_FW_SLOT_B;
 
+		vb2_timestamp(ctx, VB2_TS_FW_PHASE2_EXIT);
 		return VB2_SUCCESS;
 	}
 
@@ -147,6 +222,7 @@ int vb2api_fw_phase2(struct vb2_context *ctx)
 		return rv;
 	}
 
+	vb2_timestamp(ctx, VB2_TS_FW_PHASE2_EXIT);
 	return VB2_SUCCESS;
 }
 
@@ -174,6 +250,57 @@ int vb2api_extend_hash(struct vb2_context *ctx,
 		return vb2_digest_extend(dc, buf, size);
 }
 
+int vb2api_hash_body_from_resource(struct vb2_context *ctx,
+				   uint8_t *buf,
+				   uint32_t buf_size)
+{
+	struct vb2_shared_data *sd = vb2_get_sd(ctx);
+	struct vb2_digest_context *dc = (struct vb2_digest_context *)
+		(ctx->workbuf + sd->workbuf_hash_offset);
+	struct vb2_pipeline_source src;
+	struct vb2_pipeline pipe;
+	const void *mapped;
+	int rv;
+
+	/* Must have initialized hash digest work area */
+	if (!sd->workbuf_hash_size)
+		return VB2_ERROR_API_EXTEND_HASH_WORKBUF;
+
+	if (!sd->hash_remaining_size)
+		return VB2_ERROR_API_EXTEND_HASH_SIZE;
+
+	/* If the body is mapped, hash it in place instead of copying it */
+	rv = vb2ex_map_resource(ctx, VB2_RES_FW_BODY, 0,
+				sd->hash_remaining_size, &mapped);
+	if (rv == VB2_SUCCESS) {
+		vb2_pipeline_source_memory(&src, mapped);
+		vb2_pipeline_init(&pipe, &src, VB2_HASH_BODY_CHUNK_SIZE, dc,
+				  (uint8_t *)mapped);
+	} else if (rv != VB2_ERROR_EX_MAP_RESOURCE_UNIMPLEMENTED) {
+		return rv;
+	} else {
+		vb2_pipeline_source_resource(&src, ctx, VB2_RES_FW_BODY, 0);
+		vb2_pipeline_init(&pipe, &src, VB2_HASH_BODY_CHUNK_SIZE, dc,
+				  buf);
+
+		/*
+		 * If the body doesn't fit, take turns reading into each half
+		 * of buf.
+		 */
+		if (buf_size < sd->hash_remaining_size) {
+			if (buf_size / 2 < pipe.chunk_size)
+				pipe.chunk_size = buf_size / 2;
+			if (!pipe.chunk_size)
+				return VB2_ERROR_API_HASH_BODY_BUF;
+			pipe.sink_size = buf_size;
+		}
+	}
+
+	rv = vb2_pipeline_run(&pipe, sd->hash_remaining_size);
+	sd->hash_remaining_size -= pipe.bytes_hashed;
+	return rv;
+}
+
 int vb2api_get_pcr_digest(struct vb2_context *ctx,
 			  enum vb2_pcr_digest which_digest,
 			  uint8_t *dest,
@@ -206,3 +333,20 @@ int vb2api_get_pcr_digest(struct vb2_context *ctx,
 
 	return VB2_SUCCESS;
 }
+
+int vb2api_extend_pcrs(struct vb2_context *ctx)
+{
+	struct vb2_pcr_extend pcrs[VB2_PCR_DIGEST_COUNT];
+	int i, rv;
+
+	for (i = 0; i < VB2_PCR_DIGEST_COUNT; i++) {
+		pcrs[i].pcr = i;
+		pcrs[i].digest_size = sizeof(pcrs[i].digest);
+		rv = vb2api_get_pcr_digest(ctx, i, pcrs[i].digest,
+					   &pcrs[i].digest_size);
+		if (rv)
+			return rv;
+	}
+
+	return vb2ex_tpm_extend_pcrs(ctx, pcrs, VB2_PCR_DIGEST_COUNT);
+}
@@ -11,11 +11,18 @@
 #include "2rsa.h"
 #include "2sha.h"
 
+#ifdef VB2_WORKBUF_STATS
+static uintptr_t workbuf_high_water;
+#endif
+
+/* A machine word, which may alias the bytes it's loaded from */
+typedef uintptr_t __attribute__((may_alias)) vb2_memcmp_word_t;
+
 int vb2_safe_memcmp(const void *s1, const void *s2, size_t size)
 {
 	const unsigned char *us1 = s1;
 	const unsigned char *us2 = s2;
-	int result = 0;
+	uintptr_t result = 0;
 
 	if (0 == size)
 		return 0;
@@ -23,7 +30,23 @@ int vb2_safe_memcmp(const void *s1, const void *s2, size_t size)
 	/*
 	 * Code snippet without data-dependent branch due to Nate Lawson
 	 * (nate@root.org) of Root Labs.
+	 *
+	 * If the buffers are equally aligned, the middle is compared a word at
+	 * a time. The branches depend only on the addresses and size, never on
+	 * the data.
 	 */
+	if (((uintptr_t)us1 ^ (uintptr_t)us2) % sizeof(uintptr_t) == 0) {
+		for (; size && (uintptr_t)us1 % sizeof(uintptr_t); size--)
+			result |= *us1++ ^ *us2++;
+
+		for (; size >= sizeof(uintptr_t); size -= sizeof(uintptr_t)) {
+			result |= *(const vb2_memcmp_word_t *)us1 ^
+				*(const vb2_memcmp_word_t *)us2;
+			us1 += sizeof(uintptr_t);
+			us2 += sizeof(uintptr_t);
+		}
+	}
+
 	while (size--)
 		result |= *us1++ ^ *us2++;
 
@@ -74,6 +97,11 @@ void *vb2_workbuf_alloc(struct vb2_workbuf *wb, uint32_t size)
 	wb->buf += size;
 	wb->size -= size;
 
+#ifdef VB2_WORKBUF_STATS
+	if ((uintptr_t)wb->buf > workbuf_high_water)
+		workbuf_high_water = (uintptr_t)wb->buf;
+#endif
+
 	return ptr;
 }
 
@@ -99,6 +127,18 @@ void vb2_workbuf_free(struct vb2_workbuf *wb, uint32_t size)
 	wb->size += size;
 }
 
+#ifdef VB2_WORKBUF_STATS
+uintptr_t vb2_workbuf_high_water(int reset)
+{
+	uintptr_t high = workbuf_high_water;
+
+	if (reset)
+		workbuf_high_water = 0;
+
+	return high;
+}
+#endif
+
 ptrdiff_t vb2_offset_of(const void *base, const void *ptr)
 {
 	return (uintptr_t)ptr - (uintptr_t)base;
@@ -0,0 +1,673 @@
+/* Copyright 2018 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ */
+
+/*
+ * Ed25519 signature verification, following RFC 8032.
+ *
+ * Field elements mod p = 2^255 - 19 are ten signed limbs of alternately 26
+ * and 25 bits, so limb products fit in 64 bits on 32-bit CPUs.  Points are in
+ * extended twisted Edwards coordinates.  Only public data goes through here,
+ * so nothing tries to run in constant time.
+ */
+
+#include "2sysincludes.h"
+#include "2common.h"
+#include "2ed25519.h"
+#include "2sha.h"
+
+/*
+ * Field element.  Limb i is at bit ceil(25.5 * i).  Carried elements have
+ * limbs within +/- 2^25; sums of a few of those are fine to multiply.
+ */
+typedef int32_t fe[10];
+
+/* Point (X:Y:Z:T), with x = X/Z, y = Y/Z and x * y = T/Z */
+struct ge {
+	fe x, y, z, t;
+};
+
+/* A point ready to be added: Y + X, Y - X, 2 * Z and 2 * d * T */
+struct ge_cached {
+	fe ypx, ymx, z2, t2d;
+};
+
+/*
+ * Scalars are multiplied using signed digits up to ED25519_WINDOW, with
+ * ED25519_WINDOW / 2 precomputed odd multiples of each point.
+ */
+#define ED25519_WINDOW_BITS 4
+#define ED25519_WINDOW (1 << ED25519_WINDOW_BITS)
+
+/* Curve constant d = -121665/121666, and 2 * d */
+static const uint8_t ed25519_d[32] = {
+	0xa3, 0x78, 0x59, 0x13, 0xca, 0x4d, 0xeb, 0x75,
+	0xab, 0xd8, 0x41, 0x41, 0x4d, 0x0a, 0x70, 0x00,
+	0x98, 0xe8, 0x79, 0x77, 0x79, 0x40, 0xc7, 0x8c,
+	0x73, 0xfe, 0x6f, 0x2b, 0xee, 0x6c, 0x03, 0x52,
+};
+
+static const uint8_t ed25519_d2[32] = {
+	0x59, 0xf1, 0xb2, 0x26, 0x94, 0x9b, 0xd6, 0xeb,
+	0x56, 0xb1, 0x83, 0x82, 0x9a, 0x14, 0xe0, 0x00,
+	0x30, 0xd1, 0xf3, 0xee, 0xf2, 0x80, 0x8e, 0x19,
+	0xe7, 0xfc, 0xdf, 0x56, 0xdc, 0xd9, 0x06, 0x24,
+};
+
+/* A square root of -1 */
+static const uint8_t ed25519_sqrtm1[32] = {
+	0xb0, 0xa0, 0x0e, 0x4a, 0x27, 0x1b, 0xee, 0xc4,
+	0x78, 0xe4, 0x2f, 0xad, 0x06, 0x18, 0x43, 0x2f,
+	0xa7, 0xd7, 0xfb, 0x3d, 0x99, 0x00, 0x4d, 0x2b,
+	0x0b, 0xdf, 0xc1, 0x4f, 0x80, 0x24, 0x83, 0x2b,
+};
+
+/* Base point coordinates */
+static const uint8_t ed25519_base_x[32] = {
+	0x1a, 0xd5, 0x25, 0x8f, 0x60, 0x2d, 0x56, 0xc9,
+	0xb2, 0xa7, 0x25, 0x95, 0x60, 0xc7, 0x2c, 0x69,
+	0x5c, 0xdc, 0xd6, 0xfd, 0x31, 0xe2, 0xa4, 0xc0,
+	0xfe, 0x53, 0x6e, 0xcd, 0xd3, 0x36, 0x69, 0x21,
+};
+
+static const uint8_t ed25519_base_y[32] = {
+	0x58, 0x66, 0x66, 0x66, 0x66, 0x66, 0x66, 0x66,
+	0x66, 0x66, 0x66, 0x66, 0x66, 0x66, 0x66, 0x66,
+	0x66, 0x66, 0x66, 0x66, 0x66, 0x66, 0x66, 0x66,
+	0x66, 0x66, 0x66, 0x66, 0x66, 0x66, 0x66, 0x66,
+};
+
+/* Group order L = 2^252 + 27742317777372353535851937790883648493 */
+static const int64_t ed25519_l[32] = {
+	0xed, 0xd3, 0xf5, 0x5c, 0x1a, 0x63, 0x12, 0x58,
+	0xd6, 0x9c, 0xf7, 0xa2, 0xde, 0xf9, 0xde, 0x14,
+	0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0x10,
+};
+
+static inline int limb_bits(int i)
+{
+	return (i & 1) ? 25 : 26;
+}
+
+/**
+ * Carry 64-bit limbs into a field element.
+ */
+static void fe_carry(fe h, int64_t *t)
+{
+	int64_t c;
+	int i;
+
+	for (i = 0; i < 10; i++) {
+		c = (t[i] + ((int64_t)1 << (limb_bits(i) - 1))) >> limb_bits(i);
+		t[i] -= c * ((int64_t)1 << limb_bits(i));
+		if (i < 9)
+			t[i + 1] += c;
+		else
+			t[0] += 19 * c;
+	}
+
+	/* Limb 0 picked up the wraparound, so it may need carrying again */
+	c = (t[0] + (1 << 25)) >> 26;
+	t[0] -= c * (1 << 26);
+	t[1] += c;
+
+	for (i = 0; i < 10; i++)
+		h[i] = (int32_t)t[i];
+}
+
+/**
+ * Carry a field element that's a sum of too many others.
+ */
+static void fe_reduce(fe h, const fe f)
+{
+	int64_t t[10];
+	int i;
+
+	for (i = 0; i < 10; i++)
+		t[i] = f[i];
+	fe_carry(h, t);
+}
+
+static void fe_frombytes(fe h, const uint8_t *s)
+{
+	uint64_t acc = 0;
+	int bits = 0;
+	int i;
+
+	/* The top bit of the last byte isn't part of the element */
+	for (i = 0; i < 10; i++) {
+		while (bits < limb_bits(i)) {
+			acc |= (uint64_t)*s++ << bits;
+			bits += 8;
+		}
+		h[i] = acc & ((1 << limb_bits(i)) - 1);
+		acc >>= limb_bits(i);
+		bits -= limb_bits(i);
+	}
+}
+
+/**
+ * Store a field element, fully reduced mod p.
+ */
+static void fe_tobytes(uint8_t *s, const fe f)
+{
+	int32_t h[10], t[10];
+	uint64_t acc = 0;
+	int32_t q;
+	int bits = 0;
+	int i;
+
+	/* Once carried, q = floor(h / p), which is -1, 0 or 1 */
+	fe_reduce(h, f);
+	q = (19 * h[9] + (1 << 24)) >> 25;
+	for (i = 0; i < 10; i++)
+		q = (h[i] + q) >> limb_bits(i);
+
+	/* h - q * p = h + 19 * q mod 2^255 */
+	for (i = 0; i < 10; i++)
+		t[i] = h[i];
+	t[0] += 19 * q;
+	for (i = 0; i < 9; i++) {
+		t[i + 1] += t[i] >> limb_bits(i);
+		t[i] &= (1 << limb_bits(i)) - 1;
+	}
+	t[9] &= (1 << 25) - 1;
+
+	for (i = 0; i < 10; i++) {
+		acc |= (uint64_t)t[i] << bits;
+		for (bits += limb_bits(i); bits >= 8; bits -= 8) {
+			*s++ = (uint8_t)acc;
+			acc >>= 8;
+		}
+	}
+	*s = (uint8_t)acc;
+}
+
+static void fe_set(fe h, int32_t n)
+{
+	memset(h, 0, sizeof(fe));
+	h[0] = n;
+}
+
+static void fe_add(fe h, const fe f, const fe g)
+{
+	int i;
+
+	for (i = 0; i < 10; i++)
+		h[i] = f[i] + g[i];
+}
+
+static void fe_sub(fe h, const fe f, const fe g)
+{
+	int i;
+
+	for (i = 0; i < 10; i++)
+		h[i] = f[i] - g[i];
+}
+
+static void fe_neg(fe h, const fe f)
+{
+	int i;
+
+	for (i = 0; i < 10; i++)
+		h[i] = -f[i];
+}
+
+static void fe_mul(fe h, const fe f, const fe g)
+{
+	int64_t t[19] = {0};
+	int64_t a, a2;
+	int i, j;
+
+	/*
+	 * Limbs i and j multiply to bit ceil(25.5 * i) + ceil(25.5 * j), which
+	 * is one more than limb i + j's if both are odd.
+	 */
+	for (i = 0; i < 10; i++) {
+		a = f[i];
+		a2 = (i & 1) ? 2 * a : a;
+		for (j = 0; j < 10; j += 2)
+			t[i + j] += a * g[j];
+		for (j = 1; j < 10; j += 2)
+			t[i + j] += a2 * g[j];
+	}
+
+	/* Products past 2^255 wrap around times 19 */
+	for (i = 0; i < 9; i++)
+		t[i] += 19 * t[i + 10];
+
+	fe_carry(h, t);
+}
+
+static void fe_sq(fe h, const fe f)
+{
+	int64_t t[19] = {0};
+	int64_t a, a2;
+	int i, j;
+
+	/* As fe_mul(), counting each product of two different limbs once */
+	for (i = 0; i < 10; i++) {
+		a = f[i];
+		a2 = (i & 1) ? 2 * a : a;
+		t[2 * i] += a2 * f[i];
+		for (j = i + 1; j < 10; j += 2)
+			t[i + j] += 2 * a * f[j];
+		for (j = i + 2; j < 10; j += 2)
+			t[i + j] += 2 * a2 * f[j];
+	}
+
+	for (i = 0; i < 9; i++)
+		t[i] += 19 * t[i + 10];
+
+	fe_carry(h, t);
+}
+
+static void fe_sqn(fe h, const fe f, int n)
+{
+	fe_sq(h, f);
+	while (--n)
+		fe_sq(h, h);
+}
+
+/**
+ * Raise z to 2^250 - 1, and also return z^11.  Both inversion and square
+ * roots start from these.
+ */
+static void fe_pow250(fe out, fe z11, const fe z)
+{
+	fe t0, t1, t2;
+
+	fe_sq(t0, z);
+	fe_sqn(t1, t0, 2);
+	fe_mul(t1, z, t1);		/* z^9 */
+	fe_mul(z11, t0, t1);
+	fe_sq(t0, z11);
+	fe_mul(t0, t1, t0);		/* z^(2^5 - 1) */
+	fe_sqn(t1, t0, 5);
+	fe_mul(t0, t1, t0);		/* z^(2^10 - 1) */
+	fe_sqn(t1, t0, 10);
+	fe_mul(t1, t1, t0);		/* z^(2^20 - 1) */
+	fe_sqn(t2, t1, 20);
+	fe_mul(t1, t2, t1);		/* z^(2^40 - 1) */
+	fe_sqn(t1, t1, 10);
+	fe_mul(t0, t1, t0);		/* z^(2^50 - 1) */
+	fe_sqn(t1, t0, 50);
+	fe_mul(t1, t1, t0);		/* z^(2^100 - 1) */
+	fe_sqn(t2, t1, 100);
+	fe_mul(t1, t2, t1);		/* z^(2^200 - 1) */
+	fe_sqn(t1, t1, 50);
+	fe_mul(out, t1, t0);		/* z^(2^250 - 1) */
+}
+
+/* out = z^(p - 2) = 1 / z */
+static void fe_invert(fe out, const fe z)
+{
+	fe t, z11;
+
+	fe_pow250(t, z11, z);
+	fe_sqn(t, t, 5);
+	fe_mul(out, t, z11);
+}
+
+/* out = z^((p - 5) / 8) */
+static void fe_pow22523(fe out, const fe z)
+{
+	fe t, z11;
+
+	fe_pow250(t, z11, z);
+	fe_sqn(t, t, 2);
+	fe_mul(out, t, z);
+}
+
+static int fe_equal(const fe f, const fe g)
+{
+	uint8_t s[32], t[32];
+
+	fe_tobytes(s, f);
+	fe_tobytes(t, g);
+	return !memcmp(s, t, sizeof(s));
+}
+
+static int fe_isnegative(const fe f)
+{
+	uint8_t s[32];
+
+	fe_tobytes(s, f);
+	return s[0] & 1;
+}
+
+/**
+ * Decode a point.
+ *
+ * @return 0 if success, non-zero if the encoding isn't of a point.
+ */
+static int ge_frombytes(struct ge *h, const uint8_t *s)
+{
+	uint8_t check[32];
+	fe u, v, v3, vxx;
+
+	fe_frombytes(h->y, s);
+
+	/* y must be fully reduced */
+	fe_tobytes(check, h->y);
+	check[31] |= s[31] & 0x80;
+	if (memcmp(check, s, sizeof(check)))
+		return 1;
+
+	/* x^2 = u / v, where u = y^2 - 1 and v = d * y^2 + 1 */
+	fe_set(h->z, 1);
+	fe_sq(u, h->y);
+	fe_frombytes(v, ed25519_d);
+	fe_mul(v, v, u);
+	fe_sub(u, u, h->z);
+	fe_add(v, v, h->z);
+
+	/* x = u * v^3 * (u * v^7)^((p - 5) / 8) */
+	fe_sq(v3, v);
+	fe_mul(v3, v3, v);
+	fe_sq(h->x, v3);
+	fe_mul(h->x, h->x, v);
+	fe_mul(h->x, h->x, u);
+	fe_pow22523(h->x, h->x);
+	fe_mul(h->x, h->x, v3);
+	fe_mul(h->x, h->x, u);
+
+	/* That's a square root of u / v, or of -u / v */
+	fe_sq(vxx, h->x);
+	fe_mul(vxx, vxx, v);
+	if (!fe_equal(vxx, u)) {
+		fe_neg(u, u);
+		if (!fe_equal(vxx, u))
+			return 1;
+		fe_frombytes(v, ed25519_sqrtm1);
+		fe_mul(h->x, h->x, v);
+	}
+
+	/* Pick the root with the right sign; x = 0 has only one */
+	if (fe_isnegative(h->x) != (s[31] >> 7)) {
+		fe_set(u, 0);
+		if (fe_equal(h->x, u))
+			return 1;
+		fe_neg(h->x, h->x);
+	}
+
+	fe_mul(h->t, h->x, h->y);
+	return 0;
+}
+
+static void ge_tobytes(uint8_t *s, const struct ge *h)
+{
+	fe zinv, x, y;
+
+	fe_invert(zinv, h->z);
+	fe_mul(x, h->x, zinv);
+	fe_mul(y, h->y, zinv);
+	fe_tobytes(s, y);
+	s[31] ^= fe_isnegative(x) << 7;
+}
+
+/**
+ * Convert a point to the form ge_add() wants.
+ */
+static void ge_to_cached(struct ge_cached *c, const struct ge *p)
+{
+	fe d2;
+
+	fe_add(c->ypx, p->y, p->x);
+	fe_sub(c->ymx, p->y, p->x);
+	fe_add(c->z2, p->z, p->z);
+	fe_frombytes(d2, ed25519_d2);
+	fe_mul(c->t2d, p->t, d2);
+}
+
+/**
+ * Add a point, or subtract it if neg is non-zero.  This is "add-2008-hwcd-3",
+ * which also works for doubling and the identity.
+ */
+static void ge_add(struct ge *r, const struct ge *p,
+		   const struct ge_cached *q, int neg)
+{
+	fe a, b, c, d, e, f, g, h;
+
+	/* -(x, y) = (-x, y), so subtracting swaps y + x and y - x */
+	fe_sub(a, p->y, p->x);
+	fe_mul(a, a, neg ? q->ypx : q->ymx);
+	fe_add(b, p->y, p->x);
+	fe_mul(b, b, neg ? q->ymx : q->ypx);
+	fe_mul(c, p->t, q->t2d);
+	if (neg)
+		fe_neg(c, c);
+	fe_mul(d, p->z, q->z2);
+	fe_sub(e, b, a);
+	fe_sub(f, d, c);
+	fe_add(g, d, c);
+	fe_add(h, b, a);
+	fe_mul(r->x, e, f);
+	fe_mul(r->y, g, h);
+	fe_mul(r->t, e, h);
+	fe_mul(r->z, f, g);
+}
+
+/**
+ * Double a point.  This is "dbl-2008-hwcd" with a = -1, which doesn't need
+ * the input's T.
+ */
+static void ge_dbl(struct ge *r, const struct ge *p)
+{
+	fe a, b, c, e, f, g, h;
+
+	fe_sq(a, p->x);
+	fe_sq(b, p->y);
+	fe_sq(c, p->z);
+	fe_add(c, c, c);
+	fe_add(e, p->x, p->y);
+	fe_sq(e, e);
+	fe_add(h, a, b);
+	fe_sub(e, e, h);
+	fe_sub(g, b, a);
+	fe_sub(f, g, c);
+	fe_reduce(f, f);
+	fe_neg(h, h);
+	fe_mul(r->x, e, f);
+	fe_mul(r->y, g, h);
+	fe_mul(r->t, e, h);
+	fe_mul(r->z, f, g);
+}
+
+/**
+ * Recode a scalar into signed digits r[i], each zero or odd and under
+ * ED25519_WINDOW in size, with sum(r[i] * 2^i) equal to the scalar.  Nonzero
+ * digits are spread out, so few additions are needed.
+ */
+static void sc_slide(int8_t *r, const uint8_t *a)
+{
+	int i, b, k;
+
+	for (i = 0; i < 256; i++)
+		r[i] = (a[i >> 3] >> (i & 7)) & 1;
+
+	for (i = 0; i < 256; i++) {
+		if (!r[i])
+			continue;
+		for (b = 1; b < ED25519_WINDOW_BITS && i + b < 256; b++) {
+			if (!r[i + b])
+				continue;
+			if (r[i] + (r[i + b] << b) < ED25519_WINDOW) {
+				r[i] += r[i + b] << b;
+				r[i + b] = 0;
+			} else if (r[i] - (r[i + b] << b) > -ED25519_WINDOW) {
+				r[i] -= r[i + b] << b;
+				for (k = i + b; k < 256; k++) {
+					if (!r[k]) {
+						r[k] = 1;
+						break;
+					}
+					r[k] = 0;
+				}
+			} else {
+				break;
+			}
+		}
+	}
+}
+
+/**
+ * Fill a table with p, 3p, 5p, ...
+ */
+static void ge_odd_multiples(struct ge_cached *table, const struct ge *p)
+{
+	struct ge p2, t;
+	struct ge_cached p2c;
+	int i;
+
+	ge_dbl(&p2, p);
+	ge_to_cached(&p2c, &p2);
+	ge_to_cached(&table[0], p);
+	t = *p;
+	for (i = 1; i < ED25519_WINDOW / 2; i++) {
+		ge_add(&t, &t, &p2c, 0);
+		ge_to_cached(&table[i], &t);
+	}
+}
+
+static void ge_add_digit(struct ge *r, const struct ge_cached *table, int d)
+{
+	if (d > 0)
+		ge_add(r, r, &table[d / 2], 0);
+	else if (d < 0)
+		ge_add(r, r, &table[-d / 2], 1);
+}
+
+/**
+ * Compute r = a * p + b * q.
+ */
+static void ge_double_scalarmult(struct ge *r,
+				 const uint8_t *a, const struct ge *p,
+				 const uint8_t *b, const struct ge *q)
+{
+	struct ge_cached ptable[ED25519_WINDOW / 2];
+	struct ge_cached qtable[ED25519_WINDOW / 2];
+	int8_t aslide[256], bslide[256];
+	int i;
+
+	sc_slide(aslide, a);
+	sc_slide(bslide, b);
+	ge_odd_multiples(ptable, p);
+	ge_odd_multiples(qtable, q);
+
+	fe_set(r->x, 0);
+	fe_set(r->y, 1);
+	fe_set(r->z, 1);
+	fe_set(r->t, 0);
+
+	/* Skip leading zeroes; reduced scalars are under 2^253 */
+	for (i = 255; i >= 0; i--) {
+		if (aslide[i] || bslide[i])
+			break;
+	}
+
+	for (; i >= 0; i--) {
+		ge_dbl(r, r);
+		ge_add_digit(r, ptable, aslide[i]);
+		ge_add_digit(r, qtable, bslide[i]);
+	}
+}
+
+/**
+ * Reduce a 512-bit little-endian number mod L.
+ */
+static void sc_reduce(uint8_t *r, const uint8_t *s)
+{
+	int64_t x[64];
+	int64_t carry;
+	int i, j;
+
+	for (i = 0; i < 64; i++)
+		x[i] = s[i];
+
+	/* Fold the top bytes down, using 2^252 = L - (L - 2^252) */
+	for (i = 63; i >= 32; i--) {
+		carry = 0;
+		for (j = i - 32; j < i - 12; j++) {
+			x[j] += carry - 16 * x[i] * ed25519_l[j - (i - 32)];
+			carry = (x[j] + 128) >> 8;
+			x[j] -= carry * 256;
+		}
+		x[j] += carry;
+		x[i] = 0;
+	}
+
+	carry = 0;
+	for (j = 0; j < 32; j++) {
+		x[j] += carry - (x[31] >> 4) * ed25519_l[j];
+		carry = x[j] >> 8;
+		x[j] &= 255;
+	}
+	for (j = 0; j < 32; j++)
+		x[j] -= carry * ed25519_l[j];
+
+	for (i = 0; i < 32; i++) {
+		x[i + 1] += x[i] >> 8;
+		r[i] = x[i] & 255;
+	}
+}
+
+/**
+ * Check that a scalar is less than L, so signatures can't be malleated.
+ */
+static int sc_is_canonical(const uint8_t *s)
+{
+	int i;
+
+	for (i = 31; i >= 0; i--) {
+		if (s[i] != ed25519_l[i])
+			return s[i] < ed25519_l[i];
+	}
+	return 0;
+}
+
+int vb2_ed25519_verify(const uint8_t *pubkey,
+		       const uint8_t *sig,
+		       const uint8_t *msg,
+		       uint32_t msg_size)
+{
+	struct vb2_sha512_context ctx;
+	uint8_t digest[VB2_SHA512_DIGEST_SIZE];
+	uint8_t h[32], check[32];
+	struct ge a, b, r;
+
+	if (!pubkey || !sig || (!msg && msg_size))
+		return VB2_ERROR_ED25519_VERIFY_PARAM;
+
+	if (!sc_is_canonical(sig + 32))
+		return VB2_ERROR_ED25519_VERIFY_SCALAR;
+
+	if (ge_frombytes(&a, pubkey))
+		return VB2_ERROR_ED25519_VERIFY_KEY;
+
+	/* h = SHA-512(R || A || M) mod L */
+	vb2_sha512_init(&ctx);
+	vb2_sha512_update(&ctx, sig, 32);
+	vb2_sha512_update(&ctx, pubkey, VB2_ED25519_KEY_BYTES);
+	vb2_sha512_update(&ctx, msg, msg_size);
+	vb2_sha512_finalize(&ctx, digest);
+	sc_reduce(h, digest);
+
+	/* The signature is good if R = S * B - h * A */
+	fe_frombytes(b.x, ed25519_base_x);
+	fe_frombytes(b.y, ed25519_base_y);
+	fe_set(b.z, 1);
+	fe_mul(b.t, b.x, b.y);
+	fe_neg(a.x, a.x);
+	fe_neg(a.t, a.t);
+
+	ge_double_scalarmult(&r, sig + 32, &b, h, &a);
+	ge_tobytes(check, &r);
+
+	if (vb2_safe_memcmp(check, sig, sizeof(check)))
+		return VB2_ERROR_ED25519_VERIFY_SIG;
+
+	return VB2_SUCCESS;
+}
@@ -36,12 +36,73 @@ void vb2_set_workbuf_used(struct vb2_context *ctx, uint32_t used)
 	ctx->workbuf_used = vb2_wb_round_up(used);
 }
 
+/* Cached read, followed in the cache by its data */
+struct vb2_read_cache_entry {
+	/* Resource index, plus VB2_READ_CACHE_SLOT_B if from slot B */
+	uint32_t key;
+	uint32_t offset;
+	uint32_t size;
+} __attribute__((packed));
+
+#define VB2_READ_CACHE_SLOT_B 0x80000000
+
+int vb2_read_resource(struct vb2_context *ctx,
+		      enum vb2_resource_index index,
+		      uint32_t offset,
+		      void *buf,
+		      uint32_t size)
+{
+	struct vb2_shared_data *sd = vb2_get_sd(ctx);
+	uint8_t *cache = ctx->workbuf + sd->workbuf_read_cache_offset;
+	struct vb2_read_cache_entry e;
+	uint32_t key = index;
+	uint32_t pos, need;
+	int rv;
+
+	/* Kernel vblocks may change between reads */
+	if (!sd->workbuf_read_cache_size || index == VB2_RES_KERNEL_VBLOCK)
+		return vb2ex_read_resource(ctx, index, offset, buf, size);
+
+	/* Each slot has its own firmware vblock */
+	if (index == VB2_RES_FW_VBLOCK && (ctx->flags & VB2_CONTEXT_FW_SLOT_B))
+		key |= VB2_READ_CACHE_SLOT_B;
+
+	for (pos = 0; pos < sd->read_cache_used;
+	     pos += vb2_wb_round_up(sizeof(e) + e.size)) {
+		memcpy(&e, cache + pos, sizeof(e));
+		if (e.key != key || offset < e.offset || size > e.size ||
+		    offset - e.offset > e.size - size)
+			continue;
+
+		memcpy(buf, cache + pos + sizeof(e) + offset - e.offset, size);
+		return VB2_SUCCESS;
+	}
+
+	rv = vb2ex_read_resource(ctx, index, offset, buf, size);
+	if (rv)
+		return rv;
+
+	/* Add the data to the cache if there's room */
+	need = vb2_wb_round_up(sizeof(e) + size);
+	if (need >= sizeof(e) &&
+	    need <= sd->workbuf_read_cache_size - sd->read_cache_used) {
+		e.key = key;
+		e.offset = offset;
+		e.size = size;
+		memcpy(cache + sd->read_cache_used, &e, sizeof(e));
+		memcpy(cache + sd->read_cache_used + sizeof(e), buf, size);
+		sd->read_cache_used += need;
+	}
+
+	return VB2_SUCCESS;
+}
+
 int vb2_read_gbb_header(struct vb2_context *ctx, struct vb2_gbb_header *gbb)
 {
 	int rv;
 
 	/* Read the entire header */
-	rv = vb2ex_read_resource(ctx, VB2_RES_GBB, 0, gbb, sizeof(*gbb));
+	rv = vb2_read_resource(ctx, VB2_RES_GBB, 0, gbb, sizeof(*gbb));
 	if (rv)
 		return rv;
 
@@ -141,6 +202,62 @@ int vb2_init_context(struct vb2_context *ctx)
 	return VB2_SUCCESS;
 }
 
+#ifdef VB2_TIMESTAMPS
+void vb2_timestamp(struct vb2_context *ctx, enum vb2_timestamp_event event)
+{
+	struct vb2_shared_data *sd = vb2_get_sd(ctx);
+	struct vb2_timestamp *ts;
+
+	/* Nowhere to put it if the context isn't initialized */
+	if (!ctx->workbuf_used)
+		return;
+
+	ts = sd->timestamps + (sd->timestamp_count & (VB2_MAX_TIMESTAMPS - 1));
+	ts->time_ms = vb2ex_mtime();
+	ts->event = event;
+	sd->timestamp_count++;
+}
+#endif
+
+#ifdef VB2_WORKBUF_STATS
+void vb2_workbuf_phase(struct vb2_context *ctx, enum vb2_workbuf_phase phase)
+{
+	struct vb2_shared_data *sd = vb2_get_sd(ctx);
+	uintptr_t start = (uintptr_t)ctx->workbuf;
+	uintptr_t high = vb2_workbuf_high_water(1);
+	uint32_t used = ctx->workbuf_used;
+
+	/* Nowhere to put it if the context isn't initialized */
+	if (!ctx->workbuf_used)
+		return;
+
+	/* Ignore allocations from buffers other than the context's */
+	if (high > start && high <= start + ctx->workbuf_size &&
+	    high - start > used)
+		used = high - start;
+
+	if (sd->workbuf_phase < VB2_WB_PHASE_COUNT &&
+	    used > sd->workbuf_peak[sd->workbuf_phase])
+		sd->workbuf_peak[sd->workbuf_phase] = used;
+
+	sd->workbuf_phase = phase;
+}
+
+uint32_t vb2_workbuf_peak(struct vb2_context *ctx,
+			  enum vb2_workbuf_phase phase)
+{
+	struct vb2_shared_data *sd = vb2_get_sd(ctx);
+
+	if (!ctx->workbuf_used || phase >= VB2_WB_PHASE_COUNT)
+		return 0;
+
+	/* Fold in anything used by the current phase so far */
+	vb2_workbuf_phase(ctx, sd->workbuf_phase);
+
+	return sd->workbuf_peak[phase];
+}
+#endif
+
 void vb2_check_recovery(struct vb2_context *ctx)
 {
 	struct vb2_shared_data *sd = vb2_get_sd(ctx);
@@ -357,6 +474,82 @@ int vb2_check_tpm_clear(struct vb2_context *ctx)
 	return VB2_SUCCESS;
 }
 
+void vb2_read_vblock_ahead(struct vb2_context *ctx, struct vb2_workbuf *wb)
+{
+	struct vb2_shared_data *sd = vb2_get_sd(ctx);
+	const uint32_t size = VB2_VBLOCK_READ_AHEAD;
+	uint8_t *buf;
+
+	sd->workbuf_vblock_ahead_size = 0;
+
+	/* Leave room to verify the keyblock */
+	if (!size || wb->size < vb2_wb_round_up(size) +
+	    VB2_KEY_BLOCK_VERIFY_WORKBUF_BYTES)
+		return;
+
+	buf = vb2_workbuf_alloc(wb, size);
+	if (!buf)
+		return;
+
+	if (vb2_read_resource(ctx, VB2_RES_FW_VBLOCK, 0, buf, size)) {
+		VB2_DEBUG("Can't read ahead %u bytes of vblock\n", size);
+		vb2_workbuf_free(wb, size);
+		return;
+	}
+
+	sd->workbuf_vblock_ahead_offset = vb2_offset_of(ctx->workbuf, buf);
+	sd->workbuf_vblock_ahead_size = size;
+}
+
+int vb2_read_vblock(struct vb2_context *ctx, uint32_t offset, void *buf,
+		    uint32_t size)
+{
+	struct vb2_shared_data *sd = vb2_get_sd(ctx);
+	uint32_t copied = 0;
+
+	if (offset < sd->workbuf_vblock_ahead_size) {
+		copied = sd->workbuf_vblock_ahead_size - offset;
+		if (copied > size)
+			copied = size;
+		memmove(buf, ctx->workbuf + sd->workbuf_vblock_ahead_offset +
+			offset, copied);
+	}
+
+	if (copied == size)
+		return VB2_SUCCESS;
+
+	return vb2_read_resource(ctx, VB2_RES_FW_VBLOCK, offset + copied,
+				 (uint8_t *)buf + copied, size - copied);
+}
+
+int vb2_resume_digest(struct vb2_context *ctx, uint32_t flag,
+		      const uint8_t *digest, uint8_t *recorded, uint32_t size)
+{
+	struct vb2_shared_data *sd = vb2_get_sd(ctx);
+	struct vb2_resume_state *rs = &sd->resume;
+	int unchanged = 0;
+
+	if ((sd->status & VB2_SD_STATUS_RESUME_STATE) &&
+	    (rs->flags & flag) && rs->fw_slot == sd->fw_slot &&
+	    !vb2_safe_memcmp(digest, recorded, size))
+		unchanged = 1;
+
+	/*
+	 * Once anything has changed, what follows it in the vblock must be
+	 * verified too, even if it still matches.
+	 */
+	if (!unchanged)
+		sd->status &= ~VB2_SD_STATUS_RESUME_STATE;
+
+	rs->magic = VB2_RESUME_STATE_MAGIC;
+	rs->struct_version = VB2_RESUME_STATE_VERSION;
+	rs->fw_slot = sd->fw_slot;
+	rs->flags &= ~flag;
+	memcpy(recorded, digest, size);
+
+	return unchanged;
+}
+
 int vb2_select_fw_slot(struct vb2_context *ctx)
 {
 	struct vb2_shared_data *sd = vb2_get_sd(ctx);
@@ -96,338 +96,243 @@ void vb2_nv_init(struct vb2_context *ctx)
 		sd->status |= VB2_SD_STATUS_NV_INIT;
 }
 
-/* Macro for vb2_nv_get() single-bit settings to reduce duplicate code. */
-#define GETBIT(offs, mask) (p[offs] & mask ? 1 : 0)
+/* Flags for struct vb2_nv_field */
+enum vb2_nv_field_flags {
+	/* Single-bit flag; reads as 0 or 1, and any non-zero value sets it */
+	VB2_NV_FIELD_BOOL = (1 << 0),
 
-uint32_t vb2_nv_get(struct vb2_context *ctx, enum vb2_nv_param param)
-{
-	const uint8_t *p = ctx->nvdata;
-
-	/*
-	 * TODO: We could reduce the binary size for this code by #ifdef'ing
-	 * out the params not used by firmware verification.
-	 */
-	switch (param) {
-	case VB2_NV_FIRMWARE_SETTINGS_RESET:
-		return GETBIT(VB2_NV_OFFS_HEADER,
-			      VB2_NV_HEADER_FW_SETTINGS_RESET);
-
-	case VB2_NV_KERNEL_SETTINGS_RESET:
-		return GETBIT(VB2_NV_OFFS_HEADER,
-			      VB2_NV_HEADER_KERNEL_SETTINGS_RESET);
-
-	case VB2_NV_DEBUG_RESET_MODE:
-		return GETBIT(VB2_NV_OFFS_BOOT, VB2_NV_BOOT_DEBUG_RESET);
-
-	case VB2_NV_TRY_NEXT:
-		return GETBIT(VB2_NV_OFFS_BOOT2, VB2_NV_BOOT2_TRY_NEXT);
-
-	case VB2_NV_TRY_COUNT:
-		return p[VB2_NV_OFFS_BOOT] & VB2_NV_BOOT_TRY_COUNT_MASK;
-
-	case VB2_NV_FW_TRIED:
-		return GETBIT(VB2_NV_OFFS_BOOT2, VB2_NV_BOOT2_TRIED);
-
-	case VB2_NV_FW_RESULT:
-		return p[VB2_NV_OFFS_BOOT2] & VB2_NV_BOOT2_RESULT_MASK;
-
-	case VB2_NV_FW_PREV_TRIED:
-		return GETBIT(VB2_NV_OFFS_BOOT2, VB2_NV_BOOT2_PREV_TRIED);
-
-	case VB2_NV_FW_PREV_RESULT:
-		return (p[VB2_NV_OFFS_BOOT2] & VB2_NV_BOOT2_PREV_RESULT_MASK)
-			>> VB2_NV_BOOT2_PREV_RESULT_SHIFT;
-
-	case VB2_NV_RECOVERY_REQUEST:
-		return p[VB2_NV_OFFS_RECOVERY];
-
-	case VB2_NV_RECOVERY_SUBCODE:
-		return p[VB2_NV_OFFS_RECOVERY_SUBCODE];
-
-	case VB2_NV_LOCALIZATION_INDEX:
-		return p[VB2_NV_OFFS_LOCALIZATION];
-
-	case VB2_NV_KERNEL_FIELD:
-		return p[VB2_NV_OFFS_KERNEL1] | (p[VB2_NV_OFFS_KERNEL2] << 8);
+	/* Clip values above the field maximum to the maximum */
+	VB2_NV_FIELD_CLIP = (1 << 1),
 
-	case VB2_NV_DEV_BOOT_USB:
-		return GETBIT(VB2_NV_OFFS_DEV, VB2_NV_DEV_FLAG_USB);
+	/* Drop bits of the value which don't fit in the field */
+	VB2_NV_FIELD_TRUNCATE = (1 << 2),
 
-	case VB2_NV_DEV_BOOT_LEGACY:
-		return GETBIT(VB2_NV_OFFS_DEV, VB2_NV_DEV_FLAG_LEGACY);
+	/* Field is only present in V2 records */
+	VB2_NV_FIELD_V2 = (1 << 3),
+};
 
-	case VB2_NV_DEV_BOOT_SIGNED_ONLY:
-		return GETBIT(VB2_NV_OFFS_DEV, VB2_NV_DEV_FLAG_SIGNED_ONLY);
+/* Layout of a parameter in the non-volatile storage data */
+struct vb2_nv_field {
+	/* Offsets of the bytes holding the field, least significant first */
+	uint8_t offs[4];
 
-	case VB2_NV_DEV_BOOT_FASTBOOT_FULL_CAP:
-		return GETBIT(VB2_NV_OFFS_DEV,
-			      VB2_NV_DEV_FLAG_FASTBOOT_FULL_CAP);
+	/* Number of bytes in offs[]; 0 if the parameter is unknown */
+	uint8_t bytes;
 
-	case VB2_NV_DEV_DEFAULT_BOOT:
-		return (p[VB2_NV_OFFS_DEV] & VB2_NV_DEV_FLAG_DEFAULT_BOOT)
-			>> VB2_NV_DEV_DEFAULT_BOOT_SHIFT;
+	/* Mask and shift of the field within its byte, if bytes == 1 */
+	uint8_t mask;
+	uint8_t shift;
 
-	case VB2_NV_DEV_ENABLE_UDC:
-		return GETBIT(VB2_NV_OFFS_DEV, VB2_NV_DEV_FLAG_UDC);
+	/* Flags (enum vb2_nv_field_flags) */
+	uint8_t flags;
 
-	case VB2_NV_DISABLE_DEV_REQUEST:
-		return GETBIT(VB2_NV_OFFS_BOOT, VB2_NV_BOOT_DISABLE_DEV);
-
-	case VB2_NV_OPROM_NEEDED:
-		return GETBIT(VB2_NV_OFFS_BOOT, VB2_NV_BOOT_OPROM_NEEDED);
-
-	case VB2_NV_BACKUP_NVRAM_REQUEST:
-		return GETBIT(VB2_NV_OFFS_BOOT, VB2_NV_BOOT_BACKUP_NVRAM);
-
-	case VB2_NV_CLEAR_TPM_OWNER_REQUEST:
-		return GETBIT(VB2_NV_OFFS_TPM, VB2_NV_TPM_CLEAR_OWNER_REQUEST);
-
-	case VB2_NV_CLEAR_TPM_OWNER_DONE:
-		return GETBIT(VB2_NV_OFFS_TPM, VB2_NV_TPM_CLEAR_OWNER_DONE);
+	/*
+	 * Value stored in place of values above the field maximum, unless
+	 * VB2_NV_FIELD_CLIP or VB2_NV_FIELD_TRUNCATE is set.
+	 */
+	uint8_t invalid;
+};
+
+#define NV_BIT(offs, mask) \
+	{ {offs}, 1, mask, 0, VB2_NV_FIELD_BOOL, 0 }
+#define NV_BITS(offs, mask, shift, flags, invalid) \
+	{ {offs}, 1, mask, shift, flags, invalid }
+#define NV_BYTES(flags, ...) \
+	{ {__VA_ARGS__}, sizeof((uint8_t[]){__VA_ARGS__}), 0xff, 0, flags, 0 }
+
+/*
+ * Where each parameter lives.  Shared by vb2_nv_get() and vb2_nv_set(), so a
+ * new param only needs an entry here.
+ */
+static const struct vb2_nv_field vb2_nv_fields[] = {
+	[VB2_NV_FIRMWARE_SETTINGS_RESET] =
+		NV_BIT(VB2_NV_OFFS_HEADER, VB2_NV_HEADER_FW_SETTINGS_RESET),
+	[VB2_NV_KERNEL_SETTINGS_RESET] =
+		NV_BIT(VB2_NV_OFFS_HEADER,
+		       VB2_NV_HEADER_KERNEL_SETTINGS_RESET),
+	[VB2_NV_DEBUG_RESET_MODE] =
+		NV_BIT(VB2_NV_OFFS_BOOT, VB2_NV_BOOT_DEBUG_RESET),
+	[VB2_NV_TRY_NEXT] =
+		NV_BIT(VB2_NV_OFFS_BOOT2, VB2_NV_BOOT2_TRY_NEXT),
+	[VB2_NV_TRY_COUNT] =
+		NV_BITS(VB2_NV_OFFS_BOOT, VB2_NV_BOOT_TRY_COUNT_MASK, 0,
+			VB2_NV_FIELD_CLIP, 0),
+	[VB2_NV_RECOVERY_REQUEST] =
+		/*
+		 * Map values outside the valid range to the legacy reason,
+		 * since we can't determine if we're called from kernel or
+		 * user mode.
+		 */
+		NV_BITS(VB2_NV_OFFS_RECOVERY, 0xff, 0, 0,
+			VB2_RECOVERY_LEGACY),
+	[VB2_NV_LOCALIZATION_INDEX] =
+		/* Map values outside the valid range to the default index */
+		NV_BITS(VB2_NV_OFFS_LOCALIZATION, 0xff, 0, 0, 0),
+	[VB2_NV_KERNEL_FIELD] =
+		NV_BYTES(0, VB2_NV_OFFS_KERNEL1, VB2_NV_OFFS_KERNEL2),
+	[VB2_NV_DEV_BOOT_USB] =
+		NV_BIT(VB2_NV_OFFS_DEV, VB2_NV_DEV_FLAG_USB),
+	[VB2_NV_DEV_BOOT_LEGACY] =
+		NV_BIT(VB2_NV_OFFS_DEV, VB2_NV_DEV_FLAG_LEGACY),
+	[VB2_NV_DEV_BOOT_SIGNED_ONLY] =
+		NV_BIT(VB2_NV_OFFS_DEV, VB2_NV_DEV_FLAG_SIGNED_ONLY),
+	[VB2_NV_DEV_BOOT_FASTBOOT_FULL_CAP] =
+		NV_BIT(VB2_NV_OFFS_DEV, VB2_NV_DEV_FLAG_FASTBOOT_FULL_CAP),
+	[VB2_NV_DEV_DEFAULT_BOOT] =
+		NV_BITS(VB2_NV_OFFS_DEV, VB2_NV_DEV_FLAG_DEFAULT_BOOT,
+			VB2_NV_DEV_DEFAULT_BOOT_SHIFT, 0,
+			VB2_DEV_DEFAULT_BOOT_DISK),
+	[VB2_NV_DEV_ENABLE_UDC] =
+		NV_BIT(VB2_NV_OFFS_DEV, VB2_NV_DEV_FLAG_UDC),
+	[VB2_NV_DISABLE_DEV_REQUEST] =
+		NV_BIT(VB2_NV_OFFS_BOOT, VB2_NV_BOOT_DISABLE_DEV),
+	[VB2_NV_OPROM_NEEDED] =
+		NV_BIT(VB2_NV_OFFS_BOOT, VB2_NV_BOOT_OPROM_NEEDED),
+	[VB2_NV_CLEAR_TPM_OWNER_REQUEST] =
+		NV_BIT(VB2_NV_OFFS_TPM, VB2_NV_TPM_CLEAR_OWNER_REQUEST),
+	[VB2_NV_CLEAR_TPM_OWNER_DONE] =
+		NV_BIT(VB2_NV_OFFS_TPM, VB2_NV_TPM_CLEAR_OWNER_DONE),
+	[VB2_NV_TPM_REQUESTED_REBOOT] =
+		NV_BIT(VB2_NV_OFFS_TPM, VB2_NV_TPM_REBOOTED),
+	[VB2_NV_RECOVERY_SUBCODE] =
+		NV_BITS(VB2_NV_OFFS_RECOVERY_SUBCODE, 0xff, 0,
+			VB2_NV_FIELD_TRUNCATE, 0),
+	[VB2_NV_BACKUP_NVRAM_REQUEST] =
+		NV_BIT(VB2_NV_OFFS_BOOT, VB2_NV_BOOT_BACKUP_NVRAM),
+	[VB2_NV_FW_TRIED] =
+		NV_BIT(VB2_NV_OFFS_BOOT2, VB2_NV_BOOT2_TRIED),
+	[VB2_NV_FW_RESULT] =
+		/* Map out of range values to unknown */
+		NV_BITS(VB2_NV_OFFS_BOOT2, VB2_NV_BOOT2_RESULT_MASK, 0, 0,
+			VB2_FW_RESULT_UNKNOWN),
+	[VB2_NV_FW_PREV_TRIED] =
+		NV_BIT(VB2_NV_OFFS_BOOT2, VB2_NV_BOOT2_PREV_TRIED),
+	[VB2_NV_FW_PREV_RESULT] =
+		NV_BITS(VB2_NV_OFFS_BOOT2, VB2_NV_BOOT2_PREV_RESULT_MASK,
+			VB2_NV_BOOT2_PREV_RESULT_SHIFT, 0,
+			VB2_FW_RESULT_UNKNOWN),
+	[VB2_NV_REQ_WIPEOUT] =
+		NV_BIT(VB2_NV_OFFS_HEADER, VB2_NV_HEADER_WIPEOUT),
+	[VB2_NV_FASTBOOT_UNLOCK_IN_FW] =
+		NV_BIT(VB2_NV_OFFS_MISC, VB2_NV_MISC_UNLOCK_FASTBOOT),
+	[VB2_NV_BOOT_ON_AC_DETECT] =
+		NV_BIT(VB2_NV_OFFS_MISC, VB2_NV_MISC_BOOT_ON_AC_DETECT),
+	[VB2_NV_TRY_RO_SYNC] =
+		NV_BIT(VB2_NV_OFFS_MISC, VB2_NV_MISC_TRY_RO_SYNC),
+	[VB2_NV_BATTERY_CUTOFF_REQUEST] =
+		NV_BIT(VB2_NV_OFFS_MISC, VB2_NV_MISC_BATTERY_CUTOFF),
+	[VB2_NV_KERNEL_MAX_ROLLFORWARD] =
+		NV_BYTES(0,
+			 VB2_NV_OFFS_KERNEL_MAX_ROLLFORWARD1,
+			 VB2_NV_OFFS_KERNEL_MAX_ROLLFORWARD2,
+			 VB2_NV_OFFS_KERNEL_MAX_ROLLFORWARD3,
+			 VB2_NV_OFFS_KERNEL_MAX_ROLLFORWARD4),
+	[VB2_NV_FW_MAX_ROLLFORWARD] =
+		NV_BYTES(VB2_NV_FIELD_V2,
+			 VB2_NV_OFFS_FW_MAX_ROLLFORWARD1,
+			 VB2_NV_OFFS_FW_MAX_ROLLFORWARD2,
+			 VB2_NV_OFFS_FW_MAX_ROLLFORWARD3,
+			 VB2_NV_OFFS_FW_MAX_ROLLFORWARD4),
+	[VB2_NV_KERNEL_HINT_PART] =
+		NV_BITS(VB2_NV_OFFS_KERNEL_HINT_PART, 0xff, 0,
+			VB2_NV_FIELD_V2, 0),
+	[VB2_NV_KERNEL_HINT_GPT_CRC] =
+		NV_BYTES(VB2_NV_FIELD_V2,
+			 VB2_NV_OFFS_KERNEL_HINT_CRC1,
+			 VB2_NV_OFFS_KERNEL_HINT_CRC2,
+			 VB2_NV_OFFS_KERNEL_HINT_CRC3,
+			 VB2_NV_OFFS_KERNEL_HINT_CRC4),
+};
+
+#undef NV_BIT
+#undef NV_BITS
+#undef NV_BYTES
 
-	case VB2_NV_TPM_REQUESTED_REBOOT:
-		return GETBIT(VB2_NV_OFFS_TPM, VB2_NV_TPM_REBOOTED);
+/**
+ * Return the layout of a param, or NULL if it is unknown.
+ */
+static const struct vb2_nv_field *vb2_nv_field(enum vb2_nv_param param)
+{
+	if (param >= ARRAY_SIZE(vb2_nv_fields) || !vb2_nv_fields[param].bytes)
+		return NULL;
 
-	case VB2_NV_REQ_WIPEOUT:
-		return GETBIT(VB2_NV_OFFS_HEADER , VB2_NV_HEADER_WIPEOUT);
+	return vb2_nv_fields + param;
+}
 
-	case VB2_NV_FASTBOOT_UNLOCK_IN_FW:
-		return GETBIT(VB2_NV_OFFS_MISC, VB2_NV_MISC_UNLOCK_FASTBOOT);
+/**
+ * Check whether a param is missing from the context's record version.
+ */
+static int vb2_nv_field_missing(const struct vb2_context *ctx,
+				const struct vb2_nv_field *f)
+{
+	return (f->flags & VB2_NV_FIELD_V2) &&
+		!(ctx->flags & VB2_CONTEXT_NVDATA_V2);
+}
 
-	case VB2_NV_BOOT_ON_AC_DETECT:
-		return GETBIT(VB2_NV_OFFS_MISC, VB2_NV_MISC_BOOT_ON_AC_DETECT);
+uint32_t vb2_nv_get(struct vb2_context *ctx, enum vb2_nv_param param)
+{
+	const struct vb2_nv_field *f = vb2_nv_field(param);
+	const uint8_t *p = ctx->nvdata;
+	uint32_t value = 0;
+	int i;
 
-	case VB2_NV_TRY_RO_SYNC:
-		return GETBIT(VB2_NV_OFFS_MISC, VB2_NV_MISC_TRY_RO_SYNC);
+	if (!f)
+		return 0;
 
-	case VB2_NV_BATTERY_CUTOFF_REQUEST:
-		return GETBIT(VB2_NV_OFFS_MISC, VB2_NV_MISC_BATTERY_CUTOFF);
+	/* V2-only fields read as 0 for V1, except VB2_NV_FW_MAX_ROLLFORWARD */
+	if (vb2_nv_field_missing(ctx, f))
+		return param == VB2_NV_FW_MAX_ROLLFORWARD ?
+			VB2_FW_MAX_ROLLFORWARD_V1_DEFAULT : 0;
 
-	case VB2_NV_KERNEL_MAX_ROLLFORWARD:
-		return (p[VB2_NV_OFFS_KERNEL_MAX_ROLLFORWARD1]
-			| (p[VB2_NV_OFFS_KERNEL_MAX_ROLLFORWARD2] << 8)
-			| (p[VB2_NV_OFFS_KERNEL_MAX_ROLLFORWARD3] << 16)
-			| (p[VB2_NV_OFFS_KERNEL_MAX_ROLLFORWARD4] << 24));
+	if (f->flags & VB2_NV_FIELD_BOOL)
+		return p[f->offs[0]] & f->mask ? 1 : 0;
 
-	case VB2_NV_FW_MAX_ROLLFORWARD:
-		/* Field only present in V2 */
-		if (!(ctx->flags & VB2_CONTEXT_NVDATA_V2))
-			return VB2_FW_MAX_ROLLFORWARD_V1_DEFAULT;
+	if (f->bytes == 1)
+		return (p[f->offs[0]] & f->mask) >> f->shift;
 
-		return (p[VB2_NV_OFFS_FW_MAX_ROLLFORWARD1]
-			| (p[VB2_NV_OFFS_FW_MAX_ROLLFORWARD2] << 8)
-			| (p[VB2_NV_OFFS_FW_MAX_ROLLFORWARD3] << 16)
-			| (p[VB2_NV_OFFS_FW_MAX_ROLLFORWARD4] << 24));
-	}
+	for (i = f->bytes - 1; i >= 0; i--)
+		value = (value << 8) | p[f->offs[i]];
 
-	/*
-	 * Put default return outside the switch() instead of in default:, so
-	 * that adding a new param will cause a compiler warning.
-	 */
-	return 0;
+	return value;
 }
 
-#undef GETBIT
-
-/* Macro for vb2_nv_set() single-bit settings to reduce duplicate code. */
-#define SETBIT(offs, mask)					\
-	{ if (value) p[offs] |= mask; else p[offs] &= ~mask; }
-
 void vb2_nv_set(struct vb2_context *ctx,
 		enum vb2_nv_param param,
 		uint32_t value)
 {
+	const struct vb2_nv_field *f = vb2_nv_field(param);
 	uint8_t *p = ctx->nvdata;
+	int i;
+
+	if (!f || vb2_nv_field_missing(ctx, f))
+		return;
 
 	/* If not changing the value, don't regenerate the CRC. */
 	if (vb2_nv_get(ctx, param) == value)
 		return;
 
-	/*
-	 * TODO: We could reduce the binary size for this code by #ifdef'ing
-	 * out the params not used by firmware verification.
-	 */
-	switch (param) {
-	case VB2_NV_FIRMWARE_SETTINGS_RESET:
-		SETBIT(VB2_NV_OFFS_HEADER, VB2_NV_HEADER_FW_SETTINGS_RESET);
-		break;
-
-	case VB2_NV_KERNEL_SETTINGS_RESET:
-		SETBIT(VB2_NV_OFFS_HEADER, VB2_NV_HEADER_KERNEL_SETTINGS_RESET);
-		break;
-
-	case VB2_NV_DEBUG_RESET_MODE:
-		SETBIT(VB2_NV_OFFS_BOOT, VB2_NV_BOOT_DEBUG_RESET);
-		break;
-
-	case VB2_NV_TRY_NEXT:
-		SETBIT(VB2_NV_OFFS_BOOT2, VB2_NV_BOOT2_TRY_NEXT);
-		break;
-
-	case VB2_NV_TRY_COUNT:
-		/* Clip to valid range. */
-		if (value > VB2_NV_BOOT_TRY_COUNT_MASK)
-			value = VB2_NV_BOOT_TRY_COUNT_MASK;
-
-		p[VB2_NV_OFFS_BOOT] &= ~VB2_NV_BOOT_TRY_COUNT_MASK;
-		p[VB2_NV_OFFS_BOOT] |= (uint8_t)value;
-		break;
-
-	case VB2_NV_FW_TRIED:
-		SETBIT(VB2_NV_OFFS_BOOT2, VB2_NV_BOOT2_TRIED);
-		break;
-
-	case VB2_NV_FW_RESULT:
-		/* Map out of range values to unknown */
-		if (value > VB2_NV_BOOT2_RESULT_MASK)
-			value = VB2_FW_RESULT_UNKNOWN;
-
-		p[VB2_NV_OFFS_BOOT2] &= ~VB2_NV_BOOT2_RESULT_MASK;
-		p[VB2_NV_OFFS_BOOT2] |= (uint8_t)value;
-		break;
-
-	case VB2_NV_FW_PREV_TRIED:
-		SETBIT(VB2_NV_OFFS_BOOT2, VB2_NV_BOOT2_PREV_TRIED);
-		break;
-
-	case VB2_NV_FW_PREV_RESULT:
-		/* Map out of range values to unknown */
-		if (value > VB2_NV_BOOT2_RESULT_MASK)
-			value = VB2_FW_RESULT_UNKNOWN;
-
-		p[VB2_NV_OFFS_BOOT2] &= ~VB2_NV_BOOT2_PREV_RESULT_MASK;
-		p[VB2_NV_OFFS_BOOT2] |=
-			(uint8_t)(value << VB2_NV_BOOT2_PREV_RESULT_SHIFT);
-		break;
-
-	case VB2_NV_RECOVERY_REQUEST:
-		/*
-		 * Map values outside the valid range to the legacy reason,
-		 * since we can't determine if we're called from kernel or user
-		 * mode.
-		 */
-		if (value > 0xff)
-			value = VB2_RECOVERY_LEGACY;
-		p[VB2_NV_OFFS_RECOVERY] = (uint8_t)value;
-		break;
-
-	case VB2_NV_RECOVERY_SUBCODE:
-		p[VB2_NV_OFFS_RECOVERY_SUBCODE] = (uint8_t)value;
-		break;
-
-	case VB2_NV_LOCALIZATION_INDEX:
-		/* Map values outside the valid range to the default index. */
-		if (value > 0xFF)
-			value = 0;
-		p[VB2_NV_OFFS_LOCALIZATION] = (uint8_t)value;
-		break;
-
-	case VB2_NV_KERNEL_FIELD:
-		p[VB2_NV_OFFS_KERNEL1] = (uint8_t)(value);
-		p[VB2_NV_OFFS_KERNEL2] = (uint8_t)(value >> 8);
-		break;
-
-	case VB2_NV_DEV_BOOT_USB:
-		SETBIT(VB2_NV_OFFS_DEV, VB2_NV_DEV_FLAG_USB);
-		break;
-
-	case VB2_NV_DEV_BOOT_LEGACY:
-		SETBIT(VB2_NV_OFFS_DEV, VB2_NV_DEV_FLAG_LEGACY);
-		break;
-
-	case VB2_NV_DEV_BOOT_SIGNED_ONLY:
-		SETBIT(VB2_NV_OFFS_DEV, VB2_NV_DEV_FLAG_SIGNED_ONLY);
-		break;
-
-	case VB2_NV_DEV_BOOT_FASTBOOT_FULL_CAP:
-		SETBIT(VB2_NV_OFFS_DEV, VB2_NV_DEV_FLAG_FASTBOOT_FULL_CAP);
-		break;
-
-	case VB2_NV_DEV_DEFAULT_BOOT:
-		/* Map out of range values to disk */
-		if (value > (VB2_NV_DEV_FLAG_DEFAULT_BOOT >>
-			     VB2_NV_DEV_DEFAULT_BOOT_SHIFT))
-			value = VB2_DEV_DEFAULT_BOOT_DISK;
-
-		p[VB2_NV_OFFS_DEV] &= ~VB2_NV_DEV_FLAG_DEFAULT_BOOT;
-		p[VB2_NV_OFFS_DEV] |=
-			(uint8_t)(value << VB2_NV_DEV_DEFAULT_BOOT_SHIFT);
-		break;
-
-	case VB2_NV_DEV_ENABLE_UDC:
-		SETBIT(VB2_NV_OFFS_DEV, VB2_NV_DEV_FLAG_UDC);
-		break;
-
-	case VB2_NV_DISABLE_DEV_REQUEST:
-		SETBIT(VB2_NV_OFFS_BOOT, VB2_NV_BOOT_DISABLE_DEV);
-		break;
-
-	case VB2_NV_OPROM_NEEDED:
-		SETBIT(VB2_NV_OFFS_BOOT, VB2_NV_BOOT_OPROM_NEEDED);
-		break;
-
-	case VB2_NV_BACKUP_NVRAM_REQUEST:
-		SETBIT(VB2_NV_OFFS_BOOT, VB2_NV_BOOT_BACKUP_NVRAM);
-		break;
-
-	case VB2_NV_CLEAR_TPM_OWNER_REQUEST:
-		SETBIT(VB2_NV_OFFS_TPM, VB2_NV_TPM_CLEAR_OWNER_REQUEST);
-		break;
-
-	case VB2_NV_CLEAR_TPM_OWNER_DONE:
-		SETBIT(VB2_NV_OFFS_TPM, VB2_NV_TPM_CLEAR_OWNER_DONE);
-		break;
-
-	case VB2_NV_TPM_REQUESTED_REBOOT:
-		SETBIT(VB2_NV_OFFS_TPM, VB2_NV_TPM_REBOOTED);
-		break;
-
-	case VB2_NV_REQ_WIPEOUT:
-		SETBIT(VB2_NV_OFFS_HEADER , VB2_NV_HEADER_WIPEOUT);
-		break;
-
-	case VB2_NV_FASTBOOT_UNLOCK_IN_FW:
-		SETBIT(VB2_NV_OFFS_MISC, VB2_NV_MISC_UNLOCK_FASTBOOT);
-		break;
-
-	case VB2_NV_BOOT_ON_AC_DETECT:
-		SETBIT(VB2_NV_OFFS_MISC, VB2_NV_MISC_BOOT_ON_AC_DETECT);
-		break;
-
-	case VB2_NV_TRY_RO_SYNC:
-		SETBIT(VB2_NV_OFFS_MISC, VB2_NV_MISC_TRY_RO_SYNC);
-		break;
-
-	case VB2_NV_BATTERY_CUTOFF_REQUEST:
-		SETBIT(VB2_NV_OFFS_MISC, VB2_NV_MISC_BATTERY_CUTOFF);
-		break;
-
-	case VB2_NV_KERNEL_MAX_ROLLFORWARD:
-		p[VB2_NV_OFFS_KERNEL_MAX_ROLLFORWARD1] = (uint8_t)(value);
-		p[VB2_NV_OFFS_KERNEL_MAX_ROLLFORWARD2] = (uint8_t)(value >> 8);
-		p[VB2_NV_OFFS_KERNEL_MAX_ROLLFORWARD3] = (uint8_t)(value >> 16);
-		p[VB2_NV_OFFS_KERNEL_MAX_ROLLFORWARD4] = (uint8_t)(value >> 24);
-		break;
-
-	case VB2_NV_FW_MAX_ROLLFORWARD:
-		/* Field only present in V2 */
-		if (!(ctx->flags & VB2_CONTEXT_NVDATA_V2))
-			return;
-
-		p[VB2_NV_OFFS_FW_MAX_ROLLFORWARD1] = (uint8_t)(value);
-		p[VB2_NV_OFFS_FW_MAX_ROLLFORWARD2] = (uint8_t)(value >> 8);
-		p[VB2_NV_OFFS_FW_MAX_ROLLFORWARD3] = (uint8_t)(value >> 16);
-		p[VB2_NV_OFFS_FW_MAX_ROLLFORWARD4] = (uint8_t)(value >> 24);
-		break;
+	if (f->flags & VB2_NV_FIELD_BOOL) {
+		if (value)
+			p[f->offs[0]] |= f->mask;
+		else
+			p[f->offs[0]] &= ~f->mask;
+	} else if (f->bytes == 1) {
+		uint32_t max = f->mask >> f->shift;
+
+		if (value > max && (f->flags & VB2_NV_FIELD_CLIP))
+			value = max;
+		else if (value > max && (f->flags & VB2_NV_FIELD_TRUNCATE))
+			value &= max;
+		else if (value > max)
+			value = f->invalid;
+
+		p[f->offs[0]] &= ~f->mask;
+		p[f->offs[0]] |= (uint8_t)(value << f->shift);
+	} else {
+		for (i = 0; i < f->bytes; i++, value >>= 8)
+			p[f->offs[i]] = (uint8_t)value;
 	}
 
-	/*
-	 * Note there is no default case.  This causes a compiler warning if
-	 * a new param is added to the enum without adding support here.
-	 */
-
 	/* Need to regenerate CRC, since the value changed. */
 	vb2_nv_regen_crc(ctx);
 }
-
-#undef SETBIT
@@ -0,0 +1,330 @@
+/* Copyright 2018 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ *
+ * Streaming load/verify pipeline
+ */
+
+#include "2sysincludes.h"
+#include "2api.h"
+#include "2common.h"
+#include "2pipeline.h"
+#include "2sha.h"
+
+static int memory_read(struct vb2_pipeline_source *src, uint8_t *buf,
+		       uint32_t size)
+{
+	const uint8_t *from = src->base + src->offset;
+
+	if (buf != from)
+		memcpy(buf, from, size);
+	src->offset += size;
+	return VB2_SUCCESS;
+}
+
+void vb2_pipeline_source_memory(struct vb2_pipeline_source *src,
+				const void *buf)
+{
+	memset(src, 0, sizeof(*src));
+	src->read = memory_read;
+	src->base = buf;
+}
+
+static int resource_read(struct vb2_pipeline_source *src, uint8_t *buf,
+			 uint32_t size)
+{
+	int rv = vb2ex_read_resource((struct vb2_context *)src->arg,
+				     src->index, src->offset, buf, size);
+	if (rv)
+		return rv;
+
+	src->offset += size;
+	return VB2_SUCCESS;
+}
+
+static int resource_read_start(struct vb2_pipeline_source *src, uint8_t *buf,
+			       uint32_t size)
+{
+	int rv = vb2ex_read_resource_start((struct vb2_context *)src->arg,
+					   src->index, src->offset, buf, size);
+
+	if (rv == VB2_ERROR_EX_READ_RESOURCE_UNIMPLEMENTED) {
+		/* Read synchronously from now on */
+		src->read_start = NULL;
+		src->read_wait = NULL;
+		return resource_read(src, buf, size);
+	}
+	if (rv)
+		return rv;
+
+	src->offset += size;
+	return VB2_SUCCESS;
+}
+
+static int resource_read_wait(struct vb2_pipeline_source *src)
+{
+	return vb2ex_read_resource_wait((struct vb2_context *)src->arg);
+}
+
+void vb2_pipeline_source_resource(struct vb2_pipeline_source *src,
+				  struct vb2_context *ctx,
+				  enum vb2_resource_index index,
+				  uint32_t offset)
+{
+	memset(src, 0, sizeof(*src));
+	src->read = resource_read;
+	src->read_start = resource_read_start;
+	src->read_wait = resource_read_wait;
+	src->arg = ctx;
+	src->index = index;
+	src->offset = offset;
+}
+
+void vb2_pipeline_init(struct vb2_pipeline *pipe,
+		       struct vb2_pipeline_source *source,
+		       uint32_t chunk_size,
+		       struct vb2_digest_context *dc,
+		       uint8_t *sink)
+{
+	memset(pipe, 0, sizeof(*pipe));
+	pipe->source = source;
+	pipe->chunk_size = chunk_size;
+	pipe->dc = dc;
+	pipe->sink = sink;
+	pipe->sink_start = sink;
+}
+
+/**
+ * Hand a chunk which has been hashed to the consumer.
+ */
+static int consume(struct vb2_pipeline *pipe, const uint8_t *buf,
+		   uint32_t size)
+{
+	int rv;
+
+	if (!pipe->consume || !size)
+		return VB2_SUCCESS;
+
+	rv = pipe->consume(pipe, buf, size);
+	if (rv)
+		pipe->failed = VB2_PIPELINE_CONSUMER;
+	return rv;
+}
+
+/**
+ * Feed a chunk through the digest stage.
+ */
+static int digest(struct vb2_pipeline *pipe, const uint8_t *buf,
+		  uint32_t size)
+{
+	int rv;
+
+	if (!pipe->dc || !size)
+		return VB2_SUCCESS;
+
+	if (pipe->dc->using_hwcrypto)
+		rv = vb2ex_hwcrypto_digest_extend(buf, size);
+	else
+		rv = vb2_digest_extend(pipe->dc, buf, size);
+	if (rv) {
+		pipe->failed = VB2_PIPELINE_DIGEST;
+		return rv;
+	}
+
+	pipe->bytes_hashed += size;
+	return VB2_SUCCESS;
+}
+
+int vb2_pipeline_extend(struct vb2_pipeline *pipe,
+			const uint8_t *buf,
+			uint32_t size)
+{
+	int rv = digest(pipe, buf, size);
+
+	if (rv)
+		return rv;
+
+	return consume(pipe, buf, size);
+}
+
+/**
+ * Start reading the next chunk into the sink.
+ */
+static int start_read(struct vb2_pipeline *pipe, uint8_t *buf, uint32_t size)
+{
+	struct vb2_pipeline_source *src = pipe->source;
+	int rv;
+
+	if (src->read_start)
+		rv = src->read_start(src, buf, size);
+	else
+		rv = src->read(src, buf, size);
+	if (rv) {
+		pipe->failed = VB2_PIPELINE_SOURCE;
+		return rv;
+	}
+
+	pipe->read_count++;
+	return VB2_SUCCESS;
+}
+
+/**
+ * Wait for the read started by start_read() to finish.
+ */
+static int wait_read(struct vb2_pipeline *pipe)
+{
+	struct vb2_pipeline_source *src = pipe->source;
+	int rv;
+
+	if (!src->read_start || !src->read_wait)
+		return VB2_SUCCESS;
+
+	rv = src->read_wait(src);
+	if (rv)
+		pipe->failed = VB2_PIPELINE_SOURCE;
+	return rv;
+}
+
+/**
+ * Return the size of the next chunk.
+ */
+static uint32_t next_chunk(const struct vb2_pipeline *pipe, uint32_t remaining)
+{
+	if (pipe->chunk_size && remaining > pipe->chunk_size)
+		return pipe->chunk_size;
+	return remaining;
+}
+
+/* Digest stage work handed to another CPU by vb2ex_run_parallel() */
+struct hash_job {
+	struct vb2_digest_context *dc;
+	const uint8_t *buf;
+	uint32_t size;
+};
+
+static int hash_job_run(void *arg)
+{
+	struct hash_job *job = arg;
+
+	return vb2_digest_extend(job->dc, job->buf, job->size);
+}
+
+/**
+ * Start hashing a chunk in the background, on another CPU or in the crypto
+ * engine.  Returns VB2_SUCCESS if it was started.
+ */
+static int start_digest(struct vb2_pipeline *pipe, struct hash_job *job,
+			const uint8_t *buf, uint32_t size)
+{
+	if (pipe->dc->using_hwcrypto)
+		return vb2ex_hwcrypto_digest_extend_async(buf, size);
+
+	job->dc = pipe->dc;
+	job->buf = buf;
+	job->size = size;
+	return vb2ex_run_parallel(hash_job_run, job);
+}
+
+/**
+ * Wait for the chunk started by start_digest() to be hashed.
+ */
+static int wait_digest(struct vb2_pipeline *pipe)
+{
+	if (pipe->dc->using_hwcrypto)
+		return vb2ex_hwcrypto_digest_wait();
+	else
+		return vb2ex_wait();
+}
+
+int vb2_pipeline_run(struct vb2_pipeline *pipe, uint32_t size)
+{
+	struct hash_job job;
+	uint32_t chunk, next;
+	int parallel, offloaded;
+	int rv, hash_rv;
+
+	pipe->failed = VB2_PIPELINE_OK;
+
+	/*
+	 * Hashing may go on in the background, on another CPU or in the
+	 * crypto engine, while the boot CPU reads the next chunk.  Only the
+	 * boot CPU drives the crypto engine.
+	 */
+	parallel = pipe->dc != NULL;
+
+	/* Keep one chunk in flight while hashing the chunk before it */
+	chunk = next_chunk(pipe, size);
+	if (chunk) {
+		rv = start_read(pipe, pipe->sink, chunk);
+		if (rv)
+			return rv;
+	}
+
+	while (chunk) {
+		uint8_t *buf = pipe->sink;
+		uint8_t *next_buf = buf + chunk;
+
+		size -= chunk;
+		next = next_chunk(pipe, size);
+
+		/* Wrap around a ring sink */
+		if (pipe->sink_size &&
+		    next_buf + next > pipe->sink_start + pipe->sink_size)
+			next_buf = pipe->sink_start;
+
+		rv = wait_read(pipe);
+		if (rv)
+			return rv;
+
+		/* The last chunk has no read to overlap, so hash it here */
+		offloaded = 0;
+		if (parallel && next) {
+			hash_rv = start_digest(pipe, &job, buf, chunk);
+			if (hash_rv == VB2_SUCCESS) {
+				offloaded = 1;
+			} else if (pipe->dc->using_hwcrypto &&
+				   hash_rv !=
+				   VB2_ERROR_EX_HWCRYPTO_ASYNC_UNIMPLEMENTED) {
+				pipe->failed = VB2_PIPELINE_DIGEST;
+				return hash_rv;
+			} else {
+				parallel = 0;
+			}
+		}
+
+		if (next)
+			rv = start_read(pipe, next_buf, next);
+
+		if (offloaded) {
+			/* The hash reads buf; collect it before leaving */
+			hash_rv = wait_digest(pipe);
+			if (!rv && hash_rv) {
+				pipe->failed = VB2_PIPELINE_DIGEST;
+				wait_read(pipe);
+				return hash_rv;
+			}
+			if (!hash_rv)
+				pipe->bytes_hashed += chunk;
+		}
+		if (rv)
+			return rv;
+
+		pipe->bytes_read += chunk;
+		pipe->sink = next_buf;
+
+		if (!offloaded)
+			rv = digest(pipe, buf, chunk);
+		if (!rv)
+			rv = consume(pipe, buf, chunk);
+		if (rv) {
+			/* Don't leave a read pending into the sink */
+			if (next)
+				wait_read(pipe);
+			return rv;
+		}
+
+		chunk = next;
+	}
+
+	return VB2_SUCCESS;
+}
@@ -11,176 +11,118 @@
 
 #include "2sysincludes.h"
 #include "2common.h"
+#include "2ed25519.h"
 #include "2rsa.h"
 #include "2sha.h"
 
-/**
- * a[] -= mod
+#if VB2_RSA_64BIT_LIMBS
+/*
+ * Montgomery arithmetic on 64-bit limbs.  The key's n[] and rr[] arrays are
+ * little endian 32-bit word arrays, so limb i is words 2i and 2i+1.
  */
-static void subM(const struct vb2_public_key *key, uint32_t *a)
-{
-	int64_t A = 0;
-	uint32_t i;
-	for (i = 0; i < key->arrsize; ++i) {
-		A += (uint64_t)a[i] - key->n[i];
-		a[i] = (uint32_t)A;
-		A >>= 32;
-	}
-}
+typedef unsigned __int128 vb2_uint128_t;
 
 /**
- * Return a[] >= mod
+ * Return 64-bit limb i of a little endian 32-bit word array.
  */
-int vb2_mont_ge(const struct vb2_public_key *key, uint32_t *a)
+static inline uint64_t limb64(const uint32_t *a, uint32_t i)
 {
-	uint32_t i;
-	for (i = key->arrsize; i;) {
-		--i;
-		if (a[i] < key->n[i])
-			return 0;
-		if (a[i] > key->n[i])
-			return 1;
-	}
-	return 1;  /* equal */
+	return a[2 * i] | ((uint64_t)a[2 * i + 1] << 32);
 }
 
 /**
- * Montgomery c[] += a * b[] / R % mod
+ * Return -1 / n[0] mod 2^64, derived from the key's 32-bit n0inv.
  */
-static void montMulAdd(const struct vb2_public_key *key,
-                       uint32_t *c,
-                       const uint32_t a,
-                       const uint32_t *b)
+static uint64_t n0inv64(const struct vb2_public_key *key)
 {
-	uint64_t A = (uint64_t)a * b[0] + c[0];
-	uint32_t d0 = (uint32_t)A * key->n0inv;
-	uint64_t B = (uint64_t)d0 * key->n[0] + (uint32_t)A;
-	uint32_t i;
-
-	for (i = 1; i < key->arrsize; ++i) {
-		A = (A >> 32) + (uint64_t)a * b[i] + c[i];
-		B = (B >> 32) + (uint64_t)d0 * key->n[i] + (uint32_t)A;
-		c[i - 1] = (uint32_t)B;
-	}
-
-	A = (A >> 32) + (B >> 32);
-
-	c[i - 1] = (uint32_t)A;
+	/* -n0inv is 1 / n mod 2^32; one Newton step lifts it to 2^64 */
+	uint64_t x = (uint32_t)-key->n0inv;
 
-	if (A >> 32) {
-		subM(key, c);
-	}
+	x *= 2 - limb64(key->n, 0) * x;
+	return -x;
 }
+#endif  /* VB2_RSA_64BIT_LIMBS */
 
-/**
- * Montgomery c[] += 0 * b[] / R % mod
+/*
+ * Big endian word loads and stores.  On little endian machines, a word copy
+ * and a bswap is one or two instructions instead of four shifts and stores.
+ * Compilers which tell us the byte order also have the bswap builtin.
  */
-static void montMulAdd0(const struct vb2_public_key *key,
-			uint32_t *c,
-			const uint32_t *b)
-{
-	uint32_t d0 = c[0] * key->n0inv;
-	uint64_t B = (uint64_t)d0 * key->n[0] + c[0];
-	uint32_t i;
-
-	for (i = 1; i < key->arrsize; ++i) {
-		B = (B >> 32) + (uint64_t)d0 * key->n[i] + c[i];
-		c[i - 1] = (uint32_t)B;
-	}
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define BSWAP_WORDS 1
+#else
+#define BSWAP_WORDS 0
+#endif
 
-	c[i - 1] = B >> 32;
+static uint32_t be32_at(const uint8_t *p)
+{
+#if BSWAP_WORDS
+	uint32_t w;
+
+	memcpy(&w, p, sizeof(w));
+	return __builtin_bswap32(w);
+#else
+	return (p[0] << 24) | (p[1] << 16) | (p[2] << 8) | (p[3] << 0);
+#endif
 }
 
-/**
- * Montgomery c[] = a[] * b[] / R % mod
- */
-static void montMul(const struct vb2_public_key *key,
-                    uint32_t *c,
-                    const uint32_t *a,
-                    const uint32_t *b)
+static void put_be32(uint8_t *p, uint32_t w)
 {
-	uint32_t i;
-	for (i = 0; i < key->arrsize; ++i) {
-		c[i] = 0;
-	}
-	for (i = 0; i < key->arrsize; ++i) {
-		montMulAdd(key, c, a[i], b);
-	}
+#if BSWAP_WORDS
+	w = __builtin_bswap32(w);
+	memcpy(p, &w, sizeof(w));
+#else
+	p[0] = (uint8_t)(w >> 24);
+	p[1] = (uint8_t)(w >> 16);
+	p[2] = (uint8_t)(w >>  8);
+	p[3] = (uint8_t)(w >>  0);
+#endif
 }
 
-/* Montgomery c[] = a[] * 1 / R % key. */
-static void montMul1(const struct vb2_public_key *key,
-		     uint32_t *c,
-		     const uint32_t *a)
+void vb2_le_words_to_be(uint8_t *dst, const uint32_t *src, uint32_t words)
 {
-	int i;
-
-	for (i = 0; i < key->arrsize; ++i)
-		c[i] = 0;
+	uint32_t i;
 
-	montMulAdd(key, c, 1, a);
-	for (i = 1; i < key->arrsize; ++i)
-		montMulAdd0(key, c, a);
+	for (i = 0; i < words; i++)
+		put_be32(dst + (words - 1 - i) * 4, src[i]);
 }
 
+/* Montgomery arithmetic for keys of any size */
+#include "2rsa_mont.inc"
+
+/* And for the sizes we build fixed-size copies for */
+#if VB2_RSA_FIXED_SIZES & VB2_RSA_FIXED_2048
+#define RSA_BITS 2048
+#include "2rsa_mont.inc"
+#undef RSA_BITS
+#endif
+
+#if VB2_RSA_FIXED_SIZES & VB2_RSA_FIXED_3072
+#define RSA_BITS 3072
+#include "2rsa_mont.inc"
+#undef RSA_BITS
+#endif
+
+#if VB2_RSA_FIXED_SIZES & VB2_RSA_FIXED_4096
+#define RSA_BITS 4096
+#include "2rsa_mont.inc"
+#undef RSA_BITS
+#endif
+
+#if VB2_RSA_FIXED_SIZES & VB2_RSA_FIXED_8192
+#define RSA_BITS 8192
+#include "2rsa_mont.inc"
+#undef RSA_BITS
+#endif
+
 /**
- * In-place public exponentiation.
- *
- * @param key		Key to use in signing
- * @param inout		Input and output big-endian byte array
- * @param workbuf32	Work buffer; caller must verify this is
- *			(3 * key->arrsize) elements long.
- * @param exp		RSA public exponent: either 65537 (F4) or 3
+ * Return a[] >= mod
  */
-static void modpow(const struct vb2_public_key *key, uint8_t *inout,
-		uint32_t *workbuf32, int exp)
+int vb2_mont_ge(const struct vb2_public_key *key, uint32_t *a)
 {
-	uint32_t *a = workbuf32;
-	uint32_t *aR = a + key->arrsize;
-	uint32_t *aaR = aR + key->arrsize;
-	uint32_t *aaa = aaR;  /* Re-use location. */
-	int i;
-
-	/* Convert from big endian byte array to little endian word array. */
-	for (i = 0; i < (int)key->arrsize; ++i) {
-		uint32_t tmp =
-			(inout[((key->arrsize - 1 - i) * 4) + 0] << 24) |
-			(inout[((key->arrsize - 1 - i) * 4) + 1] << 16) |
-			(inout[((key->arrsize - 1 - i) * 4) + 2] << 8) |
-			(inout[((key->arrsize - 1 - i) * 4) + 3] << 0);
-		a[i] = tmp;
-	}
-
-	montMul(key, aR, a, key->rr);  /* aR = a * RR / R mod M   */
-	if (exp == 3) {
-		montMul(key, aaR, aR, aR); /* aaR = aR * aR / R mod M */
-		montMul(key, a, aaR, aR); /* a = aaR * aR / R mod M */
-		montMul1(key, aaa, a); /* aaa = a * 1 / R mod M */
-	} else {
-		/* Exponent 65537 */
-		for (i = 0; i < 16; i+=2) {
-			montMul(key, aaR, aR, aR);  /* aaR = aR * aR / R mod M */
-			montMul(key, aR, aaR, aaR);  /* aR = aaR * aaR / R mod M */
-		}
-		montMul(key, aaa, aR, a);  /* aaa = aR * a / R mod M */
-	}
-
-	/* Make sure aaa < mod; aaa is at most 1x mod too large. */
-	if (vb2_mont_ge(key, aaa)) {
-		subM(key, aaa);
-	}
-
-	/* Convert to bigendian byte array */
-	for (i = (int)key->arrsize - 1; i >= 0; --i) {
-		uint32_t tmp = aaa[i];
-		*inout++ = (uint8_t)(tmp >> 24);
-		*inout++ = (uint8_t)(tmp >> 16);
-		*inout++ = (uint8_t)(tmp >>  8);
-		*inout++ = (uint8_t)(tmp >>  0);
-	}
+	return mont_ge(key, a);
 }
 
-
 static const uint8_t crypto_to_sig[] = {
 	VB2_SIG_RSA1024,
 	VB2_SIG_RSA1024,
@@ -264,6 +206,9 @@ uint32_t vb2_packed_key_size(enum vb2_signature_algorithm sig_alg)
 {
 	uint32_t sig_size = vb2_rsa_sig_size(sig_alg);
 
+	if (sig_alg == VB2_SIG_ED25519)
+		return VB2_ED25519_KEY_BYTES;
+
 	if (!sig_size)
 		return 0;
 
@@ -320,8 +265,10 @@ int vb2_check_padding(const uint8_t *sig, const struct vb2_public_key *key)
 	uint32_t pad_size = sig_size - hash_size;
 	const uint8_t *tail;
 	uint32_t tail_size;
-	int result = 0;
-	int i;
+	uint32_t ff_size;
+	uint32_t result = 0;
+	uint32_t w;
+	uint32_t i;
 
 	if (!sig_size || !hash_size || hash_size > sig_size)
 		return VB2_ERROR_RSA_PADDING_SIZE;
@@ -347,8 +294,14 @@ int vb2_check_padding(const uint8_t *sig, const struct vb2_public_key *key)
 	result |= *sig++ ^ 0x00;
 	result |= *sig++ ^ 0x01;
 
-	/* Then 0xff bytes until the tail */
-	for (i = 0; i < pad_size - tail_size - 2; i++)
+	/* Then 0xff bytes until the tail, a word at a time while we can */
+	ff_size = pad_size - tail_size - 2;
+	for (i = 0; i + sizeof(w) <= ff_size; i += sizeof(w)) {
+		memcpy(&w, sig, sizeof(w));
+		result |= w ^ 0xffffffff;
+		sig += sizeof(w);
+	}
+	for (; i < ff_size; i++)
 		result |= *sig++ ^ 0xff;
 
 	/*
@@ -360,45 +313,123 @@ int vb2_check_padding(const uint8_t *sig, const struct vb2_public_key *key)
 	return result ? VB2_ERROR_RSA_PADDING : VB2_SUCCESS;
 }
 
-int vb2_rsa_verify_digest(const struct vb2_public_key *key,
-			  uint8_t *sig,
-			  const uint8_t *digest,
-			  const struct vb2_workbuf *wb)
+/* Check that [key] can be used to raise signatures to its exponent. */
+static int vb2_rsa_check_key(const struct vb2_public_key *key)
 {
-	struct vb2_workbuf wblocal = *wb;
-	uint32_t *workbuf32;
-	uint32_t key_bytes;
 	int sig_size;
-	int pad_size;
-	int exp;
-	int rv;
-
-	if (!key || !sig || !digest)
-		return VB2_ERROR_RSA_VERIFY_PARAM;
 
 	sig_size = vb2_rsa_sig_size(key->sig_alg);
-	exp = vb2_rsa_exponent(key->sig_alg);
-	if (!sig_size || !exp) {
+	if (!sig_size || !vb2_rsa_exponent(key->sig_alg)) {
 		VB2_DEBUG("Invalid signature type!\n");
 		return VB2_ERROR_RSA_VERIFY_ALGORITHM;
 	}
 
 	/* Signature length should be same as key length */
-	key_bytes = key->arrsize * sizeof(uint32_t);
-	if (key_bytes != sig_size) {
+	if (key->arrsize * sizeof(uint32_t) != sig_size) {
 		VB2_DEBUG("Signature is of incorrect length!\n");
 		return VB2_ERROR_RSA_VERIFY_SIG_LEN;
 	}
 
-	workbuf32 = vb2_workbuf_alloc(&wblocal, 3 * key_bytes);
+	return VB2_SUCCESS;
+}
+
+/*
+ * Raise [sig] to the public exponent of [key] in place, using [workbuf32]
+ * (2 * key->arrsize words).  The key must have passed vb2_rsa_check_key().
+ */
+static void vb2_rsa_modpow(const struct vb2_public_key *key,
+			   uint8_t *sig,
+			   uint32_t *workbuf32)
+{
+	int exp = vb2_rsa_exponent(key->sig_alg);
+
+	switch (vb2_rsa_sig_size(key->sig_alg)) {
+#if VB2_RSA_FIXED_SIZES & VB2_RSA_FIXED_2048
+	case 2048 / 8:
+		rsa_modpow_2048(key, sig, workbuf32, exp);
+		break;
+#endif
+#if VB2_RSA_FIXED_SIZES & VB2_RSA_FIXED_3072
+	case 3072 / 8:
+		rsa_modpow_3072(key, sig, workbuf32, exp);
+		break;
+#endif
+#if VB2_RSA_FIXED_SIZES & VB2_RSA_FIXED_4096
+	case 4096 / 8:
+		rsa_modpow_4096(key, sig, workbuf32, exp);
+		break;
+#endif
+#if VB2_RSA_FIXED_SIZES & VB2_RSA_FIXED_8192
+	case 8192 / 8:
+		rsa_modpow_8192(key, sig, workbuf32, exp);
+		break;
+#endif
+	default:
+		rsa_modpow(key, sig, workbuf32, exp);
+	}
+}
+
+/* Raise [sig] to the public exponent of [key] in place. */
+static int vb2_rsa_decrypt(const struct vb2_public_key *key,
+			   uint8_t *sig,
+			   const struct vb2_workbuf *wb)
+{
+	struct vb2_workbuf wblocal = *wb;
+	uint32_t *workbuf32;
+	uint32_t key_bytes;
+	int rv;
+
+	if (!key || !sig)
+		return VB2_ERROR_RSA_VERIFY_PARAM;
+
+	rv = vb2_rsa_check_key(key);
+	if (rv)
+		return rv;
+
+	key_bytes = key->arrsize * sizeof(uint32_t);
+	workbuf32 = vb2_workbuf_alloc(&wblocal, 2 * key_bytes);
 	if (!workbuf32) {
 		VB2_DEBUG("ERROR - vboot2 work buffer too small!\n");
 		return VB2_ERROR_RSA_VERIFY_WORKBUF;
 	}
 
-	modpow(key, sig, workbuf32, exp);
+	vb2_rsa_modpow(key, sig, workbuf32);
 
-	vb2_workbuf_free(&wblocal, 3 * key_bytes);
+	vb2_workbuf_free(&wblocal, 2 * key_bytes);
+	return VB2_SUCCESS;
+}
+
+/*
+ * Try to verify [sig] in the HW crypto engine, if [key] allows it.  Returns
+ * VB2_ERROR_EX_HWCRYPTO_UNSUPPORTED if it's up to us.
+ */
+static int vb2_rsa_verify_hwcrypto(const struct vb2_public_key *key,
+				   const uint8_t *sig,
+				   const uint8_t *digest)
+{
+	int rv;
+
+	if (!key->allow_hwcrypto)
+		return VB2_ERROR_EX_HWCRYPTO_UNSUPPORTED;
+
+	rv = vb2ex_hwcrypto_rsa_verify_digest(key, sig, digest);
+	if (rv != VB2_ERROR_EX_HWCRYPTO_UNSUPPORTED)
+		VB2_DEBUG("Using HW crypto engine for sig_alg %d\n",
+			  key->sig_alg);
+	else
+		VB2_DEBUG("HW crypto for sig_alg %d not supported, using SW\n",
+			  key->sig_alg);
+	return rv;
+}
+
+/* Check the padding and digest in a decrypted signature. */
+static int vb2_rsa_check_digest(const struct vb2_public_key *key,
+				const uint8_t *sig,
+				const uint8_t *digest)
+{
+	int sig_size;
+	int pad_size;
+	int rv;
 
 	/*
 	 * Check padding.  Only fail immediately if the padding size is bad.
@@ -414,8 +445,9 @@ int vb2_rsa_verify_digest(const struct vb2_public_key *key,
 	 * use vb2_safe_memcmp() just to be on the safe side.  (That's also why
 	 * we don't return before this check if the padding check failed.)
 	 */
+	sig_size = vb2_rsa_sig_size(key->sig_alg);
 	pad_size = sig_size - vb2_digest_size(key->hash_alg);
-	if (vb2_safe_memcmp(sig + pad_size, digest, key_bytes - pad_size)) {
+	if (vb2_safe_memcmp(sig + pad_size, digest, sig_size - pad_size)) {
 		VB2_DEBUG("Digest check failed!\n");
 		if (!rv)
 			rv = VB2_ERROR_RSA_VERIFY_DIGEST;
@@ -423,3 +455,111 @@ int vb2_rsa_verify_digest(const struct vb2_public_key *key,
 
 	return rv;
 }
+
+int vb2_rsa_verify_digest(const struct vb2_public_key *key,
+			  uint8_t *sig,
+			  const uint8_t *digest,
+			  const struct vb2_workbuf *wb)
+{
+	int rv;
+
+	if (!key || !sig || !digest)
+		return VB2_ERROR_RSA_VERIFY_PARAM;
+
+	rv = vb2_rsa_verify_hwcrypto(key, sig, digest);
+	if (rv != VB2_ERROR_EX_HWCRYPTO_UNSUPPORTED)
+		return rv;
+
+	rv = vb2_rsa_decrypt(key, sig, wb);
+	if (rv)
+		return rv;
+
+	return vb2_rsa_check_digest(key, sig, digest);
+}
+
+int vb2_rsa_verify_digest_batch(const struct vb2_public_key *key,
+				uint8_t *const *sigs,
+				const uint8_t *const *digests,
+				uint32_t count,
+				int *results,
+				const struct vb2_workbuf *wb)
+{
+	struct vb2_workbuf wblocal = *wb;
+	uint32_t *workbuf32 = NULL;
+	uint32_t key_bytes;
+	uint32_t i;
+	int first_rv = VB2_SUCCESS;
+	int key_rv, rv;
+
+	if (!key || !sigs || !digests)
+		return VB2_ERROR_RSA_VERIFY_PARAM;
+
+	/* Everything that only depends on the key is only done once */
+	key_rv = vb2_rsa_check_key(key);
+	key_bytes = key->arrsize * sizeof(uint32_t);
+
+	for (i = 0; i < count; i++) {
+		if (key_rv) {
+			rv = key_rv;
+		} else if (!sigs[i] || !digests[i]) {
+			rv = VB2_ERROR_RSA_VERIFY_PARAM;
+		} else {
+			rv = vb2_rsa_verify_hwcrypto(key, sigs[i], digests[i]);
+		}
+
+		if (rv == VB2_ERROR_EX_HWCRYPTO_UNSUPPORTED) {
+			/* Only allocate the workbuf if we need it */
+			if (!workbuf32)
+				workbuf32 = vb2_workbuf_alloc(&wblocal,
+							      2 * key_bytes);
+			if (workbuf32) {
+				vb2_rsa_modpow(key, sigs[i], workbuf32);
+				rv = vb2_rsa_check_digest(key, sigs[i],
+							  digests[i]);
+			} else {
+				VB2_DEBUG("ERROR - vboot2 work buffer too "
+					  "small!\n");
+				rv = VB2_ERROR_RSA_VERIFY_WORKBUF;
+			}
+		}
+
+		if (results)
+			results[i] = rv;
+		if (rv && !first_rv)
+			first_rv = rv;
+	}
+
+	if (workbuf32)
+		vb2_workbuf_free(&wblocal, 2 * key_bytes);
+
+	return first_rv;
+}
+
+int vb2_rsa_recover_digest(const struct vb2_public_key *key,
+			   uint8_t *sig,
+			   uint8_t *digest,
+			   uint32_t digest_size,
+			   const struct vb2_workbuf *wb)
+{
+	uint32_t hash_size;
+	int rv;
+
+	if (!digest)
+		return VB2_ERROR_RSA_VERIFY_PARAM;
+
+	hash_size = vb2_digest_size(key ? key->hash_alg : VB2_HASH_INVALID);
+	if (!hash_size || digest_size < hash_size)
+		return VB2_ERROR_RSA_VERIFY_PARAM;
+
+	rv = vb2_rsa_decrypt(key, sig, wb);
+	if (rv)
+		return rv;
+
+	rv = vb2_check_padding(sig, key);
+	if (rv)
+		return rv;
+
+	memcpy(digest, sig + vb2_rsa_sig_size(key->sig_alg) - hash_size,
+	       hash_size);
+	return VB2_SUCCESS;
+}
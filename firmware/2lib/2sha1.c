@@ -9,6 +9,7 @@
 #include "2sysincludes.h"
 #include "2common.h"
 #include "2sha.h"
+#include "2sha_private.h"
 
 /*
  * Some machines lack byteswap.h and endian.h. These have to use the
@@ -36,13 +37,18 @@ static uint32_t ror31(uint32_t val)
 	return (val >> 31) | (val << 1);
 }
 
-static void sha1_transform(struct vb2_sha1_context *ctx)
+static VB2_HOT void sha1_transform(struct vb2_sha1_context *ctx)
 {
 	/* Note that this array uses 80*4=320 bytes of stack */
 	uint32_t W[80];
 	register uint32_t A, B, C, D, E;
 	int t;
 
+#if VB2_SHA_ARCH
+	if (vb2_sha1_transform_arch(ctx->state, ctx->buf.b, 1))
+		return;
+#endif
+
 	A = ctx->state[0];
 	B = ctx->state[1];
 	C = ctx->state[2];
@@ -186,7 +192,7 @@ uint8_t *vb2_sha1_finalize(struct vb2_sha1_context *ctx)
 
 #define rol(bits, value) (((value) << (bits)) | ((value) >> (32 - (bits))))
 
-static void sha1_transform(struct vb2_sha1_context *ctx)
+static VB2_HOT void sha1_transform(struct vb2_sha1_context *ctx)
 {
 	/* Note that this array uses 80*4=320 bytes of stack */
 	uint32_t W[80];
@@ -194,6 +200,11 @@ static void sha1_transform(struct vb2_sha1_context *ctx)
 	uint8_t *p = ctx->buf;
 	int t;
 
+#if VB2_SHA_ARCH
+	if (vb2_sha1_transform_arch(ctx->state, ctx->buf, 1))
+		return;
+#endif
+
 	for(t = 0; t < 16; ++t) {
 		uint32_t tmp = *p++ << 24;
 		tmp |= *p++ << 16;
@@ -290,3 +301,40 @@ void vb2_sha1_init(struct vb2_sha1_context *ctx)
 	ctx->state[4] = 0xc3d2e1f0;
 	ctx->count = 0;
 }
+
+void vb2_sha1_digest(const uint8_t *data, uint32_t size, uint8_t *digest)
+{
+	struct vb2_sha1_context ctx;
+	uint8_t *buf = (uint8_t *)&ctx.buf;
+	uint32_t size_b = size << 3;
+	int i;
+
+	vb2_sha1_init(&ctx);
+
+	/* Whole blocks, without going through the byte-at-a-time buffer */
+	for (; size >= VB2_SHA1_BLOCK_SIZE; size -= VB2_SHA1_BLOCK_SIZE) {
+		memcpy(buf, data, VB2_SHA1_BLOCK_SIZE);
+		sha1_transform(&ctx);
+		data += VB2_SHA1_BLOCK_SIZE;
+	}
+
+	/* The rest, with padding, fills one or two more blocks */
+	memcpy(buf, data, size);
+	buf[size] = 0x80;
+	memset(buf + size + 1, 0, VB2_SHA1_BLOCK_SIZE - size - 1);
+	if (size > VB2_SHA1_BLOCK_SIZE - 9) {
+		sha1_transform(&ctx);
+		memset(buf, 0, VB2_SHA1_BLOCK_SIZE);
+	}
+	for (i = 0; i < 4; i++)
+		buf[VB2_SHA1_BLOCK_SIZE - 1 - i] = (uint8_t)(size_b >> (8 * i));
+	sha1_transform(&ctx);
+
+	for (i = 0; i < 5; i++) {
+		uint32_t tmp = ctx.state[i];
+		*digest++ = (uint8_t)(tmp >> 24);
+		*digest++ = (uint8_t)(tmp >> 16);
+		*digest++ = (uint8_t)(tmp >> 8);
+		*digest++ = (uint8_t)(tmp >> 0);
+	}
+}
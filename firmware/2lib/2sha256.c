@@ -38,6 +38,7 @@
 #include "2sysincludes.h"
 #include "2common.h"
 #include "2sha.h"
+#include "2sha_private.h"
 
 #define SHFR(x, n)    (x >> n)
 #define ROTR(x, n)   ((x >> n) | (x << ((sizeof(x) << 3) - n)))
@@ -77,7 +78,7 @@
 #define SHA256_EXP(a, b, c, d, e, f, g, h, j)				\
 	{								\
 		t1 = wv[h] + SHA256_F2(wv[e]) + CH(wv[e], wv[f], wv[g]) \
-			+ sha256_k[j] + w[j];				\
+			+ vb2_sha256_k[j] + w[j];				\
 		t2 = SHA256_F1(wv[a]) + MAJ(wv[a], wv[b], wv[c]);       \
 		wv[d] += t1;                                            \
 		wv[h] = t1 + t2;                                        \
@@ -88,7 +89,7 @@ static const uint32_t sha256_h0[8] = {
 	0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
 };
 
-static const uint32_t sha256_k[64] = {
+const uint32_t vb2_sha256_k[64] VB2_HOT_DATA = {
 	0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5,
 	0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
 	0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
@@ -126,9 +127,9 @@ void vb2_sha256_init(struct vb2_sha256_context *ctx)
 	ctx->total_size = 0;
 }
 
-static void vb2_sha256_transform(struct vb2_sha256_context *ctx,
-				 const uint8_t *message,
-				 unsigned int block_nb)
+static VB2_HOT void vb2_sha256_transform(struct vb2_sha256_context *ctx,
+					 const uint8_t *message,
+					 unsigned int block_nb)
 {
 	/* Note that these arrays use 72*4=288 bytes of stack */
 	uint32_t w[64];
@@ -141,6 +142,11 @@ static void vb2_sha256_transform(struct vb2_sha256_context *ctx,
 	int j;
 #endif
 
+#if VB2_SHA_ARCH
+	if (vb2_sha256_transform_arch(ctx->h, message, block_nb))
+		return;
+#endif
+
 	for (i = 0; i < (int) block_nb; i++) {
 		sub_block = message + (i << 6);
 
@@ -159,7 +165,7 @@ static void vb2_sha256_transform(struct vb2_sha256_context *ctx,
 
 		for (j = 0; j < 64; j++) {
 			t1 = wv[7] + SHA256_F2(wv[4]) + CH(wv[4], wv[5], wv[6])
-				+ sha256_k[j] + w[j];
+				+ vb2_sha256_k[j] + w[j];
 			t2 = SHA256_F1(wv[0]) + MAJ(wv[0], wv[1], wv[2]);
 			wv[7] = wv[6];
 			wv[6] = wv[5];
@@ -278,6 +284,38 @@ void vb2_sha256_update(struct vb2_sha256_context *ctx,
 	ctx->total_size += (block_nb + 1) << 6;
 }
 
+void vb2_sha256_update_x4(struct vb2_sha256_context *ctx[VB2_SHA256_LANES],
+			  const uint8_t *const data[VB2_SHA256_LANES],
+			  uint32_t size)
+{
+	int i;
+
+#if VB2_SHA_ARCH
+	unsigned int block_nb = size / VB2_SHA256_BLOCK_SIZE;
+	uint32_t *h[VB2_SHA256_LANES];
+
+	/* Lanes only help if every context can hash straight from data */
+	for (i = 0; i < VB2_SHA256_LANES; i++) {
+		if (ctx[i]->size)
+			break;
+		h[i] = ctx[i]->h;
+	}
+
+	if (i == VB2_SHA256_LANES && block_nb &&
+	    vb2_sha256_transform_x4_arch(h, data, block_nb)) {
+		for (i = 0; i < VB2_SHA256_LANES; i++) {
+			ctx[i]->total_size += block_nb << 6;
+			vb2_sha256_update(ctx[i], data[i] + (block_nb << 6),
+					  size % VB2_SHA256_BLOCK_SIZE);
+		}
+		return;
+	}
+#endif
+
+	for (i = 0; i < VB2_SHA256_LANES; i++)
+		vb2_sha256_update(ctx[i], data[i], size);
+}
+
 void vb2_sha256_finalize(struct vb2_sha256_context *ctx, uint8_t *digest)
 {
 	unsigned int block_nb;
@@ -315,6 +353,32 @@ void vb2_sha256_finalize(struct vb2_sha256_context *ctx, uint8_t *digest)
 #endif /* !UNROLL_LOOPS */
 }
 
+void vb2_sha256_digest(const uint8_t *data, uint32_t size, uint8_t *digest)
+{
+	struct vb2_sha256_context ctx;
+	unsigned int block_nb = size / VB2_SHA256_BLOCK_SIZE;
+	unsigned int rem_size = size % VB2_SHA256_BLOCK_SIZE;
+	unsigned int pm_size;
+	int i;
+
+	vb2_sha256_init(&ctx);
+
+	/* Whole blocks go straight from the data */
+	if (block_nb)
+		vb2_sha256_transform(&ctx, data, block_nb);
+
+	/* The rest, with padding, fills one or two more blocks */
+	pm_size = (1 + ((VB2_SHA256_BLOCK_SIZE - 9) < rem_size)) << 6;
+	memcpy(ctx.block, data + (block_nb << 6), rem_size);
+	memset(ctx.block + rem_size, 0, pm_size - rem_size);
+	ctx.block[rem_size] = 0x80;
+	UNPACK32(size << 3, ctx.block + pm_size - 4);
+	vb2_sha256_transform(&ctx, ctx.block, pm_size >> 6);
+
+	for (i = 0; i < 8; i++)
+		UNPACK32(ctx.h[i], &digest[i << 2]);
+}
+
 void vb2_sha256_extend(const uint8_t *from, const uint8_t *by, uint8_t *to)
 {
 	struct vb2_sha256_context dc;
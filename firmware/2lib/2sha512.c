@@ -90,15 +90,37 @@
 			+ SHA512_F3(w[i - 15]) + w[i - 16];	\
 	}
 
-#define SHA512_EXP(a, b, c, d, e, f, g ,h, j)				\
+/*
+ * Unrolled rounds keep the working variables in locals and only the last 16
+ * schedule words in w[], computing each new word just before the round that
+ * consumes it.
+ */
+#define SHA512_W16(j)							\
+	(w[(j) & 15] += SHA512_F4(w[((j) - 2) & 15]) + w[((j) - 7) & 15] \
+	 + SHA512_F3(w[((j) - 15) & 15]))
+
+#define SHA512_RND(a, b, c, d, e, f, g, h, j, wj)			\
+	{								\
+		t1 = h + SHA512_F2(e) + CH(e, f, g) + sha512_k[j] + (wj); \
+		t2 = SHA512_F1(a) + MAJ(a, b, c);			\
+		d += t1;						\
+		h = t1 + t2;						\
+	}
+
+#define SHA512_RND8(j, W)						\
 	{								\
-		t1 = wv[h] + SHA512_F2(wv[e]) + CH(wv[e], wv[f], wv[g]) \
-			+ sha512_k[j] + w[j];				\
-		t2 = SHA512_F1(wv[a]) + MAJ(wv[a], wv[b], wv[c]);       \
-		wv[d] += t1;                                            \
-		wv[h] = t1 + t2;                                        \
+		SHA512_RND(a, b, c, d, e, f, g, h, (j) + 0, W((j) + 0)); \
+		SHA512_RND(h, a, b, c, d, e, f, g, (j) + 1, W((j) + 1)); \
+		SHA512_RND(g, h, a, b, c, d, e, f, (j) + 2, W((j) + 2)); \
+		SHA512_RND(f, g, h, a, b, c, d, e, (j) + 3, W((j) + 3)); \
+		SHA512_RND(e, f, g, h, a, b, c, d, (j) + 4, W((j) + 4)); \
+		SHA512_RND(d, e, f, g, h, a, b, c, (j) + 5, W((j) + 5)); \
+		SHA512_RND(c, d, e, f, g, h, a, b, (j) + 6, W((j) + 6)); \
+		SHA512_RND(b, c, d, e, f, g, h, a, (j) + 7, W((j) + 7)); \
 	}
 
+#define SHA512_W0(j) (w[j])
+
 static const uint64_t sha512_h0[8] = {
 	0x6a09e667f3bcc908ULL, 0xbb67ae8584caa73bULL,
 	0x3c6ef372fe94f82bULL, 0xa54ff53a5f1d36f1ULL,
@@ -106,7 +128,7 @@ static const uint64_t sha512_h0[8] = {
 	0x1f83d9abfb41bd6bULL, 0x5be0cd19137e2179ULL
 };
 
-static const uint64_t sha512_k[80] = {
+static const uint64_t sha512_k[80] VB2_HOT_DATA = {
 	0x428a2f98d728ae22ULL, 0x7137449123ef65cdULL,
 	0xb5c0fbcfec4d3b2fULL, 0xe9b5dba58189dbbcULL,
 	0x3956c25bf348b538ULL, 0x59f111f1b605d019ULL,
@@ -153,7 +175,7 @@ static const uint64_t sha512_k[80] = {
 
 void vb2_sha512_init(struct vb2_sha512_context *ctx)
 {
-#ifdef UNROLL_LOOPS_SHA512
+#ifdef UNROLL_LOOPS
 	ctx->h[0] = sha512_h0[0]; ctx->h[1] = sha512_h0[1];
 	ctx->h[2] = sha512_h0[2]; ctx->h[3] = sha512_h0[3];
 	ctx->h[4] = sha512_h0[4]; ctx->h[5] = sha512_h0[5];
@@ -163,27 +185,34 @@ void vb2_sha512_init(struct vb2_sha512_context *ctx)
 
 	for (i = 0; i < 8; i++)
 		ctx->h[i] = sha512_h0[i];
-#endif /* UNROLL_LOOPS_SHA512 */
+#endif /* UNROLL_LOOPS */
 
 	ctx->size = 0;
 	ctx->total_size = 0;
 }
 
-static void vb2_sha512_transform(struct vb2_sha512_context *ctx,
-			     const uint8_t *message,
-                             unsigned int block_nb)
+static VB2_HOT void vb2_sha512_transform(struct vb2_sha512_context *ctx,
+					 const uint8_t *message,
+					 unsigned int block_nb)
 {
+#ifdef UNROLL_LOOPS
+	/* Only a 16-word window of the message schedule is kept */
+	uint64_t w[16];
+	uint64_t a, b, c, d, e, f, g, h;
+#else
 	/* Note that these arrays use 88*8=704 bytes of stack */
 	uint64_t w[80];
 	uint64_t wv[8];
+	int j;
+#endif
 	uint64_t t1, t2;
 	const uint8_t *sub_block;
-	int i, j;
+	int i;
 
 	for (i = 0; i < (int) block_nb; i++) {
 		sub_block = message + (i << 7);
 
-#ifdef UNROLL_LOOPS_SHA512
+#ifdef UNROLL_LOOPS
 		PACK64(&sub_block[  0], &w[ 0]);
 		PACK64(&sub_block[  8], &w[ 1]);
 		PACK64(&sub_block[ 16], &w[ 2]);
@@ -201,45 +230,27 @@ static void vb2_sha512_transform(struct vb2_sha512_context *ctx,
 		PACK64(&sub_block[112], &w[14]);
 		PACK64(&sub_block[120], &w[15]);
 
-		SHA512_SCR(16); SHA512_SCR(17); SHA512_SCR(18); SHA512_SCR(19);
-		SHA512_SCR(20); SHA512_SCR(21); SHA512_SCR(22); SHA512_SCR(23);
-		SHA512_SCR(24); SHA512_SCR(25); SHA512_SCR(26); SHA512_SCR(27);
-		SHA512_SCR(28); SHA512_SCR(29); SHA512_SCR(30); SHA512_SCR(31);
-		SHA512_SCR(32); SHA512_SCR(33); SHA512_SCR(34); SHA512_SCR(35);
-		SHA512_SCR(36); SHA512_SCR(37); SHA512_SCR(38); SHA512_SCR(39);
-		SHA512_SCR(40); SHA512_SCR(41); SHA512_SCR(42); SHA512_SCR(43);
-		SHA512_SCR(44); SHA512_SCR(45); SHA512_SCR(46); SHA512_SCR(47);
-		SHA512_SCR(48); SHA512_SCR(49); SHA512_SCR(50); SHA512_SCR(51);
-		SHA512_SCR(52); SHA512_SCR(53); SHA512_SCR(54); SHA512_SCR(55);
-		SHA512_SCR(56); SHA512_SCR(57); SHA512_SCR(58); SHA512_SCR(59);
-		SHA512_SCR(60); SHA512_SCR(61); SHA512_SCR(62); SHA512_SCR(63);
-		SHA512_SCR(64); SHA512_SCR(65); SHA512_SCR(66); SHA512_SCR(67);
-		SHA512_SCR(68); SHA512_SCR(69); SHA512_SCR(70); SHA512_SCR(71);
-		SHA512_SCR(72); SHA512_SCR(73); SHA512_SCR(74); SHA512_SCR(75);
-		SHA512_SCR(76); SHA512_SCR(77); SHA512_SCR(78); SHA512_SCR(79);
-
-		wv[0] = ctx->h[0]; wv[1] = ctx->h[1];
-		wv[2] = ctx->h[2]; wv[3] = ctx->h[3];
-		wv[4] = ctx->h[4]; wv[5] = ctx->h[5];
-		wv[6] = ctx->h[6]; wv[7] = ctx->h[7];
-
-		j = 0;
-
-		do {
-			SHA512_EXP(0,1,2,3,4,5,6,7,j); j++;
-			SHA512_EXP(7,0,1,2,3,4,5,6,j); j++;
-			SHA512_EXP(6,7,0,1,2,3,4,5,j); j++;
-			SHA512_EXP(5,6,7,0,1,2,3,4,j); j++;
-			SHA512_EXP(4,5,6,7,0,1,2,3,j); j++;
-			SHA512_EXP(3,4,5,6,7,0,1,2,j); j++;
-			SHA512_EXP(2,3,4,5,6,7,0,1,j); j++;
-			SHA512_EXP(1,2,3,4,5,6,7,0,j); j++;
-		} while (j < 80);
-
-		ctx->h[0] += wv[0]; ctx->h[1] += wv[1];
-		ctx->h[2] += wv[2]; ctx->h[3] += wv[3];
-		ctx->h[4] += wv[4]; ctx->h[5] += wv[5];
-		ctx->h[6] += wv[6]; ctx->h[7] += wv[7];
+		a = ctx->h[0]; b = ctx->h[1];
+		c = ctx->h[2]; d = ctx->h[3];
+		e = ctx->h[4]; f = ctx->h[5];
+		g = ctx->h[6]; h = ctx->h[7];
+
+		SHA512_RND8(0, SHA512_W0);
+		SHA512_RND8(8, SHA512_W0);
+
+		SHA512_RND8(16, SHA512_W16);
+		SHA512_RND8(24, SHA512_W16);
+		SHA512_RND8(32, SHA512_W16);
+		SHA512_RND8(40, SHA512_W16);
+		SHA512_RND8(48, SHA512_W16);
+		SHA512_RND8(56, SHA512_W16);
+		SHA512_RND8(64, SHA512_W16);
+		SHA512_RND8(72, SHA512_W16);
+
+		ctx->h[0] += a; ctx->h[1] += b;
+		ctx->h[2] += c; ctx->h[3] += d;
+		ctx->h[4] += e; ctx->h[5] += f;
+		ctx->h[6] += g; ctx->h[7] += h;
 #else
 		for (j = 0; j < 16; j++) {
 			PACK64(&sub_block[j << 3], &w[j]);
@@ -269,7 +280,7 @@ static void vb2_sha512_transform(struct vb2_sha512_context *ctx,
 
 		for (j = 0; j < 8; j++)
 			ctx->h[j] += wv[j];
-#endif /* UNROLL_LOOPS_SHA512 */
+#endif /* UNROLL_LOOPS */
 	}
 }
 
@@ -314,7 +325,7 @@ void vb2_sha512_finalize(struct vb2_sha512_context *ctx, uint8_t *digest)
 	unsigned int pm_size;
 	unsigned int size_b;
 
-#ifndef UNROLL_LOOPS_SHA512
+#ifndef UNROLL_LOOPS
 	int i;
 #endif
 
@@ -330,7 +341,7 @@ void vb2_sha512_finalize(struct vb2_sha512_context *ctx, uint8_t *digest)
 
 	vb2_sha512_transform(ctx, ctx->block, block_nb);
 
-#ifdef UNROLL_LOOPS_SHA512
+#ifdef UNROLL_LOOPS
 	UNPACK64(ctx->h[0], &digest[ 0]);
 	UNPACK64(ctx->h[1], &digest[ 8]);
 	UNPACK64(ctx->h[2], &digest[16]);
@@ -342,5 +353,31 @@ void vb2_sha512_finalize(struct vb2_sha512_context *ctx, uint8_t *digest)
 #else
 	for (i = 0 ; i < 8; i++)
 		UNPACK64(ctx->h[i], &digest[i << 3]);
-#endif /* UNROLL_LOOPS_SHA512 */
+#endif /* UNROLL_LOOPS */
+}
+
+void vb2_sha512_digest(const uint8_t *data, uint32_t size, uint8_t *digest)
+{
+	struct vb2_sha512_context ctx;
+	unsigned int block_nb = size / VB2_SHA512_BLOCK_SIZE;
+	unsigned int rem_size = size % VB2_SHA512_BLOCK_SIZE;
+	unsigned int pm_size;
+	int i;
+
+	vb2_sha512_init(&ctx);
+
+	/* Whole blocks go straight from the data */
+	if (block_nb)
+		vb2_sha512_transform(&ctx, data, block_nb);
+
+	/* The rest, with padding, fills one or two more blocks */
+	pm_size = (1 + ((VB2_SHA512_BLOCK_SIZE - 17) < rem_size)) << 7;
+	memcpy(ctx.block, data + (block_nb << 7), rem_size);
+	memset(ctx.block + rem_size, 0, pm_size - rem_size);
+	ctx.block[rem_size] = 0x80;
+	UNPACK32(size << 3, ctx.block + pm_size - 4);
+	vb2_sha512_transform(&ctx, ctx.block, pm_size >> 7);
+
+	for (i = 0; i < 8; i++)
+		UNPACK64(ctx.h[i], &digest[i << 3]);
 }
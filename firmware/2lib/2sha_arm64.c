@@ -0,0 +1,131 @@
+/* Copyright 2018 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ *
+ * SHA-1 and SHA-256 block transforms using the ARMv8 Cryptography
+ * Extensions.  There is no portable way to probe for these from firmware,
+ * so this file is only built (SHA_ARCH=arm64) for targets known to have
+ * them.
+ */
+
+#include <arm_neon.h>
+
+#include "2sysincludes.h"
+#include "2common.h"
+#include "2sha.h"
+#include "2sha_private.h"
+
+static const uint32_t sha1_k[4] VB2_HOT_DATA = {
+	0x5a827999, 0x6ed9eba1, 0x8f1bbcdc, 0xca62c1d6
+};
+
+static uint32x4_t load_be32x4(const uint8_t *p)
+{
+	return vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(p)));
+}
+
+VB2_HOT
+int vb2_sha256_transform_arch(uint32_t *h, const uint8_t *message,
+			      unsigned int block_nb)
+{
+	uint32x4_t state0, state1, abef_save, cdgh_save, save, tmp;
+	uint32x4_t w[4];
+	int g;
+
+	state0 = vld1q_u32(&h[0]);
+	state1 = vld1q_u32(&h[4]);
+
+	for (; block_nb; block_nb--, message += VB2_SHA256_BLOCK_SIZE) {
+		abef_save = state0;
+		cdgh_save = state1;
+
+		for (g = 0; g < 4; g++)
+			w[g] = load_be32x4(message + 16 * g);
+
+		/* Each pass does 4 rounds on message words 4g..4g+3 */
+		for (g = 0; g < 16; g++) {
+			tmp = vaddq_u32(w[g & 3], vld1q_u32(&vb2_sha256_k[4 * g]));
+
+			save = state0;
+			state0 = vsha256hq_u32(state0, state1, tmp);
+			state1 = vsha256h2q_u32(state1, save, tmp);
+
+			/* Replace words 4g.. with words 4(g+4).. */
+			if (g < 12)
+				w[g & 3] = vsha256su1q_u32(
+					vsha256su0q_u32(w[g & 3],
+							w[(g + 1) & 3]),
+					w[(g + 2) & 3], w[(g + 3) & 3]);
+		}
+
+		state0 = vaddq_u32(state0, abef_save);
+		state1 = vaddq_u32(state1, cdgh_save);
+	}
+
+	vst1q_u32(&h[0], state0);
+	vst1q_u32(&h[4], state1);
+	return 1;
+}
+
+VB2_HOT
+int vb2_sha1_transform_arch(uint32_t *state, const uint8_t *message,
+			    unsigned int block_nb)
+{
+	uint32x4_t abcd, abcd_save, tmp;
+	uint32x4_t w[4];
+	uint32_t e, e_next, e_save;
+	int g;
+
+	abcd = vld1q_u32(state);
+	e = state[4];
+
+	for (; block_nb; block_nb--, message += VB2_SHA1_BLOCK_SIZE) {
+		abcd_save = abcd;
+		e_save = e;
+
+		for (g = 0; g < 4; g++)
+			w[g] = load_be32x4(message + 16 * g);
+
+		/* Each pass does 4 rounds on message words 4g..4g+3 */
+		for (g = 0; g < 20; g++) {
+			tmp = vaddq_u32(w[g & 3], vdupq_n_u32(sha1_k[g / 5]));
+			e_next = vsha1h_u32(vgetq_lane_u32(abcd, 0));
+
+			/* The round function changes every 20 rounds */
+			switch (g / 5) {
+			case 0:
+				abcd = vsha1cq_u32(abcd, e, tmp);
+				break;
+			case 2:
+				abcd = vsha1mq_u32(abcd, e, tmp);
+				break;
+			default:
+				abcd = vsha1pq_u32(abcd, e, tmp);
+				break;
+			}
+			e = e_next;
+
+			/* Replace words 4g.. with words 4(g+4).. */
+			if (g < 16)
+				w[g & 3] = vsha1su1q_u32(
+					vsha1su0q_u32(w[g & 3], w[(g + 1) & 3],
+						      w[(g + 2) & 3]),
+					w[(g + 3) & 3]);
+		}
+
+		abcd = vaddq_u32(abcd, abcd_save);
+		e += e_save;
+	}
+
+	vst1q_u32(state, abcd);
+	state[4] = e;
+	return 1;
+}
+
+int vb2_sha256_transform_x4_arch(uint32_t *const h[4],
+				 const uint8_t *const message[4],
+				 unsigned int block_nb)
+{
+	/* The crypto extensions beat 4-lane NEON; hash each lane in turn */
+	return 0;
+}
@@ -56,46 +56,157 @@ enum vb2_hash_algorithm vb2_crypto_to_hash(uint32_t algorithm)
 		return VB2_HASH_INVALID;
 }
 
-int vb2_digest_size(enum vb2_hash_algorithm hash_alg)
-{
-	switch (hash_alg) {
 #if VB2_SUPPORT_SHA1
-	case VB2_HASH_SHA1:
-		return VB2_SHA1_DIGEST_SIZE;
+static void sha1_init(struct vb2_digest_context *dc)
+{
+	vb2_sha1_init(&dc->sha1);
+}
+
+static void sha1_update(struct vb2_digest_context *dc,
+			const uint8_t *buf, uint32_t size)
+{
+	vb2_sha1_update(&dc->sha1, buf, size);
+}
+
+static void sha1_finalize(struct vb2_digest_context *dc, uint8_t *digest)
+{
+	vb2_sha1_finalize(&dc->sha1, digest);
+}
+
+static const struct vb2_hash_ops sha1_ops = {
+	.hash_alg = VB2_HASH_SHA1,
+	.digest_size = VB2_SHA1_DIGEST_SIZE,
+	.block_size = VB2_SHA1_BLOCK_SIZE,
+	.init = sha1_init,
+	.update = sha1_update,
+	.finalize = sha1_finalize,
+	.digest = vb2_sha1_digest,
+};
 #endif
+
 #if VB2_SUPPORT_SHA256
-	case VB2_HASH_SHA256:
-		return VB2_SHA256_DIGEST_SIZE;
+static void sha256_init(struct vb2_digest_context *dc)
+{
+	vb2_sha256_init(&dc->sha256);
+}
+
+static void sha256_update(struct vb2_digest_context *dc,
+			  const uint8_t *buf, uint32_t size)
+{
+	vb2_sha256_update(&dc->sha256, buf, size);
+}
+
+static void sha256_finalize(struct vb2_digest_context *dc, uint8_t *digest)
+{
+	vb2_sha256_finalize(&dc->sha256, digest);
+}
+
+static const struct vb2_hash_ops sha256_ops = {
+	.hash_alg = VB2_HASH_SHA256,
+	.digest_size = VB2_SHA256_DIGEST_SIZE,
+	.block_size = VB2_SHA256_BLOCK_SIZE,
+	.init = sha256_init,
+	.update = sha256_update,
+	.finalize = sha256_finalize,
+	.digest = vb2_sha256_digest,
+};
 #endif
+
 #if VB2_SUPPORT_SHA512
-	case VB2_HASH_SHA512:
-		return VB2_SHA512_DIGEST_SIZE;
-#endif
-	default:
-		return 0;
-	}
+static void sha512_init(struct vb2_digest_context *dc)
+{
+	vb2_sha512_init(&dc->sha512);
 }
 
-int vb2_hash_block_size(enum vb2_hash_algorithm alg)
+static void sha512_update(struct vb2_digest_context *dc,
+			  const uint8_t *buf, uint32_t size)
 {
-	switch (alg) {
+	vb2_sha512_update(&dc->sha512, buf, size);
+}
+
+static void sha512_finalize(struct vb2_digest_context *dc, uint8_t *digest)
+{
+	vb2_sha512_finalize(&dc->sha512, digest);
+}
+
+static const struct vb2_hash_ops sha512_ops = {
+	.hash_alg = VB2_HASH_SHA512,
+	.digest_size = VB2_SHA512_DIGEST_SIZE,
+	.block_size = VB2_SHA512_BLOCK_SIZE,
+	.init = sha512_init,
+	.update = sha512_update,
+	.finalize = sha512_finalize,
+	.digest = vb2_sha512_digest,
+};
+#endif
+
+/**
+ * Look up the operations for a hash algorithm.
+ *
+ * @param hash_alg	Hash algorithm
+ * @return The operations, or NULL if the algorithm isn't supported.
+ */
+static const struct vb2_hash_ops *find_ops(enum vb2_hash_algorithm hash_alg)
+{
+	switch (hash_alg) {
 #if VB2_SUPPORT_SHA1
 	case VB2_HASH_SHA1:
-		return VB2_SHA1_BLOCK_SIZE;
+		return &sha1_ops;
 #endif
 #if VB2_SUPPORT_SHA256
 	case VB2_HASH_SHA256:
-		return VB2_SHA256_BLOCK_SIZE;
+		return &sha256_ops;
 #endif
 #if VB2_SUPPORT_SHA512
 	case VB2_HASH_SHA512:
-		return VB2_SHA512_BLOCK_SIZE;
+		return &sha512_ops;
 #endif
 	default:
-		return 0;
+		return NULL;
 	}
 }
 
+#if VB2_HASH_SINGLE_ALG
+#if VB2_SUPPORT_SHA1
+#define single_ops sha1_ops
+#elif VB2_SUPPORT_SHA256
+#define single_ops sha256_ops
+#else
+#define single_ops sha512_ops
+#endif
+#endif
+
+/**
+ * Return the operations an initialized digest context was set up with.
+ *
+ * hash_alg stays authoritative; the ops are only used if they still match
+ * it.  In a single-algorithm build this is a compile-time constant, so the
+ * calls through it become direct calls.
+ */
+static const struct vb2_hash_ops *
+digest_ops(const struct vb2_digest_context *dc)
+{
+#if VB2_HASH_SINGLE_ALG
+	return dc->hash_alg == single_ops.hash_alg ? &single_ops : NULL;
+#else
+	return dc->ops && dc->ops->hash_alg == dc->hash_alg ? dc->ops : NULL;
+#endif
+}
+
+int vb2_digest_size(enum vb2_hash_algorithm hash_alg)
+{
+	const struct vb2_hash_ops *ops = find_ops(hash_alg);
+
+	return ops ? ops->digest_size : 0;
+}
+
+int vb2_hash_block_size(enum vb2_hash_algorithm alg)
+{
+	const struct vb2_hash_ops *ops = find_ops(alg);
+
+	return ops ? ops->block_size : 0;
+}
+
 const char *vb2_get_hash_algorithm_name(enum vb2_hash_algorithm alg)
 {
 	switch (alg) {
@@ -119,81 +230,47 @@ const char *vb2_get_hash_algorithm_name(enum vb2_hash_algorithm alg)
 int vb2_digest_init(struct vb2_digest_context *dc,
 		    enum vb2_hash_algorithm hash_alg)
 {
+	const struct vb2_hash_ops *ops = find_ops(hash_alg);
+
 	dc->hash_alg = hash_alg;
 	dc->using_hwcrypto = 0;
-
-	switch (dc->hash_alg) {
-#if VB2_SUPPORT_SHA1
-	case VB2_HASH_SHA1:
-		vb2_sha1_init(&dc->sha1);
-		return VB2_SUCCESS;
+#if !VB2_HASH_SINGLE_ALG
+	dc->ops = ops;
 #endif
-#if VB2_SUPPORT_SHA256
-	case VB2_HASH_SHA256:
-		vb2_sha256_init(&dc->sha256);
-		return VB2_SUCCESS;
-#endif
-#if VB2_SUPPORT_SHA512
-	case VB2_HASH_SHA512:
-		vb2_sha512_init(&dc->sha512);
-		return VB2_SUCCESS;
-#endif
-	default:
+
+	if (!ops)
 		return VB2_ERROR_SHA_INIT_ALGORITHM;
-	}
+
+	ops->init(dc);
+	return VB2_SUCCESS;
 }
 
 int vb2_digest_extend(struct vb2_digest_context *dc,
 		      const uint8_t *buf,
 		      uint32_t size)
 {
-	switch (dc->hash_alg) {
-#if VB2_SUPPORT_SHA1
-	case VB2_HASH_SHA1:
-		vb2_sha1_update(&dc->sha1, buf, size);
-		return VB2_SUCCESS;
-#endif
-#if VB2_SUPPORT_SHA256
-	case VB2_HASH_SHA256:
-		vb2_sha256_update(&dc->sha256, buf, size);
-		return VB2_SUCCESS;
-#endif
-#if VB2_SUPPORT_SHA512
-	case VB2_HASH_SHA512:
-		vb2_sha512_update(&dc->sha512, buf, size);
-		return VB2_SUCCESS;
-#endif
-	default:
+	const struct vb2_hash_ops *ops = digest_ops(dc);
+
+	if (!ops)
 		return VB2_ERROR_SHA_EXTEND_ALGORITHM;
-	}
+
+	ops->update(dc, buf, size);
+	return VB2_SUCCESS;
 }
 
 int vb2_digest_finalize(struct vb2_digest_context *dc,
 			uint8_t *digest,
 			uint32_t digest_size)
 {
-	if (digest_size < vb2_digest_size(dc->hash_alg))
-		return VB2_ERROR_SHA_FINALIZE_DIGEST_SIZE;
+	const struct vb2_hash_ops *ops = digest_ops(dc);
 
-	switch (dc->hash_alg) {
-#if VB2_SUPPORT_SHA1
-	case VB2_HASH_SHA1:
-		vb2_sha1_finalize(&dc->sha1, digest);
-		return VB2_SUCCESS;
-#endif
-#if VB2_SUPPORT_SHA256
-	case VB2_HASH_SHA256:
-		vb2_sha256_finalize(&dc->sha256, digest);
-		return VB2_SUCCESS;
-#endif
-#if VB2_SUPPORT_SHA512
-	case VB2_HASH_SHA512:
-		vb2_sha512_finalize(&dc->sha512, digest);
-		return VB2_SUCCESS;
-#endif
-	default:
+	if (!ops)
 		return VB2_ERROR_SHA_FINALIZE_ALGORITHM;
-	}
+	if (digest_size < ops->digest_size)
+		return VB2_ERROR_SHA_FINALIZE_DIGEST_SIZE;
+
+	ops->finalize(dc, digest);
+	return VB2_SUCCESS;
 }
 
 int vb2_digest_buffer(const uint8_t *buf,
@@ -202,16 +279,115 @@ int vb2_digest_buffer(const uint8_t *buf,
 		      uint8_t *digest,
 		      uint32_t digest_size)
 {
-	struct vb2_digest_context dc;
+	const struct vb2_hash_ops *ops = find_ops(hash_alg);
+
+	if (!ops)
+		return VB2_ERROR_SHA_INIT_ALGORITHM;
+	if (digest_size < ops->digest_size)
+		return VB2_ERROR_SHA_FINALIZE_DIGEST_SIZE;
+
+	/* No context buffering is needed for the whole buffer at once */
+	ops->digest(buf, size, digest);
+	return VB2_SUCCESS;
+}
+
+int vb2_digest_multi_init(struct vb2_digest_context *dc,
+			  int count,
+			  enum vb2_hash_algorithm hash_alg)
+{
+	int i, rv;
+
+	for (i = 0; i < count; i++) {
+		rv = vb2_digest_init(&dc[i], hash_alg);
+		if (rv)
+			return rv;
+	}
+
+	return VB2_SUCCESS;
+}
+
+int vb2_digest_multi_extend(struct vb2_digest_context *dc,
+			    int count,
+			    const uint8_t *const *bufs,
+			    uint32_t size)
+{
+	int i = 0;
 	int rv;
 
-	rv = vb2_digest_init(&dc, hash_alg);
-	if (rv)
-		return rv;
+#if VB2_SUPPORT_SHA256
+	struct vb2_sha256_context *ctx[VB2_SHA256_LANES];
+	int j;
+
+	for (; i + VB2_SHA256_LANES <= count; i += VB2_SHA256_LANES) {
+		for (j = 0; j < VB2_SHA256_LANES; j++) {
+			if (dc[i + j].hash_alg != VB2_HASH_SHA256)
+				break;
+			ctx[j] = &dc[i + j].sha256;
+		}
+		if (j < VB2_SHA256_LANES)
+			break;
 
-	rv = vb2_digest_extend(&dc, buf, size);
-	if (rv)
-		return rv;
+		vb2_sha256_update_x4(ctx, bufs + i, size);
+	}
+#endif
+
+	/* Everything else is hashed one context at a time */
+	for (; i < count; i++) {
+		rv = vb2_digest_extend(&dc[i], bufs[i], size);
+		if (rv)
+			return rv;
+	}
+
+	return VB2_SUCCESS;
+}
+
+int vb2_digest_multi_finalize(struct vb2_digest_context *dc,
+			      int count,
+			      uint8_t *digests,
+			      uint32_t digest_size)
+{
+	int i, rv;
+
+	for (i = 0; i < count; i++) {
+		rv = vb2_digest_finalize(&dc[i], digests + i * digest_size,
+					 digest_size);
+		if (rv)
+			return rv;
+	}
+
+	return VB2_SUCCESS;
+}
+
+int vb2_digest_multi_buffer(const uint8_t *const *bufs,
+			    uint32_t size,
+			    int count,
+			    enum vb2_hash_algorithm hash_alg,
+			    uint8_t *digests,
+			    uint32_t digest_size)
+{
+	struct vb2_digest_context dc[VB2_SHA256_LANES];
+	int i, n, rv;
+
+	/* Hash one group of lanes at a time to bound stack use */
+	for (i = 0; i < count; i += n) {
+		n = count - i;
+		if (n > VB2_SHA256_LANES)
+			n = VB2_SHA256_LANES;
+
+		rv = vb2_digest_multi_init(dc, n, hash_alg);
+		if (rv)
+			return rv;
+
+		rv = vb2_digest_multi_extend(dc, n, bufs + i, size);
+		if (rv)
+			return rv;
+
+		rv = vb2_digest_multi_finalize(dc, n,
+					       digests + i * digest_size,
+					       digest_size);
+		if (rv)
+			return rv;
+	}
 
-	return vb2_digest_finalize(&dc, digest, digest_size);
+	return VB2_SUCCESS;
 }
@@ -0,0 +1,337 @@
+/* Copyright 2018 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ *
+ * SHA-1 and SHA-256 block transforms using the x86 SHA extensions (SHA-NI).
+ * Support is detected at runtime with CPUID, so this is safe to build into
+ * images that also run on CPUs without SHA-NI.  On those CPUs, a 4-lane
+ * SSE2 SHA-256 transform is used for multi-buffer hashing.
+ */
+
+#include <immintrin.h>
+
+#include "2sysincludes.h"
+#include "2common.h"
+#include "2sha.h"
+#include "2sha_private.h"
+
+#define SHA_NI_TARGET __attribute__((target("sha,sse4.1,ssse3")))
+#define SSE2_TARGET __attribute__((target("sse2")))
+
+static void cpuid(uint32_t leaf, uint32_t subleaf, uint32_t *eax,
+		  uint32_t *ebx, uint32_t *ecx, uint32_t *edx)
+{
+	__asm__ volatile("cpuid"
+			 : "=a" (*eax), "=b" (*ebx), "=c" (*ecx), "=d" (*edx)
+			 : "a" (leaf), "c" (subleaf));
+}
+
+/**
+ * Return non-zero if the CPU supports SHA-NI and the SSE levels it needs.
+ */
+static int have_sha_ni(void)
+{
+	static int cached = -1;
+	uint32_t eax, ebx, ecx, edx;
+
+	if (cached >= 0)
+		return cached;
+
+	cached = 0;
+	cpuid(0, 0, &eax, &ebx, &ecx, &edx);
+	if (eax < 7)
+		return cached;
+
+	/* SSSE3 and SSE4.1 */
+	cpuid(1, 0, &eax, &ebx, &ecx, &edx);
+	if (!(ecx & (1 << 9)) || !(ecx & (1 << 19)))
+		return cached;
+
+	/* SHA */
+	cpuid(7, 0, &eax, &ebx, &ecx, &edx);
+	cached = !!(ebx & (1 << 29));
+	return cached;
+}
+
+SHA_NI_TARGET
+static VB2_HOT void sha256_ni(uint32_t *h, const uint8_t *message,
+			      unsigned int block_nb)
+{
+	const __m128i bswap = _mm_set_epi64x(0x0c0d0e0f08090a0bULL,
+					     0x0405060700010203ULL);
+	__m128i state0, state1, abef_save, cdgh_save, msg, tmp;
+	__m128i w[4];
+	int g;
+
+	/* Rearrange state into the ABEF / CDGH order the instructions use */
+	tmp = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)&h[0]), 0xB1);
+	state1 = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)&h[4]),
+				   0x1B);
+	state0 = _mm_alignr_epi8(tmp, state1, 8);
+	state1 = _mm_blend_epi16(state1, tmp, 0xF0);
+
+	for (; block_nb; block_nb--, message += VB2_SHA256_BLOCK_SIZE) {
+		abef_save = state0;
+		cdgh_save = state1;
+
+		/* Each pass does 4 rounds on message words 4g..4g+3 */
+		for (g = 0; g < 16; g++) {
+			__m128i *cur = &w[g & 3];
+
+			if (g < 4)
+				*cur = _mm_shuffle_epi8(_mm_loadu_si128(
+					(const __m128i *)(message + 16 * g)),
+							bswap);
+
+			msg = _mm_add_epi32(*cur, _mm_loadu_si128(
+				(const __m128i *)&vb2_sha256_k[4 * g]));
+			state1 = _mm_sha256rnds2_epu32(state1, state0, msg);
+
+			/* Finish the schedule for words 4(g+1)... */
+			if (g >= 3 && g < 15) {
+				__m128i *next = &w[(g + 1) & 3];
+
+				tmp = _mm_alignr_epi8(*cur, w[(g - 1) & 3], 4);
+				*next = _mm_add_epi32(*next, tmp);
+				*next = _mm_sha256msg2_epu32(*next, *cur);
+			}
+
+			msg = _mm_shuffle_epi32(msg, 0x0E);
+			state0 = _mm_sha256rnds2_epu32(state0, state1, msg);
+
+			/* ...and start it for words 4(g+3) */
+			if (g >= 1 && g < 13)
+				w[(g - 1) & 3] = _mm_sha256msg1_epu32(
+					w[(g - 1) & 3], *cur);
+		}
+
+		state0 = _mm_add_epi32(state0, abef_save);
+		state1 = _mm_add_epi32(state1, cdgh_save);
+	}
+
+	/* Back to ABCD / EFGH order */
+	tmp = _mm_shuffle_epi32(state0, 0x1B);
+	state1 = _mm_shuffle_epi32(state1, 0xB1);
+	state0 = _mm_blend_epi16(tmp, state1, 0xF0);
+	state1 = _mm_alignr_epi8(state1, tmp, 8);
+
+	_mm_storeu_si128((__m128i *)&h[0], state0);
+	_mm_storeu_si128((__m128i *)&h[4], state1);
+}
+
+SHA_NI_TARGET
+static VB2_HOT void sha1_ni(uint32_t *state, const uint8_t *message,
+			    unsigned int block_nb)
+{
+	const __m128i bswap = _mm_set_epi64x(0x0001020304050607ULL,
+					     0x08090a0b0c0d0e0fULL);
+	__m128i abcd, abcd_save, e0, e0_save, e1 = _mm_setzero_si128();
+	__m128i w[4];
+	int g;
+
+	abcd = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)state),
+				 0x1B);
+	e0 = _mm_set_epi32(state[4], 0, 0, 0);
+
+	for (; block_nb; block_nb--, message += VB2_SHA1_BLOCK_SIZE) {
+		abcd_save = abcd;
+		e0_save = e0;
+
+		/* Each pass does 4 rounds on message words 4g..4g+3 */
+		for (g = 0; g < 20; g++) {
+			__m128i *cur = &w[g & 3];
+
+			if (g < 4)
+				*cur = _mm_shuffle_epi8(_mm_loadu_si128(
+					(const __m128i *)(message + 16 * g)),
+							bswap);
+
+			/* Alternate between the two E registers */
+			if (g == 0)
+				e0 = _mm_add_epi32(e0, *cur);
+			else if (g & 1)
+				e1 = _mm_sha1nexte_epu32(e1, *cur);
+			else
+				e0 = _mm_sha1nexte_epu32(e0, *cur);
+
+			/* Schedule words 4(g+1), 4(g+2) and 4(g+3) */
+			if (g >= 3 && g < 19)
+				w[(g + 1) & 3] = _mm_sha1msg2_epu32(
+					w[(g + 1) & 3], *cur);
+			if (g >= 2 && g < 18)
+				w[(g + 2) & 3] = _mm_xor_si128(
+					w[(g + 2) & 3], *cur);
+			if (g >= 1 && g < 17)
+				w[(g + 3) & 3] = _mm_sha1msg1_epu32(
+					w[(g + 3) & 3], *cur);
+
+			/* The round function changes every 20 rounds */
+			if (g & 1) {
+				e0 = abcd;
+				switch (g / 5) {
+				case 0:
+					abcd = _mm_sha1rnds4_epu32(abcd, e1, 0);
+					break;
+				case 1:
+					abcd = _mm_sha1rnds4_epu32(abcd, e1, 1);
+					break;
+				case 2:
+					abcd = _mm_sha1rnds4_epu32(abcd, e1, 2);
+					break;
+				default:
+					abcd = _mm_sha1rnds4_epu32(abcd, e1, 3);
+					break;
+				}
+			} else {
+				e1 = abcd;
+				switch (g / 5) {
+				case 0:
+					abcd = _mm_sha1rnds4_epu32(abcd, e0, 0);
+					break;
+				case 1:
+					abcd = _mm_sha1rnds4_epu32(abcd, e0, 1);
+					break;
+				case 2:
+					abcd = _mm_sha1rnds4_epu32(abcd, e0, 2);
+					break;
+				default:
+					abcd = _mm_sha1rnds4_epu32(abcd, e0, 3);
+					break;
+				}
+			}
+		}
+
+		e0 = _mm_sha1nexte_epu32(e0, e0_save);
+		abcd = _mm_add_epi32(abcd, abcd_save);
+	}
+
+	_mm_storeu_si128((__m128i *)state, _mm_shuffle_epi32(abcd, 0x1B));
+	state[4] = _mm_extract_epi32(e0, 3);
+}
+
+/*
+ * 4-lane SHA-256 using SSE2.  Each __m128i holds the same state or schedule
+ * word for four independent messages.
+ */
+#define X4_ROTR(x, n) \
+	_mm_or_si128(_mm_srli_epi32(x, n), _mm_slli_epi32(x, 32 - (n)))
+#define X4_CH(x, y, z) \
+	_mm_xor_si128(_mm_and_si128(x, y), _mm_andnot_si128(x, z))
+#define X4_MAJ(x, y, z) \
+	_mm_or_si128(_mm_and_si128(x, y), _mm_and_si128(z, _mm_or_si128(x, y)))
+
+#define X4_F1(x) _mm_xor_si128(_mm_xor_si128(X4_ROTR(x, 2), X4_ROTR(x, 13)), \
+			       X4_ROTR(x, 22))
+#define X4_F2(x) _mm_xor_si128(_mm_xor_si128(X4_ROTR(x, 6), X4_ROTR(x, 11)), \
+			       X4_ROTR(x, 25))
+#define X4_F3(x) _mm_xor_si128(_mm_xor_si128(X4_ROTR(x, 7), X4_ROTR(x, 18)), \
+			       _mm_srli_epi32(x, 3))
+#define X4_F4(x) _mm_xor_si128(_mm_xor_si128(X4_ROTR(x, 17), X4_ROTR(x, 19)), \
+			       _mm_srli_epi32(x, 10))
+
+#define X4_ADD3(x, y, z) _mm_add_epi32(_mm_add_epi32(x, y), z)
+
+#define X4_RND(a, b, c, d, e, f, g, h, j)				\
+	{								\
+		if ((j) < 16)						\
+			w[(j) & 15] = _mm_set_epi32(			\
+				be32(message[3] + off + 4 * (j)),	\
+				be32(message[2] + off + 4 * (j)),	\
+				be32(message[1] + off + 4 * (j)),	\
+				be32(message[0] + off + 4 * (j)));	\
+		else							\
+			w[(j) & 15] = X4_ADD3(				\
+				_mm_add_epi32(X4_F4(w[((j) - 2) & 15]), \
+					      w[((j) - 7) & 15]),	\
+				X4_F3(w[((j) - 15) & 15]), w[(j) & 15]); \
+		t1 = X4_ADD3(_mm_add_epi32(h, X4_F2(e)), X4_CH(e, f, g), \
+			     _mm_add_epi32(w[(j) & 15],			\
+					   _mm_set1_epi32(vb2_sha256_k[j]))); \
+		t2 = _mm_add_epi32(X4_F1(a), X4_MAJ(a, b, c));		\
+		d = _mm_add_epi32(d, t1);				\
+		h = _mm_add_epi32(t1, t2);				\
+	}
+
+static uint32_t be32(const uint8_t *p)
+{
+	return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) |
+		((uint32_t)p[2] << 8) | p[3];
+}
+
+SSE2_TARGET VB2_HOT
+void vb2_sha256_transform_x4_sse2(uint32_t *const h[4],
+				  const uint8_t *const message[4],
+				  unsigned int block_nb)
+{
+	__m128i s[8], w[16], t1, t2;
+	__m128i a, b, c, d, e, f, g, hh;
+	uint32_t lanes[4] __attribute__((aligned(16)));
+	unsigned int off;
+	int i, j;
+
+	for (i = 0; i < 8; i++)
+		s[i] = _mm_set_epi32(h[3][i], h[2][i], h[1][i], h[0][i]);
+
+	for (off = 0; block_nb; block_nb--, off += VB2_SHA256_BLOCK_SIZE) {
+		a = s[0]; b = s[1]; c = s[2]; d = s[3];
+		e = s[4]; f = s[5]; g = s[6]; hh = s[7];
+
+		for (j = 0; j < 64; j += 8) {
+			X4_RND(a, b, c, d, e, f, g, hh, j + 0);
+			X4_RND(hh, a, b, c, d, e, f, g, j + 1);
+			X4_RND(g, hh, a, b, c, d, e, f, j + 2);
+			X4_RND(f, g, hh, a, b, c, d, e, j + 3);
+			X4_RND(e, f, g, hh, a, b, c, d, j + 4);
+			X4_RND(d, e, f, g, hh, a, b, c, j + 5);
+			X4_RND(c, d, e, f, g, hh, a, b, j + 6);
+			X4_RND(b, c, d, e, f, g, hh, a, j + 7);
+		}
+
+		s[0] = _mm_add_epi32(s[0], a);
+		s[1] = _mm_add_epi32(s[1], b);
+		s[2] = _mm_add_epi32(s[2], c);
+		s[3] = _mm_add_epi32(s[3], d);
+		s[4] = _mm_add_epi32(s[4], e);
+		s[5] = _mm_add_epi32(s[5], f);
+		s[6] = _mm_add_epi32(s[6], g);
+		s[7] = _mm_add_epi32(s[7], hh);
+	}
+
+	for (i = 0; i < 8; i++) {
+		_mm_store_si128((__m128i *)lanes, s[i]);
+		for (j = 0; j < 4; j++)
+			h[j][i] = lanes[j];
+	}
+}
+
+int vb2_sha256_transform_arch(uint32_t *h, const uint8_t *message,
+			      unsigned int block_nb)
+{
+	if (!have_sha_ni())
+		return 0;
+
+	sha256_ni(h, message, block_nb);
+	return 1;
+}
+
+int vb2_sha1_transform_arch(uint32_t *state, const uint8_t *message,
+			    unsigned int block_nb)
+{
+	if (!have_sha_ni())
+		return 0;
+
+	sha1_ni(state, message, block_nb);
+	return 1;
+}
+
+int vb2_sha256_transform_x4_arch(uint32_t *const h[4],
+				 const uint8_t *const message[4],
+				 unsigned int block_nb)
+{
+	/* A single SHA-NI stream is faster than four SSE2 lanes */
+	if (have_sha_ni())
+		return 0;
+
+	vb2_sha256_transform_x4_sse2(h, message, block_nb);
+	return 1;
+}
@@ -28,6 +28,14 @@ int vb2ex_tpm_clear_owner(struct vb2_context *ctx)
 	return VB2_ERROR_EX_TPM_CLEAR_OWNER_UNIMPLEMENTED;
 }
 
+__attribute__((weak))
+int vb2ex_tpm_extend_pcrs(struct vb2_context *ctx,
+			  const struct vb2_pcr_extend *pcrs,
+			  uint32_t count)
+{
+	return VB2_ERROR_EX_TPM_EXTEND_PCRS_UNIMPLEMENTED;
+}
+
 __attribute__((weak))
 int vb2ex_read_resource(struct vb2_context *ctx,
 			enum vb2_resource_index index,
@@ -38,6 +46,62 @@ int vb2ex_read_resource(struct vb2_context *ctx,
 	return VB2_ERROR_EX_READ_RESOURCE_UNIMPLEMENTED;
 }
 
+__attribute__((weak))
+int vb2ex_read_resource_start(struct vb2_context *ctx,
+			      enum vb2_resource_index index,
+			      uint32_t offset,
+			      void *buf,
+			      uint32_t size)
+{
+	return VB2_ERROR_EX_READ_RESOURCE_UNIMPLEMENTED;
+}
+
+__attribute__((weak))
+int vb2ex_read_resource_wait(struct vb2_context *ctx)
+{
+	return VB2_SUCCESS;
+}
+
+__attribute__((weak))
+int vb2ex_map_resource(struct vb2_context *ctx,
+		       enum vb2_resource_index index,
+		       uint32_t offset,
+		       uint32_t size,
+		       const void **ptr)
+{
+	return VB2_ERROR_EX_MAP_RESOURCE_UNIMPLEMENTED;
+}
+
+__attribute__((weak))
+int vb2ex_run_parallel(int (*fn)(void *arg), void *arg)
+{
+	return VB2_ERROR_EX_RUN_PARALLEL_UNIMPLEMENTED;
+}
+
+__attribute__((weak))
+int vb2ex_wait(void)
+{
+	return VB2_SUCCESS;
+}
+
+__attribute__((weak))
+uint32_t vb2ex_mtime(void)
+{
+	return 0;
+}
+
+__attribute__((weak))
+const struct vb2_public_key *vb2ex_embedded_root_key(void)
+{
+	return NULL;
+}
+
+__attribute__((weak))
+const struct vb2_packed_key *vb2ex_embedded_recovery_key(void)
+{
+	return NULL;
+}
+
 __attribute__((weak))
 int vb2ex_hwcrypto_digest_init(enum vb2_hash_algorithm hash_alg,
 			       uint32_t data_size)
@@ -52,9 +116,30 @@ int vb2ex_hwcrypto_digest_extend(const uint8_t *buf,
 	return VB2_ERROR_SHA_EXTEND_ALGORITHM;	/* Should not be called. */
 }
 
+__attribute__((weak))
+int vb2ex_hwcrypto_digest_extend_async(const uint8_t *buf,
+				       uint32_t size)
+{
+	return VB2_ERROR_EX_HWCRYPTO_ASYNC_UNIMPLEMENTED;
+}
+
+__attribute__((weak))
+int vb2ex_hwcrypto_digest_wait(void)
+{
+	return VB2_SUCCESS;
+}
+
 __attribute__((weak))
 int vb2ex_hwcrypto_digest_finalize(uint8_t *digest,
 				   uint32_t digest_size)
 {
 	return VB2_ERROR_SHA_FINALIZE_ALGORITHM; /* Should not be called. */
 }
+
+__attribute__((weak))
+int vb2ex_hwcrypto_rsa_verify_digest(const struct vb2_public_key *key,
+				     const uint8_t *sig,
+				     const uint8_t *digest)
+{
+	return VB2_ERROR_EX_HWCRYPTO_UNSUPPORTED;
+}
@@ -28,6 +28,9 @@
 #include "2recovery_reasons.h"
 #include "2return_codes.h"
 
+struct vb2_packed_key;
+struct vb2_public_key;
+
 /*
  * Size of non-volatile data used by vboot.
  *
@@ -273,6 +276,13 @@ enum vb2_resource_index {
 	 * allow multiple kernels to be examined).
 	 */
 	VB2_RES_KERNEL_VBLOCK,
+
+	/*
+	 * Firmware body for the current slot.  Used only by
+	 * vb2api_hash_body_from_resource(); see VB2_RES_FW_VBLOCK for how to
+	 * tell which slot is meant.
+	 */
+	VB2_RES_FW_BODY,
 };
 
 /* Digest ID for vbapi_get_pcr_digest() */
@@ -282,6 +292,22 @@ enum vb2_pcr_digest {
 
 	/* SHA-256 hash digest of HWID, from GBB */
 	HWID_DIGEST_PCR,
+
+	/* Number of digests; must be last */
+	VB2_PCR_DIGEST_COUNT,
+};
+
+/*
+ * Measurement passed to vb2ex_tpm_extend_pcrs().  Each digest is extended into
+ * the PCR whose index matches its enum vb2_pcr_digest.
+ */
+struct vb2_pcr_extend {
+	/* PCR index */
+	uint32_t pcr;
+
+	/* Digest to extend, and its size in bytes */
+	uint32_t digest_size;
+	uint8_t digest[VB2_PCR_DIGEST_RECOMMENDED_SIZE];
 };
 
 /******************************************************************************
@@ -463,6 +489,23 @@ int vb2api_secdatak_create(struct vb2_context *ctx);
  */
 void vb2api_fail(struct vb2_context *ctx, uint8_t reason, uint8_t subcode);
 
+/**
+ * Set up a cache for vb2ex_read_resource() in the work buffer.
+ *
+ * Later reads of GBB or firmware vblock data which has already been read
+ * this boot are then copied from the cache instead of calling
+ * vb2ex_read_resource() again.  Reads are cached until the cache is full.
+ * Kernel vblocks are never cached.
+ *
+ * This must be called before vb2api_fw_phase1(), since the cache needs to
+ * stay in the work buffer for the rest of the boot.
+ *
+ * @param ctx		Vboot context
+ * @param size		Bytes of work buffer to use for the cache
+ * @return VB2_SUCCESS, or error code on error.
+ */
+int vb2api_init_read_cache(struct vb2_context *ctx, uint32_t size);
+
 /**
  * Firmware selection, phase 1.
  *
@@ -525,6 +568,55 @@ int vb21api_init_hash(struct vb2_context *ctx,
 		      const struct vb2_id *id,
 		      uint32_t *size);
 
+/* Maximum number of tags vb21api_init_hash_tag() can hash at once */
+#define VB21_MAX_HASH_TAGS 4
+
+/**
+ * Start hashing the data for a tag, alongside any other tags being hashed.
+ *
+ * Unlike vb21api_init_hash(), up to VB21_MAX_HASH_TAGS tags can be hashed at
+ * once, each with its own digest context in the work buffer.  This lets
+ * components loaded by different engines be hashed as their data arrives.
+ * Calling this again for a tag which is being hashed restarts its hash.
+ *
+ * These hashes always use software hashing, since the hardware crypto engine
+ * only holds a single digest.
+ *
+ * @param ctx		Vboot context
+ * @param id		Tag (hash signature ID) to start hashing
+ * @param size		If non-null, expected size of data for tag will be
+ *			stored here on output.
+ * @return VB2_SUCCESS, or error code on error.
+ */
+int vb21api_init_hash_tag(struct vb2_context *ctx,
+			  const struct vb2_id *id,
+			  uint32_t *size);
+
+/**
+ * Extend the hash started by vb21api_init_hash_tag() with additional data.
+ *
+ * @param ctx		Vboot context
+ * @param id		Tag being hashed
+ * @param buf		Data to hash
+ * @param size		Size of data in bytes
+ * @return VB2_SUCCESS, or error code on error.
+ */
+int vb21api_extend_hash_tag(struct vb2_context *ctx,
+			    const struct vb2_id *id,
+			    const void *buf,
+			    uint32_t size);
+
+/**
+ * Check the hash started by vb21api_init_hash_tag().
+ *
+ * This ends the hash for the tag, freeing its slot for another tag.
+ *
+ * @param ctx		Vboot context
+ * @param id		Tag being hashed
+ * @return VB2_SUCCESS, or error code on error.
+ */
+int vb21api_check_hash_tag(struct vb2_context *ctx, const struct vb2_id *id);
+
 /**
  * Extend the hash started by vb2api_init_hash() with additional data.
  *
@@ -539,6 +631,37 @@ int vb2api_extend_hash(struct vb2_context *ctx,
 		       const void *buf,
 		       uint32_t size);
 
+/*
+ * Chunk size vb2api_hash_body_from_resource() reads in, when the whole body
+ * fits in the caller's buffer.
+ */
+#define VB2_HASH_BODY_CHUNK_SIZE (16 * 1024)
+
+/**
+ * Read and hash the data for the hash started by vb2api_init_hash().
+ *
+ * This replaces a caller loop of reads and vb2api_extend_hash() calls.  The
+ * data is read from VB2_RES_FW_BODY into buf.  If buf is big enough, the
+ * whole body is left there; otherwise each half of buf is reused in turn.
+ * If the caller implements vb2ex_read_resource_start(), each chunk is read
+ * while the one before it is hashed.  If the caller implements
+ * vb2ex_map_resource(), the body is hashed straight from the mapping
+ * instead, and buf is not used.
+ *
+ * Check the hash afterwards with vb2api_check_hash() or vb21api_check_hash()
+ * as usual.
+ *
+ * (This is the same for both old and new style structs.)
+ *
+ * @param ctx		Vboot context
+ * @param buf		Buffer for the data
+ * @param buf_size	Size of buffer in bytes
+ * @return VB2_SUCCESS, or error code on error.
+ */
+int vb2api_hash_body_from_resource(struct vb2_context *ctx,
+				   uint8_t *buf,
+				   uint32_t buf_size);
+
 /**
  * Check the hash value started by vb2api_init_hash().
  *
@@ -564,6 +687,41 @@ int vb21api_check_hash(struct vb2_context *ctx);
 int vb2api_check_hash_get_digest(struct vb2_context *ctx, void *digest_out,
 				 uint32_t digest_out_size);
 
+/* Size of the state passed between vb2api_get/set_resume_state() */
+#define VB2_RESUME_STATE_SIZE 140
+
+/**
+ * Get the digests of the RW firmware verified this boot.
+ *
+ * Call this after vb2api_check_hash() succeeds on a normal boot, and keep
+ * the state somewhere the OS can't change it (SRAM locked before the OS
+ * runs, or a TPM NV space) to pass to vb2api_set_resume_state() on S3
+ * resume.
+ *
+ * @param ctx		Vboot context
+ * @param buf		Destination for the state
+ * @param size		Size of buf; at least VB2_RESUME_STATE_SIZE
+ * @return VB2_SUCCESS, or error code on error.
+ */
+int vb2api_get_resume_state(struct vb2_context *ctx, void *buf, uint32_t size);
+
+/**
+ * Supply the state from vb2api_get_resume_state() on S3 resume.
+ *
+ * Call this before vb2api_fw_phase3() when VB2_CONTEXT_S3_RESUME is set.
+ * If the slot chosen is the one recorded, its keyblock and preamble are
+ * checked against the recorded digests instead of their signatures, and
+ * vb2api_check_hash() compares the body digest the same way.  Anything
+ * which has changed since is verified as usual.  The body is still hashed.
+ *
+ * @param ctx		Vboot context
+ * @param buf		State from vb2api_get_resume_state()
+ * @param size		Size of buf
+ * @return VB2_SUCCESS, or error code on error.
+ */
+int vb2api_set_resume_state(struct vb2_context *ctx, const void *buf,
+			    uint32_t size);
+
 /**
  * Get a PCR digest
  *
@@ -580,6 +738,19 @@ int vb2api_get_pcr_digest(struct vb2_context *ctx,
 			  uint8_t *dest,
 			  uint32_t *dest_size);
 
+/**
+ * Extend all boot measurements into the TPM.
+ *
+ * This gets every digest vb2api_get_pcr_digest() knows about and passes them
+ * to vb2ex_tpm_extend_pcrs() together, so the caller can send them to the TPM
+ * in as few transactions as its driver allows, instead of looping over
+ * vb2api_get_pcr_digest() and extending each one separately.
+ *
+ * @param ctx		Vboot context
+ * @return VB2_SUCCESS, or error code on error.
+ */
+int vb2api_extend_pcrs(struct vb2_context *ctx);
+
 /**
  * Prepare for kernel verification stage.
  *
@@ -655,6 +826,23 @@ int vb2api_kernel_phase3(struct vb2_context *ctx);
  */
 int vb2ex_tpm_clear_owner(struct vb2_context *ctx);
 
+/**
+ * Extend a set of PCRs.
+ *
+ * Called by vb2api_extend_pcrs().  If the TPM driver can queue or combine
+ * commands, the implementation should send all the extends at once;
+ * otherwise it may call TlclExtend() for each entry in turn.  The first
+ * failure should be returned.
+ *
+ * @param ctx		Vboot context
+ * @param pcrs		Measurements to extend
+ * @param count		Number of entries in pcrs[]
+ * @return VB2_SUCCESS, or error code on error.
+ */
+int vb2ex_tpm_extend_pcrs(struct vb2_context *ctx,
+			  const struct vb2_pcr_extend *pcrs,
+			  uint32_t count);
+
 /**
  * Read a verified boot resource.
  *
@@ -671,6 +859,87 @@ int vb2ex_read_resource(struct vb2_context *ctx,
 			void *buf,
 			uint32_t size);
 
+/**
+ * Start reading a verified boot resource, without waiting for the data.
+ *
+ * Like vb2ex_read_resource(), but may return before the data is in buf.
+ * vboot calls vb2ex_read_resource_wait() before looking at the data or
+ * starting another read.  This is only used for resources read in chunks,
+ * such as by vb2api_hash_body_from_resource().
+ *
+ * This function is optional.  The default implementation returns
+ * VB2_ERROR_EX_READ_RESOURCE_UNIMPLEMENTED, so vb2ex_read_resource() is
+ * used instead.
+ *
+ * @param ctx		Vboot context
+ * @param index		Resource index to read
+ * @param offset	Byte offset within resource to start at
+ * @param buf		Destination for data
+ * @param size		Amount of data to read
+ * @return VB2_SUCCESS, or error code on error.
+ */
+int vb2ex_read_resource_start(struct vb2_context *ctx,
+			      enum vb2_resource_index index,
+			      uint32_t offset,
+			      void *buf,
+			      uint32_t size);
+
+/**
+ * Wait for the read started by vb2ex_read_resource_start() to finish.
+ *
+ * @param ctx		Vboot context
+ * @return VB2_SUCCESS, or error code if the read failed.
+ */
+int vb2ex_read_resource_wait(struct vb2_context *ctx);
+
+/**
+ * Get a pointer to a verified boot resource which is mapped into memory,
+ * such as through a memory-mapped SPI flash window.
+ *
+ * vboot only hashes data through the pointer and doesn't keep it.  Data
+ * which has to stay the same after it is verified, such as the vblocks, is
+ * still read with vb2ex_read_resource().  The mapping must stay valid until
+ * the call using it returns.  This is only used for the firmware body, by
+ * vb2api_hash_body_from_resource().
+ *
+ * This function is optional.  The default implementation returns
+ * VB2_ERROR_EX_MAP_RESOURCE_UNIMPLEMENTED, so the resource is read instead.
+ *
+ * @param ctx		Vboot context
+ * @param index		Resource index to map
+ * @param offset	Byte offset within resource to start at
+ * @param size		Amount of data needed
+ * @param ptr		Destination for pointer to the data
+ * @return VB2_SUCCESS, or error code on error.
+ */
+int vb2ex_map_resource(struct vb2_context *ctx,
+		       enum vb2_resource_index index,
+		       uint32_t offset,
+		       uint32_t size,
+		       const void **ptr);
+
+/**
+ * Start running a function on another CPU.
+ *
+ * Only one function is run this way at a time; vboot calls vb2ex_wait()
+ * before starting another.  The function only touches memory reachable from
+ * arg, and calls no other vb2ex_*() API.
+ *
+ * @param fn		Function to run
+ * @param arg		Argument to pass to fn
+ * @return VB2_SUCCESS if fn was started, or
+ * VB2_ERROR_EX_RUN_PARALLEL_UNIMPLEMENTED if the caller should run it
+ * itself.
+ */
+int vb2ex_run_parallel(int (*fn)(void *arg), void *arg);
+
+/**
+ * Wait for the function started by vb2ex_run_parallel() to finish.
+ *
+ * @return The value returned by the function.
+ */
+int vb2ex_wait(void);
+
 /**
  * Print debug output
  *
@@ -685,6 +954,39 @@ int vb2ex_read_resource(struct vb2_context *ctx,
  */
 void vb2ex_printf(const char *func, const char *fmt, ...);
 
+/**
+ * Read a millisecond timer.
+ *
+ * This is used to record boot timestamps; see vb2_timestamp().  The zero
+ * point is arbitrary, but must not change during the boot.
+ *
+ * @return The current time in milliseconds.
+ */
+uint32_t vb2ex_mtime(void);
+
+/**
+ * Return the root key built into the read-only firmware.
+ *
+ * If this returns a key, vb2_load_fw_keyblock() verifies the firmware
+ * keyblock with it instead of reading the packed root key from the GBB and
+ * unpacking it.  The key, including its precomputed n0inv and rr, is meant
+ * to be const data generated by "futility embed_keys" from the same .vbpubk
+ * that is put in the GBB.
+ *
+ * @return The unpacked root key, or NULL to use the one in the GBB.
+ */
+const struct vb2_public_key *vb2ex_embedded_root_key(void);
+
+/**
+ * Return the recovery key built into the read-only firmware.
+ *
+ * If this returns a key, it is used instead of the recovery key in the GBB.
+ * Like the root key, it is meant to be generated by "futility embed_keys".
+ *
+ * @return The packed recovery key, or NULL to use the one in the GBB.
+ */
+const struct vb2_packed_key *vb2ex_embedded_recovery_key(void);
+
 /**
  * Initialize the hardware crypto engine to calculate a block-style digest.
  *
@@ -704,6 +1006,30 @@ int vb2ex_hwcrypto_digest_init(enum vb2_hash_algorithm hash_alg,
  */
 int vb2ex_hwcrypto_digest_extend(const uint8_t *buf, uint32_t size);
 
+/**
+ * Start extending the hash in the hardware crypto engine, and return while
+ * the engine is still reading the block.
+ *
+ * Only one block is outstanding at a time; vboot calls
+ * vb2ex_hwcrypto_digest_wait() before starting another, and leaves buf alone
+ * until then.
+ *
+ * @param buf		Next data block to hash
+ * @param size		Length of data block in bytes
+ * @return VB2_SUCCESS if the block was started, or
+ * VB2_ERROR_EX_HWCRYPTO_ASYNC_UNIMPLEMENTED if vboot should use
+ * vb2ex_hwcrypto_digest_extend() instead.
+ */
+int vb2ex_hwcrypto_digest_extend_async(const uint8_t *buf, uint32_t size);
+
+/**
+ * Wait for the block started by vb2ex_hwcrypto_digest_extend_async() to be
+ * hashed.
+ *
+ * @return VB2_SUCCESS, or non-zero error code.
+ */
+int vb2ex_hwcrypto_digest_wait(void);
+
 /**
  * Finalize the digest in the hardware crypto engine and extract the result.
  *
@@ -713,4 +1039,17 @@ int vb2ex_hwcrypto_digest_extend(const uint8_t *buf, uint32_t size);
  */
 int vb2ex_hwcrypto_digest_finalize(uint8_t *digest, uint32_t digest_size);
 
+/**
+ * Verify a RSA PKCS1.5 signature against an expected digest in the hardware
+ * crypto engine.
+ *
+ * @param key		Key to use; its sig_alg and hash_alg say how it's used
+ * @param sig		Signature to verify (vb2_rsa_sig_size() bytes)
+ * @param digest	Expected digest of the signed data
+ * @return VB2_SUCCESS, or non-zero error code (HWCRYPTO_UNSUPPORTED not fatal).
+ */
+int vb2ex_hwcrypto_rsa_verify_digest(const struct vb2_public_key *key,
+				     const uint8_t *sig,
+				     const uint8_t *digest);
+
 #endif  /* VBOOT_2_API_H_ */
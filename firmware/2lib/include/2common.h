@@ -50,6 +50,29 @@ struct vb2_public_key;
 #endif
 #endif
 
+/*
+ * Place the SHA and RSA inner loops (VB2_HOT) and their constant tables
+ * (VB2_HOT_DATA) in their own linker sections, so firmware which runs from
+ * slow flash can link them into SRAM, TCM or locked cache.  Build with
+ * VB2_HOT_SECTION and VB2_HOT_DATA_SECTION set to the section names; by
+ * default they go wherever the compiler puts them.
+ */
+#ifndef VB2_HOT
+#ifdef VB2_HOT_SECTION
+#define VB2_HOT __attribute__((section(VB2_HOT_SECTION)))
+#else
+#define VB2_HOT
+#endif
+#endif
+
+#ifndef VB2_HOT_DATA
+#ifdef VB2_HOT_DATA_SECTION
+#define VB2_HOT_DATA __attribute__((section(VB2_HOT_DATA_SECTION)))
+#else
+#define VB2_HOT_DATA
+#endif
+#endif
+
 /*
  * Alignment for work buffer pointers/allocations should be useful for any
  * data type. When declaring workbuf buffers on the stack, the caller should
@@ -141,6 +164,21 @@ void *vb2_workbuf_realloc(struct vb2_workbuf *wb,
  */
 void vb2_workbuf_free(struct vb2_workbuf *wb, uint32_t size);
 
+#ifdef VB2_WORKBUF_STATS
+/**
+ * Return the end of the highest allocation made by vb2_workbuf_alloc().
+ *
+ * This is only compiled in when the firmware is built with WORKBUF_STATS=1.
+ * Work buffers are passed around by value, so the high-water mark is kept
+ * globally rather than in struct vb2_workbuf.
+ *
+ * @param reset		If non-zero, reset the high-water mark after reading it
+ * @return The address just past the highest allocation, or 0 if nothing has
+ * been allocated since the last reset.
+ */
+uintptr_t vb2_workbuf_high_water(int reset);
+#endif
+
 /* Check if a pointer is aligned on an align-byte boundary */
 #define vb2_aligned(ptr, align) (!(((uintptr_t)(ptr)) & ((align) - 1)))
 
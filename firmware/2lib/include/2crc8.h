@@ -11,10 +11,22 @@
 /**
  * Calculate CRC-8 of the data, using x^8 + x^2 + x + 1 polynomial.
  *
+ * This uses a 256-byte table if built with VB2_CRC8_TABLE (the default for
+ * host builds; see CRC8 in the Makefile), or vb2_crc8_bitwise() if not.
+ *
  * @param data		Data to CRC
  * @param size		Size of data in bytes
  * @return CRC-8 of the data.
  */
 uint8_t vb2_crc8(const void *data, uint32_t size);
 
+/**
+ * Calculate the same CRC-8 one bit at a time, without a table.
+ *
+ * @param data		Data to CRC
+ * @param size		Size of data in bytes
+ * @return CRC-8 of the data.
+ */
+uint8_t vb2_crc8_bitwise(const void *data, uint32_t size);
+
 #endif /* VBOOT_REFERENCE_2_CRC8_H_ */
@@ -52,6 +52,9 @@ enum vb2_signature_algorithm {
 	VB2_SIG_RSA2048_EXP3 = 6,
 	VB2_SIG_RSA3072_EXP3 = 7,
 
+	/* Ed25519 (RFC 8032), signing the digest of the data */
+	VB2_SIG_ED25519 = 8,
+
 	/* Last index. Don't add anything below. */
 	VB2_SIG_ALG_COUNT,
 };
@@ -0,0 +1,36 @@
+/* Copyright 2018 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ *
+ * Ed25519 signature verification (RFC 8032).
+ */
+
+#ifndef VBOOT_REFERENCE_2ED25519_H_
+#define VBOOT_REFERENCE_2ED25519_H_
+
+#include "2crypto.h"
+
+/* An Ed25519 public key is an encoded curve point */
+#define VB2_ED25519_KEY_BYTES 32
+
+/* A signature is an encoded point R followed by a scalar S */
+#define VB2_ED25519_SIG_BYTES 64
+
+/**
+ * Verify an Ed25519 signature of a message.
+ *
+ * Vboot signs the digest of the data, so callers pass that as the message.
+ * Nothing needs to be kept secret here, so this doesn't run in constant time.
+ *
+ * @param pubkey	Public key (VB2_ED25519_KEY_BYTES bytes)
+ * @param sig		Signature to verify (VB2_ED25519_SIG_BYTES bytes)
+ * @param msg		Signed message
+ * @param msg_size	Size of message in bytes
+ * @return VB2_SUCCESS, or non-zero if error.
+ */
+int vb2_ed25519_verify(const uint8_t *pubkey,
+		       const uint8_t *sig,
+		       const uint8_t *msg,
+		       uint32_t msg_size);
+
+#endif  /* VBOOT_REFERENCE_2ED25519_H_ */
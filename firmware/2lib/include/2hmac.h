@@ -8,6 +8,54 @@
 
 #include <stdint.h>
 #include "2crypto.h"
+#include "2sha.h"
+
+/*
+ * HMAC state. After vb2_hmac_init() this holds the hashes of the padded key,
+ * so a copy of it can MAC any number of messages without redoing that work.
+ */
+struct vb2_hmac_context {
+	/* Hash of the key XOR ipad, then the message */
+	struct vb2_digest_context inner;
+	/* Hash of the key XOR opad */
+	struct vb2_digest_context outer;
+	uint32_t digest_size;
+};
+
+/**
+ * Start an HMAC with a key.
+ *
+ * @param ctx		HMAC context to initialize
+ * @param alg		Hash algorithm ID
+ * @param key		HMAC key
+ * @param key_size	HMAC key size
+ * @return 0 if success, non-zero if error.
+ */
+int vb2_hmac_init(struct vb2_hmac_context *ctx,
+		  enum vb2_hash_algorithm alg,
+		  const void *key, uint32_t key_size);
+
+/**
+ * Add more of the message to an HMAC.
+ *
+ * @param ctx		HMAC context
+ * @param msg		Next part of the message
+ * @param msg_size	Size of that part
+ * @return 0 if success, non-zero if error.
+ */
+int vb2_hmac_update(struct vb2_hmac_context *ctx,
+		    const void *msg, uint32_t msg_size);
+
+/**
+ * Finish an HMAC. The context can't be used again after this.
+ *
+ * @param ctx		HMAC context
+ * @param mac		Computed message authentication code
+ * @param mac_size	Size of the buffer pointed by <mac>
+ * @return 0 if success, non-zero if error.
+ */
+int vb2_hmac_final(struct vb2_hmac_context *ctx,
+		   uint8_t *mac, uint32_t mac_size);
 
 /**
  * Compute HMAC
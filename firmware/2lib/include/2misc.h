@@ -23,6 +23,53 @@ static __inline struct vb2_shared_data *vb2_get_sd(struct vb2_context *ctx) {
 	return (struct vb2_shared_data *)ctx->workbuf;
 }
 
+/**
+ * Record a boot timestamp in the shared data.
+ *
+ * This is compiled out unless the firmware is built with TIMESTAMPS=1.
+ * Timestamps are kept in a ring; if more than VB2_MAX_TIMESTAMPS are
+ * recorded, the oldest ones are overwritten.
+ *
+ * @param ctx		Vboot context
+ * @param event		Event to record (enum vb2_timestamp_event)
+ */
+#ifdef VB2_TIMESTAMPS
+void vb2_timestamp(struct vb2_context *ctx, enum vb2_timestamp_event event);
+#else
+static __inline void vb2_timestamp(struct vb2_context *ctx,
+				   enum vb2_timestamp_event event) {}
+#endif
+
+/**
+ * Start charging work buffer usage to a new boot phase.
+ *
+ * This is compiled out unless the firmware is built with WORKBUF_STATS=1.
+ * The peak usage since the previous call is added to the phase which was
+ * current then; pass VB2_WB_PHASE_NONE to stop charging.
+ *
+ * @param ctx		Vboot context
+ * @param phase		Phase to charge (enum vb2_workbuf_phase)
+ */
+#ifdef VB2_WORKBUF_STATS
+void vb2_workbuf_phase(struct vb2_context *ctx, enum vb2_workbuf_phase phase);
+
+/**
+ * Return the peak work buffer usage recorded for a boot phase.
+ *
+ * Usage is measured in bytes from the start of the work buffer, so it
+ * includes the shared data struct and anything kept across phases.
+ *
+ * @param ctx		Vboot context
+ * @param phase		Phase to report (enum vb2_workbuf_phase)
+ * @return Peak usage in bytes, or 0 if the phase did not run.
+ */
+uint32_t vb2_workbuf_peak(struct vb2_context *ctx,
+			  enum vb2_workbuf_phase phase);
+#else
+static __inline void vb2_workbuf_phase(struct vb2_context *ctx,
+				       enum vb2_workbuf_phase phase) {}
+#endif
+
 /**
  * Validate gbb signature (the magic number)
  *
@@ -52,6 +99,26 @@ void vb2_workbuf_from_ctx(struct vb2_context *ctx, struct vb2_workbuf *wb);
  */
 void vb2_set_workbuf_used(struct vb2_context *ctx, uint32_t used);
 
+/**
+ * Read from a verified boot resource, using the read cache if there is one.
+ *
+ * Behaves like vb2ex_read_resource(), except that data already in the cache
+ * set up by vb2api_init_read_cache() is copied from there, and data read
+ * from the resource is added to the cache if it fits.
+ *
+ * @param ctx		Vboot context
+ * @param index		Resource index to read
+ * @param offset	Byte offset within resource to start at
+ * @param buf		Destination for data
+ * @param size		Amount of data to read
+ * @return VB2_SUCCESS, or error code on error.
+ */
+int vb2_read_resource(struct vb2_context *ctx,
+		      enum vb2_resource_index index,
+		      uint32_t offset,
+		      void *buf,
+		      uint32_t size);
+
 /**
  * Read the GBB header.
  *
@@ -132,6 +199,63 @@ int vb2_check_tpm_clear(struct vb2_context *ctx);
  */
 int vb2_select_fw_slot(struct vb2_context *ctx);
 
+/*
+ * Bytes at the start of the firmware vblock to read in one go when loading
+ * the keyblock.  That's usually enough for the keyblock and preamble, so
+ * they don't each need a read for their header and another for the rest.
+ * Platforms with a different vblock layout may override this; 0 disables
+ * reading ahead.
+ */
+#ifndef VB2_VBLOCK_READ_AHEAD
+#define VB2_VBLOCK_READ_AHEAD 4096
+#endif
+
+/**
+ * Read the start of the firmware vblock into the work buffer.
+ *
+ * Reads VB2_VBLOCK_READ_AHEAD bytes, if the work buffer has room for them
+ * and for verifying the keyblock.  Nothing is read if it doesn't, or if the
+ * vblock is smaller; vb2_read_vblock() then reads from the vblock itself.
+ *
+ * @param ctx		Vboot context
+ * @param wb		Work buffer to allocate the data from
+ */
+void vb2_read_vblock_ahead(struct vb2_context *ctx, struct vb2_workbuf *wb);
+
+/**
+ * Read part of the firmware vblock.
+ *
+ * Whatever vb2_read_vblock_ahead() read is copied from the work buffer, and
+ * only the rest is read from the vblock.  buf may overlap the data read
+ * ahead.
+ *
+ * @param ctx		Vboot context
+ * @param offset	Offset in the vblock to read from
+ * @param buf		Destination buffer
+ * @param size		Number of bytes to read
+ * @return VB2_SUCCESS, or error code on error.
+ */
+int vb2_read_vblock(struct vb2_context *ctx, uint32_t offset, void *buf,
+		    uint32_t size);
+
+/**
+ * Record the digest of verified firmware data in the resume state.
+ *
+ * On S3 resume with a state from vb2api_set_resume_state() for this slot,
+ * also compares the digest with the recorded one first.  The flag is left
+ * clear in the resume state; set it once the data is known to be good.
+ *
+ * @param ctx		Vboot context
+ * @param flag		Which digest (enum vb2_resume_state_flags)
+ * @param digest	Digest of the data
+ * @param recorded	Digest in sd->resume to compare with and update
+ * @param size		Size of the digest in bytes
+ * @return 1 if the data is unchanged since it was verified on the normal
+ * boot before suspend, so its signature needn't be checked; 0 if not.
+ */
+int vb2_resume_digest(struct vb2_context *ctx, uint32_t flag,
+		      const uint8_t *digest, uint8_t *recorded, uint32_t size);
+
 /**
  * Verify the firmware keyblock using the root key.
  *
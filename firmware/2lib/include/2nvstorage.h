@@ -115,6 +115,17 @@ enum vb2_nv_param {
 	 * VB2_MAX_ROLLFORWARD_MAX_V1_DEFAULT for V1.
 	 */
 	VB2_NV_FW_MAX_ROLLFORWARD,
+	/*
+	 * GPT partition number (1...N) of the kernel which last booted
+	 * normally with its successful flag set, or 0 if none.  Returns 0 for
+	 * V1.
+	 */
+	VB2_NV_KERNEL_HINT_PART,
+	/*
+	 * Header CRC of the primary GPT when VB2_NV_KERNEL_HINT_PART was
+	 * stored.  Returns 0 for V1.
+	 */
+	VB2_NV_KERNEL_HINT_GPT_CRC,
 };
 
 /* Set default boot in developer mode */
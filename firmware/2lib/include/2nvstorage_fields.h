@@ -49,6 +49,11 @@ enum vb2_nv_offset {
 	VB2_NV_OFFS_FW_MAX_ROLLFORWARD2 = 17, /* bits 8-15 of 32 */
 	VB2_NV_OFFS_FW_MAX_ROLLFORWARD3 = 18, /* bits 16-23 of 32 */
 	VB2_NV_OFFS_FW_MAX_ROLLFORWARD4 = 19, /* bits 24-31 of 32 */
+	VB2_NV_OFFS_KERNEL_HINT_CRC1 = 20, /* bits 0-7 of 32 */
+	VB2_NV_OFFS_KERNEL_HINT_CRC2 = 21, /* bits 8-15 of 32 */
+	VB2_NV_OFFS_KERNEL_HINT_CRC3 = 22, /* bits 16-23 of 32 */
+	VB2_NV_OFFS_KERNEL_HINT_CRC4 = 23, /* bits 24-31 of 32 */
+	VB2_NV_OFFS_KERNEL_HINT_PART = 24,
 
 	/* CRC must be last field */
 	VB2_NV_OFFS_CRC_V2 = 63,
@@ -0,0 +1,171 @@
+/* Copyright 2018 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ *
+ * Streaming load/verify pipeline:
+ * source -> chunker -> digest -> sink -> consumer.
+ */
+
+#ifndef VBOOT_REFERENCE_VBOOT_2PIPELINE_H_
+#define VBOOT_REFERENCE_VBOOT_2PIPELINE_H_
+
+#include "2api.h"
+#include "2sha.h"
+
+struct vb2_pipeline;
+struct vb2_pipeline_source;
+
+/* Stage which failed in the last vb2_pipeline_run() */
+enum vb2_pipeline_stage {
+	VB2_PIPELINE_OK = 0,
+	VB2_PIPELINE_SOURCE,
+	VB2_PIPELINE_DIGEST,
+	VB2_PIPELINE_CONSUMER,
+};
+
+/* Where pipeline data comes from */
+struct vb2_pipeline_source {
+	/*
+	 * Read the next size bytes into buf.  Required.  Returns
+	 * VB2_SUCCESS or non-zero error code.
+	 */
+	int (*read)(struct vb2_pipeline_source *src, uint8_t *buf,
+		    uint32_t size);
+
+	/*
+	 * Optional asynchronous read.  read_start() begins reading the next
+	 * size bytes into buf and read_wait() waits for it to finish.  At
+	 * most one read is outstanding at a time.  If read_start is NULL,
+	 * read() is used instead.
+	 */
+	int (*read_start)(struct vb2_pipeline_source *src, uint8_t *buf,
+			  uint32_t size);
+	int (*read_wait)(struct vb2_pipeline_source *src);
+
+	/* Source-specific state */
+	void *arg;
+	const uint8_t *base;
+	uint32_t offset;
+	uint32_t index;
+};
+
+struct vb2_pipeline {
+	/* Data source */
+	struct vb2_pipeline_source *source;
+
+	/* Largest read to issue, in bytes; 0 reads everything at once */
+	uint32_t chunk_size;
+
+	/*
+	 * Digest stage, or NULL to just load the data.  Set
+	 * dc->using_hwcrypto to extend through vb2ex_hwcrypto_digest_extend().
+	 */
+	struct vb2_digest_context *dc;
+
+	/* Sink; data is read here and the pointer advanced past it */
+	uint8_t *sink;
+
+	/*
+	 * If sink_size is non-zero, the sink is a ring of that many bytes
+	 * from sink_start: a chunk which wouldn't fit before its end is read
+	 * at its start instead.  With chunk_size at most half of sink_size,
+	 * that double-buffers data which needn't be kept.
+	 */
+	uint8_t *sink_start;
+	uint32_t sink_size;
+
+	/*
+	 * Optional last stage, given each chunk once it has been hashed,
+	 * such as a decompressor.  The next chunk is already being read, so
+	 * with a ring sink this overlaps the read.  Returns VB2_SUCCESS or
+	 * non-zero error code.
+	 */
+	int (*consume)(struct vb2_pipeline *pipe, const uint8_t *buf,
+		       uint32_t size);
+	void *consume_arg;
+
+	/* Counters, updated by every stage */
+	uint32_t bytes_read;
+	uint32_t bytes_hashed;
+	uint32_t read_count;
+
+	/* Stage which failed, if the last run returned an error */
+	enum vb2_pipeline_stage failed;
+};
+
+/**
+ * Initialize a memory source.
+ *
+ * Reads copy from successive bytes of buf.  If a read lands at the same
+ * address it would copy from, no copy is done, so a pipeline can hash data
+ * in place.
+ *
+ * @param src		Source to initialize
+ * @param buf		Data to read
+ */
+void vb2_pipeline_source_memory(struct vb2_pipeline_source *src,
+				const void *buf);
+
+/**
+ * Initialize a source which reads through vb2ex_read_resource().
+ *
+ * Reads are asynchronous if the caller implements
+ * vb2ex_read_resource_start().
+ *
+ * @param src		Source to initialize
+ * @param ctx		Vboot context
+ * @param index		Resource to read
+ * @param offset	Starting byte offset in the resource
+ */
+void vb2_pipeline_source_resource(struct vb2_pipeline_source *src,
+				  struct vb2_context *ctx,
+				  enum vb2_resource_index index,
+				  uint32_t offset);
+
+/**
+ * Initialize a pipeline.
+ *
+ * @param pipe		Pipeline to initialize
+ * @param source	Data source
+ * @param chunk_size	Largest read in bytes, or 0 for no limit
+ * @param dc		Initialized digest context, or NULL for no digest
+ * @param sink		Destination for data
+ */
+void vb2_pipeline_init(struct vb2_pipeline *pipe,
+		       struct vb2_pipeline_source *source,
+		       uint32_t chunk_size,
+		       struct vb2_digest_context *dc,
+		       uint8_t *sink);
+
+/**
+ * Feed data which is already in memory through the digest stage, and then
+ * the consumer, if any.
+ *
+ * @param pipe		Pipeline
+ * @param buf		Data to hash
+ * @param size		Length of data in bytes
+ * @return VB2_SUCCESS, or non-zero error code.
+ */
+int vb2_pipeline_extend(struct vb2_pipeline *pipe,
+			const uint8_t *buf,
+			uint32_t size);
+
+/**
+ * Read size bytes from the source into the sink, hashing as it goes.
+ *
+ * When the source supports asynchronous reads, the next chunk is read
+ * while the current one is hashed.  When vb2ex_run_parallel() is
+ * implemented, software hashing of each chunk but the last runs on another
+ * CPU while the boot CPU reads the next one.  Likewise, when
+ * vb2ex_hwcrypto_digest_extend_async() is implemented, the crypto engine
+ * hashes each chunk but the last while the next one is read.  On error,
+ * pipe->failed records which stage failed, and no read or hash is left
+ * outstanding.
+ *
+ * @param pipe		Pipeline
+ * @param size		Bytes to read
+ * @return VB2_SUCCESS, or the error code from the failing stage.
+ */
+int vb2_pipeline_run(struct vb2_pipeline *pipe, uint32_t size);
+
+#endif  /* VBOOT_REFERENCE_VBOOT_2PIPELINE_H_ */
@@ -350,6 +350,18 @@ enum vb2_return_code {
 	/* Vmlinuz header outside signed portion of body */
 	VB2_ERROR_PREAMBLE_VMLINUZ_HEADER_OUTSIDE,
 
+	/* Body chunk digests outside signed portion of preamble */
+	VB2_ERROR_PREAMBLE_BODY_DIGESTS_OUTSIDE,
+
+	/* No such chunk in vb2_verify_kernel_body_chunk() */
+	VB2_ERROR_PREAMBLE_BODY_CHUNK_INDEX,
+
+	/* Chunk doesn't match its digest in vb2_verify_kernel_body_chunk() */
+	VB2_ERROR_PREAMBLE_BODY_CHUNK_DIGEST,
+
+	/* Unknown compression, or compression before header version 2.4 */
+	VB2_ERROR_PREAMBLE_COMPRESSION,
+
         /**********************************************************************
 	 * Misc higher-level code errors
 	 */
@@ -391,6 +403,9 @@ enum vb2_return_code {
 	/* Keyblock version rollback in vb2_load_fw_keyblock() */
 	VB2_ERROR_FW_KEYBLOCK_VERSION_ROLLBACK,
 
+	/* Data key too big for root key space in vb2_load_fw_keyblock() */
+	VB2_ERROR_FW_KEYBLOCK_DATA_KEY_SIZE,
+
 	/* Missing firmware data key in vb2_load_fw_preamble() */
 	VB2_ERROR_FW_PREAMBLE2_DATA_KEY,
 
@@ -580,6 +595,36 @@ enum vb2_return_code {
 	/* Digest buffer passed into vb2api_check_hash incorrect. */
 	VB2_ERROR_API_CHECK_DIGEST_SIZE,
 
+	/* vb2api_init_read_cache() called after work buffer was used */
+	VB2_ERROR_API_READ_CACHE_INIT,
+
+	/* Work buffer too small for read cache in vb2api_init_read_cache() */
+	VB2_ERROR_API_READ_CACHE_WORKBUF,
+
+	/* Buffer too small in vb2api_hash_body_from_resource() */
+	VB2_ERROR_API_HASH_BODY_BUF,
+
+	/* Work buffer too small for hash tags in vb21api_init_hash_tag() */
+	VB2_ERROR_API_INIT_HASH_TAG_WORKBUF,
+
+	/* Too many tags being hashed at once in vb21api_init_hash_tag() */
+	VB2_ERROR_API_INIT_HASH_TAG_FULL,
+
+	/* Tag not initialized in vb21api_extend_hash_tag() */
+	VB2_ERROR_API_EXTEND_HASH_TAG,
+
+	/* Buffer too small in vb2api_get_resume_state() */
+	VB2_ERROR_API_RESUME_STATE_SIZE,
+
+	/* Firmware not verified yet in vb2api_get_resume_state() */
+	VB2_ERROR_API_RESUME_STATE_INCOMPLETE,
+
+	/* Bad magic, version or flags in vb2api_set_resume_state() */
+	VB2_ERROR_API_RESUME_STATE_INVALID,
+
+	/* vb2api_set_resume_state() called when not resuming from S3 */
+	VB2_ERROR_API_RESUME_STATE_NOT_RESUME,
+
         /**********************************************************************
 	 * Errors which may be generated by implementations of vb2ex functions.
 	 * Implementation may also return its own specific errors, which should
@@ -606,6 +651,49 @@ enum vb2_return_code {
 	/* Hardware crypto engine doesn't support this algorithm (non-fatal) */
 	VB2_ERROR_EX_HWCRYPTO_UNSUPPORTED,
 
+	/* TPM extend PCRs not implemented */
+	VB2_ERROR_EX_TPM_EXTEND_PCRS_UNIMPLEMENTED,
+
+	/* Platform can't run work on another CPU */
+	VB2_ERROR_EX_RUN_PARALLEL_UNIMPLEMENTED,
+
+	/* Hardware crypto engine can't hash in the background */
+	VB2_ERROR_EX_HWCRYPTO_ASYNC_UNIMPLEMENTED,
+
+	/* Resource isn't mapped into memory */
+	VB2_ERROR_EX_MAP_RESOURCE_UNIMPLEMENTED,
+
+        /**********************************************************************
+	 * Ed25519 errors
+	 */
+	VB2_ERROR_ED25519 = VB2_ERROR_BASE + 0x0b0000,
+
+	/* Null param passed to vb2_ed25519_verify() */
+	VB2_ERROR_ED25519_VERIFY_PARAM,
+
+	/* Signature scalar out of range in vb2_ed25519_verify() */
+	VB2_ERROR_ED25519_VERIFY_SCALAR,
+
+	/* Public key isn't a curve point in vb2_ed25519_verify() */
+	VB2_ERROR_ED25519_VERIFY_KEY,
+
+	/* Signature mismatch in vb2_ed25519_verify() */
+	VB2_ERROR_ED25519_VERIFY_SIG,
+
+        /**********************************************************************
+	 * Key ring errors
+	 */
+	VB2_ERROR_KEY_RING = VB2_ERROR_BASE + 0x0c0000,
+
+	/* Key without an ID passed to vb21_key_ring_add() */
+	VB2_ERROR_KEY_RING_NO_ID,
+
+	/* Key ID already in the ring in vb21_key_ring_add() */
+	VB2_ERROR_KEY_RING_DUPLICATE_ID,
+
+	/* No room for another key in vb21_key_ring_add() */
+	VB2_ERROR_KEY_RING_FULL,
+
 
         /**********************************************************************
 	 * Errors generated by host library (non-firmware) start here.
@@ -736,6 +824,33 @@ enum vb2_return_code {
 	/* Unable to copy packed key */
 	VB2_ERROR_PACKED_KEY_COPY,
 
+	/* Unable to unpack Ed25519 key in vb2_private_key_unpack() */
+	VB2_ERROR_UNPACK_PRIVATE_KEY_ED25519,
+
+	/* Unable to get Ed25519 key data in vb2_private_key_write() */
+	VB2_ERROR_PRIVATE_KEY_WRITE_ED25519,
+
+	/* Not an Ed25519 key in vb2_private_key_ed25519_public() */
+	VB2_ERROR_ED25519_PUBLIC_KEY,
+
+	/* Too many backends in vb2_register_signer() */
+	VB2_ERROR_SIGNER_REGISTER,
+
+	/* Backend couldn't find the key in vb2_signer_read_key() */
+	VB2_ERROR_SIGNER_OPEN_KEY,
+
+	/* Backend key spec is malformed */
+	VB2_ERROR_SIGNER_KEY_SPEC,
+
+	/* Backend key doesn't match the requested algorithm */
+	VB2_ERROR_SIGNER_ALGORITHM,
+
+	/* Unable to load or initialize the PKCS#11 module */
+	VB2_ERROR_PKCS11_MODULE,
+
+	/* PKCS#11 support isn't built in */
+	VB2_ERROR_PKCS11_UNSUPPORTED,
+
         /**********************************************************************
 	 * Errors generated by host library signature functions
 	 */
@@ -777,6 +892,9 @@ enum vb2_return_code {
 	/* Not enough buffer space to hold signature in vb2_sign_object() */
 	VB2_SIGN_OBJECT_OVERFLOW,
 
+	/* Ed25519 signing failed in vb2_sign_data() */
+	VB2_SIGN_DATA_ED25519,
+
         /**********************************************************************
 	 * Errors generated by host library keyblock functions
 	 */
@@ -794,6 +912,9 @@ enum vb2_return_code {
 	/* Unable to sign keyblock in vb2_create_keyblock() */
 	VB2_KEYBLOCK_CREATE_SIGN,
 
+	/* Destination buffer too small in vb2_build_keyblock() */
+	VB2_KEYBLOCK_CREATE_BUF_SIZE,
+
         /**********************************************************************
 	 * Errors generated by host library firmware preamble functions
 	 */
@@ -808,6 +929,27 @@ enum vb2_return_code {
 	/* Unable to sign preamble in vb2_create_fw_preamble() */
 	VB2_FW_PREAMBLE_CREATE_SIGN,
 
+	/*
+	 * Destination buffer too small in vb2_build_fw_preamble() or
+	 * vb21_fw_preamble_build()
+	 */
+	VB2_FW_PREAMBLE_CREATE_BUF_SIZE,
+
+	/* Unable to copy kernel subkey in vb2_build_fw_preamble() */
+	VB2_FW_PREAMBLE_CREATE_SUBKEY,
+
+	/* Unable to copy body signature in vb2_build_fw_preamble() */
+	VB2_FW_PREAMBLE_CREATE_BODY_SIG,
+
+	/* Destination buffer too small in vb2_build_kernel_preamble() */
+	VB2_KERNEL_PREAMBLE_CREATE_BUF_SIZE,
+
+	/* Unable to sign preamble in vb2_build_kernel_preamble() */
+	VB2_KERNEL_PREAMBLE_CREATE_SIGN,
+
+	/* Unable to hash a component in vb21_fw_preamble_create_from_data() */
+	VB2_FW_PREAMBLE_CREATE_HASH,
+
         /**********************************************************************
 	 * Errors generated by unit test functions
 	 */
@@ -11,7 +11,38 @@
 
 struct vb2_workbuf;
 
-/* Public key structure in RAM */
+/*
+ * Use 64-bit limbs for Montgomery multiplication.  This needs a compiler
+ * with unsigned __int128, so it defaults on only where that exists.  The key
+ * struct below is unchanged; its 32-bit arrays are read as 64-bit limbs.
+ */
+#ifndef VB2_RSA_64BIT_LIMBS
+#ifdef __SIZEOF_INT128__
+#define VB2_RSA_64BIT_LIMBS 1
+#else
+#define VB2_RSA_64BIT_LIMBS 0
+#endif
+#endif
+
+/*
+ * Key sizes to build fixed-size Montgomery routines for, as a mask of the
+ * VB2_RSA_FIXED_* flags below.  Their loops have constant bounds, so they're
+ * faster, but each one adds code; keys of other sizes use the generic
+ * routines.  Boards can set this to just the sizes they use.
+ */
+#define VB2_RSA_FIXED_2048 (1 << 0)
+#define VB2_RSA_FIXED_3072 (1 << 1)
+#define VB2_RSA_FIXED_4096 (1 << 2)
+#define VB2_RSA_FIXED_8192 (1 << 3)
+
+#ifndef VB2_RSA_FIXED_SIZES
+#define VB2_RSA_FIXED_SIZES (VB2_RSA_FIXED_2048 | VB2_RSA_FIXED_4096)
+#endif
+
+/*
+ * Public key structure in RAM.  Ed25519 keys don't have n0inv or rr[]; their
+ * n[] is the encoded public point.
+ */
 struct vb2_public_key {
 	uint32_t arrsize;    /* Length of n[] and rr[] in number of uint32_t */
 	uint32_t n0inv;      /* -1 / n[0] mod 2^32 */
@@ -22,6 +53,7 @@ struct vb2_public_key {
 	const char *desc;			/* Description */
 	uint32_t version;			/* Key version */
 	const struct vb2_id *id;		/* Key ID */
+	int allow_hwcrypto;			/* Try hardware crypto engine */
 };
 
 /**
@@ -44,13 +76,22 @@ enum vb2_signature_algorithm vb2_crypto_to_signature(uint32_t algorithm);
 uint32_t vb2_rsa_sig_size(enum vb2_signature_algorithm sig_alg);
 
 /**
- * Return the size of a pre-processed RSA public key.
+ * Return the size of a pre-processed RSA public key, or of an Ed25519 one.
  *
  * @param sig_alg	Signature algorithm
  * @return The size of the preprocessed key in bytes, or 0 if error.
  */
 uint32_t vb2_packed_key_size(enum vb2_signature_algorithm sig_alg);
 
+/**
+ * Convert a little endian array of words to a big endian byte array.
+ *
+ * @param dst		Destination byte array (4 * words bytes)
+ * @param src		Source word array
+ * @param words		Number of words to convert
+ */
+void vb2_le_words_to_be(uint8_t *dst, const uint32_t *src, uint32_t words);
+
 /**
  * Check pkcs 1.5 padding bytes
  *
@@ -61,7 +102,7 @@ uint32_t vb2_packed_key_size(enum vb2_signature_algorithm sig_alg);
 int vb2_check_padding(const uint8_t *sig, const struct vb2_public_key *key);
 
 /* Size of work buffer sufficient for vb2_rsa_verify_digest() worst case */
-#define VB2_VERIFY_RSA_DIGEST_WORKBUF_BYTES (3 * 1024)
+#define VB2_VERIFY_RSA_DIGEST_WORKBUF_BYTES (2 * 1024)
 
 /**
  * Verify a RSA PKCS1.5 signature against an expected hash digest.
@@ -77,4 +118,46 @@ int vb2_rsa_verify_digest(const struct vb2_public_key *key,
 			  const uint8_t *digest,
 			  const struct vb2_workbuf *wb);
 
+/**
+ * Verify several RSA PKCS1.5 signatures made with the same key.
+ *
+ * This gives the same results as calling vb2_rsa_verify_digest() on each
+ * signature in turn, but only checks the key and allocates the work buffer
+ * once.  All the signatures are checked even if one of them fails.
+ *
+ * @param key		Key to use in signature verification
+ * @param sigs		Signatures to verify (destroyed in process)
+ * @param digests	Digests of signed data, one per signature
+ * @param count		Number of signatures
+ * @param results	Destination for the result of each signature, or NULL
+ * @param wb		Work buffer
+ * @return VB2_SUCCESS if all of the signatures verify, or the error from the
+ * first one which didn't.
+ */
+int vb2_rsa_verify_digest_batch(const struct vb2_public_key *key,
+				uint8_t *const *sigs,
+				const uint8_t *const *digests,
+				uint32_t count,
+				int *results,
+				const struct vb2_workbuf *wb);
+
+/**
+ * Recover the hash digest from a RSA PKCS1.5 signature.
+ *
+ * This does not prove anything about the data the digest came from; it is
+ * for tools which already trust the signature and want to reuse its digest.
+ *
+ * @param key		Key the signature was made with
+ * @param sig		Signature (destroyed in process)
+ * @param digest	Destination for the digest
+ * @param digest_size	Size of digest buffer in bytes
+ * @param wb		Work buffer
+ * @return VB2_SUCCESS, or non-zero if error.
+ */
+int vb2_rsa_recover_digest(const struct vb2_public_key *key,
+			   uint8_t *sig,
+			   uint8_t *digest,
+			   uint32_t digest_size,
+			   const struct vb2_workbuf *wb);
+
 #endif  /* VBOOT_REFERENCE_2RSA_H_ */
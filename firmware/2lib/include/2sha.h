@@ -27,6 +27,16 @@
 #define VB2_SUPPORT_SHA512 1
 #endif
 
+/*
+ * With exactly one algorithm built in, the digest routines call it directly
+ * and the digest context carries no dispatch pointer.
+ */
+#if VB2_SUPPORT_SHA1 + VB2_SUPPORT_SHA256 + VB2_SUPPORT_SHA512 == 1
+#define VB2_HASH_SINGLE_ALG 1
+#else
+#define VB2_HASH_SINGLE_ALG 0
+#endif
+
 /* These are set to the biggest values among the supported hash algorithms.
  * They have to be updated as we add new hash algorithms */
 #define VB2_MAX_DIGEST_SIZE	VB2_SHA512_DIGEST_SIZE
@@ -74,6 +84,20 @@ struct vb2_sha512_context {
 	uint8_t block[2 * VB2_SHA512_BLOCK_SIZE];
 };
 
+struct vb2_digest_context;
+
+/* Operations for one hash algorithm, picked once by vb2_digest_init() */
+struct vb2_hash_ops {
+	enum vb2_hash_algorithm hash_alg;
+	uint32_t digest_size;
+	uint32_t block_size;
+	void (*init)(struct vb2_digest_context *dc);
+	void (*update)(struct vb2_digest_context *dc,
+		       const uint8_t *buf, uint32_t size);
+	void (*finalize)(struct vb2_digest_context *dc, uint8_t *digest);
+	void (*digest)(const uint8_t *buf, uint32_t size, uint8_t *digest);
+};
+
 /* Hash algorithm independent digest context; includes all of the above. */
 struct vb2_digest_context {
 	/* Context union for all algorithms */
@@ -89,6 +113,11 @@ struct vb2_digest_context {
 #endif
 	};
 
+#if !VB2_HASH_SINGLE_ALG
+	/* Operations for the current hash algorithm, or NULL if none */
+	const struct vb2_hash_ops *ops;
+#endif
+
 	/* Current hash algorithm */
 	enum vb2_hash_algorithm hash_alg;
 
@@ -122,6 +151,24 @@ void vb2_sha512_update(struct vb2_sha512_context *ctx,
 		       const uint8_t *data,
 		       uint32_t size);
 
+/* Number of SHA-256 contexts advanced together by vb2_sha256_update_x4() */
+#define VB2_SHA256_LANES 4
+
+/**
+ * Update (extend) four SHA-256 hashes by the same number of bytes.
+ *
+ * When the contexts are block-aligned, whole blocks are hashed in parallel
+ * lanes if the CPU supports it; otherwise this is equivalent to calling
+ * vb2_sha256_update() on each context in turn.
+ *
+ * @param ctx		Hash contexts
+ * @param data		Data to hash, one buffer per context
+ * @param size		Length of each buffer in bytes
+ */
+void vb2_sha256_update_x4(struct vb2_sha256_context *ctx[VB2_SHA256_LANES],
+			  const uint8_t *const data[VB2_SHA256_LANES],
+			  uint32_t size);
+
 /**
  * Finalize a hash digest.
  *
@@ -132,6 +179,21 @@ void vb2_sha1_finalize(struct vb2_sha1_context *ctx, uint8_t *digest);
 void vb2_sha256_finalize(struct vb2_sha256_context *ctx, uint8_t *digest);
 void vb2_sha512_finalize(struct vb2_sha512_context *ctx, uint8_t *digest);
 
+/**
+ * Calculate the digest of a buffer in one call.
+ *
+ * Whole blocks are hashed straight from the buffer, and only the last one or
+ * two blocks are padded, so short inputs cost just their compression-function
+ * calls.
+ *
+ * @param data		Data to hash
+ * @param size		Length of data in bytes
+ * @param digest	Destination for digest
+ */
+void vb2_sha1_digest(const uint8_t *data, uint32_t size, uint8_t *digest);
+void vb2_sha256_digest(const uint8_t *data, uint32_t size, uint8_t *digest);
+void vb2_sha512_digest(const uint8_t *data, uint32_t size, uint8_t *digest);
+
 /**
  * Hash-extend data
  *
@@ -229,4 +291,68 @@ int vb2_digest_buffer(const uint8_t *buf,
 		      uint8_t *digest,
 		      uint32_t digest_size);
 
+/**
+ * Initialize several digest contexts for the same hash algorithm.
+ *
+ * The vb2_digest_multi_*() functions hash several independent buffers of
+ * the same length together, which lets SHA-256 use parallel lanes.  They
+ * do not use vb2ex_hwcrypto routines.
+ *
+ * @param dc		Array of digest contexts
+ * @param count		Number of contexts
+ * @param hash_alg	Hash algorithm
+ * @return VB2_SUCCESS, or non-zero on error.
+ */
+int vb2_digest_multi_init(struct vb2_digest_context *dc,
+			  int count,
+			  enum vb2_hash_algorithm hash_alg);
+
+/**
+ * Extend several digests, each by the same number of bytes.
+ *
+ * @param dc		Array of digest contexts
+ * @param count		Number of contexts
+ * @param bufs		Data to hash, one buffer per context
+ * @param size		Length of each buffer in bytes
+ * @return VB2_SUCCESS, or non-zero on error.
+ */
+int vb2_digest_multi_extend(struct vb2_digest_context *dc,
+			    int count,
+			    const uint8_t *const *bufs,
+			    uint32_t size);
+
+/**
+ * Finalize several digests.
+ *
+ * @param dc		Array of digest contexts
+ * @param count		Number of contexts
+ * @param digests	Destination for digests; digest i is stored at
+ *			digests + i * digest_size.
+ * @param digest_size	Length of each digest slot in bytes.
+ * @return VB2_SUCCESS, or non-zero on error.
+ */
+int vb2_digest_multi_finalize(struct vb2_digest_context *dc,
+			      int count,
+			      uint8_t *digests,
+			      uint32_t digest_size);
+
+/**
+ * Calculate the digests of several buffers of the same length.
+ *
+ * @param bufs		Data to hash, one buffer per digest
+ * @param size		Length of each buffer in bytes
+ * @param count		Number of buffers
+ * @param hash_alg	Hash algorithm
+ * @param digests	Destination for digests; digest i is stored at
+ *			digests + i * digest_size.
+ * @param digest_size	Length of each digest slot in bytes.
+ * @return VB2_SUCCESS, or non-zero on error.
+ */
+int vb2_digest_multi_buffer(const uint8_t *const *bufs,
+			    uint32_t size,
+			    int count,
+			    enum vb2_hash_algorithm hash_alg,
+			    uint8_t *digests,
+			    uint32_t digest_size);
+
 #endif  /* VBOOT_REFERENCE_2SHA_H_ */
@@ -0,0 +1,70 @@
+/* Copyright 2018 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ *
+ * Private declarations shared between the portable SHA code and the
+ * architecture-specific block transforms.
+ */
+
+#ifndef VBOOT_REFERENCE_2SHA_PRIVATE_H_
+#define VBOOT_REFERENCE_2SHA_PRIVATE_H_
+
+/*
+ * Architecture-specific transforms are selected at build time with
+ * SHA_ARCH=x86 or SHA_ARCH=arm64; see the Makefile.
+ */
+#if defined(VB2_SHA_ARCH_X86) || defined(VB2_SHA_ARCH_ARM64)
+#define VB2_SHA_ARCH 1
+#else
+#define VB2_SHA_ARCH 0
+#endif
+
+/* SHA-256 round constants */
+extern const uint32_t vb2_sha256_k[64];
+
+/**
+ * Run the SHA-256 block transform using CPU SHA instructions.
+ *
+ * @param h		Hash state (8 words)
+ * @param message	Message blocks
+ * @param block_nb	Number of 64-byte blocks
+ * @return 1 if the blocks were processed, 0 if the CPU lacks the needed
+ * instructions and the caller must use the portable transform.
+ */
+int vb2_sha256_transform_arch(uint32_t *h, const uint8_t *message,
+			      unsigned int block_nb);
+
+/**
+ * Run the SHA-1 block transform using CPU SHA instructions.
+ *
+ * @param state		Hash state (5 words)
+ * @param message	Message blocks
+ * @param block_nb	Number of 64-byte blocks
+ * @return 1 if the blocks were processed, 0 if the CPU lacks the needed
+ * instructions and the caller must use the portable transform.
+ */
+int vb2_sha1_transform_arch(uint32_t *state, const uint8_t *message,
+			    unsigned int block_nb);
+
+/**
+ * Run the SHA-256 block transform on four independent messages in parallel
+ * SIMD lanes.
+ *
+ * @param h		Hash state (8 words) for each lane
+ * @param message	Message blocks for each lane
+ * @param block_nb	Number of 64-byte blocks in each lane
+ * @return 1 if the blocks were processed, 0 if this is not faster than
+ * running the single-lane transform on each message.
+ */
+int vb2_sha256_transform_x4_arch(uint32_t *const h[4],
+				 const uint8_t *const message[4],
+				 unsigned int block_nb);
+
+#ifdef VB2_SHA_ARCH_X86
+/* SSE2 4-lane SHA-256 transform; exported for tests */
+void vb2_sha256_transform_x4_sse2(uint32_t *const h[4],
+				  const uint8_t *const message[4],
+				  unsigned int block_nb);
+#endif
+
+#endif  /* VBOOT_REFERENCE_2SHA_PRIVATE_H_ */
@@ -68,8 +68,106 @@ enum vb2_shared_data_status {
 
 	/* Secure data kernel version space initialized */
 	VB2_SD_STATUS_SECDATAK_INIT = (1 << 4),
+
+	/* Resume state from the last normal boot supplied for S3 resume */
+	VB2_SD_STATUS_RESUME_STATE = (1 << 5),
+};
+
+/*
+ * Boot timestamp events, recorded with vb2_timestamp() when the firmware is
+ * built with TIMESTAMPS=1.  These values are exported to the OS through
+ * VbSharedDataHeader, so existing values must not be renumbered.
+ */
+enum vb2_timestamp_event {
+	VB2_TS_FW_PHASE1_ENTER = 1,
+	VB2_TS_FW_PHASE1_EXIT = 2,
+	VB2_TS_FW_PHASE2_ENTER = 3,
+	VB2_TS_FW_PHASE2_EXIT = 4,
+	VB2_TS_FW_PHASE3_ENTER = 5,
+	VB2_TS_FW_PHASE3_EXIT = 6,
+	VB2_TS_INIT_HASH = 7,
+	VB2_TS_CHECK_HASH_ENTER = 8,
+	VB2_TS_CHECK_HASH_EXIT = 9,
+	VB2_TS_LOAD_KERNEL_ENTER = 10,
+	VB2_TS_LOAD_KERNEL_EXIT = 11,
+	VB2_TS_DISK_READ_START = 12,
+	VB2_TS_DISK_READ_END = 13,
+	VB2_TS_RSA_VERIFY_START = 14,
+	VB2_TS_RSA_VERIFY_END = 15,
+};
+
+/* A single boot timestamp */
+struct vb2_timestamp {
+	/* Time from vb2ex_mtime() */
+	uint32_t time_ms;
+
+	/* Event; see enum vb2_timestamp_event */
+	uint32_t event;
+} __attribute__((packed));
+
+/* Number of timestamps kept in vb2_shared_data.  Must be power of 2. */
+#define VB2_MAX_TIMESTAMPS 32
+
+/*
+ * Boot phases whose peak work buffer usage is recorded with
+ * vb2_workbuf_phase() when the firmware is built with WORKBUF_STATS=1.
+ */
+enum vb2_workbuf_phase {
+	VB2_WB_PHASE_NONE = 0,
+	VB2_WB_PHASE_FW1,
+	VB2_WB_PHASE_FW2,
+	VB2_WB_PHASE_FW3,
+	VB2_WB_PHASE_KERNEL1,
+	VB2_WB_PHASE_KERNEL2,
+	VB2_WB_PHASE_KERNEL3,
+	VB2_WB_PHASE_LOAD_KERNEL,
+
+	/* Number of phases; must be last */
+	VB2_WB_PHASE_COUNT
 };
 
+/* Flags for vb2_resume_state.flags; which digests have been verified */
+enum vb2_resume_state_flags {
+	VB2_RESUME_KEYBLOCK = (1 << 0),
+	VB2_RESUME_PREAMBLE = (1 << 1),
+	VB2_RESUME_BODY = (1 << 2),
+
+	VB2_RESUME_ALL = (VB2_RESUME_KEYBLOCK | VB2_RESUME_PREAMBLE |
+			  VB2_RESUME_BODY),
+};
+
+#define VB2_RESUME_STATE_MAGIC 0x53524256  /* "VBRS" */
+#define VB2_RESUME_STATE_VERSION 1
+
+/*
+ * Digests of the RW firmware verified on a normal boot.  On S3 resume, data
+ * which still matches these is known to have been verified already, so its
+ * signature is not checked again.  See vb2api_get_resume_state().
+ */
+struct vb2_resume_state {
+	/* Magic number; VB2_RESUME_STATE_MAGIC */
+	uint32_t magic;
+
+	/* Version of this struct; VB2_RESUME_STATE_VERSION */
+	uint16_t struct_version;
+
+	/* Firmware slot verified (0=A, 1=B) */
+	uint8_t fw_slot;
+
+	/* Flags; see enum vb2_resume_state_flags */
+	uint8_t flags;
+
+	/* Hash algorithm of body_digest (enum vb2_hash_algorithm) */
+	uint32_t body_hash_alg;
+
+	/* SHA-256 digests of the keyblock and of the preamble */
+	uint8_t keyblock_digest[32];
+	uint8_t preamble_digest[32];
+
+	/* Digest of the firmware body, padded to the largest digest size */
+	uint8_t body_digest[64];
+} __attribute__((packed));
+
 /*
  * Data shared between vboot API calls.  Stored at the start of the work
  * buffer.
@@ -113,6 +211,15 @@ struct vb2_shared_data {
 	 */
 	uint32_t status;
 
+	/*
+	 * Offset and size of the resource read cache in the work buffer, and
+	 * how much of it holds cached reads.  Size is 0 if there is no cache;
+	 * see vb2api_init_read_cache().
+	 */
+	uint32_t workbuf_read_cache_offset;
+	uint32_t workbuf_read_cache_size;
+	uint32_t read_cache_used;
+
 	/**********************************************************************
 	 * Data from kernel verification stage.
 	 *
@@ -162,6 +269,15 @@ struct vb2_shared_data {
 	uint32_t workbuf_preamble_offset;
 	uint32_t workbuf_preamble_size;
 
+	/*
+	 * Offset and size of the start of the firmware vblock, read ahead
+	 * into the work buffer by vb2_read_vblock_ahead().  Size is 0 if
+	 * nothing was read ahead.  The data is past workbuf_used once the
+	 * keyblock is loaded, so it only lasts until the preamble is loaded.
+	 */
+	uint32_t workbuf_vblock_ahead_offset;
+	uint32_t workbuf_vblock_ahead_size;
+
 	/*
 	 * Offset and size of hash context in work buffer.  Size is 0 if
 	 * hash context is not stored in the work buffer.
@@ -183,6 +299,14 @@ struct vb2_shared_data {
 	/* Amount of data we still expect to hash */
 	uint32_t hash_remaining_size;
 
+	/*
+	 * Offset of the table of hashes started by vb21api_init_hash_tag()
+	 * in the work buffer, and the number of entries in it.  Count is 0 if
+	 * the table has not been allocated.
+	 */
+	uint32_t workbuf_hash_tags_offset;
+	uint32_t hash_tags_count;
+
 	/**********************************************************************
 	 * Temporary variables used during kernel verification.  These don't
 	 * really need to persist through to the OS, but there's nowhere else
@@ -208,10 +332,51 @@ struct vb2_shared_data {
 	uint32_t workbuf_kernel_key_offset;
 	uint32_t workbuf_kernel_key_size;
 
+	/*
+	 * Offset and size of the kernel vblock verification cache in work
+	 * buffer.  Size is 0 if the cache has not been allocated.  Unlike the
+	 * other kernel fields, this persists across LoadKernel() calls.
+	 */
+	uint32_t workbuf_vblock_cache_offset;
+	uint32_t workbuf_vblock_cache_size;
+
+	/*
+	 * Offset and size of the unpacked key cache in work buffer.  Size is
+	 * 0 if the cache has not been allocated.  This also persists across
+	 * LoadKernel() calls.
+	 */
+	uint32_t workbuf_key_cache_offset;
+	uint32_t workbuf_key_cache_size;
+
 	/* GBB data and size */
 	struct vb2_gbb_header *gbb;
 	uint32_t gbb_size;
 
+	/*
+	 * Digests of the RW firmware verified this boot, or on S3 resume the
+	 * ones recorded on the last normal boot until they are checked.
+	 */
+	struct vb2_resume_state resume;
+
+#ifdef VB2_TIMESTAMPS
+	/*
+	 * Ring of boot timestamps.  timestamp_count is the total number
+	 * recorded; once it exceeds VB2_MAX_TIMESTAMPS the oldest entries
+	 * have been overwritten.
+	 */
+	uint32_t timestamp_count;
+	struct vb2_timestamp timestamps[VB2_MAX_TIMESTAMPS];
+#endif
+
+#ifdef VB2_WORKBUF_STATS
+	/*
+	 * Phase currently being charged for work buffer usage, and the peak
+	 * number of bytes used from the start of the work buffer during each
+	 * phase (see enum vb2_workbuf_phase).
+	 */
+	uint32_t workbuf_phase;
+	uint32_t workbuf_peak[VB2_WB_PHASE_COUNT];
+#endif
 
 } __attribute__((packed));
 
@@ -370,4 +535,38 @@ struct vb2_ryu_root_key_hash {
 
 #define EXPECTED_VB2_RYU_ROOT_KEY_HASH_SIZE 48
 
+/*
+ * Precomputed hash of an EC image.  This is built alongside the EC image and
+ * stored in the AP-RW firmware (for example as a CBFS file next to the image),
+ * so it's covered by the firmware signature.  EC software sync compares it
+ * against the hash reported by the EC, and only reads the image itself if
+ * the EC needs updating.
+ */
+
+#define VB2_EC_IMAGE_HASH_MAGIC "EcImHash"
+#define VB2_EC_IMAGE_HASH_MAGIC_SIZE 8
+
+#define VB2_EC_IMAGE_HASH_VERSION_MAJOR 1
+#define VB2_EC_IMAGE_HASH_VERSION_MINOR 0
+
+struct vb2_ec_image_hash {
+	/* Magic number (VB2_EC_IMAGE_HASH_MAGIC) */
+	uint8_t magic[VB2_EC_IMAGE_HASH_MAGIC_SIZE];
+
+	/* Version of this struct */
+	uint16_t header_version_major;
+	uint16_t header_version_minor;
+
+	/*
+	 * Length of this struct, in bytes, including any variable length data
+	 * which follows (there is none, yet).
+	 */
+	uint32_t struct_size;
+
+	/* SHA-256 hash digest of the EC image, as VbExEcHashImage() reports */
+	uint8_t digest[32];
+};
+
+#define EXPECTED_VB2_EC_IMAGE_HASH_SIZE 48
+
 #endif  /* VBOOT_REFERENCE_VBOOT_2STRUCT_H_ */
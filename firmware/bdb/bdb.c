@@ -384,8 +384,7 @@ int bdb_verify(const void *buf, size_t size, const uint8_t *bdb_key_digest)
 		return BDB_ERROR_BDBKEY;
 
 	/* Calculate BDB key digest and compare with expected */
-	if (vb2_digest_buffer((uint8_t *)bdbkey, bdbkey->struct_size,
-			      VB2_HASH_SHA256, digest, BDB_SHA256_DIGEST_SIZE))
+	if (bdb_sha256(digest, bdbkey, bdbkey->struct_size))
 		return BDB_ERROR_DIGEST;
 
 	if (bdb_key_digest)
@@ -417,8 +416,7 @@ int bdb_verify(const void *buf, size_t size, const uint8_t *bdb_key_digest)
 		return BDB_ERROR_HEADER_SIG;
 
 	/* Calculate header digest and compare with expected signature */
-	if (vb2_digest_buffer((uint8_t *)oem, h->signed_size,
-			      VB2_HASH_SHA256, digest, BDB_SHA256_DIGEST_SIZE))
+	if (bdb_sha256(digest, oem, h->signed_size))
 		return BDB_ERROR_DIGEST;
 	if (bdb_verify_sig(bdbkey, sig, digest))
 		return BDB_ERROR_HEADER_SIG;
@@ -439,8 +437,7 @@ int bdb_verify(const void *buf, size_t size, const uint8_t *bdb_key_digest)
 		return BDB_ERROR_DATA_SIGNED_SIZE;
 
 	/* Calculate data digest and compare with expected signature */
-	if (vb2_digest_buffer((uint8_t *)data, data->signed_size,
-			      VB2_HASH_SHA256, digest, BDB_SHA256_DIGEST_SIZE))
+	if (bdb_sha256(digest, data, data->signed_size))
 		return BDB_ERROR_DIGEST;
 	if (bdb_verify_sig(datakey, sig, digest))
 		return BDB_ERROR_DATA_SIG;
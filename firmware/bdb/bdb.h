@@ -11,6 +11,7 @@
 #include <stdlib.h>
 #include <stddef.h>
 
+#include "2sha.h"
 #include "bdb_struct.h"
 
 /*****************************************************************************/
@@ -101,6 +102,11 @@ enum bdb_return_code {
 	BDB_ERROR_SECRET_BOOT_VERIFIED,
 	BDB_ERROR_SECRET_BOOT_PATH,
 	BDB_ERROR_SECRET_BDB,
+
+	/* Errors in bdb_load() */
+	BDB_ERROR_LOAD_ADDRESS,
+	BDB_ERROR_LOAD_READ,
+	BDB_ERROR_LOAD_DIGEST,
 };
 
 /*****************************************************************************/
@@ -159,6 +165,58 @@ const struct bdb_hash *bdb_get_hash_by_type(const void *buf,
 const struct bdb_hash *bdb_get_hash_by_index(const void *buf, int index);
 const struct bdb_sig *bdb_get_data_sig(const void *buf);
 
+/* Chunk size bdb_load() reads and hashes in */
+#define BDB_LOAD_CHUNK_SIZE (64 * 1024)
+
+/* Most hash entries bdb_load() loads at once */
+#define BDB_LOAD_MAX_CHANNELS 4
+
+/* Callbacks for bdb_load() */
+struct bdb_load_ops {
+	/*
+	 * Read size bytes from offset in a partition into buf.  Required.
+	 * Returns 0 if success, non-zero if error.
+	 */
+	int (*read)(void *ctx, int partition, uint64_t offset, void *buf,
+		    uint32_t size);
+
+	/*
+	 * Optional asynchronous reads on DMA channels 0 to channels - 1.
+	 * read_start() starts a read like read() does, and read_wait() waits
+	 * for the read on that channel to finish.  Each channel has at most
+	 * one read outstanding.  If read_start is NULL, read() is used and
+	 * entries are loaded one at a time.
+	 */
+	int (*read_start)(void *ctx, int channel, int partition,
+			  uint64_t offset, void *buf, uint32_t size);
+	int (*read_wait)(void *ctx, int channel);
+	int channels;
+
+	/*
+	 * Optional; return where to load a hash entry, or NULL if error.  If
+	 * get_dest is NULL, each entry is loaded to its load_address.
+	 */
+	void *(*get_dest)(void *ctx, const struct bdb_hash *hash);
+
+	/* Passed to the callbacks */
+	void *ctx;
+};
+
+/**
+ * Load the data for each hash entry in a verified BDB and check its digest.
+ *
+ * Each entry is read in BDB_LOAD_CHUNK_SIZE chunks, and each chunk is
+ * hashed while the next one is read.  With asynchronous reads on several
+ * channels, that many entries are loaded at once.
+ *
+ * Do not call this until after bdb_verify().
+ *
+ * @param buf		Pointer to BDB buffer
+ * @param ops		Callbacks to read the data
+ * @return 0 if success, non-zero error code if error.
+ */
+int bdb_load(const void *buf, const struct bdb_load_ops *ops);
+
 /**
  * Functions to calculate size of BDB components
  *
@@ -191,6 +249,30 @@ ptrdiff_t bdb_offset_of_data(const void *buf);
  */
 int bdb_sha256(void *digest, const void *buf, size_t size);
 
+/* Context for calculating a SHA-256 digest a piece at a time */
+struct bdb_sha256_context {
+	struct vb2_sha256_context vb2;
+};
+
+/**
+ * Calculate a SHA-256 digest of data which arrives in pieces.
+ *
+ * Call bdb_sha256_init(), then bdb_sha256_update() for each piece of data
+ * in order, then bdb_sha256_finalize().  The digest is the same one
+ * bdb_sha256() calculates for all the data at once.
+ *
+ * @param ctx		Hash context
+ * @param buf		Data to hash
+ * @param size		Size of data in bytes
+ * @param digest	Pointer to the digest buffer.  Must be
+ *			BDB_SHA256_DIGEST_SIZE bytes long.
+ * @return 0 if success, non-zero error code if error.
+ */
+int bdb_sha256_init(struct bdb_sha256_context *ctx);
+int bdb_sha256_update(struct bdb_sha256_context *ctx, const void *buf,
+		      size_t size);
+int bdb_sha256_finalize(struct bdb_sha256_context *ctx, void *digest);
+
 /**
  * Verify a RSA-4096 signed digest
  *
@@ -93,6 +93,18 @@ int vba_update_buc(struct vba_context *ctx, uint8_t *new_buc);
 int vba_derive_secret(struct vba_context *ctx, enum bdb_secret_type type,
 		      uint8_t *wsr, const uint8_t *buf, uint32_t buf_size);
 
+/**
+ * Derive all the secrets for SP-RW
+ *
+ * This derives the BDB, boot path, boot verified and BUC secrets from
+ * ctx->bdb in the order they depend on each other, the same as calling
+ * vba_derive_secret() for each of them.
+ *
+ * @param ctx
+ * @return		BDB_SUCCESS or BDB_ERROR_*
+ */
+int vba_derive_secrets(struct vba_context *ctx);
+
 /**
  * Clear a secret
  *
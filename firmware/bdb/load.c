@@ -0,0 +1,158 @@
+/* Copyright 2018 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ *
+ * Boot descriptor block verify-on-load
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "bdb.h"
+
+/* Hash entry being loaded on one channel */
+struct load_entry {
+	/* Entry, or NULL if the channel is idle */
+	const struct bdb_hash *hash;
+	uint8_t *dest;
+
+	/* Bytes read so far, and how many of those have been hashed */
+	uint32_t read;
+	uint32_t hashed;
+
+	/* Size of the read outstanding, or 0 if none */
+	uint32_t pending;
+
+	struct bdb_sha256_context sha;
+};
+
+/**
+ * Start reading the next chunk of an entry.
+ */
+static int start_chunk(const struct bdb_load_ops *ops, int channel,
+		       struct load_entry *e)
+{
+	uint32_t size = e->hash->size - e->read;
+	uint64_t offset = e->hash->offset + e->read;
+	uint8_t *buf = e->dest + e->read;
+	int rv;
+
+	if (size > BDB_LOAD_CHUNK_SIZE)
+		size = BDB_LOAD_CHUNK_SIZE;
+
+	if (ops->read_start)
+		rv = ops->read_start(ops->ctx, channel, e->hash->partition,
+				     offset, buf, size);
+	else
+		rv = ops->read(ops->ctx, e->hash->partition, offset, buf, size);
+	if (rv)
+		return BDB_ERROR_LOAD_READ;
+
+	e->read += size;
+	e->pending = size;
+	return BDB_SUCCESS;
+}
+
+/**
+ * Set up a channel to load a hash entry, and start reading its first chunk.
+ */
+static int start_entry(const struct bdb_load_ops *ops, int channel,
+		       struct load_entry *e, const struct bdb_hash *hash)
+{
+	memset(e, 0, sizeof(*e));
+
+	if (ops->get_dest)
+		e->dest = ops->get_dest(ops->ctx, hash);
+	else if (hash->load_address != (uint64_t)-1)
+		e->dest = (uint8_t *)(uintptr_t)hash->load_address;
+	if (!e->dest)
+		return BDB_ERROR_LOAD_ADDRESS;
+
+	e->hash = hash;
+	bdb_sha256_init(&e->sha);
+
+	if (!hash->size)
+		return BDB_SUCCESS;
+
+	return start_chunk(ops, channel, e);
+}
+
+/**
+ * Wait for the chunk being read on a channel, start reading the one after
+ * it, and hash the chunk just read while that loads.
+ *
+ * If stop is non-zero, just wait for the outstanding read and drop the
+ * entry.
+ */
+static int next_chunk(const struct bdb_load_ops *ops, int channel,
+		      struct load_entry *e, int stop)
+{
+	uint8_t digest[BDB_SHA256_DIGEST_SIZE];
+	uint8_t *chunk = e->dest + e->hashed;
+	uint32_t size = e->pending;
+	int rv = BDB_SUCCESS;
+
+	if (size && ops->read_start && ops->read_wait(ops->ctx, channel))
+		rv = BDB_ERROR_LOAD_READ;
+	e->pending = 0;
+
+	if (!rv && !stop && e->read < e->hash->size)
+		rv = start_chunk(ops, channel, e);
+	if (rv || stop) {
+		e->hash = NULL;
+		return rv;
+	}
+
+	bdb_sha256_update(&e->sha, chunk, size);
+	e->hashed += size;
+	if (e->hashed < e->hash->size)
+		return BDB_SUCCESS;
+
+	/* Entry is all loaded, so check it */
+	bdb_sha256_finalize(&e->sha, digest);
+	if (memcmp(digest, e->hash->digest, sizeof(digest)))
+		rv = BDB_ERROR_LOAD_DIGEST;
+	e->hash = NULL;
+	return rv;
+}
+
+int bdb_load(const void *buf, const struct bdb_load_ops *ops)
+{
+	struct load_entry entries[BDB_LOAD_MAX_CHANNELS];
+	const struct bdb_data *data = bdb_get_data(buf);
+	int channels = 1;
+	int next = 0;
+	int rv = BDB_SUCCESS;
+	int active, c;
+
+	if (ops->read_start && ops->read_wait && ops->channels > 1)
+		channels = ops->channels < BDB_LOAD_MAX_CHANNELS ?
+			ops->channels : BDB_LOAD_MAX_CHANNELS;
+
+	memset(entries, 0, sizeof(entries));
+
+	/*
+	 * Round-robin the channels.  Once something fails, no new reads are
+	 * started, but the ones outstanding are still waited for.
+	 */
+	do {
+		active = 0;
+		for (c = 0; c < channels; c++) {
+			struct load_entry *e = entries + c;
+			int r;
+
+			if (!e->hash && !rv && next < data->num_hashes)
+				rv = start_entry(ops, c, e,
+					bdb_get_hash_by_index(buf, next++));
+			if (!e->hash)
+				continue;
+
+			active = 1;
+			r = next_chunk(ops, c, e, rv != BDB_SUCCESS);
+			if (!rv)
+				rv = r;
+		}
+	} while (active);
+
+	return rv;
+}
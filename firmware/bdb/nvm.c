@@ -4,6 +4,7 @@
  */
 
 #include "2sysincludes.h"
+#include "2common.h"
 #include "2hmac.h"
 #include "2sha.h"
 #include "bdb_api.h"
@@ -39,13 +40,39 @@ static int nvmrw_validate(const void *buf, uint32_t size)
 	return BDB_SUCCESS;
 }
 
-static int nvmrw_verify(const struct bdb_secrets *secrets,
+/* Start the HMAC of NVM-RW, so it can be reused for each copy */
+static int nvmrw_key(const struct bdb_secrets *secrets,
+		     struct vb2_hmac_context *key)
+{
+	if (!secrets)
+		return BDB_ERROR_NVM_INVALID_PARAMETER;
+
+	if (vb2_hmac_init(key, VB2_HASH_SHA256,
+			  secrets->nvm_rw, BDB_SECRET_SIZE))
+		return BDB_ERROR_NVM_RW_HMAC;
+
+	return BDB_SUCCESS;
+}
+
+static int nvmrw_mac(const struct vb2_hmac_context *key,
+		     const struct nvmrw *nvm, uint8_t *mac, uint32_t mac_size)
+{
+	struct vb2_hmac_context hc = *key;
+
+	if (vb2_hmac_update(&hc, nvm, nvm->struct_size - NVM_HMAC_SIZE) ||
+	    vb2_hmac_final(&hc, mac, mac_size))
+		return BDB_ERROR_NVM_RW_HMAC;
+
+	return BDB_SUCCESS;
+}
+
+static int nvmrw_verify(const struct vb2_hmac_context *key,
 			const struct nvmrw *nvm, uint32_t size)
 {
 	uint8_t mac[NVM_HMAC_SIZE];
 	int rv;
 
-	if (!secrets || !nvm)
+	if (!key || !nvm)
 		return BDB_ERROR_NVM_INVALID_PARAMETER;
 
 	rv = nvmrw_validate(nvm, size);
@@ -53,36 +80,27 @@ static int nvmrw_verify(const struct bdb_secrets *secrets,
 		return rv;
 
 	/* Compute and verify HMAC */
-	if (hmac(VB2_HASH_SHA256, secrets->nvm_rw, BDB_SECRET_SIZE,
-		 nvm, nvm->struct_size - sizeof(mac), mac, sizeof(mac)))
+	if (nvmrw_mac(key, nvm, mac, sizeof(mac)))
 		return BDB_ERROR_NVM_RW_HMAC;
-	/* TODO: Use safe_memcmp */
-	if (memcmp(mac, nvm->hmac, sizeof(mac)))
+	if (vb2_safe_memcmp(mac, nvm->hmac, sizeof(mac)))
 		return BDB_ERROR_NVM_RW_INVALID_HMAC;
 
 	return BDB_SUCCESS;
 }
 
-int nvmrw_write(struct vba_context *ctx, enum nvm_type type)
+static int write_nvmrw(struct vba_context *ctx,
+		       const struct vb2_hmac_context *key, enum nvm_type type)
 {
 	struct nvmrw *nvm = &ctx->nvmrw;
 	int retry = NVM_MAX_WRITE_RETRY;
 	int rv;
 
-	if (!ctx)
-		return BDB_ERROR_NVM_INVALID_PARAMETER;
-
-	if (!ctx->secrets)
-		return BDB_ERROR_NVM_INVALID_SECRET;
-
 	rv = nvmrw_validate(nvm, sizeof(*nvm));
 	if (rv)
 		return rv;
 
 	/* Update HMAC */
-	hmac(VB2_HASH_SHA256, ctx->secrets->nvm_rw, BDB_SECRET_SIZE,
-	     nvm, nvm->struct_size - sizeof(nvm->hmac),
-	     nvm->hmac, sizeof(nvm->hmac));
+	nvmrw_mac(key, nvm, nvm->hmac, sizeof(nvm->hmac));
 
 	while (retry--) {
 		uint8_t buf[sizeof(struct nvmrw)];
@@ -100,66 +118,123 @@ int nvmrw_write(struct vba_context *ctx, enum nvm_type type)
 	return BDB_ERROR_NVM_WRITE;
 }
 
-static int read_verify_nvmrw(enum nvm_type type,
-			     const struct bdb_secrets *secrets,
-			     uint8_t *buf, uint32_t buf_size)
+int nvmrw_write(struct vba_context *ctx, enum nvm_type type)
 {
-	struct nvmrw *nvm = (struct nvmrw *)buf;
+	struct vb2_hmac_context key;
 	int rv;
 
-	/* Read minimum amount */
-	if (vbe_read_nvm(type, buf, NVM_MIN_STRUCT_SIZE))
-		return BDB_ERROR_NVM_VBE_READ;
+	if (!ctx)
+		return BDB_ERROR_NVM_INVALID_PARAMETER;
 
-	/* Validate the content */
-	rv = nvmrw_validate(buf, buf_size);
+	if (!ctx->secrets)
+		return BDB_ERROR_NVM_INVALID_SECRET;
+
+	rv = nvmrw_key(ctx->secrets, &key);
 	if (rv)
 		return rv;
 
+	return write_nvmrw(ctx, &key, type);
+}
+
+/* Enough of NVM-RW to learn its size and which copy is newer */
+#define NVM_RW_COUNT_SIZE \
+	(offsetof(struct nvmrw, update_count) + sizeof(uint32_t))
+
+static int read_nvmrw_header(enum nvm_type type,
+			     uint8_t *buf, uint32_t buf_size)
+{
+	if (vbe_read_nvm(type, buf, NVM_RW_COUNT_SIZE))
+		return BDB_ERROR_NVM_VBE_READ;
+
+	return nvmrw_validate(buf, buf_size);
+}
+
+/* Read the rest of a copy whose header is good, and verify it */
+static int read_verify_nvmrw(enum nvm_type type,
+			     const struct vb2_hmac_context *key, uint8_t *buf)
+{
+	struct nvmrw *nvm = (struct nvmrw *)buf;
+
 	/* Read full body */
 	if (vbe_read_nvm(type, buf, nvm->struct_size))
 		return BDB_ERROR_NVM_VBE_READ;
 
 	/* Verify the content */
-	rv = nvmrw_verify(secrets, nvm, sizeof(*nvm));
-		return rv;
+	return nvmrw_verify(key, nvm, sizeof(*nvm));
+}
 
-	return BDB_SUCCESS;
+/*
+ * Read the rest of a copy with the same update count as the [good] one. If
+ * it's identical, it's as valid as [good] is, and doesn't need an HMAC.
+ */
+static int read_check_nvmrw(enum nvm_type type,
+			    const struct vb2_hmac_context *key, uint8_t *buf,
+			    const struct nvmrw *good)
+{
+	struct nvmrw *nvm = (struct nvmrw *)buf;
+
+	if (nvm->struct_size == good->struct_size) {
+		if (vbe_read_nvm(type, buf, nvm->struct_size))
+			return BDB_ERROR_NVM_VBE_READ;
+		if (!memcmp(nvm, good, nvm->struct_size))
+			return BDB_SUCCESS;
+		return nvmrw_verify(key, nvm, sizeof(*nvm));
+	}
+
+	return read_verify_nvmrw(type, key, buf);
 }
 
-int nvmrw_read(struct vba_context *ctx)
+static int read_nvmrw(struct vba_context *ctx,
+		      const struct vb2_hmac_context *key)
 {
-	uint8_t buf1[NVM_RW_MAX_STRUCT_SIZE];
-	uint8_t buf2[NVM_RW_MAX_STRUCT_SIZE];
-	struct nvmrw *nvm1 = (struct nvmrw *)buf1;
-	struct nvmrw *nvm2 = (struct nvmrw *)buf2;
-	int rv1, rv2;
+	static const enum nvm_type type[2] = {
+		NVM_TYPE_RW_PRIMARY,
+		NVM_TYPE_RW_SECONDARY,
+	};
+	uint8_t buf[2][NVM_RW_MAX_STRUCT_SIZE];
+	struct nvmrw *nvm[2] = {
+		(struct nvmrw *)buf[0],
+		(struct nvmrw *)buf[1],
+	};
+	int rv[2];
+	int first, second;
+
+	/* The headers say which copy is newer */
+	rv[0] = read_nvmrw_header(type[0], buf[0], sizeof(buf[0]));
+	rv[1] = read_nvmrw_header(type[1], buf[1], sizeof(buf[1]));
 
-	/* Read and verify the 1st copy */
-	rv1 = read_verify_nvmrw(NVM_TYPE_RW_PRIMARY, ctx->secrets,
-				buf1, sizeof(buf1));
-
-	/* Read and verify the 2nd copy */
-	rv2 = read_verify_nvmrw(NVM_TYPE_RW_SECONDARY, ctx->secrets,
-				buf2, sizeof(buf2));
-
-	if (rv1 == BDB_SUCCESS && rv2 == BDB_SUCCESS) {
-		/* Sync primary and secondary based on update_count. */
-		if (nvm1->update_count > nvm2->update_count)
-			rv2 = !BDB_SUCCESS;
-		else if (nvm1->update_count < nvm2->update_count)
-			rv1 = !BDB_SUCCESS;
-	} else if (rv1 != BDB_SUCCESS && rv2 != BDB_SUCCESS){
+	/*
+	 * Verify the newer copy, or the primary one if they're the same age.
+	 * The other copy only needs an HMAC if that one turns out to be bad.
+	 */
+	first = rv[1] == BDB_SUCCESS &&
+		(rv[0] != BDB_SUCCESS ||
+		 nvm[1]->update_count > nvm[0]->update_count);
+	second = !first;
+
+	if (rv[first] == BDB_SUCCESS)
+		rv[first] = read_verify_nvmrw(type[first], key, buf[first]);
+
+	if (rv[first] != BDB_SUCCESS) {
+		if (rv[second] == BDB_SUCCESS)
+			rv[second] = read_verify_nvmrw(type[second], key,
+						       buf[second]);
 		/* Abort. Neither was successful. */
-		return rv1;
+		if (rv[second] != BDB_SUCCESS)
+			return rv[0];
+	} else if (rv[second] == BDB_SUCCESS) {
+		/* An older copy is stale, so it'll be synced anyway */
+		if (nvm[second]->update_count != nvm[first]->update_count)
+			rv[second] = !BDB_SUCCESS;
+		else
+			rv[second] = read_check_nvmrw(type[second], key,
+						      buf[second], nvm[first]);
 	}
 
-	if (rv1 == BDB_SUCCESS)
-		/* both copies are good. use primary copy */
-		memcpy(&ctx->nvmrw, buf1, sizeof(ctx->nvmrw));
+	if (rv[first] == BDB_SUCCESS)
+		memcpy(&ctx->nvmrw, buf[first], sizeof(ctx->nvmrw));
 	else
-		/* primary is bad but secondary is good. */
-		memcpy(&ctx->nvmrw, buf2, sizeof(ctx->nvmrw));
+		memcpy(&ctx->nvmrw, buf[second], sizeof(ctx->nvmrw));
 
 	if (ctx->nvmrw.struct_minor_version != NVM_HEADER_VERSION_MINOR) {
 		/*
@@ -171,28 +246,41 @@ int nvmrw_read(struct vba_context *ctx)
 		ctx->nvmrw.struct_size = sizeof(ctx->nvmrw);
 		/* We don't worry about calculating hmac twice because
 		 * this is a corner case. */
-		rv1 = nvmrw_write(ctx, NVM_TYPE_RW_PRIMARY);
-		rv2 = nvmrw_write(ctx, NVM_TYPE_RW_SECONDARY);
-	} else if (rv1 != BDB_SUCCESS) {
+		rv[0] = write_nvmrw(ctx, key, NVM_TYPE_RW_PRIMARY);
+		rv[1] = write_nvmrw(ctx, key, NVM_TYPE_RW_SECONDARY);
+	} else if (rv[0] != BDB_SUCCESS) {
 		/* primary copy is bad. sync it with secondary copy */
-		rv1 = nvmrw_write(ctx, NVM_TYPE_RW_PRIMARY);
-	} else if (rv2 != BDB_SUCCESS){
+		rv[0] = write_nvmrw(ctx, key, NVM_TYPE_RW_PRIMARY);
+	} else if (rv[1] != BDB_SUCCESS){
 		/* secondary copy is bad. sync it with primary copy */
-		rv2 = nvmrw_write(ctx, NVM_TYPE_RW_SECONDARY);
+		rv[1] = write_nvmrw(ctx, key, NVM_TYPE_RW_SECONDARY);
 	} else {
 		/* Both copies are good and versions are same as the reader.
 		 * Skip writing. This should be the common case. */
 	}
 
-	if (rv1 || rv2)
-		return rv1 ? rv1 : rv2;
+	if (rv[0] || rv[1])
+		return rv[0] ? rv[0] : rv[1];
 
 	return BDB_SUCCESS;
 }
 
-static int nvmrw_init(struct vba_context *ctx)
+int nvmrw_read(struct vba_context *ctx)
+{
+	struct vb2_hmac_context key;
+	int rv;
+
+	rv = nvmrw_key(ctx->secrets, &key);
+	if (rv)
+		return rv;
+
+	return read_nvmrw(ctx, &key);
+}
+
+static int nvmrw_init(struct vba_context *ctx,
+		      const struct vb2_hmac_context *key)
 {
-	if (nvmrw_read(ctx))
+	if (read_nvmrw(ctx, key))
 		return BDB_ERROR_NVM_INIT;
 
 	return BDB_SUCCESS;
@@ -204,8 +292,13 @@ int vba_update_kernel_version(struct vba_context *ctx,
 {
 	struct nvmrw *nvm = &ctx->nvmrw;
 
-	if (nvmrw_verify(ctx->secrets, nvm, sizeof(*nvm))) {
-		if (nvmrw_init(ctx))
+	struct vb2_hmac_context key;
+
+	if (nvmrw_key(ctx->secrets, &key))
+		return BDB_ERROR_NVM_INIT;
+
+	if (nvmrw_verify(&key, nvm, sizeof(*nvm))) {
+		if (nvmrw_init(ctx, &key))
 			return BDB_ERROR_NVM_INIT;
 	}
 
@@ -221,8 +314,8 @@ int vba_update_kernel_version(struct vba_context *ctx,
 		nvm->update_count++;
 
 		/* Update both copies */
-		rv1 = nvmrw_write(ctx, NVM_TYPE_RW_PRIMARY);
-		rv2 = nvmrw_write(ctx, NVM_TYPE_RW_SECONDARY);
+		rv1 = write_nvmrw(ctx, &key, NVM_TYPE_RW_PRIMARY);
+		rv2 = write_nvmrw(ctx, &key, NVM_TYPE_RW_SECONDARY);
 		if (rv1 || rv2)
 			return BDB_ERROR_RECOVERY_REQUEST;
 	}
@@ -236,8 +329,13 @@ int vba_update_buc(struct vba_context *ctx, uint8_t *new_buc)
 	uint8_t buc[BUC_ENC_DIGEST_SIZE];
 	int rv1, rv2;
 
-	if (nvmrw_verify(ctx->secrets, nvm, sizeof(*nvm))) {
-		if (nvmrw_init(ctx))
+	struct vb2_hmac_context key;
+
+	if (nvmrw_key(ctx->secrets, &key))
+		return BDB_ERROR_NVM_INIT;
+
+	if (nvmrw_verify(&key, nvm, sizeof(*nvm))) {
+		if (nvmrw_init(ctx, &key))
 			return BDB_ERROR_NVM_INIT;
 	}
 
@@ -258,8 +356,8 @@ int vba_update_buc(struct vba_context *ctx, uint8_t *new_buc)
 	nvm->update_count++;
 
 	/* Write new BUC */
-	rv1 = nvmrw_write(ctx, NVM_TYPE_RW_PRIMARY);
-	rv2 = nvmrw_write(ctx, NVM_TYPE_RW_SECONDARY);
+	rv1 = write_nvmrw(ctx, &key, NVM_TYPE_RW_PRIMARY);
+	rv2 = write_nvmrw(ctx, &key, NVM_TYPE_RW_SECONDARY);
 	if (rv1 || rv2)
 		return BDB_ERROR_WRITE_BUC;
 
@@ -4,6 +4,7 @@
  */
 
 #include "2sysincludes.h"
+#include "2common.h"
 #include "2hmac.h"
 #include "2sha.h"
 #include "bdb_api.h"
@@ -152,7 +153,7 @@ static int get_constant_with_digest(const uint8_t *buf, uint32_t buf_size,
 	if (bdb_check_key(key, buf_size))
 		return !BDB_SUCCESS;
 
-	if (vb2_digest_buffer(buf, buf_size, VB2_HASH_SHA256, out, digest_size))
+	if (bdb_sha256(out, buf, buf_size))
 		return !BDB_SUCCESS;
 
 	memcpy(out + digest_size, constant,
@@ -307,24 +308,68 @@ int vba_clear_secret(struct vba_context *ctx, enum bdb_secret_type type)
 	return BDB_SUCCESS;
 }
 
-int vba_extend_secrets_ro(struct vba_context *ctx, const uint8_t *bdb,
-			  uint8_t *wsr, f_extend extend)
+/*
+ * Secrets derived together, in the order they have to be derived in. A key
+ * of NULL means the step doesn't hash anything from the BDB.
+ */
+struct secret_step {
+	enum bdb_secret_type type;
+	const struct bdb_key *key;
+};
+
+static int derive_secrets(struct vba_context *ctx, const uint8_t *bdb,
+			  uint8_t *wsr, f_extend extend, int ro)
 {
-	const struct bdb_key *bdbkey = bdb_get_bdbkey(bdb);
-	const struct bdb_key *datakey = bdb_get_datakey(bdb);
-
-	derive_secret_ro(ctx, BDB_SECRET_TYPE_BDB, wsr, (const uint8_t *)bdbkey,
-			 bdbkey->struct_size, extend);
-	derive_secret_ro(ctx, BDB_SECRET_TYPE_BOOT_PATH, wsr,
-			 (const uint8_t *)datakey, datakey->struct_size,
-			 extend);
-	derive_secret_ro(ctx, BDB_SECRET_TYPE_BOOT_VERIFIED, wsr, NULL, 0,
-			 extend);
-	derive_secret_ro(ctx, BDB_SECRET_TYPE_NVM_WP, wsr, NULL, 0, extend);
-	/* Deriving NVM-RW has to be done after NVM-WP */
-	derive_secret_ro(ctx, BDB_SECRET_TYPE_NVM_RW, wsr, NULL, 0, extend);
-	/* Extending WSR has to be done last. */
-	derive_secret_ro(ctx, BDB_SECRET_TYPE_WSR, wsr, NULL, 0, extend);
+	const struct bdb_key *bdbkey = bdb ? bdb_get_bdbkey(bdb) : NULL;
+	const struct bdb_key *datakey = bdb ? bdb_get_datakey(bdb) : NULL;
+	const struct secret_step ro_steps[] = {
+		{BDB_SECRET_TYPE_BDB, bdbkey},
+		{BDB_SECRET_TYPE_BOOT_PATH, datakey},
+		{BDB_SECRET_TYPE_BOOT_VERIFIED, NULL},
+		{BDB_SECRET_TYPE_NVM_WP, NULL},
+		/* Deriving NVM-RW has to be done after NVM-WP */
+		{BDB_SECRET_TYPE_NVM_RW, NULL},
+		/* Extending WSR has to be done last. */
+		{BDB_SECRET_TYPE_WSR, NULL},
+	};
+	const struct secret_step rw_steps[] = {
+		{BDB_SECRET_TYPE_BDB, bdbkey},
+		{BDB_SECRET_TYPE_BOOT_PATH, datakey},
+		{BDB_SECRET_TYPE_BOOT_VERIFIED, NULL},
+		/* BUC is derived from the extended boot verified secret */
+		{BDB_SECRET_TYPE_BUC, NULL},
+	};
+	const struct secret_step *steps = ro ? ro_steps : rw_steps;
+	int count = ro ? ARRAY_SIZE(ro_steps) : ARRAY_SIZE(rw_steps);
+	int i, rv;
+
+	if (!bdbkey || !datakey)
+		return BDB_ERROR_SECRET_BDB;
+
+	for (i = 0; i < count; i++) {
+		const uint8_t *buf = (const uint8_t *)steps[i].key;
+		uint32_t buf_size = buf ? steps[i].key->struct_size : 0;
+
+		if (ro)
+			rv = derive_secret_ro(ctx, steps[i].type, wsr,
+					      buf, buf_size, extend);
+		else
+			rv = vba_derive_secret(ctx, steps[i].type, wsr,
+					       buf, buf_size);
+		if (rv)
+			return rv;
+	}
 
 	return BDB_SUCCESS;
 }
+
+int vba_derive_secrets(struct vba_context *ctx)
+{
+	return derive_secrets(ctx, ctx->bdb, NULL, NULL, 0);
+}
+
+int vba_extend_secrets_ro(struct vba_context *ctx, const uint8_t *bdb,
+			  uint8_t *wsr, f_extend extend)
+{
+	return derive_secrets(ctx, bdb, wsr, extend, 1);
+}
@@ -8,13 +8,42 @@
 #include "2sha.h"
 #include "bdb.h"
 
-int bdb_sha256(void *digest, const void *buf, size_t size)
+int bdb_sha256_init(struct bdb_sha256_context *ctx)
 {
-	struct vb2_sha256_context ctx;
+	vb2_sha256_init(&ctx->vb2);
 
-	vb2_sha256_init(&ctx);
-	vb2_sha256_update(&ctx, buf, size);
-	vb2_sha256_finalize(&ctx, digest);
+	return BDB_SUCCESS;
+}
+
+int bdb_sha256_update(struct bdb_sha256_context *ctx, const void *buf,
+		      size_t size)
+{
+	const uint8_t *p = buf;
+
+	/* The 2lib engine takes at most 4GB at a time */
+	while (size > UINT32_MAX) {
+		vb2_sha256_update(&ctx->vb2, p, UINT32_MAX);
+		p += UINT32_MAX;
+		size -= UINT32_MAX;
+	}
+	vb2_sha256_update(&ctx->vb2, p, size);
 
 	return BDB_SUCCESS;
 }
+
+int bdb_sha256_finalize(struct bdb_sha256_context *ctx, void *digest)
+{
+	vb2_sha256_finalize(&ctx->vb2, digest);
+
+	return BDB_SUCCESS;
+}
+
+int bdb_sha256(void *digest, const void *buf, size_t size)
+{
+	struct bdb_sha256_context ctx;
+
+	bdb_sha256_init(&ctx);
+	bdb_sha256_update(&ctx, buf, size);
+
+	return bdb_sha256_finalize(&ctx, digest);
+}
@@ -34,6 +34,18 @@ enum {
 #define GPT_MODIFIED_ENTRIES1 0x04
 #define GPT_MODIFIED_ENTRIES2 0x08
 
+/*
+ * Largest entries array (in sectors) whose dirty sectors are tracked in
+ * GptData.dirty_entries*; bigger arrays are always written whole.
+ */
+#define GPT_MAX_DIRTY_SECTORS 32
+
+/*
+ * Most kernel entries GptInit() will index for GptNextKernelEntry(); tables
+ * with more kernel entries are scanned in full.
+ */
+#define GPT_MAX_KERNEL_ENTRIES 16
+
 /*
  * The 'update_type' of GptUpdateKernelEntry().  We expose TRY and BAD only
  * because those are what verified boot needs.  For more precise control on GPT
@@ -64,6 +76,30 @@ enum {
 
 /* If this bit is 1, the GPT is stored in another from the streaming data */
 #define GPT_FLAG_EXTERNAL	0x1
+/*
+ * If this bit is 1, AllocAndReadGptData() skips reading the secondary GPT when
+ * the primary GPT is intact, and builds the secondary from the primary in
+ * memory instead.  The secondary is only touched again if the GPT is written
+ * back, which repairs it.
+ */
+#define GPT_FLAG_LAZY_SECONDARY	0x2
+
+/*
+ * Packed copy of the kernel entries in the primary table, in partition order.
+ * GptInit() builds it so GptNextKernelEntry() can pick a kernel from one cache
+ * line of index and attribute bytes, instead of walking the 128-byte entries;
+ * GptUpdateKernelWithEntry() keeps it in step.  Only used if valid.
+ */
+typedef struct {
+	uint8_t index[GPT_MAX_KERNEL_ENTRIES];
+	uint8_t priority[GPT_MAX_KERNEL_ENTRIES];
+	uint8_t tries[GPT_MAX_KERNEL_ENTRIES];
+	uint8_t successful[GPT_MAX_KERNEL_ENTRIES];
+	/* Only read for the kernel which is picked */
+	uint64_t start[GPT_MAX_KERNEL_ENTRIES];
+	uint64_t size[GPT_MAX_KERNEL_ENTRIES];
+	uint8_t count, valid;
+} GptKernelEntries;
 
 /*
  * A note about stored_on_device and gpt_drive_sectors:
@@ -109,6 +145,16 @@ typedef struct {
 
 	/* Internal variables */
 	uint8_t valid_headers, valid_entries, ignored;
+	/* Copies not read from the drive (MASK_*); see GPT_FLAG_LAZY_SECONDARY */
+	uint8_t deferred;
+	/*
+	 * Entry sectors changed in each copy, one bit per sector.  If the
+	 * matching GPT_MODIFIED_ENTRIES* bit is set and this is 0, the whole
+	 * array is dirty.
+	 */
+	uint32_t dirty_entries1, dirty_entries2;
+	/* Kernel entries of the primary table, as found by GptInit() */
+	GptKernelEntries kernels;
 	int current_priority;
 } GptData;
 
@@ -149,7 +195,8 @@ GptEntry *GptFindNthEntry(GptData *gpt, const Guid *guid, unsigned int n);
 /**
  * Allocate and read GPT data from the drive.  The sector_bytes and
  * drive_sectors fields should be filled on input.  The primary and secondary
- * header and entries are filled on output.
+ * header and entries are filled on output.  Only the entry sectors declared by
+ * the headers are allocated and read.
  *
  * Returns 0 if successful, 1 if error.
  */
@@ -78,6 +78,14 @@ uint32_t TlclSelfTestFull(void);
  */
 uint32_t TlclContinueSelfTest(void);
 
+/**
+ * Start the self test in the background as early as possible, e.g. right
+ * after TlclStartup(), so it overlaps work that doesn't need the TPM.  Later
+ * commands that the TPM can't run until the test is done wait for it then,
+ * without sending another self-test command.  The TPM error code is returned.
+ */
+uint32_t TlclStartSelfTest(void);
+
 /**
  * Define a space with permission [perm].  [index] is the index for the space,
  * [size] the usable data size.  The TPM error code is returned.
@@ -212,6 +220,27 @@ uint32_t TlclExtend(int pcr_num, const uint8_t *in_digest, uint8_t *out_digest);
  */
 uint32_t TlclGetPermissions(uint32_t index, uint32_t *permissions);
 
+/**
+ * Queue a TlclRead() of [length] bytes from space at [index] for the next
+ * TlclBatchSend().  Returns TPM_E_BUFFER_SIZE if the batch is full.
+ */
+uint32_t TlclBatchRead(uint32_t index, uint32_t length);
+
+/**
+ * Queue a TlclGetPermissions() of space at [index] for the next
+ * TlclBatchSend().  Returns TPM_E_BUFFER_SIZE if the batch is full.
+ */
+uint32_t TlclBatchGetPermissions(uint32_t index);
+
+/**
+ * Send the queued commands to the TPM back to back, with
+ * VbExTpmSendReceiveMulti().  Their responses are kept, and handed to the
+ * matching TlclRead() and TlclGetPermissions() calls, which must come in the
+ * order the commands were queued.  Any other command drops the rest of the
+ * batch, so a response is never used after something may have changed it.
+ */
+uint32_t TlclBatchSend(void);
+
 /**
  * Get the public information about the NVRAM space identified by |index|. All
  * other parameters are filled in with the respective information.
@@ -50,10 +50,17 @@
 #define TPM_PT_VENDOR_STRING_4          (PT_FIXED + 9)
 #define TPM_PT_FIRMWARE_VERSION_1       (PT_FIXED + 11)
 #define TPM_PT_FIRMWARE_VERSION_2       (PT_FIXED + 12)
+#define TPM_PT_NV_BUFFER_MAX            (PT_FIXED + 44)
 #define PT_VAR                          (PT_GROUP * 2)
 #define TPM_PT_PERMANENT                (PT_VAR + 0)
 #define TPM_PT_STARTUP_CLEAR            (PT_VAR + 1)
 
+/* Most properties tpm2_lite takes from one TPM2_GetCapability response */
+#define TPM2_MAX_TPM_PROPERTIES         8
+
+/* TPM2 response codes. */
+#define TPM_RC_TESTING                  ((uint32_t)0x0000090A)
+
 /* TPM startup types. */
 #define TPM_SU_CLEAR                    ((TPM_SU)0x0000)
 #define TPM_SU_STATE                    ((TPM_SU)0x0001)
@@ -137,7 +144,7 @@ typedef struct {
 
 typedef struct {
 	uint32_t count;
-	TPMS_TAGGED_PROPERTY tpm_property[1];
+	TPMS_TAGGED_PROPERTY tpm_property[TPM2_MAX_TPM_PROPERTIES];
 } TPML_TAGGED_TPM_PROPERTY;
 
 typedef union {
@@ -130,6 +130,10 @@ enum VbErrorPredefined_t {
 	VBERROR_RW_JUMP_FAILED                = 0x10028,
 	/* Error reading FWMP from TPM (note: not present is not an error) */
 	VBERROR_TPM_READ_FWMP                 = 0x10029,
+	/* VbExStreamSkip() isn't implemented; read and discard instead */
+	VBERROR_STREAM_SKIP_UNSUPPORTED       = 0x1002A,
+	/* VbExDecompressStart() can't decompress this kind of body */
+	VBERROR_DECOMPRESS_UNSUPPORTED        = 0x1002B,
 
 	/* VbExEcGetExpectedRWHash() may return the following codes */
 	/* Compute expected RW hash from the EC image; BIOS doesn't have it */
@@ -268,6 +272,12 @@ typedef struct VbSelectAndLoadKernelParams {
 	uint32_t kernel_buffer_size;
 	/* input flags.  Currently used for detachables */
 	uint32_t inflags;
+	/*
+	 * Chunk size in bytes for streaming the kernel body off disk and
+	 * hashing it as it arrives.  Must be a multiple of the disk sector
+	 * size.  0 reads the whole body before hashing it.
+	 */
+	uint32_t body_chunk_size;
 
 	/*
 	 * Outputs from VbSelectAndLoadKernel(); valid only if it returns
@@ -298,6 +308,26 @@ typedef struct VbSelectAndLoadKernelParams {
  */
 #define VB_SALK_INFLAGS_ENABLE_DETACHABLE_UI (1 << 0)
 
+/* Flag to check the vblock of the next kernel candidate before reading the
+ * body of the current one, so a bad candidate is known up front.
+ */
+#define VB_SALK_INFLAGS_PEEK_NEXT_VBLOCK (1 << 1)
+
+/* Flag to read the kernel space and FWMP from the TPM, and the GPT of the
+ * first fixed disk, on another CPU through vb2ex_run_parallel() while EC
+ * software sync runs.  VbExTpmSendReceiveMulti(), VbExDiskGetInfo() and
+ * VbExDiskRead() are then called from that CPU, alongside the VbExEc*()
+ * calls.  Ignored in recovery mode, or if vb2ex_run_parallel() isn't
+ * implemented.
+ */
+#define VB_SALK_INFLAGS_PREFETCH_DURING_EC_SYNC (1 << 2)
+
+/* Flag to remember the kernel partition which booted, in V2 NV storage, and
+ * try it first on the next normal boot if the primary GPT is unchanged.  The
+ * rest of the GPT is then only read if that kernel can't be used as is.
+ */
+#define VB_SALK_INFLAGS_KERNEL_HINT (1 << 3)
+
 /**
  * Select and loads the kernel.
  *
@@ -327,6 +357,53 @@ VbError_t VbVerifyMemoryBootImage(VbCommonParams *cparams,
 				  void *boot_image,
 				  size_t image_size);
 
+/**
+ * Start verifying a kernel image as it is received into memory.
+ *
+ * Like VbVerifyMemoryBootImage(), but for an image which arrives in pieces,
+ * such as over fastboot or the network.  Each piece is passed to
+ * VbVerifyMemoryBootImageFeed() as it arrives: the key block and preamble are
+ * verified as soon as they are complete, and the body is hashed as it
+ * streams in, so little is left to do in VbVerifyMemoryBootImageFinish().
+ *
+ * If this succeeds, VbVerifyMemoryBootImageFinish() must be called, even if
+ * feeding the image fails.  Only one image can be verified at a time.
+ * cparams and kparams must remain valid until then, and bytes already fed
+ * must not change.
+ *
+ * @param cparams	Common parameters, e.g. use member caller_context
+ *			to point to useful context data
+ * @param kparams	kernel params; filled in by
+ *			VbVerifyMemoryBootImageFinish()
+ * @param boot_image	Buffer the image is received into
+ * @param image_size	Size of the whole image
+ * @return VBERROR_... error, VBERROR_SUCCESS on success.
+ */
+VbError_t VbVerifyMemoryBootImageBegin(VbCommonParams *cparams,
+				       VbSelectAndLoadKernelParams *kparams,
+				       void *boot_image,
+				       size_t image_size);
+
+/**
+ * Feed the next piece of the kernel image being verified.
+ *
+ * The piece is copied to its place in the boot_image buffer, unless it was
+ * received there already.
+ *
+ * @param data		Next bytes of the image
+ * @param size		Number of bytes
+ * @return VBERROR_... error if the image is already known to be bad,
+ * VBERROR_SUCCESS otherwise.
+ */
+VbError_t VbVerifyMemoryBootImageFeed(const void *data, size_t size);
+
+/**
+ * Finish verifying the kernel image, once all of it has been fed.
+ *
+ * @return VBERROR_... error, VBERROR_SUCCESS on success.
+ */
+VbError_t VbVerifyMemoryBootImageFinish(void);
+
 /**
  * Fastboot API to enter dev mode.
  *
@@ -376,6 +453,35 @@ uint64_t VbExGetTimer(void);
  */
 void VbExSleepMs(uint32_t msec);
 
+/* Events for VbExWaitForEvent() */
+/* A key or button was pressed */
+#define VB_EVENT_KEYBOARD	(1 << 0)
+/* A removable disk was inserted or removed */
+#define VB_EVENT_DISK		(1 << 1)
+/*
+ * The platform can't wait for events, so the caller should poll for all of
+ * them itself.
+ */
+#define VB_EVENT_POLL		(1 << 31)
+
+/**
+ * Wait for one of the requested events, or until the timeout expires.
+ *
+ * @param mask		VB_EVENT_* flags for the events to wait for
+ * @param timeout_ms	Longest time to wait in ms
+ *
+ * @return The VB_EVENT_* flags which happened, or 0 if the timeout expired.
+ *
+ * This lets UI loops respond to a key press or a newly-inserted disk right
+ * away, instead of on their next poll.  A platform which implements this must
+ * report every event it was asked for, since removable disks are then only
+ * rescanned when VB_EVENT_DISK is returned.
+ *
+ * This function is optional.  The default implementation calls VbExSleepMs()
+ * and returns VB_EVENT_POLL.
+ */
+uint32_t VbExWaitForEvent(uint32_t mask, uint32_t timeout_ms);
+
 /**
  * Play a beep tone of the specified frequency in Hz and duration in msec.
  * This is effectively a VbSleep() variant that makes noise.
@@ -419,6 +525,28 @@ VbError_t VbExTpmOpen(void);
 VbError_t VbExTpmSendReceive(const uint8_t *request, uint32_t request_length,
                              uint8_t *response, uint32_t *response_length);
 
+/* One command of a VbExTpmSendReceiveMulti() batch */
+typedef struct VbTpmCommand {
+	const uint8_t *request;
+	uint32_t request_length;
+	uint8_t *response;
+	/* Size of the response buffer on input, received length on exit */
+	uint32_t response_length;
+	/* What VbExTpmSendReceive() would have returned for this command */
+	VbError_t result;
+} VbTpmCommand;
+
+/**
+ * Send [count] independent commands to the TPM back to back, and receive
+ * their responses.  The platform may pipeline them on the transport, but the
+ * TPM must still run them in order.
+ *
+ * This is optional.  The default implementation calls VbExTpmSendReceive()
+ * for each command in turn.  Returns VBERROR_SUCCESS if each command's result
+ * has been filled in.
+ */
+VbError_t VbExTpmSendReceiveMulti(VbTpmCommand *commands, uint32_t count);
+
 #ifdef CHROMEOS_ENVIRONMENT
 
 /**
@@ -547,6 +675,24 @@ VbError_t VbExDiskGetInfo(VbDiskInfo **infos_ptr, uint32_t *count,
 VbError_t VbExDiskFreeInfo(VbDiskInfo *infos,
                            VbExDiskHandle_t preserve_handle);
 
+/**
+ * Return the media generation of a disk.
+ *
+ * @param handle	Disk handle from VbExDiskGetInfo()
+ *
+ * @return A non-zero number which changes whenever the media behind the
+ * handle may have changed (for example, a card was swapped or the handle was
+ * reused for a new device), or 0 if this is not known.
+ *
+ * If a disk failed to boot and its generation hasn't changed, vboot doesn't
+ * try it again, so re-polling removable disks in recovery mode doesn't keep
+ * re-reading and re-verifying the same bad media.
+ *
+ * This function is optional.  The default implementation returns 0, so
+ * every disk is tried each time.
+ */
+uint32_t VbExDiskGetGeneration(VbExDiskHandle_t handle);
+
 /**
  * Read lba_count LBA sectors, starting at sector lba_start, from the disk,
  * into the buffer.
@@ -561,6 +707,30 @@ VbError_t VbExDiskFreeInfo(VbDiskInfo *infos,
 VbError_t VbExDiskRead(VbExDiskHandle_t handle, uint64_t lba_start,
                        uint64_t lba_count, void *buffer);
 
+/* One read of a VbExDiskReadMulti() batch */
+typedef struct VbDiskRange {
+	uint64_t lba_start;
+	uint64_t lba_count;
+	void *buffer;
+	/* What VbExDiskRead() would have returned for this range */
+	VbError_t result;
+} VbDiskRange;
+
+/**
+ * Read [count] independent ranges of LBA sectors from the disk, each into its
+ * own buffer.  The platform may submit them as one queued request, in any
+ * order, so a disk with a command queue (NVMe, UFS, eMMC CMDQ) only pays for
+ * one round trip.
+ *
+ * Like VbExDiskRead(), this is only used for the GPT.
+ *
+ * This is optional.  The default implementation calls VbExDiskRead() for
+ * each range in turn.  Returns VBERROR_SUCCESS if each range's result has
+ * been filled in; otherwise vboot reads the ranges again one at a time.
+ */
+VbError_t VbExDiskReadMulti(VbExDiskHandle_t handle, VbDiskRange *ranges,
+			    uint32_t count);
+
 /**
  * Write lba_count LBA sectors, starting at sector lba_start, to the disk, from
  * the buffer.
@@ -595,6 +765,37 @@ typedef void *VbExStream_t;
 VbError_t VbExStreamOpen(VbExDiskHandle_t handle, uint64_t lba_start,
 			 uint64_t lba_count, VbExStream_t *stream_ptr);
 
+/* Flags for VbExStreamOpenWithHints() */
+/* The stream will be read from start to end, without skipping back */
+#define VB_STREAM_FLAG_SEQUENTIAL (1 << 0)
+/* Data read from the stream won't be read again, so needn't be cached */
+#define VB_STREAM_FLAG_READ_ONCE (1 << 1)
+
+/**
+ * Open a stream on a disk, with hints about how it will be read
+ *
+ * @param handle		Disk to open the stream against
+ * @param lba_start		Starting sector offset within the disk to
+ *				stream from
+ * @param lba_count		Maximum extent of the stream in sectors
+ * @param flags			VB_STREAM_FLAG_* hints
+ * @param expected_bytes	About how many bytes will be read from the
+ *				stream, or 0 if unknown
+ * @param stream		out-paramter for the generated stream
+ *
+ * @return Error code, or VBERROR_SUCCESS.
+ *
+ * This is VbExStreamOpen() with hints which let the driver pick its transfer
+ * size, read-ahead and caching.  The hints don't change what may be read:
+ * the caller may still read less or more than expected_bytes, up to
+ * lba_count sectors.  This function is optional.  The default implementation
+ * ignores the hints and calls VbExStreamOpen().
+ */
+VbError_t VbExStreamOpenWithHints(VbExDiskHandle_t handle, uint64_t lba_start,
+				  uint64_t lba_count, uint32_t flags,
+				  uint64_t expected_bytes,
+				  VbExStream_t *stream);
+
 /**
  * Read from a stream on a disk
  *
@@ -610,6 +811,55 @@ VbError_t VbExStreamOpen(VbExDiskHandle_t handle, uint64_t lba_start,
  */
 VbError_t VbExStreamRead(VbExStream_t stream, uint32_t bytes, void *buffer);
 
+/**
+ * Start an asynchronous read from a stream on a disk
+ *
+ * @param stream	Stream to read from
+ * @param bytes		Number of bytes to read
+ * @param buffer	Destination to read into
+ *
+ * @return Error code, or VBERROR_SUCCESS if the read was started.
+ *
+ * The caller must not touch the buffer until VbExStreamWait() returns.  At
+ * most one asynchronous read may be outstanding per stream.  Errors may be
+ * reported either here or by VbExStreamWait().
+ *
+ * This function is optional.  The default implementation performs the read
+ * synchronously with VbExStreamRead().
+ */
+VbError_t VbExStreamReadAsync(VbExStream_t stream, uint32_t bytes,
+			      void *buffer);
+
+/**
+ * Wait for an asynchronous stream read to complete
+ *
+ * @param stream	Stream to wait on
+ *
+ * @return Error code, or VBERROR_SUCCESS if the outstanding read (if any)
+ * completed successfully.
+ *
+ * This function is optional.  The default implementation returns
+ * VBERROR_SUCCESS, since the default VbExStreamReadAsync() has already
+ * completed the read.
+ */
+VbError_t VbExStreamWait(VbExStream_t stream);
+
+/**
+ * Skip over data in a stream on a disk
+ *
+ * @param stream	Stream to skip data in
+ * @param bytes		Number of bytes to skip
+ *
+ * @return Error code, or VBERROR_SUCCESS. Failure to skip as much data as
+ * requested is an error.
+ *
+ * This lets the next read land at the start of the kernel body without
+ * reading the padding in front of it.  This function is optional.  The
+ * default implementation returns VBERROR_STREAM_SKIP_UNSUPPORTED, and vboot
+ * reads and discards the data instead.
+ */
+VbError_t VbExStreamSkip(VbExStream_t stream, uint32_t bytes);
+
 /**
  * Close a stream
  *
@@ -617,6 +867,59 @@ VbError_t VbExStreamRead(VbExStream_t stream, uint32_t bytes, void *buffer);
  */
 void VbExStreamClose(VbExStream_t stream);
 
+/*****************************************************************************/
+/* Kernel body decompression */
+
+typedef void *VbExDecompressor_t;
+
+/**
+ * Start decompressing a kernel body as it streams in
+ *
+ * @param compression	Compression of the body; see VB2_KERNEL_COMPRESSION_*
+ * @param outbuf	Destination for the decompressed body
+ * @param outbuf_size	Size of outbuf in bytes
+ * @param dp		Decompressor handle stored here on success
+ *
+ * @return Error code, or VBERROR_SUCCESS.
+ *
+ * LoadKernel() feeds the compressed body to VbExDecompressFeed() while it
+ * is still being read, before its signature has been checked.  The
+ * decompressor must therefore cope with any input, and never write past the
+ * end of outbuf.  The output is only trusted once LoadKernel() succeeds.
+ *
+ * This function is optional.  The default implementation returns
+ * VBERROR_DECOMPRESS_UNSUPPORTED, so compressed kernels are not bootable.
+ */
+VbError_t VbExDecompressStart(uint32_t compression, void *outbuf,
+			      uint32_t outbuf_size, VbExDecompressor_t *dp);
+
+/**
+ * Decompress the next part of a kernel body
+ *
+ * @param d		Decompressor from VbExDecompressStart()
+ * @param inbuf		Compressed data
+ * @param in_size	Size of compressed data in bytes
+ *
+ * @return Error code, or VBERROR_SUCCESS.
+ *
+ * inbuf may be reused as soon as this returns.
+ */
+VbError_t VbExDecompressFeed(VbExDecompressor_t d, const void *inbuf,
+			     uint32_t in_size);
+
+/**
+ * Finish decompressing a kernel body, and free the decompressor
+ *
+ * @param d		Decompressor from VbExDecompressStart()
+ * @param out_size	Bytes of decompressed data stored here on success
+ *
+ * @return Error code, or VBERROR_SUCCESS if the body was complete.
+ *
+ * This is called once for every successful VbExDecompressStart(), even if
+ * loading the body failed part way.
+ */
+VbError_t VbExDecompressFinish(VbExDecompressor_t d, uint32_t *out_size);
+
 
 /*****************************************************************************/
 /* Display */
@@ -659,6 +962,27 @@ enum VbScreenType_t {
 	VB_SCREEN_OPTIONS_MENU = 0x210,
 };
 
+/**
+ * Tell the platform which screens vboot may display during this boot.
+ *
+ * @param locale            language the screens will be displayed in
+ * @param screens           VB_SCREEN_* IDs of the screens which may be shown
+ *                          in this boot mode; most boots show none of them
+ * @param screen_count      Number of entries in screens
+ *
+ * vboot calls this before EC software sync and before any other display
+ * call, so the platform can load and decompress the bitmaps for these
+ * screens ahead of time, for example on another core.  It is called again
+ * with the same screens if the user changes the locale.  Drawing any of
+ * the screens must still work if loading them hasn't finished.
+ *
+ * This function is optional.  The default implementation does nothing.
+ *
+ * @return VBERROR_SUCCESS or error code on error.
+ */
+VbError_t VbExDisplayPrepare(uint32_t locale, const uint32_t *screens,
+			     uint32_t screen_count);
+
 /**
  * Display a predefined screen; see VB_SCREEN_* for valid screens.
  *
@@ -685,6 +1009,31 @@ VbError_t VbExDisplayMenu(uint32_t screen_type, uint32_t locale,
 			  uint32_t selected_index, uint32_t disabled_idx_mask,
 			  uint32_t redraw_base);
 
+/**
+ * Redraw some items of the menu screen which is already displayed.
+ *
+ * @param screen_type       ID of screen being displayed
+ * @param locale            language to display
+ * @param selected_index    Index of menu item that is currently selected.
+ * @param disabled_idx_mask Bitmap for enabling/disabling certain menu items.
+ *                          each bit corresponds to the menu item's index.
+ * @param dirty_idx_mask    Bitmap of the menu items which changed and need
+ *                          to be redrawn.  Other items and the base screen
+ *                          are unchanged since the last call.
+ *
+ * vboot calls this instead of VbExDisplayMenu() when only the selected or
+ * disabled items have changed, such as when the user moves the cursor.
+ *
+ * This function is optional.  The default implementation calls
+ * VbExDisplayMenu() without redrawing the base screen.
+ *
+ * @return VBERROR_SUCCESS or error code on error.
+ */
+VbError_t VbExDisplayMenuItems(uint32_t screen_type, uint32_t locale,
+			       uint32_t selected_index,
+			       uint32_t disabled_idx_mask,
+			       uint32_t dirty_idx_mask);
+
 /**
  * Display a string containing debug information on the screen, rendered in a
  * platform-dependent font.  Should be able to handle newlines '\n' in the
@@ -822,6 +1171,24 @@ VbError_t VbExEcDisableJump(int devidx);
 VbError_t VbExEcHashImage(int devidx, enum VbSelectFirmware_t select,
 			  const uint8_t **hash, int *hash_size);
 
+/**
+ * Start hashing the selected EC image in the background.
+ *
+ * @param devidx    Device index. 0: EC, 1: PD.
+ * @param select    Image to hash. RO or RW.
+ * @return          VBERROR_... error, VBERROR_SUCCESS if the hash was started.
+ *
+ * This lets several ECs hash their images at the same time.  The result is
+ * collected by the next VbExEcHashImage() call for the same device and image,
+ * which waits for the hash to finish.  At most one hash may be outstanding per
+ * device.  A failure here isn't fatal; VbExEcHashImage() computes the hash
+ * itself if none was started.
+ *
+ * This function is optional.  The default implementation does nothing, so
+ * VbExEcHashImage() hashes synchronously.
+ */
+VbError_t VbExEcHashImageStart(int devidx, enum VbSelectFirmware_t select);
+
 /**
  * Get the expected contents of the EC image associated with the main firmware
  * specified by the "select" argument.
@@ -836,12 +1203,71 @@ VbError_t VbExEcGetExpectedImage(int devidx, enum VbSelectFirmware_t select,
 VbError_t VbExEcGetExpectedImageHash(int devidx, enum VbSelectFirmware_t select,
 				     const uint8_t **hash, int *hash_size);
 
+/**
+ * Read the precomputed hash of the expected EC image.
+ *
+ * @param devidx	Device index. 0: EC, 1: PD.
+ * @param select	Image to get the hash of. RO or RW.
+ * @param buf		Pointer to a struct vb2_ec_image_hash (see 2struct.h),
+ *			read from the verified AP-RW firmware.
+ * @param size		Pointer to the size of the buffer in bytes.
+ * @return VBERROR_... error, VBERROR_SUCCESS on success.
+ *
+ * Vboot checks the format of the struct and uses its digest, so the
+ * platform doesn't need to read or hash the expected image on boots where
+ * the EC is already up to date.
+ *
+ * This function is optional.  The default implementation returns
+ * VBERROR_UNKNOWN, and VbExEcGetExpectedImageHash() is used instead.
+ */
+VbError_t VbExEcGetExpectedImageHashStruct(int devidx,
+					   enum VbSelectFirmware_t select,
+					   const uint8_t **buf, int *size);
+
 /**
  * Update the selected EC image.
  */
 VbError_t VbExEcUpdateImage(int devidx, enum VbSelectFirmware_t select,
 			    const uint8_t *image, int image_size);
 
+/**
+ * Read the SHA-256 hash of each block of the selected EC image.
+ *
+ * @param devidx	Device index. 0: EC, 1: PD.
+ * @param select	Image to get block hashes of. RO or RW.
+ * @param block_size	Pointer to the block size in bytes, normally the EC's
+ *			erase block size.
+ * @param hashes	Pointer to num_blocks SHA-256 digests, one after another.
+ * @param num_blocks	Pointer to the number of blocks.
+ * @return VBERROR_... error, VBERROR_SUCCESS on success.
+ *
+ * The blocks cover the same bytes as VbExEcHashImage(); the last block is
+ * shorter if the image size isn't a multiple of the block size.  If this
+ * succeeds, vboot updates the EC with VbExEcUpdateImageBlock() and only
+ * sends the blocks which differ from the expected image.
+ *
+ * This function is optional.  The default implementation returns
+ * VBERROR_UNKNOWN, so the whole image is sent with VbExEcUpdateImage().
+ */
+VbError_t VbExEcGetImageBlockHashes(int devidx, enum VbSelectFirmware_t select,
+				    int *block_size, const uint8_t **hashes,
+				    int *num_blocks);
+
+/**
+ * Update one block of the selected EC image.
+ *
+ * @param devidx	Device index. 0: EC, 1: PD.
+ * @param select	Image to update. RO or RW.
+ * @param offset	Offset of the block in the image.
+ * @param data		New contents of the block.
+ * @param size		Size of the block in bytes.
+ * @return VBERROR_... error, VBERROR_SUCCESS on success.
+ *
+ * This only needs to be implemented along with VbExEcGetImageBlockHashes().
+ */
+VbError_t VbExEcUpdateImageBlock(int devidx, enum VbSelectFirmware_t select,
+				 int offset, const uint8_t *data, int size);
+
 /**
  * Lock the selected EC code to prevent updates until the EC is rebooted.
  * Subsequent calls to VbExEcUpdateImage() with the same region this boot will
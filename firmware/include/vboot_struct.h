@@ -175,16 +175,34 @@ typedef struct VbKernelPreambleHeader {
 	/*
 	 * Flags passed in by the signer. Readers should return 0 for header
 	 * version < 2.2. Flags field is currently defined as:
-	 * [31:2] - Reserved (for future use)
+	 * [31:4] - Reserved (for future use)
+	 * [3:2]  - Body compression, header version >= 2.4 (0b00 - none,
+	 *                             0b01 - LZMA,
+	 *                             0b10 - LZ4)
 	 * [1:0]  - Kernel image type (0b00 - CrOS,
 	 *                             0b01 - bootimg,
 	 *                             0b10 - multiboot)
 	 */
 	uint32_t flags;
+	/*
+	 * Fields added in header version 2.3.  Size of each chunk of the
+	 * body, and offset of the chunk digests from the start of the
+	 * preamble.  Readers should return 0 for header version < 2.3.
+	 */
+	uint32_t body_chunk_size;
+	uint32_t body_digest_offset;
+	/*
+	 * Field added in header version 2.4.  Size of the body once
+	 * decompressed.  Readers should use body_signature.data_size for
+	 * header version < 2.4 or an uncompressed body.
+	 */
+	uint32_t body_load_size;
 } __attribute__((packed)) VbKernelPreambleHeader;
 
 #define EXPECTED_VBKERNELPREAMBLEHEADER2_1_SIZE 112
 #define EXPECTED_VBKERNELPREAMBLEHEADER2_2_SIZE 116
+#define EXPECTED_VBKERNELPREAMBLEHEADER2_3_SIZE 124
+#define EXPECTED_VBKERNELPREAMBLEHEADER2_4_SIZE 128
 
 /****************************************************************************/
 
@@ -284,6 +302,7 @@ typedef struct VbKernelPreambleHeader {
 
 /* Flags for VbSharedDataKernelPart.flags */
 #define VBSD_LKP_FLAG_KEY_BLOCK_VALID   0x01
+#define VBSD_LKP_FLAG_VBLOCK_CACHED     0x02
 
 /* Result codes for VbSharedDataKernelPart.check_result */
 #define VBSD_LKP_CHECK_NOT_DONE           0
@@ -364,9 +383,39 @@ typedef struct VbSharedDataKernelCall {
 	VbSharedDataKernelPart parts[VBSD_MAX_KERNEL_PARTS];
 } VbSharedDataKernelCall;
 
+/* Size of VbSharedDataKernelCall up to parts[] */
+#define VBSD_KERNEL_CALL_HEADER_SIZE 32
+
 /* Number of kernel calls to track.  Must be power of 2. */
 #define VBSD_MAX_KERNEL_CALLS 4
 
+/* A boot timestamp recorded by firmware */
+typedef struct VbSharedDataTimestamp {
+	/* Time in milliseconds, from vb2ex_mtime() */
+	uint32_t time_ms;
+	/* Event; see enum vb2_timestamp_event in 2struct.h */
+	uint32_t event;
+} __attribute__((packed)) VbSharedDataTimestamp;
+
+/* Number of boot timestamps to track.  Must be power of 2. */
+#define VBSD_MAX_TIMESTAMPS 32
+
+/* TPM latency statistics for one command code */
+typedef struct VbSharedDataTpmStats {
+	/* TPM command code */
+	uint32_t command;
+	/* Number of times the command was sent */
+	uint32_t count;
+	/* Total and longest time spent in the transport, in microseconds */
+	uint32_t total_us;
+	uint32_t max_us;
+	/* Times the command was sent again because the self test was busy */
+	uint32_t selftest_retries;
+} __attribute__((packed)) VbSharedDataTpmStats;
+
+/* Number of TPM command codes to keep statistics for */
+#define VBSD_MAX_TPM_STATS 16
+
 /*
  * Data shared between LoadFirmware(), LoadKernel(), and OS.
  *
@@ -469,10 +518,35 @@ typedef struct VbSharedDataHeader {
 	uint32_t kernel_version_lowest;
 
 	/*
-	 * After read-only firmware which uses version 2 is released, any
+	 * Fields added in version 3.  Before accessing, make sure that
+	 * struct_version >= 3
+	 */
+	/*
+	 * Number of boot timestamps recorded.  Timestamps are kept in a ring,
+	 * so if this exceeds VBSD_MAX_TIMESTAMPS the oldest ones are lost.
+	 */
+	uint32_t timestamp_count;
+	/* Reserved for padding */
+	uint32_t reserved3;
+	/* Boot timestamps */
+	VbSharedDataTimestamp timestamps[VBSD_MAX_TIMESTAMPS];
+
+	/*
+	 * Fields added in version 4.  Before accessing, make sure that
+	 * struct_version >= 4
+	 */
+	/* Number of entries used in tpm_stats[] */
+	uint32_t tpm_stats_count;
+	/* Reserved for padding */
+	uint32_t reserved4;
+	/* TPM latency statistics, if firmware was built with TPM_STATS=1 */
+	VbSharedDataTpmStats tpm_stats[VBSD_MAX_TPM_STATS];
+
+	/*
+	 * After read-only firmware which uses version 4 is released, any
 	 * additional fields must be added below, and the struct version must
 	 * be increased.  Before reading/writing those fields, make sure that
-	 * the struct being accessed is at least version 3.
+	 * the struct being accessed is at least version 5.
 	 *
 	 * It's always ok for an older firmware to access a newer struct, since
 	 * all the fields it knows about are present.  Newer firmware needs to
@@ -488,7 +562,120 @@ typedef struct VbSharedDataHeader {
  */
 #define VB_SHARED_DATA_HEADER_SIZE_V1 1072
 #define VB_SHARED_DATA_HEADER_SIZE_V2 1096
+#define VB_SHARED_DATA_HEADER_SIZE_V3 1360
+#define VB_SHARED_DATA_HEADER_SIZE_V4 1688
+
+#define VB_SHARED_DATA_VERSION 4      /* Version for struct_version */
+
+/*
+ * Compact form of VbSharedData, for handing off to the OS.
+ *
+ * VbSharedDataHeader reserves room for every debug log whether or not it was
+ * used.  The compact form is a small fixed core with what is needed on every
+ * boot, followed by optional sections.  Each section is a VbSharedDataSection
+ * header and its data; the firmware only emits the sections it was asked for
+ * and which hold something.  Readers must skip sections with unknown tags.
+ */
+
+/* Magic number for recognizing VbSharedDataCompact ("VbSC") */
+#define VB_SHARED_DATA_COMPACT_MAGIC 0x43536256
+
+#define VB_SHARED_DATA_COMPACT_VERSION 1
+
+typedef struct VbSharedDataCompact {
+	/* Magic number for struct (VB_SHARED_DATA_COMPACT_MAGIC) */
+	uint32_t magic;
+	/* Version of this structure */
+	uint16_t struct_version;
+	/* Size of this structure in bytes; the first section follows it */
+	uint16_t core_size;
+	/* Size of this structure and all sections in bytes */
+	uint32_t total_size;
+	/* Sections present; see VBSD_SECTION_MASK() */
+	uint32_t sections;
+	/* Flags; see VBSD_* */
+	uint32_t flags;
+	/* Current firmware and kernel versions in TPM */
+	uint32_t fw_version_tpm;
+	uint32_t kernel_version_tpm;
+	/* Combined key+kernel version of the kernel selected to boot */
+	uint32_t kernel_version;
+	/* Firmware index returned by LoadFirmware() or 0xFF if failure */
+	uint8_t firmware_index;
+	/* Recovery reason for current boot */
+	uint8_t recovery_reason;
+	/* GPT index of the kernel selected to boot, or 0 if none */
+	uint8_t kernel_gpt_index;
+	/* Reserved for padding */
+	uint8_t reserved0;
+	uint32_t reserved1;
+} __attribute__((packed)) VbSharedDataCompact;
+
+#define EXPECTED_VBSHAREDDATACOMPACT_SIZE 40
+
+/* Header for each section following VbSharedDataCompact */
+typedef struct VbSharedDataSection {
+	/* What the section holds; see VBSD_SECTION_* */
+	uint16_t tag;
+	/* Reserved for padding */
+	uint16_t reserved0;
+	/*
+	 * Size of the data following this header in bytes, padded to a
+	 * multiple of 8.  The next section starts right after it.
+	 */
+	uint32_t size;
+} __attribute__((packed)) VbSharedDataSection;
+
+/* Section tags */
+/* VbSharedDataTimers */
+#define VBSD_SECTION_TIMERS            1
+/* VbSharedDataFirmwareInfo */
+#define VBSD_SECTION_LOAD_FIRMWARE     2
+/*
+ * VbSharedDataKernelInfo, followed by the tracked VbSharedDataKernelCall
+ * entries in slot order.  Each call is trimmed to the parts[] entries it
+ * used.
+ */
+#define VBSD_SECTION_LOAD_KERNEL       3
+/* VbSharedDataLogCount, then the tracked timestamps in slot order */
+#define VBSD_SECTION_TIMESTAMPS        4
+/* VbSharedDataLogCount, then the used tpm_stats[] entries */
+#define VBSD_SECTION_TPM_STATS         5
+
+/* Bit for a section in VbSharedDataCompact.sections */
+#define VBSD_SECTION_MASK(tag) (1U << (tag))
+#define VBSD_SECTIONS_ALL              0xFFFFFFFF
+
+typedef struct VbSharedDataTimers {
+	uint64_t vb_init_enter;
+	uint64_t vb_init_exit;
+	uint64_t vb_select_firmware_enter;
+	uint64_t vb_select_firmware_exit;
+	uint64_t vb_select_and_load_kernel_enter;
+	uint64_t vb_select_and_load_kernel_exit;
+} __attribute__((packed)) VbSharedDataTimers;
+
+typedef struct VbSharedDataFirmwareInfo {
+	uint8_t check_fw_a_result;
+	uint8_t check_fw_b_result;
+	uint8_t reserved0[2];
+	uint32_t fw_version_tpm_start;
+	uint32_t fw_version_lowest;
+	uint32_t reserved1;
+	uint64_t fw_keyblock_flags;
+} __attribute__((packed)) VbSharedDataFirmwareInfo;
 
-#define VB_SHARED_DATA_VERSION 2      /* Version for struct_version */
+typedef struct VbSharedDataKernelInfo {
+	uint32_t lk_call_count;
+	uint32_t kernel_version_tpm_start;
+	uint32_t kernel_version_lowest;
+	uint32_t reserved0;
+} __attribute__((packed)) VbSharedDataKernelInfo;
+
+typedef struct VbSharedDataLogCount {
+	/* Number of entries recorded, which may exceed the number tracked */
+	uint32_t count;
+	uint32_t reserved0;
+} __attribute__((packed)) VbSharedDataLogCount;
 
 #endif  /* VBOOT_REFERENCE_VBOOT_STRUCT_H_ */
@@ -14,6 +14,143 @@
 #include "utility.h"
 #include "vboot_api.h"
 
+/**
+ * Copy what GptNextKernelEntry() needs from kernel entry [e] into slot [n] of
+ * the packed kernel entries.
+ */
+static void GptPackKernelEntry(GptData *gpt, uint32_t n, const GptEntry *e)
+{
+	GptKernelEntries *k = &gpt->kernels;
+
+	/* Any override is applied when the kernel is picked */
+	k->priority[n] = (e->attrs.fields.gpt_att &
+			  CGPT_ATTRIBUTE_PRIORITY_MASK) >>
+			 CGPT_ATTRIBUTE_PRIORITY_OFFSET;
+	k->tries[n] = GetEntryTries(e);
+	k->successful[n] = GetEntrySuccessful(e);
+	k->start[n] = e->starting_lba;
+	k->size[n] = e->ending_lba - e->starting_lba + 1;
+}
+
+/**
+ * Pack the kernel entries of the primary table, so GptNextKernelEntry()
+ * doesn't have to compare the type GUID of every entry on every call, or read
+ * the attributes scattered across them.
+ */
+static void GptPackKernelEntries(GptData *gpt)
+{
+	GptHeader *header = (GptHeader *)gpt->primary_header;
+	GptEntry *entries = (GptEntry *)gpt->primary_entries;
+	GptKernelEntries *k = &gpt->kernels;
+	uint32_t i;
+
+	k->count = 0;
+	k->valid = 0;
+
+	for (i = 0; i < header->number_of_entries; i++) {
+		if (!IsKernelEntry(entries + i))
+			continue;
+		if (k->count >= GPT_MAX_KERNEL_ENTRIES) {
+			VB2_DEBUG("Too many kernel entries to index\n");
+			return;
+		}
+		k->index[k->count] = i;
+		GptPackKernelEntry(gpt, k->count++, entries + i);
+	}
+
+	k->valid = 1;
+}
+
+/**
+ * Refresh the packed copy of kernel entry [e] after it has been changed.
+ */
+static void GptRepackKernelEntry(GptData *gpt, const GptEntry *e)
+{
+	GptEntry *entries = (GptEntry *)gpt->primary_entries;
+	GptKernelEntries *k = &gpt->kernels;
+	uint32_t n;
+
+	if (!k->valid)
+		return;
+
+	for (n = 0; n < k->count; n++) {
+		if (entries + k->index[n] == e) {
+			GptPackKernelEntry(gpt, n, e);
+			return;
+		}
+	}
+}
+
+/* What GptNextKernelEntry() looks at in each candidate entry */
+typedef struct {
+	uint32_t index;
+	int priority;
+	int tries;
+	int successful;
+} GptKernelCandidate;
+
+/**
+ * Return the number of entries GptNextKernelEntry() needs to look at.
+ */
+static uint32_t GptKernelCandidates(GptData *gpt)
+{
+	GptHeader *header = (GptHeader *)gpt->primary_header;
+
+	return gpt->kernels.valid ? gpt->kernels.count :
+			header->number_of_entries;
+}
+
+/**
+ * Fill in [c] for the nth entry GptNextKernelEntry() looks at, from the packed
+ * kernel entries if there are any.
+ *
+ * Returns 0 if the entry isn't a kernel entry, non-zero if it is.
+ */
+static int GptGetKernelCandidate(GptData *gpt, uint32_t n,
+				 GptKernelCandidate *c)
+{
+	GptKernelEntries *k = &gpt->kernels;
+	GptEntry *e;
+
+	if (k->valid) {
+		c->index = k->index[n];
+		c->priority = OverrideEntryPriority(
+				(GptEntry *)gpt->primary_entries + c->index,
+				k->priority[n]);
+		c->tries = k->tries[n];
+		c->successful = k->successful[n];
+		return 1;
+	}
+
+	e = (GptEntry *)gpt->primary_entries + n;
+	if (!IsKernelEntry(e))
+		return 0;
+	c->index = n;
+	c->priority = GetEntryPriority(e);
+	c->tries = GetEntryTries(e);
+	c->successful = GetEntrySuccessful(e);
+	return 1;
+}
+
+/**
+ * Pick the nth entry GptNextKernelEntry() looked at, and return its extent.
+ */
+static void GptPickKernel(GptData *gpt, uint32_t n, const GptKernelCandidate *c,
+			  uint64_t *start_sector, uint64_t *size)
+{
+	GptEntry *e = (GptEntry *)gpt->primary_entries + c->index;
+
+	gpt->current_kernel = c->index;
+	gpt->current_priority = c->priority;
+	if (gpt->kernels.valid) {
+		*start_sector = gpt->kernels.start[n];
+		*size = gpt->kernels.size[n];
+	} else {
+		*start_sector = e->starting_lba;
+		*size = e->ending_lba - e->starting_lba + 1;
+	}
+}
+
 int GptInit(GptData *gpt)
 {
 	int retval;
@@ -21,6 +158,7 @@ int GptInit(GptData *gpt)
 	gpt->modified = 0;
 	gpt->current_kernel = CGPT_KERNEL_ENTRY_NOT_FOUND;
 	gpt->current_priority = 999;
+	gpt->kernels.valid = 0;
 
 	retval = GptSanityCheck(gpt);
 	if (GPT_SUCCESS != retval) {
@@ -29,17 +167,16 @@ int GptInit(GptData *gpt)
 	}
 
 	GptRepair(gpt);
+	GptPackKernelEntries(gpt);
 	return GPT_SUCCESS;
 }
 
 int GptNextKernelEntry(GptData *gpt, uint64_t *start_sector, uint64_t *size)
 {
-	GptHeader *header = (GptHeader *)gpt->primary_header;
-	GptEntry *entries = (GptEntry *)gpt->primary_entries;
-	GptEntry *e;
-	int new_kernel = CGPT_KERNEL_ENTRY_NOT_FOUND;
+	uint32_t candidates = GptKernelCandidates(gpt);
+	GptKernelCandidate c, best;
+	uint32_t n, best_n = 0;
 	int new_prio = 0;
-	uint32_t i;
 
 	/*
 	 * If we already found a kernel, continue the scan at the current
@@ -47,22 +184,19 @@ int GptNextKernelEntry(GptData *gpt, uint64_t *start_sector, uint64_t *size)
 	 * priority.
 	 */
 	if (gpt->current_kernel != CGPT_KERNEL_ENTRY_NOT_FOUND) {
-		for (i = gpt->current_kernel + 1;
-		     i < header->number_of_entries; i++) {
-			e = entries + i;
-			if (!IsKernelEntry(e))
+		for (n = 0; n < candidates; n++) {
+			if (!GptGetKernelCandidate(gpt, n, &c))
+				continue;
+			if (c.index <= (uint32_t)gpt->current_kernel)
 				continue;
 			VB2_DEBUG("GptNextKernelEntry looking at same prio "
-				  "partition %d\n", i+1);
+				  "partition %d\n", c.index + 1);
 			VB2_DEBUG("GptNextKernelEntry s%d t%d p%d\n",
-				  GetEntrySuccessful(e), GetEntryTries(e),
-				  GetEntryPriority(e));
-			if (!(GetEntrySuccessful(e) || GetEntryTries(e)))
+				  c.successful, c.tries, c.priority);
+			if (!(c.successful || c.tries))
 				continue;
-			if (GetEntryPriority(e) == gpt->current_priority) {
-				gpt->current_kernel = i;
-				*start_sector = e->starting_lba;
-				*size = e->ending_lba - e->starting_lba + 1;
+			if (c.priority == gpt->current_priority) {
+				GptPickKernel(gpt, n, &c, start_sector, size);
 				VB2_DEBUG("GptNextKernelEntry likes it\n");
 				return GPT_SUCCESS;
 			}
@@ -73,44 +207,39 @@ int GptNextKernelEntry(GptData *gpt, uint64_t *start_sector, uint64_t *size)
 	 * We're still here, so scan for the remaining kernel with the highest
 	 * priority less than the previous attempt.
 	 */
-	for (i = 0, e = entries; i < header->number_of_entries; i++, e++) {
-		int current_prio = GetEntryPriority(e);
-		if (!IsKernelEntry(e))
+	for (n = 0; n < candidates; n++) {
+		if (!GptGetKernelCandidate(gpt, n, &c))
 			continue;
 		VB2_DEBUG("GptNextKernelEntry looking at new prio "
-			  "partition %d\n", i+1);
+			  "partition %d\n", c.index + 1);
 		VB2_DEBUG("GptNextKernelEntry s%d t%d p%d\n",
-			  GetEntrySuccessful(e), GetEntryTries(e),
-			  GetEntryPriority(e));
-		if (!(GetEntrySuccessful(e) || GetEntryTries(e)))
+			  c.successful, c.tries, c.priority);
+		if (!(c.successful || c.tries))
 			continue;
-		if (current_prio >= gpt->current_priority) {
+		if (c.priority >= gpt->current_priority) {
 			/* Already returned this kernel in a previous call */
 			continue;
 		}
-		if (current_prio > new_prio) {
-			new_kernel = i;
-			new_prio = current_prio;
+		if (c.priority > new_prio) {
+			best = c;
+			best_n = n;
+			new_prio = c.priority;
 		}
 	}
 
 	/*
-	 * Save what we found.  Note that if we didn't find a new kernel,
-	 * new_prio will still be -1, so future calls to this function will
-	 * also fail.
+	 * If we didn't find a new kernel, save that, so future calls to this
+	 * function will also fail.
 	 */
-	gpt->current_kernel = new_kernel;
-	gpt->current_priority = new_prio;
-
-	if (CGPT_KERNEL_ENTRY_NOT_FOUND == new_kernel) {
+	if (!new_prio) {
+		gpt->current_kernel = CGPT_KERNEL_ENTRY_NOT_FOUND;
+		gpt->current_priority = 0;
 		VB2_DEBUG("GptNextKernelEntry no more kernels\n");
 		return GPT_ERROR_NO_VALID_KERNEL;
 	}
 
-	VB2_DEBUG("GptNextKernelEntry likes partition %d\n", new_kernel + 1);
-	e = entries + new_kernel;
-	*start_sector = e->starting_lba;
-	*size = e->ending_lba - e->starting_lba + 1;
+	GptPickKernel(gpt, best_n, &best, start_sector, size);
+	VB2_DEBUG("GptNextKernelEntry likes partition %d\n", best.index + 1);
 	return GPT_SUCCESS;
 }
 
@@ -186,6 +315,8 @@ int GptUpdateKernelWithEntry(GptData *gpt, GptEntry *e, uint32_t update_type)
 	}
 
 	if (modified) {
+		GptRepackKernelEntry(gpt, e);
+		GptEntryModified(gpt, e);
 		GptModified(gpt);
 	}
 
@@ -161,21 +161,15 @@ int IsKernelEntry(const GptEntry *e)
 	return !memcmp(&e->type, &chromeos_kernel, sizeof(Guid));
 }
 
-int CheckEntries(GptEntry *entries, GptHeader *h)
+/*
+ * Find the first problem with the entries, in the order that CheckEntries()
+ * reports them, by comparing each entry to every other one.
+ */
+static int FirstEntryError(GptEntry *entries, GptHeader *h)
 {
-	if (!entries)
-		return GPT_ERROR_INVALID_ENTRIES;
 	GptEntry *entry;
-	uint32_t crc32;
 	uint32_t i;
 
-	/* Check CRC before examining entries. */
-	crc32 = Crc32((const uint8_t *)entries,
-		      h->size_of_entry * h->number_of_entries);
-	if (crc32 != h->entries_crc32)
-		return GPT_ERROR_CRC_CORRUPTED;
-
-	/* Check all entries. */
 	for (i = 0, entry = entries; i < h->number_of_entries; i++, entry++) {
 		GptEntry *e2;
 		uint32_t i2;
@@ -213,6 +207,109 @@ int CheckEntries(GptEntry *entries, GptHeader *h)
 	return 0;
 }
 
+static int CompareStart(const GptEntry *a, const GptEntry *b)
+{
+	return (a->starting_lba > b->starting_lba) -
+		(a->starting_lba < b->starting_lba);
+}
+
+static int CompareUnique(const GptEntry *a, const GptEntry *b)
+{
+	return memcmp(&a->unique, &b->unique, sizeof(Guid));
+}
+
+typedef int (*EntryCompare)(const GptEntry *a, const GptEntry *b);
+
+static void SiftDown(const GptEntry *entries, uint8_t *index, uint32_t root,
+		     uint32_t n, EntryCompare compare)
+{
+	uint32_t child;
+	uint8_t tmp;
+
+	while ((child = 2 * root + 1) < n) {
+		if (child + 1 < n && compare(&entries[index[child]],
+					     &entries[index[child + 1]]) < 0)
+			child++;
+		if (compare(&entries[index[root]], &entries[index[child]]) >= 0)
+			return;
+		tmp = index[root];
+		index[root] = index[child];
+		index[child] = tmp;
+		root = child;
+	}
+}
+
+/* Heapsort a list of entry indices, since firmware has no qsort(). */
+static void SortEntries(const GptEntry *entries, uint8_t *index, uint32_t n,
+			EntryCompare compare)
+{
+	uint32_t i;
+	uint8_t tmp;
+
+	for (i = n / 2; i-- > 0; )
+		SiftDown(entries, index, i, n, compare);
+	for (i = n; i-- > 1; ) {
+		tmp = index[0];
+		index[0] = index[i];
+		index[i] = tmp;
+		SiftDown(entries, index, 0, i, compare);
+	}
+}
+
+int CheckEntries(GptEntry *entries, GptHeader *h)
+{
+	if (!entries)
+		return GPT_ERROR_INVALID_ENTRIES;
+	uint8_t index[MAX_NUMBER_OF_ENTRIES];
+	GptEntry *entry;
+	uint32_t crc32;
+	uint32_t i, n = 0;
+
+	/* Check CRC before examining entries. */
+	crc32 = Crc32((const uint8_t *)entries,
+		      h->size_of_entry * h->number_of_entries);
+	if (crc32 != h->entries_crc32)
+		return GPT_ERROR_CRC_CORRUPTED;
+
+	/*
+	 * Sorting finds whether anything is wrong without comparing every pair
+	 * of entries.  If something is, FirstEntryError() says what.
+	 */
+	if (h->number_of_entries > MAX_NUMBER_OF_ENTRIES)
+		return FirstEntryError(entries, h);
+
+	/* Every entry in use must be in the valid region. */
+	for (i = 0, entry = entries; i < h->number_of_entries; i++, entry++) {
+		if (IsUnusedEntry(entry))
+			continue;
+		if ((entry->starting_lba < h->first_usable_lba) ||
+		    (entry->ending_lba > h->last_usable_lba) ||
+		    (entry->ending_lba < entry->starting_lba))
+			return FirstEntryError(entries, h);
+		index[n++] = i;
+	}
+
+	/*
+	 * Sorted by where they start, entries that don't overlap each end
+	 * before the next one starts.
+	 */
+	SortEntries(entries, index, n, CompareStart);
+	for (i = 1; i < n; i++)
+		if (entries[index[i]].starting_lba <=
+		    entries[index[i - 1]].ending_lba)
+			return FirstEntryError(entries, h);
+
+	/* Sorted by UniqueGuid, duplicates are next to each other. */
+	SortEntries(entries, index, n, CompareUnique);
+	for (i = 1; i < n; i++)
+		if (0 == CompareUnique(&entries[index[i]],
+				       &entries[index[i - 1]]))
+			return FirstEntryError(entries, h);
+
+	/* Success */
+	return 0;
+}
+
 int HeaderFieldsSame(GptHeader *h1, GptHeader *h2)
 {
 	if (memcmp(h1->signature, h2->signature, sizeof(h1->signature)))
@@ -289,7 +386,16 @@ int GptSanityCheck(GptData *gpt)
 	 */
 	if (0 == CheckEntries(entries1, goodhdr))
 		gpt->valid_entries |= MASK_PRIMARY;
-	if (0 == CheckEntries(entries2, goodhdr))
+
+	/*
+	 * Secondary entries which are the same as valid primary ones are just
+	 * as valid, so a comparison is enough to check them.
+	 */
+	if ((gpt->valid_entries & MASK_PRIMARY) && entries2 &&
+	    0 == memcmp(entries1, entries2,
+			goodhdr->size_of_entry * goodhdr->number_of_entries))
+		gpt->valid_entries |= MASK_SECONDARY;
+	else if (0 == CheckEntries(entries2, goodhdr))
 		gpt->valid_entries |= MASK_SECONDARY;
 
 	/*
@@ -402,7 +508,7 @@ int GetEntrySuccessful(const GptEntry *e)
 		CGPT_ATTRIBUTE_SUCCESSFUL_OFFSET;
 }
 
-int GetEntryPriority(const GptEntry *e)
+int OverrideEntryPriority(const GptEntry *e, int priority)
 {
 	int ret = VbExOverrideGptEntryPriority(e);
 
@@ -410,8 +516,14 @@ int GetEntryPriority(const GptEntry *e)
 	if ((ret > 0) && (ret < 16))
 		return ret;
 
-	return (e->attrs.fields.gpt_att & CGPT_ATTRIBUTE_PRIORITY_MASK) >>
-		CGPT_ATTRIBUTE_PRIORITY_OFFSET;
+	return priority;
+}
+
+int GetEntryPriority(const GptEntry *e)
+{
+	return OverrideEntryPriority(e, (e->attrs.fields.gpt_att &
+					 CGPT_ATTRIBUTE_PRIORITY_MASK) >>
+				     CGPT_ATTRIBUTE_PRIORITY_OFFSET);
 }
 
 int GetEntryTries(const GptEntry *e)
@@ -460,13 +572,89 @@ void GetCurrentKernelUniqueGuid(GptData *gpt, void *dest)
 	memcpy(dest, &e->unique, sizeof(Guid));
 }
 
+void GptEntryModified(GptData *gpt, const GptEntry *e)
+{
+	const uint8_t *p = (const uint8_t *)e;
+	size_t sector;
+	uint32_t bit;
+
+	if (!gpt->primary_entries || p < gpt->primary_entries ||
+	    !gpt->sector_bytes)
+		goto whole;
+
+	sector = (p - gpt->primary_entries) / gpt->sector_bytes;
+	if (sector >= GPT_MAX_DIRTY_SECTORS)
+		goto whole;
+	bit = 1U << sector;
+
+	/* A copy which is already wholly dirty stays that way */
+	if (!(gpt->modified & GPT_MODIFIED_ENTRIES1))
+		gpt->dirty_entries1 = bit;
+	else if (gpt->dirty_entries1)
+		gpt->dirty_entries1 |= bit;
+
+	if (!(gpt->modified & GPT_MODIFIED_ENTRIES2))
+		gpt->dirty_entries2 = bit;
+	else if (gpt->dirty_entries2)
+		gpt->dirty_entries2 |= bit;
+	goto done;
+
+whole:
+	gpt->dirty_entries1 = 0;
+	gpt->dirty_entries2 = 0;
+
+done:
+	/* Later changes before GptModified() add to the recorded sectors */
+	gpt->modified |= GPT_MODIFIED_ENTRIES1 | GPT_MODIFIED_ENTRIES2;
+}
+
+int GptPatchEntriesCrc(GptData *gpt)
+{
+	GptHeader *header = (GptHeader *)gpt->primary_header;
+	uint32_t entries_size, sector_bytes = gpt->sector_bytes;
+	uint32_t crc;
+	int i;
+
+	/*
+	 * Both copies must have been in sync before the change, so the
+	 * secondary entries still hold the old primary contents.
+	 */
+	if (!header || !gpt->primary_entries || !gpt->secondary_entries ||
+	    gpt->valid_headers != MASK_BOTH ||
+	    gpt->valid_entries != MASK_BOTH ||
+	    !gpt->dirty_entries1 || !sector_bytes)
+		return 1;
+
+	entries_size = header->size_of_entry * header->number_of_entries;
+	crc = header->entries_crc32;
+	for (i = 0; i < GPT_MAX_DIRTY_SECTORS; i++) {
+		uint32_t offset = i * sector_bytes;
+		uint32_t len;
+
+		if (!(gpt->dirty_entries1 & (1U << i)) ||
+		    offset >= entries_size)
+			continue;
+
+		len = entries_size - offset;
+		if (len > sector_bytes)
+			len = sector_bytes;
+		crc = Crc32Patch(crc, gpt->secondary_entries + offset,
+				 gpt->primary_entries + offset, len,
+				 entries_size - offset - len);
+	}
+
+	header->entries_crc32 = crc;
+	return 0;
+}
+
 void GptModified(GptData *gpt) {
 	GptHeader *header = (GptHeader *)gpt->primary_header;
 
 	/* Update the CRCs */
-	header->entries_crc32 = Crc32(gpt->primary_entries,
-				      header->size_of_entry *
-				      header->number_of_entries);
+	if (GptPatchEntriesCrc(gpt))
+		header->entries_crc32 = Crc32(gpt->primary_entries,
+					      header->size_of_entry *
+					      header->number_of_entries);
 	header->header_crc32 = HeaderCrc(header);
 	gpt->modified |= GPT_MODIFIED_HEADER1 | GPT_MODIFIED_ENTRIES1;
 
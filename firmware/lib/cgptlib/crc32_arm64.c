@@ -0,0 +1,30 @@
+/* Copyright 2018 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ *
+ * CRC32 using the ARMv8 CRC32 instructions.  This is only built
+ * (CRC32_ARCH=arm64) for targets known to have them.
+ */
+
+#include <arm_acle.h>
+
+#include "sysincludes.h"
+
+#include "crc32.h"
+
+uint32_t Crc32UpdateArch(uint32_t *value, const uint8_t *buffer,
+			 uint32_t len)
+{
+	uint32_t crc = *value;
+	uint32_t done = len & ~7U;
+	uint64_t v;
+	uint32_t i;
+
+	for (i = 0; i < done; i += 8) {
+		memcpy(&v, buffer + i, sizeof(v));
+		crc = __crc32d(crc, v);
+	}
+
+	*value = crc;
+	return done;
+}
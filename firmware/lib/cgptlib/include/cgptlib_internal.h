@@ -139,6 +139,24 @@ int GptSanityCheck(GptData *gpt);
  */
 void GptRepair(GptData *gpt);
 
+/**
+ * Record that a primary entry is about to be modified, so that only the
+ * sectors holding changed entries are written back to the drive.  Call this
+ * before GptModified().
+ */
+void GptEntryModified(GptData *gpt, const GptEntry *e);
+
+/**
+ * Fold the changes recorded by GptEntryModified() into the primary header's
+ * entries CRC, reading only the changed sectors.  The secondary entries are
+ * taken as the contents from before the change, so this must run before
+ * they are brought up to date.
+ *
+ * Returns 0 if the CRC was updated, or non-zero if the caller must recompute
+ * it over the whole entries array.
+ */
+int GptPatchEntriesCrc(GptData *gpt);
+
 /**
  * Called when the primary entries are modified and the CRCs need to be
  * recalculated and propagated to the secondary entries
@@ -150,6 +168,12 @@ void GptModified(GptData *gpt);
  */
 int IsKernelEntry(const GptEntry *e);
 
+/**
+ * Return the priority of the entry with [priority] in its attributes, after
+ * any VbExOverrideGptEntryPriority().
+ */
+int OverrideEntryPriority(const GptEntry *e, int priority);
+
 /**
  * Copy the current kernel partition's UniquePartitionGuid to the dest.
  */
@@ -9,4 +9,38 @@
 
 uint32_t Crc32(const void *buffer, uint32_t len);
 
+/**
+ * Update a CRC32 after some bytes of the buffer it covers change, without
+ * reading the rest of the buffer.
+ *
+ * @param crc		Crc32() of the buffer before the change
+ * @param old		Previous contents of the changed bytes
+ * @param new		New contents of the changed bytes
+ * @param len		Number of changed bytes
+ * @param tail		Number of bytes in the buffer after the changed ones
+ * @return Crc32() of the buffer after the change.
+ */
+uint32_t Crc32Patch(uint32_t crc, const void *old, const void *new,
+		    uint32_t len, uint32_t tail);
+
+/*
+ * CPU-specific CRC32 code is selected at build time with CRC32_ARCH=x86 or
+ * CRC32_ARCH=arm64; see the Makefile.
+ */
+#if defined(CRC32_ARCH_X86) || defined(CRC32_ARCH_ARM64)
+#define CRC32_ARCH
+
+/**
+ * Update a CRC32 register using CPU instructions.
+ *
+ * @param value		CRC32 register (not yet inverted for output)
+ * @param buffer	Data to checksum
+ * @param len		Length of data in bytes
+ * @return The number of leading bytes of buffer which were processed; the
+ * caller must process the rest.  This may be 0.
+ */
+uint32_t Crc32UpdateArch(uint32_t *value, const uint8_t *buffer,
+			 uint32_t len);
+#endif
+
 #endif  /* VBOOT_REFERENCE_GPT_CRC32_H_ */
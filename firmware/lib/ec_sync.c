@@ -9,6 +9,7 @@
 #include "2common.h"
 #include "2misc.h"
 #include "2nvstorage.h"
+#include "2sha.h"
 
 #include "sysincludes.h"
 #include "ec_sync.h"
@@ -34,6 +35,35 @@
 /* PD doesn't support RW A/B */
 #define RW_AB(devidx) ((devidx) ? 0 : VB2_CONTEXT_EC_EFS)
 
+__attribute__((weak))
+VbError_t VbExEcHashImageStart(int devidx, enum VbSelectFirmware_t select)
+{
+	return VBERROR_SUCCESS;
+}
+
+__attribute__((weak))
+VbError_t VbExEcGetImageBlockHashes(int devidx, enum VbSelectFirmware_t select,
+				    int *block_size, const uint8_t **hashes,
+				    int *num_blocks)
+{
+	return VBERROR_UNKNOWN;
+}
+
+__attribute__((weak))
+VbError_t VbExEcUpdateImageBlock(int devidx, enum VbSelectFirmware_t select,
+				 int offset, const uint8_t *data, int size)
+{
+	return VBERROR_UNKNOWN;
+}
+
+__attribute__((weak))
+VbError_t VbExEcGetExpectedImageHashStruct(int devidx,
+					   enum VbSelectFirmware_t select,
+					   const uint8_t **buf, int *size)
+{
+	return VBERROR_UNKNOWN;
+}
+
 static void request_recovery(struct vb2_context *ctx, uint32_t recovery_request)
 {
 	VB2_DEBUG("request_recovery(%u)\n", recovery_request);
@@ -90,6 +120,64 @@ static const char *image_name_to_string(enum VbSelectFirmware_t select)
 	}
 }
 
+/**
+ * Start the EC hashing an image, so check_ec_hash() only has to collect it.
+ *
+ * @param devidx	Index of EC device to hash
+ * @param select	Which firmware image to hash
+ */
+static void start_ec_hash(int devidx, enum VbSelectFirmware_t select)
+{
+	int rv = VbExEcHashImageStart(devidx, select);
+
+	/* Not fatal; VbExEcHashImage() will hash it synchronously */
+	if (rv)
+		VB2_DEBUG("VbExEcHashImageStart() returned %d\n", rv);
+}
+
+/**
+ * Get the expected hash of an EC image.
+ *
+ * Uses the precomputed hash struct if the platform provides one, else asks
+ * the platform for the hash directly.
+ *
+ * @param devidx	Index of EC device
+ * @param select	Which firmware image
+ * @param hash		Pointer to the hash
+ * @param hash_size	Pointer to the hash size
+ * @return VBERROR_SUCCESS, or non-zero error code.
+ */
+static VbError_t get_expected_hash(int devidx, enum VbSelectFirmware_t select,
+				   const uint8_t **hash, int *hash_size)
+{
+	const struct vb2_ec_image_hash *h;
+	const uint8_t *buf = NULL;
+	int size;
+
+	if (VbExEcGetExpectedImageHashStruct(devidx, select, &buf, &size))
+		return VbExEcGetExpectedImageHash(devidx, select, hash,
+						  hash_size);
+
+	h = (const struct vb2_ec_image_hash *)buf;
+	if (size < EXPECTED_VB2_EC_IMAGE_HASH_SIZE ||
+	    memcmp(h->magic, VB2_EC_IMAGE_HASH_MAGIC,
+		   VB2_EC_IMAGE_HASH_MAGIC_SIZE)) {
+		VB2_DEBUG("Bad EC image hash struct\n");
+		return VB2_ERROR_EC_HASH_EXPECTED;
+	}
+	if (h->header_version_major != VB2_EC_IMAGE_HASH_VERSION_MAJOR ||
+	    h->struct_size < EXPECTED_VB2_EC_IMAGE_HASH_SIZE ||
+	    h->struct_size > size) {
+		VB2_DEBUG("Unsupported EC image hash struct v%d, %d bytes\n",
+			  h->header_version_major, h->struct_size);
+		return VB2_ERROR_EC_HASH_EXPECTED;
+	}
+
+	*hash = h->digest;
+	*hash_size = sizeof(h->digest);
+	return VBERROR_SUCCESS;
+}
+
 /**
  * Check if the hash of the EC code matches the expected hash.
  *
@@ -117,9 +205,9 @@ static int check_ec_hash(struct vb2_context *ctx, int devidx,
 	/* Get expected EC hash. */
 	const uint8_t *hash = NULL;
 	int hash_size;
-	rv = VbExEcGetExpectedImageHash(devidx, select, &hash, &hash_size);
+	rv = get_expected_hash(devidx, select, &hash, &hash_size);
 	if (rv) {
-		VB2_DEBUG("VbExEcGetExpectedImageHash() returned %d\n", rv);
+		VB2_DEBUG("Getting expected EC hash returned %d\n", rv);
 		request_recovery(ctx, VB2_RECOVERY_EC_EXPECTED_HASH);
 		return VB2_ERROR_EC_HASH_EXPECTED;
 	}
@@ -138,6 +226,57 @@ static int check_ec_hash(struct vb2_context *ctx, int devidx,
 	return VB2_SUCCESS;
 }
 
+/**
+ * Send the EC only the blocks of its image which differ from the expected one
+ *
+ * @param devidx	Index of EC device to update
+ * @param select	Which firmware image to update
+ * @param want		Expected image
+ * @param want_size	Size of expected image in bytes
+ * @return VBERROR_SUCCESS, VBERROR_UNKNOWN if the EC can't report block
+ * hashes so the whole image must be sent, or another error from
+ * VbExEcUpdateImageBlock().
+ */
+static VbError_t update_ec_blocks(int devidx, enum VbSelectFirmware_t select,
+				  const uint8_t *want, int want_size)
+{
+	uint8_t digest[VB2_SHA256_DIGEST_SIZE];
+	const uint8_t *hashes = NULL;
+	int block_size, num_blocks;
+	int offset, size, sent = 0;
+	int rv;
+
+	rv = VbExEcGetImageBlockHashes(devidx, select, &block_size, &hashes,
+				       &num_blocks);
+	if (rv)
+		return VBERROR_UNKNOWN;
+	if (block_size <= 0 ||
+	    num_blocks != (want_size + block_size - 1) / block_size) {
+		VB2_DEBUG("EC has %d %d-byte blocks; can't update %d bytes\n",
+			  num_blocks, block_size, want_size);
+		return VBERROR_UNKNOWN;
+	}
+
+	for (offset = 0; offset < want_size; offset += block_size) {
+		size = want_size - offset < block_size ?
+			want_size - offset : block_size;
+		if (vb2_digest_buffer(want + offset, size, VB2_HASH_SHA256,
+				      digest, sizeof(digest)))
+			return VBERROR_UNKNOWN;
+		if (vb2_safe_memcmp(digest, hashes, sizeof(digest))) {
+			rv = VbExEcUpdateImageBlock(devidx, select, offset,
+						    want + offset, size);
+			if (rv)
+				return rv;
+			sent++;
+		}
+		hashes += sizeof(digest);
+	}
+
+	VB2_DEBUG("Sent %d of %d blocks\n", sent, num_blocks);
+	return VBERROR_SUCCESS;
+}
+
 /**
  * Update the specified EC and verify the update succeeded
  *
@@ -164,9 +303,12 @@ static VbError_t update_ec(struct vb2_context *ctx, int devidx,
 	}
 	VB2_DEBUG("image len = %d\n", want_size);
 
-	rv = VbExEcUpdateImage(devidx, select, want, want_size);
+	/* Only send the blocks which changed, if the EC can tell us which */
+	rv = update_ec_blocks(devidx, select, want, want_size);
+	if (rv == VBERROR_UNKNOWN)
+		rv = VbExEcUpdateImage(devidx, select, want, want_size);
 	if (rv != VBERROR_SUCCESS) {
-		VB2_DEBUG("VbExEcUpdateImage() returned %d\n", rv);
+		VB2_DEBUG("Updating EC image returned %d\n", rv);
 
 		/*
 		 * The EC may know it needs a reboot.  It may need to
@@ -362,9 +504,20 @@ VbError_t ec_sync_phase1(struct vb2_context *ctx)
 	if (do_pd_sync && check_ec_active(ctx, 1))
 		return VBERROR_EC_REBOOT_TO_RO_REQUIRED;
 
+	/*
+	 * Let every EC hash its active image at once, rather than waiting for
+	 * the EC before asking the PD.
+	 */
+	start_ec_hash(0, VB_SELECT_FIRMWARE_EC_ACTIVE);
+	if (do_pd_sync)
+		start_ec_hash(1, VB_SELECT_FIRMWARE_EC_ACTIVE);
+
 	/* Check if we need to update RW.  Failures trigger recovery mode. */
 	if (check_ec_hash(ctx, 0, VB_SELECT_FIRMWARE_EC_ACTIVE))
 		return VBERROR_EC_REBOOT_TO_RO_REQUIRED;
+	/* The EC is free again, so it can hash RO while we wait for the PD */
+	if (vb2_nv_get(ctx, VB2_NV_TRY_RO_SYNC))
+		start_ec_hash(0, VB_SELECT_FIRMWARE_READONLY);
 	if (do_pd_sync && check_ec_hash(ctx, 1, VB_SELECT_FIRMWARE_EC_ACTIVE))
 		return VBERROR_EC_REBOOT_TO_RO_REQUIRED;
 	/*
@@ -15,108 +15,356 @@
 #include "vboot_api.h"
 
 
+__attribute__((weak))
+VbError_t VbExDiskReadMulti(VbExDiskHandle_t handle, VbDiskRange *ranges,
+			    uint32_t count)
+{
+	uint32_t i;
+
+	for (i = 0; i < count; i++)
+		ranges[i].result = VbExDiskRead(handle, ranges[i].lba_start,
+						ranges[i].lba_count,
+						ranges[i].buffer);
+
+	return VBERROR_SUCCESS;
+}
+
+/**
+ * Read sector ranges from the drive, as one batch if there is more than one.
+ *
+ * Each range's result is filled in.  If the batch can't be read, each range
+ * is read again by itself, so one bad copy of the GPT doesn't cost the other.
+ */
+static void ReadRanges(VbExDiskHandle_t disk_handle, VbDiskRange *ranges,
+		       uint32_t count)
+{
+	uint32_t i;
+
+	if (count > 1 &&
+	    VBERROR_SUCCESS == VbExDiskReadMulti(disk_handle, ranges, count))
+		return;
+
+	for (i = 0; i < count; i++)
+		ranges[i].result = VbExDiskRead(disk_handle,
+						ranges[i].lba_start,
+						ranges[i].lba_count,
+						ranges[i].buffer);
+}
+
+/**
+ * Check a GPT header which has been read from the drive.
+ *
+ * Returns 0 if the header is valid, 1 if not.
+ */
+static int CheckGptHeader(GptData *gptdata, int is_secondary)
+{
+	GptHeader *h = (GptHeader *)(is_secondary ? gptdata->secondary_header :
+				     gptdata->primary_header);
+
+	if (0 == CheckHeader(h, is_secondary,
+			     gptdata->streaming_drive_sectors,
+			     gptdata->gpt_drive_sectors,
+			     gptdata->flags,
+			     gptdata->sector_bytes))
+		return 0;
+
+	VB2_DEBUG("%s GPT header is %s\n",
+		  is_secondary ? "Secondary" : "Primary",
+		  memcmp(h->signature, GPT_HEADER_SIGNATURE_IGNORED,
+			 GPT_HEADER_SIGNATURE_SIZE)
+		  ? "invalid" : "being ignored");
+	return 1;
+}
+
+/**
+ * Read the GPT headers in [mask] from the drive, both at once if both are
+ * wanted.
+ *
+ * A header is zeroed if it could not be read.
+ *
+ * Returns the mask of the headers read which are valid.
+ */
+static uint32_t ReadGptHeaders(VbExDiskHandle_t disk_handle, GptData *gptdata,
+			       uint32_t mask)
+{
+	VbDiskRange ranges[2];
+	int is_secondary[2];
+	uint32_t count = 0;
+	uint32_t valid = 0;
+	uint32_t i;
+
+	if (mask & MASK_PRIMARY) {
+		/* Skip the protective MBR */
+		ranges[count].lba_start = 1;
+		ranges[count].buffer = gptdata->primary_header;
+		is_secondary[count++] = 0;
+	}
+	if (mask & MASK_SECONDARY) {
+		ranges[count].lba_start = gptdata->gpt_drive_sectors - 1;
+		ranges[count].buffer = gptdata->secondary_header;
+		is_secondary[count++] = 1;
+	}
+	for (i = 0; i < count; i++)
+		ranges[i].lba_count = 1;
+
+	ReadRanges(disk_handle, ranges, count);
+
+	for (i = 0; i < count; i++) {
+		if (VBERROR_SUCCESS != ranges[i].result) {
+			VB2_DEBUG("Read error in %s GPT header\n",
+				  is_secondary[i] ? "secondary" : "primary");
+			memset(ranges[i].buffer, 0, gptdata->sector_bytes);
+		}
+		if (0 == CheckGptHeader(gptdata, is_secondary[i]))
+			valid |= is_secondary[i] ? MASK_SECONDARY :
+				MASK_PRIMARY;
+	}
+
+	return valid;
+}
+
+/**
+ * Read the GPT entries in [mask], as described by their (valid) headers, both
+ * at once if both are wanted.
+ *
+ * Only the sectors the headers say are in use are read.
+ *
+ * Returns the mask of the entries which were read.
+ */
+static uint32_t ReadGptEntries(VbExDiskHandle_t disk_handle, GptData *gptdata,
+			       uint32_t mask)
+{
+	VbDiskRange ranges[2];
+	int is_secondary[2];
+	uint32_t count = 0;
+	uint32_t read = 0;
+	uint32_t i;
+
+	if (mask & MASK_PRIMARY) {
+		ranges[count].buffer = gptdata->primary_entries;
+		is_secondary[count++] = 0;
+	}
+	if (mask & MASK_SECONDARY) {
+		ranges[count].buffer = gptdata->secondary_entries;
+		is_secondary[count++] = 1;
+	}
+	for (i = 0; i < count; i++) {
+		GptHeader *h = (GptHeader *)(is_secondary[i] ?
+					     gptdata->secondary_header :
+					     gptdata->primary_header);
+
+		ranges[i].lba_start = h->entries_lba;
+		ranges[i].lba_count = CalculateEntriesSectors(
+				h, gptdata->sector_bytes);
+	}
+
+	ReadRanges(disk_handle, ranges, count);
+
+	for (i = 0; i < count; i++) {
+		if (VBERROR_SUCCESS != ranges[i].result) {
+			VB2_DEBUG("Read error in %s GPT entries\n",
+				  is_secondary[i] ? "secondary" : "primary");
+			continue;
+		}
+		read |= is_secondary[i] ? MASK_SECONDARY : MASK_PRIMARY;
+	}
+
+	return read;
+}
+
+/**
+ * Read the primary GPT entries and, if their CRC matches the primary header,
+ * build the secondary GPT in memory from the primary instead of reading it.
+ *
+ * Returns 0 if successful, 1 if the secondary GPT must be read from the drive.
+ */
+static int ReadPrimaryGptOnly(VbExDiskHandle_t disk_handle, GptData *gptdata)
+{
+	GptHeader *h = (GptHeader *)gptdata->primary_header;
+	uint64_t entries_bytes = (uint64_t)CalculateEntriesSectors(h,
+					gptdata->sector_bytes) *
+				 gptdata->sector_bytes;
+
+	gptdata->primary_entries = (uint8_t *)malloc(entries_bytes);
+	gptdata->secondary_entries = (uint8_t *)malloc(entries_bytes);
+	if (gptdata->primary_entries == NULL ||
+	    gptdata->secondary_entries == NULL)
+		return 1;
+
+	if (!ReadGptEntries(disk_handle, gptdata, MASK_PRIMARY))
+		return 1;
+
+	if (Crc32(gptdata->primary_entries,
+		  h->size_of_entry * h->number_of_entries) != h->entries_crc32) {
+		VB2_DEBUG("Primary GPT entries are invalid\n");
+		return 1;
+	}
+
+	/*
+	 * Mirror the primary into the secondary.  GptInit() will then find
+	 * both copies valid and identical.  If anything is written back, the
+	 * secondary is rewritten from the primary, which repairs it.
+	 */
+	gptdata->valid_headers = MASK_PRIMARY;
+	gptdata->valid_entries = MASK_PRIMARY;
+	GptRepair(gptdata);
+	gptdata->modified = 0;
+	gptdata->deferred = MASK_SECONDARY;
+	VB2_DEBUG("Skipping secondary GPT; primary is valid\n");
+	return 0;
+}
+
 /**
  * Allocate and read GPT data from the drive.
  *
  * The sector_bytes and gpt_drive_sectors fields should be filled on input.  The
  * primary and secondary header and entries are filled on output.
  *
+ * Both headers are read first, and only as many entry sectors as the headers
+ * declare are allocated and read.  The headers are read as one
+ * VbExDiskReadMulti() batch, and so are the entries, so a drive with a command
+ * queue only waits twice.  If GPT_FLAG_LAZY_SECONDARY is set and the
+ * primary GPT is intact, the secondary GPT is not read at all.
+ *
  * Returns 0 if successful, 1 if error.
  */
 int AllocAndReadGptData(VbExDiskHandle_t disk_handle, GptData *gptdata)
 {
-	uint64_t max_entries_bytes = MAX_NUMBER_OF_ENTRIES * sizeof(GptEntry);
-	int primary_valid = 0, secondary_valid = 0;
+	GptHeader *primary_header, *secondary_header;
+	uint64_t entries_sectors = 0;
+	uint64_t entries_bytes;
+	uint32_t valid;
 
 	/* No data to be written yet */
 	gptdata->modified = 0;
 	/* This should get overwritten by GptInit() */
 	gptdata->ignored = 0;
+	gptdata->deferred = 0;
+	gptdata->dirty_entries1 = 0;
+	gptdata->dirty_entries2 = 0;
 
-	/* Allocate all buffers */
+	/* Entries are allocated once we know how big they are */
+	gptdata->primary_entries = NULL;
+	gptdata->secondary_entries = NULL;
+
+	/* Allocate header buffers */
 	gptdata->primary_header = (uint8_t *)malloc(gptdata->sector_bytes);
 	gptdata->secondary_header =
 		(uint8_t *)malloc(gptdata->sector_bytes);
-	gptdata->primary_entries = (uint8_t *)malloc(max_entries_bytes);
-	gptdata->secondary_entries = (uint8_t *)malloc(max_entries_bytes);
-
 	if (gptdata->primary_header == NULL ||
-	    gptdata->secondary_header == NULL ||
-	    gptdata->primary_entries == NULL ||
-	    gptdata->secondary_entries == NULL)
+	    gptdata->secondary_header == NULL)
 		return 1;
+	primary_header = (GptHeader *)gptdata->primary_header;
+	secondary_header = (GptHeader *)gptdata->secondary_header;
 
-	/* Read primary header from the drive, skipping the protective MBR */
-	if (0 != VbExDiskRead(disk_handle, 1, 1, gptdata->primary_header)) {
-		VB2_DEBUG("Read error in primary GPT header\n");
-		memset(gptdata->primary_header, 0, gptdata->sector_bytes);
-	}
+	if (gptdata->flags & GPT_FLAG_LAZY_SECONDARY) {
+		/* The secondary may not be needed, so start with the primary */
+		valid = ReadGptHeaders(disk_handle, gptdata, MASK_PRIMARY);
+		if (valid && 0 == ReadPrimaryGptOnly(disk_handle, gptdata))
+			return 0;
 
-	/* Only read primary GPT if the primary header is valid */
-	GptHeader* primary_header = (GptHeader*)gptdata->primary_header;
-	if (0 == CheckHeader(primary_header, 0,
-			gptdata->streaming_drive_sectors,
-			gptdata->gpt_drive_sectors,
-			gptdata->flags,
-			gptdata->sector_bytes)) {
-		primary_valid = 1;
-		uint64_t entries_bytes =
-				(uint64_t)primary_header->number_of_entries
-				* primary_header->size_of_entry;
-		uint64_t entries_sectors = entries_bytes
-					/ gptdata->sector_bytes;
-		if (0 != VbExDiskRead(disk_handle,
-				      primary_header->entries_lba,
-				      entries_sectors,
-				      gptdata->primary_entries)) {
-			VB2_DEBUG("Read error in primary GPT entries\n");
-			primary_valid = 0;
-		}
+		/* Fall back to reading both copies */
+		free(gptdata->primary_entries);
+		free(gptdata->secondary_entries);
+		gptdata->primary_entries = NULL;
+		gptdata->secondary_entries = NULL;
+		valid |= ReadGptHeaders(disk_handle, gptdata, MASK_SECONDARY);
 	} else {
-		VB2_DEBUG("Primary GPT header is %s\n",
-			  memcmp(primary_header->signature,
-				 GPT_HEADER_SIGNATURE_IGNORED,
-				 GPT_HEADER_SIGNATURE_SIZE)
-			  ? "invalid" : "being ignored");
+		valid = ReadGptHeaders(disk_handle, gptdata, MASK_BOTH);
 	}
 
-	/* Read secondary header from the end of the drive */
-	if (0 != VbExDiskRead(disk_handle, gptdata->gpt_drive_sectors - 1, 1,
-			      gptdata->secondary_header)) {
-		VB2_DEBUG("Read error in secondary GPT header\n");
-		memset(gptdata->secondary_header, 0, gptdata->sector_bytes);
-	}
+	if (!valid)
+		return 1;
 
-	/* Only read secondary GPT if the secondary header is valid */
-	GptHeader* secondary_header = (GptHeader*)gptdata->secondary_header;
-	if (0 == CheckHeader(secondary_header, 1,
-			gptdata->streaming_drive_sectors,
-			gptdata->gpt_drive_sectors,
-			gptdata->flags,
-			gptdata->sector_bytes)) {
-		secondary_valid = 1;
-		uint64_t entries_bytes =
-				(uint64_t)secondary_header->number_of_entries
-				* secondary_header->size_of_entry;
-		uint64_t entries_sectors = entries_bytes
-				/ gptdata->sector_bytes;
-		if (0 != VbExDiskRead(disk_handle,
-				      secondary_header->entries_lba,
-				      entries_sectors,
-				      gptdata->secondary_entries)) {
-			VB2_DEBUG("Read error in secondary GPT entries\n");
-			secondary_valid = 0;
-		}
-	} else {
-		VB2_DEBUG("Secondary GPT header is %s\n",
-			  memcmp(secondary_header->signature,
-				 GPT_HEADER_SIGNATURE_IGNORED,
-				 GPT_HEADER_SIGNATURE_SIZE)
-			  ? "invalid" : "being ignored");
-	}
+	/*
+	 * Size both entry buffers for the larger of the valid headers, since
+	 * GptInit() may check or repair either copy using either header.
+	 */
+	if (valid & MASK_PRIMARY)
+		entries_sectors = CalculateEntriesSectors(primary_header,
+							  gptdata->sector_bytes);
+	if (valid & MASK_SECONDARY)
+		entries_sectors = VB2_MAX(entries_sectors,
+				CalculateEntriesSectors(secondary_header,
+							gptdata->sector_bytes));
+	entries_bytes = entries_sectors * gptdata->sector_bytes;
+
+	gptdata->primary_entries = (uint8_t *)malloc(entries_bytes);
+	gptdata->secondary_entries = (uint8_t *)malloc(entries_bytes);
+	if (gptdata->primary_entries == NULL ||
+	    gptdata->secondary_entries == NULL)
+		return 1;
+
+	/* Only read entries for the headers which are valid */
+	valid = ReadGptEntries(disk_handle, gptdata, valid);
 
 	/* Return 0 if least one GPT header was valid */
-	return (primary_valid || secondary_valid) ? 0 : 1;
+	return valid ? 0 : 1;
+}
+
+/**
+ * Check whether a secondary GPT which was never read is marked to be ignored.
+ *
+ * Returns 1 if the on-disk secondary header is being ignored, 0 if not.
+ */
+static int DeferredSecondaryIgnored(VbExDiskHandle_t disk_handle,
+				    GptData *gptdata)
+{
+	uint8_t *buf = (uint8_t *)malloc(gptdata->sector_bytes);
+	int ignored = 0;
+
+	if (!buf)
+		return 0;
+
+	if (0 == VbExDiskRead(disk_handle, gptdata->gpt_drive_sectors - 1, 1,
+			      buf) &&
+	    !memcmp(((GptHeader *)buf)->signature,
+		    GPT_HEADER_SIGNATURE_IGNORED, GPT_HEADER_SIGNATURE_SIZE))
+		ignored = 1;
+
+	free(buf);
+	return ignored;
+}
+
+/**
+ * Write the modified sectors of a GPT entries array.
+ *
+ * Each run of adjacent dirty sectors is written with a single call.
+ *
+ * @param disk_handle	Drive to write to
+ * @param gptdata	GPT data
+ * @param entries_lba	First sector of the entries array on the drive
+ * @param entries_sectors	Size of the entries array in sectors
+ * @param entries	Entries array
+ * @param dirty		Bitmap of dirty sectors, or 0 to write the whole array
+ *
+ * Returns 0 if successful, 1 if error.
+ */
+static int WriteGptEntries(VbExDiskHandle_t disk_handle, GptData *gptdata,
+			   uint64_t entries_lba, uint64_t entries_sectors,
+			   const uint8_t *entries, uint32_t dirty)
+{
+	uint64_t start, end;
+
+	if (!dirty || entries_sectors > GPT_MAX_DIRTY_SECTORS)
+		return 0 != VbExDiskWrite(disk_handle, entries_lba,
+					  entries_sectors, entries);
+
+	for (start = 0; start < entries_sectors; start = end) {
+		end = start + 1;
+		if (!(dirty & (1U << start)))
+			continue;
+
+		while (end < entries_sectors && (dirty & (1U << end)))
+			end++;
+
+		if (0 != VbExDiskWrite(disk_handle, entries_lba + start,
+				       end - start,
+				       entries + start * gptdata->sector_bytes))
+			return 1;
+	}
+
+	return 0;
 }
 
 /**
@@ -128,7 +376,7 @@ int WriteAndFreeGptData(VbExDiskHandle_t disk_handle, GptData *gptdata)
 {
 	int skip_primary = 0;
 	GptHeader *header;
-	uint64_t entries_bytes, entries_sectors;
+	uint64_t entries_sectors;
 	int ret = 1;
 
 	header = (GptHeader *)gptdata->primary_header;
@@ -137,9 +385,7 @@ int WriteAndFreeGptData(VbExDiskHandle_t disk_handle, GptData *gptdata)
 	if (!header)
 		return 1;  /* No headers at all, so nothing to write */
 
-	entries_bytes = (uint64_t)header->number_of_entries
-			* header->size_of_entry;
-	entries_sectors = entries_bytes / gptdata->sector_bytes;
+	entries_sectors = CalculateEntriesSectors(header, gptdata->sector_bytes);
 
 	/*
 	 * TODO(namnguyen): Preserve padding between primary GPT header and
@@ -172,13 +418,27 @@ int WriteAndFreeGptData(VbExDiskHandle_t disk_handle, GptData *gptdata)
 	if (gptdata->primary_entries && !skip_primary) {
 		if (gptdata->modified & GPT_MODIFIED_ENTRIES1) {
 			VB2_DEBUG("Updating GPT entries 1\n");
-			if (0 != VbExDiskWrite(disk_handle, entries_lba,
-					       entries_sectors,
-					       gptdata->primary_entries))
+			if (0 != WriteGptEntries(disk_handle, gptdata,
+						 entries_lba, entries_sectors,
+						 gptdata->primary_entries,
+						 gptdata->dirty_entries1))
 				goto fail;
 		}
 	}
 
+	/*
+	 * If the secondary GPT was never read, make sure we don't overwrite
+	 * one which is meant to be ignored.
+	 */
+	if ((gptdata->deferred & MASK_SECONDARY) &&
+	    (gptdata->modified & (GPT_MODIFIED_HEADER2 |
+				  GPT_MODIFIED_ENTRIES2)) &&
+	    DeferredSecondaryIgnored(disk_handle, gptdata)) {
+		VB2_DEBUG("Not updating secondary GPT: "
+			  "marked to be ignored.\n");
+		gptdata->ignored |= MASK_SECONDARY;
+	}
+
 	entries_lba = (gptdata->gpt_drive_sectors - entries_sectors -
 		GPT_HEADER_SECTORS);
 	if (gptdata->secondary_header && !(gptdata->ignored & MASK_SECONDARY)) {
@@ -195,10 +455,18 @@ int WriteAndFreeGptData(VbExDiskHandle_t disk_handle, GptData *gptdata)
 
 	if (gptdata->secondary_entries && !(gptdata->ignored & MASK_SECONDARY)){
 		if (gptdata->modified & GPT_MODIFIED_ENTRIES2) {
+			/*
+			 * A secondary which was never read may not match the
+			 * primary anywhere, so rewrite all of it.
+			 */
+			uint32_t dirty = gptdata->deferred & MASK_SECONDARY ?
+					0 : gptdata->dirty_entries2;
+
 			VB2_DEBUG("Updating GPT entries 2\n");
-			if (0 != VbExDiskWrite(disk_handle,
-					       entries_lba, entries_sectors,
-					       gptdata->secondary_entries))
+			if (0 != WriteGptEntries(disk_handle, gptdata,
+						 entries_lba, entries_sectors,
+						 gptdata->secondary_entries,
+						 dirty))
 				goto fail;
 		}
 	}
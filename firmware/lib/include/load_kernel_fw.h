@@ -18,6 +18,10 @@ struct vb2_context;
 /* Boot flags for LoadKernel().boot_flags */
 /* GPT is external */
 #define BOOT_FLAG_EXTERNAL_GPT (0x04ULL)
+/* Check the vblock of the next candidate before loading a kernel body */
+#define BOOT_FLAG_PEEK_NEXT_VBLOCK (0x08ULL)
+/* Try the kernel which booted last time before searching the GPT */
+#define BOOT_FLAG_KERNEL_HINT (0x10ULL)
 
 struct RollbackSpaceFwmp;
 
@@ -39,6 +43,12 @@ typedef struct LoadKernelParams {
 	uint64_t boot_flags;
 	/* Firmware management parameters; may be NULL if not present. */
 	const struct RollbackSpaceFwmp *fwmp;
+	/*
+	 * If non-zero, read the kernel body in chunks of this many bytes and
+	 * hash each chunk as it arrives, instead of reading the whole body
+	 * and then hashing it.  Must be a multiple of bytes_per_lba.
+	 */
+	uint32_t body_chunk_size;
 
 	/*
 	 * Outputs from LoadKernel(); valid only if LoadKernel() returns
@@ -67,4 +77,37 @@ typedef struct LoadKernelParams {
  */
 VbError_t LoadKernel(struct vb2_context *ctx, LoadKernelParams *params);
 
+/**
+ * Rank the best kernel candidate on the current device, reading only its GPT.
+ *
+ * This lets the caller try the most promising device first, before paying to
+ * read and verify any kernel.  The GPT is not repaired or written back.
+ *
+ * @param params	Params for the device; only the inputs are used
+ *
+ * Returns 0 if the device has no candidate kernel partition.  Otherwise a
+ * higher value ranks the candidate ahead of others by priority, then by its
+ * successful flag, then by tries remaining.
+ */
+uint32_t LoadKernelRank(LoadKernelParams *params);
+
+/**
+ * Read the GPT of the current device ahead of LoadKernel().
+ *
+ * The next LoadKernel() on the same device, with the same geometry, uses this
+ * GPT instead of reading it again.  Only one GPT is held at a time, so this
+ * drops any GPT prefetched earlier.
+ *
+ * @param params	Params for the device; only the inputs are used
+ *
+ * Returns 0 if successful, 1 if error.
+ */
+int LoadKernelPrefetchGpt(LoadKernelParams *params);
+
+/**
+ * Drop the GPT read by LoadKernelPrefetchGpt(), if LoadKernel() hasn't used
+ * it.  Call this before closing the device the GPT came from.
+ */
+void LoadKernelDropGpt(void);
+
 #endif  /* VBOOT_REFERENCE_LOAD_KERNEL_FW_H_ */
@@ -111,6 +111,14 @@ enum fwmp_flags {
  * global variables.
  */
 
+/**
+ * Send the TPM reads RollbackKernelRead() and, if [read_fwmp] is non-zero,
+ * RollbackFwmpRead() start with back to back, so their round trips can
+ * overlap.  Those calls must follow, in that order.  Errors here are
+ * harmless; the calls just do their reads themselves.
+ */
+uint32_t RollbackKernelPrefetch(int read_fwmp);
+
 /**
  * Read stored kernel version.
  */
@@ -0,0 +1,81 @@
+/* Copyright 2018 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ *
+ * Per-command TPM latency statistics, kept by tlcl when built with
+ * TPM_STATS=1.
+ */
+
+#ifndef VBOOT_REFERENCE_TLCL_STATS_H_
+#define VBOOT_REFERENCE_TLCL_STATS_H_
+
+#include <stdint.h>
+
+/* Number of different command codes to keep statistics for */
+#define TLCL_MAX_COMMAND_STATS 16
+
+/* Statistics for one TPM command code */
+typedef struct TlclCommandStats {
+	/* TPM command code */
+	uint32_t command;
+	/* Number of times the command was sent */
+	uint32_t count;
+	/* Total and longest time spent in the transport, in microseconds */
+	uint32_t total_us;
+	uint32_t max_us;
+	/* Times the command was sent again because the self test was busy */
+	uint32_t selftest_retries;
+} TlclCommandStats;
+
+#ifdef TLCL_STATS
+
+/**
+ * Get the time a command is sent, to pass to TlclStatsRecord().
+ */
+uint64_t TlclStatsStart(void);
+
+/**
+ * Record that [command], sent at [start], has been answered.
+ */
+void TlclStatsRecord(uint32_t command, uint64_t start);
+
+/**
+ * Record that [command] is being sent again after TPM_E_DOING_SELFTEST or
+ * TPM_E_NEEDS_SELFTEST.
+ */
+void TlclStatsRetry(uint32_t command);
+
+/**
+ * Get the statistics recorded so far, one entry per command code, in the
+ * order the commands were first sent.  Commands beyond the first
+ * TLCL_MAX_COMMAND_STATS codes aren't recorded.
+ *
+ * @param stats		Set to the recorded statistics
+ * @return The number of entries in [stats].
+ */
+uint32_t TlclGetCommandStats(const TlclCommandStats **stats);
+
+#else
+
+static inline uint64_t TlclStatsStart(void)
+{
+	return 0;
+}
+
+static inline void TlclStatsRecord(uint32_t command, uint64_t start)
+{
+}
+
+static inline void TlclStatsRetry(uint32_t command)
+{
+}
+
+static inline uint32_t TlclGetCommandStats(const TlclCommandStats **stats)
+{
+	*stats = 0;
+	return 0;
+}
+
+#endif  /* TLCL_STATS */
+
+#endif  /* VBOOT_REFERENCE_TLCL_STATS_H_ */
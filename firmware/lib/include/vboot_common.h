@@ -138,6 +138,39 @@ uint64_t VbSharedDataReserve(VbSharedDataHeader *header, uint64_t size);
 int VbSharedDataSetKernelKey(VbSharedDataHeader *header,
                              const VbPublicKey *src);
 
+/**
+ * Append a boot timestamp to the shared data.  Does nothing if the shared
+ * data was initialized by firmware too old to have room for timestamps.
+ *
+ * Returns 0 if success, non-zero if error.
+ */
+int VbSharedDataAddTimestamp(VbSharedDataHeader *header, uint32_t event,
+			     uint32_t time_ms);
+
+/**
+ * Set a TPM command's latency statistics in the shared data.  Does nothing
+ * if the shared data was initialized by firmware too old to have room for
+ * them, or if all VBSD_MAX_TPM_STATS entries are used.
+ *
+ * Returns 0 if success, non-zero if error.
+ */
+int VbSharedDataSetTpmStats(VbSharedDataHeader *header,
+			    const VbSharedDataTpmStats *stats);
+
+/**
+ * Pack the shared data into the compact form handed to the OS.  The core is
+ * always written; each optional section is written only if its
+ * VBSD_SECTION_MASK() bit is set in [sections] and it holds something.  The
+ * result is never larger than sizeof(VbSharedDataHeader).
+ *
+ * On entry, *size is the size of [buf]; on success it is set to the number of
+ * bytes used.
+ *
+ * Returns 0 if success, non-zero if error.
+ */
+int VbSharedDataPack(const VbSharedDataHeader *header, uint32_t sections,
+		     void *buf, uint32_t *size);
+
 /**
  * Check whether recovery is allowed or not.
  *
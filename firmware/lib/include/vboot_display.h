@@ -10,6 +10,14 @@
 
 struct vb2_context;
 
+/**
+ * Tell the platform which screens this boot may display.
+ *
+ * @param ctx		Vboot context; its flags select the boot mode
+ * @param menu_ui	Non-zero if the boot uses the menu UI
+ */
+void VbDisplayPrepare(struct vb2_context *ctx, int menu_ui);
+
 VbError_t VbDisplayScreen(struct vb2_context *ctx, uint32_t screen, int force);
 VbError_t VbDisplayMenu(struct vb2_context *ctx,
 			uint32_t screen, int force, uint32_t selected_index,
@@ -82,9 +82,12 @@ uint32_t vb2_get_fwmp_flags(void);
 /**
  * Commit NvStorage.
  *
- * This may be called by UI functions which need to save settings before they
- * sit in an infinite loop waiting for shutdown (this is, by a UI state which
- * will never return).
+ * NvStorage is written once, when VbSelectAndLoadKernel() and the other entry
+ * points return.  This may also be called by UI functions which need to save
+ * settings before they sit in an infinite loop waiting for shutdown (this is,
+ * by a UI state which will never return), or before anything else which may
+ * cut power.  It only writes if ctx->nvdata differs from what the platform
+ * last read or was given, so calling it again costs nothing.
  */
 void vb2_nv_commit(struct vb2_context *ctx);
 
@@ -24,6 +24,11 @@ uint32_t TPMClearAndReenable(void)
 	return TPM_SUCCESS;
 }
 
+uint32_t RollbackKernelPrefetch(int read_fwmp)
+{
+	return TPM_SUCCESS;
+}
+
 uint32_t RollbackKernelRead(uint32_t *version)
 {
 	*version = 0;
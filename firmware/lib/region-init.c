@@ -15,6 +15,7 @@
 #include "gbb_header.h"
 #include "load_kernel_fw.h"
 #include "utility.h"
+#include "vb2_common.h"
 #include "vboot_api.h"
 #include "vboot_struct.h"
 
@@ -95,6 +96,17 @@ VbError_t VbGbbReadRootKey(struct vb2_context *ctx, VbPublicKey **keyp)
 VbError_t VbGbbReadRecoveryKey(struct vb2_context *ctx, VbPublicKey **keyp)
 {
 	struct vb2_shared_data *sd = vb2_get_sd(ctx);
+	const struct vb2_packed_key *embedded = vb2ex_embedded_recovery_key();
+	uint32_t size;
+
+	if (!embedded)
+		return VbGbbReadKey(ctx, sd->gbb->recovery_key_offset, keyp);
 
-	return VbGbbReadKey(ctx, sd->gbb->recovery_key_offset, keyp);
+	/* Callers free the key, so hand them a copy of the built-in one */
+	size = embedded->key_offset + embedded->key_size;
+	*keyp = malloc(size);
+	if (!*keyp)
+		return VBERROR_UNKNOWN;
+	memcpy(*keyp, embedded, size);
+	return VBERROR_SUCCESS;
 }
@@ -146,12 +146,14 @@ uint32_t WriteSpaceFirmware(RollbackSpaceFirmware *rsf)
 uint32_t SetVirtualDevMode(int val)
 {
 	RollbackSpaceFirmware rsf;
+	uint8_t old_flags;
 
 	VB2_DEBUG("TPM: Entering");
 	if (TPM_SUCCESS != ReadSpaceFirmware(&rsf))
 		return VBERROR_TPM_FIRMWARE_SETUP;
 
 	VB2_DEBUG("TPM: flags were 0x%02x\n", rsf.flags);
+	old_flags = rsf.flags;
 	if (val)
 		rsf.flags |= FLAG_VIRTUAL_DEV_MODE_ON;
 	else
@@ -162,6 +164,10 @@ uint32_t SetVirtualDevMode(int val)
 	 */
 	VB2_DEBUG("TPM: flags are now 0x%02x\n", rsf.flags);
 
+	/* Rewriting the same flags would only cost TPM NV wear */
+	if (rsf.flags == old_flags)
+		return VBERROR_SUCCESS;
+
 	if (TPM_SUCCESS != WriteSpaceFirmware(&rsf))
 		return VBERROR_TPM_SET_BOOT_MODE_STATE;
 
@@ -242,6 +248,11 @@ uint32_t WriteSpaceKernel(RollbackSpaceKernel *rsk)
 #ifdef DISABLE_ROLLBACK_TPM
 /* Dummy implementations which don't support TPM rollback protection */
 
+uint32_t RollbackKernelPrefetch(int read_fwmp)
+{
+	return TPM_SUCCESS;
+}
+
 uint32_t RollbackKernelRead(uint32_t* version)
 {
 	*version = 0;
@@ -266,10 +277,35 @@ uint32_t RollbackFwmpRead(struct RollbackSpaceFwmp *fwmp)
 
 #else
 
+uint32_t RollbackKernelPrefetch(int read_fwmp)
+{
+	/* Queue the same reads as ReadSpaceKernel() and RollbackFwmpRead() */
+	RETURN_ON_FAILURE(TlclBatchRead(KERNEL_NV_INDEX,
+					sizeof(RollbackSpaceKernel)));
+#ifndef TPM2_MODE
+	RETURN_ON_FAILURE(TlclBatchGetPermissions(KERNEL_NV_INDEX));
+#endif
+	if (read_fwmp)
+		RETURN_ON_FAILURE(TlclBatchRead(
+				FWMP_NV_INDEX, sizeof(struct RollbackSpaceFwmp)));
+
+	return TlclBatchSend();
+}
+
+/*
+ * Kernel space as RollbackKernelRead() last checked it, or last written.
+ * Nothing else writes the space during a boot, so RollbackKernelWrite() can
+ * start from this instead of reading it from the TPM again.
+ */
+static RollbackSpaceKernel rsk_cache;
+static int rsk_cached;
+
 uint32_t RollbackKernelRead(uint32_t* version)
 {
 	RollbackSpaceKernel rsk;
 
+	rsk_cached = 0;
+
 	/*
 	 * Read the kernel space and verify its permissions.  If the kernel
 	 * space has the wrong permission, or it doesn't contain the right
@@ -294,6 +330,9 @@ uint32_t RollbackKernelRead(uint32_t* version)
 			return TPM_E_CORRUPTED_STATE;
 	}
 #endif
+	memcpy(&rsk_cache, &rsk, sizeof(rsk_cache));
+	rsk_cached = 1;
+
 	memcpy(version, &rsk.kernel_versions, sizeof(*version));
 	VB2_DEBUG("TPM: RollbackKernelRead %x\n", (int)*version);
 	return TPM_SUCCESS;
@@ -303,12 +342,27 @@ uint32_t RollbackKernelWrite(uint32_t version)
 {
 	RollbackSpaceKernel rsk;
 	uint32_t old_version;
-	RETURN_ON_FAILURE(ReadSpaceKernel(&rsk));
+	uint32_t r;
+
+	if (rsk_cached)
+		memcpy(&rsk, &rsk_cache, sizeof(rsk));
+	else
+		RETURN_ON_FAILURE(ReadSpaceKernel(&rsk));
 	memcpy(&old_version, &rsk.kernel_versions, sizeof(old_version));
 	VB2_DEBUG("TPM: RollbackKernelWrite %x --> %x\n",
 		  (int)old_version, (int)version);
+	if (version == old_version)
+		return TPM_SUCCESS;
 	memcpy(&rsk.kernel_versions, &version, sizeof(version));
-	return WriteSpaceKernel(&rsk);
+
+	/* WriteSpaceKernel() reads the space back, so this is what it holds */
+	rsk_cached = 0;
+	r = WriteSpaceKernel(&rsk);
+	if (r == TPM_SUCCESS) {
+		memcpy(&rsk_cache, &rsk, sizeof(rsk_cache));
+		rsk_cached = 1;
+	}
+	return r;
 }
 
 uint32_t RollbackKernelLock(int recovery_mode)
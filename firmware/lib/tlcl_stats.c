@@ -0,0 +1,66 @@
+/* Copyright 2018 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ *
+ * Per-command TPM latency statistics.
+ */
+
+#include "2sysincludes.h"
+#include "tlcl_stats.h"
+#include "vboot_api.h"
+
+#ifdef TLCL_STATS
+
+static TlclCommandStats stats[TLCL_MAX_COMMAND_STATS];
+static uint32_t stats_count;
+
+static TlclCommandStats *find_stats(uint32_t command)
+{
+	uint32_t i;
+
+	for (i = 0; i < stats_count; i++) {
+		if (stats[i].command == command)
+			return stats + i;
+	}
+
+	if (stats_count == TLCL_MAX_COMMAND_STATS)
+		return NULL;
+
+	stats[stats_count].command = command;
+	return stats + stats_count++;
+}
+
+uint64_t TlclStatsStart(void)
+{
+	return VbExGetTimer();
+}
+
+void TlclStatsRecord(uint32_t command, uint64_t start)
+{
+	TlclCommandStats *s = find_stats(command);
+	uint32_t elapsed_us = VbExGetTimer() - start;
+
+	if (!s)
+		return;
+
+	s->count++;
+	s->total_us += elapsed_us;
+	if (elapsed_us > s->max_us)
+		s->max_us = elapsed_us;
+}
+
+void TlclStatsRetry(uint32_t command)
+{
+	TlclCommandStats *s = find_stats(command);
+
+	if (s)
+		s->selftest_retries++;
+}
+
+uint32_t TlclGetCommandStats(const TlclCommandStats **out)
+{
+	*out = stats;
+	return stats_count;
+}
+
+#endif  /* TLCL_STATS */
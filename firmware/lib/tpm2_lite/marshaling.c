@@ -60,7 +60,7 @@ static uint8_t unmarshal_u8(void **buffer, int *buffer_space)
 {
 	uint8_t value;
 
-	if (*buffer_space < sizeof(value)) {
+	if (*buffer_space < (int)sizeof(value)) {
 		*buffer_space = -1; /* Indicate a failure. */
 		return 0;
 	}
@@ -76,7 +76,7 @@ static uint16_t unmarshal_u16(void **buffer, int *buffer_space)
 {
 	uint16_t value;
 
-	if (*buffer_space < sizeof(value)) {
+	if (*buffer_space < (int)sizeof(value)) {
 		*buffer_space = -1; /* Indicate a failure. */
 		return 0;
 	}
@@ -92,7 +92,7 @@ static uint32_t unmarshal_u32(void **buffer, int *buffer_space)
 {
 	uint32_t value;
 
-	if (*buffer_space < sizeof(value)) {
+	if (*buffer_space < (int)sizeof(value)) {
 		*buffer_space = -1; /* Indicate a failure. */
 		return 0;
 	}
@@ -115,6 +115,9 @@ static void unmarshal_TPM2B_MAX_NV_BUFFER(void **buffer,
 	if (nv_buffer->t.size > *size) {
 		VB2_DEBUG("size mismatch: expected %d, remaining %d\n",
 			  nv_buffer->t.size, *size);
+		/* Don't leave a caller a size with no data behind it */
+		nv_buffer->t.size = 0;
+		*size = -1;
 		return;
 	}
 
@@ -219,9 +222,11 @@ static void unmarshal_nv_read_public(void **buffer, int *size,
 static void unmarshal_TPML_TAGGED_TPM_PROPERTY(void **buffer, int *size,
 					       TPML_TAGGED_TPM_PROPERTY *prop)
 {
+	uint32_t i;
+
 	prop->count = unmarshal_u32(buffer, size);
 
-	if (prop->count != 1) {
+	if (prop->count > ARRAY_SIZE(prop->tpm_property)) {
 		*size = -1;
 		VB2_DEBUG("Request to unmarshal unsupported "
 			  "number of properties: %u\n",
@@ -229,8 +234,10 @@ static void unmarshal_TPML_TAGGED_TPM_PROPERTY(void **buffer, int *size,
 		return;
 	}
 
-	prop->tpm_property[0].property = unmarshal_u32(buffer, size);
-	prop->tpm_property[0].value = unmarshal_u32(buffer, size);
+	for (i = 0; i < prop->count; i++) {
+		prop->tpm_property[i].property = unmarshal_u32(buffer, size);
+		prop->tpm_property[i].value = unmarshal_u32(buffer, size);
+	}
 }
 
 static void unmarshal_TPMS_CAPABILITY_DATA(void **buffer, int *size,
@@ -275,7 +282,7 @@ static void unmarshal_get_capability(void **buffer, int *size,
 static void marshal_blob(void **buffer, void *blob,
 			 size_t blob_size, int *buffer_space)
 {
-	if (*buffer_space < blob_size) {
+	if (*buffer_space < 0 || *buffer_space < blob_size) {
 		*buffer_space = -1;
 		return;
 	}
@@ -289,7 +296,7 @@ static void marshal_u8(void **buffer, uint8_t value, int *buffer_space)
 {
 	uint8_t *bp = *buffer;
 
-	if (*buffer_space < sizeof(value)) {
+	if (*buffer_space < (int)sizeof(value)) {
 		*buffer_space = -1;
 		return;
 	}
@@ -301,7 +308,7 @@ static void marshal_u8(void **buffer, uint8_t value, int *buffer_space)
 
 static void marshal_u16(void **buffer, uint16_t value, int *buffer_space)
 {
-	if (*buffer_space < sizeof(value)) {
+	if (*buffer_space < (int)sizeof(value)) {
 		*buffer_space = -1;
 		return;
 	}
@@ -312,7 +319,7 @@ static void marshal_u16(void **buffer, uint16_t value, int *buffer_space)
 
 static void marshal_u32(void **buffer, uint32_t value, int *buffer_space)
 {
-	if (*buffer_space < sizeof(value)) {
+	if (*buffer_space < (int)sizeof(value)) {
 		*buffer_space = -1;
 		return;
 	}
@@ -14,9 +14,56 @@
 #include "tpm2_marshaling.h"
 #include "utility.h"
 #include "tlcl.h"
+#include "tlcl_stats.h"
 
-/* Global buffer for deserialized responses. */
-struct tpm2_response tpm2_resp;
+/*
+ * Buffer for deserialized responses.  Payloads such as NV read data aren't
+ * copied out of the response; they point into the command/response buffer in
+ * tpm_get_response(), so they're only good until the next command.
+ */
+static struct tpm2_response tpm2_resp;
+
+/*
+ * TPM_PT_* property ranges fetched with one TPM2_GetCapability each and kept
+ * until something may have changed them.  Fixed properties last until
+ * TlclLibInit(); the permanent and startup-clear flags are dropped by any
+ * command other than a pure query (see tpm_invalidate_properties()).
+ */
+struct tpm_property_cache {
+	TPM_PT first;
+	uint32_t count;
+	int valid;
+	TPML_TAGGED_TPM_PROPERTY props;
+};
+
+static struct tpm_property_cache fixed_props = {
+	.first = TPM_PT_MANUFACTURER,
+	.count = TPM_PT_FIRMWARE_VERSION_2 - TPM_PT_MANUFACTURER + 1,
+};
+
+static struct tpm_property_cache var_props = {
+	.first = TPM_PT_PERMANENT,
+	.count = TPM_PT_STARTUP_CLEAR - TPM_PT_PERMANENT + 1,
+};
+
+/*
+ * Drops the cached flags unless [command] only queries the TPM.  Anything
+ * else, including failed authorizations counting towards lockout, can change
+ * TPM_PT_PERMANENT or TPM_PT_STARTUP_CLEAR.
+ */
+static void tpm_invalidate_properties(TPM_CC command)
+{
+	switch (command) {
+	case TPM2_GetCapability:
+	case TPM2_NV_ReadPublic:
+		break;
+	default:
+		var_props.valid = 0;
+	}
+}
+
+/* Set once TlclStartSelfTest() has the self test running */
+static int selftest_started;
 
 /*
  * Serializes and sends the command, gets back the response and
@@ -32,13 +79,15 @@ struct tpm2_response tpm2_resp;
  *   - if the received response was successfully unmarshaled, returns success
  *     regardless of the received response code.
  */
-static uint32_t tpm_get_response(TPM_CC command,
-				 void *command_body,
-				 struct tpm2_response *response)
+static uint32_t tpm_exchange(TPM_CC command,
+			     void *command_body,
+			     struct tpm2_response *response)
 {
 	/* Command/response buffer. */
 	static uint8_t cr_buffer[TPM_BUFFER_SIZE];
-	uint32_t out_size, in_size, res;
+	int out_size;
+	uint32_t in_size, res;
+	uint64_t start;
 
 	out_size = tpm_marshal_command(command, command_body,
 				       cr_buffer, sizeof(cr_buffer));
@@ -47,8 +96,12 @@ static uint32_t tpm_get_response(TPM_CC command,
 		return TPM_E_WRITE_FAILURE;
 	}
 
+	tpm_invalidate_properties(command);
+
 	in_size = sizeof(cr_buffer);
+	start = TlclStatsStart();
 	res = VbExTpmSendReceive(cr_buffer, out_size, cr_buffer, &in_size);
+	TlclStatsRecord(command, start);
 	if (res != TPM_SUCCESS) {
 		VB2_DEBUG("tpm transaction failed for %#x with error %#x\n",
 		          command, res);
@@ -66,6 +119,28 @@ static uint32_t tpm_get_response(TPM_CC command,
 	return TPM_SUCCESS;
 }
 
+/*
+ * Same as tpm_exchange(), but if a self test started by TlclStartSelfTest()
+ * is still running, waits for it by sending the command again for as long as
+ * the TPM answers TPM_RC_TESTING.
+ */
+static uint32_t tpm_get_response(TPM_CC command,
+				 void *command_body,
+				 struct tpm2_response *response)
+{
+	uint32_t rv;
+
+	for (;;) {
+		rv = tpm_exchange(command, command_body, response);
+		if (rv != TPM_SUCCESS || !selftest_started ||
+		    command == TPM2_SelfTest ||
+		    response->hdr.tpm_code != TPM_RC_TESTING)
+			return rv;
+
+		TlclStatsRetry(command);
+	}
+}
+
 /*
  * Same as tpm_get_response() but, if the response was successfully received,
  * returns the received response code. The set of errors returned by the
@@ -114,6 +189,9 @@ uint32_t TlclLibInit(void)
 	if (rv != TPM_SUCCESS)
 		return rv;
 
+	fixed_props.valid = 0;
+	var_props.valid = 0;
+
 	rv = tlcl_read_ph_disabled();
 	if (rv != TPM_SUCCESS)
 		TlclLibClose();
@@ -131,6 +209,9 @@ uint32_t TlclSendReceive(const uint8_t *request, uint8_t *response,
 {
 	uint32_t rv, resp_size;
 
+	/* Don't look inside raw commands; assume they change the flags */
+	var_props.valid = 0;
+
 	resp_size = max_length;
 	rv = VbExTpmSendReceive(request, tpm_get_packet_size(request),
 				response, &resp_size);
@@ -188,6 +269,19 @@ uint32_t TlclContinueSelfTest(void)
 	return tpm_get_response_code(TPM2_SelfTest, &self_test);
 }
 
+uint32_t TlclStartSelfTest(void)
+{
+	uint32_t rv = TlclContinueSelfTest();
+
+	/* TPM_RC_TESTING here just means the tests run in the background */
+	if (rv == TPM_RC_TESTING)
+		rv = TPM_SUCCESS;
+	if (rv == TPM_SUCCESS)
+		selftest_started = 1;
+
+	return rv;
+}
+
 uint32_t TlclDefineSpace(uint32_t index, uint32_t perm, uint32_t size)
 {
 	return TlclDefineSpaceEx(NULL, 0, index, perm, size, NULL, 0);
@@ -313,6 +407,25 @@ uint32_t TlclGetPermissions(uint32_t index, uint32_t *permissions)
 	return rv;
 }
 
+/*
+ * Batching isn't supported yet, so queued commands are simply dropped and
+ * the calls they stand in for go to the TPM as usual.
+ */
+uint32_t TlclBatchRead(uint32_t index, uint32_t length)
+{
+	return TPM_SUCCESS;
+}
+
+uint32_t TlclBatchGetPermissions(uint32_t index)
+{
+	return TPM_SUCCESS;
+}
+
+uint32_t TlclBatchSend(void)
+{
+	return TPM_SUCCESS;
+}
+
 uint32_t TlclGetSpaceInfo(uint32_t index, uint32_t *attributes, uint32_t *size,
                           void* auth_policy, uint32_t* auth_policy_size)
 {
@@ -337,6 +450,7 @@ uint32_t TlclGetSpaceInfo(uint32_t index, uint32_t *attributes, uint32_t *size,
 }
 
 static uint32_t tlcl_get_capability(TPM_CAP cap, TPM_PT property,
+				    uint32_t property_count,
 				    struct get_capability_response **presp)
 {
 	struct tpm2_response *response = &tpm2_resp;
@@ -345,7 +459,7 @@ static uint32_t tlcl_get_capability(TPM_CAP cap, TPM_PT property,
 
 	getcap.capability = cap;
 	getcap.property = property;
-	getcap.property_count = 1;
+	getcap.property_count = property_count;
 
 	rv = tpm_send_receive(TPM2_GetCapability, &getcap, response);
 	if (rv == TPM_SUCCESS)
@@ -354,13 +468,18 @@ static uint32_t tlcl_get_capability(TPM_CAP cap, TPM_PT property,
 	return rv;
 }
 
-static uint32_t tlcl_get_tpm_property(TPM_PT property, uint32_t *pvalue)
+/*
+ * Reads up to [count] TPM properties starting at [first] into [props].  The
+ * TPM leaves out the ones it doesn't implement.
+ */
+static uint32_t tlcl_get_tpm_properties(TPM_PT first, uint32_t count,
+					TPML_TAGGED_TPM_PROPERTY *props)
 {
-	uint32_t rv;
+	uint32_t rv, i;
 	struct get_capability_response *resp;
 	TPML_TAGGED_TPM_PROPERTY *tpm_prop;
 
-	rv = tlcl_get_capability(TPM_CAP_TPM_PROPERTIES, property, &resp);
+	rv = tlcl_get_capability(TPM_CAP_TPM_PROPERTIES, first, count, &resp);
 	if (rv != TPM_SUCCESS)
 		return rv;
 
@@ -369,14 +488,54 @@ static uint32_t tlcl_get_tpm_property(TPM_PT property, uint32_t *pvalue)
 
 	tpm_prop = &resp->capability_data.data.tpm_properties;
 
-	if ((tpm_prop->count != 1) ||
-	    (tpm_prop->tpm_property[0].property != property))
+	if (tpm_prop->count > count)
 		return TPM_E_IOERROR;
+	for (i = 0; i < tpm_prop->count; i++) {
+		if (tpm_prop->tpm_property[i].property - first >= count)
+			return TPM_E_IOERROR;
+	}
 
-	*pvalue = tpm_prop->tpm_property[0].value;
+	memcpy(props, tpm_prop, sizeof(*props));
 	return TPM_SUCCESS;
 }
 
+static uint32_t tlcl_get_tpm_property(TPM_PT property, uint32_t *pvalue)
+{
+	struct tpm_property_cache *cache = NULL;
+	TPML_TAGGED_TPM_PROPERTY one;
+	TPML_TAGGED_TPM_PROPERTY *props = &one;
+	uint32_t rv, i;
+
+	if (property - fixed_props.first < fixed_props.count)
+		cache = &fixed_props;
+	else if (property - var_props.first < var_props.count)
+		cache = &var_props;
+
+	if (cache) {
+		props = &cache->props;
+		if (!cache->valid) {
+			rv = tlcl_get_tpm_properties(cache->first,
+						     cache->count, props);
+			if (rv != TPM_SUCCESS)
+				return rv;
+			cache->valid = 1;
+		}
+	} else {
+		rv = tlcl_get_tpm_properties(property, 1, props);
+		if (rv != TPM_SUCCESS)
+			return rv;
+	}
+
+	for (i = 0; i < props->count; i++) {
+		if (props->tpm_property[i].property == property) {
+			*pvalue = props->tpm_property[i].value;
+			return TPM_SUCCESS;
+		}
+	}
+
+	return TPM_E_IOERROR;
+}
+
 uint32_t TlclGetPermanentFlags(TPM_PERMANENT_FLAGS *pflags)
 {
 	return tlcl_get_tpm_property(TPM_PT_PERMANENT,
@@ -462,7 +621,35 @@ uint32_t TlclLockPhysicalPresence(void)
 	return tlcl_disable_platform_hierarchy();
 }
 
-uint32_t TlclRead(uint32_t index, void* data, uint32_t length)
+/*
+ * Most NV data to send or receive in one command.  The rest of an NV_Read
+ * response or NV_Write command fits in what's left of the command/response
+ * buffer.
+ */
+#define NV_CHUNK_MAX (TPM_BUFFER_SIZE - 64)
+
+/*
+ * Returns how many bytes of a [length]-byte NV read or write to do per
+ * command.  Only I/O that doesn't fit in one command asks the TPM for its
+ * limit, so the usual small reads don't cost an extra round trip.
+ */
+static uint32_t tlcl_nv_chunk_size(uint32_t length)
+{
+	static uint32_t nv_buffer_max;
+
+	if (length <= NV_CHUNK_MAX)
+		return length;
+
+	if (!nv_buffer_max &&
+	    (tlcl_get_tpm_property(TPM_PT_NV_BUFFER_MAX, &nv_buffer_max) ||
+	     !nv_buffer_max))
+		nv_buffer_max = NV_CHUNK_MAX;
+
+	return nv_buffer_max < NV_CHUNK_MAX ? nv_buffer_max : NV_CHUNK_MAX;
+}
+
+static uint32_t tlcl_nv_read(uint32_t index, uint32_t offset,
+			     void *data, uint32_t length)
 {
 	struct tpm2_nv_read_cmd nv_readc;
 	struct tpm2_response *response = &tpm2_resp;
@@ -472,6 +659,7 @@ uint32_t TlclRead(uint32_t index, void* data, uint32_t length)
 
 	nv_readc.nvIndex = HR_NV_INDEX + index;
 	nv_readc.size = length;
+	nv_readc.offset = offset;
 
 	rv = tpm_send_receive(TPM2_NV_Read, &nv_readc, response);
 
@@ -498,17 +686,49 @@ uint32_t TlclRead(uint32_t index, void* data, uint32_t length)
 	return TPM_SUCCESS;
 }
 
+uint32_t TlclRead(uint32_t index, void* data, uint32_t length)
+{
+	uint32_t chunk = tlcl_nv_chunk_size(length);
+	uint32_t offset = 0;
+	uint32_t rv;
+
+	do {
+		uint32_t size = length - offset < chunk ?
+				length - offset : chunk;
+
+		rv = tlcl_nv_read(index, offset, (uint8_t *)data + offset,
+				  size);
+		if (rv != TPM_SUCCESS)
+			return rv;
+		offset += size;
+	} while (offset < length);
+
+	return TPM_SUCCESS;
+}
+
 uint32_t TlclWrite(uint32_t index, const void *data, uint32_t length)
 {
 	struct tpm2_nv_write_cmd nv_writec;
+	uint32_t chunk = tlcl_nv_chunk_size(length);
+	uint32_t offset = 0;
+	uint32_t rv;
 
-	memset(&nv_writec, 0, sizeof(nv_writec));
+	do {
+		memset(&nv_writec, 0, sizeof(nv_writec));
 
-	nv_writec.nvIndex = HR_NV_INDEX + index;
-	nv_writec.data.t.size = length;
-	nv_writec.data.t.buffer = data;
+		nv_writec.nvIndex = HR_NV_INDEX + index;
+		nv_writec.data.t.size = length - offset < chunk ?
+					length - offset : chunk;
+		nv_writec.data.t.buffer = (const uint8_t *)data + offset;
+		nv_writec.offset = offset;
 
-	return tpm_get_response_code(TPM2_NV_Write, &nv_writec);
+		rv = tpm_get_response_code(TPM2_NV_Write, &nv_writec);
+		if (rv != TPM_SUCCESS)
+			return rv;
+		offset += nv_writec.data.t.size;
+	} while (offset < length);
+
+	return TPM_SUCCESS;
 }
 
 uint32_t TlclPCRRead(uint32_t index, void *data, uint32_t length)
@@ -11,6 +11,12 @@ const struct s_tpm_create_delegation_family_cmd{
 } tpm_create_delegation_family_cmd = {{0x0, 0xc1, 0x0, 0x0, 0x0, 0x17, 0x0, 0x0, 0x0, 0xd2, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x1, 0x0, 0x0, 0x0, 0x1, },
 22, };
 
+static inline uint8_t* tpm_create_delegation_family_cmd_build(uint8_t* buffer) {
+  memcpy(buffer, tpm_create_delegation_family_cmd.buffer, 22);
+  memset(buffer + 22, 0, 1);
+  return buffer;
+}
+
 const struct s_tpm_takeownership_cmd{
   uint8_t buffer[624];
   uint16_t encOwnerAuth;
@@ -18,6 +24,12 @@ const struct s_tpm_takeownership_cmd{
 } tpm_takeownership_cmd = {{0x0, 0xc2, 0x0, 0x0, 0x2, 0x70, 0x0, 0x0, 0x0, 0xd, 0x0, 0x5, 0x0, 0x0, 0x1, 0x0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0x0, 0x0, 0x1, 0x0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0x0, 0x28, 0x0, 0x0, 0x0, 0x11, 0x0, 0x0, 0x0, 0x0, 0x1, 0x0, 0x0, 0x0, 0x1, 0x0, 0x3, 0x0, 0x1, 0x0, 0x0, 0x0, 0xc, 0x0, 0x0, 0x8, 0x0, 0x0, 0x0, 0x0, 0x2, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, },
 16, 276, };
 
+static inline uint8_t* tpm_takeownership_cmd_build(uint8_t* buffer) {
+  memcpy(buffer, tpm_takeownership_cmd.buffer, 579);
+  memset(buffer + 579, 0, 45);
+  return buffer;
+}
+
 const struct s_tpm_osap_cmd{
   uint8_t buffer[36];
   uint16_t entityType;
@@ -26,6 +38,12 @@ const struct s_tpm_osap_cmd{
 } tpm_osap_cmd = {{0x0, 0xc1, 0x0, 0x0, 0x0, 0x24, 0x0, 0x0, 0x0, 0xb, },
 10, 12, 16, };
 
+static inline uint8_t* tpm_osap_cmd_build(uint8_t* buffer) {
+  memcpy(buffer, tpm_osap_cmd.buffer, 10);
+  memset(buffer + 10, 0, 26);
+  return buffer;
+}
+
 const struct s_tpm_oiap_cmd{
   uint8_t buffer[10];
 } tpm_oiap_cmd = {{0x0, 0xc1, 0x0, 0x0, 0x0, 0xa, 0x0, 0x0, 0x0, 0xa, },
@@ -48,12 +66,24 @@ const struct s_tpm_extend_cmd{
 } tpm_extend_cmd = {{0x0, 0xc1, 0x0, 0x0, 0x0, 0x22, 0x0, 0x0, 0x0, 0x14, },
 10, 14, };
 
+static inline uint8_t* tpm_extend_cmd_build(uint8_t* buffer) {
+  memcpy(buffer, tpm_extend_cmd.buffer, 10);
+  memset(buffer + 10, 0, 24);
+  return buffer;
+}
+
 const struct s_tpm_get_random_cmd{
   uint8_t buffer[14];
   uint16_t bytesRequested;
 } tpm_get_random_cmd = {{0x0, 0xc1, 0x0, 0x0, 0x0, 0xe, 0x0, 0x0, 0x0, 0x46, },
 10, };
 
+static inline uint8_t* tpm_get_random_cmd_build(uint8_t* buffer) {
+  memcpy(buffer, tpm_get_random_cmd.buffer, 10);
+  memset(buffer + 10, 0, 4);
+  return buffer;
+}
+
 const struct s_tpm_getownership_cmd{
   uint8_t buffer[22];
 } tpm_getownership_cmd = {{0x0, 0xc1, 0x0, 0x0, 0x0, 0x16, 0x0, 0x0, 0x0, 0x65, 0x0, 0x0, 0x0, 0x5, 0x0, 0x0, 0x0, 0x4, 0x0, 0x0, 0x1, 0x11, },
@@ -65,6 +95,12 @@ const struct s_tpm_getspaceinfo_cmd{
 } tpm_getspaceinfo_cmd = {{0x0, 0xc1, 0x0, 0x0, 0x0, 0x16, 0x0, 0x0, 0x0, 0x65, 0x0, 0x0, 0x0, 0x11, 0x0, 0x0, 0x0, 0x4, },
 18, };
 
+static inline uint8_t* tpm_getspaceinfo_cmd_build(uint8_t* buffer) {
+  memcpy(buffer, tpm_getspaceinfo_cmd.buffer, 18);
+  memset(buffer + 18, 0, 4);
+  return buffer;
+}
+
 const struct s_tpm_getstclearflags_cmd{
   uint8_t buffer[22];
 } tpm_getstclearflags_cmd = {{0x0, 0xc1, 0x0, 0x0, 0x0, 0x16, 0x0, 0x0, 0x0, 0x65, 0x0, 0x0, 0x0, 0x4, 0x0, 0x0, 0x0, 0x4, 0x0, 0x0, 0x1, 0x9, },
@@ -81,6 +117,12 @@ const struct s_tpm_physicalsetdeactivated_cmd{
 } tpm_physicalsetdeactivated_cmd = {{0x0, 0xc1, 0x0, 0x0, 0x0, 0xb, 0x0, 0x0, 0x0, 0x72, },
 10, };
 
+static inline uint8_t* tpm_physicalsetdeactivated_cmd_build(uint8_t* buffer) {
+  memcpy(buffer, tpm_physicalsetdeactivated_cmd.buffer, 10);
+  memset(buffer + 10, 0, 1);
+  return buffer;
+}
+
 const struct s_tpm_physicalenable_cmd{
   uint8_t buffer[10];
 } tpm_physicalenable_cmd = {{0x0, 0xc1, 0x0, 0x0, 0x0, 0xa, 0x0, 0x0, 0x0, 0x6f, },
@@ -102,6 +144,12 @@ const struct s_tpm_readpubek_cmd{
 } tpm_readpubek_cmd = {{0x0, 0xc1, 0x0, 0x0, 0x0, 0x1e, 0x0, 0x0, 0x0, 0x7c, },
 10, };
 
+static inline uint8_t* tpm_readpubek_cmd_build(uint8_t* buffer) {
+  memcpy(buffer, tpm_readpubek_cmd.buffer, 10);
+  memset(buffer + 10, 0, 20);
+  return buffer;
+}
+
 const struct s_tpm_continueselftest_cmd{
   uint8_t buffer[10];
 } tpm_continueselftest_cmd = {{0x0, 0xc1, 0x0, 0x0, 0x0, 0xa, 0x0, 0x0, 0x0, 0x53, },
@@ -153,6 +201,12 @@ const struct s_tpm_pcr_read_cmd{
 } tpm_pcr_read_cmd = {{0x0, 0xc1, 0x0, 0x0, 0x0, 0xe, 0x0, 0x0, 0x0, 0x15, },
 10, };
 
+static inline uint8_t* tpm_pcr_read_cmd_build(uint8_t* buffer) {
+  memcpy(buffer, tpm_pcr_read_cmd.buffer, 10);
+  memset(buffer + 10, 0, 4);
+  return buffer;
+}
+
 const struct s_tpm_nv_read_cmd{
   uint8_t buffer[22];
   uint16_t index;
@@ -160,6 +214,12 @@ const struct s_tpm_nv_read_cmd{
 } tpm_nv_read_cmd = {{0x0, 0xc1, 0x0, 0x0, 0x0, 0x16, 0x0, 0x0, 0x0, 0xcf, },
 10, 18, };
 
+static inline uint8_t* tpm_nv_read_cmd_build(uint8_t* buffer) {
+  memcpy(buffer, tpm_nv_read_cmd.buffer, 10);
+  memset(buffer + 10, 0, 12);
+  return buffer;
+}
+
 const struct s_tpm_nv_write_cmd{
   uint8_t buffer[256];
   uint16_t index;
@@ -168,6 +228,12 @@ const struct s_tpm_nv_write_cmd{
 } tpm_nv_write_cmd = {{0x0, 0xc1, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0xcd, },
 10, 18, 22, };
 
+static inline uint8_t* tpm_nv_write_cmd_build(uint8_t* buffer) {
+  memcpy(buffer, tpm_nv_write_cmd.buffer, 10);
+  memset(buffer + 10, 0, 12);
+  return buffer;
+}
+
 const struct s_tpm_nv_definespace_cmd{
   uint8_t buffer[101];
   uint16_t index;
@@ -178,4 +244,10 @@ const struct s_tpm_nv_definespace_cmd{
 } tpm_nv_definespace_cmd = {{0x0, 0xc1, 0x0, 0x0, 0x0, 0x65, 0x0, 0x0, 0x0, 0xcc, 0x0, 0x18, 0, 0, 0, 0, 0x0, 0x3, 0, 0, 0, 0x1f, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0x0, 0x3, 0, 0, 0, 0x1f, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0x0, 0x17, },
 12, 16, 42, 70, 77, };
 
+static inline uint8_t* tpm_nv_definespace_cmd_build(uint8_t* buffer) {
+  memcpy(buffer, tpm_nv_definespace_cmd.buffer, 70);
+  memset(buffer + 70, 0, 31);
+  return buffer;
+}
+
 const int kWriteInfoLength = 12;
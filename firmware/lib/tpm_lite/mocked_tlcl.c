@@ -45,6 +45,11 @@ uint32_t TlclContinueSelfTest(void)
 	return TPM_SUCCESS;
 }
 
+uint32_t TlclStartSelfTest(void)
+{
+	return TPM_SUCCESS;
+}
+
 uint32_t TlclDefineSpace(uint32_t index, uint32_t perm, uint32_t size)
 {
 	return TPM_SUCCESS;
@@ -172,6 +177,21 @@ uint32_t TlclGetPermissions(uint32_t index, uint32_t* permissions)
 	return TPM_SUCCESS;
 }
 
+uint32_t TlclBatchRead(uint32_t index, uint32_t length)
+{
+	return TPM_SUCCESS;
+}
+
+uint32_t TlclBatchGetPermissions(uint32_t index)
+{
+	return TPM_SUCCESS;
+}
+
+uint32_t TlclBatchSend(void)
+{
+	return TPM_SUCCESS;
+}
+
 uint32_t TlclGetOwnership(uint8_t* owned)
 {
 	*owned = 0;
@@ -11,7 +11,8 @@
  * the fields at run time as needed.  The code in
  * utility/tlcl_generator.c builds structures containing the commands,
  * as well as the offsets of the fields that need to be set at run
- * time.
+ * time, and helpers which copy a command into a buffer so those
+ * fields can be set in place.
  */
 
 #include "2sysincludes.h"
@@ -22,6 +23,7 @@
 #include "sysincludes.h"
 #include "tlcl.h"
 #include "tlcl_internal.h"
+#include "tlcl_stats.h"
 #include "tlcl_structures.h"
 #include "utility.h"
 #include "vboot_api.h"
@@ -61,15 +63,79 @@ static inline int TpmReturnCode(const uint8_t* buffer)
 	return TpmCommandCode(buffer);
 }
 
+/* Most commands TlclBatchSend() sends at once */
+#define BATCH_MAX 3
+
+/* A command queued by TlclBatchRead() or TlclBatchGetPermissions() */
+struct batch_command {
+	uint8_t request[sizeof(tpm_nv_read_cmd.buffer)];
+	uint8_t response[TPM_LARGE_ENOUGH_COMMAND_SIZE];
+	uint32_t response_length;
+	VbError_t result;
+};
+
+static struct batch_command batch[BATCH_MAX];
+static int batch_count;  /* Commands queued */
+static int batch_sent;  /* Non-zero once the queued commands are sent */
+static int batch_next;  /* Next sent command whose response is unused */
+
+__attribute__((weak))
+VbError_t VbExTpmSendReceiveMulti(VbTpmCommand *commands, uint32_t count)
+{
+	uint32_t i;
+
+	for (i = 0; i < count; i++)
+		commands[i].result = VbExTpmSendReceive(
+				commands[i].request, commands[i].request_length,
+				commands[i].response, &commands[i].response_length);
+
+	return VBERROR_SUCCESS;
+}
+
+/* Looks for the response to [request] in the last batch.  Returns it, or NULL
+ * if the batch doesn't have it; in that case the rest of the batch is dropped,
+ * since [request] may change what it read.
+ */
+static const struct batch_command* TakeBatchResponse(const uint8_t* request)
+{
+	const struct batch_command* b;
+
+	if (!batch_sent || batch_next >= batch_count)
+		return NULL;
+
+	b = batch + batch_next;
+	if (TpmCommandSize(request) != TpmCommandSize(b->request) ||
+	    memcmp(request, b->request, TpmCommandSize(request))) {
+		batch_next = batch_count;
+		return NULL;
+	}
+
+	batch_next++;
+	return b;
+}
+
+/* Set once TlclStartSelfTest() has the self test running */
+static int selftest_started;
+
 /* Like TlclSendReceive below, but do not retry if NEEDS_SELFTEST or
  * DOING_SELFTEST errors are returned.
  */
 static uint32_t TlclSendReceiveNoRetry(const uint8_t* request,
                                        uint8_t* response, int max_length)
 {
-
+	const struct batch_command* b = TakeBatchResponse(request);
 	uint32_t response_length = max_length;
 	uint32_t result;
+	uint64_t start;
+
+	/* Use the response from the batch if it arrived */
+	if (b && b->result == 0 && b->response_length <= (uint32_t)max_length) {
+		memcpy(response, b->response, b->response_length);
+		result = TpmReturnCode(response);
+		VB2_DEBUG("TPM: batched command 0x%x returned 0x%x\n",
+			  TpmCommandCode(request), result);
+		return result;
+	}
 
 #ifdef EXTRA_LOGGING
 	VB2_DEBUG("TPM: command: %x%x %x%x%x%x %x%x%x%x\n",
@@ -78,8 +144,10 @@ static uint32_t TlclSendReceiveNoRetry(const uint8_t* request,
 		  request[6], request[7], request[8], request[9]);
 #endif
 
+	start = TlclStatsStart();
 	result = VbExTpmSendReceive(request, TpmCommandSize(request),
 				    response, &response_length);
+	TlclStatsRecord(TpmCommandCode(request), start);
 	if (0 != result) {
 		/* Communication with TPM failed, so response is garbage */
 		VB2_DEBUG("TPM: command 0x%x send/receive failed: 0x%x\n",
@@ -119,12 +187,16 @@ uint32_t TlclSendReceive(const uint8_t* request, uint8_t* response,
 	/* If the command fails because the self test has not completed, try it
 	 * again after attempting to ensure that the self test has completed. */
 	if (result == TPM_E_NEEDS_SELFTEST || result == TPM_E_DOING_SELFTEST) {
-		result = TlclContinueSelfTest();
-		if (result != TPM_SUCCESS) {
-			return result;
+		/* A self test started early is already running; just wait */
+		if (!selftest_started || result == TPM_E_NEEDS_SELFTEST) {
+			result = TlclContinueSelfTest();
+			if (result != TPM_SUCCESS) {
+				return result;
+			}
 		}
 #if defined(TPM_BLOCKING_CONTINUESELFTEST) || defined(VB_RECOVERY_MODE)
 		/* Retry only once */
+		TlclStatsRetry(TpmCommandCode(request));
 		result = TlclSendReceiveNoRetry(request, response, max_length);
 #else
 		/* This needs serious testing.  The TPM specification says:
@@ -134,6 +206,7 @@ uint32_t TlclSendReceive(const uint8_t* request, uint8_t* response,
 		 * do we know that the actions have completed other than trying
 		 * again? */
 		do {
+			TlclStatsRetry(TpmCommandCode(request));
 			result = TlclSendReceiveNoRetry(request, response,
 							max_length);
 		} while (result == TPM_E_DOING_SELFTEST);
@@ -201,19 +274,18 @@ static uint32_t StartOSAPSession(
 	session->valid = 0;
 
 	/* Build OSAP command. */
-	struct s_tpm_osap_cmd cmd;
-	memcpy(&cmd, &tpm_osap_cmd, sizeof(cmd));
-	ToTpmUint16(cmd.buffer + cmd.entityType, entity_type);
-	ToTpmUint32(cmd.buffer + cmd.entityValue, entity_value);
-	if (VbExTpmGetRandom(cmd.buffer + cmd.nonceOddOSAP,
+	uint8_t cmd[sizeof(tpm_osap_cmd.buffer)];
+	tpm_osap_cmd_build(cmd);
+	ToTpmUint16(cmd + tpm_osap_cmd.entityType, entity_type);
+	ToTpmUint32(cmd + tpm_osap_cmd.entityValue, entity_value);
+	if (VbExTpmGetRandom(cmd + tpm_osap_cmd.nonceOddOSAP,
 			     sizeof(TPM_NONCE)) != VB2_SUCCESS) {
 		return TPM_E_INTERNAL_ERROR;
 	}
 
 	/* Send OSAP command. */
 	uint8_t response[TPM_LARGE_ENOUGH_COMMAND_SIZE];
-	uint32_t result = TlclSendReceive(cmd.buffer, response,
-					  sizeof(response));
+	uint32_t result = TlclSendReceive(cmd, response, sizeof(response));
 	if (result != TPM_SUCCESS) {
 		return result;
 	}
@@ -237,7 +309,7 @@ static uint32_t StartOSAPSession(
 	/* Compute shared secret */
 	uint8_t hmac_input[2 * sizeof(TPM_NONCE)];
 	memcpy(hmac_input, nonce_even_osap, sizeof(TPM_NONCE));
-	memcpy(hmac_input + sizeof(TPM_NONCE), cmd.buffer + cmd.nonceOddOSAP,
+	memcpy(hmac_input + sizeof(TPM_NONCE), cmd + tpm_osap_cmd.nonceOddOSAP,
 	       sizeof(TPM_NONCE));
 	if (hmac(VB2_HASH_SHA1, entity_usage_auth, TPM_AUTH_DATA_LEN,
 		 hmac_input, sizeof(hmac_input), session->shared_secret,
@@ -433,6 +505,19 @@ uint32_t TlclContinueSelfTest(void)
 				      response, sizeof(response));
 }
 
+uint32_t TlclStartSelfTest(void)
+{
+	uint32_t result;
+
+	VB2_DEBUG("TPM: Start self test\n");
+	result = TlclContinueSelfTest();
+	if (result == TPM_E_DOING_SELFTEST)
+		result = TPM_SUCCESS;
+	if (result == TPM_SUCCESS)
+		selftest_started = 1;
+	return result;
+}
+
 uint32_t TlclDefineSpace(uint32_t index, uint32_t perm, uint32_t size)
 {
 	VB2_DEBUG("TPM: TlclDefineSpace(0x%x, 0x%x, %d)\n", index, perm, size);
@@ -448,7 +533,7 @@ uint32_t TlclDefineSpaceEx(const uint8_t* owner_auth, uint32_t owner_auth_size,
 	/* Build the request data. */
 	uint8_t cmd[sizeof(tpm_nv_definespace_cmd.buffer) +
 			kTpmRequestAuthBlockLength];
-	memcpy(cmd, &tpm_nv_definespace_cmd, sizeof(tpm_nv_definespace_cmd));
+	tpm_nv_definespace_cmd_build(cmd);
 	ToTpmUint32(cmd + tpm_nv_definespace_cmd.index, index);
 	ToTpmUint32(cmd + tpm_nv_definespace_cmd.perm, perm);
 	ToTpmUint32(cmd + tpm_nv_definespace_cmd.size, size);
@@ -599,35 +684,35 @@ uint32_t TlclInitNvAuthPolicy(uint32_t pcr_selection_bitmap,
 
 uint32_t TlclWrite(uint32_t index, const void* data, uint32_t length)
 {
-	struct s_tpm_nv_write_cmd cmd;
+	uint8_t cmd[sizeof(tpm_nv_write_cmd.buffer)];
 	uint8_t response[TPM_LARGE_ENOUGH_COMMAND_SIZE];
 	const int total_length =
 			kTpmRequestHeaderLength + kWriteInfoLength + length;
 
 	VB2_DEBUG("TPM: TlclWrite(0x%x, %d)\n", index, length);
-	memcpy(&cmd, &tpm_nv_write_cmd, sizeof(cmd));
 	VbAssert(total_length <= TPM_LARGE_ENOUGH_COMMAND_SIZE);
-	SetTpmCommandSize(cmd.buffer, total_length);
+	tpm_nv_write_cmd_build(cmd);
+	SetTpmCommandSize(cmd, total_length);
 
-	ToTpmUint32(cmd.buffer + tpm_nv_write_cmd.index, index);
-	ToTpmUint32(cmd.buffer + tpm_nv_write_cmd.length, length);
-	memcpy(cmd.buffer + tpm_nv_write_cmd.data, data, length);
+	ToTpmUint32(cmd + tpm_nv_write_cmd.index, index);
+	ToTpmUint32(cmd + tpm_nv_write_cmd.length, length);
+	memcpy(cmd + tpm_nv_write_cmd.data, data, length);
 
-	return TlclSendReceive(cmd.buffer, response, sizeof(response));
+	return TlclSendReceive(cmd, response, sizeof(response));
 }
 
 uint32_t TlclRead(uint32_t index, void* data, uint32_t length)
 {
-	struct s_tpm_nv_read_cmd cmd;
+	uint8_t cmd[sizeof(tpm_nv_read_cmd.buffer)];
 	uint8_t response[TPM_LARGE_ENOUGH_COMMAND_SIZE];
 	uint32_t result;
 
 	VB2_DEBUG("TPM: TlclRead(0x%x, %d)\n", index, length);
-	memcpy(&cmd, &tpm_nv_read_cmd, sizeof(cmd));
-	ToTpmUint32(cmd.buffer + tpm_nv_read_cmd.index, index);
-	ToTpmUint32(cmd.buffer + tpm_nv_read_cmd.length, length);
+	tpm_nv_read_cmd_build(cmd);
+	ToTpmUint32(cmd + tpm_nv_read_cmd.index, index);
+	ToTpmUint32(cmd + tpm_nv_read_cmd.length, length);
 
-	result = TlclSendReceive(cmd.buffer, response, sizeof(response));
+	result = TlclSendReceive(cmd, response, sizeof(response));
 	if (result == TPM_SUCCESS && length > 0) {
 		const uint8_t* nv_read_cursor =
 				response + kTpmResponseHeaderLength;
@@ -640,9 +725,93 @@ uint32_t TlclRead(uint32_t index, void* data, uint32_t length)
 	return result;
 }
 
+static struct batch_command* QueueBatchCommand(void)
+{
+	/* Start a new batch if the last one was sent */
+	if (batch_sent) {
+		batch_count = 0;
+		batch_sent = 0;
+	}
+
+	if (batch_count >= BATCH_MAX)
+		return NULL;
+
+	return batch + batch_count++;
+}
+
+uint32_t TlclBatchRead(uint32_t index, uint32_t length)
+{
+	struct batch_command* b = QueueBatchCommand();
+
+	VB2_DEBUG("TPM: TlclBatchRead(0x%x, %d)\n", index, length);
+	if (!b)
+		return TPM_E_BUFFER_SIZE;
+
+	/* Build the same command TlclRead() would, right in the batch */
+	tpm_nv_read_cmd_build(b->request);
+	ToTpmUint32(b->request + tpm_nv_read_cmd.index, index);
+	ToTpmUint32(b->request + tpm_nv_read_cmd.length, length);
+	return TPM_SUCCESS;
+}
+
+uint32_t TlclBatchGetPermissions(uint32_t index)
+{
+	struct batch_command* b = QueueBatchCommand();
+
+	VB2_DEBUG("TPM: TlclBatchGetPermissions(0x%x)\n", index);
+	if (!b)
+		return TPM_E_BUFFER_SIZE;
+
+	/* Build what TlclGetSpaceInfo() would, right in the batch */
+	VbAssert(sizeof(tpm_getspaceinfo_cmd.buffer) <= sizeof(b->request));
+	tpm_getspaceinfo_cmd_build(b->request);
+	ToTpmUint32(b->request + tpm_getspaceinfo_cmd.index, index);
+	return TPM_SUCCESS;
+}
+
+uint32_t TlclBatchSend(void)
+{
+	VbTpmCommand commands[BATCH_MAX];
+	uint32_t result;
+	uint64_t start;
+	int i;
+
+	VB2_DEBUG("TPM: TlclBatchSend(%d)\n", batch_count);
+	if (batch_sent)
+		batch_count = 0;
+
+	for (i = 0; i < batch_count; i++) {
+		commands[i].request = batch[i].request;
+		commands[i].request_length = TpmCommandSize(batch[i].request);
+		commands[i].response = batch[i].response;
+		commands[i].response_length = sizeof(batch[i].response);
+		commands[i].result = 0;
+	}
+
+	start = TlclStatsStart();
+	result = VbExTpmSendReceiveMulti(commands, batch_count);
+	/* The first command gets the time, so the totals still add up */
+	for (i = 0; i < batch_count; i++)
+		TlclStatsRecord(TpmCommandCode(batch[i].request),
+				i ? TlclStatsStart() : start);
+	if (result != 0) {
+		VB2_DEBUG("TPM: batch send/receive failed: 0x%x\n", result);
+		batch_count = 0;
+		return result;
+	}
+
+	for (i = 0; i < batch_count; i++) {
+		batch[i].response_length = commands[i].response_length;
+		batch[i].result = commands[i].result;
+	}
+	batch_sent = 1;
+	batch_next = 0;
+	return TPM_SUCCESS;
+}
+
 uint32_t TlclPCRRead(uint32_t index, void* data, uint32_t length)
 {
-	struct s_tpm_pcr_read_cmd cmd;
+	uint8_t cmd[sizeof(tpm_pcr_read_cmd.buffer)];
 	uint8_t response[TPM_LARGE_ENOUGH_COMMAND_SIZE];
 	uint32_t result;
 
@@ -650,10 +819,10 @@ uint32_t TlclPCRRead(uint32_t index, void* data, uint32_t length)
 	if (length < kPcrDigestLength) {
 		return TPM_E_IOERROR;
 	}
-	memcpy(&cmd, &tpm_pcr_read_cmd, sizeof(cmd));
-	ToTpmUint32(cmd.buffer + tpm_pcr_read_cmd.pcrNum, index);
+	tpm_pcr_read_cmd_build(cmd);
+	ToTpmUint32(cmd + tpm_pcr_read_cmd.pcrNum, index);
 
-	result = TlclSendReceive(cmd.buffer, response, sizeof(response));
+	result = TlclSendReceive(cmd, response, sizeof(response));
 	if (result == TPM_SUCCESS) {
 		const uint8_t* pcr_read_cursor =
 				response + kTpmResponseHeaderLength;
@@ -741,11 +910,11 @@ uint32_t TlclClearEnable(void)
 
 uint32_t TlclSetDeactivated(uint8_t flag)
 {
-	struct s_tpm_physicalsetdeactivated_cmd cmd;
+	uint8_t cmd[sizeof(tpm_physicalsetdeactivated_cmd.buffer)];
 	VB2_DEBUG("TPM: SetDeactivated(%d)\n", flag);
-	memcpy(&cmd, &tpm_physicalsetdeactivated_cmd, sizeof(cmd));
-	*(cmd.buffer + cmd.deactivated) = flag;
-	return Send(cmd.buffer);
+	tpm_physicalsetdeactivated_cmd_build(cmd);
+	cmd[tpm_physicalsetdeactivated_cmd.deactivated] = flag;
+	return Send(cmd);
 }
 
 uint32_t TlclGetPermanentFlags(TPM_PERMANENT_FLAGS* pflags)
@@ -815,15 +984,15 @@ uint32_t TlclSetGlobalLock(void)
 uint32_t TlclExtend(int pcr_num, const uint8_t* in_digest,
                     uint8_t* out_digest)
 {
-	struct s_tpm_extend_cmd cmd;
+	uint8_t cmd[sizeof(tpm_extend_cmd.buffer)];
 	uint8_t response[kTpmResponseHeaderLength + kPcrDigestLength];
 	uint32_t result;
 
-	memcpy(&cmd, &tpm_extend_cmd, sizeof(cmd));
-	ToTpmUint32(cmd.buffer + tpm_extend_cmd.pcrNum, pcr_num);
-	memcpy(cmd.buffer + cmd.inDigest, in_digest, kPcrDigestLength);
+	tpm_extend_cmd_build(cmd);
+	ToTpmUint32(cmd + tpm_extend_cmd.pcrNum, pcr_num);
+	memcpy(cmd + tpm_extend_cmd.inDigest, in_digest, kPcrDigestLength);
 
-	result = TlclSendReceive(cmd.buffer, response, sizeof(response));
+	result = TlclSendReceive(cmd, response, sizeof(response));
 	if (result != TPM_SUCCESS)
 		return result;
 
@@ -889,12 +1058,11 @@ uint32_t TlclGetSpaceInfo(uint32_t index, uint32_t *attributes, uint32_t *size,
 	}
 	policy = auth_policy;
 
-	struct s_tpm_getspaceinfo_cmd cmd;
-	memcpy(&cmd, &tpm_getspaceinfo_cmd, sizeof(cmd));
-	ToTpmUint32(cmd.buffer + tpm_getspaceinfo_cmd.index, index);
+	uint8_t cmd[sizeof(tpm_getspaceinfo_cmd.buffer)];
+	tpm_getspaceinfo_cmd_build(cmd);
+	ToTpmUint32(cmd + tpm_getspaceinfo_cmd.index, index);
 	uint8_t response[TPM_LARGE_ENOUGH_COMMAND_SIZE];
-	uint32_t result = TlclSendReceive(cmd.buffer, response,
-					  sizeof(response));
+	uint32_t result = TlclSendReceive(cmd, response, sizeof(response));
 	if (result != TPM_SUCCESS) {
 		return result;
 	}
@@ -960,20 +1128,20 @@ uint32_t TlclGetOwnership(uint8_t* owned)
 
 uint32_t TlclGetRandom(uint8_t* data, uint32_t length, uint32_t *size)
 {
-	struct s_tpm_get_random_cmd cmd;
+	uint8_t cmd[sizeof(tpm_get_random_cmd.buffer)];
 	uint8_t response[TPM_LARGE_ENOUGH_COMMAND_SIZE];
 	uint32_t result;
 
 	VB2_DEBUG("TPM: TlclGetRandom(%d)\n", length);
-	memcpy(&cmd, &tpm_get_random_cmd, sizeof(cmd));
-	ToTpmUint32(cmd.buffer + tpm_get_random_cmd.bytesRequested, length);
+	tpm_get_random_cmd_build(cmd);
+	ToTpmUint32(cmd + tpm_get_random_cmd.bytesRequested, length);
 	/* There must be room in the response buffer for the bytes. */
 	if (length > TPM_LARGE_ENOUGH_COMMAND_SIZE - kTpmResponseHeaderLength
 	    - sizeof(uint32_t)) {
 		return TPM_E_IOERROR;
 	}
 
-	result = TlclSendReceive(cmd.buffer, response, sizeof(response));
+	result = TlclSendReceive(cmd, response, sizeof(response));
 	if (result == TPM_SUCCESS) {
 		const uint8_t* get_random_cursor =
 				response + kTpmResponseHeaderLength;
@@ -1198,9 +1366,9 @@ uint32_t TlclReadPubek(uint32_t* public_exponent,
 		       uint8_t* modulus,
 		       uint32_t* modulus_size)
 {
-	struct s_tpm_readpubek_cmd cmd;
-	memcpy(&cmd, &tpm_readpubek_cmd, sizeof(cmd));
-	if (VbExTpmGetRandom(cmd.buffer + tpm_readpubek_cmd.antiReplay,
+	uint8_t cmd[sizeof(tpm_readpubek_cmd.buffer)];
+	tpm_readpubek_cmd_build(cmd);
+	if (VbExTpmGetRandom(cmd + tpm_readpubek_cmd.antiReplay,
 			     sizeof(TPM_NONCE)) != VB2_SUCCESS) {
 		return TPM_E_INTERNAL_ERROR;
 	}
@@ -1208,7 +1376,7 @@ uint32_t TlclReadPubek(uint32_t* public_exponent,
 	/* The response contains the public endorsement key, so use a large
 	 * response buffer. */
 	uint8_t response[TPM_LARGE_ENOUGH_COMMAND_SIZE + TPM_RSA_2048_LEN];
-	uint32_t result = TlclSendReceive(cmd.buffer, response,
+	uint32_t result = TlclSendReceive(cmd, response,
 					  sizeof(response));
 	if (result != TPM_SUCCESS) {
 		return result;
@@ -1242,7 +1410,7 @@ uint32_t TlclReadPubek(uint32_t* public_exponent,
 	vb2_sha1_init(&sha1_ctx);
 	vb2_sha1_update(&sha1_ctx, response + kTpmResponseHeaderLength,
 			checksum - (response + kTpmResponseHeaderLength));
-	vb2_sha1_update(&sha1_ctx, cmd.buffer + tpm_readpubek_cmd.antiReplay,
+	vb2_sha1_update(&sha1_ctx, cmd + tpm_readpubek_cmd.antiReplay,
 			sizeof(TPM_NONCE));
 	uint8_t digest[TPM_SHA1_160_HASH_LEN];
 	vb2_sha1_finalize(&sha1_ctx, digest);
@@ -1274,14 +1442,13 @@ uint32_t TlclTakeOwnership(uint8_t enc_owner_auth[TPM_RSA_2048_LEN],
 	}
 
 	/* Build the TakeOwnership command. */
-	struct s_tpm_takeownership_cmd cmd;
-	memcpy(&cmd, &tpm_takeownership_cmd, sizeof(cmd));
-	memcpy(cmd.buffer + tpm_takeownership_cmd.encOwnerAuth, enc_owner_auth,
+	uint8_t cmd[sizeof(tpm_takeownership_cmd.buffer)];
+	tpm_takeownership_cmd_build(cmd);
+	memcpy(cmd + tpm_takeownership_cmd.encOwnerAuth, enc_owner_auth,
 	       TPM_RSA_2048_LEN);
-	memcpy(cmd.buffer + tpm_takeownership_cmd.encSrkAuth, enc_srk_auth,
+	memcpy(cmd + tpm_takeownership_cmd.encSrkAuth, enc_srk_auth,
 	       TPM_RSA_2048_LEN);
-	result = AddRequestAuthBlock(&auth_session, cmd.buffer,
-				     sizeof(cmd.buffer), 0);
+	result = AddRequestAuthBlock(&auth_session, cmd, sizeof(cmd), 0);
 	if (result != TPM_SUCCESS) {
 		return result;
 	}
@@ -1289,7 +1456,7 @@ uint32_t TlclTakeOwnership(uint8_t enc_owner_auth[TPM_RSA_2048_LEN],
 	/* The response buffer needs to be large to hold the public half of the
 	 * generated SRK. */
 	uint8_t response[TPM_LARGE_ENOUGH_COMMAND_SIZE + TPM_RSA_2048_LEN];
-	result = TlclSendReceive(cmd.buffer, response, sizeof(response));
+	result = TlclSendReceive(cmd, response, sizeof(response));
 	if (result != TPM_SUCCESS) {
 		return result;
 	}
@@ -1306,10 +1473,10 @@ uint32_t TlclTakeOwnership(uint8_t enc_owner_auth[TPM_RSA_2048_LEN],
 
 uint32_t TlclCreateDelegationFamily(uint8_t family_label)
 {
-	struct s_tpm_create_delegation_family_cmd cmd;
-	memcpy(&cmd, &tpm_create_delegation_family_cmd, sizeof(cmd));
-	cmd.buffer[tpm_create_delegation_family_cmd.familyLabel] = family_label;
-	return Send(cmd.buffer);
+	uint8_t cmd[sizeof(tpm_create_delegation_family_cmd.buffer)];
+	tpm_create_delegation_family_cmd_build(cmd);
+	cmd[tpm_create_delegation_family_cmd.familyLabel] = family_label;
+	return Send(cmd);
 }
 
 uint32_t TlclReadDelegationFamilyTable(TPM_FAMILY_TABLE_ENTRY *table,
@@ -12,15 +12,18 @@
 #include "2misc.h"
 #include "2nvstorage.h"
 #include "2rsa.h"
+#include "2sha.h"
 #include "ec_sync.h"
 #include "gbb_access.h"
 #include "gbb_header.h"
 #include "load_kernel_fw.h"
 #include "rollback_index.h"
+#include "tlcl_stats.h"
 #include "utility.h"
 #include "vb2_common.h"
 #include "vboot_api.h"
 #include "vboot_common.h"
+#include "vboot_display.h"
 #include "vboot_kernel.h"
 
 /* Global variables */
@@ -29,6 +32,9 @@ static LoadKernelParams lkp;
 static struct vb2_context ctx;
 static uint8_t *unaligned_workbuf;
 
+/* NvStorage as last read from or written to the platform */
+static uint8_t nvdata_stored[VB2_NVDATA_SIZE_V2];
+
 #ifdef CHROMEOS_ENVIRONMENT
 /* Global variable accessors for unit tests */
 
@@ -61,7 +67,16 @@ void vb2_nv_commit(struct vb2_context *ctx)
 		return;
 
 	ctx->flags &= ~VB2_CONTEXT_NVDATA_CHANGED;
+
+	/*
+	 * Settings which were changed and then changed back don't need a
+	 * write, which on some platforms is a flash erase and program.
+	 */
+	if (!memcmp(ctx->nvdata, nvdata_stored, vb2_nv_get_size(ctx)))
+		return;
+
 	VbExNvStorageWrite(ctx->nvdata);
+	memcpy(nvdata_stored, ctx->nvdata, vb2_nv_get_size(ctx));
 }
 
 uint32_t vb2_get_fwmp_flags(void)
@@ -69,11 +84,250 @@ uint32_t vb2_get_fwmp_flags(void)
 	return fwmp.flags;
 }
 
+__attribute__((weak))
+uint32_t VbExDiskGetGeneration(VbExDiskHandle_t handle)
+{
+	return 0;
+}
+
+/* Disks which failed to boot, so they needn't be tried again until changed */
+#define FAILED_DISK_COUNT 4
+static struct {
+	VbExDiskHandle_t handle;
+	uint32_t generation;
+	VbError_t retval;
+} failed_disks[FAILED_DISK_COUNT];
+static uint32_t failed_disk_next;
+
+/**
+ * Look up a disk which already failed to boot.
+ *
+ * @param disk		Disk to look up
+ * @param retval	Set to what LoadKernel() returned for the disk
+ * @return Non-zero if the disk failed and hasn't changed since.
+ */
+static int VbDiskFailed(const VbDiskInfo *disk, VbError_t *retval)
+{
+	uint32_t generation = VbExDiskGetGeneration(disk->handle);
+	int i;
+
+	if (!generation)
+		return 0;
+
+	for (i = 0; i < FAILED_DISK_COUNT; i++) {
+		if (failed_disks[i].handle == disk->handle &&
+		    failed_disks[i].generation == generation) {
+			*retval = failed_disks[i].retval;
+			return 1;
+		}
+	}
+	return 0;
+}
+
+/**
+ * Remember that a disk failed to boot.
+ */
+static void VbSetDiskFailed(const VbDiskInfo *disk, VbError_t retval)
+{
+	uint32_t generation = VbExDiskGetGeneration(disk->handle);
+	int i;
+
+	if (!generation)
+		return;
+
+	/* Replace the disk's old entry if it has one, else the oldest */
+	for (i = 0; i < FAILED_DISK_COUNT; i++) {
+		if (failed_disks[i].handle == disk->handle)
+			break;
+	}
+	if (i == FAILED_DISK_COUNT) {
+		i = failed_disk_next;
+		failed_disk_next = (failed_disk_next + 1) % FAILED_DISK_COUNT;
+	}
+
+	failed_disks[i].handle = disk->handle;
+	failed_disks[i].generation = generation;
+	failed_disks[i].retval = retval;
+}
+
+/**
+ * Return non-zero if a disk is worth searching for a kernel.
+ */
+static int VbDiskUsable(const VbDiskInfo *disk, uint32_t get_info_flags)
+{
+	/*
+	 * Sanity-check what we can. FWIW, VbTryLoadKernel() is always
+	 * called with only a single bit set in get_info_flags.
+	 *
+	 * Ensure 512-byte sectors and non-trivially sized disk (for
+	 * cgptlib) and that we got a partition with only the flags we
+	 * asked for.
+	 */
+	if (512 != disk->bytes_per_lba ||
+	    16 > disk->lba_count ||
+	    get_info_flags != (disk->flags & ~VB_DISK_FLAG_EXTERNAL_GPT)) {
+		VB2_DEBUG("  skipping: bytes_per_lba=%" PRIu64
+			  " lba_count=%" PRIu64 " flags=0x%x\n",
+			  disk->bytes_per_lba,
+			  disk->lba_count,
+			  disk->flags);
+		return 0;
+	}
+	return 1;
+}
+
+/**
+ * Point the LoadKernel() params at a disk.
+ */
+static void VbSetLoadKernelDisk(LoadKernelParams *params,
+				const VbDiskInfo *disk)
+{
+	params->disk_handle = disk->handle;
+	params->bytes_per_lba = disk->bytes_per_lba;
+	params->gpt_lba_count = disk->lba_count;
+	params->streaming_lba_count = disk->streaming_lba_count
+					?: params->gpt_lba_count;
+	/* The disks are visited more than once, so don't let this leak */
+	params->boot_flags &= ~BOOT_FLAG_EXTERNAL_GPT;
+	params->boot_flags |= disk->flags & VB_DISK_FLAG_EXTERNAL_GPT
+			? BOOT_FLAG_EXTERNAL_GPT : 0;
+}
+
+/*
+ * Reads started by vb2_kernel_prefetch_start(), to overlap with EC sync.  The
+ * prefetch job only touches this, the TPM and the fixed disks.
+ */
+static struct vb_kernel_prefetch {
+	/* Non-zero while the job may still be running */
+	int started;
+	/* Passed to RollbackKernelPrefetch() */
+	int read_fwmp;
+	/* Fixed disks, until VbTryLoadKernel() takes them */
+	VbDiskInfo *disk_info;
+	uint32_t disk_count;
+} prefetch;
+
+/**
+ * Prefetch job: queue the kernel space reads, then read the GPT of the first
+ * usable fixed disk, which is the one a normal boot tries first.
+ */
+static int vb2_kernel_prefetch_run(void *arg)
+{
+	struct vb_kernel_prefetch *p = arg;
+	LoadKernelParams params;
+	uint32_t i;
+
+	/* Errors show up again when the reads are consumed */
+	RollbackKernelPrefetch(p->read_fwmp);
+
+	if (VBERROR_SUCCESS != VbExDiskGetInfo(&p->disk_info, &p->disk_count,
+					       VB_DISK_FLAG_FIXED)) {
+		p->disk_info = NULL;
+		return 0;
+	}
+
+	for (i = 0; i < p->disk_count; i++) {
+		if (!VbDiskUsable(&p->disk_info[i], VB_DISK_FLAG_FIXED))
+			continue;
+		memset(&params, 0, sizeof(params));
+		VbSetLoadKernelDisk(&params, &p->disk_info[i]);
+		LoadKernelPrefetchGpt(&params);
+		break;
+	}
+	return 0;
+}
+
+/**
+ * Start the prefetch job on another CPU.
+ *
+ * @param read_fwmp	Non-zero if the FWMP will be read
+ * @return VB2_SUCCESS if the job is running, or non-zero if the reads should
+ * be done in line instead.
+ */
+static int vb2_kernel_prefetch_start(int read_fwmp)
+{
+	int rv;
+
+	memset(&prefetch, 0, sizeof(prefetch));
+	prefetch.read_fwmp = read_fwmp;
+
+	rv = vb2ex_run_parallel(vb2_kernel_prefetch_run, &prefetch);
+	if (rv) {
+		VB2_DEBUG("Can't prefetch (%d); reading in line\n", rv);
+		return rv;
+	}
+
+	prefetch.started = 1;
+	return VB2_SUCCESS;
+}
+
+/**
+ * Wait for the prefetch job, if it's running.
+ */
+static void vb2_kernel_prefetch_wait(void)
+{
+	if (!prefetch.started)
+		return;
+
+	vb2ex_wait();
+	prefetch.started = 0;
+}
+
+/**
+ * Free whatever the prefetch job read that wasn't used.
+ */
+static void vb2_kernel_prefetch_free(void)
+{
+	vb2_kernel_prefetch_wait();
+
+	LoadKernelDropGpt();
+	if (prefetch.disk_info) {
+		VbExDiskFreeInfo(prefetch.disk_info, NULL);
+		prefetch.disk_info = NULL;
+	}
+}
+
+/* A usable disk and the rank of its best kernel candidate */
+struct vb_ranked_disk {
+	uint32_t index;
+	uint32_t rank;
+};
+
+/**
+ * Order the usable disks so the one with the best kernel candidate is tried
+ * first.
+ *
+ * Only the GPTs are read here, which is cheap next to reading and verifying
+ * kernels on a disk which would lose anyway.  Disks which rank equally keep
+ * the order VbExDiskGetInfo() reported them in, and disks with no candidate
+ * are still tried last so LoadKernel() reports on them as before.
+ */
+static void VbRankDisks(VbDiskInfo *disk_info, struct vb_ranked_disk *disks,
+			uint32_t count)
+{
+	uint32_t i, j;
+
+	for (i = 0; i < count; i++) {
+		struct vb_ranked_disk d = disks[i];
+
+		VbSetLoadKernelDisk(&lkp, &disk_info[d.index]);
+		d.rank = LoadKernelRank(&lkp);
+		VB2_DEBUG("VbTryLoadKernel() disk %d rank 0x%x\n",
+			  (int)d.index, d.rank);
+
+		for (j = i; j > 0 && disks[j - 1].rank < d.rank; j--)
+			disks[j] = disks[j - 1];
+		disks[j] = d;
+	}
+}
+
 uint32_t VbTryLoadKernel(struct vb2_context *ctx, uint32_t get_info_flags)
 {
 	VbError_t retval = VBERROR_UNKNOWN;
 	VbDiskInfo* disk_info = NULL;
+	struct vb_ranked_disk *disks = NULL;
 	uint32_t disk_count = 0;
+	uint32_t usable_count = 0;
 	uint32_t i;
 
 	VB2_DEBUG("VbTryLoadKernel() start, get_info_flags=0x%x\n",
@@ -82,10 +336,15 @@ uint32_t VbTryLoadKernel(struct vb2_context *ctx, uint32_t get_info_flags)
 	lkp.fwmp = &fwmp;
 	lkp.disk_handle = NULL;
 
-	/* Find disks */
-	if (VBERROR_SUCCESS != VbExDiskGetInfo(&disk_info, &disk_count,
-					       get_info_flags))
+	/* Find disks, unless they were found during EC sync */
+	if (prefetch.disk_info && VB_DISK_FLAG_FIXED == get_info_flags) {
+		disk_info = prefetch.disk_info;
+		disk_count = prefetch.disk_count;
+		prefetch.disk_info = NULL;
+	} else if (VBERROR_SUCCESS != VbExDiskGetInfo(&disk_info, &disk_count,
+						      get_info_flags)) {
 		disk_count = 0;
+	}
 
 	VB2_DEBUG("VbTryLoadKernel() found %d disks\n", (int)disk_count);
 	if (0 == disk_count) {
@@ -93,35 +352,29 @@ uint32_t VbTryLoadKernel(struct vb2_context *ctx, uint32_t get_info_flags)
 		return VBERROR_NO_DISK_FOUND;
 	}
 
-	/* Loop over disks */
-	for (i = 0; i < disk_count; i++) {
-		VB2_DEBUG("VbTryLoadKernel() trying disk %d\n", (int)i);
-		/*
-		 * Sanity-check what we can. FWIW, VbTryLoadKernel() is always
-		 * called with only a single bit set in get_info_flags.
-		 *
-		 * Ensure 512-byte sectors and non-trivially sized disk (for
-		 * cgptlib) and that we got a partition with only the flags we
-		 * asked for.
-		 */
-		if (512 != disk_info[i].bytes_per_lba ||
-		    16 > disk_info[i].lba_count ||
-		    get_info_flags != (disk_info[i].flags &
-				       ~VB_DISK_FLAG_EXTERNAL_GPT)) {
-			VB2_DEBUG("  skipping: bytes_per_lba=%" PRIu64
-				  " lba_count=%" PRIu64 " flags=0x%x\n",
-				  disk_info[i].bytes_per_lba,
-				  disk_info[i].lba_count,
-				  disk_info[i].flags);
+	disks = malloc(disk_count * sizeof(*disks));
+	if (!disks)
+		VB2_DEBUG("VbTryLoadKernel() can't allocate disk list\n");
+	for (i = 0; disks && i < disk_count; i++) {
+		VB2_DEBUG("VbTryLoadKernel() checking disk %d\n", (int)i);
+		if (!VbDiskUsable(&disk_info[i], get_info_flags))
+			continue;
+		if (VbDiskFailed(&disk_info[i], &retval)) {
+			VB2_DEBUG("  skipping: unchanged since it failed\n");
 			continue;
 		}
-		lkp.disk_handle = disk_info[i].handle;
-		lkp.bytes_per_lba = disk_info[i].bytes_per_lba;
-		lkp.gpt_lba_count = disk_info[i].lba_count;
-		lkp.streaming_lba_count = disk_info[i].streaming_lba_count
-						?: lkp.gpt_lba_count;
-		lkp.boot_flags |= disk_info[i].flags & VB_DISK_FLAG_EXTERNAL_GPT
-				? BOOT_FLAG_EXTERNAL_GPT : 0;
+		disks[usable_count++].index = i;
+	}
+
+	/* Ranking only pays off if there's a choice to make */
+	if (usable_count > 1)
+		VbRankDisks(disk_info, disks, usable_count);
+
+	/* Loop over disks */
+	for (i = 0; i < usable_count; i++) {
+		VB2_DEBUG("VbTryLoadKernel() trying disk %d\n",
+			  (int)disks[i].index);
+		VbSetLoadKernelDisk(&lkp, &disk_info[disks[i].index]);
 		retval = LoadKernel(ctx, &lkp);
 
 		VB2_DEBUG("VbTryLoadKernel() LoadKernel() = %d\n", retval);
@@ -135,8 +388,15 @@ uint32_t VbTryLoadKernel(struct vb2_context *ctx, uint32_t get_info_flags)
 		 */
 		if (VBERROR_SUCCESS == retval)
 			break;
+
+		VbSetDiskFailed(&disk_info[disks[i].index], retval);
 	}
 
+	free(disks);
+
+	/* Any prefetched GPT wasn't wanted, and its disk is about to close */
+	LoadKernelDropGpt();
+
 	/* If we didn't find any good kernels, don't return a disk handle. */
 	if (VBERROR_SUCCESS != retval) {
 		VbSetRecoveryRequest(ctx, VB2_RECOVERY_RW_NO_KERNEL);
@@ -220,11 +480,57 @@ VbError_t VbBootNormal(struct vb2_context *ctx)
 	return rv;
 }
 
+/**
+ * Read the kernel version and FWMP from the TPM.
+ *
+ * The reads should already be queued by RollbackKernelPrefetch().
+ */
+static VbError_t vb2_kernel_read_secdata(void)
+{
+	struct vb2_shared_data *sd = vb2_get_sd(&ctx);
+	VbSharedDataHeader *shared = sd->vbsd;
+
+	/* Read kernel version from the TPM.  Ignore errors in recovery mode. */
+	if (RollbackKernelRead(&shared->kernel_version_tpm)) {
+		VB2_DEBUG("Unable to get kernel versions from TPM\n");
+		if (!(ctx.flags & VB2_CONTEXT_RECOVERY_MODE)) {
+			VbSetRecoveryRequest(&ctx, VB2_RECOVERY_RW_TPM_R_ERROR);
+			return VBERROR_TPM_READ_KERNEL;
+		}
+	}
+
+	shared->kernel_version_tpm_start = shared->kernel_version_tpm;
+
+	/* Read FWMP.  Ignore errors in recovery mode. */
+	if (sd->gbb_flags & VB2_GBB_FLAG_DISABLE_FWMP) {
+		memset(&fwmp, 0, sizeof(fwmp));
+	} else if (RollbackFwmpRead(&fwmp)) {
+		VB2_DEBUG("Unable to get FWMP from TPM\n");
+		if (!(ctx.flags & VB2_CONTEXT_RECOVERY_MODE)) {
+			VbSetRecoveryRequest(&ctx, VB2_RECOVERY_RW_TPM_R_ERROR);
+			return VBERROR_TPM_READ_FWMP;
+		}
+	}
+
+	return VBERROR_SUCCESS;
+}
+
+/**
+ * Set up the vboot context and LoadKernel() params.
+ *
+ * @param cparams	Common params
+ * @param kparams	Kernel params
+ * @param allow_prefetch	Non-zero if the caller finishes a prefetch
+ *			started for VB_SALK_INFLAGS_PREFETCH_DURING_EC_SYNC
+ * @return VBERROR_SUCCESS, or non-zero error code.
+ */
 static VbError_t vb2_kernel_setup(VbCommonParams *cparams,
-				  VbSelectAndLoadKernelParams *kparams)
+				  VbSelectAndLoadKernelParams *kparams,
+				  int allow_prefetch)
 {
 	VbSharedDataHeader *shared =
 		(VbSharedDataHeader *)cparams->shared_data_blob;
+	int read_fwmp;
 
 	/* Start timer */
 	shared->timer_vb_select_and_load_kernel_enter = VbExGetTimer();
@@ -260,6 +566,7 @@ static VbError_t vb2_kernel_setup(VbCommonParams *cparams,
 		ctx.flags |= VB2_CONTEXT_NVDATA_V2;
 
 	VbExNvStorageRead(ctx.nvdata);
+	memcpy(nvdata_stored, ctx.nvdata, sizeof(nvdata_stored));
 	vb2_nv_init(&ctx);
 
 	ctx.workbuf_size = VB2_KERNEL_WORKBUF_RECOMMENDED_SIZE +
@@ -312,6 +619,11 @@ static VbError_t vb2_kernel_setup(VbCommonParams *cparams,
 	memset(&lkp, 0, sizeof(lkp));
 	lkp.kernel_buffer = kparams->kernel_buffer;
 	lkp.kernel_buffer_size = kparams->kernel_buffer_size;
+	lkp.body_chunk_size = kparams->body_chunk_size;
+	if (kparams->inflags & VB_SALK_INFLAGS_PEEK_NEXT_VBLOCK)
+		lkp.boot_flags |= BOOT_FLAG_PEEK_NEXT_VBLOCK;
+	if (kparams->inflags & VB_SALK_INFLAGS_KERNEL_HINT)
+		lkp.boot_flags |= BOOT_FLAG_KERNEL_HINT;
 
 	/* Clear output params in case we fail */
 	kparams->disk_handle = NULL;
@@ -326,29 +638,21 @@ static VbError_t vb2_kernel_setup(VbCommonParams *cparams,
 	sd->gbb_size = cparams->gbb_size;
 	sd->gbb_flags = sd->gbb->flags;
 
-	/* Read kernel version from the TPM.  Ignore errors in recovery mode. */
-	if (RollbackKernelRead(&shared->kernel_version_tpm)) {
-		VB2_DEBUG("Unable to get kernel versions from TPM\n");
-		if (!(ctx.flags & VB2_CONTEXT_RECOVERY_MODE)) {
-			VbSetRecoveryRequest(&ctx, VB2_RECOVERY_RW_TPM_R_ERROR);
-			return VBERROR_TPM_READ_KERNEL;
-		}
-	}
+	/*
+	 * Outside recovery mode, the TPM reads can overlap EC sync; they're
+	 * finished by vb2_kernel_read_secdata() once EC sync is done.
+	 */
+	read_fwmp = !(sd->gbb_flags & VB2_GBB_FLAG_DISABLE_FWMP);
+	if (allow_prefetch &&
+	    (kparams->inflags & VB_SALK_INFLAGS_PREFETCH_DURING_EC_SYNC) &&
+	    !(ctx.flags & VB2_CONTEXT_RECOVERY_MODE) &&
+	    VB2_SUCCESS == vb2_kernel_prefetch_start(read_fwmp))
+		return VBERROR_SUCCESS;
 
-	shared->kernel_version_tpm_start = shared->kernel_version_tpm;
+	/* Overlap the TPM reads below where the platform can */
+	RollbackKernelPrefetch(read_fwmp);
 
-	/* Read FWMP.  Ignore errors in recovery mode. */
-	if (sd->gbb_flags & VB2_GBB_FLAG_DISABLE_FWMP) {
-		memset(&fwmp, 0, sizeof(fwmp));
-	} else if (RollbackFwmpRead(&fwmp)) {
-		VB2_DEBUG("Unable to get FWMP from TPM\n");
-		if (!(ctx.flags & VB2_CONTEXT_RECOVERY_MODE)) {
-			VbSetRecoveryRequest(&ctx, VB2_RECOVERY_RW_TPM_R_ERROR);
-			return VBERROR_TPM_READ_FWMP;
-		}
-	}
-
-	return VBERROR_SUCCESS;
+	return vb2_kernel_read_secdata();
 }
 
 static VbError_t vb2_kernel_phase4(VbSelectAndLoadKernelParams *kparams)
@@ -387,12 +691,51 @@ static void vb2_kernel_cleanup(struct vb2_context *ctx, VbCommonParams *cparams)
 	VbSharedDataHeader *shared =
 		(VbSharedDataHeader *)cparams->shared_data_blob;
 
+	/* Free anything read ahead which the boot path didn't use */
+	vb2_kernel_prefetch_free();
+
 	/*
 	 * Clean up vboot context.
 	 *
 	 * TODO: This should propagate up to higher levels
 	 */
 
+#ifdef VB2_TIMESTAMPS
+	/* Export boot timestamps to the OS, oldest first */
+	if (ctx->workbuf_used) {
+		struct vb2_shared_data *sd = vb2_get_sd(ctx);
+		const struct vb2_timestamp *ts;
+		uint32_t i = 0;
+
+		if (sd->timestamp_count > VB2_MAX_TIMESTAMPS)
+			i = sd->timestamp_count - VB2_MAX_TIMESTAMPS;
+		for (; i < sd->timestamp_count; i++) {
+			ts = sd->timestamps + (i & (VB2_MAX_TIMESTAMPS - 1));
+			VbSharedDataAddTimestamp(shared, ts->event,
+						 ts->time_ms);
+		}
+	}
+#endif
+
+#ifdef TLCL_STATS
+	/* Export TPM latency statistics to the OS */
+	{
+		const TlclCommandStats *stats;
+		uint32_t count = TlclGetCommandStats(&stats);
+		VbSharedDataTpmStats vstats;
+		uint32_t i;
+
+		for (i = 0; i < count; i++) {
+			vstats.command = stats[i].command;
+			vstats.count = stats[i].count;
+			vstats.total_us = stats[i].total_us;
+			vstats.max_us = stats[i].max_us;
+			vstats.selftest_retries = stats[i].selftest_retries;
+			VbSharedDataSetTpmStats(shared, &vstats);
+		}
+	}
+#endif
+
 	/* Free buffers */
 	free(unaligned_workbuf);
 
@@ -408,16 +751,31 @@ static void vb2_kernel_cleanup(struct vb2_context *ctx, VbCommonParams *cparams)
 VbError_t VbSelectAndLoadKernel(VbCommonParams *cparams,
                                 VbSelectAndLoadKernelParams *kparams)
 {
-	VbError_t retval = vb2_kernel_setup(cparams, kparams);
+	VbError_t retval = vb2_kernel_setup(cparams, kparams, 1);
 	if (retval)
 		goto VbSelectAndLoadKernel_exit;
 
+	/* Let the platform load the screens this boot may show, if it likes */
+	VbDisplayPrepare(&ctx, kparams->inflags &
+			 VB_SALK_INFLAGS_ENABLE_DETACHABLE_UI);
+
 	/*
 	 * Do EC software sync unless we're in recovery mode. This has UI but
 	 * it's just a single non-interactive WAIT screen.
 	 */
 	if (!(ctx.flags & VB2_CONTEXT_RECOVERY_MODE)) {
 		retval = ec_sync_all(&ctx);
+
+		/* Pick up the TPM reads which overlapped EC sync, if any */
+		if (prefetch.started) {
+			VbError_t rv;
+
+			vb2_kernel_prefetch_wait();
+			rv = vb2_kernel_read_secdata();
+			if (!retval)
+				retval = rv;
+		}
+
 		if (retval)
 			goto VbSelectAndLoadKernel_exit;
 	}
@@ -455,163 +813,411 @@ VbError_t VbSelectAndLoadKernel(VbCommonParams *cparams,
 	return retval;
 }
 
-VbError_t VbVerifyMemoryBootImage(VbCommonParams *cparams,
-				  VbSelectAndLoadKernelParams *kparams,
-				  void *boot_image,
-				  size_t image_size)
-{
-	VbPublicKey* kernel_subkey = NULL;
-	uint8_t *kbuf;
-	VbKeyBlockHeader *key_block;
-	VbKernelPreambleHeader *preamble;
-	uint64_t body_offset;
-	int hash_only = 0;
+/* Steps in verifying a memory boot image as it arrives */
+enum vb_memboot_step {
+	/* No image being verified */
+	VB_MEMBOOT_IDLE = 0,
+	/* Waiting for the key block */
+	VB_MEMBOOT_KEYBLOCK,
+	/* Waiting for the preamble */
+	VB_MEMBOOT_PREAMBLE,
+	/* Hashing the body */
+	VB_MEMBOOT_BODY,
+	/* Verification failed; memboot.retval says why */
+	VB_MEMBOOT_FAILED,
+};
+
+/* Memory boot image being verified */
+static struct {
+	enum vb_memboot_step step;
+	VbError_t retval;
+	VbCommonParams *cparams;
+	VbSelectAndLoadKernelParams *kparams;
+	uint8_t *image;
+	uint32_t image_size;
+	uint32_t received;
+	VbPublicKey *kernel_subkey;
+	int hash_only;
 	int dev_switch;
-	uint32_t allow_fastboot_full_cap = 0;
-	struct vb2_workbuf wb;
-
-	VbError_t retval = vb2_kernel_setup(cparams, kparams);
-	if (retval)
-		goto fail;
-
-	struct vb2_shared_data *sd = vb2_get_sd(&ctx);
-	VbSharedDataHeader *shared = sd->vbsd;
-
-	if ((boot_image == NULL) || (image_size == 0)) {
-		retval = VBERROR_INVALID_PARAMETER;
-		goto fail;
-	}
-
-	kbuf = boot_image;
-
-	/*
-	 * We don't care verifying the image if:
-	 * 1. dev-mode switch is on and
-	 * 2a. GBB_FLAG_FORCE_DEV_BOOT_FASTBOOT_FULL_CAP is set, or
-	 * 2b. DEV_BOOT_FASTBOOT_FULL_CAP flag is set in NvStorage
-	 *
-	 * Check only the integrity of the image.
-	 */
-	dev_switch = shared->flags & VBSD_BOOT_DEV_SWITCH_ON;
-	allow_fastboot_full_cap =
-			vb2_nv_get(&ctx, VB2_NV_DEV_BOOT_FASTBOOT_FULL_CAP);
+	/* Unpacked from the key block, so it points into the image */
+	struct vb2_public_key data_key;
+	uint32_t preamble_offset;
+	uint32_t body_offset;
+	uint32_t body_hashed;
+	struct vb2_digest_context dc;
+} memboot;
+
+/* The preamble of the memory boot image, once its key block is verified */
+static VbKernelPreambleHeader *memboot_get_preamble(void)
+{
+	return (VbKernelPreambleHeader *)
+		(memboot.image + memboot.preamble_offset);
+}
 
-	if (0 == allow_fastboot_full_cap) {
-		allow_fastboot_full_cap = !!(sd->gbb_flags &
-				VB2_GBB_FLAG_FORCE_DEV_BOOT_FASTBOOT_FULL_CAP);
-	}
+/**
+ * Verify the key block of the memory boot image, once it has all arrived.
+ *
+ * @param final		Non-zero if no more of the image is coming
+ * @param wb		Work buffer
+ * @return VBERROR_SUCCESS, or non-zero error code.
+ */
+static VbError_t memboot_keyblock(int final, struct vb2_workbuf *wb)
+{
+	struct vb2_keyblock *keyblock = (struct vb2_keyblock *)memboot.image;
+	VbKeyBlockHeader *key_block = (VbKeyBlockHeader *)memboot.image;
+	int rv;
 
-	if (dev_switch && allow_fastboot_full_cap) {
-		VB2_DEBUG("Only performing integrity-check.\n");
-		hash_only = 1;
-	} else {
-		/* Get recovery key. */
-		retval = VbGbbReadRecoveryKey(&ctx, &kernel_subkey);
-		if (VBERROR_SUCCESS != retval) {
-			VB2_DEBUG("Gbb Read Recovery key failed.\n");
-			goto fail;
+	if (!final) {
+		if (memboot.received < sizeof(*keyblock))
+			return VBERROR_SUCCESS;
+		/* A key block bigger than the image will never arrive */
+		if (keyblock->keyblock_size > memboot.image_size) {
+			VB2_DEBUG("Key block bigger than image.\n");
+			return VBERROR_INVALID_KERNEL_FOUND;
 		}
+		if (memboot.received < keyblock->keyblock_size)
+			return VBERROR_SUCCESS;
 	}
 
-	/* If we fail at any step, retval returned would be invalid kernel. */
-	retval = VBERROR_INVALID_KERNEL_FOUND;
-
-	/* Allocate work buffer */
-	vb2_workbuf_from_ctx(&ctx, &wb);
-
 	/* Verify the key block. */
-	key_block = (VbKeyBlockHeader *)kbuf;
-	struct vb2_keyblock *keyblock2 = (struct vb2_keyblock *)kbuf;
-	int rv;
-	if (hash_only) {
-		rv = vb2_verify_keyblock_hash(keyblock2, image_size, &wb);
+	if (memboot.hash_only) {
+		rv = vb2_verify_keyblock_hash(keyblock, memboot.received, wb);
 	} else {
 		/* Unpack kernel subkey */
 		struct vb2_public_key kernel_subkey2;
 		if (VB2_SUCCESS !=
 		    vb2_unpack_key(&kernel_subkey2,
-				   (struct vb2_packed_key *)kernel_subkey)) {
+				   (struct vb2_packed_key *)
+				   memboot.kernel_subkey)) {
 			VB2_DEBUG("Unable to unpack kernel subkey\n");
-			goto fail;
+			return VBERROR_INVALID_KERNEL_FOUND;
 		}
-		rv = vb2_verify_keyblock(keyblock2, image_size,
-					 &kernel_subkey2, &wb);
+		rv = vb2_verify_keyblock(keyblock, memboot.received,
+					 &kernel_subkey2, wb);
 	}
 
 	if (VB2_SUCCESS != rv) {
 		VB2_DEBUG("Verifying key block signature/hash failed.\n");
-		goto fail;
+		return VBERROR_INVALID_KERNEL_FOUND;
 	}
 
 	/* Check the key block flags against the current boot mode. */
 	if (!(key_block->key_block_flags &
-	      (dev_switch ? KEY_BLOCK_FLAG_DEVELOPER_1 :
+	      (memboot.dev_switch ? KEY_BLOCK_FLAG_DEVELOPER_1 :
 	       KEY_BLOCK_FLAG_DEVELOPER_0))) {
 		VB2_DEBUG("Key block developer flag mismatch.\n");
-		if (hash_only == 0)
-			goto fail;
+		if (memboot.hash_only == 0)
+			return VBERROR_INVALID_KERNEL_FOUND;
 	}
 
 	if (!(key_block->key_block_flags & KEY_BLOCK_FLAG_RECOVERY_1)) {
 		VB2_DEBUG("Key block recovery flag mismatch.\n");
-		if (hash_only == 0)
-			goto fail;
+		if (memboot.hash_only == 0)
+			return VBERROR_INVALID_KERNEL_FOUND;
 	}
 
 	/* Get key for preamble/data verification from the key block. */
-	struct vb2_public_key data_key2;
-	if (VB2_SUCCESS != vb2_unpack_key(&data_key2, &keyblock2->data_key)) {
+	memset(&memboot.data_key, 0, sizeof(memboot.data_key));
+	if (VB2_SUCCESS != vb2_unpack_key(&memboot.data_key,
+					  &keyblock->data_key)) {
 		VB2_DEBUG("Unable to unpack kernel data key\n");
-		goto fail;
+		return VBERROR_INVALID_KERNEL_FOUND;
 	}
 
-	/* Verify the preamble, which follows the key block */
-	preamble = (VbKernelPreambleHeader *)(kbuf + key_block->key_block_size);
+	memboot.preamble_offset = keyblock->keyblock_size;
+	memboot.step = VB_MEMBOOT_PREAMBLE;
+	return VBERROR_SUCCESS;
+}
+
+/**
+ * Verify the preamble of the memory boot image, once it has all arrived, and
+ * start hashing the body.
+ *
+ * @param final		Non-zero if no more of the image is coming
+ * @param wb		Work buffer
+ * @return VBERROR_SUCCESS, or non-zero error code.
+ */
+static VbError_t memboot_preamble(int final, struct vb2_workbuf *wb)
+{
+	uint32_t kb_size = memboot.preamble_offset;
+	uint32_t size = memboot.received - kb_size;
+	VbKernelPreambleHeader *preamble = memboot_get_preamble();
 	struct vb2_kernel_preamble *preamble2 =
-			(struct vb2_kernel_preamble *)
-			(kbuf + key_block->key_block_size);
-
-	if (VB2_SUCCESS != vb2_verify_kernel_preamble(
-			preamble2,
-			image_size - key_block->key_block_size,
-			&data_key2,
-			&wb)) {
+			(struct vb2_kernel_preamble *)preamble;
+	uint32_t data_size;
+
+	if (!final) {
+		if (size < EXPECTED_VB2_KERNEL_PREAMBLE_2_0_SIZE)
+			return VBERROR_SUCCESS;
+		if (preamble2->preamble_size > memboot.image_size - kb_size) {
+			VB2_DEBUG("Preamble bigger than image.\n");
+			return VBERROR_INVALID_KERNEL_FOUND;
+		}
+		if (size < preamble2->preamble_size)
+			return VBERROR_SUCCESS;
+	}
+
+	/* Verify the preamble, which follows the key block */
+	if (VB2_SUCCESS != vb2_verify_kernel_preamble(preamble2, size,
+						      &memboot.data_key, wb)) {
 		VB2_DEBUG("Preamble verification failed.\n");
-		goto fail;
+		return VBERROR_INVALID_KERNEL_FOUND;
 	}
 
 	VB2_DEBUG("Kernel preamble is good.\n");
 
+	/* The signed part of the body must fit in the image */
+	memboot.body_offset = kb_size + preamble->preamble_size;
+	data_size = preamble->body_signature.data_size;
+	if (data_size > memboot.image_size - memboot.body_offset) {
+		VB2_DEBUG("Image smaller than signed kernel data.\n");
+		return VBERROR_INVALID_KERNEL_FOUND;
+	}
+
+	/* Hash the body as it arrives, in the crypto engine if there is one */
+	memboot.body_hashed = 0;
+	if (vb2_kernel_body_digest_init(&memboot.dc, preamble2,
+					memboot.data_key.hash_alg))
+		return VBERROR_INVALID_KERNEL_FOUND;
+
+	memboot.step = VB_MEMBOOT_BODY;
+	return VBERROR_SUCCESS;
+}
+
+/**
+ * Hash the part of the memory boot image body which has arrived, and verify
+ * it once it all has.
+ *
+ * @param final		Non-zero if no more of the image is coming
+ * @param wb		Work buffer
+ * @return VBERROR_SUCCESS, or non-zero error code.
+ */
+static VbError_t memboot_body(int final, struct vb2_workbuf *wb)
+{
+	VbKernelPreambleHeader *preamble = memboot_get_preamble();
+	struct vb2_signature *sig =
+			(struct vb2_signature *)&preamble->body_signature;
+	uint32_t data_size = sig->data_size;
+	uint32_t digest_size = vb2_digest_size(memboot.dc.hash_alg);
+	uint32_t size;
+	uint8_t *digest;
+	int rv;
+
+	size = memboot.received - memboot.body_offset;
+	if (size > data_size)
+		size = data_size;
+	if (size > memboot.body_hashed) {
+		const uint8_t *buf = memboot.image + memboot.body_offset +
+			memboot.body_hashed;
+
+		if (memboot.dc.using_hwcrypto)
+			rv = vb2ex_hwcrypto_digest_extend(
+					buf, size - memboot.body_hashed);
+		else
+			rv = vb2_digest_extend(&memboot.dc, buf,
+					       size - memboot.body_hashed);
+		if (rv)
+			return VBERROR_INVALID_KERNEL_FOUND;
+		memboot.body_hashed = size;
+	}
+
+	if (!final)
+		return VBERROR_SUCCESS;
+
 	/* Verify kernel data */
-	body_offset = key_block->key_block_size + preamble->preamble_size;
-	if (VB2_SUCCESS != vb2_verify_data(
-			(const uint8_t *)(kbuf + body_offset),
-			image_size - body_offset,
-			(struct vb2_signature *)&preamble->body_signature,
-			&data_key2, &wb)) {
+	digest = vb2_workbuf_alloc(wb, digest_size);
+	if (!digest || memboot.body_hashed != data_size)
+		return VBERROR_INVALID_KERNEL_FOUND;
+
+	rv = vb2_kernel_body_digest_finalize(&memboot.dc, digest, digest_size);
+	if (rv || VB2_SUCCESS != vb2_verify_digest(&memboot.data_key, sig,
+						   digest, wb)) {
 		VB2_DEBUG("Kernel data verification failed.\n");
-		goto fail;
+		return VBERROR_INVALID_KERNEL_FOUND;
 	}
 
 	VB2_DEBUG("Kernel is good.\n");
+	return VBERROR_SUCCESS;
+}
+
+/**
+ * Verify whatever the memory boot image has enough data for now.
+ *
+ * @param final		Non-zero if no more of the image is coming
+ * @return VBERROR_SUCCESS, or non-zero error code.
+ */
+static VbError_t memboot_advance(int final)
+{
+	struct vb2_workbuf wb;
+	VbError_t retval = VBERROR_SUCCESS;
+
+	vb2_workbuf_from_ctx(&ctx, &wb);
+
+	if (memboot.step == VB_MEMBOOT_KEYBLOCK)
+		retval = memboot_keyblock(final, &wb);
+	if (!retval && memboot.step == VB_MEMBOOT_PREAMBLE)
+		retval = memboot_preamble(final, &wb);
+	if (!retval && memboot.step == VB_MEMBOOT_BODY)
+		retval = memboot_body(final, &wb);
+
+	/* Only the body is left to verify once the image is complete */
+	if (!retval && final && memboot.step != VB_MEMBOOT_BODY)
+		retval = VBERROR_INVALID_KERNEL_FOUND;
+
+	if (retval) {
+		memboot.step = VB_MEMBOOT_FAILED;
+		memboot.retval = retval;
+	}
+	return retval;
+}
+
+VbError_t VbVerifyMemoryBootImageBegin(VbCommonParams *cparams,
+				       VbSelectAndLoadKernelParams *kparams,
+				       void *boot_image,
+				       size_t image_size)
+{
+	uint32_t allow_fastboot_full_cap = 0;
 
-	/* Fill in output parameters. */
-	kparams->kernel_buffer = kbuf + body_offset;
-	kparams->kernel_buffer_size = image_size - body_offset;
-	kparams->bootloader_address = preamble->bootloader_address;
-	kparams->bootloader_size = preamble->bootloader_size;
-	if (VbKernelHasFlags(preamble) == VBOOT_SUCCESS)
-		kparams->flags = preamble->flags;
+	/* Drop anything left from an image which was never finished */
+	free(memboot.kernel_subkey);
+	memset(&memboot, 0, sizeof(memboot));
+
+	VbError_t retval = vb2_kernel_setup(cparams, kparams, 0);
+	if (retval)
+		goto fail;
+
+	struct vb2_shared_data *sd = vb2_get_sd(&ctx);
+	VbSharedDataHeader *shared = sd->vbsd;
 
-	retval = VBERROR_SUCCESS;
+	if ((boot_image == NULL) || (image_size == 0) ||
+	    image_size > UINT32_MAX) {
+		retval = VBERROR_INVALID_PARAMETER;
+		goto fail;
+	}
+
+	/*
+	 * We don't care verifying the image if:
+	 * 1. dev-mode switch is on and
+	 * 2a. GBB_FLAG_FORCE_DEV_BOOT_FASTBOOT_FULL_CAP is set, or
+	 * 2b. DEV_BOOT_FASTBOOT_FULL_CAP flag is set in NvStorage
+	 *
+	 * Check only the integrity of the image.
+	 */
+	memboot.dev_switch = shared->flags & VBSD_BOOT_DEV_SWITCH_ON;
+	allow_fastboot_full_cap =
+			vb2_nv_get(&ctx, VB2_NV_DEV_BOOT_FASTBOOT_FULL_CAP);
+
+	if (0 == allow_fastboot_full_cap) {
+		allow_fastboot_full_cap = !!(sd->gbb_flags &
+				VB2_GBB_FLAG_FORCE_DEV_BOOT_FASTBOOT_FULL_CAP);
+	}
+
+	if (memboot.dev_switch && allow_fastboot_full_cap) {
+		VB2_DEBUG("Only performing integrity-check.\n");
+		memboot.hash_only = 1;
+	} else {
+		/* Get recovery key. */
+		retval = VbGbbReadRecoveryKey(&ctx, &memboot.kernel_subkey);
+		if (VBERROR_SUCCESS != retval) {
+			VB2_DEBUG("Gbb Read Recovery key failed.\n");
+			goto fail;
+		}
+	}
+
+	memboot.cparams = cparams;
+	memboot.kparams = kparams;
+	memboot.image = boot_image;
+	memboot.image_size = image_size;
+	memboot.step = VB_MEMBOOT_KEYBLOCK;
+	return VBERROR_SUCCESS;
 
 fail:
 	vb2_kernel_cleanup(&ctx, cparams);
-	if (NULL != kernel_subkey)
-		free(kernel_subkey);
+	free(memboot.kernel_subkey);
+	memboot.kernel_subkey = NULL;
 	return retval;
 }
 
+VbError_t VbVerifyMemoryBootImageFeed(const void *data, size_t size)
+{
+	uint8_t *dest = memboot.image + memboot.received;
+
+	if (memboot.step == VB_MEMBOOT_IDLE)
+		return VBERROR_INVALID_PARAMETER;
+	if (memboot.step == VB_MEMBOOT_FAILED)
+		return memboot.retval;
+
+	if (size > memboot.image_size - memboot.received) {
+		VB2_DEBUG("Fed more than the image size.\n");
+		memboot.step = VB_MEMBOOT_FAILED;
+		memboot.retval = VBERROR_INVALID_PARAMETER;
+		return memboot.retval;
+	}
+
+	/* Data received straight into the image buffer needs no copy */
+	if (data != dest)
+		memmove(dest, data, size);
+	memboot.received += size;
+
+	return memboot_advance(0);
+}
+
+VbError_t VbVerifyMemoryBootImageFinish(void)
+{
+	VbSelectAndLoadKernelParams *kparams = memboot.kparams;
+	VbError_t retval;
+
+	if (memboot.step == VB_MEMBOOT_IDLE)
+		return VBERROR_INVALID_PARAMETER;
+
+	if (memboot.step != VB_MEMBOOT_FAILED &&
+	    memboot.received != memboot.image_size) {
+		VB2_DEBUG("Only got %u of %u image bytes.\n",
+			  memboot.received, memboot.image_size);
+		memboot.step = VB_MEMBOOT_FAILED;
+		memboot.retval = VBERROR_INVALID_PARAMETER;
+	}
+
+	if (memboot.step == VB_MEMBOOT_FAILED)
+		retval = memboot.retval;
+	else
+		retval = memboot_advance(1);
+
+	if (!retval) {
+		VbKernelPreambleHeader *preamble = memboot_get_preamble();
+
+		/* Fill in output parameters. */
+		kparams->kernel_buffer = memboot.image + memboot.body_offset;
+		kparams->kernel_buffer_size =
+				memboot.image_size - memboot.body_offset;
+		kparams->bootloader_address = preamble->bootloader_address;
+		kparams->bootloader_size = preamble->bootloader_size;
+		if (VbKernelHasFlags(preamble) == VBOOT_SUCCESS)
+			kparams->flags = preamble->flags;
+	}
+
+	vb2_kernel_cleanup(&ctx, memboot.cparams);
+	free(memboot.kernel_subkey);
+	memset(&memboot, 0, sizeof(memboot));
+	return retval;
+}
+
+VbError_t VbVerifyMemoryBootImage(VbCommonParams *cparams,
+				  VbSelectAndLoadKernelParams *kparams,
+				  void *boot_image,
+				  size_t image_size)
+{
+	VbError_t retval = VbVerifyMemoryBootImageBegin(cparams, kparams,
+							boot_image,
+							image_size);
+	if (retval)
+		return retval;
+
+	/* The whole image is already there, so verify it in one go */
+	VbVerifyMemoryBootImageFeed(boot_image, image_size);
+	return VbVerifyMemoryBootImageFinish();
+}
+
 VbError_t VbUnlockDevice(void)
 {
 	VB2_DEBUG("Enabling dev-mode...\n");
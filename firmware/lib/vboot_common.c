@@ -212,6 +212,216 @@ int VbSharedDataSetKernelKey(VbSharedDataHeader *header, const VbPublicKey *src)
 	return PublicKeyCopy(kdest, src);
 }
 
+int VbSharedDataAddTimestamp(VbSharedDataHeader *header, uint32_t event,
+			     uint32_t time_ms)
+{
+	VbSharedDataTimestamp *ts;
+
+	if (!header || header->struct_version < 3)
+		return VBOOT_SHARED_DATA_INVALID;
+
+	ts = header->timestamps +
+		(header->timestamp_count & (VBSD_MAX_TIMESTAMPS - 1));
+	ts->time_ms = time_ms;
+	ts->event = event;
+	header->timestamp_count++;
+	return VBOOT_SUCCESS;
+}
+
+int VbSharedDataSetTpmStats(VbSharedDataHeader *header,
+			    const VbSharedDataTpmStats *stats)
+{
+	uint32_t i;
+
+	if (!header || header->struct_version < 4)
+		return VBOOT_SHARED_DATA_INVALID;
+
+	/* Replace the command's entry if it has one; add one if not */
+	for (i = 0; i < header->tpm_stats_count; i++) {
+		if (header->tpm_stats[i].command == stats->command)
+			break;
+	}
+	if (i == VBSD_MAX_TPM_STATS)
+		return VBOOT_SHARED_DATA_INVALID;
+
+	memcpy(header->tpm_stats + i, stats, sizeof(*stats));
+	if (i == header->tpm_stats_count)
+		header->tpm_stats_count++;
+	return VBOOT_SUCCESS;
+}
+
+/**
+ * Append a section to compact shared data.  Returns a pointer to its zeroed
+ * data, or NULL if there is no room left in the buffer.
+ */
+static void *AddSection(VbSharedDataCompact *sc, uint32_t buf_size,
+			uint16_t tag, uint32_t size)
+{
+	VbSharedDataSection *s =
+		(VbSharedDataSection *)((uint8_t *)sc + sc->total_size);
+	uint32_t padded = (size + 7) & ~7;
+
+	if (buf_size - sc->total_size < sizeof(*s) + padded)
+		return NULL;
+
+	memset(s, 0, sizeof(*s) + padded);
+	s->tag = tag;
+	s->size = padded;
+	sc->total_size += sizeof(*s) + padded;
+	sc->sections |= VBSD_SECTION_MASK(tag);
+	return s + 1;
+}
+
+/* Number of parts[] entries of a LoadKernel() call which hold data */
+static uint32_t KernelPartsUsed(const VbSharedDataKernelCall *shc)
+{
+	return shc->kernel_parts_found < VBSD_MAX_KERNEL_PARTS ?
+		shc->kernel_parts_found : VBSD_MAX_KERNEL_PARTS;
+}
+
+int VbSharedDataPack(const VbSharedDataHeader *header, uint32_t sections,
+		     void *buf, uint32_t *size)
+{
+	VbSharedDataCompact *sc = (VbSharedDataCompact *)buf;
+	uint8_t *p;
+	uint32_t calls, count, len, i;
+
+	if (!header || header->magic != VB_SHARED_DATA_MAGIC)
+		return VBOOT_SHARED_DATA_INVALID;
+	if (!buf || !size || *size < sizeof(*sc))
+		return VBOOT_SHARED_DATA_INVALID;
+
+	memset(sc, 0, sizeof(*sc));
+	sc->magic = VB_SHARED_DATA_COMPACT_MAGIC;
+	sc->struct_version = VB_SHARED_DATA_COMPACT_VERSION;
+	sc->core_size = sizeof(*sc);
+	sc->total_size = sizeof(*sc);
+	sc->flags = header->flags;
+	sc->fw_version_tpm = header->fw_version_tpm;
+	sc->kernel_version_tpm = header->kernel_version_tpm;
+	sc->firmware_index = header->firmware_index;
+	if (header->struct_version >= 2)
+		sc->recovery_reason = header->recovery_reason;
+
+	calls = header->lk_call_count < VBSD_MAX_KERNEL_CALLS ?
+		header->lk_call_count : VBSD_MAX_KERNEL_CALLS;
+
+	/* The kernel selected is the good one from the last LoadKernel() */
+	if (header->lk_call_count) {
+		const VbSharedDataKernelCall *shc = header->lk_calls +
+			((header->lk_call_count - 1) &
+			 (VBSD_MAX_KERNEL_CALLS - 1));
+
+		for (i = 0; i < KernelPartsUsed(shc); i++) {
+			const VbSharedDataKernelPart *shp = shc->parts + i;
+
+			if (shp->check_result != VBSD_LKP_CHECK_KERNEL_GOOD)
+				continue;
+			sc->kernel_gpt_index = shp->gpt_index;
+			sc->kernel_version = shp->combined_version;
+			break;
+		}
+	}
+
+	if (sections & VBSD_SECTION_MASK(VBSD_SECTION_TIMERS)) {
+		VbSharedDataTimers *t = AddSection(sc, *size,
+						   VBSD_SECTION_TIMERS,
+						   sizeof(*t));
+		if (!t)
+			return VBOOT_SHARED_DATA_INVALID;
+		t->vb_init_enter = header->timer_vb_init_enter;
+		t->vb_init_exit = header->timer_vb_init_exit;
+		t->vb_select_firmware_enter =
+			header->timer_vb_select_firmware_enter;
+		t->vb_select_firmware_exit =
+			header->timer_vb_select_firmware_exit;
+		t->vb_select_and_load_kernel_enter =
+			header->timer_vb_select_and_load_kernel_enter;
+		t->vb_select_and_load_kernel_exit =
+			header->timer_vb_select_and_load_kernel_exit;
+	}
+
+	if (sections & VBSD_SECTION_MASK(VBSD_SECTION_LOAD_FIRMWARE)) {
+		VbSharedDataFirmwareInfo *f =
+			AddSection(sc, *size, VBSD_SECTION_LOAD_FIRMWARE,
+				   sizeof(*f));
+		if (!f)
+			return VBOOT_SHARED_DATA_INVALID;
+		f->check_fw_a_result = header->check_fw_a_result;
+		f->check_fw_b_result = header->check_fw_b_result;
+		f->fw_version_tpm_start = header->fw_version_tpm_start;
+		f->fw_version_lowest = header->fw_version_lowest;
+		if (header->struct_version >= 2)
+			f->fw_keyblock_flags = header->fw_keyblock_flags;
+	}
+
+	if ((sections & VBSD_SECTION_MASK(VBSD_SECTION_LOAD_KERNEL)) &&
+	    calls) {
+		VbSharedDataKernelInfo *k;
+
+		len = sizeof(*k);
+		for (i = 0; i < calls; i++)
+			len += VBSD_KERNEL_CALL_HEADER_SIZE +
+				KernelPartsUsed(header->lk_calls + i) *
+				sizeof(VbSharedDataKernelPart);
+		k = AddSection(sc, *size, VBSD_SECTION_LOAD_KERNEL, len);
+		if (!k)
+			return VBOOT_SHARED_DATA_INVALID;
+		k->lk_call_count = header->lk_call_count;
+		if (header->struct_version >= 2) {
+			k->kernel_version_tpm_start =
+				header->kernel_version_tpm_start;
+			k->kernel_version_lowest =
+				header->kernel_version_lowest;
+		}
+
+		/* Calls stay in their slots, trimmed to the parts used */
+		p = (uint8_t *)(k + 1);
+		for (i = 0; i < calls; i++) {
+			const VbSharedDataKernelCall *shc = header->lk_calls + i;
+
+			len = VBSD_KERNEL_CALL_HEADER_SIZE +
+				KernelPartsUsed(shc) *
+				sizeof(VbSharedDataKernelPart);
+			memcpy(p, shc, len);
+			p += len;
+		}
+	}
+
+	if ((sections & VBSD_SECTION_MASK(VBSD_SECTION_TIMESTAMPS)) &&
+	    header->struct_version >= 3 && header->timestamp_count) {
+		VbSharedDataLogCount *c;
+
+		count = header->timestamp_count < VBSD_MAX_TIMESTAMPS ?
+			header->timestamp_count : VBSD_MAX_TIMESTAMPS;
+		len = count * sizeof(VbSharedDataTimestamp);
+		c = AddSection(sc, *size, VBSD_SECTION_TIMESTAMPS,
+			       sizeof(*c) + len);
+		if (!c)
+			return VBOOT_SHARED_DATA_INVALID;
+		c->count = header->timestamp_count;
+		memcpy(c + 1, header->timestamps, len);
+	}
+
+	if ((sections & VBSD_SECTION_MASK(VBSD_SECTION_TPM_STATS)) &&
+	    header->struct_version >= 4 && header->tpm_stats_count) {
+		VbSharedDataLogCount *c;
+
+		count = header->tpm_stats_count < VBSD_MAX_TPM_STATS ?
+			header->tpm_stats_count : VBSD_MAX_TPM_STATS;
+		len = count * sizeof(VbSharedDataTpmStats);
+		c = AddSection(sc, *size, VBSD_SECTION_TPM_STATS,
+			       sizeof(*c) + len);
+		if (!c)
+			return VBOOT_SHARED_DATA_INVALID;
+		c->count = count;
+		memcpy(c + 1, header->tpm_stats, len);
+	}
+
+	*size = sc->total_size;
+	return VBOOT_SUCCESS;
+}
+
 int vb2_allow_recovery(struct vb2_context *ctx)
 {
 	/* GBB_FLAG_FORCE_MANUAL_RECOVERY forces this to always return true. */
@@ -19,10 +19,60 @@
 #include "vboot_api.h"
 #include "vboot_common.h"
 #include "vboot_display.h"
+#include "vboot_kernel.h"
 
 static uint32_t disp_current_screen = VB_SCREEN_BLANK;
 static uint32_t disp_current_index = 0;
 static uint32_t disp_disabled_idx_mask = 0;
+/* Locale of the displayed menu, or -1 if the screen isn't a menu */
+static uint32_t disp_menu_locale = -1;
+
+/* Screens and locale last passed to VbExDisplayPrepare() */
+static const uint32_t *disp_prepared_screens;
+static uint32_t disp_prepared_count;
+static uint32_t disp_prepared_locale;
+
+/* Bit for a menu item in a disabled or dirty mask */
+#define MENU_ITEM_BIT(index) ((index) < 32 ? 1U << (index) : 0)
+
+/* Screens each boot mode may show; EC software sync may show the WAIT one */
+static const uint32_t normal_screens[] = {
+	VB_SCREEN_WAIT,
+};
+
+static const uint32_t developer_screens[] = {
+	VB_SCREEN_WAIT,
+	VB_SCREEN_DEVELOPER_WARNING,
+	VB_SCREEN_DEVELOPER_TO_NORM,
+	VB_SCREEN_TO_NORM_CONFIRMED,
+};
+
+static const uint32_t developer_menu_screens[] = {
+	VB_SCREEN_WAIT,
+	VB_SCREEN_DEVELOPER_WARNING_MENU,
+	VB_SCREEN_DEVELOPER_MENU,
+	VB_SCREEN_DEVELOPER_TO_NORM_MENU,
+	VB_SCREEN_TO_NORM_CONFIRMED,
+	VB_SCREEN_LANGUAGES_MENU,
+	VB_SCREEN_OPTIONS_MENU,
+};
+
+static const uint32_t recovery_screens[] = {
+	VB_SCREEN_RECOVERY_INSERT,
+	VB_SCREEN_RECOVERY_NO_GOOD,
+	VB_SCREEN_RECOVERY_TO_DEV,
+	VB_SCREEN_OS_BROKEN,
+};
+
+static const uint32_t recovery_menu_screens[] = {
+	VB_SCREEN_RECOVERY_INSERT,
+	VB_SCREEN_RECOVERY_NO_GOOD,
+	VB_SCREEN_RECOVERY_TO_DEV_MENU,
+	VB_SCREEN_OS_BROKEN,
+	VB_SCREEN_TO_NORM_CONFIRMED,
+	VB_SCREEN_LANGUAGES_MENU,
+	VB_SCREEN_OPTIONS_MENU,
+};
 
 __attribute__((weak))
 VbError_t VbExGetLocalizationCount(uint32_t *count) {
@@ -30,6 +80,63 @@ VbError_t VbExGetLocalizationCount(uint32_t *count) {
 	return VBERROR_UNKNOWN;
 }
 
+__attribute__((weak))
+VbError_t VbExDisplayMenuItems(uint32_t screen_type, uint32_t locale,
+			       uint32_t selected_index,
+			       uint32_t disabled_idx_mask,
+			       uint32_t dirty_idx_mask)
+{
+	return VbExDisplayMenu(screen_type, locale, selected_index,
+			       disabled_idx_mask, 0);
+}
+
+__attribute__((weak))
+VbError_t VbExDisplayPrepare(uint32_t locale, const uint32_t *screens,
+			     uint32_t screen_count)
+{
+	return VBERROR_SUCCESS;
+}
+
+static void prepare_screens(uint32_t locale)
+{
+	VbError_t rv;
+
+	disp_prepared_locale = locale;
+	rv = VbExDisplayPrepare(locale, disp_prepared_screens,
+				disp_prepared_count);
+	if (rv)
+		VB2_DEBUG("VbExDisplayPrepare() returned %#x\n", rv);
+}
+
+void VbDisplayPrepare(struct vb2_context *ctx, int menu_ui)
+{
+	if (ctx->flags & VB2_CONTEXT_RECOVERY_MODE) {
+		disp_prepared_screens = menu_ui ? recovery_menu_screens :
+			recovery_screens;
+		disp_prepared_count = menu_ui ?
+			ARRAY_SIZE(recovery_menu_screens) :
+			ARRAY_SIZE(recovery_screens);
+	} else if (ctx->flags & VB2_CONTEXT_DEVELOPER_MODE) {
+		disp_prepared_screens = menu_ui ? developer_menu_screens :
+			developer_screens;
+		disp_prepared_count = menu_ui ?
+			ARRAY_SIZE(developer_menu_screens) :
+			ARRAY_SIZE(developer_screens);
+	} else {
+		disp_prepared_screens = normal_screens;
+		disp_prepared_count = ARRAY_SIZE(normal_screens);
+	}
+
+	prepare_screens(vb2_nv_get(ctx, VB2_NV_LOCALIZATION_INDEX));
+}
+
+/* Tell the platform again if the locale has changed since it was told */
+static void check_prepared_locale(uint32_t locale)
+{
+	if (disp_prepared_screens && locale != disp_prepared_locale)
+		prepare_screens(locale);
+}
+
 VbError_t VbDisplayScreen(struct vb2_context *ctx, uint32_t screen, int force)
 {
 	uint32_t locale;
@@ -41,12 +148,15 @@ VbError_t VbDisplayScreen(struct vb2_context *ctx, uint32_t screen, int force)
 
 	/* Read the locale last saved */
 	locale = vb2_nv_get(ctx, VB2_NV_LOCALIZATION_INDEX);
+	check_prepared_locale(locale);
 
 	rv = VbExDisplayScreen(screen, locale);
 
-	if (rv == VBERROR_SUCCESS)
+	if (rv == VBERROR_SUCCESS) {
 		/* Keep track of the currently displayed screen */
 		disp_current_screen = screen;
+		disp_menu_locale = -1;
+	}
 
 	return rv;
 }
@@ -57,6 +167,7 @@ VbError_t VbDisplayMenu(struct vb2_context *ctx, uint32_t screen, int force,
 	uint32_t locale;
 	VbError_t rv;
 	uint32_t redraw_base_screen = 0;
+	uint32_t dirty_idx_mask;
 
 	/*
 	 * If requested screen/selected_index is the same as the current one,
@@ -76,9 +187,23 @@ VbError_t VbDisplayMenu(struct vb2_context *ctx, uint32_t screen, int force,
 
 	/* Read the locale last saved */
 	locale = vb2_nv_get(ctx, VB2_NV_LOCALIZATION_INDEX);
+	check_prepared_locale(locale);
 
-	rv = VbExDisplayMenu(screen, locale, selected_index,
-			     disabled_idx_mask, redraw_base_screen);
+	/*
+	 * If this menu is already displayed, only the items which were or are
+	 * now selected or disabled need redrawing.
+	 */
+	if (disp_current_screen == screen && disp_menu_locale == locale &&
+	    !force) {
+		dirty_idx_mask = MENU_ITEM_BIT(disp_current_index) |
+			MENU_ITEM_BIT(selected_index) |
+			(disp_disabled_idx_mask ^ disabled_idx_mask);
+		rv = VbExDisplayMenuItems(screen, locale, selected_index,
+					  disabled_idx_mask, dirty_idx_mask);
+	} else {
+		rv = VbExDisplayMenu(screen, locale, selected_index,
+				     disabled_idx_mask, redraw_base_screen);
+	}
 
 	if (rv == VBERROR_SUCCESS) {
 		/*
@@ -88,6 +213,10 @@ VbError_t VbDisplayMenu(struct vb2_context *ctx, uint32_t screen, int force,
 		disp_current_screen = screen;
 		disp_current_index = selected_index;
 		disp_disabled_idx_mask = disabled_idx_mask;
+		disp_menu_locale = locale;
+	} else {
+		/* Don't trust what's on screen now */
+		disp_menu_locale = -1;
 	}
 
 	return rv;
@@ -452,10 +581,7 @@ VbError_t VbCheckDisplayKey(struct vb2_context *ctx, uint32_t key)
 		 * This is not an example of the Right Way to do things.  See
 		 * chrome-os-partner:7689.
 		 */
-		if (ctx->flags & VB2_CONTEXT_NVDATA_CHANGED) {
-			VbExNvStorageWrite(ctx.nvdata);
-			ctx.flags &= ~VB2_CONTEXT_NVDATA_CHANGED;
-		}
+		vb2_nv_commit(ctx);
 #endif
 
 		/* Force redraw of current screen */
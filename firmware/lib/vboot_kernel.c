@@ -12,6 +12,7 @@
 #include "2common.h"
 #include "2misc.h"
 #include "2nvstorage.h"
+#include "2pipeline.h"
 #include "2rsa.h"
 #include "2sha.h"
 #include "cgptlib.h"
@@ -29,6 +30,54 @@
 
 #define LOWEST_TPM_VERSION 0xffffffff
 
+__attribute__((weak))
+VbError_t VbExStreamOpenWithHints(VbExDiskHandle_t handle, uint64_t lba_start,
+				  uint64_t lba_count, uint32_t flags,
+				  uint64_t expected_bytes,
+				  VbExStream_t *stream)
+{
+	return VbExStreamOpen(handle, lba_start, lba_count, stream);
+}
+
+__attribute__((weak))
+VbError_t VbExStreamReadAsync(VbExStream_t stream, uint32_t bytes,
+			      void *buffer)
+{
+	return VbExStreamRead(stream, bytes, buffer);
+}
+
+__attribute__((weak))
+VbError_t VbExStreamWait(VbExStream_t stream)
+{
+	return VBERROR_SUCCESS;
+}
+
+__attribute__((weak))
+VbError_t VbExStreamSkip(VbExStream_t stream, uint32_t bytes)
+{
+	return VBERROR_STREAM_SKIP_UNSUPPORTED;
+}
+
+__attribute__((weak))
+VbError_t VbExDecompressStart(uint32_t compression, void *outbuf,
+			      uint32_t outbuf_size, VbExDecompressor_t *dp)
+{
+	return VBERROR_DECOMPRESS_UNSUPPORTED;
+}
+
+__attribute__((weak))
+VbError_t VbExDecompressFeed(VbExDecompressor_t d, const void *inbuf,
+			     uint32_t in_size)
+{
+	return VBERROR_DECOMPRESS_UNSUPPORTED;
+}
+
+__attribute__((weak))
+VbError_t VbExDecompressFinish(VbExDecompressor_t d, uint32_t *out_size)
+{
+	return VBERROR_DECOMPRESS_UNSUPPORTED;
+}
+
 enum vboot_mode {
 	kBootRecovery = 0,  /* Recovery firmware, any dev switch position */
 	kBootNormal = 1,    /* Normal boot - kernel must be verified */
@@ -115,6 +164,141 @@ static uint32_t get_body_offset(uint8_t *kbuf)
 		get_preamble(kbuf)->preamble_size);
 }
 
+/* Number of verified vblocks remembered across LoadKernel() calls */
+#define VBLOCK_CACHE_ENTRIES 8
+
+/* A vblock whose keyblock and preamble signatures have been verified */
+struct vblock_cache_entry {
+	VbExDiskHandle_t disk_handle;
+	uint8_t guid[16];
+	/* SHA-256 of the kernel subkey and the vblock */
+	uint8_t digest[VB2_SHA256_DIGEST_SIZE];
+};
+
+struct vblock_cache {
+	/* Number of entries added; once full, the oldest entry is replaced */
+	uint32_t count;
+	struct vblock_cache_entry entries[VBLOCK_CACHE_ENTRIES];
+};
+
+/**
+ * Allocate the vblock verification cache in the work buffer, if it hasn't
+ * been yet.
+ *
+ * This must be called before any temporary work buffer allocations, since
+ * the cache stays allocated for the rest of the boot.
+ *
+ * @param ctx		Vboot context
+ */
+static void init_vblock_cache(struct vb2_context *ctx)
+{
+	struct vb2_shared_data *sd = vb2_get_sd(ctx);
+	struct vblock_cache *cache;
+	struct vb2_workbuf wb;
+
+	if (sd->workbuf_vblock_cache_size)
+		return;
+
+	/* Nowhere to keep it if the context hasn't been initialized */
+	if (!ctx->workbuf_used)
+		return;
+
+	vb2_workbuf_from_ctx(ctx, &wb);
+	cache = vb2_workbuf_alloc(&wb, sizeof(*cache));
+	if (!cache)
+		return;
+
+	memset(cache, 0, sizeof(*cache));
+	sd->workbuf_vblock_cache_offset = vb2_offset_of(ctx->workbuf, cache);
+	sd->workbuf_vblock_cache_size = sizeof(*cache);
+	vb2_set_workbuf_used(ctx, sd->workbuf_vblock_cache_offset +
+			     sizeof(*cache));
+}
+
+/**
+ * Return the vblock verification cache.
+ *
+ * @param ctx		Vboot context
+ * @return The cache, or NULL if it hasn't been allocated.
+ */
+static struct vblock_cache *get_vblock_cache(struct vb2_context *ctx)
+{
+	struct vb2_shared_data *sd = vb2_get_sd(ctx);
+
+	if (!sd->workbuf_vblock_cache_size)
+		return NULL;
+
+	return (struct vblock_cache *)
+		(ctx->workbuf + sd->workbuf_vblock_cache_offset);
+}
+
+/**
+ * Calculate the digest which identifies a vblock in the verification cache.
+ *
+ * This must be called before the vblock is verified, since verification
+ * overwrites the signatures.  The keyblock and preamble sizes have not been
+ * checked yet, so this only trusts them as far as the buffer bounds.
+ *
+ * @param kbuf		Buffer containing the vblock
+ * @param kbuf_size	Size of the buffer in bytes
+ * @param kernel_subkey	Packed kernel subkey used to verify the keyblock
+ * @param digest	Destination for the SHA-256 digest
+ * @return VB2_SUCCESS, or non-zero if the vblock can't be cached.
+ */
+static int vblock_cache_digest(const uint8_t *kbuf, uint32_t kbuf_size,
+			       const struct vb2_packed_key *kernel_subkey,
+			       uint8_t *digest)
+{
+	const struct vb2_keyblock *keyblock =
+		(const struct vb2_keyblock *)kbuf;
+	const struct vb2_kernel_preamble *preamble;
+	struct vb2_digest_context dc;
+	uint32_t kb_size = keyblock->keyblock_size;
+
+	if (kb_size < sizeof(*keyblock) ||
+	    kb_size > kbuf_size - sizeof(*preamble))
+		return VB2_ERROR_UNKNOWN;
+
+	preamble = (const struct vb2_kernel_preamble *)(kbuf + kb_size);
+	if (preamble->preamble_size < sizeof(*preamble) ||
+	    preamble->preamble_size > kbuf_size - kb_size)
+		return VB2_ERROR_UNKNOWN;
+
+	if (vb2_digest_init(&dc, VB2_HASH_SHA256) ||
+	    vb2_digest_extend(&dc, (const uint8_t *)kernel_subkey,
+			      sizeof(*kernel_subkey)) ||
+	    vb2_digest_extend(&dc, vb2_packed_key_data(kernel_subkey),
+			      kernel_subkey->key_size) ||
+	    vb2_digest_extend(&dc, kbuf, kb_size + preamble->preamble_size) ||
+	    vb2_digest_finalize(&dc, digest, VB2_SHA256_DIGEST_SIZE))
+		return VB2_ERROR_UNKNOWN;
+
+	return VB2_SUCCESS;
+}
+
+/**
+ * Look up a vblock in the verification cache.
+ *
+ * @param cache		Verification cache
+ * @param entry		Entry to look for
+ * @return 1 if the vblock was already verified, 0 if not.
+ */
+static int vblock_cache_find(const struct vblock_cache *cache,
+			     const struct vblock_cache_entry *entry)
+{
+	uint32_t count = cache->count;
+	uint32_t i;
+
+	if (count > VBLOCK_CACHE_ENTRIES)
+		count = VBLOCK_CACHE_ENTRIES;
+
+	for (i = 0; i < count; i++) {
+		if (!memcmp(cache->entries + i, entry, sizeof(*entry)))
+			return 1;
+	}
+	return 0;
+}
+
 /**
  * Verify a kernel vblock.
  *
@@ -122,6 +306,7 @@ static uint32_t get_body_offset(uint8_t *kbuf)
  * @param kbuf_size	Size of the buffer in bytes
  * @param kernel_subkey	Packed kernel subkey to use in validating keyblock
  * @param params	Load kernel parameters
+ * @param guid		Unique GUID of the partition (16 bytes)
  * @param min_version	Minimum kernel version
  * @param shpart	Destination for verification results
  * @param wb		Work buffer.  Must be at least
@@ -133,22 +318,54 @@ int vb2_verify_kernel_vblock(struct vb2_context *ctx,
 			     uint32_t kbuf_size,
 			     const struct vb2_packed_key *kernel_subkey,
 			     const LoadKernelParams *params,
+			     const uint8_t *guid,
 			     uint32_t min_version,
 			     VbSharedDataKernelPart *shpart,
 			     struct vb2_workbuf *wb)
 {
+	struct vblock_cache *cache = get_vblock_cache(ctx);
+	struct vblock_cache_entry entry;
+	int cached = 0;
+	int rv;
+
 	/* Unpack kernel subkey */
 	struct vb2_public_key kernel_subkey2;
-	if (VB2_SUCCESS != vb2_unpack_key(&kernel_subkey2, kernel_subkey)) {
+	if (VB2_SUCCESS != vb2_unpack_key_cached(ctx, &kernel_subkey2,
+						 kernel_subkey)) {
 		VB2_DEBUG("Unable to unpack kernel subkey\n");
 		return VB2_ERROR_VBLOCK_KERNEL_SUBKEY;
 	}
 
+	/*
+	 * If this exact vblock was already verified with the same subkey,
+	 * skip the signature checks.  Everything else, including rollback,
+	 * is still checked since it depends on the current boot state.
+	 */
+	if (cache) {
+		memset(&entry, 0, sizeof(entry));
+		entry.disk_handle = params->disk_handle;
+		memcpy(entry.guid, guid, sizeof(entry.guid));
+		if (vblock_cache_digest(kbuf, kbuf_size, kernel_subkey,
+					entry.digest))
+			cache = NULL;
+		else
+			cached = vblock_cache_find(cache, &entry);
+	}
+
 	/* Verify the key block. */
 	int keyblock_valid = 1;  /* Assume valid */
 	struct vb2_keyblock *keyblock = get_keyblock(kbuf);
-	if (VB2_SUCCESS != vb2_verify_keyblock(keyblock, kbuf_size,
-					       &kernel_subkey2, wb)) {
+	if (cached) {
+		VB2_DEBUG("Vblock already verified.\n");
+		shpart->flags |= VBSD_LKP_FLAG_VBLOCK_CACHED;
+		rv = VB2_SUCCESS;
+	} else {
+		vb2_timestamp(ctx, VB2_TS_RSA_VERIFY_START);
+		rv = vb2_verify_keyblock(keyblock, kbuf_size, &kernel_subkey2,
+					 wb);
+		vb2_timestamp(ctx, VB2_TS_RSA_VERIFY_END);
+	}
+	if (VB2_SUCCESS != rv) {
 		VB2_DEBUG("Verifying key block signature failed.\n");
 		shpart->check_result = VBSD_LKP_CHECK_KEY_BLOCK_SIG;
 		keyblock_valid = 0;
@@ -160,6 +377,9 @@ int vb2_verify_kernel_vblock(struct vb2_context *ctx,
 			return VB2_ERROR_VBLOCK_SELF_SIGNED;
 		}
 
+		/* Can't cache a keyblock which isn't signed */
+		cache = NULL;
+
 		/* Otherwise, allow the kernel if the key block hash is valid */
 		if (VB2_SUCCESS !=
 		    vb2_verify_keyblock_hash(keyblock, kbuf_size, wb)) {
@@ -251,14 +471,26 @@ int vb2_verify_kernel_vblock(struct vb2_context *ctx,
 
 	/* Verify the preamble, which follows the key block */
 	struct vb2_kernel_preamble *preamble = get_preamble(kbuf);
-	if (VB2_SUCCESS !=
-	    vb2_verify_kernel_preamble(preamble,
-				       kbuf_size - keyblock->keyblock_size,
-				       &data_key,
-				       wb)) {
-		VB2_DEBUG("Preamble verification failed.\n");
-		shpart->check_result = VBSD_LKP_CHECK_VERIFY_PREAMBLE;
-		return VB2_ERROR_UNKNOWN;
+	if (!cached) {
+		vb2_timestamp(ctx, VB2_TS_RSA_VERIFY_START);
+		rv = vb2_verify_kernel_preamble(preamble,
+						kbuf_size -
+						keyblock->keyblock_size,
+						&data_key, wb);
+		vb2_timestamp(ctx, VB2_TS_RSA_VERIFY_END);
+		if (VB2_SUCCESS != rv) {
+			VB2_DEBUG("Preamble verification failed.\n");
+			shpart->check_result = VBSD_LKP_CHECK_VERIFY_PREAMBLE;
+			return VB2_ERROR_UNKNOWN;
+		}
+
+		/* Both signatures are good, so remember this vblock */
+		if (cache) {
+			memcpy(cache->entries + (cache->count %
+						 VBLOCK_CACHE_ENTRIES),
+			       &entry, sizeof(entry));
+			cache->count++;
+		}
 	}
 
 	/*
@@ -294,11 +526,488 @@ enum vb2_load_partition_flags {
 	VB2_LOAD_PARTITION_VBLOCK_ONLY = (1 << 0),
 };
 
-#define KBUF_SIZE 65536  /* Bytes to read at start of kernel partition */
+/*
+ * Bytes to read at start of kernel partition, before the vblock says how big
+ * it is.  This holds the keyblock and signed preamble of normal kernels.
+ */
+#define VBLOCK_INITIAL_READ 4096
 
 /* Minimum context work buffer size needed for vb2_load_partition() */
 #define VB2_LOAD_PARTITION_WORKBUF_BYTES	\
-	(VB2_VERIFY_KERNEL_PREAMBLE_WORKBUF_BYTES + KBUF_SIZE)
+	(VB2_VERIFY_KERNEL_PREAMBLE_WORKBUF_BYTES + VBLOCK_INITIAL_READ)
+
+/* Round size up to a whole number of sectors */
+static uint64_t round_to_sectors(uint64_t size, uint32_t sector_bytes)
+{
+	return (size + sector_bytes - 1) / sector_bytes * sector_bytes;
+}
+
+/**
+ * Grow the vblock buffer, and read more of the vblock into it.
+ *
+ * The buffer must be the last allocation from wb.  Space past what has been
+ * read is zeroed.  If the buffer can't grow that big, it is left alone, and
+ * verifying the vblock will reject the sizes which asked for it.
+ *
+ * @param stream	Stream to read from
+ * @param sector_bytes	Bytes per sector; reads are whole sectors
+ * @param wb		Work buffer kbuf was allocated from
+ * @param kbuf		Vblock buffer
+ * @param kbuf_size	Size of kbuf; updated on exit
+ * @param kbuf_read	Bytes of the partition read into kbuf; updated on exit
+ * @param want_size	Size kbuf should have
+ * @param want_read	Bytes of the partition kbuf should hold
+ * @return VB2_SUCCESS, or non-zero error code if the read failed.
+ */
+static int grow_vblock(VbExStream_t stream, uint32_t sector_bytes,
+		       struct vb2_workbuf *wb, uint8_t *kbuf,
+		       uint32_t *kbuf_size, uint32_t *kbuf_read,
+		       uint64_t want_size, uint64_t want_read)
+{
+	uint64_t size = round_to_sectors(want_size, sector_bytes);
+	uint64_t read = round_to_sectors(want_read, sector_bytes);
+
+	if (size > UINT32_MAX)
+		return VB2_SUCCESS;
+	if (size > *kbuf_size) {
+		if (!vb2_workbuf_realloc(wb, *kbuf_size, size)) {
+			/* Put back the buffer we had; it stays where it was */
+			vb2_workbuf_alloc(wb, *kbuf_size);
+			return VB2_SUCCESS;
+		}
+		*kbuf_size = size;
+	}
+
+	if (read > *kbuf_size)
+		read = *kbuf_size;
+	if (read > *kbuf_read) {
+		if (VbExStreamRead(stream, read - *kbuf_read,
+				   kbuf + *kbuf_read))
+			return VB2_ERROR_LOAD_PARTITION_READ_VBLOCK;
+		*kbuf_read = read;
+	}
+
+	memset(kbuf + *kbuf_read, 0, *kbuf_size - *kbuf_read);
+	return VB2_SUCCESS;
+}
+
+/**
+ * Skip data in a stream.
+ *
+ * If the stream can't skip by itself, the data is read into a scratch buffer
+ * and dropped.
+ *
+ * @param stream	Stream to skip data in
+ * @param bytes		Bytes to skip; a whole number of sectors
+ * @param scratch	Buffer to read skipped data into
+ * @param scratch_size	Size of scratch; at least one sector
+ * @param sector_bytes	Bytes per sector
+ * @return VBERROR_SUCCESS, or non-zero error code.
+ */
+static VbError_t stream_skip(VbExStream_t stream, uint32_t bytes,
+			     uint8_t *scratch, uint32_t scratch_size,
+			     uint32_t sector_bytes)
+{
+	VbError_t rv;
+
+	if (!bytes)
+		return VBERROR_SUCCESS;
+
+	rv = VbExStreamSkip(stream, bytes);
+	if (rv != VBERROR_STREAM_SKIP_UNSUPPORTED)
+		return rv;
+
+	scratch_size -= scratch_size % sector_bytes;
+	while (bytes) {
+		uint32_t size = bytes < scratch_size ? bytes : scratch_size;
+
+		rv = VbExStreamRead(stream, size, scratch);
+		if (rv)
+			return rv;
+		bytes -= size;
+	}
+	return VBERROR_SUCCESS;
+}
+
+/**
+ * Read a vblock from the start of a partition.
+ *
+ * Only the keyblock and the signed part of the preamble are read.  The rest
+ * of the preamble is padding, which is zeroed in the buffer instead.  The
+ * sizes used here have not been checked yet; vb2_verify_kernel_vblock() does
+ * that.
+ *
+ * @param stream	Stream to read from
+ * @param sector_bytes	Bytes per sector
+ * @param wb		Work buffer to allocate the vblock from
+ * @param kbuf_ptr	Vblock buffer stored here on exit
+ * @param kbuf_size	Size of vblock buffer stored here on exit
+ * @param kbuf_read	Bytes of the partition read stored here on exit
+ * @return VB2_SUCCESS, or non-zero error code.
+ */
+static int read_vblock(VbExStream_t stream, uint32_t sector_bytes,
+		       struct vb2_workbuf *wb, uint8_t **kbuf_ptr,
+		       uint32_t *kbuf_size, uint32_t *kbuf_read)
+{
+	const struct vb2_kernel_preamble *preamble;
+	const struct vb2_signature *sig;
+	uint64_t keyblock_size, signed_size;
+	uint8_t *kbuf;
+	int rv;
+
+	*kbuf_size = round_to_sectors(VBLOCK_INITIAL_READ, sector_bytes);
+	*kbuf_read = 0;
+	kbuf = vb2_workbuf_alloc(wb, *kbuf_size);
+	if (!kbuf)
+		return VB2_ERROR_LOAD_PARTITION_WORKBUF;
+	*kbuf_ptr = kbuf;
+
+	rv = grow_vblock(stream, sector_bytes, wb, kbuf, kbuf_size, kbuf_read,
+			 *kbuf_size, *kbuf_size);
+	if (rv)
+		return rv;
+
+	/* Make sure the preamble header is there */
+	keyblock_size = get_keyblock(kbuf)->keyblock_size;
+	rv = grow_vblock(stream, sector_bytes, wb, kbuf, kbuf_size, kbuf_read,
+			 keyblock_size + sizeof(*preamble),
+			 keyblock_size + sizeof(*preamble));
+	if (rv || keyblock_size + sizeof(*preamble) > *kbuf_size)
+		return rv;
+
+	/* Then the rest of what the preamble signature covers */
+	preamble = (const struct vb2_kernel_preamble *)(kbuf + keyblock_size);
+	sig = &preamble->preamble_signature;
+	signed_size = VB2_MAX((uint64_t)sig->data_size,
+			      vb2_offset_of(preamble, sig) +
+			      (uint64_t)sig->sig_offset + sig->sig_size);
+	return grow_vblock(stream, sector_bytes, wb, kbuf, kbuf_size,
+			   kbuf_read, keyblock_size + preamble->preamble_size,
+			   keyblock_size + signed_size);
+}
+
+static int stream_read(struct vb2_pipeline_source *src, uint8_t *buf,
+		       uint32_t size)
+{
+	return VbExStreamRead((VbExStream_t)src->arg, size, buf);
+}
+
+static int stream_read_start(struct vb2_pipeline_source *src, uint8_t *buf,
+			     uint32_t size)
+{
+	return VbExStreamReadAsync((VbExStream_t)src->arg, size, buf);
+}
+
+static int stream_read_wait(struct vb2_pipeline_source *src)
+{
+	return VbExStreamWait((VbExStream_t)src->arg);
+}
+
+/**
+ * Initialize a pipeline source which reads from a stream.
+ *
+ * @param src		Source to initialize
+ * @param stream	Stream to read from
+ * @param async		Use VbExStreamReadAsync() so reads overlap hashing
+ */
+static void stream_source(struct vb2_pipeline_source *src,
+			  VbExStream_t stream, int async)
+{
+	memset(src, 0, sizeof(*src));
+	src->read = stream_read;
+	if (async) {
+		src->read_start = stream_read_start;
+		src->read_wait = stream_read_wait;
+	}
+	src->arg = stream;
+}
+
+/**
+ * Read the rest of a kernel body and hash it as it streams in.
+ *
+ * Each chunk is hashed as soon as it is read, while it is still in cache, so
+ * the body does not need a second pass through vb2_verify_kernel_body().
+ * Reads use VbExStreamReadAsync(), so the next chunk can load while this one
+ * hashes.
+ *
+ * @param stream	Stream to read kernel body from
+ * @param chunk_size	Maximum bytes to read per stream read call
+ * @param kernbuf	Kernel body buffer
+ * @param body_copied	Bytes at start of kernbuf already read with the vblock
+ * @param preamble	Kernel preamble with the body signature
+ * @param data_key	Key to verify body signature
+ * @param shpart	Destination for verification results
+ * @param wb		Work buffer
+ * @return VB2_SUCCESS, or non-zero error code.
+ */
+static int vb2_load_body_chunked(VbExStream_t stream,
+				 uint32_t chunk_size,
+				 uint8_t *kernbuf,
+				 uint32_t body_copied,
+				 struct vb2_kernel_preamble *preamble,
+				 const struct vb2_public_key *data_key,
+				 VbSharedDataKernelPart *shpart,
+				 const struct vb2_workbuf *wb)
+{
+	struct vb2_signature *sig = &preamble->body_signature;
+	struct vb2_workbuf wblocal = *wb;
+	struct vb2_pipeline_source src;
+	struct vb2_pipeline pipe;
+	struct vb2_digest_context *dc;
+	uint32_t digest_size = vb2_digest_size(data_key->hash_alg);
+	uint8_t *digest;
+
+	if (!digest_size) {
+		shpart->check_result = VBSD_LKP_CHECK_VERIFY_DATA;
+		return VB2_ERROR_LOAD_PARTITION_VERIFY_BODY;
+	}
+
+	digest = vb2_workbuf_alloc(&wblocal, digest_size);
+	dc = vb2_workbuf_alloc(&wblocal, sizeof(*dc));
+	if (!digest || !dc)
+		return VB2_ERROR_LOAD_PARTITION_WORKBUF;
+
+	if (vb2_kernel_body_digest_init(dc, preamble, data_key->hash_alg)) {
+		shpart->check_result = VBSD_LKP_CHECK_VERIFY_DATA;
+		return VB2_ERROR_LOAD_PARTITION_VERIFY_BODY;
+	}
+
+	/* Chunks are read straight into kernbuf, so no extra buffers needed */
+	stream_source(&src, stream, 1);
+	vb2_pipeline_init(&pipe, &src, chunk_size, dc, kernbuf + body_copied);
+
+	if (vb2_pipeline_extend(&pipe, kernbuf, body_copied) ||
+	    vb2_pipeline_run(&pipe, sig->data_size - body_copied)) {
+		if (pipe.failed == VB2_PIPELINE_SOURCE) {
+			VB2_DEBUG("Unable to read kernel data.\n");
+			shpart->check_result = VBSD_LKP_CHECK_READ_DATA;
+			return VB2_ERROR_LOAD_PARTITION_READ_BODY;
+		}
+		shpart->check_result = VBSD_LKP_CHECK_VERIFY_DATA;
+		return VB2_ERROR_LOAD_PARTITION_VERIFY_BODY;
+	}
+
+	if (vb2_kernel_body_digest_finalize(dc, digest, digest_size)) {
+		shpart->check_result = VBSD_LKP_CHECK_VERIFY_DATA;
+		return VB2_ERROR_LOAD_PARTITION_VERIFY_BODY;
+	}
+
+	vb2_workbuf_free(&wblocal, sizeof(*dc));
+
+	if (vb2_verify_digest(data_key, sig, digest, &wblocal)) {
+		VB2_DEBUG("Kernel data verification failed.\n");
+		shpart->check_result = VBSD_LKP_CHECK_VERIFY_DATA;
+		return VB2_ERROR_LOAD_PARTITION_VERIFY_BODY;
+	}
+
+	return VB2_SUCCESS;
+}
+
+/**
+ * Read the rest of a kernel body, checking each chunk against its digest.
+ *
+ * The preamble signature already covers the chunk digests, so this needs no
+ * RSA on the body, and a bad chunk stops the load as soon as it arrives.
+ * The next chunk is read with VbExStreamReadAsync() while this one hashes.
+ *
+ * @param stream	Stream to read kernel body from
+ * @param kernbuf	Kernel body buffer
+ * @param body_copied	Bytes at start of kernbuf already read with the vblock
+ * @param preamble	Verified kernel preamble, with body chunk digests
+ * @param data_key	Key the preamble was verified with
+ * @param shpart	Destination for verification results
+ * @return VB2_SUCCESS, or non-zero error code.
+ */
+static int vb2_load_body_digested(VbExStream_t stream,
+				  uint8_t *kernbuf,
+				  uint32_t body_copied,
+				  const struct vb2_kernel_preamble *preamble,
+				  const struct vb2_public_key *data_key,
+				  VbSharedDataKernelPart *shpart)
+{
+	uint32_t size = preamble->body_signature.data_size;
+	uint32_t chunk_size = vb2_kernel_get_body_chunk_size(preamble);
+	uint32_t count = vb2_kernel_get_body_chunk_count(preamble);
+	uint32_t have = body_copied;	/* Bytes of body in kernbuf */
+	uint32_t pending = 0;		/* Bytes being read after those */
+	uint32_t start, end, next_end;
+	uint32_t i;
+
+	for (i = 0, start = 0; i < count; i++, start = end) {
+		end = size - start > chunk_size ? start + chunk_size : size;
+
+		/* Finish loading this chunk */
+		if (pending) {
+			if (VbExStreamWait(stream))
+				goto read_error;
+			have += pending;
+			pending = 0;
+		}
+		if (have < end) {
+			if (VbExStreamRead(stream, end - have, kernbuf + have))
+				goto read_error;
+			have = end;
+		}
+
+		/* Start on the next one while this one is checked */
+		next_end = size - end > chunk_size ? end + chunk_size : size;
+		if (have < next_end) {
+			pending = next_end - have;
+			if (VbExStreamReadAsync(stream, pending,
+						kernbuf + have))
+				goto read_error;
+		}
+
+		if (vb2_verify_kernel_body_chunk(preamble, i, kernbuf + start,
+						 end - start,
+						 data_key->hash_alg)) {
+			VB2_DEBUG("Kernel body chunk %u failed.\n", i);
+			if (pending)
+				VbExStreamWait(stream);
+			shpart->check_result = VBSD_LKP_CHECK_VERIFY_DATA;
+			return VB2_ERROR_LOAD_PARTITION_VERIFY_BODY;
+		}
+	}
+
+	return VB2_SUCCESS;
+
+read_error:
+	VB2_DEBUG("Unable to read kernel data.\n");
+	shpart->check_result = VBSD_LKP_CHECK_READ_DATA;
+	return VB2_ERROR_LOAD_PARTITION_READ_BODY;
+}
+
+/* Compressed body read size, if the caller doesn't pick one */
+#define COMPRESSED_BODY_CHUNK_SIZE 16384
+
+static int decompress_consume(struct vb2_pipeline *pipe, const uint8_t *buf,
+			      uint32_t size)
+{
+	if (VbExDecompressFeed((VbExDecompressor_t)pipe->consume_arg,
+			       buf, size))
+		return VB2_ERROR_LOAD_PARTITION_VERIFY_BODY;
+
+	return VB2_SUCCESS;
+}
+
+/**
+ * Read the rest of a compressed kernel body, hashing and decompressing it
+ * as it streams in.
+ *
+ * The compressed body is read through a ring of two chunks in the work
+ * buffer, so each chunk is decompressed into kernbuf while the next one
+ * loads.  The body signature covers the compressed body, so it is checked
+ * at the end as usual; until then kernbuf holds untrusted data.
+ *
+ * @param stream	Stream to read kernel body from
+ * @param chunk_size	Bytes to read per stream read call, or 0 for default
+ * @param kernbuf	Destination for the decompressed body
+ * @param kernbuf_size	Size of kernbuf in bytes
+ * @param body_copied	Bytes at start of kernbuf already read with the vblock
+ * @param preamble	Verified kernel preamble, with a compressed body
+ * @param data_key	Key to verify body signature
+ * @param shpart	Destination for verification results
+ * @param wb		Work buffer
+ * @return VB2_SUCCESS, or non-zero error code.
+ */
+static int vb2_load_body_compressed(VbExStream_t stream,
+				    uint32_t chunk_size,
+				    uint8_t *kernbuf,
+				    uint32_t kernbuf_size,
+				    uint32_t body_copied,
+				    struct vb2_kernel_preamble *preamble,
+				    const struct vb2_public_key *data_key,
+				    VbSharedDataKernelPart *shpart,
+				    const struct vb2_workbuf *wb)
+{
+	struct vb2_workbuf wblocal = *wb;
+	struct vb2_signature *sig = &preamble->body_signature;
+	struct vb2_pipeline_source src;
+	struct vb2_pipeline pipe;
+	struct vb2_digest_context *dc;
+	uint32_t digest_size = vb2_digest_size(data_key->hash_alg);
+	VbExDecompressor_t d;
+	uint32_t ring_size, out_size;
+	uint8_t *digest, *ring;
+	int rv, finish_rv;
+
+	if (!chunk_size)
+		chunk_size = COMPRESSED_BODY_CHUNK_SIZE;
+	ring_size = 2 * chunk_size;
+	if (ring_size < body_copied)
+		ring_size = body_copied;
+
+	if (!digest_size) {
+		shpart->check_result = VBSD_LKP_CHECK_VERIFY_DATA;
+		return VB2_ERROR_LOAD_PARTITION_VERIFY_BODY;
+	}
+
+	digest = vb2_workbuf_alloc(&wblocal, digest_size);
+	dc = vb2_workbuf_alloc(&wblocal, sizeof(*dc));
+	ring = vb2_workbuf_alloc(&wblocal, ring_size);
+	if (!digest || !dc || !ring)
+		return VB2_ERROR_LOAD_PARTITION_WORKBUF;
+
+	if (vb2_kernel_body_digest_init(dc, preamble, data_key->hash_alg)) {
+		shpart->check_result = VBSD_LKP_CHECK_VERIFY_DATA;
+		return VB2_ERROR_LOAD_PARTITION_VERIFY_BODY;
+	}
+
+	if (VbExDecompressStart(vb2_kernel_get_compression(preamble),
+				kernbuf, kernbuf_size, &d)) {
+		VB2_DEBUG("Unable to decompress kernel body.\n");
+		shpart->check_result = VBSD_LKP_CHECK_VERIFY_DATA;
+		return VB2_ERROR_LOAD_PARTITION_VERIFY_BODY;
+	}
+
+	stream_source(&src, stream, 1);
+	vb2_pipeline_init(&pipe, &src, chunk_size, dc, ring);
+	pipe.sink_size = ring_size;
+	pipe.consume = decompress_consume;
+	pipe.consume_arg = d;
+
+	/*
+	 * The start of the body, read with the vblock, sits where the output
+	 * goes, so move it out of the way before decompressing it.
+	 */
+	memcpy(ring, kernbuf, body_copied);
+	rv = vb2_pipeline_extend(&pipe, ring, body_copied);
+	if (!rv)
+		rv = vb2_pipeline_run(&pipe, sig->data_size - body_copied);
+
+	finish_rv = VbExDecompressFinish(d, &out_size);
+	if (rv) {
+		if (pipe.failed == VB2_PIPELINE_SOURCE) {
+			VB2_DEBUG("Unable to read kernel data.\n");
+			shpart->check_result = VBSD_LKP_CHECK_READ_DATA;
+			return VB2_ERROR_LOAD_PARTITION_READ_BODY;
+		}
+		shpart->check_result = VBSD_LKP_CHECK_VERIFY_DATA;
+		return VB2_ERROR_LOAD_PARTITION_VERIFY_BODY;
+	}
+
+	if (finish_rv || out_size != vb2_kernel_get_body_load_size(preamble)) {
+		VB2_DEBUG("Kernel body decompressed to the wrong size.\n");
+		shpart->check_result = VBSD_LKP_CHECK_VERIFY_DATA;
+		return VB2_ERROR_LOAD_PARTITION_VERIFY_BODY;
+	}
+
+	if (vb2_kernel_body_digest_finalize(dc, digest, digest_size)) {
+		shpart->check_result = VBSD_LKP_CHECK_VERIFY_DATA;
+		return VB2_ERROR_LOAD_PARTITION_VERIFY_BODY;
+	}
+
+	vb2_workbuf_free(&wblocal, ring_size);
+	vb2_workbuf_free(&wblocal, sizeof(*dc));
+
+	if (vb2_verify_digest(data_key, sig, digest, &wblocal)) {
+		VB2_DEBUG("Kernel data verification failed.\n");
+		shpart->check_result = VBSD_LKP_CHECK_VERIFY_DATA;
+		return VB2_ERROR_LOAD_PARTITION_VERIFY_BODY;
+	}
+
+	return VB2_SUCCESS;
+}
 
 /**
  * Load and verify a partition from the stream.
@@ -308,6 +1017,7 @@ enum vb2_load_partition_flags {
  * @param kernel_subkey	Key to use to verify vblock
  * @param flags		Flags (one or more of vb2_load_partition_flags)
  * @param params	Load-kernel parameters
+ * @param guid		Unique GUID of the partition (16 bytes)
  * @param min_version	Minimum kernel version from TPM
  * @param shpart	Destination for verification results
  * @return VB2_SUCCESS, or non-zero error code.
@@ -317,27 +1027,34 @@ int vb2_load_partition(struct vb2_context *ctx,
 		       const struct vb2_packed_key *kernel_subkey,
 		       uint32_t flags,
 		       LoadKernelParams *params,
+		       const uint8_t *guid,
 		       uint32_t min_version,
 		       VbSharedDataKernelPart *shpart)
 {
 	struct vb2_workbuf wblocal;
-	vb2_workbuf_from_ctx(ctx, &wblocal);
+	int rv;
 
-	/* Allocate kernel header buffer in workbuf */
-	uint8_t *kbuf = vb2_workbuf_alloc(&wblocal, KBUF_SIZE);
-	if (!kbuf)
-		return VB2_ERROR_LOAD_PARTITION_WORKBUF;
+	vb2_workbuf_from_ctx(ctx, &wblocal);
 
+	uint32_t sector_bytes = (uint32_t)params->bytes_per_lba;
+	uint8_t *kbuf;
+	uint32_t kbuf_size, kbuf_read;
 
-	if (VbExStreamRead(stream, KBUF_SIZE, kbuf)) {
+	vb2_timestamp(ctx, VB2_TS_DISK_READ_START);
+	rv = read_vblock(stream, sector_bytes, &wblocal, &kbuf, &kbuf_size,
+			 &kbuf_read);
+	vb2_timestamp(ctx, VB2_TS_DISK_READ_END);
+	if (rv == VB2_ERROR_LOAD_PARTITION_READ_VBLOCK) {
 		VB2_DEBUG("Unable to read start of partition.\n");
 		shpart->check_result = VBSD_LKP_CHECK_READ_START;
-		return VB2_ERROR_LOAD_PARTITION_READ_VBLOCK;
 	}
+	if (rv)
+		return rv;
 
 	if (VB2_SUCCESS !=
-	    vb2_verify_kernel_vblock(ctx, kbuf, KBUF_SIZE, kernel_subkey,
-				     params, min_version, shpart, &wblocal)) {
+	    vb2_verify_kernel_vblock(ctx, kbuf, kbuf_size, kernel_subkey,
+				     params, guid, min_version, shpart,
+				     &wblocal)) {
 		return VB2_ERROR_LOAD_PARTITION_VERIFY_VBLOCK;
 	}
 
@@ -347,27 +1064,15 @@ int vb2_load_partition(struct vb2_context *ctx,
 	struct vb2_keyblock *keyblock = get_keyblock(kbuf);
 	struct vb2_kernel_preamble *preamble = get_preamble(kbuf);
 
-	/*
-	 * Make sure the kernel starts at or before what we already read into
-	 * kbuf.
-	 *
-	 * We could deal with a larger offset by reading and discarding the
-	 * data in between the vblock and the kernel data.
-	 */
-	uint32_t body_offset = get_body_offset(kbuf);
-	if (body_offset > KBUF_SIZE) {
-		shpart->check_result = VBSD_LKP_CHECK_BODY_OFFSET;
-		VB2_DEBUG("Kernel body offset is %u > 64KB.\n", body_offset);
-		return VB2_ERROR_LOAD_PARTITION_BODY_OFFSET;
-	}
-
+	/* A compressed body takes more room once it's loaded */
+	uint32_t load_size = vb2_kernel_get_body_load_size(preamble);
 	uint8_t *kernbuf = params->kernel_buffer;
 	uint32_t kernbuf_size = params->kernel_buffer_size;
 	if (!kernbuf) {
 		/* Get kernel load address and size from the header. */
 		kernbuf = (uint8_t *)((long)preamble->body_load_address);
-		kernbuf_size = preamble->body_signature.data_size;
-	} else if (preamble->body_signature.data_size > kernbuf_size) {
+		kernbuf_size = load_size;
+	} else if (load_size > kernbuf_size) {
 		VB2_DEBUG("Kernel body doesn't fit in memory.\n");
 		shpart->check_result = VBSD_LKP_CHECK_BODY_EXCEEDS_MEM;
 		return 	VB2_ERROR_LOAD_PARTITION_BODY_SIZE;
@@ -375,26 +1080,58 @@ int vb2_load_partition(struct vb2_context *ctx,
 
 	uint32_t body_toread = preamble->body_signature.data_size;
 	uint8_t *body_readptr = kernbuf;
+	uint32_t body_offset = get_body_offset(kbuf);
+	uint32_t body_copied;
 
-	/*
-	 * If we've already read part of the kernel, copy that to the beginning
-	 * of the kernel buffer.
-	 */
-	uint32_t body_copied = KBUF_SIZE - body_offset;
-	if (body_copied > body_toread)
-		body_copied = body_toread;  /* Don't over-copy tiny kernel */
-	memcpy(body_readptr, kbuf + body_offset, body_copied);
-	body_toread -= body_copied;
-	body_readptr += body_copied;
+	if (body_offset < kbuf_read) {
+		/*
+		 * The start of the kernel was read with the vblock, so copy
+		 * that to the beginning of the kernel buffer.
+		 */
+		body_copied = kbuf_read - body_offset;
+		if (body_copied > body_toread)
+			body_copied = body_toread;  /* Don't over-copy tiny kernel */
+		memcpy(body_readptr, kbuf + body_offset, body_copied);
+	} else {
+		/*
+		 * Skip the vblock padding, so the kernel is read straight into
+		 * the kernel buffer.  Only a kernel which doesn't start on a
+		 * sector boundary needs the rest of that sector moved down.
+		 */
+		uint32_t skip = body_offset - kbuf_read;
+		uint32_t partial = skip % sector_bytes;
+
+		if (skip && kernbuf_size < sector_bytes) {
+			shpart->check_result = VBSD_LKP_CHECK_BODY_OFFSET;
+			VB2_DEBUG("No room to skip to kernel body offset %u.\n",
+				  body_offset);
+			return VB2_ERROR_LOAD_PARTITION_BODY_OFFSET;
+		}
+
+		if (stream_skip(stream, skip - partial, kernbuf, kernbuf_size,
+				sector_bytes) ||
+		    (partial &&
+		     VbExStreamRead(stream, sector_bytes, kernbuf))) {
+			VB2_DEBUG("Unable to read kernel data.\n");
+			shpart->check_result = VBSD_LKP_CHECK_READ_DATA;
+			return VB2_ERROR_LOAD_PARTITION_READ_BODY;
+		}
 
-	/* Read the kernel data */
-	if (body_toread && VbExStreamRead(stream, body_toread, body_readptr)) {
-		VB2_DEBUG("Unable to read kernel data.\n");
-		shpart->check_result = VBSD_LKP_CHECK_READ_DATA;
-		return VB2_ERROR_LOAD_PARTITION_READ_BODY;
+		body_copied = 0;
+		if (partial) {
+			body_copied = sector_bytes - partial;
+			if (body_copied > body_toread)
+				body_copied = body_toread;
+			memmove(body_readptr, kernbuf + partial, body_copied);
+		}
 	}
+	body_toread -= body_copied;
+	body_readptr += body_copied;
 
-	/* Get key for preamble/data verification from the key block. */
+	/*
+	 * Get key for data verification from the key block.  Do this before
+	 * reading the body, so chunked reads can hash each chunk as it lands.
+	 */
 	struct vb2_public_key data_key;
 	if (VB2_SUCCESS != vb2_unpack_key(&data_key, &keyblock->data_key)) {
 		VB2_DEBUG("Unable to unpack kernel data key\n");
@@ -402,13 +1139,60 @@ int vb2_load_partition(struct vb2_context *ctx,
 		return VB2_ERROR_LOAD_PARTITION_DATA_KEY;
 	}
 
-	/* Verify kernel data */
-	if (VB2_SUCCESS != vb2_verify_data(kernbuf, kernbuf_size,
-					   &preamble->body_signature,
-					   &data_key, &wblocal)) {
-		VB2_DEBUG("Kernel data verification failed.\n");
-		shpart->check_result = VBSD_LKP_CHECK_VERIFY_DATA;
-		return VB2_ERROR_LOAD_PARTITION_VERIFY_BODY;
+	if (vb2_kernel_get_compression(preamble) !=
+	    VB2_KERNEL_COMPRESSION_NONE) {
+		/* Read, hash and decompress the kernel data in one pass */
+		vb2_timestamp(ctx, VB2_TS_DISK_READ_START);
+		rv = vb2_load_body_compressed(stream, params->body_chunk_size,
+					      kernbuf, kernbuf_size,
+					      body_copied, preamble,
+					      &data_key, shpart, &wblocal);
+		vb2_timestamp(ctx, VB2_TS_DISK_READ_END);
+		if (rv)
+			return rv;
+	} else if (vb2_kernel_get_body_chunk_size(preamble)) {
+		/* Read and check the kernel data against the chunk digests */
+		vb2_timestamp(ctx, VB2_TS_DISK_READ_START);
+		rv = vb2_load_body_digested(stream, kernbuf, body_copied,
+					    preamble, &data_key, shpart);
+		vb2_timestamp(ctx, VB2_TS_DISK_READ_END);
+		if (rv)
+			return rv;
+	} else if (params->body_chunk_size) {
+		/* Read and hash the kernel data one chunk at a time */
+		vb2_timestamp(ctx, VB2_TS_DISK_READ_START);
+		rv = vb2_load_body_chunked(stream, params->body_chunk_size,
+					   kernbuf, body_copied, preamble,
+					   &data_key, shpart, &wblocal);
+		vb2_timestamp(ctx, VB2_TS_DISK_READ_END);
+		if (rv)
+			return rv;
+	} else {
+		struct vb2_pipeline_source src;
+		struct vb2_pipeline pipe;
+
+		/* Read the kernel data */
+		stream_source(&src, stream, 0);
+		vb2_pipeline_init(&pipe, &src, 0, NULL, body_readptr);
+		vb2_timestamp(ctx, VB2_TS_DISK_READ_START);
+		rv = vb2_pipeline_run(&pipe, body_toread);
+		vb2_timestamp(ctx, VB2_TS_DISK_READ_END);
+		if (rv) {
+			VB2_DEBUG("Unable to read kernel data.\n");
+			shpart->check_result = VBSD_LKP_CHECK_READ_DATA;
+			return VB2_ERROR_LOAD_PARTITION_READ_BODY;
+		}
+
+		/* Verify kernel data */
+		vb2_timestamp(ctx, VB2_TS_RSA_VERIFY_START);
+		rv = vb2_verify_kernel_body(kernbuf, kernbuf_size, preamble,
+					    &data_key, &wblocal);
+		vb2_timestamp(ctx, VB2_TS_RSA_VERIFY_END);
+		if (VB2_SUCCESS != rv) {
+			VB2_DEBUG("Kernel data verification failed.\n");
+			shpart->check_result = VBSD_LKP_CHECK_VERIFY_DATA;
+			return VB2_ERROR_LOAD_PARTITION_VERIFY_BODY;
+		}
 	}
 
 	/* If we're still here, the kernel is valid */
@@ -427,6 +1211,363 @@ int vb2_load_partition(struct vb2_context *ctx,
 	return VB2_SUCCESS;
 }
 
+/**
+ * Set up the drive geometry and flags for reading the GPT of a disk.
+ */
+static void SetupGptData(GptData *gpt, const LoadKernelParams *params)
+{
+	gpt->sector_bytes = (uint32_t)params->bytes_per_lba;
+	gpt->streaming_drive_sectors = params->streaming_lba_count;
+	gpt->gpt_drive_sectors = params->gpt_lba_count;
+	/*
+	 * Every sector read from an external GPT (on SPI flash) is expensive,
+	 * so don't read the secondary GPT unless the primary is damaged.
+	 */
+	gpt->flags = params->boot_flags & BOOT_FLAG_EXTERNAL_GPT
+			? GPT_FLAG_EXTERNAL | GPT_FLAG_LAZY_SECONDARY : 0;
+}
+
+uint32_t LoadKernelRank(LoadKernelParams *params)
+{
+	GptData gpt;
+	uint64_t part_start, part_size;
+	uint32_t rank = 0;
+
+	SetupGptData(&gpt, params);
+	if (0 == AllocAndReadGptData(params->disk_handle, &gpt) &&
+	    GPT_SUCCESS == GptInit(&gpt) &&
+	    GPT_SUCCESS == GptNextKernelEntry(&gpt, &part_start, &part_size)) {
+		GptEntry *e = (GptEntry *)gpt.primary_entries +
+				gpt.current_kernel;
+
+		rank = 1 + (GetEntryPriority(e) << 5 |
+			    GetEntrySuccessful(e) << 4 |
+			    GetEntryTries(e));
+		VB2_DEBUG("Best kernel entry %d, rank 0x%x\n",
+			  gpt.current_kernel + 1, rank);
+	}
+
+	/* Leave any repairs to LoadKernel() on the disk we actually boot */
+	gpt.modified = 0;
+	WriteAndFreeGptData(params->disk_handle, &gpt);
+	return rank;
+}
+
+/* GPT read by LoadKernelPrefetchGpt(), until LoadKernel() takes it */
+static struct {
+	VbExDiskHandle_t handle;
+	GptData gpt;
+	int valid;
+} prefetched_gpt;
+
+int LoadKernelPrefetchGpt(LoadKernelParams *params)
+{
+	LoadKernelDropGpt();
+
+	SetupGptData(&prefetched_gpt.gpt, params);
+	if (0 != AllocAndReadGptData(params->disk_handle,
+				     &prefetched_gpt.gpt)) {
+		WriteAndFreeGptData(params->disk_handle, &prefetched_gpt.gpt);
+		return 1;
+	}
+
+	prefetched_gpt.handle = params->disk_handle;
+	prefetched_gpt.valid = 1;
+	return 0;
+}
+
+void LoadKernelDropGpt(void)
+{
+	if (!prefetched_gpt.valid)
+		return;
+
+	prefetched_gpt.valid = 0;
+	prefetched_gpt.gpt.modified = 0;
+	WriteAndFreeGptData(prefetched_gpt.handle, &prefetched_gpt.gpt);
+}
+
+/**
+ * Take the prefetched GPT, if it is the one LoadKernel() would read.
+ *
+ * @param gpt		GPT data set up for the disk; filled on success
+ * @param params	Params for the disk
+ * @return 1 if the prefetched GPT was taken, 0 if it still needs reading.
+ */
+static int TakePrefetchedGpt(GptData *gpt, const LoadKernelParams *params)
+{
+	const GptData *p = &prefetched_gpt.gpt;
+
+	if (!prefetched_gpt.valid ||
+	    prefetched_gpt.handle != params->disk_handle)
+		return 0;
+
+	/* Read with different geometry, so it may not be the same GPT */
+	if (p->sector_bytes != gpt->sector_bytes ||
+	    p->streaming_drive_sectors != gpt->streaming_drive_sectors ||
+	    p->gpt_drive_sectors != gpt->gpt_drive_sectors ||
+	    p->flags != gpt->flags) {
+		LoadKernelDropGpt();
+		return 0;
+	}
+
+	*gpt = prefetched_gpt.gpt;
+	prefetched_gpt.valid = 0;
+	return 1;
+}
+
+/**
+ * Set up tracking for a kernel partition.
+ *
+ * This wraps around if called many times, so the partition entry is
+ * initialized each time.
+ *
+ * @param shcall	Tracking for this LoadKernel() call
+ * @param kernel	GPT entry of the partition, counting from 0
+ * @param part_start	First sector of the partition
+ * @param part_size	Size of the partition in sectors
+ * @return The tracking entry for the partition.
+ */
+static VbSharedDataKernelPart *new_kernel_part(VbSharedDataKernelCall *shcall,
+					       int kernel,
+					       uint64_t part_start,
+					       uint64_t part_size)
+{
+	VbSharedDataKernelPart *shpart =
+			shcall->parts + (shcall->kernel_parts_found
+			& (VBSD_MAX_KERNEL_PARTS - 1));
+
+	memset(shpart, 0, sizeof(VbSharedDataKernelPart));
+	shpart->sector_start = part_start;
+	shpart->sector_count = part_size;
+	/*
+	 * TODO: GPT partitions start at 1, but cgptlib starts them at 0.
+	 * Adjust here, until cgptlib is fixed.
+	 */
+	shpart->gpt_index = (uint8_t)(kernel + 1);
+	shcall->kernel_parts_found++;
+	return shpart;
+}
+
+/**
+ * Open a kernel partition and load it with vb2_load_partition().
+ *
+ * @param ctx		Vboot context
+ * @param params	Load-kernel parameters
+ * @param guid		UniquePartitionGuid of the partition
+ * @param part_start	First sector of the partition
+ * @param part_size	Size of the partition in sectors
+ * @param kernel_subkey	Key to use to verify vblock
+ * @param lpflags	Flags (one or more of vb2_load_partition_flags)
+ * @param min_version	Minimum kernel version from TPM
+ * @param shpart	Destination for verification results
+ * @return VB2_SUCCESS, or non-zero error code.
+ */
+static int load_kernel_entry(struct vb2_context *ctx,
+			     LoadKernelParams *params,
+			     const uint8_t *guid,
+			     uint64_t part_start,
+			     uint64_t part_size,
+			     const struct vb2_packed_key *kernel_subkey,
+			     uint32_t lpflags,
+			     uint32_t min_version,
+			     VbSharedDataKernelPart *shpart)
+{
+	VbExStream_t stream = NULL;
+	uint32_t hints = VB_STREAM_FLAG_SEQUENTIAL;
+	uint64_t expected;
+	int rv;
+
+	if (lpflags & VB2_LOAD_PARTITION_VBLOCK_ONLY) {
+		/* Just the vblock, which the full load reads again later */
+		expected = VBLOCK_INITIAL_READ;
+	} else {
+		/* The vblock and then the body, which fits the kernel buffer */
+		hints |= VB_STREAM_FLAG_READ_ONCE;
+		expected = part_size * params->bytes_per_lba;
+		if (expected > params->kernel_buffer_size)
+			expected = params->kernel_buffer_size;
+	}
+
+	/* Set up the stream */
+	if (VbExStreamOpenWithHints(params->disk_handle, part_start, part_size,
+				    hints, expected, &stream)) {
+		VB2_DEBUG("Partition error getting stream.\n");
+		shpart->check_result = VBSD_LKP_CHECK_TOO_SMALL;
+		return VB2_ERROR_LOAD_PARTITION_READ_VBLOCK;
+	}
+
+	rv = vb2_load_partition(ctx,
+				stream,
+				kernel_subkey,
+				lpflags,
+				params,
+				guid,
+				min_version,
+				shpart);
+	VbExStreamClose(stream);
+	return rv;
+}
+
+/* Result of checking the vblock of the next kernel candidate early */
+struct kernel_peek {
+	/* GPT entry of the candidate, or CGPT_KERNEL_ENTRY_NOT_FOUND */
+	int kernel;
+	/* Result of checking its vblock */
+	int rv;
+	/* Tracking for the candidate */
+	VbSharedDataKernelPart *shpart;
+};
+
+/**
+ * Check the vblock of the kernel candidate after the current one.
+ *
+ * This is only a few KB, so doing it before reading the body of the current
+ * candidate means that if the body turns out to be bad, a bad next candidate
+ * is already known and skipped without reading it again.  If the next
+ * candidate is good, its vblock is in the verification cache by the time
+ * it's loaded, and it doesn't need checking again if it's only looked at for
+ * rollback.
+ *
+ * The GPT is left at the current candidate, and not updated; the result is
+ * acted on once the loop in LoadKernel() gets to the next candidate.  A
+ * partition which can't be read at all doesn't stop the current one loading.
+ *
+ * @param ctx		Vboot context
+ * @param params	Load-kernel parameters
+ * @param gpt		GPT, with the current candidate as its current kernel
+ * @param kernel_subkey	Key to use to verify vblock
+ * @param min_version	Minimum kernel version from TPM
+ * @param shcall	Tracking for this LoadKernel() call
+ * @param peek		Destination for the result
+ */
+static void peek_next_kernel(struct vb2_context *ctx,
+			     LoadKernelParams *params,
+			     GptData *gpt,
+			     const struct vb2_packed_key *kernel_subkey,
+			     uint32_t min_version,
+			     VbSharedDataKernelCall *shcall,
+			     struct kernel_peek *peek)
+{
+	int current_kernel = gpt->current_kernel;
+	int current_priority = gpt->current_priority;
+	uint64_t part_start, part_size;
+	uint8_t guid[16];
+
+	if (GPT_SUCCESS == GptNextKernelEntry(gpt, &part_start, &part_size)) {
+		VB2_DEBUG("Checking next kernel entry at %" PRIu64 " early\n",
+			  part_start);
+		peek->kernel = gpt->current_kernel;
+		peek->shpart = new_kernel_part(shcall, gpt->current_kernel,
+					       part_start, part_size);
+		GetCurrentKernelUniqueGuid(gpt, guid);
+		peek->rv = load_kernel_entry(ctx, params, guid,
+					     part_start, part_size,
+					     kernel_subkey,
+					     VB2_LOAD_PARTITION_VBLOCK_ONLY,
+					     min_version, peek->shpart);
+	}
+
+	gpt->current_kernel = current_kernel;
+	gpt->current_priority = current_priority;
+}
+
+/**
+ * Load the kernel partition which booted last time, reading only the primary
+ * GPT header and the sector holding the partition's entry.
+ *
+ * The hint in NV storage names the partition, along with the header CRC of
+ * the primary GPT at the time.  The header CRC covers the entries CRC, so if
+ * it still matches, no priority, tries or successful flag has changed since,
+ * and the full search would pick the same partition.  The partition is then
+ * verified as usual.  It's only taken if it needs nothing else from the
+ * search: a good, officially signed kernel whose version matches the TPM, so
+ * there's no rollback to check and nothing to update in the GPT.
+ *
+ * @param ctx		Vboot context
+ * @param params	Load-kernel parameters
+ * @param kernel_subkey	Key to use to verify vblock
+ * @param min_version	Minimum kernel version from TPM
+ * @param shcall	Tracking for this LoadKernel() call
+ * @return VB2_SUCCESS if the kernel is loaded, or non-zero if the full search
+ * is needed.
+ */
+static int load_hinted_kernel(struct vb2_context *ctx,
+			      LoadKernelParams *params,
+			      const struct vb2_packed_key *kernel_subkey,
+			      uint32_t min_version,
+			      VbSharedDataKernelCall *shcall)
+{
+	uint32_t part = vb2_nv_get(ctx, VB2_NV_KERNEL_HINT_PART);
+	uint32_t parts_found = shcall->kernel_parts_found;
+	GptData gpt;
+	GptHeader *h;
+	GptEntry *e;
+	uint8_t *buf;
+	uint64_t offset, first_usable, last_usable;
+	uint64_t part_start, part_size;
+	VbSharedDataKernelPart *shpart;
+	int rv = VB2_ERROR_UNKNOWN;
+
+	if (!part)
+		return VB2_ERROR_UNKNOWN;
+
+	SetupGptData(&gpt, params);
+	buf = malloc(gpt.sector_bytes);
+	if (!buf)
+		return VB2_ERROR_UNKNOWN;
+
+	h = (GptHeader *)buf;
+	if (0 != VbExDiskRead(params->disk_handle, GPT_PMBR_SECTORS, 1, buf) ||
+	    0 != CheckHeader(h, 0, gpt.streaming_drive_sectors,
+			     gpt.gpt_drive_sectors, gpt.flags,
+			     gpt.sector_bytes) ||
+	    h->header_crc32 != vb2_nv_get(ctx, VB2_NV_KERNEL_HINT_GPT_CRC) ||
+	    part > h->number_of_entries) {
+		VB2_DEBUG("GPT changed since the last boot\n");
+		goto hint_exit;
+	}
+
+	first_usable = h->first_usable_lba;
+	last_usable = h->last_usable_lba;
+	offset = (uint64_t)(part - 1) * h->size_of_entry;
+	if (0 != VbExDiskRead(params->disk_handle,
+			      h->entries_lba + offset / gpt.sector_bytes, 1,
+			      buf))
+		goto hint_exit;
+
+	e = (GptEntry *)(buf + offset % gpt.sector_bytes);
+	part_start = e->starting_lba;
+	part_size = e->ending_lba - e->starting_lba + 1;
+	if (!IsKernelEntry(e) || !GetEntrySuccessful(e) ||
+	    !GetEntryPriority(e) || part_start < first_usable ||
+	    e->ending_lba < part_start || e->ending_lba > last_usable)
+		goto hint_exit;
+
+	VB2_DEBUG("Trying kernel entry %d from the last boot\n", (int)part);
+	shpart = new_kernel_part(shcall, part - 1, part_start, part_size);
+	rv = load_kernel_entry(ctx, params, (const uint8_t *)&e->unique,
+			       part_start, part_size, kernel_subkey, 0,
+			       min_version, shpart);
+	if (rv == VB2_SUCCESS &&
+	    (!(shpart->flags & VBSD_LKP_FLAG_KEY_BLOCK_VALID) ||
+	     shpart->combined_version != min_version)) {
+		VB2_DEBUG("Kernel version changed; searching them all\n");
+		rv = VB2_ERROR_UNKNOWN;
+	}
+	if (rv != VB2_SUCCESS) {
+		/* The full search records this partition again */
+		shcall->kernel_parts_found = parts_found;
+		goto hint_exit;
+	}
+
+	params->partition_number = part;
+	memcpy(params->partition_guid, &e->unique, sizeof(e->unique));
+
+ hint_exit:
+	free(buf);
+	return rv;
+}
+
 VbError_t LoadKernel(struct vb2_context *ctx, LoadKernelParams *params)
 {
 	struct vb2_shared_data *sd = vb2_get_sd(ctx);
@@ -435,10 +1576,16 @@ VbError_t LoadKernel(struct vb2_context *ctx, LoadKernelParams *params)
 	struct vb2_packed_key *recovery_key = NULL;
 	int found_partitions = 0;
 	uint32_t lowest_version = LOWEST_TPM_VERSION;
+	int rv;
 
 	VbError_t retval = VBERROR_UNKNOWN;
 	int recovery = VB2_RECOVERY_LK_UNSPECIFIED;
 
+	vb2_timestamp(ctx, VB2_TS_LOAD_KERNEL_ENTER);
+	vb2_workbuf_phase(ctx, VB2_WB_PHASE_LOAD_KERNEL);
+	init_vblock_cache(ctx);
+	vb2_key_cache_init(ctx);
+
 	/* Clear output params in case we fail */
 	params->partition_number = 0;
 	params->bootloader_address = 0;
@@ -472,14 +1619,31 @@ VbError_t LoadKernel(struct vb2_context *ctx, LoadKernelParams *params)
 		kernel_subkey = (struct vb2_packed_key *)&shared->kernel_subkey;
 	}
 
+	/* Go straight to the kernel which booted last time, if unchanged */
+	int use_hint = (params->boot_flags & BOOT_FLAG_KERNEL_HINT) &&
+			kBootNormal == shcall->boot_mode;
+	if (use_hint &&
+	    VB2_SUCCESS == load_hinted_kernel(ctx, params, kernel_subkey,
+					      shared->kernel_version_tpm,
+					      shcall)) {
+		shared->flags |= VBSD_KERNEL_KEY_VERIFIED;
+		found_partitions++;
+		lowest_version = shared->kernel_version_tpm;
+		goto kernel_found;
+	}
+
 	/* Read GPT data */
 	GptData gpt;
-	gpt.sector_bytes = (uint32_t)params->bytes_per_lba;
-	gpt.streaming_drive_sectors = params->streaming_lba_count;
-	gpt.gpt_drive_sectors = params->gpt_lba_count;
-	gpt.flags = params->boot_flags & BOOT_FLAG_EXTERNAL_GPT
-			? GPT_FLAG_EXTERNAL : 0;
-	if (0 != AllocAndReadGptData(params->disk_handle, &gpt)) {
+	SetupGptData(&gpt, params);
+	vb2_timestamp(ctx, VB2_TS_DISK_READ_START);
+	if (TakePrefetchedGpt(&gpt, params)) {
+		VB2_DEBUG("Using prefetched GPT data\n");
+		rv = 0;
+	} else {
+		rv = AllocAndReadGptData(params->disk_handle, &gpt);
+	}
+	vb2_timestamp(ctx, VB2_TS_DISK_READ_END);
+	if (0 != rv) {
 		VB2_DEBUG("Unable to read GPT data\n");
 		shcall->check_result = VBSD_LKC_CHECK_GPT_READ_ERROR;
 		goto gpt_done;
@@ -494,6 +1658,8 @@ VbError_t LoadKernel(struct vb2_context *ctx, LoadKernelParams *params)
 
 	/* Loop over candidate kernel partitions */
 	uint64_t part_start, part_size;
+	uint8_t guid[16];
+	struct kernel_peek peek = { .kernel = CGPT_KERNEL_ENTRY_NOT_FOUND };
 	while (GPT_SUCCESS ==
 	       GptNextKernelEntry(&gpt, &part_start, &part_size)) {
 
@@ -501,38 +1667,9 @@ VbError_t LoadKernel(struct vb2_context *ctx, LoadKernelParams *params)
 			  PRIu64 " size %" PRIu64 "\n",
 			  part_start, part_size);
 
-		/*
-		 * Set up tracking for this partition.  This wraps around if
-		 * called many times, so initialize the partition entry each
-		 * time.
-		 */
-		VbSharedDataKernelPart *shpart =
-				shcall->parts + (shcall->kernel_parts_found
-				& (VBSD_MAX_KERNEL_PARTS - 1));
-		memset(shpart, 0, sizeof(VbSharedDataKernelPart));
-		shpart->sector_start = part_start;
-		shpart->sector_count = part_size;
-		/*
-		 * TODO: GPT partitions start at 1, but cgptlib starts them at
-		 * 0.  Adjust here, until cgptlib is fixed.
-		 */
-		shpart->gpt_index = (uint8_t)(gpt.current_kernel + 1);
-		shcall->kernel_parts_found++;
-
 		/* Found at least one kernel partition. */
 		found_partitions++;
 
-		/* Set up the stream */
-		VbExStream_t stream = NULL;
-		if (VbExStreamOpen(params->disk_handle,
-				   part_start, part_size, &stream)) {
-			VB2_DEBUG("Partition error getting stream.\n");
-			shpart->check_result = VBSD_LKP_CHECK_TOO_SMALL;
-			VB2_DEBUG("Marking kernel as invalid.\n");
-			GptUpdateKernelEntry(&gpt, GPT_UPDATE_ENTRY_BAD);
-			continue;
-		}
-
 		uint32_t lpflags = 0;
 		if (params->partition_number > 0) {
 			/*
@@ -542,14 +1679,35 @@ VbError_t LoadKernel(struct vb2_context *ctx, LoadKernelParams *params)
 			lpflags |= VB2_LOAD_PARTITION_VBLOCK_ONLY;
 		}
 
-		int rv = vb2_load_partition(ctx,
-					    stream,
-					    kernel_subkey,
-					    lpflags,
-					    params,
-					    shared->kernel_version_tpm,
-					    shpart);
-		VbExStreamClose(stream);
+		VbSharedDataKernelPart *shpart;
+		int peeked = (gpt.current_kernel == peek.kernel);
+		if (peeked) {
+			/* The vblock was checked on the last time around */
+			shpart = peek.shpart;
+			rv = peek.rv;
+			peek.kernel = CGPT_KERNEL_ENTRY_NOT_FOUND;
+		} else {
+			shpart = new_kernel_part(shcall, gpt.current_kernel,
+						 part_start, part_size);
+		}
+
+		if (!peeked || (rv == VB2_SUCCESS &&
+				!(lpflags & VB2_LOAD_PARTITION_VBLOCK_ONLY))) {
+			shpart->check_result = 0;
+			shpart->flags = 0;
+			if (!(lpflags & VB2_LOAD_PARTITION_VBLOCK_ONLY) &&
+			    (params->boot_flags & BOOT_FLAG_PEEK_NEXT_VBLOCK))
+				peek_next_kernel(ctx, params, &gpt,
+						 kernel_subkey,
+						 shared->kernel_version_tpm,
+						 shcall, &peek);
+			GetCurrentKernelUniqueGuid(&gpt, guid);
+			rv = load_kernel_entry(ctx, params, guid,
+					       part_start, part_size,
+					       kernel_subkey, lpflags,
+					       shared->kernel_version_tpm,
+					       shpart);
+		}
 
 		if (rv != VB2_SUCCESS) {
 			VB2_DEBUG("Marking kernel as invalid.\n");
@@ -621,9 +1779,27 @@ VbError_t LoadKernel(struct vb2_context *ctx, LoadKernelParams *params)
 	} /* while(GptNextKernelEntry) */
 
 gpt_done:
+	/*
+	 * Remember a kernel which has booted successfully before, so the next
+	 * boot can go straight to it.  Anything else clears the hint.
+	 */
+	if (use_hint) {
+		int hint = params->partition_number > 0 &&
+			GetEntrySuccessful((GptEntry *)gpt.primary_entries +
+					   params->partition_number - 1);
+
+		vb2_nv_set(ctx, VB2_NV_KERNEL_HINT_PART,
+			   hint ? params->partition_number : 0);
+		if (hint)
+			vb2_nv_set(ctx, VB2_NV_KERNEL_HINT_GPT_CRC,
+				   ((GptHeader *)gpt.primary_header)->
+				   header_crc32);
+	}
+
 	/* Write and free GPT data */
 	WriteAndFreeGptData(params->disk_handle, &gpt);
 
+kernel_found:
 	/* Handle finding a good partition */
 	if (params->partition_number > 0) {
 		VB2_DEBUG("Good partition %d\n", params->partition_number);
@@ -660,5 +1836,6 @@ load_kernel_exit:
 	free(recovery_key);
 
 	shcall->return_code = (uint8_t)retval;
+	vb2_timestamp(ctx, VB2_TS_LOAD_KERNEL_EXIT);
 	return retval;
 }
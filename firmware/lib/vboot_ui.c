@@ -25,6 +25,13 @@
 #include "vboot_display.h"
 #include "vboot_kernel.h"
 
+__attribute__((weak))
+uint32_t VbExWaitForEvent(uint32_t mask, uint32_t timeout_ms)
+{
+	VbExSleepMs(timeout_ms);
+	return VB_EVENT_POLL;
+}
+
 static void VbAllowUsbBoot(struct vb2_context *ctx)
 {
 	VB2_DEBUG(".");
@@ -146,7 +153,7 @@ int VbUserConfirms(struct vb2_context *ctx, uint32_t confirm_flags)
 			}
 			VbCheckDisplayKey(ctx, key);
 		}
-		VbExSleepMs(CONFIRM_KEY_DELAY);
+		VbExWaitForEvent(VB_EVENT_KEYBOARD, CONFIRM_KEY_DELAY);
 	}
 
 	/* Not reached, but compiler will complain without it */
@@ -398,6 +405,7 @@ static VbError_t recovery_ui(struct vb2_context *ctx)
 	struct vb2_shared_data *sd = vb2_get_sd(ctx);
 	VbSharedDataHeader *shared = sd->vbsd;
 	uint32_t retval;
+	uint32_t events;
 	uint32_t key;
 	int i;
 
@@ -429,7 +437,7 @@ static VbError_t recovery_ui(struct vb2_context *ctx)
 			VbCheckDisplayKey(ctx, key);
 			if (VbWantShutdown(ctx, key))
 				return VBERROR_SHUTDOWN_REQUESTED;
-			VbExSleepMs(REC_KEY_DELAY);
+			VbExWaitForEvent(VB_EVENT_KEYBOARD, REC_KEY_DELAY);
 		}
 	}
 
@@ -524,7 +532,13 @@ static VbError_t recovery_ui(struct vb2_context *ctx)
 			}
 			if (VbWantShutdown(ctx, key))
 				return VBERROR_SHUTDOWN_REQUESTED;
-			VbExSleepMs(REC_KEY_DELAY);
+
+			events = VbExWaitForEvent(VB_EVENT_KEYBOARD |
+						  VB_EVENT_DISK, REC_KEY_DELAY);
+			if (events & VB_EVENT_DISK)
+				break;  /* Scan the new disk right away */
+			if (!(events & VB_EVENT_POLL))
+				i = 0;  /* Only rescan when a disk changes */
 		}
 	}
 
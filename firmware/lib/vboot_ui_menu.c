@@ -731,6 +731,11 @@ VbError_t VbBootDeveloperMenu(struct vb2_context *ctx)
 	return retval;
 }
 
+/* Delay in recovery mode */
+#define REC_DISK_DELAY       1000     /* Check disks every 1s */
+#define REC_KEY_DELAY        20       /* Check keys every 20ms */
+#define REC_MEDIA_INIT_DELAY 500      /* Check removable media every 500ms */
+
 /* Main function that handles non-manual recovery (BROKEN) menu functionality */
 static VbError_t broken_ui(struct vb2_context *ctx)
 {
@@ -754,14 +759,10 @@ static VbError_t broken_ui(struct vb2_context *ctx)
 		VbError_t ret = vb2_handle_menu_input(ctx, key, 0);
 		if (ret != VBERROR_KEEP_LOOPING)
 			return ret;
+		VbExWaitForEvent(VB_EVENT_KEYBOARD, REC_KEY_DELAY);
 	}
 }
 
-/* Delay in recovery mode */
-#define REC_DISK_DELAY       1000     /* Check disks every 1s */
-#define REC_KEY_DELAY        20       /* Check keys every 20ms */
-#define REC_MEDIA_INIT_DELAY 500      /* Check removable media every 500ms */
-
 /**
  * Main function that handles recovery menu functionality
  *
@@ -770,6 +771,7 @@ static VbError_t broken_ui(struct vb2_context *ctx)
  */
 static VbError_t recovery_ui(struct vb2_context *ctx)
 {
+	uint32_t events;
 	uint32_t key;
 	uint32_t key_flags;
 	VbError_t ret;
@@ -817,7 +819,13 @@ static VbError_t recovery_ui(struct vb2_context *ctx)
 				if (ret != VBERROR_KEEP_LOOPING)
 					return ret;
 			}
-			VbExSleepMs(REC_KEY_DELAY);
+
+			events = VbExWaitForEvent(VB_EVENT_KEYBOARD |
+						  VB_EVENT_DISK, REC_KEY_DELAY);
+			if (events & VB_EVENT_DISK)
+				break;  /* Scan the new disk right away */
+			if (!(events & VB_EVENT_POLL))
+				i = 0;  /* Only rescan when a disk changes */
 		}
 	}
 }
@@ -19,6 +19,9 @@ int vb2api_fw_phase3(struct vb2_context *ctx)
 {
 	int rv;
 
+	vb2_timestamp(ctx, VB2_TS_FW_PHASE3_ENTER);
+	vb2_workbuf_phase(ctx, VB2_WB_PHASE_FW3);
+
 	/* Verify firmware keyblock */
 	rv = vb2_load_fw_keyblock(ctx);
 	if (rv) {
@@ -33,6 +36,7 @@ int vb2api_fw_phase3(struct vb2_context *ctx)
 		return rv;
 	}
 
+	vb2_timestamp(ctx, VB2_TS_FW_PHASE3_EXIT);
 	return VB2_SUCCESS;
 }
 
@@ -45,6 +49,7 @@ int vb2api_init_hash(struct vb2_context *ctx, uint32_t tag, uint32_t *size)
 	struct vb2_workbuf wb;
 	int rv;
 
+	vb2_timestamp(ctx, VB2_TS_INIT_HASH);
 	vb2_workbuf_from_ctx(ctx, &wb);
 
 	if (tag == VB2_HASH_TAG_INVALID)
@@ -144,6 +149,7 @@ int vb2api_check_hash_get_digest(struct vb2_context *ctx, void *digest_out,
 	struct vb2_public_key key;
 	int rv;
 
+	vb2_timestamp(ctx, VB2_TS_CHECK_HASH_ENTER);
 	vb2_workbuf_from_ctx(ctx, &wb);
 
 	/* Get preamble pointer */
@@ -177,6 +183,17 @@ int vb2api_check_hash_get_digest(struct vb2_context *ctx, void *digest_out,
 	if (sd->hash_tag != VB2_HASH_TAG_FW_BODY)
 		return VB2_ERROR_API_CHECK_HASH_TAG;
 
+	/* Nothing more to check if the body is unchanged since suspend */
+	if (sd->resume.body_hash_alg != dc->hash_alg)
+		sd->status &= ~VB2_SD_STATUS_RESUME_STATE;
+	sd->resume.body_hash_alg = dc->hash_alg;
+	if (vb2_resume_digest(ctx, VB2_RESUME_BODY, digest,
+			      sd->resume.body_digest, digest_size)) {
+		VB2_DEBUG("Body unchanged since suspend\n");
+		rv = VB2_SUCCESS;
+		goto done;
+	}
+
 	/*
 	 * The body signature is currently a *signature* of the body data, not
 	 * just its hash.  So we need to verify the signature.
@@ -192,20 +209,31 @@ int vb2api_check_hash_get_digest(struct vb2_context *ctx, void *digest_out,
 	if (rv)
 		return rv;
 
+	/* The preamble can keep its body away from the HW crypto engine */
+	key.allow_hwcrypto =
+		!(pre->flags & VB2_FIRMWARE_PREAMBLE_DISALLOW_HWCRYPTO);
+
 	/*
 	 * Check digest vs. signature.  Note that this destroys the signature.
 	 * That's ok, because we only check each signature once per boot.
 	 */
+	vb2_timestamp(ctx, VB2_TS_RSA_VERIFY_START);
 	rv = vb2_verify_digest(&key, &pre->body_signature, digest, &wb);
+	vb2_timestamp(ctx, VB2_TS_RSA_VERIFY_END);
 	if (rv)
 		vb2_fail(ctx, VB2_RECOVERY_FW_BODY, rv);
 
+ done:
+	if (!rv)
+		sd->resume.flags |= VB2_RESUME_BODY;
+
 	if (digest_out != NULL) {
 		if (digest_out_size < digest_size)
 			return VB2_ERROR_API_CHECK_DIGEST_SIZE;
 		memcpy(digest_out, digest, digest_size);
 	}
 
+	vb2_timestamp(ctx, VB2_TS_CHECK_HASH_EXIT);
 	return rv;
 }
 
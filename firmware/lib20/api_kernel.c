@@ -10,6 +10,7 @@
 #include "2api.h"
 #include "2misc.h"
 #include "2nvstorage.h"
+#include "2pipeline.h"
 #include "2secdata.h"
 #include "2sha.h"
 #include "2rsa.h"
@@ -23,6 +24,7 @@ int vb2api_kernel_phase1(struct vb2_context *ctx)
 	uint32_t key_size;
 	int rv;
 
+	vb2_workbuf_phase(ctx, VB2_WB_PHASE_KERNEL1);
 	vb2_workbuf_from_ctx(ctx, &wb);
 
 	/* Initialize secure kernel data and read version */
@@ -69,8 +71,8 @@ int vb2api_kernel_phase1(struct vb2_context *ctx)
 		if (!key_data)
 			return VB2_ERROR_API_KPHASE1_WORKBUF_REC_KEY;
 
-		rv = vb2ex_read_resource(ctx, VB2_RES_GBB, key_offset,
-					 key_data, key_size);
+		rv = vb2_read_resource(ctx, VB2_RES_GBB, key_offset,
+				       key_data, key_size);
 		if (rv)
 			return rv;
 
@@ -129,6 +131,8 @@ int vb2api_load_kernel_vblock(struct vb2_context *ctx)
 {
 	int rv;
 
+	vb2_workbuf_phase(ctx, VB2_WB_PHASE_KERNEL2);
+
 	/* Verify kernel keyblock */
 	rv = vb2_load_kernel_keyblock(ctx);
 	if (rv)
@@ -179,6 +183,8 @@ int vb2api_verify_kernel_data(struct vb2_context *ctx,
 	struct vb2_digest_context *dc;
 	struct vb2_public_key key;
 	struct vb2_workbuf wb;
+	struct vb2_pipeline_source src;
+	struct vb2_pipeline pipe;
 
 	uint8_t *digest;
 	uint32_t digest_size;
@@ -221,11 +227,14 @@ int vb2api_verify_kernel_data(struct vb2_context *ctx,
 	if (rv)
 		return rv;
 
-	rv = vb2_digest_init(dc, key.hash_alg);
+	rv = vb2_kernel_body_digest_init(dc, pre, key.hash_alg);
 	if (rv)
 		return rv;
 
-	rv = vb2_digest_extend(dc, buf, size);
+	/* The data is already in memory, so hash it in place */
+	vb2_pipeline_source_memory(&src, buf);
+	vb2_pipeline_init(&pipe, &src, 0, dc, (uint8_t *)buf);
+	rv = vb2_pipeline_run(&pipe, size);
 	if (rv)
 		return rv;
 
@@ -234,7 +243,7 @@ int vb2api_verify_kernel_data(struct vb2_context *ctx,
 	if (!digest)
 		return VB2_ERROR_API_CHECK_HASH_WORKBUF_DIGEST;
 
-	rv = vb2_digest_finalize(dc, digest, digest_size);
+	rv = vb2_kernel_body_digest_finalize(dc, digest, digest_size);
 	if (rv)
 		return rv;
 
@@ -255,6 +264,8 @@ int vb2api_kernel_phase3(struct vb2_context *ctx)
 	struct vb2_shared_data *sd = vb2_get_sd(ctx);
 	int rv;
 
+	vb2_workbuf_phase(ctx, VB2_WB_PHASE_KERNEL3);
+
 	/*
 	 * If the kernel is a newer version than in secure storage, and the
 	 * kernel signature is valid, and we're not in recovery mode, and we're
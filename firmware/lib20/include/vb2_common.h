@@ -106,6 +106,35 @@ int vb2_unpack_key_buffer(struct vb2_public_key *key,
 int vb2_unpack_key(struct vb2_public_key *key,
 		   const struct vb2_packed_key *packed_key);
 
+/**
+ * Allocate the unpacked key cache in the work buffer, if it hasn't been yet.
+ *
+ * This must be called before any temporary work buffer allocations, since
+ * the cache stays allocated for the rest of the boot.  If it can't be
+ * allocated, vb2_unpack_key_cached() just unpacks keys every time.
+ *
+ * @param ctx		Vboot context
+ */
+void vb2_key_cache_init(struct vb2_context *ctx);
+
+/**
+ * Unpack a vboot1-format key, reusing the result from an earlier call for the
+ * same packed key if there was one.
+ *
+ * Keys are looked up by where the packed key is, and a cached key is only
+ * used if the packed key header and key data words it was unpacked from are
+ * unchanged, so a packed key rewritten in place is unpacked again.  As with
+ * vb2_unpack_key(), the unpacked key points into the packed key.
+ *
+ * @param ctx		Vboot context
+ * @param key		Destination for unpacked key
+ * @param packed_key	Source packed key
+ * @return VB2_SUCCESS, or non-zero error code if error.
+ */
+int vb2_unpack_key_cached(struct vb2_context *ctx,
+			  struct vb2_public_key *key,
+			  const struct vb2_packed_key *packed_key);
+
 /**
  * Verify a signature against an expected hash digest.
  *
@@ -240,4 +269,122 @@ void vb2_kernel_get_vmlinuz_header(const struct vb2_kernel_preamble *preamble,
  */
 uint32_t vb2_kernel_get_flags(const struct vb2_kernel_preamble *preamble);
 
+/**
+ * Get the body compression for the kernel preamble.
+ *
+ * @param preamble	Preamble to check
+ * @return The compression; see VB2_KERNEL_COMPRESSION_*.  Old preamble
+ * versions (<2.4) return VB2_KERNEL_COMPRESSION_NONE.
+ */
+uint32_t vb2_kernel_get_compression(
+		const struct vb2_kernel_preamble *preamble);
+
+/**
+ * Get the size of the kernel body once it has been loaded.
+ *
+ * @param preamble	Preamble to check
+ * @return The decompressed size of a compressed body, or the signed size of
+ * one which isn't compressed.
+ */
+uint32_t vb2_kernel_get_body_load_size(
+		const struct vb2_kernel_preamble *preamble);
+
+/**
+ * Get the body chunk size for the kernel preamble.
+ *
+ * @param preamble	Preamble to check
+ * @return Size of each body chunk in bytes, or 0 if the preamble has no body
+ * chunk digests.  Old preamble versions (<2.3) return 0.
+ */
+uint32_t vb2_kernel_get_body_chunk_size(
+		const struct vb2_kernel_preamble *preamble);
+
+/**
+ * Get the number of body chunks with digests in the kernel preamble.
+ *
+ * @param preamble	Preamble to check
+ * @return The number of chunks, or 0 if the preamble has no chunk digests.
+ */
+uint32_t vb2_kernel_get_body_chunk_count(
+		const struct vb2_kernel_preamble *preamble);
+
+/**
+ * Get the body chunk digests from the kernel preamble.
+ *
+ * Only trust these after vb2_verify_kernel_preamble() has passed.
+ *
+ * @param preamble	Preamble to check
+ * @return The digests, one per chunk, or NULL if there are none.
+ */
+const uint8_t *vb2_kernel_get_body_digests(
+		const struct vb2_kernel_preamble *preamble);
+
+/**
+ * Verify one chunk of the kernel body against its digest in the preamble.
+ *
+ * Chunks can be checked in any order, as soon as each one is loaded.  The
+ * preamble must already have been verified with vb2_verify_kernel_preamble().
+ *
+ * @param preamble	Verified kernel preamble
+ * @param index		Chunk number, from 0
+ * @param buf		Chunk data
+ * @param size		Size of chunk data in bytes; all but the last chunk
+ *			are vb2_kernel_get_body_chunk_size() bytes
+ * @param hash_alg	Hash algorithm of the data key
+ * @return VB2_SUCCESS, or non-zero error code.
+ */
+int vb2_verify_kernel_body_chunk(const struct vb2_kernel_preamble *preamble,
+				 uint32_t index,
+				 const uint8_t *buf,
+				 uint32_t size,
+				 enum vb2_hash_algorithm hash_alg);
+
+/**
+ * Start hashing a kernel body.
+ *
+ * Uses the hardware crypto engine if there is one for [hash_alg], unless the
+ * preamble forbids it with VB2_KERNEL_PREAMBLE_DISALLOW_HWCRYPTO.  Either way,
+ * the body can then go through a pipeline with [dc], and its digest comes out
+ * of vb2_kernel_body_digest_finalize().
+ *
+ * @param dc		Digest context to initialize
+ * @param preamble	Verified kernel preamble
+ * @param hash_alg	Hash algorithm of the data key
+ * @return VB2_SUCCESS, or non-zero error code.
+ */
+int vb2_kernel_body_digest_init(struct vb2_digest_context *dc,
+				const struct vb2_kernel_preamble *preamble,
+				enum vb2_hash_algorithm hash_alg);
+
+/**
+ * Finish hashing a kernel body started by vb2_kernel_body_digest_init().
+ *
+ * @param dc		Digest context
+ * @param digest	Destination for digest
+ * @param digest_size	Size of digest buffer in bytes
+ * @return VB2_SUCCESS, or non-zero error code.
+ */
+int vb2_kernel_body_digest_finalize(struct vb2_digest_context *dc,
+				    uint8_t *digest,
+				    uint32_t digest_size);
+
+/**
+ * Verify a kernel body which is already in memory against the preamble.
+ *
+ * Like vb2_verify_data() on the body signature, but hashing the body with
+ * vb2_kernel_body_digest_init().  Note that this destroys the signature.
+ *
+ * @param data		Kernel body
+ * @param size		Size of kernel body buffer in bytes
+ * @param preamble	Verified kernel preamble
+ * @param key		Kernel data key
+ * @param wb		Work buffer
+ * @return VB2_SUCCESS, or non-zero error code.
+ */
+int vb2_verify_kernel_body(const uint8_t *data,
+			   uint32_t size,
+			   struct vb2_kernel_preamble *preamble,
+			   const struct vb2_public_key *key,
+			   const struct vb2_workbuf *wb);
+
 #endif  /* VBOOT_REFERENCE_VB2_COMMON_H_ */
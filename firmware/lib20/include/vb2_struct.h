@@ -189,6 +189,11 @@ struct vb2_fw_preamble {
 #define KERNEL_PREAMBLE_HEADER_VERSION_MAJOR 2
 #define KERNEL_PREAMBLE_HEADER_VERSION_MINOR 2
 
+/* Minor version of kernel preambles which carry body chunk digests */
+#define KERNEL_PREAMBLE_HEADER_VERSION_MINOR_DIGESTS 3
+/* Minor version of kernel preambles which may have compressed bodies */
+#define KERNEL_PREAMBLE_HEADER_VERSION_MINOR_COMPRESSED 4
+
 /* Flags for vb2_kernel_preamble.flags */
 /* Kernel image type = bits 1:0 */
 #define VB2_KERNEL_PREAMBLE_KERNEL_TYPE_MASK 0x00000003
@@ -196,9 +201,21 @@ struct vb2_fw_preamble {
 #define VB2_KERNEL_PREAMBLE_KERNEL_TYPE_BOOTIMG   1
 #define VB2_KERNEL_PREAMBLE_KERNEL_TYPE_MULTIBOOT 2
 /* Kernel type 3 is reserved for future use */
+/* Body compression = bits 3:2; header version 2.4 and up only */
+#define VB2_KERNEL_PREAMBLE_COMPRESSION_MASK  0x0000000c
+#define VB2_KERNEL_PREAMBLE_COMPRESSION_SHIFT 2
+#define VB2_KERNEL_COMPRESSION_NONE 0
+#define VB2_KERNEL_COMPRESSION_LZMA 1
+#define VB2_KERNEL_COMPRESSION_LZ4  2
+/* Compression 3 is reserved for future use */
+/*
+ * Don't hash the body in a hardware crypto engine, even if there is one; see
+ * VB2_FIRMWARE_PREAMBLE_DISALLOW_HWCRYPTO.  Header version 2.2 and up only.
+ */
+#define VB2_KERNEL_PREAMBLE_DISALLOW_HWCRYPTO 0x00000010
 
 /*
- * Preamble block for kernel, version 2.2
+ * Preamble block for kernel, version 2.4
  *
  * This should be followed by:
  *   1) The signature data for the kernel body, pointed to by
@@ -207,6 +224,13 @@ struct vb2_fw_preamble {
  *       pointed to by preamble_signature.sig_offset.
  *   3) The 16-bit vmlinuz header, which is used for reconstruction of
  *      vmlinuz image.
+ *
+ * Version 2.3 preambles may also contain the body chunk digests, pointed to
+ * by body_digest_offset.
+ *
+ * In version 2.4 the body may be compressed.  Its signature, and any chunk
+ * digests, cover the compressed body as stored; it decompresses to
+ * body_load_size bytes at body_load_address.
  */
 struct vb2_kernel_preamble {
 	/*
@@ -276,10 +300,46 @@ struct vb2_kernel_preamble {
 	 * header version < 2.2.
 	 */
 	uint32_t flags;
+
+	/*
+	 * Fields added in header version 2.3.  You must verify the header
+	 * version before reading these fields!
+	 */
+
+	/*
+	 * Size of each chunk of the body, in bytes; the last chunk may be
+	 * shorter.  Readers should return 0, meaning there are no chunk
+	 * digests, for header version < 2.3.
+	 */
+	uint32_t body_chunk_size;
+
+	/*
+	 * Offset of the chunk digests from the start of the preamble.  There
+	 * is one digest per chunk, using the hash algorithm of the data key,
+	 * and they are covered by the preamble signature.  The body signature
+	 * still covers the whole body, for readers which don't know about
+	 * chunks.
+	 */
+	uint32_t body_digest_offset;
+
+	/*
+	 * Fields added in header version 2.4.  You must verify the header
+	 * version before reading these fields!
+	 */
+
+	/*
+	 * Size of the body once decompressed to body_load_address, in bytes.
+	 * The bootloader and vmlinuz header addresses point into this.
+	 * Readers should use body_signature.data_size instead for header
+	 * version < 2.4, or when the body is not compressed.
+	 */
+	uint32_t body_load_size;
 } __attribute__((packed));
 
 #define EXPECTED_VB2_KERNEL_PREAMBLE_2_0_SIZE 96
 #define EXPECTED_VB2_KERNEL_PREAMBLE_2_1_SIZE 112
 #define EXPECTED_VB2_KERNEL_PREAMBLE_2_2_SIZE 116
+#define EXPECTED_VB2_KERNEL_PREAMBLE_2_3_SIZE 124
+#define EXPECTED_VB2_KERNEL_PREAMBLE_2_4_SIZE 128
 
 #endif  /* VBOOT_REFERENCE_VB2_STRUCT_H_ */
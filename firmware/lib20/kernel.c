@@ -8,6 +8,7 @@
 #include "2sysincludes.h"
 #include "2misc.h"
 #include "2nvstorage.h"
+#include "2pipeline.h"
 #include "2rsa.h"
 #include "2secdata.h"
 #include "2sha.h"
@@ -100,6 +101,8 @@ int vb2_load_kernel_keyblock(struct vb2_context *ctx)
 	struct vb2_packed_key *packed_key;
 	struct vb2_public_key kernel_key;
 
+	struct vb2_pipeline_source src;
+	struct vb2_pipeline pipe;
 	struct vb2_keyblock *kb;
 	uint32_t block_size;
 
@@ -131,29 +134,33 @@ int vb2_load_kernel_keyblock(struct vb2_context *ctx)
 	if (!kb)
 		return VB2_ERROR_KERNEL_KEYBLOCK_WORKBUF_HEADER;
 
-	rv = vb2ex_read_resource(ctx, VB2_RES_KERNEL_VBLOCK, 0, kb,
-				 sizeof(*kb));
+	vb2_pipeline_source_resource(&src, ctx, VB2_RES_KERNEL_VBLOCK, 0);
+	vb2_pipeline_init(&pipe, &src, 0, NULL, (uint8_t *)kb);
+	rv = vb2_pipeline_run(&pipe, sizeof(*kb));
 	if (rv)
 		return rv;
 
 	block_size = kb->keyblock_size;
 
 	/*
-	 * Load the entire keyblock, now that we know how big it is.  Note that
-	 * we're loading the entire keyblock instead of just the piece after
-	 * the header.  That means we re-read the header.  But that's a tiny
-	 * amount of data, and it makes the code much more straightforward.
+	 * Load the entire keyblock, now that we know how big it is.  The
+	 * realloc leaves the header in place, so the pipeline only needs to
+	 * read the rest of the keyblock after it.
 	 */
 	kb = vb2_workbuf_realloc(&wb, sizeof(*kb), block_size);
 	if (!kb)
 		return VB2_ERROR_KERNEL_KEYBLOCK_WORKBUF;
 
-	rv = vb2ex_read_resource(ctx, VB2_RES_KERNEL_VBLOCK, 0, kb, block_size);
-	if (rv)
-		return rv;
+	if (block_size > sizeof(*kb)) {
+		rv = vb2_pipeline_run(&pipe, block_size - sizeof(*kb));
+		if (rv)
+			return rv;
+	}
 
 	/* Verify the keyblock */
+	vb2_timestamp(ctx, VB2_TS_RSA_VERIFY_START);
 	rv = vb2_verify_keyblock(kb, block_size, &kernel_key, &wb);
+	vb2_timestamp(ctx, VB2_TS_RSA_VERIFY_END);
 	if (rv) {
 		keyblock_is_valid = 0;
 		if (need_keyblock_valid)
@@ -264,7 +271,11 @@ int vb2_verify_kernel_preamble(struct vb2_kernel_preamble *preamble,
 		return VB2_ERROR_PREAMBLE_HEADER_VERSION;
 	}
 
-	if (preamble->header_version_minor >= 2)
+	if (preamble->header_version_minor >= 4)
+		min_size = EXPECTED_VB2_KERNEL_PREAMBLE_2_4_SIZE;
+	else if (preamble->header_version_minor == 3)
+		min_size = EXPECTED_VB2_KERNEL_PREAMBLE_2_3_SIZE;
+	else if (preamble->header_version_minor == 2)
 		min_size = EXPECTED_VB2_KERNEL_PREAMBLE_2_2_SIZE;
 	else if (preamble->header_version_minor == 1)
 		min_size = EXPECTED_VB2_KERNEL_PREAMBLE_2_1_SIZE;
@@ -308,9 +319,19 @@ int vb2_verify_kernel_preamble(struct vb2_kernel_preamble *preamble,
 		return VB2_ERROR_PREAMBLE_BODY_SIG_OUTSIDE;
 	}
 
+	/* Only 2.4 knows about compression, and only some kinds */
+	if ((vb2_kernel_get_flags(preamble) &
+	     VB2_KERNEL_PREAMBLE_COMPRESSION_MASK) &&
+	    (preamble->header_version_minor < 4 ||
+	     vb2_kernel_get_compression(preamble) >
+	     VB2_KERNEL_COMPRESSION_LZ4)) {
+		VB2_DEBUG("Unknown kernel body compression\n");
+		return VB2_ERROR_PREAMBLE_COMPRESSION;
+	}
+
 	/*
 	 * If bootloader is present, verify it's covered by the body
-	 * signature.
+	 * signature.  For a compressed body, that's once it's decompressed.
 	 */
 	if (preamble->bootloader_size) {
 		const void *body_ptr =
@@ -318,7 +339,8 @@ int vb2_verify_kernel_preamble(struct vb2_kernel_preamble *preamble,
 		const void *bootloader_ptr =
 			(const void *)(uintptr_t)preamble->bootloader_address;
 		if (vb2_verify_member_inside(body_ptr,
-					     preamble->body_signature.data_size,
+					     vb2_kernel_get_body_load_size(
+						     preamble),
 					     bootloader_ptr,
 					     preamble->bootloader_size,
 					     0, 0)) {
@@ -338,7 +360,8 @@ int vb2_verify_kernel_preamble(struct vb2_kernel_preamble *preamble,
 		const void *vmlinuz_header_ptr = (const void *)
 			(uintptr_t)preamble->vmlinuz_header_address;
 		if (vb2_verify_member_inside(body_ptr,
-					     preamble->body_signature.data_size,
+					     vb2_kernel_get_body_load_size(
+						     preamble),
 					     vmlinuz_header_ptr,
 					     preamble->vmlinuz_header_size,
 					     0, 0)) {
@@ -347,6 +370,22 @@ int vb2_verify_kernel_preamble(struct vb2_kernel_preamble *preamble,
 		}
 	}
 
+	/* If there are body chunk digests, verify they're signed */
+	if (vb2_kernel_get_body_chunk_size(preamble)) {
+		const uint8_t *digests = vb2_kernel_get_body_digests(preamble);
+		uint64_t digests_size =
+			(uint64_t)vb2_kernel_get_body_chunk_count(preamble) *
+			vb2_digest_size(key->hash_alg);
+
+		if (!digests_size ||
+		    digests_size > preamble->preamble_size ||
+		    vb2_verify_member_inside(preamble, sig->data_size,
+					     digests, digests_size, 0, 0)) {
+			VB2_DEBUG("Body digests off end of signed data\n");
+			return VB2_ERROR_PREAMBLE_BODY_DIGESTS_OUTSIDE;
+		}
+	}
+
 	/* Success */
 	return VB2_SUCCESS;
 }
@@ -365,6 +404,8 @@ int vb2_load_kernel_preamble(struct vb2_context *ctx)
 	 * padded to around 64KB. */
 	struct vb2_kernel_preamble *pre;
 	uint32_t pre_size;
+	struct vb2_pipeline_source src;
+	struct vb2_pipeline pipe;
 
 	int rv;
 
@@ -383,24 +424,28 @@ int vb2_load_kernel_preamble(struct vb2_context *ctx)
 	if (!pre)
 		return VB2_ERROR_KERNEL_PREAMBLE2_WORKBUF_HEADER;
 
-	rv = vb2ex_read_resource(ctx, VB2_RES_KERNEL_VBLOCK,
-				 sd->vblock_preamble_offset,
-				 pre, sizeof(*pre));
+	vb2_pipeline_source_resource(&src, ctx, VB2_RES_KERNEL_VBLOCK,
+				     sd->vblock_preamble_offset);
+	vb2_pipeline_init(&pipe, &src, 0, NULL, (uint8_t *)pre);
+	rv = vb2_pipeline_run(&pipe, sizeof(*pre));
 	if (rv)
 		return rv;
 
 	pre_size = pre->preamble_size;
 
-	/* Load the entire preamble, now that we know how big it is */
+	/*
+	 * Load the entire preamble, now that we know how big it is.  The
+	 * header is already in place, so just read the rest.
+	 */
 	pre = vb2_workbuf_realloc(&wb, sizeof(*pre), pre_size);
 	if (!pre)
 		return VB2_ERROR_KERNEL_PREAMBLE2_WORKBUF;
 
-	rv = vb2ex_read_resource(ctx, VB2_RES_KERNEL_VBLOCK,
-				 sd->vblock_preamble_offset,
-				 pre, pre_size);
-	if (rv)
-		return rv;
+	if (pre_size > sizeof(*pre)) {
+		rv = vb2_pipeline_run(&pipe, pre_size - sizeof(*pre));
+		if (rv)
+			return rv;
+	}
 
 	/*
 	 * Work buffer now contains:
@@ -411,7 +456,9 @@ int vb2_load_kernel_preamble(struct vb2_context *ctx)
 	 */
 
 	/* Verify the preamble */
+	vb2_timestamp(ctx, VB2_TS_RSA_VERIFY_START);
 	rv = vb2_verify_kernel_preamble(pre, pre_size, &data_key, &wb);
+	vb2_timestamp(ctx, VB2_TS_RSA_VERIFY_END);
 	if (rv)
 		return rv;
 
@@ -476,3 +523,176 @@ uint32_t vb2_kernel_get_flags(const struct vb2_kernel_preamble *preamble)
 
 	return preamble->flags;
 }
+
+uint32_t vb2_kernel_get_compression(
+		const struct vb2_kernel_preamble *preamble)
+{
+	if (preamble->header_version_minor < 4)
+		return VB2_KERNEL_COMPRESSION_NONE;
+
+	return (preamble->flags & VB2_KERNEL_PREAMBLE_COMPRESSION_MASK) >>
+		VB2_KERNEL_PREAMBLE_COMPRESSION_SHIFT;
+}
+
+uint32_t vb2_kernel_get_body_load_size(
+		const struct vb2_kernel_preamble *preamble)
+{
+	if (vb2_kernel_get_compression(preamble) ==
+	    VB2_KERNEL_COMPRESSION_NONE)
+		return preamble->body_signature.data_size;
+
+	return preamble->body_load_size;
+}
+
+uint32_t vb2_kernel_get_body_chunk_size(
+		const struct vb2_kernel_preamble *preamble)
+{
+	if (preamble->header_version_minor < 3)
+		return 0;
+
+	return preamble->body_chunk_size;
+}
+
+uint32_t vb2_kernel_get_body_chunk_count(
+		const struct vb2_kernel_preamble *preamble)
+{
+	uint32_t chunk_size = vb2_kernel_get_body_chunk_size(preamble);
+	uint32_t size = preamble->body_signature.data_size;
+
+	if (!chunk_size)
+		return 0;
+
+	return size / chunk_size + (size % chunk_size ? 1 : 0);
+}
+
+const uint8_t *vb2_kernel_get_body_digests(
+		const struct vb2_kernel_preamble *preamble)
+{
+	if (!vb2_kernel_get_body_chunk_size(preamble))
+		return NULL;
+
+	return (const uint8_t *)preamble + preamble->body_digest_offset;
+}
+
+int vb2_verify_kernel_body_chunk(const struct vb2_kernel_preamble *preamble,
+				 uint32_t index,
+				 const uint8_t *buf,
+				 uint32_t size,
+				 enum vb2_hash_algorithm hash_alg)
+{
+	uint32_t chunk_size = vb2_kernel_get_body_chunk_size(preamble);
+	uint32_t digest_size = vb2_digest_size(hash_alg);
+	uint8_t digest[VB2_MAX_DIGEST_SIZE];
+	uint32_t want_size;
+	int rv;
+
+	if (index >= vb2_kernel_get_body_chunk_count(preamble))
+		return VB2_ERROR_PREAMBLE_BODY_CHUNK_INDEX;
+
+	/* Only the last chunk can be short */
+	want_size = preamble->body_signature.data_size - index * chunk_size;
+	if (want_size > chunk_size)
+		want_size = chunk_size;
+	if (size != want_size)
+		return VB2_ERROR_PREAMBLE_BODY_CHUNK_INDEX;
+
+	rv = vb2_digest_buffer(buf, size, hash_alg, digest, digest_size);
+	if (rv)
+		return rv;
+
+	if (vb2_safe_memcmp(digest, vb2_kernel_get_body_digests(preamble) +
+			    index * digest_size, digest_size))
+		return VB2_ERROR_PREAMBLE_BODY_CHUNK_DIGEST;
+
+	return VB2_SUCCESS;
+}
+
+int vb2_kernel_body_digest_init(struct vb2_digest_context *dc,
+				const struct vb2_kernel_preamble *preamble,
+				enum vb2_hash_algorithm hash_alg)
+{
+	int rv;
+
+	if (!(vb2_kernel_get_flags(preamble) &
+	      VB2_KERNEL_PREAMBLE_DISALLOW_HWCRYPTO)) {
+		rv = vb2ex_hwcrypto_digest_init(
+				hash_alg, preamble->body_signature.data_size);
+		if (!rv) {
+			VB2_DEBUG("Using HW crypto engine for hash_alg %d\n",
+				  hash_alg);
+			dc->hash_alg = hash_alg;
+			dc->using_hwcrypto = 1;
+			return VB2_SUCCESS;
+		}
+		if (rv != VB2_ERROR_EX_HWCRYPTO_UNSUPPORTED)
+			return rv;
+		VB2_DEBUG("HW crypto for hash_alg %d not supported, using SW\n",
+			  hash_alg);
+	} else {
+		VB2_DEBUG("HW crypto forbidden by preamble, using SW\n");
+	}
+
+	return vb2_digest_init(dc, hash_alg);
+}
+
+int vb2_kernel_body_digest_finalize(struct vb2_digest_context *dc,
+				    uint8_t *digest,
+				    uint32_t digest_size)
+{
+	if (dc->using_hwcrypto)
+		return vb2ex_hwcrypto_digest_finalize(digest, digest_size);
+	else
+		return vb2_digest_finalize(dc, digest, digest_size);
+}
+
+int vb2_verify_kernel_body(const uint8_t *data,
+			   uint32_t size,
+			   struct vb2_kernel_preamble *preamble,
+			   const struct vb2_public_key *key,
+			   const struct vb2_workbuf *wb)
+{
+	struct vb2_signature *sig = &preamble->body_signature;
+	struct vb2_workbuf wblocal = *wb;
+	struct vb2_pipeline_source src;
+	struct vb2_pipeline pipe;
+	struct vb2_digest_context *dc;
+	uint8_t *digest;
+	uint32_t digest_size;
+	int rv;
+
+	if (sig->data_size > size) {
+		VB2_DEBUG("Data buffer smaller than length of signed data.\n");
+		return VB2_ERROR_VDATA_NOT_ENOUGH_DATA;
+	}
+
+	digest_size = vb2_digest_size(key->hash_alg);
+	if (!digest_size)
+		return VB2_ERROR_VDATA_DIGEST_SIZE;
+
+	digest = vb2_workbuf_alloc(&wblocal, digest_size);
+	if (!digest)
+		return VB2_ERROR_VDATA_WORKBUF_DIGEST;
+
+	dc = vb2_workbuf_alloc(&wblocal, sizeof(*dc));
+	if (!dc)
+		return VB2_ERROR_VDATA_WORKBUF_HASHING;
+
+	rv = vb2_kernel_body_digest_init(dc, preamble, key->hash_alg);
+	if (rv)
+		return rv;
+
+	/* The data is already in memory, so hash it in place */
+	vb2_pipeline_source_memory(&src, data);
+	vb2_pipeline_init(&pipe, &src, 0, dc, (uint8_t *)data);
+	rv = vb2_pipeline_run(&pipe, sig->data_size);
+	if (rv)
+		return rv;
+
+	rv = vb2_kernel_body_digest_finalize(dc, digest, digest_size);
+	if (rv)
+		return rv;
+
+	vb2_workbuf_free(&wblocal, sizeof(*dc));
+
+	return vb2_verify_digest(key, sig, digest, &wblocal);
+}
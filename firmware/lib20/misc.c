@@ -65,6 +65,25 @@ static void vb2_report_dev_firmware(struct vb2_public_key *root)
 		VB2_DEBUG("This is developer signed firmware\n");
 }
 
+/*
+ * Record the SHA-256 of keyblock or preamble data in the resume state.
+ * Returns 1 if it's unchanged since it was verified before S3 suspend.
+ */
+static int resume_data_unchanged(struct vb2_context *ctx, uint32_t flag,
+				 const void *data, uint32_t size,
+				 uint8_t *recorded)
+{
+	uint8_t digest[VB2_SHA256_DIGEST_SIZE];
+
+	if (vb2_digest_buffer(data, size, VB2_HASH_SHA256,
+			      digest, sizeof(digest))) {
+		vb2_get_sd(ctx)->status &= ~VB2_SD_STATUS_RESUME_STATE;
+		return 0;
+	}
+
+	return vb2_resume_digest(ctx, flag, digest, recorded, sizeof(digest));
+}
+
 int vb2_load_fw_keyblock(struct vb2_context *ctx)
 {
 	struct vb2_shared_data *sd = vb2_get_sd(ctx);
@@ -73,6 +92,7 @@ int vb2_load_fw_keyblock(struct vb2_context *ctx)
 	uint8_t *key_data;
 	uint32_t key_size;
 	struct vb2_packed_key *packed_key;
+	const struct vb2_public_key *embedded_key;
 	struct vb2_public_key root_key;
 
 	struct vb2_keyblock *kb;
@@ -82,56 +102,83 @@ int vb2_load_fw_keyblock(struct vb2_context *ctx)
 
 	vb2_workbuf_from_ctx(ctx, &wb);
 
-	/* Read the root key */
+	/*
+	 * Make room for the root key.  The data key is saved here later, so
+	 * this is needed even if the root key is built into the firmware.
+	 */
 	key_size = sd->gbb_rootkey_size;
 	key_data = vb2_workbuf_alloc(&wb, key_size);
 	if (!key_data)
 		return VB2_ERROR_FW_KEYBLOCK_WORKBUF_ROOT_KEY;
 
-	rv = vb2ex_read_resource(ctx, VB2_RES_GBB, sd->gbb_rootkey_offset,
-				 key_data, key_size);
-	if (rv)
-		return rv;
+	embedded_key = vb2ex_embedded_root_key();
+	if (embedded_key) {
+		/* Already unpacked, so there's no need to read the GBB copy */
+		root_key = *embedded_key;
+	} else {
+		rv = vb2_read_resource(ctx, VB2_RES_GBB,
+				       sd->gbb_rootkey_offset,
+				       key_data, key_size);
+		if (rv)
+			return rv;
 
-	/* Unpack the root key */
-	rv = vb2_unpack_key_buffer(&root_key, key_data, key_size);
-	if (rv)
-		return rv;
+		rv = vb2_unpack_key_buffer(&root_key, key_data, key_size);
+		if (rv)
+			return rv;
+	}
+	root_key.allow_hwcrypto = 1;
 
 	/* If that's the checked-in root key, this is dev-signed firmware */
 	vb2_report_dev_firmware(&root_key);
 
-	/* Load the firmware keyblock header after the root key */
-	kb = vb2_workbuf_alloc(&wb, sizeof(*kb));
-	if (!kb)
-		return VB2_ERROR_FW_KEYBLOCK_WORKBUF_HEADER;
+	/*
+	 * Read ahead the start of the vblock after the root key.  The keyblock
+	 * is then usually verified in place, and the preamble after it needs
+	 * no more reads.
+	 */
+	vb2_read_vblock_ahead(ctx, &wb);
 
-	rv = vb2ex_read_resource(ctx, VB2_RES_FW_VBLOCK, 0, kb, sizeof(*kb));
+	rv = vb2_read_vblock(ctx, offsetof(struct vb2_keyblock, keyblock_size),
+			     &block_size, sizeof(block_size));
 	if (rv)
 		return rv;
 
-	block_size = kb->keyblock_size;
+	/* Read the rest of the keyblock, now that we know how big it is */
+	if (block_size > sd->workbuf_vblock_ahead_size) {
+		kb = vb2_workbuf_realloc(&wb, sd->workbuf_vblock_ahead_size,
+					 block_size);
+		if (!kb)
+			return VB2_ERROR_FW_KEYBLOCK_WORKBUF;
 
-	/*
-	 * Load the entire keyblock, now that we know how big it is.  Note that
-	 * we're loading the entire keyblock instead of just the piece after
-	 * the header.  That means we re-read the header.  But that's a tiny
-	 * amount of data, and it makes the code much more straightforward.
-	 */
-	kb = vb2_workbuf_realloc(&wb, sizeof(*kb), block_size);
-	if (!kb)
-		return VB2_ERROR_FW_KEYBLOCK_WORKBUF;
+		rv = vb2_read_vblock(ctx, 0, kb, block_size);
+		if (rv)
+			return rv;
 
-	rv = vb2ex_read_resource(ctx, VB2_RES_FW_VBLOCK, 0, kb, block_size);
-	if (rv)
-		return rv;
+		sd->workbuf_vblock_ahead_offset =
+			vb2_offset_of(ctx->workbuf, kb);
+		sd->workbuf_vblock_ahead_size = block_size;
+	} else {
+		kb = (struct vb2_keyblock *)
+			(ctx->workbuf + sd->workbuf_vblock_ahead_offset);
+	}
 
-	/* Verify the keyblock */
-	rv = vb2_verify_keyblock(kb, block_size, &root_key, &wb);
-	if (rv) {
-		vb2_fail(ctx, VB2_RECOVERY_FW_KEYBLOCK, rv);
-		return rv;
+	/*
+	 * Verify the keyblock, unless it's the one already verified before
+	 * S3 suspend.
+	 */
+	if (resume_data_unchanged(ctx, VB2_RESUME_KEYBLOCK, kb, block_size,
+				  sd->resume.keyblock_digest)) {
+		VB2_DEBUG("Keyblock unchanged since suspend\n");
+	} else {
+		vb2_timestamp(ctx, VB2_TS_RSA_VERIFY_START);
+		rv = vb2_verify_keyblock(kb, block_size, &root_key, &wb);
+		vb2_timestamp(ctx, VB2_TS_RSA_VERIFY_END);
+		if (rv) {
+			vb2_fail(ctx, VB2_RECOVERY_FW_KEYBLOCK, rv);
+			return rv;
+		}
 	}
+	sd->resume.flags |= VB2_RESUME_KEYBLOCK;
 
 	/* Key version is the upper 16 bits of the composite firmware version */
 	if (kb->data_key.key_version > VB2_MAX_KEY_VERSION)
@@ -156,6 +203,13 @@ int vb2_load_fw_keyblock(struct vb2_context *ctx)
 	 */
 	packed_key = (struct vb2_packed_key *)key_data;
 
+	/* With nothing read here, the data key goes right after its header */
+	if (embedded_key) {
+		if (sizeof(*packed_key) + kb->data_key.key_size > key_size)
+			return VB2_ERROR_FW_KEYBLOCK_DATA_KEY_SIZE;
+		packed_key->key_offset = sizeof(*packed_key);
+	}
+
 	packed_key->algorithm = kb->data_key.algorithm;
 	packed_key->key_version = kb->data_key.key_version;
 	packed_key->key_size = kb->data_key.key_size;
@@ -215,39 +269,46 @@ int vb2_load_fw_preamble(struct vb2_context *ctx)
 	rv = vb2_unpack_key_buffer(&data_key, key_data, key_size);
 	if (rv)
 		return rv;
+	data_key.allow_hwcrypto = 1;
 
-	/* Load the firmware preamble header */
-	pre = vb2_workbuf_alloc(&wb, sizeof(*pre));
-	if (!pre)
-		return VB2_ERROR_FW_PREAMBLE2_WORKBUF_HEADER;
-
-	rv = vb2ex_read_resource(ctx, VB2_RES_FW_VBLOCK,
-				 sd->vblock_preamble_offset,
-				 pre, sizeof(*pre));
+	/* Get the preamble size from its header */
+	rv = vb2_read_vblock(ctx, sd->vblock_preamble_offset +
+			     offsetof(struct vb2_fw_preamble, preamble_size),
+			     &pre_size, sizeof(pre_size));
 	if (rv)
 		return rv;
 
-	pre_size = pre->preamble_size;
-
 	/* Load the entire firmware preamble, now that we know how big it is */
-	pre = vb2_workbuf_realloc(&wb, sizeof(*pre), pre_size);
+	pre = vb2_workbuf_alloc(&wb, pre_size);
 	if (!pre)
 		return VB2_ERROR_FW_PREAMBLE2_WORKBUF;
 
-	rv = vb2ex_read_resource(ctx, VB2_RES_FW_VBLOCK,
-				 sd->vblock_preamble_offset,
-				 pre, pre_size);
+	rv = vb2_read_vblock(ctx, sd->vblock_preamble_offset, pre, pre_size);
 	if (rv)
 		return rv;
 
+	/* Anything read ahead is now overwritten */
+	sd->workbuf_vblock_ahead_size = 0;
+
 	/* Work buffer now contains the data subkey data and the preamble */
 
-	/* Verify the preamble */
-	rv = vb2_verify_fw_preamble(pre, pre_size, &data_key, &wb);
-	if (rv) {
-		vb2_fail(ctx, VB2_RECOVERY_FW_PREAMBLE, rv);
-		return rv;
+	/*
+	 * Verify the preamble, unless it's the one already verified before
+	 * S3 suspend.
+	 */
+	if (resume_data_unchanged(ctx, VB2_RESUME_PREAMBLE, pre, pre_size,
+				  sd->resume.preamble_digest)) {
+		VB2_DEBUG("Preamble unchanged since suspend\n");
+	} else {
+		vb2_timestamp(ctx, VB2_TS_RSA_VERIFY_START);
+		rv = vb2_verify_fw_preamble(pre, pre_size, &data_key, &wb);
+		vb2_timestamp(ctx, VB2_TS_RSA_VERIFY_END);
+		if (rv) {
+			vb2_fail(ctx, VB2_RECOVERY_FW_PREAMBLE, rv);
+			return rv;
+		}
 	}
+	sd->resume.flags |= VB2_RESUME_PREAMBLE;
 
 	/*
 	 * Firmware version is the lower 16 bits of the composite firmware
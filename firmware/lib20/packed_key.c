@@ -6,6 +6,7 @@
  */
 
 #include "2sysincludes.h"
+#include "2misc.h"
 #include "2rsa.h"
 #include "vb2_common.h"
 
@@ -35,6 +36,10 @@ int vb2_unpack_key_buffer(struct vb2_public_key *key,
 	int rv;
 
 	/* Make sure passed buffer is big enough for the packed key */
+	rv = vb2_verify_member_inside(buf, size, packed_key,
+				      sizeof(*packed_key), 0, 0);
+	if (rv)
+		return rv;
 	rv = vb2_verify_packed_key_inside(buf, size, packed_key);
 	if (rv)
 		return rv;
@@ -74,6 +79,9 @@ int vb2_unpack_key_buffer(struct vb2_public_key *key,
 	key->n = buf32 + 2;
 	key->rr = buf32 + 2 + key->arrsize;
 
+	/* Callers that want the hardware crypto engine say so */
+	key->allow_hwcrypto = 0;
+
 	return VB2_SUCCESS;
 }
 
@@ -88,3 +96,115 @@ int vb2_unpack_key(struct vb2_public_key *key,
 				     packed_key->key_offset +
 				     packed_key->key_size);
 }
+
+/* Number of unpacked keys remembered */
+#define KEY_CACHE_ENTRIES 4
+
+/* A key and the parts of the packed key it was unpacked from */
+struct key_cache_entry {
+	const struct vb2_packed_key *packed_key;
+	uint32_t algorithm;
+	uint32_t key_offset;
+	uint32_t key_size;
+	uint32_t arrsize;
+	uint32_t n0inv;
+	struct vb2_public_key key;
+};
+
+struct vb2_key_cache {
+	/* Number of entries added; once full, the oldest entry is replaced */
+	uint32_t count;
+	struct key_cache_entry entries[KEY_CACHE_ENTRIES];
+};
+
+void vb2_key_cache_init(struct vb2_context *ctx)
+{
+	struct vb2_shared_data *sd = vb2_get_sd(ctx);
+	struct vb2_key_cache *cache;
+	struct vb2_workbuf wb;
+
+	if (sd->workbuf_key_cache_size)
+		return;
+
+	/* Nowhere to keep it if the context hasn't been initialized */
+	if (!ctx->workbuf_used)
+		return;
+
+	vb2_workbuf_from_ctx(ctx, &wb);
+	cache = vb2_workbuf_alloc(&wb, sizeof(*cache));
+	if (!cache)
+		return;
+
+	memset(cache, 0, sizeof(*cache));
+	sd->workbuf_key_cache_offset = vb2_offset_of(ctx->workbuf, cache);
+	sd->workbuf_key_cache_size = sizeof(*cache);
+	vb2_set_workbuf_used(ctx, sd->workbuf_key_cache_offset +
+			     sizeof(*cache));
+}
+
+/**
+ * Check whether a cache entry still matches its packed key.
+ *
+ * Everything vb2_unpack_key() derives the key from is compared, so a match
+ * gives the same key unpacking would.
+ */
+static int key_cache_match(const struct key_cache_entry *entry,
+			   const struct vb2_packed_key *packed_key)
+{
+	const uint32_t *buf32;
+
+	if (entry->packed_key != packed_key ||
+	    entry->algorithm != packed_key->algorithm ||
+	    entry->key_offset != packed_key->key_offset ||
+	    entry->key_size != packed_key->key_size)
+		return 0;
+
+	/* Same offset as when it was unpacked, so it's still aligned */
+	buf32 = (const uint32_t *)vb2_packed_key_data(packed_key);
+	return entry->arrsize == buf32[0] && entry->n0inv == buf32[1];
+}
+
+int vb2_unpack_key_cached(struct vb2_context *ctx,
+			  struct vb2_public_key *key,
+			  const struct vb2_packed_key *packed_key)
+{
+	struct vb2_shared_data *sd = vb2_get_sd(ctx);
+	struct vb2_key_cache *cache;
+	struct key_cache_entry *entry;
+	uint32_t count, i;
+	int rv;
+
+	if (!packed_key)
+		return VB2_ERROR_UNPACK_KEY_BUFFER;
+
+	if (!sd->workbuf_key_cache_size)
+		return vb2_unpack_key(key, packed_key);
+
+	cache = (struct vb2_key_cache *)
+		(ctx->workbuf + sd->workbuf_key_cache_offset);
+	count = cache->count;
+	if (count > KEY_CACHE_ENTRIES)
+		count = KEY_CACHE_ENTRIES;
+
+	for (i = 0; i < count; i++) {
+		if (key_cache_match(cache->entries + i, packed_key)) {
+			*key = cache->entries[i].key;
+			return VB2_SUCCESS;
+		}
+	}
+
+	rv = vb2_unpack_key(key, packed_key);
+	if (rv)
+		return rv;
+
+	entry = cache->entries + cache->count++ % KEY_CACHE_ENTRIES;
+	entry->packed_key = packed_key;
+	entry->algorithm = packed_key->algorithm;
+	entry->key_offset = packed_key->key_offset;
+	entry->key_size = packed_key->key_size;
+	entry->arrsize = key->arrsize;
+	entry->n0inv = key->n0inv;
+	entry->key = *key;
+
+	return VB2_SUCCESS;
+}
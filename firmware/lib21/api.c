@@ -37,6 +37,70 @@ int vb21api_fw_phase3(struct vb2_context *ctx)
 	return VB2_SUCCESS;
 }
 
+/* Hash started by vb21api_init_hash_tag() */
+struct vb21_hash_tag {
+	/* Offset of hash signature in work buffer, or 0 if entry is unused */
+	uint32_t sig_offset;
+
+	/* Amount of data we still expect to hash */
+	uint32_t remaining_size;
+
+	struct vb2_digest_context dc;
+};
+
+/**
+ * Find the hash signature for a tag in the preamble.
+ *
+ * @return The signature, or NULL if the preamble has no hash for the tag.
+ */
+static const struct vb21_signature *find_hash(
+				const struct vb21_fw_preamble *pre,
+				const struct vb2_id *id)
+{
+	const struct vb21_signature *sig;
+	uint32_t hash_offset = pre->hash_offset;
+	int i;
+
+	for (i = 0; i < pre->hash_count; i++) {
+		sig = (const struct vb21_signature *)
+			((const uint8_t *)pre + hash_offset);
+
+		if (!memcmp(id, &sig->id, sizeof(*id)))
+			return sig;
+
+		hash_offset += sig->c.total_size;
+	}
+
+	return NULL;
+}
+
+/**
+ * Find the table entry for a tag being hashed.
+ *
+ * @return The entry, or NULL if the tag is not being hashed.
+ */
+static struct vb21_hash_tag *find_hash_tag(struct vb2_context *ctx,
+					   const struct vb2_id *id)
+{
+	struct vb2_shared_data *sd = vb2_get_sd(ctx);
+	struct vb21_hash_tag *tags = (struct vb21_hash_tag *)
+		(ctx->workbuf + sd->workbuf_hash_tags_offset);
+	const struct vb21_signature *sig;
+	int i;
+
+	for (i = 0; i < sd->hash_tags_count; i++) {
+		if (!tags[i].sig_offset)
+			continue;
+
+		sig = (const struct vb21_signature *)
+			(ctx->workbuf + tags[i].sig_offset);
+		if (!memcmp(id, &sig->id, sizeof(*id)))
+			return tags + i;
+	}
+
+	return NULL;
+}
+
 int vb21api_init_hash(struct vb2_context *ctx,
 		      const struct vb2_id *id,
 		      uint32_t *size)
@@ -46,8 +110,7 @@ int vb21api_init_hash(struct vb2_context *ctx,
 	const struct vb21_signature *sig = NULL;
 	struct vb2_digest_context *dc;
 	struct vb2_workbuf wb;
-	uint32_t hash_offset;
-	int i, rv;
+	int rv;
 
 	vb2_workbuf_from_ctx(ctx, &wb);
 
@@ -58,17 +121,8 @@ int vb21api_init_hash(struct vb2_context *ctx,
 		(ctx->workbuf + sd->workbuf_preamble_offset);
 
 	/* Find the matching signature */
-	hash_offset = pre->hash_offset;
-	for (i = 0; i < pre->hash_count; i++) {
-		sig = (const struct vb21_signature *)
-			((uint8_t *)pre + hash_offset);
-
-		if (!memcmp(id, &sig->id, sizeof(*id)))
-			break;
-
-		hash_offset += sig->c.total_size;
-	}
-	if (i >= pre->hash_count)
+	sig = find_hash(pre, id);
+	if (!sig)
 		return VB2_ERROR_API_INIT_HASH_ID;  /* No match */
 
 	/* Allocate workbuf space for the hash */
@@ -113,6 +167,124 @@ int vb21api_init_hash(struct vb2_context *ctx,
 	return vb2_digest_init(dc, sig->hash_alg);
 }
 
+int vb21api_init_hash_tag(struct vb2_context *ctx,
+			  const struct vb2_id *id,
+			  uint32_t *size)
+{
+	struct vb2_shared_data *sd = vb2_get_sd(ctx);
+	const struct vb21_fw_preamble *pre;
+	const struct vb21_signature *sig;
+	struct vb21_hash_tag *tags, *tag;
+	struct vb2_workbuf wb;
+	int i;
+
+	vb2_workbuf_from_ctx(ctx, &wb);
+
+	/* Get preamble pointer */
+	if (!sd->workbuf_preamble_size)
+		return VB2_ERROR_API_INIT_HASH_PREAMBLE;
+	pre = (const struct vb21_fw_preamble *)
+		(ctx->workbuf + sd->workbuf_preamble_offset);
+
+	/* Find the matching signature */
+	sig = find_hash(pre, id);
+	if (!sig)
+		return VB2_ERROR_API_INIT_HASH_ID;  /* No match */
+
+	/* Allocate the table of hashes the first time through */
+	if (!sd->hash_tags_count) {
+		uint32_t tags_size = VB21_MAX_HASH_TAGS * sizeof(*tags);
+
+		tags = vb2_workbuf_alloc(&wb, tags_size);
+		if (!tags)
+			return VB2_ERROR_API_INIT_HASH_TAG_WORKBUF;
+
+		memset(tags, 0, tags_size);
+		sd->workbuf_hash_tags_offset = vb2_offset_of(ctx->workbuf,
+							     tags);
+		sd->hash_tags_count = VB21_MAX_HASH_TAGS;
+		vb2_set_workbuf_used(ctx, sd->workbuf_hash_tags_offset +
+				     tags_size);
+	}
+	tags = (struct vb21_hash_tag *)
+		(ctx->workbuf + sd->workbuf_hash_tags_offset);
+
+	/* Restart the hash if the tag is already being hashed */
+	tag = find_hash_tag(ctx, id);
+	for (i = 0; !tag && i < sd->hash_tags_count; i++) {
+		if (!tags[i].sig_offset)
+			tag = tags + i;
+	}
+	if (!tag)
+		return VB2_ERROR_API_INIT_HASH_TAG_FULL;
+
+	tag->sig_offset = vb2_offset_of(ctx->workbuf, sig);
+	tag->remaining_size = sig->data_size;
+
+	if (size)
+		*size = sig->data_size;
+
+	return vb2_digest_init(&tag->dc, sig->hash_alg);
+}
+
+int vb21api_extend_hash_tag(struct vb2_context *ctx,
+			    const struct vb2_id *id,
+			    const void *buf,
+			    uint32_t size)
+{
+	struct vb21_hash_tag *tag = find_hash_tag(ctx, id);
+
+	if (!tag)
+		return VB2_ERROR_API_EXTEND_HASH_TAG;
+
+	/* Don't extend past the data we expect to hash */
+	if (!size || size > tag->remaining_size)
+		return VB2_ERROR_API_EXTEND_HASH_SIZE;
+
+	tag->remaining_size -= size;
+
+	return vb2_digest_extend(&tag->dc, buf, size);
+}
+
+int vb21api_check_hash_tag(struct vb2_context *ctx, const struct vb2_id *id)
+{
+	struct vb21_hash_tag *tag = find_hash_tag(ctx, id);
+	const struct vb21_signature *sig;
+	struct vb2_workbuf wb;
+	uint8_t *digest;
+	uint32_t digest_size;
+	int rv;
+
+	vb2_workbuf_from_ctx(ctx, &wb);
+
+	if (!tag)
+		return VB2_ERROR_API_CHECK_HASH_TAG;
+	sig = (const struct vb21_signature *)(ctx->workbuf + tag->sig_offset);
+
+	/* Should have hashed the right amount of data */
+	if (tag->remaining_size)
+		return VB2_ERROR_API_CHECK_HASH_SIZE;
+
+	/* Allocate the digest */
+	digest_size = vb2_digest_size(tag->dc.hash_alg);
+	digest = vb2_workbuf_alloc(&wb, digest_size);
+	if (!digest)
+		return VB2_ERROR_API_CHECK_HASH_WORKBUF_DIGEST;
+
+	/* The digest context is used up, so free the tag for reuse */
+	tag->sig_offset = 0;
+	rv = vb2_digest_finalize(&tag->dc, digest, digest_size);
+	if (rv)
+		return rv;
+
+	/* Compare with the signature */
+	if (vb2_safe_memcmp(digest, (const uint8_t *)sig + sig->sig_offset,
+			    digest_size))
+		return VB2_ERROR_API_CHECK_HASH_SIG;
+
+	return VB2_SUCCESS;
+}
+
 int vb21api_check_hash(struct vb2_context *ctx)
 {
 	struct vb2_shared_data *sd = vb2_get_sd(ctx);
@@ -7,6 +7,7 @@
 
 #include "2sysincludes.h"
 #include "2common.h"
+#include "2ed25519.h"
 #include "2rsa.h"
 #include "2sha.h"
 #include "vb21_common.h"
@@ -22,6 +23,10 @@ int vb21_verify_common_header(const void *parent, uint32_t parent_size)
 {
 	const struct vb21_struct_common *c = parent;
 
+	/* Parent buffer must hold the common header itself */
+	if (parent_size < sizeof(*c))
+		return VB2_ERROR_COMMON_TOTAL_SIZE;
+
 	/* Parent buffer size must be at least the claimed total size */
 	if (parent_size < c->total_size)
 		return VB2_ERROR_COMMON_TOTAL_SIZE;
@@ -139,6 +144,9 @@ uint32_t vb2_sig_size(enum vb2_signature_algorithm sig_alg,
 	if (sig_alg == VB2_SIG_NONE)
 		return digest_size;
 
+	if (sig_alg == VB2_SIG_ED25519)
+		return VB2_ED25519_SIG_BYTES;
+
 	return vb2_rsa_sig_size(sig_alg);
 }
 
@@ -171,21 +179,16 @@ const struct vb2_id *vb2_hash_id(enum vb2_hash_algorithm hash_alg)
 	}
 }
 
-int vb21_verify_signature(const struct vb21_signature *sig, uint32_t size)
+/**
+ * Verify the fields of a signature struct whose common header has already
+ * been checked.
+ */
+static int vb21_verify_signature_fields(const struct vb21_signature *sig)
 {
 	uint32_t min_offset = 0;
 	uint32_t expect_sig_size;
 	int rv;
 
-	/* Check magic number */
-	if (sig->c.magic != VB21_MAGIC_SIGNATURE)
-		return VB2_ERROR_SIG_MAGIC;
-
-	/* Make sure common header is good */
-	rv = vb21_verify_common_header(sig, size);
-	if (rv)
-		return rv;
-
 	/*
 	 * Check for compatible version.  No need to check minor version, since
 	 * that's compatible across readers matching the major version, and we
@@ -214,6 +217,73 @@ int vb21_verify_signature(const struct vb21_signature *sig, uint32_t size)
 	return VB2_SUCCESS;
 }
 
+int vb21_verify_signature(const struct vb21_signature *sig, uint32_t size)
+{
+	int rv;
+
+	/* Make sure the magic number is inside the buffer */
+	if (size < sizeof(sig->c))
+		return VB2_ERROR_COMMON_TOTAL_SIZE;
+
+	/* Check magic number */
+	if (sig->c.magic != VB21_MAGIC_SIGNATURE)
+		return VB2_ERROR_SIG_MAGIC;
+
+	/* Make sure common header is good */
+	rv = vb21_verify_common_header(sig, size);
+	if (rv)
+		return rv;
+
+	return vb21_verify_signature_fields(sig);
+}
+
+int vb21_verify_sig_array(struct vb21_sig_array *arr,
+			  void *parent,
+			  uint32_t *min_offset,
+			  uint32_t offset,
+			  uint32_t count)
+{
+	uint8_t *p = parent;
+	uint32_t sig_offset = offset;
+	uint32_t i;
+	int rv;
+
+	for (i = 0; i < count; i++, sig_offset = *min_offset) {
+		const struct vb21_signature *sig =
+			(const struct vb21_signature *)(p + sig_offset);
+
+		/*
+		 * Make sure signature is inside parent.  This also verifies
+		 * its common header.
+		 */
+		rv = vb21_verify_common_subobject(parent, min_offset,
+						  sig_offset);
+		if (rv)
+			return rv;
+
+		if (sig->c.magic != VB21_MAGIC_SIGNATURE)
+			return VB2_ERROR_SIG_MAGIC;
+
+		rv = vb21_verify_signature_fields(sig);
+		if (rv)
+			return rv;
+	}
+
+	arr->first = p + offset;
+	arr->end = p + sig_offset;
+	arr->count = count;
+
+	return VB2_SUCCESS;
+}
+
+struct vb21_signature *vb21_sig_array_next(const struct vb21_sig_array *arr,
+					   struct vb21_signature *sig)
+{
+	uint8_t *next = sig ? (uint8_t *)sig + sig->c.total_size : arr->first;
+
+	return next < arr->end ? (struct vb21_signature *)next : NULL;
+}
+
 /**
  * Return the signature data for a signature
  */
@@ -247,6 +317,11 @@ int vb21_verify_digest(const struct vb2_public_key *key,
 			return VB2_ERROR_VDATA_VERIFY_DIGEST;
 
 		return VB2_SUCCESS;
+	} else if (key->sig_alg == VB2_SIG_ED25519) {
+		/* Ed25519 keys sign the digest itself */
+		return vb2_ed25519_verify((const uint8_t *)key->n,
+					  vb21_signature_data(sig), digest,
+					  vb2_digest_size(key->hash_alg));
 	} else {
 		/* RSA-signed digest */
 		return vb2_rsa_verify_digest(key,
@@ -303,13 +378,20 @@ int vb21_verify_data(const void *data,
 	return vb21_verify_digest(key, sig, digest, &wblocal);
 }
 
-int vb21_verify_keyblock(struct vb21_keyblock *block,
-			 uint32_t size,
-			 const struct vb2_public_key *key,
-			 const struct vb2_workbuf *wb)
+/*
+ * Check everything about a keyblock except its signature, and find the
+ * signatures in it.
+ */
+static int vb21_check_keyblock(struct vb21_keyblock *block,
+			       uint32_t size,
+			       struct vb21_sig_array *sigs)
 {
-	uint32_t min_offset = 0, sig_offset;
-	int rv, i;
+	uint32_t min_offset = 0;
+	int rv;
+
+	/* Make sure the magic number is inside the buffer */
+	if (size < sizeof(block->c))
+		return VB2_ERROR_COMMON_TOTAL_SIZE;
 
 	/* Check magic number */
 	if (block->c.magic != VB21_MAGIC_KEYBLOCK)
@@ -338,48 +420,159 @@ int vb21_verify_keyblock(struct vb21_keyblock *block,
 	if (rv)
 		return rv;
 
-	/* Loop over signatures */
-	sig_offset = block->sig_offset;
-	for (i = 0; i < block->sig_count; i++, sig_offset = min_offset) {
-		struct vb21_signature *sig;
+	/* Make sure all signatures are inside and intact */
+	return vb21_verify_sig_array(sigs, block, &min_offset,
+				     block->sig_offset, block->sig_count);
+}
 
-		/* Make sure signature is inside keyblock */
-		rv = vb21_verify_common_subobject(block, &min_offset,
-						 sig_offset);
-		if (rv)
-			return rv;
+/* Verify a keyblock signature with the key matching its ID */
+static int vb21_verify_keyblock_sig(struct vb21_keyblock *block,
+				    struct vb21_signature *sig,
+				    const struct vb2_public_key *key,
+				    const struct vb2_workbuf *wb)
+{
+	/* Make sure we signed the right amount of data */
+	if (sig->data_size != block->sig_offset)
+		return VB2_ERROR_KEYBLOCK_SIGNED_SIZE;
 
-		sig = (struct vb21_signature *)((uint8_t *)block + sig_offset);
+	return vb21_verify_data(block, block->sig_offset, sig, key, wb);
+}
 
-		/* Verify the signature integrity */
-		rv = vb21_verify_signature(sig,
-					  block->c.total_size - sig_offset);
-		if (rv)
-			return rv;
+int vb21_verify_keyblock(struct vb21_keyblock *block,
+			 uint32_t size,
+			 const struct vb2_public_key *key,
+			 const struct vb2_workbuf *wb)
+{
+	struct vb21_sig_array sigs;
+	struct vb21_signature *sig = NULL;
+	int rv;
+
+	rv = vb21_check_keyblock(block, size, &sigs);
+	if (rv)
+		return rv;
 
+	while ((sig = vb21_sig_array_next(&sigs, sig))) {
 		/* Skip signature if it doesn't match the key ID */
 		if (memcmp(&sig->id, key->id, VB2_ID_NUM_BYTES))
 			continue;
 
-		/* Make sure we signed the right amount of data */
-		if (sig->data_size != block->sig_offset)
-			return VB2_ERROR_KEYBLOCK_SIGNED_SIZE;
-
-		return vb21_verify_data(block, block->sig_offset, sig, key, wb);
+		return vb21_verify_keyblock_sig(block, sig, key, wb);
 	}
 
 	/* If we're still here, no signature matched the key ID */
 	return VB2_ERROR_KEYBLOCK_SIG_ID;
 }
 
+void vb21_key_ring_init(struct vb21_key_ring *ring)
+{
+	memset(ring, 0, sizeof(*ring));
+}
+
+/*
+ * Key IDs are usually digests of the keys, but the IDs of hash-only keys
+ * aren't, so mix in all the bytes rather than taking the first few.
+ */
+static uint32_t vb21_key_ring_hash(const struct vb2_id *id)
+{
+	uint32_t h = 0;
+	int i;
+
+	for (i = 0; i < VB2_ID_NUM_BYTES; i++)
+		h = h * 31 + id->raw[i];
+
+	return h & (VB21_KEY_RING_SLOTS - 1);
+}
+
+int vb21_key_ring_add(struct vb21_key_ring *ring,
+		      const struct vb2_public_key *key)
+{
+	uint32_t slot;
+
+	if (!key->id)
+		return VB2_ERROR_KEY_RING_NO_ID;
+
+	if (vb21_key_ring_find(ring, key->id))
+		return VB2_ERROR_KEY_RING_DUPLICATE_ID;
+
+	if (ring->count >= VB21_KEY_RING_MAX_KEYS)
+		return VB2_ERROR_KEY_RING_FULL;
+
+	/* There are more slots than keys, so this finds an empty one */
+	slot = vb21_key_ring_hash(key->id);
+	while (ring->slots[slot])
+		slot = (slot + 1) & (VB21_KEY_RING_SLOTS - 1);
+
+	ring->keys[ring->count++] = key;
+	ring->slots[slot] = ring->count;
+	return VB2_SUCCESS;
+}
+
+const struct vb2_public_key *vb21_key_ring_find(
+		const struct vb21_key_ring *ring,
+		const struct vb2_id *id)
+{
+	const struct vb2_public_key *key;
+	uint32_t slot = vb21_key_ring_hash(id);
+	int i;
+
+	/* Linear probing stops at the first empty slot */
+	for (i = 0; i < VB21_KEY_RING_SLOTS; i++) {
+		if (!ring->slots[slot])
+			return NULL;
+
+		key = ring->keys[ring->slots[slot] - 1];
+		if (!memcmp(key->id, id, VB2_ID_NUM_BYTES))
+			return key;
+
+		slot = (slot + 1) & (VB21_KEY_RING_SLOTS - 1);
+	}
+
+	return NULL;
+}
+
+int vb21_verify_keyblock_ring(struct vb21_keyblock *block,
+			      uint32_t size,
+			      const struct vb21_key_ring *ring,
+			      const struct vb2_public_key **key_ptr,
+			      const struct vb2_workbuf *wb)
+{
+	struct vb21_sig_array sigs;
+	struct vb21_signature *sig = NULL;
+	const struct vb2_public_key *key;
+	int rv;
+
+	rv = vb21_check_keyblock(block, size, &sigs);
+	if (rv)
+		return rv;
+
+	/* Use the first signature by a trusted key; there's no guessing */
+	while ((sig = vb21_sig_array_next(&sigs, sig))) {
+		key = vb21_key_ring_find(ring, &sig->id);
+		if (!key)
+			continue;
+
+		if (key_ptr)
+			*key_ptr = key;
+		return vb21_verify_keyblock_sig(block, sig, key, wb);
+	}
+
+	/* If we're still here, no signature matched a key in the ring */
+	return VB2_ERROR_KEYBLOCK_SIG_ID;
+}
+
 int vb21_verify_fw_preamble(struct vb21_fw_preamble *preamble,
 			    uint32_t size,
 			    const struct vb2_public_key *key,
 			    const struct vb2_workbuf *wb)
 {
-	struct vb21_signature *sig;
-	uint32_t min_offset = 0, hash_offset;
-	int rv, i;
+	struct vb21_sig_array hashes;
+	struct vb21_signature *sig = NULL;
+	uint32_t min_offset = 0;
+	int rv;
+
+	/* Make sure the magic number is inside the buffer */
+	if (size < sizeof(preamble->c))
+		return VB2_ERROR_COMMON_TOTAL_SIZE;
 
 	/* Check magic number */
 	if (preamble->c.magic != VB21_MAGIC_FW_PREAMBLE)
@@ -402,25 +595,14 @@ int vb21_verify_fw_preamble(struct vb21_fw_preamble *preamble,
 	if (preamble->c.fixed_size < sizeof(*preamble))
 		return VB2_ERROR_PREAMBLE_SIZE;
 
-	/* Make sure all hash signatures are inside */
-	hash_offset = preamble->hash_offset;
-	for (i = 0; i < preamble->hash_count; i++, hash_offset = min_offset) {
-		/* Make sure signature is inside preamble */
-		rv = vb21_verify_common_subobject(preamble, &min_offset,
-						  hash_offset);
-		if (rv)
-			return rv;
-
-		sig = (struct vb21_signature *)
-			((uint8_t *)preamble + hash_offset);
-
-		/* Verify the signature integrity */
-		rv = vb21_verify_signature(
-				sig, preamble->c.total_size - hash_offset);
-		if (rv)
-			return rv;
+	/* Make sure all hash signatures are inside and intact */
+	rv = vb21_verify_sig_array(&hashes, preamble, &min_offset,
+				   preamble->hash_offset, preamble->hash_count);
+	if (rv)
+		return rv;
 
-		/* Hashes must all be unsigned */
+	/* Hashes must all be unsigned */
+	while ((sig = vb21_sig_array_next(&hashes, sig))) {
 		if (sig->sig_alg != VB2_SIG_NONE)
 			return VB2_ERROR_PREAMBLE_HASH_SIGNED;
 	}
@@ -75,6 +75,56 @@ int vb21_verify_common_subobject(const void *parent,
 				 uint32_t *min_offset,
 				 uint32_t member_offset);
 
+/*
+ * Validated view of signatures packed back-to-back inside a parent object,
+ * such as the signatures in a keyblock or the hashes in a firmware preamble.
+ * Filled in by vb21_verify_sig_array(); afterwards the signatures can be
+ * walked with vb21_sig_array_next() without checking their bounds again.
+ */
+struct vb21_sig_array {
+	/* First signature */
+	uint8_t *first;
+
+	/* End of the last signature */
+	uint8_t *end;
+
+	/* Number of signatures */
+	uint32_t count;
+};
+
+/**
+ * Verify an array of signatures inside a parent object
+ *
+ * Each signature is checked to be a subobject of the parent (as with
+ * vb21_verify_common_subobject()) and to be a valid signature struct (as with
+ * vb21_verify_signature()).  The common header of each signature is only
+ * checked once.
+ *
+ * @param arr		Destination for the validated view
+ * @param parent	Parent data (starts with struct vb21_struct_common)
+ * @param min_offset	Pointer to minimum offset where the array can be
+ *			located; see vb21_verify_common_member().  Updated on
+ *			return to the end of the last signature.
+ * @param offset	Offset of the first signature from start of parent
+ * @param count		Number of signatures
+ * @return VB2_SUCCESS, or non-zero if error.
+ */
+int vb21_verify_sig_array(struct vb21_sig_array *arr,
+			  void *parent,
+			  uint32_t *min_offset,
+			  uint32_t offset,
+			  uint32_t count);
+
+/**
+ * Return the next signature in a validated signature array
+ *
+ * @param arr		Array filled in by vb21_verify_sig_array()
+ * @param sig		Current signature, or NULL to get the first one
+ * @return The next signature, or NULL if there are no more.
+ */
+struct vb21_signature *vb21_sig_array_next(const struct vb21_sig_array *arr,
+					   struct vb21_signature *sig);
+
 /**
  * Unpack a key for use in verification
  *
@@ -161,6 +211,75 @@ int vb21_verify_keyblock(struct vb21_keyblock *block,
 			 const struct vb2_public_key *key,
 			 const struct vb2_workbuf *wb);
 
+/* Most keys a key ring can hold */
+#define VB21_KEY_RING_MAX_KEYS 8
+
+/* Hash table size of a key ring; a power of 2, bigger than the max keys */
+#define VB21_KEY_RING_SLOTS 16
+
+/*
+ * A set of trusted public keys, indexed by key ID.  The keys belong to the
+ * caller; the ring only points to them, so they must outlive it.
+ */
+struct vb21_key_ring {
+	/* Keys in the order they were added */
+	const struct vb2_public_key *keys[VB21_KEY_RING_MAX_KEYS];
+	uint32_t count;
+
+	/* Hash table of key ID to index in keys[] plus 1; 0 is empty */
+	uint8_t slots[VB21_KEY_RING_SLOTS];
+};
+
+/**
+ * Initialize an empty key ring.
+ *
+ * @param ring		Key ring to initialize
+ */
+void vb21_key_ring_init(struct vb21_key_ring *ring);
+
+/**
+ * Add a key to a key ring.
+ *
+ * @param ring		Key ring
+ * @param key		Unpacked key to add, with an ID
+ * @return VB2_SUCCESS, or non-zero if the key has no ID, its ID is already
+ * in the ring, or the ring is full.
+ */
+int vb21_key_ring_add(struct vb21_key_ring *ring,
+		      const struct vb2_public_key *key);
+
+/**
+ * Look up a key in a key ring.
+ *
+ * @param ring		Key ring
+ * @param id		Key ID to look for
+ * @return The key with that ID, or NULL if there isn't one.
+ */
+const struct vb2_public_key *vb21_key_ring_find(
+		const struct vb21_key_ring *ring,
+		const struct vb2_id *id);
+
+/**
+ * Check the sanity of a key block using a ring of trusted keys.
+ *
+ * Like vb21_verify_keyblock(), but the key is the one in the ring with the ID
+ * of the first signature signed by any of them.  Only that signature is
+ * verified, so callers with several possible signers don't have to try each
+ * key in turn.
+ *
+ * @param block		Key block to verify
+ * @param size		Size of key block buffer
+ * @param ring		Trusted keys
+ * @param key_ptr	If not NULL, gets the key the block was verified with
+ * @param wb		Work buffer
+ * @return VB2_SUCCESS, or non-zero error code if error.
+ */
+int vb21_verify_keyblock_ring(struct vb21_keyblock *block,
+			      uint32_t size,
+			      const struct vb21_key_ring *ring,
+			      const struct vb2_public_key **key_ptr,
+			      const struct vb2_workbuf *wb);
+
 /**
  * Check the sanity of a firmware preamble using a public key.
  *
@@ -16,42 +16,52 @@
 #include "vb21_common.h"
 
 /**
- * Read an object with a common struct header from a verified boot resource.
+ * Read an object with a common struct header from the firmware vblock.
  *
- * On success, an object buffer will be allocated in the work buffer, the
- * object will be stored into the buffer, and *buf_ptr will point to the
- * object.
+ * On success, *buf_ptr will point to the object in the work buffer.  If the
+ * object is at the start of the data vb2_read_vblock_ahead() read, that's
+ * where it stays; otherwise a buffer is allocated for it.
  *
  * @param ctx		Vboot context
- * @param index		Resource index to read
- * @param offset	Byte offset within resource to start at
+ * @param offset	Byte offset within vblock to start at
  * @param buf_ptr	Destination for object pointer
  * @return VB2_SUCCESS, or error code on error.
  */
-static int vb21_read_resource_object(struct vb2_context *ctx,
-				     enum vb2_resource_index index,
-				     uint32_t offset,
-				     struct vb2_workbuf *wb,
-				     void **buf_ptr)
+static int vb21_read_vblock_object(struct vb2_context *ctx,
+				   uint32_t offset,
+				   struct vb2_workbuf *wb,
+				   void **buf_ptr)
 {
+	struct vb2_shared_data *sd = vb2_get_sd(ctx);
 	struct vb21_struct_common c;
+	uint32_t ahead_size = 0;
 	void *buf;
 	int rv;
 
 	*buf_ptr = NULL;
 
 	/* Read the common header */
-	rv = vb2ex_read_resource(ctx, index, offset, &c, sizeof(c));
+	rv = vb2_read_vblock(ctx, offset, &c, sizeof(c));
 	if (rv)
 		return rv;
 
+	/* Data read ahead is the last allocation from wb, if it's there */
+	if (offset == 0 && sd->workbuf_vblock_ahead_size) {
+		ahead_size = sd->workbuf_vblock_ahead_size;
+		if (c.total_size <= ahead_size) {
+			*buf_ptr = ctx->workbuf +
+				sd->workbuf_vblock_ahead_offset;
+			return VB2_SUCCESS;
+		}
+	}
+
 	/* Allocate a buffer for the object, now that we know how big it is */
-	buf = vb2_workbuf_alloc(wb, c.total_size);
+	buf = vb2_workbuf_realloc(wb, ahead_size, c.total_size);
 	if (!buf)
 		return VB2_ERROR_READ_RESOURCE_OBJECT_BUF;
 
 	/* Read the object */
-	rv = vb2ex_read_resource(ctx, index, offset, buf, c.total_size);
+	rv = vb2_read_vblock(ctx, offset, buf, c.total_size);
 	if (rv) {
 		vb2_workbuf_free(wb, c.total_size);
 		return rv;
@@ -83,8 +93,8 @@ int vb21_load_fw_keyblock(struct vb2_context *ctx)
 	if (!key_data)
 		return VB2_ERROR_FW_KEYBLOCK_WORKBUF_ROOT_KEY;
 
-	rv = vb2ex_read_resource(ctx, VB2_RES_GBB, sd->gbb_rootkey_offset,
-				 key_data, key_size);
+	rv = vb2_read_resource(ctx, VB2_RES_GBB, sd->gbb_rootkey_offset,
+			       key_data, key_size);
 	if (rv)
 		return rv;
 
@@ -92,13 +102,14 @@ int vb21_load_fw_keyblock(struct vb2_context *ctx)
 	rv = vb21_unpack_key(&root_key, key_data, key_size);
 	if (rv)
 		return rv;
+	root_key.allow_hwcrypto = 1;
 
 	/*
-	 * Load the firmware keyblock common header into the work buffer after
-	 * the root key.
+	 * Load the firmware keyblock into the work buffer after the root key,
+	 * reading ahead the preamble after it too if possible.
 	 */
-	rv = vb21_read_resource_object(ctx, VB2_RES_FW_VBLOCK, 0, &wb,
-				       (void **)&kb);
+	vb2_read_vblock_ahead(ctx, &wb);
+	rv = vb21_read_vblock_object(ctx, 0, &wb, (void **)&kb);
 	if (rv)
 		return rv;
 
@@ -177,14 +188,17 @@ int vb21_load_fw_preamble(struct vb2_context *ctx)
 	rv = vb21_unpack_key(&data_key, key_data, key_size);
 	if (rv)
 		return rv;
+	data_key.allow_hwcrypto = 1;
 
 	/* Load the firmware preamble */
-	rv = vb21_read_resource_object(ctx, VB2_RES_FW_VBLOCK,
-				       sd->vblock_preamble_offset, &wb,
-				       (void **)&pre);
+	rv = vb21_read_vblock_object(ctx, sd->vblock_preamble_offset, &wb,
+				     (void **)&pre);
 	if (rv)
 		return rv;
 
+	/* Anything read ahead is now overwritten */
+	sd->workbuf_vblock_ahead_size = 0;
+
 	/* Work buffer now contains the data subkey data and the preamble */
 
 	/* Verify the preamble */
@@ -27,6 +27,15 @@ int vb2_unpack_key_data(struct vb2_public_key *key,
 	if (!vb2_aligned(buf32, sizeof(uint32_t)))
 		return VB2_ERROR_UNPACK_KEY_ALIGN;
 
+	/* Ed25519 keys are just the public point */
+	if (key->sig_alg == VB2_SIG_ED25519) {
+		key->arrsize = key_size / sizeof(uint32_t);
+		key->n0inv = 0;
+		key->n = buf32;
+		key->rr = NULL;
+		return VB2_SUCCESS;
+	}
+
 	key->arrsize = buf32[0];
 
 	/* Sanity check key array size */
@@ -52,6 +61,10 @@ int vb21_unpack_key(struct vb2_public_key *key,
 	uint32_t min_offset = 0;
 	int rv;
 
+	/* Make sure the magic number is inside the buffer */
+	if (size < sizeof(pkey->c))
+		return VB2_ERROR_COMMON_TOTAL_SIZE;
+
 	/* Check magic number */
 	if (pkey->c.magic != VB21_MAGIC_PACKED_KEY)
 		return VB2_ERROR_UNPACK_KEY_MAGIC;
@@ -81,7 +94,7 @@ int vb21_unpack_key(struct vb2_public_key *key,
 
 	key->sig_alg = pkey->sig_alg;
 	if (key->sig_alg != VB2_SIG_NONE) {
-		sig_size = vb2_rsa_sig_size(key->sig_alg);
+		sig_size = vb2_sig_size(key->sig_alg, key->hash_alg);
 		if (!sig_size)
 			return VB2_ERROR_UNPACK_KEY_SIG_ALGORITHM;
 		rv = vb2_unpack_key_data(
@@ -97,5 +110,8 @@ int vb21_unpack_key(struct vb2_public_key *key,
 	key->version = pkey->key_version;
 	key->id = &pkey->id;
 
+	/* Callers that want the hardware crypto engine say so */
+	key->allow_hwcrypto = 0;
+
 	return VB2_SUCCESS;
 }
@@ -33,6 +33,7 @@ int main(void)
 	TlclResume();
 	TlclSelfTestFull();
 	TlclContinueSelfTest();
+	TlclStartSelfTest();
 	TlclDefineSpace(0, 0, 0);
 	TlclWrite(0, 0, 0);
 	TlclRead(0, 0, 0);
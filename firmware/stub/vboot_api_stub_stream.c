@@ -72,6 +72,28 @@ VbError_t VbExStreamRead(VbExStream_t stream, uint32_t bytes, void *buffer)
 	return VBERROR_SUCCESS;
 }
 
+VbError_t VbExStreamSkip(VbExStream_t stream, uint32_t bytes)
+{
+	struct disk_stream *s = (struct disk_stream *)stream;
+	uint64_t sectors;
+
+	if (!s)
+		return VBERROR_UNKNOWN;
+
+	/* Like reads, skips must be a multiple of the LBA size */
+	if (bytes % LBA_BYTES)
+		return VBERROR_UNKNOWN;
+
+	sectors = bytes / LBA_BYTES;
+	if (sectors > s->sectors_left)
+		return VBERROR_UNKNOWN;
+
+	s->sector += sectors;
+	s->sectors_left -= sectors;
+
+	return VBERROR_SUCCESS;
+}
+
 void VbExStreamClose(VbExStream_t stream)
 {
 	struct disk_stream *s = (struct disk_stream *)stream;
@@ -13,7 +13,8 @@
 #include "bdb_struct.h"
 #include "file_type.h"
 
-enum futil_file_type ft_recognize_bdb(uint8_t *buf, uint32_t len)
+enum futil_file_type ft_recognize_bdb(uint8_t *buf, uint32_t len,
+				      const struct futil_file_index *index)
 {
 	const struct bdb_header *header = bdb_get_header(buf);
 
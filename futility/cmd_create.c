@@ -7,10 +7,12 @@
 #include <stdio.h>
 #include <unistd.h>
 
+#include <openssl/evp.h>
 #include <openssl/pem.h>
 
 #include "2sysincludes.h"
 #include "2common.h"
+#include "2ed25519.h"
 #include "2id.h"
 #include "2rsa.h"
 #include "2sha.h"
@@ -19,8 +21,10 @@
 #include "vb2_common.h"
 #include "vb21_common.h"
 
+#include "host_jobs.h"
 #include "host_key.h"
 #include "host_key2.h"
+#include "host_misc.h"
 #include "host_misc2.h"
 
 #include "futility.h"
@@ -33,13 +37,24 @@ enum {
 	OPT_DESC,
 	OPT_ID,
 	OPT_HASH_ALG,
+	OPT_MANIFEST,
+	OPT_JOBS,
 	OPT_HELP,
 };
 
 #define DEFAULT_VERSION 1
 #define DEFAULT_HASH VB2_HASH_SHA256;
 
-static char *infile, *outfile, *outext;
+/* One keypair to create */
+struct create_key {
+	const char *infile;
+	char *outfile;			/* Base name, with room for extension */
+	char *outext;			/* Where the extension goes */
+	enum vb2_hash_algorithm hash_alg;
+	int ret;
+};
+
+static char *infile;
 static uint32_t opt_version = DEFAULT_VERSION;
 enum vb2_hash_algorithm opt_hash_alg = DEFAULT_HASH;
 static char *opt_desc;
@@ -51,6 +66,8 @@ static const struct option long_opts[] = {
 	{"desc",     1, 0, OPT_DESC},
 	{"id",       1, 0, OPT_ID},
 	{"hash_alg", 1, 0, OPT_HASH_ALG},
+	{"manifest", 1, 0, OPT_MANIFEST},
+	{"jobs",     1, 0, OPT_JOBS},
 	{"help",     0, 0, OPT_HELP},
 	{NULL, 0, 0, 0}
 };
@@ -60,9 +77,10 @@ static void print_help(int argc, char *argv[])
 	const struct vb2_text_vs_enum *entry;
 
 	printf("\n"
-"Usage:  " MYNAME " %s [options] <INFILE> [<BASENAME>]\n", argv[0]);
+"Usage:  " MYNAME " %s [options] <INFILE> [<BASENAME>]\n"
+"        " MYNAME " %s [options] --manifest <FILE>\n", argv[0], argv[0]);
 	printf("\n"
-"Create a keypair from an RSA key (.pem file).\n"
+"Create a keypair from an RSA or Ed25519 (vb21 only) key (.pem file).\n"
 "\n"
 "Options:\n"
 "\n"
@@ -76,11 +94,17 @@ static void print_help(int argc, char *argv[])
 	printf(
 "  --id <id>                   Identifier for this keypair (vb21 only)\n"
 "  --desc <text>               Human-readable description (vb21 only)\n"
+"  --manifest <file>           Create a keypair for each line of <file>:\n"
+"                                <INFILE> [<BASENAME> [<HASH_ALG>]]\n"
+"                                Blank lines and lines starting with '#'\n"
+"                                are ignored.\n"
+"  --jobs <number>             Create up to this many keypairs at once\n"
+"                                (default 1)\n"
 "\n");
 
 }
 
-static int vb1_make_keypair()
+static int vb1_make_keypair(struct create_key *k)
 {
 	struct vb2_private_key *privkey = NULL;
 	struct vb2_packed_key *pubkey = NULL;
@@ -89,9 +113,9 @@ static int vb1_make_keypair()
 	uint32_t keyb_size;
 	int ret = 1;
 
-	FILE *fp = fopen(infile, "rb");
+	FILE *fp = fopen(k->infile, "rb");
 	if (!fp) {
-		fprintf(stderr, "Unable to open %s\n", infile);
+		fprintf(stderr, "Unable to open %s\n", k->infile);
 		goto done;
 	}
 
@@ -100,7 +124,7 @@ static int vb1_make_keypair()
 	rsa_key = PEM_read_RSAPrivateKey(fp, NULL, NULL, NULL);
 	fclose(fp);
 	if (!rsa_key) {
-		fprintf(stderr, "Unable to read RSA key from %s\n", infile);
+		fprintf(stderr, "Unable to read RSA key from %s\n", k->infile);
 		goto done;
 	}
 
@@ -112,7 +136,7 @@ static int vb1_make_keypair()
 
 	/* Combine the sig_alg with the hash_alg to get the vb1 algorithm */
 	uint64_t vb1_algorithm =
-		vb2_get_crypto_algorithm(opt_hash_alg, sig_alg);
+		vb2_get_crypto_algorithm(k->hash_alg, sig_alg);
 
 	/* Create the private key */
 	privkey = (struct vb2_private_key *)calloc(sizeof(*privkey), 1);
@@ -121,15 +145,15 @@ static int vb1_make_keypair()
 
 	privkey->rsa_private_key = rsa_key;
 	privkey->sig_alg = sig_alg;
-	privkey->hash_alg = opt_hash_alg;
+	privkey->hash_alg = k->hash_alg;
 
 	/* Write it out */
-	strcpy(outext, ".vbprivk");
-	if (0 != vb2_write_private_key(outfile, privkey)) {
+	strcpy(k->outext, ".vbprivk");
+	if (0 != vb2_write_private_key(k->outfile, privkey)) {
 		fprintf(stderr, "unable to write private key\n");
 		goto done;
 	}
-	printf("wrote %s\n", outfile);
+	printf("wrote %s\n", k->outfile);
 
 	/* Create the public key */
 	ret = vb_keyb_from_rsa(rsa_key, &keyb_data, &keyb_size);
@@ -144,12 +168,12 @@ static int vb1_make_keypair()
 	memcpy((uint8_t *)vb2_packed_key_data(pubkey), keyb_data, keyb_size);
 
 	/* Write it out */
-	strcpy(outext, ".vbpubk");
-	if (VB2_SUCCESS != vb2_write_packed_key(outfile, pubkey)) {
+	strcpy(k->outext, ".vbpubk");
+	if (VB2_SUCCESS != vb2_write_packed_key(k->outfile, pubkey)) {
 		fprintf(stderr, "unable to write public key\n");
 		goto done;
 	}
-	printf("wrote %s\n", outfile);
+	printf("wrote %s\n", k->outfile);
 
 	ret = 0;
 
@@ -161,24 +185,48 @@ done:
 	return ret;
 }
 
-static int vb2_make_keypair()
+/* Read an Ed25519 private key, or a public one, from a .pem file */
+static EVP_PKEY *read_ed25519_key(FILE *fp)
+{
+	EVP_PKEY *key;
+
+	if (fseek(fp, 0, SEEK_SET))
+		return NULL;
+	key = PEM_read_PrivateKey(fp, NULL, NULL, NULL);
+	if (!key) {
+		if (fseek(fp, 0, SEEK_SET))
+			return NULL;
+		key = PEM_read_PUBKEY(fp, NULL, NULL, NULL);
+	}
+
+	if (key && EVP_PKEY_id(key) != EVP_PKEY_ED25519) {
+		EVP_PKEY_free(key);
+		key = NULL;
+	}
+	return key;
+}
+
+static int vb2_make_keypair(struct create_key *k)
 {
 	struct vb2_private_key *privkey = 0;
 	struct vb2_public_key *pubkey = 0;
 	RSA *rsa_key = 0;
+	EVP_PKEY *ed25519_key = 0;
+	size_t len;
 	uint8_t *keyb_data = 0;
 	uint32_t keyb_size;
 	enum vb2_signature_algorithm sig_alg;
 	uint8_t *pubkey_buf = 0;
 	int has_priv = 0;
 	const BIGNUM *rsa_d;
+	struct vb2_id id = opt_id;
 
 	FILE *fp;
 	int ret = 1;
 
-	fp = fopen(infile, "rb");
+	fp = fopen(k->infile, "rb");
 	if (!fp) {
-		fprintf(stderr, "Unable to open %s\n", infile);
+		fprintf(stderr, "Unable to open %s\n", k->infile);
 		goto done;
 	}
 
@@ -187,23 +235,34 @@ static int vb2_make_keypair()
 	if (!rsa_key) {
 		/* Check if the PEM contains only a public key */
 		if (0 != fseek(fp, 0, SEEK_SET)) {
-			fprintf(stderr, "Error seeking in %s\n", infile);
+			fprintf(stderr, "Error seeking in %s\n", k->infile);
 			goto done;
 		}
 		rsa_key = PEM_read_RSA_PUBKEY(fp, NULL, NULL, NULL);
 	}
+	if (!rsa_key)
+		ed25519_key = read_ed25519_key(fp);
 	fclose(fp);
-	if (!rsa_key) {
-		fprintf(stderr, "Unable to read RSA key from %s\n", infile);
+	if (!rsa_key && !ed25519_key) {
+		fprintf(stderr, "Unable to read RSA or Ed25519 key from %s\n",
+			k->infile);
 		goto done;
 	}
-	/* Public keys doesn't have the private exponent */
-	RSA_get0_key(rsa_key, NULL, NULL, &rsa_d);
-	has_priv = !!rsa_d;
+
+	if (ed25519_key) {
+		/* Public keys don't have the private half */
+		has_priv = EVP_PKEY_get_raw_private_key(ed25519_key, NULL,
+							&len) == 1;
+		sig_alg = VB2_SIG_ED25519;
+	} else {
+		/* Public keys doesn't have the private exponent */
+		RSA_get0_key(rsa_key, NULL, NULL, &rsa_d);
+		has_priv = !!rsa_d;
+		sig_alg = vb2_rsa_sig_alg(rsa_key);
+	}
 	if (!has_priv)
-		fprintf(stderr, "%s has a public key only.\n", infile);
+		fprintf(stderr, "%s has a public key only.\n", k->infile);
 
-	sig_alg = vb2_rsa_sig_alg(rsa_key);
 	if (sig_alg == VB2_SIG_INVALID) {
 		fprintf(stderr, "Unsupported sig algorithm in RSA key\n");
 		goto done;
@@ -218,8 +277,9 @@ static int vb2_make_keypair()
 		}
 
 		privkey->rsa_private_key = rsa_key;
+		privkey->ed25519_private_key = ed25519_key;
 		privkey->sig_alg = sig_alg;
-		privkey->hash_alg = opt_hash_alg;
+		privkey->hash_alg = k->hash_alg;
 		if (opt_desc && vb2_private_key_set_desc(privkey, opt_desc)) {
 			fprintf(stderr,
 				"Unable to set the private key description\n");
@@ -233,8 +293,18 @@ static int vb2_make_keypair()
 		goto done;
 	}
 
-	/* Extract the keyb blob */
-	if (vb_keyb_from_rsa(rsa_key, &keyb_data, &keyb_size)) {
+	/* Extract the keyb blob, which for Ed25519 is just the public key */
+	if (ed25519_key) {
+		keyb_size = VB2_ED25519_KEY_BYTES;
+		keyb_data = malloc(keyb_size);
+		len = keyb_size;
+		if (!keyb_data ||
+		    EVP_PKEY_get_raw_public_key(ed25519_key, keyb_data,
+						&len) != 1 || len != keyb_size) {
+			fprintf(stderr, "Couldn't extract the public key\n");
+			goto done;
+		}
+	} else if (vb_keyb_from_rsa(rsa_key, &keyb_data, &keyb_size)) {
 		fprintf(stderr, "Couldn't extract the public key\n");
 		goto done;
 	}
@@ -252,56 +322,203 @@ static int vb2_make_keypair()
 		goto done;
 	}
 
-	pubkey->hash_alg = opt_hash_alg;
+	pubkey->hash_alg = k->hash_alg;
 	pubkey->version = opt_version;
 	if (opt_desc && vb2_public_key_set_desc(pubkey, opt_desc)) {
 		fprintf(stderr, "Unable to set pubkey description\n");
 		goto done;
 	}
 
-	/* Update the IDs */
+	/*
+	 * Update the IDs.  The ID is hashed once here and shared by both the
+	 * private and public key files.
+	 */
 	if (!force_id) {
 		vb2_digest_buffer(keyb_data, keyb_size, VB2_HASH_SHA1,
-				  opt_id.raw, sizeof(opt_id.raw));
+				  id.raw, sizeof(id.raw));
 	}
 
-	memcpy((struct vb2_id *)pubkey->id, &opt_id, sizeof(opt_id));
+	memcpy((struct vb2_id *)pubkey->id, &id, sizeof(id));
 
 	/* Write them out */
 	if (has_priv) {
-		privkey->id = opt_id;
-		strcpy(outext, ".vbprik2");
-		if (vb21_private_key_write(privkey, outfile)) {
+		privkey->id = id;
+		strcpy(k->outext, ".vbprik2");
+		if (vb21_private_key_write(privkey, k->outfile)) {
 			fprintf(stderr, "unable to write private key\n");
 			goto done;
 		}
-		printf("wrote %s\n", outfile);
+		printf("wrote %s\n", k->outfile);
 	}
 
-	strcpy(outext, ".vbpubk2");
-	if (vb21_public_key_write(pubkey, outfile)) {
+	strcpy(k->outext, ".vbpubk2");
+	if (vb21_public_key_write(pubkey, k->outfile)) {
 		fprintf(stderr, "unable to write public key\n");
 		goto done;
 	}
-	printf("wrote %s\n", outfile);
+	printf("wrote %s\n", k->outfile);
 
 	ret = 0;
 
 done:
 	RSA_free(rsa_key);
-	if (privkey)				/* prevent double-free */
+	EVP_PKEY_free(ed25519_key);
+	if (privkey) {				/* prevent double-free */
 		privkey->rsa_private_key = 0;
+		privkey->ed25519_private_key = 0;
+	}
 	vb2_private_key_free(privkey);
 	vb2_public_key_free(pubkey);
 	free(keyb_data);
 	return ret;
 }
 
+static void create_one(void *ctx, int i)
+{
+	struct create_key *k = (struct create_key *)ctx + i;
+
+	/* Each key has its own OpenSSL objects, so nothing is shared */
+	if (vboot_version == VBOOT_VERSION_1_0)
+		k->ret = vb1_make_keypair(k);
+	else
+		k->ret = vb2_make_keypair(k);
+}
+
+/* Create the keypairs, using up to njobs threads. Returns the failure count. */
+static int create_keys(struct create_key *keys, int count, int njobs)
+{
+	int errorcnt = 0;
+	int i;
+
+	vb2_run_jobs(create_one, keys, count, njobs);
+
+	for (i = 0; i < count; i++)
+		if (keys[i].ret)
+			errorcnt++;
+	return errorcnt;
+}
+
+/*
+ * Set up the output base name for a key. Without a basename, it's the PEM
+ * file name without its extension. Returns non-zero on error.
+ */
+static int init_key(struct create_key *k, const char *pem,
+		    const char *basename, enum vb2_hash_algorithm hash_alg)
+{
+	const char *s = basename ? basename : pem;
+	char *ext;
+
+	k->infile = pem;
+	k->hash_alg = hash_alg;
+	k->ret = 1;
+
+	/* Make an extra-large copy to leave room for filename extensions */
+	k->outfile = (char *)malloc(strlen(s) + 20);
+	if (!k->outfile) {
+		fprintf(stderr, "ERROR: malloc() failed\n");
+		return 1;
+	}
+	strcpy(k->outfile, s);
+
+	if (!basename) {
+		/* Find the last '/' if any, then the last '.' before that. */
+		ext = strrchr(k->outfile, '/');
+		if (!ext)
+			ext = k->outfile;
+		ext = strrchr(ext, '.');
+		/* Cut off the extension */
+		if (ext)
+			*ext = '\0';
+	}
+	/* Remember that spot for later */
+	k->outext = k->outfile + strlen(k->outfile);
+	return 0;
+}
+
+/*
+ * Read the keys listed in a manifest. Each line is
+ * "<INFILE> [<BASENAME> [<HASH_ALG>]]". Returns the number of keys, or -1 on
+ * error. The caller must free the keys, their outfiles and *lines_ptr.
+ */
+static int read_manifest(const char *filename, struct create_key **keys_ptr,
+			 char **lines_ptr)
+{
+	struct create_key *keys = NULL, *newkeys;
+	char *buf, *newbuf, *line, *next;
+	char *pem, *basename, *alg, *save_word;
+	enum vb2_hash_algorithm hash_alg;
+	uint32_t size;
+	int count = 0, lineno = 0;
+
+	*keys_ptr = NULL;
+	*lines_ptr = NULL;
+
+	if (vb2_read_file(filename, (uint8_t **)&buf, &size)) {
+		fprintf(stderr, "ERROR: unable to read %s\n", filename);
+		return -1;
+	}
+
+	/* NUL-terminate it so it can be split into strings in place */
+	newbuf = realloc(buf, size + 1);
+	if (!newbuf) {
+		free(buf);
+		return -1;
+	}
+	buf = newbuf;
+	buf[size] = '\0';
+
+	for (line = buf; line; line = next) {
+		next = strchr(line, '\n');
+		if (next)
+			*next++ = '\0';
+		lineno++;
+		pem = strtok_r(line, " \t\r", &save_word);
+		if (!pem || *pem == '#')
+			continue;
+		basename = strtok_r(NULL, " \t\r", &save_word);
+		alg = strtok_r(NULL, " \t\r", &save_word);
+
+		hash_alg = opt_hash_alg;
+		if (alg && !vb2_lookup_hash_alg(alg, &hash_alg)) {
+			fprintf(stderr, "%s:%d: invalid hash_alg \"%s\"\n",
+				filename, lineno, alg);
+			goto fail;
+		}
+		if (strtok_r(NULL, " \t\r", &save_word)) {
+			fprintf(stderr, "%s:%d: too many fields\n",
+				filename, lineno);
+			goto fail;
+		}
+
+		newkeys = realloc(keys, (count + 1) * sizeof(*keys));
+		if (!newkeys)
+			goto fail;
+		keys = newkeys;
+		if (init_key(&keys[count], pem, basename, hash_alg))
+			goto fail;
+		count++;
+	}
+
+	*keys_ptr = keys;
+	*lines_ptr = buf;
+	return count;
+
+fail:
+	while (count--)
+		free(keys[count].outfile);
+	free(keys);
+	free(buf);
+	return -1;
+}
+
 static int do_create(int argc, char *argv[])
 {
 	int errorcnt = 0;
-	char *e, *s;
-	int i, r, len, remove_ext = 0;
+	char *e;
+	char *manifest = NULL, *manifest_lines = NULL;
+	struct create_key *keys = NULL;
+	int count = 0, njobs = 1;
+	int i, r;
 
 	while ((i = getopt_long(argc, argv, "", long_opts, NULL)) != -1) {
 		switch (i) {
@@ -336,6 +553,19 @@ static int do_create(int argc, char *argv[])
 			}
 			break;
 
+		case OPT_MANIFEST:
+			manifest = optarg;
+			break;
+
+		case OPT_JOBS:
+			njobs = strtol(optarg, &e, 0);
+			if (!*optarg || (e && *e) || njobs < 1) {
+				fprintf(stderr,
+					"invalid jobs \"%s\"\n", optarg);
+				errorcnt++;
+			}
+			break;
+
 		case OPT_HELP:
 			print_help(argc, argv);
 			return !!errorcnt;
@@ -359,8 +589,19 @@ static int do_create(int argc, char *argv[])
 		}
 	}
 
-	/* If we don't have an input file already, we need one */
-	if (!infile) {
+	if (manifest) {
+		if (argc > optind) {
+			fprintf(stderr,
+				"ERROR: --manifest takes no other files\n");
+			errorcnt++;
+		}
+		if (force_id) {
+			fprintf(stderr,
+				"ERROR: --id can't be shared by a manifest\n");
+			errorcnt++;
+		}
+	} else if (!infile) {
+		/* If we don't have an input file already, we need one */
 		if (argc - optind <= 0) {
 			fprintf(stderr, "ERROR: missing input filename\n");
 			errorcnt++;
@@ -374,45 +615,35 @@ static int do_create(int argc, char *argv[])
 		return 1;
 	}
 
-	/* Decide how to determine the output filenames. */
-	if (argc > optind) {
-		s = argv[optind++];		/* just use this */
+	if (manifest) {
+		count = read_manifest(manifest, &keys, &manifest_lines);
+		if (count < 0)
+			return 1;
 	} else {
-		s = infile;			/* based on pem file name */
-		remove_ext = 1;
-	}
-
-	/* Make an extra-large copy to leave room for filename extensions */
-	len = strlen(s) + 20;
-	outfile = (char *)malloc(len);
-	if (!outfile) {
-		fprintf(stderr, "ERROR: malloc() failed\n");
-		return 1;
-	}
-	strcpy(outfile, s);
-
-	if (remove_ext) {
-		/* Find the last '/' if any, then the last '.' before that. */
-		s = strrchr(outfile, '/');
-		if (!s)
-			s = outfile;
-		s = strrchr(s, '.');
-		/* Cut off the extension */
-		if (s)
-			*s = '\0';
+		keys = calloc(1, sizeof(*keys));
+		if (!keys) {
+			fprintf(stderr, "ERROR: malloc() failed\n");
+			return 1;
+		}
+		/* Decide how to determine the output filenames. */
+		count = 1;
+		if (init_key(keys, infile,
+			     argc > optind ? argv[optind++] : NULL,
+			     opt_hash_alg)) {
+			free(keys);
+			return 1;
+		}
 	}
-	/* Remember that spot for later */
-	outext = outfile + strlen(outfile);
 
 	/* Okay, do it */
-	if (vboot_version == VBOOT_VERSION_1_0)
-		r = vb1_make_keypair();
-	else
-		r = vb2_make_keypair();
+	r = create_keys(keys, count, njobs);
 
-	free(outfile);
-	return r;
+	for (i = 0; i < count; i++)
+		free(keys[i].outfile);
+	free(keys);
+	free(manifest_lines);
+	return !!r;
 }
 
 DECLARE_FUTIL_COMMAND(create, do_create, VBOOT_VERSION_ALL,
-		      "Create a keypair from an RSA .pem file");
+		      "Create a keypair from an RSA or Ed25519 .pem file");
@@ -0,0 +1,740 @@
+/*
+ * Copyright 2018 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ */
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "2sysincludes.h"
+#include "2common.h"
+#include "2sha.h"
+#include "fmap.h"
+#include "futility.h"
+
+/*
+ * A delta payload is a header followed by one record for each segment of
+ * the new image, in order. The segments are cut at every FMAP area
+ * boundary, so each one lies within a single (innermost) area and either
+ * changed or didn't as a whole. Everything is little-endian.
+ */
+#define DELTA_MAGIC "FUTDELTA"
+#define DELTA_MAGIC_SIZE 8
+#define DELTA_VERSION 1
+#define DELTA_HASH_ALG VB2_HASH_SHA256
+#define DELTA_DIGEST_SIZE VB2_SHA256_DIGEST_SIZE
+
+struct delta_header {
+	uint8_t magic[DELTA_MAGIC_SIZE];
+	uint32_t version;
+	uint32_t image_size;
+	uint32_t num_segments;
+	/* The image the payload applies to, and the one it produces */
+	uint8_t old_digest[DELTA_DIGEST_SIZE];
+	uint8_t new_digest[DELTA_DIGEST_SIZE];
+} __attribute__((packed));
+
+enum delta_type {
+	/* Same as the old image; no data */
+	DELTA_SAME,
+	/* Every byte is the same; data is that byte */
+	DELTA_FILL,
+	/* Data is a list of delta_ops against the old image */
+	DELTA_DIFF,
+	/* Data is the new contents */
+	DELTA_RAW,
+};
+
+struct delta_segment {
+	/* Innermost FMAP area holding the segment, if any */
+	char name[FMAP_NAMELEN];
+	uint32_t offset;
+	uint32_t size;
+	uint32_t type;
+	uint32_t data_size;
+	/* The new contents of the segment */
+	uint8_t digest[DELTA_DIGEST_SIZE];
+} __attribute__((packed));
+
+/* Keep copy bytes from the old image, then take literal bytes from data */
+struct delta_op {
+	uint32_t copy;
+	uint32_t literal;
+} __attribute__((packed));
+
+/*
+ * Matching runs shorter than this are cheaper to send again than to
+ * describe with another delta_op.
+ */
+#define MIN_MATCH (2 * sizeof(struct delta_op))
+
+/* Chunk size for hashing the old image while applying */
+#define HASH_CHUNK (64 * 1024)
+
+static const char usage[] = "\n"
+	"Usage:  " MYNAME " %s [OPTIONS] OLD_IMAGE NEW_IMAGE PAYLOAD\n"
+	"        " MYNAME " %s --apply [OPTIONS] OLD_IMAGE PAYLOAD OUTFILE\n"
+	"\n"
+	"The first form writes a payload holding just the differences between\n"
+	"two firmware images, area by area. The second reconstructs the new\n"
+	"image from the old one and the payload, checking each area and the\n"
+	"whole image against the digests recorded in the payload. Only one\n"
+	"area of each image is held in memory at a time.\n"
+	"\n"
+	"Options:\n"
+	"  -a|--apply          Apply PAYLOAD to OLD_IMAGE\n"
+	"  -v|--verbose        List each segment and how it is stored\n"
+	"\n";
+
+static void print_help(int argc, char *argv[])
+{
+	printf(usage, argv[0], argv[0]);
+}
+
+enum {
+	OPT_HELP = 1000,
+};
+static const struct option long_opts[] = {
+	/* name    hasarg *flag  val */
+	{"apply",       0, NULL, 'a'},
+	{"verbose",     0, NULL, 'v'},
+	{"help",        0, NULL, OPT_HELP},
+	{NULL,          0, NULL, 0},
+};
+static char *short_opts = ":av";
+
+static const char * const type_name[] = {
+	[DELTA_SAME] = "same",
+	[DELTA_FILL] = "fill",
+	[DELTA_DIFF] = "diff",
+	[DELTA_RAW] = "raw",
+};
+
+static int verbose;
+
+static void print_segment(const struct delta_segment *seg)
+{
+	printf("0x%08x - 0x%08x  %-4s %8" PRIu32 "  %.*s\n",
+	       seg->offset, seg->offset + seg->size - 1,
+	       type_name[seg->type], seg->data_size,
+	       FMAP_NAMELEN, seg->name);
+}
+
+/* Read exactly len bytes at offset, or complain and return non-zero. */
+static int read_at(const char *name, int fd, uint8_t *buf, uint32_t len,
+		   uint32_t offset)
+{
+	ssize_t r;
+
+	while (len) {
+		r = pread(fd, buf, len, offset);
+		if (r <= 0) {
+			fprintf(stderr, "Can't read %s: %s\n", name,
+				r ? strerror(errno) : "unexpected end");
+			return 1;
+		}
+		buf += r;
+		len -= r;
+		offset += r;
+	}
+	return 0;
+}
+
+static int map_image(const char *name, int *fd, uint8_t **buf,
+		     uint32_t *len)
+{
+	*fd = open(name, O_RDONLY);
+	if (*fd < 0) {
+		fprintf(stderr, "Can't open %s: %s\n", name, strerror(errno));
+		return 1;
+	}
+	if (futil_map_file(*fd, MAP_RO, buf, len)) {
+		close(*fd);
+		*fd = -1;
+		return 1;
+	}
+	return 0;
+}
+
+static int cmp_offset(const void *a, const void *b)
+{
+	uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+/*
+ * Cut [0, len) at every area boundary in the FMAP. Returns the number of
+ * segments; bounds[] gets one more entry than that.
+ */
+static int find_segments(FmapHeader *fmap, uint32_t len, uint32_t *bounds)
+{
+	FmapAreaHeader *ah = (FmapAreaHeader *)(fmap + 1);
+	int i, n = 0, num = 0;
+
+	bounds[n++] = 0;
+	bounds[n++] = len;
+	for (i = 0; i < fmap->fmap_nareas; i++, ah++) {
+		if (ah->area_offset < len)
+			bounds[n++] = ah->area_offset;
+		if (ah->area_size < len - ah->area_offset &&
+		    ah->area_offset < len)
+			bounds[n++] = ah->area_offset + ah->area_size;
+	}
+	qsort(bounds, n, sizeof(bounds[0]), cmp_offset);
+
+	for (i = 1; i < n; i++)
+		if (bounds[i] != bounds[num])
+			bounds[++num] = bounds[i];
+	return num;
+}
+
+/* Name a segment after the smallest area that holds it */
+static void name_segment(FmapHeader *fmap, struct delta_segment *seg)
+{
+	FmapAreaHeader *ah = (FmapAreaHeader *)(fmap + 1);
+	uint32_t best = UINT32_MAX;
+	int i;
+
+	memset(seg->name, 0, sizeof(seg->name));
+	for (i = 0; i < fmap->fmap_nareas; i++, ah++) {
+		if (ah->area_offset <= seg->offset &&
+		    seg->offset + seg->size - ah->area_offset <=
+		    ah->area_size && ah->area_size < best) {
+			best = ah->area_size;
+			memcpy(seg->name, ah->area_name, sizeof(seg->name));
+		}
+	}
+}
+
+/*
+ * Warn about areas which aren't where they were. They still work, since
+ * segments are compared at the same offset, but their diffs won't be
+ * small.
+ */
+static void check_layout(FmapHeader *new_fmap, uint8_t *old_buf,
+			 uint32_t old_len)
+{
+	FmapHeader *old_fmap = fmap_find(old_buf, old_len);
+	FmapAreaHeader *ah = (FmapAreaHeader *)(new_fmap + 1);
+	FmapAreaHeader *old_ah;
+	char name[FMAP_NAMELEN + 1];
+	int i;
+
+	if (!old_fmap) {
+		fprintf(stderr, "Warning: the old image has no FMAP\n");
+		return;
+	}
+
+	for (i = 0; i < new_fmap->fmap_nareas; i++, ah++) {
+		snprintf(name, sizeof(name), "%s", ah->area_name);
+		old_ah = NULL;
+		fmap_find_by_name(old_buf, old_len, old_fmap, name, &old_ah);
+		if (!old_ah)
+			fprintf(stderr, "Warning: area %s is new\n", name);
+		else if (old_ah->area_offset != ah->area_offset ||
+			 old_ah->area_size != ah->area_size)
+			fprintf(stderr, "Warning: area %s has moved\n", name);
+	}
+}
+
+/*
+ * Describe new[] as changes to old[]. Returns the size of the encoding, or
+ * 0 if it wouldn't be any smaller than new[] itself.
+ */
+static uint32_t encode_diff(uint8_t *out, const uint8_t *old,
+			    const uint8_t *new, uint32_t size)
+{
+	struct delta_op op;
+	uint32_t pos = 0, i = 0, j, k;
+
+	while (i < size) {
+		for (j = i; j < size && old[j] == new[j]; j++)
+			;
+		op.copy = j - i;
+		i = j;
+
+		/* The literal runs until the next worthwhile match */
+		while (j < size) {
+			if (old[j] != new[j]) {
+				j++;
+				continue;
+			}
+			for (k = j; k < size && k - j < MIN_MATCH &&
+				     old[k] == new[k]; k++)
+				;
+			if (k - j >= MIN_MATCH || k == size)
+				break;
+			j = k;
+		}
+		op.literal = j - i;
+
+		if (pos + sizeof(op) + op.literal >= size)
+			return 0;
+		memcpy(out + pos, &op, sizeof(op));
+		pos += sizeof(op);
+		memcpy(out + pos, new + i, op.literal);
+		pos += op.literal;
+		i = j;
+	}
+
+	return pos;
+}
+
+/* Rebuild new[] from old[] and the data of a segment */
+static int apply_segment(const struct delta_segment *seg, uint8_t *new,
+			 const uint8_t *old, const uint8_t *data)
+{
+	struct delta_op op;
+	uint32_t pos = 0, i = 0;
+
+	switch (seg->type) {
+	case DELTA_SAME:
+		memcpy(new, old, seg->size);
+		return 0;
+	case DELTA_FILL:
+		memset(new, data[0], seg->size);
+		return 0;
+	case DELTA_RAW:
+		memcpy(new, data, seg->size);
+		return 0;
+	}
+
+	while (pos < seg->data_size) {
+		if (seg->data_size - pos < sizeof(op))
+			return 1;
+		memcpy(&op, data + pos, sizeof(op));
+		pos += sizeof(op);
+		if (op.copy > seg->size - i ||
+		    op.literal > seg->size - i - op.copy ||
+		    op.literal > seg->data_size - pos)
+			return 1;
+		memcpy(new + i, old + i, op.copy);
+		i += op.copy;
+		memcpy(new + i, data + pos, op.literal);
+		i += op.literal;
+		pos += op.literal;
+	}
+
+	return i != seg->size;
+}
+
+static int write_payload(FILE *fp, const void *buf, size_t len)
+{
+	return len && fwrite(buf, len, 1, fp) != 1;
+}
+
+static int create_payload(const char *old_name, const char *new_name,
+			  const char *outfile)
+{
+	struct delta_header hdr;
+	struct delta_segment seg;
+	int old_fd = -1, new_fd = -1;
+	uint8_t *old_buf = NULL, *new_buf = NULL;
+	uint32_t old_len = 0, new_len = 0;
+	uint32_t *bounds = NULL;
+	uint8_t *data = NULL;
+	uint32_t i, num;
+	uint64_t total;
+	FmapHeader *fmap;
+	FILE *fp = NULL;
+	int errorcnt = 0;
+
+	if (map_image(old_name, &old_fd, &old_buf, &old_len) ||
+	    map_image(new_name, &new_fd, &new_buf, &new_len)) {
+		errorcnt++;
+		goto done;
+	}
+
+	if (old_len != new_len) {
+		fprintf(stderr, "%s is %" PRIu32 " bytes, but %s is %"
+			PRIu32 "\n", old_name, old_len, new_name, new_len);
+		errorcnt++;
+		goto done;
+	}
+
+	fmap = fmap_find(new_buf, new_len);
+	if (!fmap) {
+		fprintf(stderr, "Can't find an FMAP in %s\n", new_name);
+		errorcnt++;
+		goto done;
+	}
+	check_layout(fmap, old_buf, old_len);
+
+	bounds = malloc((2 * fmap->fmap_nareas + 2) * sizeof(*bounds));
+	data = malloc(new_len);
+	if (!bounds || !data) {
+		fprintf(stderr, "Couldn't allocate memory\n");
+		errorcnt++;
+		goto done;
+	}
+	num = find_segments(fmap, new_len, bounds);
+
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.magic, DELTA_MAGIC, DELTA_MAGIC_SIZE);
+	hdr.version = DELTA_VERSION;
+	hdr.image_size = new_len;
+	hdr.num_segments = num;
+	if (vb2_digest_buffer(old_buf, old_len, DELTA_HASH_ALG,
+			      hdr.old_digest, sizeof(hdr.old_digest)) ||
+	    vb2_digest_buffer(new_buf, new_len, DELTA_HASH_ALG,
+			      hdr.new_digest, sizeof(hdr.new_digest))) {
+		fprintf(stderr, "Can't hash the images\n");
+		errorcnt++;
+		goto done;
+	}
+
+	fp = fopen(outfile, "wb");
+	if (!fp) {
+		fprintf(stderr, "Can't open %s: %s\n",
+			outfile, strerror(errno));
+		errorcnt++;
+		goto done;
+	}
+	if (write_payload(fp, &hdr, sizeof(hdr))) {
+		fprintf(stderr, "Can't write %s\n", outfile);
+		errorcnt++;
+		goto done;
+	}
+	total = sizeof(hdr);
+
+	for (i = 0; i < num; i++) {
+		const uint8_t *old_seg, *new_seg;
+		uint32_t j;
+
+		seg.offset = bounds[i];
+		seg.size = bounds[i + 1] - bounds[i];
+		name_segment(fmap, &seg);
+		old_seg = old_buf + seg.offset;
+		new_seg = new_buf + seg.offset;
+
+		vb2_digest_buffer(new_seg, seg.size, DELTA_HASH_ALG,
+				  seg.digest, sizeof(seg.digest));
+
+		for (j = 1; j < seg.size && new_seg[j] == new_seg[0]; j++)
+			;
+		if (!memcmp(old_seg, new_seg, seg.size)) {
+			seg.type = DELTA_SAME;
+			seg.data_size = 0;
+		} else if (j == seg.size) {
+			seg.type = DELTA_FILL;
+			seg.data_size = 1;
+			data[0] = new_seg[0];
+		} else {
+			seg.type = DELTA_DIFF;
+			seg.data_size = encode_diff(data, old_seg, new_seg,
+						    seg.size);
+			if (!seg.data_size) {
+				seg.type = DELTA_RAW;
+				seg.data_size = seg.size;
+				memcpy(data, new_seg, seg.size);
+			}
+		}
+
+		if (verbose)
+			print_segment(&seg);
+
+		if (write_payload(fp, &seg, sizeof(seg)) ||
+		    write_payload(fp, data, seg.data_size)) {
+			fprintf(stderr, "Can't write %s\n", outfile);
+			errorcnt++;
+			goto done;
+		}
+		total += sizeof(seg) + seg.data_size;
+	}
+
+	printf("Payload is %" PRIu64 " bytes for a %" PRIu32
+	       " byte image (%" PRIu32 " segments)\n", total, new_len, num);
+
+done:
+	if (fp && fclose(fp)) {
+		fprintf(stderr, "Can't write %s: %s\n",
+			outfile, strerror(errno));
+		errorcnt++;
+	}
+	free(data);
+	free(bounds);
+	if (new_buf)
+		futil_unmap_file(new_fd, MAP_RO, new_buf, new_len);
+	if (old_buf)
+		futil_unmap_file(old_fd, MAP_RO, old_buf, old_len);
+	if (new_fd >= 0)
+		close(new_fd);
+	if (old_fd >= 0)
+		close(old_fd);
+	return !!errorcnt;
+}
+
+static int read_payload(FILE *fp, void *buf, size_t len)
+{
+	return len && fread(buf, len, 1, fp) != 1;
+}
+
+/* Hash the old image a chunk at a time and compare it with the payload */
+static int check_old_image(const char *name, int fd, uint32_t len,
+			   const uint8_t *want)
+{
+	struct vb2_digest_context dc;
+	uint8_t digest[DELTA_DIGEST_SIZE];
+	uint8_t *buf;
+	uint32_t offset, size;
+	int rv = 1;
+
+	buf = malloc(HASH_CHUNK);
+	if (!buf) {
+		fprintf(stderr, "Couldn't allocate memory\n");
+		return 1;
+	}
+
+	if (vb2_digest_init(&dc, DELTA_HASH_ALG))
+		goto done;
+	for (offset = 0; offset < len; offset += size) {
+		size = len - offset < HASH_CHUNK ? len - offset : HASH_CHUNK;
+		if (read_at(name, fd, buf, size, offset) ||
+		    vb2_digest_extend(&dc, buf, size))
+			goto done;
+	}
+	if (vb2_digest_finalize(&dc, digest, sizeof(digest)))
+		goto done;
+
+	if (memcmp(digest, want, sizeof(digest))) {
+		fprintf(stderr, "%s isn't the image this payload applies to\n",
+			name);
+		goto done;
+	}
+	rv = 0;
+
+done:
+	free(buf);
+	return rv;
+}
+
+static int apply_payload(const char *old_name, const char *payload,
+			 const char *outfile)
+{
+	struct delta_header hdr;
+	struct delta_segment seg;
+	struct vb2_digest_context dc;
+	uint8_t digest[DELTA_DIGEST_SIZE];
+	uint8_t *old_seg = NULL, *new_seg = NULL, *data = NULL;
+	uint32_t i, offset = 0;
+	struct stat old_sb, out_sb;
+	FILE *fp = NULL, *out = NULL;
+	int old_fd = -1;
+	int errorcnt = 0;
+
+	fp = fopen(payload, "rb");
+	if (!fp) {
+		fprintf(stderr, "Can't open %s: %s\n",
+			payload, strerror(errno));
+		return 1;
+	}
+	if (read_payload(fp, &hdr, sizeof(hdr)) ||
+	    memcmp(hdr.magic, DELTA_MAGIC, DELTA_MAGIC_SIZE)) {
+		fprintf(stderr, "%s is not a delta payload\n", payload);
+		errorcnt++;
+		goto done;
+	}
+	if (hdr.version != DELTA_VERSION) {
+		fprintf(stderr, "%s is version %" PRIu32 ", not %d\n",
+			payload, hdr.version, DELTA_VERSION);
+		errorcnt++;
+		goto done;
+	}
+
+	old_fd = open(old_name, O_RDONLY);
+	if (old_fd < 0 || fstat(old_fd, &old_sb)) {
+		fprintf(stderr, "Can't open %s: %s\n",
+			old_name, strerror(errno));
+		errorcnt++;
+		goto done;
+	}
+	if (old_sb.st_size != hdr.image_size) {
+		fprintf(stderr, "%s is %lld bytes, but the payload is for %"
+			PRIu32 "\n", old_name, (long long)old_sb.st_size,
+			hdr.image_size);
+		errorcnt++;
+		goto done;
+	}
+	if (check_old_image(old_name, old_fd, hdr.image_size,
+			    hdr.old_digest)) {
+		errorcnt++;
+		goto done;
+	}
+
+	/* Segments are read from the old image as the new one is written */
+	if (!stat(outfile, &out_sb) && out_sb.st_dev == old_sb.st_dev &&
+	    out_sb.st_ino == old_sb.st_ino) {
+		fprintf(stderr, "The output can't be the old image\n");
+		errorcnt++;
+		goto done;
+	}
+	out = fopen(outfile, "wb");
+	if (!out) {
+		fprintf(stderr, "Can't open %s: %s\n",
+			outfile, strerror(errno));
+		errorcnt++;
+		goto done;
+	}
+
+	if (vb2_digest_init(&dc, DELTA_HASH_ALG)) {
+		errorcnt++;
+		goto done;
+	}
+
+	for (i = 0; i < hdr.num_segments; i++) {
+		if (read_payload(fp, &seg, sizeof(seg)) ||
+		    seg.offset != offset || !seg.size ||
+		    seg.size > hdr.image_size - offset ||
+		    seg.type > DELTA_RAW ||
+		    (seg.type == DELTA_SAME && seg.data_size) ||
+		    (seg.type == DELTA_FILL && seg.data_size != 1) ||
+		    (seg.type == DELTA_RAW && seg.data_size != seg.size) ||
+		    seg.data_size > seg.size) {
+			fprintf(stderr, "%s is corrupt at segment %" PRIu32
+				"\n", payload, i);
+			errorcnt++;
+			goto done;
+		}
+
+		if (verbose)
+			print_segment(&seg);
+
+		old_seg = malloc(seg.size);
+		new_seg = malloc(seg.size);
+		data = malloc(seg.data_size + 1);
+		if (!old_seg || !new_seg || !data) {
+			fprintf(stderr, "Couldn't allocate memory\n");
+			errorcnt++;
+			goto done;
+		}
+
+		if (read_payload(fp, data, seg.data_size) ||
+		    read_at(old_name, old_fd, old_seg, seg.size, offset) ||
+		    apply_segment(&seg, new_seg, old_seg, data)) {
+			fprintf(stderr, "Can't rebuild segment %" PRIu32
+				" at 0x%08x\n", i, offset);
+			errorcnt++;
+			goto done;
+		}
+
+		if (vb2_digest_buffer(new_seg, seg.size, DELTA_HASH_ALG,
+				      digest, sizeof(digest)) ||
+		    memcmp(digest, seg.digest, sizeof(digest))) {
+			fprintf(stderr, "Segment %" PRIu32 " at 0x%08x (%.*s)"
+				" doesn't match its digest\n", i, offset,
+				FMAP_NAMELEN, seg.name);
+			errorcnt++;
+			goto done;
+		}
+
+		if (vb2_digest_extend(&dc, new_seg, seg.size) ||
+		    fwrite(new_seg, seg.size, 1, out) != 1) {
+			fprintf(stderr, "Can't write %s\n", outfile);
+			errorcnt++;
+			goto done;
+		}
+		offset += seg.size;
+
+		free(old_seg);
+		free(new_seg);
+		free(data);
+		old_seg = new_seg = data = NULL;
+	}
+
+	if (offset != hdr.image_size) {
+		fprintf(stderr, "%s ends early\n", payload);
+		errorcnt++;
+		goto done;
+	}
+	if (vb2_digest_finalize(&dc, digest, sizeof(digest)) ||
+	    memcmp(digest, hdr.new_digest, sizeof(digest))) {
+		fprintf(stderr, "The new image doesn't match its digest\n");
+		errorcnt++;
+		goto done;
+	}
+
+	printf("Wrote %s (%" PRIu32 " bytes)\n", outfile, hdr.image_size);
+
+done:
+	free(old_seg);
+	free(new_seg);
+	free(data);
+	if (out && fclose(out)) {
+		fprintf(stderr, "Can't write %s: %s\n",
+			outfile, strerror(errno));
+		errorcnt++;
+	}
+	/* Don't leave a half-built image behind */
+	if (out && errorcnt)
+		unlink(outfile);
+	if (old_fd >= 0)
+		close(old_fd);
+	fclose(fp);
+	return !!errorcnt;
+}
+
+static int do_delta(int argc, char *argv[])
+{
+	int apply = 0;
+	int errorcnt = 0;
+	int i;
+
+	opterr = 0;		/* quiet, you */
+	while ((i = getopt_long(argc, argv, short_opts, long_opts, 0)) != -1) {
+		switch (i) {
+		case 'a':
+			apply = 1;
+			break;
+		case 'v':
+			verbose = 1;
+			break;
+		case OPT_HELP:
+			print_help(argc, argv);
+			return !!errorcnt;
+		case '?':
+			if (optopt)
+				fprintf(stderr, "Unrecognized option: -%c\n",
+					optopt);
+			else
+				fprintf(stderr, "Unrecognized option\n");
+			errorcnt++;
+			break;
+		case ':':
+			fprintf(stderr, "Missing argument to -%c\n", optopt);
+			errorcnt++;
+			break;
+		default:
+			DIE;
+		}
+	}
+
+	if (errorcnt) {
+		print_help(argc, argv);
+		return 1;
+	}
+
+	if (argc - optind != 3) {
+		fprintf(stderr, "You must specify three files\n");
+		print_help(argc, argv);
+		return 1;
+	}
+
+	if (apply)
+		return apply_payload(argv[optind], argv[optind + 1],
+				     argv[optind + 2]);
+	return create_payload(argv[optind], argv[optind + 1],
+			      argv[optind + 2]);
+}
+
+DECLARE_FUTIL_COMMAND(delta, do_delta, VBOOT_VERSION_ALL,
+		      "Create or apply a per-area firmware delta payload");
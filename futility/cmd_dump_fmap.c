@@ -16,19 +16,171 @@
 #include <sys/types.h>
 #include <unistd.h>
 
+#include "2sysincludes.h"
+#include "2common.h"
+#include "2sha.h"
 #include "fmap.h"
 #include "futility.h"
+#include "host_jobs.h"
 
 enum { FMT_NORMAL, FMT_PRETTY, FMT_FLASHROM, FMT_HUMAN };
 
 /* global variables */
 static int opt_extract;
+static int opt_hash;
 static int opt_format = FMT_NORMAL;
 static int opt_overlap;
+static int opt_jobs;
 static void *base_of_rom;
 static size_t size_of_rom;
+static int rom_fd = -1;
 static int opt_gaps;
 
+enum area_status {
+	AREA_OK,
+	AREA_EMPTY,
+	AREA_TOO_BIG,
+	AREA_OPEN_FAILED,
+	AREA_WRITE_FAILED,
+};
+
+/* An area to show, and maybe extract or hash */
+struct area_job {
+	const FmapAreaHeader *ah;
+	int index;
+	char name[FMAP_NAMELEN + 1];
+	const char *outname;
+	char *default_name;		/* outname, if we made it up */
+	enum area_status status;
+	int err;
+	uint8_t digest[VB2_SHA256_DIGEST_SIZE];
+};
+
+/* Write [size] bytes of the image at [offset] to [fd]. Returns 0 if
+ * successful. */
+static int write_area(int fd, uint32_t offset, uint32_t size)
+{
+	off_t pos = offset;
+	size_t left = size;
+	ssize_t n;
+
+#ifdef HAVE_COPY_FILE_RANGE
+	/* Let the kernel copy, or share the blocks if the filesystem can */
+	while (left) {
+		n = copy_file_range(rom_fd, &pos, fd, NULL, left, 0);
+		if (n <= 0)
+			break;
+		left -= n;
+	}
+#endif
+
+	/* Anything it couldn't do is written from the mapped image */
+	while (left) {
+		n = write(fd, (uint8_t *)base_of_rom + pos, left);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n < 0)
+			return -1;
+		pos += n;
+		left -= n;
+	}
+
+	return 0;
+}
+
+static void do_area(struct area_job *a)
+{
+	const FmapAreaHeader *ah = a->ah;
+	int fd;
+
+	if ((uint64_t)ah->area_offset + ah->area_size > size_of_rom) {
+		a->status = AREA_TOO_BIG;
+		return;
+	}
+
+	if (opt_hash)
+		vb2_digest_buffer((uint8_t *)base_of_rom + ah->area_offset,
+				  ah->area_size, VB2_HASH_SHA256,
+				  a->digest, sizeof(a->digest));
+
+	if (!opt_extract)
+		return;
+
+	fd = open(a->outname, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+	if (fd < 0) {
+		a->status = AREA_OPEN_FAILED;
+		a->err = errno;
+		return;
+	}
+
+	if (!ah->area_size) {
+		a->status = AREA_EMPTY;
+	} else if (write_area(fd, ah->area_offset, ah->area_size)) {
+		a->status = AREA_WRITE_FAILED;
+		a->err = errno;
+	}
+
+	if (close(fd) && a->status == AREA_OK) {
+		a->status = AREA_WRITE_FAILED;
+		a->err = errno;
+	}
+}
+
+static void area_one(void *ctx, int i)
+{
+	/* Each area has its own output file, so nothing is shared */
+	do_area((struct area_job *)ctx + i);
+}
+
+/* Extract and/or hash the areas, using up to njobs threads. */
+static void do_areas(struct area_job *areas, int count, int njobs)
+{
+	vb2_run_jobs(area_one, areas, count, njobs);
+}
+
+static void print_digest(const uint8_t *digest)
+{
+	int i;
+
+	for (i = 0; i < VB2_SHA256_DIGEST_SIZE; i++)
+		printf("%02x", digest[i]);
+}
+
+/* Report what do_area() did. Returns 0 if successful */
+static int show_area_result(const struct area_job *a, const char *progname)
+{
+	switch (a->status) {
+	case AREA_TOO_BIG:
+		fprintf(stderr, "%s: section %s is larger than the image\n",
+			progname, a->name);
+		return 1;
+	case AREA_OPEN_FAILED:
+		fprintf(stderr, "%s: can't open %s: %s\n",
+			progname, a->outname, strerror(a->err));
+		return 1;
+	case AREA_WRITE_FAILED:
+		fprintf(stderr, "%s: can't write %s: %s\n",
+			progname, a->name, strerror(a->err));
+		return 1;
+	case AREA_EMPTY:
+		fprintf(stderr, "%s: section %s has zero size\n",
+			progname, a->name);
+		break;
+	case AREA_OK:
+		if (opt_extract && FMT_NORMAL == opt_format)
+			printf("saved as \"%s\"\n", a->outname);
+		break;
+	}
+
+	if (opt_hash && FMT_NORMAL == opt_format) {
+		printf("area_sha256:     ");
+		print_digest(a->digest);
+		printf("\n");
+	}
+
+	return 0;
+}
+
 /* Return 0 if successful */
 static int normal_fmap(const FmapHeader *fmh, int argc, char *argv[])
 {
@@ -37,7 +189,8 @@ static int normal_fmap(const FmapHeader *fmh, int argc, char *argv[])
 	const FmapAreaHeader *ah;
 	ah = (const FmapAreaHeader *) (fmh + 1);
 	char *extract_names[argc];
-	char *outname = 0;
+	struct area_job *areas, *a;
+	int count = 0;
 
 	memset(extract_names, 0, sizeof(extract_names));
 
@@ -61,6 +214,55 @@ static int normal_fmap(const FmapHeader *fmh, int argc, char *argv[])
 			return retval;
 	}
 
+	areas = calloc(fmh->fmap_nareas ? fmh->fmap_nareas : 1,
+		       sizeof(*areas));
+	if (!areas) {
+		fprintf(stderr, "%s: out of memory\n", argv[0]);
+		return 1;
+	}
+
+	/* Pick the areas to show */
+	for (i = 0; i < fmh->fmap_nareas; i++, ah++) {
+		a = &areas[count];
+		snprintf(a->name, sizeof(a->name), "%s", ah->area_name);
+
+		if (argc) {
+			int j, found = 0;
+			for (j = 0; j < argc; j++)
+				if (!strcmp(argv[j], a->name)) {
+					found = 1;
+					a->outname = extract_names[j];
+					break;
+				}
+			if (!found)
+				continue;
+		}
+
+		if (opt_extract && !a->outname) {
+			char *s;
+			a->default_name = strdup(a->name);
+			if (!a->default_name) {
+				fprintf(stderr, "%s: out of memory\n",
+					argv[0]);
+				retval = 1;
+				goto out;
+			}
+			for (s = a->default_name; *s; s++)
+				if (*s == ' ')
+					*s = '_';
+			a->outname = a->default_name;
+		}
+
+		a->ah = ah;
+		a->index = i;
+		count++;
+	}
+
+	/* Extracting and hashing can happen in any order... */
+	if (opt_extract || opt_hash)
+		do_areas(areas, count, opt_jobs);
+
+	/* ...but the report is in FMAP order */
 	if (FMT_NORMAL == opt_format) {
 		snprintf(buf, FMAP_SIGNATURE_SIZE + 1, "%s",
 			 fmh->fmap_signature);
@@ -75,77 +277,42 @@ static int normal_fmap(const FmapHeader *fmh, int argc, char *argv[])
 		printf("fmap_nareas:     %d\n", fmh->fmap_nareas);
 	}
 
-	for (i = 0; i < fmh->fmap_nareas; i++, ah++) {
-		snprintf(buf, FMAP_NAMELEN + 1, "%s", ah->area_name);
-
-		if (argc) {
-			int j, found = 0;
-			outname = NULL;
-			for (j = 0; j < argc; j++)
-				if (!strcmp(argv[j], buf)) {
-					found = 1;
-					outname = extract_names[j];
-					break;
-				}
-			if (!found)
-				continue;
-		}
+	for (a = areas; a < areas + count; a++) {
+		ah = a->ah;
 
 		switch (opt_format) {
 		case FMT_PRETTY:
-			printf("%s %d %d\n", buf, ah->area_offset,
+			printf("%s %d %d", a->name, ah->area_offset,
 			       ah->area_size);
+			if (opt_hash && a->status != AREA_TOO_BIG) {
+				printf(" ");
+				print_digest(a->digest);
+			}
+			printf("\n");
 			break;
 		case FMT_FLASHROM:
 			if (ah->area_size)
 				printf("0x%08x:0x%08x %s\n", ah->area_offset,
 				       ah->area_offset + ah->area_size - 1,
-				       buf);
+				       a->name);
 			break;
 		default:
-			printf("area:            %d\n", i + 1);
+			printf("area:            %d\n", a->index + 1);
 			printf("area_offset:     0x%08x\n", ah->area_offset);
 			printf("area_size:       0x%08x (%d)\n", ah->area_size,
 			       ah->area_size);
-			printf("area_name:       %s\n", buf);
+			printf("area_name:       %s\n", a->name);
 		}
 
-		if (opt_extract) {
-			char *s;
-			if (!outname) {
-				for (s = buf; *s; s++)
-					if (*s == ' ')
-						*s = '_';
-				outname = buf;
-			}
-			FILE *fp = fopen(outname, "wb");
-			if (!fp) {
-				fprintf(stderr, "%s: can't open %s: %s\n",
-					argv[0], outname, strerror(errno));
-				retval = 1;
-			} else if (!ah->area_size) {
-				fprintf(stderr,
-					"%s: section %s has zero size\n",
-					argv[0], buf);
-			} else if (ah->area_offset + ah->area_size >
-				   size_of_rom) {
-				fprintf(stderr, "%s: section %s is larger"
-					" than the image\n", argv[0], buf);
-				retval = 1;
-			} else if (1 != fwrite(base_of_rom + ah->area_offset,
-					       ah->area_size, 1, fp)) {
-				fprintf(stderr, "%s: can't write %s: %s\n",
-					argv[0], buf, strerror(errno));
-				retval = 1;
-			} else {
-				if (FMT_NORMAL == opt_format)
-					printf("saved as \"%s\"\n", outname);
-			}
-			if (fp)
-				fclose(fp);
-		}
+		if ((opt_extract || opt_hash) &&
+		    show_area_result(a, argv[0]))
+			retval = 1;
 	}
 
+out:
+	for (i = 0; i < count; i++)
+		free(areas[i].default_name);
+	free(areas);
 	return retval;
 }
 
@@ -405,6 +572,8 @@ static const char usage[] =
 	"  -H             With -h, display any gaps\n"
 	"  -p             Use a format easy to parse by scripts\n"
 	"  -F             Use the format expected by flashrom\n"
+	"  --hash         Show the SHA-256 digest of each section\n"
+	"  --jobs NUM     Extract or hash up to NUM sections at once\n"
 	"\n"
 	"Specify one or more NAMEs to dump only those sections.\n"
 	"\n";
@@ -416,9 +585,13 @@ static void print_help(int argc, char *argv[])
 
 enum {
 	OPT_HELP = 1000,
+	OPT_HASH,
+	OPT_JOBS,
 };
 static const struct option long_opts[] = {
 	{"help",     0, 0, OPT_HELP},
+	{"hash",     0, 0, OPT_HASH},
+	{"jobs",     1, 0, OPT_JOBS},
 	{NULL, 0, 0, 0}
 };
 static int do_dump_fmap(int argc, char *argv[])
@@ -429,6 +602,9 @@ static int do_dump_fmap(int argc, char *argv[])
 	int fd;
 	const FmapHeader *fmap;
 	int retval = 1;
+	char *e;
+
+	opt_jobs = sysconf(_SC_NPROCESSORS_ONLN);
 
 	opterr = 0;		/* quiet, you */
 	while ((c = getopt_long(argc, argv, ":xpFhH", long_opts, 0)) != -1) {
@@ -449,6 +625,17 @@ static int do_dump_fmap(int argc, char *argv[])
 			opt_format = FMT_HUMAN;
 			opt_overlap++;
 			break;
+		case OPT_HASH:
+			opt_hash = 1;
+			break;
+		case OPT_JOBS:
+			opt_jobs = strtol(optarg, &e, 0);
+			if (!*optarg || (e && *e) || opt_jobs < 1) {
+				fprintf(stderr, "%s: invalid --jobs \"%s\"\n",
+					argv[0], optarg);
+				errorcnt++;
+			}
+			break;
 		case OPT_HELP:
 			print_help(argc, argv);
 			return 0;
@@ -468,6 +655,13 @@ static int do_dump_fmap(int argc, char *argv[])
 		}
 	}
 
+	if (opt_hash && (FMT_HUMAN == opt_format ||
+			 FMT_FLASHROM == opt_format)) {
+		fprintf(stderr, "%s: --hash doesn't work with -h or -F\n",
+			argv[0]);
+		errorcnt++;
+	}
+
 	if (errorcnt || optind >= argc) {
 		print_help(argc, argv);
 		return 1;
@@ -495,7 +689,8 @@ static int do_dump_fmap(int argc, char *argv[])
 		close(fd);
 		return 1;
 	}
-	close(fd);		/* done with this now */
+	/* Extracted areas are copied from the file itself */
+	rom_fd = fd;
 	size_of_rom = sb.st_size;
 
 	fmap = fmap_find(base_of_rom, size_of_rom);
@@ -515,6 +710,9 @@ static int do_dump_fmap(int argc, char *argv[])
 		}
 	}
 
+	close(rom_fd);
+	rom_fd = -1;
+
 	if (0 != munmap(base_of_rom, sb.st_size)) {
 		fprintf(stderr, "%s: can't munmap %s: %s\n",
 			argv[0], argv[optind], strerror(errno));
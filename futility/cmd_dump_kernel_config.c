@@ -7,6 +7,7 @@
 
 #include <getopt.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <sys/mman.h>
 #include <unistd.h>
 
@@ -28,16 +29,18 @@ static const struct option long_opts[] = {
 static void print_help(int argc, char *argv[])
 {
 	printf("\nUsage:  " MYNAME " %s [--kloadaddr ADDRESS] "
-	       "KERNEL_PARTITION\n\n", argv[0]);
+	       "KERNEL_PARTITION [...]\n\n"
+	       "When more than one partition is given, each command line is\n"
+	       "preceded by the partition name.\n\n", argv[0]);
 }
 
 static int do_dump_kern_cfg(int argc, char *argv[])
 {
-	char *infile = NULL;
-	char *config = NULL;
+	char **configs = NULL;
 	uint64_t kernel_body_load_address = USE_PREAMBLE_LOAD_ADDR;
 	int parse_error = 0;
 	char *e;
+	int count, failures;
 	int i;
 
 	while (((i = getopt_long(argc, argv, ":", long_opts, NULL)) != -1) &&
@@ -70,27 +73,42 @@ static int do_dump_kern_cfg(int argc, char *argv[])
 	if (optind >= argc) {
 		fprintf(stderr, "Expected argument after options\n");
 		parse_error = 1;
-	} else
-		infile = argv[optind];
+	}
 
 	if (parse_error) {
 		print_help(argc, argv);
 		return 1;
 	}
 
-	if (!infile || !*infile) {
-		fprintf(stderr, "Must specify filename\n");
-		return 1;
+	count = argc - optind;
+	for (i = optind; i < argc; i++) {
+		if (!*argv[i]) {
+			fprintf(stderr, "Must specify filename\n");
+			return 1;
+		}
 	}
 
-	config = FindKernelConfig(infile, kernel_body_load_address);
-	if (!config)
+	configs = calloc(count, sizeof(*configs));
+	if (!configs) {
+		fprintf(stderr, "Out of memory\n");
 		return 1;
+	}
 
-	printf("%s", config);
+	failures = FindKernelConfigs((const char *const *)(argv + optind),
+				     count, kernel_body_load_address, configs);
+
+	for (i = 0; i < count; i++) {
+		if (!configs[i])
+			continue;
+		if (count > 1)
+			printf("%s:\n%s\n", argv[optind + i], configs[i]);
+		else
+			printf("%s", configs[i]);
+		free(configs[i]);
+	}
 
-	free(config);
-	return 0;
+	free(configs);
+	return failures ? 1 : 0;
 }
 
 DECLARE_FUTIL_COMMAND(dump_kernel_config, do_dump_kern_cfg, VBOOT_VERSION_ALL,
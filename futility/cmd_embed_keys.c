@@ -0,0 +1,346 @@
+/*
+ * Copyright 2018 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ */
+
+/*
+ * Generate C source for read-only firmware that has its root and recovery
+ * keys built in, so verstage needn't read them from the GBB.
+ *
+ * The root key is emitted already unpacked, as a const vb2_public_key with
+ * its modulus and precomputed Montgomery constants (n0inv and rr), which is
+ * what vb2ex_embedded_root_key() returns.  The recovery key stays packed,
+ * since vb2ex_embedded_recovery_key() hands it to code that takes a packed
+ * key.  Checking the keys against the GBB of the built image catches firmware
+ * that would disagree with its own GBB.
+ */
+
+#include <errno.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "2sysincludes.h"
+#include "2common.h"
+#include "2rsa.h"
+#include "futility.h"
+#include "gbb_header.h"
+#include "host_key.h"
+#include "host_misc.h"
+#include "vb2_common.h"
+
+static const char usage[] = "\n"
+	"Usage:  " MYNAME " %s [OPTIONS] [OUTFILE]\n"
+	"\n"
+	"Write C source for read-only firmware with its keys built in,\n"
+	"defining vb2ex_embedded_root_key() and/or\n"
+	"vb2ex_embedded_recovery_key().\n"
+	"\n"
+	"Options:\n"
+	"  --rootkey FILE.vbpubk       Root key to build in\n"
+	"  --recoverykey FILE.vbpubk   Recovery key to build in\n"
+	"  --image FILE                Fail unless the keys are the same as\n"
+	"                                the ones in the GBB of this image\n"
+	"\n"
+	"At least one key is needed. OUTFILE may only be left out with\n"
+	"--image, to just check the keys.\n"
+	"\n";
+
+static void print_help(int argc, char *argv[])
+{
+	printf(usage, argv[0]);
+}
+
+/* Printable enum names for the generated source */
+static const char * const sig_alg_names[VB2_SIG_ALG_COUNT] = {
+	[VB2_SIG_INVALID] = "VB2_SIG_INVALID",
+	[VB2_SIG_NONE] = "VB2_SIG_NONE",
+	[VB2_SIG_RSA1024] = "VB2_SIG_RSA1024",
+	[VB2_SIG_RSA2048] = "VB2_SIG_RSA2048",
+	[VB2_SIG_RSA4096] = "VB2_SIG_RSA4096",
+	[VB2_SIG_RSA8192] = "VB2_SIG_RSA8192",
+	[VB2_SIG_RSA2048_EXP3] = "VB2_SIG_RSA2048_EXP3",
+	[VB2_SIG_RSA3072_EXP3] = "VB2_SIG_RSA3072_EXP3",
+	[VB2_SIG_ED25519] = "VB2_SIG_ED25519",
+};
+
+static const char * const hash_alg_names[VB2_HASH_ALG_COUNT] = {
+	[VB2_HASH_INVALID] = "VB2_HASH_INVALID",
+	[VB2_HASH_SHA1] = "VB2_HASH_SHA1",
+	[VB2_HASH_SHA256] = "VB2_HASH_SHA256",
+	[VB2_HASH_SHA512] = "VB2_HASH_SHA512",
+};
+
+struct embedded_key {
+	const char *what;
+	const char *filename;
+	struct vb2_packed_key *packed;
+	uint32_t packed_size;
+	struct vb2_public_key key;
+};
+
+/* Read a .vbpubk, and make sure firmware will be able to use it */
+static int read_key(struct embedded_key *k)
+{
+	k->packed = vb2_read_packed_key(k->filename);
+	if (!k->packed) {
+		fprintf(stderr, "Can't read %s key from %s\n", k->what,
+			k->filename);
+		return 1;
+	}
+	k->packed_size = k->packed->key_offset + k->packed->key_size;
+
+	if (vb2_unpack_key_buffer(&k->key, (const uint8_t *)k->packed,
+				  k->packed_size)) {
+		fprintf(stderr, "Can't unpack %s key from %s\n", k->what,
+			k->filename);
+		return 1;
+	}
+	return 0;
+}
+
+/* The GBB key has to be the same key with the same version */
+static int check_key(const struct embedded_key *k,
+		     const GoogleBinaryBlockHeader *gbb,
+		     uint32_t offset, uint32_t size)
+{
+	const struct vb2_packed_key *g =
+		(const struct vb2_packed_key *)((const uint8_t *)gbb + offset);
+
+	if (size < sizeof(*g) || g->key_offset > size ||
+	    g->key_size > size - g->key_offset) {
+		fprintf(stderr, "The GBB has no valid %s key\n", k->what);
+		return 1;
+	}
+
+	if (g->algorithm != k->packed->algorithm ||
+	    g->key_version != k->packed->key_version ||
+	    g->key_size != k->packed->key_size ||
+	    memcmp((const uint8_t *)g + g->key_offset,
+		   (const uint8_t *)k->packed + k->packed->key_offset,
+		   g->key_size)) {
+		fprintf(stderr, "The %s key in %s doesn't match the GBB\n",
+			k->what, k->filename);
+		return 1;
+	}
+	return 0;
+}
+
+static int check_image(const char *image, const struct embedded_key *root,
+		       const struct embedded_key *recovery)
+{
+	GoogleBinaryBlockHeader *gbb;
+	uint8_t *buf;
+	uint32_t len;
+	int count;
+	int errorcnt = 0;
+
+	if (vb2_read_file(image, &buf, &len)) {
+		fprintf(stderr, "Can't read %s\n", image);
+		return 1;
+	}
+
+	gbb = futil_find_gbb(buf, len, &count);
+	if (!gbb) {
+		fprintf(stderr, "%s has %s GBB header\n", image,
+			count ? "more than one" : "no");
+		free(buf);
+		return 1;
+	}
+
+	if (root->packed)
+		errorcnt += check_key(root, gbb, gbb->rootkey_offset,
+				      gbb->rootkey_size);
+	if (recovery->packed)
+		errorcnt += check_key(recovery, gbb, gbb->recovery_key_offset,
+				      gbb->recovery_key_size);
+
+	free(buf);
+	return errorcnt;
+}
+
+static void print_words(FILE *fp, const char *name, const uint32_t *words,
+			uint32_t count)
+{
+	uint32_t i;
+
+	fprintf(fp, "static const uint32_t %s[%u] = {", name, count);
+	for (i = 0; i < count; i++)
+		fprintf(fp, "%s0x%08x,", i % 4 ? " " : "\n\t", words[i]);
+	fprintf(fp, "\n};\n\n");
+}
+
+static void print_root_key(FILE *fp, const struct embedded_key *k)
+{
+	const struct vb2_public_key *key = &k->key;
+
+	print_words(fp, "root_key_n", key->n, key->arrsize);
+	print_words(fp, "root_key_rr", key->rr, key->arrsize);
+
+	fprintf(fp, "static const struct vb2_public_key root_key = {\n");
+	fprintf(fp, "\t.arrsize = %u,\n", key->arrsize);
+	fprintf(fp, "\t.n0inv = 0x%08x,\n", key->n0inv);
+	fprintf(fp, "\t.n = root_key_n,\n");
+	fprintf(fp, "\t.rr = root_key_rr,\n");
+	fprintf(fp, "\t.sig_alg = %s,\n", sig_alg_names[key->sig_alg]);
+	fprintf(fp, "\t.hash_alg = %s,\n", hash_alg_names[key->hash_alg]);
+	fprintf(fp, "\t.version = %u,\n", key->version);
+	fprintf(fp, "};\n\n");
+
+	fprintf(fp, "const struct vb2_public_key *"
+		"vb2ex_embedded_root_key(void)\n");
+	fprintf(fp, "{\n\treturn &root_key;\n}\n");
+}
+
+static void print_recovery_key(FILE *fp, const struct embedded_key *k)
+{
+	const uint8_t *bytes = (const uint8_t *)k->packed;
+	uint32_t i;
+
+	/* Aligned, so it can be used as a packed key in place */
+	fprintf(fp, "static const uint8_t recovery_key[%u]\n"
+		"\t__attribute__((aligned(4))) = {", k->packed_size);
+	for (i = 0; i < k->packed_size; i++)
+		fprintf(fp, "%s0x%02x,", i % 8 ? " " : "\n\t", bytes[i]);
+	fprintf(fp, "\n};\n\n");
+
+	fprintf(fp, "const struct vb2_packed_key *"
+		"vb2ex_embedded_recovery_key(void)\n");
+	fprintf(fp, "{\n\treturn (const struct vb2_packed_key *)"
+		"recovery_key;\n}\n");
+}
+
+static int write_source(const char *outfile, const struct embedded_key *root,
+			const struct embedded_key *recovery)
+{
+	FILE *fp;
+	int errorcnt = 0;
+
+	fp = fopen(outfile, "w");
+	if (!fp) {
+		fprintf(stderr, "Can't open %s for writing: %s\n", outfile,
+			strerror(errno));
+		return 1;
+	}
+
+	fprintf(fp, "/* Generated by futility embed_keys.  Do not edit. */\n");
+	fprintf(fp, "\n#include \"2sysincludes.h\"\n");
+	fprintf(fp, "#include \"2api.h\"\n");
+	fprintf(fp, "#include \"2rsa.h\"\n");
+	if (root->packed) {
+		fprintf(fp, "\n/* Root key from %s */\n", root->filename);
+		print_root_key(fp, root);
+	}
+	if (recovery->packed) {
+		fprintf(fp, "\n/* Recovery key from %s */\n",
+			recovery->filename);
+		print_recovery_key(fp, recovery);
+	}
+
+	if (ferror(fp)) {
+		fprintf(stderr, "Error writing %s\n", outfile);
+		errorcnt++;
+	}
+	if (fclose(fp)) {
+		fprintf(stderr, "Error when closing %s: %s\n", outfile,
+			strerror(errno));
+		errorcnt++;
+	}
+	return errorcnt;
+}
+
+enum {
+	OPT_HELP = 1000,
+	OPT_ROOTKEY,
+	OPT_RECOVERYKEY,
+	OPT_IMAGE,
+};
+static const struct option long_opts[] = {
+	{"help",        0, 0, OPT_HELP},
+	{"rootkey",     1, 0, OPT_ROOTKEY},
+	{"recoverykey", 1, 0, OPT_RECOVERYKEY},
+	{"image",       1, 0, OPT_IMAGE},
+	{NULL, 0, 0, 0}
+};
+static int do_embed_keys(int argc, char *argv[])
+{
+	struct embedded_key root = { .what = "root" };
+	struct embedded_key recovery = { .what = "recovery" };
+	const char *image = NULL;
+	const char *outfile = NULL;
+	int errorcnt = 0;
+	int i;
+
+	opterr = 0;		/* quiet, you */
+	while ((i = getopt_long(argc, argv, ":", long_opts, NULL)) != -1) {
+		switch (i) {
+		case OPT_ROOTKEY:
+			root.filename = optarg;
+			break;
+		case OPT_RECOVERYKEY:
+			recovery.filename = optarg;
+			break;
+		case OPT_IMAGE:
+			image = optarg;
+			break;
+		case OPT_HELP:
+			print_help(argc, argv);
+			return 0;
+		case '?':
+			if (optopt)
+				fprintf(stderr, "Unrecognized option: -%c\n",
+					optopt);
+			else
+				fprintf(stderr, "Unrecognized option\n");
+			errorcnt++;
+			break;
+		case ':':
+			fprintf(stderr, "Missing argument to -%c\n", optopt);
+			errorcnt++;
+			break;
+		default:
+			DIE;
+		}
+	}
+
+	if (optind < argc)
+		outfile = argv[optind++];
+	if (optind < argc) {
+		fprintf(stderr, "Too many arguments\n");
+		errorcnt++;
+	}
+	if (!root.filename && !recovery.filename) {
+		fprintf(stderr, "No keys to embed\n");
+		errorcnt++;
+	}
+	if (!outfile && !image) {
+		fprintf(stderr, "Need an OUTFILE or an image to check\n");
+		errorcnt++;
+	}
+	if (errorcnt) {
+		print_help(argc, argv);
+		return 1;
+	}
+
+	if (root.filename)
+		errorcnt += read_key(&root);
+	if (recovery.filename)
+		errorcnt += read_key(&recovery);
+
+	/* Don't write anything the image disagrees with */
+	if (!errorcnt && image)
+		errorcnt += check_image(image, &root, &recovery);
+	if (!errorcnt && outfile)
+		errorcnt += write_source(outfile, &root, &recovery);
+
+	free(root.packed);
+	free(recovery.packed);
+	return !!errorcnt;
+}
+
+DECLARE_FUTIL_COMMAND(embed_keys, do_embed_keys, VBOOT_VERSION_ALL,
+		      "Generate C source for firmware with built-in keys");
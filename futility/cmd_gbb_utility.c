@@ -4,6 +4,7 @@
  * found in the LICENSE file.
  */
 #include <errno.h>
+#include <fcntl.h>
 #include <getopt.h>
 #include <inttypes.h>
 #include <stddef.h>
@@ -11,12 +12,14 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
 
 #include "futility.h"
 #include "gbb_header.h"
+#include "host_misc.h"
 
 static void print_help(int argc, char *argv[])
 {
@@ -98,23 +101,12 @@ static void opt_has_arg(const char *name, int val)
 
 static int errorcnt;
 
-#define GBB_SEARCH_STRIDE 4
 static GoogleBinaryBlockHeader *FindGbbHeader(uint8_t *ptr, size_t size)
 {
-	size_t i;
-	GoogleBinaryBlockHeader *tmp, *gbb_header = NULL;
-	int count = 0;
-
-	for (i = 0; i <= size - GBB_SEARCH_STRIDE; i += GBB_SEARCH_STRIDE) {
-		if (0 != memcmp(ptr + i, GBB_SIGNATURE, GBB_SIGNATURE_SIZE))
-			continue;
-
-		/* Found something. See if it's any good. */
-		tmp = (GoogleBinaryBlockHeader *) (ptr + i);
-		if (futil_valid_gbb_header(tmp, size - i, NULL))
-			if (!count++)
-				gbb_header = tmp;
-	}
+	GoogleBinaryBlockHeader *gbb_header;
+	int count;
+
+	gbb_header = futil_find_gbb(ptr, size, &count);
 
 	switch (count) {
 	case 0:
@@ -201,59 +193,19 @@ static uint8_t *create_gbb(const char *desc, off_t *sizeptr)
 	return buf;
 }
 
-static uint8_t *read_entire_file(const char *filename, off_t *sizeptr)
+static uint8_t *read_entire_file(const char *filename, off_t *sizeptr,
+				 struct vb2_file_view **view_ptr)
 {
-	FILE *fp = NULL;
-	uint8_t *buf = NULL;
-	struct stat sb;
-
-	fp = fopen(filename, "rb");
-	if (!fp) {
-		fprintf(stderr, "ERROR: Unable to open %s for reading: %s\n",
-			filename, strerror(errno));
-		goto fail;
-	}
-
-	if (0 != fstat(fileno(fp), &sb)) {
-		fprintf(stderr, "ERROR: can't fstat %s: %s\n",
-			filename, strerror(errno));
-		goto fail;
-	}
-	if (sizeptr)
-		*sizeptr = sb.st_size;
-
-	buf = (uint8_t *) malloc(sb.st_size);
-	if (!buf) {
-		fprintf(stderr, "ERROR: can't malloc %" PRIi64 " bytes: %s\n",
-			sb.st_size, strerror(errno));
-		goto fail;
-	}
-
-	if (1 != fread(buf, sb.st_size, 1, fp)) {
+	if (vb2_file_view_open(filename, 0, view_ptr)) {
 		fprintf(stderr, "ERROR: Unable to read from %s: %s\n",
 			filename, strerror(errno));
-		goto fail;
-	}
-
-	if (0 != fclose(fp)) {
-		fprintf(stderr, "ERROR: Unable to close %s: %s\n",
-			filename, strerror(errno));
-		fp = NULL;  /* Don't try to close it again */
-		goto fail;
+		errorcnt++;
+		return NULL;
 	}
 
-	return buf;
-
-fail:
-	errorcnt++;
-
-	if (buf)
-		free(buf);
-
-	if (fp && 0 != fclose(fp))
-		fprintf(stderr, "ERROR: Unable to close %s: %s\n",
-			filename, strerror(errno));
-	return NULL;
+	if (sizeptr)
+		*sizeptr = (*view_ptr)->size;
+	return (*view_ptr)->data;
 }
 
 static int write_to_file(const char *msg, const char *filename,
@@ -353,6 +305,68 @@ done_close:
 	return r;
 }
 
+/* Return non-zero if both names refer to the same file */
+static int same_file(const char *a, const char *b)
+{
+	struct stat sa, sb;
+
+	if (!strcmp(a, b))
+		return 1;
+	if (stat(a, &sa) || stat(b, &sb))
+		return 0;
+	return sa.st_dev == sb.st_dev && sa.st_ino == sb.st_ino;
+}
+
+/* Only blocks of this size which changed are copied back to the file */
+#define PATCH_BLOCK_SIZE 4096
+
+/*
+ * Copy an edited GBB back over the one in a shared mapping of the image,
+ * touching only the blocks which changed, then flush them to the file.
+ */
+static int save_in_place(const char *filename, uint8_t *image,
+			 uint32_t image_size, uint8_t *gbb_map,
+			 const uint8_t *gbb_copy, uint32_t gbb_size,
+			 int new_rootkey)
+{
+	uintptr_t page_mask = sysconf(_SC_PAGESIZE) - 1;
+	uint8_t *sync_start;
+	size_t sync_size;
+	uint32_t i, n;
+
+	for (i = 0; i < gbb_size; i += n) {
+		n = gbb_size - i;
+		if (n > PATCH_BLOCK_SIZE)
+			n = PATCH_BLOCK_SIZE;
+		if (memcmp(gbb_map + i, gbb_copy + i, n))
+			memcpy(gbb_map + i, gbb_copy + i, n);
+	}
+
+	/* The ryu root header can be anywhere, so sync everything for it */
+	if (new_rootkey) {
+		if (fill_ryu_root_header(image, image_size,
+					 (GoogleBinaryBlockHeader *)gbb_map)) {
+			errorcnt++;
+			return 1;
+		}
+		sync_start = image;
+		sync_size = image_size;
+	} else {
+		sync_start = (uint8_t *)((uintptr_t)gbb_map & ~page_mask);
+		sync_size = gbb_map + gbb_size - sync_start;
+	}
+
+	if (msync(sync_start, sync_size, MS_SYNC)) {
+		fprintf(stderr, "ERROR: Unable to sync %s: %s\n",
+			filename, strerror(errno));
+		errorcnt++;
+		return 1;
+	}
+
+	printf("successfully saved new image to: %s\n", filename);
+	return 0;
+}
+
 static int do_gbb(int argc, char *argv[])
 {
 	enum do_what_now { DO_GET, DO_SET, DO_CREATE } mode = DO_GET;
@@ -368,11 +382,18 @@ static int do_gbb(int argc, char *argv[])
 	int sel_digest = 0;
 	int sel_flags = 0;
 	int sel_roothash = 0;
+	struct vb2_file_view *inview = NULL;
 	uint8_t *inbuf = NULL;
 	off_t filesize;
 	uint8_t *outbuf = NULL;
 	GoogleBinaryBlockHeader *gbb;
 	uint8_t *gbb_base;
+	uint8_t *gbb_map = NULL;
+	uint32_t gbb_size = 0;
+	uint8_t *image = NULL;
+	uint32_t image_size = 0;
+	int image_fd = -1;
+	int in_place = 0;
 	int i;
 
 	opterr = 0;		/* quiet, you */
@@ -478,7 +499,7 @@ static int do_gbb(int argc, char *argv[])
 		    && !sel_flags && !sel_digest)
 			sel_hwid = 1;
 
-		inbuf = read_entire_file(infile, &filesize);
+		inbuf = read_entire_file(infile, &filesize, &inview);
 		if (!inbuf)
 			break;
 
@@ -540,34 +561,77 @@ static int do_gbb(int argc, char *argv[])
 			return 1;
 		}
 
-		/* With no args, we'll either copy it unchanged or do nothing */
-		inbuf = read_entire_file(infile, &filesize);
-		if (!inbuf)
-			break;
+		/*
+		 * Edit the image in place unless it's going somewhere else.
+		 * Only the GBB is copied, so a failed edit leaves the image
+		 * alone.
+		 */
+		in_place = same_file(infile, outfile);
+		if (in_place) {
+			image_fd = open(infile, O_RDWR);
+			if (image_fd < 0) {
+				fprintf(stderr,
+					"ERROR: Unable to open %s: %s\n",
+					infile, strerror(errno));
+				errorcnt++;
+				break;
+			}
+			if (futil_map_file(image_fd, MAP_RW, &image,
+					   &image_size)) {
+				image = NULL;
+				errorcnt++;
+				break;
+			}
+			inbuf = image;
+			filesize = image_size;
+		} else {
+			/* With no args, we'll copy it unchanged */
+			inbuf = read_entire_file(infile, &filesize, &inview);
+			if (!inbuf)
+				break;
+		}
 
 		gbb = FindGbbHeader(inbuf, filesize);
 		if (!gbb) {
 			fprintf(stderr, "ERROR: No GBB found in %s\n", infile);
 			break;
 		}
-		gbb_base = (uint8_t *) gbb;
 
-		outbuf = (uint8_t *) malloc(filesize);
-		if (!outbuf) {
-			errorcnt++;
-			fprintf(stderr,
-				"ERROR: can't malloc %" PRIi64 " bytes: %s\n",
-				filesize, strerror(errno));
-			break;
-		}
+		if (in_place) {
+			gbb_map = (uint8_t *)gbb;
+			futil_valid_gbb_header(gbb, filesize - (gbb_map - inbuf),
+					       &gbb_size);
+			outbuf = (uint8_t *) malloc(gbb_size);
+			if (!outbuf) {
+				errorcnt++;
+				fprintf(stderr,
+					"ERROR: can't malloc %" PRIu32
+					" bytes: %s\n",
+					gbb_size, strerror(errno));
+				break;
+			}
+			memcpy(outbuf, gbb_map, gbb_size);
+			gbb = (GoogleBinaryBlockHeader *)outbuf;
+		} else {
+			outbuf = (uint8_t *) malloc(filesize);
+			if (!outbuf) {
+				errorcnt++;
+				fprintf(stderr,
+					"ERROR: can't malloc %" PRIi64
+					" bytes: %s\n",
+					filesize, strerror(errno));
+				break;
+			}
 
-		/* Switch pointers to outbuf */
-		memcpy(outbuf, inbuf, filesize);
-		gbb = FindGbbHeader(outbuf, filesize);
-		if (!gbb) {
-			fprintf(stderr,
-				"INTERNAL ERROR: No GBB found in outbuf\n");
-			exit(1);
+			/* Switch pointers to outbuf */
+			memcpy(outbuf, inbuf, filesize);
+			gbb = FindGbbHeader(outbuf, filesize);
+			if (!gbb) {
+				fprintf(stderr,
+					"INTERNAL ERROR: No GBB found in "
+					"outbuf\n");
+				exit(1);
+			}
 		}
 		gbb_base = (uint8_t *) gbb;
 
@@ -607,7 +671,9 @@ static int do_gbb(int argc, char *argv[])
 				       gbb_base + gbb->rootkey_offset,
 				       gbb->rootkey_size);
 
-			if (fill_ryu_root_header(outbuf, filesize, gbb))
+			/* In place, this waits until the GBB is saved */
+			if (!in_place &&
+			    fill_ryu_root_header(outbuf, filesize, gbb))
 				errorcnt++;
 		}
 		if (opt_bmpfv)
@@ -620,7 +686,10 @@ static int do_gbb(int argc, char *argv[])
 				       gbb->recovery_key_size);
 
 		/* Write it out if there are no problems. */
-		if (!errorcnt)
+		if (!errorcnt && in_place)
+			save_in_place(outfile, image, image_size, gbb_map,
+				      outbuf, gbb_size, !!opt_rootkey);
+		else if (!errorcnt)
 			write_to_file("successfully saved new image to:",
 				      outfile, outbuf, filesize);
 
@@ -651,8 +720,11 @@ static int do_gbb(int argc, char *argv[])
 		break;
 	}
 
-	if (inbuf)
-		free(inbuf);
+	vb2_file_view_put(inview);
+	if (image)
+		munmap(image, image_size);
+	if (image_fd >= 0)
+		close(image_fd);
 	if (outbuf)
 		free(outbuf);
 	return !!errorcnt;
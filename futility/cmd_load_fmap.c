@@ -23,6 +23,7 @@
 
 static const char usage[] = "\n"
 	"Usage:  " MYNAME " %s [OPTIONS] FILE AREA:file [AREA:file ...]\n"
+	"        " MYNAME " %s [OPTIONS] --manifest MANIFEST|- FILE\n"
 	"\n"
 	"Replace the contents of specific FMAP areas. This is the complement\n"
 	"of " MYNAME " dump_fmap -x FILE AREA [AREA ...]\n"
@@ -31,6 +32,21 @@ static const char usage[] = "\n"
 	"  -o OUTFILE     Write the result to this file, instead of modifying\n"
 	"                   the input file. This is safer, since there are no\n"
 	"                   safeguards against doing something stupid.\n"
+	"  --manifest MANIFEST\n"
+	"                 Then make the changes listed in MANIFEST (or stdin\n"
+	"                   if it's \"-\"), one per line:\n"
+	"\n"
+	"    area AREA FILE        Load FILE into AREA\n"
+	"    gbb hwid HWID         Set the GBB's HWID\n"
+	"    gbb flags FLAGS       Set the GBB's flags\n"
+	"    gbb rootkey FILE      Set the GBB's root key\n"
+	"    gbb recoverykey FILE  Set the GBB's recovery key\n"
+	"    gbb bmpfv FILE        Set the GBB's bitmap volume\n"
+	"    sign [OPTIONS]        Sign the image in place, with the options\n"
+	"                            of \"" MYNAME " sign\"\n"
+	"\n"
+	"                 Arguments may be quoted, and '#' starts a comment.\n"
+	"                 The image is mapped once for all of the changes.\n"
 	"\n"
 	"Example:\n"
 	"\n"
@@ -41,48 +57,113 @@ static const char usage[] = "\n"
 
 static void print_help(int argc, char *argv[])
 {
-	printf(usage, argv[0], argv[0]);
+	printf(usage, argv[0], argv[0], argv[0]);
 }
 
 enum {
 	OPT_HELP = 1000,
+	OPT_MANIFEST,
 };
 static const struct option long_opts[] = {
 	/* name    hasarg *flag  val */
 	{"help",        0, NULL, OPT_HELP},
+	{"manifest",    1, NULL, OPT_MANIFEST},
 	{NULL,          0, NULL, 0},
 };
 static char *short_opts = ":o:";
 
+#define MANIFEST_MAX_ARGS 64
+
+/* The image being changed, mapped once for everything */
+struct image {
+	const char *name;
+	int fd;
+	uint8_t *buf;
+	uint32_t len;
+	struct fmap_index fi;
+};
 
-static int copy_to_area(char *file, uint8_t *buf, uint32_t len, char *area)
+/*
+ * Copy up to len bytes of file into buf, which is part of the mapped image.
+ * Regular files are copied by the kernel into the image's own pages (or share
+ * blocks, on filesystems which can), and anything else is read straight into
+ * the mapping. If clear is non-zero, the file must fit and the rest of buf is
+ * zeroed.
+ */
+static int copy_to_area(const char *file, struct image *img, uint8_t *buf,
+			uint32_t len, const char *area, int clear)
 {
-	FILE *fp;
+	struct stat sb;
+	uint32_t n = 0;
+	ssize_t r;
 	int retval = 0;
-	int n;
+	int fd;
 
-	fp = fopen(file, "r");
-	if (!fp) {
+	fd = open(file, O_RDONLY);
+	if (fd < 0) {
 		fprintf(stderr, "area %s: can't open %s for reading: %s\n",
 			area, file, strerror(errno));
 		return 1;
 	}
 
-	n = fread(buf, 1, len, fp);
-	if (n == 0) {
-		if (feof(fp))
-			fprintf(stderr, "area %s: unexpected EOF on %s\n",
-				area, file);
-		if (ferror(fp))
+	if (fstat(fd, &sb)) {
+		fprintf(stderr, "area %s: can't stat %s: %s\n",
+			area, file, strerror(errno));
+		close(fd);
+		return 1;
+	}
+
+	if (clear) {
+		if (S_ISREG(sb.st_mode) && sb.st_size > len) {
+			fprintf(stderr, "area %s: %s exceeds capacity "
+				"(%" PRIu32 ")\n", area, file, len);
+			close(fd);
+			return 1;
+		}
+		memset(buf, 0, len);
+	}
+
+#ifdef HAVE_COPY_FILE_RANGE
+	if (S_ISREG(sb.st_mode)) {
+		loff_t pos = buf - img->buf;
+		uint32_t want = sb.st_size < len ? sb.st_size : len;
+
+		while (n < want) {
+			r = copy_file_range(fd, NULL, img->fd, &pos,
+					    want - n, 0);
+			if (r <= 0)
+				break;
+			n += r;
+		}
+	}
+#endif
+
+	/* This picks up wherever copy_file_range() left off */
+	while (n < len) {
+		r = read(fd, buf + n, len - n);
+		if (r < 0 && errno == EINTR)
+			continue;
+		if (r < 0) {
 			fprintf(stderr, "area %s: can't read from %s: %s\n",
 				area, file, strerror(errno));
+			retval = 1;
+			break;
+		}
+		if (r == 0)
+			break;
+		n += r;
+	}
+
+	if (!retval && n == 0) {
+		fprintf(stderr, "area %s: unexpected EOF on %s\n",
+			area, file);
 		retval = 1;
-	} else if (n < len) {
+	} else if (!retval && n < len && !clear) {
 		fprintf(stderr, "Warning on area %s: only read %d "
 			"(not %d) from %s\n", area, n, len, file);
 	}
 
-	if (0 != fclose(fp)) {
+	if (0 != close(fd)) {
 		fprintf(stderr, "area %s: error closing %s: %s\n",
 			area, file, strerror(errno));
 		retval = 1;
@@ -91,17 +172,147 @@ static int copy_to_area(char *file, uint8_t *buf, uint32_t len, char *area)
 	return retval;
 }
 
+static int load_area(struct image *img, const char *area, const char *file)
+{
+	FmapAreaHeader *ah;
+	uint8_t *area_buf = fmap_index_find(&img->fi, area, &ah);
+
+	if (!area_buf) {
+		fprintf(stderr, "Can't find area \"%s\" in FMAP\n", area);
+		return 1;
+	}
+
+	return copy_to_area(file, img, area_buf, ah->area_size, area, 0);
+}
+
+static int edit_gbb(struct image *img, const char *field, const char *value)
+{
+	GoogleBinaryBlockHeader *gbb;
+	uint8_t *gbb_base;
+	char *e = NULL;
+	uint32_t val;
+	int count;
+
+	gbb = futil_find_gbb(img->buf, img->len, &count);
+	if (!gbb) {
+		fprintf(stderr, count ? "Multiple GBB headers found in %s\n" :
+			"No GBB found in %s\n", img->name);
+		return 1;
+	}
+	gbb_base = (uint8_t *)gbb;
+
+	if (!strcmp(field, "hwid")) {
+		if (strlen(value) + 1 > gbb->hwid_size) {
+			fprintf(stderr, "Null-terminated HWID exceeds"
+				" capacity (%d)\n", gbb->hwid_size);
+			return 1;
+		}
+		/* Wipe data before writing new value. */
+		memset(gbb_base + gbb->hwid_offset, 0, gbb->hwid_size);
+		strcpy((char *)(gbb_base + gbb->hwid_offset), value);
+		update_hwid_digest(gbb);
+		return 0;
+	}
+
+	if (!strcmp(field, "flags")) {
+		val = (uint32_t)strtoul(value, &e, 0);
+		if (!*value || (e && *e)) {
+			fprintf(stderr, "Invalid GBB flags value: %s\n",
+				value);
+			return 1;
+		}
+		gbb->flags = val;
+		return 0;
+	}
+
+	if (!strcmp(field, "rootkey")) {
+		if (copy_to_area(value, img, gbb_base + gbb->rootkey_offset,
+				 gbb->rootkey_size, "GBB root_key", 1))
+			return 1;
+		return !!fill_ryu_root_header(img->buf, img->len, gbb);
+	}
+
+	if (!strcmp(field, "recoverykey"))
+		return copy_to_area(value, img,
+				    gbb_base + gbb->recovery_key_offset,
+				    gbb->recovery_key_size,
+				    "GBB recovery_key", 1);
+
+	if (!strcmp(field, "bmpfv"))
+		return copy_to_area(value, img, gbb_base + gbb->bmpfv_offset,
+				    gbb->bmpfv_size, "GBB bmp_fv", 1);
+
+	fprintf(stderr, "Unknown GBB field \"%s\"\n", field);
+	return 1;
+}
+
+/* Make the changes listed in a manifest. Returns non-zero on error. */
+static int run_manifest(struct image *img, const char *manifest)
+{
+	char *args[MANIFEST_MAX_ARGS];
+	char *line = NULL;
+	size_t line_size = 0;
+	FILE *fp = stdin;
+	int line_num = 0;
+	int errorcnt = 0;
+	int count;
+
+	if (strcmp(manifest, "-")) {
+		fp = fopen(manifest, "r");
+		if (!fp) {
+			fprintf(stderr, "Can't open %s: %s\n",
+				manifest, strerror(errno));
+			return 1;
+		}
+	}
+
+	/* Stop at the first failure, as the AREA:file arguments do */
+	while (!errorcnt && getline(&line, &line_size, fp) != -1) {
+		line_num++;
+		count = futil_split_line(line, args, MANIFEST_MAX_ARGS);
+		if (count == 0)
+			continue;
+
+		if (count > 0 && !strcmp(args[0], "area") && count == 3)
+			errorcnt += load_area(img, args[1], args[2]);
+		else if (count > 0 && !strcmp(args[0], "gbb") && count == 3)
+			errorcnt += edit_gbb(img, args[1], args[2]);
+		else if (count > 0 && !strcmp(args[0], "sign"))
+			errorcnt += !!futil_sign_mapped(count - 1, args + 1,
+							img->name, img->buf,
+							img->len);
+		else {
+			fprintf(stderr, "%s line %d: malformed change\n",
+				manifest, line_num);
+			errorcnt++;
+		}
+
+		if (errorcnt)
+			fprintf(stderr, "%s line %d: failed\n",
+				manifest, line_num);
+	}
+
+	if (ferror(fp)) {
+		fprintf(stderr, "Error reading %s: %s\n",
+			manifest, strerror(errno));
+		errorcnt++;
+	}
+	if (fp != stdin)
+		fclose(fp);
+	free(line);
+
+	return errorcnt;
+}
+
 
 static int do_load_fmap(int argc, char *argv[])
 {
 	char *infile = 0;
 	char *outfile = 0;
-	uint8_t *buf;
-	uint32_t len;
-	FmapHeader *fmap;
-	FmapAreaHeader *ah;
+	char *manifest = 0;
+	struct image img;
 	int errorcnt = 0;
-	int fd, i;
+	int i;
 
 	opterr = 0;		/* quiet, you */
 	while ((i = getopt_long(argc, argv, short_opts, long_opts, 0)) != -1) {
@@ -109,6 +320,9 @@ static int do_load_fmap(int argc, char *argv[])
 		case 'o':
 			outfile = optarg;
 			break;
+		case OPT_MANIFEST:
+			manifest = optarg;
+			break;
 		case OPT_HELP:
 			print_help(argc, argv);
 			return !!errorcnt;
@@ -134,7 +348,7 @@ static int do_load_fmap(int argc, char *argv[])
 		return 1;
 	}
 
-	if (argc - optind < 2) {
+	if (argc - optind < (manifest ? 1 : 2)) {
 		fprintf(stderr,
 			"You must specify an input file"
 			" and at least one AREA:file argument\n");
@@ -150,19 +364,19 @@ static int do_load_fmap(int argc, char *argv[])
 	else
 		outfile = infile;
 
-	fd = open(outfile, O_RDWR);
-	if (fd < 0) {
+	img.name = outfile;
+	img.fd = open(outfile, O_RDWR);
+	if (img.fd < 0) {
 		fprintf(stderr, "Can't open %s: %s\n",
 			outfile, strerror(errno));
 		return 1;
 	}
 
-	errorcnt |= futil_map_file(fd, MAP_RW, &buf, &len);
+	errorcnt |= futil_map_file(img.fd, MAP_RW, &img.buf, &img.len);
 	if (errorcnt)
 		goto done_file;
 
-	fmap = fmap_find(buf, len);
-	if (!fmap) {
+	if (!fmap_index_init(&img.fi, img.buf, img.len, NULL)) {
 		fprintf(stderr, "Can't find an FMAP in %s\n", infile);
 		errorcnt++;
 		goto done_map;
@@ -178,25 +392,21 @@ static int do_load_fmap(int argc, char *argv[])
 			break;
 		}
 		*f++ = '\0';
-		uint8_t *area_buf = fmap_find_by_name(buf, len, fmap, a, &ah);
-		if (!area_buf) {
-			fprintf(stderr, "Can't find area \"%s\" in FMAP\n", a);
-			errorcnt++;
-			break;
-		}
-
-		if (0 != copy_to_area(f, area_buf, ah->area_size, a)) {
+		if (0 != load_area(&img, a, f)) {
 			errorcnt++;
 			break;
 		}
 	}
 
+	if (!errorcnt && manifest)
+		errorcnt += run_manifest(&img, manifest);
+
 done_map:
-	errorcnt |= futil_unmap_file(fd, 1, buf, len);
+	errorcnt |= futil_unmap_file(img.fd, 1, img.buf, img.len);
 
 done_file:
 
-	if (0 != close(fd)) {
+	if (0 != close(img.fd)) {
 		fprintf(stderr, "Error closing %s: %s\n",
 			outfile, strerror(errno));
 		errorcnt++;
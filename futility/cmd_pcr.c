@@ -5,22 +5,26 @@
  */
 
 #include <ctype.h>
+#include <errno.h>
 #include <getopt.h>
+#include <inttypes.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include "2sysincludes.h"
 #include "2common.h"
 #include "2sha.h"
 #include "futility.h"
+#include "futility_options.h"
 
 static const char usage[] = "\n"
 	"Usage:  " MYNAME " %s [OPTIONS] DIGEST [...]\n"
 	"\n"
 	"This simulates a TPM PCR extension, to determine the expected output\n"
 	"\n"
-	"Each DIGEST arg should be a hex string (spaces optional) of the\n"
+	"Each DIGEST should be a hex string (spaces optional) of the\n"
 	"appropriate length. The PCR is extended with each digest in turn\n"
 	"and the new value displayed.\n"
 	"\n"
@@ -29,16 +33,25 @@ static const char usage[] = "\n"
 	"            (the default is to start with all zeros)\n"
 	"  -2      Use sha256 DIGESTS (the default is sha1)\n"
 	"\n"
+	"  --log                Replay DIGESTs read from stdin instead of the\n"
+	"                         command line, and show only the final PCRs\n"
+	"  --binary             The --log input is raw bytes (default is hex)\n"
+	"  --bank ALG           Extend a PCR bank using hash ALG (sha1 or\n"
+	"                         sha256). With --log, this may be repeated;\n"
+	"                         each event then has one DIGEST per bank, in\n"
+	"                         the order the banks were given.\n"
+	"\n"
 	"Examples:\n"
 	"\n"
 	"  " MYNAME " %s b52791126f96a21a8ba4d511c6f25a1c1eb6dc9e\n"
 	"  " MYNAME " %s "
 	"'b5 27 91 12 6f 96 a2 1a 8b a4 d5 11 c6 f2 5a 1c 1e b6 dc 9e'\n"
+	"  " MYNAME " %s --log --bank sha1 --bank sha256 < events.txt\n"
 	"\n";
 
 static void print_help(int argc, char *argv[])
 {
-	printf(usage, argv[0], argv[0], argv[0]);
+	printf(usage, argv[0], argv[0], argv[0], argv[0]);
 }
 
 static int parse_hex(uint8_t *val, const char *str)
@@ -99,20 +112,200 @@ static void print_digest(const uint8_t *buf, int len)
 		printf("%02x", buf[i]);
 }
 
+/* The banks a single --log replay can extend at once */
+#define MAX_BANKS 4
+
+/* Size of the chunks the --log input is read in */
+#define LOG_BUFFER_SIZE (64 * 1024)
+
+struct pcr_bank {
+	enum vb2_hash_algorithm alg;
+	int digest_size;
+	/* The PCR value followed by the digest extending it */
+	uint8_t accum[VB2_MAX_DIGEST_SIZE * 2];
+};
+
+struct log_reader {
+	FILE *fp;
+	int binary;
+	uint8_t buf[LOG_BUFFER_SIZE];
+	size_t pos;
+	size_t len;
+};
+
+/* Return how many buffered bytes are left, reading more if there are none. */
+static size_t log_fill(struct log_reader *r)
+{
+	if (r->pos == r->len) {
+		r->len = fread(r->buf, 1, sizeof(r->buf), r->fp);
+		r->pos = 0;
+	}
+	return r->len - r->pos;
+}
+
+/* Return the next byte of input, or -1 at EOF. */
+static int log_getc(struct log_reader *r)
+{
+	if (!log_fill(r))
+		return -1;
+	return r->buf[r->pos++];
+}
+
+/*
+ * Read the next len-byte DIGEST from the log. Returns 1 if one was read, 0
+ * at the end of the log, or -1 if the log ends part way through the DIGEST
+ * or holds something that isn't hex.
+ */
+static int log_read_digest(struct log_reader *r, uint8_t *buf, int len)
+{
+	char hex[3] = {0, 0, 0};
+	size_t n;
+	int c, i;
+
+	if (r->binary) {
+		for (i = 0; i < len; i += n) {
+			n = log_fill(r);
+			if (!n)
+				return i ? -1 : 0;
+			if (n > len - i)
+				n = len - i;
+			memcpy(buf + i, r->buf + r->pos, n);
+			r->pos += n;
+		}
+		return 1;
+	}
+
+	for (i = 0; i < len; i++) {
+		/* skip whitespace */
+		do {
+			c = log_getc(r);
+		} while (c >= 0 && isspace(c));
+		if (c < 0)
+			return i ? -1 : 0;
+
+		hex[0] = c;
+		c = log_getc(r);
+		hex[1] = c < 0 ? 0 : c;
+		if (!parse_hex(buf + i, hex))
+			return -1;
+	}
+	return 1;
+}
+
+/* Extend each bank with one event from the log until the log runs out. */
+static int replay_log(struct pcr_bank *banks, int nbanks, int opt_init,
+		      struct log_reader *r, uint64_t *count)
+{
+	struct pcr_bank *b;
+	int i, ret;
+
+	*count = 0;
+	for (;;) {
+		for (i = 0; i < nbanks; i++) {
+			b = &banks[i];
+			ret = log_read_digest(r, b->accum + b->digest_size,
+					      b->digest_size);
+			if (ret <= 0)
+				break;
+		}
+		if (ret == 0 && i == 0)
+			return 0;
+		if (ret <= 0) {
+			fprintf(stderr, "Invalid %s DIGEST in event %" PRIu64
+				"\n", vb2_get_hash_algorithm_name(b->alg),
+				*count);
+			return 1;
+		}
+
+		for (i = 0; i < nbanks; i++) {
+			b = &banks[i];
+			if (opt_init && !*count) {
+				memcpy(b->accum, b->accum + b->digest_size,
+				       b->digest_size);
+				continue;
+			}
+			if (VB2_SUCCESS !=
+			    vb2_digest_buffer(b->accum, b->digest_size * 2,
+					      b->alg, b->accum,
+					      b->digest_size)) {
+				fprintf(stderr, "Error computing digest!\n");
+				return 1;
+			}
+		}
+		(*count)++;
+	}
+}
+
+static int do_log(struct pcr_bank *banks, int nbanks, int opt_init,
+		  int binary)
+{
+	struct log_reader *r;
+	uint64_t count;
+	int i;
+
+	r = malloc(sizeof(*r));
+	if (!r) {
+		fprintf(stderr, "Couldn't allocate log buffer\n");
+		return 1;
+	}
+	r->fp = stdin;
+	r->binary = binary;
+	r->pos = r->len = 0;
+
+	for (i = 0; i < nbanks; i++)
+		memset(banks[i].accum, 0, sizeof(banks[i].accum));
+
+	if (replay_log(banks, nbanks, opt_init, r, &count)) {
+		free(r);
+		return 1;
+	}
+	if (ferror(stdin)) {
+		fprintf(stderr, "Error reading log: %s\n", strerror(errno));
+		free(r);
+		return 1;
+	}
+	free(r);
+
+	if (count < 1 + opt_init) {
+		fprintf(stderr, "You must extend at least one DIGEST\n");
+		return 1;
+	}
+
+	printf("Events: %" PRIu64 "\n", count - opt_init);
+	for (i = 0; i < nbanks; i++) {
+		printf("%s PCR: ", vb2_get_hash_algorithm_name(banks[i].alg));
+		print_digest(banks[i].accum, banks[i].digest_size);
+		printf("\n");
+	}
+
+	return 0;
+}
+
 enum {
 	OPT_HELP = 1000,
+	OPT_LOG,
+	OPT_BINARY,
+	OPT_BANK,
 };
 static const struct option long_opts[] = {
 	{"help",     0, 0, OPT_HELP},
+	{"log",      0, 0, OPT_LOG},
+	{"binary",   0, 0, OPT_BINARY},
+	{"bank",     1, 0, OPT_BANK},
 	{NULL, 0, 0, 0}
 };
 static int do_pcr(int argc, char *argv[])
 {
 	uint8_t accum[VB2_MAX_DIGEST_SIZE * 2];
 	uint8_t pcr[VB2_MAX_DIGEST_SIZE];
+	struct pcr_bank banks[MAX_BANKS];
+	enum vb2_hash_algorithm alg;
+	int nbanks = 0;
 	int digest_alg = VB2_HASH_SHA1;
 	int digest_size;
 	int opt_init = 0;
+	int opt_log = 0;
+	int opt_binary = 0;
 	int errorcnt = 0;
 	int i;
 
@@ -125,6 +318,29 @@ static int do_pcr(int argc, char *argv[])
 		case '2':
 			digest_alg = VB2_HASH_SHA256;
 			break;
+		case OPT_LOG:
+			opt_log = 1;
+			break;
+		case OPT_BINARY:
+			opt_binary = 1;
+			break;
+		case OPT_BANK:
+			if (!vb2_lookup_hash_alg(optarg, &alg) ||
+			    (alg != VB2_HASH_SHA1 && alg != VB2_HASH_SHA256)) {
+				fprintf(stderr, "invalid bank \"%s\"\n",
+					optarg);
+				errorcnt++;
+				break;
+			}
+			if (nbanks == MAX_BANKS) {
+				fprintf(stderr, "Too many banks\n");
+				errorcnt++;
+				break;
+			}
+			banks[nbanks].alg = alg;
+			banks[nbanks].digest_size = vb2_digest_size(alg);
+			nbanks++;
+			break;
 		case OPT_HELP:
 			print_help(argc, argv);
 			return !!errorcnt;
@@ -145,11 +361,36 @@ static int do_pcr(int argc, char *argv[])
 		}
 	}
 
+	if (!opt_log && nbanks > 1) {
+		fprintf(stderr, "Only --log can extend several banks\n");
+		errorcnt++;
+	}
+	if (opt_log && argc > optind) {
+		fprintf(stderr, "DIGEST args can't be used with --log\n");
+		errorcnt++;
+	}
+	if (opt_binary && !opt_log) {
+		fprintf(stderr, "--binary only applies to --log\n");
+		errorcnt++;
+	}
+
 	if (errorcnt) {
 		print_help(argc, argv);
 		return 1;
 	}
 
+	if (opt_log) {
+		if (!nbanks) {
+			banks[0].alg = digest_alg;
+			banks[0].digest_size = vb2_digest_size(digest_alg);
+			nbanks = 1;
+		}
+		return do_log(banks, nbanks, opt_init, opt_binary);
+	}
+
+	if (nbanks)
+		digest_alg = banks[0].alg;
+
 	if (argc - optind < 1 + opt_init) {
 		fprintf(stderr, "You must extend at least one DIGEST\n");
 		print_help(argc, argv);
@@ -7,6 +7,7 @@
 #include <openssl/rsa.h>
 
 #include <errno.h>
+#include <dirent.h>
 #include <fcntl.h>
 #include <getopt.h>
 #include <inttypes.h>
@@ -17,6 +18,8 @@
 #include <string.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <sys/wait.h>
+#include <time.h>
 #include <unistd.h>
 
 #include "2sysincludes.h"
@@ -30,6 +33,7 @@
 #include "futility_options.h"
 #include "host_common.h"
 #include "host_key2.h"
+#include "keys_summary.h"
 #include "util_misc.h"
 #include "vb1_helper.h"
 #include "vb2_common.h"
@@ -40,9 +44,16 @@ struct show_option_s show_option = {
 	.type = FILE_TYPE_UNKNOWN,
 };
 
-/* Shared work buffer */
-static uint8_t workbuf[VB2_KERNEL_WORKBUF_RECOMMENDED_SIZE];
-static struct vb2_workbuf wb;
+/*
+ * Shared work buffer. It's set up statically so the show functions also work
+ * when they're called from other commands.
+ */
+static uint8_t workbuf[VB2_KERNEL_WORKBUF_RECOMMENDED_SIZE]
+	__attribute__((aligned(VB2_WORKBUF_ALIGN)));
+static struct vb2_workbuf wb = {
+	.buf = workbuf,
+	.size = sizeof(workbuf),
+};
 
 void show_pubkey(const struct vb2_packed_key *pubkey, const char *sp)
 {
@@ -347,6 +358,18 @@ int ft_show_kernel_preamble(const char *name, uint8_t *buf, uint32_t len,
 	}
 
 	printf("  Flags:                 0x%x\n", vb2_kernel_get_flags(pre2));
+	if (vb2_kernel_get_compression(pre2) != VB2_KERNEL_COMPRESSION_NONE) {
+		printf("  Body compression:      %u\n",
+		       vb2_kernel_get_compression(pre2));
+		printf("  Body load size:        0x%x\n",
+		       vb2_kernel_get_body_load_size(pre2));
+	}
+	if (vb2_kernel_get_body_chunk_size(pre2)) {
+		printf("  Body chunk size:       0x%x\n",
+		       vb2_kernel_get_body_chunk_size(pre2));
+		printf("  Body chunks:           %u\n",
+		       vb2_kernel_get_body_chunk_count(pre2));
+	}
 
 	/* Verify kernel body */
 	uint8_t *kernel_blob = 0;
@@ -369,14 +392,19 @@ int ft_show_kernel_preamble(const char *name, uint8_t *buf, uint32_t len,
 
 	if (VB2_SUCCESS !=
 	    vb2_verify_data(kernel_blob, kernel_size, &pre2->body_signature,
-			    &data_key, &wb)) {
+			    &data_key, &wb) ||
+	    VerifyKernelBodyChunks(pre2, kernel_blob, kernel_size,
+				   data_key.hash_alg)) {
 		fprintf(stderr, "Error verifying kernel body.\n");
 		return 1;
 	}
 
 	printf("Body verification succeeded.\n");
 
-	printf("Config:\n%s\n", kernel_blob + kernel_cmd_line_offset(pre2));
+	/* The config is somewhere inside a compressed body */
+	if (vb2_kernel_get_compression(pre2) == VB2_KERNEL_COMPRESSION_NONE)
+		printf("Config:\n%s\n",
+		       kernel_blob + kernel_cmd_line_offset(pre2));
 
 	return retval;
 }
@@ -385,6 +413,9 @@ enum no_short_opts {
 	OPT_PADDING = 1000,
 	OPT_TYPE,
 	OPT_PUBKEY,
+	OPT_TIMING,
+	OPT_KEYS_SUMMARY,
+	OPT_KEYSET,
 	OPT_HELP,
 };
 
@@ -403,8 +434,18 @@ static const char usage[] = "\n"
 	"\n"
 	"Options:\n"
 	"  -t                               Just show the type of each file\n"
+	"  -r|--recursive                   Look at every file found under\n"
+	"                                     any FILE which is a directory\n"
+	"  -j|--jobs        NUM             Look at NUM files at once\n"
+	"  --timing                         Report the time spent on each\n"
+	"                                     type of file\n"
 	"  --type           TYPE            Override the detected file type\n"
 	"                                     Use \"--type help\" for a list\n"
+	"  --keys-summary                   Just show which keys signed each\n"
+	"                                     image, disk image or keyblock\n"
+	"  --keyset         DIR             Name the keys which match any\n"
+	"                                     .vbpubk in DIR (with\n"
+	"                                     --keys-summary)\n"
 	"Type-specific options:\n"
 	"  -k|--publickey   FILE.vbpubk     Public key in vb1 format\n"
 	"  --pubkey         FILE.vpubk2     Public key in vb2 format\n"
@@ -433,17 +474,23 @@ static const struct option long_opts[] = {
 	{"type",        1, NULL, OPT_TYPE},
 	{"strict",      0, &show_option.strict, 1},
 	{"pubkey",      1, NULL, OPT_PUBKEY},
+	{"recursive",   0, NULL, 'r'},
+	{"jobs",        1, NULL, 'j'},
+	{"timing",      0, NULL, OPT_TIMING},
+	{"keys-summary", 0, NULL, OPT_KEYS_SUMMARY},
+	{"keyset",      1, NULL, OPT_KEYSET},
 	{"help",        0, NULL, OPT_HELP},
 	{NULL, 0, NULL, 0},
 };
-static char *short_opts = ":f:k:t";
+static char *short_opts = ":f:k:trj:";
 
 
-static int show_type(char *filename)
+static int show_type(const char *filename, enum futil_file_type *typep)
 {
 	enum futil_file_err err;
 	enum futil_file_type type;
 	err = futil_file_type(filename, &type);
+	*typep = type;
 	switch (err) {
 	case FILE_ERR_NONE:
 		printf("%s:\t%s\n", filename, futil_file_type_name(type));
@@ -468,20 +515,372 @@ static int show_type(char *filename)
 	return 1;
 }
 
+/* Look at one file, and report what type it turned out to be */
+static int show_file(const char *infile, enum futil_file_type *typep)
+{
+	struct vb2_file_view *view;
+	uint64_t size;
+	int ifd;
+	int errorcnt = 0;
+
+	*typep = FILE_TYPE_UNKNOWN;
+	if (show_option.t_flag)
+		return show_type(infile, typep);
+
+	ifd = open(infile, O_RDONLY);
+	if (ifd < 0) {
+		fprintf(stderr, "Can't open %s: %s\n",
+			infile, strerror(errno));
+		return 1;
+	}
+
+	/* Whole disks are read a kernel partition at a time, not mapped */
+	if (!show_option.keys_summary &&
+	    (!show_option.type_override ||
+	     show_option.type == FILE_TYPE_CHROMIUMOS_DISK) &&
+	    futil_disk_stream_fd(ifd, &size)) {
+		*typep = FILE_TYPE_CHROMIUMOS_DISK;
+		errorcnt += ft_show_disk_fd(infile, ifd, size);
+		goto boo;
+	}
+
+	if (0 != vb2_file_view_open_fd(ifd, 0, &view)) {
+		fprintf(stderr, "Can't read %s\n", infile);
+		errorcnt++;
+		goto boo;
+	}
+
+	/* Allow the user to override the type */
+	if (show_option.type_override)
+		*typep = show_option.type;
+	else
+		*typep = futil_file_type_buf(view->data, view->size);
+
+	if (show_option.keys_summary)
+		errorcnt += show_keys_summary(*typep, infile, view->data,
+					      view->size);
+	else
+		errorcnt += futil_file_type_show(*typep, infile, view->data,
+						 view->size);
+
+	vb2_file_view_put(view);
+boo:
+	if (close(ifd)) {
+		errorcnt++;
+		fprintf(stderr, "Error when closing %s: %s\n",
+			infile, strerror(errno));
+	}
+
+	return errorcnt;
+}
+
+/** Collecting the files to look at **/
+
+struct file_list {
+	char **names;
+	int count;
+	int size;
+};
+
+static int add_file(struct file_list *list, const char *name)
+{
+	if (list->count == list->size) {
+		int size = list->size ? 2 * list->size : 64;
+		char **names = realloc(list->names, size * sizeof(*names));
+		if (!names) {
+			fprintf(stderr, "Can't allocate the file list\n");
+			return 1;
+		}
+		list->names = names;
+		list->size = size;
+	}
+
+	list->names[list->count] = strdup(name);
+	if (!list->names[list->count]) {
+		fprintf(stderr, "Can't allocate the file list\n");
+		return 1;
+	}
+	list->count++;
+	return 0;
+}
+
+/*
+ * Add every regular file under a directory, in sorted order so that the
+ * output doesn't depend on the filesystem. Symlinks to directories aren't
+ * followed, so we can't loop.
+ */
+static int add_dir(struct file_list *list, const char *dir)
+{
+	struct dirent **ents;
+	struct stat sb;
+	const char *sep;
+	char *path;
+	int errorcnt = 0;
+	int i, n;
+
+	n = scandir(dir, &ents, NULL, alphasort);
+	if (n < 0) {
+		fprintf(stderr, "Can't read directory %s: %s\n",
+			dir, strerror(errno));
+		return 1;
+	}
+
+	sep = dir[0] && dir[strlen(dir) - 1] == '/' ? "" : "/";
+	for (i = 0; i < n; i++) {
+		const char *name = ents[i]->d_name;
+
+		if (strcmp(name, ".") && strcmp(name, "..") && !errorcnt) {
+			if (asprintf(&path, "%s%s%s", dir, sep, name) < 0) {
+				fprintf(stderr, "Can't allocate the file list\n");
+				errorcnt++;
+			} else {
+				if (lstat(path, &sb)) {
+					fprintf(stderr, "Can't stat %s: %s\n",
+						path, strerror(errno));
+					errorcnt++;
+				} else if (S_ISDIR(sb.st_mode)) {
+					errorcnt += add_dir(list, path);
+				} else if (S_ISREG(sb.st_mode)) {
+					errorcnt += add_file(list, path);
+				}
+				free(path);
+			}
+		}
+		free(ents[i]);
+	}
+	free(ents);
+
+	return errorcnt;
+}
+
+static int expand_file_list(int argc, char *argv[], int recursive,
+			    char ***files, int *num_files)
+{
+	struct file_list list = {0};
+	struct stat sb;
+	int errorcnt = 0;
+	int i;
+
+	for (i = 0; i < argc && !errorcnt; i++) {
+		if (recursive && !stat(argv[i], &sb) && S_ISDIR(sb.st_mode))
+			errorcnt += add_dir(&list, argv[i]);
+		else
+			errorcnt += add_file(&list, argv[i]);
+	}
+
+	*files = list.names;
+	*num_files = list.count;
+	return errorcnt;
+}
+
+/** Looking at the files **/
+
+/* What happened to each file */
+struct show_result {
+	enum futil_file_type type;
+	int errorcnt;
+	uint64_t nsecs;
+};
+
+/* A file being looked at by a child process */
+struct show_job {
+	const char *name;
+	pid_t pid;
+	int result_fd;
+	FILE *out;
+	FILE *err;
+};
+
+static uint64_t now_nsecs(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void show_one(const char *name, struct show_result *res)
+{
+	uint64_t start = now_nsecs();
+
+	res->errorcnt = show_file(name, &res->type);
+	res->nsecs = now_nsecs() - start;
+}
+
+static void free_job(struct show_job *job)
+{
+	if (job->out)
+		fclose(job->out);
+	if (job->err)
+		fclose(job->err);
+	if (job->result_fd >= 0)
+		close(job->result_fd);
+	job->out = job->err = NULL;
+	job->result_fd = -1;
+}
+
+/*
+ * Start looking at a file in a child process. Its output goes to temporary
+ * files, so that it can be copied out in order once it's done. If we can't
+ * start a child, the file will be looked at when the job is finished.
+ */
+static void start_job(struct show_job *job, const char *name)
+{
+	struct show_result res;
+	int fds[2];
+
+	job->name = name;
+	job->pid = -1;
+	job->result_fd = -1;
+	job->out = tmpfile();
+	job->err = tmpfile();
+	if (!job->out || !job->err || pipe(fds)) {
+		free_job(job);
+		return;
+	}
+
+	fflush(stdout);
+	fflush(stderr);
+	job->pid = fork();
+	if (job->pid < 0) {
+		close(fds[0]);
+		close(fds[1]);
+		free_job(job);
+		return;
+	}
+
+	if (!job->pid) {
+		/* Child */
+		close(fds[0]);
+		if (dup2(fileno(job->out), STDOUT_FILENO) < 0 ||
+		    dup2(fileno(job->err), STDERR_FILENO) < 0)
+			_exit(1);
+		show_one(name, &res);
+		fflush(stdout);
+		fflush(stderr);
+		if (write(fds[1], &res, sizeof(res)) != sizeof(res))
+			_exit(1);
+		_exit(0);
+	}
+
+	close(fds[1]);
+	job->result_fd = fds[0];
+}
+
+static void copy_output(FILE *from, FILE *to)
+{
+	char buf[4096];
+	size_t n;
+
+	rewind(from);
+	while ((n = fread(buf, 1, sizeof(buf), from)) > 0)
+		fwrite(buf, 1, n, to);
+}
+
+static void finish_job(struct show_job *job, struct show_result *res)
+{
+	int status;
+
+	if (job->pid < 0) {
+		show_one(job->name, res);
+		return;
+	}
+
+	if (read(job->result_fd, res, sizeof(*res)) != sizeof(*res)) {
+		res->type = FILE_TYPE_UNKNOWN;
+		res->errorcnt = 1;
+		res->nsecs = 0;
+	}
+	if (waitpid(job->pid, &status, 0) < 0 ||
+	    !WIFEXITED(status) || WEXITSTATUS(status)) {
+		fprintf(stderr, "Lost track of %s\n", job->name);
+		res->errorcnt++;
+	}
+
+	copy_output(job->out, stdout);
+	copy_output(job->err, stderr);
+	free_job(job);
+}
+
+static void print_timing(const int *count, const uint64_t *nsecs,
+			 uint64_t wall_nsecs)
+{
+	enum futil_file_type type;
+
+	fprintf(stderr, "%-24s %8s %12s %12s\n",
+		"type", "files", "total ms", "ms/file");
+	for (type = 0; type < NUM_FILE_TYPES; type++)
+		if (count[type])
+			fprintf(stderr, "%-24s %8d %12.3f %12.3f\n",
+				futil_file_type_name(type), count[type],
+				nsecs[type] / 1e6,
+				nsecs[type] / 1e6 / count[type]);
+	fprintf(stderr, "%-24s %8s %12.3f\n", "elapsed", "",
+		wall_nsecs / 1e6);
+}
+
+/*
+ * Look at all the files, up to [jobs] at once. Each file gets its own process
+ * (and so its own work buffer), but the output is always in the same order.
+ */
+static int show_files(char **files, int num_files, int jobs, int timing)
+{
+	int count[NUM_FILE_TYPES] = {0};
+	uint64_t nsecs[NUM_FILE_TYPES] = {0};
+	uint64_t start = now_nsecs();
+	struct show_result res;
+	struct show_job *job = NULL;
+	int errorcnt = 0;
+	int i;
+
+	if (jobs > num_files)
+		jobs = num_files;
+	if (jobs > 1) {
+		job = calloc(jobs, sizeof(*job));
+		if (!job)
+			jobs = 1;
+	}
+
+	for (i = 0; i < num_files + jobs; i++) {
+		if (jobs > 1) {
+			if (i >= jobs)
+				finish_job(&job[i % jobs], &res);
+			if (i < num_files)
+				start_job(&job[i % jobs], files[i]);
+			if (i < jobs)
+				continue;
+		} else if (i < num_files) {
+			show_one(files[i], &res);
+		} else {
+			break;
+		}
+
+		errorcnt += res.errorcnt;
+		count[res.type]++;
+		nsecs[res.type] += res.nsecs;
+	}
+	free(job);
+
+	if (timing)
+		print_timing(count, nsecs, now_nsecs() - start);
+
+	return errorcnt;
+}
+
 static int do_show(int argc, char *argv[])
 {
 	uint8_t *pubkbuf = NULL;
 	struct vb2_public_key pubk2;
-	char *infile = 0;
-	int ifd, i;
+	int i;
 	int errorcnt = 0;
-	uint8_t *buf;
 	uint32_t len;
 	char *e = 0;
-	int type_override = 0;
-	enum futil_file_type type;
-
-	vb2_workbuf_init(&wb, workbuf, sizeof(workbuf));
+	int recursive = 0;
+	int jobs = 1;
+	int timing = 0;
+	char **files = NULL;
+	int num_files = 0;
+	const char *keyset = NULL;
 
 	opterr = 0;		/* quiet, you */
 	while ((i = getopt_long(argc, argv, short_opts, long_opts, 0)) != -1) {
@@ -515,6 +914,26 @@ static int do_show(int argc, char *argv[])
 		case 't':
 			show_option.t_flag = 1;
 			break;
+		case 'r':
+			recursive = 1;
+			break;
+		case 'j':
+			jobs = strtoul(optarg, &e, 0);
+			if (!*optarg || (e && *e) || jobs < 1) {
+				fprintf(stderr,
+					"Invalid --jobs \"%s\"\n", optarg);
+				errorcnt++;
+			}
+			break;
+		case OPT_TIMING:
+			timing = 1;
+			break;
+		case OPT_KEYS_SUMMARY:
+			show_option.keys_summary = 1;
+			break;
+		case OPT_KEYSET:
+			keyset = optarg;
+			break;
 		case OPT_PADDING:
 			show_option.padding = strtoul(optarg, &e, 0);
 			if (!*optarg || (e && *e)) {
@@ -532,7 +951,7 @@ static int do_show(int argc, char *argv[])
 					"Invalid --type \"%s\"\n", optarg);
 				errorcnt++;
 			}
-			type_override = 1;
+			show_option.type_override = 1;
 			break;
 		case OPT_PUBKEY:
 			if (vb21_packed_key_read(&show_option.pkey, optarg)) {
@@ -563,6 +982,11 @@ static int do_show(int argc, char *argv[])
 		}
 	}
 
+	if (keyset && !show_option.keys_summary) {
+		fprintf(stderr, "--keyset only works with --keys-summary\n");
+		errorcnt++;
+	}
+
 	if (errorcnt) {
 		print_help(argc, argv);
 		return 1;
@@ -574,45 +998,25 @@ static int do_show(int argc, char *argv[])
 		return 1;
 	}
 
-	if (show_option.t_flag) {
-		for (i = optind; i < argc; i++)
-			errorcnt += show_type(argv[i]);
+	if (expand_file_list(argc - optind, argv + optind, recursive,
+			     &files, &num_files)) {
+		errorcnt++;
 		goto done;
 	}
 
-	for (i = optind; i < argc; i++) {
-		infile = argv[i];
-		ifd = open(infile, O_RDONLY);
-		if (ifd < 0) {
-			errorcnt++;
-			fprintf(stderr, "Can't open %s: %s\n",
-				infile, strerror(errno));
-			continue;
-		}
-
-		if (0 != futil_map_file(ifd, MAP_RO, &buf, &len)) {
-			errorcnt++;
-			goto boo;
-		}
-
-		/* Allow the user to override the type */
-		if (type_override)
-			type = show_option.type;
-		else
-			type = futil_file_type_buf(buf, len);
-
-		errorcnt += futil_file_type_show(type, infile, buf, len);
-
-		errorcnt += futil_unmap_file(ifd, MAP_RO, buf, len);
-boo:
-		if (close(ifd)) {
-			errorcnt++;
-			fprintf(stderr, "Error when closing %s: %s\n",
-				infile, strerror(errno));
-		}
+	/* Before any jobs start, so that they all know the keys */
+	if (keyset && keys_summary_load_keyset(keyset)) {
+		errorcnt++;
+		goto done;
 	}
 
+	errorcnt += show_files(files, num_files, jobs, timing);
+
 done:
+	keys_summary_free_keyset();
+	for (i = 0; i < num_files; i++)
+		free(files[i]);
+	free(files);
 	if (pubkbuf)
 		free(pubkbuf);
 	if (show_option.fv)
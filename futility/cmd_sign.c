@@ -3,6 +3,7 @@
  * Use of this source code is governed by a BSD-style license that can be
  * found in the LICENSE file.
  */
+#include <ctype.h>
 #include <errno.h>
 #include <fcntl.h>
 #include <getopt.h>
@@ -24,6 +25,7 @@
 #include "futility_options.h"
 #include "gbb_header.h"
 #include "host_common.h"
+#include "host_jobs.h"
 #include "host_key2.h"
 #include "kernel_blob.h"
 #include "util_misc.h"
@@ -72,6 +74,8 @@ int ft_sign_pubkey(const char *name, uint8_t *buf, uint32_t len, void *data)
 	if (sign_option.pem_signpriv) {
 		if (sign_option.pem_external) {
 			/* External signing uses the PEM file directly. */
+			vb2_external_signer_persistent(
+				sign_option.pem_persistent);
 			block = vb2_create_keyblock_external(
 				data_key,
 				sign_option.pem_signpriv,
@@ -107,56 +111,29 @@ int ft_sign_pubkey(const char *name, uint8_t *buf, uint32_t len, void *data)
 int ft_sign_raw_kernel(const char *name, uint8_t *buf, uint32_t len,
 		       void *data)
 {
-	uint8_t *vmlinuz_data, *kblob_data, *vblock_data;
-	uint32_t vmlinuz_size, kblob_size, vblock_size;
-	int rv;
-
-	vmlinuz_data = buf;
-	vmlinuz_size = len;
-
-	kblob_data = CreateKernelBlob(
-		vmlinuz_data, vmlinuz_size,
-		sign_option.arch, sign_option.kloadaddr,
-		sign_option.config_data, sign_option.config_size,
-		sign_option.bootloader_data, sign_option.bootloader_size,
-		&kblob_size);
-	if (!kblob_data) {
-		fprintf(stderr, "Unable to create kernel blob\n");
-		return 1;
-	}
-	Debug("kblob_size = 0x%x\n", kblob_size);
-
-	vblock_data = SignKernelBlob(kblob_data, kblob_size,
-				     sign_option.padding,
-				     sign_option.version,
-				     sign_option.kloadaddr,
-				     sign_option.keyblock,
-				     sign_option.signprivate,
-				     sign_option.flags, &vblock_size);
-	if (!vblock_data) {
-		fprintf(stderr, "Unable to sign kernel blob\n");
-		free(kblob_data);
-		return 1;
-	}
-	Debug("vblock_size = 0x%x\n", vblock_size);
-
 	/* We should be creating a completely new output file.
 	 * If not, something's wrong. */
 	if (!sign_option.create_new_outfile)
 		DIE;
 
-	if (sign_option.vblockonly)
-		rv = WriteSomeParts(sign_option.outfile,
-				    vblock_data, vblock_size,
-				    NULL, 0);
-	else
-		rv = WriteSomeParts(sign_option.outfile,
-				    vblock_data, vblock_size,
-				    kblob_data, kblob_size);
+	if (WriteSignedKernelBlob(sign_option.outfile, sign_option.vblockonly,
+				  buf, len,
+				  sign_option.arch, sign_option.kloadaddr,
+				  sign_option.config_data,
+				  sign_option.config_size,
+				  sign_option.bootloader_data,
+				  sign_option.bootloader_size,
+				  sign_option.padding,
+				  sign_option.version,
+				  sign_option.keyblock,
+				  sign_option.signprivate,
+				  sign_option.flags,
+				  sign_option.body_chunk_size)) {
+		fprintf(stderr, "Unable to sign kernel blob\n");
+		return 1;
+	}
 
-	free(vblock_data);
-	free(kblob_data);
-	return rv;
+	return 0;
 }
 
 int ft_sign_kern_preamble(const char *name, uint8_t *buf, uint32_t len,
@@ -208,6 +185,11 @@ int ft_sign_kern_preamble(const char *name, uint8_t *buf, uint32_t len,
 	if (sign_option.flags_specified == 0)
 		sign_option.flags = kernel_flags;
 
+	/* Likewise keep any body chunk digests */
+	if (!sign_option.body_chunk_size_specified)
+		sign_option.body_chunk_size =
+			vb2_kernel_get_body_chunk_size(preamble);
+
 	/* Replace the keyblock if asked */
 	if (sign_option.keyblock)
 		keyblock = sign_option.keyblock;
@@ -220,6 +202,7 @@ int ft_sign_kern_preamble(const char *name, uint8_t *buf, uint32_t len,
 				     keyblock,
 				     sign_option.signprivate,
 				     sign_option.flags,
+				     sign_option.body_chunk_size,
 				     &vblock_size);
 	if (!vblock_data) {
 		fprintf(stderr, "Unable to sign kernel blob\n");
@@ -306,6 +289,11 @@ static const char usage_pubkey[] = "\n"
 	"  --pem_external   PROGRAM"
 	"         External program to compute the signature\n"
 	"                                     (requires a PEM signing key)\n"
+	"  --pem_persistent"
+	"                 Keep the external program running for\n"
+	"                                     later signatures, passing it\n"
+	"                                     framed requests (see\n"
+	"                                     host_signature.c)\n"
 	"\n";
 static void print_help_pubkey(int argc, char *argv[])
 {
@@ -353,12 +341,16 @@ static const char usage_bios[] = "\n"
 	"\n"
 	"Optional PARAMS:\n"
 	"  -v|--version     NUM             The firmware version number"
-	" (default %d)\n"
+	" (default is\n"
+	"                                     unchanged, or %d if unknown)\n"
 	"  -f|--flags       NUM             The preamble flags value"
 	" (default is\n"
 	"                                     unchanged, or 0 if unknown)\n"
 	"  -d|--loemdir     DIR             Local OEM output vblock directory\n"
 	"  -l|--loemid      STRING          Local OEM vblock suffix\n"
+	"  --reuse_body_hash                Don't rehash FW_MAIN; re-sign the\n"
+	"                                     digest from the old preamble\n"
+	"                                     if it verifies\n"
 	"  [--outfile]      OUTFILE         Output firmware image\n"
 	"\n";
 static void print_help_bios_image(int argc, char *argv[])
@@ -391,10 +383,15 @@ static const char usage_new_kpart[] = "\n"
 	" --vblockonly                      Emit just the vblock (requires a\n"
 	"                                     distinct outfile)\n"
 	"  -f|--flags       NUM             The preamble flags value\n"
+	"  --body_chunk_size NUM            Also sign a digest of each NUM\n"
+	"                                     bytes of the kernel blob, so\n"
+	"                                     it can be verified as it loads\n"
+	"                                     (a multiple of 0x%x)\n"
 	"\n";
 static void print_help_raw_kernel(int argc, char *argv[])
 {
-	printf(usage_new_kpart, sign_option.kloadaddr, sign_option.padding);
+	printf(usage_new_kpart, sign_option.kloadaddr, sign_option.padding,
+	       BODY_CHUNK_ALIGN);
 }
 
 static const char usage_old_kpart[] = "\n"
@@ -417,10 +414,41 @@ static const char usage_old_kpart[] = "\n"
 	"  --vblockonly                     Emit just the vblock (requires a\n"
 	"                                     distinct OUTFILE)\n"
 	"  -f|--flags       NUM             The preamble flags value\n"
+	"  --body_chunk_size NUM            Size of each body chunk digest\n"
+	"                                     (a multiple of 0x%x, or 0 for\n"
+	"                                     none; default is to keep them)\n"
 	"\n";
 static void print_help_kern_preamble(int argc, char *argv[])
 {
-	printf(usage_old_kpart, sign_option.padding);
+	printf(usage_old_kpart, sign_option.padding, BODY_CHUNK_ALIGN);
+}
+
+static const char usage_disk[] = "\n"
+	"To resign all the kernel partitions of a disk image in place:\n"
+	"\n"
+	"Required PARAMS:\n"
+	"  -s|--signprivate FILE.vbprivk"
+	"    The private key to sign the kernel blobs\n"
+	"  [--infile]       INFILE          Input disk image (modified\n"
+	"                                     in place if no OUTFILE given)\n"
+	"\n"
+	"Optional PARAMS:\n"
+	"  -b|--keyblock    FILE.keyblock   Keyblock containing the public\n"
+	"                                     key to verify the kernel blobs\n"
+	"  -v|--version     NUM             The kernel version number\n"
+	"  --config         FILE            The kernel commandline file\n"
+	"  [--outfile]      OUTFILE         Output disk image\n"
+	"  -f|--flags       NUM             The preamble flags value\n"
+	"  --body_chunk_size NUM            Size of each body chunk digest\n"
+	"                                     (0 for none; default is to keep\n"
+	"                                     them)\n"
+	"\n"
+	"Each vblock keeps its size, since the kernel blob behind it can't\n"
+	"move. Partitions without a vblock are skipped.\n"
+	"\n";
+static void print_help_disk_image(int argc, char *argv[])
+{
+	puts(usage_disk);
 }
 
 static void print_help_usbpd1(int argc, char *argv[])
@@ -469,6 +497,14 @@ static void print_help_usbpd1(int argc, char *argv[])
 	       "           Start of the RO section (default 0)\n"
 	       "  --rw_offset      NUM"
 	       "           Start of the RW section (default half)\n"
+	       "\n"
+	       "Several images can be signed in place with the same key:\n"
+	       "\n"
+	       "  --multi                        "
+	       "Sign INFILE and every file after it\n"
+	       "  --jobs           NUM           "
+	       "Sign this many at once (default is one\n"
+	       "                                   per CPU)\n"
 	       "\n");
 }
 
@@ -511,6 +547,11 @@ static void print_help_rwsig(int argc, char *argv[])
 	       "                                    the file does not contain an FMAP.\n"
 	       "                                    (default 1024 bytes)\n"
 	       "  --data_size   NUM               Number of bytes of INFILE to sign\n"
+	       "  --multi                         Sign INFILE and every file after it\n"
+	       "                                    in place, without an OUTFILE or\n"
+	       "                                    EC_RW.bin\n"
+	       "  --jobs        NUM               With --multi, sign this many at once\n"
+	       "                                    (default is one per CPU)\n"
 	       "\n",
 	       argv[0],
 	       futil_file_type_name(FILE_TYPE_RWSIG),
@@ -523,6 +564,7 @@ static void (*help_type[NUM_FILE_TYPES])(int argc, char *argv[]) = {
 	[FILE_TYPE_BIOS_IMAGE] = &print_help_bios_image,
 	[FILE_TYPE_RAW_KERNEL] = &print_help_raw_kernel,
 	[FILE_TYPE_KERN_PREAMBLE] = &print_help_kern_preamble,
+	[FILE_TYPE_CHROMIUMOS_DISK] = &print_help_disk_image,
 	[FILE_TYPE_USBPD1] = &print_help_usbpd1,
 	[FILE_TYPE_RWSIG] = &print_help_rwsig,
 };
@@ -538,16 +580,33 @@ static const char usage_default[] = "\n"
 	"  full firmware image (bios.bin)      same, or signed in-place\n"
 	"  raw linux kernel (vmlinuz)          kernel partition image\n"
 	"  kernel partition (/dev/sda2)        same, or signed in-place\n"
+	"  chromiumos disk image (/dev/sda)    same, or signed in-place\n"
 	"  usbpd1 firmware image               same, or signed in-place\n"
 	"  RW device image                     same, or signed in-place\n"
 	"\n"
+	"Many files can be signed in one pass with\n"
+	"\n"
+	"  " MYNAME " %s --batch FILE|-\n"
+	"\n"
+	"where each line of FILE (or stdin) holds the PARAMS, INFILE and\n"
+	"OUTFILE of one job. Keys used by several jobs are loaded once, and\n"
+	"the result of each job is printed as a line of JSON.\n"
+	"\n"
+	"Wherever a .vbprivk or PEM private key is expected, a key held in a\n"
+	"PKCS#11 token can be given instead as\n"
+	"\n"
+	"  pkcs11:MODULE.so:SLOT:LABEL[:ALGORITHM]\n"
+	"\n"
+	"The module is loaded once and each key keeps its session open, so\n"
+	"signing runs in-process. A user PIN is read from $VBOOT_PKCS11_PIN.\n"
+	"\n"
 	"For more information, use \"" MYNAME " help %s TYPE\", where\n"
 	"TYPE is one of:\n\n";
 static void print_help_default(int argc, char *argv[])
 {
 	enum futil_file_type type;
 
-	printf(usage_default, argv[0], argv[0]);
+	printf(usage_default, argv[0], argv[0], argv[0]);
 	for (type = 0; type < NUM_FILE_TYPES; type++)
 		if (help_type[type])
 			printf("  %s", futil_file_type_name(type));
@@ -588,6 +647,8 @@ enum no_short_opts {
 	OPT_DATA_SIZE,
 	OPT_SIG_SIZE,
 	OPT_PRIKEY,
+	OPT_JOBS,
+	OPT_BODY_CHUNK_SIZE,
 	OPT_HELP,
 };
 
@@ -616,8 +677,10 @@ static const struct option long_opts[] = {
 	{"pem",          1, NULL, OPT_PEM_SIGNPRIV}, /* alias */
 	{"pem_algo",     1, NULL, OPT_PEM_ALGO},
 	{"pem_external", 1, NULL, OPT_PEM_EXTERNAL},
+	{"pem_persistent", 0, &sign_option.pem_persistent, 1},
 	{"type",         1, NULL, OPT_TYPE},
 	{"vblockonly",   0, &sign_option.vblockonly, 1},
+	{"reuse_body_hash", 0, &sign_option.reuse_body_hash, 1},
 	{"hash_alg",     1, NULL, OPT_HASH_ALG},
 	{"ro_size",      1, NULL, OPT_RO_SIZE},
 	{"rw_size",      1, NULL, OPT_RW_SIZE},
@@ -627,6 +690,9 @@ static const struct option long_opts[] = {
 	{"sig_size",     1, NULL, OPT_SIG_SIZE},
 	{"prikey",       1, NULL, OPT_PRIKEY},
 	{"privkey",      1, NULL, OPT_PRIKEY},	/* alias */
+	{"multi",        0, &sign_option.multi, 1},
+	{"jobs",         1, NULL, OPT_JOBS},
+	{"body_chunk_size", 1, NULL, OPT_BODY_CHUNK_SIZE},
 	{"help",         0, NULL, OPT_HELP},
 	{NULL,           0, NULL, 0},
 };
@@ -645,6 +711,147 @@ static int parse_number_opt(const char *arg, const char *name, uint32_t *dest)
 	return 0;
 }
 
+/*
+ * In --batch mode, keys named by more than one job are parsed only once and
+ * stay loaded until the batch is done.
+ */
+enum key_kind {
+	KEY_PRIVATE,
+	KEY_KEYBLOCK,
+	KEY_PACKED,
+};
+
+struct cached_key {
+	struct cached_key *next;
+	enum key_kind kind;
+	char *path;
+	void *key;
+};
+
+static int batch_mode;
+static struct cached_key *key_cache;
+static const char *job_infile;
+
+/* The image futil_sign_mapped() is signing, if it's running do_sign() */
+static uint8_t *mapped_buf;
+static uint32_t mapped_len;
+
+static void *read_key(enum key_kind kind, const char *path)
+{
+	struct cached_key *c;
+	void *key = NULL;
+
+	if (batch_mode)
+		for (c = key_cache; c; c = c->next)
+			if (c->kind == kind && !strcmp(c->path, path))
+				return c->key;
+
+	switch (kind) {
+	case KEY_PRIVATE:
+		key = vb2_read_private_key(path);
+		break;
+	case KEY_KEYBLOCK:
+		key = vb2_read_keyblock(path);
+		break;
+	case KEY_PACKED:
+		key = vb2_read_packed_key(path);
+		break;
+	}
+
+	if (key && batch_mode) {
+		c = malloc(sizeof(*c));
+		if (c) {
+			c->kind = kind;
+			c->path = strdup(path);
+			c->key = key;
+			c->next = key_cache;
+			key_cache = c;
+		}
+	}
+
+	return key;
+}
+
+static void free_key_cache(void)
+{
+	struct cached_key *c;
+
+	while ((c = key_cache)) {
+		key_cache = c->next;
+		if (c->kind == KEY_PRIVATE)
+			vb2_private_key_free(c->key);
+		else
+			free(c->key);
+		free(c->path);
+		free(c);
+	}
+}
+
+static int sign_batch(int argc, char *argv[]);
+
+/* Images shared out among the --multi worker threads */
+struct multi_job {
+	char **files;
+	int errorcnt;
+};
+
+/* Sign one image in place. Returns non-zero on error. */
+static int sign_in_place(const char *file)
+{
+	uint8_t *buf;
+	uint32_t buf_len;
+	int errorcnt = 0;
+	int fd;
+
+	fd = open(file, O_RDWR);
+	if (fd < 0) {
+		fprintf(stderr, "Can't open %s for writing: %s\n",
+			file, strerror(errno));
+		return 1;
+	}
+
+	if (futil_map_file(fd, MAP_RW, &buf, &buf_len)) {
+		close(fd);
+		return 1;
+	}
+
+	errorcnt += futil_file_type_sign(sign_option.type, file,
+					 buf, buf_len);
+	errorcnt += futil_unmap_file(fd, MAP_RW, buf, buf_len);
+
+	if (close(fd)) {
+		fprintf(stderr, "Error when closing %s: %s\n",
+			file, strerror(errno));
+		errorcnt++;
+	}
+
+	return errorcnt;
+}
+
+static void sign_one(void *ctx, int i)
+{
+	struct multi_job *job = ctx;
+
+	/* The key is only read, so all the images can share it */
+	if (sign_in_place(job->files[i])) {
+		fprintf(stderr, "Failed to sign %s\n", job->files[i]);
+		__sync_add_and_fetch(&job->errorcnt, 1);
+	}
+}
+
+/* Sign the images in place, using up to njobs threads. Returns the failure
+ * count. */
+static int sign_multi(char **files, int count, int njobs)
+{
+	struct multi_job job;
+
+	job.files = files;
+	job.errorcnt = 0;
+	vb2_run_jobs(sign_one, &job, count, njobs);
+
+	return job.errorcnt;
+}
+
 static int do_sign(int argc, char *argv[])
 {
 	char *infile = 0;
@@ -657,27 +864,35 @@ static int do_sign(int argc, char *argv[])
 	int mapping;
 	int helpind = 0;
 	int longindex;
+	int njobs = sysconf(_SC_NPROCESSORS_ONLN);
+	char **files;
+	enum futil_file_type type;
+
+	/* --batch takes over the whole command line */
+	if (argc > 1 && !strcmp(argv[1], "--batch"))
+		return sign_batch(argc, argv);
 
 	opterr = 0;		/* quiet, you */
 	while ((i = getopt_long(argc, argv, short_opts, long_opts,
 				&longindex)) != -1) {
 		switch (i) {
 		case 's':
-			sign_option.signprivate = vb2_read_private_key(optarg);
+			sign_option.signprivate = read_key(KEY_PRIVATE, optarg);
 			if (!sign_option.signprivate) {
 				fprintf(stderr, "Error reading %s\n", optarg);
 				errorcnt++;
 			}
 			break;
 		case 'b':
-			sign_option.keyblock = vb2_read_keyblock(optarg);
+			sign_option.keyblock = read_key(KEY_KEYBLOCK, optarg);
 			if (!sign_option.keyblock) {
 				fprintf(stderr, "Error reading %s\n", optarg);
 				errorcnt++;
 			}
 			break;
 		case 'k':
-			sign_option.kernel_subkey = vb2_read_packed_key(optarg);
+			sign_option.kernel_subkey = read_key(KEY_PACKED,
+							     optarg);
 			if (!sign_option.kernel_subkey) {
 				fprintf(stderr, "Error reading %s\n", optarg);
 				errorcnt++;
@@ -685,14 +900,15 @@ static int do_sign(int argc, char *argv[])
 			break;
 		case 'S':
 			sign_option.devsignprivate =
-				vb2_read_private_key(optarg);
+				read_key(KEY_PRIVATE, optarg);
 			if (!sign_option.devsignprivate) {
 				fprintf(stderr, "Error reading %s\n", optarg);
 				errorcnt++;
 			}
 			break;
 		case 'B':
-			sign_option.devkeyblock = vb2_read_keyblock(optarg);
+			sign_option.devkeyblock = read_key(KEY_KEYBLOCK,
+							   optarg);
 			if (!sign_option.devkeyblock) {
 				fprintf(stderr, "Error reading %s\n", optarg);
 				errorcnt++;
@@ -842,6 +1058,26 @@ static int do_sign(int argc, char *argv[])
 				errorcnt++;
 			}
 			break;
+		case OPT_JOBS:
+			njobs = strtol(optarg, &e, 0);
+			if (!*optarg || (e && *e) || njobs < 1) {
+				fprintf(stderr,
+					"Invalid --jobs \"%s\"\n", optarg);
+				errorcnt++;
+			}
+			break;
+		case OPT_BODY_CHUNK_SIZE:
+			sign_option.body_chunk_size_specified = 1;
+			if (parse_number_opt(optarg, "body_chunk_size",
+					     &sign_option.body_chunk_size)) {
+				errorcnt++;
+			} else if (sign_option.body_chunk_size %
+				   BODY_CHUNK_ALIGN) {
+				fprintf(stderr, "--body_chunk_size must be a "
+					"multiple of 0x%x\n", BODY_CHUNK_ALIGN);
+				errorcnt++;
+			}
+			break;
 		case OPT_HELP:
 			helpind = optind - 1;
 			break;
@@ -889,15 +1125,20 @@ static int do_sign(int argc, char *argv[])
 		}
 	}
 
-	/* Look for an output file if we don't have one, just in case. */
-	if (!sign_option.outfile && argc - optind > 0) {
+	/* Look for an output file if we don't have one, just in case. With
+	 * --multi, the rest of the args are more images to sign instead. */
+	if (!sign_option.multi && !sign_option.outfile && argc - optind > 0) {
 		sign_option.inout_file_count++;
 		sign_option.outfile = argv[optind++];
 	}
 
+	job_infile = infile;
+
 	/* What are we looking at? */
-	if (sign_option.type == FILE_TYPE_UNKNOWN &&
-	    futil_file_type(infile, &sign_option.type)) {
+	if (sign_option.type == FILE_TYPE_UNKNOWN && mapped_buf) {
+		sign_option.type = futil_file_type_buf(mapped_buf, mapped_len);
+	} else if (sign_option.type == FILE_TYPE_UNKNOWN &&
+		   futil_file_type(infile, &sign_option.type)) {
 		errorcnt++;
 		goto done;
 	}
@@ -911,6 +1152,16 @@ static int do_sign(int argc, char *argv[])
 			sign_option.type = FILE_TYPE_RAW_FIRMWARE;
 	}
 
+	/* A whole disk can be given where a kernel partition is expected */
+	if (sign_option.type == FILE_TYPE_KERN_PREAMBLE) {
+		if (mapped_buf)
+			type = futil_file_type_buf(mapped_buf, mapped_len);
+		else if (futil_file_type(infile, &type))
+			type = FILE_TYPE_UNKNOWN;
+		if (type == FILE_TYPE_CHROMIUMOS_DISK)
+			sign_option.type = type;
+	}
+
 	Debug("type=%s\n", futil_file_type_name(sign_option.type));
 
 	/* Check the arguments for the type of thing we want to sign */
@@ -936,6 +1187,11 @@ static int do_sign(int argc, char *argv[])
 				" --pem_signpriv\n");
 			errorcnt++;
 		}
+		if (sign_option.pem_persistent && !sign_option.pem_external) {
+			fprintf(stderr, "--pem_persistent must be used with"
+				" --pem_external\n");
+			errorcnt++;
+		}
 		/* We'll wait to read the PEM file, since the external signer
 		 * may want to read it instead. */
 		break;
@@ -950,6 +1206,14 @@ static int do_sign(int argc, char *argv[])
 		if (sign_option.vblockonly || sign_option.inout_file_count > 1)
 			sign_option.create_new_outfile = 1;
 		break;
+	case FILE_TYPE_CHROMIUMOS_DISK:
+		errorcnt += no_opt_if(!sign_option.signprivate, "signprivate");
+		if (sign_option.vblockonly) {
+			fprintf(stderr,
+				"--vblockonly can't be used with a disk image\n");
+			errorcnt++;
+		}
+		break;
 	case FILE_TYPE_RAW_FIRMWARE:
 		sign_option.create_new_outfile = 1;
 		errorcnt += no_opt_if(!sign_option.signprivate, "signprivate");
@@ -974,6 +1238,25 @@ static int do_sign(int argc, char *argv[])
 		errorcnt += no_opt_if(!sign_option.pem_signpriv, "pem");
 		errorcnt += no_opt_if(sign_option.hash_alg == VB2_HASH_INVALID,
 				      "hash_alg");
+		if (sign_option.prikey) {
+			fprintf(stderr, "--prikey can't be used with"
+				" usbpd1 images; use --pem\n");
+			errorcnt++;
+		}
+		/* Read the keypair once, however many images there are */
+		if (!errorcnt) {
+			if (vb2_private_key_read_pem(&sign_option.prikey,
+						     sign_option.pem_signpriv)) {
+				fprintf(stderr,
+					"Unable to read keypair from %s\n",
+					sign_option.pem_signpriv);
+				errorcnt++;
+				break;
+			}
+			sign_option.prikey->hash_alg = sign_option.hash_alg;
+			sign_option.prikey->sig_alg = vb2_rsa_sig_alg(
+				sign_option.prikey->rsa_private_key);
+		}
 		break;
 	case FILE_TYPE_RWSIG:
 		if (sign_option.inout_file_count > 1)
@@ -985,6 +1268,43 @@ static int do_sign(int argc, char *argv[])
 		break;
 	}
 
+	if (sign_option.multi && mapped_buf) {
+		fprintf(stderr, "--multi can't be used on a mapped image\n");
+		errorcnt++;
+		goto done;
+	}
+
+	if (sign_option.multi) {
+		if (sign_option.type != FILE_TYPE_USBPD1 &&
+		    sign_option.type != FILE_TYPE_RWSIG) {
+			fprintf(stderr, "--multi only works with %s and %s"
+				" images\n",
+				futil_file_type_name(FILE_TYPE_USBPD1),
+				futil_file_type_name(FILE_TYPE_RWSIG));
+			errorcnt++;
+		}
+		if (sign_option.outfile) {
+			fprintf(stderr, "--multi signs images in place, so"
+				" there's no OUTFILE\n");
+			errorcnt++;
+		}
+		if (errorcnt)
+			goto done;
+
+		/* INFILE and whatever follows it */
+		files = calloc(argc - optind + 1, sizeof(*files));
+		if (!files) {
+			errorcnt++;
+			goto done;
+		}
+		files[0] = infile;
+		for (i = 0; optind + i < argc; i++)
+			files[i + 1] = argv[optind + i];
+		errorcnt += sign_multi(files, i + 1, njobs);
+		free(files);
+		goto done;
+	}
+
 	Debug("infile=%s\n", infile);
 	Debug("sign_option.inout_file_count=%d\n", sign_option.inout_file_count);
 	Debug("sign_option.create_new_outfile=%d\n",
@@ -1011,6 +1331,21 @@ static int do_sign(int argc, char *argv[])
 	if (errorcnt)
 		goto done;
 
+	if (mapped_buf) {
+		/* The caller has it mapped, so it can only change in place */
+		if (sign_option.create_new_outfile ||
+		    sign_option.inout_file_count > 1) {
+			fprintf(stderr, "ERROR: a mapped %s image can only be"
+				" signed in place\n",
+				futil_file_type_name(sign_option.type));
+			errorcnt++;
+			goto done;
+		}
+		errorcnt += futil_file_type_sign(sign_option.type, infile,
+						 mapped_buf, mapped_len);
+		goto done;
+	}
+
 	if (sign_option.create_new_outfile) {
 		/* The input is read-only, the output is write-only. */
 		mapping = MAP_RO;
@@ -1055,12 +1390,14 @@ done:
 			strerror(errno));
 	}
 
-	if (sign_option.signprivate)
-		free(sign_option.signprivate);
-	if (sign_option.keyblock)
-		free(sign_option.keyblock);
-	if (sign_option.kernel_subkey)
-		free(sign_option.kernel_subkey);
+	/* Batch keys belong to the cache */
+	if (!batch_mode) {
+		vb2_free_private_key(sign_option.signprivate);
+		if (sign_option.keyblock)
+			free(sign_option.keyblock);
+		if (sign_option.kernel_subkey)
+			free(sign_option.kernel_subkey);
+	}
 	if (sign_option.prikey)
 		vb2_private_key_free(sign_option.prikey);
 
@@ -1070,5 +1407,140 @@ done:
 	return !!errorcnt;
 }
 
+#define BATCH_MAX_ARGS 64
+
+static void print_json_string(const char *str)
+{
+	putchar('"');
+	for (; str && *str; str++) {
+		if (*str == '"' || *str == '\\')
+			printf("\\%c", *str);
+		else if ((unsigned char)*str < 0x20)
+			printf("\\u%04x", (unsigned char)*str);
+		else
+			putchar(*str);
+	}
+	putchar('"');
+}
+
+/*
+ * Run each line of a manifest as the arguments to a separate "sign", in one
+ * process so that keys shared between jobs are only loaded once. A JSON
+ * object describing the result of each job is printed as it completes.
+ */
+static int sign_batch(int argc, char *argv[])
+{
+	struct sign_option_s defaults = sign_option;
+	char *args[BATCH_MAX_ARGS + 1];
+	char *line = NULL;
+	size_t line_size = 0;
+	FILE *fp = stdin;
+	int line_num = 0;
+	int jobs = 0;
+	int failed = 0;
+
+	if (argc != 3) {
+		fprintf(stderr, "Usage: " MYNAME " %s --batch FILE|-\n",
+			argv[0]);
+		return 1;
+	}
+
+	if (strcmp(argv[2], "-")) {
+		fp = fopen(argv[2], "r");
+		if (!fp) {
+			fprintf(stderr, "Can't open %s: %s\n",
+				argv[2], strerror(errno));
+			return 1;
+		}
+	}
+
+	batch_mode = 1;
+	while (getline(&line, &line_size, fp) != -1) {
+		int count;
+		int rv;
+
+		line_num++;
+		args[0] = argv[0];
+		count = futil_split_line(line, args + 1, BATCH_MAX_ARGS);
+		if (count == 0)
+			continue;
+
+		jobs++;
+		sign_option = defaults;
+		job_infile = NULL;
+		if (count < 0) {
+			fprintf(stderr, "line %d: malformed job\n", line_num);
+			rv = 1;
+		} else {
+			optind = 0;
+			rv = do_sign(count + 1, args);
+		}
+		if (rv)
+			failed++;
+
+		printf("{\"job\":%d,\"line\":%d,\"input\":", jobs, line_num);
+		print_json_string(job_infile);
+		printf(",\"output\":");
+		print_json_string(sign_option.outfile);
+		printf(",\"type\":");
+		print_json_string(futil_file_type_name(sign_option.type));
+		printf(",\"status\":\"%s\"}\n", rv ? "failed" : "ok");
+		fflush(stdout);
+
+		free(sign_option.bootloader_data);
+		free(sign_option.config_data);
+	}
+	batch_mode = 0;
+
+	if (ferror(fp)) {
+		fprintf(stderr, "Error reading %s: %s\n",
+			argv[2], strerror(errno));
+		failed++;
+	}
+	if (fp != stdin)
+		fclose(fp);
+	free(line);
+	free_key_cache();
+	sign_option = defaults;
+
+	return !!failed;
+}
+
+int futil_sign_mapped(int argc, char *argv[], const char *name,
+		      uint8_t *buf, uint32_t len)
+{
+	struct sign_option_s defaults = sign_option;
+	char **args;
+	int i, rv;
+
+	if (argc > 0 && !strcmp(argv[0], "--batch")) {
+		fprintf(stderr, "--batch can't be used on a mapped image\n");
+		return 1;
+	}
+
+	/* The command name, the options, then the image */
+	args = calloc(argc + 3, sizeof(*args));
+	if (!args)
+		return 1;
+	args[0] = "sign";
+	for (i = 0; i < argc; i++)
+		args[i + 1] = argv[i];
+	args[argc + 1] = (char *)name;
+
+	mapped_buf = buf;
+	mapped_len = len;
+	optind = 0;
+	rv = do_sign(argc + 2, args);
+	mapped_buf = NULL;
+	mapped_len = 0;
+
+	free(sign_option.bootloader_data);
+	free(sign_option.config_data);
+	sign_option = defaults;
+	free(args);
+
+	return rv;
+}
+
 DECLARE_FUTIL_COMMAND(sign, do_sign, VBOOT_VERSION_ALL,
 		      "Sign / resign various binary components");
@@ -0,0 +1,480 @@
+/*
+ * Copyright 2018 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ */
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "file_type.h"
+#include "fmap.h"
+#include "futility.h"
+#include "futility_options.h"
+
+#define DEFAULT_BLOCK_SIZE 4096
+#define MAX_REGIONS 32
+
+static const char usage[] = "\n"
+	"Usage:  " MYNAME " %s [OPTIONS] NEW_IMAGE TARGET\n"
+	"\n"
+	"Write a new firmware image over TARGET, which is the current image\n"
+	"or a block device holding it, changing only the erase blocks which\n"
+	"differ. The new image is verified first, as \"" MYNAME " verify\"\n"
+	"would, and the blocks written are read back afterwards.\n"
+	"\n"
+	"Options:\n"
+	"  -i|--region AREA     Only update this FMAP area (may be repeated).\n"
+	"                         AREA must be at the same place in both\n"
+	"                         images. The default is the whole image.\n"
+	"  -b|--block-size NUM  Erase block size (default %d)\n"
+	"  -n|--dry-run         Just report what would be written\n"
+	"  --no-verify          Don't verify NEW_IMAGE before writing\n"
+	"  -v|--verbose         List each range of blocks written\n"
+	"\n";
+
+static void print_help(int argc, char *argv[])
+{
+	printf(usage, argv[0], DEFAULT_BLOCK_SIZE);
+}
+
+enum {
+	OPT_HELP = 1000,
+	OPT_NO_VERIFY,
+};
+static const struct option long_opts[] = {
+	/* name    hasarg *flag  val */
+	{"region",      1, NULL, 'i'},
+	{"block-size",  1, NULL, 'b'},
+	{"dry-run",     0, NULL, 'n'},
+	{"no-verify",   0, NULL, OPT_NO_VERIFY},
+	{"verbose",     0, NULL, 'v'},
+	{"help",        0, NULL, OPT_HELP},
+	{NULL,          0, NULL, 0},
+};
+static char *short_opts = ":i:b:nv";
+
+/* A byte range of the image to update */
+struct region {
+	const char *name;
+	uint32_t offset;
+	uint32_t size;
+};
+
+/*
+ * Check a new image's signatures the way "verify" does. The verification
+ * works on a private mapping of its own, since it may change the buffer it
+ * checks.
+ */
+static int verify_image(const char *name, int fd)
+{
+	uint8_t *buf;
+	uint32_t len;
+	int retval;
+
+	if (futil_map_file(fd, MAP_RO, &buf, &len))
+		return 1;
+
+	if (futil_file_type_buf(buf, len) != FILE_TYPE_BIOS_IMAGE) {
+		fprintf(stderr, "%s is not a firmware image\n", name);
+		retval = 1;
+	} else {
+		show_option.strict = 1;
+		retval = futil_file_type_show(FILE_TYPE_BIOS_IMAGE, name,
+					      buf, len);
+		if (retval)
+			fprintf(stderr, "%s doesn't verify\n", name);
+	}
+
+	futil_unmap_file(fd, MAP_RO, buf, len);
+	return !!retval;
+}
+
+/* Read exactly len bytes at offset, or complain and return non-zero. */
+static int read_at(const char *name, int fd, uint8_t *buf, uint32_t len,
+		   uint32_t offset)
+{
+	ssize_t r;
+
+	while (len) {
+		r = pread(fd, buf, len, offset);
+		if (r <= 0) {
+			fprintf(stderr, "Can't read %s: %s\n", name,
+				r ? strerror(errno) : "unexpected end");
+			return 1;
+		}
+		buf += r;
+		len -= r;
+		offset += r;
+	}
+	return 0;
+}
+
+/* Write exactly len bytes at offset, or complain and return non-zero. */
+static int write_at(const char *name, int fd, const uint8_t *buf,
+		    uint32_t len, uint32_t offset)
+{
+	ssize_t r;
+
+	while (len) {
+		r = pwrite(fd, buf, len, offset);
+		if (r <= 0) {
+			fprintf(stderr, "Can't write %s: %s\n", name,
+				r ? strerror(errno) : "no progress");
+			return 1;
+		}
+		buf += r;
+		len -= r;
+		offset += r;
+	}
+	return 0;
+}
+
+/*
+ * Look up each requested area in both images. They have to be in the same
+ * place, or blocks can't be compared one for one.
+ */
+static int find_regions(struct region *regions, int num_regions,
+			uint8_t *new_buf, uint8_t *cur_buf, uint32_t len)
+{
+	FmapHeader *new_fmap = fmap_find(new_buf, len);
+	FmapHeader *cur_fmap = fmap_find(cur_buf, len);
+	FmapAreaHeader *new_ah, *cur_ah;
+	int errorcnt = 0;
+	int i;
+
+	if (!cur_fmap) {
+		fprintf(stderr, "Can't find an FMAP in the target\n");
+		return 1;
+	}
+
+	for (i = 0; i < num_regions; i++) {
+		new_ah = cur_ah = NULL;
+		fmap_find_by_name(new_buf, len, new_fmap, regions[i].name,
+				  &new_ah);
+		fmap_find_by_name(cur_buf, len, cur_fmap, regions[i].name,
+				  &cur_ah);
+		if (!new_ah || !cur_ah) {
+			fprintf(stderr, "No area %s in %s image\n",
+				regions[i].name, new_ah ? "the target" :
+				"the new");
+			errorcnt++;
+			continue;
+		}
+		if (new_ah->area_offset != cur_ah->area_offset ||
+		    new_ah->area_size != cur_ah->area_size) {
+			fprintf(stderr, "Area %s has moved; update the whole"
+				" image instead\n", regions[i].name);
+			errorcnt++;
+			continue;
+		}
+		if (new_ah->area_offset > len ||
+		    new_ah->area_size > len - new_ah->area_offset) {
+			fprintf(stderr, "Area %s is off the end of the"
+				" image\n", regions[i].name);
+			errorcnt++;
+			continue;
+		}
+		regions[i].offset = new_ah->area_offset;
+		regions[i].size = new_ah->area_size;
+	}
+
+	return errorcnt;
+}
+
+/*
+ * Fill in what block [offset, offset + size) of the target should hold:
+ * the new image inside the requested regions, and the current contents
+ * everywhere else.
+ */
+static void merge_block(uint8_t *want, const uint8_t *new_buf,
+			const uint8_t *cur_buf, uint32_t offset,
+			uint32_t size, const struct region *regions,
+			int num_regions)
+{
+	uint32_t start, end;
+	int i;
+
+	if (!num_regions) {
+		memcpy(want, new_buf + offset, size);
+		return;
+	}
+
+	memcpy(want, cur_buf + offset, size);
+	for (i = 0; i < num_regions; i++) {
+		start = regions[i].offset;
+		end = start + regions[i].size;
+		if (start < offset)
+			start = offset;
+		if (end > offset + size)
+			end = offset + size;
+		if (start < end)
+			memcpy(want + start - offset, new_buf + start,
+			       end - start);
+	}
+}
+
+/* Print the FMAP areas that a range of blocks touches */
+static void print_areas(FmapHeader *fmap, uint32_t offset, uint32_t size)
+{
+	FmapAreaHeader *ah = (FmapAreaHeader *)(fmap + 1);
+	int i;
+
+	for (i = 0; i < fmap->fmap_nareas; i++, ah++) {
+		if (ah->area_offset < offset + size &&
+		    offset < ah->area_offset + ah->area_size)
+			printf(" %.*s", FMAP_NAMELEN, ah->area_name);
+	}
+}
+
+static int do_update(int argc, char *argv[])
+{
+	struct region regions[MAX_REGIONS];
+	int num_regions = 0;
+	uint32_t block_size = DEFAULT_BLOCK_SIZE;
+	int dry_run = 0, no_verify = 0, verbose = 0;
+	const char *new_name, *target;
+	int new_fd = -1, fd = -1;
+	uint8_t *new_buf = NULL, *cur_buf = NULL, *want = NULL;
+	uint8_t *dirty = NULL;
+	uint32_t new_len = 0, len;
+	uint32_t offset, size, run_start = 0, run_len = 0;
+	uint32_t b, blocks, changed = 0, changed_bytes = 0;
+	FmapHeader *fmap;
+	struct stat sb;
+	off_t end;
+	char *e;
+	int errorcnt = 0;
+	int i;
+
+	opterr = 0;		/* quiet, you */
+	while ((i = getopt_long(argc, argv, short_opts, long_opts, 0)) != -1) {
+		switch (i) {
+		case 'i':
+			if (num_regions >= MAX_REGIONS) {
+				fprintf(stderr, "Too many regions\n");
+				errorcnt++;
+				break;
+			}
+			regions[num_regions++].name = optarg;
+			break;
+		case 'b':
+			block_size = strtoul(optarg, &e, 0);
+			if (!*optarg || (e && *e) || !block_size) {
+				fprintf(stderr, "Invalid --block-size \"%s\"\n",
+					optarg);
+				errorcnt++;
+			}
+			break;
+		case 'n':
+			dry_run = 1;
+			break;
+		case OPT_NO_VERIFY:
+			no_verify = 1;
+			break;
+		case 'v':
+			verbose = 1;
+			break;
+		case OPT_HELP:
+			print_help(argc, argv);
+			return !!errorcnt;
+		case '?':
+			if (optopt)
+				fprintf(stderr, "Unrecognized option: -%c\n",
+					optopt);
+			else
+				fprintf(stderr, "Unrecognized option\n");
+			errorcnt++;
+			break;
+		case ':':
+			fprintf(stderr, "Missing argument to -%c\n", optopt);
+			errorcnt++;
+			break;
+		default:
+			DIE;
+		}
+	}
+
+	if (errorcnt) {
+		print_help(argc, argv);
+		return 1;
+	}
+
+	if (argc - optind != 2) {
+		fprintf(stderr, "You must specify a new image and a target\n");
+		print_help(argc, argv);
+		return 1;
+	}
+	new_name = argv[optind];
+	target = argv[optind + 1];
+
+	new_fd = open(new_name, O_RDONLY);
+	if (new_fd < 0) {
+		fprintf(stderr, "Can't open %s: %s\n",
+			new_name, strerror(errno));
+		return 1;
+	}
+
+	/* Nothing is written unless the new image checks out */
+	if (!no_verify && verify_image(new_name, new_fd)) {
+		errorcnt++;
+		goto done;
+	}
+
+	if (futil_map_file(new_fd, MAP_RO, &new_buf, &new_len)) {
+		new_buf = NULL;
+		errorcnt++;
+		goto done;
+	}
+
+	fmap = fmap_find(new_buf, new_len);
+	if (!fmap) {
+		fprintf(stderr, "Can't find an FMAP in %s\n", new_name);
+		errorcnt++;
+		goto done;
+	}
+
+	fd = open(target, dry_run ? O_RDONLY : O_RDWR);
+	if (fd < 0 || fstat(fd, &sb)) {
+		fprintf(stderr, "Can't open %s: %s\n",
+			target, strerror(errno));
+		errorcnt++;
+		goto done;
+	}
+	if (!S_ISREG(sb.st_mode) && !S_ISBLK(sb.st_mode)) {
+		fprintf(stderr, "%s must be a file or a block device\n",
+			target);
+		errorcnt++;
+		goto done;
+	}
+
+	end = lseek(fd, 0, SEEK_END);
+	if (end != new_len) {
+		fprintf(stderr, "%s is %lld bytes, but %s is %" PRIu32 "\n",
+			target, (long long)end, new_name, new_len);
+		errorcnt++;
+		goto done;
+	}
+	len = new_len;
+
+	blocks = len / block_size + !!(len % block_size);
+	cur_buf = malloc(len);
+	want = malloc(block_size);
+	dirty = calloc(blocks, 1);
+	if (!cur_buf || !want || !dirty) {
+		fprintf(stderr, "Couldn't allocate memory\n");
+		errorcnt++;
+		goto done;
+	}
+	if (read_at(target, fd, cur_buf, len, 0)) {
+		errorcnt++;
+		goto done;
+	}
+
+	if (num_regions &&
+	    find_regions(regions, num_regions, new_buf, cur_buf, len)) {
+		errorcnt++;
+		goto done;
+	}
+
+	/*
+	 * Compare one erase block at a time, and write each run of changed
+	 * blocks when it ends; the extra pass at the end writes the last one.
+	 * cur_buf becomes what the target should hold.
+	 */
+	for (b = 0; b <= blocks; b++) {
+		offset = b * block_size;
+		size = 0;
+		if (b < blocks)
+			size = len - offset < block_size ?
+				len - offset : block_size;
+		if (size) {
+			merge_block(want, new_buf, cur_buf, offset, size,
+				    regions, num_regions);
+			if (memcmp(want, cur_buf + offset, size)) {
+				memcpy(cur_buf + offset, want, size);
+				if (!run_len)
+					run_start = offset;
+				run_len += size;
+				dirty[b] = 1;
+				changed++;
+				changed_bytes += size;
+				continue;
+			}
+		}
+
+		if (!run_len)
+			continue;
+
+		if (verbose) {
+			printf("0x%08x - 0x%08x:", run_start,
+			       run_start + run_len - 1);
+			print_areas(fmap, run_start, run_len);
+			printf("\n");
+		}
+		if (!dry_run &&
+		    write_at(target, fd, cur_buf + run_start, run_len,
+			     run_start)) {
+			errorcnt++;
+			goto done;
+		}
+		run_len = 0;
+	}
+
+	printf("%s %" PRIu32 " of %" PRIu32 " blocks (%" PRIu32 " bytes)\n",
+	       dry_run ? "Would write" : "Wrote", changed, blocks,
+	       changed_bytes);
+
+	if (dry_run || !changed)
+		goto done;
+
+	/* Read back what was written */
+	if (fsync(fd)) {
+		fprintf(stderr, "Can't sync %s: %s\n",
+			target, strerror(errno));
+		errorcnt++;
+		goto done;
+	}
+	for (b = 0; b < blocks; b++) {
+		if (!dirty[b])
+			continue;
+		offset = b * block_size;
+		size = len - offset < block_size ? len - offset : block_size;
+		if (read_at(target, fd, want, size, offset)) {
+			errorcnt++;
+			break;
+		}
+		if (memcmp(want, cur_buf + offset, size)) {
+			fprintf(stderr, "%s doesn't match at 0x%08x after"
+				" writing\n", target, offset);
+			errorcnt++;
+			break;
+		}
+	}
+
+done:
+	free(dirty);
+	free(want);
+	free(cur_buf);
+	if (new_buf)
+		futil_unmap_file(new_fd, MAP_RO, new_buf, new_len);
+	close(new_fd);
+	if (fd >= 0 && close(fd)) {
+		fprintf(stderr, "Error closing %s: %s\n",
+			target, strerror(errno));
+		errorcnt++;
+	}
+
+	return !!errorcnt;
+}
+
+DECLARE_FUTIL_COMMAND(update, do_update, VBOOT_VERSION_ALL,
+		      "Write only the changed blocks of a new firmware image");
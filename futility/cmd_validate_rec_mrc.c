@@ -15,6 +15,7 @@
 #include <unistd.h>
 
 #include "futility.h"
+#include "host_misc.h"
 
 enum {
 	OPT_HELP = 1000,
@@ -49,36 +50,58 @@ struct mrc_metadata {
 #define REGF_METADATA_BLOCK_SIZE	REGF_BLOCK_GRANULARITY
 #define REGF_UNALLOCATED_BLOCK		0xffff
 
+/*
+ * Compute an IP style checksum: the ones' complement of the ones' complement
+ * sum of the little-endian 16-bit words in the buffer.
+ *
+ * Ones' complement addition is associative, so the buffer is summed 32 bits
+ * at a time into a 64-bit accumulator and the carries are folded back in once
+ * at the end.  Each 32-bit word holds two 16-bit words, which fold to the same
+ * result as adding them separately.
+ */
 unsigned long compute_ip_checksum(const void *addr, unsigned long length)
 {
-	const uint8_t *ptr;
-	volatile union {
-		uint8_t  byte[2];
-		uint16_t word;
-	} value;
-	unsigned long sum;
-	unsigned long i;
-	/* In the most straight forward way possible,
-	 * compute an ip style checksum.
-	 */
-	sum = 0;
-	ptr = addr;
-	for(i = 0; i < length; i++) {
-		unsigned long v;
-		v = ptr[i];
-		if (i & 1) {
-			v <<= 8;
-		}
-		/* Add the new value */
-		sum += v;
-		/* Wrap around the carry */
-		if (sum > 0xFFFF) {
-			sum = (sum + (sum >> 16)) & 0xFFFF;
-		}
+	const uint8_t *ptr = addr;
+	uint64_t sum = 0;
+	uint8_t bytes[2];
+	uint16_t word;
+
+	while (length >= 4) {
+		/*
+		 * Fold before the accumulator could overflow.  Each word adds
+		 * less than 2^32, so this only matters past 16 GB.
+		 */
+		unsigned long chunk = length / 4;
+		if (chunk > UINT32_MAX)
+			chunk = UINT32_MAX;
+		length -= chunk * 4;
+
+		for (; chunk; chunk--, ptr += 4)
+			sum += (uint32_t)ptr[0] | (uint32_t)ptr[1] << 8 |
+				(uint32_t)ptr[2] << 16 |
+				(uint32_t)ptr[3] << 24;
+
+		sum = (sum & 0xFFFFFFFF) + (sum >> 32);
+	}
+
+	/* The tail starts on an even offset, so its first byte is a low byte */
+	if (length >= 2) {
+		sum += ptr[0] | ptr[1] << 8;
+		ptr += 2;
+		length -= 2;
 	}
-	value.byte[0] = sum & 0xff;
-	value.byte[1] = (sum >> 8) & 0xff;
-	return (~value.word) & 0xFFFF;
+	if (length)
+		sum += ptr[0];
+
+	/* Wrap around the carries */
+	while (sum > 0xFFFF)
+		sum = (sum & 0xFFFF) + (sum >> 16);
+
+	/* The sum is little-endian in memory, like the data it covers */
+	bytes[0] = sum & 0xff;
+	bytes[1] = (sum >> 8) & 0xff;
+	memcpy(&word, bytes, sizeof(word));
+	return (~word) & 0xFFFF;
 }
 
 static int verify_mrc_slot(struct mrc_metadata *md, unsigned long slot_len)
@@ -175,6 +198,7 @@ static int do_validate_rec_mrc(int argc, char *argv[])
 	int fd, i, ret = 1;
 	uint32_t file_size;
 	uint8_t *buff;
+	struct vb2_file_view *view;
 	uint32_t offset = 0;
 	uint32_t data_offset;
 	uint32_t data_size;
@@ -223,16 +247,18 @@ static int do_validate_rec_mrc(int argc, char *argv[])
 		return 1;
 	}
 
-	if (futil_map_file(fd, MAP_RO, &buff, &file_size) != FILE_ERR_NONE) {
+	if (vb2_file_view_open_fd(fd, 0, &view) != VB2_SUCCESS) {
 		fprintf(stderr, "Cannot map file %s\n", infile);
 		close(fd);
 		return 1;
 	}
+	buff = view->data;
+	file_size = view->size;
 
 	if (offset > file_size) {
 		fprintf(stderr, "File size(0x%x) smaller than offset(0x%x)\n",
 			file_size, offset);
-		futil_unmap_file(fd, MAP_RO, buff, file_size);
+		vb2_file_view_put(view);
 		close(fd);
 		return 1;
 	}
@@ -240,7 +266,7 @@ static int do_validate_rec_mrc(int argc, char *argv[])
 	if (get_mrc_data_slot((uint16_t *)(buff + offset), &data_offset,
 			      &data_size)) {
 		fprintf(stderr, "Metadata block error\n");
-		futil_unmap_file(fd, MAP_RO, buff, file_size);
+		vb2_file_view_put(view);
 		close(fd);
 		return 1;
 	}
@@ -254,10 +280,7 @@ static int do_validate_rec_mrc(int argc, char *argv[])
 			"offset=0x%x, file size=0x%x, data_size=0x%x\n",
 			offset, file_size, data_size);
 
-	if (futil_unmap_file(fd, MAP_RO, buff, file_size) != FILE_ERR_NONE) {
-		fprintf(stderr, "Failed to unmap file %s\n", infile);
-		ret = 1;
-	}
+	vb2_file_view_put(view);
 
 	close(fd);
 	return ret;
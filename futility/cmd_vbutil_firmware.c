@@ -171,8 +171,7 @@ static int do_vblock(const char *outfile, const char *keyblock_file,
 vblock_cleanup:
 	if (keyblock)
 		free(keyblock);
-	if (signing_key)
-		free(signing_key);
+	vb2_free_private_key(signing_key);
 	if (kernel_subkey)
 		free(kernel_subkey);
 	if (fv_data)
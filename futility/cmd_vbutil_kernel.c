@@ -443,39 +443,19 @@ static int do_vbutil_kernel(int argc, char *argv[])
 		if (!vmlinuz_size)
 			Fatal("Empty vmlinuz file\n");
 
-		kblob_data = CreateKernelBlob(
-			vmlinuz_buf, vmlinuz_size,
-			arch, kernel_body_load_address,
-			t_config_data, t_config_size,
-			t_bootloader_data, t_bootloader_size,
-			&kblob_size);
-		if (!kblob_data)
-			Fatal("Unable to create kernel blob\n");
-
-		Debug("kblob_size = 0x%x\n", kblob_size);
-
-		vblock_data = SignKernelBlob(kblob_data, kblob_size, opt_pad,
-					     version, kernel_body_load_address,
-					     t_keyblock, signpriv_key, flags,
-					     &vblock_size);
-		if (!vblock_data)
+		rv = WriteSignedKernelBlob(filename, opt_vblockonly,
+					   vmlinuz_buf, vmlinuz_size,
+					   arch, kernel_body_load_address,
+					   t_config_data, t_config_size,
+					   t_bootloader_data, t_bootloader_size,
+					   opt_pad, version, t_keyblock,
+					   signpriv_key, flags, 0);
+		if (rv)
 			Fatal("Unable to sign kernel blob\n");
 
-		Debug("vblock_size = 0x%x\n", vblock_size);
-
-		if (opt_vblockonly)
-			rv = WriteSomeParts(filename,
-					    vblock_data, vblock_size,
-					    NULL, 0);
-		else
-			rv = WriteSomeParts(filename,
-					    vblock_data, vblock_size,
-					    kblob_data, kblob_size);
-
 		free(vmlinuz_buf);
 		free(t_config_data);
 		free(t_bootloader_data);
-		free(vblock_data);
 		vb2_free_private_key(signpriv_key);
 		return rv;
 
@@ -536,11 +516,14 @@ static int do_vbutil_kernel(int argc, char *argv[])
 				Fatal("Error reading key block.\n");
 		}
 
-		/* Reuse previous body size */
+		/* Reuse previous body size, and any body chunk digests */
 		vblock_data = SignKernelBlob(kblob_data, kblob_size, opt_pad,
 					     version, kernel_body_load_address,
 					     t_keyblock ? t_keyblock : keyblock,
-					     signpriv_key, flags, &vblock_size);
+					     signpriv_key, flags,
+					     vb2_kernel_get_body_chunk_size(
+						     preamble),
+					     &vblock_size);
 		if (!vblock_data)
 			Fatal("Unable to sign kernel blob\n");
 
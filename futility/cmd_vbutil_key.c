@@ -96,10 +96,10 @@ static int do_pack(const char *infile, const char *outfile, uint32_t algorithm,
 	if (privkey) {
 		if (VB2_SUCCESS != vb2_write_private_key(outfile, privkey)) {
 			fprintf(stderr, "vbutil_key: Error writing key.\n");
-			free(privkey);
+			vb2_free_private_key(privkey);
 			return 1;
 		}
-		free(privkey);
+		vb2_free_private_key(privkey);
 		return 0;
 	}
 
@@ -147,10 +147,10 @@ static int do_unpack(const char *infile, const char *outfile)
 		if (outfile &&
 		    VB2_SUCCESS != vb2_write_private_key(outfile, privkey)) {
 			fprintf(stderr,"vbutil_key: Error writing key copy\n");
-			free(privkey);
+			vb2_free_private_key(privkey);
 			return 1;
 		}
-		free(privkey);
+		vb2_free_private_key(privkey);
 		return 0;
 	}
 
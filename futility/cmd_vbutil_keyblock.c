@@ -148,8 +148,7 @@ static int Pack(const char *outfile, const char *datapubkey,
 	}
 
 	free(data_key);
-	if (signing_key)
-		free(signing_key);
+	vb2_free_private_key(signing_key);
 
 	if (VB2_SUCCESS != vb2_write_keyblock(outfile, block)) {
 		fprintf(stderr, "vbutil_keyblock: Error writing key block.\n");
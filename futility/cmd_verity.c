@@ -0,0 +1,716 @@
+/*
+ * Copyright 2018 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ */
+
+/*
+ * Build the dm-verity hash tree for a rootfs, in the format the Chrome OS
+ * kernel's dm-bht code expects:
+ *
+ * Each 4K block of the payload is hashed (followed by the salt, if there is
+ * one), and the digests are packed into 4K blocks of the level above it,
+ * padded with zeros. That repeats until a level is a single block, whose
+ * digest is the root_hexdigest. The levels are stored root first.
+ */
+
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "2sysincludes.h"
+#include "2common.h"
+#include "2sha.h"
+#include "futility.h"
+#include "futility_options.h"
+#include "host_jobs.h"
+
+#define VERITY_BLOCK_SIZE 4096
+#define VERITY_SECTORS_PER_BLOCK (VERITY_BLOCK_SIZE / 512)
+#define VERITY_SALT_SIZE 32
+#define VERITY_MAX_DEPTH 8
+
+/* Largest kernel command line we'll update */
+#define MAX_CONFIG_SIZE 4096
+
+struct verity_level {
+	/* Blocks of digests at this level */
+	uint64_t count;
+	uint8_t *blocks;
+};
+
+struct verity_tree {
+	enum vb2_hash_algorithm alg;
+	int digest_size;
+	/* Digests per block, rounded down to a power of two */
+	int node_shift;
+	uint8_t salt[VERITY_SALT_SIZE];
+	int have_salt;
+
+	const uint8_t *payload;
+	uint64_t payload_blocks;
+
+	/* Level 0 is the root block, level depth - 1 holds the leaves */
+	int depth;
+	struct verity_level levels[VERITY_MAX_DEPTH];
+	uint8_t *buf;
+	uint64_t buf_size;
+	uint8_t root[VB2_MAX_DIGEST_SIZE];
+};
+
+static int hash_block(const struct verity_tree *tree, const uint8_t *block,
+		      uint8_t *digest)
+{
+	struct vb2_digest_context dc;
+
+	if (VB2_SUCCESS != vb2_digest_init(&dc, tree->alg) ||
+	    VB2_SUCCESS != vb2_digest_extend(&dc, block, VERITY_BLOCK_SIZE) ||
+	    (tree->have_salt &&
+	     VB2_SUCCESS != vb2_digest_extend(&dc, tree->salt,
+					      sizeof(tree->salt))) ||
+	    VB2_SUCCESS != vb2_digest_finalize(&dc, digest,
+					       tree->digest_size))
+		return 1;
+	return 0;
+}
+
+/*
+ * Hash the blocks of one level into the level above it. Digest block i of
+ * [parent] covers blocks (i << node_shift) onwards of [child].
+ */
+static int hash_blocks(const struct verity_tree *tree,
+		       const uint8_t *child, uint64_t child_count,
+		       uint8_t *parent, uint64_t first, uint64_t end)
+{
+	uint64_t i, j, k, n;
+
+	for (i = first; i < end; i++) {
+		j = i << tree->node_shift;
+		n = child_count - j;
+		if (n > (1 << tree->node_shift))
+			n = 1 << tree->node_shift;
+		for (k = 0; k < n; k++)
+			if (hash_block(tree,
+				       child + (j + k) * VERITY_BLOCK_SIZE,
+				       parent + i * VERITY_BLOCK_SIZE +
+				       k * tree->digest_size))
+				return 1;
+	}
+	return 0;
+}
+
+/* The leaves are nearly all of the work, so they're shared out in chunks */
+struct leaf_job {
+	struct verity_tree *tree;
+	int retval;
+};
+
+/* Leaf blocks handed to a thread at a time */
+#define LEAF_CHUNK 16
+
+static void hash_leaf_chunk(void *ctx, int chunk)
+{
+	struct leaf_job *job = ctx;
+	struct verity_tree *tree = job->tree;
+	struct verity_level *leaves = &tree->levels[tree->depth - 1];
+	uint64_t first = (uint64_t)chunk * LEAF_CHUNK;
+	uint64_t end = first + LEAF_CHUNK;
+	int rv;
+
+	if (end > leaves->count)
+		end = leaves->count;
+	rv = hash_blocks(tree, tree->payload, tree->payload_blocks,
+			 leaves->blocks, first, end);
+	if (rv)
+		__sync_bool_compare_and_swap(&job->retval, 0, rv);
+}
+
+static int hash_leaves(struct verity_tree *tree, int njobs)
+{
+	struct verity_level *leaves = &tree->levels[tree->depth - 1];
+	struct leaf_job job;
+
+	job.tree = tree;
+	job.retval = 0;
+	vb2_run_jobs(hash_leaf_chunk, &job,
+		     (leaves->count + LEAF_CHUNK - 1) / LEAF_CHUNK, njobs);
+
+	return job.retval;
+}
+
+/* Work out the shape of the tree and allocate it */
+static int init_tree(struct verity_tree *tree)
+{
+	uint64_t count, offset;
+	int bits, d;
+
+	tree->digest_size = vb2_digest_size(tree->alg);
+	if (!tree->digest_size) {
+		fprintf(stderr, "Unsupported hash algorithm\n");
+		return 1;
+	}
+	for (tree->node_shift = 0;
+	     (2 << tree->node_shift) * tree->digest_size <= VERITY_BLOCK_SIZE;
+	     tree->node_shift++)
+		;
+
+	/* Enough levels for the leaves to reduce to a single root block */
+	for (bits = 0; bits < 64 && (tree->payload_blocks - 1) >> bits;
+	     bits++)
+		;
+	tree->depth = (bits + tree->node_shift - 1) / tree->node_shift;
+	if (!tree->depth)
+		tree->depth = 1;
+	if (tree->depth > VERITY_MAX_DEPTH) {
+		fprintf(stderr, "The payload is too big\n");
+		return 1;
+	}
+
+	count = tree->payload_blocks;
+	for (d = tree->depth - 1; d >= 0; d--) {
+		count = (count + (1 << tree->node_shift) - 1) >>
+			tree->node_shift;
+		tree->levels[d].count = count;
+	}
+
+	tree->buf_size = 0;
+	for (d = 0; d < tree->depth; d++)
+		tree->buf_size += tree->levels[d].count * VERITY_BLOCK_SIZE;
+	tree->buf = calloc(1, tree->buf_size);
+	if (!tree->buf) {
+		fprintf(stderr, "Couldn't allocate %" PRIu64
+			" bytes for the hash tree\n", tree->buf_size);
+		return 1;
+	}
+
+	for (d = 0, offset = 0; d < tree->depth; d++) {
+		tree->levels[d].blocks = tree->buf + offset;
+		offset += tree->levels[d].count * VERITY_BLOCK_SIZE;
+	}
+
+	return 0;
+}
+
+static int build_tree(struct verity_tree *tree, int njobs)
+{
+	struct verity_level *child;
+	int d;
+
+	if (hash_leaves(tree, njobs)) {
+		fprintf(stderr, "Error hashing the payload\n");
+		return 1;
+	}
+
+	for (d = tree->depth - 2; d >= 0; d--) {
+		child = &tree->levels[d + 1];
+		if (hash_blocks(tree, child->blocks, child->count,
+				tree->levels[d].blocks, 0,
+				tree->levels[d].count)) {
+			fprintf(stderr, "Error hashing the tree\n");
+			return 1;
+		}
+	}
+
+	if (hash_block(tree, tree->levels[0].blocks, tree->root)) {
+		fprintf(stderr, "Error hashing the root\n");
+		return 1;
+	}
+
+	return 0;
+}
+
+/* The verity table spells hash names in lower case */
+static void print_alg_name(enum vb2_hash_algorithm alg)
+{
+	const char *s;
+
+	for (s = vb2_get_hash_algorithm_name(alg); *s; s++)
+		putchar(tolower(*s));
+}
+
+static void hexify(char *out, const uint8_t *buf, int len)
+{
+	int i;
+
+	for (i = 0; i < len; i++)
+		sprintf(out + 2 * i, "%02x", buf[i]);
+	out[2 * len] = '\0';
+}
+
+/* Like the kernel, a short salt is padded with zeros and a long one cut. */
+static int parse_salt(struct verity_tree *tree, const char *hex)
+{
+	int i, len = strlen(hex);
+	unsigned int v;
+
+	if (len % 2)
+		return 1;
+	for (i = 0; i < len; i++)
+		if (!isxdigit(hex[i]))
+			return 1;
+
+	memset(tree->salt, 0, sizeof(tree->salt));
+	for (i = 0; i < len / 2 && i < VERITY_SALT_SIZE; i++) {
+		sscanf(hex + 2 * i, "%2x", &v);
+		tree->salt[i] = v;
+	}
+	tree->have_salt = 1;
+	return 0;
+}
+
+/*
+ * Find the value of "key=" in the dm="..." verity args of a kernel command
+ * line. Returns a pointer to the value and its length in *len, or NULL.
+ */
+static char *find_verity_arg(char *config, const char *key, size_t *len)
+{
+	size_t key_len = strlen(key);
+	char *s = strstr(config, "dm=\"");
+
+	if (!s)
+		return NULL;
+
+	for (s += 4; *s && *s != '"'; s++) {
+		if ((s[-1] == ' ' || s[-1] == ',') &&
+		    !strncmp(s, key, key_len) && s[key_len] == '=') {
+			s += key_len + 1;
+			*len = strcspn(s, " \",\n");
+			return s;
+		}
+	}
+	return NULL;
+}
+
+/* Replace the value of a verity arg, or add it after root_hexdigest. */
+static char *set_verity_arg(char *config, const char *key, const char *val)
+{
+	size_t len, newlen;
+	char *s, *out;
+
+	s = find_verity_arg(config, key, &len);
+	if (!s) {
+		s = find_verity_arg(config, "root_hexdigest", &len);
+		if (!s)
+			return NULL;
+		s += len;
+		len = 0;
+		newlen = strlen(config) + strlen(key) + strlen(val) + 3;
+		out = malloc(newlen);
+		if (!out)
+			return NULL;
+		snprintf(out, newlen, "%.*s %s=%s%s", (int)(s - config),
+			 config, key, val, s);
+		return out;
+	}
+
+	newlen = strlen(config) - len + strlen(val) + 1;
+	out = malloc(newlen);
+	if (!out)
+		return NULL;
+	snprintf(out, newlen, "%.*s%s%s", (int)(s - config), config, val,
+		 s + len);
+	return out;
+}
+
+static char *read_config(const char *filename)
+{
+	FILE *fp;
+	char *buf;
+	size_t len;
+
+	fp = fopen(filename, "rb");
+	if (!fp) {
+		fprintf(stderr, "Can't open %s: %s\n", filename,
+			strerror(errno));
+		return NULL;
+	}
+	buf = malloc(MAX_CONFIG_SIZE + 1);
+	if (!buf) {
+		fclose(fp);
+		return NULL;
+	}
+	len = fread(buf, 1, MAX_CONFIG_SIZE + 1, fp);
+	fclose(fp);
+	if (len > MAX_CONFIG_SIZE) {
+		fprintf(stderr, "%s is too big for a kernel command line\n",
+			filename);
+		free(buf);
+		return NULL;
+	}
+	buf[len] = '\0';
+	return buf;
+}
+
+static int write_config(const char *filename, const char *config)
+{
+	FILE *fp;
+	int rv = 0;
+
+	fp = fopen(filename, "wb");
+	if (!fp) {
+		fprintf(stderr, "Can't open %s for writing: %s\n", filename,
+			strerror(errno));
+		return 1;
+	}
+	if (1 != fwrite(config, strlen(config), 1, fp)) {
+		fprintf(stderr, "Can't write %s: %s\n", filename,
+			strerror(errno));
+		rv = 1;
+	}
+	if (fclose(fp)) {
+		fprintf(stderr, "Can't close %s: %s\n", filename,
+			strerror(errno));
+		rv = 1;
+	}
+	return rv;
+}
+
+/* Fill in whatever the command line didn't give from the config's args */
+static int parse_config(struct verity_tree *tree, char *config,
+			int alg_specified)
+{
+	enum vb2_hash_algorithm alg;
+	char val[VERITY_SALT_SIZE * 4 + 1];
+	const char *key[] = {"alg", "hashstart", "salt"};
+	uint64_t sectors;
+	size_t len;
+	char *s, *e;
+	int i;
+
+	if (!find_verity_arg(config, "root_hexdigest", &len)) {
+		fprintf(stderr, "No verity root_hexdigest in the config\n");
+		return 1;
+	}
+
+	for (i = 0; i < ARRAY_SIZE(key); i++) {
+		s = find_verity_arg(config, key[i], &len);
+		if (!s)
+			continue;
+		if (len >= sizeof(val)) {
+			fprintf(stderr, "Verity %s is too long\n", key[i]);
+			return 1;
+		}
+		memcpy(val, s, len);
+		val[len] = '\0';
+
+		if (!strcmp(key[i], "alg") && !alg_specified) {
+			if (!vb2_lookup_hash_alg(val, &alg)) {
+				fprintf(stderr, "Unknown verity alg %s\n",
+					val);
+				return 1;
+			}
+			tree->alg = alg;
+		} else if (!strcmp(key[i], "hashstart") &&
+			   !tree->payload_blocks) {
+			sectors = strtoull(val, &e, 0);
+			if (!*val || *e || !sectors ||
+			    sectors % VERITY_SECTORS_PER_BLOCK) {
+				fprintf(stderr, "Bad verity hashstart %s\n",
+					val);
+				return 1;
+			}
+			tree->payload_blocks =
+				sectors / VERITY_SECTORS_PER_BLOCK;
+		} else if (!strcmp(key[i], "salt") && !tree->have_salt) {
+			if (parse_salt(tree, val)) {
+				fprintf(stderr, "Bad verity salt %s\n", val);
+				return 1;
+			}
+		}
+	}
+
+	return 0;
+}
+
+/* Put the new root digest (and salt) in the config */
+static char *update_config(const struct verity_tree *tree, char *config)
+{
+	char hex[VB2_MAX_DIGEST_SIZE * 2 + 1];
+	char *tmp, *out;
+
+	hexify(hex, tree->root, tree->digest_size);
+	out = set_verity_arg(config, "root_hexdigest", hex);
+	if (out && tree->have_salt) {
+		hexify(hex, tree->salt, sizeof(tree->salt));
+		tmp = out;
+		out = set_verity_arg(tmp, "salt", hex);
+		free(tmp);
+	}
+
+	if (!out)
+		fprintf(stderr, "Unable to update the config\n");
+	return out;
+}
+
+/* Write all of buf, or complain */
+static int write_all(int fd, const uint8_t *buf, uint64_t size,
+		     off_t offset, const char *filename)
+{
+	ssize_t n;
+
+	while (size) {
+		n = pwrite(fd, buf, size, offset);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0) {
+			fprintf(stderr, "Can't write %s: %s\n", filename,
+				strerror(errno));
+			return 1;
+		}
+		buf += n;
+		size -= n;
+		offset += n;
+	}
+	return 0;
+}
+
+static const char usage[] = "\n"
+	"Usage:  " MYNAME " %s [OPTIONS] ROOTFS [HASHTREE]\n"
+	"\n"
+	"Build the dm-verity hash tree for ROOTFS and print the verity table\n"
+	"for it. The tree is written to HASHTREE, or if that isn't given, into\n"
+	"ROOTFS right after the blocks that are hashed.\n"
+	"\n"
+	"Options:\n"
+	"  --blocks NUM        Number of 4096-byte blocks to hash (default is\n"
+	"                        hashstart from --config, or all of ROOTFS)\n"
+	"  --alg ALG           Hash algorithm: sha1, sha256 or sha512 (default\n"
+	"                        is alg from --config, or sha256)\n"
+	"  --salt HEX          Salt for the hashes (default is salt from\n"
+	"                        --config, or none)\n"
+	"  --config FILE       Kernel command line with dm=\"... verity ...\".\n"
+	"                        Its root_hexdigest and salt are updated in\n"
+	"                        place, ready for \"" MYNAME " sign --config\"\n"
+	"  --jobs NUM          Hash with this many threads (default is one per\n"
+	"                        CPU)\n"
+	"\n";
+
+static void print_help(int argc, char *argv[])
+{
+	printf(usage, argv[0]);
+}
+
+enum {
+	OPT_HELP = 1000,
+	OPT_BLOCKS,
+	OPT_ALG,
+	OPT_SALT,
+	OPT_CONFIG,
+	OPT_JOBS,
+};
+static const struct option long_opts[] = {
+	{"help",     0, 0, OPT_HELP},
+	{"blocks",   1, 0, OPT_BLOCKS},
+	{"alg",      1, 0, OPT_ALG},
+	{"salt",     1, 0, OPT_SALT},
+	{"config",   1, 0, OPT_CONFIG},
+	{"jobs",     1, 0, OPT_JOBS},
+	{NULL, 0, 0, 0}
+};
+static int do_verity(int argc, char *argv[])
+{
+	struct verity_tree tree;
+	char hex[VB2_MAX_DIGEST_SIZE * 2 + 1];
+	char *config_file = NULL, *config = NULL, *new_config = NULL;
+	char *infile, *outfile;
+	uint8_t *payload = MAP_FAILED;
+	uint64_t payload_size = 0;
+	off_t size;
+	int alg_specified = 0;
+	int njobs = sysconf(_SC_NPROCESSORS_ONLN);
+	int ifd = -1, ofd = -1;
+	int errorcnt = 0;
+	char *e;
+	int i;
+
+	memset(&tree, 0, sizeof(tree));
+	tree.alg = VB2_HASH_SHA256;
+
+	opterr = 0;		/* quiet, you */
+	while ((i = getopt_long(argc, argv, ":", long_opts, NULL)) != -1) {
+		switch (i) {
+		case OPT_BLOCKS:
+			tree.payload_blocks = strtoull(optarg, &e, 0);
+			if (!*optarg || (e && *e) || !tree.payload_blocks) {
+				fprintf(stderr,
+					"Invalid --blocks \"%s\"\n", optarg);
+				errorcnt++;
+			}
+			break;
+		case OPT_ALG:
+			if (!vb2_lookup_hash_alg(optarg, &tree.alg)) {
+				fprintf(stderr,
+					"Invalid --alg \"%s\"\n", optarg);
+				errorcnt++;
+			}
+			alg_specified = 1;
+			break;
+		case OPT_SALT:
+			if (parse_salt(&tree, optarg)) {
+				fprintf(stderr,
+					"Invalid --salt \"%s\"\n", optarg);
+				errorcnt++;
+			}
+			break;
+		case OPT_CONFIG:
+			config_file = optarg;
+			break;
+		case OPT_JOBS:
+			njobs = strtol(optarg, &e, 0);
+			if (!*optarg || (e && *e) || njobs < 1) {
+				fprintf(stderr,
+					"Invalid --jobs \"%s\"\n", optarg);
+				errorcnt++;
+			}
+			break;
+		case OPT_HELP:
+			print_help(argc, argv);
+			return !!errorcnt;
+		case '?':
+			if (optopt)
+				fprintf(stderr, "Unrecognized option: -%c\n",
+					optopt);
+			else
+				fprintf(stderr, "Unrecognized option: %s\n",
+					argv[optind - 1]);
+			errorcnt++;
+			break;
+		case ':':
+			fprintf(stderr, "Missing argument to %s\n",
+				argv[optind - 1]);
+			errorcnt++;
+			break;
+		default:
+			DIE;
+		}
+	}
+
+	if (argc - optind < 1 || argc - optind > 2) {
+		fprintf(stderr, "Need ROOTFS and optionally HASHTREE\n");
+		errorcnt++;
+	}
+	if (errorcnt) {
+		print_help(argc, argv);
+		return 1;
+	}
+	infile = argv[optind];
+	outfile = argc - optind > 1 ? argv[optind + 1] : NULL;
+	if (njobs < 1)
+		njobs = 1;
+
+	if (config_file) {
+		config = read_config(config_file);
+		if (!config || parse_config(&tree, config, alg_specified)) {
+			errorcnt++;
+			goto done;
+		}
+	}
+
+	/* Without HASHTREE, the tree goes after the payload in ROOTFS */
+	ifd = open(infile, outfile ? O_RDONLY : O_RDWR);
+	if (ifd < 0) {
+		fprintf(stderr, "Can't open %s: %s\n", infile,
+			strerror(errno));
+		errorcnt++;
+		goto done;
+	}
+	size = lseek(ifd, 0, SEEK_END);
+	if (size < 0) {
+		fprintf(stderr, "Can't find the size of %s: %s\n", infile,
+			strerror(errno));
+		errorcnt++;
+		goto done;
+	}
+	if (!tree.payload_blocks)
+		tree.payload_blocks = size / VERITY_BLOCK_SIZE;
+	payload_size = tree.payload_blocks * VERITY_BLOCK_SIZE;
+	if (!tree.payload_blocks || payload_size > size) {
+		fprintf(stderr, "%s doesn't have %" PRIu64 " blocks to hash\n",
+			infile, tree.payload_blocks);
+		errorcnt++;
+		goto done;
+	}
+
+	payload = mmap(NULL, payload_size, PROT_READ, MAP_SHARED, ifd, 0);
+	if (payload == MAP_FAILED) {
+		fprintf(stderr, "Can't mmap %s: %s\n", infile,
+			strerror(errno));
+		errorcnt++;
+		goto done;
+	}
+	/* Each block is read once, in order (mostly) */
+	madvise(payload, payload_size, MADV_SEQUENTIAL);
+	tree.payload = payload;
+
+	if (init_tree(&tree) || build_tree(&tree, njobs)) {
+		errorcnt++;
+		goto done;
+	}
+
+	if (outfile) {
+		ofd = open(outfile, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+		if (ofd < 0) {
+			fprintf(stderr, "Can't open %s for writing: %s\n",
+				outfile, strerror(errno));
+			errorcnt++;
+			goto done;
+		}
+		errorcnt += write_all(ofd, tree.buf, tree.buf_size, 0,
+				      outfile);
+	} else {
+		errorcnt += write_all(ifd, tree.buf, tree.buf_size,
+				      payload_size, infile);
+	}
+	if (errorcnt)
+		goto done;
+
+	if (config) {
+		new_config = update_config(&tree, config);
+		if (!new_config || write_config(config_file, new_config)) {
+			errorcnt++;
+			goto done;
+		}
+	}
+
+	/* The same table the verity tool prints */
+	hexify(hex, tree.root, tree.digest_size);
+	printf("0 %" PRIu64 " verity payload=ROOT_DEV hashtree=HASH_DEV "
+	       "hashstart=%" PRIu64 " alg=",
+	       tree.payload_blocks * VERITY_SECTORS_PER_BLOCK,
+	       tree.payload_blocks * VERITY_SECTORS_PER_BLOCK);
+	print_alg_name(tree.alg);
+	printf(" root_hexdigest=%s", hex);
+	if (tree.have_salt) {
+		hexify(hex, tree.salt, sizeof(tree.salt));
+		printf(" salt=%s", hex);
+	}
+	printf("\n");
+
+done:
+	if (payload != MAP_FAILED)
+		munmap(payload, payload_size);
+	if (ofd >= 0 && close(ofd)) {
+		fprintf(stderr, "Error when closing %s: %s\n", outfile,
+			strerror(errno));
+		errorcnt++;
+	}
+	if (ifd >= 0)
+		close(ifd);
+	free(tree.buf);
+	free(config);
+	free(new_config);
+	return !!errorcnt;
+}
+
+DECLARE_FUTIL_COMMAND(verity, do_verity, VBOOT_VERSION_ALL,
+		      "Build the dm-verity hash tree for a rootfs");
@@ -5,6 +5,7 @@
  * Exports the kernel commandline from a given partition/image.
  */
 
+#include <errno.h>
 #include <fcntl.h>
 #include <stdio.h>
 #include <string.h>
@@ -27,6 +28,14 @@
 #endif
 
 typedef ssize_t (*ReadFullyFn)(void *ctx, void *buf, size_t count);
+typedef int (*SkipFn)(void *ctx, ReadFullyFn read_fn, size_t count);
+
+/* Position within a seekable file or block device */
+struct SeekContext {
+	int fd;
+	off_t pos;
+	off_t size;
+};
 
 static ssize_t ReadFullyWithRead(void *ctx, void *buf, size_t count)
 {
@@ -45,6 +54,27 @@ static ssize_t ReadFullyWithRead(void *ctx, void *buf, size_t count)
 	return nr_read;
 }
 
+static ssize_t ReadFullyWithPread(void *ctx, void *buf, size_t count)
+{
+	struct SeekContext *seek_ctx = (struct SeekContext *)ctx;
+	ssize_t nr_read = 0;
+	while (nr_read < count) {
+		ssize_t chunk = pread(seek_ctx->fd, buf + nr_read,
+				      count - nr_read,
+				      seek_ctx->pos + nr_read);
+		if (chunk < 0) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		} else if (chunk == 0) {
+			break;
+		}
+		nr_read += chunk;
+	}
+	seek_ctx->pos += nr_read;
+	return nr_read;
+}
+
 #ifdef USE_MTD
 static ssize_t ReadFullyWithMtdRead(void *ctx, void *buf, size_t count)
 {
@@ -71,7 +101,18 @@ static int SkipWithRead(void *ctx, ReadFullyFn read_fn, size_t count)
 	return 0;
 }
 
+/* Skip the stream by moving the read position. Return 0 on success. */
+static int SkipWithSeek(void *ctx, ReadFullyFn read_fn, size_t count)
+{
+	struct SeekContext *seek_ctx = (struct SeekContext *)ctx;
+	if ((uint64_t)(seek_ctx->size - seek_ctx->pos) < count)
+		return -1;
+	seek_ctx->pos += count;
+	return 0;
+}
+
 static char *FindKernelConfigFromStream(void *ctx, ReadFullyFn read_fn,
+					SkipFn skip_fn,
 					uint64_t kernel_body_load_address)
 {
 	struct vb2_keyblock keyblock;
@@ -85,7 +126,7 @@ static char *FindKernelConfigFromStream(void *ctx, ReadFullyFn read_fn,
 		return NULL;
 	}
 	ssize_t to_skip = keyblock.keyblock_size - sizeof(keyblock);
-	if (to_skip < 0 || SkipWithRead(ctx, read_fn, to_skip)) {
+	if (to_skip < 0 || skip_fn(ctx, read_fn, to_skip)) {
 		VbExError("keyblock_size advances past the end of the blob\n");
 		return NULL;
 	}
@@ -97,7 +138,7 @@ static char *FindKernelConfigFromStream(void *ctx, ReadFullyFn read_fn,
 		return NULL;
 	}
 	to_skip = preamble.preamble_size - sizeof(preamble);
-	if (to_skip < 0 || SkipWithRead(ctx, read_fn, to_skip)) {
+	if (to_skip < 0 || skip_fn(ctx, read_fn, to_skip)) {
 		VbExError("preamble_size advances past the end of the blob\n");
 		return NULL;
 	}
@@ -115,7 +156,7 @@ static char *FindKernelConfigFromStream(void *ctx, ReadFullyFn read_fn,
 	    (kernel_body_load_address + CROS_PARAMS_SIZE +
 	     CROS_CONFIG_SIZE) + now;
 	to_skip = offset - now;
-	if (to_skip < 0 || SkipWithRead(ctx, read_fn, to_skip)) {
+	if (to_skip < 0 || skip_fn(ctx, read_fn, to_skip)) {
 		VbExError("params are outside of the memory blob: %x\n",
 			  offset);
 		return NULL;
@@ -145,26 +186,45 @@ char *FindKernelConfig(const char *infile, uint64_t kernel_body_load_address)
 
 	void *ctx = &fd;
 	ReadFullyFn read_fn = ReadFullyWithRead;
+	SkipFn skip_fn = SkipWithRead;
 
-#ifdef USE_MTD
 	struct stat stat_buf;
 	if (fstat(fd, &stat_buf)) {
 		VbExError("Cannot stat %s\n", infile);
+		close(fd);
 		return NULL;
 	}
 
+	/*
+	 * Regular files and block devices can be read at any offset, so skip
+	 * straight to the config instead of reading the whole kernel body.
+	 * Pipes and character devices (including MTD) must be read in order.
+	 */
+	struct SeekContext seek_ctx = { .fd = fd, .pos = 0 };
+	if (S_ISREG(stat_buf.st_mode) || S_ISBLK(stat_buf.st_mode)) {
+		seek_ctx.size = lseek(fd, 0, SEEK_END);
+		if (seek_ctx.size >= 0) {
+			ctx = &seek_ctx;
+			read_fn = ReadFullyWithPread;
+			skip_fn = SkipWithSeek;
+		}
+	}
+
+#ifdef USE_MTD
 	int is_mtd = (major(stat_buf.st_rdev) == MTD_CHAR_MAJOR);
 	if (is_mtd) {
 		ctx = mtd_read_descriptor(fd, infile);
 		if (!ctx) {
 			VbExError("Cannot read from MTD device %s\n", infile);
+			close(fd);
 			return NULL;
 		}
 		read_fn = ReadFullyWithMtdRead;
+		skip_fn = SkipWithRead;
 	}
 #endif
 
-	newstr = FindKernelConfigFromStream(ctx, read_fn,
+	newstr = FindKernelConfigFromStream(ctx, read_fn, skip_fn,
 					    kernel_body_load_address);
 
 #ifdef USE_MTD
@@ -176,3 +236,18 @@ char *FindKernelConfig(const char *infile, uint64_t kernel_body_load_address)
 
 	return newstr;
 }
+
+int FindKernelConfigs(const char *const *infiles, int count,
+		      uint64_t kernel_body_load_address, char **configs)
+{
+	int failures = 0;
+	int i;
+
+	for (i = 0; i < count; i++) {
+		configs[i] = FindKernelConfig(infiles[i],
+					      kernel_body_load_address);
+		if (!configs[i])
+			failures++;
+	}
+	return failures;
+}
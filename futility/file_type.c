@@ -6,10 +6,12 @@
 
 #include <errno.h>
 #include <fcntl.h>
+#include <linux/fs.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/ioctl.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
@@ -17,6 +19,7 @@
 #include "file_type.h"
 #include "futility.h"
 #include "gbb_header.h"
+#include "host_misc.h"
 
 /* Description and functions to handle each file type */
 struct futil_file_type_s {
@@ -25,7 +28,8 @@ struct futil_file_type_s {
 	/* Human-readable description */
 	const char *desc;
 	/* Functions to identify, display, and sign this type of file. */
-	enum futil_file_type (*recognize)(uint8_t *buf, uint32_t len);
+	enum futil_file_type (*recognize)(uint8_t *buf, uint32_t len,
+					  const struct futil_file_index *index);
 	int (*show)(const char *name, uint8_t *buf, uint32_t len, void *data);
 	int (*sign)(const char *name, uint8_t *buf, uint32_t len, void *data);
 };
@@ -84,27 +88,60 @@ void print_file_types_and_exit(int retval)
 /* Try to figure out what we're looking at */
 enum futil_file_type futil_file_type_buf(uint8_t *buf, uint32_t len)
 {
+	struct futil_file_index index;
 	enum futil_file_type type;
 	int i;
 
+	/* Only look through the whole buffer once */
+	index.fmap = fmap_find(buf, len);
+
 	for (i = 0; i < NUM_FILE_TYPES; i++) {
-		if (futil_file_types[i].recognize) {
-			type = futil_file_types[i].recognize(buf, len);
-			if (type != FILE_TYPE_UNKNOWN)
-				return type;
-		}
+		if (!futil_file_types[i].recognize)
+			continue;
+		/* Related types share a recognizer, which only needs one try */
+		if (i && futil_file_types[i].recognize ==
+		    futil_file_types[i - 1].recognize)
+			continue;
+		type = futil_file_types[i].recognize(buf, len, &index);
+		if (type != FILE_TYPE_UNKNOWN)
+			return type;
 	}
 
 	return FILE_TYPE_UNKNOWN;
 }
 
+int futil_disk_stream_fd(int fd, uint64_t *size)
+{
+	uint8_t buf[2 * 512];
+	struct stat sb;
+
+	if (fstat(fd, &sb))
+		return 0;
+
+	if (S_ISBLK(sb.st_mode)) {
+		if (ioctl(fd, BLKGETSIZE64, size))
+			return 0;
+	} else if (S_ISREG(sb.st_mode) &&
+		   sb.st_size >= FUTIL_DISK_STREAM_SIZE) {
+		*size = sb.st_size;
+	} else {
+		return 0;
+	}
+
+	/* The GPT header is in the second sector */
+	if (pread(fd, buf, sizeof(buf), 0) != sizeof(buf))
+		return 0;
+	return ft_recognize_gpt(buf, sizeof(buf), NULL) ==
+		FILE_TYPE_CHROMIUMOS_DISK;
+}
+
 enum futil_file_err futil_file_type(const char *filename,
 				    enum futil_file_type *type)
 {
 	int ifd;
-	uint8_t *buf;
-	uint32_t buf_len;
+	struct vb2_file_view *view;
 	struct stat sb;
+	uint64_t size;
 	enum futil_file_err err = FILE_ERR_NONE;
 
 	*type = FILE_TYPE_UNKNOWN;
@@ -123,20 +160,18 @@ enum futil_file_err futil_file_type(const char *filename,
 		return FILE_ERR_STAT;
 	}
 
-	if (S_ISREG(sb.st_mode) || S_ISBLK(sb.st_mode)) {
-		err = futil_map_file(ifd, MAP_RO, &buf, &buf_len);
-		if (err) {
+	if (futil_disk_stream_fd(ifd, &size)) {
+		*type = FILE_TYPE_CHROMIUMOS_DISK;
+	} else if (S_ISREG(sb.st_mode) || S_ISBLK(sb.st_mode)) {
+		if (vb2_file_view_open_fd(ifd, 0, &view)) {
+			fprintf(stderr, "Can't read input file\n");
 			close(ifd);
-			return err;
+			return FILE_ERR_MMAP;
 		}
 
-		*type = futil_file_type_buf(buf, buf_len);
+		*type = futil_file_type_buf(view->data, view->size);
 
-		err = futil_unmap_file(ifd, MAP_RO, buf, buf_len);
-		if (err) {
-			close(ifd);
-			return err;
-		}
+		vb2_file_view_put(view);
 	} else if (S_ISDIR(sb.st_mode)) {
 		err = FILE_ERR_DIR;
 	} else if (S_ISCHR(sb.st_mode)) {
@@ -6,6 +6,8 @@
 #ifndef VBOOT_REFERENCE_FUTILITY_FILE_TYPE_H_
 #define VBOOT_REFERENCE_FUTILITY_FILE_TYPE_H_
 
+#include "fmap.h"
+
 /* What type of things do I know how to handle? */
 enum futil_file_type {
 	FILE_TYPE_UNKNOWN,
@@ -27,6 +29,15 @@ void print_file_types_and_exit(int retval);
 /* Lookup a type by name. Return true on success */
 int futil_str_to_file_type(const char *str, enum futil_file_type *type);
 
+/*
+ * What a single scan of a buffer found, so that each file type's recognizer
+ * doesn't have to search the buffer again.
+ */
+struct futil_file_index {
+	/* The FMAP header, if there is one */
+	FmapHeader *fmap;
+};
+
 /*
  * This tries to match the buffer content to one of the known file types.
  */
@@ -39,6 +50,25 @@ enum futil_file_type futil_file_type_buf(uint8_t *buf, uint32_t len);
 enum futil_file_err futil_file_type(const char *filename,
 				    enum futil_file_type *type);
 
+/*
+ * Block devices, and disk images at least this big, are looked at through
+ * reads of the parts that matter rather than being mapped whole.
+ */
+#define FUTIL_DISK_STREAM_SIZE (256 * 1024 * 1024)
+
+/*
+ * Returns non-zero if [fd] holds a Chrome OS disk that should be read as
+ * needed rather than mapped, and sets *size to its size. Only the first
+ * sectors are read to find out.
+ */
+int futil_disk_stream_fd(int fd, uint64_t *size);
+
+/*
+ * Show and verify the kernel partitions of a disk which isn't mapped. Only
+ * the GPT and the kernel partitions are read. Returns zero on success.
+ */
+int ft_show_disk_fd(const char *name, int fd, uint64_t size);
+
 /*
  * Call the show() method on a buffer containing a specific file type.
  * Returns zero on success. It's up to the caller to ensure that only valid
@@ -59,7 +89,8 @@ int futil_file_type_sign(enum futil_file_type type,
 
 /* Declare the file_type functions. */
 #define R_(FOO) \
-	enum futil_file_type FOO(uint8_t *buf, uint32_t len);
+	enum futil_file_type FOO(uint8_t *buf, uint32_t len, \
+				 const struct futil_file_index *index);
 #define S_(FOO) \
 	int FOO(const char *name, uint8_t *buf, uint32_t len, void *data);
 #define NONE
@@ -5,10 +5,13 @@
  */
 #include <errno.h>
 #include <limits.h>
+#include <pthread.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
+#include "2rsa.h"
 #include "bmpblk_header.h"
 #include "fmap.h"
 #include "file_type.h"
@@ -194,7 +197,7 @@ BUILD_ASSERT(ARRAY_SIZE(fmap_show_fn) == NUM_BIOS_COMPONENTS);
 
 int ft_show_bios(const char *name, uint8_t *buf, uint32_t len, void *data)
 {
-	FmapHeader *fmap;
+	struct fmap_index fi;
 	FmapAreaHeader *ah = 0;
 	char ah_name[FMAP_NAMELEN + 1];
 	enum bios_component c;
@@ -206,11 +209,11 @@ int ft_show_bios(const char *name, uint8_t *buf, uint32_t len, void *data)
 	printf("BIOS:                    %s\n", name);
 
 	/* We've already checked, so we know this will work. */
-	fmap = fmap_find(buf, len);
+	fmap_index_init(&fi, buf, len, NULL);
 	for (c = 0; c < NUM_BIOS_COMPONENTS; c++) {
 		/* We know one of these will work, too */
-		if (fmap_find_by_name(buf, len, fmap, fmap_name[c], &ah) ||
-		    fmap_find_by_name(buf, len, fmap, fmap_oldname[c], &ah)) {
+		if (fmap_index_find(&fi, fmap_name[c], &ah) ||
+		    fmap_index_find(&fi, fmap_oldname[c], &ah)) {
 			/* But the file might be truncated */
 			fmap_limit_area(ah, len);
 			/* The name is not necessarily null-terminated */
@@ -255,6 +258,49 @@ static int fmap_sign_fw_main(const char *name, uint8_t *buf, uint32_t len,
 	return 0;
 }
 
+/*
+ * Remember the body digest from an existing preamble, so it can be re-signed
+ * without hashing the body again. The preamble must verify with the data key
+ * from the keyblock it follows, or we'll hash the body as usual.
+ */
+static void save_body_digest(const char *name, uint8_t *buf, uint32_t len,
+			     struct bios_area_s *fw_body_area,
+			     struct vb2_workbuf *wb)
+{
+	struct vb2_keyblock *keyblock = (struct vb2_keyblock *)buf;
+	uint32_t more = keyblock->keyblock_size;
+	struct vb2_public_key data_key;
+	struct vb2_fw_preamble *preamble;
+	uint8_t *copy;
+
+	/* Verifying a signature destroys it, so work on a copy */
+	copy = malloc(len);
+	if (!copy)
+		return;
+	memcpy(copy, buf, len);
+	keyblock = (struct vb2_keyblock *)copy;
+	preamble = (struct vb2_fw_preamble *)(copy + more);
+
+	if (VB2_SUCCESS != vb2_unpack_key(&data_key, &keyblock->data_key) ||
+	    VB2_SUCCESS != vb2_verify_fw_preamble(preamble, len - more,
+						  &data_key, wb) ||
+	    preamble->body_signature.sig_size !=
+	    vb2_rsa_sig_size(data_key.sig_alg) ||
+	    VB2_SUCCESS != vb2_rsa_recover_digest(&data_key,
+				vb2_signature_data(&preamble->body_signature),
+				fw_body_area->digest,
+				sizeof(fw_body_area->digest), wb)) {
+		fprintf(stderr, "Warning: %s preamble doesn't verify. "
+			"Rehashing the firmware body...\n", name);
+		free(copy);
+		return;
+	}
+
+	Debug("%s() reusing %s body digest\n", __func__, name);
+	fw_body_area->hash_alg = data_key.hash_alg;
+	free(copy);
+}
+
 /*
  * This handles VBLOCK_A and VBLOCK_B while processing a BIOS image. We don't
  * do any signing here. We just check to see if the existing FMAP area contains
@@ -264,8 +310,8 @@ static int fmap_sign_fw_main(const char *name, uint8_t *buf, uint32_t len,
 static int fmap_sign_fw_preamble(const char *name, uint8_t *buf, uint32_t len,
 				 void *data)
 {
-	static uint8_t workbuf[VB2_WORKBUF_RECOMMENDED_SIZE];
-	static struct vb2_workbuf wb;
+	uint8_t workbuf[VB2_WORKBUF_RECOMMENDED_SIZE];
+	struct vb2_workbuf wb;
 	vb2_workbuf_init(&wb, workbuf, sizeof(workbuf));
 
 	struct vb2_keyblock *keyblock = (struct vb2_keyblock *)buf;
@@ -290,6 +336,11 @@ static int fmap_sign_fw_preamble(const char *name, uint8_t *buf, uint32_t len,
 		goto whatever;
 	}
 	uint32_t more = keyblock->keyblock_size;
+	if (more > len || len - more < sizeof(struct vb2_fw_preamble)) {
+		fprintf(stderr, "Warning: %s has no room for a preamble. "
+			"Signing the entire FW FMAP region...\n", name);
+		goto whatever;
+	}
 	struct vb2_fw_preamble *preamble =
 		(struct vb2_fw_preamble *)(buf + more);
 	uint32_t fw_size = preamble->body_signature.data_size;
@@ -298,9 +349,11 @@ static int fmap_sign_fw_preamble(const char *name, uint8_t *buf, uint32_t len,
 	switch (state->c) {
 	case BIOS_FMAP_VBLOCK_A:
 		fw_body_area = &state->area[BIOS_FMAP_FW_MAIN_A];
-		/* Preserve the flags if they're not specified */
+		/* Preserve the flags and version if they're not specified */
 		if (!sign_option.flags_specified)
 			sign_option.flags = preamble->flags;
+		if (!sign_option.version_specified)
+			sign_option.version = preamble->firmware_version;
 		break;
 	case BIOS_FMAP_VBLOCK_B:
 		fw_body_area = &state->area[BIOS_FMAP_FW_MAIN_B];
@@ -319,6 +372,9 @@ static int fmap_sign_fw_preamble(const char *name, uint8_t *buf, uint32_t len,
 	/* Update the firmware size */
 	fw_body_area->len = fw_size;
 
+	if (sign_option.reuse_body_hash)
+		save_body_digest(name, buf, len, fw_body_area, &wb);
+
 whatever:
 	state->area[state->c].is_valid = 1;
 
@@ -331,37 +387,63 @@ static int write_new_preamble(struct bios_area_s *vblock,
 			      struct vb2_keyblock *keyblock)
 {
 	struct vb2_signature *body_sig;
-	struct vb2_fw_preamble *preamble;
-
-	body_sig = vb2_calculate_signature(fw_body->buf, fw_body->len, signkey);
+	uint32_t more = keyblock->keyblock_size;
+	int rv;
+
+	if (fw_body->hash_alg != VB2_HASH_INVALID &&
+	    fw_body->hash_alg == signkey->hash_alg)
+		body_sig = vb2_sign_digest(fw_body->digest, fw_body->len,
+					   signkey);
+	else
+		body_sig = vb2_calculate_signature(fw_body->buf, fw_body->len,
+						   signkey);
 	if (!body_sig) {
 		fprintf(stderr, "Error calculating body signature\n");
 		return 1;
 	}
 
-	preamble = vb2_create_fw_preamble(sign_option.version,
-			(struct vb2_packed_key *)sign_option.kernel_subkey,
-			body_sig,
-			signkey,
-			sign_option.flags);
-	if (!preamble) {
-		fprintf(stderr, "Error creating firmware preamble.\n");
+	if (more > vblock->len) {
+		fprintf(stderr, "Keyblock doesn't fit in the VBLOCK area.\n");
 		free(body_sig);
 		return 1;
 	}
 
 	/* Write the new keyblock */
-	uint32_t more = keyblock->keyblock_size;
 	memcpy(vblock->buf, keyblock, more);
-	/* and the new preamble */
-	memcpy(vblock->buf + more, preamble, preamble->preamble_size);
 
-	free(preamble);
+	/* and build the new preamble right after it */
+	rv = vb2_build_fw_preamble(vblock->buf + more, vblock->len - more,
+			sign_option.version,
+			(struct vb2_packed_key *)sign_option.kernel_subkey,
+			body_sig,
+			signkey,
+			sign_option.flags);
 	free(body_sig);
+	if (rv) {
+		fprintf(stderr, "Error creating firmware preamble.\n");
+		return 1;
+	}
 
 	return 0;
 }
 
+struct preamble_job {
+	struct bios_area_s *vblock;
+	struct bios_area_s *fw_body;
+	struct vb2_private_key *signkey;
+	struct vb2_keyblock *keyblock;
+	int retval;
+};
+
+static void *preamble_worker(void *arg)
+{
+	struct preamble_job *job = arg;
+
+	job->retval = write_new_preamble(job->vblock, job->fw_body,
+					 job->signkey, job->keyblock);
+	return NULL;
+}
+
 static int write_loem(const char *ab, struct bios_area_s *vblock)
 {
 	char filename[PATH_MAX];
@@ -411,6 +493,15 @@ static int sign_bios_at_end(struct bios_state_s *state)
 		return 1;
 	}
 
+	struct preamble_job job_a = {vblock_a, fw_a,
+				     sign_option.signprivate,
+				     sign_option.keyblock};
+	/* FW B is always normal keys */
+	struct preamble_job job_b = {vblock_b, fw_b,
+				     sign_option.signprivate,
+				     sign_option.keyblock};
+	pthread_t thread_a;
+
 	/* Do A & B differ ? */
 	if (fw_a->len != fw_b->len ||
 	    memcmp(fw_a->buf, fw_b->buf, fw_a->len)) {
@@ -420,22 +511,22 @@ static int sign_bios_at_end(struct bios_state_s *state)
 				"FW A & B differ. DEV keys are required.\n");
 			return 1;
 		}
-		retval |= write_new_preamble(vblock_a, fw_a,
-					     sign_option.devsignprivate,
-					     sign_option.devkeyblock);
-	} else {
-		retval |= write_new_preamble(vblock_a, fw_a,
-					     sign_option.signprivate,
-					     sign_option.keyblock);
+		job_a.signkey = sign_option.devsignprivate;
+		job_a.keyblock = sign_option.devkeyblock;
 	}
 
-	/* FW B is always normal keys */
-	retval |= write_new_preamble(vblock_b, fw_b,
-				     sign_option.signprivate,
-				     sign_option.keyblock);
-
-
-
+	/*
+	 * The slots are independent, so hash and sign A on another thread
+	 * while B is done on this one.
+	 */
+	if (pthread_create(&thread_a, NULL, preamble_worker, &job_a)) {
+		preamble_worker(&job_a);
+		preamble_worker(&job_b);
+	} else {
+		preamble_worker(&job_b);
+		pthread_join(thread_a, NULL);
+	}
+	retval |= job_a.retval | job_b.retval;
 
 	if (sign_option.loemid) {
 		retval |= write_loem("A", vblock_a);
@@ -458,7 +549,7 @@ BUILD_ASSERT(ARRAY_SIZE(fmap_sign_fn) == NUM_BIOS_COMPONENTS);
 
 int ft_sign_bios(const char *name, uint8_t *buf, uint32_t len, void *data)
 {
-	FmapHeader *fmap;
+	struct fmap_index fi;
 	FmapAreaHeader *ah = 0;
 	char ah_name[FMAP_NAMELEN + 1];
 	enum bios_component c;
@@ -468,11 +559,11 @@ int ft_sign_bios(const char *name, uint8_t *buf, uint32_t len, void *data)
 	memset(&state, 0, sizeof(state));
 
 	/* We've already checked, so we know this will work. */
-	fmap = fmap_find(buf, len);
+	fmap_index_init(&fi, buf, len, NULL);
 	for (c = 0; c < NUM_BIOS_COMPONENTS; c++) {
 		/* We know one of these will work, too */
-		if (fmap_find_by_name(buf, len, fmap, fmap_name[c], &ah) ||
-		    fmap_find_by_name(buf, len, fmap, fmap_oldname[c], &ah)) {
+		if (fmap_index_find(&fi, fmap_name[c], &ah) ||
+		    fmap_index_find(&fi, fmap_oldname[c], &ah)) {
 			/* But the file might be truncated */
 			fmap_limit_area(ah, len);
 			/* The name is not necessarily null-terminated */
@@ -502,23 +593,24 @@ int ft_sign_bios(const char *name, uint8_t *buf, uint32_t len, void *data)
 	return retval;
 }
 
-enum futil_file_type ft_recognize_bios_image(uint8_t *buf, uint32_t len)
+enum futil_file_type ft_recognize_bios_image(uint8_t *buf, uint32_t len,
+		const struct futil_file_index *index)
 {
-	FmapHeader *fmap;
+	struct fmap_index fi;
 	enum bios_component c;
 
-	fmap = fmap_find(buf, len);
-	if (!fmap)
+	if (!index->fmap)
 		return FILE_TYPE_UNKNOWN;
 
+	fmap_index_init(&fi, buf, len, index->fmap);
 	for (c = 0; c < NUM_BIOS_COMPONENTS; c++)
-		if (!fmap_find_by_name(buf, len, fmap, fmap_name[c], 0))
+		if (!fmap_index_find(&fi, fmap_name[c], 0))
 			break;
 	if (c == NUM_BIOS_COMPONENTS)
 		return FILE_TYPE_BIOS_IMAGE;
 
 	for (c = 0; c < NUM_BIOS_COMPONENTS; c++)
-		if (!fmap_find_by_name(buf, len, fmap, fmap_oldname[c], 0))
+		if (!fmap_index_find(&fi, fmap_oldname[c], 0))
 			break;
 	if (c == NUM_BIOS_COMPONENTS)
 		return FILE_TYPE_OLD_BIOS_IMAGE;
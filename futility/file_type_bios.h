@@ -7,6 +7,8 @@
 #define VBOOT_REFERENCE_FUTILITY_FILE_TYPE_BIOS_H_
 #include <stdint.h>
 
+#include "2sha.h"
+
 /*
  * The Chrome OS BIOS must contain specific FMAP areas, which we want to look
  * at in a certain order.
@@ -27,6 +29,9 @@ struct bios_area_s {
 	uint8_t *buf;
 	uint32_t len;
 	uint32_t is_valid;
+	/* Known digest of the body, if hash_alg is valid */
+	enum vb2_hash_algorithm hash_alg;
+	uint8_t digest[VB2_MAX_DIGEST_SIZE];
 };
 
 /* State to track as we visit all components */
@@ -0,0 +1,838 @@
+/*
+ * Copyright 2018 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ */
+
+/*
+ * Resign or verify every kernel partition of a Chrome OS disk image in
+ * place. This does what extracting each partition, running "futility sign"
+ * or "futility verify" on it and writing it back would do, but without any
+ * temporary files.
+ */
+#include <errno.h>
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "2sysincludes.h"
+#include "2api.h"
+#include "2sha.h"
+#include "cgptlib_internal.h"
+#include "file_type.h"
+#include "futility.h"
+#include "futility_options.h"
+#include "gpt.h"
+#include "host_common.h"
+#include "host_jobs.h"
+#include "keys_summary.h"
+#include "vb1_helper.h"
+#include "vb2_common.h"
+#include "vb2_struct.h"
+
+#define DISK_SECTOR_SIZE 512
+
+/* How much of a kernel partition to read first when it isn't mapped */
+#define DISK_VBLOCK_READ (64 * 1024)
+
+/* How much of a kernel body to read and hash at a time */
+#define DISK_BODY_READ (1024 * 1024)
+
+/*
+ * Where the disk comes from: either mapped whole into [buf], or read as
+ * needed from [fd].
+ */
+struct disk_src {
+	uint8_t *buf;
+	int fd;
+	uint64_t size;
+};
+
+/* Copy [size] bytes at [offset] of the disk. Returns non-zero if error. */
+static int disk_read(const struct disk_src *src, uint64_t offset, void *dst,
+		     uint64_t size)
+{
+	uint8_t *p = dst;
+	ssize_t n;
+
+	if (offset > src->size || size > src->size - offset)
+		return 1;
+
+	if (src->buf) {
+		memcpy(dst, src->buf + offset, size);
+		return 0;
+	}
+
+	while (size) {
+		n = pread(src->fd, p, size, offset);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return 1;
+		p += n;
+		offset += n;
+		size -= n;
+	}
+	return 0;
+}
+
+/* One kernel partition being resigned */
+struct kernel_job {
+	/* Partition number, as cgpt counts them */
+	uint32_t number;
+	uint8_t *kpart_data;
+	uint32_t kpart_size;
+	uint8_t *kblob_data;
+	uint32_t kblob_size;
+	struct vb2_private_key *signkey;
+	/* Size of each body chunk digest, or 0 for none */
+	uint32_t body_chunk_size;
+	/* Output */
+	struct vb2_signature *body_sig;
+	struct vb2_body_digests digests;
+	int digests_ok;
+};
+
+/*
+ * Hashing the kernel blob is most of the work, and it only touches the job,
+ * so the partitions are hashed on several threads at once.
+ */
+static void kernel_worker(void *ctx, int index)
+{
+	struct kernel_job *job = (struct kernel_job *)ctx + index;
+
+	job->body_sig = vb2_calculate_signature(job->kblob_data,
+						job->kblob_size,
+						job->signkey);
+	job->digests_ok = !job->body_chunk_size ||
+		(VB2_SUCCESS == vb2_body_digests_init(&job->digests,
+						      job->signkey->hash_alg,
+						      job->body_chunk_size) &&
+		 VB2_SUCCESS == vb2_body_digests_extend(&job->digests,
+							job->kblob_data,
+							job->kblob_size) &&
+		 VB2_SUCCESS == vb2_body_digests_finalize(&job->digests));
+}
+
+/* Copy one entries array out of the image, if its header points to one. */
+static void load_entries(GptData *gpt, int is_secondary,
+			 const struct disk_src *src)
+{
+	GptHeader *h = (GptHeader *)(is_secondary ? gpt->secondary_header
+				     : gpt->primary_header);
+	uint8_t *entries = is_secondary ? gpt->secondary_entries
+		: gpt->primary_entries;
+	uint64_t size;
+
+	/* A bad header leaves zeroed entries behind for GptRepair() */
+	if (CheckHeader(h, is_secondary, gpt->streaming_drive_sectors,
+			gpt->gpt_drive_sectors, gpt->flags,
+			gpt->sector_bytes))
+		return;
+
+	size = CalculateEntriesSectors(h, gpt->sector_bytes) *
+		gpt->sector_bytes;
+	if (size > MAX_NUMBER_OF_ENTRIES * sizeof(GptEntry) ||
+	    h->entries_lba + size / gpt->sector_bytes >
+	    gpt->gpt_drive_sectors)
+		return;
+
+	if (disk_read(src, h->entries_lba * gpt->sector_bytes, entries, size))
+		memset(entries, 0, size);
+}
+
+/*
+ * Set up [gpt] from copies of the image's GPT, so that repairing it in
+ * memory can't change the image.
+ */
+static int load_gpt(GptData *gpt, const struct disk_src *src)
+{
+	memset(gpt, 0, sizeof(*gpt));
+	gpt->sector_bytes = DISK_SECTOR_SIZE;
+	gpt->streaming_drive_sectors = src->size / DISK_SECTOR_SIZE;
+	gpt->gpt_drive_sectors = gpt->streaming_drive_sectors;
+
+	if (gpt->gpt_drive_sectors <
+	    2 * (GPT_PMBR_SECTORS + GPT_HEADER_SECTORS))
+		return 1;
+
+	gpt->primary_header = calloc(1, DISK_SECTOR_SIZE);
+	gpt->secondary_header = calloc(1, DISK_SECTOR_SIZE);
+	gpt->primary_entries = calloc(MAX_NUMBER_OF_ENTRIES, sizeof(GptEntry));
+	gpt->secondary_entries = calloc(MAX_NUMBER_OF_ENTRIES,
+					sizeof(GptEntry));
+	if (!gpt->primary_header || !gpt->secondary_header ||
+	    !gpt->primary_entries || !gpt->secondary_entries)
+		return 1;
+
+	if (disk_read(src, GPT_PMBR_SECTORS * DISK_SECTOR_SIZE,
+		      gpt->primary_header, DISK_SECTOR_SIZE) ||
+	    disk_read(src, (gpt->gpt_drive_sectors - GPT_HEADER_SECTORS) *
+		      DISK_SECTOR_SIZE, gpt->secondary_header,
+		      DISK_SECTOR_SIZE))
+		return 1;
+	load_entries(gpt, 0, src);
+	load_entries(gpt, 1, src);
+
+	return 0;
+}
+
+static void free_gpt(GptData *gpt)
+{
+	free(gpt->primary_header);
+	free(gpt->secondary_header);
+	free(gpt->primary_entries);
+	free(gpt->secondary_entries);
+}
+
+/* Load and repair the GPT of [buf]. Returns non-zero if there isn't one. */
+static int open_gpt(GptData *gpt, const char *name,
+		    const struct disk_src *src)
+{
+	if (load_gpt(gpt, src) || GptSanityCheck(gpt)) {
+		fprintf(stderr, "Can't find a valid GPT in %s\n", name);
+		return 1;
+	}
+	GptRepair(gpt);
+	return 0;
+}
+
+/* Make sure a partition is all there, so it can be used in place. */
+static int check_partition(GptData *gpt, GptEntry *e, const char *name,
+			   uint32_t number, uint64_t len)
+{
+	if ((e->ending_lba + 1) * DISK_SECTOR_SIZE > len ||
+	    GptGetEntrySizeBytes(gpt, e) > UINT32_MAX) {
+		fprintf(stderr, "Kernel partition %d doesn't fit in %s\n",
+			number, name);
+		return 1;
+	}
+	return 0;
+}
+
+/*
+ * Find the kernel blob in a partition and replace its config if asked. The
+ * blob pointers live in vb1_helper's globals, so this part is done one
+ * partition at a time.
+ */
+static int start_kernel_job(struct kernel_job *job)
+{
+	struct vb2_kernel_preamble *preamble;
+
+	if (job->kpart_size < KEY_BLOCK_MAGIC_SIZE ||
+	    memcmp(job->kpart_data, KEY_BLOCK_MAGIC, KEY_BLOCK_MAGIC_SIZE)) {
+		fprintf(stderr, "Skipping unsigned kernel partition %d\n",
+			job->number);
+		return 1;
+	}
+
+	job->kblob_data = unpack_kernel_partition(job->kpart_data,
+						  job->kpart_size,
+						  job->kpart_size,
+						  NULL, &preamble,
+						  &job->kblob_size);
+	if (!job->kblob_data) {
+		fprintf(stderr, "Unable to unpack kernel partition %d\n",
+			job->number);
+		return -1;
+	}
+
+	if (sign_option.config_data &&
+	    0 != UpdateKernelBlobConfig(job->kblob_data, job->kblob_size,
+					sign_option.config_data,
+					sign_option.config_size)) {
+		fprintf(stderr, "Unable to update config of partition %d\n",
+			job->number);
+		return -1;
+	}
+
+	job->signkey = sign_option.signprivate;
+	job->body_chunk_size = sign_option.body_chunk_size_specified ?
+		sign_option.body_chunk_size :
+		vb2_kernel_get_body_chunk_size(preamble);
+	return 0;
+}
+
+/* Wrap the new body signature in a vblock and write it over the old one. */
+static int finish_kernel_job(struct kernel_job *job)
+{
+	struct vb2_keyblock *keyblock;
+	struct vb2_kernel_preamble *preamble;
+	uint8_t *vblock_data;
+	uint32_t vblock_size, old_vblock_size, flags, version;
+
+	if (!job->body_sig || !job->digests_ok) {
+		fprintf(stderr, "Error calculating body signature of"
+			" partition %d\n", job->number);
+		return 1;
+	}
+
+	/* Point the globals back at this partition */
+	unpack_kernel_partition(job->kpart_data, job->kpart_size,
+				job->kpart_size, &keyblock, &preamble, NULL);
+
+	/*
+	 * The blob stays where it is, so the old vblock size is the padding.
+	 * As in ft_sign_kern_preamble(), the version, flags and body chunk
+	 * size are preserved unless new ones are given, and the load address
+	 * always is.
+	 */
+	old_vblock_size = job->kblob_data - job->kpart_data;
+	version = sign_option.version_specified ? sign_option.version
+		: preamble->kernel_version;
+	flags = sign_option.flags_specified ? sign_option.flags
+		: vb2_kernel_get_flags(preamble);
+	if (sign_option.keyblock)
+		keyblock = sign_option.keyblock;
+
+	vblock_data = CreateKernelVblock(job->body_sig,
+					 job->body_chunk_size ?
+					 &job->digests : NULL,
+					 old_vblock_size,
+					 version, preamble->body_load_address,
+					 keyblock, sign_option.signprivate,
+					 flags, &vblock_size);
+	if (!vblock_data) {
+		fprintf(stderr, "Unable to sign kernel partition %d\n",
+			job->number);
+		return 1;
+	}
+
+	if (vblock_size != old_vblock_size) {
+		fprintf(stderr, "New vblock for partition %d is 0x%x bytes,"
+			" but only 0x%x bytes are free\n",
+			job->number, vblock_size, old_vblock_size);
+		free(vblock_data);
+		return 1;
+	}
+
+	Debug("partition %d: vblock_size = 0x%x\n", job->number, vblock_size);
+	memcpy(job->kpart_data, vblock_data, vblock_size);
+	free(vblock_data);
+	return 0;
+}
+
+int ft_sign_disk_image(const char *name, uint8_t *buf, uint32_t len,
+		       void *data)
+{
+	struct disk_src src = { .buf = buf, .fd = -1, .size = len };
+	GptData gpt;
+	GptHeader *h;
+	GptEntry *entries;
+	struct kernel_job *jobs = NULL;
+	uint32_t count = 0, i;
+	int retval = 1;
+
+	if (open_gpt(&gpt, name, &src))
+		goto done;
+
+	h = (GptHeader *)gpt.primary_header;
+	entries = (GptEntry *)gpt.primary_entries;
+	jobs = calloc(h->number_of_entries, sizeof(*jobs));
+	if (!jobs) {
+		fprintf(stderr, "Couldn't allocate memory\n");
+		goto done;
+	}
+
+	/* KERN-C and friends are resigned too, whatever their priority */
+	for (i = 0; i < h->number_of_entries; i++) {
+		GptEntry *e = entries + i;
+		struct kernel_job *job = jobs + count;
+		int rv;
+
+		if (!IsKernelEntry(e))
+			continue;
+
+		if (check_partition(&gpt, e, name, i + 1, len))
+			goto done;
+
+		job->number = i + 1;
+		job->kpart_data = buf + e->starting_lba * DISK_SECTOR_SIZE;
+		job->kpart_size = GptGetEntrySizeBytes(&gpt, e);
+
+		rv = start_kernel_job(job);
+		if (rv < 0)
+			goto done;
+		if (rv == 0)
+			count++;
+	}
+
+	if (!count) {
+		fprintf(stderr, "No signed kernel partitions in %s\n", name);
+		goto done;
+	}
+
+	vb2_run_jobs(kernel_worker, jobs, count, sysconf(_SC_NPROCESSORS_ONLN));
+
+	retval = 0;
+	for (i = 0; i < count; i++)
+		retval |= finish_kernel_job(jobs + i);
+
+done:
+	for (i = 0; i < count; i++) {
+		free(jobs[i].body_sig);
+		free(jobs[i].digests.digests);
+	}
+	free(jobs);
+	free_gpt(&gpt);
+	return retval;
+}
+
+/* One kernel partition being verified */
+struct verify_job {
+	/* Partition number, as cgpt counts them */
+	uint32_t number;
+	char label[sizeof(((GptEntry *)0)->name) / sizeof(uint16_t) + 1];
+	const struct disk_src *src;
+	uint64_t kpart_offset;
+	uint32_t kpart_size;
+	/*
+	 * The vblock: the whole partition if the disk is mapped, otherwise
+	 * just enough of its start to hold the keyblock and preamble.
+	 */
+	uint8_t *vblock_data;
+	uint32_t vblock_size;
+	const struct vb2_public_key *sign_key;
+	int has_vblock;
+	/* Output */
+	const char *error;
+	int good_sig;
+	uint32_t data_key_version;
+	uint32_t kernel_version;
+	uint32_t flags;
+	uint32_t body_size;
+	uint64_t nsecs;
+};
+
+static uint64_t now_nsecs(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/*
+ * Read the start of a partition of an unmapped disk, growing the read if the
+ * keyblock and preamble claim to be bigger. They're checked later, so this
+ * only has to keep the sizes within the partition.
+ */
+static int read_vblock(struct verify_job *job)
+{
+	struct vb2_keyblock *keyblock;
+	struct vb2_kernel_preamble *preamble;
+	uint32_t want = job->kpart_size < DISK_VBLOCK_READ ?
+		job->kpart_size : DISK_VBLOCK_READ;
+	uint64_t need;
+
+	while (1) {
+		free(job->vblock_data);
+		job->vblock_data = malloc(want);
+		job->vblock_size = want;
+		if (!job->vblock_data ||
+		    disk_read(job->src, job->kpart_offset, job->vblock_data,
+			      want))
+			return 1;
+
+		keyblock = (struct vb2_keyblock *)job->vblock_data;
+		if (want < sizeof(*keyblock))
+			return 0;
+		need = (uint64_t)keyblock->keyblock_size + sizeof(*preamble);
+		if (need > want) {
+			if (need > job->kpart_size)
+				return 0;
+			want = need;
+			continue;
+		}
+
+		preamble = (struct vb2_kernel_preamble *)
+			(job->vblock_data + keyblock->keyblock_size);
+		need = (uint64_t)keyblock->keyblock_size +
+			preamble->preamble_size;
+		if (need <= want || need > job->kpart_size)
+			return 0;
+		want = need;
+	}
+}
+
+/*
+ * Check the body of a partition of an unmapped disk, reading it a piece at a
+ * time. This does what vb2_verify_data() and VerifyKernelBodyChunks() do for
+ * a mapped one. Returns non-zero if the body is bad.
+ */
+static int verify_body_stream(struct verify_job *job,
+			      struct vb2_kernel_preamble *preamble,
+			      const struct vb2_public_key *data_key,
+			      uint32_t offset, struct vb2_workbuf *wb)
+{
+	uint32_t chunk_size = vb2_kernel_get_body_chunk_size(preamble);
+	uint32_t chunk_count = vb2_kernel_get_body_chunk_count(preamble);
+	uint32_t size = preamble->body_signature.data_size;
+	uint32_t step = DISK_BODY_READ;
+	uint32_t done, n, i, chunk = 0;
+	uint8_t digest[VB2_MAX_DIGEST_SIZE];
+	struct vb2_digest_context dc;
+	uint8_t *buf = NULL;
+	int retval = 1;
+
+	if (size > job->kpart_size - offset)
+		return 1;
+
+	/* Whole chunks are read at a time, so each can be checked */
+	if (chunk_size)
+		step = chunk_size < DISK_BODY_READ ?
+			DISK_BODY_READ / chunk_size * chunk_size : chunk_size;
+
+	buf = malloc(step);
+	if (!buf || VB2_SUCCESS != vb2_digest_init(&dc, data_key->hash_alg))
+		goto done;
+
+	for (done = 0; done < size; done += n) {
+		n = size - done < step ? size - done : step;
+		if (disk_read(job->src, job->kpart_offset + offset + done,
+			      buf, n) ||
+		    VB2_SUCCESS != vb2_digest_extend(&dc, buf, n))
+			goto done;
+
+		for (i = 0; chunk_size && i < n && chunk < chunk_count;
+		     i += chunk_size, chunk++) {
+			if (VB2_SUCCESS != vb2_verify_kernel_body_chunk(
+				    preamble, chunk, buf + i,
+				    n - i < chunk_size ? n - i : chunk_size,
+				    data_key->hash_alg))
+				goto done;
+		}
+	}
+
+	if (VB2_SUCCESS == vb2_digest_finalize(&dc, digest, sizeof(digest)) &&
+	    VB2_SUCCESS == vb2_verify_digest(data_key,
+					     &preamble->body_signature,
+					     digest, wb))
+		retval = 0;
+
+done:
+	free(buf);
+	return retval;
+}
+
+/*
+ * Check the keyblock, preamble and body of one partition, the same way
+ * ft_show_kernel_preamble() does. Each job has its own work buffer, so any
+ * number of these can run at once.
+ */
+static void verify_kernel(struct verify_job *job, struct vb2_workbuf *wb)
+{
+	struct vb2_keyblock *keyblock;
+	struct vb2_kernel_preamble *preamble;
+	struct vb2_public_key data_key;
+	uint32_t len;
+	uint32_t more;
+
+	if (!job->src->buf && read_vblock(job)) {
+		job->error = "can't read partition";
+		return;
+	}
+	keyblock = (struct vb2_keyblock *)job->vblock_data;
+	len = job->vblock_size;
+
+	if (VB2_SUCCESS != vb2_verify_keyblock_hash(keyblock, len, wb)) {
+		job->error = "keyblock is invalid";
+		return;
+	}
+
+	if (job->sign_key && VB2_SUCCESS ==
+	    vb2_verify_keyblock(keyblock, len, job->sign_key, wb))
+		job->good_sig = 1;
+
+	job->data_key_version = keyblock->data_key.key_version;
+	if (VB2_SUCCESS != vb2_unpack_key(&data_key, &keyblock->data_key)) {
+		job->error = "data key is invalid";
+		return;
+	}
+
+	more = keyblock->keyblock_size;
+	preamble = (struct vb2_kernel_preamble *)(job->vblock_data + more);
+	if (VB2_SUCCESS != vb2_verify_kernel_preamble(preamble, len - more,
+						      &data_key, wb)) {
+		job->error = "preamble is invalid";
+		return;
+	}
+
+	job->kernel_version = preamble->kernel_version;
+	job->flags = vb2_kernel_get_flags(preamble);
+	job->body_size = preamble->body_signature.data_size;
+
+	/* The body follows the vblock, however much padding that has */
+	more += preamble->preamble_size;
+	if (more > job->kpart_size) {
+		job->error = "body is invalid";
+		return;
+	}
+	if (job->src->buf ?
+	    (VB2_SUCCESS != vb2_verify_data(job->vblock_data + more,
+					    len - more,
+					    &preamble->body_signature,
+					    &data_key, wb) ||
+	     VerifyKernelBodyChunks(preamble, job->vblock_data + more,
+				    len - more, data_key.hash_alg)) :
+	    verify_body_stream(job, preamble, &data_key, more, wb)) {
+		job->error = "body is invalid";
+		return;
+	}
+}
+
+static void verify_worker(void *ctx, int index)
+{
+	struct verify_job *job = (struct verify_job *)ctx + index;
+	struct vb2_workbuf wb;
+	uint8_t *workbuf;
+	uint64_t start = now_nsecs();
+
+	if (!job->has_vblock)
+		return;
+
+	workbuf = malloc(VB2_KERNEL_WORKBUF_RECOMMENDED_SIZE);
+	if (!workbuf) {
+		job->error = "out of memory";
+		return;
+	}
+	vb2_workbuf_init(&wb, workbuf, VB2_KERNEL_WORKBUF_RECOMMENDED_SIZE);
+
+	verify_kernel(job, &wb);
+
+	free(workbuf);
+	job->nsecs = now_nsecs() - start;
+}
+
+/* Print what we found out about one partition. Returns non-zero if bad. */
+static int show_verify_job(struct verify_job *job)
+{
+	int retval = 0;
+
+	if (!job->has_vblock) {
+		printf("Kernel partition %d (%s): not signed\n",
+		       job->number, job->label);
+		return 0;
+	}
+
+	printf("Kernel partition %d (%s):\n", job->number, job->label);
+	if (job->error) {
+		printf("  Error:                 %s\n", job->error);
+		retval = 1;
+	} else {
+		printf("  Signature:             %s\n",
+		       !job->sign_key ? "ignored" :
+		       job->good_sig ? "valid" : "invalid");
+		printf("  Data key version:      %u\n", job->data_key_version);
+		printf("  Kernel version:        %u\n", job->kernel_version);
+		printf("  Flags:                 0x%x\n", job->flags);
+		printf("  Body size:             0x%x\n", job->body_size);
+		printf("  Body verification succeeded.\n");
+		if (show_option.strict && !job->good_sig)
+			retval = 1;
+	}
+	printf("  Time:                  %" PRIu64 ".%03" PRIu64 " ms\n",
+	       job->nsecs / 1000000, job->nsecs / 1000 % 1000);
+
+	return retval;
+}
+
+static int show_disk(const char *name, const struct disk_src *src)
+{
+	GptData gpt;
+	GptHeader *h;
+	GptEntry *entries;
+	struct verify_job *jobs = NULL;
+	uint32_t count = 0, num_signed = 0, i, j;
+	uint8_t magic[KEY_BLOCK_MAGIC_SIZE];
+	int retval = 1;
+
+	if (open_gpt(&gpt, name, src))
+		goto done;
+
+	h = (GptHeader *)gpt.primary_header;
+	entries = (GptEntry *)gpt.primary_entries;
+	jobs = calloc(h->number_of_entries, sizeof(*jobs));
+	if (!jobs) {
+		fprintf(stderr, "Couldn't allocate memory\n");
+		goto done;
+	}
+
+	printf("Disk image:              %s\n", name);
+
+	for (i = 0; i < h->number_of_entries; i++) {
+		GptEntry *e = entries + i;
+		struct verify_job *job = jobs + count;
+
+		if (!IsKernelEntry(e))
+			continue;
+
+		if (check_partition(&gpt, e, name, i + 1, src->size))
+			goto done;
+
+		count++;
+		job->number = i + 1;
+		job->src = src;
+		job->kpart_offset = e->starting_lba * DISK_SECTOR_SIZE;
+		job->kpart_size = GptGetEntrySizeBytes(&gpt, e);
+		job->sign_key = show_option.k;
+		if (src->buf) {
+			job->vblock_data = src->buf + job->kpart_offset;
+			job->vblock_size = job->kpart_size;
+		}
+
+		/* The name is UTF-16, but it's ASCII in practice */
+		for (j = 0; j < ARRAY_SIZE(e->name) && e->name[j]; j++)
+			job->label[j] = e->name[j] < 0x80 ? e->name[j] : '?';
+
+		/* An empty KERN-C is normal, so that's not an error */
+		if (job->kpart_size < KEY_BLOCK_MAGIC_SIZE ||
+		    disk_read(src, job->kpart_offset, magic, sizeof(magic)) ||
+		    memcmp(magic, KEY_BLOCK_MAGIC, KEY_BLOCK_MAGIC_SIZE))
+			continue;
+
+		job->has_vblock = 1;
+		num_signed++;
+	}
+
+	vb2_run_jobs(verify_worker, jobs, count, sysconf(_SC_NPROCESSORS_ONLN));
+
+	/* Report in partition order, whichever finished first */
+	retval = 0;
+	for (i = 0; i < count; i++)
+		retval |= show_verify_job(jobs + i);
+
+	if (!num_signed) {
+		printf("No signed kernel partitions\n");
+		if (show_option.strict)
+			retval = 1;
+	}
+
+done:
+	for (i = 0; i < count; i++)
+		if (!src->buf)
+			free(jobs[i].vblock_data);
+	free(jobs);
+	free_gpt(&gpt);
+	return retval;
+}
+
+int ft_show_disk_image(const char *name, uint8_t *buf, uint32_t len,
+		       void *data)
+{
+	struct disk_src src = { .buf = buf, .fd = -1, .size = len };
+
+	return show_disk(name, &src);
+}
+
+int ft_show_disk_fd(const char *name, int fd, uint64_t size)
+{
+	struct disk_src src = { .buf = NULL, .fd = fd, .size = size };
+
+	return show_disk(name, &src);
+}
+
+/* One kernel partition whose keys are being summarized */
+struct keys_job {
+	/* Partition number, as cgpt counts them */
+	uint32_t number;
+	uint8_t *kpart_data;
+	uint32_t kpart_size;
+	int has_vblock;
+	/* Output */
+	struct keyblock_summary summary;
+};
+
+static void keys_worker(void *ctx, int index)
+{
+	struct keys_job *job = (struct keys_job *)ctx + index;
+	struct vb2_workbuf wb;
+	uint8_t *workbuf;
+
+	if (!job->has_vblock)
+		return;
+
+	/* Leaving the summary invalid is all we can do without memory */
+	workbuf = malloc(VB2_KERNEL_WORKBUF_RECOMMENDED_SIZE);
+	if (!workbuf)
+		return;
+	vb2_workbuf_init(&wb, workbuf, VB2_KERNEL_WORKBUF_RECOMMENDED_SIZE);
+
+	keys_summary_keyblock(&job->summary, job->kpart_data, job->kpart_size,
+			      NULL, NULL, &wb);
+
+	free(workbuf);
+}
+
+int ft_show_disk_keys(const char *name, uint8_t *buf, uint32_t len)
+{
+	struct disk_src src = { .buf = buf, .fd = -1, .size = len };
+	GptData gpt;
+	GptHeader *h;
+	GptEntry *entries;
+	struct keys_job *jobs = NULL;
+	uint32_t count = 0, i;
+	char what[32];
+	int retval = 1;
+
+	if (open_gpt(&gpt, name, &src))
+		goto done;
+
+	h = (GptHeader *)gpt.primary_header;
+	entries = (GptEntry *)gpt.primary_entries;
+	jobs = calloc(h->number_of_entries, sizeof(*jobs));
+	if (!jobs) {
+		fprintf(stderr, "Couldn't allocate memory\n");
+		goto done;
+	}
+
+	printf("IMAGE: %s\n", name);
+
+	for (i = 0; i < h->number_of_entries; i++) {
+		GptEntry *e = entries + i;
+		struct keys_job *job = jobs + count;
+
+		if (!IsKernelEntry(e))
+			continue;
+
+		if (check_partition(&gpt, e, name, i + 1, len))
+			goto done;
+
+		count++;
+		job->number = i + 1;
+		job->kpart_data = buf + e->starting_lba * DISK_SECTOR_SIZE;
+		job->kpart_size = GptGetEntrySizeBytes(&gpt, e);
+
+		if (job->kpart_size < KEY_BLOCK_MAGIC_SIZE ||
+		    memcmp(job->kpart_data, KEY_BLOCK_MAGIC,
+			   KEY_BLOCK_MAGIC_SIZE))
+			continue;
+
+		job->has_vblock = 1;
+	}
+
+	vb2_run_jobs(keys_worker, jobs, count, sysconf(_SC_NPROCESSORS_ONLN));
+
+	retval = 0;
+	for (i = 0; i < count; i++) {
+		struct keys_job *job = jobs + i;
+
+		snprintf(what, sizeof(what), "part %u kernel:", job->number);
+		if (!job->has_vblock) {
+			printf("  %-16snot signed\n", what);
+			continue;
+		}
+		keys_summary_print_keyblock(what, &job->summary);
+		if (!job->summary.valid)
+			retval = 1;
+	}
+
+done:
+	free(jobs);
+	free_gpt(&gpt);
+	return retval;
+}
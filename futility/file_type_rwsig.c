@@ -19,6 +19,7 @@
 
 #include "2sysincludes.h"
 #include "2common.h"
+#include "2ed25519.h"
 #include "2rsa.h"
 #include "2sha.h"
 #include "file_type.h"
@@ -317,7 +318,8 @@ int ft_sign_rwsig(const char *name, uint8_t *buf, uint32_t len, void *nuthin)
 		Debug("Replacing old signature with new one\n");
 		memset(old_sig, 0xff, sig_size);
 		memcpy(old_sig, tmp_sig, tmp_sig->c.total_size);
-		if (fmap) {
+		/* One EC_RW.bin can't stand for several images */
+		if (fmap && !sign_option.multi) {
 			Debug("Writing %s (size=%d)\n",
 			      EC_RW_FILENAME, fmaparea->area_size);
 			if (vb2_write_file(EC_RW_FILENAME,
@@ -347,9 +349,18 @@ int ft_sign_rwsig(const char *name, uint8_t *buf, uint32_t len, void *nuthin)
 			goto done;
 		}
 
-		/* Extract the keyb blob */
-		if (vb_keyb_from_rsa(sign_option.prikey->rsa_private_key,
-					&keyb_data, &keyb_size)) {
+		/* Extract the keyb blob, which for Ed25519 is just the key */
+		if (sign_option.prikey->sig_alg == VB2_SIG_ED25519) {
+			keyb_size = VB2_ED25519_KEY_BYTES;
+			keyb_data = malloc(keyb_size);
+			if (!keyb_data || vb2_private_key_ed25519_public(
+					sign_option.prikey, keyb_data)) {
+				fprintf(stderr,
+					"Couldn't extract the public key\n");
+				goto done;
+			}
+		} else if (vb_keyb_from_rsa(sign_option.prikey->rsa_private_key,
+					    &keyb_data, &keyb_size)) {
 			fprintf(stderr, "Couldn't extract the public key\n");
 			goto done;
 		}
@@ -412,7 +423,8 @@ done:
 	return retval;
 }
 
-enum futil_file_type ft_recognize_rwsig(uint8_t *buf, uint32_t len)
+enum futil_file_type ft_recognize_rwsig(uint8_t *buf, uint32_t len,
+					const struct futil_file_index *index)
 {
 	FmapHeader *fmap;
 	const struct vb21_signature *sig = NULL;
@@ -421,7 +433,7 @@ enum futil_file_type ft_recognize_rwsig(uint8_t *buf, uint32_t len)
 	if (!vb21_verify_signature((const struct vb21_signature *)buf, len))
 		return FILE_TYPE_RWSIG;
 
-	fmap = fmap_find(buf, len);
+	fmap = index->fmap;
 	if (fmap) {
 		/* This looks like a full image. */
 		FmapAreaHeader *fmaparea;
@@ -105,16 +105,21 @@ int ft_sign_usbpd1(const char *name, uint8_t *buf, uint32_t len, void *data)
 	if (!parse_size_opts(len, &ro_size, &rw_size, &ro_offset, &rw_offset))
 		goto done;
 
-	/* Read the signing keypair file */
-	if (vb2_private_key_read_pem(&key_ptr, sign_option.pem_signpriv)) {
-		fprintf(stderr, "Unable to read keypair from %s\n",
-			sign_option.pem_signpriv);
-		goto done;
+	/* Use the keypair the caller already read, or read it here */
+	if (sign_option.prikey) {
+		key_ptr = sign_option.prikey;
+	} else {
+		if (vb2_private_key_read_pem(&key_ptr,
+					     sign_option.pem_signpriv)) {
+			fprintf(stderr, "Unable to read keypair from %s\n",
+				sign_option.pem_signpriv);
+			goto done;
+		}
+
+		/* Set the algs */
+		key_ptr->hash_alg = sign_option.hash_alg;
+		key_ptr->sig_alg = vb2_rsa_sig_alg(key_ptr->rsa_private_key);
 	}
-
-	/* Set the algs */
-	key_ptr->hash_alg = sign_option.hash_alg;
-	key_ptr->sig_alg = vb2_rsa_sig_alg(key_ptr->rsa_private_key);
 	if (key_ptr->sig_alg == VB2_SIG_INVALID) {
 		fprintf(stderr, "Unsupported sig algorithm in RSA key\n");
 		goto done;
@@ -241,7 +246,7 @@ int ft_sign_usbpd1(const char *name, uint8_t *buf, uint32_t len, void *data)
 	/* Finally */
 	retval = 0;
 done:
-	if (key_ptr)
+	if (key_ptr && key_ptr != sign_option.prikey)
 		vb2_private_key_free(key_ptr);
 	if (keyb_data)
 		free(keyb_data);
@@ -462,7 +467,8 @@ int ft_show_usbpd1(const char *name, uint8_t *buf, uint32_t len, void *data)
 	return 1;
 }
 
-enum futil_file_type ft_recognize_usbpd1(uint8_t *buf, uint32_t len)
+enum futil_file_type ft_recognize_usbpd1(uint8_t *buf, uint32_t len,
+					 const struct futil_file_index *index)
 {
 	uint32_t ro_size, rw_size, ro_offset, rw_offset;
 	int s, h;
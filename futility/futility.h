@@ -105,6 +105,15 @@ int futil_looks_like_gbb(GoogleBinaryBlockHeader *gbb, uint32_t len);
 int futil_valid_gbb_header(GoogleBinaryBlockHeader *gbb, uint32_t len,
 			   uint32_t *maxlen);
 
+/*
+ * Find the GBB header in an image: in the FMAP's GBB area if there is one,
+ * then at the start of the buffer, and only then by scanning the whole thing.
+ * Returns NULL unless exactly one valid header is found.  If count_ptr isn't
+ * NULL, it gets the number of valid headers found.
+ */
+GoogleBinaryBlockHeader *futil_find_gbb(uint8_t *buf, uint32_t len,
+					int *count_ptr);
+
 /* For GBB v1.2 and later, update the hwid_digest */
 void update_hwid_digest(GoogleBinaryBlockHeader *gbb);
 
@@ -140,6 +149,11 @@ enum futil_file_err {
 	FILE_ERR_SOCK,
 };
 
+/* copy_file_range() arrived in glibc 2.27 */
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || __GLIBC_MINOR__ >= 27)
+#define HAVE_COPY_FILE_RANGE
+#endif
+
 /* Wrapper for mmap/munmap. Skips stupidly large files. */
 #define MAP_RO 0
 #define MAP_RW 1
@@ -148,6 +162,22 @@ enum futil_file_err futil_map_file(int fd, int writeable,
 enum futil_file_err futil_unmap_file(int fd, int writeable,
 				     uint8_t *buf, uint32_t len);
 
+/*
+ * Split 'line' in place into whitespace-separated arguments, which may be
+ * quoted with ' or ". An argument starting with '#' begins a comment that
+ * runs to the end of the line. Returns the argument count, or -1 if the line
+ * is malformed or has more than max_args arguments.
+ */
+int futil_split_line(char *line, char *args[], int max_args);
+
+/*
+ * Sign an image which is already mapped, as "sign ARGS... NAME" would sign
+ * the file NAME in place. argv[0] is the first option, not a command name.
+ * Returns non-zero on error.
+ */
+int futil_sign_mapped(int argc, char *argv[], const char *name,
+		      uint8_t *buf, uint32_t len);
+
 /* The CPU architecture is occasionally important */
 enum arch_t {
 	ARCH_UNSPECIFIED,
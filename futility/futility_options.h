@@ -7,6 +7,10 @@
 /*
  * We centralize option parsing but may split operations into multiple files,
  * so let's declare the option structures in a single place (here).
+ *
+ * The ft_show_*() and ft_sign_*() functions read these as they go, so they
+ * must not change while any thread is showing or signing. Worker threads
+ * that only read them, like those in file_type_disk.c, are fine.
  */
 
 #ifndef VBOOT_REFERENCE_FUTILITY_OPTIONS_H_
@@ -26,6 +30,8 @@ struct show_option_s {
 	uint32_t padding;
 	int strict;
 	int t_flag;
+	int type_override;
+	int keys_summary;
 	enum futil_file_type type;
 	struct vb21_packed_key *pkey;
 	uint32_t sig_size;
@@ -42,8 +48,11 @@ struct sign_option_s {
 	int version_specified;
 	uint32_t flags;
 	int flags_specified;
+	uint32_t body_chunk_size;
+	int body_chunk_size_specified;
 	char *loemdir;
 	char *loemid;
+	int reuse_body_hash;
 	uint8_t *bootloader_data;
 	uint64_t bootloader_size;
 	uint8_t *config_data;
@@ -60,12 +69,14 @@ struct sign_option_s {
 	int pem_algo_specified;
 	uint32_t pem_algo;
 	char *pem_external;
+	int pem_persistent;
 	enum futil_file_type type;
 	enum vb2_hash_algorithm hash_alg;
 	uint32_t ro_size, rw_size;
 	uint32_t ro_offset, rw_offset;
 	uint32_t data_size, sig_size;
 	struct vb2_private_key *prikey;
+	int multi;			/* Several images, signed in place */
 };
 extern struct sign_option_s sign_option;
 
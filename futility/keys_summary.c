@@ -0,0 +1,377 @@
+/*
+ * Copyright 2018 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ */
+
+/*
+ * Report which keys were used to sign an image, the way vbutil_what_keys
+ * does, but from one look at the image instead of extracting its pieces.
+ * The keys are named by their sha1sums, and by the names of any known keys
+ * (read from a keyset directory of .vbpubk files) which match them.
+ */
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "2sysincludes.h"
+#include "2api.h"
+#include "2common.h"
+#include "2rsa.h"
+#include "file_type.h"
+#include "fmap.h"
+#include "futility.h"
+#include "gbb_header.h"
+#include "host_common.h"
+#include "keys_summary.h"
+#include "util_misc.h"
+#include "vb2_common.h"
+
+struct known_key {
+	/* The file name, without the .vbpubk */
+	char *name;
+	struct vb2_packed_key *packed;
+	struct vb2_public_key key;
+	char sha1[KEY_SHA1_STRING_SIZE];
+};
+
+static struct known_key *known_keys;
+static int known_key_count;
+
+static int compare_known_keys(const void *a, const void *b)
+{
+	return strcmp(((const struct known_key *)a)->name,
+		      ((const struct known_key *)b)->name);
+}
+
+static int add_known_key(const char *dir, const char *file)
+{
+	struct known_key *k;
+	char *path;
+	size_t len = strlen(file) - strlen(".vbpubk");
+
+	if (asprintf(&path, "%s/%s", dir, file) < 0)
+		return 1;
+
+	k = realloc(known_keys, (known_key_count + 1) * sizeof(*k));
+	if (!k) {
+		free(path);
+		return 1;
+	}
+	known_keys = k;
+	k += known_key_count;
+	memset(k, 0, sizeof(*k));
+
+	k->packed = vb2_read_packed_key(path);
+	if (!k->packed || VB2_SUCCESS != vb2_unpack_key(&k->key, k->packed)) {
+		fprintf(stderr, "Unable to read key %s\n", path);
+		free(k->packed);
+		free(path);
+		return 1;
+	}
+	free(path);
+
+	k->name = strndup(file, len);
+	if (!k->name) {
+		free(k->packed);
+		return 1;
+	}
+	packed_key_sha1_string_r(k->packed, k->sha1);
+	known_key_count++;
+	return 0;
+}
+
+int keys_summary_load_keyset(const char *dir)
+{
+	DIR *d = opendir(dir);
+	struct dirent *ent;
+	size_t len;
+	int errorcnt = 0;
+
+	if (!d) {
+		fprintf(stderr, "Can't open keyset %s\n", dir);
+		return 1;
+	}
+
+	while ((ent = readdir(d))) {
+		len = strlen(ent->d_name);
+		if (len <= strlen(".vbpubk") ||
+		    strcmp(ent->d_name + len - strlen(".vbpubk"), ".vbpubk"))
+			continue;
+		errorcnt += add_known_key(dir, ent->d_name);
+	}
+	closedir(d);
+
+	/* Directory order is arbitrary, but the output shouldn't be */
+	qsort(known_keys, known_key_count, sizeof(*known_keys),
+	      compare_known_keys);
+	return errorcnt;
+}
+
+void keys_summary_free_keyset(void)
+{
+	int i;
+
+	for (i = 0; i < known_key_count; i++) {
+		free(known_keys[i].name);
+		free(known_keys[i].packed);
+	}
+	free(known_keys);
+	known_keys = NULL;
+	known_key_count = 0;
+}
+
+/* Append [name] to the list in [dest]. */
+static void add_name(char *dest, size_t size, const char *name)
+{
+	size_t used = strlen(dest);
+
+	snprintf(dest + used, size - used, "%s%s", used ? ", " : "", name);
+}
+
+/* List the known keys with the sha1sum [sha1]. */
+static void find_key_names(const char *sha1, char *dest, size_t size)
+{
+	int i;
+
+	dest[0] = '\0';
+	for (i = 0; i < known_key_count; i++)
+		if (!strcmp(known_keys[i].sha1, sha1))
+			add_name(dest, size, known_keys[i].name);
+}
+
+/*
+ * See if [key] signed [keyblock]. Checking the signature destroys it, so this
+ * checks a copy at [copy].
+ */
+static int signed_by(const struct vb2_keyblock *keyblock, uint8_t *copy,
+		     const struct vb2_public_key *key,
+		     const struct vb2_workbuf *wb)
+{
+	uint32_t size = keyblock->keyblock_size;
+
+	/* Save copying anything for keys which can't have made the sig */
+	if (keyblock->keyblock_signature.sig_size !=
+	    vb2_rsa_sig_size(key->sig_alg))
+		return 0;
+
+	memcpy(copy, keyblock, size);
+	return VB2_SUCCESS == vb2_verify_keyblock((struct vb2_keyblock *)copy,
+						  size, key, wb);
+}
+
+void keys_summary_keyblock(struct keyblock_summary *s,
+			   const uint8_t *buf, uint32_t len,
+			   const struct vb2_public_key *signer,
+			   const char *signer_name,
+			   const struct vb2_workbuf *wb)
+{
+	const struct vb2_keyblock *keyblock = (const struct vb2_keyblock *)buf;
+	struct vb2_workbuf wblocal = *wb;
+	uint8_t *copy;
+	int i;
+
+	memset(s, 0, sizeof(*s));
+	if (VB2_SUCCESS != vb2_verify_keyblock_hash(keyblock, len, wb))
+		return;
+
+	s->valid = 1;
+	s->flags = keyblock->keyblock_flags;
+	packed_key_sha1_string_r(&keyblock->data_key, s->data_key_sha1);
+	find_key_names(s->data_key_sha1, s->data_key_names,
+		       sizeof(s->data_key_names));
+
+	copy = vb2_workbuf_alloc(&wblocal, keyblock->keyblock_size);
+	if (!copy)
+		return;
+
+	if (signer && signed_by(keyblock, copy, signer, &wblocal))
+		add_name(s->signer_names, sizeof(s->signer_names),
+			 signer_name);
+	for (i = 0; i < known_key_count; i++)
+		if (signed_by(keyblock, copy, &known_keys[i].key, &wblocal))
+			add_name(s->signer_names, sizeof(s->signer_names),
+				 known_keys[i].name);
+}
+
+void keys_summary_print_keyblock(const char *what,
+				 const struct keyblock_summary *s)
+{
+	char flags[sizeof(" !DEV DEV !REC REC")] = "";
+
+	if (!s->valid) {
+		printf("  %-16s--invalid--\n", what);
+		return;
+	}
+
+	if (s->flags & VB2_KEY_BLOCK_FLAG_DEVELOPER_0)
+		strcat(flags, " !DEV");
+	if (s->flags & VB2_KEY_BLOCK_FLAG_DEVELOPER_1)
+		strcat(flags, " DEV");
+	if (s->flags & VB2_KEY_BLOCK_FLAG_RECOVERY_0)
+		strcat(flags, " !REC");
+	if (s->flags & VB2_KEY_BLOCK_FLAG_RECOVERY_1)
+		strcat(flags, " REC");
+
+	printf("  %-16s%s  (%s)", what, s->data_key_sha1,
+	       *flags ? flags + 1 : "");
+	if (*s->data_key_names)
+		printf("  %s", s->data_key_names);
+	if (*s->signer_names)
+		printf("  signed by %s", s->signer_names);
+	printf("\n");
+}
+
+/* Print a packed key. Returns non-zero if there isn't one. */
+static int print_key(const char *what, const struct vb2_packed_key *key,
+		     uint32_t len)
+{
+	char sha1[KEY_SHA1_STRING_SIZE];
+	char names[KEY_NAMES_SIZE];
+
+	if (!packed_key_looks_ok(key, len)) {
+		printf("  %-16s--invalid--\n", what);
+		return 1;
+	}
+
+	packed_key_sha1_string_r(key, sha1);
+	find_key_names(sha1, names, sizeof(names));
+	printf("  %-16s%s%s%s\n", what, sha1, *names ? "  " : "", names);
+	return 0;
+}
+
+/*
+ * Print the HWID and keys from a GBB. If the root key is good, it's unpacked
+ * into [rootkey] for checking the firmware keyblocks.
+ */
+static int show_gbb_keys(GoogleBinaryBlockHeader *gbb, uint32_t len,
+			 struct vb2_public_key *rootkey, int *have_rootkey)
+{
+	uint8_t *buf = (uint8_t *)gbb;
+	struct vb2_packed_key *key;
+	uint32_t maxlen = 0;
+	int errorcnt = 0;
+
+	if (!futil_valid_gbb_header(gbb, len, &maxlen) || maxlen > len) {
+		printf("  %-16s--invalid--\n", "GBB:");
+		return 1;
+	}
+
+	printf("  %-16s%.*s\n", "hwid:", gbb->hwid_size,
+	       buf + gbb->hwid_offset);
+
+	key = (struct vb2_packed_key *)(buf + gbb->rootkey_offset);
+	if (print_key("root key:", key, gbb->rootkey_size))
+		errorcnt++;
+	else if (rootkey && VB2_SUCCESS == vb2_unpack_key(rootkey, key))
+		*have_rootkey = 1;
+
+	key = (struct vb2_packed_key *)(buf + gbb->recovery_key_offset);
+	errorcnt += print_key("recovery key:", key, gbb->recovery_key_size);
+
+	return errorcnt;
+}
+
+static int show_bios_keys(const char *name, uint8_t *buf, uint32_t len,
+			  const struct vb2_workbuf *wb)
+{
+	static const char * const vblock_names[][2] = {
+		{"VBLOCK_A", "Firmware A Key"},
+		{"VBLOCK_B", "Firmware B Key"},
+	};
+	GoogleBinaryBlockHeader *gbb;
+	FmapHeader *fmap;
+	FmapAreaHeader *ah;
+	struct keyblock_summary s;
+	struct vb2_public_key rootkey;
+	int have_rootkey = 0;
+	char what[FMAP_NAMELEN + 2];
+	int errorcnt = 0;
+	int i, j;
+
+	printf("BIOS: %s\n", name);
+
+	gbb = futil_find_gbb(buf, len, NULL);
+	if (!gbb) {
+		printf("  %-16s--missing--\n", "GBB:");
+		errorcnt++;
+	} else {
+		errorcnt += show_gbb_keys(gbb, len - ((uint8_t *)gbb - buf),
+					  &rootkey, &have_rootkey);
+	}
+
+	fmap = fmap_find(buf, len);
+	for (i = 0; i < ARRAY_SIZE(vblock_names); i++) {
+		for (j = 0; j < 2; j++)
+			if (fmap_find_by_name(buf, len, fmap,
+					      vblock_names[i][j], &ah))
+				break;
+		if (j == 2 || ah->area_offset > len ||
+		    ah->area_size > len - ah->area_offset)
+			continue;
+
+		snprintf(what, sizeof(what), "%.*s:", FMAP_NAMELEN,
+			 ah->area_name);
+		keys_summary_keyblock(&s, buf + ah->area_offset,
+				      ah->area_size,
+				      have_rootkey ? &rootkey : NULL,
+				      "root key", wb);
+		keys_summary_print_keyblock(what, &s);
+		if (!s.valid)
+			errorcnt++;
+	}
+
+	return errorcnt;
+}
+
+int show_keys_summary(enum futil_file_type type, const char *name,
+		      uint8_t *buf, uint32_t len)
+{
+	struct keyblock_summary s;
+	struct vb2_workbuf wb;
+	uint8_t *workbuf;
+	int retval = 1;
+
+	/* A disk image has its own buffer for each partition */
+	if (type == FILE_TYPE_CHROMIUMOS_DISK)
+		return ft_show_disk_keys(name, buf, len);
+
+	workbuf = malloc(VB2_KERNEL_WORKBUF_RECOMMENDED_SIZE);
+	if (!workbuf) {
+		fprintf(stderr, "Couldn't allocate memory\n");
+		return 1;
+	}
+	vb2_workbuf_init(&wb, workbuf, VB2_KERNEL_WORKBUF_RECOMMENDED_SIZE);
+
+	switch (type) {
+	case FILE_TYPE_BIOS_IMAGE:
+	case FILE_TYPE_OLD_BIOS_IMAGE:
+		retval = show_bios_keys(name, buf, len, &wb);
+		break;
+	case FILE_TYPE_GBB:
+		printf("GBB: %s\n", name);
+		retval = show_gbb_keys((GoogleBinaryBlockHeader *)buf, len,
+				       NULL, NULL);
+		break;
+	case FILE_TYPE_KEYBLOCK:
+	case FILE_TYPE_FW_PREAMBLE:
+	case FILE_TYPE_KERN_PREAMBLE:
+		printf("KEYBLOCK: %s\n", name);
+		keys_summary_keyblock(&s, buf, len, NULL, NULL, &wb);
+		keys_summary_print_keyblock("keyblock:", &s);
+		retval = !s.valid;
+		break;
+	case FILE_TYPE_PUBKEY:
+		printf("KEY: %s\n", name);
+		retval = print_key("key:", (struct vb2_packed_key *)buf, len);
+		break;
+	default:
+		fprintf(stderr, "%s: can't summarize the keys of type %s\n",
+			name, futil_file_type_name(type));
+		break;
+	}
+
+	free(workbuf);
+	return retval;
+}
@@ -0,0 +1,66 @@
+/*
+ * Copyright 2018 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ */
+#ifndef VBOOT_REFERENCE_FUTILITY_KEYS_SUMMARY_H_
+#define VBOOT_REFERENCE_FUTILITY_KEYS_SUMMARY_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "file_type.h"
+#include "util_misc.h"
+
+struct vb2_public_key;
+struct vb2_workbuf;
+
+/* Room for the names of all the known keys matching one key */
+#define KEY_NAMES_SIZE 256
+
+/* What one keyblock says about the keys around it */
+struct keyblock_summary {
+	/* Zero if the keyblock is damaged, and the rest is meaningless */
+	int valid;
+	uint32_t flags;
+	char data_key_sha1[KEY_SHA1_STRING_SIZE];
+	/* Known keys with the same data key, or which signed the keyblock */
+	char data_key_names[KEY_NAMES_SIZE];
+	char signer_names[KEY_NAMES_SIZE];
+};
+
+/*
+ * Read every .vbpubk in [dir] as a known key, to be named in the summaries.
+ * Returns non-zero if error.
+ */
+int keys_summary_load_keyset(const char *dir);
+
+/* Forget the known keys. */
+void keys_summary_free_keyset(void);
+
+/*
+ * Summarize the keyblock at [buf]. Apart from the known keys, [signer] is
+ * tried as its signer too, and reported as [signer_name]. Only [wb] and [s]
+ * are written to, so any number of these can run at once.
+ */
+void keys_summary_keyblock(struct keyblock_summary *s,
+			   const uint8_t *buf, uint32_t len,
+			   const struct vb2_public_key *signer,
+			   const char *signer_name,
+			   const struct vb2_workbuf *wb);
+
+/* Print one line of a summary, for the keyblock [s] at [what]. */
+void keys_summary_print_keyblock(const char *what,
+				 const struct keyblock_summary *s);
+
+/*
+ * Print which keys were used to sign the [type] image at [buf]. Returns
+ * non-zero if the image doesn't have any keys we know how to look at.
+ */
+int show_keys_summary(enum futil_file_type type, const char *name,
+		      uint8_t *buf, uint32_t len);
+
+/* Summarize every kernel partition in a disk image */
+int ft_show_disk_keys(const char *name, uint8_t *buf, uint32_t len);
+
+#endif	/* VBOOT_REFERENCE_FUTILITY_KEYS_SUMMARY_H_ */
@@ -4,7 +4,9 @@
  * found in the LICENSE file.
  */
 
+#include <ctype.h>
 #include <errno.h>
+#include <fcntl.h>
 #ifndef HAVE_MACOS
 #include <linux/fs.h>		/* For BLKGETSIZE64 */
 #endif
@@ -17,7 +19,6 @@
 #include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/types.h>
-#include <sys/wait.h>
 #include <unistd.h>
 
 #include "2sysincludes.h"
@@ -26,6 +27,7 @@
 #include "2sha.h"
 #include "cgptlib_internal.h"
 #include "file_type.h"
+#include "fmap.h"
 #include "futility.h"
 #include "gbb_header.h"
 
@@ -60,16 +62,22 @@ static inline uint32_t max(uint32_t a, uint32_t b)
 	return a > b ? a : b;
 }
 
-enum futil_file_type ft_recognize_gbb(uint8_t *buf, uint32_t len)
+static inline uint32_t min(uint32_t a, uint32_t b)
+{
+	return a < b ? a : b;
+}
+
+enum futil_file_type ft_recognize_gbb(uint8_t *buf, uint32_t len,
+				      const struct futil_file_index *index)
 {
 	GoogleBinaryBlockHeader *gbb = (GoogleBinaryBlockHeader *)buf;
 
+	if (sizeof(GoogleBinaryBlockHeader) > len)
+		return FILE_TYPE_UNKNOWN;
 	if (memcmp(gbb->signature, GBB_SIGNATURE, GBB_SIGNATURE_SIZE))
 		return FILE_TYPE_UNKNOWN;
 	if (gbb->major_version > GBB_MAJOR_VER)
 		return FILE_TYPE_UNKNOWN;
-	if (sizeof(GoogleBinaryBlockHeader) > len)
-		return FILE_TYPE_UNKNOWN;
 
 	/* close enough */
 	return FILE_TYPE_GBB;
@@ -130,6 +138,62 @@ int futil_valid_gbb_header(GoogleBinaryBlockHeader *gbb, uint32_t len,
 	return 1;
 }
 
+#define GBB_SEARCH_STRIDE 4
+
+GoogleBinaryBlockHeader *futil_find_gbb(uint8_t *buf, uint32_t len,
+					int *count_ptr)
+{
+	GoogleBinaryBlockHeader *gbb = NULL;
+	FmapHeader *fmap;
+	FmapAreaHeader *ah;
+	uint8_t *p = NULL;
+	int count = 0;
+
+	/* An FMAP says where the GBB is, if the image has one */
+	fmap = fmap_find(buf, len);
+	if (fmap) {
+		p = fmap_find_by_name(buf, len, fmap, "GBB", &ah);
+		if (!p)
+			p = fmap_find_by_name(buf, len, fmap, "GBB Area", &ah);
+	}
+	if (p && ah->area_offset < len &&
+	    futil_valid_gbb_header((GoogleBinaryBlockHeader *)p,
+				   min(ah->area_size, len - ah->area_offset),
+				   NULL)) {
+		gbb = (GoogleBinaryBlockHeader *)p;
+		count = 1;
+		goto done;
+	}
+
+	/* A bare GBB blob starts with its header */
+	if (futil_valid_gbb_header((GoogleBinaryBlockHeader *)buf, len, NULL)) {
+		gbb = (GoogleBinaryBlockHeader *)buf;
+		count = 1;
+		goto done;
+	}
+
+	/*
+	 * Otherwise look everywhere. memmem() finds the signature much faster
+	 * than comparing at every stride.
+	 */
+	for (p = buf; (p = memmem(p, buf + len - p, GBB_SIGNATURE,
+				  GBB_SIGNATURE_SIZE)); p++) {
+		if ((p - buf) % GBB_SEARCH_STRIDE)
+			continue;
+		if (futil_valid_gbb_header((GoogleBinaryBlockHeader *)p,
+					   buf + len - p, NULL))
+			if (!count++)
+				gbb = (GoogleBinaryBlockHeader *)p;
+	}
+	if (count > 1)
+		gbb = NULL;
+
+done:
+	if (count_ptr)
+		*count_ptr = count;
+	return gbb;
+}
+
 /* For GBB v1.2 and later, print the stored digest of the HWID (and whether
  * it's correct). Return true if it is correct. */
 int print_hwid_digest(GoogleBinaryBlockHeader *gbb,
@@ -181,58 +245,133 @@ void update_hwid_digest(GoogleBinaryBlockHeader *gbb)
 			  gbb->hwid_digest, sizeof(gbb->hwid_digest));
 }
 
+/* Buffer size for copying file data with read() and write() */
+#define COPY_CHUNK_SIZE (1024 * 1024)
+
+/* Copy [offset, offset + size) between descriptors. Returns 0 on success. */
+static int copy_file_data(int ifd, int ofd, off_t offset, off_t size)
+{
+	uint8_t *buf;
+	ssize_t n;
+
+#ifndef HAVE_MACOS
+	/* Let the kernel move the data, or share it if the filesystem can */
+	while (size > 0) {
+		off_t in_off = offset, out_off = offset;
+		n = copy_file_range(ifd, &in_off, ofd, &out_off, size, 0);
+		if (n <= 0)
+			break;
+		offset += n;
+		size -= n;
+	}
+#endif
+
+	if (size <= 0)
+		return 0;
+
+	buf = malloc(COPY_CHUNK_SIZE);
+	if (!buf)
+		return -1;
+
+	while (size > 0) {
+		n = pread(ifd, buf,
+			  size < COPY_CHUNK_SIZE ? size : COPY_CHUNK_SIZE,
+			  offset);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0 || pwrite(ofd, buf, n, offset) != n) {
+			free(buf);
+			return -1;
+		}
+		offset += n;
+		size -= n;
+	}
+
+	free(buf);
+	return 0;
+}
+
 /*
- * TODO: All sorts of race conditions likely here, and everywhere this is used.
- * Do we care? If so, fix it.
+ * Copy a whole file, leaving holes where the input has them. Returns 0 on
+ * success.
  */
+static int copy_file_sparse(int ifd, int ofd, off_t size)
+{
+	off_t data, hole;
+
+	if (ftruncate(ofd, size))
+		return -1;
+
+	for (data = 0; data < size; data = hole) {
+#ifdef SEEK_DATA
+		data = lseek(ifd, data, SEEK_DATA);
+		if (data < 0)
+			/* ENXIO means only a hole is left */
+			return errno == ENXIO ? 0 : -1;
+		hole = lseek(ifd, data, SEEK_HOLE);
+		if (hole < 0)
+			return -1;
+#else
+		hole = size;
+#endif
+		if (hole > size)
+			hole = size;
+		if (copy_file_data(ifd, ofd, data, hole - data))
+			return -1;
+	}
+
+	return 0;
+}
+
 void futil_copy_file_or_die(const char *infile, const char *outfile)
 {
-	pid_t pid;
-	int status;
+	struct stat sb;
+	int ifd, ofd;
 
 	Debug("%s(%s, %s)\n", __func__, infile, outfile);
 
-	pid = fork();
-
-	if (pid < 0) {
-		fprintf(stderr, "Couldn't fork /bin/cp process: %s\n",
-			strerror(errno));
+	ifd = open(infile, O_RDONLY);
+	if (ifd < 0) {
+		fprintf(stderr, "Can't open %s for reading: %s\n",
+			infile, strerror(errno));
 		exit(1);
 	}
-
-	/* child */
-	if (!pid) {
-		execl("/bin/cp", "/bin/cp", infile, outfile, NULL);
-		fprintf(stderr, "Child couldn't exec /bin/cp: %s\n",
-			strerror(errno));
+	if (fstat(ifd, &sb)) {
+		fprintf(stderr, "Can't stat %s: %s\n",
+			infile, strerror(errno));
 		exit(1);
 	}
 
-	/* parent - wait for child to finish */
-	if (wait(&status) == -1) {
-		fprintf(stderr,
-			"Couldn't wait for /bin/cp process to exit: %s\n",
-			strerror(errno));
+	ofd = open(outfile, O_WRONLY | O_CREAT | O_TRUNC, sb.st_mode & 0777);
+	if (ofd < 0) {
+		fprintf(stderr, "Can't open %s for writing: %s\n",
+			outfile, strerror(errno));
 		exit(1);
 	}
 
-	if (WIFEXITED(status)) {
-		status = WEXITSTATUS(status);
-		/* zero is normal exit */
-		if (!status)
-			return;
-		fprintf(stderr, "/bin/cp exited with status %d\n", status);
+	/*
+	 * Signing only changes a few blocks, so a reflink copy which shares
+	 * the rest with the input is best. Otherwise copy just the data.
+	 */
+#ifdef FICLONE
+	if (!ioctl(ofd, FICLONE, ifd))
+		goto done;
+#endif
+	if (copy_file_sparse(ifd, ofd, sb.st_size)) {
+		fprintf(stderr, "Can't copy %s to %s: %s\n",
+			infile, outfile, strerror(errno));
 		exit(1);
 	}
 
-	if (WIFSIGNALED(status)) {
-		status = WTERMSIG(status);
-		fprintf(stderr, "/bin/cp was killed with signal %d\n", status);
+#ifdef FICLONE
+done:
+#endif
+	if (close(ofd)) {
+		fprintf(stderr, "Can't close %s: %s\n",
+			outfile, strerror(errno));
 		exit(1);
 	}
-
-	fprintf(stderr, "I have no idea what just happened\n");
-	exit(1);
+	close(ifd);
 }
 
 
@@ -304,7 +443,8 @@ enum futil_file_err futil_unmap_file(int fd, int writeable,
 
 
 #define DISK_SECTOR_SIZE 512
-enum futil_file_type ft_recognize_gpt(uint8_t *buf, uint32_t len)
+enum futil_file_type ft_recognize_gpt(uint8_t *buf, uint32_t len,
+				      const struct futil_file_index *index)
 {
 	GptHeader *h;
 
@@ -329,3 +469,41 @@ enum futil_file_type ft_recognize_gpt(uint8_t *buf, uint32_t len)
 
 	return FILE_TYPE_CHROMIUMOS_DISK;
 }
+
+int futil_split_line(char *line, char *args[], int max_args)
+{
+	char *in = line;
+	char *out;
+	char quote;
+	int count = 0;
+
+	while (1) {
+		while (isspace((unsigned char)*in))
+			in++;
+		if (!*in || *in == '#')
+			return count;
+		if (count == max_args)
+			return -1;
+
+		args[count++] = out = in;
+		for (quote = 0; *in; in++) {
+			if (quote) {
+				if (*in == quote)
+					quote = 0;
+				else
+					*out++ = *in;
+			} else if (*in == '\'' || *in == '"') {
+				quote = *in;
+			} else if (isspace((unsigned char)*in)) {
+				break;
+			} else {
+				*out++ = *in;
+			}
+		}
+		if (quote)
+			return -1;
+		if (*in)
+			in++;
+		*out = '\0';
+	}
+}
@@ -5,6 +5,7 @@
  */
 
 #include <errno.h>
+#include <fcntl.h>
 #include <inttypes.h>		/* For PRIu64 */
 #include <stdio.h>
 #include <string.h>
@@ -19,6 +20,7 @@
 #include "file_type.h"
 #include "futility.h"
 #include "host_common.h"
+#include "host_signature2.h"
 #include "kernel_blob.h"
 #include "util_misc.h"
 #include "vb1_helper.h"
@@ -158,8 +160,9 @@ static int KernelSize(uint8_t *kernel_buf,
 	return kernel_size - kernel32_start;
 }
 
-/* This extracts g_kernel_* and g_param_* from a standard vmlinuz file.
- * It returns nonzero on error. */
+/* This extracts g_kernel_size and g_param_* from a standard vmlinuz file.
+ * The 32-bit kernel itself stays in [kernel_buf], following the
+ * g_vmlinuz_header_size bytes of header. It returns nonzero on error. */
 static int PickApartVmlinuz(uint8_t *kernel_buf,
 			    uint32_t kernel_size,
 			    enum arch_t arch,
@@ -224,12 +227,9 @@ static int PickApartVmlinuz(uint8_t *kernel_buf,
 	Debug(" kernel32_start=0x%" PRIx64 "\n", kernel32_start);
 	Debug(" kernel32_size=0x%" PRIx64 "\n", kernel32_size);
 
-	/* Keep just the 32-bit kernel. */
-	if (kernel32_size) {
+	/* The caller keeps just the 32-bit kernel. */
+	if (kernel32_size)
 		g_kernel_size = kernel32_size;
-		memcpy(g_kernel_data, kernel_buf + kernel32_start,
-		       g_kernel_size);
-	}
 
 	/* done */
 	return 0;
@@ -365,6 +365,13 @@ uint8_t *unpack_kernel_partition(uint8_t *kpart_data,
 	uint32_t flags = vb2_kernel_get_flags(preamble);
 	Debug(" flags = 0x%x\n", flags);
 
+	/* The parts of a compressed blob can't be found without unpacking */
+	if (vb2_kernel_get_compression(preamble) !=
+	    VB2_KERNEL_COMPRESSION_NONE) {
+		fprintf(stderr, "Kernel body is compressed\n");
+		return NULL;
+	}
+
 	g_preamble = preamble;
 	g_ondisk_bootloader_addr = g_preamble->bootloader_address;
 
@@ -401,29 +408,22 @@ uint8_t *unpack_kernel_partition(uint8_t *kpart_data,
 	return g_kernel_blob_data;
 }
 
-uint8_t *SignKernelBlob(uint8_t *kernel_blob,
-			uint32_t kernel_size,
-			uint32_t padding,
-			int version,
-			uint64_t kernel_body_load_address,
-			struct vb2_keyblock *keyblock,
-			struct vb2_private_key *signpriv_key,
-			uint32_t flags,
-			uint32_t *vblock_size_ptr)
+/* Build a kernel vblock (keyblock + preamble) around [body_sig] and the
+ * optional chunk [digests], using the blob layout in the globals. */
+uint8_t *CreateKernelVblock(struct vb2_signature *body_sig,
+			    const struct vb2_body_digests *digests,
+			    uint32_t padding,
+			    int version,
+			    uint64_t kernel_body_load_address,
+			    struct vb2_keyblock *keyblock,
+			    struct vb2_private_key *signpriv_key,
+			    uint32_t flags,
+			    uint32_t *vblock_size_ptr)
 {
 	/* Make sure the preamble fills up the rest of the required padding */
 	uint32_t min_size = padding > keyblock->keyblock_size
 		? padding - keyblock->keyblock_size : 0;
 
-	/* Sign the kernel data */
-	struct vb2_signature *body_sig = vb2_calculate_signature(kernel_blob,
-								 kernel_size,
-								 signpriv_key);
-	if (!body_sig) {
-		fprintf(stderr, "Error calculating body signature\n");
-		return NULL;
-	}
-
 	/* Create preamble */
 	struct vb2_kernel_preamble *preamble =
 		vb2_create_kernel_preamble(version,
@@ -434,6 +434,10 @@ uint8_t *SignKernelBlob(uint8_t *kernel_blob,
 					   g_ondisk_vmlinuz_header_addr,
 					   g_vmlinuz_header_size,
 					   flags,
+					   digests ? digests->chunk_size : 0,
+					   digests ? digests->digests : NULL,
+					   digests ? digests->digests_size : 0,
+					   0,
 					   min_size,
 					   signpriv_key);
 	if (!preamble) {
@@ -446,12 +450,60 @@ uint8_t *SignKernelBlob(uint8_t *kernel_blob,
 	memcpy(outbuf, keyblock, keyblock->keyblock_size);
 	memcpy(outbuf + keyblock->keyblock_size,
 	       preamble, preamble->preamble_size);
+	free(preamble);
 
 	if (vblock_size_ptr)
 		*vblock_size_ptr = outsize;
 	return outbuf;
 }
 
+uint8_t *SignKernelBlob(uint8_t *kernel_blob,
+			uint32_t kernel_size,
+			uint32_t padding,
+			int version,
+			uint64_t kernel_body_load_address,
+			struct vb2_keyblock *keyblock,
+			struct vb2_private_key *signpriv_key,
+			uint32_t flags,
+			uint32_t body_chunk_size,
+			uint32_t *vblock_size_ptr)
+{
+	struct vb2_body_digests digests = {0};
+	uint8_t *outbuf;
+
+	/* Digest each chunk of the kernel data, if asked to */
+	if (body_chunk_size &&
+	    (VB2_SUCCESS != vb2_body_digests_init(&digests,
+						  signpriv_key->hash_alg,
+						  body_chunk_size) ||
+	     VB2_SUCCESS != vb2_body_digests_extend(&digests, kernel_blob,
+						    kernel_size) ||
+	     VB2_SUCCESS != vb2_body_digests_finalize(&digests))) {
+		fprintf(stderr, "Error calculating body chunk digests\n");
+		free(digests.digests);
+		return NULL;
+	}
+
+	/* Sign the kernel data */
+	struct vb2_signature *body_sig = vb2_calculate_signature(kernel_blob,
+								 kernel_size,
+								 signpriv_key);
+	if (!body_sig) {
+		fprintf(stderr, "Error calculating body signature\n");
+		free(digests.digests);
+		return NULL;
+	}
+
+	outbuf = CreateKernelVblock(body_sig,
+				    body_chunk_size ? &digests : NULL,
+				    padding, version,
+				    kernel_body_load_address, keyblock,
+				    signpriv_key, flags, vblock_size_ptr);
+	free(body_sig);
+	free(digests.digests);
+	return outbuf;
+}
+
 /* Returns zero on success */
 int WriteSomeParts(const char *outfile,
 		   void *part1_data, uint32_t part1_size,
@@ -615,6 +667,19 @@ int VerifyKernelBlob(uint8_t *kernel_blob,
 
 	printf("  Flags          :       0x%x\n",
 	       vb2_kernel_get_flags(g_preamble));
+	if (vb2_kernel_get_compression(g_preamble) !=
+	    VB2_KERNEL_COMPRESSION_NONE) {
+		printf("  Body compression:    %u\n",
+		       vb2_kernel_get_compression(g_preamble));
+		printf("  Body load size:      0x%x\n",
+		       vb2_kernel_get_body_load_size(g_preamble));
+	}
+	if (vb2_kernel_get_body_chunk_size(g_preamble)) {
+		printf("  Body chunk size:     0x%x\n",
+		       vb2_kernel_get_body_chunk_size(g_preamble));
+		printf("  Body chunks:         %u\n",
+		       vb2_kernel_get_body_chunk_count(g_preamble));
+	}
 
 	if (g_preamble->kernel_version < (min_version & 0xFFFF)) {
 		fprintf(stderr,
@@ -627,26 +692,58 @@ int VerifyKernelBlob(uint8_t *kernel_blob,
 	if (VB2_SUCCESS !=
 	    vb2_verify_data(kernel_blob, kernel_size,
 			    &g_preamble->body_signature,
-			    &pubkey, &wb)) {
+			    &pubkey, &wb) ||
+	    VerifyKernelBodyChunks(g_preamble, kernel_blob, kernel_size,
+				   pubkey.hash_alg)) {
 		fprintf(stderr, "Error verifying kernel body.\n");
 		goto done;
 	}
 	printf("Body verification succeeded.\n");
 
-	printf("Config:\n%s\n",
-	       kernel_blob + kernel_cmd_line_offset(g_preamble));
+	/* The config is somewhere inside a compressed body */
+	if (vb2_kernel_get_compression(g_preamble) ==
+	    VB2_KERNEL_COMPRESSION_NONE)
+		printf("Config:\n%s\n",
+		       kernel_blob + kernel_cmd_line_offset(g_preamble));
 
 	rv = 0;
 done:
 	return rv;
 }
 
+int VerifyKernelBodyChunks(const struct vb2_kernel_preamble *preamble,
+			   const uint8_t *kernel_blob, uint32_t kernel_size,
+			   enum vb2_hash_algorithm hash_alg)
+{
+	uint32_t chunk_size = vb2_kernel_get_body_chunk_size(preamble);
+	uint32_t count = vb2_kernel_get_body_chunk_count(preamble);
+	uint32_t size = preamble->body_signature.data_size;
+	uint32_t i, n;
 
-uint8_t *CreateKernelBlob(uint8_t *vmlinuz_buf, uint32_t vmlinuz_size,
-			  enum arch_t arch, uint64_t kernel_body_load_address,
-			  uint8_t *config_data, uint32_t config_size,
-			  uint8_t *bootloader_data, uint32_t bootloader_size,
-			  uint32_t *blob_size_ptr)
+	if (size > kernel_size)
+		return 1;
+
+	for (i = 0; i < count; i++, size -= n) {
+		n = size < chunk_size ? size : chunk_size;
+		if (VB2_SUCCESS !=
+		    vb2_verify_kernel_body_chunk(preamble, i,
+						 kernel_blob + i * chunk_size,
+						 n, hash_alg)) {
+			fprintf(stderr, "Error verifying body chunk %u.\n", i);
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+/* Work out the size and location of each part of a new kernel blob, leaving
+ * them in the globals, and return the size of the whole blob. Returns 0 on
+ * error. */
+static uint32_t LayoutKernelBlob(uint8_t *vmlinuz_buf, uint32_t vmlinuz_size,
+				 enum arch_t arch,
+				 uint64_t kernel_body_load_address,
+				 uint32_t bootloader_size)
 {
 	uint32_t now = 0;
 	int tmp;
@@ -654,7 +751,7 @@ uint8_t *CreateKernelBlob(uint8_t *vmlinuz_buf, uint32_t vmlinuz_size,
 	/* We have all the parts. How much room do we need? */
 	tmp = KernelSize(vmlinuz_buf, vmlinuz_size, arch);
 	if (tmp < 0)
-		return NULL;
+		return 0;
 	g_kernel_size = tmp;
 	g_config_size = CROS_CONFIG_SIZE;
 	g_param_size = CROS_PARAMS_SIZE;
@@ -668,27 +765,18 @@ uint8_t *CreateKernelBlob(uint8_t *vmlinuz_buf, uint32_t vmlinuz_size,
 		g_vmlinuz_header_size;
 	Debug("g_kernel_blob_size  0x%" PRIx64 "\n", g_kernel_blob_size);
 
-	/* Allocate space for the blob. */
-	g_kernel_blob_data = malloc(g_kernel_blob_size);
-	memset(g_kernel_blob_data, 0, g_kernel_blob_size);
-
-	/* Assign the sub-pointers */
-	g_kernel_data = g_kernel_blob_data + now;
 	Debug("g_kernel_size       0x%" PRIx64 " ofs 0x%" PRIx64 "\n",
 	      g_kernel_size, now);
 	now += roundup(g_kernel_size, CROS_ALIGN);
 
-	g_config_data = g_kernel_blob_data + now;
 	Debug("g_config_size       0x%" PRIx64 " ofs 0x%" PRIx64 "\n",
 	      g_config_size, now);
 	now += g_config_size;
 
-	g_param_data = g_kernel_blob_data + now;
 	Debug("g_param_size        0x%" PRIx64 " ofs 0x%" PRIx64 "\n",
 	      g_param_size, now);
 	now += g_param_size;
 
-	g_bootloader_data = g_kernel_blob_data + now;
 	Debug("g_bootloader_size   0x%" PRIx64 " ofs 0x%" PRIx64 "\n",
 	      g_bootloader_size, now);
 	g_ondisk_bootloader_addr = kernel_body_load_address + now;
@@ -697,7 +785,6 @@ uint8_t *CreateKernelBlob(uint8_t *vmlinuz_buf, uint32_t vmlinuz_size,
 	now += g_bootloader_size;
 
 	if (g_vmlinuz_header_size) {
-		g_vmlinuz_header_data = g_kernel_blob_data + now;
 		Debug("g_vmlinuz_header_size 0x%" PRIx64 " ofs 0x%" PRIx64 "\n",
 		      g_vmlinuz_header_size, now);
 		g_ondisk_vmlinuz_header_addr = kernel_body_load_address + now;
@@ -706,6 +793,30 @@ uint8_t *CreateKernelBlob(uint8_t *vmlinuz_buf, uint32_t vmlinuz_size,
 	}
 
 	Debug("end of kern_blob at kern_blob+0x%" PRIx64 "\n", now);
+	return g_kernel_blob_size;
+}
+
+uint8_t *CreateKernelBlob(uint8_t *vmlinuz_buf, uint32_t vmlinuz_size,
+			  enum arch_t arch, uint64_t kernel_body_load_address,
+			  uint8_t *config_data, uint32_t config_size,
+			  uint8_t *bootloader_data, uint32_t bootloader_size,
+			  uint32_t *blob_size_ptr)
+{
+	if (!LayoutKernelBlob(vmlinuz_buf, vmlinuz_size, arch,
+			      kernel_body_load_address, bootloader_size))
+		return NULL;
+
+	/* Allocate space for the blob. */
+	g_kernel_blob_data = malloc(g_kernel_blob_size);
+	memset(g_kernel_blob_data, 0, g_kernel_blob_size);
+
+	/* Assign the sub-pointers */
+	g_kernel_data = g_kernel_blob_data;
+	g_config_data = g_kernel_data + roundup(g_kernel_size, CROS_ALIGN);
+	g_param_data = g_config_data + g_config_size;
+	g_bootloader_data = g_param_data + g_param_size;
+	if (g_vmlinuz_header_size)
+		g_vmlinuz_header_data = g_bootloader_data + g_bootloader_size;
 
 	/* Copy the kernel and params bits into the correct places */
 	if (0 != PickApartVmlinuz(vmlinuz_buf, vmlinuz_size,
@@ -716,6 +827,8 @@ uint8_t *CreateKernelBlob(uint8_t *vmlinuz_buf, uint32_t vmlinuz_size,
 		g_kernel_blob_size = 0;
 		return NULL;
 	}
+	memcpy(g_kernel_data, vmlinuz_buf + g_vmlinuz_header_size,
+	       g_kernel_size);
 
 	/* Copy the other bits too */
 	memcpy(g_config_data, config_data, config_size);
@@ -731,7 +844,178 @@ uint8_t *CreateKernelBlob(uint8_t *vmlinuz_buf, uint32_t vmlinuz_size,
 	return g_kernel_blob_data;
 }
 
-enum futil_file_type ft_recognize_vblock1(uint8_t *buf, uint32_t len)
+/* Write [size] bytes of [buf] to [fd] at [offset]. Returns zero on success. */
+static int WriteAt(int fd, const uint8_t *buf, uint32_t size, off_t offset)
+{
+	while (size) {
+		ssize_t n = pwrite(fd, buf, size, offset);
+		if (n <= 0)
+			return -1;
+		buf += n;
+		size -= n;
+		offset += n;
+	}
+	return 0;
+}
+
+/* Feed the body signature digest and the chunk [digests], if any. Returns
+ * zero on success. */
+static int hash_some(struct vb2_digest_context *dc,
+		     struct vb2_body_digests *digests,
+		     const uint8_t *buf, uint32_t size)
+{
+	if (VB2_SUCCESS != vb2_digest_extend(dc, buf, size))
+		return -1;
+	if (digests &&
+	    VB2_SUCCESS != vb2_body_digests_extend(digests, buf, size))
+		return -1;
+	return 0;
+}
+
+/* Returns zero on success */
+int WriteSignedKernelBlob(const char *outfile, int vblock_only,
+			  uint8_t *vmlinuz_buf, uint32_t vmlinuz_size,
+			  enum arch_t arch, uint64_t kernel_body_load_address,
+			  uint8_t *config_data, uint32_t config_size,
+			  uint8_t *bootloader_data, uint32_t bootloader_size,
+			  uint32_t padding,
+			  int version,
+			  struct vb2_keyblock *keyblock,
+			  struct vb2_private_key *signpriv_key,
+			  uint32_t flags,
+			  uint32_t body_chunk_size)
+{
+	static const uint8_t zeroes[CROS_ALIGN];
+	uint8_t config_buf[CROS_CONFIG_SIZE] = {0};
+	uint8_t param_buf[CROS_PARAMS_SIZE] = {0};
+	uint8_t digest[VB2_MAX_DIGEST_SIZE];
+	struct vb2_digest_context dc;
+	struct vb2_body_digests digests = {0};
+	struct vb2_signature *body_sig;
+	uint8_t *vblock_data;
+	uint32_t vblock_size;
+	uint32_t ofs = 0;
+	uint64_t start;
+	int fd;
+	int i;
+
+	if (!LayoutKernelBlob(vmlinuz_buf, vmlinuz_size, arch,
+			      kernel_body_load_address, bootloader_size))
+		return -1;
+
+	/* Only the small parts of the blob are built in memory. The config
+	 * goes in after the params, exactly as CreateKernelBlob() does it. */
+	g_config_data = config_buf;
+	g_param_data = param_buf;
+	if (0 != PickApartVmlinuz(vmlinuz_buf, vmlinuz_size,
+				  arch, kernel_body_load_address)) {
+		fprintf(stderr, "Error picking apart kernel file.\n");
+		return -1;
+	}
+	memcpy(config_buf, config_data, config_size);
+
+	/* The parts of the blob, in order, each padded out with zeroes */
+	const struct {
+		const uint8_t *data;
+		uint32_t size;
+		uint32_t padded_size;
+	} parts[] = {
+		{vmlinuz_buf + g_vmlinuz_header_size, g_kernel_size,
+		 roundup(g_kernel_size, CROS_ALIGN)},
+		{config_buf, g_config_size, g_config_size},
+		{param_buf, g_param_size, g_param_size},
+		{bootloader_data, bootloader_size, g_bootloader_size},
+		{vmlinuz_buf, g_vmlinuz_header_size, g_vmlinuz_header_size},
+	};
+
+	/* Hash the blob a piece at a time, along with any chunk digests */
+	start = vb2_sign_stats_start();
+	if (VB2_SUCCESS != vb2_digest_init(&dc, signpriv_key->hash_alg))
+		return -1;
+	if (body_chunk_size &&
+	    VB2_SUCCESS != vb2_body_digests_init(&digests,
+						 signpriv_key->hash_alg,
+						 body_chunk_size))
+		return -1;
+	for (i = 0; i < ARRAY_SIZE(parts); i++) {
+		uint32_t pad = parts[i].padded_size - parts[i].size;
+
+		if (hash_some(&dc, body_chunk_size ? &digests : NULL,
+			      parts[i].data, parts[i].size))
+			goto error_digests;
+		while (pad) {
+			uint32_t n = pad < sizeof(zeroes) ? pad : sizeof(zeroes);
+			if (hash_some(&dc, body_chunk_size ? &digests : NULL,
+				      zeroes, n))
+				goto error_digests;
+			pad -= n;
+		}
+	}
+	if (VB2_SUCCESS != vb2_digest_finalize(&dc, digest, sizeof(digest)))
+		goto error_digests;
+	if (body_chunk_size &&
+	    VB2_SUCCESS != vb2_body_digests_finalize(&digests))
+		goto error_digests;
+	vb2_sign_stats_hash(g_kernel_blob_size, start);
+
+	body_sig = vb2_sign_digest(digest, g_kernel_blob_size, signpriv_key);
+	if (!body_sig) {
+		fprintf(stderr, "Error calculating body signature\n");
+		goto error_digests;
+	}
+	vblock_data = CreateKernelVblock(body_sig,
+					 body_chunk_size ? &digests : NULL,
+					 padding, version,
+					 kernel_body_load_address, keyblock,
+					 signpriv_key, flags, &vblock_size);
+	free(body_sig);
+	free(digests.digests);
+	if (!vblock_data)
+		return -1;
+
+	/* Write the vblock up front, then each part of the blob in place */
+	Debug("writing %s with 0x%" PRIx64 ", 0x%" PRIx64 "\n",
+	      outfile, vblock_size, vblock_only ? 0 : g_kernel_blob_size);
+	fd = open(outfile, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+	if (fd < 0) {
+		fprintf(stderr, "Can't open output file %s: %s\n",
+			outfile, strerror(errno));
+		free(vblock_data);
+		return -1;
+	}
+	if (WriteAt(fd, vblock_data, vblock_size, 0))
+		goto error;
+	ofs = vblock_size;
+	for (i = 0; !vblock_only && i < ARRAY_SIZE(parts); i++) {
+		if (WriteAt(fd, parts[i].data, parts[i].size, ofs))
+			goto error;
+		ofs += parts[i].padded_size;
+	}
+	/* The padding at the very end is never written, so add it here. */
+	if (ftruncate(fd, ofs) || close(fd)) {
+		fd = -1;
+		goto error;
+	}
+
+	free(vblock_data);
+	return 0;
+
+error:
+	fprintf(stderr, "Can't write output file %s: %s\n",
+		outfile, strerror(errno));
+	if (fd >= 0)
+		close(fd);
+	unlink(outfile);
+	free(vblock_data);
+	return -1;
+
+error_digests:
+	free(digests.digests);
+	return -1;
+}
+
+enum futil_file_type ft_recognize_vblock1(uint8_t *buf, uint32_t len,
+					  const struct futil_file_index *index)
 {
 	uint8_t workbuf[VB2_KERNEL_WORKBUF_RECOMMENDED_SIZE];
 	struct vb2_workbuf wb;
@@ -784,7 +1068,8 @@ enum futil_file_type ft_recognize_vblock1(uint8_t *buf, uint32_t len)
 	return FILE_TYPE_KEYBLOCK;
 }
 
-enum futil_file_type ft_recognize_vb1_key(uint8_t *buf, uint32_t len)
+enum futil_file_type ft_recognize_vb1_key(uint8_t *buf, uint32_t len,
+					  const struct futil_file_index *index)
 {
 	/* Maybe just a packed public key? */
 	const struct vb2_packed_key *pubkey = (struct vb2_packed_key *)buf;
@@ -6,9 +6,14 @@
 #ifndef VBOOT_REFERENCE_FUTILITY_VB1_HELPER_H_
 #define VBOOT_REFERENCE_FUTILITY_VB1_HELPER_H_
 
+struct vb2_body_digests;
 struct vb2_kernel_preamble;
 struct vb2_keyblock;
 struct vb2_packed_key;
+struct vb2_signature;
+
+/* Kernel body chunks are whole pages, so they also fill whole sectors */
+#define BODY_CHUNK_ALIGN 4096
 
 /* Display a public key with variable indentation */
 void show_pubkey(const struct vb2_packed_key *pubkey, const char *sp);
@@ -23,6 +28,25 @@ uint8_t *CreateKernelBlob(uint8_t *vmlinuz_buf, uint32_t vmlinuz_size,
 			  uint8_t *bootloader_data, uint32_t bootloader_size,
 			  uint32_t *blob_size_ptr);
 
+/* Like CreateKernelBlob() + SignKernelBlob() + WriteSomeParts(), but without
+ * ever holding the whole blob in memory: the parts are hashed where they are
+ * and written straight to [outfile] behind the vblock. Returns zero on
+ * success.
+ *
+ * A nonzero [body_chunk_size] also puts a digest of each chunk of the blob
+ * in the preamble, making it version 2.3. */
+int WriteSignedKernelBlob(const char *outfile, int vblock_only,
+			  uint8_t *vmlinuz_buf, uint32_t vmlinuz_size,
+			  enum arch_t arch, uint64_t kernel_body_load_address,
+			  uint8_t *config_data, uint32_t config_size,
+			  uint8_t *bootloader_data, uint32_t bootloader_size,
+			  uint32_t padding,
+			  int version,
+			  struct vb2_keyblock *keyblock,
+			  struct vb2_private_key *signpriv_key,
+			  uint32_t flags,
+			  uint32_t body_chunk_size);
+
 uint8_t *SignKernelBlob(uint8_t *kernel_blob,
 			uint32_t kernel_size,
 			uint32_t padding,
@@ -31,8 +55,22 @@ uint8_t *SignKernelBlob(uint8_t *kernel_blob,
 			struct vb2_keyblock *keyblock,
 			struct vb2_private_key *signpriv_key,
 			uint32_t flags,
+			uint32_t body_chunk_size,
 			uint32_t *vblock_size_ptr);
 
+/* Like SignKernelBlob(), but for a body signature and chunk digests (NULL
+ * for none) that are already computed. The bootloader and vmlinuz header
+ * come from the last blob unpacked. */
+uint8_t *CreateKernelVblock(struct vb2_signature *body_sig,
+			    const struct vb2_body_digests *digests,
+			    uint32_t padding,
+			    int version,
+			    uint64_t kernel_body_load_address,
+			    struct vb2_keyblock *keyblock,
+			    struct vb2_private_key *signpriv_key,
+			    uint32_t flags,
+			    uint32_t *vblock_size_ptr);
+
 int WriteSomeParts(const char *outfile,
 		   void *part1_data, uint32_t part1_size,
 		   void *part2_data, uint32_t part2_size);
@@ -40,6 +78,10 @@ int WriteSomeParts(const char *outfile,
 /**
  * Unpack a kernel partition.
  *
+ * This points globals used by CreateKernelVblock(), SignKernelBlob() and
+ * UpdateKernelBlobConfig() at the partition, so those may only be used from
+ * one thread at a time.
+ *
  * @param kpart_data	Kernel partition data
  * @param kpart_size	Size of kernel partition data in bytes
  * @param padding	Expected max size of keyblock+preamble
@@ -65,6 +107,12 @@ int VerifyKernelBlob(uint8_t *kernel_blob,
 		     const char *keyblock_outfile,
 		     uint32_t min_version);
 
+/* Check each body chunk digest in a verified [preamble] against the kernel
+ * blob, if it has any. Returns zero on success. */
+int VerifyKernelBodyChunks(const struct vb2_kernel_preamble *preamble,
+			   const uint8_t *kernel_blob, uint32_t kernel_size,
+			   enum vb2_hash_algorithm hash_alg);
+
 uint64_t kernel_cmd_line_offset(const struct vb2_kernel_preamble *preamble);
 
 #endif	/* VBOOT_REFERENCE_FUTILITY_VB1_HELPER_H_ */
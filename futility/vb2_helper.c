@@ -8,6 +8,7 @@
 
 #include "2sysincludes.h"
 #include "2common.h"
+#include "2ed25519.h"
 #include "2id.h"
 #include "2rsa.h"
 #include "2sha.h"
@@ -49,7 +50,8 @@ int vb2_lookup_hash_alg(const char *str, enum vb2_hash_algorithm *alg)
 	return 1;
 }
 
-enum futil_file_type ft_recognize_vb21_key(uint8_t *buf, uint32_t len)
+enum futil_file_type ft_recognize_vb21_key(uint8_t *buf, uint32_t len,
+					   const struct futil_file_index *index)
 {
 	struct vb2_public_key pubkey;
 	struct vb2_private_key *privkey = 0;
@@ -122,9 +124,19 @@ int ft_show_vb21_pubkey(const char *name, uint8_t *buf, uint32_t len,
 
 static int vb2_private_key_sha1sum(struct vb2_private_key *key, uint8_t *digest)
 {
+	uint8_t pubkey[VB2_ED25519_KEY_BYTES];
 	uint8_t *buf;
 	uint32_t buflen;
 
+	/* Ed25519 key IDs are the sha1sum of the public key */
+	if (key->sig_alg == VB2_SIG_ED25519) {
+		if (vb2_private_key_ed25519_public(key, pubkey))
+			return 0;
+		vb2_digest_buffer(pubkey, sizeof(pubkey), VB2_HASH_SHA1,
+				  digest, VB2_SHA1_DIGEST_SIZE);
+		return 1;
+	}
+
 	if (vb_keyb_from_rsa(key->rsa_private_key, &buf, &buflen))
 		return 0;
 
@@ -189,7 +201,8 @@ static RSA *rsa_from_buffer(uint8_t *buf, uint32_t len)
 	return rsa_key;
 }
 
-enum futil_file_type ft_recognize_pem(uint8_t *buf, uint32_t len)
+enum futil_file_type ft_recognize_pem(uint8_t *buf, uint32_t len,
+				      const struct futil_file_index *index)
 {
 	RSA *rsa_key = rsa_from_buffer(buf, len);
 
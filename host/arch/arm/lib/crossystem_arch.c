@@ -6,6 +6,7 @@
 #include <stdio.h>
 #include <string.h>
 #include <stddef.h>
+#include <dirent.h>
 #include <stdlib.h>
 #ifndef HAVE_MACOS
 #include <linux/fs.h>
@@ -65,25 +66,150 @@ static int FindEmmcDev(void)
 	return E_FAIL;
 }
 
-static int ReadFdtValue(const char *property, int *value)
+static void GetFdtPropertyPath(const char *property, char *path, size_t size)
+{
+	if (property[0] == '/')
+		StrCopy(path, property, size);
+	else
+		snprintf(path, size, FDT_BASE_PATH "/%s", property);
+}
+
+/* The device tree doesn't change while we run, so each property is read at
+ * most once per process and kept here, along with properties which couldn't
+ * be read.  The firmware node is listed on first use, so properties missing
+ * from it are known without trying to open them. */
+struct FdtProperty {
+	char *name;
+	int loaded;  /* Non-zero once result and data are valid */
+	int result;  /* 0 if read, or the error from reading it */
+	char *data;  /* NUL-terminated */
+	size_t size;
+	struct FdtProperty *next;
+};
+
+static struct FdtProperty *fdt_properties;
+/* 0 if FDT_BASE_PATH hasn't been listed yet, 1 if it has, -1 if it can't be */
+static int fdt_listed;
+
+static int ReadFdtFile(const char *property, char **data, size_t *size)
 {
 	char filename[FNAME_SIZE];
-	FILE *file;
-	int data = 0;
+	struct stat file_status;
+	ssize_t len;
+	int fd;
+
+	GetFdtPropertyPath(property, filename, sizeof(filename));
+	fd = open(filename, O_RDONLY);
+	if (fd < 0)
+		return E_FILEOP;
+
+	if (fstat(fd, &file_status)) {
+		close(fd);
+		return E_FILEOP;
+	}
+
+	*size = file_status.st_size;
+	*data = malloc(*size + 1);
+	if (!*data) {
+		close(fd);
+		return E_MEM;
+	}
+	(*data)[*size] = 0;
 
-	snprintf(filename, sizeof(filename), FDT_BASE_PATH "/%s", property);
-	file = fopen(filename, "rb");
-	if (!file) {
-		fprintf(stderr, "Unable to open FDT property %s\n", property);
+	len = read(fd, *data, *size);
+	close(fd);
+	if (len < 0 || (size_t)len != *size) {
+		free(*data);
+		*data = NULL;
 		return E_FILEOP;
 	}
 
-	if (fread(&data, 1, sizeof(data), file) != sizeof(data)) {
+	return 0;
+}
+
+static struct FdtProperty *AddFdtProperty(const char *property)
+{
+	struct FdtProperty *prop;
+
+	prop = calloc(1, sizeof(*prop));
+	if (!prop)
+		return NULL;
+	prop->name = strdup(property);
+	if (!prop->name) {
+		free(prop);
+		return NULL;
+	}
+
+	prop->next = fdt_properties;
+	fdt_properties = prop;
+	return prop;
+}
+
+/* Add an unread cache entry for each property in the firmware node. */
+static void ListFdtProperties(void)
+{
+	struct dirent *entry;
+	DIR *dir;
+
+	fdt_listed = -1;
+	dir = opendir(FDT_BASE_PATH);
+	if (!dir)
+		return;
+
+	while ((entry = readdir(dir))) {
+		if (entry->d_name[0] == '.')
+			continue;
+		if (!AddFdtProperty(entry->d_name)) {
+			closedir(dir);
+			return;
+		}
+	}
+	closedir(dir);
+	fdt_listed = 1;
+}
+
+/* Return the cache entry for an FDT property, reading it if needed. */
+static const struct FdtProperty *GetFdtProperty(const char *property)
+{
+	struct FdtProperty *prop;
+
+	if (!fdt_listed)
+		ListFdtProperties();
+
+	for (prop = fdt_properties; prop; prop = prop->next) {
+		if (!strcmp(prop->name, property))
+			break;
+	}
+
+	if (!prop) {
+		prop = AddFdtProperty(property);
+		if (!prop)
+			return NULL;
+		/* Not in the listing, so there's nothing to open */
+		if (fdt_listed > 0 && property[0] != '/') {
+			prop->result = E_FILEOP;
+			prop->loaded = 1;
+		}
+	}
+
+	if (!prop->loaded) {
+		prop->result = ReadFdtFile(property, &prop->data, &prop->size);
+		prop->loaded = 1;
+	}
+	return prop;
+}
+
+static int ReadFdtValue(const char *property, int *value)
+{
+	const struct FdtProperty *prop = GetFdtProperty(property);
+	int data = 0;
+
+	if (!prop || prop->result || prop->size < sizeof(data)) {
 		fprintf(stderr, "Unable to read FDT property %s\n", property);
 		return E_FILEOP;
 	}
-	fclose(file);
 
+	memcpy(&data, prop->data, sizeof(data));
 	if (value)
 		*value = ntohl(data); /* FDT is network byte order */
 
@@ -98,65 +224,40 @@ static int ReadFdtInt(const char *property)
 	return value;
 }
 
-static void GetFdtPropertyPath(const char *property, char *path, size_t size)
-{
-	if (property[0] == '/')
-		StrCopy(path, property, size);
-	else
-		snprintf(path, size, FDT_BASE_PATH "/%s", property);
-}
-
 static int FdtPropertyExist(const char *property)
 {
-	char filename[FNAME_SIZE];
-	struct stat file_status;
+	const struct FdtProperty *prop = GetFdtProperty(property);
 
-	GetFdtPropertyPath(property, filename, sizeof(filename));
-	if (!stat(filename, &file_status))
-		return 1; // It exists!
-	else
-		return 0; // It does not exist or some error happened.
+	/* Readable, or it does not exist or some error happened. */
+	return prop && !prop->result;
 }
 
+/* Read an FDT property into a newly allocated, NUL-terminated block, which
+ * the caller must free. */
 static int ReadFdtBlock(const char *property, void **block, size_t *size)
 {
-	char filename[FNAME_SIZE];
-	FILE *file;
-	size_t property_size;
+	const struct FdtProperty *prop;
 	char *data;
 
 	if (!block)
 		return E_FAIL;
 
-	GetFdtPropertyPath(property, filename, sizeof(filename));
-	file = fopen(filename, "rb");
-	if (!file) {
-		fprintf(stderr, "Unable to open FDT property %s\n", property);
-		return E_FILEOP;
-	}
-
-	fseek(file, 0, SEEK_END);
-	property_size = ftell(file);
-	rewind(file);
-
-	data = malloc(property_size +1);
-	if (!data) {
-		fclose(file);
+	prop = GetFdtProperty(property);
+	if (!prop)
 		return E_MEM;
+	if (prop->result) {
+		fprintf(stderr, "Unable to read FDT property %s\n", property);
+		return prop->result;
 	}
-	data[property_size] = 0;
 
-	if (1 != fread(data, property_size, 1, file)) {
-		fprintf(stderr, "Unable to read from property %s\n", property);
-		fclose(file);
-		free(data);
-		return E_FILEOP;
-	}
+	data = malloc(prop->size + 1);
+	if (!data)
+		return E_MEM;
+	memcpy(data, prop->data, prop->size + 1);
 
-	fclose(file);
 	*block = data;
 	if (size)
-		*size = property_size;
+		*size = prop->size;
 
 	return 0;
 }
@@ -169,6 +270,59 @@ static char * ReadFdtString(const char *property)
 	return (char *)str;
 }
 
+/* GPIO value files stay open once found, so reading a switch again is a
+ * single pread() */
+#define MAX_GPIO_FILES 8
+static struct {
+	char path[FNAME_SIZE];
+	int fd;
+} gpio_files[MAX_GPIO_FILES];
+static int gpio_file_count;
+
+static int ReadGpioFile(const char *path, unsigned *value)
+{
+	char buf[16];
+	char *e = NULL;
+	ssize_t len;
+	int keep = 1;
+	int fd = -1;
+	int i;
+
+	for (i = 0; i < gpio_file_count; i++) {
+		if (!strcmp(gpio_files[i].path, path)) {
+			fd = gpio_files[i].fd;
+			break;
+		}
+	}
+
+	if (fd < 0) {
+		fd = open(path, O_RDONLY);
+		if (fd < 0)
+			return -1;
+		if (gpio_file_count < MAX_GPIO_FILES) {
+			StrCopy(gpio_files[gpio_file_count].path, path,
+				sizeof(gpio_files[0].path));
+			gpio_files[gpio_file_count++].fd = fd;
+		} else {
+			keep = 0;  /* No room to keep it open */
+		}
+	}
+
+	/* Reading from the start makes sysfs sample the GPIO again */
+	len = pread(fd, buf, sizeof(buf) - 1, 0);
+	if (!keep)
+		close(fd);
+	if (len <= 0)
+		return -1;
+	buf[len] = 0;
+
+	*value = (unsigned)strtoul(buf, &e, 0);
+	if (e == buf)
+		return -1;
+
+	return 0;
+}
+
 static int VbGetPlatformGpioStatus(const char* name)
 {
 	char gpio_name[FNAME_SIZE];
@@ -176,7 +330,7 @@ static int VbGetPlatformGpioStatus(const char* name)
 
 	snprintf(gpio_name, sizeof(gpio_name), "%s/%s/value",
 		 PLATFORM_DEV_PATH, name);
-	if (ReadFileInt(gpio_name, &value) < 0)
+	if (ReadGpioFile(gpio_name, &value) < 0)
 		return -1;
 
 	return (int)value;
@@ -189,7 +343,7 @@ static int VbGetGpioStatus(unsigned gpio_number)
 
 	snprintf(gpio_name, sizeof(gpio_name), "%s/gpio%d/value",
 		 GPIO_BASE_PATH, gpio_number);
-	if (ReadFileInt(gpio_name, &value) < 0) {
+	if (ReadGpioFile(gpio_name, &value) < 0) {
 		/* Try exporting the GPIO */
 		FILE* f = fopen(GPIO_EXPORT_PATH, "wt");
 		if (!f)
@@ -198,7 +352,7 @@ static int VbGetGpioStatus(unsigned gpio_number)
 		fclose(f);
 
 		/* Try re-reading the GPIO value */
-		if (ReadFileInt(gpio_name, &value) < 0)
+		if (ReadGpioFile(gpio_name, &value) < 0)
 			return -1;
 	}
 
@@ -207,11 +361,9 @@ static int VbGetGpioStatus(unsigned gpio_number)
 
 static int VbGetVarGpio(const char* name)
 {
+	const struct FdtProperty *prop;
 	int gpio_num;
-	void *pp = NULL;
-	int *prop;
-	size_t proplen = 0;
-	int ret = 0;
+	uint32_t cells[3];
 
 	/* TODO: This should at some point in the future use the phandle
 	 * to find the gpio chip and thus the base number. Assume 0 now,
@@ -219,13 +371,13 @@ static int VbGetVarGpio(const char* name)
 	 * moved to an offchip gpio controller.
 	 */
 
-	ret = ReadFdtBlock(name, &pp, &proplen);
-	if (ret || !pp || proplen != 12) {
-		ret = 2;
-		goto out;
-	}
-	prop = pp;
-	gpio_num = ntohl(prop[1]);
+	prop = GetFdtProperty(name);
+	if (prop && prop->result)
+		fprintf(stderr, "Unable to read FDT property %s\n", name);
+	if (!prop || prop->result || prop->size != sizeof(cells))
+		return 2;
+	memcpy(cells, prop->data, sizeof(cells));
+	gpio_num = ntohl(cells[1]);
 
 	/*
 	 * TODO(chrome-os-partner:11296): Use gpio_num == 0 to denote non-exist
@@ -234,14 +386,9 @@ static int VbGetVarGpio(const char* name)
 	 * "non-exist" properly.
 	 */
 	if (gpio_num)
-		ret = VbGetGpioStatus(gpio_num);
+		return VbGetGpioStatus(gpio_num);
 	else
-		ret = -1;
-out:
-	if (pp)
-		free(pp);
-
-	return ret;
+		return -1;
 }
 
 static int vb2_read_nv_storage_disk(struct vb2_context *ctx)
@@ -359,6 +506,10 @@ int vb2_read_nv_storage(struct vb2_context *ctx)
 	media = ReadFdtString(FDT_NVSTORAGE_TYPE_PROP);
 	if (!strcmp(media, "disk"))
 		return vb2_read_nv_storage_disk(ctx);
+	/* Ask the EC directly if we can, since running mosys is slow */
+	if ((!strcmp(media, "cros-ec") || !strcmp(media, "mkbp")) &&
+	    !vb2_read_nv_storage_cros_ec(ctx))
+		return 0;
 	if (!strcmp(media, "cros-ec") || !strcmp(media, "mkbp") ||
 	    !strcmp(media, "flash"))
 		return vb2_read_nv_storage_mosys(ctx);
@@ -375,6 +526,9 @@ int vb2_write_nv_storage(struct vb2_context *ctx)
 	media = ReadFdtString(FDT_NVSTORAGE_TYPE_PROP);
 	if (!strcmp(media, "disk"))
 		return vb2_write_nv_storage_disk(ctx);
+	if ((!strcmp(media, "cros-ec") || !strcmp(media, "mkbp")) &&
+	    !vb2_write_nv_storage_cros_ec(ctx))
+		return 0;
 	if (!strcmp(media, "cros-ec") || !strcmp(media, "mkbp") ||
 	    !strcmp(media, "flash"))
 		return vb2_write_nv_storage_mosys(ctx);
@@ -388,6 +542,13 @@ VbSharedDataHeader *VbSharedDataRead(void)
 	if (ReadFdtBlock("vboot-shared-data", &block, &size))
 		return NULL;
 	VbSharedDataHeader *p = (VbSharedDataHeader *)block;
+	if (size >= sizeof(uint32_t) &&
+	    p->magic == VB_SHARED_DATA_COMPACT_MAGIC) {
+		/* Firmware handed off the compact form */
+		p = VbSharedDataExpand(block, size);
+		free(block);
+		return p;
+	}
 	if (p->magic != VB_SHARED_DATA_MAGIC) {
 		fprintf(stderr,  "%s: failed to validate magic in "
 			"VbSharedDataHeader (%x != %x)\n",
@@ -6,10 +6,12 @@
 #include <ctype.h>
 #include <dirent.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <linux/nvram.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <sys/ioctl.h>
 #include <sys/stat.h>
@@ -318,6 +320,14 @@ VbSharedDataHeader* VbSharedDataRead(void)
 	if (!sh)
 		return NULL;
 
+	/* Firmware may hand off the compact form instead */
+	if (got_size >= sizeof(uint32_t) &&
+	    sh->magic == VB_SHARED_DATA_COMPACT_MAGIC) {
+		VbSharedDataHeader *full = VbSharedDataExpand(sh, got_size);
+		free(sh);
+		return full;
+	}
+
 	/* Make sure the size is sufficient for the struct version we got.
 	 * Check supported old versions first. */
 	if (1 == sh->struct_version)
@@ -473,31 +483,100 @@ static int VbGetRecoveryReason(void)
 	}
 }
 
-/* Physical GPIO number <N> may be accessed through /sys/class/gpio/gpio<M>/,
- * but <N> and <M> may differ by some offset <O>. To determine that constant,
- * we look for a directory named /sys/class/gpio/gpiochip<O>/. If there's not
- * exactly one match for that, we're SOL.
- */
-static int FindGpioChipOffset(unsigned *gpio_num, unsigned *offset,
-                              const char *name)
+/* What we know about a /sys/class/gpio/gpiochip<O>/ directory.  The chips
+ * don't come and go while we run, so they are listed once per process and
+ * each chip's label and uid are read the first time something asks. */
+struct GpioChip {
+	unsigned offset;
+	int label_state;  /* 1 if read, -1 if unreadable, 0 if not read yet */
+	char label[128];
+	int uid_state;
+	unsigned uid;
+};
+
+static struct GpioChip *gpio_chips;
+static int gpio_chip_count = -1;
+
+/* List the gpiochip<O> directories, if not done already.
+ *
+ * Returns the number of chips found. */
+static int GetGpioChips(void)
 {
 	DIR *dir;
 	struct dirent *ent;
-	int match = 0;
+	struct GpioChip *chips;
+	unsigned offset;
 
+	if (gpio_chip_count >= 0)
+		return gpio_chip_count;
+
+	gpio_chip_count = 0;
 	dir = opendir(GPIO_BASE_PATH);
-	if (!dir) {
+	if (!dir)
 		return 0;
-	}
 
-	while(0 != (ent = readdir(dir))) {
-		if (1 == sscanf(ent->d_name, "gpiochip%u", offset)) {
-			match++;
-		}
+	while (0 != (ent = readdir(dir))) {
+		if (1 != sscanf(ent->d_name, "gpiochip%u", &offset))
+			continue;
+		chips = realloc(gpio_chips,
+				(gpio_chip_count + 1) * sizeof(*chips));
+		if (!chips)
+			break;
+		gpio_chips = chips;
+		memset(&chips[gpio_chip_count], 0, sizeof(*chips));
+		chips[gpio_chip_count++].offset = offset;
 	}
 
 	closedir(dir);
-	return (1 == match);
+	return gpio_chip_count;
+}
+
+/* Return the label of a GPIO chip, or NULL if it has none. */
+static const char *GpioChipLabel(struct GpioChip *chip)
+{
+	char filename[128];
+
+	if (!chip->label_state) {
+		snprintf(filename, sizeof(filename), "%s/gpiochip%u/label",
+			 GPIO_BASE_PATH, chip->offset);
+		chip->label_state = ReadFileString(chip->label,
+						   sizeof(chip->label),
+						   filename) ? 1 : -1;
+	}
+	return chip->label_state > 0 ? chip->label : NULL;
+}
+
+/* Read the ACPI uid of a GPIO chip.
+ *
+ * Returns 0 if success, or -1 if error. */
+static int GpioChipUid(struct GpioChip *chip, unsigned *uid)
+{
+	char filename[128];
+
+	if (!chip->uid_state) {
+		snprintf(filename, sizeof(filename),
+			 "%s/gpiochip%u/device/firmware_node/uid",
+			 GPIO_BASE_PATH, chip->offset);
+		chip->uid_state = ReadFileInt(filename, &chip->uid) < 0 ?
+				-1 : 1;
+	}
+	*uid = chip->uid;
+	return chip->uid_state > 0 ? 0 : -1;
+}
+
+/* Physical GPIO number <N> may be accessed through /sys/class/gpio/gpio<M>/,
+ * but <N> and <M> may differ by some offset <O>. To determine that constant,
+ * we look for a directory named /sys/class/gpio/gpiochip<O>/. If there's not
+ * exactly one match for that, we're SOL.
+ */
+static int FindGpioChipOffset(unsigned *gpio_num, unsigned *offset,
+                              const char *name)
+{
+	if (1 != GetGpioChips())
+		return 0;
+
+	*offset = gpio_chips[0].offset;
+	return 1;
 }
 
 /* Physical GPIO number <N> may be accessed through /sys/class/gpio/gpio<M>/,
@@ -508,61 +587,37 @@ static int FindGpioChipOffset(unsigned *gpio_num, unsigned *offset,
 static int FindGpioChipOffsetByLabel(unsigned *gpio_num, unsigned *offset,
                                      const char *name)
 {
-	DIR *dir;
-	struct dirent *ent;
-	char filename[128];
-	char chiplabel[128];
+	const char *chiplabel;
+	int count = GetGpioChips();
 	int match = 0;
-	unsigned controller_offset = 0;
+	int i;
 
-	dir = opendir(GPIO_BASE_PATH);
-	if (!dir) {
-		return 0;
-	}
-
-	while(0 != (ent = readdir(dir))) {
-		if (1 == sscanf(ent->d_name, "gpiochip%u",
-				&controller_offset)) {
-			/*
-			 * Read the file at gpiochip<O>/label to get the
-			 * identifier for this bank of GPIOs.
-			 */
-			snprintf(filename, sizeof(filename),
-				 "%s/gpiochip%u/label",
-				 GPIO_BASE_PATH, controller_offset);
-			if (ReadFileString(chiplabel, sizeof(chiplabel),
-					   filename)) {
-				if (!strncasecmp(chiplabel, name,
-						 strlen(name))) {
-					/*
-					 * Store offset when chip label is
-					 * matched.
-					 */
-					*offset = controller_offset;
-					match++;
-				}
-			}
+	for (i = 0; i < count; i++) {
+		chiplabel = GpioChipLabel(&gpio_chips[i]);
+		if (chiplabel && !strncasecmp(chiplabel, name, strlen(name))) {
+			/* Store offset when chip label is matched. */
+			*offset = gpio_chips[i].offset;
+			match++;
 		}
 	}
 
-	closedir(dir);
 	return (1 == match);
 }
 
 static int FindGpioChipOffsetByNumber(unsigned *gpio_num, unsigned *offset,
 				      Basemapping *data)
 {
-	DIR *dir;
-	struct dirent *ent;
-	int match = 0;
+	unsigned uid_value;
+	int count;
+	int i;
 
 	/* Obtain relative GPIO number.
 	 * The assumption here is the Basemapping
 	 * table is arranged in decreasing order of
 	 * base address and ends with 0.
 	 * A UID with value 0 indicates an invalid range
-	 * and causes an early return to avoid the directory
-	 * opening code below.
+	 * and causes an early return to avoid the chip
+	 * lookup below.
 	 */
 	do {
 		if (*gpio_num >= data->base) {
@@ -576,30 +631,18 @@ static int FindGpioChipOffsetByNumber(unsigned *gpio_num, unsigned *offset,
 		return 0;
 	}
 
-	dir = opendir(GPIO_BASE_PATH);
-	if (!dir) {
-		return 0;
-	}
-
-	while(0 != (ent = readdir(dir))) {
-		/* For every gpiochip entry determine uid. */
-		if (1 == sscanf(ent->d_name, "gpiochip%u", offset)) {
-			char uid_file[128];
-			unsigned uid_value;
-			snprintf(uid_file, sizeof(uid_file),
-				 "%s/gpiochip%u/device/firmware_node/uid",
-				 GPIO_BASE_PATH, *offset);
-			if (ReadFileInt(uid_file, &uid_value) < 0)
-				continue;
-			if (data->uid == uid_value) {
-				match++;
-				break;
-			}
+	/* For every gpiochip entry determine uid. */
+	count = GetGpioChips();
+	for (i = 0; i < count; i++) {
+		if (GpioChipUid(&gpio_chips[i], &uid_value) < 0)
+			continue;
+		if (data->uid == uid_value) {
+			*offset = gpio_chips[i].offset;
+			return 1;
 		}
 	}
 
-	closedir(dir);
-	return (1 == match);
+	return 0;
 }
 
 
@@ -694,34 +737,63 @@ static const struct GpioChipset *FindChipset(const char *name)
 	return NULL;
 }
 
-/* Read a GPIO of the specified signal type (see ACPI GPIO SignalType).
+/* Find the index of the ACPI GPIO.<N> entry for the specified signal type.
+ * The signal types of all the entries are read on the first call.
  *
- * Returns 1 if the signal is asserted, 0 if not asserted, or -1 if error. */
-static int ReadGpio(unsigned signal_type)
+ * Returns the index, or -1 if there is no such GPIO. */
+static int FindAcpiGpio(unsigned signal_type)
 {
+	static unsigned *gpio_types;
+	static int gpio_count = -1;
 	char name[128];
-	int index = 0;
 	unsigned gpio_type;
-	unsigned active_high;
+	unsigned *types;
+	int index;
+
+	if (gpio_count < 0) {
+		/* Scan GPIO.* until we run out of GPIOs */
+		for (gpio_count = 0; ; gpio_count++) {
+			snprintf(name, sizeof(name), "%s.%d/GPIO.0",
+				 ACPI_GPIO_PATH, gpio_count);
+			if (ReadFileInt(name, &gpio_type) < 0)
+				break;
+			types = realloc(gpio_types,
+					(gpio_count + 1) * sizeof(*types));
+			if (!types)
+				break;
+			gpio_types = types;
+			gpio_types[gpio_count] = gpio_type;
+		}
+	}
+
+	for (index = 0; index < gpio_count; index++) {
+		if (gpio_types[index] == signal_type)
+			return index;
+	}
+	return -1;
+}
+
+/* Find the GPIO of the specified signal type (see ACPI GPIO SignalType) and
+ * whether it's active high.
+ *
+ * Returns 0 if success, or -1 if error. */
+static int FindGpio(unsigned signal_type, unsigned *gpio_num,
+		    unsigned *active_high)
+{
+	char name[128];
+	int index;
 	unsigned controller_num;
 	unsigned controller_offset = 0;
 	char controller_name[128];
-	unsigned value;
 	const struct GpioChipset *chipset;
 
-	/* Scan GPIO.* to find a matching signal type */
-	for (index = 0; ; index++) {
-		snprintf(name, sizeof(name), "%s.%d/GPIO.0", ACPI_GPIO_PATH,
-			 index);
-		if (ReadFileInt(name, &gpio_type) < 0)
-			return -1; /* Ran out of GPIOs before finding a match */
-		if (gpio_type == signal_type)
-			break;
-	}
+	index = FindAcpiGpio(signal_type);
+	if (index < 0)
+		return -1;
 
 	/* Read attributes and controller info for the GPIO */
 	snprintf(name, sizeof(name), "%s.%d/GPIO.1", ACPI_GPIO_PATH, index);
-	if (ReadFileInt(name, &active_high) < 0)
+	if (ReadFileInt(name, active_high) < 0)
 		return -1;
 	snprintf(name, sizeof(name), "%s.%d/GPIO.2", ACPI_GPIO_PATH, index);
 	if (ReadFileInt(name, &controller_num) < 0)
@@ -743,34 +815,90 @@ static int ReadGpio(unsigned signal_type)
 					      &controller_offset,
 					      chipset->name))
 		return -1;
-	controller_offset += controller_num;
+	*gpio_num = controller_offset + controller_num;
+	return 0;
+}
+
+/* Open the value file of a GPIO, exporting the GPIO if needed.
+ *
+ * Returns the file descriptor, or -1 if error. */
+static int OpenGpioValue(unsigned gpio_num)
+{
+	char name[128];
+	FILE *f;
+	int fd;
 
-	/* Try reading the GPIO value */
 	snprintf(name, sizeof(name), "%s/gpio%d/value",
-		 GPIO_BASE_PATH, controller_offset);
-	if (ReadFileInt(name, &value) < 0) {
-		/* Try exporting the GPIO */
-		FILE* f = fopen(GPIO_EXPORT_PATH, "wt");
-		if (!f)
-			return -1;
-		fprintf(f, "%u", controller_offset);
-		fclose(f);
+		 GPIO_BASE_PATH, gpio_num);
+	fd = open(name, O_RDONLY);
+	if (fd >= 0)
+		return fd;
 
-		/* Try re-reading the GPIO value */
-		if (ReadFileInt(name, &value) < 0)
+	/* Try exporting the GPIO */
+	f = fopen(GPIO_EXPORT_PATH, "wt");
+	if (!f)
+		return -1;
+	fprintf(f, "%u", gpio_num);
+	fclose(f);
+
+	/* Try re-opening the GPIO value */
+	return open(name, O_RDONLY);
+}
+
+/* Read a GPIO of the specified signal type (see ACPI GPIO SignalType).
+ *
+ * Returns 1 if the signal is asserted, 0 if not asserted, or -1 if error. */
+static int ReadGpio(unsigned signal_type)
+{
+	/* Where the GPIOs are doesn't change, so only look each one up once,
+	 * and keep its value file open so later reads are a single pread() */
+	static struct {
+		int found;  /* 1 if found, -1 if not there, 0 if not looked */
+		unsigned gpio_num;
+		unsigned active_high;
+		int fd;
+	} gpios[GPIO_SIGNAL_TYPE_PHASE_ENFORCEMENT + 1];
+	char buf[16];
+	char *e = NULL;
+	unsigned value;
+	ssize_t len;
+
+	if (signal_type >= ARRAY_SIZE(gpios))
+		return -1;
+	if (!gpios[signal_type].found) {
+		gpios[signal_type].found =
+			FindGpio(signal_type, &gpios[signal_type].gpio_num,
+				 &gpios[signal_type].active_high) ? -1 : 1;
+		gpios[signal_type].fd = -1;
+	}
+	if (gpios[signal_type].found < 0)
+		return -1;
+
+	if (gpios[signal_type].fd < 0) {
+		gpios[signal_type].fd =
+			OpenGpioValue(gpios[signal_type].gpio_num);
+		if (gpios[signal_type].fd < 0)
 			return -1;
 	}
 
+	/* Reading from the start makes sysfs sample the GPIO again */
+	len = pread(gpios[signal_type].fd, buf, sizeof(buf) - 1, 0);
+	if (len <= 0)
+		return -1;
+	buf[len] = '\0';
+	value = (unsigned)strtoul(buf, &e, 0);
+	if (e == buf)
+		return -1;
+
 	/* Normalize the value read from the kernel in case it is not always
 	 * 1. */
 	value = value ? 1 : 0;
 
 	/* Compare the GPIO value with the active value and return 1 if
 	 * match. */
-	return (value == active_high ? 1 : 0);
+	return (value == gpios[signal_type].active_high ? 1 : 0);
 }
 
-
 int VbGetArchPropertyInt(const char* name)
 {
 	int value = -1;
@@ -19,6 +19,7 @@ typedef struct CgptCreateParams {
 	uint64_t drive_size;
 	int zap;
 	uint64_t padding;
+	int sparse;
 } CgptCreateParams;
 
 typedef struct CgptAddParams {
@@ -48,6 +49,12 @@ typedef struct CgptAddParams {
 	int set_raw;
 } CgptAddParams;
 
+enum {
+	CGPT_SHOW_FORMAT_TEXT = 0,
+	CGPT_SHOW_FORMAT_JSON,
+	CGPT_SHOW_FORMAT_TSV,
+};
+
 typedef struct CgptShowParams {
 	char *drive_name;
 	uint64_t drive_size;
@@ -58,12 +65,15 @@ typedef struct CgptShowParams {
 	int single_item;
 	int debug;
 	int num_partitions;
+	/* CGPT_SHOW_FORMAT_*; anything but text dumps every field at once */
+	int format;
 } CgptShowParams;
 
 typedef struct CgptRepairParams {
 	char *drive_name;
 	uint64_t drive_size;
 	int verbose;
+	int sparse;
 } CgptRepairParams;
 
 typedef struct CgptBootParams {
@@ -108,6 +118,10 @@ typedef struct CgptFindParams {
 	 * need to print the device name. so this parameter is here to properly
 	 * show the correct device name in that special case. */
 	CgptFindShowFn show_fn;
+	/* number of drives to search at once when scanning all drives */
+	int jobs;
+	/* file caching the partitions found when scanning all drives, or NULL */
+	const char *cache_file;
 } CgptFindParams;
 
 enum {
@@ -12,6 +12,9 @@ extern "C" {
 
 #include <stddef.h>
 
+/* These functions share cached copies of NV storage and VbSharedData, so
+ * they aren't thread-safe.  Call them from one thread at a time. */
+
 /* Recommended size for string property buffers used with
  * VbGetSystemPropertyString(). */
 #define VB_MAX_STRING_PROPERTY     ((size_t) 8192)
@@ -45,6 +48,30 @@ int VbSetSystemPropertyInt(const char* name, int value);
  * Returns 0 if success, -1 if error. */
 int VbSetSystemPropertyString(const char* name, const char* value);
 
+/* Start collecting property changes to write together.
+ *
+ * Until VbCommitSystemPropertyTransaction(), property changes which are kept
+ * in NV storage are applied to a copy of it read at the first change, and
+ * reads see them.  Other properties are still set right away. */
+void VbBeginSystemPropertyTransaction(void);
+
+/* Write the NV storage changes collected since
+ * VbBeginSystemPropertyTransaction(), if there were any.
+ *
+ * Returns 0 if success, -1 if error. */
+int VbCommitSystemPropertyTransaction(void);
+
+/* Forget the copy of NV storage kept by this process.
+ *
+ * NV storage is read once per process and kept up to date by this process's
+ * own writes, so that long-running callers can read properties as often as
+ * they like without touching the hardware.  Those callers should call this
+ * when they need to see changes made by other processes, such as a
+ * crossystem run from the shell.  Values which can't change while the OS is
+ * running, like the VbSharedData ones, are kept, and so is NV storage while a
+ * transaction is open. */
+void VbInvalidateSystemPropertyCache(void);
+
 #ifdef __cplusplus
 }
 #endif
@@ -28,6 +28,22 @@ int vb2_read_nv_storage_mosys(struct vb2_context *ctx);
  */
 int vb2_write_nv_storage_mosys(struct vb2_context* ctx);
 
+/**
+ * Attempt to read non-volatile storage kept by the EC, through the kernel's
+ * cros_ec device.
+ *
+ * Returns 0 if success, non-zero if error.
+ */
+int vb2_read_nv_storage_cros_ec(struct vb2_context *ctx);
+
+/**
+ * Attempt to write non-volatile storage kept by the EC, through the kernel's
+ * cros_ec device.
+ *
+ * Returns 0 if success, non-zero if error.
+ */
+int vb2_write_nv_storage_cros_ec(struct vb2_context *ctx);
+
 #ifdef __cplusplus
 }
 #endif
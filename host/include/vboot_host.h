@@ -57,6 +57,12 @@ int GuidIsZero(const Guid *guid);
 char *FindKernelConfig(const char *filename,
                        uint64_t kernel_body_load_address);
 
+/* Fills configs[i] with a new copy of the kernel cmdline from filenames[i],
+ * or NULL if it can't be found. The caller must free each config. Returns the
+ * number of files whose cmdline could not be found. */
+int FindKernelConfigs(const char *const *filenames, int count,
+		      uint64_t kernel_body_load_address, char **configs);
+
 /****************************************************************************/
 /* Kernel partition */
 
@@ -67,5 +73,15 @@ char *FindKernelConfig(const char *filename,
 int ExtractVmlinuz(void *kpart_data, size_t kpart_size,
 		   void **vmlinuz_out, size_t *vmlinuz_size);
 
+/* Like ExtractVmlinuz(), but for a kernel partition of kpart_size bytes at
+ * kpart_offset in kpart_fd. Only the keyblock and preamble headers are read
+ * into memory; the vmlinuz is copied to the current position of vmlinuz_fd.
+ * If vmlinuz_size is not NULL, it is set to the number of bytes written.
+ * Returns zero on success.
+ */
+int ExtractVmlinuzFile(int kpart_fd, uint64_t kpart_offset,
+		       uint64_t kpart_size, int vmlinuz_fd,
+		       size_t *vmlinuz_size);
+
 
 #endif  /* VBOOT_HOST_H_ */
@@ -10,6 +10,7 @@
 #include <sys/stat.h>
 #include <unistd.h>
 #include <ctype.h>
+#include <sys/ioctl.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <sys/wait.h>
@@ -35,12 +36,42 @@
 #define MOSYS_CROS_PATH "/usr/sbin/mosys"
 #define MOSYS_ANDROID_PATH "/system/bin/mosys"
 
+/*
+ * The EC keeps NV storage for some ARM systems.  mosys gets it through the
+ * kernel's cros_ec device, and so can we, without the fork and the hex dump.
+ * These come from the EC's ec_commands.h and the kernel's cros_ec_dev.h.
+ */
+#define CROS_EC_DEV_PATH "/dev/cros_ec"
+#define EC_CMD_VBNV_CONTEXT 0x0017
+#define EC_VER_VBNV_CONTEXT 1
+#define EC_VBNV_BLOCK_SIZE 16
+#define EC_VBNV_CONTEXT_OP_READ 0
+#define EC_VBNV_CONTEXT_OP_WRITE 1
+
+struct cros_ec_command_v2 {
+	uint32_t version;
+	uint32_t command;
+	uint32_t outsize;
+	uint32_t insize;
+	uint32_t result;
+	uint8_t data[0];
+};
+
+#define CROS_EC_DEV_IOCXCMD_V2 _IOWR(0xec, 0, struct cros_ec_command_v2)
+
+struct ec_params_vbnvcontext {
+	uint32_t op;
+	uint8_t block[EC_VBNV_BLOCK_SIZE];
+} __attribute__((packed));
+
 /* Fields that GetVdatString() can get */
 typedef enum VdatStringField {
 	VDAT_STRING_TIMERS = 0,           /* Timer values */
 	VDAT_STRING_LOAD_FIRMWARE_DEBUG,  /* LoadFirmware() debug information */
 	VDAT_STRING_LOAD_KERNEL_DEBUG,    /* LoadKernel() debug information */
-	VDAT_STRING_MAINFW_ACT            /* Active main firmware */
+	VDAT_STRING_MAINFW_ACT,           /* Active main firmware */
+	VDAT_STRING_TIMESTAMPS,           /* Boot timestamps */
+	VDAT_STRING_TPM_STATS             /* TPM latency statistics */
 } VdatStringField;
 
 
@@ -94,12 +125,182 @@ int FwidStartsWith(const char *start)
 	return 0 == strncmp(fwid, start, strlen(start));
 }
 
+/* Fill in the LoadKernel() fields from a VBSD_SECTION_LOAD_KERNEL section */
+static int ExpandKernelSection(VbSharedDataHeader *sh, const uint8_t *data,
+			       uint32_t size)
+{
+	const VbSharedDataKernelInfo *k = (const VbSharedDataKernelInfo *)data;
+	const uint8_t *end = data + size;
+	const uint8_t *p = data + sizeof(*k);
+	uint32_t calls, i;
+
+	if (size < sizeof(*k))
+		return -1;
+	sh->lk_call_count = k->lk_call_count;
+	sh->kernel_version_tpm_start = k->kernel_version_tpm_start;
+	sh->kernel_version_lowest = k->kernel_version_lowest;
+
+	calls = sh->lk_call_count < VBSD_MAX_KERNEL_CALLS ?
+		sh->lk_call_count : VBSD_MAX_KERNEL_CALLS;
+	for (i = 0; i < calls; i++) {
+		VbSharedDataKernelCall *shc = sh->lk_calls + i;
+		uint32_t parts;
+
+		if (end - p < VBSD_KERNEL_CALL_HEADER_SIZE)
+			return -1;
+		memcpy(shc, p, VBSD_KERNEL_CALL_HEADER_SIZE);
+		p += VBSD_KERNEL_CALL_HEADER_SIZE;
+
+		parts = shc->kernel_parts_found < VBSD_MAX_KERNEL_PARTS ?
+			shc->kernel_parts_found : VBSD_MAX_KERNEL_PARTS;
+		if (end - p < parts * sizeof(VbSharedDataKernelPart))
+			return -1;
+		memcpy(shc->parts, p, parts * sizeof(VbSharedDataKernelPart));
+		p += parts * sizeof(VbSharedDataKernelPart);
+	}
+	return 0;
+}
+
+VbSharedDataHeader *VbSharedDataExpand(const void *buf, uint32_t size)
+{
+	const VbSharedDataCompact *sc = (const VbSharedDataCompact *)buf;
+	const VbSharedDataLogCount *c;
+	const VbSharedDataTimers *t;
+	const VbSharedDataFirmwareInfo *f;
+	const uint8_t *p, *end;
+	VbSharedDataHeader *sh;
+	uint32_t count;
+
+	if (size < sizeof(*sc) || sc->magic != VB_SHARED_DATA_COMPACT_MAGIC ||
+	    sc->core_size < sizeof(*sc) || sc->core_size > sc->total_size ||
+	    sc->total_size > size)
+		return NULL;
+
+	sh = (VbSharedDataHeader *)calloc(1, sizeof(*sh));
+	if (!sh)
+		return NULL;
+
+	sh->magic = VB_SHARED_DATA_MAGIC;
+	sh->struct_version = VB_SHARED_DATA_VERSION;
+	sh->struct_size = sizeof(*sh);
+	sh->data_size = sizeof(*sh);
+	sh->data_used = sizeof(*sh);
+	sh->flags = sc->flags;
+	sh->fw_version_tpm = sc->fw_version_tpm;
+	sh->kernel_version_tpm = sc->kernel_version_tpm;
+	sh->firmware_index = sc->firmware_index;
+	sh->recovery_reason = sc->recovery_reason;
+
+	p = (const uint8_t *)buf + sc->core_size;
+	end = (const uint8_t *)buf + sc->total_size;
+	while (end - p >= sizeof(VbSharedDataSection)) {
+		const VbSharedDataSection *s = (const VbSharedDataSection *)p;
+		const uint8_t *data = p + sizeof(*s);
+
+		if (end - data < s->size)
+			goto bad;
+
+		switch (s->tag) {
+		case VBSD_SECTION_TIMERS:
+			if (s->size < sizeof(*t))
+				goto bad;
+			t = (const VbSharedDataTimers *)data;
+			sh->timer_vb_init_enter = t->vb_init_enter;
+			sh->timer_vb_init_exit = t->vb_init_exit;
+			sh->timer_vb_select_firmware_enter =
+				t->vb_select_firmware_enter;
+			sh->timer_vb_select_firmware_exit =
+				t->vb_select_firmware_exit;
+			sh->timer_vb_select_and_load_kernel_enter =
+				t->vb_select_and_load_kernel_enter;
+			sh->timer_vb_select_and_load_kernel_exit =
+				t->vb_select_and_load_kernel_exit;
+			break;
+		case VBSD_SECTION_LOAD_FIRMWARE:
+			if (s->size < sizeof(*f))
+				goto bad;
+			f = (const VbSharedDataFirmwareInfo *)data;
+			sh->check_fw_a_result = f->check_fw_a_result;
+			sh->check_fw_b_result = f->check_fw_b_result;
+			sh->fw_version_tpm_start = f->fw_version_tpm_start;
+			sh->fw_version_lowest = f->fw_version_lowest;
+			sh->fw_keyblock_flags = f->fw_keyblock_flags;
+			break;
+		case VBSD_SECTION_LOAD_KERNEL:
+			if (ExpandKernelSection(sh, data, s->size))
+				goto bad;
+			break;
+		case VBSD_SECTION_TIMESTAMPS:
+			c = (const VbSharedDataLogCount *)data;
+			if (s->size < sizeof(*c))
+				goto bad;
+			count = c->count < VBSD_MAX_TIMESTAMPS ?
+				c->count : VBSD_MAX_TIMESTAMPS;
+			if (s->size - sizeof(*c) <
+			    count * sizeof(VbSharedDataTimestamp))
+				goto bad;
+			sh->timestamp_count = c->count;
+			memcpy(sh->timestamps, c + 1,
+			       count * sizeof(VbSharedDataTimestamp));
+			break;
+		case VBSD_SECTION_TPM_STATS:
+			c = (const VbSharedDataLogCount *)data;
+			if (s->size < sizeof(*c))
+				goto bad;
+			count = c->count < VBSD_MAX_TPM_STATS ?
+				c->count : VBSD_MAX_TPM_STATS;
+			if (s->size - sizeof(*c) <
+			    count * sizeof(VbSharedDataTpmStats))
+				goto bad;
+			sh->tpm_stats_count = count;
+			memcpy(sh->tpm_stats, c + 1,
+			       count * sizeof(VbSharedDataTpmStats));
+			break;
+		default:
+			/* Sections from newer firmware are skipped */
+			break;
+		}
+		p = data + s->size;
+	}
+	return sh;
+
+bad:
+	free(sh);
+	return NULL;
+}
+
+/*
+ * VbSharedData is written by the firmware at boot and doesn't change while the
+ * OS is running.  Reading it means parsing a hex dump on some platforms, so
+ * read it once and keep it for the life of the process.
+ */
+static VbSharedDataHeader *vdat;
+static int vdat_read;
+
+/* Return the VbSharedData, or NULL if error.  The caller must not free it. */
+static const VbSharedDataHeader *VbSharedDataGet(void)
+{
+	if (!vdat_read) {
+		vdat = VbSharedDataRead();
+		vdat_read = 1;
+	}
+	return vdat;
+}
+
+/*
+ * NV storage is read once too.  vb2_set_nv_storage() keeps this copy up to
+ * date with our own writes; VbInvalidateSystemPropertyCache() drops it so
+ * changes made by other processes are seen.
+ */
+static struct vb2_context cached_ctx;
 static int vnc_read;
 
+/* Set while changes are collected in cached_ctx rather than written */
+static int nv_transaction;
+
 int vb2_get_nv_storage(enum vb2_nv_param param)
 {
-	VbSharedDataHeader* sh = VbSharedDataRead();
-	static struct vb2_context cached_ctx;
+	const VbSharedDataHeader *sh = VbSharedDataGet();
 
 	/* TODO: locking around NV access */
 	if (!vnc_read) {
@@ -119,11 +320,52 @@ int vb2_get_nv_storage(enum vb2_nv_param param)
 	return (int)vb2_nv_get(&cached_ctx, param);
 }
 
+void VbInvalidateSystemPropertyCache(void)
+{
+	/* Don't lose changes which haven't been written yet */
+	if (!nv_transaction)
+		vnc_read = 0;
+}
+
+void VbBeginSystemPropertyTransaction(void)
+{
+	/* Changes are applied to what's in NV storage now, not an old copy */
+	if (!nv_transaction)
+		vnc_read = 0;
+	nv_transaction = 1;
+}
+
+int VbCommitSystemPropertyTransaction(void)
+{
+	if (!nv_transaction)
+		return 0;
+	nv_transaction = 0;
+
+	if (!vnc_read || !(cached_ctx.flags & VB2_CONTEXT_NVDATA_CHANGED))
+		return 0;
+
+	if (0 != vb2_write_nv_storage(&cached_ctx)) {
+		vnc_read = 0;
+		return -1;
+	}
+
+	cached_ctx.flags &= ~VB2_CONTEXT_NVDATA_CHANGED;
+	return 0;
+}
+
 int vb2_set_nv_storage(enum vb2_nv_param param, int value)
 {
-	VbSharedDataHeader* sh = VbSharedDataRead();
+	const VbSharedDataHeader *sh = VbSharedDataGet();
 	struct vb2_context ctx;
 
+	if (nv_transaction) {
+		/* Read NV storage if we haven't yet, then just update it */
+		if (-1 == vb2_get_nv_storage(param))
+			return -1;
+		vb2_nv_set(&cached_ctx, param, (uint32_t)value);
+		return 0;
+	}
+
 	/* TODO: locking around NV access */
 	memset(&ctx, 0, sizeof(ctx));
 	if (sh && sh->flags & VBSD_NVDATA_V2)
@@ -139,6 +381,11 @@ int vb2_set_nv_storage(enum vb2_nv_param param, int value)
 			return -1;
 	}
 
+	/* What we just read, or wrote, is now the latest copy */
+	cached_ctx = ctx;
+	cached_ctx.flags &= ~VB2_CONTEXT_NVDATA_CHANGED;
+	vnc_read = 1;
+
 	/* Success */
 	return 0;
 }
@@ -323,9 +570,105 @@ LoadKernelDebugExit:
 	return dest;
 }
 
+/* Names for boot timestamp events; see enum vb2_timestamp_event */
+static const char *const timestamp_names[] = {
+	[VB2_TS_FW_PHASE1_ENTER] = "fw_phase1_enter",
+	[VB2_TS_FW_PHASE1_EXIT] = "fw_phase1_exit",
+	[VB2_TS_FW_PHASE2_ENTER] = "fw_phase2_enter",
+	[VB2_TS_FW_PHASE2_EXIT] = "fw_phase2_exit",
+	[VB2_TS_FW_PHASE3_ENTER] = "fw_phase3_enter",
+	[VB2_TS_FW_PHASE3_EXIT] = "fw_phase3_exit",
+	[VB2_TS_INIT_HASH] = "init_hash",
+	[VB2_TS_CHECK_HASH_ENTER] = "check_hash_enter",
+	[VB2_TS_CHECK_HASH_EXIT] = "check_hash_exit",
+	[VB2_TS_LOAD_KERNEL_ENTER] = "load_kernel_enter",
+	[VB2_TS_LOAD_KERNEL_EXIT] = "load_kernel_exit",
+	[VB2_TS_DISK_READ_START] = "disk_read_start",
+	[VB2_TS_DISK_READ_END] = "disk_read_end",
+	[VB2_TS_RSA_VERIFY_START] = "rsa_verify_start",
+	[VB2_TS_RSA_VERIFY_END] = "rsa_verify_end",
+};
+
+char *GetVdatTimestamps(char *dest, int size, const VbSharedDataHeader *sh)
+{
+	int used = 0;
+	uint32_t first = 0;
+	uint32_t i;
+
+	/* Older firmware doesn't record timestamps */
+	if (sh->struct_version < 3)
+		return NULL;
+
+	/* Make sure we have space for truncation warning */
+	if (size < strlen(TRUNCATED) + 1)
+		return NULL;
+	size -= strlen(TRUNCATED) + 1;
+
+	dest[0] = '\0';
+	if (sh->timestamp_count > VBSD_MAX_TIMESTAMPS)
+		first = sh->timestamp_count - VBSD_MAX_TIMESTAMPS;
+	for (i = first; i < sh->timestamp_count; i++) {
+		const VbSharedDataTimestamp *ts =
+			sh->timestamps + (i & (VBSD_MAX_TIMESTAMPS - 1));
+		const char *name = NULL;
+
+		if (ts->event < ARRAY_SIZE(timestamp_names))
+			name = timestamp_names[ts->event];
+
+		if (name)
+			used += snprintf(dest + used, size - used,
+					 "%u %s\n", ts->time_ms, name);
+		else
+			used += snprintf(dest + used, size - used,
+					 "%u event_%u\n", ts->time_ms,
+					 ts->event);
+		if (used > size)
+			break;
+	}
+
+	/* Warn if data was truncated; we left space for this above. */
+	if (used > size)
+		strcat(dest, TRUNCATED);
+
+	return dest;
+}
+
+char *GetVdatTpmStats(char *dest, int size, const VbSharedDataHeader *sh)
+{
+	int used = 0;
+	uint32_t i;
+
+	/* Older firmware doesn't record TPM statistics */
+	if (sh->struct_version < 4)
+		return NULL;
+
+	/* Make sure we have space for truncation warning */
+	if (size < strlen(TRUNCATED) + 1)
+		return NULL;
+	size -= strlen(TRUNCATED) + 1;
+
+	dest[0] = '\0';
+	for (i = 0; i < sh->tpm_stats_count && i < VBSD_MAX_TPM_STATS; i++) {
+		const VbSharedDataTpmStats *s = sh->tpm_stats + i;
+
+		used += snprintf(dest + used, size - used,
+				 "0x%x count=%u total_us=%u max_us=%u "
+				 "retries=%u\n", s->command, s->count,
+				 s->total_us, s->max_us, s->selftest_retries);
+		if (used > size)
+			break;
+	}
+
+	/* Warn if data was truncated; we left space for this above. */
+	if (used > size)
+		strcat(dest, TRUNCATED);
+
+	return dest;
+}
+
 char *GetVdatString(char *dest, int size, VdatStringField field)
 {
-	VbSharedDataHeader *sh = VbSharedDataRead();
+	const VbSharedDataHeader *sh = VbSharedDataGet();
 	char *value = dest;
 
 	if (!sh)
@@ -353,6 +696,14 @@ char *GetVdatString(char *dest, int size, VdatStringField field)
 			value = GetVdatLoadKernelDebug(dest, size, sh);
 			break;
 
+		case VDAT_STRING_TIMESTAMPS:
+			value = GetVdatTimestamps(dest, size, sh);
+			break;
+
+		case VDAT_STRING_TPM_STATS:
+			value = GetVdatTpmStats(dest, size, sh);
+			break;
+
 		case VDAT_STRING_MAINFW_ACT:
 			switch(sh->firmware_index) {
 				case 0:
@@ -374,13 +725,12 @@ char *GetVdatString(char *dest, int size, VdatStringField field)
 			break;
 	}
 
-	free(sh);
 	return value;
 }
 
 int GetVdatInt(VdatIntField field)
 {
-	VbSharedDataHeader* sh = VbSharedDataRead();
+	const VbSharedDataHeader *sh = VbSharedDataGet();
 	int value = -1;
 
 	if (!sh)
@@ -439,7 +789,6 @@ int GetVdatInt(VdatIntField field)
 		}
 	}
 
-	free(sh);
 	return value;
 }
 
@@ -449,8 +798,148 @@ int VbSharedDataVersion(void)
 	return GetVdatInt(VDAT_INT_HEADER_VERSION);
 }
 
+/* Where an integer property is kept */
+typedef enum IntPropertyType {
+	PROP_NV = 0,   /* NV storage param */
+	PROP_KERN_NV,  /* Bit field of the kernel NV storage field */
+	PROP_VDAT,     /* VbSharedData field */
+} IntPropertyType;
+
+/* Flags for IntProperty */
+#define PROP_CAN_SET     0x01  /* Writable */
+#define PROP_CLEAR_ONLY  0x02  /* Can only be cleared; set by firmware */
+#define PROP_BACKUP      0x04  /* Writable, and flag NV for backup after */
+
+typedef struct IntProperty {
+	const char *name;
+	IntPropertyType type;
+	int param;  /* vb2_nv_param, kern_nv mask or VdatIntField, per type */
+	int flags;
+} IntProperty;
+
+/*
+ * Integer properties which are just a field in NV storage or VbSharedData.
+ * Sorted by name, ignoring case, for bsearch().
+ */
+static const IntProperty int_properties[] = {
+	/* Best-effort only, since it requires firmware and TPM support */
+	{"backup_nvram_request", PROP_NV,
+	 VB2_NV_BACKUP_NVRAM_REQUEST, PROP_CAN_SET},
+	{"battery_cutoff_request", PROP_NV,
+	 VB2_NV_BATTERY_CUTOFF_REQUEST, PROP_CAN_SET},
+	{"block_devmode", PROP_KERN_NV,
+	 KERN_NV_BLOCK_DEVMODE_FLAG, PROP_BACKUP},
+	{"boot_on_ac_detect", PROP_NV, VB2_NV_BOOT_ON_AC_DETECT, PROP_BACKUP},
+	{"clear_tpm_owner_done", PROP_NV,
+	 VB2_NV_CLEAR_TPM_OWNER_DONE, PROP_CLEAR_ONLY},
+	{"clear_tpm_owner_request", PROP_NV,
+	 VB2_NV_CLEAR_TPM_OWNER_REQUEST, PROP_CAN_SET},
+	{"dbg_reset", PROP_NV, VB2_NV_DEBUG_RESET_MODE, PROP_CAN_SET},
+	{"dev_boot_fastboot_full_cap", PROP_NV,
+	 VB2_NV_DEV_BOOT_FASTBOOT_FULL_CAP, PROP_BACKUP},
+	{"dev_boot_legacy", PROP_NV, VB2_NV_DEV_BOOT_LEGACY, PROP_BACKUP},
+	{"dev_boot_signed_only", PROP_NV,
+	 VB2_NV_DEV_BOOT_SIGNED_ONLY, PROP_BACKUP},
+	{"dev_boot_usb", PROP_NV, VB2_NV_DEV_BOOT_USB, PROP_BACKUP},
+	{"dev_enable_udc", PROP_NV, VB2_NV_DEV_ENABLE_UDC, PROP_BACKUP},
+	{"devsw_boot", PROP_VDAT, VDAT_INT_DEVSW_BOOT, 0},
+	{"devsw_virtual", PROP_VDAT, VDAT_INT_DEVSW_VIRTUAL, 0},
+	{"disable_dev_request", PROP_NV,
+	 VB2_NV_DISABLE_DEV_REQUEST, PROP_CAN_SET},
+	{"fastboot_unlock_in_fw", PROP_NV,
+	 VB2_NV_FASTBOOT_UNLOCK_IN_FW, PROP_BACKUP},
+	{"fw_try_count", PROP_NV, VB2_NV_TRY_COUNT, PROP_CAN_SET},
+	{"fw_vboot2", PROP_VDAT, VDAT_INT_FW_BOOT2, 0},
+	{"fwb_tries", PROP_NV, VB2_NV_TRY_COUNT, PROP_CAN_SET},
+	{"fwupdate_tries", PROP_KERN_NV,
+	 KERN_NV_FWUPDATE_TRIES_MASK, PROP_BACKUP},
+	{"kern_nv", PROP_NV, VB2_NV_KERNEL_FIELD, 0},
+	{"kernel_max_rollforward", PROP_NV,
+	 VB2_NV_KERNEL_MAX_ROLLFORWARD, PROP_CAN_SET},
+	{"loc_idx", PROP_NV, VB2_NV_LOCALIZATION_INDEX, PROP_BACKUP},
+	{"nvram_cleared", PROP_NV,
+	 VB2_NV_KERNEL_SETTINGS_RESET, PROP_CLEAR_ONLY},
+	{"oprom_needed", PROP_NV, VB2_NV_OPROM_NEEDED, PROP_CAN_SET},
+	{"recovery_reason", PROP_VDAT, VDAT_INT_RECOVERY_REASON, 0},
+	{"recovery_request", PROP_NV, VB2_NV_RECOVERY_REQUEST, PROP_CAN_SET},
+	{"recovery_subcode", PROP_NV, VB2_NV_RECOVERY_SUBCODE, PROP_CAN_SET},
+	{"recoverysw_boot", PROP_VDAT, VDAT_INT_RECSW_BOOT, 0},
+	/* Should only be read and cleared, but may be set to 1 for testing */
+	{"tpm_attack", PROP_KERN_NV, KERN_NV_TPM_ATTACK_FLAG, PROP_BACKUP},
+	{"tpm_fwver", PROP_VDAT, VDAT_INT_FW_VERSION_TPM, 0},
+	{"tpm_kernver", PROP_VDAT, VDAT_INT_KERNEL_VERSION_TPM, 0},
+	{"tpm_rebooted", PROP_NV, VB2_NV_TPM_REQUESTED_REBOOT, 0},
+	{"tried_fwb", PROP_VDAT, VDAT_INT_TRIED_FIRMWARE_B, 0},
+	{"try_ro_sync", PROP_NV, VB2_NV_TRY_RO_SYNC, PROP_BACKUP},
+	{"vdat_flags", PROP_VDAT, VDAT_INT_FLAGS, 0},
+	{"wipeout_request", PROP_NV, VB2_NV_REQ_WIPEOUT, PROP_CLEAR_ONLY},
+	{"wpsw_boot", PROP_VDAT, VDAT_INT_HW_WPSW_BOOT, 0},
+};
+
+static int CompareIntProperty(const void *name, const void *p)
+{
+	return strcasecmp(name, ((const IntProperty *)p)->name);
+}
+
+static const IntProperty *FindIntProperty(const char *name)
+{
+	return bsearch(name, int_properties, ARRAY_SIZE(int_properties),
+		       sizeof(int_properties[0]), CompareIntProperty);
+}
+
+/* Lowest set bit of a kern_nv mask; the field's value is in units of this */
+#define KERN_NV_LOW_BIT(mask) ((mask) & -(mask))
+
+static int GetIntProperty(const IntProperty *p)
+{
+	int value;
+
+	switch (p->type) {
+	case PROP_KERN_NV:
+		value = vb2_get_nv_storage(VB2_NV_KERNEL_FIELD);
+		if (value == -1)
+			return -1;
+		return (value & p->param) / KERN_NV_LOW_BIT(p->param);
+	case PROP_VDAT:
+		return GetVdatInt(p->param);
+	default:
+		return vb2_get_nv_storage(p->param);
+	}
+}
+
+static int SetIntProperty(const IntProperty *p, int value)
+{
+	int kern_nv;
+
+	if (!(p->flags & (PROP_CAN_SET | PROP_CLEAR_ONLY | PROP_BACKUP)))
+		return -1;
+	if (p->flags & PROP_CLEAR_ONLY)
+		value = 0;
+
+	switch (p->type) {
+	case PROP_KERN_NV:
+		kern_nv = vb2_get_nv_storage(VB2_NV_KERNEL_FIELD);
+		if (kern_nv == -1)
+			return -1;
+		/* A single bit field is set by any non-zero value */
+		if (p->param == KERN_NV_LOW_BIT(p->param))
+			value = !!value;
+		kern_nv &= ~p->param;
+		kern_nv |= (value * KERN_NV_LOW_BIT(p->param)) & p->param;
+		return vb2_set_nv_storage_with_backup(VB2_NV_KERNEL_FIELD,
+						      kern_nv);
+	case PROP_NV:
+		if (p->flags & PROP_BACKUP)
+			return vb2_set_nv_storage_with_backup(p->param, value);
+		return vb2_set_nv_storage(p->param, value);
+	default:
+		return -1;
+	}
+}
+
 int VbGetSystemPropertyInt(const char *name)
 {
+	const IntProperty *p;
 	int value = -1;
 
 	/* Check architecture-dependent properties first */
@@ -458,98 +947,15 @@ int VbGetSystemPropertyInt(const char *name)
 	if (-1 != value)
 		return value;
 
-	/* NV storage values */
-	else if (!strcasecmp(name,"kern_nv")) {
-		value = vb2_get_nv_storage(VB2_NV_KERNEL_FIELD);
-	} else if (!strcasecmp(name,"nvram_cleared")) {
-		value = vb2_get_nv_storage(VB2_NV_KERNEL_SETTINGS_RESET);
-	} else if (!strcasecmp(name,"recovery_request")) {
-		value = vb2_get_nv_storage(VB2_NV_RECOVERY_REQUEST);
-	} else if (!strcasecmp(name,"dbg_reset")) {
-		value = vb2_get_nv_storage(VB2_NV_DEBUG_RESET_MODE);
-	} else if (!strcasecmp(name,"disable_dev_request")) {
-		value = vb2_get_nv_storage(VB2_NV_DISABLE_DEV_REQUEST);
-	} else if (!strcasecmp(name,"clear_tpm_owner_request")) {
-		value = vb2_get_nv_storage(VB2_NV_CLEAR_TPM_OWNER_REQUEST);
-	} else if (!strcasecmp(name,"clear_tpm_owner_done")) {
-		value = vb2_get_nv_storage(VB2_NV_CLEAR_TPM_OWNER_DONE);
-	} else if (!strcasecmp(name,"tpm_rebooted")) {
-		value = vb2_get_nv_storage(VB2_NV_TPM_REQUESTED_REBOOT);
-	} else if (!strcasecmp(name,"fwb_tries") ||
-		   !strcasecmp(name,"fw_try_count")) {
-		value = vb2_get_nv_storage(VB2_NV_TRY_COUNT);
-	} else if (!strcasecmp(name,"fw_vboot2")) {
-		value = GetVdatInt(VDAT_INT_FW_BOOT2);
-	} else if (!strcasecmp(name,"fwupdate_tries")) {
-		value = vb2_get_nv_storage(VB2_NV_KERNEL_FIELD);
-		if (value != -1)
-			value &= KERN_NV_FWUPDATE_TRIES_MASK;
-	} else if (!strcasecmp(name,"block_devmode")) {
-		value = vb2_get_nv_storage(VB2_NV_KERNEL_FIELD);
-		if (value != -1) {
-			value &= KERN_NV_BLOCK_DEVMODE_FLAG;
-			value = !!value;
-		}
-	} else if (!strcasecmp(name,"tpm_attack")) {
-		value = vb2_get_nv_storage(VB2_NV_KERNEL_FIELD);
-		if (value != -1) {
-			value &= KERN_NV_TPM_ATTACK_FLAG;
-			value = !!value;
-		}
-	} else if (!strcasecmp(name,"loc_idx")) {
-		value = vb2_get_nv_storage(VB2_NV_LOCALIZATION_INDEX);
-	} else if (!strcasecmp(name,"backup_nvram_request")) {
-		value = vb2_get_nv_storage(VB2_NV_BACKUP_NVRAM_REQUEST);
-	} else if (!strcasecmp(name,"dev_boot_usb")) {
-		value = vb2_get_nv_storage(VB2_NV_DEV_BOOT_USB);
-	} else if (!strcasecmp(name,"dev_boot_legacy")) {
-		value = vb2_get_nv_storage(VB2_NV_DEV_BOOT_LEGACY);
-	} else if (!strcasecmp(name,"dev_boot_signed_only")) {
-		value = vb2_get_nv_storage(VB2_NV_DEV_BOOT_SIGNED_ONLY);
-	} else if (!strcasecmp(name,"dev_boot_fastboot_full_cap")) {
-		value = vb2_get_nv_storage(VB2_NV_DEV_BOOT_FASTBOOT_FULL_CAP);
-	} else if (!strcasecmp(name,"dev_enable_udc")) {
-		value = vb2_get_nv_storage(VB2_NV_DEV_ENABLE_UDC);
-	} else if (!strcasecmp(name,"oprom_needed")) {
-		value = vb2_get_nv_storage(VB2_NV_OPROM_NEEDED);
-	} else if (!strcasecmp(name,"recovery_subcode")) {
-		value = vb2_get_nv_storage(VB2_NV_RECOVERY_SUBCODE);
-	} else if (!strcasecmp(name,"wipeout_request")) {
-		value = vb2_get_nv_storage(VB2_NV_REQ_WIPEOUT);
-	} else if (!strcasecmp(name,"kernel_max_rollforward")) {
-		value = vb2_get_nv_storage(VB2_NV_KERNEL_MAX_ROLLFORWARD);
-	}
+	p = FindIntProperty(name);
+	if (p)
+		return GetIntProperty(p);
+
 	/* Other parameters */
-	else if (!strcasecmp(name,"cros_debug")) {
+	if (!strcasecmp(name,"cros_debug")) {
 		value = VbGetCrosDebug();
 	} else if (!strcasecmp(name,"debug_build")) {
 		value = VbGetDebugBuild();
-	} else if (!strcasecmp(name,"devsw_boot")) {
-		value = GetVdatInt(VDAT_INT_DEVSW_BOOT);
-	} else if (!strcasecmp(name,"devsw_virtual")) {
-		value = GetVdatInt(VDAT_INT_DEVSW_VIRTUAL);
-	} else if (!strcasecmp(name, "recoverysw_boot")) {
-		value = GetVdatInt(VDAT_INT_RECSW_BOOT);
-	} else if (!strcasecmp(name, "wpsw_boot")) {
-		value = GetVdatInt(VDAT_INT_HW_WPSW_BOOT);
-	} else if (!strcasecmp(name,"vdat_flags")) {
-		value = GetVdatInt(VDAT_INT_FLAGS);
-	} else if (!strcasecmp(name,"tpm_fwver")) {
-		value = GetVdatInt(VDAT_INT_FW_VERSION_TPM);
-	} else if (!strcasecmp(name,"tpm_kernver")) {
-		value = GetVdatInt(VDAT_INT_KERNEL_VERSION_TPM);
-	} else if (!strcasecmp(name,"tried_fwb")) {
-		value = GetVdatInt(VDAT_INT_TRIED_FIRMWARE_B);
-	} else if (!strcasecmp(name,"recovery_reason")) {
-		value = GetVdatInt(VDAT_INT_RECOVERY_REASON);
-	} else if (!strcasecmp(name, "fastboot_unlock_in_fw")) {
-		value = vb2_get_nv_storage(VB2_NV_FASTBOOT_UNLOCK_IN_FW);
-	} else if (!strcasecmp(name, "boot_on_ac_detect")) {
-		value = vb2_get_nv_storage(VB2_NV_BOOT_ON_AC_DETECT);
-	} else if (!strcasecmp(name, "try_ro_sync")) {
-		value = vb2_get_nv_storage(VB2_NV_TRY_RO_SYNC);
-	} else if (!strcasecmp(name, "battery_cutoff_request")) {
-		value = vb2_get_nv_storage(VB2_NV_BATTERY_CUTOFF_REQUEST);
 	} else if (!strcasecmp(name, "inside_vm")) {
 		/* Detect if the host is a VM. If there is no HWID and the
 		 * firmware type is "nonchrome", then assume it is a VM. If
@@ -596,6 +1002,10 @@ const char *VbGetSystemPropertyString(const char *name, char *dest,
 				     VDAT_STRING_LOAD_FIRMWARE_DEBUG);
 	} else if (!strcasecmp(name, "vdat_lkdebug")) {
 		return GetVdatString(dest, size, VDAT_STRING_LOAD_KERNEL_DEBUG);
+	} else if (!strcasecmp(name, "vdat_timestamps")) {
+		return GetVdatString(dest, size, VDAT_STRING_TIMESTAMPS);
+	} else if (!strcasecmp(name, "vdat_tpm_stats")) {
+		return GetVdatString(dest, size, VDAT_STRING_TPM_STATS);
 	} else if (!strcasecmp(name, "fw_try_next")) {
 		return vb2_get_nv_storage(VB2_NV_TRY_NEXT) ? "B" : "A";
 	} else if (!strcasecmp(name, "fw_tried")) {
@@ -628,102 +1038,16 @@ const char *VbGetSystemPropertyString(const char *name, char *dest,
 
 int VbSetSystemPropertyInt(const char *name, int value)
 {
+	const IntProperty *p;
+
 	/* Check architecture-dependent properties first */
 
 	if (0 == VbSetArchPropertyInt(name, value))
 		return 0;
 
-	/* NV storage values */
-	if (!strcasecmp(name,"nvram_cleared")) {
-		/* Can only clear this flag; it's set inside the NV storage
-		 * library. */
-		return vb2_set_nv_storage(VB2_NV_KERNEL_SETTINGS_RESET, 0);
-	} else if (!strcasecmp(name,"recovery_request")) {
-		return vb2_set_nv_storage(VB2_NV_RECOVERY_REQUEST, value);
-	} else if (!strcasecmp(name,"recovery_subcode")) {
-		return vb2_set_nv_storage(VB2_NV_RECOVERY_SUBCODE, value);
-	} else if (!strcasecmp(name,"dbg_reset")) {
-		return vb2_set_nv_storage(VB2_NV_DEBUG_RESET_MODE, value);
-	} else if (!strcasecmp(name,"disable_dev_request")) {
-		return vb2_set_nv_storage(VB2_NV_DISABLE_DEV_REQUEST, value);
-	} else if (!strcasecmp(name,"clear_tpm_owner_request")) {
-		return vb2_set_nv_storage(VB2_NV_CLEAR_TPM_OWNER_REQUEST, value);
-	} else if (!strcasecmp(name,"clear_tpm_owner_done")) {
-		/* Can only clear this flag; it's set by firmware. */
-		return vb2_set_nv_storage(VB2_NV_CLEAR_TPM_OWNER_DONE, 0);
-	} else if (!strcasecmp(name,"fwb_tries") ||
-		   !strcasecmp(name,"fw_try_count")) {
-		return vb2_set_nv_storage(VB2_NV_TRY_COUNT, value);
-	} else if (!strcasecmp(name,"oprom_needed")) {
-		return vb2_set_nv_storage(VB2_NV_OPROM_NEEDED, value);
-	} else if (!strcasecmp(name,"wipeout_request")) {
-		/* Can only clear this flag, set only by firmware. */
-		return vb2_set_nv_storage(VB2_NV_REQ_WIPEOUT, 0);
-	} else if (!strcasecmp(name,"backup_nvram_request")) {
-		/* Best-effort only, since it requires firmware and TPM
-		 * support. */
-		return vb2_set_nv_storage(VB2_NV_BACKUP_NVRAM_REQUEST, value);
-	} else if (!strcasecmp(name,"fwupdate_tries")) {
-		int kern_nv = vb2_get_nv_storage(VB2_NV_KERNEL_FIELD);
-		if (kern_nv == -1)
-			return -1;
-		kern_nv &= ~KERN_NV_FWUPDATE_TRIES_MASK;
-		kern_nv |= (value & KERN_NV_FWUPDATE_TRIES_MASK);
-		return vb2_set_nv_storage_with_backup(VB2_NV_KERNEL_FIELD,
-						      kern_nv);
-	} else if (!strcasecmp(name,"block_devmode")) {
-		int kern_nv = vb2_get_nv_storage(VB2_NV_KERNEL_FIELD);
-		if (kern_nv == -1)
-			return -1;
-		kern_nv &= ~KERN_NV_BLOCK_DEVMODE_FLAG;
-		if (value)
-			kern_nv |= KERN_NV_BLOCK_DEVMODE_FLAG;
-		return vb2_set_nv_storage_with_backup(VB2_NV_KERNEL_FIELD,
-						      kern_nv);
-	} else if (!strcasecmp(name,"tpm_attack")) {
-		/* This value should only be read and cleared, but we allow
-		 * setting it to 1 for testing. */
-		int kern_nv = vb2_get_nv_storage(VB2_NV_KERNEL_FIELD);
-		if (kern_nv == -1)
-			return -1;
-		kern_nv &= ~KERN_NV_TPM_ATTACK_FLAG;
-		if (value)
-			kern_nv |= KERN_NV_TPM_ATTACK_FLAG;
-		return vb2_set_nv_storage_with_backup(
-		    VB2_NV_KERNEL_FIELD, kern_nv);
-	} else if (!strcasecmp(name,"loc_idx")) {
-		return vb2_set_nv_storage_with_backup(
-		    VB2_NV_LOCALIZATION_INDEX,
-						 value);
-	} else if (!strcasecmp(name,"dev_boot_usb")) {
-		return vb2_set_nv_storage_with_backup(
-		    VB2_NV_DEV_BOOT_USB, value);
-	} else if (!strcasecmp(name,"dev_boot_legacy")) {
-		return vb2_set_nv_storage_with_backup(
-		    VB2_NV_DEV_BOOT_LEGACY, value);
-	} else if (!strcasecmp(name,"dev_boot_signed_only")) {
-		return vb2_set_nv_storage_with_backup(
-		    VB2_NV_DEV_BOOT_SIGNED_ONLY, value);
-	} else if (!strcasecmp(name,"dev_boot_fastboot_full_cap")) {
-		return vb2_set_nv_storage_with_backup(
-		    VB2_NV_DEV_BOOT_FASTBOOT_FULL_CAP, value);
-	} else if (!strcasecmp(name, "fastboot_unlock_in_fw")) {
-		return vb2_set_nv_storage_with_backup(
-		    VB2_NV_FASTBOOT_UNLOCK_IN_FW, value);
-	} else if (!strcasecmp(name, "dev_enable_udc")) {
-		return vb2_set_nv_storage_with_backup(
-		    VB2_NV_DEV_ENABLE_UDC, value);
-	} else if (!strcasecmp(name, "boot_on_ac_detect")) {
-		return vb2_set_nv_storage_with_backup(
-		    VB2_NV_BOOT_ON_AC_DETECT, value);
-	} else if (!strcasecmp(name, "try_ro_sync")) {
-		return vb2_set_nv_storage_with_backup(
-		    VB2_NV_TRY_RO_SYNC, value);
-	} else if (!strcasecmp(name, "battery_cutoff_request")) {
-		return vb2_set_nv_storage(VB2_NV_BATTERY_CUTOFF_REQUEST, value);
-	} else if (!strcasecmp(name,"kernel_max_rollforward")) {
-		return vb2_set_nv_storage(VB2_NV_KERNEL_MAX_ROLLFORWARD, value);
-	}
+	p = FindIntProperty(name);
+	if (p)
+		return SetIntProperty(p, value);
 
 	return -1;
 }
@@ -843,6 +1167,60 @@ static int ExecuteMosys(char * const argv[], char *buf, size_t bufsize)
 	return 0;
 }
 
+/*
+ * Read or write the EC's NV storage block.
+ *
+ * Returns 0 if success, -1 if error. */
+static int CrosEcVbnvContext(uint32_t op, uint8_t *block)
+{
+	struct {
+		struct cros_ec_command_v2 cmd;
+		/* The response (just the block) is returned here too */
+		struct ec_params_vbnvcontext params;
+	} __attribute__((packed)) buf;
+	int fd, rv;
+
+	memset(&buf, 0, sizeof(buf));
+	buf.cmd.version = EC_VER_VBNV_CONTEXT;
+	buf.cmd.command = EC_CMD_VBNV_CONTEXT;
+	buf.cmd.outsize = sizeof(buf.params);
+	buf.params.op = op;
+	if (op == EC_VBNV_CONTEXT_OP_READ)
+		buf.cmd.insize = EC_VBNV_BLOCK_SIZE;
+	else
+		memcpy(buf.params.block, block, EC_VBNV_BLOCK_SIZE);
+
+	fd = open(CROS_EC_DEV_PATH, O_RDWR);
+	if (fd < 0)
+		return -1;
+	rv = ioctl(fd, CROS_EC_DEV_IOCXCMD_V2, &buf);
+	close(fd);
+	if (rv < 0 || buf.cmd.result)
+		return -1;
+
+	if (op == EC_VBNV_CONTEXT_OP_READ) {
+		if (rv < EC_VBNV_BLOCK_SIZE)
+			return -1;
+		memcpy(block, &buf.params, EC_VBNV_BLOCK_SIZE);
+	}
+	return 0;
+}
+
+int vb2_read_nv_storage_cros_ec(struct vb2_context *ctx)
+{
+	/* The EC only keeps the original 16-byte records */
+	if (vb2_nv_get_size(ctx) != EC_VBNV_BLOCK_SIZE)
+		return -1;
+	return CrosEcVbnvContext(EC_VBNV_CONTEXT_OP_READ, ctx->nvdata);
+}
+
+int vb2_write_nv_storage_cros_ec(struct vb2_context *ctx)
+{
+	if (vb2_nv_get_size(ctx) != EC_VBNV_BLOCK_SIZE)
+		return -1;
+	return CrosEcVbnvContext(EC_VBNV_CONTEXT_OP_WRITE, ctx->nvdata);
+}
+
 int vb2_read_nv_storage_mosys(struct vb2_context *ctx)
 {
 	/* Reserve extra 32 bytes */
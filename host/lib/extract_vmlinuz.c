@@ -2,74 +2,232 @@
  * Use of this source code is governed by a BSD-style license that can be
  * found in the LICENSE file.
  *
- * Exports a vmlinuz from a kernel partition in memory.
+ * Exports a vmlinuz from a kernel partition in memory or in a file.
  */
 
+#include <errno.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
+#ifndef HAVE_MACOS
+#include <sys/sendfile.h>
+#endif
 
 #include "vb2_struct.h"
 #include "vboot_struct.h"
 
+/* Largest chunk moved by a single pread()/write() when copying a file */
+#define COPY_CHUNK_SIZE (1024 * 1024)
 
-int ExtractVmlinuz(void *kpart_data, size_t kpart_size,
-		   void **vmlinuz_out, size_t *vmlinuz_size) {
-	size_t now = 0;
-	struct vb2_kernel_preamble *preamble = NULL;
-	uint8_t *kblob_data = NULL;
-	uint32_t kblob_size = 0;
-	uint32_t vmlinuz_header_size = 0;
-	uint64_t vmlinuz_header_address = 0;
-	uint64_t vmlinuz_header_offset = 0;
-	void *vmlinuz = NULL;
-
-	struct vb2_keyblock *keyblock = (struct vb2_keyblock *)kpart_data;
-	now += keyblock->keyblock_size;
-	if (now > kpart_size)
-		return 1;
+/*
+ * Locate the vmlinuz header and the kernel blob using the keyblock and
+ * preamble headers. The preamble starts at keyblock->keyblock_size. Offsets
+ * are from the start of a partition kpart_size bytes long.
+ *
+ * Returns 0 if both ranges lie within the partition, non-zero if not.
+ */
+static int find_vmlinuz(const struct vb2_keyblock *keyblock,
+			const struct vb2_kernel_preamble *preamble,
+			uint64_t kpart_size,
+			uint64_t *header_offset, uint32_t *header_size,
+			uint64_t *kblob_offset, uint32_t *kblob_size)
+{
+	uint64_t now = keyblock->keyblock_size;
+	uint64_t vmlinuz_header_address;
 
-	preamble = (struct vb2_kernel_preamble *)(kpart_data + now);
 	now += preamble->preamble_size;
 	if (now > kpart_size)
 		return 1;
 
-	kblob_data = kpart_data + now;
-	kblob_size = preamble->body_signature.data_size;
-
-	if (!kblob_data || (now + kblob_size) > kpart_size)
+	*kblob_offset = now;
+	*kblob_size = preamble->body_signature.data_size;
+	if (now + *kblob_size > kpart_size)
 		return 1;
 
-	if (preamble->header_version_minor > 0) {
-		vmlinuz_header_address = preamble->vmlinuz_header_address;
-		vmlinuz_header_size = preamble->vmlinuz_header_size;
-	}
+	if (preamble->header_version_minor == 0)
+		return 1;
 
-	if (!vmlinuz_header_size ||
-	    kpart_data + vmlinuz_header_offset + vmlinuz_header_size >
-	    kpart_data) {
+	vmlinuz_header_address = preamble->vmlinuz_header_address;
+	*header_size = preamble->vmlinuz_header_size;
+	if (!*header_size ||
+	    vmlinuz_header_address < preamble->body_load_address)
 		return 1;
-	}
 
 	// calculate the vmlinuz_header offset from
 	// the beginning of the kpart_data.  The kblob doesn't
 	// include the body_load_offset, but does include
 	// the keyblock and preamble sections.
-	vmlinuz_header_offset = vmlinuz_header_address -
-		preamble->body_load_address +
-		keyblock->keyblock_size +
-		preamble->preamble_size;
+	*header_offset = vmlinuz_header_address -
+		preamble->body_load_address + now;
+	if (*header_offset > kpart_size ||
+	    *header_size > kpart_size - *header_offset)
+		return 1;
+
+	return 0;
+}
+
+int ExtractVmlinuz(void *kpart_data, size_t kpart_size,
+		   void **vmlinuz_out, size_t *vmlinuz_size) {
+	struct vb2_keyblock *keyblock = (struct vb2_keyblock *)kpart_data;
+	struct vb2_kernel_preamble *preamble;
+	uint64_t vmlinuz_header_offset, kblob_offset;
+	uint32_t vmlinuz_header_size, kblob_size;
+	uint8_t *vmlinuz;
+
+	if (kpart_size < sizeof(*keyblock) + sizeof(*preamble) ||
+	    keyblock->keyblock_size > kpart_size - sizeof(*preamble))
+		return 1;
+	preamble = (struct vb2_kernel_preamble *)
+		((uint8_t *)kpart_data + keyblock->keyblock_size);
+
+	if (find_vmlinuz(keyblock, preamble, kpart_size,
+			 &vmlinuz_header_offset, &vmlinuz_header_size,
+			 &kblob_offset, &kblob_size))
+		return 1;
 
 	vmlinuz = malloc(vmlinuz_header_size + kblob_size);
 	if (vmlinuz == NULL)
 		return 1;
 
-	memcpy(vmlinuz, kpart_data + vmlinuz_header_offset,
+	memcpy(vmlinuz, (uint8_t *)kpart_data + vmlinuz_header_offset,
 	       vmlinuz_header_size);
 
-	memcpy(vmlinuz + vmlinuz_header_size, kblob_data, kblob_size);
+	memcpy(vmlinuz + vmlinuz_header_size,
+	       (uint8_t *)kpart_data + kblob_offset, kblob_size);
 
 	*vmlinuz_out = vmlinuz;
 	*vmlinuz_size = vmlinuz_header_size + kblob_size;
 
 	return 0;
 }
+
+static int pread_fully(int fd, void *buf, size_t count, off_t offset)
+{
+	uint8_t *p = buf;
+	ssize_t n;
+
+	while (count) {
+		n = pread(fd, p, count, offset);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return 1;
+		p += n;
+		count -= n;
+		offset += n;
+	}
+
+	return 0;
+}
+
+static int write_fully(int fd, const void *buf, size_t count)
+{
+	const uint8_t *p = buf;
+	ssize_t n;
+
+	while (count) {
+		n = write(fd, p, count);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return 1;
+		p += n;
+		count -= n;
+	}
+
+	return 0;
+}
+
+/* Return non-zero if a failed in-kernel copy is worth retrying another way. */
+static int copy_unsupported(int err)
+{
+	return err == EINVAL || err == EXDEV || err == ENOSYS ||
+		err == EOPNOTSUPP || err == EBADF;
+}
+
+/* Copy count bytes at offset in in_fd to the current position of out_fd. */
+static int copy_range(int in_fd, off_t offset, int out_fd, size_t count)
+{
+	uint8_t *buf;
+	size_t len;
+	ssize_t n;
+
+#ifndef HAVE_MACOS
+	/* Let the kernel move the data if it can; it may not need to copy. */
+	while (count) {
+		loff_t off_in = offset;
+
+		n = copy_file_range(in_fd, &off_in, out_fd, NULL, count, 0);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n < 0 && copy_unsupported(errno))
+			break;
+		if (n <= 0)
+			return 1;
+		offset += n;
+		count -= n;
+	}
+	while (count) {
+		n = sendfile(out_fd, in_fd, &offset, count);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n < 0 && copy_unsupported(errno))
+			break;
+		if (n <= 0)
+			return 1;
+		count -= n;
+	}
+#endif
+	if (!count)
+		return 0;
+
+	buf = malloc(count < COPY_CHUNK_SIZE ? count : COPY_CHUNK_SIZE);
+	if (!buf)
+		return 1;
+
+	while (count) {
+		len = count < COPY_CHUNK_SIZE ? count : COPY_CHUNK_SIZE;
+		if (pread_fully(in_fd, buf, len, offset) ||
+		    write_fully(out_fd, buf, len))
+			break;
+		offset += len;
+		count -= len;
+	}
+
+	free(buf);
+	return count ? 1 : 0;
+}
+
+int ExtractVmlinuzFile(int kpart_fd, uint64_t kpart_offset,
+		       uint64_t kpart_size, int vmlinuz_fd,
+		       size_t *vmlinuz_size) {
+	struct vb2_keyblock keyblock;
+	struct vb2_kernel_preamble preamble;
+	uint64_t vmlinuz_header_offset, kblob_offset;
+	uint32_t vmlinuz_header_size, kblob_size;
+
+	if (kpart_size < sizeof(keyblock) + sizeof(preamble) ||
+	    pread_fully(kpart_fd, &keyblock, sizeof(keyblock), kpart_offset))
+		return 1;
+
+	if (keyblock.keyblock_size > kpart_size - sizeof(preamble) ||
+	    pread_fully(kpart_fd, &preamble, sizeof(preamble),
+			kpart_offset + keyblock.keyblock_size))
+		return 1;
+
+	if (find_vmlinuz(&keyblock, &preamble, kpart_size,
+			 &vmlinuz_header_offset, &vmlinuz_header_size,
+			 &kblob_offset, &kblob_size))
+		return 1;
+
+	if (copy_range(kpart_fd, kpart_offset + vmlinuz_header_offset,
+		       vmlinuz_fd, vmlinuz_header_size) ||
+	    copy_range(kpart_fd, kpart_offset + kblob_offset,
+		       vmlinuz_fd, kblob_size))
+		return 1;
+
+	if (vmlinuz_size)
+		*vmlinuz_size = vmlinuz_header_size + kblob_size;
+
+	return 0;
+}
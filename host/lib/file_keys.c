@@ -5,10 +5,12 @@
  * Utility functions for file and key handling.
  */
 
+#include <errno.h>
 #include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
@@ -21,23 +23,91 @@
 #include "host_common.h"
 #include "signature_digest.h"
 
+/* Amount of data hashed per vb2_digest_extend() call, and read buffer size */
+#define DIGEST_FILE_CHUNK_SIZE (1024 * 1024)
+
+/* Hash a mapped file.  Returns 0 if the file couldn't be mapped. */
+static int digest_mmap(int fd, off_t size, struct vb2_digest_context *ctx)
+{
+	uint8_t *data;
+	off_t offset;
+
+	if (size <= 0 || (off_t)(size_t)size != size)
+		return 0;
+
+	data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (data == MAP_FAILED)
+		return 0;
+	madvise(data, size, MADV_SEQUENTIAL);
+
+	for (offset = 0; offset < size; offset += DIGEST_FILE_CHUNK_SIZE) {
+		off_t len = size - offset;
+
+		if (len > DIGEST_FILE_CHUNK_SIZE)
+			len = DIGEST_FILE_CHUNK_SIZE;
+		vb2_digest_extend(ctx, data + offset, len);
+
+		/* Keep the mapping from growing with the size of the file */
+		madvise(data + offset, len, MADV_DONTNEED);
+	}
+
+	munmap(data, size);
+	return 1;
+}
+
+/* Hash a file by reading it.  Returns VB2_SUCCESS, or non-zero on error. */
+static int digest_read(int fd, struct vb2_digest_context *ctx)
+{
+	void *data;
+	ssize_t len;
+
+	if (posix_memalign(&data, getpagesize(), DIGEST_FILE_CHUNK_SIZE))
+		return VB2_ERROR_UNKNOWN;
+
+	while ((len = read(fd, data, DIGEST_FILE_CHUNK_SIZE)) != 0) {
+		if (len < 0) {
+			if (errno == EINTR)
+				continue;
+			free(data);
+			return VB2_ERROR_UNKNOWN;
+		}
+		vb2_digest_extend(ctx, data, len);
+	}
+
+	free(data);
+	return VB2_SUCCESS;
+}
+
 int DigestFile(char *input_file, enum vb2_hash_algorithm alg,
 	       uint8_t *digest, uint32_t digest_size)
 {
-	int input_fd, len;
-	uint8_t data[VB2_SHA1_BLOCK_SIZE];
 	struct vb2_digest_context ctx;
+	struct stat sb;
+	int input_fd;
+	int rv = VB2_SUCCESS;
 
 	if( (input_fd = open(input_file, O_RDONLY)) == -1 ) {
 		fprintf(stderr, "Couldn't open %s\n", input_file);
 		return VB2_ERROR_UNKNOWN;
 	}
 	vb2_digest_init(&ctx, alg);
-	while ((len = read(input_fd, data, sizeof(data))) == sizeof(data))
-		vb2_digest_extend(&ctx, data, len);
-	if (len != -1)
-		vb2_digest_extend(&ctx, data, len);
+
+	/*
+	 * Map regular files so the data is hashed straight out of the page
+	 * cache.  Anything else, or a file too big to map, is read in large
+	 * chunks instead.
+	 */
+	if (fstat(input_fd, &sb) || !S_ISREG(sb.st_mode) ||
+	    !digest_mmap(input_fd, sb.st_size, &ctx)) {
+		posix_fadvise(input_fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+		rv = digest_read(input_fd, &ctx);
+	}
 	close(input_fd);
 
+	if (rv) {
+		fprintf(stderr, "Couldn't read %s\n", input_file);
+		return rv;
+	}
+
 	return vb2_digest_finalize(&ctx, digest, digest_size);
 }
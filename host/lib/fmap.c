@@ -25,23 +25,67 @@ static int is_fmap(uint8_t *ptr)
 	return 0;
 }
 
+/*
+ * How strongly an FMAP at this offset should be preferred. The start of the
+ * buffer comes first, then larger alignments before smaller ones, to find the
+ * "right" FMAP.
+ */
+static size_t fmap_alignment(size_t offset)
+{
+	if (!offset)
+		return ~(size_t)0;
+	return offset & -offset;
+}
+
 /* Find and point to the FMAP header within the buffer */
 FmapHeader *fmap_find(uint8_t *ptr, size_t size)
 {
-	ssize_t offset, align;
-	ssize_t lim = size - sizeof(FmapHeader);
+	uint8_t *best = NULL;
+	uint8_t *p = ptr;
+	size_t offset;
+
+	if (size < sizeof(FmapHeader))
+		return NULL;
 
-	if (lim >= 0 && is_fmap(ptr))
-		return (FmapHeader *)ptr;
+	/*
+	 * Let memmem() look for the signature, which is much faster than
+	 * comparing at every stride, and rank whatever it finds.
+	 */
+	while ((p = memmem(p, ptr + size - p, FMAP_SIGNATURE,
+			   FMAP_SIGNATURE_SIZE))) {
+		offset = p - ptr;
+		if (offset > size - sizeof(FmapHeader))
+			break;
+		if (!(offset % FMAP_SEARCH_STRIDE) &&
+		    (!best || fmap_alignment(offset) >
+		     fmap_alignment(best - ptr)) &&
+		    is_fmap(p)) {
+			best = p;
+			if (!offset)
+				break;
+		}
+		p++;
+	}
 
-	/* Search large alignments before small ones to find "right" FMAP. */
-	for (align = FMAP_SEARCH_STRIDE; align <= lim; align *= 2);
-	for (; align >= FMAP_SEARCH_STRIDE; align /= 2)
-		for (offset = align; offset <= lim; offset += align * 2)
-			if (is_fmap(ptr + offset))
-				return (FmapHeader *)(ptr + offset);
+	return (FmapHeader *)best;
+}
 
-	return NULL;
+static FmapAreaHeader *fmap_areas(FmapHeader *fmap)
+{
+	return (FmapAreaHeader *)((void *)fmap + sizeof(FmapHeader));
+}
+
+/* Linear search for an area, or -1 if it isn't there */
+static int fmap_area_number(FmapHeader *fmap, const char *name)
+{
+	FmapAreaHeader *ah = fmap_areas(fmap);
+	int i;
+
+	for (i = 0; i < fmap->fmap_nareas; i++)
+		if (!strncmp(ah[i].area_name, name, FMAP_NAMELEN))
+			return i;
+
+	return -1;
 }
 
 /* Search for an area by name, return pointer to its beginning */
@@ -49,20 +93,99 @@ uint8_t *fmap_find_by_name(uint8_t *ptr, size_t size, FmapHeader *fmap,
 			   const char *name, FmapAreaHeader **ah_ptr)
 {
 	int i;
-	FmapAreaHeader *ah;
 
 	if (!fmap)
 		fmap = fmap_find(ptr, size);
 	if (!fmap)
 		return NULL;
 
-	ah = (FmapAreaHeader*)((void *)fmap + sizeof(FmapHeader));
-	for (i = 0; i < fmap->fmap_nareas; i++)
-		if (!strncmp(ah[i].area_name, name, FMAP_NAMELEN)) {
-			if (ah_ptr)
-				*ah_ptr = ah + i;
-			return ptr + ah[i].area_offset;
+	i = fmap_area_number(fmap, name);
+	if (i < 0)
+		return NULL;
+
+	if (ah_ptr)
+		*ah_ptr = fmap_areas(fmap) + i;
+	return ptr + fmap_areas(fmap)[i].area_offset;
+}
+
+/* FNV-1a, over no more of the name than strncmp() would compare */
+static uint32_t fmap_name_hash(const char *name)
+{
+	uint32_t hash = 2166136261u;
+	int i;
+
+	for (i = 0; i < FMAP_NAMELEN && name[i]; i++)
+		hash = (hash ^ (uint8_t)name[i]) * 16777619;
+
+	return hash;
+}
+
+FmapHeader *fmap_index_init(struct fmap_index *index, uint8_t *ptr,
+			    size_t size, FmapHeader *fmap)
+{
+	FmapAreaHeader *ah;
+	uint32_t slot;
+	int i;
+
+	memset(index, 0, sizeof(*index));
+	index->ptr = ptr;
+	index->fmap = fmap ? fmap : fmap_find(ptr, size);
+	if (!index->fmap)
+		return NULL;
+
+	/* Keep the table at most half full, or just search linearly */
+	if (index->fmap->fmap_nareas > FMAP_INDEX_SLOTS / 2)
+		return index->fmap;
+
+	ah = fmap_areas(index->fmap);
+	for (i = 0; i < index->fmap->fmap_nareas; i++) {
+		slot = fmap_name_hash(ah[i].area_name);
+		for (;; slot++) {
+			slot %= FMAP_INDEX_SLOTS;
+			if (!index->slot[slot]) {
+				index->slot[slot] = i + 1;
+				break;
+			}
+			/* The first of any duplicate names wins */
+			if (!strncmp(ah[index->slot[slot] - 1].area_name,
+				     ah[i].area_name, FMAP_NAMELEN))
+				break;
 		}
+	}
+	index->hashed = 1;
+
+	return index->fmap;
+}
+
+uint8_t *fmap_index_find(const struct fmap_index *index, const char *name,
+			 FmapAreaHeader **ah_ptr)
+{
+	FmapAreaHeader *ah;
+	uint32_t slot;
+	int i = -1;
+
+	if (!index->fmap)
+		return NULL;
+
+	ah = fmap_areas(index->fmap);
+	if (!index->hashed) {
+		i = fmap_area_number(index->fmap, name);
+	} else {
+		for (slot = fmap_name_hash(name); ; slot++) {
+			slot %= FMAP_INDEX_SLOTS;
+			if (!index->slot[slot])
+				break;
+			if (!strncmp(ah[index->slot[slot] - 1].area_name,
+				     name, FMAP_NAMELEN)) {
+				i = index->slot[slot] - 1;
+				break;
+			}
+		}
+	}
+	if (i < 0)
+		return NULL;
 
-	return NULL;
+	if (ah_ptr)
+		*ah_ptr = ah + i;
+	return index->ptr + ah[i].area_offset;
 }
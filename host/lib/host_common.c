@@ -16,24 +16,34 @@
 #include "vb2_common.h"
 #include "vboot_common.h"
 
-struct vb2_fw_preamble *vb2_create_fw_preamble(
-	uint32_t firmware_version,
-	const struct vb2_packed_key *kernel_subkey,
-	const struct vb2_signature *body_signature,
-	const struct vb2_private_key *signing_key,
-	uint32_t flags)
+uint32_t vb2_fw_preamble_size(const struct vb2_packed_key *kernel_subkey,
+			      const struct vb2_signature *body_signature,
+			      const struct vb2_private_key *signing_key)
+{
+	return sizeof(struct vb2_fw_preamble) + kernel_subkey->key_size +
+		body_signature->sig_size +
+		vb2_rsa_sig_size(signing_key->sig_alg);
+}
+
+int vb2_build_fw_preamble(uint8_t *buf,
+			  uint32_t buf_size,
+			  uint32_t firmware_version,
+			  const struct vb2_packed_key *kernel_subkey,
+			  const struct vb2_signature *body_signature,
+			  const struct vb2_private_key *signing_key,
+			  uint32_t flags)
 {
 	uint32_t signed_size = (sizeof(struct vb2_fw_preamble) +
 				kernel_subkey->key_size +
 				body_signature->sig_size);
-	uint32_t block_size = signed_size +
-		vb2_rsa_sig_size(signing_key->sig_alg);
+	uint32_t block_size = vb2_fw_preamble_size(kernel_subkey,
+						   body_signature,
+						   signing_key);
+	struct vb2_fw_preamble *h = (struct vb2_fw_preamble *)buf;
 
-	/* Allocate key block */
-	struct vb2_fw_preamble *h =
-		(struct vb2_fw_preamble *)calloc(block_size, 1);
-	if (!h)
-		return NULL;
+	if (buf_size < block_size)
+		return VB2_FW_PREAMBLE_CREATE_BUF_SIZE;
+	memset(buf, 0, block_size);
 
 	uint8_t *kernel_subkey_dest = (uint8_t *)(h + 1);
 	uint8_t *body_sig_dest = kernel_subkey_dest + kernel_subkey->key_size;
@@ -49,19 +59,15 @@ struct vb2_fw_preamble *vb2_create_fw_preamble(
 	vb2_init_packed_key(&h->kernel_subkey, kernel_subkey_dest,
 			    kernel_subkey->key_size);
 	if (VB2_SUCCESS !=
-	    vb2_copy_packed_key(&h->kernel_subkey, kernel_subkey)) {
-		free(h);
-		return NULL;
-	}
+	    vb2_copy_packed_key(&h->kernel_subkey, kernel_subkey))
+		return VB2_FW_PREAMBLE_CREATE_SUBKEY;
 
 	/* Copy body signature */
 	vb2_init_signature(&h->body_signature,
 			   body_sig_dest, body_signature->sig_size, 0);
 	if (VB2_SUCCESS !=
-	    vb2_copy_signature(&h->body_signature, body_signature)) {
-		free(h);
-		return NULL;
-	}
+	    vb2_copy_signature(&h->body_signature, body_signature))
+		return VB2_FW_PREAMBLE_CREATE_BODY_SIG;
 
 	/* Set up signature struct so we can calculate the signature */
 	vb2_init_signature(&h->preamble_signature, block_sig_dest,
@@ -69,15 +75,63 @@ struct vb2_fw_preamble *vb2_create_fw_preamble(
 
 	/* Calculate signature */
 	struct vb2_signature *sig =
-		vb2_calculate_signature((uint8_t *)h, signed_size, signing_key);
-	vb2_copy_signature(&h->preamble_signature, sig);
+		vb2_calculate_signature(buf, signed_size, signing_key);
+	int rv = sig ? vb2_copy_signature(&h->preamble_signature, sig) :
+		VB2_FW_PREAMBLE_CREATE_SIGN;
 	free(sig);
 
+	return rv ? VB2_FW_PREAMBLE_CREATE_SIGN : VB2_SUCCESS;
+}
+
+struct vb2_fw_preamble *vb2_create_fw_preamble(
+	uint32_t firmware_version,
+	const struct vb2_packed_key *kernel_subkey,
+	const struct vb2_signature *body_signature,
+	const struct vb2_private_key *signing_key,
+	uint32_t flags)
+{
+	/* Allocate key block */
+	uint32_t block_size = vb2_fw_preamble_size(kernel_subkey,
+						   body_signature,
+						   signing_key);
+	uint8_t *buf = malloc(block_size);
+	if (!buf)
+		return NULL;
+
+	if (VB2_SUCCESS != vb2_build_fw_preamble(buf, block_size,
+						 firmware_version,
+						 kernel_subkey, body_signature,
+						 signing_key, flags)) {
+		free(buf);
+		return NULL;
+	}
+
 	/* Return the header */
-	return h;
+	return (struct vb2_fw_preamble *)buf;
 }
 
-struct vb2_kernel_preamble *vb2_create_kernel_preamble(
+uint32_t vb2_kernel_preamble_size(const struct vb2_signature *body_signature,
+				  uint32_t body_chunk_size,
+				  uint32_t body_digests_size,
+				  uint32_t desired_size,
+				  const struct vb2_private_key *signing_key)
+{
+	if (!body_chunk_size)
+		body_digests_size = 0;
+	uint32_t block_size = (sizeof(struct vb2_kernel_preamble) +
+			       body_signature->sig_size + body_digests_size +
+			       vb2_rsa_sig_size(signing_key->sig_alg));
+
+	/* If the block size is smaller than the desired size, pad it */
+	if (block_size < desired_size)
+		block_size = desired_size;
+
+	return block_size;
+}
+
+int vb2_build_kernel_preamble(
+	uint8_t *buf,
+	uint32_t buf_size,
 	uint32_t kernel_version,
 	uint64_t body_load_address,
 	uint64_t bootloader_address,
@@ -86,29 +140,44 @@ struct vb2_kernel_preamble *vb2_create_kernel_preamble(
 	uint64_t vmlinuz_header_address,
 	uint32_t vmlinuz_header_size,
 	uint32_t flags,
+	uint32_t body_chunk_size,
+	const uint8_t *body_digests,
+	uint32_t body_digests_size,
+	uint32_t body_load_size,
 	uint32_t desired_size,
 	const struct vb2_private_key *signing_key)
 {
+	if (!body_chunk_size)
+		body_digests_size = 0;
 	uint64_t signed_size = (sizeof(struct vb2_kernel_preamble) +
-				body_signature->sig_size);
+				body_signature->sig_size + body_digests_size);
 	uint32_t sig_size = vb2_rsa_sig_size(signing_key->sig_alg);
-	uint32_t block_size = signed_size + sig_size;
+	uint32_t block_size = vb2_kernel_preamble_size(body_signature,
+						       body_chunk_size,
+						       body_digests_size,
+						       desired_size,
+						       signing_key);
+	struct vb2_kernel_preamble *h = (struct vb2_kernel_preamble *)buf;
 
-	/* If the block size is smaller than the desired size, pad it */
-	if (block_size < desired_size)
-		block_size = desired_size;
-
-	/* Allocate key block */
-	struct vb2_kernel_preamble *h =
-		(struct vb2_kernel_preamble *)calloc(block_size, 1);
-	if (!h)
-		return NULL;
+	if (buf_size < block_size)
+		return VB2_KERNEL_PREAMBLE_CREATE_BUF_SIZE;
+	memset(buf, 0, block_size);
 
 	uint8_t *body_sig_dest = (uint8_t *)(h + 1);
-	uint8_t *block_sig_dest = body_sig_dest + body_signature->sig_size;
+	uint8_t *digests_dest = body_sig_dest + body_signature->sig_size;
+	uint8_t *block_sig_dest = digests_dest + body_digests_size;
 
 	h->header_version_major = KERNEL_PREAMBLE_HEADER_VERSION_MAJOR;
-	h->header_version_minor = KERNEL_PREAMBLE_HEADER_VERSION_MINOR;
+	if (flags & VB2_KERNEL_PREAMBLE_COMPRESSION_MASK) {
+		h->header_version_minor =
+			KERNEL_PREAMBLE_HEADER_VERSION_MINOR_COMPRESSED;
+		h->body_load_size = body_load_size;
+	} else if (body_chunk_size) {
+		h->header_version_minor =
+			KERNEL_PREAMBLE_HEADER_VERSION_MINOR_DIGESTS;
+	} else {
+		h->header_version_minor = KERNEL_PREAMBLE_HEADER_VERSION_MINOR;
+	}
 	h->preamble_size = block_size;
 	h->kernel_version = kernel_version;
 	h->body_load_address = body_load_address;
@@ -123,16 +192,135 @@ struct vb2_kernel_preamble *vb2_create_kernel_preamble(
 			   body_signature->sig_size, 0);
 	vb2_copy_signature(&h->body_signature, body_signature);
 
+	/* Copy body chunk digests, so the preamble signature covers them */
+	if (body_chunk_size) {
+		h->body_chunk_size = body_chunk_size;
+		h->body_digest_offset = digests_dest - buf;
+		memcpy(digests_dest, body_digests, body_digests_size);
+	}
+
 	/* Set up signature struct so we can calculate the signature */
 	vb2_init_signature(&h->preamble_signature, block_sig_dest,
 			   sig_size, signed_size);
 
 	/* Calculate signature */
 	struct vb2_signature *sigtmp =
-		vb2_calculate_signature((uint8_t *)h, signed_size, signing_key);
-	vb2_copy_signature(&h->preamble_signature, sigtmp);
+		vb2_calculate_signature(buf, signed_size, signing_key);
+	int rv = sigtmp ? vb2_copy_signature(&h->preamble_signature, sigtmp) :
+		VB2_KERNEL_PREAMBLE_CREATE_SIGN;
 	free(sigtmp);
 
+	return rv ? VB2_KERNEL_PREAMBLE_CREATE_SIGN : VB2_SUCCESS;
+}
+
+struct vb2_kernel_preamble *vb2_create_kernel_preamble(
+	uint32_t kernel_version,
+	uint64_t body_load_address,
+	uint64_t bootloader_address,
+	uint32_t bootloader_size,
+	const struct vb2_signature *body_signature,
+	uint64_t vmlinuz_header_address,
+	uint32_t vmlinuz_header_size,
+	uint32_t flags,
+	uint32_t body_chunk_size,
+	const uint8_t *body_digests,
+	uint32_t body_digests_size,
+	uint32_t body_load_size,
+	uint32_t desired_size,
+	const struct vb2_private_key *signing_key)
+{
+	/* Allocate key block */
+	uint32_t block_size = vb2_kernel_preamble_size(body_signature,
+						       body_chunk_size,
+						       body_digests_size,
+						       desired_size,
+						       signing_key);
+	uint8_t *buf = malloc(block_size);
+	if (!buf)
+		return NULL;
+
+	if (VB2_SUCCESS != vb2_build_kernel_preamble(
+		    buf, block_size, kernel_version, body_load_address,
+		    bootloader_address, bootloader_size, body_signature,
+		    vmlinuz_header_address, vmlinuz_header_size, flags,
+		    body_chunk_size, body_digests, body_digests_size,
+		    body_load_size, desired_size, signing_key)) {
+		free(buf);
+		return NULL;
+	}
+
 	/* Return the header */
-	return h;
+	return (struct vb2_kernel_preamble *)buf;
+}
+
+int vb2_body_digests_init(struct vb2_body_digests *bd,
+			  enum vb2_hash_algorithm hash_alg,
+			  uint32_t chunk_size)
+{
+	memset(bd, 0, sizeof(*bd));
+	bd->hash_alg = hash_alg;
+	bd->chunk_size = chunk_size;
+
+	if (!chunk_size || !vb2_digest_size(hash_alg))
+		return VB2_ERROR_UNKNOWN;
+
+	return vb2_digest_init(&bd->dc, hash_alg);
+}
+
+/* Finish the current chunk and start the next one */
+static int body_digests_next(struct vb2_body_digests *bd)
+{
+	uint32_t digest_size = vb2_digest_size(bd->hash_alg);
+	uint8_t *digests = realloc(bd->digests,
+				   bd->digests_size + digest_size);
+	int rv;
+
+	if (!digests)
+		return VB2_ERROR_UNKNOWN;
+	bd->digests = digests;
+
+	rv = vb2_digest_finalize(&bd->dc, digests + bd->digests_size,
+				 digest_size);
+	if (rv)
+		return rv;
+	bd->digests_size += digest_size;
+	bd->chunk_used = 0;
+
+	return vb2_digest_init(&bd->dc, bd->hash_alg);
+}
+
+int vb2_body_digests_extend(struct vb2_body_digests *bd,
+			    const uint8_t *buf,
+			    uint32_t size)
+{
+	int rv;
+
+	while (size) {
+		uint32_t n = bd->chunk_size - bd->chunk_used;
+
+		if (n > size)
+			n = size;
+		rv = vb2_digest_extend(&bd->dc, buf, n);
+		if (rv)
+			return rv;
+		bd->chunk_used += n;
+		buf += n;
+		size -= n;
+
+		if (bd->chunk_used == bd->chunk_size) {
+			rv = body_digests_next(bd);
+			if (rv)
+				return rv;
+		}
+	}
+
+	return VB2_SUCCESS;
+}
+
+int vb2_body_digests_finalize(struct vb2_body_digests *bd)
+{
+	if (!bd->chunk_used)
+		return VB2_SUCCESS;
+
+	return body_digests_next(bd);
 }
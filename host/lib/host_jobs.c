@@ -0,0 +1,63 @@
+/* Copyright 2018 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ *
+ * Running independent jobs on several threads, for host utilities.
+ */
+
+#include <pthread.h>
+#include <stdlib.h>
+
+#include "host_jobs.h"
+
+struct job_queue {
+	void (*fn)(void *ctx, int index);
+	void *ctx;
+	int count;
+	int next;  /* Next index to hand out */
+};
+
+static void *job_worker(void *arg)
+{
+	struct job_queue *q = arg;
+	int i;
+
+	while ((i = __sync_fetch_and_add(&q->next, 1)) < q->count)
+		q->fn(q->ctx, i);
+
+	return NULL;
+}
+
+void vb2_run_jobs(void (*fn)(void *ctx, int index), void *ctx, int count,
+		  int njobs)
+{
+	struct job_queue q = {
+		.fn = fn,
+		.ctx = ctx,
+		.count = count,
+		.next = 0,
+	};
+	pthread_t *threads = NULL;
+	int nthreads = 0;
+	int i;
+
+	/* This thread does its share of the work too. */
+	if (njobs > 1 && count > 1) {
+		nthreads = (njobs < count ? njobs : count) - 1;
+		threads = calloc(nthreads, sizeof(*threads));
+		if (!threads)
+			nthreads = 0;
+	}
+	for (i = 0; i < nthreads; i++) {
+		if (pthread_create(&threads[i], NULL, job_worker, &q)) {
+			nthreads = i;
+			break;
+		}
+	}
+
+	job_worker(&q);
+
+	for (i = 0; i < nthreads; i++)
+		pthread_join(threads[i], NULL);
+	free(threads);
+}
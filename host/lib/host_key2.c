@@ -11,6 +11,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <sys/stat.h>
 #include <unistd.h>
 
 #include "2sysincludes.h"
@@ -21,9 +22,14 @@
 #include "host_key.h"
 #include "host_key2.h"
 #include "host_misc.h"
+#include "host_signer.h"
 #include "vb2_common.h"
 #include "vboot_common.h"
 
+#ifdef HAVE_MACOS
+#define st_mtim st_mtimespec
+#endif
+
 enum vb2_crypto_algorithm vb2_get_crypto_algorithm(
 		enum vb2_hash_algorithm hash_alg,
 		enum vb2_signature_algorithm sig_alg)
@@ -39,65 +45,193 @@ enum vb2_crypto_algorithm vb2_get_crypto_algorithm(
 		+ (hash_alg - VB2_HASH_SHA1);
 };
 
-struct vb2_private_key *vb2_read_private_key(const char *filename)
+/*
+ * Keys read from files are cached, so a key used several times in one run is
+ * only parsed once and shares OpenSSL's per-key setup (CRT Montgomery
+ * contexts, blinding).  Entries match on the file's identity, size and mtime,
+ * so a rewritten key file is read again.  The cache holds a reference to each
+ * of its keys until vb2_private_key_cache_flush(), which runs at exit.
+ */
+struct key_cache_entry {
+	struct key_cache_entry *next;
+	enum vb2_private_key_format format;
+	uint32_t algorithm;
+	dev_t dev;
+	ino_t ino;
+	off_t size;
+	struct timespec mtime;
+	struct vb2_private_key *key;
+};
+
+static struct key_cache_entry *key_cache;
+static volatile int key_cache_lock;
+
+static int key_cache_match(const struct key_cache_entry *e,
+			   enum vb2_private_key_format format,
+			   uint32_t algorithm, const struct stat *st)
+{
+	return e->format == format && e->algorithm == algorithm &&
+		e->dev == st->st_dev && e->ino == st->st_ino &&
+		e->size == st->st_size &&
+		e->mtime.tv_sec == st->st_mtim.tv_sec &&
+		e->mtime.tv_nsec == st->st_mtim.tv_nsec;
+}
+
+int vb2_private_key_cache_read(struct vb2_private_key **key_ptr,
+			       const char *filename,
+			       enum vb2_private_key_format format,
+			       uint32_t algorithm,
+			       vb2_private_key_reader_t reader)
+{
+	static int registered;
+	struct key_cache_entry *e;
+	struct stat st;
+	int rv;
+
+	*key_ptr = NULL;
+
+	/* The reader reports files it can't get at */
+	if (stat(filename, &st) || !S_ISREG(st.st_mode))
+		return reader(key_ptr, filename, algorithm);
+
+	vb2_host_lock(&key_cache_lock);
+	for (e = key_cache; e; e = e->next) {
+		if (key_cache_match(e, format, algorithm, &st)) {
+			e->key->refs++;
+			*key_ptr = e->key;
+			break;
+		}
+	}
+	vb2_host_unlock(&key_cache_lock);
+	if (*key_ptr)
+		return VB2_SUCCESS;
+
+	rv = reader(key_ptr, filename, algorithm);
+	if (rv)
+		return rv;
+
+	/* Not caching is only slower, so allocation failure isn't an error */
+	e = calloc(1, sizeof(*e));
+	if (!e)
+		return VB2_SUCCESS;
+	e->format = format;
+	e->algorithm = algorithm;
+	e->dev = st.st_dev;
+	e->ino = st.st_ino;
+	e->size = st.st_size;
+	e->mtime = st.st_mtim;
+	e->key = *key_ptr;
+	e->key->refs = 2;  /* The caller's and the cache's */
+
+	vb2_host_lock(&key_cache_lock);
+	e->next = key_cache;
+	key_cache = e;
+	if (!registered) {
+		atexit(vb2_private_key_cache_flush);
+		registered = 1;
+	}
+	vb2_host_unlock(&key_cache_lock);
+
+	return VB2_SUCCESS;
+}
+
+void vb2_private_key_cache_flush(void)
+{
+	struct key_cache_entry *e;
+
+	vb2_host_lock(&key_cache_lock);
+	e = key_cache;
+	key_cache = NULL;
+	vb2_host_unlock(&key_cache_lock);
+
+	while (e) {
+		struct key_cache_entry *next = e->next;
+
+		vb2_private_key_free(e->key);
+		free(e);
+		e = next;
+	}
+}
+
+int vb2_private_key_unref(struct vb2_private_key *key)
 {
-	uint8_t *buf = NULL;
-	uint32_t bufsize = 0;
-	if (VB2_SUCCESS != vb2_read_file(filename, &buf, &bufsize)) {
+	int in_use;
+
+	if (!key->refs)
+		return 0;
+
+	vb2_host_lock(&key_cache_lock);
+	in_use = --key->refs > 0;
+	vb2_host_unlock(&key_cache_lock);
+
+	return in_use;
+}
+
+static int read_vbprivk(struct vb2_private_key **key_ptr,
+			const char *filename, uint32_t algorithm)
+{
+	struct vb2_file_view *view;
+	if (VB2_SUCCESS != vb2_file_view_open(filename, 0, &view)) {
 		VbExError("unable to read from file %s\n", filename);
-		return NULL;
+		return VB2_ERROR_READ_FILE_OPEN;
 	}
 
 	struct vb2_private_key *key =
 		(struct vb2_private_key *)calloc(sizeof(*key), 1);
 	if (!key) {
 		VbExError("Unable to allocate private key\n");
-		free(buf);
-		return NULL;
+		vb2_file_view_put(view);
+		return VB2_ERROR_UNPACK_PRIVATE_KEY_ALLOC;
 	}
 
-	uint64_t alg = *(uint64_t *)buf;
+	uint64_t alg = *(uint64_t *)view->data;
 	key->hash_alg = vb2_crypto_to_hash(alg);
 	key->sig_alg = vb2_crypto_to_signature(alg);
-	const unsigned char *start = buf + sizeof(alg);
+	const unsigned char *start = view->data + sizeof(alg);
 
 	key->rsa_private_key =
-		d2i_RSAPrivateKey(0, &start, bufsize - sizeof(alg));
+		d2i_RSAPrivateKey(0, &start, view->size - sizeof(alg));
 
 	if (!key->rsa_private_key) {
 		VbExError("Unable to parse RSA private key\n");
-		free(buf);
+		vb2_file_view_put(view);
 		free(key);
-		return NULL;
+		return VB2_ERROR_UNPACK_PRIVATE_KEY_RSA;
 	}
 
-	free(buf);
-	return key;
+	vb2_file_view_put(view);
+	*key_ptr = key;
+	return VB2_SUCCESS;
 }
 
-struct vb2_private_key *vb2_read_private_key_pem(
-		const char* filename,
-		enum vb2_crypto_algorithm algorithm)
+struct vb2_private_key *vb2_read_private_key(const char *filename)
 {
-	if (algorithm >= VB2_ALG_COUNT) {
-		VB2_DEBUG("%s() called with invalid algorithm!\n",
-			  __FUNCTION__);
-		return NULL;
-	}
+	struct vb2_private_key *key;
 
+	if (vb2_find_signer(filename))
+		return vb2_signer_read_key(filename, VB2_ALG_COUNT);
+
+	vb2_private_key_cache_read(&key, filename, VB2_PRIVATE_KEY_VBPRIVK, 0,
+				   read_vbprivk);
+	return key;
+}
+
+static int read_pem(struct vb2_private_key **key_ptr,
+		    const char *filename, uint32_t algorithm)
+{
 	/* Read private key */
 	FILE *f = fopen(filename, "r");
 	if (!f) {
 		VB2_DEBUG("%s(): Couldn't open key file: %s\n",
 			  __FUNCTION__, filename);
-		return NULL;
+		return VB2_ERROR_READ_PEM_FILE_OPEN;
 	}
 	struct rsa_st *rsa_key = PEM_read_RSAPrivateKey(f, NULL, NULL, NULL);
 	fclose(f);
 	if (!rsa_key) {
 		VB2_DEBUG("%s(): Couldn't read private key from file: %s\n",
 			 __FUNCTION__, filename);
-		return NULL;
+		return VB2_ERROR_READ_PEM_RSA;
 	}
 
 	/* Store key and algorithm in our struct */
@@ -105,23 +239,39 @@ struct vb2_private_key *vb2_read_private_key_pem(
 		(struct vb2_private_key *)calloc(sizeof(*key), 1);
 	if (!key) {
 		RSA_free(rsa_key);
-		return NULL;
+		return VB2_ERROR_READ_PEM_ALLOC;
 	}
 	key->rsa_private_key = rsa_key;
 	key->hash_alg = vb2_crypto_to_hash(algorithm);
 	key->sig_alg = vb2_crypto_to_signature(algorithm);
 
-	/* Return the key */
+	*key_ptr = key;
+	return VB2_SUCCESS;
+}
+
+struct vb2_private_key *vb2_read_private_key_pem(
+		const char* filename,
+		enum vb2_crypto_algorithm algorithm)
+{
+	struct vb2_private_key *key;
+
+	if (algorithm >= VB2_ALG_COUNT) {
+		VB2_DEBUG("%s() called with invalid algorithm!\n",
+			  __FUNCTION__);
+		return NULL;
+	}
+
+	if (vb2_find_signer(filename))
+		return vb2_signer_read_key(filename, algorithm);
+
+	vb2_private_key_cache_read(&key, filename, VB2_PRIVATE_KEY_PEM,
+				   algorithm, read_pem);
 	return key;
 }
 
 void vb2_free_private_key(struct vb2_private_key *key)
 {
-	if (!key)
-		return;
-	if (key->rsa_private_key)
-		RSA_free(key->rsa_private_key);
-	free(key);
+	vb2_private_key_free(key);
 }
 
 int vb2_write_private_key(const char *filename,
@@ -234,29 +384,29 @@ struct vb2_packed_key *vb2_read_packed_keyb(const char *filename,
 		return NULL;
 	}
 
-	uint8_t *key_data = NULL;
-	uint32_t key_size = 0;
-	if (VB2_SUCCESS != vb2_read_file(filename, &key_data, &key_size))
+	struct vb2_file_view *view;
+	if (VB2_SUCCESS != vb2_file_view_open(filename, 0, &view))
 		return NULL;
 
+	uint32_t key_size = view->size;
 	uint32_t expected_key_size =
 			vb2_packed_key_size(vb2_crypto_to_signature(algorithm));
 	if (!expected_key_size || expected_key_size != key_size) {
 		fprintf(stderr, "%s() - wrong key size %u for algorithm %u\n",
 			__func__, key_size, algorithm);
-		free(key_data);
+		vb2_file_view_put(view);
 		return NULL;
 	}
 
 	struct vb2_packed_key *key =
 		vb2_alloc_packed_key(key_size, algorithm, version);
 	if (!key) {
-		free(key_data);
+		vb2_file_view_put(view);
 		return NULL;
 	}
-	memcpy((uint8_t *)vb2_packed_key_data(key), key_data, key_size);
+	memcpy((uint8_t *)vb2_packed_key_data(key), view->data, key_size);
 
-	free(key_data);
+	vb2_file_view_put(view);
 	return key;
 }
 
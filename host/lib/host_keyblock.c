@@ -21,20 +21,31 @@
 #include "vb2_struct.h"
 #include "vboot_common.h"
 
-struct vb2_keyblock *vb2_create_keyblock(
-		const struct vb2_packed_key *data_key,
-		const struct vb2_private_key *signing_key,
-		uint32_t flags)
+uint32_t vb2_keyblock_size(const struct vb2_packed_key *data_key,
+			   const struct vb2_private_key *signing_key)
+{
+	uint32_t sig_data_size =
+		(signing_key ? vb2_rsa_sig_size(signing_key->sig_alg) : 0);
+
+	return sizeof(struct vb2_keyblock) + data_key->key_size +
+		VB2_SHA512_DIGEST_SIZE + sig_data_size;
+}
+
+int vb2_build_keyblock(uint8_t *buf,
+		       uint32_t buf_size,
+		       const struct vb2_packed_key *data_key,
+		       const struct vb2_private_key *signing_key,
+		       uint32_t flags)
 {
-	/* Allocate key block */
 	uint32_t signed_size = sizeof(struct vb2_keyblock) + data_key->key_size;
 	uint32_t sig_data_size =
 		(signing_key ? vb2_rsa_sig_size(signing_key->sig_alg) : 0);
-	uint32_t block_size =
-		signed_size + VB2_SHA512_DIGEST_SIZE + sig_data_size;
-	struct vb2_keyblock *h = (struct vb2_keyblock *)calloc(block_size, 1);
-	if (!h)
-		return NULL;
+	uint32_t block_size = vb2_keyblock_size(data_key, signing_key);
+	struct vb2_keyblock *h = (struct vb2_keyblock *)buf;
+
+	if (buf_size < block_size)
+		return VB2_KEYBLOCK_CREATE_BUF_SIZE;
+	memset(buf, 0, block_size);
 
 	uint8_t *data_key_dest = (uint8_t *)(h + 1);
 	uint8_t *block_chk_dest = data_key_dest + data_key->key_size;
@@ -48,37 +59,65 @@ struct vb2_keyblock *vb2_create_keyblock(
 
 	/* Copy data key */
 	vb2_init_packed_key(&h->data_key, data_key_dest, data_key->key_size);
-	vb2_copy_packed_key(&h->data_key, data_key);
+	if (VB2_SUCCESS != vb2_copy_packed_key(&h->data_key, data_key))
+		return VB2_KEYBLOCK_CREATE_DATA_KEY;
 
 	/* Set up signature structs so we can calculate the signatures */
 	vb2_init_signature(&h->keyblock_hash, block_chk_dest,
 			   VB2_SHA512_DIGEST_SIZE, signed_size);
-	if (signing_key) {
+	if (signing_key)
 		vb2_init_signature(&h->keyblock_signature, block_sig_dest,
 				   sig_data_size, signed_size);
-	} else {
-		memset(&h->keyblock_signature, 0,
-		       sizeof(h->keyblock_signature));
-	}
 
 	/* Calculate hash */
-	struct vb2_signature *chk =
-		vb2_sha512_signature((uint8_t*)h, signed_size);
-	vb2_copy_signature(&h->keyblock_hash, chk);
-	free(chk);
+	uint8_t digest[VB2_SHA512_DIGEST_SIZE];
+	if (VB2_SUCCESS != vb2_digest_buffer(buf, signed_size,
+					     VB2_HASH_SHA512, digest,
+					     sizeof(digest)))
+		return VB2_KEYBLOCK_CREATE_SIGN;
+	memcpy(block_chk_dest, digest, sizeof(digest));
 
 	/* Calculate signature */
 	if (signing_key) {
+		/*
+		 * The checksum already covers the same bytes, so a SHA-512
+		 * signing key can reuse its digest instead of hashing the
+		 * block again.
+		 */
 		struct vb2_signature *sigtmp =
-			vb2_calculate_signature((uint8_t*)h,
-						signed_size,
-						signing_key);
-		vb2_copy_signature(&h->keyblock_signature, sigtmp);
+			signing_key->hash_alg == VB2_HASH_SHA512 ?
+			vb2_sign_digest(digest, signed_size, signing_key) :
+			vb2_calculate_signature(buf, signed_size, signing_key);
+		int rv = sigtmp ?
+			vb2_copy_signature(&h->keyblock_signature, sigtmp) :
+			VB2_KEYBLOCK_CREATE_SIGN;
 		free(sigtmp);
+		if (rv)
+			return VB2_KEYBLOCK_CREATE_SIGN;
+	}
+
+	return VB2_SUCCESS;
+}
+
+struct vb2_keyblock *vb2_create_keyblock(
+		const struct vb2_packed_key *data_key,
+		const struct vb2_private_key *signing_key,
+		uint32_t flags)
+{
+	/* Allocate key block */
+	uint32_t block_size = vb2_keyblock_size(data_key, signing_key);
+	uint8_t *buf = malloc(block_size);
+	if (!buf)
+		return NULL;
+
+	if (VB2_SUCCESS != vb2_build_keyblock(buf, block_size, data_key,
+					      signing_key, flags)) {
+		free(buf);
+		return NULL;
 	}
 
 	/* Return the header */
-	return h;
+	return (struct vb2_keyblock *)buf;
 }
 
 /* TODO(gauravsh): This could easily be integrated into the function above
@@ -148,22 +187,28 @@ struct vb2_keyblock *vb2_read_keyblock(const char *filename)
 	struct vb2_workbuf wb;
 	vb2_workbuf_init(&wb, workbuf, sizeof(workbuf));
 
+	struct vb2_file_view *view;
 	struct vb2_keyblock *block;
-	uint32_t file_size;
-	if (VB2_SUCCESS !=
-	    vb2_read_file(filename, (uint8_t **)&block, &file_size)) {
+	if (VB2_SUCCESS != vb2_file_view_open(filename, 0, &view)) {
 		fprintf(stderr, "Error reading key block file: %s\n", filename);
 		return NULL;
 	}
 
 	/* Verify the hash of the key block, since we can do that without
 	 * the public signing key. */
-	if (VB2_SUCCESS != vb2_verify_keyblock_hash(block, file_size, &wb)) {
+	block = (struct vb2_keyblock *)view->data;
+	if (VB2_SUCCESS != vb2_verify_keyblock_hash(block, view->size, &wb)) {
 		fprintf(stderr, "Invalid key block file: %s\n", filename);
-		free(block);
+		vb2_file_view_put(view);
 		return NULL;
 	}
 
+	/* Keep only the key block itself, not anything after it */
+	uint32_t size = block->keyblock_size;
+	block = malloc(size);
+	if (block)
+		memcpy(block, view->data, size);
+	vb2_file_view_put(view);
 	return block;
 }
 
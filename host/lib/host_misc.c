@@ -7,11 +7,21 @@
 
 /* TODO: change all 'return 0', 'return 1' into meaningful return codes */
 
+#include <errno.h>
+#include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <unistd.h>
+#ifndef HAVE_MACOS
+#include <linux/fs.h>		/* For BLKGETSIZE64 */
+#include <sys/ioctl.h>
+#endif
 
+#include "2sysincludes.h"
+#include "2common.h"
 #include "host_common.h"
 #include "vboot_common.h"
 
@@ -22,40 +32,228 @@ char* StrCopy(char* dest, const char* src, int dest_size)
 	return dest;
 }
 
-uint8_t* ReadFile(const char* filename, uint64_t* sizeptr)
+/* Heap buffer size to start with when the file size isn't known */
+#define READ_FD_CHUNK_SIZE (64 * 1024)
+
+/*
+ * Find the size of a regular file or block device.  Returns VB2_SUCCESS and
+ * sets *size_ptr to 0 for anything else, whose size is only known once it has
+ * been read.
+ */
+static int fd_size(int fd, uint32_t *size_ptr)
 {
-	FILE* f;
-	uint8_t* buf;
-	long size;
+	struct stat sb;
+	uint64_t size = 0;
 
-	f = fopen(filename, "rb");
-	if (!f) {
-		fprintf(stderr, "Unable to open file %s\n", filename);
-		return NULL;
+	*size_ptr = 0;
+
+	if (fstat(fd, &sb))
+		return VB2_ERROR_READ_FILE_SIZE;
+
+	if (S_ISREG(sb.st_mode))
+		size = sb.st_size;
+#ifndef HAVE_MACOS
+	else if (S_ISBLK(sb.st_mode) && ioctl(fd, BLKGETSIZE64, &size))
+		return VB2_ERROR_READ_FILE_SIZE;
+#endif
+
+	if (size > UINT32_MAX)
+		return VB2_ERROR_READ_FILE_SIZE;
+
+	*size_ptr = size;
+	return VB2_SUCCESS;
+}
+
+/*
+ * Read from |fd| until EOF into a newly allocated buffer.  |size_hint| is the
+ * expected size, or 0 if unknown.
+ */
+static int read_fd(int fd, uint32_t size_hint,
+		   uint8_t **data_ptr, uint32_t *size_ptr)
+{
+	/* One spare byte so a correct hint doesn't need a second buffer */
+	uint64_t alloc = size_hint ? (uint64_t)size_hint + 1 :
+		READ_FD_CHUNK_SIZE;
+	uint64_t size = 0;
+	uint8_t *buf, *newbuf;
+
+	*data_ptr = NULL;
+	*size_ptr = 0;
+
+	buf = malloc(alloc);
+	if (!buf)
+		return VB2_ERROR_READ_FILE_ALLOC;
+
+	for (;;) {
+		ssize_t got;
+
+		if (size == alloc) {
+			if (alloc > UINT32_MAX) {
+				free(buf);
+				return VB2_ERROR_READ_FILE_SIZE;
+			}
+			alloc *= 2;
+			newbuf = realloc(buf, alloc);
+			if (!newbuf) {
+				free(buf);
+				return VB2_ERROR_READ_FILE_ALLOC;
+			}
+			buf = newbuf;
+		}
+
+		got = read(fd, buf + size, alloc - size);
+		if (got < 0) {
+			if (errno == EINTR)
+				continue;
+			free(buf);
+			return VB2_ERROR_READ_FILE_DATA;
+		}
+		if (got == 0)
+			break;
+		size += got;
 	}
 
-	fseek(f, 0, SEEK_END);
-	size = ftell(f);
-	if (size < 0) {
-		fclose(f);
-		return NULL;
+	if (size > UINT32_MAX) {
+		free(buf);
+		return VB2_ERROR_READ_FILE_SIZE;
 	}
-	rewind(f);
 
-	buf = malloc(size);
-	if (!buf) {
-		fclose(f);
-		return NULL;
+	*data_ptr = buf;
+	*size_ptr = size;
+	return VB2_SUCCESS;
+}
+
+int vb2_read_file(const char *filename, uint8_t **data_ptr, uint32_t *size_ptr)
+{
+	uint32_t size;
+	int fd, rv;
+
+	*data_ptr = NULL;
+	*size_ptr = 0;
+
+	fd = open(filename, O_RDONLY | O_CLOEXEC);
+	if (fd < 0) {
+		VB2_DEBUG("Unable to open file %s\n", filename);
+		return VB2_ERROR_READ_FILE_OPEN;
+	}
+
+	rv = fd_size(fd, &size);
+	if (!rv)
+		rv = read_fd(fd, size, data_ptr, size_ptr);
+	if (rv)
+		VB2_DEBUG("Unable to read file %s\n", filename);
+
+	close(fd);
+	return rv;
+}
+
+int vb2_file_view_open_fd(int fd, uint32_t flags,
+			  struct vb2_file_view **view_ptr)
+{
+	struct vb2_file_view *view;
+	uint32_t size;
+	int rv;
+
+	*view_ptr = NULL;
+
+	rv = fd_size(fd, &size);
+	if (rv)
+		return rv;
+
+	view = calloc(1, sizeof(*view));
+	if (!view)
+		return VB2_ERROR_READ_FILE_ALLOC;
+	view->refcount = 1;
+
+	if (size) {
+		int mmap_flags = MAP_PRIVATE;
+		void *ptr;
+
+#ifdef MAP_POPULATE
+		if (flags & VB2_FILE_VIEW_POPULATE)
+			mmap_flags |= MAP_POPULATE;
+#endif
+		ptr = mmap(NULL, size, PROT_READ | PROT_WRITE, mmap_flags,
+			   fd, 0);
+		if (ptr != MAP_FAILED) {
+#ifdef MADV_HUGEPAGE
+			if (flags & VB2_FILE_VIEW_HUGEPAGE)
+				madvise(ptr, size, MADV_HUGEPAGE);
+#endif
+			view->data = ptr;
+			view->size = size;
+			view->mapped = 1;
+			*view_ptr = view;
+			return VB2_SUCCESS;
+		}
+	}
+
+	/* Can't map it, so read a copy instead */
+	rv = read_fd(fd, size, &view->data, &view->size);
+	if (rv) {
+		free(view);
+		return rv;
 	}
 
-	if(1 != fread(buf, size, 1, f)) {
+	*view_ptr = view;
+	return VB2_SUCCESS;
+}
+
+int vb2_file_view_open(const char *filename, uint32_t flags,
+		       struct vb2_file_view **view_ptr)
+{
+	int fd, rv;
+
+	*view_ptr = NULL;
+
+	fd = open(filename, O_RDONLY | O_CLOEXEC);
+	if (fd < 0) {
+		VB2_DEBUG("Unable to open file %s\n", filename);
+		return VB2_ERROR_READ_FILE_OPEN;
+	}
+
+	rv = vb2_file_view_open_fd(fd, flags, view_ptr);
+	if (rv)
+		VB2_DEBUG("Unable to read file %s\n", filename);
+
+	/* A mapping stays valid after its descriptor is closed */
+	close(fd);
+	return rv;
+}
+
+struct vb2_file_view *vb2_file_view_get(struct vb2_file_view *view)
+{
+	view->refcount++;
+	return view;
+}
+
+void vb2_file_view_put(struct vb2_file_view *view)
+{
+	if (!view || --view->refcount)
+		return;
+
+	if (view->mapped)
+		munmap(view->data, view->size);
+	else
+		free(view->data);
+	free(view);
+}
+
+uint8_t* ReadFile(const char* filename, uint64_t* sizeptr)
+{
+	uint8_t* buf;
+	uint32_t size;
+	int rv;
+
+	rv = vb2_read_file(filename, &buf, &size);
+	if (rv == VB2_ERROR_READ_FILE_OPEN) {
+		fprintf(stderr, "Unable to open file %s\n", filename);
+		return NULL;
+	} else if (rv) {
 		fprintf(stderr, "Unable to read from file %s\n", filename);
-		fclose(f);
-		free(buf);
 		return NULL;
 	}
 
-	fclose(f);
 	if (sizeptr)
 		*sizeptr = size;
 	return buf;
@@ -0,0 +1,342 @@
+/* Copyright 2018 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ *
+ * PKCS#11 signer backend.
+ *
+ * Keys are named "pkcs11:<module>:<slot>:<label>[:<algorithm>]", where
+ * <module> is the path of the token's PKCS#11 library, <slot> is the slot ID,
+ * <label> is the CKA_LABEL of the private key and <algorithm> is the crypto
+ * algorithm number to sign with.  Without <algorithm>, the signature algorithm
+ * follows from the key's modulus size and SHA-256 is used.  If the token needs
+ * a login, the user PIN is taken from $VBOOT_PKCS11_PIN.
+ *
+ * The module is loaded and initialized once, and each key keeps a session
+ * open until it is freed, so signing only costs the C_Sign() round trip.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef HAVE_PKCS11
+#include <dlfcn.h>
+#include <p11-kit/pkcs11.h>
+#endif
+
+#include "2sysincludes.h"
+#include "2common.h"
+#include "2rsa.h"
+#include "2sha.h"
+#include "host_key2.h"
+#include "host_misc.h"
+#include "host_signer.h"
+
+#ifdef HAVE_PKCS11
+
+/* Only one module is loaded at a time, shared by all its keys */
+static struct {
+	char *path;
+	void *handle;
+	CK_FUNCTION_LIST_PTR fn;
+	int refs;
+} module;
+
+static volatile int module_lock;
+
+struct pkcs11_key {
+	CK_SESSION_HANDLE session;
+	CK_OBJECT_HANDLE object;
+	/* A session runs one operation at a time */
+	volatile int lock;
+};
+
+static int get_module_locked(const char *path)
+{
+	CK_C_INITIALIZE_ARGS args = { .flags = CKF_OS_LOCKING_OK };
+	CK_C_GetFunctionList get_list;
+	CK_RV rv;
+
+	if (module.refs) {
+		if (strcmp(module.path, path)) {
+			fprintf(stderr, "PKCS#11 module %s is already in use\n",
+				module.path);
+			return VB2_ERROR_PKCS11_MODULE;
+		}
+		module.refs++;
+		return VB2_SUCCESS;
+	}
+
+	module.handle = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+	if (!module.handle) {
+		fprintf(stderr, "Unable to load PKCS#11 module: %s\n",
+			dlerror());
+		return VB2_ERROR_PKCS11_MODULE;
+	}
+
+	get_list = (CK_C_GetFunctionList)dlsym(module.handle,
+					       "C_GetFunctionList");
+	if (!get_list || get_list(&module.fn) != CKR_OK)
+		goto error;
+
+	rv = module.fn->C_Initialize(&args);
+	if (rv != CKR_OK && rv != CKR_CRYPTOKI_ALREADY_INITIALIZED)
+		goto error;
+
+	module.path = strdup(path);
+	if (!module.path) {
+		module.fn->C_Finalize(NULL);
+		goto error;
+	}
+	module.refs = 1;
+	return VB2_SUCCESS;
+
+error:
+	fprintf(stderr, "Unable to initialize PKCS#11 module %s\n", path);
+	dlclose(module.handle);
+	module.handle = NULL;
+	module.fn = NULL;
+	return VB2_ERROR_PKCS11_MODULE;
+}
+
+static int get_module(const char *path)
+{
+	int rv;
+
+	vb2_host_lock(&module_lock);
+	rv = get_module_locked(path);
+	vb2_host_unlock(&module_lock);
+
+	return rv;
+}
+
+static void put_module(void)
+{
+	vb2_host_lock(&module_lock);
+	if (!--module.refs) {
+		module.fn->C_Finalize(NULL);
+		dlclose(module.handle);
+		free(module.path);
+		module.path = NULL;
+		module.handle = NULL;
+		module.fn = NULL;
+	}
+	vb2_host_unlock(&module_lock);
+}
+
+/* Pick the algorithms for a key with a [modulus_size]-byte modulus. */
+static int choose_algorithm(struct vb2_private_key *key, uint32_t modulus_size,
+			    enum vb2_crypto_algorithm algorithm)
+{
+	int sig_alg;
+
+	if (algorithm < VB2_ALG_COUNT) {
+		key->hash_alg = vb2_crypto_to_hash(algorithm);
+		key->sig_alg = vb2_crypto_to_signature(algorithm);
+		if (vb2_rsa_sig_size(key->sig_alg) != modulus_size)
+			return VB2_ERROR_SIGNER_ALGORITHM;
+		return VB2_SUCCESS;
+	}
+
+	for (sig_alg = VB2_SIG_RSA1024; sig_alg <= VB2_SIG_RSA8192;
+	     sig_alg++) {
+		if (vb2_rsa_sig_size(sig_alg) == modulus_size) {
+			key->hash_alg = VB2_HASH_SHA256;
+			key->sig_alg = sig_alg;
+			return VB2_SUCCESS;
+		}
+	}
+	return VB2_ERROR_SIGNER_ALGORITHM;
+}
+
+static int find_key(struct pkcs11_key *p11, const char *label,
+		    uint32_t *modulus_size)
+{
+	CK_FUNCTION_LIST_PTR fn = module.fn;
+	CK_OBJECT_CLASS class = CKO_PRIVATE_KEY;
+	CK_ATTRIBUTE find[] = {
+		{ CKA_CLASS, &class, sizeof(class) },
+		{ CKA_LABEL, (void *)label, strlen(label) },
+	};
+	CK_ATTRIBUTE modulus = { CKA_MODULUS, NULL, 0 };
+	CK_ULONG found = 0;
+
+	if (fn->C_FindObjectsInit(p11->session, find, ARRAY_SIZE(find)) !=
+	    CKR_OK)
+		return VB2_ERROR_SIGNER_OPEN_KEY;
+	if (fn->C_FindObjects(p11->session, &p11->object, 1, &found) !=
+	    CKR_OK)
+		found = 0;
+	fn->C_FindObjectsFinal(p11->session);
+	if (!found) {
+		fprintf(stderr, "No PKCS#11 private key labelled \"%s\"\n",
+			label);
+		return VB2_ERROR_SIGNER_OPEN_KEY;
+	}
+
+	/* Asking for the size only needs the length, not the value */
+	if (fn->C_GetAttributeValue(p11->session, p11->object, &modulus, 1) !=
+	    CKR_OK)
+		return VB2_ERROR_SIGNER_OPEN_KEY;
+
+	*modulus_size = modulus.ulValueLen;
+	return VB2_SUCCESS;
+}
+
+static int open_session(struct pkcs11_key *p11, CK_SLOT_ID slot)
+{
+	CK_FUNCTION_LIST_PTR fn = module.fn;
+	const char *pin = getenv("VBOOT_PKCS11_PIN");
+	CK_RV rv;
+
+	if (fn->C_OpenSession(slot, CKF_SERIAL_SESSION, NULL, NULL,
+			      &p11->session) != CKR_OK) {
+		fprintf(stderr, "Unable to open PKCS#11 session on slot %lu\n",
+			(unsigned long)slot);
+		return VB2_ERROR_SIGNER_OPEN_KEY;
+	}
+
+	if (pin) {
+		/* Logins are per token, so another key may have done it */
+		rv = fn->C_Login(p11->session, CKU_USER,
+				 (unsigned char *)pin, strlen(pin));
+		if (rv != CKR_OK && rv != CKR_USER_ALREADY_LOGGED_IN) {
+			fprintf(stderr, "PKCS#11 login failed\n");
+			fn->C_CloseSession(p11->session);
+			return VB2_ERROR_SIGNER_OPEN_KEY;
+		}
+	}
+	return VB2_SUCCESS;
+}
+
+static int pkcs11_open_key(struct vb2_private_key *key, const char *spec,
+			   enum vb2_crypto_algorithm algorithm)
+{
+	struct pkcs11_key *p11 = NULL;
+	char *copy = strdup(spec);
+	char *path, *slot_str, *label, *alg_str, *end;
+	unsigned long slot;
+	uint32_t modulus_size;
+	int rv = VB2_ERROR_SIGNER_KEY_SPEC;
+
+	if (!copy)
+		return VB2_ERROR_SIGNER_OPEN_KEY;
+
+	path = strtok(copy, ":");
+	slot_str = strtok(NULL, ":");
+	label = strtok(NULL, ":");
+	alg_str = strtok(NULL, ":");
+	if (!path || !slot_str || !label || strtok(NULL, ":"))
+		goto out;
+
+	slot = strtoul(slot_str, &end, 0);
+	if (*end)
+		goto out;
+
+	if (alg_str) {
+		unsigned long alg = strtoul(alg_str, &end, 0);
+		if (*end || alg >= VB2_ALG_COUNT)
+			goto out;
+		if (algorithm < VB2_ALG_COUNT && algorithm != alg) {
+			rv = VB2_ERROR_SIGNER_ALGORITHM;
+			goto out;
+		}
+		algorithm = alg;
+	}
+
+	p11 = calloc(1, sizeof(*p11));
+	if (!p11) {
+		rv = VB2_ERROR_SIGNER_OPEN_KEY;
+		goto out;
+	}
+
+	rv = get_module(path);
+	if (rv)
+		goto out;
+
+	rv = open_session(p11, slot);
+	if (rv) {
+		put_module();
+		goto out;
+	}
+
+	rv = find_key(p11, label, &modulus_size);
+	if (!rv)
+		rv = choose_algorithm(key, modulus_size, algorithm);
+	if (rv) {
+		module.fn->C_CloseSession(p11->session);
+		put_module();
+		goto out;
+	}
+
+	key->signer_key = p11;
+	p11 = NULL;
+
+out:
+	free(p11);
+	free(copy);
+	return rv;
+}
+
+static int pkcs11_sign(const struct vb2_private_key *key,
+		       const uint8_t *data, uint32_t size,
+		       uint8_t *sig, uint32_t sig_size)
+{
+	struct pkcs11_key *p11 = key->signer_key;
+	CK_MECHANISM mech = { CKM_RSA_PKCS, NULL, 0 };
+	CK_ULONG len = sig_size;
+	CK_RV rv;
+
+	vb2_host_lock(&p11->lock);
+	rv = module.fn->C_SignInit(p11->session, &mech, p11->object);
+	if (rv == CKR_OK)
+		rv = module.fn->C_Sign(p11->session, (uint8_t *)data, size,
+				       sig, &len);
+	vb2_host_unlock(&p11->lock);
+
+	if (rv != CKR_OK || len != sig_size) {
+		fprintf(stderr, "PKCS#11 signing failed (0x%lx)\n",
+			(unsigned long)rv);
+		return VB2_SIGN_DATA_RSA_ENCRYPT;
+	}
+	return VB2_SUCCESS;
+}
+
+static void pkcs11_close_key(struct vb2_private_key *key)
+{
+	struct pkcs11_key *p11 = key->signer_key;
+
+	module.fn->C_CloseSession(p11->session);
+	put_module();
+	free(p11);
+	key->signer_key = NULL;
+}
+
+#else  /* !HAVE_PKCS11 */
+
+static int pkcs11_open_key(struct vb2_private_key *key, const char *spec,
+			   enum vb2_crypto_algorithm algorithm)
+{
+	fprintf(stderr, "This build has no PKCS#11 support\n");
+	return VB2_ERROR_PKCS11_UNSUPPORTED;
+}
+
+static int pkcs11_sign(const struct vb2_private_key *key,
+		       const uint8_t *data, uint32_t size,
+		       uint8_t *sig, uint32_t sig_size)
+{
+	return VB2_ERROR_PKCS11_UNSUPPORTED;
+}
+
+static void pkcs11_close_key(struct vb2_private_key *key)
+{
+}
+
+#endif  /* HAVE_PKCS11 */
+
+const struct vb2_signer vb2_pkcs11_signer = {
+	.name = "pkcs11",
+	.open_key = pkcs11_open_key,
+	.sign = pkcs11_sign,
+	.close_key = pkcs11_close_key,
+};
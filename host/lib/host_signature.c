@@ -11,6 +11,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sys/types.h>
 #include <sys/wait.h>
 #include <unistd.h>
@@ -21,9 +22,81 @@
 #include "2rsa.h"
 #include "2sha.h"
 #include "host_common.h"
+#include "host_misc.h"
 #include "host_signature2.h"
 #include "vb2_common.h"
 
+/* Fork [external_signer] with [arg1] and optional [arg2] as its arguments,
+ * wired to a pair of pipes.  [*to_child] is connected to the signer's stdin and
+ * [*from_child] to its stdout.  Returns -1 on error, 0 on success.
+ */
+static int spawn_external(const char *external_signer,
+			  const char *arg1,
+			  const char *arg2,
+			  pid_t *pid_ptr,
+			  int *to_child,
+			  int *from_child)
+{
+	int p_to_c[2], c_to_p[2];  /* pipe descriptors */
+	pid_t pid;
+
+	/* Need two pipes since we want to invoke the external_signer as
+	 * a co-process writing to its stdin and reading from its stdout. */
+	if (pipe(p_to_c) < 0)  {
+		VB2_DEBUG("pipe() error\n");
+		return -1;
+	}
+	if (pipe(c_to_p) < 0) {
+		VB2_DEBUG("pipe() error\n");
+		close(p_to_c[0]);
+		close(p_to_c[1]);
+		return -1;
+	}
+	if ((pid = fork()) < 0) {
+		VB2_DEBUG("fork() error\n");
+		close(p_to_c[0]);
+		close(p_to_c[1]);
+		close(c_to_p[0]);
+		close(c_to_p[1]);
+		return -1;
+	} else if (pid > 0) {  /* Parent. */
+		close(p_to_c[STDIN_FILENO]);
+		close(c_to_p[STDOUT_FILENO]);
+		*pid_ptr = pid;
+		*to_child = p_to_c[STDOUT_FILENO];
+		*from_child = c_to_p[STDIN_FILENO];
+		return 0;
+	}
+
+	/* Child. */
+	close (p_to_c[STDOUT_FILENO]);
+	close (c_to_p[STDIN_FILENO]);
+	/* Map the stdin to the first pipe (this pipe gets input
+	 * from the parent) */
+	if (STDIN_FILENO != p_to_c[STDIN_FILENO]) {
+		if (dup2(p_to_c[STDIN_FILENO], STDIN_FILENO) !=
+		    STDIN_FILENO) {
+			VB2_DEBUG("stdin dup2() failed\n");
+			_exit(1);
+		}
+		close(p_to_c[STDIN_FILENO]);
+	}
+	/* Map the stdout to the second pipe (this pipe sends back
+	 * signer output to the parent) */
+	if (STDOUT_FILENO != c_to_p[STDOUT_FILENO]) {
+		if (dup2(c_to_p[STDOUT_FILENO], STDOUT_FILENO) !=
+		    STDOUT_FILENO) {
+			VB2_DEBUG("stdout dup2() failed\n");
+			_exit(1);
+		}
+		close(c_to_p[STDOUT_FILENO]);
+	}
+	/* External signer is invoked here. */
+	execl(external_signer, external_signer, arg1, arg2, (char *) 0);
+	VB2_DEBUG("execl() of external signer failed\n");
+	_exit(1);
+}
+
 /* Invoke [external_signer] command with [pem_file] as an argument, contents of
  * [inbuf] passed redirected to stdin, and the stdout of the command is put
  * back into [outbuf].  Returns -1 on error, 0 on success.
@@ -36,7 +109,7 @@ static int sign_external(uint32_t size,
 			 const char *external_signer)
 {
 	int rv = 0, n;
-	int p_to_c[2], c_to_p[2];  /* pipe descriptors */
+	int to_child, from_child;
 	pid_t pid;
 
 	VB2_DEBUG("Will invoke \"%s %s\" to perform signing.\n"
@@ -44,72 +117,212 @@ static int sign_external(uint32_t size,
 		 "Output of the signer will be read from standard out.\n",
 		  external_signer, pem_file);
 
-	/* Need two pipes since we want to invoke the external_signer as
-	 * a co-process writing to its stdin and reading from its stdout. */
-	if (pipe(p_to_c) < 0 || pipe(c_to_p) < 0) {
-		VB2_DEBUG("pipe() error\n");
+	if (spawn_external(external_signer, pem_file, NULL,
+			   &pid, &to_child, &from_child))
 		return -1;
-	}
-	if ((pid = fork()) < 0) {
-		VB2_DEBUG("fork() error\n");
-		return -1;
-	} else if (pid > 0) {  /* Parent. */
-		close(p_to_c[STDIN_FILENO]);
-		close(c_to_p[STDOUT_FILENO]);
 
-		/* We provide input to the child process (external signer). */
-		if (write(p_to_c[STDOUT_FILENO], inbuf, size) != size) {
-			VB2_DEBUG("write() error\n");
-			rv = -1;
-		} else {
-			/* Send EOF to child (signer process). */
-			close(p_to_c[STDOUT_FILENO]);
-
-			do {
-				n = read(c_to_p[STDIN_FILENO], outbuf,
-					 outbufsize);
-				outbuf += n;
-				outbufsize -= n;
-			} while (n > 0 && outbufsize);
-
-			if (n < 0) {
-				VB2_DEBUG("read() error\n");
-				rv = -1;
-			}
-		}
-		if (waitpid(pid, NULL, 0) < 0) {
-			VB2_DEBUG("waitpid() error\n");
+	/* We provide input to the child process (external signer). */
+	if (write(to_child, inbuf, size) != size) {
+		VB2_DEBUG("write() error\n");
+		close(to_child);
+		rv = -1;
+	} else {
+		/* Send EOF to child (signer process). */
+		close(to_child);
+
+		do {
+			n = read(from_child, outbuf, outbufsize);
+			outbuf += n;
+			outbufsize -= n;
+		} while (n > 0 && outbufsize);
+
+		if (n < 0) {
+			VB2_DEBUG("read() error\n");
 			rv = -1;
 		}
-	} else {  /* Child. */
-		close (p_to_c[STDOUT_FILENO]);
-		close (c_to_p[STDIN_FILENO]);
-		/* Map the stdin to the first pipe (this pipe gets input
-		 * from the parent) */
-		if (STDIN_FILENO != p_to_c[STDIN_FILENO]) {
-			if (dup2(p_to_c[STDIN_FILENO], STDIN_FILENO) !=
-			    STDIN_FILENO) {
-				VB2_DEBUG("stdin dup2() failed\n");
-				close(p_to_c[0]);
-				return -1;
-			}
-		}
-		/* Map the stdout to the second pipe (this pipe sends back
-		 * signer output to the parent) */
-		if (STDOUT_FILENO != c_to_p[STDOUT_FILENO]) {
-			if (dup2(c_to_p[STDOUT_FILENO], STDOUT_FILENO) !=
-			    STDOUT_FILENO) {
-				VB2_DEBUG("stdout dup2() failed\n");
-				close(c_to_p[STDOUT_FILENO]);
-				return -1;
-			}
-		}
-		/* External signer is invoked here. */
-		if (execl(external_signer, external_signer, pem_file,
-			  (char *) 0) < 0) {
-			VB2_DEBUG("execl() of external signer failed\n");
-		}
 	}
+	close(from_child);
+	if (waitpid(pid, NULL, 0) < 0) {
+		VB2_DEBUG("waitpid() error\n");
+		rv = -1;
+	}
+	return rv;
+}
+
+/*
+ * In persistent mode the external signer is started once, as
+ * "[external_signer] --persistent [pem_file]", and kept running for further
+ * signatures with the same key.  Each request on its stdin is an 8-byte
+ * header holding a request ID and the payload length, both big-endian 32-bit
+ * values, followed by the payload.  Each response on its stdout echoes the ID
+ * with the length of the signature that follows; a length of 0 means the
+ * signature failed.  The signer exits when its stdin is closed.
+ */
+static int persistent_mode;
+
+/* Only one request can be in flight on the co-process's pipes */
+static volatile int coproc_lock;
+
+static struct {
+	pid_t pid;
+	int to_child;
+	int from_child;
+	char *external_signer;
+	char *pem_file;
+	uint32_t next_id;
+} coproc = { .pid = -1 };
+
+void vb2_external_signer_persistent(int enable)
+{
+	persistent_mode = enable;
+}
+
+static void stop_coproc(void)
+{
+	if (coproc.pid < 0)
+		return;
+
+	close(coproc.to_child);
+	close(coproc.from_child);
+	if (waitpid(coproc.pid, NULL, 0) < 0)
+		VB2_DEBUG("waitpid() error\n");
+	free(coproc.external_signer);
+	free(coproc.pem_file);
+	coproc.external_signer = NULL;
+	coproc.pem_file = NULL;
+	coproc.pid = -1;
+}
+
+static int start_coproc(const char *pem_file, const char *external_signer)
+{
+	static int registered;
+
+	if (coproc.pid >= 0 &&
+	    !strcmp(coproc.external_signer, external_signer) &&
+	    !strcmp(coproc.pem_file, pem_file))
+		return 0;
+
+	stop_coproc();
+
+	VB2_DEBUG("Starting \"%s --persistent %s\" to perform signing.\n",
+		  external_signer, pem_file);
+	coproc.external_signer = strdup(external_signer);
+	coproc.pem_file = strdup(pem_file);
+	if (!coproc.external_signer || !coproc.pem_file ||
+	    spawn_external(external_signer, "--persistent", pem_file,
+			   &coproc.pid, &coproc.to_child, &coproc.from_child)) {
+		free(coproc.external_signer);
+		free(coproc.pem_file);
+		coproc.external_signer = NULL;
+		coproc.pem_file = NULL;
+		coproc.pid = -1;
+		return -1;
+	}
+
+	if (!registered) {
+		atexit(stop_coproc);
+		registered = 1;
+	}
+	return 0;
+}
+
+static int write_all(int fd, const uint8_t *buf, uint32_t size)
+{
+	while (size) {
+		ssize_t n = write(fd, buf, size);
+		if (n <= 0)
+			return -1;
+		buf += n;
+		size -= n;
+	}
+	return 0;
+}
+
+static int read_all(int fd, uint8_t *buf, uint32_t size)
+{
+	while (size) {
+		ssize_t n = read(fd, buf, size);
+		if (n <= 0)
+			return -1;
+		buf += n;
+		size -= n;
+	}
+	return 0;
+}
+
+static void put_be32(uint8_t *buf, uint32_t val)
+{
+	buf[0] = val >> 24;
+	buf[1] = val >> 16;
+	buf[2] = val >> 8;
+	buf[3] = val;
+}
+
+static uint32_t get_be32(const uint8_t *buf)
+{
+	return ((uint32_t)buf[0] << 24) | ((uint32_t)buf[1] << 16) |
+		((uint32_t)buf[2] << 8) | buf[3];
+}
+
+static int sign_persistent_locked(uint32_t size,
+				  const uint8_t *inbuf,
+				  uint8_t *outbuf,
+				  uint32_t outbufsize,
+				  const char *pem_file,
+				  const char *external_signer)
+{
+	uint8_t header[8];
+	uint32_t id, len;
+
+	if (start_coproc(pem_file, external_signer))
+		return -1;
+
+	id = ++coproc.next_id;
+	put_be32(header, id);
+	put_be32(header + 4, size);
+	if (write_all(coproc.to_child, header, sizeof(header)) ||
+	    write_all(coproc.to_child, inbuf, size)) {
+		VB2_DEBUG("write() error\n");
+		goto error;
+	}
+
+	if (read_all(coproc.from_child, header, sizeof(header))) {
+		VB2_DEBUG("read() error\n");
+		goto error;
+	}
+	len = get_be32(header + 4);
+	if (get_be32(header) != id || len > outbufsize) {
+		VB2_DEBUG("bad response from external signer\n");
+		goto error;
+	}
+	if (read_all(coproc.from_child, outbuf, len)) {
+		VB2_DEBUG("read() error\n");
+		goto error;
+	}
+
+	return len ? 0 : -1;
+
+error:
+	/* The stream can't be trusted any more; start over next time. */
+	stop_coproc();
+	return -1;
+}
+
+/* Like sign_external(), but using the persistent signer co-process. */
+static int sign_persistent(uint32_t size,
+			   const uint8_t *inbuf,
+			   uint8_t *outbuf,
+			   uint32_t outbufsize,
+			   const char *pem_file,
+			   const char *external_signer)
+{
+	int rv;
+
+	vb2_host_lock(&coproc_lock);
+	rv = sign_persistent_locked(size, inbuf, outbuf, outbufsize,
+				    pem_file, external_signer);
+	vb2_host_unlock(&coproc_lock);
+
 	return rv;
 }
 
@@ -134,11 +347,13 @@ struct vb2_signature *vb2_external_signature(const uint8_t *data,
 	uint64_t signature_digest_len = digest_size + digest_info_size;
 
 	int rv;
+	uint64_t start = vb2_sign_stats_start();
 
 	/* Calculate the digest */
 	if (VB2_SUCCESS != vb2_digest_buffer(data, size, vb2_alg,
 					     digest, sizeof(digest)))
 		return NULL;
+	vb2_sign_stats_hash(size, start);
 
 	/* Prepend the digest info to the digest */
 	signature_digest = calloc(signature_digest_len, 1);
@@ -158,12 +373,15 @@ struct vb2_signature *vb2_external_signature(const uint8_t *data,
 	}
 
 	/* Sign the signature_digest into our output buffer */
-	rv = sign_external(signature_digest_len,    /* Input length */
+	start = vb2_sign_stats_start();
+	rv = (persistent_mode ? sign_persistent : sign_external)(
+			   signature_digest_len,    /* Input length */
 			   signature_digest,        /* Input data */
 			   vb2_signature_data(sig), /* Output sig */
 			   sig_size,                /* Max Output sig size */
 			   key_file,                /* Key file to use */
 			   external_signer);        /* External cmd to invoke */
+	vb2_sign_stats_rsa(start);
 	free(signature_digest);
 
 	if (-1 == rv) {
@@ -22,6 +22,7 @@
 #include "host_common.h"
 #include "host_key2.h"
 #include "host_signature2.h"
+#include "host_signer.h"
 #include "vb2_common.h"
 #include "vboot_common.h"
 
@@ -81,11 +82,10 @@ struct vb2_signature *vb2_sha512_signature(const uint8_t *data, uint32_t size)
 	return sig;
 }
 
-struct vb2_signature *vb2_calculate_signature(
-		const uint8_t *data, uint32_t size,
-		const struct vb2_private_key *key)
+struct vb2_signature *vb2_sign_digest(const uint8_t *digest,
+				      uint32_t data_size,
+				      const struct vb2_private_key *key)
 {
-	uint8_t digest[VB2_MAX_DIGEST_SIZE];
 	uint32_t digest_size = vb2_digest_size(key->hash_alg);
 
 	uint32_t digest_info_size = 0;
@@ -94,11 +94,6 @@ struct vb2_signature *vb2_calculate_signature(
 					   &digest_info, &digest_info_size))
 		return NULL;
 
-	/* Calculate the digest */
-	if (VB2_SUCCESS != vb2_digest_buffer(data, size, key->hash_alg,
-					     digest, digest_size))
-		return NULL;
-
 	/* Prepend the digest info to the digest */
 	int signature_digest_len = digest_size + digest_info_size;
 	uint8_t *signature_digest = malloc(signature_digest_len);
@@ -110,18 +105,27 @@ struct vb2_signature *vb2_calculate_signature(
 
 	/* Allocate output signature */
 	struct vb2_signature *sig = (struct vb2_signature *)
-		vb2_alloc_signature(vb2_rsa_sig_size(key->sig_alg), size);
+		vb2_alloc_signature(vb2_rsa_sig_size(key->sig_alg), data_size);
 	if (!sig) {
 		free(signature_digest);
 		return NULL;
 	}
 
 	/* Sign the signature_digest into our output buffer */
-	int rv = RSA_private_encrypt(signature_digest_len,    /* Input length */
-				     signature_digest,        /* Input data */
-				     vb2_signature_data(sig), /* Output sig */
-				     key->rsa_private_key,    /* Key to use */
-				     RSA_PKCS1_PADDING);      /* Padding */
+	uint64_t start = vb2_sign_stats_start();
+	int rv;
+	if (key->signer)
+		rv = vb2_signer_sign(key, signature_digest,
+				     signature_digest_len,
+				     vb2_signature_data(sig),
+				     sig->sig_size) ? -1 : 0;
+	else
+		rv = RSA_private_encrypt(signature_digest_len,
+					 signature_digest,
+					 vb2_signature_data(sig),
+					 key->rsa_private_key,
+					 RSA_PKCS1_PADDING);
+	vb2_sign_stats_rsa(start);
 	free(signature_digest);
 
 	if (-1 == rv) {
@@ -133,3 +137,71 @@ struct vb2_signature *vb2_calculate_signature(
 	/* Return the signature */
 	return sig;
 }
+
+struct vb2_signature *vb2_calculate_signature(
+		const uint8_t *data, uint32_t size,
+		const struct vb2_private_key *key)
+{
+	uint8_t digest[VB2_MAX_DIGEST_SIZE];
+	uint32_t digest_size = vb2_digest_size(key->hash_alg);
+	uint64_t start = vb2_sign_stats_start();
+
+	/* Calculate the digest */
+	if (VB2_SUCCESS != vb2_digest_buffer(data, size, key->hash_alg,
+					     digest, digest_size))
+		return NULL;
+	vb2_sign_stats_hash(size, start);
+
+	return vb2_sign_digest(digest, size, key);
+}
+
+int vb2_calculate_signatures(const uint8_t *data, uint32_t size,
+			     const struct vb2_private_key **keys,
+			     uint32_t key_count,
+			     struct vb2_signature **sigs)
+{
+	/* Each digest is calculated once, however many keys use it */
+	uint8_t digests[VB2_HASH_ALG_COUNT][VB2_MAX_DIGEST_SIZE];
+	uint8_t hashed[VB2_HASH_ALG_COUNT] = {0};
+	uint32_t i;
+	int rv = VB2_SUCCESS;
+
+	for (i = 0; i < key_count; i++)
+		sigs[i] = NULL;
+
+	for (i = 0; i < key_count; i++) {
+		enum vb2_hash_algorithm hash_alg = keys[i]->hash_alg;
+		uint32_t digest_size = vb2_digest_size(hash_alg);
+
+		if (!digest_size) {
+			rv = VB2_SIGN_DATA_DIGEST_SIZE;
+			break;
+		}
+
+		if (!hashed[hash_alg]) {
+			uint64_t start = vb2_sign_stats_start();
+
+			rv = vb2_digest_buffer(data, size, hash_alg,
+					       digests[hash_alg], digest_size);
+			if (rv)
+				break;
+			vb2_sign_stats_hash(size, start);
+			hashed[hash_alg] = 1;
+		}
+
+		sigs[i] = vb2_sign_digest(digests[hash_alg], size, keys[i]);
+		if (!sigs[i]) {
+			rv = VB2_SIGN_DATA_RSA_ENCRYPT;
+			break;
+		}
+	}
+
+	if (rv) {
+		for (i = 0; i < key_count; i++) {
+			free(sigs[i]);
+			sigs[i] = NULL;
+		}
+	}
+
+	return rv;
+}
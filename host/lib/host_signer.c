@@ -0,0 +1,85 @@
+/* Copyright 2018 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ *
+ * Signer backend registry.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "2sysincludes.h"
+#include "2common.h"
+#include "host_key2.h"
+#include "host_signer.h"
+
+#define MAX_SIGNERS 8
+
+static const struct vb2_signer *signers[MAX_SIGNERS] = {
+	&vb2_pkcs11_signer,
+};
+static int signer_count = 1;
+
+int vb2_register_signer(const struct vb2_signer *signer)
+{
+	if (signer_count >= MAX_SIGNERS)
+		return VB2_ERROR_SIGNER_REGISTER;
+
+	signers[signer_count++] = signer;
+	return VB2_SUCCESS;
+}
+
+const struct vb2_signer *vb2_find_signer(const char *key_name)
+{
+	const char *colon = strchr(key_name, ':');
+	int i;
+
+	if (!colon)
+		return NULL;
+
+	for (i = 0; i < signer_count; i++) {
+		size_t len = strlen(signers[i]->name);
+
+		if (len == colon - key_name &&
+		    !strncmp(key_name, signers[i]->name, len))
+			return signers[i];
+	}
+	return NULL;
+}
+
+struct vb2_private_key *vb2_signer_read_key(
+		const char *key_name,
+		enum vb2_crypto_algorithm algorithm)
+{
+	const struct vb2_signer *signer = vb2_find_signer(key_name);
+	struct vb2_private_key *key;
+	int rv;
+
+	if (!signer) {
+		fprintf(stderr, "No signer backend for key %s\n", key_name);
+		return NULL;
+	}
+
+	key = calloc(1, sizeof(*key));
+	if (!key)
+		return NULL;
+
+	rv = signer->open_key(key, strchr(key_name, ':') + 1, algorithm);
+	if (rv) {
+		fprintf(stderr, "Unable to open %s key %s (error 0x%x)\n",
+			signer->name, key_name, rv);
+		free(key);
+		return NULL;
+	}
+
+	key->signer = signer;
+	return key;
+}
+
+int vb2_signer_sign(const struct vb2_private_key *key,
+		    const uint8_t *data, uint32_t size,
+		    uint8_t *sig, uint32_t sig_size)
+{
+	return key->signer->sign(key, data, size, sig, sig_size);
+}
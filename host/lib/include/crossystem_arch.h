@@ -69,6 +69,15 @@ int vb2_write_nv_storage(struct vb2_context *ctx);
  * free(), or NULL if error. */
 VbSharedDataHeader* VbSharedDataRead(void);
 
+/* Expand the compact form of VbSharedData (VbSharedDataCompact and its
+ * sections) into a VbSharedDataHeader.  Fields of sections which are not
+ * present are left zero.  VbSharedDataRead() implementations use this when
+ * the firmware handed off the compact form.
+ *
+ * Returns the expanded header, which must be freed by the caller using
+ * free(), or NULL if the data is not valid. */
+VbSharedDataHeader *VbSharedDataExpand(const void *buf, uint32_t size);
+
 /* Read an architecture-specific system property integer.
  *
  * Returns the property value, or -1 if error. */
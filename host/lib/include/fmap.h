@@ -47,4 +47,33 @@ uint8_t *fmap_find_by_name(uint8_t *ptr, size_t size,
 			   /* optional, return pointer to entry if not NULL */
 			   FmapAreaHeader **ah);
 
+/*
+ * For looking up many areas in the same FMAP. Areas are found by hashing
+ * their names, unless there are too many of them to fit in the table.
+ */
+#define FMAP_INDEX_SLOTS 256
+struct fmap_index {
+	uint8_t *ptr;
+	FmapHeader *fmap;
+	int hashed;
+	/* Area number + 1 for each hash slot, or 0 if the slot is empty */
+	uint16_t slot[FMAP_INDEX_SLOTS];
+};
+
+/*
+ * Prepare to look up areas in the FMAP within the buffer. Returns the FMAP
+ * header, or NULL if there isn't one.
+ */
+FmapHeader *fmap_index_init(struct fmap_index *index,
+			    uint8_t *ptr, size_t size,
+			    /* optional, will call fmap_find() if NULL */
+			    FmapHeader *fmap);
+
+/* Search for an area by name, like fmap_find_by_name() */
+uint8_t *fmap_index_find(const struct fmap_index *index,
+			 /* The area name to search for */
+			 const char *name,
+			 /* optional, return pointer to entry if not NULL */
+			 FmapAreaHeader **ah);
+
 #endif  /* __FMAP_H__ */
@@ -8,6 +8,7 @@
 #ifndef VBOOT_REFERENCE_HOST_COMMON_H_
 #define VBOOT_REFERENCE_HOST_COMMON_H_
 
+#include "2sha.h"
 #include "host_key.h"
 #include "host_key2.h"
 #include "host_keyblock.h"
@@ -36,6 +37,39 @@ struct vb2_fw_preamble *vb2_create_fw_preamble(
 	uint32_t flags);
 
 
+/**
+ * Return the size of the firmware preamble vb2_build_fw_preamble() would
+ * create.
+ *
+ * @param kernel_subkey		Kernel subkey to store in preamble
+ * @param body_signature	Signature of firmware body
+ * @param signing_key		Private key to sign header with
+ *
+ * @return The preamble size in bytes.
+ */
+uint32_t vb2_fw_preamble_size(const struct vb2_packed_key *kernel_subkey,
+			      const struct vb2_signature *body_signature,
+			      const struct vb2_private_key *signing_key);
+
+/**
+ * Create a firmware preamble in a caller-provided buffer.
+ *
+ * @param buf			Destination buffer
+ * @param buf_size		Size of destination buffer in bytes; must be
+ *				at least vb2_fw_preamble_size()
+ *
+ * The other parameters are as for vb2_create_fw_preamble().
+ *
+ * @return VB2_SUCCESS, or non-zero error code if failure.
+ */
+int vb2_build_fw_preamble(uint8_t *buf,
+			  uint32_t buf_size,
+			  uint32_t firmware_version,
+			  const struct vb2_packed_key *kernel_subkey,
+			  const struct vb2_signature *body_signature,
+			  const struct vb2_private_key *signing_key,
+			  uint32_t flags);
+
 /**
  * Create a kernel preamble.
  *
@@ -47,9 +81,20 @@ struct vb2_fw_preamble *vb2_create_fw_preamble(
  * @param vmlinuz_header_address	Load address for 16-bit vmlinuz header
  * @param vmlinuz_header_size		Size of 16-bit vmlinuz header in bytes
  * @param flags				Kernel preamble flags
+ * @param body_chunk_size		Size of each body chunk in bytes, or 0
+ *					for no chunk digests
+ * @param body_digests			Digests of each body chunk, from
+ *					vb2_body_digests_finalize()
+ * @param body_digests_size		Size of body_digests in bytes
+ * @param body_load_size		Size of the body once decompressed, if
+ *					flags give it a compression
  * @param desired_size			Minimum size of preamble in bytes
  * @param signing_key			Private key to sign header with
  *
+ * A compressed body makes the preamble version 2.4.  Otherwise it is 2.3
+ * with chunk digests, or 2.2.  The body signature and digests are of the
+ * body as stored.
+ *
  * @return The preamble, or NULL if error.  Caller must free() it.
  */
 struct vb2_kernel_preamble *vb2_create_kernel_preamble(
@@ -61,7 +106,102 @@ struct vb2_kernel_preamble *vb2_create_kernel_preamble(
 	uint64_t vmlinuz_header_address,
 	uint32_t vmlinuz_header_size,
 	uint32_t flags,
+	uint32_t body_chunk_size,
+	const uint8_t *body_digests,
+	uint32_t body_digests_size,
+	uint32_t body_load_size,
+	uint32_t desired_size,
+	const struct vb2_private_key *signing_key);
+
+/**
+ * Return the size of the kernel preamble vb2_build_kernel_preamble() would
+ * create.
+ *
+ * The parameters are as for vb2_create_kernel_preamble().
+ *
+ * @return The preamble size in bytes.
+ */
+uint32_t vb2_kernel_preamble_size(const struct vb2_signature *body_signature,
+				  uint32_t body_chunk_size,
+				  uint32_t body_digests_size,
+				  uint32_t desired_size,
+				  const struct vb2_private_key *signing_key);
+
+/**
+ * Create a kernel preamble in a caller-provided buffer.
+ *
+ * @param buf			Destination buffer
+ * @param buf_size		Size of destination buffer in bytes; must be
+ *				at least vb2_kernel_preamble_size()
+ *
+ * The other parameters are as for vb2_create_kernel_preamble().
+ *
+ * @return VB2_SUCCESS, or non-zero error code if failure.
+ */
+int vb2_build_kernel_preamble(
+	uint8_t *buf,
+	uint32_t buf_size,
+	uint32_t kernel_version,
+	uint64_t body_load_address,
+	uint64_t bootloader_address,
+	uint32_t bootloader_size,
+	const struct vb2_signature *body_signature,
+	uint64_t vmlinuz_header_address,
+	uint32_t vmlinuz_header_size,
+	uint32_t flags,
+	uint32_t body_chunk_size,
+	const uint8_t *body_digests,
+	uint32_t body_digests_size,
+	uint32_t body_load_size,
 	uint32_t desired_size,
 	const struct vb2_private_key *signing_key);
 
+/* Kernel body chunk digests, calculated as the body goes by */
+struct vb2_body_digests {
+	enum vb2_hash_algorithm hash_alg;
+	uint32_t chunk_size;
+
+	/* Bytes of the current chunk hashed so far */
+	uint32_t chunk_used;
+	struct vb2_digest_context dc;
+
+	/* Digests of the finished chunks; caller must free() */
+	uint8_t *digests;
+	uint32_t digests_size;
+};
+
+/**
+ * Start calculating kernel body chunk digests.
+ *
+ * @param bd		Digests to initialize
+ * @param hash_alg	Hash algorithm; that of the kernel data key
+ * @param chunk_size	Size of each chunk in bytes
+ * @return VB2_SUCCESS, or non-zero error code.
+ */
+int vb2_body_digests_init(struct vb2_body_digests *bd,
+			  enum vb2_hash_algorithm hash_alg,
+			  uint32_t chunk_size);
+
+/**
+ * Feed the next part of the kernel body to the chunk digests.
+ *
+ * @param bd		Digests being calculated
+ * @param buf		Body data
+ * @param size		Size of body data in bytes
+ * @return VB2_SUCCESS, or non-zero error code.
+ */
+int vb2_body_digests_extend(struct vb2_body_digests *bd,
+			    const uint8_t *buf,
+			    uint32_t size);
+
+/**
+ * Finish the last, possibly short, chunk.
+ *
+ * After this, bd->digests holds one digest per chunk.
+ *
+ * @param bd		Digests being calculated
+ * @return VB2_SUCCESS, or non-zero error code.
+ */
+int vb2_body_digests_finalize(struct vb2_body_digests *bd);
+
 #endif  /* VBOOT_REFERENCE_HOST_COMMON_H_ */
@@ -0,0 +1,30 @@
+/* Copyright 2018 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ *
+ * Running independent jobs on several threads, for host utilities.
+ */
+
+#ifndef VBOOT_REFERENCE_HOST_JOBS_H_
+#define VBOOT_REFERENCE_HOST_JOBS_H_
+
+/**
+ * Run fn(ctx, index) once for each index from 0 to count - 1.
+ *
+ * Up to njobs threads are used, including the calling thread, which runs
+ * whatever jobs the others don't get to.  Indexes are handed out in order,
+ * but the jobs may finish in any order, so each one should write its results
+ * somewhere of its own.  If no threads can be started, all the jobs run in
+ * the calling thread.  Returns once every job has finished.
+ *
+ * Callers must link with pthreads.
+ *
+ * @param fn		Function to run for each job
+ * @param ctx		Context passed to fn
+ * @param count		Number of jobs
+ * @param njobs		Maximum number of threads to use
+ */
+void vb2_run_jobs(void (*fn)(void *ctx, int index), void *ctx, int count,
+		  int njobs);
+
+#endif  /* VBOOT_REFERENCE_HOST_JOBS_H_ */
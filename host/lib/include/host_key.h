@@ -41,10 +41,65 @@ struct vb2_private_key *vb2_read_private_key_pem(
 /**
  * Free a private key.
  *
+ * Keys from the key cache are only freed once nothing else refers to them.
+ *
  * @param key		Key to free; ok to pass NULL (ignored).
  */
 void vb2_free_private_key(struct vb2_private_key *key);
 
+/* Private key file formats, for the key cache */
+enum vb2_private_key_format {
+	VB2_PRIVATE_KEY_VBPRIVK,	/* vb1 .vbprivk */
+	VB2_PRIVATE_KEY_PEM,		/* PEM, with a crypto algorithm */
+	VB2_PRIVATE_KEY_VBPRIK2,	/* vb21 .vbprik2 */
+};
+
+/* Reads a private key file the cache doesn't have; see below. */
+typedef int (*vb2_private_key_reader_t)(struct vb2_private_key **key_ptr,
+					const char *filename,
+					uint32_t algorithm);
+
+/**
+ * Read a private key file through the key cache.
+ *
+ * Reading the same unchanged file in the same format again returns the same
+ * key, with another reference, so it is parsed once however many times it is
+ * used.  Shared keys must not be modified; callers which adjust a key after
+ * reading it should read it with [reader] directly.  Each key returned must be
+ * freed with vb2_free_private_key() or vb2_private_key_free().
+ *
+ * @param key_ptr	Destination for the key
+ * @param filename	File to read
+ * @param format	Format of the file
+ * @param algorithm	Algorithm passed to [reader]; also part of the cache
+ *			key, since the same PEM file can be read as several
+ * @param reader	Function to read the file on a cache miss
+ *
+ * @return VB2_SUCCESS, or the error from [reader].
+ */
+int vb2_private_key_cache_read(struct vb2_private_key **key_ptr,
+			       const char *filename,
+			       enum vb2_private_key_format format,
+			       uint32_t algorithm,
+			       vb2_private_key_reader_t reader);
+
+/**
+ * Drop the key cache's references to its keys.
+ *
+ * Keys no longer in use are freed.  Later reads start with an empty cache.
+ * This runs automatically at exit.
+ */
+void vb2_private_key_cache_flush(void);
+
+/**
+ * Drop a reference to a cached key.
+ *
+ * @param key		Key being freed
+ *
+ * @return Non-zero if the key is still in use and must not be freed yet.
+ */
+int vb2_private_key_unref(struct vb2_private_key *key);
+
 /**
  * Write a private key to a file in .vbprivk format.
  *
@@ -28,6 +28,39 @@ struct vb2_keyblock *vb2_create_keyblock(
 		const struct vb2_private_key *signing_key,
 		uint32_t flags);
 
+/**
+ * Return the size of the keyblock vb2_build_keyblock() would create.
+ *
+ * @param data_key	Data key to store in keyblock
+ * @param signing_key	Key to sign keyblock with, or NULL
+ *
+ * @return The keyblock size in bytes.
+ */
+uint32_t vb2_keyblock_size(const struct vb2_packed_key *data_key,
+			   const struct vb2_private_key *signing_key);
+
+/**
+ * Create a keyblock header in a caller-provided buffer.
+ *
+ * This is vb2_create_keyblock() without the allocation, so a signer can build
+ * the keyblock directly in its output, such as a mapped VBLOCK area.
+ *
+ * @param buf		Destination buffer
+ * @param buf_size	Size of destination buffer in bytes; must be at least
+ *			vb2_keyblock_size()
+ * @param data_key	Data key to store in keyblock
+ * @param signing_key	Key to sign keyblock with.  May be NULL if keyblock
+ *			only needs a hash digest.
+ * @param flags		Keyblock flags
+ *
+ * @return VB2_SUCCESS, or non-zero error code if failure.
+ */
+int vb2_build_keyblock(uint8_t *buf,
+		       uint32_t buf_size,
+		       const struct vb2_packed_key *data_key,
+		       const struct vb2_private_key *signing_key,
+		       uint32_t flags);
+
 /**
  * Create a keyblock header using an external signer for all private key
  * operations.
@@ -8,6 +8,8 @@
 #ifndef VBOOT_REFERENCE_HOST_MISC_H_
 #define VBOOT_REFERENCE_HOST_MISC_H_
 
+#include <sched.h>
+
 #include "utility.h"
 #include "vboot_struct.h"
 
@@ -19,7 +21,8 @@ char* StrCopy(char* dest, const char* src, int dest_size);
 /* Read data from [filename].  Store the size of returned data in [size].
  *
  * Returns the data buffer, which the caller must Free(), or NULL if
- * error. */
+ * error.  Callers which only need to look at the data should use
+ * vb2_file_view_open() instead, which avoids the copy. */
 uint8_t* ReadFile(const char* filename, uint64_t* size);
 
 /* Read a string from a file.  Passed the destination, dest size, and
@@ -65,6 +68,72 @@ int vb2_read_file(const char *filename, uint8_t **data_ptr, uint32_t *size_ptr);
  */
 int vb2_write_file(const char *filename, const void *buf, uint32_t size);
 
+/* Hints for vb2_file_view_open() */
+enum vb2_file_view_flags {
+	/* Fault the whole file in up front (MAP_POPULATE) */
+	VB2_FILE_VIEW_POPULATE = (1 << 0),
+
+	/* Ask for the mapping to be backed by huge pages */
+	VB2_FILE_VIEW_HUGEPAGE = (1 << 1),
+};
+
+/*
+ * A reference-counted view of the contents of a file.  The data is mapped
+ * from the file when possible and read into the heap otherwise (pipes,
+ * character devices, empty files).  Writes to the data are private to the
+ * process and never reach the file.
+ */
+struct vb2_file_view {
+	uint8_t *data;
+	uint32_t size;
+
+	/* Internal to the view functions */
+	uint32_t refcount;
+	int mapped;
+};
+
+/**
+ * Open a view of the whole contents of a file.
+ *
+ * @param filename	Name of file to read from
+ * @param flags		Bitwise OR of enum vb2_file_view_flags
+ * @param view_ptr	On exit, the new view with one reference.  Release it
+ *			with vb2_file_view_put().
+ * @return VB2_SUCCESS, or non-zero if error.
+ */
+int vb2_file_view_open(const char *filename, uint32_t flags,
+		       struct vb2_file_view **view_ptr);
+
+/**
+ * Open a view of a file which is already open.
+ *
+ * Regular files and block devices are mapped from offset 0.  Anything else is
+ * read from the current position to EOF.  The caller still owns |fd| and may
+ * close it while the view is in use.
+ *
+ * @param fd		File descriptor to read from
+ * @param flags		Bitwise OR of enum vb2_file_view_flags
+ * @param view_ptr	On exit, the new view with one reference.
+ * @return VB2_SUCCESS, or non-zero if error.
+ */
+int vb2_file_view_open_fd(int fd, uint32_t flags,
+			  struct vb2_file_view **view_ptr);
+
+/**
+ * Take another reference to a view.
+ *
+ * @param view		View to reference
+ * @return |view|.
+ */
+struct vb2_file_view *vb2_file_view_get(struct vb2_file_view *view);
+
+/**
+ * Drop a reference to a view, releasing it when the last one goes.
+ *
+ * @param view		View to release; NULL is ignored.
+ */
+void vb2_file_view_put(struct vb2_file_view *view);
+
 /**
  * Write a buffer which starts with a standard vb21_struct_common header.
  *
@@ -96,4 +165,19 @@ static __inline const uint32_t roundup32(uint32_t v)
  */
 uint32_t vb2_desc_size(const char *desc);
 
+/*
+ * A lock for host library state shared between threads, so library users
+ * don't need to link with pthreads. Locks start out as zero.
+ */
+static __inline void vb2_host_lock(volatile int *lock)
+{
+	while (__sync_lock_test_and_set(lock, 1))
+		sched_yield();
+}
+
+static __inline void vb2_host_unlock(volatile int *lock)
+{
+	__sync_lock_release(lock);
+}
+
 #endif  /* VBOOT_REFERENCE_HOST_MISC_H_ */
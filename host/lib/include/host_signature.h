@@ -71,6 +71,43 @@ struct vb2_signature *vb2_calculate_signature(
 		const uint8_t *data, uint32_t size,
 		const struct vb2_private_key *key);
 
+/**
+ * Calculate signatures for the data using several keys.
+ *
+ * The data is hashed once for each hash algorithm the keys use, rather than
+ * once for each key.
+ *
+ * @param data		Pointer to data to sign
+ * @param size		Length of data in bytes
+ * @param keys		Private keys to use to sign data
+ * @param key_count	Number of keys
+ * @param sigs		On success, sigs[i] is signed with keys[i].
+ *			Caller must free() each one.
+ *
+ * @return VB2_SUCCESS, or non-zero if error, in which case no signatures are
+ * returned.
+ */
+int vb2_calculate_signatures(const uint8_t *data, uint32_t size,
+			     const struct vb2_private_key **keys,
+			     uint32_t key_count,
+			     struct vb2_signature **sigs);
+
+/**
+ * Calculate a signature from the digest of some data.
+ *
+ * This is for callers which hash the data themselves, for example a piece at
+ * a time.
+ *
+ * @param digest	Digest of the data, using key->hash_alg
+ * @param data_size	Length of the data in bytes
+ * @param key		Private key to use to sign the digest
+ *
+ * @return The signature, or NULL if error.  Caller must free() it.
+ */
+struct vb2_signature *vb2_sign_digest(const uint8_t *digest,
+				      uint32_t data_size,
+				      const struct vb2_private_key *key);
+
 /**
  * Calculate a signature for the data using an external signer.
  *
@@ -88,4 +125,16 @@ struct vb2_signature *vb2_external_signature(const uint8_t *data,
 					     uint32_t key_algorithm,
 					     const char *external_signer);
 
+/**
+ * Choose how vb2_external_signature() runs the external signer.
+ *
+ * By default the signer is run once per signature.  When persistent mode is
+ * enabled, it is started once per (signer, key file) pair with a
+ * "--persistent" argument and fed framed requests until the process exits.
+ * Requests from several threads are sent to it one at a time.
+ *
+ * @param enable		Non-zero to enable persistent mode
+ */
+void vb2_external_signer_persistent(int enable);
+
 #endif  /* VBOOT_REFERENCE_HOST_SIGNATURE_H_ */
@@ -0,0 +1,103 @@
+/* Copyright 2018 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ *
+ * Signer backends, for private keys which live outside this process.
+ */
+
+#ifndef VBOOT_REFERENCE_HOST_SIGNER_H_
+#define VBOOT_REFERENCE_HOST_SIGNER_H_
+
+#include "2crypto.h"
+
+struct vb2_private_key;
+
+/*
+ * A signer backend holds private keys somewhere else, for example in an HSM,
+ * and signs digests on request.  Its keys are named "<name>:<spec>", where
+ * the format of <spec> is up to the backend.  Once read, such a key is used
+ * like any other private key; vb2_sign_digest() and vb21_sign_digest() hand
+ * the digest to the backend instead of signing it with OpenSSL.
+ */
+struct vb2_signer {
+	/* Prefix naming the backend, without the ':' */
+	const char *name;
+
+	/*
+	 * Open the key named by [spec] and fill in key->signer_key,
+	 * key->hash_alg and key->sig_alg.  [algorithm] is the crypto algorithm
+	 * the caller expects, or VB2_ALG_COUNT if it has no opinion.
+	 *
+	 * Returns VB2_SUCCESS, or non-zero if error.
+	 */
+	int (*open_key)(struct vb2_private_key *key, const char *spec,
+			enum vb2_crypto_algorithm algorithm);
+
+	/*
+	 * RSA PKCS#1 v1.5 sign the [size] bytes of digest info and digest at
+	 * [data], writing exactly [sig_size] bytes to [sig].  May be called
+	 * from several threads at once.
+	 *
+	 * Returns VB2_SUCCESS, or non-zero if error.
+	 */
+	int (*sign)(const struct vb2_private_key *key,
+		    const uint8_t *data, uint32_t size,
+		    uint8_t *sig, uint32_t sig_size);
+
+	/* Release key->signer_key. */
+	void (*close_key)(struct vb2_private_key *key);
+};
+
+/* The PKCS#11 backend, keys named "pkcs11:<module>:<slot>:<label>[:<alg>]" */
+extern const struct vb2_signer vb2_pkcs11_signer;
+
+/**
+ * Make a backend available to vb2_signer_read_key().
+ *
+ * The built-in backends are always available.  [signer] must stay valid for
+ * the life of the process.
+ *
+ * @param signer	Backend to add
+ *
+ * @return VB2_SUCCESS, or non-zero if error.
+ */
+int vb2_register_signer(const struct vb2_signer *signer);
+
+/**
+ * Find the backend for a key name.
+ *
+ * @param key_name	"<name>:<spec>" for a backend key, or a filename
+ *
+ * @return The backend, or NULL if [key_name] doesn't name a backend key.
+ */
+const struct vb2_signer *vb2_find_signer(const char *key_name);
+
+/**
+ * Open a private key held by a backend.
+ *
+ * @param key_name	"<name>:<spec>"
+ * @param algorithm	Crypto algorithm the caller expects, or VB2_ALG_COUNT
+ *
+ * @return The private key or NULL if error.  Caller must free it with
+ * vb2_free_private_key().
+ */
+struct vb2_private_key *vb2_signer_read_key(
+		const char *key_name,
+		enum vb2_crypto_algorithm algorithm);
+
+/**
+ * Sign with a backend key.
+ *
+ * @param key		Key opened by vb2_signer_read_key()
+ * @param data		Digest info followed by the digest
+ * @param size		Length of data in bytes
+ * @param sig		Destination for the signature
+ * @param sig_size	Size of the signature in bytes
+ *
+ * @return VB2_SUCCESS, or non-zero if error.
+ */
+int vb2_signer_sign(const struct vb2_private_key *key,
+		    const uint8_t *data, uint32_t size,
+		    uint8_t *sig, uint32_t sig_size);
+
+#endif  /* VBOOT_REFERENCE_HOST_SIGNER_H_ */
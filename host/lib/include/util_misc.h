@@ -14,12 +14,15 @@ struct rsa_st;
 struct vb2_packed_key;
 struct vb2_private_key;
 
+/* Size of a buffer for a SHA1 digest string, including the terminator */
+#define KEY_SHA1_STRING_SIZE (VB2_SHA1_DIGEST_SIZE * 2 + 1)
+
 /**
  * Returns the SHA1 digest of the packed key data as a string.
  *
- * The returned string is a global static buffer, so each call to this
- * overwrites the previous digest string.  So don't call this more than once
- * per printf().
+ * The returned string is a static buffer for each thread, so each call to
+ * this overwrites the previous digest string from the same thread.  So don't
+ * call this more than once per printf().
  *
  * @param key		Key to print digest for
  *
@@ -27,12 +30,23 @@ struct vb2_private_key;
  */
 const char *packed_key_sha1_string(const struct vb2_packed_key *key);
 
+/**
+ * Like packed_key_sha1_string(), but into a buffer from the caller.
+ *
+ * @param key		Key to print digest for
+ * @param dest		Buffer of at least KEY_SHA1_STRING_SIZE bytes
+ *
+ * @return dest.
+ */
+char *packed_key_sha1_string_r(const struct vb2_packed_key *key,
+			      char *dest);
+
 /**
  * Returns the SHA1 digest of the private key data as a string.
  *
- * The returned string is a global static buffer, so each call to this
- * overwrites the previous digest string.  So don't call this more than once
- * per printf().
+ * The returned string is a static buffer for each thread, so each call to
+ * this overwrites the previous digest string from the same thread.  So don't
+ * call this more than once per printf().
  *
  * @param key		Key to print digest for
  *
@@ -40,6 +54,17 @@ const char *packed_key_sha1_string(const struct vb2_packed_key *key);
  */
 const char *private_key_sha1_string(const struct vb2_private_key *key);
 
+/**
+ * Like private_key_sha1_string(), but into a buffer from the caller.
+ *
+ * @param key		Key to print digest for
+ * @param dest		Buffer of at least KEY_SHA1_STRING_SIZE bytes
+ *
+ * @return dest.
+ */
+char *private_key_sha1_string_r(const struct vb2_private_key *key,
+			       char *dest);
+
 /*
  * Our packed RSBPublicKey buffer (historically in files ending with ".keyb",
  * but also the part of struct vb2_packed_key and struct vb21_packed_key that
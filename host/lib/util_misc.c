@@ -18,52 +18,183 @@
 #include "2common.h"
 #include "2sha.h"
 #include "host_common.h"
+#include "host_misc.h"
 #include "openssl_compat.h"
 #include "util_misc.h"
 #include "vb2_common.h"
 #include "host_key2.h"
 #include "vboot_common.h"
 
-const char *packed_key_sha1_string(const struct vb2_packed_key *key)
+/*
+ * The same few keys tend to be shown over and over when looking at many
+ * images, so remember the sha1sums of the last few we've seen. Entries are
+ * matched on the key data itself rather than on where it lives, so they can't
+ * go stale when buffers are freed and reused.
+ */
+#define KEY_SHA1_CACHE_SIZE 16
+
+enum key_sha1_kind {
+	KEY_SHA1_PACKED,		/* data is the packed key */
+	KEY_SHA1_MODULUS,		/* data is the private key modulus */
+};
+
+struct key_sha1_entry {
+	enum key_sha1_kind kind;
+	uint32_t fingerprint;
+	uint32_t size;
+	uint8_t *data;
+	char sha1[VB2_SHA1_DIGEST_SIZE * 2 + 1];
+};
+
+static struct key_sha1_entry key_sha1_cache[KEY_SHA1_CACHE_SIZE];
+static int key_sha1_next;
+/* Held while looking in or adding to the cache */
+static volatile int key_sha1_lock;
+
+/* Cheap enough to check before comparing the whole key */
+static uint32_t key_fingerprint(const uint8_t *data, uint32_t size)
+{
+	uint32_t fp = size;
+	uint32_t i;
+
+	for (i = 0; i < 8 && i < size; i++)
+		fp = fp * 31 + data[i] + (data[size - 1 - i] << 8);
+
+	return fp;
+}
+
+/* Look up a key, copying its digest string to [sha1] if found. */
+static int key_sha1_find(enum key_sha1_kind kind, const uint8_t *data,
+			 uint32_t size, char *sha1)
+{
+	uint32_t fp = key_fingerprint(data, size);
+	int found = 0;
+	int i;
+
+	vb2_host_lock(&key_sha1_lock);
+	for (i = 0; i < KEY_SHA1_CACHE_SIZE; i++) {
+		struct key_sha1_entry *e = &key_sha1_cache[i];
+		if (e->data && e->kind == kind && e->fingerprint == fp &&
+		    e->size == size && !memcmp(e->data, data, size)) {
+			strcpy(sha1, e->sha1);
+			found = 1;
+			break;
+		}
+	}
+	vb2_host_unlock(&key_sha1_lock);
+
+	return found;
+}
+
+static void key_sha1_add(enum key_sha1_kind kind,
+			 const uint8_t *data, uint32_t size, const char *sha1)
+{
+	struct key_sha1_entry *e;
+	uint8_t *copy = malloc(size);
+	uint8_t *old;
+
+	/* It's only a cache, so not remembering is fine */
+	if (!copy)
+		return;
+	memcpy(copy, data, size);
+
+	vb2_host_lock(&key_sha1_lock);
+	e = &key_sha1_cache[key_sha1_next];
+	old = e->data;
+	e->kind = kind;
+	e->fingerprint = key_fingerprint(data, size);
+	e->size = size;
+	e->data = copy;
+	strcpy(e->sha1, sha1);
+	key_sha1_next = (key_sha1_next + 1) % KEY_SHA1_CACHE_SIZE;
+	vb2_host_unlock(&key_sha1_lock);
+
+	free(old);
+}
+
+static void sha1_to_string(const uint8_t *buf, uint32_t buflen, char *dest)
 {
-	uint8_t *buf = ((uint8_t *)key) + key->key_offset;
-	uint32_t buflen = key->key_size;
 	uint8_t digest[VB2_SHA1_DIGEST_SIZE];
-	static char dest[VB2_SHA1_DIGEST_SIZE * 2 + 1];
+	int i;
 
 	vb2_digest_buffer(buf, buflen, VB2_HASH_SHA1, digest, sizeof(digest));
 
-	char *dnext = dest;
-	int i;
 	for (i = 0; i < sizeof(digest); i++)
-		dnext += sprintf(dnext, "%02x", digest[i]);
+		dest += sprintf(dest, "%02x", digest[i]);
+}
+
+char *packed_key_sha1_string_r(const struct vb2_packed_key *key,
+			      char *dest)
+{
+	uint8_t *buf = ((uint8_t *)key) + key->key_offset;
+	uint32_t buflen = key->key_size;
+
+	if (key_sha1_find(KEY_SHA1_PACKED, buf, buflen, dest))
+		return dest;
+
+	sha1_to_string(buf, buflen, dest);
+	key_sha1_add(KEY_SHA1_PACKED, buf, buflen, dest);
 
 	return dest;
 }
 
-const char *private_key_sha1_string(const struct vb2_private_key *key)
+const char *packed_key_sha1_string(const struct vb2_packed_key *key)
+{
+	static __thread char dest[KEY_SHA1_STRING_SIZE];
+
+	return packed_key_sha1_string_r(key, dest);
+}
+
+char *private_key_sha1_string_r(const struct vb2_private_key *key,
+			       char *dest)
 {
+	const BIGNUM *n;
 	uint8_t *buf;
 	uint32_t buflen;
-	uint8_t digest[VB2_SHA1_DIGEST_SIZE];
-	static char dest[VB2_SHA1_DIGEST_SIZE * 2 + 1];
-
-	if (!key->rsa_private_key ||
-	    vb_keyb_from_rsa(key->rsa_private_key, &buf, &buflen)) {
-		return "<error>";
+	uint8_t *modulus = NULL;
+	uint32_t modulus_size = 0;
+
+	if (!key->rsa_private_key)
+		return strcpy(dest, "<error>");
+
+	/*
+	 * The packed form is derived entirely from the modulus, so look that
+	 * up instead of doing all the bignum math to pack the key again.
+	 */
+	RSA_get0_key(key->rsa_private_key, &n, NULL, NULL);
+	if (n) {
+		modulus_size = BN_num_bytes(n);
+		modulus = malloc(modulus_size);
+		if (modulus)
+			BN_bn2bin(n, modulus);
+	}
+	if (modulus &&
+	    key_sha1_find(KEY_SHA1_MODULUS, modulus, modulus_size, dest)) {
+		free(modulus);
+		return dest;
 	}
 
-	vb2_digest_buffer(buf, buflen, VB2_HASH_SHA1, digest, sizeof(digest));
+	if (vb_keyb_from_rsa(key->rsa_private_key, &buf, &buflen)) {
+		free(modulus);
+		return strcpy(dest, "<error>");
+	}
 
-	char *dnext = dest;
-	int i;
-	for (i = 0; i < sizeof(digest); i++)
-		dnext += sprintf(dnext, "%02x", digest[i]);
+	sha1_to_string(buf, buflen, dest);
+	if (modulus)
+		key_sha1_add(KEY_SHA1_MODULUS, modulus, modulus_size, dest);
 
+	free(modulus);
 	free(buf);
 	return dest;
 }
 
+const char *private_key_sha1_string(const struct vb2_private_key *key)
+{
+	static __thread char dest[KEY_SHA1_STRING_SIZE];
+
+	return private_key_sha1_string_r(key, dest);
+}
+
 int vb_keyb_from_rsa(struct rsa_st *rsa_private_key,
 		     uint8_t **keyb_data, uint32_t *keyb_size)
 {
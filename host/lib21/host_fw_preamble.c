@@ -6,6 +6,7 @@
  */
 
 #include "2sysincludes.h"
+#include "2api.h"
 #include "2common.h"
 #include "2rsa.h"
 #include "host_common.h"
@@ -16,19 +17,20 @@
 #include "host_signature2.h"
 #include "vb21_common.h"
 
-int vb21_fw_preamble_create(struct vb21_fw_preamble **fp_ptr,
-			    const struct vb2_private_key *signing_key,
-			    const struct vb21_signature **hash_list,
-			    uint32_t hash_count,
-			    uint32_t fw_version,
-			    uint32_t flags,
-			    const char *desc)
+/* Fill in the fixed header, including the offsets and total size */
+static int fw_preamble_header(struct vb21_fw_preamble *fp,
+			      const struct vb2_private_key *signing_key,
+			      const struct vb21_signature **hash_list,
+			      uint32_t hash_count,
+			      uint32_t fw_version,
+			      uint32_t flags,
+			      const char *desc)
 {
-	struct vb21_fw_preamble fp = {
+	struct vb21_fw_preamble h = {
 		.c.magic = VB21_MAGIC_FW_PREAMBLE,
 		.c.struct_version_major = VB21_FW_PREAMBLE_VERSION_MAJOR,
 		.c.struct_version_minor = VB21_FW_PREAMBLE_VERSION_MAJOR,
-		.c.fixed_size = sizeof(fp),
+		.c.fixed_size = sizeof(h),
 		.c.desc_size = vb2_desc_size(desc),
 		.flags = flags,
 		.fw_version = fw_version,
@@ -37,29 +39,66 @@ int vb21_fw_preamble_create(struct vb21_fw_preamble **fp_ptr,
 
 	uint32_t hash_next;
 	uint32_t sig_size;
-	uint8_t *buf;
 	int i;
 
-	*fp_ptr = NULL;
-
 	/* Determine component sizes */
-	hash_next = fp.hash_offset = fp.c.fixed_size + fp.c.desc_size;
+	hash_next = h.hash_offset = h.c.fixed_size + h.c.desc_size;
 
 	for (i = 0; i < hash_count; i++)
 		hash_next += hash_list[i]->c.total_size;
 
-	fp.sig_offset = hash_next;
+	h.sig_offset = hash_next;
 
 	if (vb21_sig_size_for_key(&sig_size, signing_key, NULL))
 		return VB2_FW_PREAMBLE_CREATE_SIG_SIZE;
 
-	fp.c.total_size = fp.sig_offset + sig_size;
+	h.c.total_size = h.sig_offset + sig_size;
 
-	/* Allocate buffer and copy components */
-	buf = calloc(fp.c.total_size, 1);
-	if (!buf)
-		return VB2_FW_PREAMBLE_CREATE_ALLOC;
+	memcpy(fp, &h, sizeof(h));
+	return VB2_SUCCESS;
+}
+
+int vb21_fw_preamble_size(uint32_t *size_ptr,
+			  const struct vb2_private_key *signing_key,
+			  const struct vb21_signature **hash_list,
+			  uint32_t hash_count,
+			  const char *desc)
+{
+	struct vb21_fw_preamble fp;
+	int rv;
+
+	rv = fw_preamble_header(&fp, signing_key, hash_list, hash_count,
+				0, 0, desc);
+	if (rv)
+		return rv;
+
+	*size_ptr = fp.c.total_size;
+	return VB2_SUCCESS;
+}
+
+int vb21_fw_preamble_build(uint8_t *buf,
+			   uint32_t buf_size,
+			   const struct vb2_private_key *signing_key,
+			   const struct vb21_signature **hash_list,
+			   uint32_t hash_count,
+			   uint32_t fw_version,
+			   uint32_t flags,
+			   const char *desc)
+{
+	struct vb21_fw_preamble fp;
+	uint32_t hash_next;
+	int i, rv;
+
+	rv = fw_preamble_header(&fp, signing_key, hash_list, hash_count,
+				fw_version, flags, desc);
+	if (rv)
+		return rv;
 
+	if (buf_size < fp.c.total_size)
+		return VB2_FW_PREAMBLE_CREATE_BUF_SIZE;
+
+	/* Copy components */
+	memset(buf, 0, fp.c.total_size);
 	memcpy(buf, &fp, sizeof(fp));
 	if (fp.c.desc_size)
 		strcpy((char *)buf + fp.c.fixed_size, desc);
@@ -72,11 +111,134 @@ int vb21_fw_preamble_create(struct vb21_fw_preamble **fp_ptr,
 	}
 
 	/* Sign the preamble */
-	if (vb21_sign_object(buf, fp.sig_offset, signing_key, NULL)) {
-		free(buf);
+	if (vb21_sign_object(buf, fp.sig_offset, signing_key, NULL))
 		return VB2_FW_PREAMBLE_CREATE_SIGN;
+
+	return VB2_SUCCESS;
+}
+
+int vb21_fw_preamble_create(struct vb21_fw_preamble **fp_ptr,
+			    const struct vb2_private_key *signing_key,
+			    const struct vb21_signature **hash_list,
+			    uint32_t hash_count,
+			    uint32_t fw_version,
+			    uint32_t flags,
+			    const char *desc)
+{
+	uint32_t size;
+	uint8_t *buf;
+	int rv;
+
+	*fp_ptr = NULL;
+
+	rv = vb21_fw_preamble_size(&size, signing_key, hash_list, hash_count,
+				   desc);
+	if (rv)
+		return rv;
+
+	/* Allocate buffer and build the preamble in it */
+	buf = malloc(size);
+	if (!buf)
+		return VB2_FW_PREAMBLE_CREATE_ALLOC;
+
+	rv = vb21_fw_preamble_build(buf, size, signing_key, hash_list,
+				    hash_count, fw_version, flags, desc);
+	if (rv) {
+		free(buf);
+		return rv;
 	}
 
 	*fp_ptr = (struct vb21_fw_preamble *)buf;
 	return VB2_SUCCESS;
 }
+
+/* A component hashed on another CPU by vb2ex_run_parallel() */
+struct component_hash_job {
+	const struct vb21_fw_component *component;
+	struct vb21_signature **sig_ptr;
+};
+
+static int component_hash(const struct vb21_fw_component *component,
+			  struct vb21_signature **sig_ptr)
+{
+	const struct vb2_private_key *hash_key;
+
+	if (vb2_private_key_hash(&hash_key, component->hash_alg))
+		return VB2_FW_PREAMBLE_CREATE_HASH;
+
+	if (vb21_sign_data(sig_ptr, component->buf, component->size,
+			   hash_key, component->desc))
+		return VB2_FW_PREAMBLE_CREATE_HASH;
+
+	return VB2_SUCCESS;
+}
+
+static int component_hash_run(void *arg)
+{
+	struct component_hash_job *job = arg;
+
+	return component_hash(job->component, job->sig_ptr);
+}
+
+int vb21_fw_preamble_create_from_data(struct vb21_fw_preamble **fp_ptr,
+				      const struct vb2_private_key *signing_key,
+				      const struct vb21_fw_component *components,
+				      uint32_t component_count,
+				      uint32_t fw_version,
+				      uint32_t flags,
+				      const char *desc)
+{
+	struct vb21_signature **hash_list;
+	struct component_hash_job job;
+	uint32_t largest = 0;
+	int started = 0;
+	int i, rv = VB2_SUCCESS, job_rv;
+
+	*fp_ptr = NULL;
+
+	hash_list = calloc(component_count ? component_count : 1,
+			   sizeof(*hash_list));
+	if (!hash_list)
+		return VB2_FW_PREAMBLE_CREATE_ALLOC;
+
+	/*
+	 * Hand the largest component to another CPU and hash the rest here,
+	 * so a preamble with one big body and some small components takes
+	 * about as long as hashing the body.
+	 */
+	for (i = 1; i < component_count; i++) {
+		if (components[i].size > components[largest].size)
+			largest = i;
+	}
+	if (component_count) {
+		job.component = components + largest;
+		job.sig_ptr = hash_list + largest;
+		started = (vb2ex_run_parallel(component_hash_run, &job) ==
+			   VB2_SUCCESS);
+	}
+
+	for (i = 0; i < component_count && !rv; i++) {
+		if (i == largest && started)
+			continue;
+		rv = component_hash(components + i, hash_list + i);
+	}
+
+	/* Always collect the other CPU's work before touching hash_list */
+	if (started) {
+		job_rv = vb2ex_wait();
+		if (!rv)
+			rv = job_rv;
+	}
+
+	if (!rv)
+		rv = vb21_fw_preamble_create(
+			fp_ptr, signing_key,
+			(const struct vb21_signature **)hash_list,
+			component_count, fw_version, flags, desc);
+
+	for (i = 0; i < component_count; i++)
+		free(hash_list[i]);
+	free(hash_list);
+
+	return rv;
+}
@@ -7,16 +7,19 @@
 
 #include <stdio.h>
 
+#include <openssl/evp.h>
 #include <openssl/pem.h>
 
 #include "2sysincludes.h"
 #include "2common.h"
+#include "2ed25519.h"
 #include "2rsa.h"
 #include "2sha.h"
 #include "vb21_common.h"
 #include "host_common.h"
 #include "host_key2.h"
 #include "host_misc.h"
+#include "host_signer.h"
 #include "openssl_compat.h"
 
 const struct vb2_text_vs_enum vb2_text_vs_sig[] = {
@@ -26,6 +29,7 @@ const struct vb2_text_vs_enum vb2_text_vs_sig[] = {
 	{"RSA8192", VB2_SIG_RSA8192},
 	{"RSA2048EXP3", VB2_SIG_RSA2048_EXP3},
 	{"RSA3072EXP3", VB2_SIG_RSA3072_EXP3},
+	{"ED25519", VB2_SIG_ED25519},
 	{0, 0}
 };
 
@@ -126,12 +130,18 @@ const char *vb2_get_crypto_algorithm_file(enum vb2_crypto_algorithm alg)
 
 void vb2_private_key_free(struct vb2_private_key *key)
 {
-	if (!key)
+	if (!key || vb2_private_key_unref(key))
 		return;
 
+	if (key->signer)
+		key->signer->close_key(key);
+
 	if (key->rsa_private_key)
 		RSA_free(key->rsa_private_key);
 
+	if (key->ed25519_private_key)
+		EVP_PKEY_free(key->ed25519_private_key);
+
 	if (key->desc)
 		free(key->desc);
 
@@ -150,6 +160,9 @@ int vb21_private_key_unpack(struct vb2_private_key **key_ptr,
 
 	*key_ptr = NULL;
 
+	if (size < sizeof(pkey->c))
+		return VB2_ERROR_UNPACK_PRIVATE_KEY_HEADER;
+
 	/*
 	 * Check magic number.
 	 *
@@ -191,6 +204,15 @@ int vb21_private_key_unpack(struct vb2_private_key **key_ptr,
 			free(key);
 			return VB2_ERROR_UNPACK_PRIVATE_KEY_HASH;
 		}
+	} else if (pkey->sig_alg == VB2_SIG_ED25519) {
+		/* Ed25519 keys are the raw private key */
+		key->ed25519_private_key = EVP_PKEY_new_raw_private_key(
+			EVP_PKEY_ED25519, NULL, buf + pkey->key_offset,
+			pkey->key_size);
+		if (!key->ed25519_private_key) {
+			free(key);
+			return VB2_ERROR_UNPACK_PRIVATE_KEY_ED25519;
+		}
 	} else {
 		start = (const unsigned char *)(buf + pkey->key_offset);
 		key->rsa_private_key = d2i_RSAPrivateKey(0, &start,
@@ -214,26 +236,31 @@ int vb21_private_key_unpack(struct vb2_private_key **key_ptr,
 	return VB2_SUCCESS;
 }
 
-int vb21_private_key_read(struct vb2_private_key **key_ptr,
-			  const char *filename)
+static int read_vbprik2(struct vb2_private_key **key_ptr,
+			const char *filename, uint32_t algorithm)
 {
-	uint32_t size = 0;
-	uint8_t *buf = NULL;
+	struct vb2_file_view *view;
 	int rv;
 
-	*key_ptr = NULL;
-
-	rv = vb2_read_file(filename, &buf, &size);
+	rv = vb2_file_view_open(filename, 0, &view);
 	if (rv)
 		return rv;
 
-	rv = vb21_private_key_unpack(key_ptr, buf, size);
+	rv = vb21_private_key_unpack(key_ptr, view->data, view->size);
 
-	free(buf);
+	vb2_file_view_put(view);
 
 	return rv;
 }
 
+int vb21_private_key_read(struct vb2_private_key **key_ptr,
+			  const char *filename)
+{
+	return vb2_private_key_cache_read(key_ptr, filename,
+					  VB2_PRIVATE_KEY_VBPRIK2, 0,
+					  read_vbprik2);
+}
+
 int vb2_private_key_read_pem(struct vb2_private_key **key_ptr,
 			     const char *filename)
 {
@@ -242,6 +269,11 @@ int vb2_private_key_read_pem(struct vb2_private_key **key_ptr,
 
 	*key_ptr = NULL;
 
+	if (vb2_find_signer(filename)) {
+		*key_ptr = vb2_signer_read_key(filename, VB2_ALG_COUNT);
+		return *key_ptr ? VB2_SUCCESS : VB2_ERROR_SIGNER_OPEN_KEY;
+	}
+
 	/* Allocate the new key */
 	key = calloc(1, sizeof(*key));
 	if (!key)
@@ -255,9 +287,22 @@ int vb2_private_key_read_pem(struct vb2_private_key **key_ptr,
 	}
 
 	key->rsa_private_key = PEM_read_RSAPrivateKey(f, NULL, NULL, NULL);
+
+	/* If it isn't RSA, it may be Ed25519 */
+	if (!key->rsa_private_key && !fseek(f, 0, SEEK_SET)) {
+		key->ed25519_private_key = PEM_read_PrivateKey(f, NULL, NULL,
+							       NULL);
+		if (key->ed25519_private_key &&
+		    EVP_PKEY_id(key->ed25519_private_key) != EVP_PKEY_ED25519) {
+			EVP_PKEY_free(key->ed25519_private_key);
+			key->ed25519_private_key = NULL;
+		}
+		if (key->ed25519_private_key)
+			key->sig_alg = VB2_SIG_ED25519;
+	}
 	fclose(f);
 
-	if (!key->rsa_private_key) {
+	if (!key->rsa_private_key && !key->ed25519_private_key) {
 		free(key);
 		return VB2_ERROR_READ_PEM_RSA;
 	}
@@ -295,29 +340,45 @@ int vb21_private_key_write(const struct vb2_private_key *key,
 		.id = key->id,
 	};
 	uint8_t *buf;
-	uint8_t *rsabuf = NULL;
-	int rsalen = 0;
+	uint8_t *keybuf = NULL;
+	int keylen = 0;
+	size_t len;
 	int rv;
 
 	memcpy(&pkey.id, &key->id, sizeof(pkey.id));
 
 	pkey.c.desc_size = vb2_desc_size(key->desc);
 
-	if (key->sig_alg != VB2_SIG_NONE) {
+	if (key->sig_alg == VB2_SIG_ED25519) {
+		/* Pack the raw Ed25519 key */
+		if (!key->ed25519_private_key ||
+		    EVP_PKEY_get_raw_private_key(key->ed25519_private_key,
+						 NULL, &len) != 1)
+			return VB2_ERROR_PRIVATE_KEY_WRITE_ED25519;
+		keybuf = malloc(len);
+		if (!keybuf)
+			return VB2_ERROR_PRIVATE_KEY_WRITE_ALLOC;
+		if (EVP_PKEY_get_raw_private_key(key->ed25519_private_key,
+						 keybuf, &len) != 1) {
+			free(keybuf);
+			return VB2_ERROR_PRIVATE_KEY_WRITE_ED25519;
+		}
+		keylen = len;
+	} else if (key->sig_alg != VB2_SIG_NONE) {
 		/* Pack RSA key */
-		rsalen = i2d_RSAPrivateKey(key->rsa_private_key, &rsabuf);
-		if (rsalen <= 0 || !rsabuf)
+		keylen = i2d_RSAPrivateKey(key->rsa_private_key, &keybuf);
+		if (keylen <= 0 || !keybuf)
 			return VB2_ERROR_PRIVATE_KEY_WRITE_RSA;
 	}
 
 	pkey.key_offset = pkey.c.fixed_size + pkey.c.desc_size;
-	pkey.key_size = roundup32(rsalen);
+	pkey.key_size = roundup32(keylen);
 	pkey.c.total_size = pkey.key_offset + pkey.key_size;
 
 	/* Pack private key */
 	buf = calloc(1, pkey.c.total_size);
 	if (!buf) {
-		free(rsabuf);
+		free(keybuf);
 		return VB2_ERROR_PRIVATE_KEY_WRITE_ALLOC;
 	}
 
@@ -327,9 +388,9 @@ int vb21_private_key_write(const struct vb2_private_key *key,
 	if (pkey.c.desc_size)
 		strcpy((char *)buf + pkey.c.fixed_size, key->desc);
 
-	if (rsabuf) {
-		memcpy(buf + pkey.key_offset, rsabuf, rsalen);
-		free(rsabuf);
+	if (keybuf) {
+		memcpy(buf + pkey.key_offset, keybuf, keylen);
+		free(keybuf);
 	}
 
 	rv = vb21_write_object(filename, buf);
@@ -433,14 +494,16 @@ int vb2_public_key_read_keyb(struct vb2_public_key **key_ptr,
 			     const char *filename)
 {
 	struct vb2_public_key *key = NULL;
-	uint8_t *key_data, *key_buf;
+	struct vb2_file_view *view;
+	uint8_t *key_buf;
 	uint32_t key_size;
 	enum vb2_signature_algorithm sig_alg;
 
 	*key_ptr = NULL;
 
-	if (vb2_read_file(filename, &key_data, &key_size))
+	if (vb2_file_view_open(filename, 0, &view))
 		return VB2_ERROR_READ_KEYB_DATA;
+	key_size = view->size;
 
 	/* Guess the signature algorithm from the key size
 	 * Note: This only considers exponent F4 keys, as there is no way to
@@ -451,19 +514,19 @@ int vb2_public_key_read_keyb(struct vb2_public_key **key_ptr,
 			break;
 	}
 	if (sig_alg > VB2_SIG_RSA8192) {
-		free(key_data);
+		vb2_file_view_put(view);
 		return VB2_ERROR_READ_KEYB_SIZE;
 	}
 
 	if (vb2_public_key_alloc(&key, sig_alg)) {
-		free(key_data);
+		vb2_file_view_put(view);
 		return VB2_ERROR_READ_KEYB_ALLOC;
 	}
 
-	/* Copy data from the file buffer to the public key buffer */
+	/* Copy data from the file view to the public key buffer */
 	key_buf = vb2_public_key_packed_data(key);
-	memcpy(key_buf, key_data, key_size);
-	free(key_data);
+	memcpy(key_buf, view->data, key_size);
+	vb2_file_view_put(view);
 
 	if (vb2_unpack_key_data(key, key_buf, key_size)) {
 		vb2_public_key_free(key);
@@ -556,7 +619,10 @@ int vb21_public_key_pack(struct vb21_packed_key **key_ptr,
 		buf[key.c.fixed_size + key.c.desc_size - 1] = 0;
 	}
 
-	if (pubk->sig_alg != VB2_SIG_NONE) {
+	if (pubk->sig_alg == VB2_SIG_ED25519) {
+		/* Ed25519 key data is just the point */
+		memcpy(buf + key.key_offset, pubk->n, key.key_size);
+	} else if (pubk->sig_alg != VB2_SIG_NONE) {
 		/* Re-pack the key arrays */
 		buf32 = (uint32_t *)(buf + key.key_offset);
 		buf32[0] = pubk->arrsize;
@@ -635,6 +701,20 @@ enum vb2_signature_algorithm vb2_rsa_sig_alg(struct rsa_st *rsa)
 	return VB2_SIG_INVALID;
 }
 
+int vb2_private_key_ed25519_public(const struct vb2_private_key *key,
+				   uint8_t *pubkey)
+{
+	size_t len = VB2_ED25519_KEY_BYTES;
+
+	if (!key->ed25519_private_key ||
+	    EVP_PKEY_get_raw_public_key(key->ed25519_private_key,
+					pubkey, &len) != 1 ||
+	    len != VB2_ED25519_KEY_BYTES)
+		return VB2_ERROR_ED25519_PUBLIC_KEY;
+
+	return VB2_SUCCESS;
+}
+
 int vb21_public_key_write(const struct vb2_public_key *key,
 			  const char *filename)
 {
@@ -5,8 +5,11 @@
  * Host functions for signatures.
  */
 
+#include <openssl/evp.h>
 #include <openssl/rsa.h>
 
+#include <time.h>
+
 #include "2sysincludes.h"
 #include "2common.h"
 #include "2rsa.h"
@@ -15,8 +18,56 @@
 #include "host_common.h"
 #include "host_key2.h"
 #include "host_signature2.h"
+#include "host_signer.h"
 #include "host_misc.h"
 
+static struct vb2_sign_stats sign_stats;
+
+void vb2_get_sign_stats(struct vb2_sign_stats *stats, int reset)
+{
+	if (reset) {
+		stats->hash_bytes = __sync_lock_test_and_set(
+			&sign_stats.hash_bytes, 0);
+		stats->hash_nsecs = __sync_lock_test_and_set(
+			&sign_stats.hash_nsecs, 0);
+		stats->rsa_count = __sync_lock_test_and_set(
+			&sign_stats.rsa_count, 0);
+		stats->rsa_nsecs = __sync_lock_test_and_set(
+			&sign_stats.rsa_nsecs, 0);
+	} else {
+		stats->hash_bytes = __sync_add_and_fetch(
+			&sign_stats.hash_bytes, 0);
+		stats->hash_nsecs = __sync_add_and_fetch(
+			&sign_stats.hash_nsecs, 0);
+		stats->rsa_count = __sync_add_and_fetch(
+			&sign_stats.rsa_count, 0);
+		stats->rsa_nsecs = __sync_add_and_fetch(
+			&sign_stats.rsa_nsecs, 0);
+	}
+}
+
+uint64_t vb2_sign_stats_start(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+void vb2_sign_stats_hash(uint64_t bytes, uint64_t start)
+{
+	__sync_add_and_fetch(&sign_stats.hash_bytes, bytes);
+	__sync_add_and_fetch(&sign_stats.hash_nsecs,
+			     vb2_sign_stats_start() - start);
+}
+
+void vb2_sign_stats_rsa(uint64_t start)
+{
+	__sync_add_and_fetch(&sign_stats.rsa_count, 1);
+	__sync_add_and_fetch(&sign_stats.rsa_nsecs,
+			     vb2_sign_stats_start() - start);
+}
+
 int vb2_digest_info(enum vb2_hash_algorithm hash_alg,
 		    const uint8_t **buf_ptr,
 		    uint32_t *size_ptr)
@@ -68,11 +119,11 @@ int vb2_digest_info(enum vb2_hash_algorithm hash_alg,
 	}
 }
 
-int vb21_sign_data(struct vb21_signature **sig_ptr,
-		   const uint8_t *data,
-		   uint32_t size,
-		   const struct vb2_private_key *key,
-		   const char *desc)
+int vb21_sign_digest(struct vb21_signature **sig_ptr,
+		     const uint8_t *digest,
+		     uint32_t size,
+		     const struct vb2_private_key *key,
+		     const char *desc)
 {
 	struct vb21_signature s = {
 		.c.magic = VB21_MAGIC_SIGNATURE,
@@ -85,13 +136,16 @@ int vb21_sign_data(struct vb21_signature **sig_ptr,
 		.id = key->id,
 	};
 
-	struct vb2_digest_context dc;
 	uint32_t digest_size;
 	const uint8_t *info = NULL;
 	uint32_t info_size = 0;
 	uint32_t sig_digest_size;
 	uint8_t *sig_digest;
 	uint8_t *buf;
+	uint64_t start;
+	EVP_MD_CTX *mdctx;
+	size_t sig_size;
+	int ok;
 
 	*sig_ptr = NULL;
 
@@ -109,7 +163,7 @@ int vb21_sign_data(struct vb21_signature **sig_ptr,
 	s.c.total_size = s.sig_offset + s.sig_size;
 
 	/* Determine digest size and allocate buffer */
-	if (s.sig_alg != VB2_SIG_NONE) {
+	if (s.sig_alg != VB2_SIG_NONE && s.sig_alg != VB2_SIG_ED25519) {
 		if (vb2_digest_info(s.hash_alg, &info, &info_size))
 			return VB2_SIGN_DATA_DIGEST_INFO;
 	}
@@ -126,22 +180,7 @@ int vb21_sign_data(struct vb21_signature **sig_ptr,
 	/* Prepend digest info, if any */
 	if (info_size)
 		memcpy(sig_digest, info, info_size);
-
-	/* Calculate hash digest */
-	if (vb2_digest_init(&dc, s.hash_alg)) {
-		free(sig_digest);
-		return VB2_SIGN_DATA_DIGEST_INIT;
-	}
-
-	if (vb2_digest_extend(&dc, data, size)) {
-		free(sig_digest);
-		return VB2_SIGN_DATA_DIGEST_EXTEND;
-	}
-
-	if (vb2_digest_finalize(&dc, sig_digest + info_size, digest_size)) {
-		free(sig_digest);
-		return VB2_SIGN_DATA_DIGEST_FINALIZE;
-	}
+	memcpy(sig_digest + info_size, digest, digest_size);
 
 	/* Allocate signature buffer and copy header */
 	buf = calloc(1, s.c.total_size);
@@ -154,9 +193,31 @@ int vb21_sign_data(struct vb21_signature **sig_ptr,
 	if (s.sig_alg == VB2_SIG_NONE) {
 		/* Bare hash signature is just the digest */
 		memcpy(buf + s.sig_offset, sig_digest, sig_digest_size);
+	} else if (s.sig_alg == VB2_SIG_ED25519) {
+		/* Sign the digest, as if it were the whole message */
+		start = vb2_sign_stats_start();
+		sig_size = s.sig_size;
+		mdctx = EVP_MD_CTX_new();
+		ok = mdctx && key->ed25519_private_key &&
+			EVP_DigestSignInit(mdctx, NULL, NULL, NULL,
+					   key->ed25519_private_key) == 1 &&
+			EVP_DigestSign(mdctx, buf + s.sig_offset, &sig_size,
+				       sig_digest, sig_digest_size) == 1 &&
+			sig_size == s.sig_size;
+		EVP_MD_CTX_free(mdctx);
+		if (!ok) {
+			free(sig_digest);
+			free(buf);
+			return VB2_SIGN_DATA_ED25519;
+		}
+		vb2_sign_stats_rsa(start);
 	} else {
 		/* RSA-encrypt the signature */
-		if (RSA_private_encrypt(sig_digest_size,
+		start = vb2_sign_stats_start();
+		if (key->signer ?
+		    vb2_signer_sign(key, sig_digest, sig_digest_size,
+				    buf + s.sig_offset, s.sig_size) :
+		    RSA_private_encrypt(sig_digest_size,
 					sig_digest,
 					buf + s.sig_offset,
 					key->rsa_private_key,
@@ -165,6 +226,7 @@ int vb21_sign_data(struct vb21_signature **sig_ptr,
 			free(buf);
 			return VB2_SIGN_DATA_RSA_ENCRYPT;
 		}
+		vb2_sign_stats_rsa(start);
 	}
 
 	free(sig_digest);
@@ -172,6 +234,71 @@ int vb21_sign_data(struct vb21_signature **sig_ptr,
 	return VB2_SUCCESS;
 }
 
+/**
+ * Hash [size] bytes of [data] with [hash_alg] into [digest], which must be
+ * big enough for it.
+ */
+static int vb21_hash_data(const uint8_t *data, uint32_t size,
+			  enum vb2_hash_algorithm hash_alg, uint8_t *digest)
+{
+	struct vb2_digest_context dc;
+	uint64_t start = vb2_sign_stats_start();
+
+	if (vb2_digest_init(&dc, hash_alg))
+		return VB2_SIGN_DATA_DIGEST_INIT;
+
+	if (vb2_digest_extend(&dc, data, size))
+		return VB2_SIGN_DATA_DIGEST_EXTEND;
+
+	if (vb2_digest_finalize(&dc, digest, vb2_digest_size(hash_alg)))
+		return VB2_SIGN_DATA_DIGEST_FINALIZE;
+
+	vb2_sign_stats_hash(size, start);
+	return VB2_SUCCESS;
+}
+
+/**
+ * Check that vb21_sign_digest() can sign with [key], so bad keys are caught
+ * before spending time on the data.
+ */
+static int vb21_check_sign_key(const struct vb2_private_key *key)
+{
+	const uint8_t *info;
+	uint32_t info_size;
+
+	if (!vb2_sig_size(key->sig_alg, key->hash_alg))
+		return VB2_SIGN_DATA_SIG_SIZE;
+	if (key->sig_alg != VB2_SIG_NONE && key->sig_alg != VB2_SIG_ED25519 &&
+	    vb2_digest_info(key->hash_alg, &info, &info_size))
+		return VB2_SIGN_DATA_DIGEST_INFO;
+	if (!vb2_digest_size(key->hash_alg))
+		return VB2_SIGN_DATA_DIGEST_SIZE;
+
+	return VB2_SUCCESS;
+}
+
+int vb21_sign_data(struct vb21_signature **sig_ptr,
+		   const uint8_t *data,
+		   uint32_t size,
+		   const struct vb2_private_key *key,
+		   const char *desc)
+{
+	uint8_t digest[VB2_MAX_DIGEST_SIZE];
+	int rv;
+
+	*sig_ptr = NULL;
+
+	rv = vb21_check_sign_key(key);
+	if (rv)
+		return rv;
+
+	rv = vb21_hash_data(data, size, key->hash_alg, digest);
+	if (rv)
+		return rv;
+
+	return vb21_sign_digest(sig_ptr, digest, size, key, desc);
+}
+
 int vb21_sig_size_for_key(uint32_t *size_ptr,
 			  const struct vb2_private_key *key,
 			  const char *desc)
@@ -239,12 +366,29 @@ int vb21_sign_object_multiple(uint8_t *buf,
 {
 	struct vb21_struct_common *c = (struct vb21_struct_common *)buf;
 	uint32_t sig_next = sig_offset;
+	/* Each digest is calculated once, however many keys use it */
+	uint8_t digests[VB2_HASH_ALG_COUNT][VB2_MAX_DIGEST_SIZE];
+	uint8_t hashed[VB2_HASH_ALG_COUNT] = {0};
 	int rv, i;
 
 	for (i = 0; i < key_count; i++)	{
+		const struct vb2_private_key *key = key_list[i];
 		struct vb21_signature *sig = NULL;
 
-		rv = vb21_sign_data(&sig, buf, sig_offset, key_list[i], NULL);
+		rv = vb21_check_sign_key(key);
+		if (rv)
+			return rv;
+
+		if (!hashed[key->hash_alg]) {
+			rv = vb21_hash_data(buf, sig_offset, key->hash_alg,
+					    digests[key->hash_alg]);
+			if (rv)
+				return rv;
+			hashed[key->hash_alg] = 1;
+		}
+
+		rv = vb21_sign_digest(&sig, digests[key->hash_alg],
+				      sig_offset, key, NULL);
 		if (rv)
 			return rv;
 
@@ -8,9 +8,25 @@
 #ifndef VBOOT_REFERENCE_HOST_FW_PREAMBLE2_H_
 #define VBOOT_REFERENCE_HOST_FW_PREAMBLE2_H_
 
+#include "2crypto.h"
+
 struct vb2_private_key;
 struct vb21_fw_preamble;
 struct vb21_signature;
+
+/* A firmware component to hash into a preamble */
+struct vb21_fw_component {
+	/* Component data */
+	const uint8_t *buf;
+	uint32_t size;
+
+	/* Hash algorithm for the component */
+	enum vb2_hash_algorithm hash_alg;
+
+	/* Description (tag) for the component hash, or NULL if none */
+	const char *desc;
+};
+
 /**
  * Create and sign a firmware preamble.
  *
@@ -32,4 +48,65 @@ int vb21_fw_preamble_create(struct vb21_fw_preamble **fp_ptr,
 			    uint32_t flags,
 			    const char *desc);
 
+/**
+ * Calculate the size of a firmware preamble.
+ *
+ * @param size_ptr	On success, contains the preamble size in bytes.
+ * @param signing_key	Key to sign the preamble with
+ * @param hash_list	Component hashes to include in the keyblock
+ * @param hash_count	Number of component hashes
+ * @param desc		Description for preamble, or NULL if none
+ * @return VB2_SUCCESS, or non-zero error code if failure.
+ */
+int vb21_fw_preamble_size(uint32_t *size_ptr,
+			  const struct vb2_private_key *signing_key,
+			  const struct vb21_signature **hash_list,
+			  uint32_t hash_count,
+			  const char *desc);
+
+/**
+ * Create and sign a firmware preamble in a caller-provided buffer.
+ *
+ * @param buf		Destination buffer
+ * @param buf_size	Size of destination buffer in bytes; must be at least
+ *			the size from vb21_fw_preamble_size()
+ *
+ * The other parameters are as for vb21_fw_preamble_create().
+ *
+ * @return VB2_SUCCESS, or non-zero error code if failure.
+ */
+int vb21_fw_preamble_build(uint8_t *buf,
+			   uint32_t buf_size,
+			   const struct vb2_private_key *signing_key,
+			   const struct vb21_signature **hash_list,
+			   uint32_t hash_count,
+			   uint32_t fw_version,
+			   uint32_t flags,
+			   const char *desc);
+
+/**
+ * Hash firmware components, then create and sign a preamble with the hashes.
+ *
+ * The largest component is hashed on another CPU through
+ * vb2ex_run_parallel(), if the caller provides it, while the others are
+ * hashed on this one.
+ *
+ * @param fp_ptr	On success, points to a newly allocated preamble buffer.
+ *			Caller is responsible for calling free() on this.
+ * @param signing_key	Key to sign the preamble with
+ * @param components	Components to hash, in preamble order
+ * @param component_count	Number of components
+ * @param fw_version	Firmware version
+ * @param flags		Flags for preamble
+ * @param desc		Description for preamble, or NULL if none
+ * @return VB2_SUCCESS, or non-zero error code if failure.
+ */
+int vb21_fw_preamble_create_from_data(struct vb21_fw_preamble **fp_ptr,
+				      const struct vb2_private_key *signing_key,
+				      const struct vb21_fw_component *components,
+				      uint32_t component_count,
+				      uint32_t fw_version,
+				      uint32_t flags,
+				      const char *desc);
+
 #endif  /* VBOOT_REFERENCE_HOST_FW_PREAMBLE2_H_ */
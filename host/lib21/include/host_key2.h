@@ -13,14 +13,19 @@
 
 struct vb2_public_key;
 struct vb21_packed_key;
+struct vb2_signer;
 
 /* Private key data, in-memory format for use in signing calls. */
 struct vb2_private_key {
 	struct rsa_st *rsa_private_key;		/* Private key data */
+	struct evp_pkey_st *ed25519_private_key; /* Or this, for Ed25519 */
 	enum vb2_hash_algorithm hash_alg;	/* Hash algorithm */
 	enum vb2_signature_algorithm sig_alg;	/* Signature algorithm */
 	char *desc;				/* Description */
 	struct vb2_id id;			/* Key ID */
+	const struct vb2_signer *signer;	/* Or a backend holds the key */
+	void *signer_key;			/* Backend's handle for it */
+	int refs;				/* References, if cached */
 };
 
 struct vb2_packed_private_key {
@@ -118,6 +123,8 @@ int vb21_private_key_read(struct vb2_private_key **key_ptr,
  *
  * This only reads the internal data for the key.  It does not set any of the
  * other fields in *key_ptr, since those are not contained in the .pem file.
+ * The exception is sig_alg for Ed25519 keys, whose key data says nothing else
+ * about what they are.
  *
  * @param key_ptr	Destination for newly allocated key; this must be
  *			freed with vb2_private_key_free().
@@ -255,6 +262,16 @@ int vb2_public_key_hash(struct vb2_public_key *key,
  */
 enum vb2_signature_algorithm vb2_rsa_sig_alg(struct rsa_st *rsa);
 
+/**
+ * Get the public key of an Ed25519 private key
+ *
+ * @param key		Private key
+ * @param pubkey	Destination for VB2_ED25519_KEY_BYTES of key data
+ * @return VB2_SUCCESS, or non-zero error code if error.
+ */
+int vb2_private_key_ed25519_public(const struct vb2_private_key *key,
+				   uint8_t *pubkey);
+
 /**
  * Write a public key to the vb21_packed_key format.
  *
@@ -13,6 +13,38 @@
 struct vb2_private_key;
 struct vb21_signature;
 
+/*
+ * Running totals of the work done to make signatures, so that benchmarks can
+ * tell where the time goes. Work done on several threads at once is added
+ * up, so the totals can be more than the time that actually passed.
+ */
+struct vb2_sign_stats {
+	uint64_t hash_bytes;
+	uint64_t hash_nsecs;
+	uint64_t rsa_count;
+	uint64_t rsa_nsecs;
+};
+
+/**
+ * Get the signing totals so far.
+ *
+ * @param stats		Destination for the totals
+ * @param reset		If non-zero, start counting again from zero
+ */
+void vb2_get_sign_stats(struct vb2_sign_stats *stats, int reset);
+
+/**
+ * Return a monotonic time in nanoseconds, to pass to vb2_sign_stats_hash()
+ * or vb2_sign_stats_rsa() once the work is done.
+ */
+uint64_t vb2_sign_stats_start(void);
+
+/**
+ * Count some hashing, or one RSA signature, that began at [start].
+ */
+void vb2_sign_stats_hash(uint64_t bytes, uint64_t start);
+void vb2_sign_stats_rsa(uint64_t start);
+
 /**
  * Get the digest info for a hash algorithm
  *
@@ -25,6 +57,27 @@ int vb2_digest_info(enum vb2_hash_algorithm hash_alg,
 		    const uint8_t **buf_ptr,
 		    uint32_t *size_ptr);
 
+/**
+ * Sign the digest of a data buffer
+ *
+ * This is for callers which hash the data themselves, for example to sign
+ * it with several keys which use the same hash algorithm.
+ *
+ * @param sig_ptr	On success, points to a newly allocated signature.
+ *			Caller is responsible for calling free() on this.
+ * @param digest	Digest of the data, using key->hash_alg
+ * @param size		Size of the data in bytes
+ * @param key		Private key to use to sign the digest
+ * @param desc		Optional description for signature.  If NULL, the
+ *			key description will be used.
+ * @return VB2_SUCCESS, or non-zero error code on failure.
+ */
+int vb21_sign_digest(struct vb21_signature **sig_ptr,
+		     const uint8_t *digest,
+		     uint32_t size,
+		     const struct vb2_private_key *key,
+		     const char *desc);
+
 /**
  * Sign data buffer
  *
@@ -92,6 +145,9 @@ int vb21_sign_object(uint8_t *buf,
  *			in the buffer will be signed.
  * @param key_list	List of keys to sign object with
  * @param key_count	Number of keys in list
+ *
+ * The object is hashed once for each hash algorithm the keys use, not once
+ * for each key.
  */
 int vb21_sign_object_multiple(uint8_t *buf,
 			      uint32_t sig_offset,
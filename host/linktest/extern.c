@@ -41,6 +41,7 @@ int main(void)
 	CgptPrioritize(0);
 	CgptSetAttributes(0);
 	FindKernelConfig(0, 0);
+	FindKernelConfigs(0, 0, 0, 0);
 	GuidEqual(0, 0);
 	GuidIsZero(0);
 	GuidToStr(0, 0, 0);
@@ -205,17 +205,21 @@ calculate_rootfs_hash() {
     salt=$(get_verity_arg "${vroot_dev}" salt)
   fi
 
-  local salt_arg
-  if [ -n "$salt" ]; then
-    salt_arg="salt=$salt"
+  # Hash the rootfs partition. Only the legacy format needs the verity tool.
+  local slave
+  if is_old_verity_argv "${vroot_dev}"; then
+    slave=$(sudo ${verity_bin} mode=create \
+      alg=${verity_algorithm} \
+      payload="${rootfs_image}" \
+      payload_blocks=$((rootfs_sectors / 8)) \
+      hashtree="${hash_image}")
+  else
+    slave=$(sudo ${FUTILITY} verity \
+      --alg ${verity_algorithm} \
+      --blocks $((rootfs_sectors / 8)) \
+      ${salt:+--salt "${salt}"} \
+      "${rootfs_image}" "${hash_image}")
   fi
-
-  # Run the verity tool on the rootfs partition.
-  local slave=$(sudo ${verity_bin} mode=create \
-    alg=${verity_algorithm} \
-    payload="${rootfs_image}" \
-    payload_blocks=$((rootfs_sectors / 8)) \
-    hashtree="${hash_image}" ${salt_arg})
   # Reconstruct new kernel config command line and replace placeholders.
   slave="$(echo "${slave}" |
     sed -s "s|ROOT_DEV|${root_dev}|g;s|HASH_DEV|${hash_dev}|")"
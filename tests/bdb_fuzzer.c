@@ -0,0 +1,26 @@
+/* Copyright 2018 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ *
+ * Fuzz target for bdb_verify().
+ */
+
+#include <stdlib.h>
+
+#include "bdb.h"
+#include "fuzz_common.h"
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+	void *buf;
+
+	if (size > FUZZ_MAX_INPUT_SIZE)
+		return 0;
+
+	/* With no key digest, a good BDB returns BDB_GOOD_OTHER_THAN_KEY */
+	buf = fuzz_copy_input(data, size);
+	bdb_verify(buf, size, NULL);
+	free(buf);
+
+	return 0;
+}
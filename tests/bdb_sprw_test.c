@@ -44,6 +44,8 @@ static struct bdb_secrets secrets = {
 };
 
 static int vbe_write_nvm_failure = 0;
+/* Number of reads from each NVM-RW copy */
+static int nvmrw1_reads, nvmrw2_reads;
 
 static struct bdb_header *create_bdb(const char *key_dir,
 				     struct bdb_hash *hash, int num_hashes)
@@ -284,11 +286,13 @@ int vbe_read_nvm(enum nvm_type type, uint8_t *buf, uint32_t size)
 		if (sizeof(nvmrw1) < size)
 			return -1;
 		memcpy(buf, nvmrw1, size);
+		nvmrw1_reads++;
 		break;
 	case NVM_TYPE_RW_SECONDARY:
 		if (sizeof(nvmrw2) < size)
 			return -1;
 		memcpy(buf, nvmrw2, size);
+		nvmrw2_reads++;
 		break;
 	default:
 		return -1;
@@ -420,6 +424,39 @@ static void test_nvm_read(void)
 	TEST_SUCC(memcmp(nvmrw1, nvmrw2_copy, sizeof(nvmrw1)), NULL);
 	TEST_SUCC(memcmp(nvmrw2, nvmrw2_copy, sizeof(nvmrw2)), NULL);
 
+	/*
+	 * Test update count: the stale primary is only read for its count,
+	 * and then to check the write.
+	 */
+	install_nvm(NVM_TYPE_RW_PRIMARY, 0, 1, 0);
+	install_nvm(NVM_TYPE_RW_SECONDARY, 1, 0, 1);
+	memset(&ctx.nvmrw, 0, sizeof(ctx.nvmrw));
+	nvmrw1_reads = nvmrw2_reads = 0;
+	TEST_SUCC(nvmrw_read(&ctx), NULL);
+	TEST_EQ(nvmrw1_reads, 2, "  primary reads");
+	TEST_EQ(nvmrw2_reads, 2, "  secondary reads");
+
+	/* Test update count: secondary new but bad -> pick primary */
+	install_nvm(NVM_TYPE_RW_PRIMARY, 0, 1, 0);
+	install_nvm(NVM_TYPE_RW_SECONDARY, 1, 0, 1);
+	memcpy(nvmrw1_copy, nvmrw1, sizeof(*nvm));
+	nvm = (struct nvmrw *)nvmrw2;
+	nvm->hmac[0] ^= 0xff;
+	memset(&ctx.nvmrw, 0, sizeof(ctx.nvmrw));
+	TEST_SUCC(nvmrw_read(&ctx), NULL);
+	TEST_SUCC(memcmp(&ctx.nvmrw, nvmrw1_copy, sizeof(*nvm)), NULL);
+	TEST_SUCC(memcmp(nvmrw2, nvmrw1_copy, sizeof(nvmrw1)), NULL);
+
+	/* Test same update count, different but valid -> pick primary */
+	install_nvm(NVM_TYPE_RW_PRIMARY, 0, 1, 0);
+	install_nvm(NVM_TYPE_RW_SECONDARY, 1, 0, 0);
+	memcpy(nvmrw1_copy, nvmrw1, sizeof(nvmrw1));
+	memcpy(nvmrw2_copy, nvmrw2, sizeof(nvmrw2));
+	memset(&ctx.nvmrw, 0, sizeof(ctx.nvmrw));
+	TEST_SUCC(nvmrw_read(&ctx), NULL);
+	TEST_SUCC(memcmp(&ctx.nvmrw, nvmrw1_copy, sizeof(*nvm)), NULL);
+	TEST_SUCC(memcmp(nvmrw2, nvmrw2_copy, sizeof(nvmrw2)), NULL);
+
 	/* Test old reader -> minor version downgrade */
 	install_nvm(NVM_TYPE_RW_PRIMARY, 0, 1, 0);
 	install_nvm(NVM_TYPE_RW_SECONDARY, 1, 0, 1);
@@ -665,6 +702,46 @@ static void test_derive_secrets(void)
 			 BDB_SECRET_SIZE), NULL);
 }
 
+static void test_derive_all_secrets(const char *key_dir)
+{
+	struct bdb_hash hash = {
+		.offset = 0x28000,
+		.size = 0x20000,
+		.partition = 1,
+		.type = BDB_DATA_AP_RW,
+		.load_address = 0x200000,
+	};
+	struct bdb_header *b = create_bdb(key_dir, &hash, 1);
+	struct bdb_secrets one_by_one, batch;
+	struct vba_context ctx = {
+		.bdb = (uint8_t *)b,
+		.flags = VBA_CONTEXT_FLAG_KERNEL_DATA_KEY_VERIFIED,
+	};
+	const struct bdb_key *bdbkey = bdb_get_bdbkey(b);
+	const struct bdb_key *datakey = bdb_get_datakey(b);
+
+	memset(&one_by_one, 0x5a, sizeof(one_by_one));
+	memcpy(&batch, &one_by_one, sizeof(batch));
+
+	ctx.secrets = &one_by_one;
+	vba_derive_secret(&ctx, BDB_SECRET_TYPE_BDB, NULL,
+			  (const uint8_t *)bdbkey, bdbkey->struct_size);
+	vba_derive_secret(&ctx, BDB_SECRET_TYPE_BOOT_PATH, NULL,
+			  (const uint8_t *)datakey, datakey->struct_size);
+	vba_derive_secret(&ctx, BDB_SECRET_TYPE_BOOT_VERIFIED, NULL, NULL, 0);
+	vba_derive_secret(&ctx, BDB_SECRET_TYPE_BUC, NULL, NULL, 0);
+
+	ctx.secrets = &batch;
+	TEST_SUCC(vba_derive_secrets(&ctx), "vba_derive_secrets()");
+	TEST_SUCC(memcmp(&one_by_one, &batch, sizeof(batch)),
+		  "Same secrets as one at a time");
+
+	ctx.bdb = NULL;
+	TEST_EQ(vba_derive_secrets(&ctx), BDB_ERROR_SECRET_BDB, "No BDB");
+
+	free(b);
+}
+
 int main(int argc, char *argv[])
 {
 	if (argc != 2) {
@@ -679,6 +756,7 @@ int main(int argc, char *argv[])
 	test_update_kernel_version();
 	test_update_buc();
 	test_derive_secrets();
+	test_derive_all_secrets(argv[1]);
 
 	return gTestSuccess ? 0 : 255;
 }
@@ -248,6 +248,166 @@ void check_data_tests(void)
 /**
  * Test bdb_verify() and bdb_create()
  */
+void check_sha256_tests(void)
+{
+	uint8_t buf[1000];
+	uint8_t digest[BDB_SHA256_DIGEST_SIZE];
+	uint8_t expect[BDB_SHA256_DIGEST_SIZE];
+	struct bdb_sha256_context ctx;
+	int i;
+
+	for (i = 0; i < sizeof(buf); i++)
+		buf[i] = i * 3;
+
+	vb2_digest_buffer(buf, sizeof(buf), VB2_HASH_SHA256,
+			  expect, sizeof(expect));
+	TEST_EQ_S(bdb_sha256(digest, buf, sizeof(buf)), BDB_SUCCESS);
+	TEST_EQ_S(memcmp(digest, expect, sizeof(digest)), 0);
+
+	/* Same digest when the data arrives in uneven pieces */
+	TEST_EQ_S(bdb_sha256_init(&ctx), BDB_SUCCESS);
+	TEST_EQ_S(bdb_sha256_update(&ctx, buf, 1), BDB_SUCCESS);
+	TEST_EQ_S(bdb_sha256_update(&ctx, buf + 1, 0), BDB_SUCCESS);
+	TEST_EQ_S(bdb_sha256_update(&ctx, buf + 1, 63), BDB_SUCCESS);
+	TEST_EQ_S(bdb_sha256_update(&ctx, buf + 64, sizeof(buf) - 64),
+		  BDB_SUCCESS);
+	TEST_EQ_S(bdb_sha256_finalize(&ctx, digest), BDB_SUCCESS);
+	TEST_EQ_S(memcmp(digest, expect, sizeof(digest)), 0);
+}
+
+/* Mock partition and load buffers for bdb_load() */
+static uint8_t *mock_part;
+static size_t mock_part_size;
+static uint8_t *mock_dest[2];
+static int mock_read_fail;
+static int mock_pending[BDB_LOAD_MAX_CHANNELS];
+static int mock_max_pending;
+
+static int mock_read(void *ctx, int partition, uint64_t offset, void *buf,
+		     uint32_t size)
+{
+	if (partition != 1 || offset + size > mock_part_size)
+		return 1;
+	if (mock_read_fail && --mock_read_fail == 0)
+		return 1;
+
+	memcpy(buf, mock_part + offset, size);
+	return 0;
+}
+
+static int mock_read_start(void *ctx, int channel, int partition,
+			   uint64_t offset, void *buf, uint32_t size)
+{
+	int i, n = 0;
+
+	if (mock_pending[channel])
+		return 1;
+	if (mock_read(ctx, partition, offset, buf, size))
+		return 1;
+
+	mock_pending[channel] = 1;
+	for (i = 0; i < BDB_LOAD_MAX_CHANNELS; i++)
+		n += mock_pending[i];
+	if (n > mock_max_pending)
+		mock_max_pending = n;
+	return 0;
+}
+
+static int mock_read_wait(void *ctx, int channel)
+{
+	if (!mock_pending[channel])
+		return 1;
+
+	mock_pending[channel] = 0;
+	return 0;
+}
+
+static void *mock_get_dest(void *ctx, const struct bdb_hash *hash)
+{
+	switch (hash->type) {
+	case BDB_DATA_SP_RW:
+		return mock_dest[0];
+	case BDB_DATA_AP_RW:
+		return mock_dest[1];
+	default:
+		return NULL;
+	}
+}
+
+static void check_bdb_load(const struct bdb_header *hgood, size_t hsize)
+{
+	struct bdb_load_ops ops = {
+		.read = mock_read,
+		.get_dest = mock_get_dest,
+	};
+	struct bdb_header *h = calloc(hsize, 1);
+	struct bdb_hash *hash;
+	size_t i;
+	int j;
+
+	/* Partition data, and BDB hashes which match it */
+	mock_part_size = 0x48000;
+	mock_part = malloc(mock_part_size);
+	for (i = 0; i < mock_part_size; i++)
+		mock_part[i] = i * 7 + (i >> 9);
+
+	memcpy(h, hgood, hsize);
+	for (j = 0; j < 2; j++) {
+		hash = (struct bdb_hash *)bdb_get_hash_by_index(h, j);
+		mock_dest[j] = calloc(hash->size, 1);
+		vb2_digest_buffer(mock_part + hash->offset, hash->size,
+				  VB2_HASH_SHA256,
+				  hash->digest, BDB_SHA256_DIGEST_SIZE);
+	}
+
+	/* Synchronous reads */
+	TEST_EQ_S(bdb_load(h, &ops), BDB_SUCCESS);
+	for (j = 0; j < 2; j++) {
+		hash = (struct bdb_hash *)bdb_get_hash_by_index(h, j);
+		TEST_EQ_S(memcmp(mock_dest[j], mock_part + hash->offset,
+				 hash->size), 0);
+	}
+
+	/* Entries load at the same time with several channels */
+	ops.read_start = mock_read_start;
+	ops.read_wait = mock_read_wait;
+	ops.channels = BDB_LOAD_MAX_CHANNELS + 1;
+	memset(mock_dest[1], 0, bdb_get_hash_by_index(h, 1)->size);
+	mock_max_pending = 0;
+	TEST_EQ_S(bdb_load(h, &ops), BDB_SUCCESS);
+	TEST_EQ_S(mock_max_pending, 2);
+	hash = (struct bdb_hash *)bdb_get_hash_by_index(h, 1);
+	TEST_EQ_S(memcmp(mock_dest[1], mock_part + hash->offset, hash->size),
+		  0);
+
+	/* One channel still overlaps reads with hashing */
+	ops.channels = 1;
+	mock_max_pending = 0;
+	TEST_EQ_S(bdb_load(h, &ops), BDB_SUCCESS);
+	TEST_EQ_S(mock_max_pending, 1);
+
+	/* Errors leave no reads outstanding */
+	ops.channels = 2;
+	mock_read_fail = 3;
+	TEST_EQ_S(bdb_load(h, &ops), BDB_ERROR_LOAD_READ);
+	TEST_EQ_S(mock_pending[0] + mock_pending[1], 0);
+	mock_read_fail = 0;
+
+	mock_part[hash->offset + hash->size - 1] ^= 0x42;
+	TEST_EQ_S(bdb_load(h, &ops), BDB_ERROR_LOAD_DIGEST);
+	TEST_EQ_S(mock_pending[0] + mock_pending[1], 0);
+	mock_part[hash->offset + hash->size - 1] ^= 0x42;
+
+	hash->type = BDB_DATA_MCU;
+	TEST_EQ_S(bdb_load(h, &ops), BDB_ERROR_LOAD_ADDRESS);
+	TEST_EQ_S(mock_pending[0] + mock_pending[1], 0);
+
+	free(mock_part);
+	free(mock_dest[0]);
+	free(mock_dest[1]);
+	free(h);
+}
+
 void check_bdb_verify(const char *key_dir)
 {
 	uint8_t oem_area_0[32] = "Some OEM area.";
@@ -473,6 +633,9 @@ void check_bdb_verify(const char *key_dir)
 	 * oem_area_1_size can't cause wraparound.
 	 */
 
+	/* Load the data the hash entries describe */
+	check_bdb_load(hgood, hsize);
+
 	/* Free keys and buffers */
 	free(p.bdbkey);
 	free(p.datakey);
@@ -496,6 +659,7 @@ int main(int argc, char *argv[])
 	check_key_tests();
 	check_sig_tests();
 	check_data_tests();
+	check_sha256_tests();
 	check_bdb_verify(argv[1]);
 
 	printf("All tests passed!\n");
@@ -183,6 +183,48 @@ class TestReuse(TempDirTestCase):
     self.assertEqual(0, rc)
 
 
+class TestDuplicates(TempDirTestCase):
+
+  def testStoredOnce(self):
+    """Images with the same contents should only be stored once"""
+    foo = os.path.join(self.tempdir, 'FOO')
+    bar = os.path.join(self.tempdir, 'BAR')
+    rc, out, err = runprog(prog, '-z', '2', '-c', 'case_dup.yaml', foo)
+    self.assertEqual(0, rc)
+    rc, out, err = runprog(prog, foo)
+    self.assertEqual(0, rc)
+    self.assertTrue('  2 discrete images' in out)
+    rc, out, err = runprog(prog, '-x', '-d', self.tempdir, foo)
+    self.assertEqual(0, rc)
+    os.chdir(self.tempdir)
+    rc, out, err = runprog(prog, '-c', 'config.yaml', bar)
+    self.assertEqual(0, rc)
+    rc, out, err = runprog('/usr/bin/cmp', foo, bar)
+    self.assertEqual(0, rc)
+
+  def testCache(self):
+    """A compression cache shouldn't change the output"""
+    foo = os.path.join(self.tempdir, 'FOO')
+    bar = os.path.join(self.tempdir, 'BAR')
+    baz = os.path.join(self.tempdir, 'BAZ')
+    cache = os.path.join(self.tempdir, 'cache')
+    os.mkdir(cache)
+    rc, out, err = runprog(prog, '-z', '1', '-c', 'case_dup.yaml', foo)
+    self.assertEqual(0, rc)
+    rc, out, err = runprog(prog, '-z', '1', '-C', cache,
+                           '-c', 'case_dup.yaml', bar)
+    self.assertEqual(0, rc)
+    self.assertEqual(2, len(os.listdir(cache)))
+    rc, out, err = runprog(prog, '-z', '1', '-C', cache, '-D',
+                           '-c', 'case_dup.yaml', baz)
+    self.assertEqual(0, rc)
+    self.assertEqual(2, out.count('using cached'))
+    rc, out, err = runprog('/usr/bin/cmp', foo, bar)
+    self.assertEqual(0, rc)
+    rc, out, err = runprog('/usr/bin/cmp', foo, baz)
+    self.assertEqual(0, rc)
+
+
 # Run these tests
 if __name__ == '__main__':
   varname = 'BMPBLK'
@@ -0,0 +1,613 @@
+/* Copyright 2018 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ *
+ * Boot path simulator: runs LoadKernel() against a disk image through a
+ * model of the boot storage, and prints a timeline of where the time went.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "2sysincludes.h"
+#include "2api.h"
+#include "2misc.h"
+#include "2nvstorage.h"
+#include "host_common.h"
+#include "timer_utils.h"
+#include "util_misc.h"
+#include "vboot_common.h"
+#include "vboot_api.h"
+#include "vboot_kernel.h"
+
+#define LBA_BYTES 512
+
+/* Timing of a boot storage device */
+struct storage_profile {
+	const char *name;
+	/* Fixed cost of each command, in microseconds */
+	uint32_t latency_us;
+	/* Transfer rate in Mbytes/sec, or 0 for no transfer cost */
+	uint32_t mbytes_per_sec;
+	/* Largest transfer a single command can make, or 0 for no limit */
+	uint32_t max_xfer_kbytes;
+};
+
+static const struct storage_profile profiles[] = {
+	{"ideal", 0,    0,    0},
+	{"spi",   10,   25,   0},
+	{"emmc",  150,  150,  512},
+	{"usb",   1000, 25,   64},
+	{"nvme",  20,   1000, 128},
+};
+
+/* Parts of the boot path each event is charged to */
+enum sim_phase {
+	PHASE_GPT,	/* Reading, parsing and updating the GPT */
+	PHASE_VBLOCK,	/* Reading and verifying keyblock and preamble */
+	PHASE_BODY,	/* Reading and verifying the kernel body */
+	PHASE_COUNT
+};
+
+static const char *const phase_names[PHASE_COUNT] = {
+	"gpt",
+	"vblock",
+	"body",
+};
+
+enum sim_kind {
+	EVENT_CPU,
+	EVENT_READ,
+	EVENT_WRITE,
+	EVENT_READ_ASYNC,
+	EVENT_WAIT,
+};
+
+static const char *const kind_names[] = {
+	"cpu",
+	"read",
+	"write",
+	"async",
+	"wait",
+};
+
+struct sim_event {
+	enum sim_kind kind;
+	enum sim_phase phase;
+	uint64_t start_ns;
+	uint64_t duration_ns;
+	uint64_t lba;
+	uint64_t lba_count;
+	uint32_t commands;
+};
+
+struct sim_stream {
+	uint64_t sector;
+	uint64_t sectors_left;
+	uint32_t reads;
+	/* Simulated time the outstanding async read completes, if any */
+	uint64_t async_done_ns;
+	int async_pending;
+};
+
+/* Simulator state */
+static struct storage_profile storage;
+static double cpu_scale = 1.0;
+static int disk_fd = -1;
+static uint64_t disk_lba_count;
+
+/* Simulated time, and when the device finishes its current command */
+static uint64_t sim_now_ns;
+static uint64_t device_free_ns;
+static enum sim_phase cur_phase;
+/* Host time when the code under test last got control back */
+static uint64_t last_real_ns;
+
+static struct sim_event *events;
+static size_t event_count;
+static size_t event_alloc;
+static int recording;
+
+static void add_event(enum sim_kind kind, uint64_t start_ns,
+		      uint64_t duration_ns, uint64_t lba, uint64_t lba_count,
+		      uint32_t commands)
+{
+	struct sim_event *e;
+
+	if (!recording)
+		return;
+
+	if (event_count == event_alloc) {
+		event_alloc = event_alloc ? event_alloc * 2 : 256;
+		events = realloc(events, event_alloc * sizeof(*events));
+		if (!events) {
+			fprintf(stderr, "Can't allocate timeline\n");
+			exit(1);
+		}
+	}
+
+	e = &events[event_count++];
+	e->kind = kind;
+	e->phase = cur_phase;
+	e->start_ns = start_ns;
+	e->duration_ns = duration_ns;
+	e->lba = lba;
+	e->lba_count = lba_count;
+	e->commands = commands;
+}
+
+/*
+ * Charge the host CPU time used since the code under test last called out to
+ * storage, scaled to the target CPU, to the current phase.
+ */
+static void sim_cpu(void)
+{
+	uint64_t ns = (GetTimeNsecs() - last_real_ns) * cpu_scale;
+
+	if (ns)
+		add_event(EVENT_CPU, sim_now_ns, ns, 0, 0, 0);
+	sim_now_ns += ns;
+}
+
+/* Hand control back to the code under test. */
+static void sim_resume(void)
+{
+	last_real_ns = GetTimeNsecs();
+}
+
+/* Return how many commands a transfer takes */
+static uint32_t xfer_commands(uint64_t lba_count)
+{
+	uint64_t max_lbas = storage.max_xfer_kbytes * 1024ULL / LBA_BYTES;
+
+	if (!max_lbas)
+		return 1;
+	return (lba_count + max_lbas - 1) / max_lbas;
+}
+
+/* Return how long the device takes to transfer lba_count sectors */
+static uint64_t xfer_ns(uint64_t lba_count)
+{
+	uint64_t ns = xfer_commands(lba_count) * storage.latency_us * 1000ULL;
+
+	if (storage.mbytes_per_sec)
+		ns += lba_count * LBA_BYTES * 1000ULL / storage.mbytes_per_sec;
+	return ns;
+}
+
+/* Start a transfer on the device, and return when it completes. */
+static uint64_t device_start(enum sim_kind kind, uint64_t lba,
+			     uint64_t lba_count)
+{
+	uint64_t start = sim_now_ns > device_free_ns ?
+		sim_now_ns : device_free_ns;
+	uint64_t ns = xfer_ns(lba_count);
+
+	add_event(kind, start, ns, lba, lba_count, xfer_commands(lba_count));
+	device_free_ns = start + ns;
+	return device_free_ns;
+}
+
+/* Wait for the device to reach done_ns, charging any stall as a wait. */
+static void device_wait(enum sim_kind kind, uint64_t done_ns)
+{
+	if (done_ns <= sim_now_ns)
+		return;
+	if (kind == EVENT_WAIT)
+		add_event(kind, sim_now_ns, done_ns - sim_now_ns, 0, 0, 0);
+	sim_now_ns = done_ns;
+}
+
+static int disk_read(uint64_t lba_start, uint64_t lba_count, void *buffer)
+{
+	if (lba_start >= disk_lba_count ||
+	    lba_start + lba_count > disk_lba_count)
+		return 1;
+
+	if (pread(disk_fd, buffer, lba_count * LBA_BYTES,
+		  lba_start * LBA_BYTES) != lba_count * LBA_BYTES) {
+		fprintf(stderr, "Read error: %s\n", strerror(errno));
+		return 1;
+	}
+	return 0;
+}
+
+VbError_t VbExDiskRead(VbExDiskHandle_t handle, uint64_t lba_start,
+		       uint64_t lba_count, void *buffer)
+{
+	int rv;
+
+	sim_cpu();
+	cur_phase = PHASE_GPT;
+	device_wait(EVENT_READ,
+		    device_start(EVENT_READ, lba_start, lba_count));
+	rv = disk_read(lba_start, lba_count, buffer);
+	sim_resume();
+
+	return rv ? VBERROR_UNKNOWN : VBERROR_SUCCESS;
+}
+
+VbError_t VbExDiskWrite(VbExDiskHandle_t handle, uint64_t lba_start,
+			uint64_t lba_count, const void *buffer)
+{
+	sim_cpu();
+	cur_phase = PHASE_GPT;
+	if (lba_start >= disk_lba_count ||
+	    lba_start + lba_count > disk_lba_count) {
+		sim_resume();
+		return VBERROR_UNKNOWN;
+	}
+
+	/* Account for the write, but leave the image alone for the next run */
+	device_wait(EVENT_WRITE,
+		    device_start(EVENT_WRITE, lba_start, lba_count));
+	sim_resume();
+
+	return VBERROR_SUCCESS;
+}
+
+VbError_t VbExStreamOpen(VbExDiskHandle_t handle, uint64_t lba_start,
+			 uint64_t lba_count, VbExStream_t *stream)
+{
+	struct sim_stream *s;
+
+	s = calloc(1, sizeof(*s));
+	if (!s) {
+		*stream = NULL;
+		return VBERROR_UNKNOWN;
+	}
+	s->sector = lba_start;
+	s->sectors_left = lba_count;
+
+	*stream = (void *)s;
+	return VBERROR_SUCCESS;
+}
+
+/* Start a stream read on the device; returns 0 if ok. */
+static int stream_start(struct sim_stream *s, uint32_t bytes, void *buffer,
+			enum sim_kind kind, uint64_t *done_ns)
+{
+	uint64_t sectors;
+
+	if (bytes % LBA_BYTES)
+		return 1;
+	sectors = bytes / LBA_BYTES;
+	if (sectors > s->sectors_left)
+		return 1;
+
+	/* The first read of a partition fetches its keyblock and preamble */
+	cur_phase = s->reads++ ? PHASE_BODY : PHASE_VBLOCK;
+	*done_ns = device_start(kind, s->sector, sectors);
+	if (disk_read(s->sector, sectors, buffer))
+		return 1;
+
+	s->sector += sectors;
+	s->sectors_left -= sectors;
+	return 0;
+}
+
+VbError_t VbExStreamRead(VbExStream_t stream, uint32_t bytes, void *buffer)
+{
+	struct sim_stream *s = (struct sim_stream *)stream;
+	uint64_t done_ns;
+	int rv;
+
+	if (!s)
+		return VBERROR_UNKNOWN;
+
+	sim_cpu();
+	rv = stream_start(s, bytes, buffer, EVENT_READ, &done_ns);
+	if (!rv)
+		device_wait(EVENT_READ, done_ns);
+	sim_resume();
+
+	return rv ? VBERROR_UNKNOWN : VBERROR_SUCCESS;
+}
+
+VbError_t VbExStreamReadAsync(VbExStream_t stream, uint32_t bytes,
+			      void *buffer)
+{
+	struct sim_stream *s = (struct sim_stream *)stream;
+	int rv;
+
+	if (!s || s->async_pending)
+		return VBERROR_UNKNOWN;
+
+	sim_cpu();
+	rv = stream_start(s, bytes, buffer, EVENT_READ_ASYNC,
+			  &s->async_done_ns);
+	s->async_pending = !rv;
+	sim_resume();
+
+	return rv ? VBERROR_UNKNOWN : VBERROR_SUCCESS;
+}
+
+VbError_t VbExStreamWait(VbExStream_t stream)
+{
+	struct sim_stream *s = (struct sim_stream *)stream;
+
+	if (!s)
+		return VBERROR_UNKNOWN;
+	if (!s->async_pending)
+		return VBERROR_SUCCESS;
+
+	sim_cpu();
+	device_wait(EVENT_WAIT, s->async_done_ns);
+	s->async_pending = 0;
+	sim_resume();
+
+	return VBERROR_SUCCESS;
+}
+
+void VbExStreamClose(VbExStream_t stream)
+{
+	free(stream);
+}
+
+/* Run LoadKernel() once, returning its result and the simulated time. */
+static VbError_t run_once(VbPublicKey *kernkey, LoadKernelParams *params,
+			  uint8_t *workbuf, uint64_t *total_ns)
+{
+	static uint8_t shared_data[VB_SHARED_DATA_MIN_SIZE];
+	VbSharedDataHeader *shared = (VbSharedDataHeader *)shared_data;
+	struct vb2_context ctx;
+	VbError_t rv;
+
+	*total_ns = 0;
+	VbSharedDataInit(shared, sizeof(shared_data));
+	VbSharedDataSetKernelKey(shared, kernkey);
+
+	memset(&ctx, 0, sizeof(ctx));
+	ctx.workbuf = workbuf;
+	ctx.workbuf_size = VB2_KERNEL_WORKBUF_RECOMMENDED_SIZE;
+	if (VB2_SUCCESS != vb2_init_context(&ctx)) {
+		fprintf(stderr, "Can't init context\n");
+		return VBERROR_UNKNOWN;
+	}
+	vb2_get_sd(&ctx)->vbsd = shared;
+	vb2_nv_init(&ctx);
+
+	sim_now_ns = device_free_ns = 0;
+	cur_phase = PHASE_GPT;
+	sim_resume();
+	rv = LoadKernel(&ctx, params);
+	sim_cpu();
+
+	*total_ns = sim_now_ns > device_free_ns ? sim_now_ns : device_free_ns;
+	return rv;
+}
+
+static void print_timeline(void)
+{
+	const struct sim_event *e;
+	uint64_t cpu_ns[PHASE_COUNT] = {0};
+	uint64_t io_ns[PHASE_COUNT] = {0};
+	uint64_t io_bytes[PHASE_COUNT] = {0};
+	size_t i;
+
+	printf("%12s %12s  %-7s %-6s\n", "start(us)", "time(us)", "phase",
+	       "event");
+	for (i = 0; i < event_count; i++) {
+		e = &events[i];
+		printf("%12.1f %12.1f  %-7s %-6s", e->start_ns / 1e3,
+		       e->duration_ns / 1e3, phase_names[e->phase],
+		       kind_names[e->kind]);
+		if (e->lba_count)
+			printf(" lba %" PRIu64 "+%" PRIu64 " (%u command%s)",
+			       e->lba, e->lba_count, e->commands,
+			       e->commands == 1 ? "" : "s");
+		printf("\n");
+
+		switch (e->kind) {
+		case EVENT_CPU:
+			cpu_ns[e->phase] += e->duration_ns;
+			break;
+		case EVENT_READ_ASYNC:
+			/* Only the time spent waiting for it counts */
+			io_bytes[e->phase] += e->lba_count * LBA_BYTES;
+			break;
+		case EVENT_READ:
+		case EVENT_WRITE:
+			io_bytes[e->phase] += e->lba_count * LBA_BYTES;
+			/* Fall through */
+		case EVENT_WAIT:
+			io_ns[e->phase] += e->duration_ns;
+			break;
+		}
+	}
+
+	printf("\n%-7s %12s %12s %12s\n", "phase", "cpu(us)", "io wait(us)",
+	       "bytes");
+	for (i = 0; i < PHASE_COUNT; i++)
+		printf("%-7s %12.1f %12.1f %12" PRIu64 "\n", phase_names[i],
+		       cpu_ns[i] / 1e3, io_ns[i] / 1e3, io_bytes[i]);
+}
+
+static void print_help(const char *progname)
+{
+	int i;
+
+	printf("\nUsage: %s [OPTIONS] <disk_image> <kernel.vbpubk>\n\n"
+	       "Run LoadKernel() against a disk image through a model of the\n"
+	       "boot storage, and print a timeline of the boot path.\n\n"
+	       "Options:\n"
+	       "  -p, --profile NAME     Storage profile (default emmc):\n",
+	       progname);
+	for (i = 0; i < ARRAY_SIZE(profiles); i++)
+		printf("                           %-6s %5u us/command, "
+		       "%4u MB/s, %u KB max/command\n", profiles[i].name,
+		       profiles[i].latency_us, profiles[i].mbytes_per_sec,
+		       profiles[i].max_xfer_kbytes);
+	printf("  -l, --latency USEC     Override the per-command latency\n"
+	       "  -B, --bandwidth MBPS   Override the transfer rate"
+	       " (0 = unlimited)\n"
+	       "  -x, --max-xfer KB      Override the largest transfer per"
+	       " command (0 = unlimited)\n"
+	       "  -c, --cpu-scale N      Multiply host CPU time by N to model"
+	       " a slower CPU\n"
+	       "  -n, --runs N           Run N times and report the fastest"
+	       " and mean (default 1)\n"
+	       "\n"
+	       "CPU time is measured on the host while the boot path runs;"
+	       " storage time\n"
+	       "comes from the profile.  Async reads overlap the CPU work"
+	       " that follows\n"
+	       "them, and only the time spent waiting for them is charged.\n"
+	       "\n");
+}
+
+static const struct option long_opts[] = {
+	{"profile",   1, 0, 'p'},
+	{"latency",   1, 0, 'l'},
+	{"bandwidth", 1, 0, 'B'},
+	{"max-xfer",  1, 0, 'x'},
+	{"cpu-scale", 1, 0, 'c'},
+	{"runs",      1, 0, 'n'},
+	{"help",      0, 0, 'h'},
+	{NULL, 0, 0, 0}
+};
+
+static int parse_u32(const char *str, uint32_t *val)
+{
+	char *e;
+
+	*val = strtoul(str, &e, 0);
+	return !*str || (e && *e);
+}
+
+int main(int argc, char *argv[])
+{
+	LoadKernelParams params;
+	VbPublicKey *kernkey;
+	uint8_t *workbuf;
+	uint64_t total_ns, best_ns = 0, sum_ns = 0;
+	uint32_t runs = 1;
+	char *e;
+	int errorcnt = 0;
+	int rv = 0;
+	int i;
+
+	storage = profiles[2];
+
+	opterr = 0;
+	while ((i = getopt_long(argc, argv, ":p:l:B:x:c:n:h", long_opts,
+				NULL)) != -1) {
+		switch (i) {
+		case 'p':
+			for (i = 0; i < ARRAY_SIZE(profiles); i++)
+				if (!strcmp(optarg, profiles[i].name))
+					break;
+			if (i == ARRAY_SIZE(profiles)) {
+				fprintf(stderr, "Unknown profile \"%s\"\n",
+					optarg);
+				errorcnt++;
+				break;
+			}
+			storage = profiles[i];
+			break;
+		case 'l':
+			errorcnt += parse_u32(optarg, &storage.latency_us);
+			break;
+		case 'B':
+			errorcnt += parse_u32(optarg, &storage.mbytes_per_sec);
+			break;
+		case 'x':
+			errorcnt += parse_u32(optarg,
+					      &storage.max_xfer_kbytes);
+			break;
+		case 'c':
+			cpu_scale = strtod(optarg, &e);
+			if (!*optarg || (e && *e) || cpu_scale <= 0)
+				errorcnt++;
+			break;
+		case 'n':
+			if (parse_u32(optarg, &runs) || !runs)
+				errorcnt++;
+			break;
+		case 'h':
+			print_help(argv[0]);
+			return 0;
+		case '?':
+			fprintf(stderr, "Unrecognized option\n");
+			errorcnt++;
+			break;
+		case ':':
+			fprintf(stderr, "Missing argument to -%c\n", optopt);
+			errorcnt++;
+			break;
+		}
+	}
+
+	if (errorcnt || argc - optind != 2) {
+		print_help(argv[0]);
+		return 1;
+	}
+
+	disk_fd = open(argv[optind], O_RDONLY);
+	if (disk_fd < 0) {
+		fprintf(stderr, "Can't open disk file %s\n", argv[optind]);
+		return 1;
+	}
+	disk_lba_count = lseek(disk_fd, 0, SEEK_END) / LBA_BYTES;
+
+	kernkey = (VbPublicKey *)vb2_read_packed_key(argv[optind + 1]);
+	if (!kernkey) {
+		fprintf(stderr, "Can't read key file %s\n", argv[optind + 1]);
+		return 1;
+	}
+
+	memset(&params, 0, sizeof(params));
+	params.disk_handle = (VbExDiskHandle_t)1;
+	params.bytes_per_lba = LBA_BYTES;
+	params.streaming_lba_count = disk_lba_count;
+	params.gpt_lba_count = disk_lba_count;
+	params.kernel_buffer_size = 16 * 1024 * 1024;
+	params.kernel_buffer = malloc(params.kernel_buffer_size);
+	workbuf = malloc(VB2_KERNEL_WORKBUF_RECOMMENDED_SIZE);
+	if (!params.kernel_buffer || !workbuf) {
+		fprintf(stderr, "Can't allocate buffers\n");
+		return 1;
+	}
+
+	printf("Profile: %s, %u us/command, %u MB/s, %u KB max/command, "
+	       "cpu x%.2f\n\n", storage.name, storage.latency_us,
+	       storage.mbytes_per_sec, storage.max_xfer_kbytes, cpu_scale);
+
+	/* Migrations would show up as CPU time */
+	PinToCpu(-1);
+
+	for (i = 0; i < runs; i++) {
+		/* Keep the timeline of the first run only */
+		recording = !i;
+		if (run_once(kernkey, &params, workbuf, &total_ns) !=
+		    VBERROR_SUCCESS)
+			rv = 1;
+		if (!i || total_ns < best_ns)
+			best_ns = total_ns;
+		sum_ns += total_ns;
+		if (!i)
+			print_timeline();
+	}
+
+	printf("\nLoadKernel() %s", rv ? "failed" : "succeeded");
+	if (!rv)
+		printf(", partition %u", params.partition_number);
+	printf("\nTotal: %.1f us", best_ns / 1e3);
+	if (runs > 1)
+		printf(" fastest, %.1f us mean over %u runs",
+		       sum_ns / 1e3 / runs, runs);
+	printf("\n");
+
+	free(events);
+	free(workbuf);
+	free(params.kernel_buffer);
+	free(kernkey);
+	close(disk_fd);
+	return rv;
+}
@@ -0,0 +1,69 @@
+/* Copyright 2018 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ *
+ * Fuzz target for GptInit(), which runs GptSanityCheck() on the headers and
+ * entries and then repairs and indexes them.
+ *
+ * The input is the primary header sector, the secondary header sector, the
+ * primary entries and the secondary entries, in that order.  Short inputs
+ * are padded with zeroes.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "2sysincludes.h"
+#include "cgptlib.h"
+#include "cgptlib_internal.h"
+#include "gpt.h"
+#include "gpt_misc.h"
+#include "fuzz_common.h"
+
+#define SECTOR_BYTES 512
+#define DRIVE_SECTORS 16384
+#define ENTRIES_BYTES (MAX_NUMBER_OF_ENTRIES * sizeof(GptEntry))
+
+/* Copy the next part of the input into a buffer of its own */
+static uint8_t *take(const uint8_t **data, size_t *size, size_t bytes)
+{
+	uint8_t *buf = calloc(bytes, 1);
+	size_t len = *size < bytes ? *size : bytes;
+
+	if (!buf)
+		abort();
+	memcpy(buf, *data, len);
+	*data += len;
+	*size -= len;
+	return buf;
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+	GptData gpt;
+	uint64_t start, count;
+	int i;
+
+	memset(&gpt, 0, sizeof(gpt));
+	gpt.sector_bytes = SECTOR_BYTES;
+	gpt.streaming_drive_sectors = DRIVE_SECTORS;
+	gpt.gpt_drive_sectors = DRIVE_SECTORS;
+	gpt.primary_header = take(&data, &size, SECTOR_BYTES);
+	gpt.secondary_header = take(&data, &size, SECTOR_BYTES);
+	gpt.primary_entries = take(&data, &size, ENTRIES_BYTES);
+	gpt.secondary_entries = take(&data, &size, ENTRIES_BYTES);
+
+	if (GPT_SUCCESS == GptInit(&gpt)) {
+		for (i = 0; i < MAX_NUMBER_OF_ENTRIES; i++)
+			if (GPT_SUCCESS !=
+			    GptNextKernelEntry(&gpt, &start, &count))
+				break;
+	}
+
+	free(gpt.primary_header);
+	free(gpt.secondary_header);
+	free(gpt.primary_entries);
+	free(gpt.secondary_entries);
+
+	return 0;
+}
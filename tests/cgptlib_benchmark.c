@@ -0,0 +1,190 @@
+/* Copyright 2018 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ *
+ * Measures the cost of parsing, verifying and updating a GPT.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__i386__) || defined(__x86_64__)
+#include <x86intrin.h>
+#define HAVE_TSC 1
+#endif
+
+#include "cgptlib.h"
+#include "cgptlib_internal.h"
+#include "cgptlib_test.h"
+#include "crc32.h"
+#include "gpt.h"
+#include "timer_utils.h"
+
+#define SECTOR_SIZE 512
+#define DRIVE_SECTORS 16384
+#define PARTITION_SECTORS 64
+#define TOTAL_ENTRIES_SIZE (MAX_NUMBER_OF_ENTRIES * sizeof(GptEntry))
+
+/* Run each operation repeatedly until at least this much time has passed */
+#define MIN_TEST_MSECS 200
+
+/* Run this many operations between checks of the timer */
+#define BATCH_OPS 64
+
+static uint8_t primary_header[SECTOR_SIZE];
+static uint8_t secondary_header[SECTOR_SIZE];
+static uint8_t primary_entries[TOTAL_ENTRIES_SIZE];
+static uint8_t secondary_entries[TOTAL_ENTRIES_SIZE];
+
+/*
+ * Build a good GPT with room for the usual 128 entries, the first
+ * 'num_kernels' of which are ChromeOS kernels with distinct GUIDs and a mix
+ * of priorities.
+ */
+static void BuildGptData(GptData *gpt, int num_kernels)
+{
+	Guid chromeos_kernel = GPT_ENT_TYPE_CHROMEOS_KERNEL;
+	GptHeader *h1 = (GptHeader *)primary_header;
+	GptHeader *h2 = (GptHeader *)secondary_header;
+	GptEntry *e = (GptEntry *)primary_entries;
+	int i;
+
+	memset(gpt, 0, sizeof(*gpt));
+	memset(primary_header, 0, sizeof(primary_header));
+	memset(primary_entries, 0, sizeof(primary_entries));
+	gpt->primary_header = primary_header;
+	gpt->secondary_header = secondary_header;
+	gpt->primary_entries = primary_entries;
+	gpt->secondary_entries = secondary_entries;
+	gpt->sector_bytes = SECTOR_SIZE;
+	gpt->streaming_drive_sectors = gpt->gpt_drive_sectors = DRIVE_SECTORS;
+
+	memcpy(h1->signature, GPT_HEADER_SIGNATURE, GPT_HEADER_SIGNATURE_SIZE);
+	h1->revision = GPT_HEADER_REVISION;
+	h1->size = sizeof(GptHeader);
+	h1->my_lba = 1;
+	h1->alternate_lba = DRIVE_SECTORS - 1;
+	h1->first_usable_lba = 34;
+	h1->last_usable_lba = DRIVE_SECTORS - 1 - 32 - 1;
+	h1->entries_lba = 2;
+	h1->number_of_entries = MAX_NUMBER_OF_ENTRIES;
+	h1->size_of_entry = sizeof(GptEntry);
+
+	for (i = 0; i < num_kernels; i++, e++) {
+		memcpy(&e->type, &chromeos_kernel, sizeof(chromeos_kernel));
+		memset(&e->unique, 0, sizeof(e->unique));
+		memcpy(&e->unique, &i, sizeof(i));
+		e->starting_lba = 34 + i * PARTITION_SECTORS;
+		e->ending_lba = e->starting_lba + PARTITION_SECTORS - 1;
+		SetEntryPriority(e, 1 + i % 15);
+		SetEntryTries(e, 15);
+	}
+
+	h1->entries_crc32 = Crc32(primary_entries, TOTAL_ENTRIES_SIZE);
+	h1->header_crc32 = HeaderCrc(h1);
+
+	memcpy(h2, h1, sizeof(GptHeader));
+	memcpy(secondary_entries, primary_entries, TOTAL_ENTRIES_SIZE);
+	h2->my_lba = DRIVE_SECTORS - 1;
+	h2->alternate_lba = 1;
+	h2->entries_lba = DRIVE_SECTORS - 1 - 32;
+	h2->header_crc32 = HeaderCrc(h2);
+}
+
+static void OpGptInit(GptData *gpt, int i)
+{
+	GptInit(gpt);
+}
+
+static void OpGptSanityCheck(GptData *gpt, int i)
+{
+	GptSanityCheck(gpt);
+}
+
+static void OpCheckEntries(GptData *gpt, int i)
+{
+	CheckEntries((GptEntry *)gpt->primary_entries,
+		     (GptHeader *)gpt->primary_header);
+}
+
+static void OpGptNextKernelEntry(GptData *gpt, int i)
+{
+	uint64_t start, size;
+
+	gpt->current_kernel = CGPT_KERNEL_ENTRY_NOT_FOUND;
+	GptNextKernelEntry(gpt, &start, &size);
+}
+
+static void OpGptUpdateKernelEntry(GptData *gpt, int i)
+{
+	/* Alternate so that every call changes the entry. */
+	GptUpdateKernelEntry(gpt, (i & 1) ? GPT_UPDATE_ENTRY_INVALID :
+			     GPT_UPDATE_ENTRY_ACTIVE);
+}
+
+static const struct {
+	const char *name;
+	void (*op)(GptData *gpt, int i);
+} ops[] = {
+	{"GptInit", OpGptInit},
+	{"GptSanityCheck", OpGptSanityCheck},
+	{"CheckEntries", OpCheckEntries},
+	{"GptNextKernelEntry", OpGptNextKernelEntry},
+	{"GptUpdateKernelEntry", OpGptUpdateKernelEntry},
+};
+
+static const int num_kernels[] = {4, 32, 128};
+
+int main(int argc, char *argv[])
+{
+	GptData gpt;
+	ClockTimerState ct;
+	uint64_t passes;
+	double nsecs;
+	int i, j, k;
+
+	for (i = 0; i < ARRAY_SIZE(num_kernels); i++) {
+		for (j = 0; j < ARRAY_SIZE(ops); j++) {
+#ifdef HAVE_TSC
+			uint64_t tsc_start;
+#endif
+
+			BuildGptData(&gpt, num_kernels[i]);
+			if (GPT_SUCCESS != GptInit(&gpt)) {
+				fprintf(stderr, "# Bad test GPT\n");
+				return 1;
+			}
+			if (ops[j].op == OpGptUpdateKernelEntry) {
+				uint64_t start, size;
+				GptNextKernelEntry(&gpt, &start, &size);
+			}
+
+			passes = 0;
+			StartTimer(&ct);
+#ifdef HAVE_TSC
+			tsc_start = __rdtsc();
+#endif
+			do {
+				for (k = 0; k < BATCH_OPS; k++)
+					ops[j].op(&gpt, k);
+				passes += BATCH_OPS;
+				StopTimer(&ct);
+			} while (GetDurationMsecs(&ct) < MIN_TEST_MSECS);
+
+			nsecs = (double)GetDurationNsecs(&ct) / passes;
+			fprintf(stderr, "# %s with %d kernels: %f ns/op\n",
+				ops[j].name, num_kernels[i], nsecs);
+			fprintf(stdout, "ns_per_op_%s_%d:%f\n",
+				ops[j].name, num_kernels[i], nsecs);
+#ifdef HAVE_TSC
+			fprintf(stdout, "cycles_per_op_%s_%d:%f\n",
+				ops[j].name, num_kernels[i],
+				(double)(__rdtsc() - tsc_start) / passes);
+#endif
+		}
+	}
+
+	return 0;
+}
@@ -863,6 +863,62 @@ static int OverlappedPartitionTest(void) {
 	return TEST_OK;
 }
 
+/* Test checking a full table, whose entries are checked by sorting them. */
+static int FullTableEntriesTest(void)
+{
+	GptData *gpt = GetEmptyGptData();
+	GptHeader *h = (GptHeader *)gpt->primary_header;
+	GptEntry *e = (GptEntry *)gpt->primary_entries;
+	GptEntry *e2 = (GptEntry *)gpt->secondary_entries;
+	int i;
+
+	/* One sector each, in reverse order */
+	BuildTestGptData(gpt);
+	ZeroEntries(gpt);
+	for (i = 0; i < h->number_of_entries; i++) {
+		memcpy(&e[i].type, &guid_kernel, sizeof(Guid));
+		SetGuid(&e[i].unique, i);
+		e[i].starting_lba = e[i].ending_lba = 300 - i;
+	}
+	memcpy(e2, e, PARTITION_ENTRIES_SIZE);
+	RefreshCrc32(gpt);
+	EXPECT(0 == CheckEntries(e, h));
+	EXPECT(GPT_SUCCESS == GptSanityCheck(gpt));
+	EXPECT(MASK_BOTH == gpt->valid_entries);
+
+	/* The last entry covers the first */
+	e[127].ending_lba = e[0].ending_lba;
+	RefreshCrc32(gpt);
+	EXPECT(GPT_ERROR_START_LBA_OVERLAP == CheckEntries(e, h));
+	e[127].ending_lba = e[127].starting_lba;
+
+	/* Far apart duplicate GUIDs */
+	SetGuid(&e[120].unique, 5);
+	RefreshCrc32(gpt);
+	EXPECT(GPT_ERROR_DUP_GUID == CheckEntries(e, h));
+	SetGuid(&e[120].unique, 120);
+
+	/* Errors are reported in entry order, not in the order they're found */
+	e[100].ending_lba = e[100].starting_lba - 1;
+	e[3].ending_lba = e[2].ending_lba;
+	RefreshCrc32(gpt);
+	EXPECT(GPT_ERROR_START_LBA_OVERLAP == CheckEntries(e, h));
+	e[3].ending_lba = e[3].starting_lba;
+	e[111].ending_lba = e[110].ending_lba;
+	RefreshCrc32(gpt);
+	EXPECT(GPT_ERROR_OUT_OF_REGION == CheckEntries(e, h));
+
+	/* Secondary entries which differ from valid primary ones are checked */
+	ZeroEntries(gpt);
+	BuildTestGptData(gpt);
+	e2[1].ending_lba = e2[0].ending_lba;
+	RefreshCrc32(gpt);
+	EXPECT(GPT_SUCCESS == GptSanityCheck(gpt));
+	EXPECT(MASK_PRIMARY == gpt->valid_entries);
+
+	return TEST_OK;
+}
+
 /* Test both sanity checking and repair. */
 static int SanityCheckTest(void)
 {
@@ -1413,6 +1469,74 @@ static int GetNextTriesTest(void)
 	return TEST_OK;
 }
 
+static int GptKernelIndexTest(void)
+{
+	GptData *gpt = GetEmptyGptData();
+	GptEntry *e1 = (GptEntry *)(gpt->primary_entries);
+	uint64_t start, size;
+	int i;
+
+	/* GptInit() indexes the kernel entries */
+	BuildTestGptData(gpt);
+	EXPECT(GPT_SUCCESS == GptInit(gpt));
+	EXPECT(1 == gpt->kernels.valid);
+	EXPECT(2 == gpt->kernels.count);
+	EXPECT(0 == gpt->kernels.index[0]);
+	EXPECT(3 == gpt->kernels.index[1]);
+
+	/* ...with the attributes and extent of each */
+	BuildTestGptData(gpt);
+	FillEntry(e1 + KERNEL_A, 1, 4, 0, 3);
+	FillEntry(e1 + KERNEL_B, 1, 2, 1, 0);
+	RefreshCrc32(gpt);
+	EXPECT(GPT_SUCCESS == GptInit(gpt));
+	EXPECT(4 == gpt->kernels.priority[0]);
+	EXPECT(3 == gpt->kernels.tries[0]);
+	EXPECT(0 == gpt->kernels.successful[0]);
+	EXPECT(e1[KERNEL_A].starting_lba == gpt->kernels.start[0]);
+	EXPECT(e1[KERNEL_A].ending_lba - e1[KERNEL_A].starting_lba + 1 ==
+	       gpt->kernels.size[0]);
+	EXPECT(1 == gpt->kernels.successful[1]);
+	EXPECT(GPT_SUCCESS == GptNextKernelEntry(gpt, &start, &size));
+	EXPECT(KERNEL_A == gpt->current_kernel);
+	EXPECT(e1[KERNEL_A].starting_lba == start);
+	EXPECT(gpt->kernels.size[0] == size);
+
+	/* Updates keep the packed copy in step */
+	EXPECT(GPT_SUCCESS == GptUpdateKernelEntry(gpt, GPT_UPDATE_ENTRY_TRY));
+	EXPECT(2 == gpt->kernels.tries[0]);
+	EXPECT(GPT_SUCCESS == GptUpdateKernelEntry(gpt, GPT_UPDATE_ENTRY_BAD));
+	EXPECT(0 == gpt->kernels.priority[0]);
+	EXPECT(0 == gpt->kernels.tries[0]);
+	gpt->current_kernel = CGPT_KERNEL_ENTRY_NOT_FOUND;
+	gpt->current_priority = 999;
+	EXPECT(GPT_SUCCESS == GptNextKernelEntry(gpt, &start, &size));
+	EXPECT(KERNEL_B == gpt->current_kernel);
+
+	/* Too many kernels to index falls back to scanning every entry */
+	BuildTestGptData(gpt);
+	for (i = 0; i <= GPT_MAX_KERNEL_ENTRIES; i++) {
+		FillEntry(e1 + i, 1, 1, 1, 0);
+		SetGuid(&e1[i].unique, i);
+		e1[i].starting_lba = 34 + i * 10;
+		e1[i].ending_lba = 34 + i * 10 + 9;
+	}
+	SetEntryPriority(e1 + GPT_MAX_KERNEL_ENTRIES, 5);
+	memcpy(gpt->secondary_entries, gpt->primary_entries,
+	       PARTITION_ENTRIES_SIZE);
+	RefreshCrc32(gpt);
+	EXPECT(GPT_SUCCESS == GptInit(gpt));
+	EXPECT(0 == gpt->kernels.valid);
+	EXPECT(GPT_SUCCESS == GptNextKernelEntry(gpt, &start, &size));
+	EXPECT(GPT_MAX_KERNEL_ENTRIES == gpt->current_kernel);
+	EXPECT(GPT_SUCCESS == GptNextKernelEntry(gpt, &start, &size));
+	EXPECT(0 == gpt->current_kernel);
+	EXPECT(GPT_SUCCESS == GptNextKernelEntry(gpt, &start, &size));
+	EXPECT(1 == gpt->current_kernel);
+
+	return TEST_OK;
+}
+
 static int GptUpdateTest(void)
 {
 	GptData *gpt = GetEmptyGptData();
@@ -1533,6 +1657,107 @@ static int GptOverridePriorityTest(void)
 	return TEST_OK;
 }
 
+/*
+ * Updating an entry marks only the sector holding it as dirty, in both copies
+ * of the entries.
+ */
+static int GptUpdateDirtyTest(void)
+{
+	GptData *gpt = GetEmptyGptData();
+	GptEntry *e = (GptEntry *)(gpt->primary_entries);
+	int per_sector = DEFAULT_SECTOR_SIZE / sizeof(GptEntry);
+
+	BuildTestGptData(gpt);
+	FillEntry(e + KERNEL_A, 1, 4, 0, 2);
+	FillEntry(e + 2 * per_sector, 1, 3, 0, 2);
+	RefreshCrc32(gpt);
+	gpt->modified = 0;
+
+	EXPECT(GPT_SUCCESS == GptUpdateKernelWithEntry(gpt, e + 2 * per_sector,
+						       GPT_UPDATE_ENTRY_TRY));
+	EXPECT(0x0F == gpt->modified);
+	EXPECT(0x04 == gpt->dirty_entries1);
+	EXPECT(0x04 == gpt->dirty_entries2);
+
+	/* Further updates accumulate */
+	EXPECT(GPT_SUCCESS == GptUpdateKernelWithEntry(gpt, e + KERNEL_A,
+						       GPT_UPDATE_ENTRY_TRY));
+	EXPECT(0x05 == gpt->dirty_entries1);
+	EXPECT(0x05 == gpt->dirty_entries2);
+
+	/* A copy which was already wholly modified stays that way */
+	BuildTestGptData(gpt);
+	FillEntry(e + KERNEL_A, 1, 4, 0, 2);
+	RefreshCrc32(gpt);
+	gpt->modified = GPT_MODIFIED_ENTRIES2;
+	gpt->dirty_entries2 = 0;
+	EXPECT(GPT_SUCCESS == GptUpdateKernelWithEntry(gpt, e + KERNEL_A,
+						       GPT_UPDATE_ENTRY_TRY));
+	EXPECT(0x01 == gpt->dirty_entries1);
+	EXPECT(0 == gpt->dirty_entries2);
+
+	/* Entries past the tracked sectors dirty the whole array */
+	gpt->modified = 0;
+	gpt->dirty_entries1 = gpt->dirty_entries2 = 0x01;
+	GptEntryModified(gpt, (GptEntry *)(gpt->primary_entries +
+			 GPT_MAX_DIRTY_SECTORS * DEFAULT_SECTOR_SIZE));
+	EXPECT(0 == gpt->dirty_entries1);
+	EXPECT(0 == gpt->dirty_entries2);
+
+	return TEST_OK;
+}
+
+/* Test that updates patch the entries CRC instead of recomputing it. */
+static int GptUpdateCrcTest(void)
+{
+	GptData *gpt = GetEmptyGptData();
+	GptHeader *h = (GptHeader *)gpt->primary_header;
+	GptHeader *h2 = (GptHeader *)gpt->secondary_header;
+	GptEntry *e = (GptEntry *)(gpt->primary_entries);
+	uint32_t entries_size;
+	uint32_t crc;
+
+	BuildTestGptData(gpt);
+	FillEntry(e + KERNEL_A, 1, 4, 0, 2);
+	FillEntry(e + KERNEL_B, 1, 3, 0, 2);
+	memcpy(gpt->secondary_entries, gpt->primary_entries, TOTAL_ENTRIES_SIZE);
+	RefreshCrc32(gpt);
+	gpt->modified = 0;
+	entries_size = h->number_of_entries * h->size_of_entry;
+
+	EXPECT(GPT_SUCCESS == GptUpdateKernelWithEntry(gpt, e + KERNEL_A,
+						       GPT_UPDATE_ENTRY_TRY));
+	crc = Crc32(gpt->primary_entries, entries_size);
+	EXPECT(crc == h->entries_crc32);
+	EXPECT(crc == h2->entries_crc32);
+	EXPECT(0 == CheckHeader(h, 0, gpt->streaming_drive_sectors,
+				gpt->gpt_drive_sectors, 0, gpt->sector_bytes));
+	EXPECT(0 == CheckHeader(h2, 1, gpt->streaming_drive_sectors,
+				gpt->gpt_drive_sectors, 0, gpt->sector_bytes));
+
+	EXPECT(GPT_SUCCESS == GptUpdateKernelWithEntry(gpt, e + KERNEL_B,
+						       GPT_UPDATE_ENTRY_BAD));
+	EXPECT(Crc32(gpt->primary_entries, entries_size) == h->entries_crc32);
+	EXPECT(h->entries_crc32 == h2->entries_crc32);
+
+	/* Only the changed bytes are folded into the existing CRC */
+	h->entries_crc32 ^= 0x5a5a5a5a;
+	EXPECT(GPT_SUCCESS == GptUpdateKernelWithEntry(gpt, e + KERNEL_A,
+						       GPT_UPDATE_ENTRY_TRY));
+	EXPECT((Crc32(gpt->primary_entries, entries_size) ^ 0x5a5a5a5a) ==
+	       h->entries_crc32);
+
+	/* Without an in-sync secondary, the CRC is recomputed */
+	gpt->valid_entries = MASK_PRIMARY;
+	gpt->modified = 0;
+	h->entries_crc32 ^= 0x5a5a5a5a;
+	EXPECT(GPT_SUCCESS == GptUpdateKernelWithEntry(gpt, e + KERNEL_A,
+						       GPT_UPDATE_ENTRY_BAD));
+	EXPECT(Crc32(gpt->primary_entries, entries_size) == h->entries_crc32);
+
+	return TEST_OK;
+}
+
 /*
  * Give an invalid kernel type, and expect GptUpdateKernelEntry() returns
  * GPT_ERROR_INVALID_UPDATE_TYPE.
@@ -1732,6 +1957,7 @@ int main(int argc, char *argv[])
 		{ TEST_CASE(EntriesCrcTest), },
 		{ TEST_CASE(ValidEntryTest), },
 		{ TEST_CASE(OverlappedPartitionTest), },
+		{ TEST_CASE(FullTableEntriesTest), },
 		{ TEST_CASE(SanityCheckTest), },
 		{ TEST_CASE(NoValidKernelEntryTest), },
 		{ TEST_CASE(EntryAttributeGetSetTest), },
@@ -1739,11 +1965,16 @@ int main(int argc, char *argv[])
 		{ TEST_CASE(GetNextNormalTest), },
 		{ TEST_CASE(GetNextPrioTest), },
 		{ TEST_CASE(GetNextTriesTest), },
+		{ TEST_CASE(GptKernelIndexTest), },
 		{ TEST_CASE(GptUpdateTest), },
+		{ TEST_CASE(GptUpdateDirtyTest), },
+		{ TEST_CASE(GptUpdateCrcTest), },
 		{ TEST_CASE(GptOverridePriorityTest), },
 		{ TEST_CASE(UpdateInvalidKernelTypeTest), },
 		{ TEST_CASE(DuplicateUniqueGuidTest), },
 		{ TEST_CASE(TestCrc32TestVectors), },
+		{ TEST_CASE(TestCrc32MatchesReference), },
+		{ TEST_CASE(TestCrc32Patch), },
 		{ TEST_CASE(GetKernelGuidTest), },
 		{ TEST_CASE(ErrorTextTest), },
 		{ TEST_CASE(CheckHeaderOffDevice), },
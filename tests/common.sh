@@ -66,3 +66,59 @@ function check_test_keys {
     error 1 "You must run gen_test_keys.sh to generate test keys first."
 }
 
+
+# Cache of generated test keys and signed test data, shared by all build
+# directories.  An entry is stored under a hash of its name, the generating
+# script and its input files, so changing any of them regenerates it.  Put
+# the versions of the tools which made an entry in its name.  Set
+# VBOOT_TEST_CACHE to move the cache, or to "none" to disable it.
+TEST_CACHE_DIR="${VBOOT_TEST_CACHE:-${XDG_CACHE_HOME:-${HOME}/.cache}/vboot_reference/tests}"
+
+function openssl_version {
+  openssl version | cut -d' ' -f1-2
+}
+
+function futility_version {
+  "${FUTILITY}" version | cut -d' ' -f1
+}
+
+# args: <name> [input files...]
+function cache_key {
+  local name="$1"
+  shift
+  {
+    echo "${name}"
+    cat "$0" "${SCRIPT_DIR}/common.sh"
+    [ $# -eq 0 ] || cat "$@"
+  } | sha256sum | cut -d' ' -f1
+}
+
+# Copy the files of a cache entry into place.  Fails if any is missing.
+# args: <key> <output files...>
+function cache_restore {
+  local dir="${TEST_CACHE_DIR}/$1"
+  local f
+  shift
+  [ "${VBOOT_TEST_CACHE}" != "none" ] || return 1
+  for f in "$@"; do
+    [ -f "${dir}/$(basename "${f}")" ] || return 1
+  done
+  for f in "$@"; do
+    cp "${dir}/$(basename "${f}")" "${f}" || return 1
+  done
+}
+
+# Save files as a cache entry.  The cache is only an optimization, so
+# failing to write it is not an error.
+# args: <key> <output files...>
+function cache_store {
+  local dir="${TEST_CACHE_DIR}/$1"
+  local tmp="${dir}.tmp.$$"
+  shift
+  [ "${VBOOT_TEST_CACHE}" != "none" ] || return 0
+  [ ! -d "${dir}" ] || return 0
+  if mkdir -p "${tmp}" 2>/dev/null && cp "$@" "${tmp}/"; then
+    mv -T "${tmp}" "${dir}" 2>/dev/null || true
+  fi
+  rm -rf "${tmp}"
+}
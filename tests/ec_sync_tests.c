@@ -13,6 +13,7 @@
 #include "2common.h"
 #include "2misc.h"
 #include "2nvstorage.h"
+#include "2sha.h"
 #include "ec_sync.h"
 #include "gbb_header.h"
 #include "host_common.h"
@@ -41,6 +42,21 @@ static int ec_ro_updated;
 static int ec_rw_updated;
 static int get_expected_retval;
 static int shutdown_request_calls_left;
+static VbError_t hash_start_retval;
+static int hash_started[2];
+static int hashes_collected;
+static int hash_was_started;
+static int ro_hash_was_started;
+static uint8_t fake_image[64] = {5, 6, 7, 8};
+static uint8_t mock_ec_image[64];
+static int mock_block_size;
+static int mock_num_blocks;
+static int blocks_updated;
+static int block_update_offset;
+static VbError_t block_update_retval;
+static struct vb2_ec_image_hash mock_hash_struct;
+static int mock_hash_struct_size;
+static int get_expected_hash_calls;
 
 static uint8_t mock_ec_ro_hash[32];
 static uint8_t mock_ec_rw_hash[32];
@@ -90,6 +106,19 @@ static void ResetMocks(void)
 	run_retval = VBERROR_SUCCESS;
 	get_expected_retval = VBERROR_SUCCESS;
 	shutdown_request_calls_left = -1;
+	hash_start_retval = VBERROR_SUCCESS;
+	memset(hash_started, 0, sizeof(hash_started));
+	hashes_collected = 0;
+	hash_was_started = 0;
+	ro_hash_was_started = 0;
+	memcpy(mock_ec_image, fake_image, sizeof(mock_ec_image));
+	mock_block_size = 0;
+	mock_num_blocks = 0;
+	blocks_updated = 0;
+	block_update_offset = -1;
+	block_update_retval = VBERROR_SUCCESS;
+	mock_hash_struct_size = 0;
+	get_expected_hash_calls = 0;
 
 	memset(mock_ec_ro_hash, 0, sizeof(mock_ec_ro_hash));
 	mock_ec_ro_hash[0] = 42;
@@ -103,6 +132,14 @@ static void ResetMocks(void)
 	want_ec_hash[0] = 42;
 	want_ec_hash_size = sizeof(want_ec_hash);
 
+	memset(&mock_hash_struct, 0, sizeof(mock_hash_struct));
+	memcpy(mock_hash_struct.magic, VB2_EC_IMAGE_HASH_MAGIC,
+	       VB2_EC_IMAGE_HASH_MAGIC_SIZE);
+	mock_hash_struct.header_version_major = VB2_EC_IMAGE_HASH_VERSION_MAJOR;
+	mock_hash_struct.header_version_minor = VB2_EC_IMAGE_HASH_VERSION_MINOR;
+	mock_hash_struct.struct_size = sizeof(mock_hash_struct);
+	mock_hash_struct.digest[0] = 42;
+
 	update_hash = 42;
 
 	// TODO: ensure these are actually needed
@@ -161,9 +198,23 @@ VbError_t VbExEcJumpToRW(int devidx)
 	return run_retval;
 }
 
+VbError_t VbExEcHashImageStart(int devidx, enum VbSelectFirmware_t select)
+{
+	if (hash_start_retval == VBERROR_SUCCESS)
+		hash_started[select == VB_SELECT_FIRMWARE_READONLY] = 1;
+	return hash_start_retval;
+}
+
 VbError_t VbExEcHashImage(int devidx, enum VbSelectFirmware_t select,
 			  const uint8_t **hash, int *hash_size)
 {
+	/* Note whether the first hash collected was started in advance */
+	if (!hashes_collected++)
+		hash_was_started = hash_started[0];
+	if (select == VB_SELECT_FIRMWARE_READONLY)
+		ro_hash_was_started = hash_started[1];
+	hash_started[select == VB_SELECT_FIRMWARE_READONLY] = 0;
+
 	*hash = select == VB_SELECT_FIRMWARE_READONLY ?
 		mock_ec_ro_hash : mock_ec_rw_hash;
 	*hash_size = select == VB_SELECT_FIRMWARE_READONLY ?
@@ -174,7 +225,6 @@ VbError_t VbExEcHashImage(int devidx, enum VbSelectFirmware_t select,
 VbError_t VbExEcGetExpectedImage(int devidx, enum VbSelectFirmware_t select,
 				 const uint8_t **image, int *image_size)
 {
-	static uint8_t fake_image[64] = {5, 6, 7, 8};
 	*image = fake_image;
 	*image_size = sizeof(fake_image);
 	return get_expected_retval;
@@ -183,12 +233,25 @@ VbError_t VbExEcGetExpectedImage(int devidx, enum VbSelectFirmware_t select,
 VbError_t VbExEcGetExpectedImageHash(int devidx, enum VbSelectFirmware_t select,
 				     const uint8_t **hash, int *hash_size)
 {
+	get_expected_hash_calls++;
 	*hash = want_ec_hash;
 	*hash_size = want_ec_hash_size;
 
 	return want_ec_hash_size ? VBERROR_SUCCESS : VBERROR_SIMULATED;
 }
 
+VbError_t VbExEcGetExpectedImageHashStruct(int devidx,
+					   enum VbSelectFirmware_t select,
+					   const uint8_t **buf, int *size)
+{
+	if (!mock_hash_struct_size)
+		return VBERROR_UNKNOWN;
+
+	*buf = (const uint8_t *)&mock_hash_struct;
+	*size = mock_hash_struct_size;
+	return VBERROR_SUCCESS;
+}
+
 VbError_t VbExEcUpdateImage(int devidx, enum VbSelectFirmware_t select,
 			    const uint8_t *image, int image_size)
 {
@@ -202,6 +265,38 @@ VbError_t VbExEcUpdateImage(int devidx, enum VbSelectFirmware_t select,
 	return update_retval;
 }
 
+VbError_t VbExEcGetImageBlockHashes(int devidx, enum VbSelectFirmware_t select,
+				    int *block_size, const uint8_t **hashes,
+				    int *num_blocks)
+{
+	static uint8_t block_hashes[8 * VB2_SHA256_DIGEST_SIZE];
+	int i;
+
+	if (!mock_block_size)
+		return VBERROR_UNKNOWN;
+
+	for (i = 0; i < sizeof(mock_ec_image) / mock_block_size; i++)
+		vb2_digest_buffer(mock_ec_image + i * mock_block_size,
+				  mock_block_size, VB2_HASH_SHA256,
+				  block_hashes + i * VB2_SHA256_DIGEST_SIZE,
+				  VB2_SHA256_DIGEST_SIZE);
+
+	*block_size = mock_block_size;
+	*hashes = block_hashes;
+	*num_blocks = mock_num_blocks;
+	return VBERROR_SUCCESS;
+}
+
+VbError_t VbExEcUpdateImageBlock(int devidx, enum VbSelectFirmware_t select,
+				 int offset, const uint8_t *data, int size)
+{
+	blocks_updated++;
+	block_update_offset = offset;
+	memcpy(mock_ec_image + offset, data, size);
+	mock_ec_rw_hash[0] = update_hash;
+	return block_update_retval;
+}
+
 VbError_t VbDisplayScreen(struct vb2_context *ctx, uint32_t screen, int force)
 {
 	if (screens_count < ARRAY_SIZE(screens_displayed))
@@ -252,6 +347,60 @@ static void VbSoftwareSyncTest(void)
 	test_ssync(VBERROR_EC_REBOOT_TO_RO_REQUIRED,
 		   VB2_RECOVERY_EC_HASH_SIZE, "Bad EC hash size");
 
+	ResetMocks();
+	test_ssync(0, 0, "Hash started before it is collected");
+	TEST_EQ(hash_was_started, 1, "  active hash started");
+	TEST_EQ(hashes_collected, 1, "  one hash collected");
+
+	ResetMocks();
+	vb2_nv_set(&ctx, VB2_NV_TRY_RO_SYNC, 1);
+	test_ssync(0, 0, "RO hash started when trying RO sync");
+	TEST_EQ(hashes_collected, 2, "  two hashes collected");
+	TEST_EQ(ro_hash_was_started, 1, "  RO hash started");
+
+	ResetMocks();
+	hash_start_retval = VBERROR_SIMULATED;
+	test_ssync(0, 0, "Hash start failure isn't fatal");
+	TEST_EQ(hash_was_started, 0, "  hash not started");
+	TEST_EQ(hashes_collected, 1, "  hash still collected");
+
+	ResetMocks();
+	mock_hash_struct_size = sizeof(mock_hash_struct);
+	want_ec_hash_size = 0;
+	test_ssync(0, 0, "Precomputed hash struct");
+	TEST_EQ(get_expected_hash_calls, 0, "  expected hash not needed");
+	TEST_EQ(ec_rw_updated, 0, "  ec rw not updated");
+
+	ResetMocks();
+	mock_hash_struct_size = sizeof(mock_hash_struct);
+	mock_hash_struct.digest[0]++;
+	update_hash = mock_hash_struct.digest[0];
+	test_ssync(0, 0, "Precomputed hash struct mismatch");
+	TEST_EQ(ec_rw_updated, 1, "  ec rw updated");
+
+	ResetMocks();
+	mock_hash_struct_size = EXPECTED_VB2_EC_IMAGE_HASH_SIZE - 1;
+	test_ssync(VBERROR_EC_REBOOT_TO_RO_REQUIRED,
+		   VB2_RECOVERY_EC_EXPECTED_HASH, "Hash struct too small");
+
+	ResetMocks();
+	mock_hash_struct_size = sizeof(mock_hash_struct);
+	mock_hash_struct.magic[0]++;
+	test_ssync(VBERROR_EC_REBOOT_TO_RO_REQUIRED,
+		   VB2_RECOVERY_EC_EXPECTED_HASH, "Hash struct bad magic");
+
+	ResetMocks();
+	mock_hash_struct_size = sizeof(mock_hash_struct);
+	mock_hash_struct.header_version_major++;
+	test_ssync(VBERROR_EC_REBOOT_TO_RO_REQUIRED,
+		   VB2_RECOVERY_EC_EXPECTED_HASH, "Hash struct bad version");
+
+	ResetMocks();
+	mock_hash_struct_size = sizeof(mock_hash_struct);
+	mock_hash_struct.struct_size++;
+	test_ssync(VBERROR_EC_REBOOT_TO_RO_REQUIRED,
+		   VB2_RECOVERY_EC_EXPECTED_HASH, "Hash struct bad size");
+
 	ResetMocks();
 	want_ec_hash_size = 0;
 	test_ssync(VBERROR_EC_REBOOT_TO_RO_REQUIRED,
@@ -306,6 +455,35 @@ static void VbSoftwareSyncTest(void)
 	TEST_EQ(ec_ro_protected, 1, "  ec ro protected");
 	TEST_EQ(ec_ro_updated, 1, "  ec ro updated");
 
+	ResetMocks();
+	mock_ec_rw_hash[0]++;
+	mock_block_size = 16;
+	mock_num_blocks = 4;
+	mock_ec_image[40]++;
+	test_ssync(0, 0, "Update only changed rw blocks");
+	TEST_EQ(ec_rw_updated, 0, "  whole image not sent");
+	TEST_EQ(blocks_updated, 1, "  one block sent");
+	TEST_EQ(block_update_offset, 32, "  changed block sent");
+	TEST_EQ(ec_run_image, 1, "  ec run image");
+
+	ResetMocks();
+	mock_ec_rw_hash[0]++;
+	mock_block_size = 16;
+	mock_num_blocks = 3;
+	test_ssync(0, 0, "Bad block count sends the whole image");
+	TEST_EQ(ec_rw_updated, 1, "  ec rw updated");
+	TEST_EQ(blocks_updated, 0, "  no blocks sent");
+
+	ResetMocks();
+	mock_ec_rw_hash[0]++;
+	mock_block_size = 16;
+	mock_num_blocks = 4;
+	mock_ec_image[0]++;
+	block_update_retval = VBERROR_SIMULATED;
+	test_ssync(VBERROR_EC_REBOOT_TO_RO_REQUIRED, VB2_RECOVERY_EC_UPDATE,
+		   "Block update failed");
+	TEST_EQ(ec_rw_updated, 0, "  whole image not sent");
+
 	ResetMocks();
 	mock_ec_rw_hash[0]++;
 	mock_ec_ro_hash[0]++;
@@ -1,9 +1,34 @@
 #!/bin/bash
 
-if [ $# -ne 1 ]; then
-  echo "Usage: $0 <private_key_pem_file>"
+usage() {
+  echo "Usage: $0 [--persistent] <private_key_pem_file>"
   echo "Reads data to sign from stdin, encrypted data is output to stdout"
+  echo "With --persistent, requests and responses are framed and the signer"
+  echo "runs until stdin is closed"
   exit 1
+}
+
+# Prints the bytes given as a string of hex digits.
+unhex() {
+  printf "$(echo "$1" | sed 's/../\\x&/g')"
+}
+
+if [ "$1" = "--persistent" ]; then
+  [ $# -eq 2 ] || usage
+  echo "$$" >> "${SIGNER_LOG:-/dev/null}"
+  # Each request is a 4-byte ID and a 4-byte length, then the data.
+  while header=$(dd bs=1 count=8 status=none | od -An -v -tx1 | tr -d ' \n') &&
+        [ ${#header} -eq 16 ]; do
+    len=$((16#${header:8:8}))
+    sig=$(dd bs=1 count=${len} status=none | openssl rsautl -sign -inkey "$2" |
+          od -An -v -tx1 | tr -d ' \n')
+    unhex "${header:0:8}$(printf '%08x' $((${#sig} / 2)))${sig}"
+  done
+  exit 0
+fi
+
+if [ $# -ne 1 ]; then
+  usage
 fi
 
 openssl rsautl -sign -inkey $1
@@ -0,0 +1,180 @@
+/* Copyright 2018 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ *
+ * Tests for extracting vmlinuz from a kernel partition.
+ */
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "2sysincludes.h"
+#include "2common.h"
+#include "host_common.h"
+#include "host_misc.h"
+#include "vb2_struct.h"
+#include "vboot_host.h"
+
+#include "test_common.h"
+
+#define KPART_SIZE 0x1000
+#define KEYBLOCK_SIZE 0x100
+#define PREAMBLE_SIZE 0x100
+#define KBLOB_OFFSET (KEYBLOCK_SIZE + PREAMBLE_SIZE)
+#define KBLOB_SIZE 0x400
+#define LOAD_ADDRESS 0x100000
+#define HEADER_OFFSET 0x300
+#define HEADER_SIZE 0x80
+/* Where the partition starts in the disk image file */
+#define DISK_OFFSET 0x800
+
+static uint8_t kpart[KPART_SIZE];
+static uint8_t expect[HEADER_SIZE + KBLOB_SIZE];
+
+static struct vb2_kernel_preamble *preamble =
+	(struct vb2_kernel_preamble *)(kpart + KEYBLOCK_SIZE);
+
+static void reset_kpart(void)
+{
+	struct vb2_keyblock *keyblock = (struct vb2_keyblock *)kpart;
+	int i;
+
+	for (i = 0; i < KPART_SIZE; i++)
+		kpart[i] = i * 7 + (i >> 8);
+
+	memset(kpart, 0, KBLOB_OFFSET);
+	keyblock->keyblock_size = KEYBLOCK_SIZE;
+	preamble->preamble_size = PREAMBLE_SIZE;
+	preamble->header_version_minor = 2;
+	preamble->body_load_address = LOAD_ADDRESS;
+	preamble->body_signature.data_size = KBLOB_SIZE;
+	preamble->vmlinuz_header_address = LOAD_ADDRESS + HEADER_OFFSET;
+	preamble->vmlinuz_header_size = HEADER_SIZE;
+
+	memcpy(expect, kpart + KBLOB_OFFSET + HEADER_OFFSET, HEADER_SIZE);
+	memcpy(expect + HEADER_SIZE, kpart + KBLOB_OFFSET, KBLOB_SIZE);
+}
+
+static void memory_tests(void)
+{
+	void *vmlinuz = NULL;
+	size_t size = 0;
+
+	reset_kpart();
+	TEST_SUCC(ExtractVmlinuz(kpart, sizeof(kpart), &vmlinuz, &size),
+		  "ExtractVmlinuz() good");
+	TEST_EQ(size, sizeof(expect), "  size");
+	TEST_EQ(memcmp(vmlinuz, expect, sizeof(expect)), 0, "  data");
+	free(vmlinuz);
+
+	TEST_NEQ(ExtractVmlinuz(kpart, KBLOB_OFFSET + KBLOB_SIZE - 1,
+				&vmlinuz, &size), 0,
+		 "ExtractVmlinuz() kblob past end");
+	TEST_NEQ(ExtractVmlinuz(kpart, KEYBLOCK_SIZE, &vmlinuz, &size), 0,
+		 "ExtractVmlinuz() preamble past end");
+
+	preamble->header_version_minor = 0;
+	TEST_NEQ(ExtractVmlinuz(kpart, sizeof(kpart), &vmlinuz, &size), 0,
+		 "ExtractVmlinuz() old preamble");
+
+	reset_kpart();
+	preamble->vmlinuz_header_address = LOAD_ADDRESS + KPART_SIZE;
+	TEST_NEQ(ExtractVmlinuz(kpart, sizeof(kpart), &vmlinuz, &size), 0,
+		 "ExtractVmlinuz() header past end");
+
+	reset_kpart();
+	preamble->vmlinuz_header_address = LOAD_ADDRESS - 1;
+	TEST_NEQ(ExtractVmlinuz(kpart, sizeof(kpart), &vmlinuz, &size), 0,
+		 "ExtractVmlinuz() header before body");
+}
+
+static void file_tests(const char *temp_dir)
+{
+	char *diskfile, *outfile;
+	uint8_t *data;
+	uint32_t data_size;
+	size_t size = 0;
+	int in_fd, out_fd, fds[2];
+	uint8_t pipe_data[sizeof(expect)];
+
+	xasprintf(&diskfile, "%s/extract_vmlinuz_disk.dat", temp_dir);
+	xasprintf(&outfile, "%s/extract_vmlinuz_out.dat", temp_dir);
+
+	reset_kpart();
+	in_fd = open(diskfile, O_RDWR | O_CREAT | O_TRUNC, 0666);
+	TEST_NEQ(in_fd, -1, "create disk file");
+	TEST_EQ(pwrite(in_fd, kpart, sizeof(kpart), DISK_OFFSET),
+		sizeof(kpart), "write disk file");
+
+	/* To a regular file, after whatever it already holds */
+	out_fd = open(outfile, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+	TEST_EQ(write(out_fd, "X", 1), 1, "write output prefix");
+	TEST_SUCC(ExtractVmlinuzFile(in_fd, DISK_OFFSET, sizeof(kpart),
+				     out_fd, &size),
+		  "ExtractVmlinuzFile() good");
+	close(out_fd);
+	TEST_EQ(size, sizeof(expect), "  size");
+	TEST_SUCC(vb2_read_file(outfile, &data, &data_size), "  read output");
+	TEST_EQ(data_size, sizeof(expect) + 1, "  output size");
+	TEST_EQ(data[0], 'X', "  prefix kept");
+	TEST_EQ(memcmp(data + 1, expect, sizeof(expect)), 0, "  data");
+	free(data);
+
+	/* To a pipe */
+	TEST_SUCC(pipe(fds), "pipe");
+	TEST_SUCC(ExtractVmlinuzFile(in_fd, DISK_OFFSET, sizeof(kpart),
+				     fds[1], NULL),
+		  "ExtractVmlinuzFile() to pipe");
+	close(fds[1]);
+	TEST_EQ(read(fds[0], pipe_data, sizeof(pipe_data)), sizeof(pipe_data),
+		"  read pipe");
+	TEST_EQ(memcmp(pipe_data, expect, sizeof(expect)), 0, "  data");
+	close(fds[0]);
+
+	/* Sizes are checked against the partition, not the file */
+	out_fd = open(outfile, O_WRONLY | O_TRUNC);
+	TEST_NEQ(ExtractVmlinuzFile(in_fd, DISK_OFFSET,
+				    KBLOB_OFFSET + KBLOB_SIZE - 1, out_fd,
+				    NULL), 0,
+		 "ExtractVmlinuzFile() kblob past end");
+	TEST_EQ(lseek(out_fd, 0, SEEK_END), 0, "  nothing written");
+
+	/* A truncated file fails part way */
+	TEST_SUCC(ftruncate(in_fd, DISK_OFFSET + KBLOB_OFFSET + 0x10),
+		  "truncate disk file");
+	TEST_NEQ(ExtractVmlinuzFile(in_fd, DISK_OFFSET, sizeof(kpart),
+				    out_fd, NULL), 0,
+		 "ExtractVmlinuzFile() truncated");
+	close(out_fd);
+
+	/* Too short to hold the headers */
+	TEST_SUCC(ftruncate(in_fd, DISK_OFFSET + 0x10), "truncate headers");
+	out_fd = open(outfile, O_WRONLY | O_TRUNC);
+	TEST_NEQ(ExtractVmlinuzFile(in_fd, DISK_OFFSET, sizeof(kpart),
+				    out_fd, NULL), 0,
+		 "ExtractVmlinuzFile() no headers");
+	close(out_fd);
+	close(in_fd);
+
+	unlink(diskfile);
+	unlink(outfile);
+	free(diskfile);
+	free(outfile);
+}
+
+int main(int argc, char* argv[])
+{
+	if (argc != 2) {
+		fprintf(stderr, "Usage: %s <temp_dir>\n", argv[0]);
+		return -1;
+	}
+
+	memory_tests();
+	file_tests(argv[1]);
+
+	return gTestSuccess ? 0 : 255;
+}
@@ -0,0 +1,126 @@
+/* Copyright 2018 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ *
+ * Tests for FMAP searching and area lookup.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "fmap.h"
+#include "test_common.h"
+
+#define IMAGE_SIZE 0x10000
+
+static uint8_t image[IMAGE_SIZE];
+
+/* Put an FMAP with [nareas] areas named AREA_0, AREA_1, ... at [offset] */
+static FmapHeader *put_fmap(uint32_t offset, int nareas)
+{
+	FmapHeader *fmap = (FmapHeader *)(image + offset);
+	FmapAreaHeader *ah = (FmapAreaHeader *)(fmap + 1);
+	int i;
+
+	memcpy(fmap->fmap_signature, FMAP_SIGNATURE, FMAP_SIGNATURE_SIZE);
+	fmap->fmap_ver_major = FMAP_VER_MAJOR;
+	fmap->fmap_nareas = nareas;
+	for (i = 0; i < nareas; i++) {
+		ah[i].area_offset = 0x100 * i;
+		ah[i].area_size = 0x100;
+		snprintf(ah[i].area_name, FMAP_NAMELEN, "AREA_%d", i);
+	}
+
+	return fmap;
+}
+
+static void find_tests(void)
+{
+	FmapHeader *fmap;
+
+	memset(image, 0, sizeof(image));
+	TEST_PTR_EQ(fmap_find(image, sizeof(image)), NULL, "No FMAP");
+	TEST_PTR_EQ(fmap_find(image, 4), NULL, "Tiny buffer");
+
+	/* Unaligned signatures don't count */
+	put_fmap(0x1002, 0);
+	TEST_PTR_EQ(fmap_find(image, sizeof(image)), NULL, "Unaligned FMAP");
+
+	/* The most aligned one wins, wherever it is */
+	put_fmap(0x104, 0);
+	fmap = put_fmap(0x800, 0);
+	put_fmap(0xc00, 0);
+	TEST_PTR_EQ(fmap_find(image, sizeof(image)), fmap, "Most aligned");
+
+	/* Then the first one */
+	put_fmap(0x1800, 0);
+	TEST_PTR_EQ(fmap_find(image, sizeof(image)), fmap, "First of equals");
+	fmap = put_fmap(0x1000, 0);
+	TEST_PTR_EQ(fmap_find(image, sizeof(image)), fmap, "More aligned");
+
+	/* Unless there's one at the start */
+	fmap = put_fmap(0, 0);
+	TEST_PTR_EQ(fmap_find(image, sizeof(image)), fmap, "At start");
+
+	/* Wrong versions are skipped */
+	fmap->fmap_ver_major++;
+	TEST_PTR_EQ(fmap_find(image, sizeof(image)), image + 0x1000,
+		    "Bad version");
+
+	/* It has to fit */
+	memset(image, 0, sizeof(image));
+	put_fmap(IMAGE_SIZE - sizeof(FmapHeader) - 4, 0);
+	TEST_PTR_EQ(fmap_find(image, IMAGE_SIZE - 8), NULL, "Truncated FMAP");
+	TEST_PTR_EQ(fmap_find(image, sizeof(image)),
+		    image + IMAGE_SIZE - sizeof(FmapHeader) - 4, "Last FMAP");
+}
+
+static void index_tests(int nareas)
+{
+	struct fmap_index fi;
+	FmapAreaHeader *ah;
+	FmapHeader *fmap;
+	char name[FMAP_NAMELEN];
+	int i, good;
+
+	memset(image, 0, sizeof(image));
+	fmap = put_fmap(0x1000, nareas);
+	TEST_PTR_EQ(fmap_index_init(&fi, image, sizeof(image), NULL), fmap,
+		    "Index FMAP");
+	TEST_EQ(fi.hashed, nareas <= FMAP_INDEX_SLOTS / 2, "Index hashed");
+
+	for (good = 1, i = 0; i < nareas; i++) {
+		snprintf(name, sizeof(name), "AREA_%d", i);
+		ah = NULL;
+		if (fmap_index_find(&fi, name, &ah) != image + 0x100 * i ||
+		    ah != (FmapAreaHeader *)(fmap + 1) + i ||
+		    fmap_find_by_name(image, sizeof(image), fmap, name, 0) !=
+		    image + 0x100 * i)
+			good = 0;
+	}
+	TEST_TRUE(good, "Find all areas");
+
+	TEST_PTR_EQ(fmap_index_find(&fi, "AREA", 0), NULL, "Missing area");
+	TEST_PTR_EQ(fmap_find_by_name(image, sizeof(image), NULL, "AREA", 0),
+		    NULL, "Missing area, no index");
+
+	/* Only the first of any duplicates is found */
+	strcpy(((FmapAreaHeader *)(fmap + 1))[1].area_name, "AREA_0");
+	fmap_index_init(&fi, image, sizeof(image), fmap);
+	TEST_PTR_EQ(fmap_index_find(&fi, "AREA_0", 0), image, "Duplicate");
+
+	memset(image, 0, sizeof(image));
+	TEST_PTR_EQ(fmap_index_init(&fi, image, sizeof(image), NULL), NULL,
+		    "Index no FMAP");
+	TEST_PTR_EQ(fmap_index_find(&fi, "AREA_0", 0), NULL, "Empty index");
+}
+
+int main(int argc, char *argv[])
+{
+	find_tests();
+	index_tests(20);
+	index_tests(FMAP_INDEX_SLOTS);
+
+	return gTestSuccess ? 0 : 255;
+}
@@ -0,0 +1,27 @@
+/* Copyright 2018 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ *
+ * Fuzz target for futil_file_type_buf(), which runs every file type
+ * recognizer on the input.
+ */
+
+#include <stdlib.h>
+
+#include "file_type.h"
+#include "futility.h"
+#include "fuzz_common.h"
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+	uint8_t *buf;
+
+	if (size > FUZZ_MAX_INPUT_SIZE)
+		return 0;
+
+	buf = fuzz_copy_input(data, size);
+	futil_file_type_buf(buf, size);
+	free(buf);
+
+	return 0;
+}
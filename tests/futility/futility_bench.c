@@ -0,0 +1,272 @@
+/*
+ * Copyright 2018 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ *
+ * Times the futility signing operations end to end, using the dev keys and
+ * the images in tests/futility/data.
+ *
+ * Each signing operation is broken down into the time spent reading its input
+ * file, hashing, doing RSA, and everything else (parsing and building the
+ * signed structures). Hashing and RSA done on several threads at once are
+ * added up, so they can be more than the total. Verification happens in the
+ * firmware library, which doesn't keep track, so it's only timed as a whole.
+ */
+
+#include <fcntl.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "2sysincludes.h"
+#include "2common.h"
+#include "file_type.h"
+#include "futility.h"
+#include "futility_options.h"
+#include "host_common.h"
+#include "host_key2.h"
+#include "kernel_blob.h"
+#include "host_signature2.h"
+#include "vb1_helper.h"
+
+/* Run each operation a few times before timing it */
+#define WARMUP_RUNS 2
+
+/* Then run it at least this many times, for at least this long */
+#define MIN_RUNS 5
+#define MIN_TEST_MSECS 500
+
+static const char *srcdir;
+
+/* Things the operations need, loaded once */
+static struct vb2_private_key *root_key;
+static struct vb2_private_key *kernel_data_key;
+static struct vb2_keyblock *kernel_keyblock;
+static uint8_t bootloader[4096];
+static char config[] = "console=tty0 cros_secure";
+
+static const char *src_path(const char *file)
+{
+	static char path[PATH_MAX];
+
+	snprintf(path, sizeof(path), "%s/%s", srcdir, file);
+	return path;
+}
+
+static uint64_t now_nsecs(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static int setup(void)
+{
+	sign_option.signprivate = vb2_read_private_key(
+		src_path("tests/devkeys/firmware_data_key.vbprivk"));
+	sign_option.keyblock = vb2_read_keyblock(
+		src_path("tests/devkeys/firmware.keyblock"));
+	sign_option.kernel_subkey = vb2_read_packed_key(
+		src_path("tests/devkeys/kernel_subkey.vbpubk"));
+	sign_option.pem_signpriv = strdup(
+		src_path("tests/futility/data/zinger.pem"));
+	/* The rwsig signature goes in a file of its own, which we don't need */
+	sign_option.inout_file_count = 2;
+	sign_option.outfile = "/dev/null";
+	root_key = vb2_read_private_key(
+		src_path("tests/devkeys/root_key.vbprivk"));
+	kernel_data_key = vb2_read_private_key(
+		src_path("tests/devkeys/kernel_data_key.vbprivk"));
+	kernel_keyblock = vb2_read_keyblock(
+		src_path("tests/devkeys/kernel.keyblock"));
+
+	if (vb21_private_key_read(&sign_option.prikey,
+			src_path("tests/futility/data/sample.vbprik2")))
+		return 1;
+
+	return !sign_option.signprivate || !sign_option.keyblock ||
+		!sign_option.kernel_subkey || !sign_option.pem_signpriv ||
+		!root_key || !kernel_data_key || !kernel_keyblock;
+}
+
+/* The operations. Each one works on a fresh copy of its input file. */
+
+static int sign_keyblock(const char *name, uint8_t *buf, uint32_t len)
+{
+	struct vb2_keyblock *keyblock;
+
+	keyblock = vb2_create_keyblock((struct vb2_packed_key *)buf,
+				       root_key, 7);
+	free(keyblock);
+	return !keyblock;
+}
+
+static int sign_kernel(const char *name, uint8_t *buf, uint32_t len)
+{
+	uint8_t *blob, *vblock;
+	uint32_t blob_size, vblock_size;
+
+	blob = CreateKernelBlob(buf, len, ARCH_X86, CROS_32BIT_ENTRY_ADDR,
+				(uint8_t *)config, sizeof(config),
+				bootloader, sizeof(bootloader), &blob_size);
+	if (!blob)
+		return 1;
+
+	vblock = SignKernelBlob(blob, blob_size, 65536, 1,
+				CROS_32BIT_ENTRY_ADDR, kernel_keyblock,
+				kernel_data_key, 0, 0, &vblock_size);
+	free(vblock);
+	free(blob);
+	return !vblock;
+}
+
+static int sign_bios(const char *name, uint8_t *buf, uint32_t len)
+{
+	return ft_sign_bios(name, buf, len, NULL);
+}
+
+static int sign_rwsig(const char *name, uint8_t *buf, uint32_t len)
+{
+	return ft_sign_rwsig(name, buf, len, NULL);
+}
+
+static int sign_usbpd1(const char *name, uint8_t *buf, uint32_t len)
+{
+	return ft_sign_usbpd1(name, buf, len, NULL);
+}
+
+static int verify(const char *name, uint8_t *buf, uint32_t len)
+{
+	const struct futil_cmd_t *const *cmd;
+	char *argv[] = {"verify", (char *)name, NULL};
+	int saved_stdout, devnull;
+	int rv = 1;
+
+	for (cmd = futil_cmds; *cmd; cmd++)
+		if (!strcmp((*cmd)->name, "verify"))
+			break;
+	if (!*cmd)
+		return 1;
+
+	/* It tells us all about the file, which we don't need to see */
+	fflush(stdout);
+	saved_stdout = dup(STDOUT_FILENO);
+	devnull = open("/dev/null", O_WRONLY);
+	if (saved_stdout < 0 || devnull < 0 ||
+	    dup2(devnull, STDOUT_FILENO) < 0)
+		goto done;
+
+	optind = 0;
+	rv = (*cmd)->handler(ARRAY_SIZE(argv) - 1, argv);
+
+	fflush(stdout);
+	dup2(saved_stdout, STDOUT_FILENO);
+done:
+	if (devnull >= 0)
+		close(devnull);
+	if (saved_stdout >= 0)
+		close(saved_stdout);
+	return rv;
+}
+
+static const struct {
+	const char *name;
+	const char *file;
+	int (*op)(const char *name, uint8_t *buf, uint32_t len);
+	/* Keeps track of hashing and RSA */
+	int breakdown;
+} ops[] = {
+	{"keyblock", "tests/devkeys/firmware_data_key.vbpubk",
+	 sign_keyblock, 1},
+	{"kernel", "tests/futility/data/vmlinuz-amd64.bin", sign_kernel, 1},
+	{"bios", "tests/futility/data/bios_peppy_mp.bin", sign_bios, 1},
+	{"rwsig", "tests/futility/data/EC_RW.bin", sign_rwsig, 1},
+	{"usbpd1", "tests/futility/data/zinger.unsigned", sign_usbpd1, 1},
+	{"verify", "tests/futility/data/bios_peppy_mp.bin", verify, 0},
+};
+
+int main(int argc, char *argv[])
+{
+	struct vb2_sign_stats stats;
+	uint64_t start, io_start, total, io, work;
+	uint32_t len;
+	uint8_t *buf;
+	const char *file;
+	int i, runs;
+
+	/* Where's the source directory? */
+	if (argc > 1)
+		srcdir = argv[1];
+	else if (!(srcdir = getenv("SRCDIR")))
+		srcdir = ".";
+
+	if (setup()) {
+		fprintf(stderr, "# Can't read the keys from %s\n", srcdir);
+		return 1;
+	}
+
+	for (i = 0; i < ARRAY_SIZE(ops); i++) {
+		file = strdup(src_path(ops[i].file));
+		io = work = 0;
+
+		for (runs = -WARMUP_RUNS; runs < MIN_RUNS ||
+			     (io + work) / 1000000 < MIN_TEST_MSECS; runs++) {
+			if (!runs) {
+				io = work = 0;
+				vb2_get_sign_stats(&stats, 1);
+			}
+
+			io_start = now_nsecs();
+			if (VB2_SUCCESS != vb2_read_file(file, &buf, &len)) {
+				fprintf(stderr, "# Can't read %s\n", file);
+				return 1;
+			}
+			start = now_nsecs();
+			if (ops[i].op(file, buf, len)) {
+				fprintf(stderr, "# %s failed\n", ops[i].name);
+				return 1;
+			}
+			work += now_nsecs() - start;
+			io += start - io_start;
+			free(buf);
+		}
+		vb2_get_sign_stats(&stats, 1);
+		free((char *)file);
+
+		total = (io + work) / runs;
+		fprintf(stderr, "# %s: %f ms/op over %d runs\n",
+			ops[i].name, total / 1e6, runs);
+		fprintf(stdout, "ns_per_op_%s_total:%" PRIu64 "\n",
+			ops[i].name, total);
+		fprintf(stdout, "ops_per_sec_%s:%f\n",
+			ops[i].name, 1e9 / total);
+		if (!ops[i].breakdown)
+			continue;
+
+		work /= runs;
+		stats.hash_nsecs /= runs;
+		stats.rsa_nsecs /= runs;
+		fprintf(stdout, "ns_per_op_%s_io:%" PRIu64 "\n",
+			ops[i].name, io / runs);
+		fprintf(stdout, "ns_per_op_%s_hash:%" PRIu64 "\n",
+			ops[i].name, stats.hash_nsecs);
+		fprintf(stdout, "ns_per_op_%s_rsa:%" PRIu64 "\n",
+			ops[i].name, stats.rsa_nsecs);
+		fprintf(stdout, "ns_per_op_%s_serialize:%" PRIu64 "\n",
+			ops[i].name,
+			work > stats.hash_nsecs + stats.rsa_nsecs ?
+			work - stats.hash_nsecs - stats.rsa_nsecs : 0);
+		fprintf(stdout, "bytes_hashed_per_op_%s:%" PRIu64 "\n",
+			ops[i].name, stats.hash_bytes / runs);
+		fprintf(stdout, "signatures_per_op_%s:%" PRIu64 "\n",
+			ops[i].name, stats.rsa_count / runs);
+	}
+
+	return 0;
+}
@@ -42,20 +42,28 @@ export OUTDIR
 TESTS="
 ${SCRIPTDIR}/test_bdb.sh
 ${SCRIPTDIR}/test_create.sh
+${SCRIPTDIR}/test_delta.sh
 ${SCRIPTDIR}/test_dump_fmap.sh
+${SCRIPTDIR}/test_embed_keys.sh
 ${SCRIPTDIR}/test_gbb_utility.sh
 ${SCRIPTDIR}/test_load_fmap.sh
 ${SCRIPTDIR}/test_main.sh
+${SCRIPTDIR}/test_pcr.sh
 ${SCRIPTDIR}/test_rwsig.sh
 ${SCRIPTDIR}/test_show_contents.sh
+${SCRIPTDIR}/test_show_keys.sh
 ${SCRIPTDIR}/test_show_kernel.sh
 ${SCRIPTDIR}/test_show_vs_verify.sh
 ${SCRIPTDIR}/test_show_usbpd1.sh
 ${SCRIPTDIR}/test_sign_firmware.sh
+${SCRIPTDIR}/test_sign_disk.sh
 ${SCRIPTDIR}/test_sign_fw_main.sh
 ${SCRIPTDIR}/test_sign_kernel.sh
+${SCRIPTDIR}/test_sign_kernel_chunks.sh
 ${SCRIPTDIR}/test_sign_keyblocks.sh
 ${SCRIPTDIR}/test_sign_usbpd1.sh
+${SCRIPTDIR}/test_update.sh
+${SCRIPTDIR}/test_verity.sh
 ${SCRIPTDIR}/test_file_types.sh
 "
 
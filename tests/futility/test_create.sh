@@ -27,7 +27,7 @@ done
 
 # Demonstrate that we can create some vb21 keypairs. This doesn't prove
 # prove anything until we've used them to sign some stuff, though.
-for sig in rsa1024 rsa2048 rsa4096 rsa8192; do
+for sig in rsa1024 rsa2048 rsa4096 rsa8192 ed25519; do
   for hash in sha1 sha256 sha512; do
     ${FUTILITY} --vb21 create --hash_alg "${hash}" \
       "${TESTKEYS}/key_${sig}.pem" "${TMP}_key_${sig}.${hash}"
@@ -55,7 +55,7 @@ done
 # Demonstrate that we can create some vb21 public key from PEM containing
 # only the pubkeypairs and verify it's the same as the one generated from
 # the private key.
-for sig in rsa1024 rsa2048 rsa4096 rsa8192; do
+for sig in rsa1024 rsa2048 rsa4096 rsa8192 ed25519; do
   for hash in sha1 sha256 sha512; do
     ${FUTILITY} --vb21 create --hash_alg "${hash}" \
       "${TESTKEYS}/key_${sig}.pub.pem" "${TMP}_key_${sig}.pubonly.${hash}"
@@ -64,6 +64,41 @@ for sig in rsa1024 rsa2048 rsa4096 rsa8192; do
   done
 done
 
+# Demonstrate that a manifest creates the same keys as one key at a time, no
+# matter how many jobs share the work.
+for vb in vb1 vb21; do
+  : > "${TMP}_manifest"
+  echo "# comment" >> "${TMP}_manifest"
+  echo "" >> "${TMP}_manifest"
+  for sig in rsa1024 rsa2048 rsa4096 rsa8192; do
+    for hash in sha1 sha256 sha512; do
+      echo "${TESTKEYS}/key_${sig}.pem ${TMP}_${vb}_${sig}.${hash} ${hash}" \
+        >> "${TMP}_manifest"
+    done
+  done
+  ${FUTILITY} --${vb} create --jobs 4 --manifest "${TMP}_manifest"
+  for sig in rsa1024 rsa2048 rsa4096 rsa8192; do
+    for hash in sha1 sha256 sha512; do
+      if [ "${vb}" = "vb1" ]; then
+        cmp "${TESTKEYS}/key_${sig}.${hash}.vbprivk" \
+          "${TMP}_${vb}_${sig}.${hash}.vbprivk"
+        cmp "${TESTKEYS}/key_${sig}.${hash}.vbpubk" \
+          "${TMP}_${vb}_${sig}.${hash}.vbpubk"
+      else
+        cmp "${TMP}_key_${sig}.${hash}.vbprik2" \
+          "${TMP}_${vb}_${sig}.${hash}.vbprik2"
+        cmp "${TMP}_key_${sig}.${hash}.vbpubk2" \
+          "${TMP}_${vb}_${sig}.${hash}.vbpubk2"
+      fi
+    done
+  done
+done
+
+# A bad manifest line fails without creating anything
+echo "${TESTKEYS}/key_rsa1024.pem ${TMP}_bad sha3" > "${TMP}_manifest"
+if ${FUTILITY} create --manifest "${TMP}_manifest"; then false; fi
+[ ! -e "${TMP}_bad.vbpubk2" ]
+
 # cleanup
 rm -rf ${TMP}*
 exit 0
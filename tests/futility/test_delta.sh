@@ -0,0 +1,66 @@
+#!/bin/bash -eux
+# Copyright 2018 The Chromium OS Authors. All rights reserved.
+# Use of this source code is governed by a BSD-style license that can be
+# found in the LICENSE file.
+
+me=${0##*/}
+TMP="$me.tmp"
+
+# Work in scratch directory
+cd "$OUTDIR"
+
+IN=${SCRIPTDIR}/data/bios_link_mp.bin
+OLD=${TMP}.old.bin
+NEW=${TMP}.new.bin
+
+# Change a few bytes in one area, erase another and replace a third
+cp ${IN} ${OLD}
+cp ${IN} ${NEW}
+${FUTILITY} dump_fmap -x ${NEW} VBLOCK_B BOOT_STUB
+printf 'new' | dd of=VBLOCK_B bs=1 seek=100 conv=notrunc
+size=$(stat -c '%s' BOOT_STUB)
+tr '\000' '\377' < /dev/zero | head -c ${size} > BOOT_STUB
+${FUTILITY} dump_fmap -x ${NEW} RW_SHARED
+size=$(stat -c '%s' RW_SHARED)
+dd if=/dev/urandom of=RW_SHARED bs=${size} count=1
+${FUTILITY} load_fmap ${NEW} VBLOCK_B:VBLOCK_B BOOT_STUB:BOOT_STUB \
+  RW_SHARED:RW_SHARED
+
+# The payload is much smaller than the image, and rebuilds it
+${FUTILITY} delta -v ${OLD} ${NEW} ${TMP}.payload > ${TMP}.create
+grep -q "diff .*VBLOCK_B" ${TMP}.create
+grep -q "fill .*BOOT_STUB" ${TMP}.create
+grep -q "raw .*SHARED_DATA" ${TMP}.create
+[ $(stat -c '%s' ${TMP}.payload) -lt $(( $(stat -c '%s' ${NEW}) / 4 )) ]
+${FUTILITY} delta --apply ${OLD} ${TMP}.payload ${TMP}.out
+cmp ${NEW} ${TMP}.out
+
+# Identical images make an (almost) empty payload
+${FUTILITY} delta ${OLD} ${OLD} ${TMP}.same
+[ $(stat -c '%s' ${TMP}.same) -lt 8192 ]
+${FUTILITY} delta -a ${OLD} ${TMP}.same ${TMP}.out
+cmp ${OLD} ${TMP}.out
+
+# The payload only applies to the image it was made from
+rm -f ${TMP}.out
+if ${FUTILITY} delta -a ${NEW} ${TMP}.payload ${TMP}.out; then false; fi
+[ ! -e ${TMP}.out ]
+if ${FUTILITY} delta -a ${OLD} ${TMP}.payload ${OLD}; then false; fi
+cmp ${IN} ${OLD}
+
+# A damaged payload is caught, and nothing is left behind
+cp ${TMP}.payload ${TMP}.bad
+size=$(stat -c '%s' ${TMP}.bad)
+printf 'xyz' | dd of=${TMP}.bad bs=1 seek=$(( size - 100 )) conv=notrunc
+if ${FUTILITY} delta -a ${OLD} ${TMP}.bad ${TMP}.out; then false; fi
+[ ! -e ${TMP}.out ]
+head -c 100 ${TMP}.payload > ${TMP}.bad
+if ${FUTILITY} delta -a ${OLD} ${TMP}.bad ${TMP}.out; then false; fi
+
+# Images must be the same size
+head -c 4096 ${OLD} > ${TMP}.short
+if ${FUTILITY} delta ${TMP}.short ${NEW} ${TMP}.bad; then false; fi
+
+# cleanup
+rm -f ${TMP}* VBLOCK_B BOOT_STUB RW_SHARED
+exit 0
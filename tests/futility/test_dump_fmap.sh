@@ -36,6 +36,30 @@ cmp "${SCRIPTDIR}/data_fmap_expect_x.txt" "$TMP"
 cmp "${SCRIPTDIR}/data_fmap_expect_x2.txt" "$TMP"
 cmp SI_DESC FOO
 
+# Hash a section without extracting it
+"$FUTILITY" dump_fmap -p --hash "${SCRIPTDIR}/data_fmap.bin" SI_DESC > "$TMP"
+[ "$(cut -d' ' -f4 "$TMP")" = "$(sha256sum SI_DESC | cut -d' ' -f1)" ]
+
+# Padded out, the image holds every section. Extracting them all at once
+# gives the same files and report as one at a time.
+cp "${SCRIPTDIR}/data_fmap.bin" "$TMP.img"
+truncate -s 8M "$TMP.img"
+mkdir -p "$TMP.j1" "$TMP.j4"
+(cd "$TMP.j1" && "$FUTILITY" dump_fmap -x --hash --jobs 1 ../"$TMP.img" \
+	> ../"$TMP.j1.txt")
+(cd "$TMP.j4" && "$FUTILITY" dump_fmap -x --hash --jobs 4 ../"$TMP.img" \
+	> ../"$TMP.j4.txt")
+cmp "$TMP.j1.txt" "$TMP.j4.txt"
+diff -r "$TMP.j1" "$TMP.j4"
+[ "$(grep -c '^saved as' "$TMP.j4.txt")" = 30 ]
+[ "$(grep '^area_sha256' "$TMP.j4.txt" | sed -n 2p | cut -c18-)" = \
+  "$(sha256sum "$TMP.j4/SI_DESC" | cut -d' ' -f1)" ]
+
+# --hash has no place in these formats
+if "$FUTILITY" dump_fmap -h --hash "${SCRIPTDIR}/data_fmap.bin"; then false; fi
+if "$FUTILITY" dump_fmap -F --hash "${SCRIPTDIR}/data_fmap.bin"; then false; fi
+if "$FUTILITY" dump_fmap --jobs 0 "${SCRIPTDIR}/data_fmap.bin"; then false; fi
+
 # This FMAP has problems, and should fail.
 if "$FUTILITY" dump_fmap -h "${SCRIPTDIR}/data_fmap2.bin" > "$TMP"; then false; fi
 cmp "${SCRIPTDIR}/data_fmap2_expect_h.txt" "$TMP"
@@ -48,5 +72,5 @@ cmp "${SCRIPTDIR}/data_fmap2_expect_hhH.txt" "$TMP"
 
 
 # cleanup
-rm -f ${TMP}* FMAP SI_DESC FOO
+rm -rf ${TMP}* FMAP SI_DESC FOO
 exit 0
@@ -0,0 +1,69 @@
+#!/bin/bash -eux
+# Copyright 2018 The Chromium OS Authors. All rights reserved.
+# Use of this source code is governed by a BSD-style license that can be
+# found in the LICENSE file.
+
+me=${0##*/}
+TMP="$me.tmp"
+
+# Work in scratch directory
+cd "$OUTDIR"
+
+DEVKEYS=${SRCDIR}/tests/devkeys
+ROOTKEY=${DEVKEYS}/root_key.vbpubk
+RECKEY=${DEVKEYS}/recovery_key.vbpubk
+
+# A GBB with the dev keys in it
+${FUTILITY} gbb -c 0x100,0x1000,0,0x1000 ${TMP}.gbb
+${FUTILITY} gbb -s -k ${ROOTKEY} -r ${RECKEY} ${TMP}.gbb
+
+# Both keys, checked against the GBB
+${FUTILITY} embed_keys --rootkey ${ROOTKEY} --recoverykey ${RECKEY} \
+  --image ${TMP}.gbb ${TMP}.keys.c
+grep -q 'vb2ex_embedded_root_key(void)' ${TMP}.keys.c
+grep -q 'vb2ex_embedded_recovery_key(void)' ${TMP}.keys.c
+
+# The root key is unpacked, with the n0inv from the packed key. The dev
+# root key is RSA8192, so n[] and rr[] are 256 words each.
+n0inv=$(od -A n -t x4 -j 36 -N 4 ${ROOTKEY} | tr -d ' ')
+grep -q "\.n0inv = 0x${n0inv}," ${TMP}.keys.c
+grep -q '\.arrsize = 256,' ${TMP}.keys.c
+grep -q 'root_key_n\[256\]' ${TMP}.keys.c
+grep -q 'root_key_rr\[256\]' ${TMP}.keys.c
+grep -q '\.sig_alg = VB2_SIG_RSA8192,' ${TMP}.keys.c
+grep -q '\.hash_alg = VB2_HASH_SHA512,' ${TMP}.keys.c
+
+# The recovery key is packed, byte for byte
+size=$(stat -c %s ${RECKEY})
+grep -q "recovery_key\[${size}\]" ${TMP}.keys.c
+od -A n -t x1 -v ${RECKEY} | tr -s ' \n' '\n' | grep -v '^$' |
+  sed 's/^/0x/' > ${TMP}.rec_bytes
+sed -n '/recovery_key\[/,/^};/p' ${TMP}.keys.c | grep -o '0x[0-9a-f]\{2\}' \
+  > ${TMP}.src_bytes
+cmp ${TMP}.rec_bytes ${TMP}.src_bytes
+
+# Either key may be left out
+${FUTILITY} embed_keys --rootkey ${ROOTKEY} ${TMP}.root.c
+grep -q 'vb2ex_embedded_root_key' ${TMP}.root.c
+if grep -q 'vb2ex_embedded_recovery_key' ${TMP}.root.c; then false; fi
+
+# Only checking is fine too
+${FUTILITY} embed_keys --recoverykey ${RECKEY} --image ${TMP}.gbb
+
+# Keys that don't match the GBB are caught, and nothing is written
+if ${FUTILITY} embed_keys --rootkey ${RECKEY} --image ${TMP}.gbb \
+  ${TMP}.bad.c; then false; fi
+[ ! -e ${TMP}.bad.c ]
+if ${FUTILITY} embed_keys --recoverykey ${ROOTKEY} \
+  --image ${TMP}.gbb; then false; fi
+
+# Other things that should fail
+if ${FUTILITY} embed_keys ${TMP}.x.c; then false; fi
+if ${FUTILITY} embed_keys --rootkey ${ROOTKEY}; then false; fi
+if ${FUTILITY} embed_keys --rootkey ${TMP}.gbb ${TMP}.x.c; then false; fi
+if ${FUTILITY} embed_keys --rootkey ${ROOTKEY} --image ${ROOTKEY}; then
+  false; fi
+
+# cleanup
+rm -rf ${TMP}*
+exit 0
@@ -230,6 +230,21 @@ ${FUTILITY} gbb -g --digest ${TMP}.blob.bad | grep 'invalid'
 cat ${TMP}.blob | ${REPLACE} 0x84 0x70 0x71 0x72 > ${TMP}.blob.bad
 ${FUTILITY} gbb -g --digest ${TMP}.blob.bad | grep 'invalid'
 
+# Edits in place keep the same file, and a failed edit changes nothing.
+inode=$(stat -c %i ${TMP}.blob)
+${FUTILITY} gbb -s --flags=0x1234 ${TMP}.blob
+[ $(stat -c %i ${TMP}.blob) = "$inode" ]
+${FUTILITY} gbb -g --flags ${TMP}.blob | grep -i 'flags: 0x00001234'
+cp ${TMP}.blob ${TMP}.blob.orig
+if ${FUTILITY} gbb -s --flags=0x5678 --hwid="0123456789ABCDEF" \
+  ${TMP}.blob; then false; fi
+cmp ${TMP}.blob ${TMP}.blob.orig
+
+# Writing somewhere else leaves the input alone.
+${FUTILITY} gbb -s --flags=0x5678 ${TMP}.blob ${TMP}.blob.new
+cmp ${TMP}.blob ${TMP}.blob.orig
+${FUTILITY} gbb -g --flags ${TMP}.blob.new | grep -i 'flags: 0x00005678'
+
 # cleanup
 rm -f ${TMP}*
 exit 0
@@ -38,6 +38,45 @@ for a in ${AREAS}; do
   cmp $a $a.rand
 done
 
+# A manifest does all that and more against one mapping of the image. It
+# should match what the separate commands do.
+KEYDIR=${SRCDIR}/tests/devkeys
+SIGN_ARGS="-s ${KEYDIR}/firmware_data_key.vbprivk \
+  -b ${KEYDIR}/firmware.keyblock -k ${KEYDIR}/kernel_subkey.vbpubk"
+
+cp ${IN} ${BIOS}.1
+${FUTILITY} load_fmap ${BIOS}.1 BOOT_STUB:BOOT_STUB.rand
+${FUTILITY} gbb -s --hwid="TEST HWID 42" --flags=0x39 \
+  -k ${KEYDIR}/root_key.vbpubk ${BIOS}.1
+${FUTILITY} sign ${SIGN_ARGS} ${BIOS}.1
+
+cat > ${TMP}.manifest <<EOF
+# Assemble the image
+area BOOT_STUB BOOT_STUB.rand
+gbb hwid "TEST HWID 42"
+gbb flags 0x39   # dev mode
+gbb rootkey ${KEYDIR}/root_key.vbpubk
+sign ${SIGN_ARGS}
+EOF
+${FUTILITY} load_fmap -o ${BIOS}.2 --manifest ${TMP}.manifest ${IN}
+cmp ${BIOS}.1 ${BIOS}.2
+
+# From stdin, after AREA:file arguments
+cp ${IN} ${BIOS}.3
+echo "gbb hwid 'TEST HWID 42'" | \
+  ${FUTILITY} load_fmap --manifest - ${BIOS}.3 BOOT_STUB:BOOT_STUB.rand
+${FUTILITY} gbb -g --hwid ${BIOS}.3 | grep -q "TEST HWID 42"
+${FUTILITY} dump_fmap -x ${BIOS}.3 BOOT_STUB
+cmp BOOT_STUB BOOT_STUB.rand
+
+# Bad changes fail
+for bad in "bogus" "area NO_SUCH_AREA BOOT_STUB.rand" "gbb color blue" \
+    "gbb flags none" "area BOOT_STUB /no/such/file" "sign --outfile x"; do
+  if echo "$bad" | ${FUTILITY} load_fmap --manifest - ${BIOS}.3; then
+    false
+  fi
+done
+
 # cleanup
 rm -f ${TMP}* ${AREAS} *.rand *.good
 exit 0
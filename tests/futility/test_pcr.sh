@@ -0,0 +1,48 @@
+#!/bin/bash -eux
+# Copyright 2018 The Chromium OS Authors. All rights reserved.
+# Use of this source code is governed by a BSD-style license that can be
+# found in the LICENSE file.
+
+me=${0##*/}
+TMP="$me.tmp"
+
+# Work in scratch directory
+cd "$OUTDIR"
+
+SHA1_A=b52791126f96a21a8ba4d511c6f25a1c1eb6dc9e
+SHA1_B=0000000000000000000000000000000000000001
+SHA256_A=$(printf '%064x' 5)
+
+# Replaying a log ends with the same PCR as extending one DIGEST at a time
+"${FUTILITY}" pcr "${SHA1_A}" "${SHA1_B}" | tail -n 1 > "${TMP}.args"
+printf "%s\n%s\n" "${SHA1_A}" "${SHA1_B}" | "${FUTILITY}" pcr --log \
+  > "${TMP}.log"
+grep -q "^Events: 2$" "${TMP}.log"
+[ "$(sed -n 's/^SHA1 //p' "${TMP}.log")" = "$(cat "${TMP}.args")" ]
+
+"${FUTILITY}" pcr -2 "${SHA256_A}" "${SHA256_A}" | tail -n 1 \
+  > "${TMP}.args256"
+
+# Several banks at once, in hex and in binary
+printf "%s %s\n%s %s\n" "${SHA1_A}" "${SHA256_A}" "${SHA1_B}" "${SHA256_A}" \
+  > "${TMP}.events"
+"${FUTILITY}" pcr --log --bank sha1 --bank sha256 < "${TMP}.events" \
+  > "${TMP}.banks"
+[ "$(sed -n 's/^SHA1 //p' "${TMP}.banks")" = "$(cat "${TMP}.args")" ]
+[ "$(sed -n 's/^SHA256 //p' "${TMP}.banks")" = "$(cat "${TMP}.args256")" ]
+
+printf "$(tr -d ' \n' < "${TMP}.events" | sed 's/../\\x&/g')" \
+  > "${TMP}.events.bin"
+"${FUTILITY}" pcr --log --binary --bank sha1 --bank sha256 \
+  < "${TMP}.events.bin" > "${TMP}.banks.bin"
+cmp "${TMP}.banks" "${TMP}.banks.bin"
+
+# A truncated or invalid log is an error
+if head -c 50 "${TMP}.events.bin" | \
+  "${FUTILITY}" pcr --log --binary --bank sha1 --bank sha256; then false; fi
+if echo "${SHA1_A}zz" | "${FUTILITY}" pcr --log; then false; fi
+if "${FUTILITY}" pcr --bank sha1 --bank sha256 "${SHA1_A}"; then false; fi
+
+# cleanup
+rm -f ${TMP}*
+exit 0
@@ -56,6 +56,27 @@ for s in $SIGS; do
     done
 done
 
+# Several images signed in place at once match signing each by itself, and
+# don't leave an EC_RW.bin behind
+rm -f ${EC_RW}
+for i in 1 2 3 4; do
+    cp ${infile} ${TMP}.multi_${i}
+done
+${FUTILITY} sign --type rwsig --prikey ${outkeys}.vbprik2 --version 2 \
+    --multi --jobs 2 ${TMP}.multi_*
+[[ ! -e ${EC_RW} ]]
+cp ${infile} ${TMP}.single
+${FUTILITY} sign --type rwsig --prikey ${outkeys}.vbprik2 --version 2 \
+    ${TMP}.single
+for i in 1 2 3 4; do
+    cmp ${TMP}.single ${TMP}.multi_${i}
+done
+
+# Only in-place signing of these types works
+if ${FUTILITY} sign --type rwsig --prikey ${outkeys}.vbprik2 --multi \
+    --outfile ${TMP}.x ${TMP}.multi_1; then false; fi
+if ${FUTILITY} sign --type bios --multi ${TMP}.multi_1; then false; fi
+
 # cleanup
 rm -rf ${TMP}*
 exit 0
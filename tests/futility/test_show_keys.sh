@@ -0,0 +1,131 @@
+#!/bin/bash -eux
+# Copyright 2018 The Chromium OS Authors. All rights reserved.
+# Use of this source code is governed by a BSD-style license that can be
+# found in the LICENSE file.
+
+me=${0##*/}
+TMP="$me.tmp"
+
+# Work in scratch directory
+cd "$OUTDIR"
+
+DEVKEYS=${SRCDIR}/tests/devkeys
+CGPT=${BINDIR}/cgpt
+
+# Args are <summary file>, <line label>, <expected rest of line>
+expect_line() {
+  grep -q "^  $2 *$3\$" "$1"
+}
+
+sha1_of() {
+  ${FUTILITY} show "$1" | awk '/Key sha1sum:/ {print $3}'
+}
+
+root_sha1=$(sha1_of ${DEVKEYS}/root_key.vbpubk)
+recovery_sha1=$(sha1_of ${DEVKEYS}/recovery_key.vbpubk)
+firmware_sha1=$(sha1_of ${DEVKEYS}/firmware_data_key.vbpubk)
+kernel_sha1=$(sha1_of ${DEVKEYS}/kernel_data_key.vbpubk)
+rec_kernel_sha1=$(sha1_of ${DEVKEYS}/recovery_kernel_data_key.vbpubk)
+
+#### firmware image
+
+# Sign a firmware image with the dev keys throughout
+cp ${SCRIPTDIR}/data/bios_peppy_mp.bin ${TMP}.bios
+${FUTILITY} gbb -s --hwid="PEPPY TEST 0000" \
+  -k ${DEVKEYS}/root_key.vbpubk -r ${DEVKEYS}/recovery_key.vbpubk ${TMP}.bios
+${FUTILITY} sign -s ${DEVKEYS}/firmware_data_key.vbprivk \
+  -b ${DEVKEYS}/firmware.keyblock -k ${DEVKEYS}/kernel_subkey.vbpubk \
+  ${TMP}.bios
+
+${FUTILITY} show --keys-summary --keyset ${DEVKEYS} ${TMP}.bios \
+  > ${TMP}.bios.txt
+head -1 ${TMP}.bios.txt | grep -q "^BIOS: ${TMP}.bios\$"
+expect_line ${TMP}.bios.txt "hwid:" "PEPPY TEST 0000"
+expect_line ${TMP}.bios.txt "root key:" "${root_sha1}  root_key"
+expect_line ${TMP}.bios.txt "recovery key:" "${recovery_sha1}  recovery_key"
+for ab in A B; do
+  expect_line ${TMP}.bios.txt "VBLOCK_${ab}:" \
+    "${firmware_sha1}  (!DEV DEV !REC)  firmware_data_key  $(echo \
+      signed by root key, root_key)"
+done
+
+# Without a keyset, there are just sha1sums
+${FUTILITY} show --keys-summary ${TMP}.bios > ${TMP}.bios2.txt
+expect_line ${TMP}.bios2.txt "root key:" "${root_sha1}"
+expect_line ${TMP}.bios2.txt "VBLOCK_A:" \
+  "${firmware_sha1}  (!DEV DEV !REC)  signed by root key"
+
+#### disk image
+
+echo "hi there" > ${TMP}.config.txt
+dd if=/dev/urandom bs=512 count=1 of=${TMP}.bootloader.bin
+
+sectors=8192
+kern_a=64
+kern_b=$((kern_a + sectors))
+kern_c=$((kern_b + sectors))
+
+${FUTILITY} sign \
+  --keyblock ${DEVKEYS}/kernel.keyblock \
+  --signprivate ${DEVKEYS}/kernel_data_key.vbprivk \
+  --version 1 \
+  --config ${TMP}.config.txt \
+  --bootloader ${TMP}.bootloader.bin \
+  --vmlinuz ${SCRIPTDIR}/data/vmlinuz-amd64.bin \
+  --arch amd64 \
+  --outfile ${TMP}.kern_a
+${FUTILITY} sign \
+  --keyblock ${DEVKEYS}/recovery_kernel.keyblock \
+  --signprivate ${DEVKEYS}/recovery_kernel_data_key.vbprivk \
+  --version 1 \
+  --config ${TMP}.config.txt \
+  --bootloader ${TMP}.bootloader.bin \
+  --vmlinuz ${SCRIPTDIR}/data/vmlinuz-amd64.bin \
+  --arch amd64 \
+  --outfile ${TMP}.kern_b
+
+dd if=/dev/zero bs=512 count=$((kern_c + sectors + 64)) of=${TMP}.disk
+${CGPT} create ${TMP}.disk
+${CGPT} add -i 2 -t kernel -b ${kern_a} -s ${sectors} -l KERN-A ${TMP}.disk
+${CGPT} add -i 4 -t kernel -b ${kern_b} -s ${sectors} -l KERN-B ${TMP}.disk
+${CGPT} add -i 6 -t kernel -b ${kern_c} -s ${sectors} -l KERN-C ${TMP}.disk
+dd if=${TMP}.kern_a of=${TMP}.disk bs=512 seek=${kern_a} conv=notrunc
+dd if=${TMP}.kern_b of=${TMP}.disk bs=512 seek=${kern_b} conv=notrunc
+
+${FUTILITY} show --keys-summary --keyset ${DEVKEYS} ${TMP}.disk \
+  > ${TMP}.disk.txt
+head -1 ${TMP}.disk.txt | grep -q "^IMAGE: ${TMP}.disk\$"
+expect_line ${TMP}.disk.txt "part 2 kernel:" \
+  "${kernel_sha1}  (!DEV DEV !REC)  kernel_data_key  signed by kernel_subkey"
+expect_line ${TMP}.disk.txt "part 4 kernel:" \
+  "${rec_kernel_sha1}  (!DEV DEV REC)  $(echo installer_kernel_data_key, \
+    recovery_kernel_data_key)  signed by recovery_key"
+expect_line ${TMP}.disk.txt "part 6 kernel:" "not signed"
+
+# Several files at once come out in order
+${FUTILITY} show --keys-summary --keyset ${DEVKEYS} -j 2 \
+  ${TMP}.bios ${TMP}.disk > ${TMP}.both.txt
+cat ${TMP}.bios.txt ${TMP}.disk.txt | cmp - ${TMP}.both.txt
+
+# A damaged keyblock is reported, and fails
+cp ${TMP}.disk ${TMP}.bad.disk
+dd if=/dev/zero of=${TMP}.bad.disk bs=1 seek=$((kern_b * 512 + 64)) \
+  count=16 conv=notrunc
+if ${FUTILITY} show --keys-summary ${TMP}.bad.disk > ${TMP}.bad.txt; then
+  false
+fi
+expect_line ${TMP}.bad.txt "part 4 kernel:" "--invalid--"
+
+#### bad args
+
+if ${FUTILITY} show --keyset ${DEVKEYS} ${TMP}.bios; then false; fi
+if ${FUTILITY} show --keys-summary --keyset /no/such/dir ${TMP}.bios; then
+  false
+fi
+if ${FUTILITY} show --keys-summary ${SCRIPTDIR}/data/random_noise.bin; then
+  false
+fi
+
+# cleanup
+rm -rf ${TMP}*
+exit 0
@@ -70,6 +70,25 @@ ${FUTILITY} verify ${SCRIPTDIR}/data/rec_kernel_part.bin \
   --publickey ${DEVKEYS}/recovery_key.vbpubk
 
 
+#### many files at once
+
+mkdir -p ${TMP}.dir/sub
+cp ${DEVKEYS}/firmware.keyblock ${DEVKEYS}/kernel.keyblock ${TMP}.dir
+cp ${SCRIPTDIR}/data/rec_kernel_part.bin ${TMP}.dir/sub
+
+# Parallel output matches serial output, in the same order
+${FUTILITY} show -r ${TMP}.dir ${DEVKEYS}/root_key.vbpubk > ${TMP}.serial
+${FUTILITY} show -r -j 3 --timing ${TMP}.dir ${DEVKEYS}/root_key.vbpubk \
+  > ${TMP}.parallel 2> ${TMP}.timing
+cmp ${TMP}.serial ${TMP}.parallel
+grep -q '^keyblock  *2 ' ${TMP}.timing
+grep -q '^kernel  *1 ' ${TMP}.timing
+
+# and any failure fails the whole run
+if ${FUTILITY} verify -r -j 2 ${TMP}.dir \
+  --publickey ${DEVKEYS}/root_key.vbpubk ; then false ; fi
+
+
 # cleanup
 rm -rf ${TMP}*
 exit 0
@@ -0,0 +1,194 @@
+#!/bin/bash -eux
+# Copyright 2018 The Chromium OS Authors. All rights reserved.
+# Use of this source code is governed by a BSD-style license that can be
+# found in the LICENSE file.
+
+me=${0##*/}
+TMP="$me.tmp"
+
+# Work in scratch directory
+cd "$OUTDIR"
+
+DEVKEYS=${SRCDIR}/tests/devkeys
+CGPT=${BINDIR}/cgpt
+
+echo "hi there" > ${TMP}.config.txt
+echo "hello boys" > ${TMP}.config2.txt
+dd if=/dev/urandom bs=512 count=1 of=${TMP}.bootloader.bin
+
+# Vblock paddings of the two kernels
+pad_a=65536
+pad_b=49152
+
+# Partition layout, in sectors
+part_sectors=8192
+kern_a=64
+kern_b=$((kern_a + part_sectors))
+kern_c=$((kern_b + part_sectors))
+
+# Two recovery-signed kernels, with different versions and paddings, and
+# body chunk digests in one
+${FUTILITY} sign \
+  --keyblock ${DEVKEYS}/recovery_kernel.keyblock \
+  --signprivate ${DEVKEYS}/recovery_kernel_data_key.vbprivk \
+  --version 3 \
+  --config ${TMP}.config.txt \
+  --bootloader ${TMP}.bootloader.bin \
+  --vmlinuz ${SCRIPTDIR}/data/vmlinuz-amd64.bin \
+  --arch amd64 \
+  --outfile ${TMP}.kern_a
+${FUTILITY} sign \
+  --keyblock ${DEVKEYS}/recovery_kernel.keyblock \
+  --signprivate ${DEVKEYS}/recovery_kernel_data_key.vbprivk \
+  --version 5 \
+  --flags 0x1 \
+  --pad ${pad_b} \
+  --body_chunk_size 0x8000 \
+  --config ${TMP}.config.txt \
+  --bootloader ${TMP}.bootloader.bin \
+  --vmlinuz ${SCRIPTDIR}/data/vmlinuz-amd64.bin \
+  --arch amd64 \
+  --outfile ${TMP}.kern_b
+
+# Put them in a disk image. KERN-C is left empty, as on a fresh image.
+dd if=/dev/zero bs=512 count=$((kern_c + part_sectors + 64)) of=${TMP}.disk
+${CGPT} create ${TMP}.disk
+${CGPT} add -i 2 -t kernel -b ${kern_a} -s ${part_sectors} -l KERN-A \
+  ${TMP}.disk
+${CGPT} add -i 4 -t kernel -b ${kern_b} -s ${part_sectors} -l KERN-B \
+  ${TMP}.disk
+${CGPT} add -i 6 -t kernel -b ${kern_c} -s ${part_sectors} -l KERN-C \
+  ${TMP}.disk
+dd if=${TMP}.kern_a of=${TMP}.disk bs=512 seek=${kern_a} conv=notrunc
+dd if=${TMP}.kern_b of=${TMP}.disk bs=512 seek=${kern_b} conv=notrunc
+cp ${TMP}.disk ${TMP}.disk.orig
+
+# Args are <disk image>, <partition start>, <output file>
+extract_part() {
+  dd if="$1" of="$3" bs=512 skip="$2" count=${part_sectors}
+}
+
+# The disk images are recognized as such
+${FUTILITY} show -t ${TMP}.disk | grep -q 'disk_img'
+
+# Resign in place, letting futility figure out what it's looking at
+${FUTILITY} --debug sign \
+  --signprivate ${DEVKEYS}/kernel_data_key.vbprivk \
+  --keyblock ${DEVKEYS}/kernel.keyblock \
+  ${TMP}.disk
+
+# Each kernel should match what resigning it by itself gives
+for part in a b; do
+  start=kern_${part}
+  pad=pad_${part}
+  extract_part ${TMP}.disk.orig ${!start} ${TMP}.part_${part}
+  ${FUTILITY} sign \
+    --signprivate ${DEVKEYS}/kernel_data_key.vbprivk \
+    --keyblock ${DEVKEYS}/kernel.keyblock \
+    --pad ${!pad} \
+    ${TMP}.part_${part}
+  extract_part ${TMP}.disk ${!start} ${TMP}.disk_${part}
+  cmp ${TMP}.part_${part} ${TMP}.disk_${part}
+  ${FUTILITY} vbutil_kernel --verify ${TMP}.disk_${part} \
+    --pad ${!pad} \
+    --signpubkey ${DEVKEYS}/kernel_subkey.vbpubk > ${TMP}.verify_${part}
+done
+
+# The version, flags and chunk digests of each partition are kept
+grep -q 'Kernel version: *3' ${TMP}.verify_a
+grep -q 'Kernel version: *5' ${TMP}.verify_b
+grep -q 'Flags *: *0x1' ${TMP}.verify_b
+if grep -q 'Body chunk size' ${TMP}.verify_a; then false; fi
+grep -q 'Body chunk size: *0x8000' ${TMP}.verify_b
+
+# The GPT and the empty KERN-C are untouched
+cmp -n $((kern_a * 512)) ${TMP}.disk.orig ${TMP}.disk
+extract_part ${TMP}.disk.orig ${kern_c} ${TMP}.part_c
+extract_part ${TMP}.disk ${kern_c} ${TMP}.disk_c
+cmp ${TMP}.part_c ${TMP}.disk_c
+
+# All the kernels on the disk verify at once, against the right key only
+${FUTILITY} verify --publickey ${DEVKEYS}/kernel_subkey.vbpubk \
+  ${TMP}.disk > ${TMP}.verify_disk
+[ "$(grep -c 'Body verification succeeded' ${TMP}.verify_disk)" = "2" ]
+grep -q 'Kernel partition 6 (KERN-C): not signed' ${TMP}.verify_disk
+grep -A3 'Kernel partition 4 (KERN-B)' ${TMP}.verify_disk |
+  grep -q 'Kernel version: *5'
+if ${FUTILITY} verify --publickey ${DEVKEYS}/recovery_key.vbpubk \
+  ${TMP}.disk; then false; fi
+if ${FUTILITY} verify ${TMP}.disk; then false; fi
+${FUTILITY} show ${TMP}.disk | grep -q 'Signature: *ignored'
+
+# A corrupted body is caught
+cp ${TMP}.disk ${TMP}.disk.bad
+dd if=/dev/urandom of=${TMP}.disk.bad bs=512 count=1 conv=notrunc \
+  seek=$((kern_b + pad_b / 512 + 16))
+if ${FUTILITY} verify --publickey ${DEVKEYS}/kernel_subkey.vbpubk \
+  ${TMP}.disk.bad > ${TMP}.verify_bad; then false; fi
+grep -A1 'Kernel partition 4 (KERN-B)' ${TMP}.verify_bad |
+  grep -q 'body is invalid'
+
+# A disk this big is verified through reads of its GPT and kernel
+# partitions rather than being mapped, with the same results
+truncate -s 256M ${TMP}.big
+${CGPT} create ${TMP}.big
+${CGPT} add -i 2 -t kernel -b ${kern_a} -s ${part_sectors} -l KERN-A \
+  ${TMP}.big
+${CGPT} add -i 4 -t kernel -b ${kern_b} -s ${part_sectors} -l KERN-B \
+  ${TMP}.big
+${CGPT} add -i 6 -t kernel -b ${kern_c} -s ${part_sectors} -l KERN-C \
+  ${TMP}.big
+dd if=${TMP}.disk of=${TMP}.big bs=512 skip=${kern_a} seek=${kern_a} \
+  count=$((3 * part_sectors)) conv=notrunc
+${FUTILITY} show -t ${TMP}.big | grep -q 'disk_img'
+${FUTILITY} verify --publickey ${DEVKEYS}/kernel_subkey.vbpubk \
+  ${TMP}.big > ${TMP}.verify_big
+diff <(grep -v -e Time -e 'Disk image' ${TMP}.verify_disk) \
+  <(grep -v -e Time -e 'Disk image' ${TMP}.verify_big)
+dd if=/dev/urandom of=${TMP}.big bs=512 count=1 conv=notrunc \
+  seek=$((kern_b + pad_b / 512 + 16))
+if ${FUTILITY} verify --publickey ${DEVKEYS}/kernel_subkey.vbpubk \
+  ${TMP}.big > ${TMP}.verify_big; then false; fi
+grep -A1 'Kernel partition 4 (KERN-B)' ${TMP}.verify_big |
+  grep -q 'body is invalid'
+
+# Now to a new file, asking for a kernel and a new version and config
+cp ${TMP}.disk.orig ${TMP}.disk.copy
+${FUTILITY} sign --type kernel \
+  --signprivate ${DEVKEYS}/recovery_kernel_data_key.vbprivk \
+  --version 7 \
+  --config ${TMP}.config2.txt \
+  ${TMP}.disk.orig ${TMP}.disk2
+cmp ${TMP}.disk.orig ${TMP}.disk.copy
+for part in a b; do
+  start=kern_${part}
+  pad=pad_${part}
+  extract_part ${TMP}.disk2 ${!start} ${TMP}.disk2_${part}
+  # The keyblock wasn't replaced, so these are still recovery kernels
+  ${FUTILITY} vbutil_kernel --verify ${TMP}.disk2_${part} \
+    --pad ${!pad} \
+    --signpubkey ${DEVKEYS}/recovery_key.vbpubk > ${TMP}.verify2_${part}
+  grep -q 'Kernel version: *7' ${TMP}.verify2_${part}
+  grep -q 'hello boys' ${TMP}.verify2_${part}
+done
+
+# Things that should fail
+if ${FUTILITY} sign --type disk_img ${TMP}.disk; then false; fi
+if ${FUTILITY} sign --type disk_img --vblockonly \
+  --signprivate ${DEVKEYS}/kernel_data_key.vbprivk \
+  ${TMP}.disk ${TMP}.vblock; then false; fi
+if ${FUTILITY} sign --type disk_img \
+  --signprivate ${DEVKEYS}/kernel_data_key.vbprivk \
+  ${TMP}.kern_a; then false; fi
+
+# A disk with no signed kernels has nothing to sign
+dd if=/dev/zero bs=512 count=$((kern_c + part_sectors + 64)) of=${TMP}.empty
+${CGPT} create ${TMP}.empty
+${CGPT} add -i 2 -t kernel -b ${kern_a} -s ${part_sectors} -l KERN-A \
+  ${TMP}.empty
+if ${FUTILITY} sign --signprivate ${DEVKEYS}/kernel_data_key.vbprivk \
+  ${TMP}.empty; then false; fi
+
+# cleanup
+rm -rf ${TMP}*
+exit 0
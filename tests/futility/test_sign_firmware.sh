@@ -149,7 +149,7 @@ cmp ${TMP}.onemore.body ${TMP}.good.fw_main
 
 
 # Sign the last one again but don't specify the version or the preamble flags.
-# The version should default to 1, but the preamble flags should be preserved.
+# Both should be preserved.
 : $(( count++ ))
 echo -n "$count " 1>&3
 
@@ -161,11 +161,29 @@ ${FUTILITY} sign \
   ${MORE_OUT} ${MORE_OUT}.2
 
 m=$(${FUTILITY} verify --publickey ${KEYDIR}/root_key.vbpubk ${MORE_OUT}.2 \
-  | egrep 'Firmware version: +1$|Preamble flags: +8$' | wc -l)
+  | egrep 'Firmware version: +14$|Preamble flags: +8$' | wc -l)
 [ "$m" = "4" ]
 
 
-# If the original preamble is not present, the preamble flags should be zero.
+# Re-signing with the body digests from the old preambles should give the same
+# result as rehashing the bodies.
+: $(( count++ ))
+echo -n "$count " 1>&3
+
+${FUTILITY} --debug sign \
+  -s ${KEYDIR}/firmware_data_key.vbprivk \
+  -b ${KEYDIR}/firmware.keyblock \
+  ${DEV_FIRMWARE_PARAMS} \
+  -k ${KEYDIR}/kernel_subkey.vbpubk \
+  --reuse_body_hash \
+  ${MORE_OUT} ${MORE_OUT}.reuse > ${TMP}.reuse.log
+
+cmp ${MORE_OUT}.2 ${MORE_OUT}.reuse
+[ "$(grep -c 'reusing .* body digest' ${TMP}.reuse.log)" = "2" ]
+
+
+# If the original preamble is not present, the version should default to 1 and
+# the preamble flags should be zero.
 : $(( count++ ))
 echo -n "$count " 1>&3
 
@@ -41,6 +41,27 @@ ${FUTILITY} --debug sign \
 # They should match
 cmp ${TMP}.vblock.old ${TMP}.vblock.new
 
+# and in a batch, sharing the keys between jobs
+KEYS="-s ${KEYDIR}/firmware_data_key.vbprivk -b ${KEYDIR}/firmware.keyblock"
+KEYS="${KEYS} -k ${KEYDIR}/kernel_subkey.vbpubk"
+cat > ${TMP}.batch <<EOF
+# comment
+${KEYS} --version 12 --flags 42 --fv ${TMP}.fw_main ${TMP}.vblock.batch1
+
+${KEYS} -v 12 -f 42 ${TMP}.fw_main '${TMP}.vblock.batch2'
+--type fwblob -s ${KEYDIR}/firmware_data_key.vbprivk ${TMP}.fw_main ${TMP}.vblock.batch3
+EOF
+if ${FUTILITY} sign --batch - < ${TMP}.batch > ${TMP}.batch.out; then
+  false
+fi
+cmp ${TMP}.vblock.old ${TMP}.vblock.batch1
+cmp ${TMP}.vblock.old ${TMP}.vblock.batch2
+[ ! -e ${TMP}.vblock.batch3 ]
+[ "$(grep -c '"status":"ok"' ${TMP}.batch.out)" = 2 ]
+grep -q '"job":3,"line":5,.*"status":"failed"' ${TMP}.batch.out
+grep -q "\"output\":\"${TMP}.vblock.batch2\",\"type\":\"fwblob\"" \
+  ${TMP}.batch.out
+
 # cleanup
 rm -rf ${TMP}*
 exit 0
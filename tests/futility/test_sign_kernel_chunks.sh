@@ -0,0 +1,92 @@
+#!/bin/bash -eux
+# Copyright 2018 The Chromium OS Authors. All rights reserved.
+# Use of this source code is governed by a BSD-style license that can be
+# found in the LICENSE file.
+
+me=${0##*/}
+TMP="$me.tmp"
+
+# Work in scratch directory
+cd "$OUTDIR"
+
+DEVKEYS=${SRCDIR}/tests/devkeys
+
+echo "hi there" > ${TMP}.config.txt
+dd if=/dev/urandom bs=512 count=1 of=${TMP}.bootloader.bin
+
+# A new kernel, with a digest for each 16K of the blob
+${FUTILITY} sign \
+  --keyblock ${DEVKEYS}/kernel.keyblock \
+  --signprivate ${DEVKEYS}/kernel_data_key.vbprivk \
+  --version 1 \
+  --config ${TMP}.config.txt \
+  --bootloader ${TMP}.bootloader.bin \
+  --vmlinuz ${SCRIPTDIR}/data/vmlinuz-amd64.bin \
+  --arch amd64 \
+  --body_chunk_size 0x4000 \
+  --outfile ${TMP}.kern
+${FUTILITY} show --publickey ${DEVKEYS}/kernel_subkey.vbpubk \
+  ${TMP}.kern > ${TMP}.show
+grep -q 'Header version: *2.3' ${TMP}.show
+grep -q 'Body chunk size: *0x4000' ${TMP}.show
+grep -q 'Body verification succeeded' ${TMP}.show
+
+# One digest per chunk, the last one short
+body=$(sed -n 's/^ *Body size: *0x\([0-9a-f]*\)$/\1/p' ${TMP}.show)
+chunks=$(( (0x${body} + 0x3fff) / 0x4000 ))
+grep -q "Body chunks: *${chunks}\$" ${TMP}.show
+
+# The blob is the same as without digests; only the vblock grows
+${FUTILITY} sign \
+  --keyblock ${DEVKEYS}/kernel.keyblock \
+  --signprivate ${DEVKEYS}/kernel_data_key.vbprivk \
+  --version 1 \
+  --config ${TMP}.config.txt \
+  --bootloader ${TMP}.bootloader.bin \
+  --vmlinuz ${SCRIPTDIR}/data/vmlinuz-amd64.bin \
+  --arch amd64 \
+  --outfile ${TMP}.kern_plain
+${FUTILITY} show --publickey ${DEVKEYS}/kernel_subkey.vbpubk \
+  ${TMP}.kern_plain > ${TMP}.show_plain
+grep -q 'Header version: *2.2' ${TMP}.show_plain
+if grep -q 'Body chunk' ${TMP}.show_plain; then false; fi
+cmp <(tail -c +65537 ${TMP}.kern) <(tail -c +65537 ${TMP}.kern_plain)
+
+# Resigning keeps the digests, unless asked not to
+${FUTILITY} sign \
+  --signprivate ${DEVKEYS}/kernel_data_key.vbprivk \
+  --version 2 \
+  ${TMP}.kern ${TMP}.kern2
+${FUTILITY} vbutil_kernel --verify ${TMP}.kern2 \
+  --signpubkey ${DEVKEYS}/kernel_subkey.vbpubk > ${TMP}.verify2
+grep -q 'Body chunk size: *0x4000' ${TMP}.verify2
+grep -q 'Kernel version: *2' ${TMP}.verify2
+${FUTILITY} sign \
+  --signprivate ${DEVKEYS}/kernel_data_key.vbprivk \
+  --body_chunk_size 0 \
+  ${TMP}.kern ${TMP}.kern3
+${FUTILITY} show ${TMP}.kern3 | grep -q 'Header version: *2.2'
+${FUTILITY} sign \
+  --signprivate ${DEVKEYS}/kernel_data_key.vbprivk \
+  --body_chunk_size 0x1000 \
+  ${TMP}.kern_plain ${TMP}.kern4
+${FUTILITY} show ${TMP}.kern4 | grep -q 'Body chunk size: *0x1000'
+
+# A corrupted chunk is caught
+cp ${TMP}.kern ${TMP}.kern.bad
+dd if=/dev/urandom of=${TMP}.kern.bad bs=512 count=1 conv=notrunc \
+  seek=$((65536 / 512 + 40))
+if ${FUTILITY} show --publickey ${DEVKEYS}/kernel_subkey.vbpubk \
+  ${TMP}.kern.bad; then false; fi
+if ${FUTILITY} vbutil_kernel --verify ${TMP}.kern.bad \
+  --signpubkey ${DEVKEYS}/kernel_subkey.vbpubk; then false; fi
+
+# Chunks must be whole pages
+if ${FUTILITY} sign \
+  --signprivate ${DEVKEYS}/kernel_data_key.vbprivk \
+  --body_chunk_size 1000 \
+  ${TMP}.kern ${TMP}.kern5; then false; fi
+
+# cleanup
+rm -rf ${TMP}*
+exit 0
@@ -104,6 +104,17 @@ ${FUTILITY} --debug sign \
 
 cmp ${TMP}.keyblock4 ${TMP}.keyblock5
 
+# and with one persistent signer shared by a batch of jobs
+JOB="--pem_signpriv ${TESTKEYS}/key_rsa4096.pem --pem_algo 8 --flags 19"
+JOB="${JOB} --pem_external ${SIGNER} --pem_persistent"
+JOB="${JOB} ${DEVKEYS}/firmware_data_key.vbpubk"
+printf "%s\n" "${JOB} ${TMP}.keyblock6" "${JOB} ${TMP}.keyblock7" | \
+  SIGNER_LOG=${TMP}.signer_log ${FUTILITY} sign --batch -
+
+cmp ${TMP}.keyblock4 ${TMP}.keyblock6
+cmp ${TMP}.keyblock4 ${TMP}.keyblock7
+[ "$(wc -l < ${TMP}.signer_log)" = 1 ]
+
 
 # cleanup
 rm -rf ${TMP}*
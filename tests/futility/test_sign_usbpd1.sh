@@ -51,6 +51,35 @@ for test in $TESTS; do
 
 done
 
+# Several copies of one image signed in place at once should all come out
+# the same as signing it by itself
+test=zinger
+for i in 1 2 3 4 5; do
+    cp ${DATADIR}/${test}.unsigned ${TMP}.multi_${i}
+done
+${FUTILITY} sign --type usbpd1 --pem ${DATADIR}/${test}.pem --multi \
+    --jobs 3 ${TMP}.multi_*
+for i in 1 2 3 4 5; do
+    cmp ${DATADIR}/${test}.signed ${TMP}.multi_${i}
+done
+
+# Each image gets its own signature even when they differ, and the number of
+# threads doesn't matter
+cp ${DATADIR}/dingdong.unsigned ${TMP}.multi_2
+${FUTILITY} sign --type usbpd1 --pem ${DATADIR}/dingdong.pem --multi \
+    --ro_size 0 --jobs 1 ${TMP}.multi_2
+${FUTILITY} sign --type usbpd1 --pem ${DATADIR}/dingdong.pem --ro_size 0 \
+    ${DATADIR}/dingdong.unsigned ${TMP}.multi_2.good
+cmp ${TMP}.multi_2.good ${TMP}.multi_2
+
+# Things that should fail
+if ${FUTILITY} sign --type usbpd1 --pem ${DATADIR}/${test}.pem --multi \
+    --outfile ${TMP}.x ${TMP}.multi_1; then false; fi
+if ${FUTILITY} sign --type usbpd1 --pem ${DATADIR}/${test}.pem --multi \
+    ${TMP}.multi_1 ${TMP}.missing; then false; fi
+if ${FUTILITY} sign --type usbpd1 --pem ${DATADIR}/${test}.pem --multi \
+    --jobs 0 ${TMP}.multi_1; then false; fi
+
 # cleanup
 rm -rf ${TMP}*
 exit 0
@@ -0,0 +1,72 @@
+#!/bin/bash -eux
+# Copyright 2018 The Chromium OS Authors. All rights reserved.
+# Use of this source code is governed by a BSD-style license that can be
+# found in the LICENSE file.
+
+me=${0##*/}
+TMP="$me.tmp"
+
+# Work in scratch directory
+cd "$OUTDIR"
+
+KEYDIR=${SRCDIR}/tests/devkeys
+IN=${SCRIPTDIR}/data/bios_peppy_mp.bin
+OLD=${TMP}.old.bin
+NEW=${TMP}.new.bin
+
+# A properly signed image to start from, and a copy with new RW firmware
+cp ${IN} ${OLD}
+${FUTILITY} gbb -s -k ${KEYDIR}/root_key.vbpubk ${OLD}
+${FUTILITY} sign -s ${KEYDIR}/firmware_data_key.vbprivk \
+  -b ${KEYDIR}/firmware.keyblock -k ${KEYDIR}/kernel_subkey.vbpubk ${OLD}
+
+cp ${OLD} ${NEW}
+${FUTILITY} dump_fmap -x ${NEW} FW_MAIN_A
+dd if=/dev/urandom of=FW_MAIN_A.rand bs=4096 count=2
+${FUTILITY} load_fmap ${NEW} FW_MAIN_A:FW_MAIN_A.rand FW_MAIN_B:FW_MAIN_A.rand
+${FUTILITY} sign -s ${KEYDIR}/firmware_data_key.vbprivk \
+  -b ${KEYDIR}/firmware.keyblock -k ${KEYDIR}/kernel_subkey.vbpubk ${NEW}
+
+# Nothing to do for an identical image
+cp ${OLD} ${TMP}.target
+${FUTILITY} update ${OLD} ${TMP}.target | grep "Wrote 0 of"
+
+# A dry run reports the changed blocks and leaves the target alone
+${FUTILITY} update -n -v ${NEW} ${TMP}.target > ${TMP}.dry
+grep -q "FW_MAIN_A" ${TMP}.dry
+grep -q "VBLOCK_A" ${TMP}.dry
+cmp ${OLD} ${TMP}.target
+
+# Only the changed blocks are written, and the result is the new image
+${FUTILITY} update ${NEW} ${TMP}.target > ${TMP}.out
+grep -q "Wrote" ${TMP}.out
+cmp ${NEW} ${TMP}.target
+if grep -q "Wrote 0 of" ${TMP}.out; then false; fi
+
+# Updating just one area leaves the rest of the target as it was
+cp ${OLD} ${TMP}.target
+${FUTILITY} update --no-verify -i VBLOCK_A ${NEW} ${TMP}.target
+${FUTILITY} dump_fmap -x ${TMP}.target VBLOCK_A FW_MAIN_A
+mv VBLOCK_A VBLOCK_A.target
+mv FW_MAIN_A FW_MAIN_A.target
+${FUTILITY} dump_fmap -x ${NEW} VBLOCK_A
+cmp VBLOCK_A VBLOCK_A.target
+${FUTILITY} dump_fmap -x ${OLD} FW_MAIN_A
+cmp FW_MAIN_A FW_MAIN_A.target
+
+# An image which doesn't verify isn't written
+cp ${NEW} ${TMP}.bad
+dd if=/dev/urandom of=FW_MAIN_A.rand.2 bs=4096 count=2
+${FUTILITY} load_fmap ${TMP}.bad FW_MAIN_A:FW_MAIN_A.rand.2
+cp ${OLD} ${TMP}.target
+if ${FUTILITY} update ${TMP}.bad ${TMP}.target; then false; fi
+cmp ${OLD} ${TMP}.target
+
+# Sizes must match, and areas must exist
+head -c 4096 ${OLD} > ${TMP}.short
+if ${FUTILITY} update ${NEW} ${TMP}.short; then false; fi
+if ${FUTILITY} update -i NO_SUCH_AREA ${NEW} ${TMP}.target; then false; fi
+
+# cleanup
+rm -f ${TMP}* FW_MAIN_A* VBLOCK_A*
+exit 0
@@ -0,0 +1,104 @@
+#!/bin/bash -eux
+# Copyright 2018 The Chromium OS Authors. All rights reserved.
+# Use of this source code is governed by a BSD-style license that can be
+# found in the LICENSE file.
+
+me=${0##*/}
+TMP="$me.tmp"
+
+# Work in scratch directory
+cd "$OUTDIR"
+
+# A payload just big enough for a two-level tree
+blocks=200
+salt=0123456789abcdef
+dd if=/dev/urandom bs=4096 count=${blocks} of=${TMP}.rootfs
+
+# Turn a hex string into bytes
+unhex() {
+  printf "$(echo "$1" | sed 's/../\\x&/g')"
+}
+
+# Print the salted sha256 of each 4K block read from stdin, packed into 4K
+# blocks. Args are <input> <block count>
+hash_level() {
+  local i
+  for i in $(seq 0 $(($2 - 1))); do
+    { dd if="$1" bs=4096 skip=$i count=1 2>/dev/null; unhex ${salt}; } |
+      sha256sum | cut -d ' ' -f 1
+  done
+}
+pack() {
+  local out=$1
+  rm -f "${out}"
+  while read hex; do
+    unhex ${hex} >> "${out}"
+  done
+  truncate -s %4096 "${out}"
+}
+
+# Build the reference tree the slow way: the leaves, then the root block.
+# The kernel pads the salt to 32 bytes.
+salt=${salt}$(printf '0%.0s' $(seq 1 48))
+hash_level ${TMP}.rootfs ${blocks} | pack ${TMP}.leaves
+leaf_blocks=$(($(stat -c %s ${TMP}.leaves) / 4096))
+[ "${leaf_blocks}" = "2" ]
+hash_level ${TMP}.leaves ${leaf_blocks} | pack ${TMP}.top
+root=$(hash_level ${TMP}.top 1)
+cat ${TMP}.top ${TMP}.leaves > ${TMP}.tree.expect
+
+# Now futility's turn, with a separate hash tree file
+${FUTILITY} verity --salt ${salt} --jobs 3 \
+  ${TMP}.rootfs ${TMP}.tree > ${TMP}.table
+cmp ${TMP}.tree.expect ${TMP}.tree
+sectors=$((blocks * 8))
+[ "$(cat ${TMP}.table)" = "0 ${sectors} verity payload=ROOT_DEV \
+hashtree=HASH_DEV hashstart=${sectors} alg=sha256 root_hexdigest=${root} \
+salt=${salt}" ]
+
+# The number of threads doesn't matter
+${FUTILITY} verity --salt ${salt} --jobs 1 \
+  ${TMP}.rootfs ${TMP}.tree1 > ${TMP}.table1
+cmp ${TMP}.tree ${TMP}.tree1
+cmp ${TMP}.table ${TMP}.table1
+
+# Update a kernel command line, taking the parameters from it. The hash
+# tree goes after the payload, where the old one was.
+cat ${TMP}.rootfs ${TMP}.tree > ${TMP}.rootfs2
+dd if=/dev/urandom of=${TMP}.rootfs2 bs=4096 seek=${blocks} count=3 \
+  conv=notrunc
+dmargs="1 vroot none ro 1,0 ${sectors} verity payload=PARTUUID=%U/PARTNROFF=1"
+dmargs+=" hashtree=PARTUUID=%U/PARTNROFF=1 hashstart=${sectors} alg=sha256"
+echo "console= dm=\"${dmargs} root_hexdigest=1234 salt=${salt}\" quiet" \
+  > ${TMP}.config
+${FUTILITY} verity --config ${TMP}.config ${TMP}.rootfs2
+cmp ${TMP}.rootfs2 <(cat ${TMP}.rootfs ${TMP}.tree)
+[ "$(cat ${TMP}.config)" = "console= dm=\"${dmargs} \
+root_hexdigest=${root} salt=${salt}\" quiet" ]
+
+# A new salt is added to the config, and changes everything
+echo "dm=\"${dmargs} root_hexdigest=1234\"" > ${TMP}.config2
+${FUTILITY} verity --config ${TMP}.config2 --salt 00 \
+  ${TMP}.rootfs ${TMP}.tree2
+if cmp ${TMP}.tree ${TMP}.tree2; then false; fi
+grep -q "root_hexdigest=[0-9a-f]\{64\} salt=0\{64\}\"" ${TMP}.config2
+if grep -q "root_hexdigest=${root}" ${TMP}.config2; then false; fi
+
+# Without a salt it's different again, and sha1 is shorter
+${FUTILITY} verity ${TMP}.rootfs ${TMP}.tree3 | grep -v salt=
+if cmp ${TMP}.tree ${TMP}.tree3; then false; fi
+${FUTILITY} verity --alg sha1 ${TMP}.rootfs ${TMP}.tree4 |
+  grep "alg=sha1 root_hexdigest=[0-9a-f]\{40\}$"
+
+# Things that should fail
+if ${FUTILITY} verity; then false; fi
+if ${FUTILITY} verity --blocks $((blocks + 1)) ${TMP}.rootfs ${TMP}.x; then
+  false; fi
+if ${FUTILITY} verity --salt xyz ${TMP}.rootfs ${TMP}.x; then false; fi
+echo "quiet" > ${TMP}.config3
+if ${FUTILITY} verity --config ${TMP}.config3 ${TMP}.rootfs ${TMP}.x; then
+  false; fi
+
+# cleanup
+rm -rf ${TMP}*
+exit 0
@@ -0,0 +1,50 @@
+/* Copyright 2018 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ *
+ * Helpers shared by the fuzz targets built with "make fuzzers".
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "2sysincludes.h"
+#include "2common.h"
+#include "2rsa.h"
+#include "fuzz_common.h"
+
+#define FUZZ_RSA_ARRSIZE (2048 / 32)
+
+static uint32_t fuzz_n[FUZZ_RSA_ARRSIZE];
+static uint32_t fuzz_rr[FUZZ_RSA_ARRSIZE];
+
+void *fuzz_copy_input(const uint8_t *data, size_t size)
+{
+	void *buf = malloc(size ? size : 1);
+
+	if (!buf)
+		abort();
+	memcpy(buf, data, size);
+	return buf;
+}
+
+void fuzz_rsa_key(struct vb2_public_key *key)
+{
+	int i;
+
+	/* n = 2^2048 - 1, so n[0] = -1 and -1 / n[0] = 1 */
+	for (i = 0; i < FUZZ_RSA_ARRSIZE; i++) {
+		fuzz_n[i] = 0xffffffff;
+		fuzz_rr[i] = 0;
+	}
+	fuzz_rr[0] = 1;
+
+	memset(key, 0, sizeof(*key));
+	key->arrsize = FUZZ_RSA_ARRSIZE;
+	key->n0inv = 1;
+	key->n = fuzz_n;
+	key->rr = fuzz_rr;
+	key->sig_alg = VB2_SIG_RSA2048;
+	key->hash_alg = VB2_HASH_SHA256;
+	key->desc = "fuzz key";
+}
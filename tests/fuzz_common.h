@@ -0,0 +1,45 @@
+/* Copyright 2018 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ *
+ * Helpers shared by the fuzz targets built with "make fuzzers".
+ */
+
+#ifndef VBOOT_REFERENCE_FUZZ_COMMON_H_
+#define VBOOT_REFERENCE_FUZZ_COMMON_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+struct vb2_public_key;
+
+/* Inputs larger than this are skipped; vboot passes sizes as uint32_t */
+#define FUZZ_MAX_INPUT_SIZE (1 << 20)
+
+/* Entry point implemented by each fuzz target */
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size);
+
+/**
+ * Copy the fuzzer input into an allocation of exactly its size.
+ *
+ * The verifiers take non-const buffers, and an exact-size copy lets the
+ * address sanitizer catch any access past the end of the input.
+ *
+ * @param data		Input data
+ * @param size		Size of input in bytes
+ * @return The copy, which the caller must free().
+ */
+void *fuzz_copy_input(const uint8_t *data, size_t size);
+
+/**
+ * Fill in an RSA-2048 / SHA-256 public key for the verifiers.
+ *
+ * The modulus is an arbitrary odd number, so no input gets past the
+ * signature check.  The fuzzers are aimed at the parsing and bounds checks
+ * which run on untrusted data before the signature is verified.
+ *
+ * @param key		Key to fill in
+ */
+void fuzz_rsa_key(struct vb2_public_key *key);
+
+#endif  /* VBOOT_REFERENCE_FUZZ_COMMON_H_ */
@@ -0,0 +1,93 @@
+/* Copyright 2018 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ *
+ * Stand-in for libFuzzer's main(), used by "make fuzzers FUZZ_DRIVER=1".
+ * Runs the fuzz target once on each file named on the command line, or on
+ * each file in a named directory, so a corpus or a crash can be replayed
+ * with a compiler which doesn't have libFuzzer.
+ */
+
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+
+#include "2sysincludes.h"
+#include "fuzz_common.h"
+#include "host_misc.h"
+
+static int run_file(const char *filename)
+{
+	uint8_t *data;
+	uint32_t size;
+
+	if (vb2_read_file(filename, &data, &size)) {
+		fprintf(stderr, "Can't read %s\n", filename);
+		return -1;
+	}
+
+	LLVMFuzzerTestOneInput(data, size);
+	free(data);
+	return 0;
+}
+
+static int run_path(const char *path, int *count)
+{
+	struct dirent *ent;
+	struct stat sb;
+	char filename[4096];
+	DIR *dir;
+	int rv = 0;
+
+	if (stat(path, &sb)) {
+		fprintf(stderr, "Can't stat %s\n", path);
+		return -1;
+	}
+
+	if (!S_ISDIR(sb.st_mode)) {
+		if (run_file(path))
+			return -1;
+		(*count)++;
+		return 0;
+	}
+
+	dir = opendir(path);
+	if (!dir) {
+		fprintf(stderr, "Can't open directory %s\n", path);
+		return -1;
+	}
+	while ((ent = readdir(dir))) {
+		if (ent->d_name[0] == '.')
+			continue;
+		snprintf(filename, sizeof(filename), "%s/%s",
+			 path, ent->d_name);
+		if (stat(filename, &sb) || !S_ISREG(sb.st_mode))
+			continue;
+		if (run_file(filename))
+			rv = -1;
+		else
+			(*count)++;
+	}
+	closedir(dir);
+	return rv;
+}
+
+int main(int argc, char *argv[])
+{
+	int count = 0;
+	int rv = 0;
+	int i;
+
+	if (argc < 2) {
+		fprintf(stderr, "Usage: %s <file or directory>...\n", argv[0]);
+		return 1;
+	}
+
+	for (i = 1; i < argc; i++)
+		if (run_path(argv[i], &count))
+			rv = 1;
+
+	printf("Ran %d inputs\n", count);
+	return rv;
+}
@@ -22,6 +22,19 @@ TEST_CONFIG_FILE=${TESTCASE_DIR}/testconfig
 # Config size must < 4096
 TEST_CONFIG_SIZE=3000
 
+# Everything this script makes
+TEST_OUTPUTS=(
+  ${TEST_IMAGE_FILE}
+  ${TEST_BOOTLOADER_FILE}
+  ${TEST_CONFIG_FILE}
+  ${TESTCASE_DIR}/firmware.keyblock
+  ${TESTCASE_DIR}/kernel.keyblock
+  ${TESTCASE_DIR}/firmware.vblock
+  ${TESTCASE_DIR}/root_key.vbpubk
+  ${TESTCASE_DIR}/kernel.vblock.image
+  ${TESTCASE_DIR}/firmware_key.vbpubk
+)
+
 function generate_fuzzing_images {
   echo "Generating key blocks..."
   # Firmware key block - RSA8192/SHA512 root key, RSA4096/SHA512 firmware
@@ -80,7 +93,14 @@ function pre_work {
 }
 
 mkdir -p ${TESTCASE_DIR}
-pre_work
 check_test_keys
+cache=$(cache_key "fuzz_testcases $(futility_version)" \
+  ${TESTKEY_DIR}/key_rsa4096.sha*.vbp* ${TESTKEY_DIR}/key_rsa8192.sha*.vbp*)
+if cache_restore ${cache} "${TEST_OUTPUTS[@]}"; then
+  echo "Using cached fuzzing test cases"
+  exit 0
+fi
+pre_work
 generate_fuzzing_images ${TEST_IMAGE_FILE}
+cache_store ${cache} "${TEST_OUTPUTS[@]}"
 
@@ -21,12 +21,18 @@ function generate_test_signatures {
   do
     for hashalgo in ${hash_algos[@]}
     do
-      openssl dgst -${hashalgo} -binary ${TEST_FILE} > \
-        ${TEST_FILE}.${hashalgo}.digest
-      ${BIN_DIR}/signature_digest_utility $algorithmcounter  \
-        ${TEST_FILE} | openssl rsautl \
-        -sign -pkcs -inkey ${TESTKEY_DIR}/key_rsa${keylen}.pem \
-        > ${TEST_FILE}.rsa${keylen}_${hashalgo}.sig
+      key=${TESTKEY_DIR}/key_rsa${keylen}.pem
+      digest=${TEST_FILE}.${hashalgo}.digest
+      sig=${TEST_FILE}.rsa${keylen}_${hashalgo}.sig
+      cache=$(cache_key "rsa${keylen}_${hashalgo} $(openssl_version)" \
+        ${TEST_FILE} ${key})
+      if ! cache_restore ${cache} ${digest} ${sig}; then
+        openssl dgst -${hashalgo} -binary ${TEST_FILE} > ${digest}
+        ${BIN_DIR}/signature_digest_utility $algorithmcounter  \
+          ${TEST_FILE} | openssl rsautl \
+          -sign -pkcs -inkey ${key} > ${sig}
+        cache_store ${cache} ${digest} ${sig}
+      fi
       let algorithmcounter=algorithmcounter+1
     done
   done
@@ -33,10 +33,15 @@ function generate_keys {
         bits="${i%%_exp${exp}}"
     fi
 
-    openssl genrsa -${exp} -out ${key_base}.pem ${bits}
-    # Generate self-signed certificate from key.
-    openssl req -batch -new -x509 -key ${key_base}.pem \
-      -out ${key_base}.crt
+    # Generating the key is the slow part, so reuse a cached one if we can.
+    cache=$(cache_key "key_rsa${i} $(openssl_version)")
+    if ! cache_restore ${cache} ${key_base}.pem ${key_base}.crt; then
+      openssl genrsa -${exp} -out ${key_base}.pem ${bits}
+      # Generate self-signed certificate from key.
+      openssl req -batch -new -x509 -key ${key_base}.pem \
+        -out ${key_base}.crt
+      cache_store ${cache} ${key_base}.pem ${key_base}.crt
+    fi
 
     # Generate pre-processed key for use by RSA signature verification code.
     ${BIN_DIR}/dumpRSAPublicKey -cert ${key_base}.crt \
@@ -64,5 +69,23 @@ function generate_keys {
   done
 }
 
+# Generate an Ed25519 test key, which vb21 structs can use.
+function generate_ed25519_key {
+  key_base="${TESTKEY_DIR}/key_ed25519"
+  if [ -f "${key_base}.pem" ]; then
+    return
+  fi
+
+  cache=$(cache_key "key_ed25519 $(openssl_version)")
+  if cache_restore ${cache} ${key_base}.pem ${key_base}.pub.pem; then
+    return
+  fi
+
+  openssl genpkey -algorithm ed25519 -out ${key_base}.pem
+  openssl pkey -in ${key_base}.pem -pubout -out ${key_base}.pub.pem
+  cache_store ${cache} ${key_base}.pem ${key_base}.pub.pem
+}
+
 mkdir -p ${TESTKEY_DIR}
 generate_keys
+generate_ed25519_key
@@ -73,6 +73,41 @@ static void test_hmac_error(void)
 		  "Invalid algorithm");
 }
 
+static void test_hmac_context(enum vb2_hash_algorithm alg)
+{
+	struct vb2_hmac_context key, hc;
+	uint8_t mac[VB2_MAX_DIGEST_SIZE];
+	uint8_t md[VB2_MAX_DIGEST_SIZE];
+	uint32_t split = 10;
+	int i;
+
+	TEST_SUCC(hmac(alg, long_key, strlen(long_key),
+		       message, strlen(message), md, sizeof(md)),
+		  "One-shot HMAC");
+	TEST_SUCC(vb2_hmac_init(&key, alg, long_key, strlen(long_key)),
+		  "vb2_hmac_init()");
+
+	/* The keyed context can be copied and used more than once */
+	for (i = 0; i < 2; i++) {
+		hc = key;
+		TEST_SUCC(vb2_hmac_update(&hc, message, split),
+			  "vb2_hmac_update() first part");
+		TEST_SUCC(vb2_hmac_update(&hc, message + split,
+					  strlen(message) - split),
+			  "vb2_hmac_update() second part");
+		TEST_SUCC(vb2_hmac_final(&hc, mac, sizeof(mac)),
+			  "vb2_hmac_final()");
+		TEST_SUCC(memcmp(mac, md, vb2_digest_size(alg)),
+			  "Streamed HMAC matches");
+	}
+
+	hc = key;
+	TEST_TRUE(vb2_hmac_update(&hc, NULL, 1), "Update with NULL msg");
+	TEST_TRUE(vb2_hmac_final(&hc, mac, 1), "Final buffer too small");
+	TEST_TRUE(vb2_hmac_init(&hc, -1, short_key, strlen(short_key)),
+		  "Init invalid algorithm");
+}
+
 static void test_hmac(void)
 {
 	int alg;
@@ -86,6 +121,7 @@ static void test_hmac(void)
 				     message, strlen(message));
 		/* Try empty key and message */
 		test_hmac_by_openssl(alg, "", 0, "", 0);
+		test_hmac_context(alg);
 	}
 }
 
@@ -73,3 +73,10 @@ ${BUILD_RUN}/tests/verify_kernel disk.test \
     ${SCRIPT_DIR}/devkeys/kernel_subkey.vbpubk
 
 happy 'Image verification succeeded'
+
+# And run it through the boot path simulator
+echo 'Simulating boot from test disk image'
+${BUILD_RUN}/tests/boot_sim -p usb -n 2 disk.test \
+    ${SCRIPT_DIR}/devkeys/kernel_subkey.vbpubk
+
+happy 'Boot simulation succeeded'
@@ -259,6 +259,26 @@ uint32_t TlclGetPermissions(uint32_t index, uint32_t* permissions)
 	return (++mock_count == fail_at_count) ? fail_with_error : TPM_SUCCESS;
 }
 
+uint32_t TlclBatchRead(uint32_t index, uint32_t length)
+{
+	mock_cnext += sprintf(mock_cnext, "TlclBatchRead(0x%x, %d)\n",
+			      index, length);
+	return (++mock_count == fail_at_count) ? fail_with_error : TPM_SUCCESS;
+}
+
+uint32_t TlclBatchGetPermissions(uint32_t index)
+{
+	mock_cnext += sprintf(mock_cnext, "TlclBatchGetPermissions(0x%x)\n",
+			      index);
+	return (++mock_count == fail_at_count) ? fail_with_error : TPM_SUCCESS;
+}
+
+uint32_t TlclBatchSend(void)
+{
+	mock_cnext += sprintf(mock_cnext, "TlclBatchSend()\n");
+	return (++mock_count == fail_at_count) ? fail_with_error : TPM_SUCCESS;
+}
+
 /****************************************************************************/
 /* Tests for CRC errors  */
 
@@ -512,6 +532,29 @@ static void RollbackKernelTest(void)
 {
 	uint32_t version = 0;
 
+	/* Prefetch */
+	ResetMocks(0, 0);
+	TEST_EQ(RollbackKernelPrefetch(1), 0, "RollbackKernelPrefetch()");
+	TEST_STR_EQ(mock_calls,
+		    "TlclBatchRead(0x1008, 13)\n"
+		    "TlclBatchGetPermissions(0x1008)\n"
+		    "TlclBatchRead(0x100a, 40)\n"
+		    "TlclBatchSend()\n",
+		    "tlcl calls");
+
+	ResetMocks(0, 0);
+	TEST_EQ(RollbackKernelPrefetch(0), 0,
+		"RollbackKernelPrefetch() no FWMP");
+	TEST_STR_EQ(mock_calls,
+		    "TlclBatchRead(0x1008, 13)\n"
+		    "TlclBatchGetPermissions(0x1008)\n"
+		    "TlclBatchSend()\n",
+		    "tlcl calls");
+
+	ResetMocks(4, TPM_E_IOERROR);
+	TEST_EQ(RollbackKernelPrefetch(1), TPM_E_IOERROR,
+		"RollbackKernelPrefetch() error");
+
 	/* Normal read */
 	ResetMocks(0, 0);
 	mock_rsk.uid = ROLLBACK_SPACE_KERNEL_UID;
@@ -560,6 +603,55 @@ static void RollbackKernelTest(void)
 	TEST_EQ(RollbackKernelWrite(123), TPM_E_IOERROR,
 		"RollbackKernelWrite() error");
 
+	/* Write after a good read doesn't read the space again */
+	ResetMocks(0, 0);
+	mock_rsk.uid = ROLLBACK_SPACE_KERNEL_UID;
+	mock_permissions = TPM_NV_PER_PPWRITE;
+	TEST_EQ(RollbackKernelRead(&version), 0, "RollbackKernelRead()");
+	*mock_calls = 0;
+	mock_cnext = mock_calls;
+	TEST_EQ(RollbackKernelWrite(0xBEAD1234), 0,
+		"RollbackKernelWrite() after read");
+	TEST_EQ(mock_rsk.kernel_versions, 0xBEAD1234,
+		"RollbackKernelWrite() version");
+	TEST_EQ(mock_rsk.uid, ROLLBACK_SPACE_KERNEL_UID,
+		"RollbackKernelWrite() uid");
+	TEST_STR_EQ(mock_calls,
+		    "TlclWrite(0x1008, 13)\n"
+		    "TlclRead(0x1008, 13)\n",
+		    "tlcl calls");
+
+	/* Nor does a second write */
+	*mock_calls = 0;
+	mock_cnext = mock_calls;
+	TEST_EQ(RollbackKernelWrite(0xBEAD5678), 0,
+		"RollbackKernelWrite() again");
+	TEST_EQ(mock_rsk.kernel_versions, 0xBEAD5678,
+		"RollbackKernelWrite() version");
+	TEST_STR_EQ(mock_calls,
+		    "TlclWrite(0x1008, 13)\n"
+		    "TlclRead(0x1008, 13)\n",
+		    "tlcl calls");
+
+	/* Writing the version the space already holds doesn't touch the TPM */
+	*mock_calls = 0;
+	mock_cnext = mock_calls;
+	TEST_EQ(RollbackKernelWrite(0xBEAD5678), 0,
+		"RollbackKernelWrite() same version");
+	TEST_STR_EQ(mock_calls, "", "tlcl calls");
+
+	/* A failed write makes the next one read first */
+	ResetMocks(1, TPM_E_IOERROR);
+	TEST_EQ(RollbackKernelWrite(123), TPM_E_IOERROR,
+		"RollbackKernelWrite() error");
+	ResetMocks(0, 0);
+	TEST_EQ(RollbackKernelWrite(0xBEAD4321), 0, "RollbackKernelWrite()");
+	TEST_STR_EQ(mock_calls,
+		    "TlclRead(0x1008, 13)\n"
+		    "TlclWrite(0x1008, 13)\n"
+		    "TlclRead(0x1008, 13)\n",
+		    "tlcl calls");
+
 	/* Test lock (recovery off) */
 	ResetMocks(1, TPM_E_IOERROR);
 	TEST_EQ(RollbackKernelLock(0), TPM_E_IOERROR,
@@ -0,0 +1,191 @@
+/* Copyright 2018 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ *
+ * Measures the cost of verifying an RSA signature with each key size, using
+ * the keys in tests/testkeys.
+ *
+ * Each verify is timed with a warm work buffer, reused from the last verify,
+ * and with a cold one, evicted from the caches first.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__i386__) || defined(__x86_64__)
+#include <x86intrin.h>
+#define HAVE_TSC 1
+#endif
+
+#include "2sysincludes.h"
+#include "2common.h"
+#include "2rsa.h"
+#include "2sha.h"
+#include "host_common.h"
+#include "host_key.h"
+#include "host_key2.h"
+#include "host_signature.h"
+#include "timer_utils.h"
+#include "vb2_common.h"
+
+/* Verify repeatedly until at least this much time has been measured */
+#define MIN_TEST_MSECS 500
+
+/* Largest signature we time */
+#define MAX_SIG_SIZE (8192 / 8)
+
+/*
+ * Writing this much evicts the work buffer from the caches.  That takes
+ * longer than verifying, so cold verifies are only done this many times.
+ */
+#define COLD_BUFFER_SIZE (8 * 1024 * 1024)
+#define COLD_PASSES 200
+
+static const uint8_t test_data[] = "This is some test data to sign.";
+
+/* The algorithms to time; each signs a SHA-256 digest */
+static const struct {
+	enum vb2_signature_algorithm sig_alg;
+	enum vb2_crypto_algorithm crypto_alg;
+} algs[] = {
+	{VB2_SIG_RSA1024, VB2_ALG_RSA1024_SHA256},
+	{VB2_SIG_RSA2048, VB2_ALG_RSA2048_SHA256},
+	{VB2_SIG_RSA4096, VB2_ALG_RSA4096_SHA256},
+	{VB2_SIG_RSA8192, VB2_ALG_RSA8192_SHA256},
+	{VB2_SIG_RSA2048_EXP3, VB2_ALG_RSA2048_EXP3_SHA256},
+	{VB2_SIG_RSA3072_EXP3, VB2_ALG_RSA3072_EXP3_SHA256},
+};
+
+static uint8_t workbuf[VB2_VERIFY_RSA_DIGEST_WORKBUF_BYTES]
+	__attribute__ ((aligned (VB2_WORKBUF_ALIGN)));
+
+static void evict_caches(uint8_t *cold_buffer)
+{
+	static uint8_t fill;
+
+	memset(cold_buffer, ++fill, COLD_BUFFER_SIZE);
+}
+
+/**
+ * Time verifies with one key, and print the results.
+ *
+ * @return 0 if success, non-zero if a verify failed.
+ */
+static int time_verify(const char *name, const char *temp,
+		       const struct vb2_public_key *key,
+		       struct vb2_signature *sig,
+		       const uint8_t *digest,
+		       uint8_t *cold_buffer)
+{
+	uint8_t sig_work[MAX_SIG_SIZE];
+	struct vb2_workbuf wb;
+	ClockTimerState ct;
+	uint64_t passes = 0;
+	uint64_t nsecs = 0;
+	double verifies_per_sec;
+#ifdef HAVE_TSC
+	uint64_t cycles = 0;
+	uint64_t tsc_start;
+#endif
+
+	vb2_workbuf_init(&wb, workbuf, sizeof(workbuf));
+
+	do {
+		memcpy(sig_work, vb2_signature_data(sig), sig->sig_size);
+		if (cold_buffer)
+			evict_caches(cold_buffer);
+
+		StartTimer(&ct);
+#ifdef HAVE_TSC
+		tsc_start = __rdtsc();
+#endif
+		if (vb2_rsa_verify_digest(key, sig_work, digest, &wb)) {
+			fprintf(stderr, "# %s verify failed\n", name);
+			return 1;
+		}
+#ifdef HAVE_TSC
+		cycles += __rdtsc() - tsc_start;
+#endif
+		StopTimer(&ct);
+		nsecs += GetDurationNsecs(&ct);
+		passes++;
+	} while (cold_buffer ? passes < COLD_PASSES :
+		 nsecs / 1000000 < MIN_TEST_MSECS);
+
+	verifies_per_sec = passes * 1e9 / nsecs;
+	fprintf(stderr, "# %s %s: %f verifies/sec\n",
+		name, temp, verifies_per_sec);
+	fprintf(stdout, "verifies_per_sec_%s_%s:%f\n",
+		name, temp, verifies_per_sec);
+#ifdef HAVE_TSC
+	fprintf(stdout, "cycles_per_verify_%s_%s:%f\n",
+		name, temp, (double)cycles / passes);
+#endif
+
+	return 0;
+}
+
+/*
+ * Usage: rsa_benchmark [keys_dir]
+ */
+int main(int argc, char *argv[])
+{
+	const char *keys_dir = argc > 1 ? argv[1] : "tests/testkeys";
+	uint8_t *cold_buffer = malloc(COLD_BUFFER_SIZE);
+	uint8_t digest[VB2_SHA256_DIGEST_SIZE];
+	char filename[1024];
+	int rv = 0;
+	int i;
+
+	if (!cold_buffer)
+		return 1;
+
+	if (vb2_digest_buffer(test_data, sizeof(test_data), VB2_HASH_SHA256,
+			      digest, sizeof(digest))) {
+		free(cold_buffer);
+		return 1;
+	}
+
+	for (i = 0; i < ARRAY_SIZE(algs) && !rv; i++) {
+		const char *name = vb2_get_sig_algorithm_name(algs[i].sig_alg);
+		struct vb2_private_key *private_key;
+		struct vb2_packed_key *packed_key;
+		struct vb2_signature *sig = NULL;
+		struct vb2_public_key key;
+
+		snprintf(filename, sizeof(filename), "%s/key_%s.pem", keys_dir,
+			 vb2_get_crypto_algorithm_file(algs[i].crypto_alg));
+		private_key = vb2_read_private_key_pem(filename,
+						       algs[i].crypto_alg);
+
+		snprintf(filename, sizeof(filename), "%s/key_%s.keyb", keys_dir,
+			 vb2_get_crypto_algorithm_file(algs[i].crypto_alg));
+		packed_key = vb2_read_packed_keyb(filename, algs[i].crypto_alg,
+						  1);
+
+		if (private_key)
+			sig = vb2_calculate_signature(test_data,
+						      sizeof(test_data),
+						      private_key);
+
+		if (!sig || !packed_key || vb2_unpack_key(&key, packed_key)) {
+			fprintf(stderr, "# Can't use the %s key in %s\n",
+				name, keys_dir);
+			rv = 1;
+		} else {
+			rv = time_verify(name, "warm", &key, sig, digest,
+					 NULL) ||
+				time_verify(name, "cold", &key, sig, digest,
+					    cold_buffer);
+		}
+
+		free(sig);
+		free(packed_key);
+		vb2_free_private_key(private_key);
+	}
+
+	free(cold_buffer);
+	return rv;
+}
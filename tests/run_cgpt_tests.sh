@@ -120,6 +120,30 @@ run_basic_tests() {
   [ "$X $Y" = "$RANDOM_START $RANDOM_SIZE" ] || error
 
 
+  echo "Get every field at once..."
+  $CGPT show $MTD -f tsv ${DEV} > tsv.txt
+  X=$(head -n 1 tsv.txt | cut -f 1-4)
+  [ "$X" = "$(printf 'part\tstart\tsize\ttype')" ] || error
+  [ "$(wc -l < tsv.txt)" = "7" ] || error
+  for idx in $(seq 1 6); do
+    X=$(awk -F '\t' -v i=$idx '$1 == i {print $2, $3, $4, $5, $12}' tsv.txt)
+    Y=$(for f in b s t u l; do $CGPT show $MTD -$f -i $idx ${DEV}; done)
+    [ "$X" = "$(echo $Y)" ] || error
+  done
+  X=$($CGPT show $MTD --format=tsv -i $KERN_NUM ${DEV} | tail -n 1 | cut -f 1-3)
+  [ "$X" = "$(printf '%s\t%s\t%s' $KERN_NUM $KERN_START $KERN_SIZE)" ] || error
+
+  $CGPT show $MTD --format=json ${DEV} > json.txt
+  grep -q '"valid": true, "primary": {"valid": true' json.txt || error
+  [ "$(grep -c '"number": ' json.txt)" = "6" ] || error
+  grep -q "\"number\": $ROOTFS_NUM, \"start\": $ROOTFS_START, \"size\": \
+$ROOTFS_SIZE, \"label\": \"$ROOTFS_LABEL\"" json.txt || error
+  X=$($CGPT show $MTD -f json -i $ESP_NUM ${DEV} | grep -c '"number": ')
+  [ "$X" = "1" ] || error
+  assert_fail $CGPT show $MTD -f xml ${DEV}
+  assert_fail $CGPT show $MTD -f json -b -i $DATA_NUM ${DEV}
+
+
   echo "Change the beginning..."
   DATA_START=$((DATA_START + 10))
   $CGPT add $MTD -i 1 -b ${DATA_START} ${DEV} || error
@@ -291,6 +315,114 @@ $CGPT show $MTD ${DEV} | grep -q INVALID
 $CGPT repair $MTD ${DEV}
 ($CGPT show $MTD ${DEV} | grep -q INVALID) && error
 
+# Same again, writing the repaired entries sector by sector.
+EXPECTED=$($CGPT show $MTD -q ${DEV})
+dd if=/dev/zero of=${DEV} seek=2 conv=notrunc bs=512 count=32 2>/dev/null
+$CGPT show $MTD ${DEV} | grep -q INVALID
+$CGPT repair $MTD -s ${DEV}
+($CGPT show $MTD ${DEV} | grep -q INVALID) && error
+[ "$($CGPT show $MTD -q ${DEV})" = "$EXPECTED" ] || error
+dd if=/dev/zero of=${DEV} seek=$(($NUM_SECTORS - 33)) conv=notrunc bs=512 \
+  count=32 2>/dev/null
+$CGPT show $MTD ${DEV} | grep -q INVALID
+$CGPT repair $MTD -s ${DEV}
+($CGPT show $MTD ${DEV} | grep -q INVALID) && error
+[ "$($CGPT show $MTD -q ${DEV})" = "$EXPECTED" ] || error
+# In a batch, nothing is written unless every command succeeds.
+dd if=/dev/zero of=${DEV} seek=$(($NUM_SECTORS - 33)) conv=notrunc bs=512 \
+  count=32 2>/dev/null
+printf 'repair -s\nadd -i 99 -P 1\n' | assert_fail $CGPT batch $MTD ${DEV}
+$CGPT show $MTD ${DEV} | grep -q INVALID
+echo "repair -s" | $CGPT batch $MTD ${DEV}
+($CGPT show $MTD ${DEV} | grep -q INVALID) && error
+[ "$($CGPT show $MTD -q ${DEV})" = "$EXPECTED" ] || error
+
+echo "Test sparse cgpt create..."
+$CGPT create $MTD -s ${DEV}
+($CGPT show $MTD ${DEV} | grep -q INVALID) && error
+[ -z "$($CGPT show $MTD -q ${DEV})" ] || error
+$CGPT add $MTD -b ${DATA_START} -s ${DATA_SIZE} -t ${DATA_GUID} ${DEV}
+$CGPT create $MTD -s ${DEV}
+[ -z "$($CGPT show $MTD -q ${DEV})" ] || error
+# The entries of a sparse image shouldn't take up any more space
+truncate -s $((NUM_SECTORS * 512)) sparse.bin sparse_s.bin
+$CGPT create $MTD sparse.bin
+$CGPT create $MTD -s sparse_s.bin
+[ "$(stat -c %b sparse_s.bin)" -le "$(stat -c %b sparse.bin)" ] || error
+# Adding a partition only writes the entry sectors it changed, so where the
+# filesystem keeps holes, the image stays smaller than the full one.
+FULL_BLOCKS=$(stat -c %b sparse.bin)
+SPARSE_BLOCKS=$(stat -c %b sparse_s.bin)
+$CGPT add $MTD -b ${DATA_START} -s ${DATA_SIZE} -t ${DATA_GUID} sparse_s.bin
+($CGPT show $MTD sparse_s.bin | grep -q INVALID) && error
+if [ "${SPARSE_BLOCKS}" -lt "${FULL_BLOCKS}" ]; then
+  [ "$(stat -c %b sparse_s.bin)" -lt "${FULL_BLOCKS}" ] || error
+fi
+rm -f sparse.bin sparse_s.bin
+
+echo "Test cgpt drive locking..."
+if type flock >/dev/null 2>&1; then
+  $CGPT create $MTD ${DEV}
+  # Writers wait for a shared lock, readers only for an exclusive one.
+  flock -s ${DEV} -c "touch locked; sleep 2" &
+  LOCKER=$!
+  while [ ! -e locked ]; do sleep 0.1; done
+  $CGPT show $MTD -q ${DEV} >/dev/null
+  assert_fail timeout 1 $CGPT add $MTD -b ${DATA_START} -s ${DATA_SIZE} \
+    -t ${DATA_GUID} ${DEV}
+  wait ${LOCKER}
+  rm -f locked
+  [ -z "$($CGPT show $MTD -q ${DEV})" ] || error
+  flock -x ${DEV} -c "touch locked; sleep 2" &
+  LOCKER=$!
+  while [ ! -e locked ]; do sleep 0.1; done
+  assert_fail timeout 1 $CGPT show $MTD -q ${DEV}
+  wait ${LOCKER}
+  rm -f locked
+fi
+
+echo "Test labels and unique GUIDs..."
+$CGPT create $MTD ${DEV}
+LABELS=("ascii only" "données" "ascii then ☃" "𝄞 clef")
+for idx in 1 2 3 4; do
+  $CGPT add $MTD -b $((DATA_START + idx * 10)) -s 10 -t ${DATA_GUID} \
+    -l "${LABELS[idx - 1]}" ${DEV}
+  [ "$($CGPT show $MTD -l -i $idx ${DEV})" = "${LABELS[idx - 1]}" ] || error
+done
+X=$(for idx in 1 2 3 4; do $CGPT show $MTD -u -i $idx ${DEV}; done |
+  sort -u | wc -l)
+[ "$X" = "4" ] || error
+assert_fail $CGPT add $MTD -i 1 -l "$(printf 'bad \xff')" ${DEV}
+
+echo "Test cgpt batch command..."
+$CGPT create $MTD ${DEV}
+$CGPT add $MTD -b ${DATA_START} -s ${DATA_SIZE} -t ${DATA_GUID} \
+  -l "${DATA_LABEL}" ${DEV}
+$CGPT add $MTD -b ${KERN_START} -s ${KERN_SIZE} -t ${KERN_GUID} \
+  -l "${KERN_LABEL}" -P 3 ${DEV}
+$CGPT prioritize $MTD -i ${KERN_NUM} ${DEV}
+EXPECTED=$($CGPT show $MTD -q ${DEV})
+$CGPT create $MTD ${DEV}
+cat > batch.txt <<EOF2
+# Same layout as above, in one pass
+add -b ${DATA_START} -s ${DATA_SIZE} -t ${DATA_GUID} -l "${DATA_LABEL}"
+
+add -b ${KERN_START} -s ${KERN_SIZE} -t ${KERN_GUID} -l '${KERN_LABEL}' -P 3
+prioritize -i ${KERN_NUM}
+EOF2
+$CGPT batch $MTD -f batch.txt ${DEV}
+[ "$($CGPT show $MTD -q ${DEV})" = "$EXPECTED" ] || error
+($CGPT show $MTD ${DEV} | grep -q INVALID) && error
+# A failing command discards the whole batch.
+printf 'add -i %d -P 5\nadd -i 99 -P 1\n' ${KERN_NUM} | \
+  assert_fail $CGPT batch $MTD ${DEV}
+[ "$($CGPT show $MTD -q ${DEV})" = "$EXPECTED" ] || error
+printf 'create -s\nadd -i 99 -P 1\n' | assert_fail $CGPT batch $MTD ${DEV}
+[ "$($CGPT show $MTD -q ${DEV})" = "$EXPECTED" ] || error
+($CGPT show $MTD ${DEV} | grep -q INVALID) && error
+echo "batch" | assert_fail $CGPT batch $MTD ${DEV}
+echo "add -l 'unterminated" | assert_fail $CGPT batch $MTD ${DEV}
+
 echo "Test with IGNOREME primary GPT..."
 $CGPT create $MTD ${DEV}
 $CGPT legacy $MTD -p ${DEV}
@@ -191,6 +191,28 @@ else
   echo -e "${COL_GREEN}PASSED${COL_STOP}"
 fi
 
+piped=$(cat "${USB_KERN}" | "${FUTILITY}" dump_kernel_config /dev/stdin)
+echo -n "check piped kernel config ..."
+: $(( tests++ ))
+if [ "$orig" != "$piped" ]; then
+  echo -e "${COL_RED}FAILED${COL_STOP}"
+  : $(( errs++ ))
+else
+  echo -e "${COL_GREEN}PASSED${COL_STOP}"
+fi
+
+both=$("${FUTILITY}" dump_kernel_config "${USB_KERN}" "${tempfile}")
+expected=$(printf "%s:\n%s\n%s:\n%s\n" "${USB_KERN}" "$orig" \
+  "${tempfile}" "$orig")
+echo -n "check multiple kernel configs ..."
+: $(( tests++ ))
+if [ "$expected" != "$both" ]; then
+  echo -e "${COL_RED}FAILED${COL_STOP}"
+  : $(( errs++ ))
+else
+  echo -e "${COL_GREEN}PASSED${COL_STOP}"
+fi
+
 # Summary
 ME=$(basename "$0")
 if [ "$errs" -ne 0 ]; then
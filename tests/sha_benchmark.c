@@ -15,32 +15,81 @@
 
 #define TEST_BUFFER_SIZE 4000000
 
+/* Hash repeatedly until at least this much time has passed */
+#define MIN_TEST_MSECS 500
+
+/* ...and at least this many times, keeping at most MAX_SAMPLES timings */
+#define MIN_SAMPLES 5
+#define MAX_SAMPLES 1000
+
+/*
+ * Usage: sha_benchmark [min_sha512_mbytes_per_sec]
+ *
+ * If a minimum SHA-512 throughput is given, exit non-zero when the measured
+ * speed falls below it. Speeds come from the median pass, so a pass slowed
+ * by an interrupt or another process doesn't skew them.
+ */
 int main(int argc, char *argv[]) {
 	int i;
+	uint32_t count;
 	double speed;
-	uint32_t msecs;
+	double min_sha512_speed = 0;
+	uint64_t start, elapsed;
+	uint64_t cycles = 0;
 	uint8_t *buffer = malloc(TEST_BUFFER_SIZE);
 	uint8_t digest[VB2_MAX_DIGEST_SIZE];
-	ClockTimerState ct;
+	uint64_t nsecs[MAX_SAMPLES];
+	TimerStatsState stats;
+	int rv = 0;
+
+	if (argc > 1)
+		min_sha512_speed = strtod(argv[1], NULL);
+
+	if (PinToCpu(-1))
+		fprintf(stderr, "# Unable to pin to a CPU; expect noise\n");
 
 	/* Iterate through all the hash functions. */
 	for(i = VB2_HASH_SHA1; i < VB2_HASH_ALG_COUNT; i++) {
-		StartTimer(&ct);
-		vb2_digest_buffer(buffer, TEST_BUFFER_SIZE, i,
-				  digest, sizeof(digest));
-		StopTimer(&ct);
+		count = 0;
+		cycles = 0;
+		start = GetTimeNsecs();
+		do {
+			uint64_t t = GetTimeNsecs();
+			uint64_t c = ReadCycleCounter();
+
+			vb2_digest_buffer(buffer, TEST_BUFFER_SIZE, i,
+					  digest, sizeof(digest));
+			cycles += ReadCycleCounter() - c;
+			nsecs[count++] = GetTimeNsecs() - t;
+			elapsed = GetTimeNsecs() - start;
+		} while (count < MAX_SAMPLES &&
+			 (count < MIN_SAMPLES ||
+			  elapsed < MIN_TEST_MSECS * 1000000ULL));
 
-		msecs = GetDurationMsecs(&ct);
-		speed = ((TEST_BUFFER_SIZE / 10e6)
-			 / (msecs / 10e3)); /* Mbytes/sec */
+		ComputeTimerStats(nsecs, count, &stats);
+		/* Bytes per nanosecond is Gbytes/sec, so scale to Mbytes/sec */
+		speed = (double)TEST_BUFFER_SIZE * 1e3 / stats.median;
 
 		fprintf(stderr,
-			"# %s Time taken = %u ms, Speed = %f Mbytes/sec\n",
-			vb2_get_hash_algorithm_name(i), msecs, speed);
+			"# %s %u passes, ns/pass min %" PRIu64 " median %"
+			PRIu64 " p99 %" PRIu64 ", Speed = %f Mbytes/sec\n",
+			vb2_get_hash_algorithm_name(i), count, stats.min,
+			stats.median, stats.p99, speed);
+		if (HaveCycleCounter())
+			fprintf(stderr, "# %s %f counter ticks/byte\n",
+				vb2_get_hash_algorithm_name(i),
+				(double)cycles / count / TEST_BUFFER_SIZE);
 		fprintf(stdout, "mbytes_per_sec_%s:%f\n",
 			vb2_get_hash_algorithm_name(i), speed);
+
+		if (i == VB2_HASH_SHA512 && speed < min_sha512_speed) {
+			fprintf(stderr,
+				"# SHA512 below target of %f Mbytes/sec\n",
+				min_sha512_speed);
+			rv = 1;
+		}
 	}
 
 	free(buffer);
-	return 0;
+	return rv;
 }
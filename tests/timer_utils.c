@@ -3,22 +3,111 @@
  * found in the LICENSE file.
  */
 
+#ifdef __linux__
+#include <sched.h>
+#endif
+#include <stdlib.h>
+
 #include "timer_utils.h"
 
+#ifdef CLOCK_MONOTONIC_RAW
+#define TIMER_CLOCK CLOCK_MONOTONIC_RAW
+#else
+#define TIMER_CLOCK CLOCK_MONOTONIC
+#endif
+
 void StartTimer(ClockTimerState* ct) {
-  clock_gettime(CLOCK_REALTIME, &ct->start_time);
+  clock_gettime(TIMER_CLOCK, &ct->start_time);
 }
 
 void StopTimer(ClockTimerState* ct) {
-  clock_gettime(CLOCK_REALTIME, &ct->end_time);
+  clock_gettime(TIMER_CLOCK, &ct->end_time);
 }
 
-uint32_t GetDurationMsecs(ClockTimerState* ct) {
+uint64_t GetDurationNsecs(ClockTimerState* ct) {
   uint64_t start = ((uint64_t) ct->start_time.tv_sec * 1000000000 +
                     (uint64_t) ct->start_time.tv_nsec);
   uint64_t end = ((uint64_t) ct->end_time.tv_sec * 1000000000 +
                   (uint64_t) ct->end_time.tv_nsec);
-  uint64_t duration_msecs = (end - start) / 1000000U;  /* Nanoseconds ->
-                                                        * Milliseconds. */
-  return (uint32_t) duration_msecs;
+  return end - start;
+}
+
+uint32_t GetDurationMsecs(ClockTimerState* ct) {
+  return (uint32_t) (GetDurationNsecs(ct) / 1000000U);  /* Nanoseconds ->
+                                                         * Milliseconds. */
+}
+
+uint64_t GetTimeNsecs(void) {
+  struct timespec now;
+
+  clock_gettime(TIMER_CLOCK, &now);
+  return (uint64_t) now.tv_sec * 1000000000 + (uint64_t) now.tv_nsec;
+}
+
+int HaveCycleCounter(void) {
+#if defined(__x86_64__) || defined(__i386__) || defined(__aarch64__)
+  return 1;
+#else
+  return 0;
+#endif
+}
+
+uint64_t ReadCycleCounter(void) {
+#if defined(__x86_64__) || defined(__i386__)
+  uint32_t lo, hi;
+  __asm__ __volatile__("rdtsc" : "=a" (lo), "=d" (hi));
+  return ((uint64_t) hi << 32) | lo;
+#elif defined(__aarch64__)
+  uint64_t val;
+  __asm__ __volatile__("isb; mrs %0, cntvct_el0" : "=r" (val));
+  return val;
+#else
+  return 0;
+#endif
+}
+
+static int CompareSamples(const void* a, const void* b) {
+  uint64_t x = *(const uint64_t*) a;
+  uint64_t y = *(const uint64_t*) b;
+  return x < y ? -1 : x > y;
+}
+
+void ComputeTimerStats(uint64_t* samples, uint32_t count,
+                       TimerStatsState* stats) {
+  double sum = 0;
+  uint32_t i;
+
+  stats->count = count;
+  if (!count) {
+    stats->min = stats->median = stats->p99 = stats->max = 0;
+    stats->mean = 0;
+    return;
+  }
+
+  qsort(samples, count, sizeof(*samples), CompareSamples);
+  for (i = 0; i < count; i++)
+    sum += samples[i];
+
+  stats->min = samples[0];
+  stats->median = samples[count / 2];
+  /* Nearest-rank percentile, so small sets report their worst sample */
+  stats->p99 = samples[(count * 99 + 99) / 100 - 1];
+  stats->max = samples[count - 1];
+  stats->mean = sum / count;
+}
+
+int PinToCpu(int cpu) {
+#ifdef __linux__
+  cpu_set_t set;
+
+  if (cpu < 0)
+    cpu = sched_getcpu();
+  if (cpu < 0)
+    return -1;
+  CPU_ZERO(&set);
+  CPU_SET(cpu, &set);
+  return sched_setaffinity(0, sizeof(set), &set) ? -1 : 0;
+#else
+  return -1;
+#endif
 }
@@ -15,6 +15,16 @@ typedef struct ClockTimer {
   struct timespec end_time;
 } ClockTimerState;
 
+/* Summary of a set of timing samples, in the units of the samples. */
+typedef struct TimerStats {
+  uint32_t count;
+  uint64_t min;
+  uint64_t median;
+  uint64_t p99;
+  uint64_t max;
+  double mean;
+} TimerStatsState;
+
 /* Start timer and update [ct]. */
 void StartTimer(ClockTimerState* ct);
 
@@ -24,4 +34,29 @@ void StopTimer(ClockTimerState* ct);
 /* Get duration in milliseconds. */
 uint32_t GetDurationMsecs(ClockTimerState* ct);
 
+/* Get duration in nanoseconds. */
+uint64_t GetDurationNsecs(ClockTimerState* ct);
+
+/* Get the current time in nanoseconds, from an arbitrary starting point.
+ * This uses the raw monotonic clock where there is one, so NTP slewing
+ * doesn't leak into measurements. */
+uint64_t GetTimeNsecs(void);
+
+/* Return non-zero if ReadCycleCounter() works on this CPU. */
+int HaveCycleCounter(void);
+
+/* Read the CPU cycle counter (rdtsc on x86, cntvct_el0 on arm64), or 0 if
+ * there isn't one. Only differences between readings on the same CPU are
+ * meaningful; use PinToCpu() to stay on one. */
+uint64_t ReadCycleCounter(void);
+
+/* Fill [stats] from the [count] samples at [samples], which are sorted in
+ * place. */
+void ComputeTimerStats(uint64_t* samples, uint32_t count,
+                       TimerStatsState* stats);
+
+/* Keep the calling thread on [cpu], or on the CPU it is running on now if
+ * [cpu] is negative, so migrations don't add noise. Returns 0 on success. */
+int PinToCpu(int cpu);
+
 #endif  /* VBOOT_REFERENCE_TIMER_UTILS_H_ */
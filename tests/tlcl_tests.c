@@ -14,6 +14,7 @@
 #include "test_common.h"
 #include "tlcl.h"
 #include "tlcl_internal.h"
+#include "tlcl_stats.h"
 #include "vboot_common.h"
 
 /* Mock data */
@@ -178,6 +179,15 @@ static void SendCommandTest(void)
 	TEST_EQ(TlclContinueSelfTest(), 0, "ContinueSelfTest");
 	TEST_EQ(calls[0].req_cmd, TPM_ORD_ContinueSelfTest, "  cmd");
 
+	ResetMocks();
+	TEST_EQ(TlclStartSelfTest(), 0, "StartSelfTest");
+	TEST_EQ(calls[0].req_cmd, TPM_ORD_ContinueSelfTest, "  cmd");
+
+	ResetMocks();
+	SetResponse(0, TPM_E_DOING_SELFTEST, 10);
+	TEST_EQ(TlclStartSelfTest(), 0, "StartSelfTest already running");
+	TEST_EQ(ncalls, 1, "  one command");
+
 	ResetMocks();
 	TEST_EQ(TlclAssertPhysicalPresence(), 0,
 		"AssertPhysicalPresence");
@@ -265,6 +275,102 @@ static void ReadWriteTest(void)
 	TEST_EQ(calls[0].req_cmd, TPM_ORD_NV_WriteValue, "  cmd");
 }
 
+/**
+ * Set call <call_idx> to return a 3-byte NV read of <data>.
+ */
+static void SetReadResponse(int call_idx, uint8_t data)
+{
+	struct srcall *c = calls + call_idx;
+
+	SetResponse(call_idx, TPM_SUCCESS, 17);
+	ToTpmUint32(c->rsp_buf + 10, 3);
+	memset(c->rsp_buf + 14, data, 3);
+}
+
+/**
+ * Batched command tests
+ */
+static void BatchTest(void)
+{
+	uint8_t buf[3];
+
+	/* Responses are used by the matching calls */
+	ResetMocks();
+	SetReadResponse(0, 0x11);
+	SetReadResponse(1, 0x22);
+	TEST_EQ(TlclBatchRead(1, 3), 0, "BatchRead");
+	TEST_EQ(TlclBatchGetPermissions(1), 0, "BatchGetPermissions");
+	TEST_EQ(TlclBatchRead(2, 3), 0, "BatchRead");
+	TEST_EQ(TlclBatchRead(3, 3), TPM_E_BUFFER_SIZE, "BatchRead full");
+	TEST_EQ(TlclBatchSend(), 0, "BatchSend");
+	TEST_EQ(ncalls, 3, "  sent");
+	TEST_EQ(calls[0].req_cmd, TPM_ORD_NV_ReadValue, "  cmd");
+	TEST_EQ(calls[1].req_cmd, TPM_ORD_GetCapability, "  cmd");
+	TEST_EQ(calls[2].req_cmd, TPM_ORD_NV_ReadValue, "  cmd");
+	TEST_EQ(TlclRead(1, buf, 3), 0, "Read batched");
+	TEST_EQ(buf[0], 0x11, "  data");
+	TEST_EQ(ncalls, 3, "  not sent");
+
+	/* Something else drops the rest of the batch */
+	SetReadResponse(3, 0x33);
+	TEST_EQ(TlclRead(2, buf, 3), 0, "Read out of order");
+	TEST_EQ(buf[0], 0x33, "  data");
+	TEST_EQ(ncalls, 4, "  sent");
+
+	/* Commands the transport failed are sent again */
+	ResetMocks();
+	calls[0].retval = VBERROR_SIMULATED;
+	SetReadResponse(1, 0x44);
+	TEST_EQ(TlclBatchRead(1, 3), 0, "BatchRead");
+	TEST_EQ(TlclBatchSend(), 0, "BatchSend");
+	TEST_EQ(TlclRead(1, buf, 3), 0, "Read failed batch");
+	TEST_EQ(buf[0], 0x44, "  data");
+	TEST_EQ(ncalls, 2, "  sent");
+
+	/* A response is only used once */
+	ResetMocks();
+	SetReadResponse(0, 0x55);
+	SetReadResponse(1, 0x66);
+	TEST_EQ(TlclBatchRead(1, 3), 0, "BatchRead");
+	TEST_EQ(TlclBatchSend(), 0, "BatchSend");
+	TEST_EQ(TlclRead(1, buf, 3), 0, "Read batched");
+	TEST_EQ(buf[0], 0x55, "  data");
+	TEST_EQ(TlclRead(1, buf, 3), 0, "Read again");
+	TEST_EQ(buf[0], 0x66, "  data");
+	TEST_EQ(ncalls, 2, "  sent");
+}
+
+#ifdef TLCL_STATS
+/**
+ * TPM latency statistics tests
+ */
+static void StatsTest(void)
+{
+	const TlclCommandStats *stats;
+	uint32_t count, i;
+	uint32_t before = 0;
+
+	count = TlclGetCommandStats(&stats);
+	for (i = 0; i < count; i++) {
+		if (stats[i].command == TPM_ORD_ForceClear)
+			before = stats[i].count;
+	}
+
+	ResetMocks();
+	TEST_EQ(TlclForceClear(), 0, "ForceClear");
+	TEST_EQ(TlclForceClear(), 0, "ForceClear");
+
+	count = TlclGetCommandStats(&stats);
+	for (i = 0; i < count; i++) {
+		if (stats[i].command == TPM_ORD_ForceClear)
+			break;
+	}
+	TEST_NEQ(i, count, "Stats for ForceClear");
+	TEST_EQ(stats[i].count, before + 2, "  count");
+	TEST_EQ(stats[i].total_us >= stats[i].max_us, 1, "  max <= total");
+}
+#endif
+
 /**
  * Test DefineSpaceEx
  */
@@ -1153,6 +1259,10 @@ int main(void)
 	TlclTest();
 	SendCommandTest();
 	ReadWriteTest();
+	BatchTest();
+#ifdef TLCL_STATS
+	StatsTest();
+#endif
 	DefineSpaceExTest();
 	InitNvAuthPolicyTest();
 	PcrTest();
@@ -0,0 +1,48 @@
+/* Copyright 2018 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ *
+ * Fuzz target for tpm_unmarshal_response().  Only built with TPM2_MODE.
+ *
+ * The first byte of the input picks the command the response is for, and
+ * the rest is the response.
+ */
+
+#include <stdlib.h>
+
+#include "2sysincludes.h"
+#include "2common.h"
+#include "tpm2_marshaling.h"
+#include "fuzz_common.h"
+
+static const TPM_CC commands[] = {
+	TPM2_Hierarchy_Control,
+	TPM2_Clear,
+	TPM2_NV_DefineSpace,
+	TPM2_NV_Write,
+	TPM2_NV_WriteLock,
+	TPM2_SelfTest,
+	TPM2_Startup,
+	TPM2_Shutdown,
+	TPM2_NV_Read,
+	TPM2_NV_ReadLock,
+	TPM2_NV_ReadPublic,
+	TPM2_GetCapability,
+};
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+	struct tpm2_response response;
+	TPM_CC command;
+	void *buf;
+
+	if (size < 1 || size > FUZZ_MAX_INPUT_SIZE)
+		return 0;
+
+	command = commands[data[0] % ARRAY_SIZE(commands)];
+	buf = fuzz_copy_input(data + 1, size - 1);
+	tpm_unmarshal_response(command, buf, size - 1, &response);
+	free(buf);
+
+	return 0;
+}
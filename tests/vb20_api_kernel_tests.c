@@ -42,6 +42,11 @@ static int mock_read_gbb_header_retval;
 static int mock_load_kernel_keyblock_retval;
 static int mock_load_kernel_preamble_retval;
 
+/* Mocked crypto engine, which hashes in software behind the scenes */
+static int mock_hwcrypto_enabled;
+static uint32_t mock_hwcrypto_hashed;
+static struct vb2_digest_context mock_hwcrypto_dc;
+
 /* Type of test to reset for */
 enum reset_type {
 	FOR_PHASE1,
@@ -73,6 +78,8 @@ static void reset_common_data(enum reset_type t)
 	mock_read_gbb_header_retval = VB2_SUCCESS;
 	mock_load_kernel_keyblock_retval = VB2_SUCCESS;
 	mock_load_kernel_preamble_retval = VB2_SUCCESS;
+	mock_hwcrypto_enabled = 0;
+	mock_hwcrypto_hashed = 0;
 
 	/* Recovery key in mock GBB */
 	mock_gbb.recovery_key.algorithm = 11;
@@ -218,6 +225,26 @@ int vb2_verify_digest(const struct vb2_public_key *key,
 	return VB2_SUCCESS;
 }
 
+int vb2ex_hwcrypto_digest_init(enum vb2_hash_algorithm hash_alg,
+			       uint32_t data_size)
+{
+	if (!mock_hwcrypto_enabled)
+		return VB2_ERROR_EX_HWCRYPTO_UNSUPPORTED;
+
+	return vb2_digest_init(&mock_hwcrypto_dc, hash_alg);
+}
+
+int vb2ex_hwcrypto_digest_extend(const uint8_t *buf, uint32_t size)
+{
+	mock_hwcrypto_hashed += size;
+	return vb2_digest_extend(&mock_hwcrypto_dc, buf, size);
+}
+
+int vb2ex_hwcrypto_digest_finalize(uint8_t *digest, uint32_t digest_size)
+{
+	return vb2_digest_finalize(&mock_hwcrypto_dc, digest, digest_size);
+}
+
 /* Tests */
 
 static void phase1_tests(void)
@@ -412,6 +439,31 @@ static void verify_kernel_data_tests(void)
 					  sizeof(kernel_data)),
 		VB2_ERROR_VDATA_VERIFY_DIGEST, "verify hash digest");
 	kernel_data[3] ^= 0xd0;
+
+	/* The body goes through the crypto engine when there is one */
+	reset_common_data(FOR_PHASE2);
+	mock_hwcrypto_enabled = 1;
+	TEST_SUCC(vb2api_verify_kernel_data(&cc, kernel_data,
+					    sizeof(kernel_data)),
+		  "verify hwcrypto");
+	TEST_EQ(mock_hwcrypto_hashed, sizeof(kernel_data), "  hashed in HW");
+
+	reset_common_data(FOR_PHASE2);
+	mock_hwcrypto_enabled = 1;
+	kernel_data[3] ^= 0xd0;
+	TEST_EQ(vb2api_verify_kernel_data(&cc, kernel_data,
+					  sizeof(kernel_data)),
+		VB2_ERROR_VDATA_VERIFY_DIGEST, "verify hwcrypto digest");
+	kernel_data[3] ^= 0xd0;
+
+	reset_common_data(FOR_PHASE2);
+	mock_hwcrypto_enabled = 1;
+	kpre->header_version_minor = 2;
+	kpre->flags = VB2_KERNEL_PREAMBLE_DISALLOW_HWCRYPTO;
+	TEST_SUCC(vb2api_verify_kernel_data(&cc, kernel_data,
+					    sizeof(kernel_data)),
+		  "verify hwcrypto forbidden");
+	TEST_EQ(mock_hwcrypto_hashed, 0, "  hashed in SW");
 }
 
 static void phase3_tests(void)
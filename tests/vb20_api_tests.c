@@ -42,6 +42,12 @@ static int retval_vb2_load_fw_keyblock;
 static int retval_vb2_load_fw_preamble;
 static int retval_vb2_digest_finalize;
 static int retval_vb2_verify_digest;
+static int mock_verify_allow_hwcrypto;
+static int mock_read_async;
+static int mock_read_pending;
+static int mock_read_calls;
+static int mock_map;
+static int mock_map_retval;
 
 /* Type of test to reset for */
 enum reset_type {
@@ -73,6 +79,11 @@ static void reset_common_data(enum reset_type t)
 	retval_vb2_load_fw_preamble = VB2_SUCCESS;
 	retval_vb2_digest_finalize = VB2_SUCCESS;
 	retval_vb2_verify_digest = VB2_SUCCESS;
+	mock_read_async = 0;
+	mock_read_pending = 0;
+	mock_read_calls = 0;
+	mock_map = 0;
+	mock_map_retval = VB2_SUCCESS;
 
 	sd->workbuf_preamble_offset = cc.workbuf_used;
 	sd->workbuf_preamble_size = sizeof(*pre);
@@ -132,6 +143,67 @@ int vb2_unpack_key_buffer(struct vb2_public_key *key,
 	return VB2_SUCCESS;
 }
 
+int vb2ex_read_resource(struct vb2_context *ctx,
+			enum vb2_resource_index index,
+			uint32_t offset,
+			void *buf,
+			uint32_t size)
+{
+	if (index != VB2_RES_FW_BODY)
+		return VB2_ERROR_EX_READ_RESOURCE_INDEX;
+	if (offset > mock_body_size || size > mock_body_size - offset)
+		return VB2_ERROR_EX_READ_RESOURCE_SIZE;
+
+	memcpy(buf, mock_body + offset, size);
+	mock_read_calls++;
+	return VB2_SUCCESS;
+}
+
+int vb2ex_read_resource_start(struct vb2_context *ctx,
+			      enum vb2_resource_index index,
+			      uint32_t offset,
+			      void *buf,
+			      uint32_t size)
+{
+	if (!mock_read_async)
+		return VB2_ERROR_EX_READ_RESOURCE_UNIMPLEMENTED;
+
+	/* Only one read may be outstanding */
+	if (mock_read_pending)
+		return VB2_ERROR_MOCK;
+
+	mock_read_pending = 1;
+	return vb2ex_read_resource(ctx, index, offset, buf, size);
+}
+
+int vb2ex_read_resource_wait(struct vb2_context *ctx)
+{
+	if (!mock_read_pending)
+		return VB2_ERROR_MOCK;
+
+	mock_read_pending = 0;
+	return VB2_SUCCESS;
+}
+
+int vb2ex_map_resource(struct vb2_context *ctx,
+		       enum vb2_resource_index index,
+		       uint32_t offset,
+		       uint32_t size,
+		       const void **ptr)
+{
+	if (!mock_map)
+		return VB2_ERROR_EX_MAP_RESOURCE_UNIMPLEMENTED;
+	if (mock_map_retval)
+		return mock_map_retval;
+	if (index != VB2_RES_FW_BODY)
+		return VB2_ERROR_EX_READ_RESOURCE_INDEX;
+	if (offset > mock_body_size || size > mock_body_size - offset)
+		return VB2_ERROR_EX_READ_RESOURCE_SIZE;
+
+	*ptr = mock_body + offset;
+	return VB2_SUCCESS;
+}
+
 int vb2ex_hwcrypto_digest_init(enum vb2_hash_algorithm hash_alg,
 			       uint32_t data_size)
 {
@@ -225,6 +297,7 @@ int vb2_rsa_verify_digest(const struct vb2_public_key *key,
 			  const uint8_t *digest,
 			  const struct vb2_workbuf *wb)
 {
+	mock_verify_allow_hwcrypto = key->allow_hwcrypto;
 	return retval_vb2_verify_digest;
 }
 
@@ -347,13 +420,79 @@ static void extend_hash_tests(void)
 	}
 }
 
+static void hash_body_tests(void)
+{
+	uint8_t buf[sizeof(mock_body)];
+
+	reset_common_data(FOR_EXTEND_HASH);
+	memset(buf, 0, sizeof(buf));
+	TEST_SUCC(vb2api_hash_body_from_resource(&cc, buf, sizeof(buf)),
+		  "hash body good");
+	TEST_EQ(sd->hash_remaining_size, 0, "  remaining");
+	TEST_EQ(mock_read_calls, 1, "  reads");
+	TEST_EQ(memcmp(buf, mock_body, sizeof(buf)), 0, "  body loaded");
+	TEST_SUCC(vb2api_check_hash(&cc), "  check hash");
+
+	reset_common_data(FOR_EXTEND_HASH);
+	TEST_SUCC(vb2api_hash_body_from_resource(&cc, buf, 64),
+		  "hash body double buffered");
+	TEST_EQ(sd->hash_remaining_size, 0, "  remaining");
+	TEST_EQ(mock_read_calls, mock_body_size / 32, "  reads");
+
+	reset_common_data(FOR_EXTEND_HASH);
+	mock_read_async = 1;
+	TEST_SUCC(vb2api_hash_body_from_resource(&cc, buf, 64),
+		  "hash body async");
+	TEST_EQ(sd->hash_remaining_size, 0, "  remaining");
+	TEST_EQ(mock_read_pending, 0, "  no read pending");
+
+	reset_common_data(FOR_EXTEND_HASH);
+	TEST_EQ(vb2api_hash_body_from_resource(&cc, buf, 1),
+		VB2_ERROR_API_HASH_BODY_BUF, "hash body buffer too small");
+
+	/* A mapped body is hashed in place, with no reads or buffer */
+	reset_common_data(FOR_EXTEND_HASH);
+	mock_map = 1;
+	TEST_SUCC(vb2api_hash_body_from_resource(&cc, NULL, 0),
+		  "hash body mapped");
+	TEST_EQ(sd->hash_remaining_size, 0, "  remaining");
+	TEST_EQ(mock_read_calls, 0, "  no reads");
+	TEST_SUCC(vb2api_check_hash(&cc), "  check hash");
+
+	reset_common_data(FOR_EXTEND_HASH);
+	mock_map = 1;
+	mock_map_retval = VB2_ERROR_MOCK;
+	TEST_EQ(vb2api_hash_body_from_resource(&cc, buf, sizeof(buf)),
+		VB2_ERROR_MOCK, "hash body map error");
+	TEST_EQ(mock_read_calls, 0, "  no reads");
+
+	reset_common_data(FOR_EXTEND_HASH);
+	sd->workbuf_hash_size = 0;
+	TEST_EQ(vb2api_hash_body_from_resource(&cc, buf, sizeof(buf)),
+		VB2_ERROR_API_EXTEND_HASH_WORKBUF, "hash body no workbuf");
+
+	reset_common_data(FOR_EXTEND_HASH);
+	vb2api_extend_hash(&cc, mock_body, mock_body_size);
+	TEST_EQ(vb2api_hash_body_from_resource(&cc, buf, sizeof(buf)),
+		VB2_ERROR_API_EXTEND_HASH_SIZE, "hash body already hashed");
+
+	reset_common_data(FOR_EXTEND_HASH);
+	sd->hash_remaining_size++;
+	TEST_EQ(vb2api_hash_body_from_resource(&cc, buf, 64),
+		VB2_ERROR_EX_READ_RESOURCE_SIZE, "hash body read error");
+	TEST_NEQ(sd->hash_remaining_size, 0, "  not all hashed");
+}
+
 static void check_hash_tests(void)
 {
 	struct vb2_fw_preamble *pre;
 	const uint32_t digest_value = 0x0a0a0a0a;
 
 	reset_common_data(FOR_CHECK_HASH);
+	mock_verify_allow_hwcrypto = -1;
 	TEST_SUCC(vb2api_check_hash(&cc), "check hash good");
+	TEST_EQ(mock_verify_allow_hwcrypto,
+		hwcrypto_state != HWCRYPTO_FORBIDDEN, "check hash HW RSA");
 
 	reset_common_data(FOR_CHECK_HASH);
 	TEST_SUCC(vb2api_check_hash_get_digest(&cc, digest_result,
@@ -421,6 +560,59 @@ static void check_hash_tests(void)
 		VB2_ERROR_RSA_VERIFY_DIGEST, "check hash finalize");
 }
 
+static void resume_tests(void)
+{
+	struct vb2_resume_state rs = {
+		.magic = VB2_RESUME_STATE_MAGIC,
+		.struct_version = VB2_RESUME_STATE_VERSION,
+		.flags = VB2_RESUME_ALL,
+		.body_hash_alg = VB2_HASH_SHA256,
+	};
+
+	/* Recorded on a normal boot */
+	reset_common_data(FOR_CHECK_HASH);
+	TEST_SUCC(vb2api_check_hash(&cc), "resume record body");
+	TEST_NEQ(sd->resume.flags & VB2_RESUME_BODY, 0, "  flag");
+	TEST_EQ(sd->resume.body_hash_alg, VB2_HASH_SHA256, "  alg");
+	TEST_EQ(sd->resume.body_digest[0], 0x0a, "  digest");
+
+	reset_common_data(FOR_CHECK_HASH);
+	retval_vb2_verify_digest = VB2_ERROR_MOCK;
+	TEST_EQ(vb2api_check_hash(&cc), VB2_ERROR_MOCK, "resume bad body");
+	TEST_EQ(sd->resume.flags & VB2_RESUME_BODY, 0, "  no flag");
+
+	/* Unchanged body isn't verified again on resume */
+	fill_digest(rs.body_digest, VB2_SHA256_DIGEST_SIZE);
+	reset_common_data(FOR_CHECK_HASH);
+	cc.flags |= VB2_CONTEXT_S3_RESUME;
+	TEST_SUCC(vb2api_set_resume_state(&cc, &rs, sizeof(rs)),
+		  "resume set state");
+	retval_vb2_verify_digest = VB2_ERROR_MOCK;
+	TEST_SUCC(vb2api_check_hash_get_digest(&cc, digest_result,
+					       digest_result_size),
+		  "resume body unchanged");
+	TEST_EQ(digest_result[0], 0x0a, "  digest");
+
+	/* Changed body is verified */
+	rs.body_digest[0]++;
+	reset_common_data(FOR_CHECK_HASH);
+	cc.flags |= VB2_CONTEXT_S3_RESUME;
+	vb2api_set_resume_state(&cc, &rs, sizeof(rs));
+	retval_vb2_verify_digest = VB2_ERROR_MOCK;
+	TEST_EQ(vb2api_check_hash(&cc), VB2_ERROR_MOCK,
+		"resume body changed");
+	rs.body_digest[0]--;
+
+	/* So is one with a different hash algorithm */
+	rs.body_hash_alg = VB2_HASH_SHA512;
+	reset_common_data(FOR_CHECK_HASH);
+	cc.flags |= VB2_CONTEXT_S3_RESUME;
+	vb2api_set_resume_state(&cc, &rs, sizeof(rs));
+	retval_vb2_verify_digest = VB2_ERROR_MOCK;
+	TEST_EQ(vb2api_check_hash(&cc), VB2_ERROR_MOCK,
+		"resume body hash alg");
+}
+
 int main(int argc, char* argv[])
 {
 	phase3_tests();
@@ -429,19 +621,26 @@ int main(int argc, char* argv[])
 	hwcrypto_state = HWCRYPTO_DISABLED;
 	init_hash_tests();
 	extend_hash_tests();
+	hash_body_tests();
 	check_hash_tests();
 
 	fprintf(stderr, "Running hash API tests with hwcrypto support...\n");
 	hwcrypto_state = HWCRYPTO_ENABLED;
 	init_hash_tests();
 	extend_hash_tests();
+	hash_body_tests();
 	check_hash_tests();
 
 	fprintf(stderr, "Running hash API tests with forbidden hwcrypto...\n");
 	hwcrypto_state = HWCRYPTO_FORBIDDEN;
 	init_hash_tests();
 	extend_hash_tests();
+	hash_body_tests();
 	check_hash_tests();
 
+	fprintf(stderr, "Running S3 resume tests...\n");
+	hwcrypto_state = HWCRYPTO_DISABLED;
+	resume_tests();
+
 	return gTestSuccess ? 0 : 255;
 }
@@ -10,6 +10,8 @@
 #include <string.h>
 
 #include "2sysincludes.h"
+#include "2api.h"
+#include "2misc.h"
 #include "2rsa.h"
 #include "file_keys.h"
 #include "host_common.h"
@@ -80,6 +82,71 @@ static void test_unpack_key(const struct vb2_packed_key *key1)
 		"vb2_unpack_key_() buffer NULL");
 }
 
+static void test_unpack_key_cached(const struct vb2_packed_key *key1)
+{
+	uint8_t workbuf[VB2_WORKBUF_RECOMMENDED_SIZE]
+		__attribute__ ((aligned (VB2_WORKBUF_ALIGN)));
+	struct vb2_context ctx;
+	struct vb2_public_key pubk, pubk2;
+	uint32_t size = key1->key_offset + key1->key_size;
+	struct vb2_packed_key *key = malloc(size);
+	uint32_t *buf32;
+
+	memset(&ctx, 0, sizeof(ctx));
+	memset(&pubk, 0, sizeof(pubk));
+	memset(&pubk2, 0, sizeof(pubk2));
+	ctx.workbuf = workbuf;
+	ctx.workbuf_size = sizeof(workbuf);
+	vb2_init_context(&ctx);
+	memcpy(key, key1, size);
+	buf32 = (uint32_t *)((uint8_t *)key + key->key_offset);
+
+	/* Without a cache it's just unpacking */
+	TEST_SUCC(vb2_unpack_key_cached(&ctx, &pubk, key),
+		  "vb2_unpack_key_cached() no cache");
+	TEST_SUCC(vb2_unpack_key(&pubk2, key), "  unpack");
+	TEST_SUCC(memcmp(&pubk, &pubk2, sizeof(pubk)), "  same key");
+
+	vb2_key_cache_init(&ctx);
+	TEST_NEQ(vb2_get_sd(&ctx)->workbuf_key_cache_size, 0,
+		 "vb2_key_cache_init()");
+
+	memset(&pubk, 0, sizeof(pubk));
+	TEST_SUCC(vb2_unpack_key_cached(&ctx, &pubk, key),
+		  "vb2_unpack_key_cached() miss");
+	TEST_SUCC(memcmp(&pubk, &pubk2, sizeof(pubk)), "  same key");
+
+	memset(&pubk, 0, sizeof(pubk));
+	TEST_SUCC(vb2_unpack_key_cached(&ctx, &pubk, key),
+		  "vb2_unpack_key_cached() hit");
+	TEST_SUCC(memcmp(&pubk, &pubk2, sizeof(pubk)), "  same key");
+
+	/* Rewritten packed keys are unpacked again */
+	key->algorithm = VB2_ALG_COUNT;
+	TEST_EQ(vb2_unpack_key_cached(&ctx, &pubk, key),
+		VB2_ERROR_UNPACK_KEY_SIG_ALGORITHM,
+		"vb2_unpack_key_cached() changed algorithm");
+	key->algorithm = key1->algorithm;
+
+	buf32[0] /= 2;
+	TEST_EQ(vb2_unpack_key_cached(&ctx, &pubk, key),
+		VB2_ERROR_UNPACK_KEY_ARRAY_SIZE,
+		"vb2_unpack_key_cached() changed array size");
+	buf32[0] *= 2;
+
+	buf32[1]++;
+	TEST_SUCC(vb2_unpack_key_cached(&ctx, &pubk, key),
+		  "vb2_unpack_key_cached() changed n0inv");
+	TEST_EQ(pubk.n0inv, buf32[1], "  new n0inv");
+	buf32[1]--;
+
+	TEST_EQ(vb2_unpack_key_cached(&ctx, &pubk, NULL),
+		VB2_ERROR_UNPACK_KEY_BUFFER,
+		"vb2_unpack_key_cached() NULL");
+
+	free(key);
+}
+
 static void test_verify_data(const struct vb2_packed_key *key1,
 			     const struct vb2_signature *sig)
 {
@@ -138,6 +205,34 @@ static void test_verify_data(const struct vb2_packed_key *key1,
 	free(sig2);
 }
 
+static void test_calculate_signatures(const struct vb2_private_key *prik,
+				      struct vb2_signature *sig)
+{
+	const struct vb2_private_key *keys[2] = {prik, prik};
+	struct vb2_signature *sigs[2];
+	struct vb2_private_key bad_key;
+	int i;
+
+	TEST_SUCC(vb2_calculate_signatures(test_data, sizeof(test_data),
+					   keys, 2, sigs),
+		  "Calculate signatures");
+	for (i = 0; i < 2; i++) {
+		TEST_EQ(sigs[i]->sig_size, sig->sig_size, "  sig_size");
+		TEST_EQ(sigs[i]->data_size, sig->data_size, "  data_size");
+		TEST_EQ(0, memcmp(vb2_signature_data(sigs[i]),
+				  vb2_signature_data(sig), sig->sig_size),
+			"  same sig");
+		free(sigs[i]);
+	}
+
+	bad_key = *prik;
+	bad_key.hash_alg = VB2_HASH_INVALID;
+	keys[1] = &bad_key;
+	TEST_EQ(vb2_calculate_signatures(test_data, sizeof(test_data),
+					 keys, 2, sigs),
+		VB2_SIGN_DATA_DIGEST_SIZE, "Calculate signatures bad key");
+	TEST_PTR_EQ(sigs[0], NULL, "  no sigs");
+}
 
 int test_algorithm(int key_algorithm, const char *keys_dir)
 {
@@ -177,15 +272,16 @@ int test_algorithm(int key_algorithm, const char *keys_dir)
 		goto cleanup_algorithm;
 
 	test_unpack_key(key1);
+	test_unpack_key_cached(key1);
 	test_verify_data(key1, sig);
+	test_calculate_signatures(private_key, sig);
 
 	retval = 0;
 
 cleanup_algorithm:
 	if (key1)
 		free(key1);
-	if (private_key)
-		free(private_key);
+	vb2_free_private_key(private_key);
 	if (sig)
 		free(sig);
 
@@ -189,6 +189,74 @@ static void test_verify_keyblock(const struct vb2_public_key *public_key,
 	free(hdr);
 }
 
+static void test_build_in_place(const struct vb2_private_key *private_key,
+				const struct vb2_packed_key *data_key)
+{
+	struct vb2_signature *body_sig = vb2_alloc_signature(56, 78);
+	struct vb2_keyblock *kb;
+	struct vb2_fw_preamble *fw;
+	struct vb2_kernel_preamble *kp;
+	uint8_t *buf;
+	uint32_t size;
+
+	/* Keyblock */
+	kb = vb2_create_keyblock(data_key, private_key, 0x1234);
+	size = vb2_keyblock_size(data_key, private_key);
+	TEST_EQ(size, kb->keyblock_size, "vb2_keyblock_size()");
+	buf = malloc(size);
+	TEST_EQ(vb2_build_keyblock(buf, size - 1, data_key, private_key,
+				   0x1234),
+		VB2_KEYBLOCK_CREATE_BUF_SIZE, "vb2_build_keyblock() too small");
+	TEST_SUCC(vb2_build_keyblock(buf, size, data_key, private_key, 0x1234),
+		  "vb2_build_keyblock()");
+	TEST_SUCC(memcmp(buf, kb, size), "vb2_build_keyblock() matches");
+	free(buf);
+	free(kb);
+
+	/* Firmware preamble */
+	fw = vb2_create_fw_preamble(0x1234, data_key, body_sig,
+				    private_key, 0x5678);
+	size = vb2_fw_preamble_size(data_key, body_sig, private_key);
+	TEST_EQ(size, fw->preamble_size, "vb2_fw_preamble_size()");
+	buf = malloc(size);
+	TEST_EQ(vb2_build_fw_preamble(buf, size - 1, 0x1234, data_key,
+				      body_sig, private_key, 0x5678),
+		VB2_FW_PREAMBLE_CREATE_BUF_SIZE,
+		"vb2_build_fw_preamble() too small");
+	TEST_SUCC(vb2_build_fw_preamble(buf, size, 0x1234, data_key,
+					body_sig, private_key, 0x5678),
+		  "vb2_build_fw_preamble()");
+	TEST_SUCC(memcmp(buf, fw, size), "vb2_build_fw_preamble() matches");
+	free(buf);
+	free(fw);
+
+	/* Kernel preamble, padded to a desired size */
+	kp = vb2_create_kernel_preamble(0x1234, 0x100000, 0x300000, 0x4000,
+					body_sig, 0x304000, 0x10000, 0,
+					0, NULL, 0, 0, 0x4000, private_key);
+	size = vb2_kernel_preamble_size(body_sig, 0, 0, 0x4000, private_key);
+	TEST_EQ(size, 0x4000, "vb2_kernel_preamble_size() padded");
+	TEST_EQ(size, kp->preamble_size, "vb2_kernel_preamble_size()");
+	buf = malloc(size);
+	TEST_EQ(vb2_build_kernel_preamble(buf, size - 1, 0x1234, 0x100000,
+					  0x300000, 0x4000, body_sig,
+					  0x304000, 0x10000, 0, 0, NULL, 0,
+					  0, 0x4000, private_key),
+		VB2_KERNEL_PREAMBLE_CREATE_BUF_SIZE,
+		"vb2_build_kernel_preamble() too small");
+	TEST_SUCC(vb2_build_kernel_preamble(buf, size, 0x1234, 0x100000,
+					    0x300000, 0x4000, body_sig,
+					    0x304000, 0x10000, 0, 0, NULL, 0,
+					    0, 0x4000, private_key),
+		  "vb2_build_kernel_preamble()");
+	TEST_SUCC(memcmp(buf, kp, size),
+		  "vb2_build_kernel_preamble() matches");
+	free(buf);
+	free(kp);
+
+	free(body_sig);
+}
+
 static void resign_fw_preamble(struct vb2_fw_preamble *h,
 			       struct vb2_private_key *key)
 {
@@ -363,7 +431,8 @@ static void test_verify_kernel_preamble(
 
 	struct vb2_kernel_preamble *hdr =
 		vb2_create_kernel_preamble(0x1234, 0x100000, 0x300000, 0x4000,
-					   body_sig, 0x304000, 0x10000, 0, 0,
+					   body_sig, 0x304000, 0x10000, 0,
+					   0, NULL, 0, 0, 0,
 					   private_key);
 	TEST_PTR_NEQ(hdr, NULL,
 		     "vb2_verify_kernel_preamble() prereq test preamble");
@@ -509,6 +578,201 @@ static void test_verify_kernel_preamble(
 	free(body_sig);
 }
 
+static void test_kernel_body_chunks(const struct vb2_packed_key *public_key,
+				    const struct vb2_private_key *private_key)
+{
+	struct vb2_kernel_preamble *h;
+	struct vb2_body_digests bd;
+	struct vb2_public_key rsa;
+	struct vb2_workbuf wb;
+	uint8_t body[10000];
+	uint32_t hsize;
+	int i;
+
+	uint8_t workbuf[VB2_VERIFY_KERNEL_PREAMBLE_WORKBUF_BYTES]
+		 __attribute__ ((aligned (VB2_WORKBUF_ALIGN)));
+
+	vb2_workbuf_init(&wb, workbuf, sizeof(workbuf));
+	for (i = 0; i < sizeof(body); i++)
+		body[i] = (uint8_t)(i * 7 + i / 1000);
+
+	TEST_SUCC(vb2_unpack_key(&rsa, public_key),
+		  "vb2_verify_kernel_body_chunk() prereq key");
+
+	/* Three chunks, the last one short */
+	TEST_SUCC(vb2_body_digests_init(&bd, rsa.hash_alg, 4096),
+		  "vb2_body_digests_init()");
+	TEST_SUCC(vb2_body_digests_extend(&bd, body, 5000),
+		  "vb2_body_digests_extend() part");
+	TEST_SUCC(vb2_body_digests_extend(&bd, body + 5000,
+					  sizeof(body) - 5000),
+		  "vb2_body_digests_extend() rest");
+	TEST_SUCC(vb2_body_digests_finalize(&bd),
+		  "vb2_body_digests_finalize()");
+	TEST_EQ(bd.digests_size, 3 * vb2_digest_size(rsa.hash_alg),
+		"  one digest per chunk");
+
+	struct vb2_signature *body_sig =
+		vb2_alloc_signature(56, sizeof(body));
+	struct vb2_kernel_preamble *hdr =
+		vb2_create_kernel_preamble(0x1234, 0x100000, 0, 0,
+					   body_sig, 0, 0, 0,
+					   4096, bd.digests, bd.digests_size,
+					   0, 0, private_key);
+	TEST_PTR_NEQ(hdr, NULL, "vb2_create_kernel_preamble() with digests");
+	if (!hdr) {
+		free(bd.digests);
+		free(body_sig);
+		return;
+	}
+	TEST_EQ(hdr->header_version_minor,
+		KERNEL_PREAMBLE_HEADER_VERSION_MINOR_DIGESTS,
+		"  preamble version 2.3");
+
+	hsize = hdr->preamble_size;
+	h = malloc(hsize);
+
+	memcpy(h, hdr, hsize);
+	TEST_SUCC(vb2_verify_kernel_preamble(h, hsize, &rsa, &wb),
+		  "vb2_verify_kernel_preamble() with digests");
+	TEST_EQ(vb2_kernel_get_body_chunk_size(h), 4096, "  chunk size");
+	TEST_EQ(vb2_kernel_get_body_chunk_count(h), 3, "  chunk count");
+
+	/* Chunks verify in any order */
+	TEST_SUCC(vb2_verify_kernel_body_chunk(h, 2, body + 8192,
+					       sizeof(body) - 8192,
+					       rsa.hash_alg),
+		  "vb2_verify_kernel_body_chunk() last");
+	TEST_SUCC(vb2_verify_kernel_body_chunk(h, 0, body, 4096,
+					       rsa.hash_alg),
+		  "vb2_verify_kernel_body_chunk() first");
+	TEST_EQ(vb2_verify_kernel_body_chunk(h, 1, body, 4096, rsa.hash_alg),
+		VB2_ERROR_PREAMBLE_BODY_CHUNK_DIGEST,
+		"vb2_verify_kernel_body_chunk() wrong data");
+	TEST_EQ(vb2_verify_kernel_body_chunk(h, 1, body + 4096, 4095,
+					     rsa.hash_alg),
+		VB2_ERROR_PREAMBLE_BODY_CHUNK_INDEX,
+		"vb2_verify_kernel_body_chunk() short");
+	TEST_EQ(vb2_verify_kernel_body_chunk(h, 3, body, 0, rsa.hash_alg),
+		VB2_ERROR_PREAMBLE_BODY_CHUNK_INDEX,
+		"vb2_verify_kernel_body_chunk() off end");
+
+	/* Digests must be signed */
+	memcpy(h, hdr, hsize);
+	h->body_digest_offset = h->preamble_signature.sig_offset;
+	resign_kernel_preamble(h, private_key);
+	TEST_EQ(vb2_verify_kernel_preamble(h, hsize, &rsa, &wb),
+		VB2_ERROR_PREAMBLE_BODY_DIGESTS_OUTSIDE,
+		"vb2_verify_kernel_preamble() digests off end");
+
+	memcpy(h, hdr, hsize);
+	h->body_chunk_size = 1;
+	resign_kernel_preamble(h, private_key);
+	TEST_EQ(vb2_verify_kernel_preamble(h, hsize, &rsa, &wb),
+		VB2_ERROR_PREAMBLE_BODY_DIGESTS_OUTSIDE,
+		"vb2_verify_kernel_preamble() too many digests");
+
+	/* Older preambles have no digests */
+	memcpy(h, hdr, hsize);
+	h->header_version_minor = 2;
+	resign_kernel_preamble(h, private_key);
+	TEST_SUCC(vb2_verify_kernel_preamble(h, hsize, &rsa, &wb),
+		  "vb2_verify_kernel_preamble() 2.2 ignores digests");
+	TEST_EQ(vb2_kernel_get_body_chunk_size(h), 0, "  no chunk size");
+	TEST_EQ(vb2_kernel_get_body_chunk_count(h), 0, "  no chunks");
+	TEST_PTR_EQ(vb2_kernel_get_body_digests(h), NULL, "  no digests");
+
+	free(h);
+	free(hdr);
+	free(bd.digests);
+	free(body_sig);
+}
+
+static void test_kernel_compression(const struct vb2_packed_key *public_key,
+				    const struct vb2_private_key *private_key)
+{
+	struct vb2_kernel_preamble *h;
+	struct vb2_public_key rsa;
+	struct vb2_workbuf wb;
+	uint32_t hsize;
+
+	uint8_t workbuf[VB2_VERIFY_KERNEL_PREAMBLE_WORKBUF_BYTES]
+		 __attribute__ ((aligned (VB2_WORKBUF_ALIGN)));
+
+	vb2_workbuf_init(&wb, workbuf, sizeof(workbuf));
+
+	TEST_SUCC(vb2_unpack_key(&rsa, public_key),
+		  "vb2_kernel_get_compression() prereq key");
+
+	/* The bootloader is past the end of the compressed body */
+	struct vb2_signature *body_sig = vb2_alloc_signature(56, 0x100000);
+	struct vb2_kernel_preamble *hdr =
+		vb2_create_kernel_preamble(0x1234, 0x100000, 0x400000, 0x4000,
+					   body_sig, 0, 0,
+					   VB2_KERNEL_COMPRESSION_LZ4 <<
+					   VB2_KERNEL_PREAMBLE_COMPRESSION_SHIFT,
+					   0, NULL, 0, 0x310000,
+					   0, private_key);
+	TEST_PTR_NEQ(hdr, NULL, "vb2_create_kernel_preamble() compressed");
+	if (!hdr) {
+		free(body_sig);
+		return;
+	}
+	TEST_EQ(hdr->header_version_minor,
+		KERNEL_PREAMBLE_HEADER_VERSION_MINOR_COMPRESSED,
+		"  preamble version 2.4");
+
+	hsize = hdr->preamble_size;
+	h = malloc(hsize);
+
+	memcpy(h, hdr, hsize);
+	TEST_SUCC(vb2_verify_kernel_preamble(h, hsize, &rsa, &wb),
+		  "vb2_verify_kernel_preamble() compressed");
+	TEST_EQ(vb2_kernel_get_compression(h), VB2_KERNEL_COMPRESSION_LZ4,
+		"  compression");
+	TEST_EQ(vb2_kernel_get_body_load_size(h), 0x310000, "  load size");
+
+	memcpy(h, hdr, hsize);
+	h->body_load_size = 0x300000;
+	resign_kernel_preamble(h, private_key);
+	TEST_EQ(vb2_verify_kernel_preamble(h, hsize, &rsa, &wb),
+		VB2_ERROR_PREAMBLE_BOOTLOADER_OUTSIDE,
+		"vb2_verify_kernel_preamble() bootloader off end of load");
+
+	memcpy(h, hdr, hsize);
+	h->flags |= VB2_KERNEL_PREAMBLE_COMPRESSION_MASK;
+	resign_kernel_preamble(h, private_key);
+	TEST_EQ(vb2_verify_kernel_preamble(h, hsize, &rsa, &wb),
+		VB2_ERROR_PREAMBLE_COMPRESSION,
+		"vb2_verify_kernel_preamble() unknown compression");
+
+	/* Older preambles can't be compressed */
+	memcpy(h, hdr, hsize);
+	h->header_version_minor = 3;
+	resign_kernel_preamble(h, private_key);
+	TEST_EQ(vb2_verify_kernel_preamble(h, hsize, &rsa, &wb),
+		VB2_ERROR_PREAMBLE_COMPRESSION,
+		"vb2_verify_kernel_preamble() compressed 2.3");
+	TEST_EQ(vb2_kernel_get_compression(h), VB2_KERNEL_COMPRESSION_NONE,
+		"  no compression");
+	TEST_EQ(vb2_kernel_get_body_load_size(h), 0x100000,
+		"  load size is body size");
+
+	/* Uncompressed 2.4 bodies load as they are */
+	memcpy(h, hdr, hsize);
+	h->flags = 0;
+	h->bootloader_address = 0x1f0000;
+	resign_kernel_preamble(h, private_key);
+	TEST_SUCC(vb2_verify_kernel_preamble(h, hsize, &rsa, &wb),
+		  "vb2_verify_kernel_preamble() 2.4 uncompressed");
+	TEST_EQ(vb2_kernel_get_body_load_size(h), 0x100000,
+		"  load size is body size");
+
+	free(h);
+	free(hdr);
+	free(body_sig);
+}
+
 int test_permutation(int signing_key_algorithm, int data_key_algorithm,
 		     const char *keys_dir)
 {
@@ -573,17 +837,19 @@ int test_permutation(int signing_key_algorithm, int data_key_algorithm,
 			    data_public_key);
 	test_verify_keyblock(&signing_public_key2, signing_private_key,
 			     data_public_key);
+	test_build_in_place(signing_private_key, data_public_key);
 	test_verify_fw_preamble(signing_public_key, signing_private_key,
 				data_public_key);
 	test_verify_kernel_preamble(signing_public_key, signing_private_key);
+	test_kernel_body_chunks(signing_public_key, signing_private_key);
+	test_kernel_compression(signing_public_key, signing_private_key);
 
 	retval = 0;
 
 cleanup_permutation:
 	if (signing_public_key)
 		free(signing_public_key);
-	if (signing_private_key)
-		free(signing_private_key);
+	vb2_free_private_key(signing_private_key);
 	if (data_public_key)
 		free(data_public_key);
 
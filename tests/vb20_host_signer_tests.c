@@ -0,0 +1,223 @@
+/* Copyright 2018 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ *
+ * Tests for host library signer backends
+ */
+
+#include <openssl/evp.h>
+#include <openssl/rsa.h>
+#include <openssl/x509.h>
+
+#include <stdio.h>
+#include <string.h>
+
+#include "2sysincludes.h"
+#include "2common.h"
+#include "2rsa.h"
+#include "2sha.h"
+#include "vb21_common.h"
+#include "host_common.h"
+#include "host_key2.h"
+#include "host_signature2.h"
+#include "host_signer.h"
+#include "vb2_common.h"
+#include "test_common.h"
+
+static const uint8_t test_data[] = "This is some test data to sign.";
+
+static int opened, signed_count, closed;
+
+/* A backend which keeps an in-memory key read from a .vbprivk file */
+static int test_open_key(struct vb2_private_key *key, const char *spec,
+			 enum vb2_crypto_algorithm algorithm)
+{
+	const unsigned char *der;
+	uint8_t *buf;
+	uint32_t size;
+	uint64_t alg;
+	EVP_PKEY *pkey;
+
+	if (!strcmp(spec, "missing"))
+		return VB2_ERROR_SIGNER_OPEN_KEY;
+
+	if (vb2_read_file(spec, &buf, &size))
+		return VB2_ERROR_SIGNER_OPEN_KEY;
+	if (size <= sizeof(alg)) {
+		free(buf);
+		return VB2_ERROR_SIGNER_OPEN_KEY;
+	}
+
+	/* Algorithm, then the DER private key */
+	memcpy(&alg, buf, sizeof(alg));
+	der = buf + sizeof(alg);
+	pkey = d2i_PrivateKey(EVP_PKEY_RSA, NULL, &der, size - sizeof(alg));
+	free(buf);
+	if (!pkey)
+		return VB2_ERROR_SIGNER_OPEN_KEY;
+
+	key->hash_alg = vb2_crypto_to_hash(alg);
+	key->sig_alg = vb2_crypto_to_signature(alg);
+	key->signer_key = pkey;
+	opened++;
+	return VB2_SUCCESS;
+}
+
+static int test_sign(const struct vb2_private_key *key,
+		     const uint8_t *data, uint32_t size,
+		     uint8_t *sig, uint32_t sig_size)
+{
+	EVP_PKEY_CTX *ctx;
+	size_t len = sig_size;
+	int ok;
+
+	signed_count++;
+
+	/* With no digest set, this pads the digest info as given */
+	ctx = EVP_PKEY_CTX_new(key->signer_key, NULL);
+	if (!ctx)
+		return VB2_SIGN_DATA_RSA_ENCRYPT;
+	ok = EVP_PKEY_sign_init(ctx) > 0 &&
+		EVP_PKEY_CTX_set_rsa_padding(ctx, RSA_PKCS1_PADDING) > 0 &&
+		EVP_PKEY_sign(ctx, sig, &len, data, size) > 0 &&
+		len == sig_size;
+	EVP_PKEY_CTX_free(ctx);
+
+	return ok ? VB2_SUCCESS : VB2_SIGN_DATA_RSA_ENCRYPT;
+}
+
+static void test_close_key(struct vb2_private_key *key)
+{
+	EVP_PKEY_free(key->signer_key);
+	key->signer_key = NULL;
+	closed++;
+}
+
+static const struct vb2_signer test_signer = {
+	.name = "test",
+	.open_key = test_open_key,
+	.sign = test_sign,
+	.close_key = test_close_key,
+};
+
+static void find_tests(void)
+{
+	TEST_PTR_EQ(vb2_find_signer("pkcs11:lib.so:0:key"),
+		    &vb2_pkcs11_signer, "Find pkcs11");
+	TEST_PTR_EQ(vb2_find_signer("key_rsa2048.sha256.vbprivk"), NULL,
+		    "Find file");
+	TEST_PTR_EQ(vb2_find_signer("pkcs1:lib.so:0:key"), NULL,
+		    "Find prefix of name");
+	TEST_PTR_EQ(vb2_find_signer("pkcs111:lib.so:0:key"), NULL,
+		    "Find longer name");
+	TEST_PTR_EQ(vb2_find_signer("test:foo"), NULL,
+		    "Find unregistered");
+
+	TEST_SUCC(vb2_register_signer(&test_signer), "Register");
+	TEST_PTR_EQ(vb2_find_signer("test:foo"), &test_signer,
+		    "Find registered");
+}
+
+static void sign_tests(const char *keys_dir)
+{
+	char name[1024];
+	struct vb2_private_key *key, *mem_key;
+	struct vb2_signature *sig, *mem_sig;
+	struct vb21_signature *sig21, *mem_sig21;
+
+	snprintf(name, sizeof(name), "%s/key_rsa2048.sha256.vbprivk",
+		 keys_dir);
+	mem_key = vb2_read_private_key(name);
+	TEST_PTR_NEQ(mem_key, NULL, "Read file key");
+
+	snprintf(name, sizeof(name), "test:%s/key_rsa2048.sha256.vbprivk",
+		 keys_dir);
+	key = vb2_read_private_key(name);
+	TEST_PTR_NEQ(key, NULL, "Read backend key");
+	if (!key || !mem_key)
+		return;
+	TEST_EQ(opened, 1, "  opened");
+	TEST_PTR_EQ(key->signer, &test_signer, "  signer");
+	TEST_PTR_EQ(key->rsa_private_key, NULL, "  no RSA key");
+	TEST_EQ(key->hash_alg, VB2_HASH_SHA256, "  hash_alg");
+	TEST_EQ(key->sig_alg, VB2_SIG_RSA2048, "  sig_alg");
+
+	/* Backend signatures match in-memory ones */
+	sig = vb2_calculate_signature(test_data, sizeof(test_data), key);
+	mem_sig = vb2_calculate_signature(test_data, sizeof(test_data),
+					  mem_key);
+	TEST_PTR_NEQ(sig, NULL, "Sign vb2");
+	TEST_EQ(signed_count, 1, "  by backend");
+	TEST_EQ(0, memcmp(vb2_signature_data(sig),
+			  vb2_signature_data(mem_sig), mem_sig->sig_size),
+		"  same sig");
+	free(sig);
+	free(mem_sig);
+
+	TEST_SUCC(vb21_sign_data(&sig21, test_data, sizeof(test_data), key,
+				 NULL), "Sign vb21");
+	TEST_SUCC(vb21_sign_data(&mem_sig21, test_data, sizeof(test_data),
+				 mem_key, NULL), "  in memory");
+	TEST_EQ(signed_count, 2, "  by backend");
+	TEST_EQ(0, memcmp(sig21, mem_sig21, mem_sig21->c.total_size),
+		"  same sig");
+	free(sig21);
+	free(mem_sig21);
+
+	vb2_free_private_key(key);
+	TEST_EQ(closed, 1, "Free backend key");
+	vb2_free_private_key(mem_key);
+
+	/* PEM readers hand backend keys over too, with their algorithm */
+	key = vb2_read_private_key_pem(name, VB2_ALG_RSA2048_SHA256);
+	TEST_PTR_NEQ(key, NULL, "Read backend key as PEM");
+	TEST_PTR_EQ(key ? key->signer : NULL, &test_signer, "  signer");
+	vb2_free_private_key(key);
+
+	TEST_SUCC(vb2_private_key_read_pem(&key, name),
+		  "Read backend key as vb21 PEM");
+	TEST_PTR_EQ(key->signer, &test_signer, "  signer");
+	vb2_private_key_free(key);
+	TEST_EQ(closed, 3, "  freed");
+
+	TEST_PTR_EQ(vb2_read_private_key("test:missing"), NULL,
+		    "Read missing key");
+}
+
+static void pkcs11_tests(void)
+{
+	TEST_PTR_EQ(vb2_read_private_key("pkcs11:"), NULL,
+		    "PKCS#11 empty spec");
+	TEST_PTR_EQ(vb2_read_private_key("pkcs11:lib.so:0"), NULL,
+		    "PKCS#11 no label");
+	TEST_PTR_EQ(vb2_read_private_key("pkcs11:lib.so:zero:key"), NULL,
+		    "PKCS#11 bad slot");
+	TEST_PTR_EQ(vb2_read_private_key("pkcs11:lib.so:0:key:999"), NULL,
+		    "PKCS#11 bad algorithm");
+	TEST_PTR_EQ(vb2_read_private_key("pkcs11:/no/such/module.so:0:key"),
+		    NULL, "PKCS#11 missing module");
+}
+
+static void register_tests(void)
+{
+	int i, rv = VB2_SUCCESS;
+
+	for (i = 0; i < 16 && !rv; i++)
+		rv = vb2_register_signer(&test_signer);
+	TEST_EQ(rv, VB2_ERROR_SIGNER_REGISTER, "Register too many");
+}
+
+int main(int argc, char *argv[])
+{
+	if (argc != 2) {
+		fprintf(stderr, "Usage: %s <keys_dir>", argv[0]);
+		return -1;
+	}
+
+	find_tests();
+	sign_tests(argv[1]);
+	pkcs11_tests();
+	register_tests();
+
+	return gTestSuccess ? 0 : 255;
+}
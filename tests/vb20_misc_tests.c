@@ -43,10 +43,17 @@ static struct {
 		struct vb2_fw_preamble pre;
 		uint8_t predata[128];
 	} p;
+	/* Room to read ahead past the preamble */
+	uint8_t pad[VB2_VBLOCK_READ_AHEAD];
 
 } mock_vblock;
 
 static int mock_read_res_fail_on_call;
+static int mock_read_vblock_calls;
+static int mock_read_gbb_calls;
+static const struct vb2_public_key *mock_embedded_root_key;
+static struct vb2_public_key mock_root_key;
+static const struct vb2_public_key *mock_keyblock_key;
 static int mock_unpack_key_retval;
 static int mock_verify_keyblock_retval;
 static int mock_verify_preamble_retval;
@@ -77,6 +84,11 @@ static void reset_common_data(enum reset_type t)
 	vb2_secdata_init(&cc);
 
 	mock_read_res_fail_on_call = 0;
+	mock_read_vblock_calls = 0;
+	mock_read_gbb_calls = 0;
+	mock_embedded_root_key = NULL;
+	memset(&mock_root_key, 0, sizeof(mock_root_key));
+	mock_keyblock_key = NULL;
 	mock_unpack_key_retval = VB2_SUCCESS;
 	mock_verify_keyblock_retval = VB2_SUCCESS;
 	mock_verify_preamble_retval = VB2_SUCCESS;
@@ -108,8 +120,11 @@ static void reset_common_data(enum reset_type t)
 	pre->firmware_version = 2;
 
 	/* If verifying preamble, verify keyblock first to set up data key */
-	if (t == FOR_PREAMBLE)
+	if (t == FOR_PREAMBLE) {
 		vb2_load_fw_keyblock(&cc);
+		/* Tests change the preamble after this, so read it again */
+		sd->workbuf_vblock_ahead_size = 0;
+	}
 };
 
 /* Mocked functions */
@@ -130,10 +145,12 @@ int vb2ex_read_resource(struct vb2_context *ctx,
 	case VB2_RES_GBB:
 		rptr = (uint8_t *)&mock_gbb;
 		rsize = sizeof(mock_gbb);
+		mock_read_gbb_calls++;
 		break;
 	case VB2_RES_FW_VBLOCK:
 		rptr = (uint8_t *)&mock_vblock;
 		rsize = sizeof(mock_vblock);
+		mock_read_vblock_calls++;
 		break;
 	default:
 		return VB2_ERROR_EX_READ_RESOURCE_INDEX;
@@ -159,6 +176,8 @@ int vb2_verify_keyblock(struct vb2_keyblock *block,
 			const struct vb2_public_key *key,
 			const struct vb2_workbuf *wb)
 {
+	mock_keyblock_key = key;
+	memcpy(&mock_root_key, key, sizeof(mock_root_key));
 	return mock_verify_keyblock_retval;
 }
 
@@ -170,6 +189,11 @@ int vb2_verify_fw_preamble(struct vb2_fw_preamble *preamble,
 	return mock_verify_preamble_retval;
 }
 
+const struct vb2_public_key *vb2ex_embedded_root_key(void)
+{
+	return mock_embedded_root_key;
+}
+
 /* Tests */
 
 static void verify_keyblock_tests(void)
@@ -182,6 +206,7 @@ static void verify_keyblock_tests(void)
 	reset_common_data(FOR_KEYBLOCK);
 	wb_used_before = cc.workbuf_used;
 	TEST_SUCC(vb2_load_fw_keyblock(&cc), "keyblock verify");
+	TEST_EQ(mock_read_vblock_calls, 1, "keyblock read ahead");
 	TEST_EQ(sd->fw_version, 0x20000, "keyblock version");
 	TEST_EQ(sd->vblock_preamble_offset, sizeof(mock_vblock.k),
 		"preamble offset");
@@ -231,11 +256,26 @@ static void verify_keyblock_tests(void)
 	cc.workbuf_used = cc.workbuf_size -
 			vb2_wb_round_up(sd->gbb_rootkey_size);
 	TEST_EQ(vb2_load_fw_keyblock(&cc),
-		VB2_ERROR_FW_KEYBLOCK_WORKBUF_HEADER,
-		"keyblock not enough workbuf for header");
+		VB2_ERROR_FW_KEYBLOCK_WORKBUF,
+		"keyblock not enough workbuf for keyblock");
 
 	reset_common_data(FOR_KEYBLOCK);
 	mock_read_res_fail_on_call = 2;
+	TEST_SUCC(vb2_load_fw_keyblock(&cc), "keyblock read ahead fails");
+	TEST_EQ(mock_read_vblock_calls, 2, "keyblock read from vblock");
+
+	reset_common_data(FOR_KEYBLOCK);
+	cc.workbuf_used = cc.workbuf_size -
+			vb2_wb_round_up(sd->gbb_rootkey_size) -
+			vb2_wb_round_up(sizeof(mock_vblock.k));
+	TEST_SUCC(vb2_load_fw_keyblock(&cc), "keyblock no room to read ahead");
+	TEST_EQ(mock_read_vblock_calls, 2, "keyblock read from vblock 2");
+
+	reset_common_data(FOR_KEYBLOCK);
+	mock_read_res_fail_on_call = 2;
+	cc.workbuf_used = cc.workbuf_size -
+			vb2_wb_round_up(sd->gbb_rootkey_size) -
+			vb2_wb_round_up(sizeof(mock_vblock.k));
 	TEST_EQ(vb2_load_fw_keyblock(&cc),
 		VB2_ERROR_EX_READ_RESOURCE_INDEX,
 		"keyblock read keyblock header");
@@ -248,6 +288,11 @@ static void verify_keyblock_tests(void)
 		VB2_ERROR_FW_KEYBLOCK_WORKBUF,
 		"keyblock not enough workbuf for entire keyblock");
 
+	reset_common_data(FOR_KEYBLOCK);
+	kb->keyblock_size = VB2_VBLOCK_READ_AHEAD + 16;
+	TEST_SUCC(vb2_load_fw_keyblock(&cc), "keyblock past read ahead");
+	TEST_EQ(mock_read_vblock_calls, 2, "keyblock read rest");
+
 	reset_common_data(FOR_KEYBLOCK);
 	kb->keyblock_size = sizeof(mock_vblock) + 1;
 	TEST_EQ(vb2_load_fw_keyblock(&cc),
@@ -278,6 +323,74 @@ static void verify_keyblock_tests(void)
 	TEST_SUCC(vb2_load_fw_keyblock(&cc), "keyblock rollback with GBB flag");
 }
 
+static void embedded_root_key_tests(void)
+{
+	struct vb2_keyblock *kb = &mock_vblock.k.kb;
+	struct vb2_public_key embedded;
+	struct vb2_packed_key *k;
+
+	/* Without a built-in key, the GBB one is used */
+	reset_common_data(FOR_KEYBLOCK);
+	TEST_SUCC(vb2_load_fw_keyblock(&cc), "gbb root key");
+	TEST_EQ(mock_read_gbb_calls, 1, "  gbb read");
+	TEST_EQ(mock_root_key.allow_hwcrypto, 1, "  hwcrypto allowed");
+
+	/* A built-in key replaces the GBB read and unpack */
+	reset_common_data(FOR_KEYBLOCK);
+	memset(&embedded, 0, sizeof(embedded));
+	embedded.sig_alg = VB2_SIG_RSA2048;
+	embedded.hash_alg = VB2_HASH_SHA256;
+	mock_embedded_root_key = &embedded;
+	mock_unpack_key_retval = VB2_ERROR_UNPACK_KEY_SIG_ALGORITHM;
+	sd->gbb_rootkey_size = sizeof(mock_gbb.rootkey) +
+		sizeof(mock_gbb.rootkey_data);
+	TEST_SUCC(vb2_load_fw_keyblock(&cc), "embedded root key");
+	TEST_EQ(mock_read_gbb_calls, 0, "  no gbb read");
+	TEST_EQ(mock_root_key.sig_alg, VB2_SIG_RSA2048, "  sig alg");
+	TEST_EQ(mock_root_key.hash_alg, VB2_HASH_SHA256, "  hash alg");
+	TEST_EQ(mock_root_key.allow_hwcrypto, 1, "  hwcrypto allowed");
+	TEST_PTR_NEQ(mock_keyblock_key, &embedded, "  const key not changed");
+	TEST_EQ(embedded.allow_hwcrypto, 0, "  const key hwcrypto");
+	TEST_EQ(sd->fw_version, 0x20000, "  keyblock version");
+
+	/* The data key is still saved where the root key would have been */
+	k = (struct vb2_packed_key *)(cc.workbuf + sd->workbuf_data_key_offset);
+	TEST_EQ(k->key_offset, sizeof(*k), "  data key offset");
+	TEST_EQ(k->key_size, sizeof(mock_vblock.k.data_key_data),
+		"  data key size");
+	TEST_EQ(memcmp((uint8_t *)k + k->key_offset,
+		       mock_vblock.k.data_key_data,
+		       sizeof(mock_vblock.k.data_key_data)),
+		0, "  data key data");
+	TEST_EQ(sd->workbuf_data_key_size,
+		sizeof(*k) + sizeof(mock_vblock.k.data_key_data),
+		"  data key total size");
+
+	/* The data key has to fit in the space the GBB says the root key has */
+	reset_common_data(FOR_KEYBLOCK);
+	mock_embedded_root_key = &embedded;
+	sd->gbb_rootkey_size = sizeof(struct vb2_packed_key) +
+		sizeof(mock_vblock.k.data_key_data) - 1;
+	TEST_EQ(vb2_load_fw_keyblock(&cc),
+		VB2_ERROR_FW_KEYBLOCK_DATA_KEY_SIZE,
+		"embedded root key data key too big");
+
+	reset_common_data(FOR_KEYBLOCK);
+	mock_embedded_root_key = &embedded;
+	mock_verify_keyblock_retval = VB2_ERROR_KEYBLOCK_MAGIC;
+	TEST_EQ(vb2_load_fw_keyblock(&cc), VB2_ERROR_KEYBLOCK_MAGIC,
+		"embedded root key verify keyblock");
+
+	/* The built-in key also works with keyblocks past the read ahead */
+	reset_common_data(FOR_KEYBLOCK);
+	mock_embedded_root_key = &embedded;
+	sd->gbb_rootkey_size = sizeof(mock_gbb.rootkey) +
+		sizeof(mock_gbb.rootkey_data);
+	kb->keyblock_size = VB2_VBLOCK_READ_AHEAD + 16;
+	TEST_SUCC(vb2_load_fw_keyblock(&cc), "embedded key past read ahead");
+	TEST_EQ(mock_read_vblock_calls, 2, "  keyblock read rest");
+}
+
 static void verify_preamble_tests(void)
 {
 	struct vb2_fw_preamble *pre = &mock_vblock.p.pre;
@@ -296,6 +409,17 @@ static void verify_preamble_tests(void)
 		vb2_wb_round_up(sd->workbuf_preamble_offset +
 				sd->workbuf_preamble_size),
 		"workbuf used");
+	TEST_EQ(mock_read_vblock_calls, 3, "preamble read from vblock");
+
+	/* Preamble read ahead with the keyblock */
+	reset_common_data(FOR_KEYBLOCK);
+	TEST_SUCC(vb2_load_fw_keyblock(&cc), "preamble read ahead keyblock");
+	TEST_SUCC(vb2_load_fw_preamble(&cc), "preamble read ahead");
+	TEST_EQ(mock_read_vblock_calls, 1, "preamble read ahead calls");
+	TEST_EQ(memcmp(cc.workbuf + sd->workbuf_preamble_offset,
+		       &mock_vblock.p, sizeof(mock_vblock.p)),
+		0, "preamble read ahead data");
+	TEST_EQ(sd->workbuf_vblock_ahead_size, 0, "read ahead gone");
 
 	/* Expected failures */
 	reset_common_data(FOR_PREAMBLE);
@@ -310,13 +434,6 @@ static void verify_preamble_tests(void)
 		VB2_ERROR_UNPACK_KEY_HASH_ALGORITHM,
 		"preamble unpack data key");
 
-	reset_common_data(FOR_PREAMBLE);
-	cc.workbuf_used = cc.workbuf_size + VB2_WORKBUF_ALIGN -
-			vb2_wb_round_up(sizeof(struct vb2_fw_preamble));
-	TEST_EQ(vb2_load_fw_preamble(&cc),
-		VB2_ERROR_FW_PREAMBLE2_WORKBUF_HEADER,
-		"preamble not enough workbuf for header");
-
 	reset_common_data(FOR_PREAMBLE);
 	sd->vblock_preamble_offset = sizeof(mock_vblock);
 	TEST_EQ(vb2_load_fw_preamble(&cc),
@@ -385,10 +502,120 @@ static void verify_preamble_tests(void)
 	TEST_EQ(v, 0x20002, "no roll forward");
 }
 
+static void resume_tests(void)
+{
+	struct vb2_resume_state rs;
+
+	/* A normal boot records digests of what it verified */
+	reset_common_data(FOR_KEYBLOCK);
+	TEST_SUCC(vb2_load_fw_keyblock(&cc), "resume record keyblock");
+	TEST_SUCC(vb2_load_fw_preamble(&cc), "resume record preamble");
+	TEST_EQ(sd->resume.magic, VB2_RESUME_STATE_MAGIC, "  magic");
+	TEST_EQ(sd->resume.flags, VB2_RESUME_KEYBLOCK | VB2_RESUME_PREAMBLE,
+		"  flags");
+	memcpy(&rs, &sd->resume, sizeof(rs));
+	rs.flags = VB2_RESUME_ALL;
+
+	/* Failed verification doesn't record anything */
+	reset_common_data(FOR_KEYBLOCK);
+	mock_verify_keyblock_retval = VB2_ERROR_KEYBLOCK_SIG_INVALID;
+	TEST_EQ(vb2_load_fw_keyblock(&cc), VB2_ERROR_KEYBLOCK_SIG_INVALID,
+		"resume record bad keyblock");
+	TEST_EQ(sd->resume.flags, 0, "  flags");
+
+	/* On resume, unchanged data isn't verified again */
+	reset_common_data(FOR_KEYBLOCK);
+	cc.flags |= VB2_CONTEXT_S3_RESUME;
+	TEST_SUCC(vb2api_set_resume_state(&cc, &rs, sizeof(rs)),
+		  "resume set state");
+	mock_verify_keyblock_retval = VB2_ERROR_KEYBLOCK_SIG_INVALID;
+	mock_verify_preamble_retval = VB2_ERROR_PREAMBLE_SIG_INVALID;
+	TEST_SUCC(vb2_load_fw_keyblock(&cc), "resume keyblock unchanged");
+	TEST_SUCC(vb2_load_fw_preamble(&cc), "resume preamble unchanged");
+	TEST_NEQ(sd->status & VB2_SD_STATUS_RESUME_STATE, 0, "  still valid");
+	TEST_EQ(sd->fw_version, 0x20002, "  version");
+
+	/* Rollback is still checked */
+	reset_common_data(FOR_KEYBLOCK);
+	cc.flags |= VB2_CONTEXT_S3_RESUME;
+	vb2api_set_resume_state(&cc, &rs, sizeof(rs));
+	sd->fw_version_secdata = 0x30000;
+	TEST_EQ(vb2_load_fw_keyblock(&cc),
+		VB2_ERROR_FW_KEYBLOCK_VERSION_ROLLBACK,
+		"resume keyblock rollback");
+
+	/* Other slot is verified */
+	reset_common_data(FOR_KEYBLOCK);
+	cc.flags |= VB2_CONTEXT_S3_RESUME;
+	vb2api_set_resume_state(&cc, &rs, sizeof(rs));
+	sd->fw_slot = 1;
+	mock_verify_keyblock_retval = VB2_ERROR_KEYBLOCK_SIG_INVALID;
+	TEST_EQ(vb2_load_fw_keyblock(&cc), VB2_ERROR_KEYBLOCK_SIG_INVALID,
+		"resume other slot");
+
+	/* Changed keyblock is verified, and so is the preamble after it */
+	reset_common_data(FOR_KEYBLOCK);
+	cc.flags |= VB2_CONTEXT_S3_RESUME;
+	vb2api_set_resume_state(&cc, &rs, sizeof(rs));
+	mock_vblock.k.kbdata[0] ^= 1;
+	TEST_SUCC(vb2_load_fw_keyblock(&cc), "resume keyblock changed");
+	mock_vblock.k.kbdata[0] ^= 1;
+	TEST_EQ(sd->status & VB2_SD_STATUS_RESUME_STATE, 0, "  invalidated");
+	mock_verify_preamble_retval = VB2_ERROR_PREAMBLE_SIG_INVALID;
+	TEST_EQ(vb2_load_fw_preamble(&cc), VB2_ERROR_PREAMBLE_SIG_INVALID,
+		"  preamble verified");
+
+	/* Changed preamble is verified */
+	reset_common_data(FOR_KEYBLOCK);
+	cc.flags |= VB2_CONTEXT_S3_RESUME;
+	vb2api_set_resume_state(&cc, &rs, sizeof(rs));
+	TEST_SUCC(vb2_load_fw_keyblock(&cc), "resume preamble changed");
+	sd->workbuf_vblock_ahead_size = 0;
+	mock_vblock.p.predata[0] ^= 1;
+	mock_verify_preamble_retval = VB2_ERROR_PREAMBLE_SIG_INVALID;
+	TEST_EQ(vb2_load_fw_preamble(&cc), VB2_ERROR_PREAMBLE_SIG_INVALID,
+		"  preamble verified");
+	mock_vblock.p.predata[0] ^= 1;
+
+	/* Setting the state */
+	reset_common_data(FOR_KEYBLOCK);
+	TEST_EQ(vb2api_set_resume_state(&cc, &rs, sizeof(rs)),
+		VB2_ERROR_API_RESUME_STATE_NOT_RESUME, "resume set not resume");
+	cc.flags |= VB2_CONTEXT_S3_RESUME;
+	TEST_EQ(vb2api_set_resume_state(&cc, &rs, sizeof(rs) - 1),
+		VB2_ERROR_API_RESUME_STATE_INVALID, "resume set size");
+	rs.magic++;
+	TEST_EQ(vb2api_set_resume_state(&cc, &rs, sizeof(rs)),
+		VB2_ERROR_API_RESUME_STATE_INVALID, "resume set magic");
+	rs.magic--;
+	rs.flags = VB2_RESUME_KEYBLOCK;
+	TEST_EQ(vb2api_set_resume_state(&cc, &rs, sizeof(rs)),
+		VB2_ERROR_API_RESUME_STATE_INVALID, "resume set flags");
+	TEST_EQ(sd->status & VB2_SD_STATUS_RESUME_STATE, 0, "  not set");
+
+	/* Getting the state */
+	reset_common_data(FOR_KEYBLOCK);
+	TEST_EQ(vb2api_get_resume_state(&cc, &rs, sizeof(rs)),
+		VB2_ERROR_API_RESUME_STATE_INCOMPLETE, "resume get none");
+	vb2_load_fw_keyblock(&cc);
+	vb2_load_fw_preamble(&cc);
+	TEST_EQ(vb2api_get_resume_state(&cc, &rs, sizeof(rs)),
+		VB2_ERROR_API_RESUME_STATE_INCOMPLETE, "resume get no body");
+	sd->resume.flags |= VB2_RESUME_BODY;
+	TEST_EQ(vb2api_get_resume_state(&cc, &rs, sizeof(rs) - 1),
+		VB2_ERROR_API_RESUME_STATE_SIZE, "resume get size");
+	TEST_SUCC(vb2api_get_resume_state(&cc, &rs, sizeof(rs)),
+		  "resume get");
+	TEST_EQ(memcmp(&rs, &sd->resume, sizeof(rs)), 0, "  data");
+	TEST_EQ(sizeof(rs), VB2_RESUME_STATE_SIZE, "  size");
+}
+
 int main(int argc, char* argv[])
 {
 	verify_keyblock_tests();
+	embedded_root_key_tests();
 	verify_preamble_tests();
+	resume_tests();
 
 	return gTestSuccess ? 0 : 255;
 }
@@ -16,6 +16,17 @@
 #include "host_key.h"
 #include "vb2_common.h"
 
+static int retval_hwcrypto_rsa;
+static int hwcrypto_rsa_calls;
+
+int vb2ex_hwcrypto_rsa_verify_digest(const struct vb2_public_key *key,
+				     const uint8_t *sig,
+				     const uint8_t *digest)
+{
+	hwcrypto_rsa_calls++;
+	return retval_hwcrypto_rsa;
+}
+
 /**
  * Test valid and invalid signatures.
  */
@@ -70,7 +81,7 @@ static void test_verify_digest(struct vb2_public_key *key) {
 		VB2_ERROR_RSA_VERIFY_PARAM, "vb2_rsa_verify_digest() bad arg");
 
 	memcpy(sig, signatures[0], sizeof(sig));
-	vb2_workbuf_init(&wb, workbuf, sizeof(sig) * 3 - 1);
+	vb2_workbuf_init(&wb, workbuf, sizeof(sig) * 2 - 1);
 	TEST_EQ(vb2_rsa_verify_digest(key, sig, test_message_sha1_hash, &wb),
 		VB2_ERROR_RSA_VERIFY_WORKBUF,
 		"vb2_rsa_verify_digest() small workbuf");
@@ -100,6 +111,147 @@ static void test_verify_digest(struct vb2_public_key *key) {
 	sig[RSA1024NUMBYTES - 3] ^= 0x56;
 	TEST_EQ(vb2_rsa_verify_digest(key, sig, test_message_sha1_hash, &wb),
 		VB2_ERROR_RSA_PADDING, "vb2_rsa_verify_digest() bad sig end");
+
+	/* The HW crypto engine only gets asked if the key allows it */
+	retval_hwcrypto_rsa = VB2_ERROR_EX_HWCRYPTO_UNSUPPORTED;
+	hwcrypto_rsa_calls = 0;
+	memcpy(sig, signatures[0], sizeof(sig));
+	TEST_SUCC(vb2_rsa_verify_digest(key, sig, test_message_sha1_hash, &wb),
+		  "vb2_rsa_verify_digest() no HW");
+	TEST_EQ(hwcrypto_rsa_calls, 0, "  HW not asked");
+
+	key->allow_hwcrypto = 1;
+	memcpy(sig, signatures[0], sizeof(sig));
+	TEST_SUCC(vb2_rsa_verify_digest(key, sig, test_message_sha1_hash, &wb),
+		  "vb2_rsa_verify_digest() HW unsupported");
+	TEST_EQ(hwcrypto_rsa_calls, 1, "  HW asked");
+
+	memcpy(sig, signatures[0], sizeof(sig));
+	sig[3] ^= 0x42;
+	TEST_EQ(vb2_rsa_verify_digest(key, sig, test_message_sha1_hash, &wb),
+		VB2_ERROR_RSA_PADDING,
+		"vb2_rsa_verify_digest() HW unsupported, bad sig");
+
+	retval_hwcrypto_rsa = VB2_SUCCESS;
+	TEST_SUCC(vb2_rsa_verify_digest(key, sig, test_message_sha1_hash, &wb),
+		  "vb2_rsa_verify_digest() HW good");
+
+	retval_hwcrypto_rsa = VB2_ERROR_MOCK;
+	memcpy(sig, signatures[0], sizeof(sig));
+	TEST_EQ(vb2_rsa_verify_digest(key, sig, test_message_sha1_hash, &wb),
+		VB2_ERROR_MOCK, "vb2_rsa_verify_digest() HW bad");
+	key->allow_hwcrypto = 0;
+}
+
+static void test_verify_digest_batch(struct vb2_public_key *key) {
+	uint8_t workbuf[VB2_VERIFY_DIGEST_WORKBUF_BYTES]
+		 __attribute__ ((aligned (VB2_WORKBUF_ALIGN)));
+	uint8_t sig[3][RSA1024NUMBYTES];
+	uint8_t *sigs[3] = {sig[0], sig[1], sig[2]};
+	const uint8_t *digests[3] = {test_message_sha1_hash,
+				     test_message_sha1_hash,
+				     test_message_sha1_hash};
+	int results[3];
+	struct vb2_workbuf wb;
+	int i;
+
+	vb2_workbuf_init(&wb, workbuf, sizeof(workbuf));
+
+	for (i = 0; i < 3; i++)
+		memcpy(sig[i], signatures[0], sizeof(sig[i]));
+	TEST_SUCC(vb2_rsa_verify_digest_batch(key, sigs, digests, 3, results,
+					      &wb),
+		  "vb2_rsa_verify_digest_batch() good");
+	TEST_EQ(results[0] | results[1] | results[2], 0, "  all good");
+
+	/* The rest get checked even if one is bad */
+	for (i = 0; i < 3; i++)
+		memcpy(sig[i], signatures[0], sizeof(sig[i]));
+	sig[1][3] ^= 0x42;
+	TEST_EQ(vb2_rsa_verify_digest_batch(key, sigs, digests, 3, results,
+					    &wb),
+		VB2_ERROR_RSA_PADDING, "vb2_rsa_verify_digest_batch() bad sig");
+	TEST_SUCC(results[0], "  first good");
+	TEST_EQ(results[1], VB2_ERROR_RSA_PADDING, "  second bad");
+	TEST_SUCC(results[2], "  third good");
+
+	for (i = 0; i < 3; i++)
+		memcpy(sig[i], signatures[0], sizeof(sig[i]));
+	sigs[2] = NULL;
+	TEST_EQ(vb2_rsa_verify_digest_batch(key, sigs, digests, 3, NULL, &wb),
+		VB2_ERROR_RSA_VERIFY_PARAM,
+		"vb2_rsa_verify_digest_batch() no results, NULL sig");
+	sigs[2] = sig[2];
+
+	TEST_SUCC(vb2_rsa_verify_digest_batch(key, sigs, digests, 0, NULL, &wb),
+		  "vb2_rsa_verify_digest_batch() none");
+	TEST_EQ(vb2_rsa_verify_digest_batch(key, NULL, digests, 3, results,
+					    &wb),
+		VB2_ERROR_RSA_VERIFY_PARAM,
+		"vb2_rsa_verify_digest_batch() bad arg");
+
+	for (i = 0; i < 3; i++)
+		memcpy(sig[i], signatures[0], sizeof(sig[i]));
+	vb2_workbuf_init(&wb, workbuf, sizeof(sig[0]) * 2 - 1);
+	TEST_EQ(vb2_rsa_verify_digest_batch(key, sigs, digests, 3, results,
+					    &wb),
+		VB2_ERROR_RSA_VERIFY_WORKBUF,
+		"vb2_rsa_verify_digest_batch() small workbuf");
+	TEST_EQ(results[2], VB2_ERROR_RSA_VERIFY_WORKBUF, "  all small");
+	vb2_workbuf_init(&wb, workbuf, sizeof(workbuf));
+
+	key->arrsize *= 2;
+	TEST_EQ(vb2_rsa_verify_digest_batch(key, sigs, digests, 3, results,
+					    &wb),
+		VB2_ERROR_RSA_VERIFY_SIG_LEN,
+		"vb2_rsa_verify_digest_batch() bad sig len");
+	TEST_EQ(results[2], VB2_ERROR_RSA_VERIFY_SIG_LEN, "  all bad");
+	key->arrsize /= 2;
+
+	/* The HW crypto engine gets asked about each one */
+	key->allow_hwcrypto = 1;
+	retval_hwcrypto_rsa = VB2_SUCCESS;
+	hwcrypto_rsa_calls = 0;
+	sig[0][3] ^= 0x42;
+	TEST_SUCC(vb2_rsa_verify_digest_batch(key, sigs, digests, 3, results,
+					      &wb),
+		  "vb2_rsa_verify_digest_batch() HW good");
+	TEST_EQ(hwcrypto_rsa_calls, 3, "  HW asked");
+	key->allow_hwcrypto = 0;
+}
+
+static void test_recover_digest(struct vb2_public_key *key) {
+	uint8_t workbuf[VB2_VERIFY_DIGEST_WORKBUF_BYTES]
+		 __attribute__ ((aligned (VB2_WORKBUF_ALIGN)));
+	uint8_t sig[RSA1024NUMBYTES];
+	uint8_t digest[VB2_MAX_DIGEST_SIZE];
+	struct vb2_workbuf wb;
+
+	vb2_workbuf_init(&wb, workbuf, sizeof(workbuf));
+
+	memcpy(sig, signatures[0], sizeof(sig));
+	memset(digest, 0, sizeof(digest));
+	TEST_SUCC(vb2_rsa_recover_digest(key, sig, digest, sizeof(digest), &wb),
+		  "vb2_rsa_recover_digest() good");
+	TEST_SUCC(memcmp(digest, test_message_sha1_hash,
+			 sizeof(test_message_sha1_hash)),
+		  "vb2_rsa_recover_digest() digest");
+
+	memcpy(sig, signatures[0], sizeof(sig));
+	TEST_EQ(vb2_rsa_recover_digest(key, sig, NULL, sizeof(digest), &wb),
+		VB2_ERROR_RSA_VERIFY_PARAM,
+		"vb2_rsa_recover_digest() bad arg");
+
+	memcpy(sig, signatures[0], sizeof(sig));
+	TEST_EQ(vb2_rsa_recover_digest(key, sig, digest,
+				       sizeof(test_message_sha1_hash) - 1, &wb),
+		VB2_ERROR_RSA_VERIFY_PARAM,
+		"vb2_rsa_recover_digest() small digest");
+
+	memcpy(sig, signatures[0], sizeof(sig));
+	sig[3] ^= 0x42;
+	TEST_EQ(vb2_rsa_recover_digest(key, sig, digest, sizeof(digest), &wb),
+		VB2_ERROR_RSA_PADDING, "vb2_rsa_recover_digest() bad sig");
 }
 
 int main(int argc, char *argv[])
@@ -126,6 +278,8 @@ int main(int argc, char *argv[])
 	/* Run tests */
 	test_signatures(&k2);
 	test_verify_digest(&k2);
+	test_verify_digest_batch(&k2);
+	test_recover_digest(&k2);
 
 	/* Clean up and exit */
 	free(pk);
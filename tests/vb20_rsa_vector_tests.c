@@ -0,0 +1,180 @@
+/* Copyright 2018 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ *
+ * Checks the signatures in tests/testcases against the keys in
+ * tests/testkeys, for every key size and hash algorithm, in one process.
+ * This replaces running verify_data once per algorithm.
+ */
+
+#include <ctype.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "2sysincludes.h"
+#include "2common.h"
+#include "2rsa.h"
+#include "2sha.h"
+#include "host_common.h"
+#include "host_key2.h"
+#include "host_signature.h"
+#include "vb2_common.h"
+#include "test_common.h"
+
+static uint8_t *test_file;
+static uint32_t test_file_size;
+
+/* Digests of the test file, by hash algorithm */
+static uint8_t digests[VB2_HASH_ALG_COUNT][VB2_MAX_DIGEST_SIZE];
+
+static double now_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+/* Lower-case name of the hash algorithm, as used in test case file names */
+static const char *hash_file_name(enum vb2_hash_algorithm hash_alg)
+{
+	static char name[16];
+	int i;
+
+	snprintf(name, sizeof(name), "%s",
+		 vb2_get_hash_algorithm_name(hash_alg));
+	for (i = 0; name[i]; i++)
+		name[i] = tolower(name[i]);
+	return name;
+}
+
+/* Read a signature file into a vb2_signature for the algorithm */
+static struct vb2_signature *read_sig(const char *filename, uint32_t alg)
+{
+	struct vb2_signature *sig;
+	uint8_t *buf;
+	uint32_t size;
+
+	if (vb2_read_file(filename, &buf, &size)) {
+		fprintf(stderr, "Can't read %s\n", filename);
+		return NULL;
+	}
+	if (size != vb2_rsa_sig_size(vb2_crypto_to_signature(alg))) {
+		fprintf(stderr, "%s is %u bytes, expected %u\n", filename,
+			size, vb2_rsa_sig_size(vb2_crypto_to_signature(alg)));
+		free(buf);
+		return NULL;
+	}
+
+	sig = vb2_alloc_signature(size, test_file_size);
+	if (sig)
+		memcpy(vb2_signature_data(sig), buf, size);
+	free(buf);
+	return sig;
+}
+
+static int test_algorithm(uint32_t alg, const char *keys_dir,
+			  const char *cases_dir)
+{
+	uint8_t workbuf[VB2_VERIFY_DIGEST_WORKBUF_BYTES]
+		 __attribute__ ((aligned (VB2_WORKBUF_ALIGN)));
+	enum vb2_hash_algorithm hash_alg = vb2_crypto_to_hash(alg);
+	enum vb2_hash_algorithm other_alg;
+	const char *alg_name = vb2_get_crypto_algorithm_name(alg);
+	struct vb2_packed_key *packed = NULL;
+	struct vb2_signature *sig = NULL;
+	struct vb2_public_key key;
+	struct vb2_workbuf wb;
+	char filename[1024];
+	uint8_t *sig_data;
+	double start;
+	int rv;
+
+	vb2_workbuf_init(&wb, workbuf, sizeof(workbuf));
+
+	snprintf(filename, sizeof(filename), "%s/key_%s.keyb",
+		 keys_dir, vb2_get_crypto_algorithm_file(alg));
+	packed = vb2_read_packed_keyb(filename, alg, 0);
+	if (!packed) {
+		fprintf(stderr, "Can't read %s\n", filename);
+		return 1;
+	}
+	if (vb2_unpack_key_buffer(&key, (const uint8_t *)packed,
+				  packed->key_offset + packed->key_size)) {
+		fprintf(stderr, "Can't unpack %s\n", filename);
+		free(packed);
+		return 1;
+	}
+
+	snprintf(filename, sizeof(filename), "%s/test_file.%s_%s.sig",
+		 cases_dir, vb2_get_crypto_algorithm_file(alg),
+		 hash_file_name(hash_alg));
+	sig = read_sig(filename, alg);
+	if (!sig) {
+		free(packed);
+		return 1;
+	}
+	sig_data = vb2_signature_data(sig);
+
+	start = now_ms();
+	rv = vb2_verify_digest(&key, sig, digests[hash_alg], &wb);
+	printf("%-24s verify %8.3f ms\n", alg_name, now_ms() - start);
+	TEST_SUCC(rv, "  good signature");
+
+	/* A signature for some other data doesn't verify */
+	other_alg = hash_alg == VB2_HASH_SHA1 ? VB2_HASH_SHA256 :
+		VB2_HASH_SHA1;
+	TEST_NEQ(vb2_verify_digest(&key, sig, digests[other_alg], &wb),
+		 0, "  wrong digest");
+
+	sig_data[sig->sig_size / 2] ^= 0x5a;
+	TEST_NEQ(vb2_verify_digest(&key, sig, digests[hash_alg], &wb),
+		 0, "  corrupt signature");
+
+	free(sig);
+	free(packed);
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	char filename[1024];
+	double start;
+	uint32_t alg;
+	int hash_alg;
+
+	if (argc != 3) {
+		fprintf(stderr, "Usage: %s <keys_dir> <testcases_dir>\n",
+			argv[0]);
+		return -1;
+	}
+
+	/* Load and hash the test file once for every case */
+	snprintf(filename, sizeof(filename), "%s/test_file", argv[2]);
+	if (vb2_read_file(filename, &test_file, &test_file_size)) {
+		fprintf(stderr, "Can't read %s\n", filename);
+		return 1;
+	}
+	for (hash_alg = VB2_HASH_SHA1; hash_alg <= VB2_HASH_SHA512;
+	     hash_alg++) {
+		start = now_ms();
+		TEST_SUCC(vb2_digest_buffer(test_file, test_file_size,
+					    hash_alg, digests[hash_alg],
+					    sizeof(digests[hash_alg])),
+			  vb2_get_hash_algorithm_name(hash_alg));
+		printf("%-24s digest %8.3f ms\n",
+		       vb2_get_hash_algorithm_name(hash_alg),
+		       now_ms() - start);
+	}
+
+	for (alg = 0; alg < VB2_ALG_COUNT; alg++) {
+		if (test_algorithm(alg, argv[1], argv[2]))
+			gTestSuccess = 0;
+	}
+
+	free(test_file);
+	return gTestSuccess ? 0 : 255;
+}
@@ -11,6 +11,7 @@
 
 #include "2sysincludes.h"
 #include "2api.h"
+#include "2misc.h"
 
 const char *gbb_fname;
 const char *vblock_fname;
@@ -215,5 +216,14 @@ int main(int argc, char *argv[])
 
 	printf("Workbuf used = %d bytes\n", ctx.workbuf_used);
 
+#ifdef VB2_WORKBUF_STATS
+	printf("Workbuf peak phase 1 = %d bytes\n",
+	       vb2_workbuf_peak(&ctx, VB2_WB_PHASE_FW1));
+	printf("Workbuf peak phase 2 = %d bytes\n",
+	       vb2_workbuf_peak(&ctx, VB2_WB_PHASE_FW2));
+	printf("Workbuf peak phase 3 = %d bytes\n",
+	       vb2_workbuf_peak(&ctx, VB2_WB_PHASE_FW3));
+#endif
+
 	return 0;
 }
@@ -355,9 +355,125 @@ static void check_hash_tests(void)
 	}
 }
 
+static void hash_tag_tests(void)
+{
+	struct vb21_fw_preamble *pre;
+	struct vb21_signature *sig;
+	int wb_used_before;
+	uint32_t size;
+	int i;
+
+	/* Hash three tags at once, interleaving the data */
+	reset_common_data(FOR_MISC);
+	wb_used_before = ctx.workbuf_used;
+	for (i = 0; i < 3; i++)
+		TEST_SUCC(vb21api_init_hash_tag(&ctx, test_id + i, &size),
+			  "init hash tag");
+	TEST_EQ(size, mock_body_size - 32, "  size");
+	TEST_EQ(sd->workbuf_hash_tags_offset, wb_used_before,
+		"  tags offset");
+	TEST_EQ(sd->hash_tags_count, VB21_MAX_HASH_TAGS, "  tags count");
+	TEST_NEQ(ctx.workbuf_used, wb_used_before, "  tags use workbuf");
+	TEST_EQ(sd->workbuf_hash_size, 0, "  single hash untouched");
+
+	for (i = 2; i >= 0; i--)
+		TEST_SUCC(vb21api_extend_hash_tag(&ctx, test_id + i,
+						  mock_body, 32),
+			  "extend hash tag");
+	for (i = 0; i < 3; i++)
+		TEST_SUCC(vb21api_extend_hash_tag(&ctx, test_id + i,
+						  mock_body + 32,
+						  mock_body_size - 32 - 16 * i),
+			  "extend hash tag rest");
+	TEST_SUCC(vb21api_check_hash_tag(&ctx, test_id + 1),
+		  "check hash tag 2");
+	TEST_EQ(vb21api_check_hash_tag(&ctx, test_id + 1),
+		VB2_ERROR_API_CHECK_HASH_TAG, "  tag freed");
+	TEST_SUCC(vb21api_check_hash_tag(&ctx, test_id + 0),
+		  "check hash tag 1");
+	TEST_SUCC(vb21api_check_hash_tag(&ctx, test_id + 2),
+		  "check hash tag 3");
+
+	/* Table is reused once allocated */
+	wb_used_before = ctx.workbuf_used;
+	TEST_SUCC(vb21api_init_hash_tag(&ctx, test_id, NULL),
+		  "init hash tag again");
+	TEST_EQ(ctx.workbuf_used, wb_used_before, "  reuses table");
+
+	/* Restarting a tag resets its hash */
+	TEST_SUCC(vb21api_extend_hash_tag(&ctx, test_id, mock_body, 32),
+		  "extend hash tag before restart");
+	TEST_SUCC(vb21api_init_hash_tag(&ctx, test_id, NULL),
+		  "restart hash tag");
+	TEST_SUCC(vb21api_extend_hash_tag(&ctx, test_id, mock_body,
+					  mock_body_size),
+		  "  extend");
+	TEST_SUCC(vb21api_check_hash_tag(&ctx, test_id), "  check");
+
+	reset_common_data(FOR_MISC);
+	TEST_EQ(vb21api_init_hash_tag(&ctx, test_id + 3, NULL),
+		VB2_ERROR_API_INIT_HASH_ID, "init hash tag invalid id");
+
+	reset_common_data(FOR_MISC);
+	sd->workbuf_preamble_size = 0;
+	TEST_EQ(vb21api_init_hash_tag(&ctx, test_id, NULL),
+		VB2_ERROR_API_INIT_HASH_PREAMBLE, "init hash tag preamble");
+
+	reset_common_data(FOR_MISC);
+	ctx.workbuf_used = ctx.workbuf_size - VB2_WORKBUF_ALIGN;
+	TEST_EQ(vb21api_init_hash_tag(&ctx, test_id, NULL),
+		VB2_ERROR_API_INIT_HASH_TAG_WORKBUF, "init hash tag workbuf");
+
+	/* Shrink the table so the mock preamble can fill it */
+	reset_common_data(FOR_MISC);
+	vb21api_init_hash_tag(&ctx, test_id + 0, NULL);
+	vb21api_init_hash_tag(&ctx, test_id + 1, NULL);
+	sd->hash_tags_count = 2;
+	TEST_SUCC(vb21api_init_hash_tag(&ctx, test_id + 1, NULL),
+		  "init hash tag restart when full");
+	TEST_EQ(vb21api_init_hash_tag(&ctx, test_id + 2, NULL),
+		VB2_ERROR_API_INIT_HASH_TAG_FULL, "init hash tag full");
+
+	reset_common_data(FOR_MISC);
+	pre = (struct vb21_fw_preamble *)
+		(ctx.workbuf + sd->workbuf_preamble_offset);
+	sig = (struct vb21_signature *)((uint8_t *)pre + pre->hash_offset);
+	sig->hash_alg = VB2_HASH_INVALID;
+	TEST_EQ(vb21api_init_hash_tag(&ctx, test_id, NULL),
+		VB2_ERROR_SHA_INIT_ALGORITHM, "init hash tag algorithm");
+
+	reset_common_data(FOR_MISC);
+	TEST_EQ(vb21api_extend_hash_tag(&ctx, test_id, mock_body, 32),
+		VB2_ERROR_API_EXTEND_HASH_TAG, "extend hash tag not started");
+	vb21api_init_hash_tag(&ctx, test_id, NULL);
+	TEST_EQ(vb21api_extend_hash_tag(&ctx, test_id, mock_body,
+					mock_body_size + 1),
+		VB2_ERROR_API_EXTEND_HASH_SIZE, "extend hash tag too much");
+	TEST_EQ(vb21api_extend_hash_tag(&ctx, test_id, mock_body, 0),
+		VB2_ERROR_API_EXTEND_HASH_SIZE, "extend hash tag empty");
+
+	TEST_EQ(vb21api_check_hash_tag(&ctx, test_id),
+		VB2_ERROR_API_CHECK_HASH_SIZE, "check hash tag size");
+	vb21api_extend_hash_tag(&ctx, test_id, mock_body, mock_body_size);
+	wb_used_before = ctx.workbuf_used;
+	ctx.workbuf_used = ctx.workbuf_size;
+	TEST_EQ(vb21api_check_hash_tag(&ctx, test_id),
+		VB2_ERROR_API_CHECK_HASH_WORKBUF_DIGEST,
+		"check hash tag workbuf");
+	ctx.workbuf_used = wb_used_before;
+
+	pre = (struct vb21_fw_preamble *)
+		(ctx.workbuf + sd->workbuf_preamble_offset);
+	sig = (struct vb21_signature *)((uint8_t *)pre + pre->hash_offset);
+	*((uint8_t *)sig + sig->sig_offset) ^= 0x55;
+	TEST_EQ(vb21api_check_hash_tag(&ctx, test_id),
+		VB2_ERROR_API_CHECK_HASH_SIG, "check hash tag sig");
+}
+
 int main(int argc, char* argv[])
 {
 	phase3_tests();
+	hash_tag_tests();
 
 	fprintf(stderr, "Running hash API tests without hwcrypto support...\n");
 	hwcrypto_state = HWCRYPTO_DISABLED;
@@ -373,6 +373,119 @@ static void test_verify_keyblock(void)
 	free(buf2);
 }
 
+/**
+ * Key ring
+ */
+static void test_key_ring(void)
+{
+	const char desc[16] = "test keyblock";
+	const struct vb2_private_key *prik[2];
+	const struct vb2_public_key *used;
+	struct vb2_public_key pubk, pubk2, pubk3, nokey;
+	struct vb2_public_key fake[VB21_KEY_RING_MAX_KEYS];
+	struct vb2_id fake_id[VB21_KEY_RING_MAX_KEYS];
+	struct vb21_key_ring ring;
+	struct vb21_keyblock *kbuf;
+	uint32_t buf_size;
+	uint8_t *buf, *buf2;
+	int i;
+
+	uint8_t workbuf[VB2_KEY_BLOCK_VERIFY_WORKBUF_BYTES]
+		 __attribute__ ((aligned (VB2_WORKBUF_ALIGN)));
+	struct vb2_workbuf wb;
+
+	vb2_public_key_hash(&pubk, VB2_HASH_SHA256);
+	vb2_public_key_hash(&pubk2, VB2_HASH_SHA512);
+	vb2_public_key_hash(&pubk3, VB2_HASH_SHA1);
+	vb2_private_key_hash(prik + 0, VB2_HASH_SHA256);
+	vb2_private_key_hash(prik + 1, VB2_HASH_SHA512);
+
+	/* Adding and finding keys */
+	vb21_key_ring_init(&ring);
+	TEST_PTR_EQ(vb21_key_ring_find(&ring, pubk.id), NULL,
+		    "key ring empty");
+	TEST_SUCC(vb21_key_ring_add(&ring, &pubk), "key ring add");
+	TEST_SUCC(vb21_key_ring_add(&ring, &pubk3), "key ring add 2");
+	TEST_PTR_EQ(vb21_key_ring_find(&ring, pubk.id), &pubk,
+		    "key ring find");
+	TEST_PTR_EQ(vb21_key_ring_find(&ring, pubk3.id), &pubk3,
+		    "key ring find 2");
+	TEST_PTR_EQ(vb21_key_ring_find(&ring, pubk2.id), NULL,
+		    "key ring find missing");
+	TEST_EQ(vb21_key_ring_add(&ring, &pubk),
+		VB2_ERROR_KEY_RING_DUPLICATE_ID, "key ring add duplicate");
+	nokey = pubk2;
+	nokey.id = NULL;
+	TEST_EQ(vb21_key_ring_add(&ring, &nokey), VB2_ERROR_KEY_RING_NO_ID,
+		"key ring add no id");
+
+	/* Fill it up with IDs that differ in one byte, so some collide */
+	vb21_key_ring_init(&ring);
+	for (i = 0; i < VB21_KEY_RING_MAX_KEYS; i++) {
+		memset(fake_id + i, 0, sizeof(fake_id[i]));
+		fake_id[i].raw[VB2_ID_NUM_BYTES - 1] = i * VB21_KEY_RING_SLOTS;
+		fake[i] = pubk;
+		fake[i].id = fake_id + i;
+		TEST_SUCC(vb21_key_ring_add(&ring, fake + i), "key ring fill");
+	}
+	for (i = 0; i < VB21_KEY_RING_MAX_KEYS; i++)
+		TEST_PTR_EQ(vb21_key_ring_find(&ring, fake_id + i), fake + i,
+			    "key ring find colliding");
+	TEST_EQ(vb21_key_ring_add(&ring, &pubk2), VB2_ERROR_KEY_RING_FULL,
+		"key ring full");
+	TEST_PTR_EQ(vb21_key_ring_find(&ring, pubk2.id), NULL,
+		    "key ring full find missing");
+
+	/* Keyblock signed by the SHA-256 and SHA-512 keys, in that order */
+	vb21_keyblock_create(&kbuf, &pubk3, prik, 2, 0x4321, desc);
+	buf = (uint8_t *)kbuf;
+	buf_size = kbuf->c.total_size;
+	buf2 = malloc(buf_size);
+	memcpy(buf2, buf, buf_size);
+	vb2_workbuf_init(&wb, workbuf, sizeof(workbuf));
+
+	vb21_key_ring_init(&ring);
+	vb21_key_ring_add(&ring, &pubk3);
+	vb21_key_ring_add(&ring, &pubk2);
+	used = NULL;
+	TEST_SUCC(vb21_verify_keyblock_ring(kbuf, buf_size, &ring, &used, &wb),
+		  "vb21_verify_keyblock_ring()");
+	TEST_PTR_EQ(used, &pubk2, "  second signer's key");
+
+	memcpy(buf, buf2, buf_size);
+	vb21_key_ring_add(&ring, &pubk);
+	TEST_SUCC(vb21_verify_keyblock_ring(kbuf, buf_size, &ring, &used, &wb),
+		  "vb21_verify_keyblock_ring() both signers");
+	TEST_PTR_EQ(used, &pubk, "  first signer's key");
+
+	memcpy(buf, buf2, buf_size);
+	TEST_SUCC(vb21_verify_keyblock_ring(kbuf, buf_size, &ring, NULL, &wb),
+		  "vb21_verify_keyblock_ring() no key_ptr");
+
+	memcpy(buf, buf2, buf_size);
+	vb21_key_ring_init(&ring);
+	vb21_key_ring_add(&ring, &pubk3);
+	TEST_EQ(vb21_verify_keyblock_ring(kbuf, buf_size, &ring, NULL, &wb),
+		VB2_ERROR_KEYBLOCK_SIG_ID,
+		"vb21_verify_keyblock_ring() no trusted signer");
+
+	memcpy(buf, buf2, buf_size);
+	vb21_key_ring_add(&ring, &pubk);
+	kbuf->c.magic = VB21_MAGIC_PACKED_KEY;
+	TEST_EQ(vb21_verify_keyblock_ring(kbuf, buf_size, &ring, NULL, &wb),
+		VB2_ERROR_KEYBLOCK_MAGIC,
+		"vb21_verify_keyblock_ring() magic");
+
+	memcpy(buf, buf2, buf_size);
+	kbuf->c.struct_version_minor++;
+	TEST_EQ(vb21_verify_keyblock_ring(kbuf, buf_size, &ring, NULL, &wb),
+		VB2_ERROR_VDATA_VERIFY_DIGEST,
+		"vb21_verify_keyblock_ring() corrupt");
+
+	free(buf);
+	free(buf2);
+}
+
 /**
  * Verify firmware preamble
  */
@@ -384,7 +497,8 @@ static void test_verify_fw_preamble(void)
 	struct vb2_public_key pubk;
 	struct vb21_signature *sig;
 	struct vb21_fw_preamble *pre;
-	uint32_t buf_size;
+	struct vb21_sig_array arr;
+	uint32_t buf_size, min_offset;
 	uint8_t *buf, *buf2;
 
 	uint8_t workbuf[VB2_VERIFY_FIRMWARE_PREAMBLE_WORKBUF_BYTES]
@@ -434,6 +548,37 @@ static void test_verify_fw_preamble(void)
 	TEST_SUCC(vb21_verify_fw_preamble(pre, buf_size, &pubk, &wb),
 		  "vb21_verify_fw_preamble()");
 
+	/* Walk the hashes through a signature array view */
+	memcpy(buf, buf2, buf_size);
+	min_offset = 0;
+	TEST_SUCC(vb21_verify_sig_array(&arr, pre, &min_offset,
+					pre->hash_offset, pre->hash_count),
+		  "vb21_verify_sig_array()");
+	TEST_EQ(min_offset, pre->sig_offset, "  min offset");
+	TEST_EQ(arr.count, 3, "  count");
+	sig = vb21_sig_array_next(&arr, NULL);
+	TEST_PTR_EQ(sig, buf + pre->hash_offset, "  first");
+	TEST_EQ(sig->data_size, sizeof(test_data), "  first data");
+	sig = vb21_sig_array_next(&arr, sig);
+	TEST_EQ(sig->data_size, sizeof(test_data2), "  second data");
+	sig = vb21_sig_array_next(&arr, sig);
+	TEST_EQ(sig->data_size, sizeof(test_data3), "  third data");
+	TEST_PTR_EQ(vb21_sig_array_next(&arr, sig), NULL, "  end");
+
+	min_offset = 0;
+	TEST_SUCC(vb21_verify_sig_array(&arr, pre, &min_offset,
+					pre->hash_offset, 0),
+		  "vb21_verify_sig_array() empty");
+	TEST_PTR_EQ(vb21_sig_array_next(&arr, NULL), NULL, "  no entries");
+
+	sig = (struct vb21_signature *)(buf + pre->hash_offset);
+	sig = (struct vb21_signature *)((uint8_t *)sig + sig->c.total_size);
+	sig->c.magic = VB21_MAGIC_PACKED_KEY;
+	min_offset = 0;
+	TEST_EQ(vb21_verify_sig_array(&arr, pre, &min_offset,
+				      pre->hash_offset, pre->hash_count),
+		VB2_ERROR_SIG_MAGIC, "vb21_verify_sig_array() magic");
+
 	memcpy(buf, buf2, buf_size);
 	pre->c.magic = VB21_MAGIC_PACKED_KEY;
 	TEST_EQ(vb21_verify_fw_preamble(pre, buf_size, &pubk, &wb),
@@ -519,6 +664,7 @@ int main(int argc, char* argv[])
 	test_sig_size();
 	test_verify_hash();
 	test_verify_keyblock();
+	test_key_ring();
 	test_verify_fw_preamble();
 
 	return gTestSuccess ? 0 : 255;
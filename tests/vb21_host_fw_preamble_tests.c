@@ -25,6 +25,35 @@ const uint8_t test_data1[] = "Some test data";
 const uint8_t test_data2[] = "Some more test data";
 const uint8_t test_data3[] = "Even more test data";
 
+static int mock_parallel;
+static int mock_parallel_jobs;
+static int (*mock_parallel_fn)(void *arg);
+static void *mock_parallel_arg;
+
+int vb2ex_run_parallel(int (*fn)(void *arg), void *arg)
+{
+	if (!mock_parallel)
+		return VB2_ERROR_EX_RUN_PARALLEL_UNIMPLEMENTED;
+
+	/* Run it at vb2ex_wait(), to catch anything done in between */
+	mock_parallel_fn = fn;
+	mock_parallel_arg = arg;
+	mock_parallel_jobs++;
+	return VB2_SUCCESS;
+}
+
+int vb2ex_wait(void)
+{
+	int rv;
+
+	if (!mock_parallel_fn)
+		return VB2_ERROR_UNKNOWN;
+
+	rv = mock_parallel_fn(mock_parallel_arg);
+	mock_parallel_fn = NULL;
+	return rv;
+}
+
 static void preamble_tests(const char *keys_dir)
 {
 	struct vb2_private_key *prik4096;
@@ -36,7 +65,14 @@ static void preamble_tests(const char *keys_dir)
 	const char test_desc[] = "Test fw preamble";
 	const uint32_t test_version = 2061;
 	const uint32_t test_flags = 0x11223344;
-	uint32_t hash_next;
+	struct vb21_fw_preamble *fp2_bad;
+	struct vb21_fw_component components[] = {
+		{test_data1, sizeof(test_data1), VB2_HASH_SHA256, "Hash 1"},
+		{test_data2, sizeof(test_data2), VB2_HASH_SHA256, "Hash 2"},
+		{test_data3, sizeof(test_data3), VB2_HASH_SHA256, "Hash 3"},
+	};
+	uint32_t hash_next, size;
+	uint8_t *buf;
 	int i;
 
 	uint8_t workbuf[VB2_VERIFY_FIRMWARE_PREAMBLE_WORKBUF_BYTES]
@@ -93,6 +129,55 @@ static void preamble_tests(const char *keys_dir)
 		hash_next += hashes[i]->c.total_size;
 	}
 
+	/* Build the same preamble in place */
+	TEST_SUCC(vb21_fw_preamble_size(&size, prik4096,
+					(const struct vb21_signature **)hashes,
+					3, test_desc),
+		  "Preamble size");
+	TEST_EQ(size, fp->c.total_size, "  total_size");
+	buf = malloc(size);
+	TEST_EQ(vb21_fw_preamble_build(buf, size - 1, prik4096,
+				       (const struct vb21_signature **)hashes,
+				       3, test_version, test_flags, test_desc),
+		VB2_FW_PREAMBLE_CREATE_BUF_SIZE, "Build preamble too small");
+	TEST_SUCC(vb21_fw_preamble_build(buf, size, prik4096,
+					 (const struct vb21_signature **)hashes,
+					 3, test_version, test_flags,
+					 test_desc),
+		  "Build preamble good");
+	/* Verifying fp clobbered its signature, so check the signed part */
+	TEST_EQ(memcmp(buf, fp, fp->sig_offset), 0, "  matches");
+	TEST_SUCC(vb21_verify_fw_preamble((struct vb21_fw_preamble *)buf,
+					  size, pubk4096, &wb),
+		  "Verify built preamble");
+	free(buf);
+
+	/* Hash the components as part of creating the preamble */
+	for (i = 0; i < 2; i++) {
+		struct vb21_fw_preamble *fp2;
+
+		mock_parallel = i;
+		mock_parallel_jobs = 0;
+		TEST_SUCC(vb21_fw_preamble_create_from_data(
+				  &fp2, prik4096, components, 3,
+				  test_version, test_flags, test_desc),
+			  "Create preamble from data");
+		TEST_EQ(mock_parallel_jobs, i, "  parallel jobs");
+		TEST_EQ(memcmp(fp2, fp, fp->sig_offset), 0, "  matches");
+		TEST_SUCC(vb21_verify_fw_preamble(fp2, fp2->c.total_size,
+						  pubk4096, &wb),
+			  "  verify");
+		free(fp2);
+	}
+	mock_parallel = 0;
+
+	components[1].hash_alg = VB2_HASH_INVALID;
+	TEST_EQ(vb21_fw_preamble_create_from_data(
+			&fp2_bad, prik4096, components, 3,
+			test_version, test_flags, test_desc),
+		VB2_FW_PREAMBLE_CREATE_HASH, "Create preamble from bad data");
+	TEST_PTR_EQ(fp2_bad, NULL, "  fp_ptr");
+
 	free(fp);
 
 	/* Test errors */
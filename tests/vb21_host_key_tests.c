@@ -6,6 +6,7 @@
  */
 
 #include <stdio.h>
+#include <sys/time.h>
 #include <unistd.h>
 
 #include "2sysincludes.h"
@@ -167,6 +168,71 @@ static void private_key_tests(const struct alg_combo *combo,
 	unlink(testfile);
 }
 
+static void key_cache_tests(const struct alg_combo *combo,
+			    const char *pemfile, const char *temp_dir)
+{
+	struct vb2_private_key *key, *k2, *k3;
+	struct timeval times[2] = {{1, 0}, {1, 0}};
+	enum vb2_crypto_algorithm alg =
+		vb2_get_crypto_algorithm(combo->hash_alg, combo->sig_alg);
+	char *testfile;
+
+	xasprintf(&testfile, "%s/test_cache.vbprik2", temp_dir);
+
+	/* The same file in the same format is shared */
+	key = vb2_read_private_key_pem(pemfile, alg);
+	k2 = vb2_read_private_key_pem(pemfile, alg);
+	TEST_PTR_NEQ(key, NULL, "Cache PEM first read");
+	TEST_PTR_EQ(k2, key, "  second read shared");
+	TEST_EQ(key->refs, 3, "  refs");
+	vb2_free_private_key(k2);
+	TEST_EQ(key->refs, 2, "  free drops a ref");
+	TEST_PTR_NEQ(key->rsa_private_key, NULL, "  still usable");
+
+	/* Other algorithms are other keys */
+	k3 = vb2_read_private_key_pem(pemfile, alg ^ 1);
+	TEST_PTR_NEQ(k3, key, "Cache PEM other algorithm");
+	TEST_EQ(k3->hash_alg, vb2_crypto_to_hash(alg ^ 1), "  hash_alg");
+	vb2_free_private_key(k3);
+
+	vb2_free_private_key(key);
+
+	/* A rewritten file is read again */
+	TEST_SUCC(vb2_private_key_read_pem(&k3, pemfile), "Read pem uncached");
+	k3->hash_alg = combo->hash_alg;
+	k3->sig_alg = combo->sig_alg;
+	k3->id.raw[0] = 0x12;
+	TEST_SUCC(vb21_private_key_write(k3, testfile), "Write key");
+	vb2_private_key_free(k3);
+	TEST_SUCC(vb21_private_key_read(&key, testfile), "Cache vbprik2");
+	TEST_SUCC(vb21_private_key_read(&k2, testfile), "  again");
+	TEST_PTR_EQ(k2, key, "  shared");
+	vb2_private_key_free(k2);
+	TEST_SUCC(utimes(testfile, times), "Touch key");
+	TEST_SUCC(vb21_private_key_read(&k2, testfile), "  read after touch");
+	TEST_PTR_NEQ(k2, key, "  not shared");
+	TEST_EQ(k2->id.raw[0], 0x12, "  same contents");
+	vb2_private_key_free(k2);
+	vb2_private_key_free(key);
+
+	/* Unreadable files aren't cached */
+	unlink(testfile);
+	TEST_EQ(vb21_private_key_read(&key, testfile),
+		VB2_ERROR_READ_FILE_OPEN, "Cache missing file");
+	TEST_PTR_EQ(key, NULL, "  key_ptr");
+
+	/* Flushing leaves keys in use alone */
+	key = vb2_read_private_key_pem(pemfile, alg);
+	vb2_private_key_cache_flush();
+	TEST_EQ(key->refs, 1, "Flush drops the cache's ref");
+	k2 = vb2_read_private_key_pem(pemfile, alg);
+	TEST_PTR_NEQ(k2, key, "  later reads start over");
+	vb2_free_private_key(k2);
+	vb2_free_private_key(key);
+
+	free(testfile);
+}
+
 static void public_key_tests(const struct alg_combo *combo,
 			     const char *keybfile, const char *temp_dir)
 {
@@ -293,6 +359,7 @@ static int test_algorithm(const struct alg_combo *combo, const char *keys_dir,
 	xasprintf(&keybfile, "%s/key_rsa%d.keyb", keys_dir, rsa_bits);
 
 	private_key_tests(combo, pemfile, temp_dir);
+	key_cache_tests(combo, pemfile, temp_dir);
 	public_key_tests(combo, keybfile, temp_dir);
 
 	free(pemfile);
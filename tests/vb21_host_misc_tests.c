@@ -71,6 +71,71 @@ static void file_tests(const char *temp_dir)
 	unlink(testfile);
 }
 
+static void file_view_tests(const char *temp_dir)
+{
+	char *testfile;
+	const uint8_t test_data[] = "Some test data";
+	struct vb2_file_view *view, *view2;
+	int fds[2];
+
+	xasprintf(&testfile, "%s/file_view_tests.dat", temp_dir);
+
+	unlink(testfile);
+
+	TEST_EQ(vb2_file_view_open(testfile, 0, &view),
+		VB2_ERROR_READ_FILE_OPEN, "vb2_file_view_open() missing");
+	TEST_PTR_EQ(view, NULL, "  no view");
+
+	/* Regular files are mapped */
+	TEST_SUCC(vb2_write_file(testfile, test_data, sizeof(test_data)),
+		  "write test file");
+	TEST_SUCC(vb2_file_view_open(testfile, VB2_FILE_VIEW_POPULATE |
+				     VB2_FILE_VIEW_HUGEPAGE, &view),
+		  "vb2_file_view_open() good");
+	TEST_EQ(view->size, sizeof(test_data), "  data size");
+	TEST_EQ(memcmp(view->data, test_data, view->size), 0, "  data");
+	TEST_EQ(view->mapped, 1, "  mapped");
+
+	/* Views stay valid until the last reference goes */
+	view2 = vb2_file_view_get(view);
+	TEST_PTR_EQ(view2, view, "vb2_file_view_get()");
+	TEST_EQ(view->refcount, 2, "  refcount");
+	vb2_file_view_put(view);
+	TEST_EQ(view2->refcount, 1, "  put one ref");
+	TEST_EQ(memcmp(view2->data, test_data, view2->size), 0, "  data");
+
+	/* Changes to the view don't reach the file */
+	view2->data[0] = 'X';
+	vb2_file_view_put(view2);
+	TEST_SUCC(vb2_file_view_open(testfile, 0, &view), "reopen");
+	TEST_EQ(view->data[0], test_data[0], "  file unchanged");
+	vb2_file_view_put(view);
+	vb2_file_view_put(NULL);
+	unlink(testfile);
+
+	/* Empty files are read instead */
+	fclose(fopen(testfile, "wb"));
+	TEST_SUCC(vb2_file_view_open(testfile, 0, &view), "view empty file");
+	TEST_EQ(view->size, 0, "  data size");
+	TEST_EQ(view->mapped, 0, "  not mapped");
+	vb2_file_view_put(view);
+	unlink(testfile);
+
+	/* So are pipes */
+	TEST_SUCC(pipe(fds), "pipe");
+	TEST_EQ(write(fds[1], test_data, sizeof(test_data)), sizeof(test_data),
+		"write pipe");
+	close(fds[1]);
+	TEST_SUCC(vb2_file_view_open_fd(fds[0], 0, &view), "view pipe");
+	close(fds[0]);
+	TEST_EQ(view->size, sizeof(test_data), "  data size");
+	TEST_EQ(memcmp(view->data, test_data, view->size), 0, "  data");
+	TEST_EQ(view->mapped, 0, "  not mapped");
+	vb2_file_view_put(view);
+
+	free(testfile);
+}
+
 int main(int argc, char* argv[])
 {
 	if (argc != 2) {
@@ -81,6 +146,7 @@ int main(int argc, char* argv[])
 
 	misc_tests();
 	file_tests(temp_dir);
+	file_view_tests(temp_dir);
 
 	return gTestSuccess ? 0 : 255;
 }
@@ -10,6 +10,7 @@
 
 #include "2sysincludes.h"
 #include "2common.h"
+#include "2ed25519.h"
 #include "2rsa.h"
 #include "vb21_common.h"
 #include "host_common.h"
@@ -28,6 +29,8 @@ static const struct alg_combo test_algs[] = {
 	{"RSA2048/SHA-256", VB2_SIG_RSA2048, VB2_HASH_SHA256},
 	{"RSA4096/SHA-256", VB2_SIG_RSA4096, VB2_HASH_SHA256},
 	{"RSA8192/SHA-512", VB2_SIG_RSA8192, VB2_HASH_SHA512},
+	{"Ed25519/SHA-256", VB2_SIG_ED25519, VB2_HASH_SHA256},
+	{"Ed25519/SHA-512", VB2_SIG_ED25519, VB2_HASH_SHA512},
 };
 
 const struct vb2_id test_id = {.raw = {0xaa}};
@@ -44,6 +47,7 @@ static void sig_tests(const struct alg_combo *combo,
 	const struct vb2_private_key *prihash, *priks[2];
 	struct vb2_public_key *pubk, pubhash;
 	struct vb21_signature *sig, *sig2;
+	uint8_t digest[VB2_MAX_DIGEST_SIZE];
 	uint32_t size;
 
 	uint8_t workbuf[VB2_VERIFY_DATA_WORKBUF_BYTES]
@@ -65,7 +69,21 @@ static void sig_tests(const struct alg_combo *combo,
 	prik->sig_alg = combo->sig_alg;
 	vb2_private_key_set_desc(prik, test_desc);
 
-	TEST_SUCC(vb2_public_key_read_keyb(&pubk, keybfile), "Read pub key");
+	if (keybfile) {
+		TEST_SUCC(vb2_public_key_read_keyb(&pubk, keybfile),
+			  "Read pub key");
+	} else {
+		/* Ed25519 keys don't have a .keyb file */
+		TEST_SUCC(vb2_public_key_alloc(&pubk, combo->sig_alg),
+			  "Alloc pub key");
+		TEST_SUCC(vb2_private_key_ed25519_public(
+				  prik, vb2_public_key_packed_data(pubk)),
+			  "Get pub key");
+		TEST_SUCC(vb2_unpack_key_data(pubk,
+					      vb2_public_key_packed_data(pubk),
+					      VB2_ED25519_KEY_BYTES),
+			  "Unpack pub key");
+	}
 	pubk->id = &test_id;
 	pubk->hash_alg = combo->hash_alg;
 	vb2_public_key_set_desc(pubk, test_desc);
@@ -89,6 +107,9 @@ static void sig_tests(const struct alg_combo *combo,
 	TEST_EQ(size, sig->c.total_size, "  size");
 	TEST_SUCC(vb21_verify_data(test_data, test_size, sig, pubk, &wb),
 		  "Verify good");
+	((uint8_t *)sig)[sig->sig_offset] ^= 0x01;
+	TEST_NEQ(vb21_verify_data(test_data, test_size, sig, pubk, &wb), 0,
+		 "Verify bad sig");
 	free(sig);
 
 	TEST_SUCC(vb21_sign_data(&sig, test_data, test_size, prik,
@@ -115,6 +136,22 @@ static void sig_tests(const struct alg_combo *combo,
 	TEST_EQ(vb21_sign_data(&sig, test_data, test_size, &prik2, NULL),
 		VB2_SIGN_DATA_SIG_SIZE, "Sign bad sig alg");
 
+	/* Signing a precalculated digest matches signing the data */
+	TEST_SUCC(vb2_digest_buffer(test_data, test_size, prik->hash_alg,
+				    digest, sizeof(digest)), "Digest data");
+	TEST_SUCC(vb21_sign_data(&sig, test_data, test_size, prik, NULL),
+		  "Sign data");
+	TEST_SUCC(vb21_sign_digest(&sig2, digest, test_size, prik, NULL),
+		  "Sign digest");
+	TEST_EQ(sig2->c.total_size, sig->c.total_size, "  size");
+	TEST_EQ(0, memcmp(sig2, sig, sig->c.total_size), "  same sig");
+	TEST_SUCC(vb21_verify_data(test_data, test_size, sig2, pubk, &wb),
+		  "  verify");
+	free(sig);
+	free(sig2);
+	TEST_EQ(vb21_sign_digest(&sig, digest, test_size, &prik2, NULL),
+		VB2_SIGN_DATA_SIG_SIZE, "Sign digest bad sig alg");
+
 	/* Sign an object with a little (24 bytes) data */
 	c_sig_offs = sizeof(*c) + 24;
 	TEST_SUCC(vb21_sig_size_for_key(&size, prik, NULL), "Sig size");
@@ -171,6 +208,13 @@ static int test_algorithm(const struct alg_combo *combo, const char *keys_dir)
 
 	printf("***Testing algorithm: %s\n", combo->name);
 
+	if (combo->sig_alg == VB2_SIG_ED25519) {
+		snprintf(pemfile, sizeof(pemfile),
+			 "%s/key_ed25519.pem", keys_dir);
+		sig_tests(combo, pemfile, NULL);
+		return 0;
+	}
+
 	snprintf(pemfile, sizeof(pemfile),
 		 "%s/key_rsa%d.pem", keys_dir, rsa_bits);
 	snprintf(keybfile, sizeof(keybfile),
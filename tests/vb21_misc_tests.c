@@ -45,9 +45,12 @@ static struct {
 		struct vb21_fw_preamble pre;
 		uint8_t predata[128];
 	} p;
+	/* Room to read ahead past the preamble */
+	uint8_t pad[VB2_VBLOCK_READ_AHEAD];
 } mock_vblock;
 
 static int mock_read_res_fail_on_call;
+static int mock_read_vblock_calls;
 static int mock_unpack_key_retval;
 static int mock_verify_keyblock_retval;
 static int mock_verify_preamble_retval;
@@ -79,6 +82,7 @@ static void reset_common_data(enum reset_type t)
 	vb2_secdata_init(&ctx);
 
 	mock_read_res_fail_on_call = 0;
+	mock_read_vblock_calls = 0;
 	mock_unpack_key_retval = VB2_SUCCESS;
 	mock_verify_keyblock_retval = VB2_SUCCESS;
 	mock_verify_preamble_retval = VB2_SUCCESS;
@@ -113,8 +117,11 @@ static void reset_common_data(enum reset_type t)
 	pre->fw_version = 2;
 
 	/* If verifying preamble, verify keyblock first to set up data key */
-	if (t == FOR_PREAMBLE)
+	if (t == FOR_PREAMBLE) {
 		vb21_load_fw_keyblock(&ctx);
+		/* Tests change the preamble after this, so read it again */
+		sd->workbuf_vblock_ahead_size = 0;
+	}
 };
 
 /* Mocked functions */
@@ -139,6 +146,7 @@ int vb2ex_read_resource(struct vb2_context *ctx,
 	case VB2_RES_FW_VBLOCK:
 		rptr = (uint8_t *)&mock_vblock;
 		rsize = sizeof(mock_vblock);
+		mock_read_vblock_calls++;
 		break;
 	default:
 		return VB2_ERROR_EX_READ_RESOURCE_INDEX;
@@ -187,6 +195,7 @@ static void load_keyblock_tests(void)
 	reset_common_data(FOR_KEYBLOCK);
 	wb_used_before = ctx.workbuf_used;
 	TEST_SUCC(vb21_load_fw_keyblock(&ctx), "keyblock verify");
+	TEST_EQ(mock_read_vblock_calls, 1, "keyblock read ahead");
 	TEST_EQ(sd->fw_version, 0x20000, "keyblock version");
 	TEST_EQ(sd->vblock_preamble_offset, sizeof(mock_vblock.k),
 		"preamble offset");
@@ -242,6 +251,21 @@ static void load_keyblock_tests(void)
 
 	reset_common_data(FOR_KEYBLOCK);
 	mock_read_res_fail_on_call = 2;
+	TEST_SUCC(vb21_load_fw_keyblock(&ctx), "keyblock read ahead fails");
+	TEST_EQ(mock_read_vblock_calls, 2, "keyblock read from vblock");
+
+	reset_common_data(FOR_KEYBLOCK);
+	ctx.workbuf_used = ctx.workbuf_size -
+			vb2_wb_round_up(sd->gbb_rootkey_size) -
+			vb2_wb_round_up(sizeof(mock_vblock.k));
+	TEST_SUCC(vb21_load_fw_keyblock(&ctx), "keyblock no room to read ahead");
+	TEST_EQ(mock_read_vblock_calls, 2, "keyblock read from vblock 2");
+
+	reset_common_data(FOR_KEYBLOCK);
+	mock_read_res_fail_on_call = 2;
+	ctx.workbuf_used = ctx.workbuf_size -
+			vb2_wb_round_up(sd->gbb_rootkey_size) -
+			vb2_wb_round_up(sizeof(mock_vblock.k));
 	TEST_EQ(vb21_load_fw_keyblock(&ctx),
 		VB2_ERROR_EX_READ_RESOURCE_INDEX,
 		"keyblock read keyblock header");
@@ -254,6 +278,11 @@ static void load_keyblock_tests(void)
 		VB2_ERROR_READ_RESOURCE_OBJECT_BUF,
 		"keyblock not enough workbuf for entire keyblock");
 
+	reset_common_data(FOR_KEYBLOCK);
+	kb->c.total_size = VB2_VBLOCK_READ_AHEAD + 16;
+	TEST_SUCC(vb21_load_fw_keyblock(&ctx), "keyblock past read ahead");
+	TEST_EQ(mock_read_vblock_calls, 2, "keyblock read rest");
+
 	reset_common_data(FOR_KEYBLOCK);
 	kb->c.total_size = sizeof(mock_vblock) + 1;
 	TEST_EQ(vb21_load_fw_keyblock(&ctx),
@@ -305,6 +334,18 @@ static void load_preamble_tests(void)
 	TEST_EQ(sd->workbuf_data_key_offset, 0, "data key offset gone");
 	TEST_EQ(sd->workbuf_data_key_size, 0, "data key size gone");
 
+	TEST_EQ(mock_read_vblock_calls, 3, "preamble read from vblock");
+
+	/* Preamble read ahead with the keyblock */
+	reset_common_data(FOR_KEYBLOCK);
+	TEST_SUCC(vb21_load_fw_keyblock(&ctx), "preamble read ahead keyblock");
+	TEST_SUCC(vb21_load_fw_preamble(&ctx), "preamble read ahead");
+	TEST_EQ(mock_read_vblock_calls, 1, "preamble read ahead calls");
+	TEST_EQ(memcmp(ctx.workbuf + sd->workbuf_preamble_offset,
+		       &mock_vblock.p, sizeof(mock_vblock.p)),
+		0, "preamble read ahead data");
+	TEST_EQ(sd->workbuf_vblock_ahead_size, 0, "read ahead gone");
+
 	/* Expected failures */
 	reset_common_data(FOR_PREAMBLE);
 	sd->workbuf_data_key_size = 0;
@@ -39,6 +39,10 @@ static int retval_vb2_fw_parse_gbb;
 static int retval_vb2_check_dev_switch;
 static int retval_vb2_check_tpm_clear;
 static int retval_vb2_select_fw_slot;
+static int retval_vb2ex_tpm_extend_pcrs;
+static int mock_extend_calls;
+static uint32_t mock_extend_count;
+static struct vb2_pcr_extend mock_extend_pcrs[VB2_PCR_DIGEST_COUNT];
 
 /* Type of test to reset for */
 enum reset_type {
@@ -65,6 +69,10 @@ static void reset_common_data(enum reset_type t)
 	retval_vb2_check_dev_switch = VB2_SUCCESS;
 	retval_vb2_check_tpm_clear = VB2_SUCCESS;
 	retval_vb2_select_fw_slot = VB2_SUCCESS;
+	retval_vb2ex_tpm_extend_pcrs = VB2_SUCCESS;
+	mock_extend_calls = 0;
+	mock_extend_count = 0;
+	memset(mock_extend_pcrs, 0, sizeof(mock_extend_pcrs));
 
 	memcpy(sd->gbb_hwid_digest, mock_hwid_digest,
 	       sizeof(sd->gbb_hwid_digest));
@@ -92,6 +100,17 @@ int vb2_select_fw_slot(struct vb2_context *ctx)
 	return retval_vb2_select_fw_slot;
 }
 
+int vb2ex_tpm_extend_pcrs(struct vb2_context *ctx,
+			  const struct vb2_pcr_extend *pcrs,
+			  uint32_t count)
+{
+	mock_extend_calls++;
+	mock_extend_count = count;
+	if (count <= VB2_PCR_DIGEST_COUNT)
+		memcpy(mock_extend_pcrs, pcrs, count * sizeof(*pcrs));
+	return retval_vb2ex_tpm_extend_pcrs;
+}
+
 /* Tests */
 
 static void misc_tests(void)
@@ -315,6 +334,37 @@ static void get_pcr_digest_tests(void)
 		"invalid enum vb2_pcr_digest");
 }
 
+static void extend_pcrs_tests(void)
+{
+	uint8_t digest[VB2_PCR_DIGEST_RECOMMENDED_SIZE];
+	uint32_t digest_size;
+
+	reset_common_data(FOR_MISC);
+	TEST_SUCC(vb2api_extend_pcrs(&cc), "extend pcrs");
+	TEST_EQ(mock_extend_calls, 1, "  one batch");
+	TEST_EQ(mock_extend_count, VB2_PCR_DIGEST_COUNT, "  all digests");
+
+	digest_size = sizeof(digest);
+	vb2api_get_pcr_digest(&cc, BOOT_MODE_PCR, digest, &digest_size);
+	TEST_EQ(mock_extend_pcrs[0].pcr, 0, "  boot mode pcr");
+	TEST_EQ(mock_extend_pcrs[0].digest_size, digest_size,
+		"  boot mode size");
+	TEST_SUCC(memcmp(mock_extend_pcrs[0].digest, digest, digest_size),
+		  "  boot mode digest");
+
+	TEST_EQ(mock_extend_pcrs[1].pcr, 1, "  hwid pcr");
+	TEST_EQ(mock_extend_pcrs[1].digest_size, VB2_GBB_HWID_DIGEST_SIZE,
+		"  hwid size");
+	TEST_SUCC(memcmp(mock_extend_pcrs[1].digest, mock_hwid_digest,
+			 VB2_GBB_HWID_DIGEST_SIZE),
+		  "  hwid digest");
+
+	reset_common_data(FOR_MISC);
+	retval_vb2ex_tpm_extend_pcrs = VB2_ERROR_MOCK;
+	TEST_EQ(vb2api_extend_pcrs(&cc), VB2_ERROR_MOCK,
+		"extend pcrs failure");
+}
+
 int main(int argc, char* argv[])
 {
 	misc_tests();
@@ -322,6 +372,7 @@ int main(int argc, char* argv[])
 	phase2_tests();
 
 	get_pcr_digest_tests();
+	extend_pcrs_tests();
 
 	return gTestSuccess ? 0 : 255;
 }
@@ -19,6 +19,41 @@ static void test_memcmp(void)
 	TEST_EQ(vb2_safe_memcmp("foo1", "foo2", 0), 0, "memcmp 0-size");
 }
 
+/**
+ * Test safe memcmp with every alignment, size and place for a difference
+ */
+static void test_memcmp_words(void)
+{
+	uint8_t a[64 + 16] __attribute__ ((aligned (16)));
+	uint8_t b[64 + 16] __attribute__ ((aligned (16)));
+	int wrong = 0;
+	int oa, ob, size, diff;
+
+	for (oa = 0; oa < 16; oa++) {
+		for (ob = 0; ob < 16; ob++) {
+			for (size = 0; size <= 64; size++) {
+				memset(a, 0x5a, sizeof(a));
+				memset(b, 0x5a, sizeof(b));
+				/* Differences just outside don't count */
+				if (oa)
+					a[oa - 1] = 0;
+				a[oa + size] = 0;
+				if (vb2_safe_memcmp(a + oa, b + ob, size) != 0)
+					wrong++;
+
+				for (diff = 0; diff < size; diff++) {
+					b[ob + diff] ^= 0x80;
+					if (vb2_safe_memcmp(a + oa, b + ob,
+							    size) != 1)
+						wrong++;
+					b[ob + diff] ^= 0x80;
+				}
+			}
+		}
+	}
+	TEST_EQ(wrong, 0, "memcmp all alignments and sizes");
+}
+
 /**
  * Test alignment functions
  */
@@ -112,6 +147,7 @@ static void test_workbuf(void)
 int main(int argc, char* argv[])
 {
 	test_memcmp();
+	test_memcmp_words();
 	test_align();
 	test_workbuf();
 
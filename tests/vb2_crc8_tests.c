@@ -0,0 +1,40 @@
+/* Copyright 2018 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ *
+ * Tests for CRC-8
+ */
+
+#include "2sysincludes.h"
+#include "2crc8.h"
+
+#include "test_common.h"
+
+static void crc8_tests(void)
+{
+	const char check[] = "123456789";
+	uint8_t buf[300];
+	int i, mismatches = 0;
+
+	/* The standard check value for this polynomial with no final XOR */
+	TEST_EQ(vb2_crc8(check, strlen(check)), 0xf4, "Check value");
+	TEST_EQ(vb2_crc8_bitwise(check, strlen(check)), 0xf4,
+		"Check value bitwise");
+	TEST_EQ(vb2_crc8(check, 0), 0, "Empty buffer");
+
+	/* Both versions agree, whatever the bytes and length */
+	for (i = 0; i < sizeof(buf); i++)
+		buf[i] = i * 37 + 11;
+	for (i = 0; i <= sizeof(buf); i++) {
+		if (vb2_crc8(buf, i) != vb2_crc8_bitwise(buf, i))
+			mismatches++;
+	}
+	TEST_EQ(mismatches, 0, "Table matches bitwise");
+}
+
+int main(int argc, char* argv[])
+{
+	crc8_tests();
+
+	return gTestSuccess ? 0 : 255;
+}
@@ -0,0 +1,160 @@
+/* Copyright 2018 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ *
+ * Tests for Ed25519 signature verification.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "2sysincludes.h"
+#include "2common.h"
+#include "2ed25519.h"
+#include "2return_codes.h"
+#include "test_common.h"
+
+/* Test vectors from RFC 8032 section 7.1 */
+static const struct {
+	const char *name;
+	const char *pubkey;
+	const char *msg;
+	const char *sig;
+} vectors[] = {
+	{
+		"TEST 1",
+		"d75a980182b10ab7d54bfed3c964073a0ee172f3daa62325af021a68f707511a",
+		"",
+		"e5564300c360ac729086e2cc806e828a84877f1eb8e5d974d873e06522490155"
+		"5fb8821590a33bacc61e39701cf9b46bd25bf5f0595bbe24655141438e7a100b",
+	},
+	{
+		"TEST 2",
+		"3d4017c3e843895a92b70aa74d1b7ebc9c982ccf2ec4968cc0cd55f12af4660c",
+		"72",
+		"92a009a9f0d4cab8720e820b5f642540a2b27b5416503f8fb3762223ebdb69da"
+		"085ac1e43e15996e458f3613d0f11d8c387b2eaeb4302aeeb00d291612bb0c00",
+	},
+	{
+		"TEST 3",
+		"fc51cd8e6218a1a38da47ed00230f0580816ed13ba3303ac5deb911548908025",
+		"af82",
+		"6291d657deec24024827e69c3abe01a30ce548a284743a445e3680d7db5ac3ac"
+		"18ff9b538d16f290ae67f760984dc6594a7c15e9716ed28dc027beceea1ec40a",
+	},
+};
+
+/* Order of the base point, little-endian */
+static const uint8_t group_order[32] = {
+	0xed, 0xd3, 0xf5, 0x5c, 0x1a, 0x63, 0x12, 0x58,
+	0xd6, 0x9c, 0xf7, 0xa2, 0xde, 0xf9, 0xde, 0x14,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x10,
+};
+
+static uint32_t from_hex(uint8_t *buf, const char *hex)
+{
+	uint32_t size = 0;
+	unsigned int byte;
+
+	for (; *hex; hex += 2) {
+		sscanf(hex, "%2x", &byte);
+		buf[size++] = byte;
+	}
+	return size;
+}
+
+static void vector_tests(void)
+{
+	uint8_t pubkey[VB2_ED25519_KEY_BYTES];
+	uint8_t sig[VB2_ED25519_SIG_BYTES];
+	uint8_t msg[16];
+	uint32_t msg_size;
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(vectors); i++) {
+		from_hex(pubkey, vectors[i].pubkey);
+		from_hex(sig, vectors[i].sig);
+		msg_size = from_hex(msg, vectors[i].msg);
+
+		printf("***Testing vector: %s\n", vectors[i].name);
+
+		TEST_SUCC(vb2_ed25519_verify(pubkey, sig, msg, msg_size),
+			  "Verify good");
+
+		sig[5] ^= 0x10;
+		TEST_EQ(vb2_ed25519_verify(pubkey, sig, msg, msg_size),
+			VB2_ERROR_ED25519_VERIFY_SIG, "Verify bad R");
+		sig[5] ^= 0x10;
+
+		sig[40] ^= 0x01;
+		TEST_EQ(vb2_ed25519_verify(pubkey, sig, msg, msg_size),
+			VB2_ERROR_ED25519_VERIFY_SIG, "Verify bad S");
+		sig[40] ^= 0x01;
+
+		msg[msg_size] = 0x5a;
+		TEST_EQ(vb2_ed25519_verify(pubkey, sig, msg, msg_size + 1),
+			VB2_ERROR_ED25519_VERIFY_SIG, "Verify bad message");
+
+		pubkey[3] ^= 0x02;
+		TEST_NEQ(vb2_ed25519_verify(pubkey, sig, msg, msg_size), 0,
+			 "Verify bad key");
+		pubkey[3] ^= 0x02;
+	}
+}
+
+static void error_tests(void)
+{
+	uint8_t pubkey[VB2_ED25519_KEY_BYTES];
+	uint8_t sig[VB2_ED25519_SIG_BYTES];
+	uint8_t bad_sig[VB2_ED25519_SIG_BYTES];
+	uint8_t bad_key[VB2_ED25519_KEY_BYTES];
+	uint32_t carry = 0;
+	int i;
+
+	from_hex(pubkey, vectors[0].pubkey);
+	from_hex(sig, vectors[0].sig);
+
+	TEST_EQ(vb2_ed25519_verify(NULL, sig, NULL, 0),
+		VB2_ERROR_ED25519_VERIFY_PARAM, "No key");
+	TEST_EQ(vb2_ed25519_verify(pubkey, NULL, NULL, 0),
+		VB2_ERROR_ED25519_VERIFY_PARAM, "No signature");
+	TEST_EQ(vb2_ed25519_verify(pubkey, sig, NULL, 1),
+		VB2_ERROR_ED25519_VERIFY_PARAM, "No message");
+
+	/* S + L is the same scalar mod L, but isn't canonical */
+	memcpy(bad_sig, sig, sizeof(sig));
+	for (i = 0; i < 32; i++) {
+		carry += bad_sig[32 + i] + group_order[i];
+		bad_sig[32 + i] = carry;
+		carry >>= 8;
+	}
+	TEST_EQ(vb2_ed25519_verify(pubkey, bad_sig, NULL, 0),
+		VB2_ERROR_ED25519_VERIFY_SCALAR, "S + L");
+
+	memcpy(bad_sig + 32, group_order, sizeof(group_order));
+	TEST_EQ(vb2_ed25519_verify(pubkey, bad_sig, NULL, 0),
+		VB2_ERROR_ED25519_VERIFY_SCALAR, "S = L");
+
+	/* y = 2 isn't on the curve */
+	memset(bad_key, 0, sizeof(bad_key));
+	bad_key[0] = 2;
+	TEST_EQ(vb2_ed25519_verify(bad_key, sig, NULL, 0),
+		VB2_ERROR_ED25519_VERIFY_KEY, "Key not on curve");
+
+	/* y = p is y = 0 encoded the long way */
+	memset(bad_key, 0xff, sizeof(bad_key));
+	bad_key[0] = 0xed;
+	bad_key[31] = 0x7f;
+	TEST_EQ(vb2_ed25519_verify(bad_key, sig, NULL, 0),
+		VB2_ERROR_ED25519_VERIFY_KEY, "Key not canonical");
+}
+
+int main(int argc, char *argv[])
+{
+	vector_tests();
+	error_tests();
+
+	return gTestSuccess ? 0 : 255;
+}
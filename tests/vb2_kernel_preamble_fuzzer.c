@@ -0,0 +1,36 @@
+/* Copyright 2018 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ *
+ * Fuzz target for vb2_verify_kernel_preamble().
+ */
+
+#include <stdlib.h>
+
+#include "2sysincludes.h"
+#include "2common.h"
+#include "2rsa.h"
+#include "vb2_common.h"
+#include "fuzz_common.h"
+
+static uint8_t workbuf[VB2_WORKBUF_RECOMMENDED_SIZE]
+	__attribute__ ((aligned (VB2_WORKBUF_ALIGN)));
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+	struct vb2_public_key key;
+	struct vb2_workbuf wb;
+	struct vb2_kernel_preamble *preamble;
+
+	if (size > FUZZ_MAX_INPUT_SIZE)
+		return 0;
+
+	fuzz_rsa_key(&key);
+	vb2_workbuf_init(&wb, workbuf, sizeof(workbuf));
+
+	preamble = fuzz_copy_input(data, size);
+	vb2_verify_kernel_preamble(preamble, size, &key, &wb);
+	free(preamble);
+
+	return 0;
+}
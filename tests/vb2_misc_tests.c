@@ -24,8 +24,10 @@ static struct vb2_shared_data *sd;
 enum vb2_resource_index mock_resource_index;
 void *mock_resource_ptr;
 uint32_t mock_resource_size;
+int mock_resource_calls;
 int mock_tpm_clear_called;
 int mock_tpm_clear_retval;
+uint32_t mock_mtime;
 
 
 static void reset_common_data(void)
@@ -44,8 +46,10 @@ static void reset_common_data(void)
 	vb2_secdata_create(&cc);
 	vb2_secdata_init(&cc);
 
+	mock_resource_calls = 0;
 	mock_tpm_clear_called = 0;
 	mock_tpm_clear_retval = VB2_SUCCESS;
+	mock_mtime = 0;
 };
 
 /* Mocked functions */
@@ -56,6 +60,8 @@ int vb2ex_read_resource(struct vb2_context *ctx,
 			void *buf,
 			uint32_t size)
 {
+	mock_resource_calls++;
+
 	if (index != mock_resource_index)
 		return VB2_ERROR_EX_READ_RESOURCE_INDEX;
 
@@ -73,6 +79,11 @@ int vb2ex_tpm_clear_owner(struct vb2_context *ctx)
 	return mock_tpm_clear_retval;
 }
 
+uint32_t vb2ex_mtime(void)
+{
+	return mock_mtime;
+}
+
 /* Tests */
 
 static void init_context_tests(void)
@@ -120,6 +131,176 @@ static void misc_tests(void)
 	TEST_EQ(wb.size, cc.workbuf_size - 16, "vb_workbuf_from_ctx() size");
 }
 
+static void timestamp_tests(void)
+{
+#ifdef VB2_TIMESTAMPS
+	int i;
+
+	reset_common_data();
+	mock_mtime = 42;
+	vb2_timestamp(&cc, VB2_TS_FW_PHASE1_ENTER);
+	TEST_EQ(sd->timestamp_count, 1, "Timestamp count");
+	TEST_EQ(sd->timestamps[0].time_ms, 42, "  time");
+	TEST_EQ(sd->timestamps[0].event, VB2_TS_FW_PHASE1_ENTER, "  event");
+
+	for (i = 0; i < VB2_MAX_TIMESTAMPS; i++) {
+		mock_mtime = 100 + i;
+		vb2_timestamp(&cc, VB2_TS_DISK_READ_START);
+	}
+	TEST_EQ(sd->timestamp_count, VB2_MAX_TIMESTAMPS + 1, "Timestamp wrap");
+	TEST_EQ(sd->timestamps[0].time_ms, 100 + VB2_MAX_TIMESTAMPS - 1,
+		"  oldest overwritten");
+	TEST_EQ(sd->timestamps[1].time_ms, 100, "  next oldest kept");
+
+	/* Uninitialized context is ignored */
+	cc.workbuf_used = 0;
+	vb2_timestamp(&cc, VB2_TS_FW_PHASE1_EXIT);
+	TEST_EQ(sd->timestamp_count, VB2_MAX_TIMESTAMPS + 1,
+		"Timestamp without context");
+#endif
+}
+
+static void workbuf_stats_tests(void)
+{
+#ifdef VB2_WORKBUF_STATS
+	struct vb2_workbuf wb;
+	uint32_t base;
+
+	reset_common_data();
+	base = cc.workbuf_used;
+	vb2_workbuf_phase(&cc, VB2_WB_PHASE_FW1);
+	vb2_workbuf_from_ctx(&cc, &wb);
+	vb2_workbuf_alloc(&wb, 64);
+	vb2_workbuf_alloc(&wb, 32);
+	vb2_workbuf_free(&wb, 32);
+	vb2_workbuf_phase(&cc, VB2_WB_PHASE_FW2);
+	TEST_EQ(sd->workbuf_peak[VB2_WB_PHASE_FW1], base + 96, "Peak phase 1");
+	TEST_EQ(sd->workbuf_phase, VB2_WB_PHASE_FW2, "  phase switched");
+
+	/* Persistent usage counts even without any allocations */
+	cc.workbuf_used = base + 256;
+	TEST_EQ(vb2_workbuf_peak(&cc, VB2_WB_PHASE_FW2), base + 256,
+		"Peak phase 2 workbuf_used");
+	TEST_EQ(vb2_workbuf_peak(&cc, VB2_WB_PHASE_FW1), base + 96,
+		"  phase 1 unchanged");
+	TEST_EQ(vb2_workbuf_peak(&cc, VB2_WB_PHASE_FW3), 0, "  phase 3 unused");
+	TEST_EQ(vb2_workbuf_peak(&cc, VB2_WB_PHASE_COUNT), 0, "  bad phase");
+
+	/* Peak is the maximum over repeated entries into a phase */
+	vb2_workbuf_phase(&cc, VB2_WB_PHASE_FW1);
+	vb2_workbuf_alloc(&wb, 16);
+	vb2_workbuf_phase(&cc, VB2_WB_PHASE_NONE);
+	TEST_EQ(sd->workbuf_peak[VB2_WB_PHASE_FW1], base + 256,
+		"Peak phase 1 re-entered");
+
+	/* Allocations outside the context's work buffer are ignored */
+	vb2_workbuf_phase(&cc, VB2_WB_PHASE_FW3);
+	vb2_workbuf_init(&wb, workbuf + sizeof(workbuf), 64);
+	vb2_workbuf_alloc(&wb, 32);
+	TEST_EQ(vb2_workbuf_peak(&cc, VB2_WB_PHASE_FW3), base + 256,
+		"Peak ignores other buffers");
+
+	/* Uninitialized context is ignored */
+	cc.workbuf_used = 0;
+	vb2_workbuf_phase(&cc, VB2_WB_PHASE_KERNEL1);
+	TEST_EQ(sd->workbuf_phase, VB2_WB_PHASE_FW3, "Phase without context");
+#endif
+}
+
+static void read_cache_tests(void)
+{
+	uint8_t data[64], buf[16];
+	int i;
+
+	for (i = 0; i < sizeof(data); i++)
+		data[i] = i;
+	mock_resource_index = VB2_RES_GBB;
+	mock_resource_ptr = data;
+	mock_resource_size = sizeof(data);
+
+	/* No cache */
+	reset_common_data();
+	TEST_SUCC(vb2_read_resource(&cc, VB2_RES_GBB, 8, buf, 8),
+		  "read no cache");
+	TEST_SUCC(vb2_read_resource(&cc, VB2_RES_GBB, 8, buf, 8),
+		  "read no cache again");
+	TEST_EQ(mock_resource_calls, 2, "  not cached");
+	TEST_EQ(memcmp(buf, data + 8, 8), 0, "  data");
+
+	/* Setting up the cache */
+	reset_common_data();
+	cc.workbuf_used += VB2_WORKBUF_ALIGN;
+	TEST_EQ(vb2api_init_read_cache(&cc, 64),
+		VB2_ERROR_API_READ_CACHE_INIT, "init cache too late");
+
+	reset_common_data();
+	TEST_EQ(vb2api_init_read_cache(&cc, sizeof(workbuf)),
+		VB2_ERROR_API_READ_CACHE_WORKBUF, "init cache too big");
+
+	reset_common_data();
+	TEST_SUCC(vb2api_init_read_cache(&cc, 64), "init cache");
+	TEST_EQ(cc.workbuf_used,
+		vb2_wb_round_up(sizeof(struct vb2_shared_data)) + 64,
+		"  workbuf used");
+	TEST_EQ(vb2api_init_read_cache(&cc, 64),
+		VB2_ERROR_API_READ_CACHE_INIT, "  only once");
+
+	/* Reads served from the cache */
+	TEST_SUCC(vb2_read_resource(&cc, VB2_RES_GBB, 8, buf, 16),
+		  "read cached");
+	TEST_EQ(mock_resource_calls, 1, "  read resource");
+	memset(buf, 0, sizeof(buf));
+	TEST_SUCC(vb2_read_resource(&cc, VB2_RES_GBB, 8, buf, 16),
+		  "read cached again");
+	TEST_EQ(mock_resource_calls, 1, "  from cache");
+	TEST_EQ(memcmp(buf, data + 8, 16), 0, "  data");
+	memset(buf, 0, sizeof(buf));
+	TEST_SUCC(vb2_read_resource(&cc, VB2_RES_GBB, 12, buf, 4),
+		  "read part of cached");
+	TEST_EQ(mock_resource_calls, 1, "  from cache");
+	TEST_EQ(memcmp(buf, data + 12, 4), 0, "  data");
+	TEST_SUCC(vb2_read_resource(&cc, VB2_RES_GBB, 20, buf, 8),
+		  "read past cached");
+	TEST_EQ(mock_resource_calls, 2, "  read resource");
+	TEST_EQ(memcmp(buf, data + 20, 8), 0, "  data");
+
+	/* Cache is full now, but reads still work */
+	TEST_SUCC(vb2_read_resource(&cc, VB2_RES_GBB, 40, buf, 16),
+		  "read cache full");
+	TEST_SUCC(vb2_read_resource(&cc, VB2_RES_GBB, 40, buf, 16),
+		  "read cache full again");
+	TEST_EQ(mock_resource_calls, 4, "  not cached");
+	TEST_EQ(memcmp(buf, data + 40, 16), 0, "  data");
+
+	/* Errors aren't cached */
+	TEST_EQ(vb2_read_resource(&cc, VB2_RES_GBB, 60, buf, 8),
+		VB2_ERROR_EX_READ_RESOURCE_SIZE, "read error");
+
+	/* Firmware vblock is cached per slot */
+	reset_common_data();
+	vb2api_init_read_cache(&cc, 128);
+	mock_resource_index = VB2_RES_FW_VBLOCK;
+	TEST_SUCC(vb2_read_resource(&cc, VB2_RES_FW_VBLOCK, 0, buf, 8),
+		  "read vblock A");
+	cc.flags |= VB2_CONTEXT_FW_SLOT_B;
+	TEST_SUCC(vb2_read_resource(&cc, VB2_RES_FW_VBLOCK, 0, buf, 8),
+		  "read vblock B");
+	TEST_SUCC(vb2_read_resource(&cc, VB2_RES_FW_VBLOCK, 0, buf, 8),
+		  "read vblock B again");
+	cc.flags &= ~VB2_CONTEXT_FW_SLOT_B;
+	TEST_SUCC(vb2_read_resource(&cc, VB2_RES_FW_VBLOCK, 0, buf, 8),
+		  "read vblock A again");
+	TEST_EQ(mock_resource_calls, 2, "  cached per slot");
+
+	/* Kernel vblock is never cached */
+	mock_resource_index = VB2_RES_KERNEL_VBLOCK;
+	TEST_SUCC(vb2_read_resource(&cc, VB2_RES_KERNEL_VBLOCK, 0, buf, 8),
+		  "read kernel vblock");
+	TEST_SUCC(vb2_read_resource(&cc, VB2_RES_KERNEL_VBLOCK, 0, buf, 8),
+		  "read kernel vblock again");
+	TEST_EQ(mock_resource_calls, 4, "  not cached");
+}
+
 static void gbb_tests(void)
 {
 	struct vb2_gbb_header gbb = {
@@ -590,6 +771,9 @@ int main(int argc, char* argv[])
 {
 	init_context_tests();
 	misc_tests();
+	timestamp_tests();
+	workbuf_stats_tests();
+	read_cache_tests();
 	gbb_tests();
 	fail_tests();
 	recovery_tests();
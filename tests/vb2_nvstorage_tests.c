@@ -68,6 +68,8 @@ static struct nv_field nvfields[] = {
 static struct nv_field nv2fields[] = {
 	{VB2_NV_FW_MAX_ROLLFORWARD, 0, VB2_FW_MAX_ROLLFORWARD_V1_DEFAULT,
 	 0x87654321, "firmware max rollforward"},
+	{VB2_NV_KERNEL_HINT_PART, 0, 0, 0x80, "kernel hint partition"},
+	{VB2_NV_KERNEL_HINT_GPT_CRC, 0, 0, 0x89ABCDEF, "kernel hint GPT CRC"},
 	{0, 0, 0, 0, NULL}
 };
 
@@ -0,0 +1,629 @@
+/* Copyright 2018 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ *
+ * Tests for streaming load/verify pipeline
+ */
+
+#include "2sysincludes.h"
+#include "2api.h"
+#include "2common.h"
+#include "2pipeline.h"
+#include "2sha.h"
+
+#include "test_common.h"
+
+#define DATA_SIZE 1000
+
+static uint8_t data[DATA_SIZE];
+static uint8_t sink[DATA_SIZE];
+static uint8_t expect_digest[VB2_SHA256_DIGEST_SIZE];
+static struct vb2_context cc;
+
+/* Mocked function data */
+static int mock_read_fail_on_call;
+static int mock_wait_fail_on_call;
+static int mock_hwcrypto_fail;
+static int mock_pending;
+static int mock_waits;
+static uint32_t mock_hwcrypto_bytes;
+static int mock_hwcrypto_async;
+static int mock_hwcrypto_async_fail;
+static int mock_hwcrypto_wait_fail;
+static int mock_hwcrypto_async_blocks;
+static int mock_hwcrypto_overlaps;
+static const uint8_t *mock_hwcrypto_buf;
+static uint32_t mock_hwcrypto_size;
+static struct vb2_digest_context mock_hwcrypto_dc;
+static uint32_t mock_res_offset;
+static int mock_parallel;
+static int mock_parallel_fail;
+static int mock_parallel_jobs;
+static int mock_parallel_overlaps;
+static int (*mock_parallel_fn)(void *arg);
+static void *mock_parallel_arg;
+static uint8_t mock_consumed[DATA_SIZE];
+static uint32_t mock_consumed_size;
+static int mock_consume_calls;
+static int mock_consume_fail_on_call;
+static int mock_consume_overlaps;
+
+static void reset_common_data(void)
+{
+	int i;
+
+	for (i = 0; i < DATA_SIZE; i++)
+		data[i] = (uint8_t)(i * 13);
+	memset(sink, 0, sizeof(sink));
+	vb2_digest_buffer(data, DATA_SIZE, VB2_HASH_SHA256,
+			  expect_digest, sizeof(expect_digest));
+
+	mock_read_fail_on_call = 0;
+	mock_wait_fail_on_call = 0;
+	mock_hwcrypto_fail = 0;
+	mock_pending = 0;
+	mock_waits = 0;
+	mock_hwcrypto_bytes = 0;
+	mock_hwcrypto_async = 0;
+	mock_hwcrypto_async_fail = 0;
+	mock_hwcrypto_wait_fail = 0;
+	mock_hwcrypto_async_blocks = 0;
+	mock_hwcrypto_overlaps = 0;
+	mock_hwcrypto_buf = NULL;
+	mock_hwcrypto_size = 0;
+	vb2_digest_init(&mock_hwcrypto_dc, VB2_HASH_SHA256);
+	mock_res_offset = 0;
+	mock_parallel = 0;
+	mock_parallel_fail = 0;
+	mock_parallel_jobs = 0;
+	mock_parallel_overlaps = 0;
+	mock_parallel_fn = NULL;
+	memset(mock_consumed, 0, sizeof(mock_consumed));
+	mock_consumed_size = 0;
+	mock_consume_calls = 0;
+	mock_consume_fail_on_call = 0;
+	mock_consume_overlaps = 0;
+}
+
+/* Mocked functions */
+
+int vb2ex_read_resource(struct vb2_context *ctx,
+			enum vb2_resource_index index,
+			uint32_t offset,
+			void *buf,
+			uint32_t size)
+{
+	if (index != VB2_RES_KERNEL_VBLOCK)
+		return VB2_ERROR_EX_READ_RESOURCE_INDEX;
+
+	if (offset > DATA_SIZE || offset + size > DATA_SIZE)
+		return VB2_ERROR_EX_READ_RESOURCE_SIZE;
+
+	/* Reads must be sequential */
+	if (offset != mock_res_offset)
+		return VB2_ERROR_UNKNOWN;
+	mock_res_offset += size;
+
+	memcpy(buf, data + offset, size);
+	return VB2_SUCCESS;
+}
+
+int vb2ex_hwcrypto_digest_extend(const uint8_t *buf, uint32_t size)
+{
+	if (mock_hwcrypto_fail)
+		return VB2_ERROR_MOCK;
+
+	mock_hwcrypto_bytes += size;
+	return vb2_digest_extend(&mock_hwcrypto_dc, buf, size);
+}
+
+int vb2ex_hwcrypto_digest_extend_async(const uint8_t *buf, uint32_t size)
+{
+	if (!mock_hwcrypto_async)
+		return VB2_ERROR_EX_HWCRYPTO_ASYNC_UNIMPLEMENTED;
+	if (mock_hwcrypto_async_fail)
+		return VB2_ERROR_MOCK;
+	if (mock_hwcrypto_buf)
+		return VB2_ERROR_UNKNOWN;
+
+	/* Hash it at vb2ex_hwcrypto_digest_wait(), to catch a stomped buf */
+	mock_hwcrypto_buf = buf;
+	mock_hwcrypto_size = size;
+	mock_hwcrypto_async_blocks++;
+	return VB2_SUCCESS;
+}
+
+int vb2ex_hwcrypto_digest_wait(void)
+{
+	const uint8_t *buf = mock_hwcrypto_buf;
+
+	if (!buf)
+		return VB2_ERROR_UNKNOWN;
+
+	mock_hwcrypto_buf = NULL;
+	if (mock_hwcrypto_wait_fail)
+		return VB2_ERROR_MOCK;
+	mock_hwcrypto_bytes += mock_hwcrypto_size;
+	return vb2_digest_extend(&mock_hwcrypto_dc, buf, mock_hwcrypto_size);
+}
+
+int vb2ex_run_parallel(int (*fn)(void *arg), void *arg)
+{
+	if (!mock_parallel)
+		return VB2_ERROR_EX_RUN_PARALLEL_UNIMPLEMENTED;
+	if (mock_parallel_fn)
+		return VB2_ERROR_UNKNOWN;
+
+	/* Run it at vb2ex_wait(), to catch anything done in between */
+	mock_parallel_fn = fn;
+	mock_parallel_arg = arg;
+	mock_parallel_jobs++;
+	return VB2_SUCCESS;
+}
+
+int vb2ex_wait(void)
+{
+	int rv;
+
+	if (!mock_parallel_fn)
+		return VB2_ERROR_UNKNOWN;
+
+	rv = mock_parallel_fn(mock_parallel_arg);
+	mock_parallel_fn = NULL;
+	if (mock_parallel_fail)
+		return VB2_ERROR_MOCK;
+	return rv;
+}
+
+/* Async source which reads from data[] and counts outstanding reads */
+static int async_start(struct vb2_pipeline_source *src, uint8_t *buf,
+		       uint32_t size)
+{
+	if (--mock_read_fail_on_call == 0)
+		return VB2_ERROR_MOCK;
+	if (mock_pending)
+		return VB2_ERROR_UNKNOWN;
+
+	mock_pending = 1;
+	if (mock_parallel_fn)
+		mock_parallel_overlaps++;
+	if (mock_hwcrypto_buf)
+		mock_hwcrypto_overlaps++;
+	memcpy(buf, src->base + src->offset, size);
+	src->offset += size;
+	return VB2_SUCCESS;
+}
+
+static int async_wait(struct vb2_pipeline_source *src)
+{
+	mock_waits++;
+	mock_pending = 0;
+	if (--mock_wait_fail_on_call == 0)
+		return VB2_ERROR_MOCK;
+	return VB2_SUCCESS;
+}
+
+static int async_read(struct vb2_pipeline_source *src, uint8_t *buf,
+		      uint32_t size)
+{
+	return VB2_ERROR_UNKNOWN;
+}
+
+static void async_source(struct vb2_pipeline_source *src)
+{
+	vb2_pipeline_source_memory(src, data);
+	src->read = async_read;
+	src->read_start = async_start;
+	src->read_wait = async_wait;
+}
+
+/* Tests */
+
+static int mock_consume(struct vb2_pipeline *pipe, const uint8_t *buf,
+			uint32_t size)
+{
+	if (++mock_consume_calls == mock_consume_fail_on_call)
+		return VB2_ERROR_MOCK;
+
+	if (mock_pending)
+		mock_consume_overlaps++;
+
+	memcpy(mock_consumed + mock_consumed_size, buf, size);
+	mock_consumed_size += size;
+	return VB2_SUCCESS;
+}
+
+static void memory_tests(void)
+{
+	struct vb2_pipeline_source src;
+	struct vb2_pipeline pipe;
+	struct vb2_digest_context dc;
+	uint8_t digest[VB2_SHA256_DIGEST_SIZE];
+
+	/* Copy and hash in chunks */
+	reset_common_data();
+	vb2_digest_init(&dc, VB2_HASH_SHA256);
+	vb2_pipeline_source_memory(&src, data);
+	vb2_pipeline_init(&pipe, &src, 300, &dc, sink);
+	TEST_SUCC(vb2_pipeline_run(&pipe, DATA_SIZE), "Memory run");
+	TEST_EQ(memcmp(sink, data, DATA_SIZE), 0, "  data copied");
+	TEST_PTR_EQ(pipe.sink, sink + DATA_SIZE, "  sink advanced");
+	TEST_EQ(pipe.read_count, 4, "  read count");
+	TEST_EQ(pipe.bytes_read, DATA_SIZE, "  bytes read");
+	TEST_EQ(pipe.bytes_hashed, DATA_SIZE, "  bytes hashed");
+	vb2_digest_finalize(&dc, digest, sizeof(digest));
+	TEST_EQ(memcmp(digest, expect_digest, sizeof(digest)), 0,
+		"  digest");
+
+	/* Hash in place, in one piece; nothing to copy */
+	reset_common_data();
+	vb2_digest_init(&dc, VB2_HASH_SHA256);
+	vb2_pipeline_source_memory(&src, data);
+	vb2_pipeline_init(&pipe, &src, 0, &dc, data);
+	TEST_SUCC(vb2_pipeline_run(&pipe, DATA_SIZE), "In place run");
+	TEST_EQ(pipe.read_count, 1, "  read count");
+	vb2_digest_finalize(&dc, digest, sizeof(digest));
+	TEST_EQ(memcmp(digest, expect_digest, sizeof(digest)), 0,
+		"  digest");
+
+	/* Extend with data already loaded, then run the rest */
+	reset_common_data();
+	vb2_digest_init(&dc, VB2_HASH_SHA256);
+	vb2_pipeline_source_memory(&src, data + 100);
+	vb2_pipeline_init(&pipe, &src, 256, &dc, sink);
+	TEST_SUCC(vb2_pipeline_extend(&pipe, data, 100), "Extend");
+	TEST_SUCC(vb2_pipeline_run(&pipe, DATA_SIZE - 100), "  run");
+	TEST_EQ(pipe.bytes_read, DATA_SIZE - 100, "  bytes read");
+	TEST_EQ(pipe.bytes_hashed, DATA_SIZE, "  bytes hashed");
+	vb2_digest_finalize(&dc, digest, sizeof(digest));
+	TEST_EQ(memcmp(digest, expect_digest, sizeof(digest)), 0,
+		"  digest");
+
+	/* No digest stage */
+	reset_common_data();
+	vb2_pipeline_source_memory(&src, data);
+	vb2_pipeline_init(&pipe, &src, 0, NULL, sink);
+	TEST_SUCC(vb2_pipeline_run(&pipe, DATA_SIZE), "Load only");
+	TEST_EQ(memcmp(sink, data, DATA_SIZE), 0, "  data copied");
+	TEST_EQ(pipe.bytes_hashed, 0, "  bytes hashed");
+
+	/* Zero-size run does nothing */
+	reset_common_data();
+	vb2_pipeline_source_memory(&src, data);
+	vb2_pipeline_init(&pipe, &src, 0, NULL, sink);
+	TEST_SUCC(vb2_pipeline_run(&pipe, 0), "Empty run");
+	TEST_EQ(pipe.read_count, 0, "  read count");
+}
+
+static void resource_tests(void)
+{
+	struct vb2_pipeline_source src;
+	struct vb2_pipeline pipe;
+
+	reset_common_data();
+	vb2_pipeline_source_resource(&src, &cc, VB2_RES_KERNEL_VBLOCK, 0);
+	vb2_pipeline_init(&pipe, &src, 0, NULL, sink);
+	TEST_SUCC(vb2_pipeline_run(&pipe, 16), "Resource header");
+	TEST_SUCC(vb2_pipeline_run(&pipe, DATA_SIZE - 16), "  rest");
+	TEST_EQ(memcmp(sink, data, DATA_SIZE), 0, "  data");
+	TEST_EQ(pipe.read_count, 2, "  read count");
+
+	reset_common_data();
+	vb2_pipeline_source_resource(&src, &cc, VB2_RES_KERNEL_VBLOCK, 0);
+	vb2_pipeline_init(&pipe, &src, 0, NULL, sink);
+	TEST_EQ(vb2_pipeline_run(&pipe, DATA_SIZE + 1),
+		VB2_ERROR_EX_READ_RESOURCE_SIZE, "Resource read fail");
+	TEST_EQ(pipe.failed, VB2_PIPELINE_SOURCE, "  failed stage");
+}
+
+static void async_tests(void)
+{
+	struct vb2_pipeline_source src;
+	struct vb2_pipeline pipe;
+	struct vb2_digest_context dc;
+	uint8_t digest[VB2_SHA256_DIGEST_SIZE];
+
+	reset_common_data();
+	vb2_digest_init(&dc, VB2_HASH_SHA256);
+	async_source(&src);
+	vb2_pipeline_init(&pipe, &src, 128, &dc, sink);
+	TEST_SUCC(vb2_pipeline_run(&pipe, DATA_SIZE), "Async run");
+	TEST_EQ(mock_pending, 0, "  no read pending");
+	TEST_EQ(mock_waits, 8, "  waits");
+	TEST_EQ(pipe.read_count, 8, "  read count");
+	vb2_digest_finalize(&dc, digest, sizeof(digest));
+	TEST_EQ(memcmp(digest, expect_digest, sizeof(digest)), 0,
+		"  digest");
+
+	reset_common_data();
+	mock_read_fail_on_call = 3;
+	vb2_digest_init(&dc, VB2_HASH_SHA256);
+	async_source(&src);
+	vb2_pipeline_init(&pipe, &src, 128, &dc, sink);
+	TEST_EQ(vb2_pipeline_run(&pipe, DATA_SIZE), VB2_ERROR_MOCK,
+		"Async start fail");
+	TEST_EQ(pipe.failed, VB2_PIPELINE_SOURCE, "  failed stage");
+	TEST_EQ(mock_pending, 0, "  no read pending");
+
+	reset_common_data();
+	mock_wait_fail_on_call = 2;
+	vb2_digest_init(&dc, VB2_HASH_SHA256);
+	async_source(&src);
+	vb2_pipeline_init(&pipe, &src, 128, &dc, sink);
+	TEST_EQ(vb2_pipeline_run(&pipe, DATA_SIZE), VB2_ERROR_MOCK,
+		"Async wait fail");
+	TEST_EQ(pipe.failed, VB2_PIPELINE_SOURCE, "  failed stage");
+	TEST_EQ(pipe.bytes_hashed, 128, "  bytes hashed");
+
+	/* Digest failure waits out the read in flight */
+	reset_common_data();
+	vb2_digest_init(&dc, VB2_HASH_SHA256);
+	dc.hash_alg = VB2_HASH_INVALID;
+	async_source(&src);
+	vb2_pipeline_init(&pipe, &src, 128, &dc, sink);
+	TEST_EQ(vb2_pipeline_run(&pipe, DATA_SIZE),
+		VB2_ERROR_SHA_EXTEND_ALGORITHM, "Digest fail");
+	TEST_EQ(pipe.failed, VB2_PIPELINE_DIGEST, "  failed stage");
+	TEST_EQ(mock_pending, 0, "  no read pending");
+}
+
+static void hwcrypto_tests(void)
+{
+	struct vb2_pipeline_source src;
+	struct vb2_pipeline pipe;
+	struct vb2_digest_context dc;
+
+	reset_common_data();
+	dc.using_hwcrypto = 1;
+	vb2_pipeline_source_memory(&src, data);
+	vb2_pipeline_init(&pipe, &src, 512, &dc, sink);
+	TEST_SUCC(vb2_pipeline_run(&pipe, DATA_SIZE), "Hwcrypto run");
+	TEST_EQ(mock_hwcrypto_bytes, DATA_SIZE, "  bytes to hwcrypto");
+
+	reset_common_data();
+	mock_hwcrypto_fail = 1;
+	dc.using_hwcrypto = 1;
+	vb2_pipeline_source_memory(&src, data);
+	vb2_pipeline_init(&pipe, &src, 512, &dc, sink);
+	TEST_EQ(vb2_pipeline_run(&pipe, DATA_SIZE), VB2_ERROR_MOCK,
+		"Hwcrypto fail");
+	TEST_EQ(pipe.failed, VB2_PIPELINE_DIGEST, "  failed stage");
+}
+
+static void hwcrypto_async_tests(void)
+{
+	struct vb2_pipeline_source src;
+	struct vb2_pipeline pipe;
+	struct vb2_digest_context dc;
+	uint8_t digest[VB2_SHA256_DIGEST_SIZE];
+
+	/* Each chunk but the last is hashed while the next one is read */
+	reset_common_data();
+	mock_hwcrypto_async = 1;
+	dc.using_hwcrypto = 1;
+	async_source(&src);
+	vb2_pipeline_init(&pipe, &src, 300, &dc, sink);
+	TEST_SUCC(vb2_pipeline_run(&pipe, DATA_SIZE), "Hwcrypto async run");
+	TEST_EQ(mock_hwcrypto_async_blocks, 3, "  async blocks");
+	TEST_EQ(mock_hwcrypto_overlaps, 3, "  reads overlap hashing");
+	TEST_PTR_EQ(mock_hwcrypto_buf, NULL, "  no hash left");
+	TEST_EQ(mock_pending, 0, "  no read left");
+	TEST_EQ(mock_hwcrypto_bytes, DATA_SIZE, "  bytes to hwcrypto");
+	TEST_EQ(pipe.bytes_hashed, DATA_SIZE, "  bytes hashed");
+	vb2_digest_finalize(&mock_hwcrypto_dc, digest, sizeof(digest));
+	TEST_EQ(memcmp(digest, expect_digest, sizeof(digest)), 0,
+		"  digest");
+
+	/* Double-buffered through a ring sink */
+	reset_common_data();
+	mock_hwcrypto_async = 1;
+	dc.using_hwcrypto = 1;
+	async_source(&src);
+	vb2_pipeline_init(&pipe, &src, 100, &dc, sink);
+	pipe.sink_size = 200;
+	TEST_SUCC(vb2_pipeline_run(&pipe, DATA_SIZE), "Hwcrypto async ring");
+	TEST_EQ(mock_hwcrypto_async_blocks, 9, "  async blocks");
+	vb2_digest_finalize(&mock_hwcrypto_dc, digest, sizeof(digest));
+	TEST_EQ(memcmp(digest, expect_digest, sizeof(digest)), 0,
+		"  digest");
+
+	/* Failing to start is a digest failure, not a reason to retry */
+	reset_common_data();
+	mock_hwcrypto_async = 1;
+	mock_hwcrypto_async_fail = 1;
+	dc.using_hwcrypto = 1;
+	async_source(&src);
+	vb2_pipeline_init(&pipe, &src, 300, &dc, sink);
+	TEST_EQ(vb2_pipeline_run(&pipe, DATA_SIZE), VB2_ERROR_MOCK,
+		"Hwcrypto async start fail");
+	TEST_EQ(pipe.failed, VB2_PIPELINE_DIGEST, "  failed stage");
+	TEST_EQ(mock_hwcrypto_bytes, 0, "  nothing hashed");
+	TEST_EQ(mock_pending, 0, "  no read left");
+
+	reset_common_data();
+	mock_hwcrypto_async = 1;
+	mock_hwcrypto_wait_fail = 1;
+	dc.using_hwcrypto = 1;
+	async_source(&src);
+	vb2_pipeline_init(&pipe, &src, 300, &dc, sink);
+	TEST_EQ(vb2_pipeline_run(&pipe, DATA_SIZE), VB2_ERROR_MOCK,
+		"Hwcrypto async wait fail");
+	TEST_EQ(pipe.failed, VB2_PIPELINE_DIGEST, "  failed stage");
+	TEST_EQ(pipe.bytes_hashed, 0, "  bytes hashed");
+	TEST_EQ(mock_pending, 0, "  no read left");
+
+	/* Read failure while a block is out still waits for the block */
+	reset_common_data();
+	mock_hwcrypto_async = 1;
+	mock_read_fail_on_call = 2;
+	dc.using_hwcrypto = 1;
+	async_source(&src);
+	vb2_pipeline_init(&pipe, &src, 300, &dc, sink);
+	TEST_EQ(vb2_pipeline_run(&pipe, DATA_SIZE), VB2_ERROR_MOCK,
+		"Hwcrypto async read fail");
+	TEST_EQ(pipe.failed, VB2_PIPELINE_SOURCE, "  failed stage");
+	TEST_PTR_EQ(mock_hwcrypto_buf, NULL, "  no hash left");
+}
+
+static void parallel_tests(void)
+{
+	struct vb2_pipeline_source src;
+	struct vb2_pipeline pipe;
+	struct vb2_digest_context dc;
+	uint8_t digest[VB2_SHA256_DIGEST_SIZE];
+
+	/* Each chunk but the last is hashed on the other CPU */
+	reset_common_data();
+	mock_parallel = 1;
+	vb2_digest_init(&dc, VB2_HASH_SHA256);
+	async_source(&src);
+	vb2_pipeline_init(&pipe, &src, 300, &dc, sink);
+	TEST_SUCC(vb2_pipeline_run(&pipe, DATA_SIZE), "Parallel run");
+	TEST_EQ(memcmp(sink, data, DATA_SIZE), 0, "  data copied");
+	TEST_EQ(mock_parallel_jobs, 3, "  jobs");
+	TEST_EQ(mock_parallel_overlaps, 3, "  reads overlap hashing");
+	TEST_PTR_EQ(mock_parallel_fn, NULL, "  no job left");
+	TEST_EQ(mock_pending, 0, "  no read left");
+	TEST_EQ(pipe.bytes_hashed, DATA_SIZE, "  bytes hashed");
+	vb2_digest_finalize(&dc, digest, sizeof(digest));
+	TEST_EQ(memcmp(digest, expect_digest, sizeof(digest)), 0,
+		"  digest");
+
+	/* Synchronous sources overlap too */
+	reset_common_data();
+	mock_parallel = 1;
+	vb2_digest_init(&dc, VB2_HASH_SHA256);
+	vb2_pipeline_source_memory(&src, data);
+	vb2_pipeline_init(&pipe, &src, 300, &dc, sink);
+	TEST_SUCC(vb2_pipeline_run(&pipe, DATA_SIZE), "Parallel memory run");
+	TEST_EQ(mock_parallel_jobs, 3, "  jobs");
+	vb2_digest_finalize(&dc, digest, sizeof(digest));
+	TEST_EQ(memcmp(digest, expect_digest, sizeof(digest)), 0,
+		"  digest");
+
+	/* A single chunk has nothing to overlap */
+	reset_common_data();
+	mock_parallel = 1;
+	vb2_digest_init(&dc, VB2_HASH_SHA256);
+	vb2_pipeline_source_memory(&src, data);
+	vb2_pipeline_init(&pipe, &src, 0, &dc, sink);
+	TEST_SUCC(vb2_pipeline_run(&pipe, DATA_SIZE), "Parallel one chunk");
+	TEST_EQ(mock_parallel_jobs, 0, "  no jobs");
+
+	/* Hardware crypto stays on this CPU */
+	reset_common_data();
+	mock_parallel = 1;
+	dc.using_hwcrypto = 1;
+	vb2_pipeline_source_memory(&src, data);
+	vb2_pipeline_init(&pipe, &src, 300, &dc, sink);
+	TEST_SUCC(vb2_pipeline_run(&pipe, DATA_SIZE), "Parallel hwcrypto");
+	TEST_EQ(mock_parallel_jobs, 0, "  no jobs");
+	TEST_EQ(mock_hwcrypto_bytes, DATA_SIZE, "  bytes to hwcrypto");
+
+	/* Digest failure on the other CPU */
+	reset_common_data();
+	mock_parallel = 1;
+	mock_parallel_fail = 1;
+	vb2_digest_init(&dc, VB2_HASH_SHA256);
+	async_source(&src);
+	vb2_pipeline_init(&pipe, &src, 300, &dc, sink);
+	TEST_EQ(vb2_pipeline_run(&pipe, DATA_SIZE), VB2_ERROR_MOCK,
+		"Parallel digest fail");
+	TEST_EQ(pipe.failed, VB2_PIPELINE_DIGEST, "  failed stage");
+	TEST_EQ(pipe.bytes_hashed, 0, "  bytes hashed");
+	TEST_EQ(mock_pending, 0, "  no read left");
+
+	/* Read failure while a job is out still collects the job */
+	reset_common_data();
+	mock_parallel = 1;
+	mock_read_fail_on_call = 2;
+	vb2_digest_init(&dc, VB2_HASH_SHA256);
+	async_source(&src);
+	vb2_pipeline_init(&pipe, &src, 300, &dc, sink);
+	TEST_EQ(vb2_pipeline_run(&pipe, DATA_SIZE), VB2_ERROR_MOCK,
+		"Parallel read fail");
+	TEST_EQ(pipe.failed, VB2_PIPELINE_SOURCE, "  failed stage");
+	TEST_PTR_EQ(mock_parallel_fn, NULL, "  no job left");
+}
+
+static void consumer_tests(void)
+{
+	struct vb2_pipeline_source src;
+	struct vb2_pipeline pipe;
+	struct vb2_digest_context dc;
+	uint8_t digest[VB2_SHA256_DIGEST_SIZE];
+
+	/* Each chunk goes to the consumer once hashed, leaving a ring sink */
+	reset_common_data();
+	vb2_digest_init(&dc, VB2_HASH_SHA256);
+	async_source(&src);
+	vb2_pipeline_init(&pipe, &src, 128, &dc, sink);
+	pipe.sink_size = 256;
+	pipe.consume = mock_consume;
+	TEST_SUCC(vb2_pipeline_extend(&pipe, data, 0), "Consume nothing");
+	TEST_EQ(mock_consume_calls, 0, "  no calls");
+	TEST_SUCC(vb2_pipeline_run(&pipe, DATA_SIZE), "Consumer run");
+	TEST_EQ(mock_consume_calls, 8, "  calls");
+	TEST_EQ(mock_consume_overlaps, 7, "  reads overlap consumer");
+	TEST_EQ(mock_consumed_size, DATA_SIZE, "  bytes consumed");
+	TEST_EQ(memcmp(mock_consumed, data, DATA_SIZE), 0, "  data consumed");
+	vb2_digest_finalize(&dc, digest, sizeof(digest));
+	TEST_EQ(memcmp(digest, expect_digest, sizeof(digest)), 0,
+		"  digest");
+
+	/* Data already in memory is consumed too */
+	reset_common_data();
+	vb2_digest_init(&dc, VB2_HASH_SHA256);
+	vb2_pipeline_source_memory(&src, data + 100);
+	vb2_pipeline_init(&pipe, &src, 300, &dc, sink);
+	pipe.consume = mock_consume;
+	TEST_SUCC(vb2_pipeline_extend(&pipe, data, 100), "Consumer extend");
+	TEST_SUCC(vb2_pipeline_run(&pipe, DATA_SIZE - 100),
+		  "Consumer extend run");
+	TEST_EQ(memcmp(mock_consumed, data, DATA_SIZE), 0, "  data consumed");
+
+	/* Consumer after parallel hashing */
+	reset_common_data();
+	mock_parallel = 1;
+	vb2_digest_init(&dc, VB2_HASH_SHA256);
+	async_source(&src);
+	vb2_pipeline_init(&pipe, &src, 300, &dc, sink);
+	pipe.consume = mock_consume;
+	TEST_SUCC(vb2_pipeline_run(&pipe, DATA_SIZE), "Consumer parallel");
+	TEST_EQ(mock_parallel_jobs, 3, "  jobs");
+	TEST_EQ(memcmp(mock_consumed, data, DATA_SIZE), 0, "  data consumed");
+
+	/* Failure waits out the read in flight */
+	reset_common_data();
+	mock_consume_fail_on_call = 2;
+	vb2_digest_init(&dc, VB2_HASH_SHA256);
+	async_source(&src);
+	vb2_pipeline_init(&pipe, &src, 128, &dc, sink);
+	pipe.consume = mock_consume;
+	TEST_EQ(vb2_pipeline_run(&pipe, DATA_SIZE), VB2_ERROR_MOCK,
+		"Consumer fail");
+	TEST_EQ(pipe.failed, VB2_PIPELINE_CONSUMER, "  failed stage");
+	TEST_EQ(mock_pending, 0, "  no read pending");
+
+	reset_common_data();
+	mock_consume_fail_on_call = 1;
+	vb2_pipeline_source_memory(&src, data);
+	vb2_pipeline_init(&pipe, &src, 0, NULL, sink);
+	pipe.consume = mock_consume;
+	TEST_EQ(vb2_pipeline_extend(&pipe, data, 10), VB2_ERROR_MOCK,
+		"Consumer extend fail");
+	TEST_EQ(pipe.failed, VB2_PIPELINE_CONSUMER, "  failed stage");
+}
+
+int main(int argc, char* argv[])
+{
+	memory_tests();
+	resource_tests();
+	async_tests();
+	hwcrypto_tests();
+	hwcrypto_async_tests();
+	parallel_tests();
+	consumer_tests();
+
+	return gTestSuccess ? 0 : 255;
+}
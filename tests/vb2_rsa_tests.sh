@@ -12,26 +12,14 @@
 set -e
 
 return_code=0
-TEST_FILE=${TESTCASE_DIR}/test_file
 
 function test_signatures {
-  algorithmcounter=0
-  for keylen in ${key_lengths[@]}
-  do
-    for hashalgo in ${hash_algos[@]}
-    do
-      echo -e "For ${COL_YELLOW}RSA-$keylen and $hashalgo${COL_STOP}:"
-      ${BIN_DIR}/verify_data $algorithmcounter \
-        ${TESTKEY_DIR}/key_rsa${keylen}.keyb \
-        ${TEST_FILE}.rsa${keylen}_${hashalgo}.sig \
-        ${TEST_FILE}
-      if [ $? -ne 0 ]
-      then
-        return_code=255
-      fi
-      let algorithmcounter=algorithmcounter+1
-    done
-  done
+  # Every key size and hash algorithm, in one process
+  ${TEST_DIR}/vb20_rsa_vector_tests ${TESTKEY_DIR} ${TESTCASE_DIR}
+  if [ $? -ne 0 ]
+  then
+    return_code=255
+  fi
   echo -e "Peforming ${COL_YELLOW}PKCS #1 v1.5 Padding Tests${COL_STOP}..."
   ${TEST_DIR}/vb20_rsa_padding_tests ${TESTKEY_DIR}/rsa_padding_test_pubkey.keyb
 }
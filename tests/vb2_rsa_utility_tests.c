@@ -105,6 +105,17 @@ static void test_utils(void)
 	TEST_NEQ(vb2_safe_memcmp("foo", "bar", 3), 0, "vb2_safe_memcmp() bad");
 	TEST_EQ(vb2_safe_memcmp("foo", "bar", 0), 0, "vb2_safe_memcmp() zero");
 
+	/* Test endian conversion */
+	{
+		const uint8_t be[8] = {0x01, 0x02, 0x03, 0x04,
+				       0x05, 0x06, 0x07, 0x08};
+		const uint32_t words[2] = {0x05060708, 0x01020304};
+		uint8_t out[8];
+
+		vb2_le_words_to_be(out, words, 2);
+		TEST_EQ(memcmp(out, be, sizeof(be)), 0, "le_words_to_be");
+	}
+
 	/* Test Montgomery >= */
 	{
 		uint32_t n[4] = {4, 4, 4, 4};
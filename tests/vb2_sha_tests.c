@@ -10,6 +10,7 @@
 #include "2sysincludes.h"
 #include "2rsa.h"
 #include "2sha.h"
+#include "2sha_private.h"
 #include "2return_codes.h"
 
 #include "sha_test_vectors.h"
@@ -168,6 +169,132 @@ void misc_tests(void)
 	TEST_EQ(vb2_digest_finalize(&dc, digest, sizeof(digest)),
 		VB2_ERROR_SHA_FINALIZE_ALGORITHM,
 		"vb2_digest_finalize() invalid alg");
+
+	/* A failed init leaves nothing to extend or finalize */
+	TEST_EQ(vb2_digest_init(&dc, VB2_HASH_INVALID),
+		VB2_ERROR_SHA_INIT_ALGORITHM, "vb2_digest_init() invalid alg");
+	TEST_EQ(vb2_digest_extend(&dc, digest, sizeof(digest)),
+		VB2_ERROR_SHA_EXTEND_ALGORITHM,
+		"vb2_digest_extend() after failed init");
+	TEST_EQ(vb2_digest_finalize(&dc, digest, sizeof(digest)),
+		VB2_ERROR_SHA_FINALIZE_ALGORITHM,
+		"vb2_digest_finalize() after failed init");
+}
+
+static void multi_tests(void)
+{
+	const uint32_t size = 1000;
+	uint8_t bufs[6][1000];
+	const uint8_t *ptrs[6];
+	uint8_t digests[6][VB2_MAX_DIGEST_SIZE];
+	uint8_t digest[VB2_MAX_DIGEST_SIZE];
+	struct vb2_digest_context dc[VB2_SHA256_LANES];
+	enum vb2_hash_algorithm alg;
+	char test_name[256];
+	int i, j;
+
+	for (i = 0; i < 6; i++) {
+		for (j = 0; j < size; j++)
+			bufs[i][j] = (uint8_t)(i * 31 + j * 7);
+		ptrs[i] = bufs[i];
+	}
+
+	for (alg = 1; alg < VB2_HASH_ALG_COUNT; alg++) {
+		TEST_SUCC(vb2_digest_multi_buffer(ptrs, size, 6, alg,
+						  digests[0],
+						  sizeof(digests[0])),
+			  "vb2_digest_multi_buffer()");
+		for (i = 0; i < 6; i++) {
+			vb2_digest_buffer(ptrs[i], size, alg,
+					  digest, sizeof(digest));
+			sprintf(test_name, "%s: %s lane %d", __func__,
+				vb2_get_hash_algorithm_name(alg), i);
+			TEST_EQ(memcmp(digest, digests[i],
+				       vb2_digest_size(alg)), 0, test_name);
+		}
+	}
+
+	/* Contexts which are not block-aligned take the single-lane path */
+	vb2_digest_multi_init(dc, VB2_SHA256_LANES, VB2_HASH_SHA256);
+	vb2_digest_multi_extend(dc, VB2_SHA256_LANES, ptrs, 5);
+	vb2_digest_multi_extend(dc, VB2_SHA256_LANES, ptrs, size);
+	vb2_digest_multi_finalize(dc, VB2_SHA256_LANES, digests[0],
+				  sizeof(digests[0]));
+	for (i = 0; i < VB2_SHA256_LANES; i++) {
+		struct vb2_digest_context one;
+
+		vb2_digest_init(&one, VB2_HASH_SHA256);
+		vb2_digest_extend(&one, ptrs[i], 5);
+		vb2_digest_extend(&one, ptrs[i], size);
+		vb2_digest_finalize(&one, digest, sizeof(digest));
+		TEST_EQ(memcmp(digest, digests[i], VB2_SHA256_DIGEST_SIZE), 0,
+			"Multi extend unaligned");
+	}
+
+	TEST_EQ(vb2_digest_multi_buffer(ptrs, size, 6, VB2_HASH_INVALID,
+					digests[0], sizeof(digests[0])),
+		VB2_ERROR_SHA_INIT_ALGORITHM,
+		"vb2_digest_multi_buffer() invalid alg");
+	TEST_EQ(vb2_digest_multi_buffer(ptrs, size, 6, VB2_HASH_SHA256,
+					digests[0], 1),
+		VB2_ERROR_SHA_FINALIZE_DIGEST_SIZE,
+		"vb2_digest_multi_buffer() too small");
+
+#ifdef VB2_SHA_ARCH_X86
+	/* Check the SSE2 lanes even on CPUs where SHA-NI is preferred */
+	{
+		struct vb2_sha256_context ctx[VB2_SHA256_LANES];
+		uint32_t state[VB2_SHA256_LANES][8];
+		uint32_t *h[VB2_SHA256_LANES];
+
+		for (i = 0; i < VB2_SHA256_LANES; i++) {
+			vb2_sha256_init(&ctx[i]);
+			memcpy(state[i], ctx[i].h, sizeof(state[i]));
+			h[i] = state[i];
+			vb2_sha256_update(&ctx[i], ptrs[i],
+					  3 * VB2_SHA256_BLOCK_SIZE);
+		}
+		vb2_sha256_transform_x4_sse2(h, ptrs, 3);
+		for (i = 0; i < VB2_SHA256_LANES; i++)
+			TEST_EQ(memcmp(state[i], ctx[i].h, sizeof(state[i])),
+				0, "SHA-256 SSE2 lanes");
+	}
+#endif
+}
+
+static void one_shot_tests(void)
+{
+	uint8_t digest[VB2_SHA512_DIGEST_SIZE];
+	uint8_t expect[VB2_SHA512_DIGEST_SIZE];
+	struct vb2_digest_context dc;
+	enum vb2_hash_algorithm alg;
+	uint32_t size, mismatches;
+
+	/* Sizes straddle every padding boundary of every block size */
+	for (alg = 1; alg < VB2_HASH_ALG_COUNT; alg++) {
+		uint32_t digest_size = vb2_digest_size(alg);
+
+		if (!digest_size)
+			continue;
+
+		mismatches = 0;
+		for (size = 0; size <= 300; size++) {
+			vb2_digest_init(&dc, alg);
+			vb2_digest_extend(&dc, (uint8_t *)long_msg, size);
+			vb2_digest_finalize(&dc, expect, sizeof(expect));
+
+			if (vb2_digest_buffer((uint8_t *)long_msg, size, alg,
+					      digest, sizeof(digest)) ||
+			    memcmp(digest, expect, digest_size))
+				mismatches++;
+		}
+		TEST_EQ(mismatches, 0, vb2_get_hash_algorithm_name(alg));
+
+		TEST_EQ(vb2_digest_buffer((uint8_t *)long_msg, 1, alg,
+					  digest, digest_size - 1),
+			VB2_ERROR_SHA_FINALIZE_DIGEST_SIZE,
+			"vb2_digest_buffer() digest too small");
+	}
 }
 
 static void hash_algorithm_name_tests(void)
@@ -197,6 +324,8 @@ int main(int argc, char *argv[])
 	sha256_tests();
 	sha512_tests();
 	misc_tests();
+	multi_tests();
+	one_shot_tests();
 	hash_algorithm_name_tests();
 
 	free(long_msg);
@@ -0,0 +1,66 @@
+#!/bin/bash
+
+# Copyright 2018 The Chromium OS Authors. All rights reserved.
+# Use of this source code is governed by a BSD-style license that can be
+# found in the LICENSE file.
+#
+# Report the peak work buffer usage of vboot2 firmware verification for each
+# combination of root key and firmware subkey size.  The firmware must be
+# built with WORKBUF_STATS=1.
+
+# Load common constants and variables.
+. "$(dirname "$0")/common.sh"
+
+set -e
+
+# Run in a dedicated directory for easy cleanup or debugging.
+DIR="${TEST_DIR}/vb2_workbuf_report_dir"
+[ -d "$DIR" ] || mkdir -p "$DIR"
+cd "$DIR"
+
+echo 'This is a test firmware body.  This is only a test.  Lalalalala' \
+    > body.test
+
+${FUTILITY} vbutil_key --pack kernkey.test \
+    --key ${TESTKEY_DIR}/key_rsa2048.keyb --algorithm 4
+
+# Key sizes and the matching SHA-256 algorithm numbers
+sizes=( 1024 2048 4096 8192 )
+algos=( 1 4 7 10 )
+
+printf "%-8s %-8s %8s %8s %8s\n" root fw phase1 phase2 phase3
+
+for r in ${!sizes[@]}; do
+  root=${sizes[$r]}
+  ${FUTILITY} vbutil_key --pack rootkey.test \
+      --key ${TESTKEY_DIR}/key_rsa${root}.keyb --algorithm ${algos[$r]}
+  ${FUTILITY} gbb -c 128,2400,0,0 gbb.test > /dev/null
+  ${FUTILITY} gbb gbb.test -s --hwid='Test GBB' \
+      --rootkey=rootkey.test > /dev/null
+
+  for f in ${!sizes[@]}; do
+    fw=${sizes[$f]}
+    ${FUTILITY} vbutil_key --pack fwsubkey.test \
+        --key ${TESTKEY_DIR}/key_rsa${fw}.keyb --algorithm ${algos[$f]}
+    ${FUTILITY} vbutil_keyblock --pack keyblock.test \
+        --datapubkey fwsubkey.test \
+        --signprivate ${TESTKEY_DIR}/key_rsa${root}.sha256.vbprivk \
+        > /dev/null
+    ${FUTILITY} vbutil_firmware \
+        --vblock vblock.test \
+        --keyblock keyblock.test \
+        --signprivate ${TESTKEY_DIR}/key_rsa${fw}.sha256.vbprivk \
+        --fv body.test \
+        --version 1 \
+        --kernelkey kernkey.test > /dev/null
+
+    ${BUILD_RUN}/tests/vb20_verify_fw gbb.test vblock.test body.test \
+        > verify.log
+    if ! grep -q 'Workbuf peak' verify.log; then
+      error 'No workbuf peaks reported; build with WORKBUF_STATS=1'
+    fi
+    peaks=$(sed -n 's/^Workbuf peak phase . = \([0-9]*\) bytes$/\1/p' \
+        verify.log)
+    printf "%-8s %-8s %8s %8s %8s\n" rsa${root} rsa${fw} ${peaks}
+  done
+done
@@ -35,6 +35,8 @@ static struct vb2_shared_data *sd;
 static int shutdown_request_calls_left;
 static int audio_looping_calls_left;
 static uint32_t vbtlk_retval;
+static int vbtlk_calls;
+static uint32_t mock_events;
 static int vbexlegacy_called;
 static int trust_ec;
 static int virtdev_set;
@@ -75,6 +77,8 @@ static void ResetMocks(void)
 	shutdown_request_calls_left = -1;
 	audio_looping_calls_left = 30;
 	vbtlk_retval = 1000;
+	vbtlk_calls = 0;
+	mock_events = VB_EVENT_POLL;
 	vbexlegacy_called = 0;
 	trust_ec = 0;
 	virtdev_set = 0;
@@ -175,9 +179,15 @@ int vb2_audio_looping(void)
 
 uint32_t VbTryLoadKernel(struct vb2_context *ctx, uint32_t get_info_flags)
 {
+	vbtlk_calls++;
 	return vbtlk_retval + get_info_flags;
 }
 
+uint32_t VbExWaitForEvent(uint32_t mask, uint32_t timeout_ms)
+{
+	return mock_events & (mask | VB_EVENT_POLL);
+}
+
 VbError_t VbDisplayScreen(struct vb2_context *ctx, uint32_t screen, int force)
 {
 	if (screens_count < ARRAY_SIZE(screens_displayed))
@@ -615,6 +625,28 @@ static void VbBootRecTest(void)
 		"Insert (forced by GBB)");
 	TEST_EQ(screens_displayed[0], VB_SCREEN_RECOVERY_INSERT,
 		"  insert screen");
+	TEST_EQ(vbtlk_calls, 3, "  disks polled");
+
+	/* Disks are only rescanned on disk events if the platform has them */
+	ResetMocks();
+	shutdown_request_calls_left = 100;
+	sd->gbb_flags |= VB2_GBB_FLAG_FORCE_MANUAL_RECOVERY;
+	vbtlk_retval = VBERROR_NO_DISK_FOUND - VB_DISK_FLAG_REMOVABLE;
+	mock_events = 0;
+	TEST_EQ(VbBootRecovery(&ctx),
+		VBERROR_SHUTDOWN_REQUESTED,
+		"Insert, no events");
+	TEST_EQ(vbtlk_calls, 1, "  disks scanned once");
+
+	ResetMocks();
+	shutdown_request_calls_left = 100;
+	sd->gbb_flags |= VB2_GBB_FLAG_FORCE_MANUAL_RECOVERY;
+	vbtlk_retval = VBERROR_NO_DISK_FOUND - VB_DISK_FLAG_REMOVABLE;
+	mock_events = VB_EVENT_DISK;
+	TEST_EQ(VbBootRecovery(&ctx),
+		VBERROR_SHUTDOWN_REQUESTED,
+		"Insert, disk events");
+	TEST_EQ(vbtlk_calls, 101, "  disks scanned on each event");
 
 	/* No removal if recovery button physically pressed */
 	ResetMocks();
@@ -39,6 +39,23 @@ static uint32_t new_version;
 static struct RollbackSpaceFwmp rfr_fwmp;
 static int rkr_retval, rkw_retval, rkl_retval, rfr_retval;
 static VbError_t vbboot_retval;
+static VbError_t ec_sync_retval;
+static int nv_write_calls;
+static int mock_loc_toggle;
+
+/* Prefetch mocks */
+static int mock_parallel;
+static int (*mock_parallel_fn)(void *arg);
+static void *mock_parallel_arg;
+static int mock_parallel_waits;
+static int rkp_calls, rkr_calls;
+static int ec_sync_rkp_calls, ec_sync_rkr_calls;
+static VbDiskInfo mock_disks[2];
+static uint32_t mock_disk_count;
+static uint32_t mock_get_info_flags;
+static int mock_get_info_calls, mock_free_info_calls;
+static VbExDiskHandle_t mock_prefetch_handle;
+static int mock_prefetch_calls;
 
 /* Reset mock data (for use before each test) */
 static void ResetMocks(void)
@@ -75,6 +92,28 @@ static void ResetMocks(void)
 	rkr_version = new_version = 0x10002;
 	rkr_retval = rkw_retval = rkl_retval = VBERROR_SUCCESS;
 	vbboot_retval = VBERROR_SUCCESS;
+	ec_sync_retval = VBERROR_SUCCESS;
+	nv_write_calls = 0;
+	mock_loc_toggle = 0;
+
+	mock_parallel = 0;
+	mock_parallel_fn = NULL;
+	mock_parallel_waits = 0;
+	rkp_calls = rkr_calls = 0;
+	ec_sync_rkp_calls = ec_sync_rkr_calls = -1;
+
+	memset(mock_disks, 0, sizeof(mock_disks));
+	mock_disks[0].bytes_per_lba = 512;
+	mock_disks[0].lba_count = 100;
+	mock_disks[0].flags = VB_DISK_FLAG_FIXED;
+	mock_disks[0].handle = (VbExDiskHandle_t)1;
+	mock_disks[1] = mock_disks[0];
+	mock_disks[1].handle = (VbExDiskHandle_t)2;
+	mock_disk_count = 2;
+	mock_get_info_flags = 0;
+	mock_get_info_calls = mock_free_info_calls = 0;
+	mock_prefetch_handle = NULL;
+	mock_prefetch_calls = 0;
 }
 
 /* Mock functions */
@@ -87,12 +126,20 @@ VbError_t VbExNvStorageRead(uint8_t *buf)
 
 VbError_t VbExNvStorageWrite(const uint8_t *buf)
 {
+	nv_write_calls++;
 	memcpy(ctx.nvdata, buf, vb2_nv_get_size(&ctx));
 	return VBERROR_SUCCESS;
 }
 
+uint32_t RollbackKernelPrefetch(int read_fwmp)
+{
+	rkp_calls++;
+	return TPM_SUCCESS;
+}
+
 uint32_t RollbackKernelRead(uint32_t *version)
 {
+	rkr_calls++;
 	*version = rkr_version;
 	return rkr_retval;
 }
@@ -114,10 +161,68 @@ uint32_t RollbackFwmpRead(struct RollbackSpaceFwmp *fwmp)
 	return rfr_retval;
 }
 
+int vb2ex_run_parallel(int (*fn)(void *arg), void *arg)
+{
+	if (!mock_parallel)
+		return VB2_ERROR_EX_RUN_PARALLEL_UNIMPLEMENTED;
+
+	/* Run it at vb2ex_wait(), to catch anything done in between */
+	mock_parallel_fn = fn;
+	mock_parallel_arg = arg;
+	return VB2_SUCCESS;
+}
+
+int vb2ex_wait(void)
+{
+	int rv = mock_parallel_fn(mock_parallel_arg);
+
+	mock_parallel_fn = NULL;
+	mock_parallel_waits++;
+	return rv;
+}
+
+VbError_t ec_sync_all(struct vb2_context *ctx)
+{
+	ec_sync_rkp_calls = rkp_calls;
+	ec_sync_rkr_calls = rkr_calls;
+	return ec_sync_retval;
+}
+
+VbError_t VbExDiskGetInfo(VbDiskInfo **infos_ptr, uint32_t *count,
+			  uint32_t disk_flags)
+{
+	mock_get_info_calls++;
+	mock_get_info_flags = disk_flags;
+	*infos_ptr = mock_disks;
+	*count = mock_disk_count;
+	return VBERROR_SUCCESS;
+}
+
+VbError_t VbExDiskFreeInfo(VbDiskInfo *infos,
+			   VbExDiskHandle_t preserve_handle)
+{
+	mock_free_info_calls++;
+	return VBERROR_SUCCESS;
+}
+
+int LoadKernelPrefetchGpt(LoadKernelParams *params)
+{
+	mock_prefetch_calls++;
+	mock_prefetch_handle = params->disk_handle;
+	return 0;
+}
+
 uint32_t VbTryLoadKernel(struct vb2_context *ctx, uint32_t get_info_flags)
 {
 	shared->kernel_version_tpm = new_version;
 
+	/* Change a setting, then maybe change it back */
+	if (mock_loc_toggle) {
+		vb2_nv_set(ctx, VB2_NV_LOCALIZATION_INDEX, 1);
+		if (mock_loc_toggle > 1)
+			vb2_nv_set(ctx, VB2_NV_LOCALIZATION_INDEX, 0);
+	}
+
 	if (vbboot_retval == -1)
 		return VBERROR_SIMULATED;
 
@@ -158,6 +263,18 @@ static void VbSlkTest(void)
 	ResetMocks();
 	test_slk(0, 0, "Normal");
 	TEST_EQ(rkr_version, 0x10002, "  version");
+	TEST_EQ(nv_write_calls, 0, "  NV not written");
+
+	ResetMocks();
+	mock_loc_toggle = 1;
+	test_slk(0, 0, "NV change");
+	TEST_EQ(nv_write_calls, 1, "  NV written once");
+	TEST_EQ(vb2_nv_get(&ctx, VB2_NV_LOCALIZATION_INDEX), 1, "  saved");
+
+	ResetMocks();
+	mock_loc_toggle = 2;
+	test_slk(0, 0, "NV changed back");
+	TEST_EQ(nv_write_calls, 0, "  NV not written");
 
 	/*
 	 * If shared->flags doesn't ask for software sync, we won't notice
@@ -264,9 +381,89 @@ static void VbSlkTest(void)
 
 }
 
+static void VbSlkPrefetchTest(void)
+{
+	/* The TPM and disk reads go to another CPU during EC sync */
+	ResetMocks();
+	kparams.inflags = VB_SALK_INFLAGS_PREFETCH_DURING_EC_SYNC;
+	mock_parallel = 1;
+	mock_disks[0].bytes_per_lba = 4096;
+	test_slk(0, 0, "Prefetch during EC sync");
+	TEST_EQ(ec_sync_rkp_calls, 0, "  TPM reads not queued before EC sync");
+	TEST_EQ(ec_sync_rkr_calls, 0, "  or consumed");
+	TEST_EQ(mock_parallel_waits, 1, "  waited for prefetch");
+	TEST_EQ(rkp_calls, 1, "  TPM reads queued");
+	TEST_EQ(rkr_calls, 1, "  and consumed");
+	TEST_EQ(rkr_version, 0x10002, "  version");
+	TEST_EQ(mock_get_info_calls, 1, "  found disks");
+	TEST_EQ(mock_get_info_flags, VB_DISK_FLAG_FIXED, "  fixed ones");
+	TEST_EQ(mock_prefetch_calls, 1, "  read one GPT");
+	TEST_PTR_EQ(mock_prefetch_handle, mock_disks[1].handle,
+		    "  of the first usable disk");
+	TEST_EQ(mock_free_info_calls, 1, "  unused disks freed");
+
+	ResetMocks();
+	kparams.inflags = VB_SALK_INFLAGS_PREFETCH_DURING_EC_SYNC;
+	mock_parallel = 1;
+	mock_disk_count = 0;
+	test_slk(0, 0, "Prefetch with no disks");
+	TEST_EQ(mock_prefetch_calls, 0, "  no GPT read");
+
+	ResetMocks();
+	kparams.inflags = VB_SALK_INFLAGS_PREFETCH_DURING_EC_SYNC;
+	mock_parallel = 1;
+	rkr_retval = 123;
+	test_slk(VBERROR_TPM_READ_KERNEL,
+		 VB2_RECOVERY_RW_TPM_R_ERROR, "Prefetched kernel rollback bad");
+
+	ResetMocks();
+	kparams.inflags = VB_SALK_INFLAGS_PREFETCH_DURING_EC_SYNC;
+	mock_parallel = 1;
+	rfr_retval = 123;
+	test_slk(VBERROR_TPM_READ_FWMP,
+		 VB2_RECOVERY_RW_TPM_R_ERROR, "Prefetched FWMP bad");
+
+	/* An EC sync error wins, but the prefetch is still finished */
+	ResetMocks();
+	kparams.inflags = VB_SALK_INFLAGS_PREFETCH_DURING_EC_SYNC;
+	mock_parallel = 1;
+	rkr_retval = 123;
+	ec_sync_retval = VBERROR_EC_REBOOT_TO_RO_REQUIRED;
+	test_slk(VBERROR_EC_REBOOT_TO_RO_REQUIRED,
+		 VB2_RECOVERY_RW_TPM_R_ERROR, "Prefetch with EC sync error");
+	TEST_EQ(mock_parallel_waits, 1, "  waited for prefetch");
+	TEST_EQ(mock_free_info_calls, 1, "  disks freed");
+
+	/* Without another CPU, the reads are done before EC sync as usual */
+	ResetMocks();
+	kparams.inflags = VB_SALK_INFLAGS_PREFETCH_DURING_EC_SYNC;
+	test_slk(0, 0, "Prefetch unimplemented");
+	TEST_EQ(ec_sync_rkr_calls, 1, "  TPM read before EC sync");
+	TEST_EQ(mock_parallel_waits, 0, "  nothing to wait for");
+	TEST_EQ(mock_get_info_calls, 0, "  disks left to VbTryLoadKernel()");
+
+	/* Nor without the flag */
+	ResetMocks();
+	mock_parallel = 1;
+	test_slk(0, 0, "Prefetch not asked for");
+	TEST_EQ(ec_sync_rkr_calls, 1, "  TPM read before EC sync");
+	TEST_EQ(mock_parallel_waits, 0, "  nothing to wait for");
+
+	/* Recovery mode has no EC sync to hide behind */
+	ResetMocks();
+	kparams.inflags = VB_SALK_INFLAGS_PREFETCH_DURING_EC_SYNC;
+	mock_parallel = 1;
+	shared->recovery_reason = 123;
+	test_slk(0, 0, "No prefetch in recovery");
+	TEST_EQ(ec_sync_rkr_calls, -1, "  no EC sync");
+	TEST_EQ(rkr_calls, 1, "  TPM read");
+	TEST_EQ(mock_parallel_waits, 0, "  nothing to wait for");
+}
+
 int main(void)
 {
 	VbSlkTest();
+	VbSlkPrefetchTest();
 
 	return gTestSuccess ? 0 : 255;
 }
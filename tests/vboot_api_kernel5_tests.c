@@ -16,6 +16,7 @@
 #include "2misc.h"
 #include "2nvstorage.h"
 #include "2rsa.h"
+#include "2sha.h"
 #include "gbb_header.h"
 #include "host_common.h"
 #include "load_kernel_fw.h"
@@ -38,8 +39,11 @@ static uint8_t gbb_buf[4096];
 static GoogleBinaryBlockHeader *gbb = (GoogleBinaryBlockHeader *)gbb_buf;
 
 static uint8_t kernel_buffer[80000];
+static uint8_t recv_buffer[80000];
 static int key_block_verify_fail;  /* 0=ok, 1=sig, 2=hash */
+static int key_block_verify_calls;
 static int preamble_verify_fail;
+static int preamble_verify_calls;
 static int verify_data_fail;
 static int unpack_key_fail;
 
@@ -81,7 +85,9 @@ static void ResetMocks(void)
 	VbSharedDataInit(shared, sizeof(shared_data));
 
 	key_block_verify_fail = 0;
+	key_block_verify_calls = 0;
 	preamble_verify_fail = 0;
+	preamble_verify_calls = 0;
 	verify_data_fail = 0;
 
 	memset(&kbh, 0, sizeof(kbh));
@@ -98,6 +104,7 @@ static void ResetMocks(void)
 
 	memcpy(kernel_buffer, &kbh, sizeof(kbh));
 	memcpy((kernel_buffer + kbh.key_block_size), &kph, sizeof(kph));
+	memset(recv_buffer, 0, sizeof(recv_buffer));
 
 	hash_only_check = -1;
 }
@@ -115,6 +122,7 @@ int vb2_unpack_key_buffer(struct vb2_public_key *key,
 	if (--unpack_key_fail == 0)
 		return VB2_ERROR_MOCK;
 
+	key->hash_alg = VB2_HASH_SHA256;
 	return VB2_SUCCESS;
 }
 
@@ -124,6 +132,7 @@ int vb2_verify_keyblock(struct vb2_keyblock *block,
 			const struct vb2_workbuf *wb)
 {
 	hash_only_check = 0;
+	key_block_verify_calls++;
 
 	if (key_block_verify_fail)
 		return VB2_ERROR_MOCK;
@@ -138,6 +147,7 @@ int vb2_verify_keyblock_hash(const struct vb2_keyblock *block,
 			     const struct vb2_workbuf *wb)
 {
 	hash_only_check = 1;
+	key_block_verify_calls++;
 
 	if (key_block_verify_fail)
 		return VB2_ERROR_MOCK;
@@ -152,6 +162,8 @@ int vb2_verify_kernel_preamble(struct vb2_kernel_preamble *preamble,
 			       const struct vb2_public_key *key,
 			       const struct vb2_workbuf *wb)
 {
+	preamble_verify_calls++;
+
 	if (preamble_verify_fail)
 		return VB2_ERROR_MOCK;
 
@@ -160,15 +172,23 @@ int vb2_verify_kernel_preamble(struct vb2_kernel_preamble *preamble,
 	return VB2_SUCCESS;
 }
 
-int vb2_verify_data(const uint8_t *data,
-		    uint32_t size,
-		    struct vb2_signature *sig,
-		    const struct vb2_public_key *key,
-		    const struct vb2_workbuf *wb)
+int vb2_verify_digest(const struct vb2_public_key *key,
+		      struct vb2_signature *sig,
+		      const uint8_t *digest,
+		      const struct vb2_workbuf *wb)
 {
+	uint8_t expect[VB2_SHA256_DIGEST_SIZE];
+	uint32_t body_offset = kbh.key_block_size + kph.preamble_size;
+
 	if (verify_data_fail)
 		return VB2_ERROR_MOCK;
 
+	/* The body must be hashed the same however it arrives */
+	vb2_digest_buffer(kernel_buffer + body_offset, sig->data_size,
+			  VB2_HASH_SHA256, expect, sizeof(expect));
+	if (memcmp(digest, expect, sizeof(expect)))
+		return VB2_ERROR_MOCK;
+
 	return VB2_SUCCESS;
 }
 
@@ -313,9 +333,168 @@ static void VerifyMemoryBootImageTest(void)
 		VBERROR_INVALID_KERNEL_FOUND, "Data verification");
 }
 
+/* Feed an image into recv_buffer in pieces; returns the last result */
+static VbError_t FeedInPieces(const uint8_t *image, size_t size,
+			      size_t piece)
+{
+	VbError_t rv = VBERROR_SUCCESS;
+	size_t done;
+
+	for (done = 0; done < size; done += piece) {
+		if (piece > size - done)
+			piece = size - done;
+		rv = VbVerifyMemoryBootImageFeed(image + done, piece);
+		if (rv)
+			break;
+	}
+	return rv;
+}
+
+static void VerifyMemoryBootImageStreamTest(void)
+{
+	size_t size = sizeof(kernel_buffer);
+	uint32_t body_offset;
+
+	/* The vblock is verified as soon as it arrives */
+	ResetMocks();
+	body_offset = kbh.key_block_size + kph.preamble_size;
+	TEST_SUCC(VbVerifyMemoryBootImageBegin(&cparams, &kparams,
+					       recv_buffer, size),
+		  "Stream begin");
+	TEST_SUCC(VbVerifyMemoryBootImageFeed(kernel_buffer, 16),
+		  "  part of key block");
+	TEST_EQ(key_block_verify_calls, 0, "  key block not verified yet");
+	TEST_SUCC(VbVerifyMemoryBootImageFeed(kernel_buffer + 16, 1024 - 16),
+		  "  rest of key block");
+	TEST_EQ(key_block_verify_calls, 1, "  key block verified");
+	TEST_EQ(preamble_verify_calls, 0, "  preamble not verified yet");
+	TEST_SUCC(VbVerifyMemoryBootImageFeed(kernel_buffer + 1024,
+					      body_offset - 1024),
+		  "  rest of preamble");
+	TEST_EQ(preamble_verify_calls, 1, "  preamble verified");
+	TEST_SUCC(FeedInPieces(kernel_buffer + body_offset, size - body_offset,
+			       1000), "  body");
+	TEST_SUCC(VbVerifyMemoryBootImageFinish(), "  finish");
+	TEST_EQ(key_block_verify_calls, 1, "  key block verified once");
+	TEST_EQ(preamble_verify_calls, 1, "  preamble verified once");
+	TEST_PTR_EQ(kparams.kernel_buffer, recv_buffer + body_offset,
+		    "  kernel buffer");
+	TEST_EQ(kparams.kernel_buffer_size, size - body_offset,
+		"  kernel buffer size");
+	TEST_EQ(kparams.bootloader_address, 0xbeadd008, "  bootloader addr");
+	TEST_EQ(hash_only_check, 0, "  signature check");
+
+	/* Data already in the image buffer isn't copied */
+	ResetMocks();
+	memcpy(recv_buffer, kernel_buffer, size);
+	TEST_SUCC(VbVerifyMemoryBootImageBegin(&cparams, &kparams,
+					       recv_buffer, size),
+		  "Stream in place");
+	TEST_SUCC(FeedInPieces(recv_buffer, size, 4096), "  feed");
+	TEST_SUCC(VbVerifyMemoryBootImageFinish(), "  finish");
+
+	/* Integrity check only */
+	ResetMocks();
+	shared->flags = VBSD_BOOT_DEV_SWITCH_ON;
+	gbb->flags = GBB_FLAG_FORCE_DEV_BOOT_FASTBOOT_FULL_CAP;
+	TEST_SUCC(VbVerifyMemoryBootImageBegin(&cparams, &kparams,
+					       recv_buffer, size),
+		  "Stream hash only");
+	TEST_SUCC(FeedInPieces(kernel_buffer, size, 512), "  feed");
+	TEST_SUCC(VbVerifyMemoryBootImageFinish(), "  finish");
+	TEST_EQ(hash_only_check, 1, "  hash check");
+
+	/* A bad key block is reported before the rest of the image arrives */
+	ResetMocks();
+	key_block_verify_fail = 1;
+	VbVerifyMemoryBootImageBegin(&cparams, &kparams, recv_buffer, size);
+	TEST_EQ(VbVerifyMemoryBootImageFeed(kernel_buffer, 1024),
+		VBERROR_INVALID_KERNEL_FOUND, "Stream bad key block");
+	TEST_EQ(VbVerifyMemoryBootImageFeed(kernel_buffer + 1024, 1024),
+		VBERROR_INVALID_KERNEL_FOUND, "  still bad");
+	TEST_EQ(VbVerifyMemoryBootImageFinish(),
+		VBERROR_INVALID_KERNEL_FOUND, "  finish");
+	TEST_EQ(preamble_verify_calls, 0, "  preamble not verified");
+
+	/* So is a key block which can't fit in the image */
+	ResetMocks();
+	kbh.key_block_size = size + 1;
+	copy_kbh();
+	VbVerifyMemoryBootImageBegin(&cparams, &kparams, recv_buffer, size);
+	TEST_EQ(VbVerifyMemoryBootImageFeed(kernel_buffer, 1024),
+		VBERROR_INVALID_KERNEL_FOUND, "Stream huge key block");
+	TEST_EQ(key_block_verify_calls, 0, "  key block not verified");
+	TEST_EQ(VbVerifyMemoryBootImageFinish(),
+		VBERROR_INVALID_KERNEL_FOUND, "  finish");
+
+	/* And a bad preamble */
+	ResetMocks();
+	preamble_verify_fail = 1;
+	VbVerifyMemoryBootImageBegin(&cparams, &kparams, recv_buffer, size);
+	TEST_EQ(FeedInPieces(kernel_buffer, size, 4096),
+		VBERROR_INVALID_KERNEL_FOUND, "Stream bad preamble");
+	TEST_EQ(VbVerifyMemoryBootImageFinish(),
+		VBERROR_INVALID_KERNEL_FOUND, "  finish");
+
+	/* A body which changed on the way is caught at the end */
+	ResetMocks();
+	body_offset = kbh.key_block_size + kph.preamble_size;
+	memcpy(recv_buffer, kernel_buffer, size);
+	recv_buffer[body_offset + 5000] ^= 0x01;
+	VbVerifyMemoryBootImageBegin(&cparams, &kparams, recv_buffer, size);
+	TEST_SUCC(FeedInPieces(recv_buffer, size, 3000), "Stream bad body");
+	TEST_EQ(VbVerifyMemoryBootImageFinish(),
+		VBERROR_INVALID_KERNEL_FOUND, "  finish");
+	TEST_PTR_EQ(kparams.kernel_buffer, NULL, "  no kernel buffer");
+
+	/* Body signature failure */
+	ResetMocks();
+	verify_data_fail = 1;
+	VbVerifyMemoryBootImageBegin(&cparams, &kparams, recv_buffer, size);
+	TEST_SUCC(FeedInPieces(kernel_buffer, size, 4096), "Stream bad sig");
+	TEST_EQ(VbVerifyMemoryBootImageFinish(),
+		VBERROR_INVALID_KERNEL_FOUND, "  finish");
+
+	/* Signed data bigger than the image is caught with the preamble */
+	ResetMocks();
+	kph.body_signature.data_size = size;
+	VbVerifyMemoryBootImageBegin(&cparams, &kparams, recv_buffer, size);
+	TEST_EQ(FeedInPieces(kernel_buffer, size, 4096),
+		VBERROR_INVALID_KERNEL_FOUND, "Stream body too big");
+	VbVerifyMemoryBootImageFinish();
+
+	/* Not enough or too much of the image */
+	ResetMocks();
+	VbVerifyMemoryBootImageBegin(&cparams, &kparams, recv_buffer, size);
+	TEST_SUCC(FeedInPieces(kernel_buffer, size - 1, 4096),
+		  "Stream short image");
+	TEST_EQ(VbVerifyMemoryBootImageFinish(), VBERROR_INVALID_PARAMETER,
+		"  finish");
+
+	ResetMocks();
+	VbVerifyMemoryBootImageBegin(&cparams, &kparams, recv_buffer,
+				     size - 1);
+	TEST_EQ(VbVerifyMemoryBootImageFeed(kernel_buffer, size),
+		VBERROR_INVALID_PARAMETER, "Stream too much");
+	TEST_EQ(VbVerifyMemoryBootImageFinish(), VBERROR_INVALID_PARAMETER,
+		"  finish");
+
+	/* Calls out of order */
+	ResetMocks();
+	TEST_EQ(VbVerifyMemoryBootImageFeed(kernel_buffer, 16),
+		VBERROR_INVALID_PARAMETER, "Stream feed without begin");
+	TEST_EQ(VbVerifyMemoryBootImageFinish(), VBERROR_INVALID_PARAMETER,
+		"Stream finish without begin");
+	TEST_EQ(VbVerifyMemoryBootImageBegin(&cparams, &kparams, NULL, size),
+		VBERROR_INVALID_PARAMETER, "Stream empty image");
+	TEST_EQ(VbVerifyMemoryBootImageFinish(), VBERROR_INVALID_PARAMETER,
+		"  nothing to finish");
+}
+
 int main(void)
 {
 	VerifyMemoryBootImageTest();
+	VerifyMemoryBootImageStreamTest();
 
 	return gTestSuccess ? 0 : 255;
 }
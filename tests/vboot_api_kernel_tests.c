@@ -31,6 +31,7 @@ typedef struct {
 	uint64_t lba_count;
 	uint32_t flags;
 	const char *diskname;
+	uint32_t rank;
 } disk_desc_t;
 
 typedef struct {
@@ -137,6 +138,41 @@ test_case_t test[] = {
 		.expected_to_load_disk = pickme,
 		.expected_return_val = VBERROR_SUCCESS
 	},
+	{
+		.name = "best ranked drive first",
+		.want_flags = VB_DISK_FLAG_REMOVABLE,
+		.disks_to_provide = {
+			{512,  100,  VB_DISK_FLAG_REMOVABLE, "lower", 0x21},
+			{512,  100,  VB_DISK_FLAG_REMOVABLE, pickme, 0x1f1},
+			/* no kernels */
+			{512,  100,  VB_DISK_FLAG_REMOVABLE, "empty", 0},
+		},
+		.disk_count_to_return = DEFAULT_COUNT,
+		.diskgetinfo_return_val = VBERROR_SUCCESS,
+		.loadkernel_return_val = {0, 1, 1, 1, 1, 1, 1, 1, 1, 1,},
+
+		.expected_recovery_request_val = VB2_RECOVERY_NOT_REQUESTED,
+		.expected_to_find_disk = pickme,
+		.expected_to_load_disk = pickme,
+		.expected_return_val = VBERROR_SUCCESS
+	},
+	{
+		.name = "fall back to lower ranked drive",
+		.want_flags = VB_DISK_FLAG_FIXED,
+		.disks_to_provide = {
+			{512,  100,  VB_DISK_FLAG_FIXED, "empty", 0},
+			{512,  100,  VB_DISK_FLAG_FIXED, pickme, 0x21},
+			{512,  100,  VB_DISK_FLAG_FIXED, "bad", 0x31},
+		},
+		.disk_count_to_return = DEFAULT_COUNT,
+		.diskgetinfo_return_val = VBERROR_SUCCESS,
+		.loadkernel_return_val = {1, 0, 1, 1, 1, 1, 1, 1, 1, 1,},
+
+		.expected_recovery_request_val = VB2_RECOVERY_NOT_REQUESTED,
+		.expected_to_find_disk = pickme,
+		.expected_to_load_disk = pickme,
+		.expected_return_val = VBERROR_SUCCESS
+	},
 	{
 		.name = "no drives at all",
 		.want_flags = VB_DISK_FLAG_FIXED,
@@ -191,6 +227,7 @@ static const char *got_find_disk;
 static const char *got_load_disk;
 static uint32_t got_return_val;
 static uint32_t got_external_mismatch;
+static uint32_t mock_generation;
 static struct vb2_context ctx;
 
 /**
@@ -213,6 +250,18 @@ static void ResetMocks(int i)
 	t = test + i;
 }
 
+/* Find the test case with a given name */
+static int FindTest(const char *name)
+{
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(test); i++) {
+		if (!strcmp(test[i].name, name))
+			return i;
+	}
+	return 0;
+}
+
 int is_nonzero(const void *vptr, size_t count)
 {
 	const char *p = (const char *)vptr;
@@ -274,6 +323,11 @@ VbError_t VbExDiskGetInfo(VbDiskInfo **infos_ptr, uint32_t *count,
 	return t->diskgetinfo_return_val;
 }
 
+uint32_t VbExDiskGetGeneration(VbExDiskHandle_t handle)
+{
+	return mock_generation;
+}
+
 VbError_t VbExDiskFreeInfo(VbDiskInfo *infos,
                            VbExDiskHandle_t preserve_handle)
 {
@@ -295,6 +349,18 @@ VbError_t LoadKernel(struct vb2_context *ctx, LoadKernelParams *params)
 	return t->loadkernel_return_val[load_kernel_calls++];
 }
 
+uint32_t LoadKernelRank(LoadKernelParams *params)
+{
+	int i;
+
+	for (i = 0; i < MAX_TEST_DISKS; i++) {
+		if (t->disks_to_provide[i].diskname ==
+		    (const char *)params->disk_handle)
+			return t->disks_to_provide[i].rank;
+	}
+	return 0;
+}
+
 void vb2_nv_set(struct vb2_context *ctx,
 		enum vb2_nv_param param,
 		uint32_t value)
@@ -328,9 +394,47 @@ static void VbTryLoadKernelTest(void)
 	}
 }
 
+static void VbFailedDiskTest(void)
+{
+	int bad = FindTest("no valid drives");
+
+	printf("Testing disks which already failed...\n");
+
+	mock_generation = 1;
+	ResetMocks(bad);
+	TEST_EQ(VbTryLoadKernel(&ctx, VB_DISK_FLAG_FIXED), 1, "First try");
+	TEST_EQ(load_kernel_calls, 2, "  both disks tried");
+
+	ResetMocks(bad);
+	TEST_EQ(VbTryLoadKernel(&ctx, VB_DISK_FLAG_FIXED), 1, "Unchanged");
+	TEST_EQ(load_kernel_calls, 0, "  disks skipped");
+	TEST_EQ(got_recovery_request_val, VB2_RECOVERY_RW_NO_KERNEL,
+		"  recovery_request");
+	TEST_PTR_EQ(got_load_disk, 0, "  load disk");
+
+	mock_generation = 2;
+	ResetMocks(bad);
+	TEST_EQ(VbTryLoadKernel(&ctx, VB_DISK_FLAG_FIXED), 1, "Changed");
+	TEST_EQ(load_kernel_calls, 2, "  both disks tried again");
+
+	mock_generation = 3;
+	ResetMocks(FindTest("second removable drive"));
+	TEST_EQ(VbTryLoadKernel(&ctx, VB_DISK_FLAG_REMOVABLE), 0,
+		"Boot from good disk");
+	ResetMocks(FindTest("second removable drive"));
+	t->loadkernel_return_val[0] = 0;
+	TEST_EQ(VbTryLoadKernel(&ctx, VB_DISK_FLAG_REMOVABLE), 0,
+		"Good disk still tried");
+	TEST_PTR_EQ(got_load_disk, pickme, "  load disk");
+	t->loadkernel_return_val[0] = 1;
+
+	mock_generation = 0;
+}
+
 int main(void)
 {
 	VbTryLoadKernelTest();
+	VbFailedDiskTest();
 
 	return gTestSuccess ? 0 : 255;
 }
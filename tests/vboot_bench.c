@@ -0,0 +1,1059 @@
+/* Copyright 2018 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ *
+ * Benchmarks for the hashing, signature, CRC, GPT, NV storage and
+ * verification APIs, in one binary with comparable output.
+ */
+
+#include <fnmatch.h>
+#include <getopt.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "2sysincludes.h"
+#include "2api.h"
+#include "2common.h"
+#include "2crc8.h"
+#include "2misc.h"
+#include "2nvstorage.h"
+#include "2rsa.h"
+#include "2sha.h"
+#include "bdb.h"
+#include "cgptlib.h"
+#include "cgptlib_internal.h"
+#include "crc32.h"
+#include "gpt.h"
+#include "host.h"
+#include "host_common.h"
+#include "host_fw_preamble2.h"
+#include "host_key.h"
+#include "host_key2.h"
+#include "host_keyblock.h"
+#include "host_keyblock2.h"
+#include "host_signature.h"
+#include "host_signature2.h"
+#include "timer_utils.h"
+#include "vb2_common.h"
+#include "vb21_common.h"
+
+/* Time each case for at least this long by default */
+#define DEFAULT_TIME_MSECS 200
+
+/* Each sample runs enough operations to take at least this long */
+#define MIN_SAMPLE_NSECS 20000
+
+#define MIN_SAMPLES 5
+#define MAX_SAMPLES 1000
+
+/* Fail a baseline comparison when a case slows down by more than this */
+#define DEFAULT_THRESHOLD_PERCENT 10
+
+#define MAX_CASES 128
+#define MAX_FILTERS 32
+#define MAX_NAME 64
+
+/* Operation under test; iter counts up so ops can vary their input */
+typedef int (*bench_op)(void *arg, uint32_t iter);
+
+struct bench_case {
+	char name[MAX_NAME];
+	bench_op op;
+	void *arg;
+	/* Bytes each operation processes, or 0 if throughput is meaningless */
+	uint64_t bytes;
+};
+
+struct bench_suite {
+	const char *name;
+	const char *desc;
+	/* Add the suite's cases with add_case(); returns non-zero if error */
+	int (*setup)(const char *keys_dir);
+};
+
+struct bench_result {
+	char name[MAX_NAME];
+	uint64_t ops;
+	double ns_min;
+	double ns_median;
+	double ns_p99;
+	double mbytes_per_sec;
+};
+
+static struct bench_case cases[MAX_CASES];
+static int num_cases;
+
+static const char *filters[MAX_FILTERS];
+static int num_filters;
+
+static uint8_t workbuf[VB2_KERNEL_WORKBUF_RECOMMENDED_SIZE]
+	__attribute__ ((aligned (VB2_WORKBUF_ALIGN)));
+
+/* Return non-zero if a filter selects [name], or a prefix of it ending at a
+ * path separator, so "hash" selects everything in the hash suite. */
+static int selected(const char *name)
+{
+	char prefix[MAX_NAME];
+	const char *p;
+	int i;
+
+	if (!num_filters)
+		return 1;
+
+	for (i = 0; i < num_filters; i++) {
+		if (!fnmatch(filters[i], name, 0))
+			return 1;
+		for (p = strchr(name, '/'); p; p = strchr(p + 1, '/')) {
+			snprintf(prefix, sizeof(prefix), "%.*s",
+				 (int)(p - name), name);
+			if (!fnmatch(filters[i], prefix, 0))
+				return 1;
+		}
+	}
+	return 0;
+}
+
+/* Return non-zero if a filter could select a case from [suite]. */
+static int suite_selected(const char *suite)
+{
+	char first[MAX_NAME];
+	int i;
+
+	if (!num_filters)
+		return 1;
+
+	for (i = 0; i < num_filters; i++) {
+		snprintf(first, sizeof(first), "%.*s",
+			 (int)strcspn(filters[i], "/"), filters[i]);
+		if (!fnmatch(first, suite, 0))
+			return 1;
+	}
+	return 0;
+}
+
+static int add_case(bench_op op, void *arg, uint64_t bytes,
+		    const char *fmt, ...)
+	__attribute__((format(printf, 4, 5)));
+
+static int add_case(bench_op op, void *arg, uint64_t bytes,
+		    const char *fmt, ...)
+{
+	struct bench_case *c;
+	va_list ap;
+
+	if (num_cases == MAX_CASES) {
+		fprintf(stderr, "Too many benchmark cases\n");
+		return 1;
+	}
+
+	c = &cases[num_cases++];
+	va_start(ap, fmt);
+	vsnprintf(c->name, sizeof(c->name), fmt, ap);
+	va_end(ap);
+	c->op = op;
+	c->arg = arg;
+	c->bytes = bytes;
+	return 0;
+}
+
+/****************************************************************************/
+/* Hashing */
+
+struct hash_arg {
+	enum vb2_hash_algorithm alg;
+	uint32_t size;
+};
+
+static uint8_t *hash_buffer;
+
+static int op_digest(void *arg, uint32_t iter)
+{
+	const struct hash_arg *a = arg;
+	uint8_t digest[VB2_MAX_DIGEST_SIZE];
+
+	return vb2_digest_buffer(hash_buffer, a->size, a->alg,
+				 digest, sizeof(digest));
+}
+
+static int setup_hash(const char *keys_dir)
+{
+	static const enum vb2_hash_algorithm algs[] = {
+		VB2_HASH_SHA1, VB2_HASH_SHA256, VB2_HASH_SHA512,
+	};
+	static const uint32_t sizes[] = {64, 4096, 65536, 1048576};
+	static struct hash_arg args[ARRAY_SIZE(algs) * ARRAY_SIZE(sizes)];
+	struct hash_arg *a = args;
+	int i, j;
+
+	hash_buffer = malloc(sizes[ARRAY_SIZE(sizes) - 1]);
+	if (!hash_buffer)
+		return 1;
+	for (i = 0; i < sizes[ARRAY_SIZE(sizes) - 1]; i++)
+		hash_buffer[i] = i * 13;
+
+	for (i = 0; i < ARRAY_SIZE(algs); i++) {
+		for (j = 0; j < ARRAY_SIZE(sizes); j++, a++) {
+			a->alg = algs[i];
+			a->size = sizes[j];
+			if (add_case(op_digest, a, a->size, "hash/%s/%u",
+				     vb2_get_hash_algorithm_name(a->alg),
+				     a->size))
+				return 1;
+		}
+	}
+	return 0;
+}
+
+/****************************************************************************/
+/* RSA */
+
+/* Largest signature we time */
+#define MAX_SIG_SIZE (8192 / 8)
+
+static const uint8_t sign_data[] = "This is some test data to sign.";
+
+struct rsa_arg {
+	struct vb2_public_key key;
+	struct vb2_packed_key *packed_key;
+	struct vb2_signature *sig;
+	uint8_t digest[VB2_SHA256_DIGEST_SIZE];
+};
+
+static int op_rsa_verify(void *arg, uint32_t iter)
+{
+	struct rsa_arg *a = arg;
+	uint8_t sig_work[MAX_SIG_SIZE];
+	struct vb2_workbuf wb;
+
+	/* Verifying destroys the signature, so work on a copy */
+	memcpy(sig_work, vb2_signature_data(a->sig), a->sig->sig_size);
+	vb2_workbuf_init(&wb, workbuf, sizeof(workbuf));
+	return vb2_rsa_verify_digest(&a->key, sig_work, a->digest, &wb);
+}
+
+static int setup_rsa(const char *keys_dir)
+{
+	static const enum vb2_crypto_algorithm algs[] = {
+		VB2_ALG_RSA1024_SHA256,
+		VB2_ALG_RSA2048_SHA256,
+		VB2_ALG_RSA4096_SHA256,
+		VB2_ALG_RSA8192_SHA256,
+		VB2_ALG_RSA2048_EXP3_SHA256,
+		VB2_ALG_RSA3072_EXP3_SHA256,
+	};
+	static struct rsa_arg args[ARRAY_SIZE(algs)];
+	struct vb2_private_key *private_key;
+	char filename[1024];
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(algs); i++) {
+		struct rsa_arg *a = &args[i];
+		const char *file = vb2_get_crypto_algorithm_file(algs[i]);
+
+		snprintf(filename, sizeof(filename), "%s/key_%s.pem",
+			 keys_dir, file);
+		private_key = vb2_read_private_key_pem(filename, algs[i]);
+		snprintf(filename, sizeof(filename), "%s/key_%s.keyb",
+			 keys_dir, file);
+		a->packed_key = vb2_read_packed_keyb(filename, algs[i], 1);
+
+		if (private_key)
+			a->sig = vb2_calculate_signature(sign_data,
+							 sizeof(sign_data),
+							 private_key);
+		vb2_free_private_key(private_key);
+
+		if (!a->sig || !a->packed_key ||
+		    vb2_unpack_key(&a->key, a->packed_key) ||
+		    vb2_digest_buffer(sign_data, sizeof(sign_data),
+				      VB2_HASH_SHA256, a->digest,
+				      sizeof(a->digest))) {
+			fprintf(stderr, "Can't use the %s key in %s\n",
+				file, keys_dir);
+			return 1;
+		}
+
+		if (add_case(op_rsa_verify, a, 0, "rsa/%s",
+			     vb2_get_sig_algorithm_name(a->key.sig_alg)))
+			return 1;
+	}
+	return 0;
+}
+
+/****************************************************************************/
+/* CRCs */
+
+#define CRC32_SIZE (MAX_NUMBER_OF_ENTRIES * sizeof(GptEntry))
+
+static uint8_t crc_buffer[CRC32_SIZE];
+
+static int op_crc32(void *arg, uint32_t iter)
+{
+	/* Use the result so the call can't be optimized away */
+	return Crc32(crc_buffer, (uintptr_t)arg) == 0x12345678 &&
+		iter == UINT32_MAX;
+}
+
+static int op_crc8(void *arg, uint32_t iter)
+{
+	return vb2_crc8(crc_buffer, (uintptr_t)arg) == 0x12 &&
+		iter == UINT32_MAX;
+}
+
+static int op_crc8_bitwise(void *arg, uint32_t iter)
+{
+	return vb2_crc8_bitwise(crc_buffer, (uintptr_t)arg) == 0x12 &&
+		iter == UINT32_MAX;
+}
+
+static int setup_crc(const char *keys_dir)
+{
+	int i;
+
+	for (i = 0; i < sizeof(crc_buffer); i++)
+		crc_buffer[i] = i * 7;
+
+	/* A GPT header, and a full set of GPT entries */
+	return add_case(op_crc32, (void *)(uintptr_t)sizeof(GptHeader),
+			sizeof(GptHeader), "crc/Crc32/%zu",
+			sizeof(GptHeader)) ||
+		add_case(op_crc32, (void *)(uintptr_t)CRC32_SIZE, CRC32_SIZE,
+			 "crc/Crc32/%zu", CRC32_SIZE) ||
+		/* NV storage, v1 and v2 */
+		add_case(op_crc8, (void *)(uintptr_t)15, 15,
+			 "crc/vb2_crc8/15") ||
+		add_case(op_crc8, (void *)(uintptr_t)63, 63,
+			 "crc/vb2_crc8/63") ||
+		/* The table-free version, whichever vb2_crc8() is */
+		add_case(op_crc8_bitwise, (void *)(uintptr_t)15, 15,
+			 "crc/vb2_crc8_bitwise/15") ||
+		add_case(op_crc8_bitwise, (void *)(uintptr_t)63, 63,
+			 "crc/vb2_crc8_bitwise/63");
+}
+
+/****************************************************************************/
+/* Constant-time compare */
+
+/* A digest and an RSA-4096 key's worth */
+#define MEMCMP_SIZE 512
+
+struct memcmp_arg {
+	size_t size;
+	/* Offset of the one differing byte, or size if they're equal */
+	size_t diff;
+	uint8_t a[MEMCMP_SIZE];
+	uint8_t b[MEMCMP_SIZE];
+};
+
+static struct memcmp_arg memcmp_args[6];
+
+static int op_memcmp(void *arg, uint32_t iter)
+{
+	struct memcmp_arg *m = arg;
+
+	return vb2_safe_memcmp(m->a, m->b, m->size) != (m->diff < m->size);
+}
+
+static int setup_memcmp(const char *keys_dir)
+{
+	static const char * const where[] = {"equal", "first", "last"};
+	int i;
+
+	/*
+	 * The time shouldn't depend on where the buffers differ, so the
+	 * "first" and "last" cases should match "equal".
+	 */
+	for (i = 0; i < ARRAY_SIZE(memcmp_args); i++) {
+		struct memcmp_arg *m = memcmp_args + i;
+
+		m->size = i < 3 ? 32 : MEMCMP_SIZE;
+		m->diff = i % 3 == 0 ? m->size : i % 3 == 1 ? 0 : m->size - 1;
+		memset(m->a, 0x5c, sizeof(m->a));
+		memset(m->b, 0x5c, sizeof(m->b));
+		if (m->diff < m->size)
+			m->b[m->diff] ^= 1;
+
+		if (add_case(op_memcmp, m, m->size,
+			     "memcmp/vb2_safe_memcmp/%zu/%s", m->size,
+			     where[i % 3]))
+			return 1;
+	}
+
+	return 0;
+}
+
+/****************************************************************************/
+/* GPT */
+
+#define GPT_SECTOR_SIZE 512
+#define GPT_DRIVE_SECTORS 16384
+#define GPT_PARTITION_SECTORS 64
+#define GPT_KERNELS 32
+
+static uint8_t gpt_primary_header[GPT_SECTOR_SIZE];
+static uint8_t gpt_secondary_header[GPT_SECTOR_SIZE];
+static uint8_t gpt_primary_entries[CRC32_SIZE];
+static uint8_t gpt_secondary_entries[CRC32_SIZE];
+static GptData gpt;
+
+/* Build a good GPT whose first GPT_KERNELS entries are ChromeOS kernels. */
+static void build_gpt(void)
+{
+	Guid chromeos_kernel = GPT_ENT_TYPE_CHROMEOS_KERNEL;
+	GptHeader *h1 = (GptHeader *)gpt_primary_header;
+	GptHeader *h2 = (GptHeader *)gpt_secondary_header;
+	GptEntry *e = (GptEntry *)gpt_primary_entries;
+	int i;
+
+	memset(&gpt, 0, sizeof(gpt));
+	gpt.primary_header = gpt_primary_header;
+	gpt.secondary_header = gpt_secondary_header;
+	gpt.primary_entries = gpt_primary_entries;
+	gpt.secondary_entries = gpt_secondary_entries;
+	gpt.sector_bytes = GPT_SECTOR_SIZE;
+	gpt.streaming_drive_sectors = gpt.gpt_drive_sectors =
+		GPT_DRIVE_SECTORS;
+
+	memset(h1, 0, sizeof(gpt_primary_header));
+	memcpy(h1->signature, GPT_HEADER_SIGNATURE, GPT_HEADER_SIGNATURE_SIZE);
+	h1->revision = GPT_HEADER_REVISION;
+	h1->size = sizeof(GptHeader);
+	h1->my_lba = 1;
+	h1->alternate_lba = GPT_DRIVE_SECTORS - 1;
+	h1->first_usable_lba = 34;
+	h1->last_usable_lba = GPT_DRIVE_SECTORS - 1 - 32 - 1;
+	h1->entries_lba = 2;
+	h1->number_of_entries = MAX_NUMBER_OF_ENTRIES;
+	h1->size_of_entry = sizeof(GptEntry);
+
+	memset(e, 0, sizeof(gpt_primary_entries));
+	for (i = 0; i < GPT_KERNELS; i++, e++) {
+		memcpy(&e->type, &chromeos_kernel, sizeof(chromeos_kernel));
+		memcpy(&e->unique, &i, sizeof(i));
+		e->starting_lba = 34 + i * GPT_PARTITION_SECTORS;
+		e->ending_lba = e->starting_lba + GPT_PARTITION_SECTORS - 1;
+		SetEntryPriority(e, 1 + i % 15);
+		SetEntryTries(e, 15);
+	}
+
+	h1->entries_crc32 = Crc32(gpt_primary_entries, CRC32_SIZE);
+	h1->header_crc32 = HeaderCrc(h1);
+
+	memcpy(h2, h1, sizeof(GptHeader));
+	memcpy(gpt_secondary_entries, gpt_primary_entries, CRC32_SIZE);
+	h2->my_lba = GPT_DRIVE_SECTORS - 1;
+	h2->alternate_lba = 1;
+	h2->entries_lba = GPT_DRIVE_SECTORS - 1 - 32;
+	h2->header_crc32 = HeaderCrc(h2);
+}
+
+static int op_gpt_init(void *arg, uint32_t iter)
+{
+	return GptInit(&gpt);
+}
+
+static int op_gpt_next_kernel(void *arg, uint32_t iter)
+{
+	uint64_t start, size;
+
+	gpt.current_kernel = CGPT_KERNEL_ENTRY_NOT_FOUND;
+	return GptNextKernelEntry(&gpt, &start, &size);
+}
+
+static int setup_gpt(const char *keys_dir)
+{
+	build_gpt();
+	if (GptInit(&gpt)) {
+		fprintf(stderr, "Bad benchmark GPT\n");
+		return 1;
+	}
+	return add_case(op_gpt_init, NULL, 0, "gpt/GptInit/%d", GPT_KERNELS) ||
+		add_case(op_gpt_next_kernel, NULL, 0,
+			 "gpt/GptNextKernelEntry/%d", GPT_KERNELS);
+}
+
+/****************************************************************************/
+/* NV storage */
+
+static struct vb2_context nv_ctx;
+
+static int op_nv_get(void *arg, uint32_t iter)
+{
+	return vb2_nv_get(&nv_ctx, VB2_NV_TRY_COUNT) > 15;
+}
+
+static int op_nv_set(void *arg, uint32_t iter)
+{
+	/* Alternate so that every call changes the data and its CRC */
+	vb2_nv_set(&nv_ctx, VB2_NV_TRY_COUNT, iter & 1);
+	return 0;
+}
+
+static int setup_nv(const char *keys_dir)
+{
+	static uint8_t nv_workbuf[VB2_WORKBUF_RECOMMENDED_SIZE]
+		__attribute__ ((aligned (VB2_WORKBUF_ALIGN)));
+
+	memset(&nv_ctx, 0, sizeof(nv_ctx));
+	nv_ctx.workbuf = nv_workbuf;
+	nv_ctx.workbuf_size = sizeof(nv_workbuf);
+	if (vb2_init_context(&nv_ctx))
+		return 1;
+	vb2_nv_init(&nv_ctx);
+
+	return add_case(op_nv_get, NULL, 0, "nv/vb2_nv_get") ||
+		add_case(op_nv_set, NULL, 0, "nv/vb2_nv_set");
+}
+
+/****************************************************************************/
+/* Firmware verification */
+
+/* A structure to verify, and a scratch copy, since verifying destroys it */
+struct verify_arg {
+	const void *data;
+	void *copy;
+	uint32_t size;
+	struct vb2_public_key key;
+	const struct vb2_public_key *key_ptr;
+	const uint8_t *bdbkey_digest;
+};
+
+static void *verify_copy(struct verify_arg *a)
+{
+	memcpy(a->copy, a->data, a->size);
+	return a->copy;
+}
+
+static int op_vb2_keyblock(void *arg, uint32_t iter)
+{
+	struct verify_arg *a = arg;
+	struct vb2_workbuf wb;
+
+	vb2_workbuf_init(&wb, workbuf, sizeof(workbuf));
+	return vb2_verify_keyblock(verify_copy(a), a->size, &a->key, &wb);
+}
+
+static int op_vb2_fw_preamble(void *arg, uint32_t iter)
+{
+	struct verify_arg *a = arg;
+	struct vb2_workbuf wb;
+
+	vb2_workbuf_init(&wb, workbuf, sizeof(workbuf));
+	return vb2_verify_fw_preamble(verify_copy(a), a->size, &a->key, &wb);
+}
+
+static int op_vb21_keyblock(void *arg, uint32_t iter)
+{
+	struct verify_arg *a = arg;
+	struct vb2_workbuf wb;
+
+	vb2_workbuf_init(&wb, workbuf, sizeof(workbuf));
+	return vb21_verify_keyblock(verify_copy(a), a->size, a->key_ptr, &wb);
+}
+
+static int op_vb21_fw_preamble(void *arg, uint32_t iter)
+{
+	struct verify_arg *a = arg;
+	struct vb2_workbuf wb;
+
+	vb2_workbuf_init(&wb, workbuf, sizeof(workbuf));
+	return vb21_verify_fw_preamble(verify_copy(a), a->size, a->key_ptr,
+				       &wb);
+}
+
+static int op_bdb_verify(void *arg, uint32_t iter)
+{
+	struct verify_arg *a = arg;
+
+	return bdb_verify(verify_copy(a), a->size, a->bdbkey_digest);
+}
+
+static int init_verify_arg(struct verify_arg *a, const void *data,
+			   uint32_t size)
+{
+	a->data = data;
+	a->size = size;
+	a->copy = malloc(size);
+	return !data || !a->copy;
+}
+
+/* Signing key is RSA4096; the data key it signs is RSA2048. */
+static int setup_vb2(const char *keys_dir)
+{
+	static struct verify_arg kb_arg, fw_arg;
+	struct vb2_private_key *root_private, *data_private;
+	struct vb2_packed_key *root_key, *data_key;
+	struct vb2_keyblock *kb = NULL;
+	struct vb2_fw_preamble *fw = NULL;
+	struct vb2_signature *body_sig = NULL;
+	char filename[1024];
+
+	snprintf(filename, sizeof(filename), "%s/key_rsa4096.pem", keys_dir);
+	root_private = vb2_read_private_key_pem(filename,
+						VB2_ALG_RSA4096_SHA256);
+	snprintf(filename, sizeof(filename), "%s/key_rsa4096.keyb", keys_dir);
+	root_key = vb2_read_packed_keyb(filename, VB2_ALG_RSA4096_SHA256, 1);
+	snprintf(filename, sizeof(filename), "%s/key_rsa2048.pem", keys_dir);
+	data_private = vb2_read_private_key_pem(filename,
+						VB2_ALG_RSA2048_SHA256);
+	snprintf(filename, sizeof(filename), "%s/key_rsa2048.keyb", keys_dir);
+	data_key = vb2_read_packed_keyb(filename, VB2_ALG_RSA2048_SHA256, 1);
+
+	if (root_private && root_key && data_private && data_key) {
+		kb = vb2_create_keyblock(data_key, root_private, 0x7);
+		body_sig = vb2_calculate_signature(sign_data,
+						   sizeof(sign_data),
+						   data_private);
+	}
+	if (body_sig)
+		fw = vb2_create_fw_preamble(1, data_key, body_sig,
+					    data_private, 0);
+
+	if (!kb || !fw ||
+	    init_verify_arg(&kb_arg, kb, kb->keyblock_size) ||
+	    init_verify_arg(&fw_arg, fw, fw->preamble_size) ||
+	    vb2_unpack_key(&kb_arg.key, root_key) ||
+	    vb2_unpack_key(&fw_arg.key, data_key)) {
+		fprintf(stderr, "Can't create vb2 structs from %s\n",
+			keys_dir);
+		return 1;
+	}
+
+	vb2_free_private_key(root_private);
+	vb2_free_private_key(data_private);
+	free(body_sig);
+
+	return add_case(op_vb2_keyblock, &kb_arg, 0,
+			"vb2/vb2_verify_keyblock") ||
+		add_case(op_vb2_fw_preamble, &fw_arg, 0,
+			 "vb2/vb2_verify_fw_preamble");
+}
+
+static int setup_vb21(const char *keys_dir)
+{
+	static struct verify_arg kb_arg, fw_arg;
+	struct vb2_public_key *root_key = NULL, *data_key = NULL;
+	struct vb2_private_key *root_private = NULL, *data_private = NULL;
+	const struct vb2_private_key *hash_private;
+	struct vb21_signature *hash = NULL;
+	struct vb21_keyblock *kb = NULL;
+	struct vb21_fw_preamble *fw = NULL;
+	char filename[1024];
+
+	snprintf(filename, sizeof(filename), "%s/key_rsa4096.keyb", keys_dir);
+	vb2_public_key_read_keyb(&root_key, filename);
+	snprintf(filename, sizeof(filename), "%s/key_rsa4096.pem", keys_dir);
+	vb2_private_key_read_pem(&root_private, filename);
+	snprintf(filename, sizeof(filename), "%s/key_rsa2048.keyb", keys_dir);
+	vb2_public_key_read_keyb(&data_key, filename);
+	snprintf(filename, sizeof(filename), "%s/key_rsa2048.pem", keys_dir);
+	vb2_private_key_read_pem(&data_private, filename);
+
+	if (root_key && root_private && data_key && data_private) {
+		const struct vb2_private_key *signers[] = {root_private};
+
+		root_key->hash_alg = root_private->hash_alg = VB2_HASH_SHA256;
+		root_private->sig_alg = VB2_SIG_RSA4096;
+		data_key->hash_alg = data_private->hash_alg = VB2_HASH_SHA256;
+		data_private->sig_alg = VB2_SIG_RSA2048;
+
+		vb21_keyblock_create(&kb, data_key, signers, 1, 0, NULL);
+		if (!vb2_private_key_hash(&hash_private, VB2_HASH_SHA256))
+			vb21_sign_data(&hash, sign_data, sizeof(sign_data),
+				       hash_private, "Hash");
+	}
+	if (hash)
+		vb21_fw_preamble_create(&fw, data_private,
+					(const struct vb21_signature **)&hash,
+					1, 1, 0, NULL);
+
+	if (!kb || !fw ||
+	    init_verify_arg(&kb_arg, kb, kb->c.total_size) ||
+	    init_verify_arg(&fw_arg, fw, fw->c.total_size)) {
+		fprintf(stderr, "Can't create vb21 structs from %s\n",
+			keys_dir);
+		return 1;
+	}
+	kb_arg.key_ptr = root_key;
+	fw_arg.key_ptr = data_key;
+
+	vb2_private_key_free(root_private);
+	vb2_private_key_free(data_private);
+	free(hash);
+
+	return add_case(op_vb21_keyblock, &kb_arg, 0,
+			"vb21/vb21_verify_keyblock") ||
+		add_case(op_vb21_fw_preamble, &fw_arg, 0,
+			 "vb21/vb21_verify_fw_preamble");
+}
+
+static int setup_bdb(const char *keys_dir)
+{
+	static uint8_t bdbkey_digest[BDB_SHA256_DIGEST_SIZE];
+	static struct verify_arg arg;
+	struct bdb_hash hash = {
+		.offset = 0x10000,
+		.size = 0x18000,
+		.partition = 1,
+		.type = BDB_DATA_AP_RW,
+		.load_address = 0x100000,
+	};
+	struct bdb_create_params p = {
+		.header_sig_description = "The header sig",
+		.data_sig_description = "The data sig",
+		.data_description = "Benchmark BDB data",
+		.data_version = 1,
+		.hash = &hash,
+		.num_hashes = 1,
+	};
+	struct bdb_header *h = NULL;
+	char filename[1024];
+
+	snprintf(filename, sizeof(filename), "%s/bdbkey.keyb", keys_dir);
+	p.bdbkey = bdb_create_key(filename, 100, "BDB key");
+	snprintf(filename, sizeof(filename), "%s/datakey.keyb", keys_dir);
+	p.datakey = bdb_create_key(filename, 200, "datakey");
+	snprintf(filename, sizeof(filename), "%s/bdbkey.pem", keys_dir);
+	p.private_bdbkey = read_pem(filename);
+	snprintf(filename, sizeof(filename), "%s/datakey.pem", keys_dir);
+	p.private_datakey = read_pem(filename);
+
+	if (p.bdbkey && p.datakey && p.private_bdbkey && p.private_datakey) {
+		vb2_digest_buffer((uint8_t *)p.bdbkey, p.bdbkey->struct_size,
+				  VB2_HASH_SHA256, bdbkey_digest,
+				  sizeof(bdbkey_digest));
+		h = bdb_create(&p);
+	}
+	if (!h || init_verify_arg(&arg, h, h->bdb_size)) {
+		fprintf(stderr, "Can't create a BDB from %s\n", keys_dir);
+		return 1;
+	}
+	arg.bdbkey_digest = bdbkey_digest;
+
+	return add_case(op_bdb_verify, &arg, 0, "bdb/bdb_verify");
+}
+
+static const struct bench_suite suites[] = {
+	{"hash", "vb2_digest_buffer() by algorithm and size", setup_hash},
+	{"rsa", "vb2_rsa_verify_digest() by algorithm", setup_rsa},
+	{"crc", "Crc32() and vb2_crc8()", setup_crc},
+	{"memcmp", "vb2_safe_memcmp() by size and first difference",
+	 setup_memcmp},
+	{"gpt", "GptInit() and GptNextKernelEntry()", setup_gpt},
+	{"nv", "vb2_nv_get() and vb2_nv_set()", setup_nv},
+	{"vb2", "vb2 keyblock and firmware preamble verification", setup_vb2},
+	{"vb21", "vb21 keyblock and firmware preamble verification",
+	 setup_vb21},
+	{"bdb", "bdb_verify()", setup_bdb},
+};
+
+/****************************************************************************/
+/* Measurement and reporting */
+
+static int run_case(const struct bench_case *c, uint64_t min_nsecs,
+		    struct bench_result *r)
+{
+	static uint64_t samples[MAX_SAMPLES];
+	TimerStatsState stats;
+	uint32_t batch = 1, count = 0, iter = 0, i;
+	uint64_t start, t;
+
+	/* Warm up, and make sure the operation works at all */
+	if (c->op(c->arg, iter++)) {
+		fprintf(stderr, "%s failed\n", c->name);
+		return 1;
+	}
+
+	/* Batch enough operations per sample for the clock to resolve */
+	for (;;) {
+		t = GetTimeNsecs();
+		for (i = 0; i < batch; i++)
+			c->op(c->arg, iter++);
+		t = GetTimeNsecs() - t;
+		if (t >= MIN_SAMPLE_NSECS || batch >= (1 << 24))
+			break;
+		batch *= 2;
+	}
+
+	start = GetTimeNsecs();
+	do {
+		t = GetTimeNsecs();
+		for (i = 0; i < batch; i++)
+			c->op(c->arg, iter++);
+		samples[count++] = GetTimeNsecs() - t;
+	} while (count < MAX_SAMPLES &&
+		 (count < MIN_SAMPLES || GetTimeNsecs() - start < min_nsecs));
+
+	ComputeTimerStats(samples, count, &stats);
+
+	memcpy(r->name, c->name, sizeof(r->name));
+	r->ops = (uint64_t)count * batch;
+	r->ns_min = (double)stats.min / batch;
+	r->ns_median = (double)stats.median / batch;
+	r->ns_p99 = (double)stats.p99 / batch;
+	r->mbytes_per_sec = c->bytes ? c->bytes * 1e3 / r->ns_median : 0;
+	return 0;
+}
+
+struct baseline {
+	struct bench_result *results;
+	int count;
+};
+
+/*
+ * Read the results of an earlier --json run. Each result is on a line of
+ * its own, so this only needs to pick the fields it compares out of each
+ * line.
+ */
+static int read_baseline(const char *filename, struct baseline *b)
+{
+	char line[512];
+	struct bench_result r;
+	const char *p;
+	FILE *fp;
+
+	fp = fopen(filename, "r");
+	if (!fp) {
+		fprintf(stderr, "Can't open baseline %s\n", filename);
+		return 1;
+	}
+
+	memset(b, 0, sizeof(*b));
+	while (fgets(line, sizeof(line), fp)) {
+		memset(&r, 0, sizeof(r));
+		p = strstr(line, "\"name\": \"");
+		if (!p || sscanf(p, "\"name\": \"%63[^\"]\"", r.name) != 1)
+			continue;
+		p = strstr(line, "\"ns_median\": ");
+		if (!p || sscanf(p, "\"ns_median\": %lf", &r.ns_median) != 1)
+			continue;
+
+		b->results = realloc(b->results,
+				     (b->count + 1) * sizeof(*b->results));
+		if (!b->results) {
+			fclose(fp);
+			return 1;
+		}
+		b->results[b->count++] = r;
+	}
+
+	fclose(fp);
+	if (!b->count) {
+		fprintf(stderr, "No results in baseline %s\n", filename);
+		return 1;
+	}
+	return 0;
+}
+
+static const struct bench_result *find_baseline(const struct baseline *b,
+						const char *name)
+{
+	int i;
+
+	for (i = 0; i < b->count; i++)
+		if (!strcmp(b->results[i].name, name))
+			return &b->results[i];
+	return NULL;
+}
+
+static void print_result(const struct bench_result *r,
+			 const struct bench_result *base, int json, int first)
+{
+	if (json) {
+		printf("%s    {\"name\": \"%s\", \"ops\": %" PRIu64 ", "
+		       "\"ns_min\": %.3f, \"ns_median\": %.3f, "
+		       "\"ns_p99\": %.3f", first ? "" : ",\n", r->name, r->ops, r->ns_min,
+		       r->ns_median, r->ns_p99);
+		if (r->mbytes_per_sec)
+			printf(", \"mbytes_per_sec\": %.3f",
+			       r->mbytes_per_sec);
+		if (base)
+			printf(", \"baseline_ns_median\": %.3f",
+			       base->ns_median);
+		printf("}");
+		return;
+	}
+
+	printf("%-40s %12.1f ns %12.1f min %12.1f p99", r->name,
+	       r->ns_median, r->ns_min, r->ns_p99);
+	if (r->mbytes_per_sec)
+		printf(" %10.1f MB/s", r->mbytes_per_sec);
+	if (base)
+		printf(" %+7.1f%%", (r->ns_median / base->ns_median - 1) * 100);
+	printf("\n");
+}
+
+static void print_help(const char *progname)
+{
+	int i;
+
+	printf("\nUsage: %s [OPTIONS] [FILTER ...]\n\n"
+	       "Run vboot benchmarks. Each FILTER is a shell pattern matched"
+	       " against\n"
+	       "case names such as \"hash/SHA256/4096\"; a pattern that"
+	       " matches a leading\n"
+	       "part of a name, such as \"hash\" or \"rsa/RSA2048*\", selects"
+	       " the cases under it.\n\n"
+	       "Options:\n"
+	       "  -l, --list             List the cases instead of running"
+	       " them\n"
+	       "  -j, --json             Print results as JSON\n"
+	       "  -b, --baseline FILE    Compare against the JSON results in"
+	       " FILE, and fail\n"
+	       "                           if a case is slower by more than"
+	       " the threshold\n"
+	       "  -t, --threshold PCT    Regression threshold (default %d%%)\n"
+	       "  -T, --time MSECS       Time each case at least this long"
+	       " (default %d)\n"
+	       "  -k, --keys DIR         Test keys (default tests/testkeys)\n"
+	       "\nSuites:\n",
+	       progname, DEFAULT_THRESHOLD_PERCENT, DEFAULT_TIME_MSECS);
+	for (i = 0; i < ARRAY_SIZE(suites); i++)
+		printf("  %-6s %s\n", suites[i].name, suites[i].desc);
+	printf("\n");
+}
+
+static const struct option long_opts[] = {
+	{"list",      0, 0, 'l'},
+	{"json",      0, 0, 'j'},
+	{"baseline",  1, 0, 'b'},
+	{"threshold", 1, 0, 't'},
+	{"time",      1, 0, 'T'},
+	{"keys",      1, 0, 'k'},
+	{"help",      0, 0, 'h'},
+	{NULL, 0, 0, 0}
+};
+
+int main(int argc, char *argv[])
+{
+	const char *keys_dir = "tests/testkeys";
+	const char *baseline_file = NULL;
+	struct baseline baseline = {NULL, 0};
+	const struct bench_result *base;
+	struct bench_result r;
+	double threshold = DEFAULT_THRESHOLD_PERCENT;
+	uint64_t min_nsecs = DEFAULT_TIME_MSECS * 1000000ULL;
+	int opt_list = 0, opt_json = 0;
+	int regressions = 0, failures = 0, printed = 0;
+	int errorcnt = 0;
+	int i;
+	char *e;
+
+	opterr = 0;
+	while ((i = getopt_long(argc, argv, ":ljb:t:T:k:h", long_opts,
+				NULL)) != -1) {
+		switch (i) {
+		case 'l':
+			opt_list = 1;
+			break;
+		case 'j':
+			opt_json = 1;
+			break;
+		case 'b':
+			baseline_file = optarg;
+			break;
+		case 't':
+			threshold = strtod(optarg, &e);
+			if (!*optarg || (e && *e) || threshold < 0) {
+				fprintf(stderr, "Invalid threshold\n");
+				errorcnt++;
+			}
+			break;
+		case 'T':
+			min_nsecs = strtoul(optarg, &e, 0) * 1000000ULL;
+			if (!*optarg || (e && *e)) {
+				fprintf(stderr, "Invalid time\n");
+				errorcnt++;
+			}
+			break;
+		case 'k':
+			keys_dir = optarg;
+			break;
+		case 'h':
+			print_help(argv[0]);
+			return 0;
+		case ':':
+			fprintf(stderr, "Missing argument to -%c\n", optopt);
+			errorcnt++;
+			break;
+		default:
+			fprintf(stderr, "Unrecognized option\n");
+			errorcnt++;
+			break;
+		}
+	}
+
+	for (i = optind; i < argc; i++) {
+		if (num_filters == MAX_FILTERS) {
+			fprintf(stderr, "Too many filters\n");
+			errorcnt++;
+			break;
+		}
+		filters[num_filters++] = argv[i];
+	}
+
+	if (errorcnt) {
+		print_help(argv[0]);
+		return 1;
+	}
+
+	if (baseline_file && read_baseline(baseline_file, &baseline))
+		return 1;
+
+	for (i = 0; i < ARRAY_SIZE(suites); i++) {
+		if (!suite_selected(suites[i].name))
+			continue;
+		if (suites[i].setup(keys_dir)) {
+			fprintf(stderr, "Can't set up the %s suite\n",
+				suites[i].name);
+			return 1;
+		}
+	}
+
+	if (opt_list) {
+		for (i = 0; i < num_cases; i++)
+			if (selected(cases[i].name))
+				printf("%s\n", cases[i].name);
+		return 0;
+	}
+
+	if (PinToCpu(-1))
+		fprintf(stderr, "# Unable to pin to a CPU; expect noise\n");
+
+	if (opt_json)
+		printf("{\n  \"benchmarks\": [\n");
+
+	for (i = 0; i < num_cases; i++) {
+		if (!selected(cases[i].name))
+			continue;
+		if (run_case(&cases[i], min_nsecs, &r)) {
+			failures++;
+			continue;
+		}
+		base = find_baseline(&baseline, r.name);
+		print_result(&r, base, opt_json, !printed);
+		printed++;
+		fflush(stdout);
+
+		if (base && r.ns_median > base->ns_median *
+		    (1 + threshold / 100)) {
+			fprintf(stderr, "REGRESSION: %s %.1f ns, baseline "
+				"%.1f ns (+%.1f%%)\n", r.name, r.ns_median,
+				base->ns_median,
+				(r.ns_median / base->ns_median - 1) * 100);
+			regressions++;
+		}
+	}
+
+	if (opt_json)
+		printf("%s  ]\n}\n", printed ? "\n" : "");
+
+	if (!printed && !failures)
+		fprintf(stderr, "No cases match the filters\n");
+
+	free(baseline.results);
+	return failures || regressions || !printed;
+}
@@ -9,6 +9,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 
+#include "crossystem_arch.h"
 #include "host_common.h"
 #include "test_common.h"
 #include "utility.h"
@@ -26,7 +27,7 @@ static void StructPackingTest(void)
 		"sizeof(VbSignature)");
 	TEST_EQ(EXPECTED_VBKEYBLOCKHEADER_SIZE, sizeof(VbKeyBlockHeader),
 		"sizeof(VbKeyBlockHeader)");
-	TEST_EQ(EXPECTED_VBKERNELPREAMBLEHEADER2_2_SIZE,
+	TEST_EQ(EXPECTED_VBKERNELPREAMBLEHEADER2_4_SIZE,
 		sizeof(VbKernelPreambleHeader),
 		"sizeof(VbKernelPreambleHeader)");
 
@@ -35,8 +36,22 @@ static void StructPackingTest(void)
 		"sizeof(VbSharedDataHeader) V1");
 
 	TEST_EQ(VB_SHARED_DATA_HEADER_SIZE_V2,
-		sizeof(VbSharedDataHeader),
+		(long)&((VbSharedDataHeader*)NULL)->timestamp_count,
 		"sizeof(VbSharedDataHeader) V2");
+
+	TEST_EQ(VB_SHARED_DATA_HEADER_SIZE_V3,
+		(long)&((VbSharedDataHeader*)NULL)->tpm_stats_count,
+		"sizeof(VbSharedDataHeader) V3");
+
+	TEST_EQ(VB_SHARED_DATA_HEADER_SIZE_V4,
+		sizeof(VbSharedDataHeader),
+		"sizeof(VbSharedDataHeader) V4");
+
+	TEST_EQ(VBSD_KERNEL_CALL_HEADER_SIZE,
+		(long)&((VbSharedDataKernelCall*)NULL)->parts,
+		"VbSharedDataKernelCall header size");
+	TEST_EQ(EXPECTED_VBSHAREDDATACOMPACT_SIZE, sizeof(VbSharedDataCompact),
+		"sizeof(VbSharedDataCompact)");
 }
 
 /* Test array size macro */
@@ -188,6 +203,8 @@ static void VbSharedDataTest(void)
 {
 	uint8_t buf[VB_SHARED_DATA_MIN_SIZE + 1];
 	VbSharedDataHeader* d = (VbSharedDataHeader*)buf;
+	VbSharedDataTpmStats stats;
+	int i;
 
 	TEST_NEQ(VBOOT_SUCCESS,
 		 VbSharedDataInit(d, sizeof(VbSharedDataHeader) - 1),
@@ -224,6 +241,189 @@ static void VbSharedDataTest(void)
 		"VbSharedDataSetKernelKey sd null");
 	TEST_EQ(VBOOT_PUBLIC_KEY_INVALID, VbSharedDataSetKernelKey(d, NULL),
 		"VbSharedDataSetKernelKey pubkey null");
+
+	/* Timestamps */
+	TEST_EQ(d->timestamp_count, 0, "VbSharedDataInit timestamp_count");
+	TEST_EQ(VBOOT_SUCCESS, VbSharedDataAddTimestamp(d, 3, 100),
+		"VbSharedDataAddTimestamp");
+	TEST_EQ(d->timestamp_count, 1, "  count");
+	TEST_EQ(d->timestamps[0].event, 3, "  event");
+	TEST_EQ(d->timestamps[0].time_ms, 100, "  time");
+	for (i = 1; i <= VBSD_MAX_TIMESTAMPS; i++)
+		VbSharedDataAddTimestamp(d, 4, 100 + i);
+	TEST_EQ(d->timestamp_count, VBSD_MAX_TIMESTAMPS + 1,
+		"VbSharedDataAddTimestamp wrap count");
+	TEST_EQ(d->timestamps[0].time_ms, 100 + VBSD_MAX_TIMESTAMPS,
+		"  oldest overwritten");
+	TEST_EQ(VBOOT_SHARED_DATA_INVALID, VbSharedDataAddTimestamp(NULL, 3, 0),
+		"VbSharedDataAddTimestamp sd null");
+	d->struct_version = 2;
+	d->timestamp_count = 0;
+	TEST_EQ(VBOOT_SHARED_DATA_INVALID, VbSharedDataAddTimestamp(d, 3, 0),
+		"VbSharedDataAddTimestamp old struct");
+	TEST_EQ(d->timestamp_count, 0, "  count unchanged");
+
+	/* TPM statistics */
+	d->struct_version = VB_SHARED_DATA_VERSION;
+	TEST_EQ(d->tpm_stats_count, 0, "VbSharedDataInit tpm_stats_count");
+	memset(&stats, 0, sizeof(stats));
+	stats.command = 0x14f;
+	stats.count = 2;
+	TEST_EQ(VBOOT_SUCCESS, VbSharedDataSetTpmStats(d, &stats),
+		"VbSharedDataSetTpmStats");
+	TEST_EQ(d->tpm_stats_count, 1, "  count");
+	TEST_EQ(d->tpm_stats[0].count, 2, "  entry");
+	stats.count = 3;
+	VbSharedDataSetTpmStats(d, &stats);
+	TEST_EQ(d->tpm_stats_count, 1, "VbSharedDataSetTpmStats replace");
+	TEST_EQ(d->tpm_stats[0].count, 3, "  entry");
+	for (i = 1; i < VBSD_MAX_TPM_STATS; i++) {
+		stats.command = 0x200 + i;
+		VbSharedDataSetTpmStats(d, &stats);
+	}
+	TEST_EQ(d->tpm_stats_count, VBSD_MAX_TPM_STATS, "  full");
+	stats.command = 0x300;
+	TEST_EQ(VBOOT_SHARED_DATA_INVALID, VbSharedDataSetTpmStats(d, &stats),
+		"VbSharedDataSetTpmStats full");
+	TEST_EQ(d->tpm_stats_count, VBSD_MAX_TPM_STATS, "  count unchanged");
+	d->struct_version = 3;
+	d->tpm_stats_count = 0;
+	TEST_EQ(VBOOT_SHARED_DATA_INVALID, VbSharedDataSetTpmStats(d, &stats),
+		"VbSharedDataSetTpmStats old struct");
+	TEST_EQ(d->tpm_stats_count, 0, "  count unchanged");
+}
+
+static void VbSharedDataPackTest(void)
+{
+	uint8_t buf[VB_SHARED_DATA_MIN_SIZE];
+	uint8_t packed[sizeof(VbSharedDataHeader)];
+	VbSharedDataHeader *d = (VbSharedDataHeader *)buf;
+	VbSharedDataCompact *sc = (VbSharedDataCompact *)packed;
+	VbSharedDataKernelCall shc;
+	VbSharedDataTpmStats stats;
+	VbSharedDataHeader *x;
+	uint32_t size, core_only;
+	int i;
+
+	VbSharedDataInit(d, sizeof(buf));
+	d->flags = VBSD_BOOT_DEV_SWITCH_ON | VBSD_NVDATA_V2;
+	d->fw_version_tpm = 0x10002;
+	d->kernel_version_tpm = 0x30004;
+	d->firmware_index = 1;
+	d->recovery_reason = 0x42;
+
+	/* Core only */
+	size = sizeof(packed);
+	TEST_SUCC(VbSharedDataPack(d, 0, packed, &size), "Pack core");
+	TEST_EQ(size, sizeof(VbSharedDataCompact), "  size");
+	TEST_EQ(sc->magic, VB_SHARED_DATA_COMPACT_MAGIC, "  magic");
+	TEST_EQ(sc->total_size, size, "  total_size");
+	TEST_EQ(sc->sections, 0, "  no sections");
+	TEST_EQ(sc->kernel_gpt_index, 0, "  no kernel");
+	core_only = size;
+
+	/* Empty logs aren't emitted */
+	size = sizeof(packed);
+	TEST_SUCC(VbSharedDataPack(d, VBSD_SECTION_MASK(VBSD_SECTION_TIMESTAMPS),
+				   packed, &size), "Pack empty log");
+	TEST_EQ(size, core_only, "  size");
+
+	/* Fill in the logs */
+	d->timer_vb_init_enter = 1234;
+	d->check_fw_b_result = VBSD_LF_CHECK_VALID;
+	d->fw_keyblock_flags = 7;
+	d->lk_call_count = VBSD_MAX_KERNEL_CALLS + 1;
+	for (i = 0; i < VBSD_MAX_KERNEL_CALLS; i++)
+		d->lk_calls[i].kernel_parts_found = i;
+	/* The header is packed, so fill in the first call through a copy */
+	memcpy(&shc, &d->lk_calls[0], sizeof(shc));
+	shc.kernel_parts_found = 2;
+	shc.parts[0].check_result = VBSD_LKP_CHECK_KEY_BLOCK_SIG;
+	shc.parts[1].check_result = VBSD_LKP_CHECK_KERNEL_GOOD;
+	shc.parts[1].gpt_index = 4;
+	shc.parts[1].combined_version = 0x30005;
+	memcpy(&d->lk_calls[0], &shc, sizeof(shc));
+	d->lk_calls[2].kernel_parts_found = VBSD_MAX_KERNEL_PARTS + 3;
+	d->lk_calls[2].parts[VBSD_MAX_KERNEL_PARTS - 1].sector_start = 99;
+	for (i = 0; i < VBSD_MAX_TIMESTAMPS + 2; i++)
+		VbSharedDataAddTimestamp(d, i, 100 + i);
+	memset(&stats, 0, sizeof(stats));
+	stats.command = 0x14f;
+	stats.count = 2;
+	VbSharedDataSetTpmStats(d, &stats);
+
+	size = sizeof(VbSharedDataCompact) + 8;
+	TEST_EQ(VbSharedDataPack(d, VBSD_SECTIONS_ALL, packed, &size),
+		VBOOT_SHARED_DATA_INVALID, "Pack too small");
+	size = sizeof(packed);
+	TEST_SUCC(VbSharedDataPack(d, VBSD_SECTIONS_ALL, packed, &size),
+		  "Pack all");
+	TEST_EQ(sc->kernel_gpt_index, 4, "  kernel gpt index");
+	TEST_EQ(sc->kernel_version, 0x30005, "  kernel version");
+	TEST_EQ(sc->sections,
+		VBSD_SECTION_MASK(VBSD_SECTION_TIMERS) |
+		VBSD_SECTION_MASK(VBSD_SECTION_LOAD_FIRMWARE) |
+		VBSD_SECTION_MASK(VBSD_SECTION_LOAD_KERNEL) |
+		VBSD_SECTION_MASK(VBSD_SECTION_TIMESTAMPS) |
+		VBSD_SECTION_MASK(VBSD_SECTION_TPM_STATS), "  sections");
+	TEST_TRUE(size < sizeof(VbSharedDataHeader), "  smaller");
+
+	/* Round trip */
+	x = VbSharedDataExpand(packed, size);
+	TEST_PTR_NEQ(x, NULL, "Expand");
+	if (x) {
+		TEST_EQ(x->magic, VB_SHARED_DATA_MAGIC, "  magic");
+		TEST_EQ(x->struct_version, VB_SHARED_DATA_VERSION,
+			"  version");
+		TEST_EQ(x->flags, d->flags, "  flags");
+		TEST_EQ(x->fw_version_tpm, 0x10002, "  fw version");
+		TEST_EQ(x->kernel_version_tpm, 0x30004, "  kernel version");
+		TEST_EQ(x->firmware_index, 1, "  firmware index");
+		TEST_EQ(x->recovery_reason, 0x42, "  recovery reason");
+		TEST_EQ(x->timer_vb_init_enter, 1234, "  timer");
+		TEST_EQ(x->check_fw_b_result, VBSD_LF_CHECK_VALID,
+			"  fw b result");
+		TEST_EQ(x->fw_keyblock_flags, 7, "  fw keyblock flags");
+		TEST_EQ(memcmp(x->lk_calls, d->lk_calls, sizeof(d->lk_calls)), 0,
+			"  kernel calls");
+		TEST_EQ(x->lk_call_count, d->lk_call_count, "  call count");
+		TEST_EQ(x->timestamp_count, d->timestamp_count,
+			"  timestamp count");
+		TEST_EQ(memcmp(x->timestamps, d->timestamps,
+			       sizeof(d->timestamps)), 0, "  timestamps");
+		TEST_EQ(x->tpm_stats_count, 1, "  tpm stats count");
+		TEST_EQ(x->tpm_stats[0].count, 2, "  tpm stats");
+		free(x);
+	}
+
+	/* Unknown sections are skipped */
+	{
+		VbSharedDataSection *s =
+			(VbSharedDataSection *)(packed + sc->total_size);
+
+		s->tag = 0x7777;
+		s->size = 8;
+		sc->total_size += sizeof(*s) + 8;
+		x = VbSharedDataExpand(packed, sc->total_size);
+		TEST_PTR_NEQ(x, NULL, "Expand unknown section");
+		if (x)
+			TEST_EQ(x->tpm_stats_count, 1, "  later sections");
+		free(x);
+		sc->total_size = size;
+	}
+
+	/* Bad data */
+	TEST_PTR_EQ(VbSharedDataExpand(packed, size - 1), NULL,
+		    "Expand truncated");
+	TEST_PTR_EQ(VbSharedDataExpand(buf, sizeof(buf)), NULL,
+		    "Expand full header");
+	((VbSharedDataSection *)(packed + sc->core_size))->size = size;
+	TEST_PTR_EQ(VbSharedDataExpand(packed, size), NULL,
+		    "Expand section overflow");
+
+	size = sizeof(packed);
+	TEST_EQ(VbSharedDataPack(NULL, 0, packed, &size),
+		VBOOT_SHARED_DATA_INVALID, "Pack null");
 }
 
 int main(int argc, char* argv[])
@@ -233,6 +433,7 @@ int main(int argc, char* argv[])
 	VerifyHelperFunctions();
 	PublicKeyTest();
 	VbSharedDataTest();
+	VbSharedDataPackTest();
 
 	return gTestSuccess ? 0 : 255;
 }
@@ -33,6 +33,14 @@ static struct vb2_context ctx;
 struct vb2_shared_data *sd;
 static uint8_t workbuf[VB2_KERNEL_WORKBUF_RECOMMENDED_SIZE];
 static uint32_t mock_localization_count;
+static int menu_calls;
+static int menu_items_calls;
+static uint32_t mock_redraw_base;
+static uint32_t mock_dirty_idx_mask;
+static int prepare_calls;
+static uint32_t mock_prepared_locale;
+static const uint32_t *mock_prepared_screens;
+static uint32_t mock_prepared_count;
 
 /* Reset mock data (for use before each test) */
 static void ResetMocks(void)
@@ -75,6 +83,14 @@ static void ResetMocks(void)
 	VbSharedDataInit(shared, sizeof(shared_data));
 
 	*debug_info = 0;
+
+	menu_calls = 0;
+	menu_items_calls = 0;
+	mock_redraw_base = 0;
+	mock_dirty_idx_mask = 0;
+	prepare_calls = 0;
+	mock_prepared_screens = NULL;
+	mock_prepared_count = 0;
 }
 
 /* Mocks */
@@ -95,6 +111,145 @@ VbError_t VbExDisplayDebugInfo(const char *info_str)
 	return VBERROR_SUCCESS;
 }
 
+VbError_t VbExDisplayMenu(uint32_t screen_type, uint32_t locale,
+			  uint32_t selected_index, uint32_t disabled_idx_mask,
+			  uint32_t redraw_base)
+{
+	menu_calls++;
+	mock_redraw_base = redraw_base;
+	return VBERROR_SUCCESS;
+}
+
+VbError_t VbExDisplayMenuItems(uint32_t screen_type, uint32_t locale,
+			       uint32_t selected_index,
+			       uint32_t disabled_idx_mask,
+			       uint32_t dirty_idx_mask)
+{
+	menu_items_calls++;
+	mock_dirty_idx_mask = dirty_idx_mask;
+	return VBERROR_SUCCESS;
+}
+
+VbError_t VbExDisplayPrepare(uint32_t locale, const uint32_t *screens,
+			     uint32_t screen_count)
+{
+	prepare_calls++;
+	mock_prepared_locale = locale;
+	mock_prepared_screens = screens;
+	mock_prepared_count = screen_count;
+	return VBERROR_SUCCESS;
+}
+
+/* Return non-zero if the last VbExDisplayPrepare() call listed a screen */
+static int screen_prepared(uint32_t screen)
+{
+	uint32_t i;
+
+	for (i = 0; i < mock_prepared_count; i++)
+		if (mock_prepared_screens[i] == screen)
+			return 1;
+	return 0;
+}
+
+/* Test telling the platform which screens to load */
+static void DisplayPrepareTest(void)
+{
+	ResetMocks();
+	VbDisplayPrepare(&ctx, 0);
+	TEST_EQ(prepare_calls, 1, "Normal mode");
+	TEST_EQ(mock_prepared_count, 1, "  one screen");
+	TEST_TRUE(screen_prepared(VB_SCREEN_WAIT), "  wait screen");
+
+	ResetMocks();
+	ctx.flags |= VB2_CONTEXT_DEVELOPER_MODE;
+	VbDisplayPrepare(&ctx, 0);
+	TEST_TRUE(screen_prepared(VB_SCREEN_DEVELOPER_WARNING),
+		  "Developer mode");
+	TEST_FALSE(screen_prepared(VB_SCREEN_DEVELOPER_MENU), "  no menus");
+
+	ResetMocks();
+	ctx.flags |= VB2_CONTEXT_DEVELOPER_MODE;
+	VbDisplayPrepare(&ctx, 1);
+	TEST_TRUE(screen_prepared(VB_SCREEN_DEVELOPER_MENU),
+		  "Developer menu");
+
+	ResetMocks();
+	ctx.flags |= VB2_CONTEXT_RECOVERY_MODE | VB2_CONTEXT_DEVELOPER_MODE;
+	vb2_nv_set(&ctx, VB2_NV_LOCALIZATION_INDEX, 2);
+	VbDisplayPrepare(&ctx, 0);
+	TEST_TRUE(screen_prepared(VB_SCREEN_RECOVERY_INSERT), "Recovery mode");
+	TEST_FALSE(screen_prepared(VB_SCREEN_DEVELOPER_WARNING),
+		   "  no developer screens");
+	TEST_FALSE(screen_prepared(VB_SCREEN_WAIT), "  no EC sync");
+	TEST_EQ(mock_prepared_locale, 2, "  locale");
+
+	ResetMocks();
+	ctx.flags |= VB2_CONTEXT_RECOVERY_MODE;
+	VbDisplayPrepare(&ctx, 1);
+	TEST_TRUE(screen_prepared(VB_SCREEN_RECOVERY_TO_DEV_MENU),
+		  "Recovery menu");
+	TEST_FALSE(screen_prepared(VB_SCREEN_RECOVERY_TO_DEV),
+		   "  no legacy screens");
+
+	/* Changing the locale announces the same screens again */
+	ResetMocks();
+	vb2_nv_set(&ctx, VB2_NV_LOCALIZATION_INDEX, 0);
+	VbDisplayScreen(&ctx, VB_SCREEN_BLANK, 1);
+	TEST_EQ(prepare_calls, 0, "Same locale");
+
+	vb2_nv_set(&ctx, VB2_NV_LOCALIZATION_INDEX, 1);
+	VbDisplayMenu(&ctx, VB_SCREEN_LANGUAGES_MENU, 1, 1, 0);
+	TEST_EQ(prepare_calls, 1, "New locale");
+	TEST_EQ(mock_prepared_locale, 1, "  locale");
+	TEST_TRUE(screen_prepared(VB_SCREEN_RECOVERY_TO_DEV_MENU),
+		  "  same screens");
+}
+
+/* Test redrawing menus */
+static void DisplayMenuTest(void)
+{
+	ResetMocks();
+	TEST_SUCC(VbDisplayMenu(&ctx, VB_SCREEN_OPTIONS_MENU, 0, 0, 0),
+		  "New menu");
+	TEST_EQ(menu_calls, 1, "  whole menu drawn");
+	TEST_EQ(mock_redraw_base, 1, "  base screen drawn");
+
+	ResetMocks();
+	TEST_SUCC(VbDisplayMenu(&ctx, VB_SCREEN_OPTIONS_MENU, 0, 0, 0),
+		  "Same menu");
+	TEST_EQ(menu_calls + menu_items_calls, 0, "  nothing drawn");
+
+	ResetMocks();
+	TEST_SUCC(VbDisplayMenu(&ctx, VB_SCREEN_OPTIONS_MENU, 0, 2, 0),
+		  "Move cursor");
+	TEST_EQ(menu_calls, 0, "  whole menu not drawn");
+	TEST_EQ(menu_items_calls, 1, "  items drawn");
+	TEST_EQ(mock_dirty_idx_mask, 0x05, "  old and new items dirty");
+
+	ResetMocks();
+	TEST_SUCC(VbDisplayMenu(&ctx, VB_SCREEN_OPTIONS_MENU, 0, 3, 0x10),
+		  "Move cursor and disable item");
+	TEST_EQ(mock_dirty_idx_mask, 0x1c, "  disabled item dirty");
+
+	ResetMocks();
+	TEST_SUCC(VbDisplayMenu(&ctx, VB_SCREEN_OPTIONS_MENU, 1, 3, 0x10),
+		  "Forced redraw");
+	TEST_EQ(menu_calls, 1, "  whole menu drawn");
+	TEST_EQ(mock_redraw_base, 0, "  base screen not drawn");
+
+	ResetMocks();
+	vb2_nv_set(&ctx, VB2_NV_LOCALIZATION_INDEX, 1);
+	TEST_SUCC(VbDisplayMenu(&ctx, VB_SCREEN_OPTIONS_MENU, 0, 2, 0x10),
+		  "New locale");
+	TEST_EQ(menu_calls, 1, "  whole menu drawn");
+
+	ResetMocks();
+	VbDisplayScreen(&ctx, VB_SCREEN_OPTIONS_MENU, 1);
+	TEST_SUCC(VbDisplayMenu(&ctx, VB_SCREEN_OPTIONS_MENU, 0, 1, 0),
+		  "Menu after plain screen");
+	TEST_EQ(menu_calls, 1, "  whole menu drawn");
+}
+
 /* Test displaying debug info */
 static void DebugInfoTest(void)
 {
@@ -179,6 +334,8 @@ int main(void)
 {
 	DebugInfoTest();
 	DisplayKeyTest();
+	DisplayMenuTest();
+	DisplayPrepareTest();
 
 	return gTestSuccess ? 0 : 255;
 }
@@ -15,6 +15,7 @@
 #include "2common.h"
 #include "2misc.h"
 #include "2nvstorage.h"
+#include "2rsa.h"
 #include "2sha.h"
 #include "cgptlib.h"
 #include "cgptlib_internal.h"
@@ -49,14 +50,34 @@ static int mock_part_next;
 
 /* Mock data */
 static char call_log[4096];
+/* Hints passed to each stream opened, kept apart from the read sequence */
+static char hints_log[256];
 static uint8_t kernel_buffer[80000];
 static int disk_read_to_fail;
+static int disk_read_multi_fail;
 static int disk_write_to_fail;
 static int gpt_init_fail;
 static int key_block_verify_fail;  /* 0=ok, 1=sig, 2=hash */
 static int preamble_verify_fail;
+static int key_block_verify_calls;
+static int key_block_verify_fail_call;  /* Fail only this call */
+static int preamble_verify_calls;
 static int verify_data_fail;
+static int verify_data_calls;
+static int verify_data_fail_call;  /* Fail only this call */
+static int verify_digest_fail;
+static int verify_chunk_fail;
+static int decompress_start_fail;
+static int decompress_feed_fail;
+static int decompress_finish_calls;
+static uint8_t *decompress_out;
+static uint32_t decompress_out_size;
+static uint32_t decompress_size;
+static int stream_wait_fail;
 static int unpack_key_fail;
+static int unpack_key_calls;
+static uint32_t unpack_key_first_alg;
+static const struct vb2_packed_key *mock_recovery_key;
 static int gpt_flag_external;
 
 static uint8_t gbb_data[sizeof(GoogleBinaryBlockHeader) + 2048];
@@ -110,9 +131,21 @@ static void SetupGptHeader(GptHeader *h, int is_secondary)
 	h->header_crc32 = HeaderCrc(h);
 }
 
+/**
+ * Give the primary GPT on the mock disk a valid entries CRC
+ */
+static void SetPrimaryEntriesCrc(void)
+{
+	mock_gpt_primary->entries_crc32 =
+		Crc32(&mock_disk[MOCK_SECTOR_SIZE * mock_gpt_primary->entries_lba],
+		      MAX_NUMBER_OF_ENTRIES * sizeof(GptEntry));
+	mock_gpt_primary->header_crc32 = HeaderCrc(mock_gpt_primary);
+}
+
 static void ResetCallLog(void)
 {
 	*call_log = 0;
+	*hints_log = 0;
 }
 
 /**
@@ -127,13 +160,29 @@ static void ResetMocks(void)
 	SetupGptHeader(mock_gpt_secondary, 1);
 
 	disk_read_to_fail = -1;
+	disk_read_multi_fail = 0;
 	disk_write_to_fail = -1;
 
 	gpt_init_fail = 0;
 	key_block_verify_fail = 0;
 	preamble_verify_fail = 0;
+	key_block_verify_calls = 0;
+	key_block_verify_fail_call = 0;
+	preamble_verify_calls = 0;
 	verify_data_fail = 0;
+	verify_data_calls = 0;
+	verify_data_fail_call = 0;
+	verify_digest_fail = 0;
+	verify_chunk_fail = -1;
+	decompress_start_fail = 0;
+	decompress_feed_fail = 0;
+	decompress_finish_calls = 0;
+	decompress_size = 0;
+	stream_wait_fail = 0;
 	unpack_key_fail = 0;
+	unpack_key_calls = 0;
+	unpack_key_first_alg = 0;
+	mock_recovery_key = NULL;
 
 	gpt_flag_external = 0;
 
@@ -177,6 +226,7 @@ static void ResetMocks(void)
 	memset(&ctx, 0, sizeof(ctx));
 	ctx.workbuf = workbuf;
 	ctx.workbuf_size = sizeof(workbuf);
+	memset(workbuf, 0, sizeof(struct vb2_shared_data));
 	vb2_nv_init(&ctx);
 
 	struct vb2_shared_data *sd = vb2_get_sd(&ctx);
@@ -203,6 +253,24 @@ VbError_t VbExDiskRead(VbExDiskHandle_t handle, uint64_t lba_start,
 	return VBERROR_SUCCESS;
 }
 
+VbError_t VbExDiskReadMulti(VbExDiskHandle_t handle, VbDiskRange *ranges,
+			    uint32_t count)
+{
+	uint32_t i;
+
+	LOGCALL("VbExDiskReadMulti(h, %d)\n", (int)count);
+
+	if (disk_read_multi_fail)
+		return VBERROR_SIMULATED;
+
+	for (i = 0; i < count; i++)
+		ranges[i].result = VbExDiskRead(handle, ranges[i].lba_start,
+						ranges[i].lba_count,
+						ranges[i].buffer);
+
+	return VBERROR_SUCCESS;
+}
+
 VbError_t VbExDiskWrite(VbExDiskHandle_t handle, uint64_t lba_start,
 			uint64_t lba_count, const void *buffer)
 {
@@ -217,14 +285,85 @@ VbError_t VbExDiskWrite(VbExDiskHandle_t handle, uint64_t lba_start,
 	return VBERROR_SUCCESS;
 }
 
+VbError_t VbExStreamOpenWithHints(VbExDiskHandle_t handle, uint64_t lba_start,
+				  uint64_t lba_count, uint32_t flags,
+				  uint64_t expected_bytes,
+				  VbExStream_t *stream)
+{
+	sprintf(hints_log + strlen(hints_log), "%d: 0x%x, %d\n",
+		(int)lba_start, flags, (int)expected_bytes);
+
+	return VbExStreamOpen(handle, lba_start, lba_count, stream);
+}
+
+VbError_t VbExStreamReadAsync(VbExStream_t stream, uint32_t bytes,
+			      void *buffer)
+{
+	LOGCALL("VbExStreamReadAsync(s, %d)\n", (int)bytes);
+
+	return VbExStreamRead(stream, bytes, buffer);
+}
+
+VbError_t VbExStreamWait(VbExStream_t stream)
+{
+	LOGCALL("VbExStreamWait(s)\n");
+
+	if (--stream_wait_fail == 0)
+		return VBERROR_SIMULATED;
+
+	return VBERROR_SUCCESS;
+}
+
+VbError_t VbExDecompressStart(uint32_t compression, void *outbuf,
+			      uint32_t outbuf_size, VbExDecompressor_t *dp)
+{
+	LOGCALL("VbExDecompressStart(%d, %d)\n", (int)compression,
+		(int)outbuf_size);
+
+	if (decompress_start_fail)
+		return VBERROR_DECOMPRESS_UNSUPPORTED;
+
+	/* "Decompression" just copies, so the body hash is the same */
+	decompress_out = outbuf;
+	decompress_out_size = outbuf_size;
+	*dp = &decompress_size;
+	return VBERROR_SUCCESS;
+}
+
+VbError_t VbExDecompressFeed(VbExDecompressor_t d, const void *inbuf,
+			     uint32_t in_size)
+{
+	if (--decompress_feed_fail == 0)
+		return VBERROR_SIMULATED;
+	if (d != &decompress_size ||
+	    decompress_size + in_size > decompress_out_size)
+		return VBERROR_UNKNOWN;
+
+	memcpy(decompress_out + decompress_size, inbuf, in_size);
+	decompress_size += in_size;
+	return VBERROR_SUCCESS;
+}
+
+VbError_t VbExDecompressFinish(VbExDecompressor_t d, uint32_t *out_size)
+{
+	LOGCALL("VbExDecompressFinish(%d)\n", (int)decompress_size);
+
+	decompress_finish_calls++;
+	*out_size = decompress_size;
+	return VBERROR_SUCCESS;
+}
+
 int GptInit(GptData *gpt)
 {
+	gpt->current_kernel = CGPT_KERNEL_ENTRY_NOT_FOUND;
 	return gpt_init_fail;
 }
 
 int GptNextKernelEntry(GptData *gpt, uint64_t *start_sector, uint64_t *size)
 {
-	struct mock_part *p = mock_parts + mock_part_next;
+	/* Like the real one, carry on from the current kernel */
+	int next = gpt->current_kernel + 1;
+	struct mock_part *p = mock_parts + next;
 
 	if (!p->size)
 		return GPT_ERROR_NO_VALID_KERNEL;
@@ -232,10 +371,10 @@ int GptNextKernelEntry(GptData *gpt, uint64_t *start_sector, uint64_t *size)
 	if (gpt->flags & GPT_FLAG_EXTERNAL)
 		gpt_flag_external++;
 
-	gpt->current_kernel = mock_part_next;
+	gpt->current_kernel = next;
 	*start_sector = p->start;
 	*size = p->size;
-	mock_part_next++;
+	mock_part_next = next + 1;
 	return GPT_SUCCESS;
 }
 
@@ -246,13 +385,22 @@ void GetCurrentKernelUniqueGuid(GptData *gpt, void *dest)
 	memcpy(dest, fake_guid, sizeof(fake_guid));
 }
 
+const struct vb2_packed_key *vb2ex_embedded_recovery_key(void)
+{
+	return mock_recovery_key;
+}
+
 int vb2_unpack_key_buffer(struct vb2_public_key *key,
 		   const uint8_t *buf,
 		   uint32_t size)
 {
+	if (!unpack_key_calls++)
+		unpack_key_first_alg =
+			((const struct vb2_packed_key *)buf)->algorithm;
 	if (--unpack_key_fail == 0)
 		return VB2_ERROR_MOCK;
 
+	key->hash_alg = VB2_HASH_SHA256;
 	return VB2_SUCCESS;
 }
 
@@ -261,7 +409,10 @@ int vb2_verify_keyblock(struct vb2_keyblock *block,
 			const struct vb2_public_key *key,
 			const struct vb2_workbuf *wb)
 {
-	if (key_block_verify_fail >= 1)
+	key_block_verify_calls++;
+
+	if (key_block_verify_fail >= 1 ||
+	    key_block_verify_calls == key_block_verify_fail_call)
 		return VB2_ERROR_MOCK;
 
 	/* Use this as an opportunity to override the key block */
@@ -286,6 +437,8 @@ int vb2_verify_kernel_preamble(struct vb2_kernel_preamble *preamble,
 			       const struct vb2_public_key *key,
 			       const struct vb2_workbuf *wb)
 {
+	preamble_verify_calls++;
+
 	if (preamble_verify_fail)
 		return VB2_ERROR_MOCK;
 
@@ -294,13 +447,51 @@ int vb2_verify_kernel_preamble(struct vb2_kernel_preamble *preamble,
 	return VB2_SUCCESS;
 }
 
-int vb2_verify_data(const uint8_t *data,
-		    uint32_t size,
-		    struct vb2_signature *sig,
-		    const struct vb2_public_key *key,
-		    const struct vb2_workbuf *wb)
+int vb2_verify_kernel_body(const uint8_t *data,
+			   uint32_t size,
+			   struct vb2_kernel_preamble *preamble,
+			   const struct vb2_public_key *key,
+			   const struct vb2_workbuf *wb)
+{
+	verify_data_calls++;
+
+	if (verify_data_fail || verify_data_calls == verify_data_fail_call)
+		return VB2_ERROR_MOCK;
+
+	return VB2_SUCCESS;
+}
+
+int vb2_verify_digest(const struct vb2_public_key *key,
+		      struct vb2_signature *sig,
+		      const uint8_t *digest,
+		      const struct vb2_workbuf *wb)
+{
+	struct vb2_sha256_context sc;
+	uint8_t expect[VB2_SHA256_DIGEST_SIZE];
+
+	if (verify_digest_fail)
+		return VB2_ERROR_MOCK;
+
+	/* Chunked hashing must match hashing the whole body at once */
+	vb2_sha256_init(&sc);
+	vb2_sha256_update(&sc, kernel_buffer, sig->data_size);
+	vb2_sha256_finalize(&sc, expect);
+	if (memcmp(digest, expect, sizeof(expect)))
+		return VB2_ERROR_MOCK;
+
+	return VB2_SUCCESS;
+}
+
+int vb2_verify_kernel_body_chunk(const struct vb2_kernel_preamble *preamble,
+				 uint32_t index,
+				 const uint8_t *buf,
+				 uint32_t size,
+				 enum vb2_hash_algorithm hash_alg)
 {
-	if (verify_data_fail)
+	LOGCALL("vb2_verify_kernel_body_chunk(%d, %d)\n", (int)index,
+		(int)size);
+
+	if ((int)index == verify_chunk_fail)
 		return VB2_ERROR_MOCK;
 
 	return VB2_SUCCESS;
@@ -326,13 +517,16 @@ static void ReadWriteGptTest(void)
 
 	g.sector_bytes = MOCK_SECTOR_SIZE;
 	g.streaming_drive_sectors = g.gpt_drive_sectors = MOCK_SECTOR_COUNT;
+	g.flags = 0;
 	g.valid_headers = g.valid_entries = MASK_BOTH;
 
 	ResetMocks();
 	TEST_EQ(AllocAndReadGptData(handle, &g), 0, "AllocAndRead");
-	TEST_CALLS("VbExDiskRead(h, 1, 1)\n"
-		   "VbExDiskRead(h, 2, 32)\n"
+	TEST_CALLS("VbExDiskReadMulti(h, 2)\n"
+		   "VbExDiskRead(h, 1, 1)\n"
 		   "VbExDiskRead(h, 1023, 1)\n"
+		   "VbExDiskReadMulti(h, 2)\n"
+		   "VbExDiskRead(h, 2, 32)\n"
 		   "VbExDiskRead(h, 991, 32)\n");
 	ResetCallLog();
 	/*
@@ -343,6 +537,22 @@ static void ReadWriteGptTest(void)
 	TEST_EQ(WriteAndFreeGptData(handle, &g), 0, "WriteAndFree");
 	TEST_CALLS("");
 
+	/* If a batch can't be read, each range is read by itself */
+	ResetMocks();
+	disk_read_multi_fail = 1;
+	TEST_EQ(AllocAndReadGptData(handle, &g), 0, "AllocAndRead no batch");
+	TEST_CALLS("VbExDiskReadMulti(h, 2)\n"
+		   "VbExDiskRead(h, 1, 1)\n"
+		   "VbExDiskRead(h, 1023, 1)\n"
+		   "VbExDiskReadMulti(h, 2)\n"
+		   "VbExDiskRead(h, 2, 32)\n"
+		   "VbExDiskRead(h, 991, 32)\n");
+	TEST_EQ(CheckHeader((GptHeader *)g.secondary_header, 1,
+			    g.streaming_drive_sectors, g.gpt_drive_sectors, 0,
+			    g.sector_bytes),
+		0, "  secondary header read");
+	WriteAndFreeGptData(handle, &g);
+
 	/*
 	 * Invalidate primary GPT header,
 	 * check that AllocAndReadGptData still succeeds
@@ -357,7 +567,8 @@ static void ReadWriteGptTest(void)
 	TEST_EQ(CheckHeader(mock_gpt_secondary, 1, g.streaming_drive_sectors,
 		g.gpt_drive_sectors, 0, g.sector_bytes),
                 0, "Secondary header is valid");
-	TEST_CALLS("VbExDiskRead(h, 1, 1)\n"
+	TEST_CALLS("VbExDiskReadMulti(h, 2)\n"
+		   "VbExDiskRead(h, 1, 1)\n"
 		   "VbExDiskRead(h, 1023, 1)\n"
 		   "VbExDiskRead(h, 991, 32)\n");
 	WriteAndFreeGptData(handle, &g);
@@ -376,9 +587,10 @@ static void ReadWriteGptTest(void)
 	TEST_EQ(CheckHeader(mock_gpt_secondary, 1, g.streaming_drive_sectors,
 		g.gpt_drive_sectors, 0, g.sector_bytes),
                 1, "Secondary header is invalid");
-	TEST_CALLS("VbExDiskRead(h, 1, 1)\n"
-		   "VbExDiskRead(h, 2, 32)\n"
-		   "VbExDiskRead(h, 1023, 1)\n");
+	TEST_CALLS("VbExDiskReadMulti(h, 2)\n"
+		   "VbExDiskRead(h, 1, 1)\n"
+		   "VbExDiskRead(h, 1023, 1)\n"
+		   "VbExDiskRead(h, 2, 32)\n");
 	WriteAndFreeGptData(handle, &g);
 
 	/*
@@ -396,7 +608,8 @@ static void ReadWriteGptTest(void)
 	TEST_EQ(CheckHeader(mock_gpt_secondary, 1, g.streaming_drive_sectors,
 		g.gpt_drive_sectors, 0, g.sector_bytes),
                 1, "Secondary header is invalid");
-	TEST_CALLS("VbExDiskRead(h, 1, 1)\n"
+	TEST_CALLS("VbExDiskReadMulti(h, 2)\n"
+		   "VbExDiskRead(h, 1, 1)\n"
 		   "VbExDiskRead(h, 1023, 1)\n");
 	WriteAndFreeGptData(handle, &g);
 
@@ -416,7 +629,8 @@ static void ReadWriteGptTest(void)
 	GptRepair(&g);
 	TEST_EQ(WriteAndFreeGptData(handle, &g), 0,
 		"Fix Primary GPT: WriteAndFreeGptData");
-	TEST_CALLS("VbExDiskRead(h, 1, 1)\n"
+	TEST_CALLS("VbExDiskReadMulti(h, 2)\n"
+		   "VbExDiskRead(h, 1, 1)\n"
 		   "VbExDiskRead(h, 1023, 1)\n"
 		   "VbExDiskRead(h, 991, 32)\n"
 		   "VbExDiskWrite(h, 1, 1)\n"
@@ -441,9 +655,10 @@ static void ReadWriteGptTest(void)
 	GptRepair(&g);
 	TEST_EQ(WriteAndFreeGptData(handle, &g), 0,
 		"Fix Secondary GPT: WriteAndFreeGptData");
-	TEST_CALLS("VbExDiskRead(h, 1, 1)\n"
-		   "VbExDiskRead(h, 2, 32)\n"
+	TEST_CALLS("VbExDiskReadMulti(h, 2)\n"
+		   "VbExDiskRead(h, 1, 1)\n"
 		   "VbExDiskRead(h, 1023, 1)\n"
+		   "VbExDiskRead(h, 2, 32)\n"
 		   "VbExDiskWrite(h, 1023, 1)\n"
 		   "VbExDiskWrite(h, 991, 32)\n");
 	TEST_EQ(CheckHeader(mock_gpt_secondary, 1, g.streaming_drive_sectors,
@@ -482,6 +697,49 @@ static void ReadWriteGptTest(void)
 		   "VbExDiskWrite(h, 1023, 1)\n"
 		   "VbExDiskWrite(h, 991, 32)\n");
 
+	/* Only dirty entry sectors are written, one write per run */
+	ResetMocks();
+	AllocAndReadGptData(handle, &g);
+	g.modified = -1;
+	g.dirty_entries1 = g.dirty_entries2 = 0x0b;
+	ResetCallLog();
+	TEST_EQ(WriteAndFreeGptData(handle, &g), 0, "WriteAndFree dirty");
+	TEST_CALLS("VbExDiskWrite(h, 1, 1)\n"
+		   "VbExDiskWrite(h, 2, 2)\n"
+		   "VbExDiskWrite(h, 5, 1)\n"
+		   "VbExDiskWrite(h, 1023, 1)\n"
+		   "VbExDiskWrite(h, 991, 2)\n"
+		   "VbExDiskWrite(h, 994, 1)\n");
+
+	/* LoadKernel()'s usual update writes one entries sector per copy */
+	ResetMocks();
+	AllocAndReadGptData(handle, &g);
+	g.modified = 0;
+	GptEntryModified(&g, (GptEntry *)g.primary_entries + 1);
+	GptModified(&g);
+	ResetCallLog();
+	TEST_EQ(WriteAndFreeGptData(handle, &g), 0, "WriteAndFree update");
+	TEST_CALLS("VbExDiskWrite(h, 1, 1)\n"
+		   "VbExDiskWrite(h, 2, 1)\n"
+		   "VbExDiskWrite(h, 1023, 1)\n"
+		   "VbExDiskWrite(h, 991, 1)\n");
+
+	/* A deferred secondary is always rewritten whole */
+	ResetMocks();
+	SetPrimaryEntriesCrc();
+	g.flags = GPT_FLAG_LAZY_SECONDARY;
+	AllocAndReadGptData(handle, &g);
+	g.flags = 0;
+	GptEntryModified(&g, (GptEntry *)g.primary_entries + 1);
+	GptModified(&g);
+	ResetCallLog();
+	TEST_EQ(WriteAndFreeGptData(handle, &g), 0, "WriteAndFree deferred");
+	TEST_CALLS("VbExDiskWrite(h, 1, 1)\n"
+		   "VbExDiskWrite(h, 2, 1)\n"
+		   "VbExDiskRead(h, 1023, 1)\n"
+		   "VbExDiskWrite(h, 1023, 1)\n"
+		   "VbExDiskWrite(h, 991, 32)\n");
+
 	/* If legacy signature, don't modify GPT header/entries 1 */
 	ResetMocks();
 	AllocAndReadGptData(handle, &g);
@@ -565,6 +823,82 @@ static void ReadWriteGptTest(void)
 	memset(g.primary_header, '\0', g.sector_bytes);
 	TEST_NEQ(WriteAndFreeGptData(handle, &g), 0, "WriteAndFree disk fail");
 
+	/* Lazy secondary: valid primary means the secondary isn't read */
+	g.flags = GPT_FLAG_LAZY_SECONDARY;
+	ResetMocks();
+	SetPrimaryEntriesCrc();
+	TEST_EQ(AllocAndReadGptData(handle, &g), 0, "AllocAndRead lazy");
+	TEST_CALLS("VbExDiskRead(h, 1, 1)\n"
+		   "VbExDiskRead(h, 2, 32)\n");
+	TEST_EQ(g.deferred, MASK_SECONDARY, "  secondary deferred");
+	TEST_EQ(g.modified, 0, "  not modified");
+	TEST_EQ(CheckHeader((GptHeader *)g.secondary_header, 1,
+			    g.streaming_drive_sectors, g.gpt_drive_sectors, 0,
+			    g.sector_bytes),
+		0, "  secondary header built from primary");
+	TEST_EQ(memcmp(g.primary_entries, g.secondary_entries,
+		       MAX_NUMBER_OF_ENTRIES * sizeof(GptEntry)),
+		0, "  secondary entries built from primary");
+	TEST_EQ(GptSanityCheck(&g), GPT_SUCCESS, "  sanity check");
+	TEST_EQ(g.valid_headers, MASK_BOTH, "  both headers valid");
+	TEST_EQ(g.valid_entries, MASK_BOTH, "  both entries valid");
+	ResetCallLog();
+	TEST_EQ(WriteAndFreeGptData(handle, &g), 0, "WriteAndFree lazy");
+	TEST_CALLS("");
+
+	/* Writing back a lazy GPT rewrites the secondary too */
+	ResetMocks();
+	SetPrimaryEntriesCrc();
+	AllocAndReadGptData(handle, &g);
+	g.modified = -1;
+	ResetCallLog();
+	TEST_EQ(WriteAndFreeGptData(handle, &g), 0, "WriteAndFree lazy mod");
+	TEST_CALLS("VbExDiskWrite(h, 1, 1)\n"
+		   "VbExDiskWrite(h, 2, 32)\n"
+		   "VbExDiskRead(h, 1023, 1)\n"
+		   "VbExDiskWrite(h, 1023, 1)\n"
+		   "VbExDiskWrite(h, 991, 32)\n");
+	TEST_EQ(CheckHeader(mock_gpt_secondary, 1, g.streaming_drive_sectors,
+			    g.gpt_drive_sectors, 0, g.sector_bytes),
+		0, "  secondary header is valid");
+
+	/* ...unless the secondary on disk is being ignored */
+	ResetMocks();
+	SetPrimaryEntriesCrc();
+	memcpy(mock_gpt_secondary->signature, GPT_HEADER_SIGNATURE_IGNORED,
+	       GPT_HEADER_SIGNATURE_SIZE);
+	AllocAndReadGptData(handle, &g);
+	g.modified = -1;
+	ResetCallLog();
+	TEST_EQ(WriteAndFreeGptData(handle, &g), 0,
+		"WriteAndFree lazy ignored");
+	TEST_CALLS("VbExDiskWrite(h, 1, 1)\n"
+		   "VbExDiskWrite(h, 2, 32)\n"
+		   "VbExDiskRead(h, 1023, 1)\n");
+
+	/* Bad primary entries CRC falls back to reading both copies */
+	ResetMocks();
+	TEST_EQ(AllocAndReadGptData(handle, &g), 0, "AllocAndRead lazy bad");
+	TEST_CALLS("VbExDiskRead(h, 1, 1)\n"
+		   "VbExDiskRead(h, 2, 32)\n"
+		   "VbExDiskRead(h, 1023, 1)\n"
+		   "VbExDiskReadMulti(h, 2)\n"
+		   "VbExDiskRead(h, 2, 32)\n"
+		   "VbExDiskRead(h, 991, 32)\n");
+	TEST_EQ(g.deferred, 0, "  nothing deferred");
+	WriteAndFreeGptData(handle, &g);
+
+	/* Invalid primary header reads the secondary */
+	ResetMocks();
+	memset(mock_gpt_primary, '\0', sizeof(*mock_gpt_primary));
+	TEST_EQ(AllocAndReadGptData(handle, &g), 0,
+		"AllocAndRead lazy primary invalid");
+	TEST_CALLS("VbExDiskRead(h, 1, 1)\n"
+		   "VbExDiskRead(h, 1023, 1)\n"
+		   "VbExDiskRead(h, 991, 32)\n");
+	WriteAndFreeGptData(handle, &g);
+
+	g.flags = 0;
 }
 
 static void TestLoadKernel(int expect_retval, char *test_name)
@@ -587,8 +921,208 @@ static void InvalidParamsTest(void)
 	TestLoadKernel(VBERROR_INVALID_KERNEL_FOUND, "Bad disk handle");
 }
 
+static void LoadKernelRankTest(void)
+{
+	GptEntry *e = (GptEntry *)&mock_disk[MOCK_SECTOR_SIZE * 2];
+
+	ResetMocks();
+	TEST_EQ(LoadKernelRank(&lkp), 1, "Rank plain kernel");
+	TEST_EQ(mock_part_next, 1, "  looked at best entry only");
+
+	ResetMocks();
+	SetEntryPriority(e, 5);
+	SetEntrySuccessful(e, 1);
+	SetEntryTries(e, 3);
+	TEST_EQ(LoadKernelRank(&lkp), 1 + (5 << 5 | 1 << 4 | 3),
+		"Rank by priority, successful, tries");
+
+	/* Ranking never writes the GPT back, even if it was repaired */
+	ResetMocks();
+	mock_gpt_secondary->header_crc32++;
+	TEST_NEQ(LoadKernelRank(&lkp), 0, "Rank damaged GPT");
+	TEST_PTR_EQ(strstr(call_log, "VbExDiskWrite"), NULL, "  no writes");
+
+	ResetMocks();
+	mock_parts[0].size = 0;
+	TEST_EQ(LoadKernelRank(&lkp), 0, "Rank no kernels");
+
+	ResetMocks();
+	gpt_init_fail = 1;
+	TEST_EQ(LoadKernelRank(&lkp), 0, "Rank bad GPT");
+}
+
+static void PrefetchGptTest(void)
+{
+	const char *gpt_read = "VbExDiskRead(h, 1, 1)";
+
+	ResetMocks();
+	TEST_EQ(LoadKernelPrefetchGpt(&lkp), 0, "Prefetch GPT");
+	TEST_PTR_NEQ(strstr(call_log, gpt_read), NULL, "  read the GPT");
+	ResetCallLog();
+	TestLoadKernel(0, "  load kernel");
+	TEST_EQ(lkp.partition_number, 1, "  part num");
+	TEST_PTR_EQ(strstr(call_log, gpt_read), NULL, "  GPT not read again");
+	ResetMocks();
+	TestLoadKernel(0, "  load kernel again");
+	TEST_PTR_NEQ(strstr(call_log, gpt_read), NULL, "  GPT read this time");
+
+	/* Only the same disk with the same geometry can use it */
+	ResetMocks();
+	LoadKernelPrefetchGpt(&lkp);
+	lkp.disk_handle = (VbExDiskHandle_t)2;
+	ResetCallLog();
+	TestLoadKernel(0, "Prefetch GPT of other disk");
+	TEST_PTR_NEQ(strstr(call_log, gpt_read), NULL, "  GPT read");
+	LoadKernelDropGpt();
+
+	ResetMocks();
+	LoadKernelPrefetchGpt(&lkp);
+	lkp.boot_flags |= BOOT_FLAG_EXTERNAL_GPT;
+	ResetCallLog();
+	TestLoadKernel(0, "Prefetch GPT with other flags");
+	TEST_PTR_NEQ(strstr(call_log, gpt_read), NULL, "  GPT read");
+	TEST_EQ(gpt_flag_external, 1, "  GPT was external");
+
+	ResetMocks();
+	LoadKernelPrefetchGpt(&lkp);
+	LoadKernelDropGpt();
+	ResetCallLog();
+	TestLoadKernel(0, "Prefetch GPT dropped");
+	TEST_PTR_NEQ(strstr(call_log, gpt_read), NULL, "  GPT read");
+
+	ResetMocks();
+	mock_gpt_primary->header_crc32++;
+	mock_gpt_secondary->header_crc32++;
+	TEST_NEQ(LoadKernelPrefetchGpt(&lkp), 0, "Prefetch bad GPT");
+	ResetCallLog();
+	TestLoadKernel(VBERROR_NO_KERNEL_FOUND, "  load kernel");
+	TEST_PTR_NEQ(strstr(call_log, gpt_read), NULL, "  GPT read again");
+	TEST_PTR_EQ(strstr(call_log, "VbExDiskWrite"), NULL, "  no writes");
+}
+
+/**
+ * Set up the first GPT entry as a kernel partition, and V2 NV storage for the
+ * boot hint.
+ */
+static void ResetHintMocks(int successful)
+{
+	Guid kernel_type = GPT_ENT_TYPE_CHROMEOS_KERNEL;
+	GptEntry *e = (GptEntry *)&mock_disk[MOCK_SECTOR_SIZE * 2];
+
+	ResetMocks();
+	memcpy(&e->type, &kernel_type, sizeof(kernel_type));
+	memcpy(&e->unique, "HintGuid", 9);
+	e->starting_lba = mock_parts[0].start;
+	e->ending_lba = mock_parts[0].start + mock_parts[0].size - 1;
+	SetEntryPriority(e, 1);
+	SetEntrySuccessful(e, successful);
+
+	ctx.flags |= VB2_CONTEXT_NVDATA_V2;
+	vb2_nv_init(&ctx);
+	lkp.boot_flags |= BOOT_FLAG_KERNEL_HINT;
+}
+
+static int LastCallPartsFound(void)
+{
+	return shared->lk_calls[(shared->lk_call_count - 1) &
+				(VBSD_MAX_KERNEL_CALLS - 1)].kernel_parts_found;
+}
+
+static void KernelHintTest(void)
+{
+	const char *secondary_read = "VbExDiskRead(h, 1023, 1)";
+
+	/* A kernel which has booted successfully is remembered */
+	ResetHintMocks(1);
+	TestLoadKernel(0, "Kernel hint stored");
+	TEST_EQ(vb2_nv_get(&ctx, VB2_NV_KERNEL_HINT_PART), 1, "  partition");
+	TEST_EQ(vb2_nv_get(&ctx, VB2_NV_KERNEL_HINT_GPT_CRC),
+		mock_gpt_primary->header_crc32, "  GPT header CRC");
+
+	ResetHintMocks(0);
+	vb2_nv_set(&ctx, VB2_NV_KERNEL_HINT_PART, 3);
+	TestLoadKernel(0, "Kernel hint not stored for a new kernel");
+	TEST_EQ(vb2_nv_get(&ctx, VB2_NV_KERNEL_HINT_PART), 0, "  cleared");
+
+	ResetHintMocks(1);
+	lkp.boot_flags &= ~BOOT_FLAG_KERNEL_HINT;
+	TestLoadKernel(0, "Kernel hint not asked for");
+	TEST_EQ(vb2_nv_get(&ctx, VB2_NV_KERNEL_HINT_PART), 0, "  not stored");
+
+	ResetHintMocks(1);
+	ctx.flags |= VB2_CONTEXT_DEVELOPER_MODE;
+	TestLoadKernel(0, "Kernel hint not stored in dev mode");
+	TEST_EQ(vb2_nv_get(&ctx, VB2_NV_KERNEL_HINT_PART), 0, "  not stored");
+
+	/* Next time, it's loaded without searching the GPT */
+	ResetHintMocks(1);
+	vb2_nv_set(&ctx, VB2_NV_KERNEL_HINT_PART, 1);
+	vb2_nv_set(&ctx, VB2_NV_KERNEL_HINT_GPT_CRC,
+		   mock_gpt_primary->header_crc32);
+	TestLoadKernel(0, "Kernel hint used");
+	TEST_EQ(lkp.partition_number, 1, "  part num");
+	TEST_STR_EQ((char *)lkp.partition_guid, "HintGuid", "  guid");
+	TEST_EQ(lkp.bootloader_address, 0xbeadd008, "  bootloader addr");
+	TEST_EQ(mock_part_next, 0, "  no search");
+	TEST_PTR_NEQ(strstr(call_log, "VbExDiskRead(h, 2, 1)\n"), NULL,
+		     "  read one entries sector");
+	TEST_PTR_EQ(strstr(call_log, secondary_read), NULL,
+		    "  no secondary GPT read");
+	TEST_PTR_EQ(strstr(call_log, "VbExDiskWrite"), NULL, "  no writes");
+	TEST_EQ(shared->kernel_version_tpm, 0x20001, "  tpm version");
+
+	/* Anything else goes back to searching the GPT */
+	ResetHintMocks(1);
+	vb2_nv_set(&ctx, VB2_NV_KERNEL_HINT_PART, 1);
+	vb2_nv_set(&ctx, VB2_NV_KERNEL_HINT_GPT_CRC,
+		   mock_gpt_primary->header_crc32 + 1);
+	TestLoadKernel(0, "Kernel hint for a changed GPT");
+	TEST_EQ(mock_part_next, 1, "  searched");
+	TEST_PTR_NEQ(strstr(call_log, secondary_read), NULL,
+		     "  secondary GPT read");
+	TEST_EQ(vb2_nv_get(&ctx, VB2_NV_KERNEL_HINT_GPT_CRC),
+		mock_gpt_primary->header_crc32, "  hint updated");
+
+	ResetHintMocks(1);
+	vb2_nv_set(&ctx, VB2_NV_KERNEL_HINT_PART, 2);
+	vb2_nv_set(&ctx, VB2_NV_KERNEL_HINT_GPT_CRC,
+		   mock_gpt_primary->header_crc32);
+	TestLoadKernel(0, "Kernel hint for a non-kernel entry");
+	TEST_EQ(mock_part_next, 1, "  searched");
+	TEST_EQ(vb2_nv_get(&ctx, VB2_NV_KERNEL_HINT_PART), 1, "  hint updated");
+
+	ResetHintMocks(1);
+	vb2_nv_set(&ctx, VB2_NV_KERNEL_HINT_PART, 1);
+	vb2_nv_set(&ctx, VB2_NV_KERNEL_HINT_GPT_CRC,
+		   mock_gpt_primary->header_crc32);
+	kph.kernel_version = 2;
+	TestLoadKernel(0, "Kernel hint with a new kernel version");
+	TEST_EQ(mock_part_next, 1, "  searched");
+	TEST_EQ(shared->kernel_version_tpm, 0x20002, "  tpm version");
+	TEST_EQ(LastCallPartsFound(), 1, "  partition recorded once");
+
+	ResetHintMocks(1);
+	vb2_nv_set(&ctx, VB2_NV_KERNEL_HINT_PART, 1);
+	vb2_nv_set(&ctx, VB2_NV_KERNEL_HINT_GPT_CRC,
+		   mock_gpt_primary->header_crc32);
+	key_block_verify_fail = 1;
+	TestLoadKernel(VBERROR_INVALID_KERNEL_FOUND, "Kernel hint bad kernel");
+	TEST_EQ(mock_part_next, 1, "  searched");
+	TEST_EQ(vb2_nv_get(&ctx, VB2_NV_KERNEL_HINT_PART), 0, "  cleared");
+
+	ResetHintMocks(1);
+	vb2_nv_set(&ctx, VB2_NV_KERNEL_HINT_PART, 1);
+	vb2_nv_set(&ctx, VB2_NV_KERNEL_HINT_GPT_CRC,
+		   mock_gpt_primary->header_crc32);
+	ctx.flags |= VB2_CONTEXT_RECOVERY_MODE;
+	TestLoadKernel(0, "Kernel hint not used in recovery");
+	TEST_EQ(mock_part_next, 1, "  searched");
+}
+
 static void LoadKernelTest(void)
 {
+	struct vb2_packed_key embedded_key;
+
 	ResetMocks();
 
 	TestLoadKernel(0, "First kernel good");
@@ -716,6 +1250,23 @@ static void LoadKernelTest(void)
 	kbh.data_key.key_version = 1;
 	ctx.flags |= VB2_CONTEXT_RECOVERY_MODE;
 	TestLoadKernel(0, "Key version ignored in rec mode");
+	TEST_EQ(unpack_key_first_alg, 0, "  gbb recovery key");
+
+	/* A recovery key built into the firmware replaces the GBB one */
+	ResetMocks();
+	embedded_key.algorithm = VB2_ALG_RSA4096_SHA256;
+	embedded_key.key_offset = sizeof(embedded_key);
+	embedded_key.key_size = 0;
+	mock_recovery_key = &embedded_key;
+	ctx.flags |= VB2_CONTEXT_RECOVERY_MODE;
+	TestLoadKernel(0, "Embedded recovery key");
+	TEST_EQ(unpack_key_first_alg, VB2_ALG_RSA4096_SHA256,
+		"  embedded recovery key");
+
+	ResetMocks();
+	mock_recovery_key = &embedded_key;
+	TestLoadKernel(0, "Embedded recovery key not used in normal mode");
+	TEST_EQ(unpack_key_first_alg, 0, "  kernel subkey");
 
 	ResetMocks();
 	unpack_key_fail = 2;
@@ -759,9 +1310,84 @@ static void LoadKernelTest(void)
 	kph.preamble_size |= 0x07;
 	TestLoadKernel(VBERROR_INVALID_KERNEL_FOUND, "Kernel body offset");
 
+	/* The padding past the vblock is skipped, not read */
+	ResetMocks();
+	kph.preamble_size += 65536;
+	mock_parts[0].size = 300;
+	mock_disk[(100 + 136 + 1) * MOCK_SECTOR_SIZE] = 0x5a;
+	TestLoadKernel(0, "Kernel body offset huge");
+	TEST_EQ(kernel_buffer[MOCK_SECTOR_SIZE], 0x5a, "  body data");
+	TEST_STR_EQ(hints_log, "100: 0x3, 80000\n",
+		    "  stream hints limited by kernel buffer");
+	TEST_TRUE(strstr(call_log, "VbExDiskRead(h, 100, 8)\n"
+			 "VbExDiskRead(h, 236, 137)\n") != NULL,
+		  "  reads");
+
+	/* A body which isn't sector aligned has its first sector moved */
+	ResetMocks();
+	kph.preamble_size += 65536 + 16;
+	mock_parts[0].size = 300;
+	mock_disk[(100 + 136) * MOCK_SECTOR_SIZE + 16] = 0x5a;
+	mock_disk[(100 + 137) * MOCK_SECTOR_SIZE + 16] = 0xa5;
+	kph.body_signature.data_size = 496 + 135 * MOCK_SECTOR_SIZE;
+	TestLoadKernel(0, "Kernel body offset unaligned");
+	TEST_EQ(kernel_buffer[0], 0x5a, "  body start");
+	TEST_EQ(kernel_buffer[MOCK_SECTOR_SIZE], 0xa5, "  body data");
+	TEST_TRUE(strstr(call_log, "VbExDiskRead(h, 100, 8)\n"
+			 "VbExDiskRead(h, 236, 1)\n"
+			 "VbExDiskRead(h, 237, 135)\n") != NULL,
+		  "  reads");
+
 	ResetMocks();
 	kph.preamble_size += 65536;
-	TestLoadKernel(VBERROR_INVALID_KERNEL_FOUND, "Kernel body offset huge");
+	disk_read_to_fail = 236;
+	mock_parts[0].size = 300;
+	TestLoadKernel(VBERROR_INVALID_KERNEL_FOUND,
+		       "Fail reading kernel data after skip");
+
+	ResetMocks();
+	kph.preamble_size += 65536;
+	TestLoadKernel(VBERROR_INVALID_KERNEL_FOUND,
+		       "Kernel body offset past partition");
+
+	/* Only the signed part of a padded vblock is read */
+	ResetMocks();
+	kph.preamble_size = 65536 - kbh.key_block_size;
+	kph.preamble_signature.data_size = 1024;
+	memcpy(mock_disk + 100 * MOCK_SECTOR_SIZE, &kbh, sizeof(kbh));
+	memcpy(mock_disk + 100 * MOCK_SECTOR_SIZE + kbh.key_block_size,
+	       &kph, sizeof(kph));
+	mock_parts[0].size = 300;
+	TestLoadKernel(0, "Padded vblock");
+	TEST_TRUE(strstr(call_log, "VbExDiskRead(h, 100, 8)\n"
+			 "VbExDiskRead(h, 228, 137)\n") != NULL,
+		  "  reads");
+
+	/* Signed data past the initial read is fetched */
+	ResetMocks();
+	kph.preamble_size = 65536 - kbh.key_block_size;
+	kph.preamble_signature.data_size = 6000;
+	memcpy(mock_disk + 100 * MOCK_SECTOR_SIZE, &kbh, sizeof(kbh));
+	memcpy(mock_disk + 100 * MOCK_SECTOR_SIZE + kbh.key_block_size,
+	       &kph, sizeof(kph));
+	mock_parts[0].size = 300;
+	TestLoadKernel(0, "Padded vblock big preamble");
+	TEST_TRUE(strstr(call_log, "VbExDiskRead(h, 100, 8)\n"
+			 "VbExDiskRead(h, 108, 4)\n"
+			 "VbExDiskRead(h, 228, 137)\n") != NULL,
+		  "  reads");
+
+	/* Other kernels are only checked as far as their vblocks */
+	ResetMocks();
+	kph.kernel_version = 2;
+	mock_parts[1].start = 300;
+	mock_parts[1].size = 150;
+	TestLoadKernel(0, "Vblock only");
+	TEST_EQ(mock_part_next, 2, "  read second one");
+	TEST_TRUE(strstr(call_log, "VbExDiskRead(h, 300, 8)\n") != NULL,
+		  "  vblock read");
+	TEST_PTR_EQ(strstr(call_log, "VbExDiskRead(h, 308"), NULL,
+		    "  no body read");
 
 	/* Check getting kernel load address from header */
 	ResetMocks();
@@ -787,7 +1413,7 @@ static void LoadKernelTest(void)
 	TestLoadKernel(0, "Kernel tiny");
 
 	ResetMocks();
-	disk_read_to_fail = 228;
+	disk_read_to_fail = 108;
 	TestLoadKernel(VBERROR_INVALID_KERNEL_FOUND,
 		       "Fail reading kernel data");
 
@@ -795,6 +1421,166 @@ static void LoadKernelTest(void)
 	verify_data_fail = 1;
 	TestLoadKernel(VBERROR_INVALID_KERNEL_FOUND, "Bad data");
 
+	/* Read and hash the body in chunks */
+	ResetMocks();
+	lkp.body_chunk_size = 4096;
+	mock_disk[240 * MOCK_SECTOR_SIZE] = 0x5a;
+	TestLoadKernel(0, "Chunked body");
+	TEST_EQ(lkp.partition_number, 1, "  part num");
+	TEST_EQ(kernel_buffer[(240 - 100) * MOCK_SECTOR_SIZE - 4096], 0x5a,
+		"  body data");
+	TEST_TRUE(strstr(call_log, "VbExStreamReadAsync(s, 4096)\n"
+			 "VbExDiskRead(h, 228, 8)\n"
+			 "VbExStreamWait(s)\n"
+			 "VbExStreamReadAsync(s, 4096)\n"
+			 "VbExDiskRead(h, 236, 8)\n"
+			 "VbExStreamWait(s)\n"
+			 "VbExStreamReadAsync(s, 512)\n"
+			 "VbExDiskRead(h, 244, 1)\n"
+			 "VbExStreamWait(s)\n") != NULL,
+		  "  chunk reads");
+
+	ResetMocks();
+	lkp.body_chunk_size = 4096;
+	kph.body_signature.data_size = 8192;
+	TestLoadKernel(0, "Chunked body tiny");
+
+	ResetMocks();
+	lkp.body_chunk_size = 4096;
+	disk_read_to_fail = 236;
+	TestLoadKernel(VBERROR_INVALID_KERNEL_FOUND,
+		       "Chunked body read fail");
+
+	ResetMocks();
+	lkp.body_chunk_size = 4096;
+	stream_wait_fail = 2;
+	TestLoadKernel(VBERROR_INVALID_KERNEL_FOUND,
+		       "Chunked body wait fail");
+
+	ResetMocks();
+	lkp.body_chunk_size = 4096;
+	verify_digest_fail = 1;
+	TestLoadKernel(VBERROR_INVALID_KERNEL_FOUND, "Chunked body bad data");
+
+	/* Check each chunk against the digests in the preamble */
+	ResetMocks();
+	kph.header_version_minor = 3;
+	kph.body_chunk_size = 32768;
+	verify_data_fail = 1;
+	TestLoadKernel(0, "Body digests");
+	TEST_TRUE(strstr(call_log, "VbExDiskRead(h, 108, 64)\n"
+			 "VbExStreamReadAsync(s, 32768)\n"
+			 "VbExDiskRead(h, 172, 64)\n"
+			 "vb2_verify_kernel_body_chunk(0, 32768)\n"
+			 "VbExStreamWait(s)\n"
+			 "VbExStreamReadAsync(s, 4608)\n"
+			 "VbExDiskRead(h, 236, 9)\n"
+			 "vb2_verify_kernel_body_chunk(1, 32768)\n"
+			 "VbExStreamWait(s)\n"
+			 "vb2_verify_kernel_body_chunk(2, 4608)\n") != NULL,
+		  "  chunks checked as they load");
+
+	ResetMocks();
+	kph.header_version_minor = 3;
+	kph.body_chunk_size = 32768;
+	verify_chunk_fail = 1;
+	TestLoadKernel(VBERROR_INVALID_KERNEL_FOUND, "Body digest bad chunk");
+	TEST_PTR_EQ(strstr(call_log, "vb2_verify_kernel_body_chunk(2"), NULL,
+		    "  stops at the bad chunk");
+
+	ResetMocks();
+	kph.header_version_minor = 3;
+	kph.body_chunk_size = 32768;
+	disk_read_to_fail = 172;
+	TestLoadKernel(VBERROR_INVALID_KERNEL_FOUND, "Body digest read fail");
+
+	ResetMocks();
+	kph.header_version_minor = 3;
+	kph.body_chunk_size = 32768;
+	stream_wait_fail = 1;
+	TestLoadKernel(VBERROR_INVALID_KERNEL_FOUND, "Body digest wait fail");
+
+	/* Load a compressed body, verifying it as stored */
+	ResetMocks();
+	kph.header_version_minor = 4;
+	kph.flags = VB2_KERNEL_COMPRESSION_LZ4 <<
+		VB2_KERNEL_PREAMBLE_COMPRESSION_SHIFT;
+	kph.body_load_size = kph.body_signature.data_size;
+	mock_disk[240 * MOCK_SECTOR_SIZE] = 0x5a;
+	TestLoadKernel(0, "Compressed body");
+	TEST_EQ(kernel_buffer[(240 - 108) * MOCK_SECTOR_SIZE], 0x5a,
+		"  body data");
+	TEST_TRUE(strstr(call_log, "VbExDecompressStart(2, 80000)\n"
+			 "VbExStreamReadAsync(s, 16384)\n") != NULL,
+		  "  decompressed as it loads");
+	TEST_TRUE(strstr(call_log, "VbExDecompressFinish(70144)\n") != NULL,
+		  "  decompressed whole body");
+
+	ResetMocks();
+	kph.header_version_minor = 4;
+	kph.flags = VB2_KERNEL_COMPRESSION_LZMA <<
+		VB2_KERNEL_PREAMBLE_COMPRESSION_SHIFT;
+	kph.body_load_size = kph.body_signature.data_size;
+	kph.body_signature.data_size = 8192;
+	TestLoadKernel(VBERROR_INVALID_KERNEL_FOUND,
+		       "Compressed body decompresses to wrong size");
+	TEST_EQ(decompress_finish_calls, 1, "  finished");
+
+	ResetMocks();
+	kph.header_version_minor = 4;
+	kph.flags = VB2_KERNEL_COMPRESSION_LZ4 <<
+		VB2_KERNEL_PREAMBLE_COMPRESSION_SHIFT;
+	kph.body_load_size = sizeof(kernel_buffer) + 1;
+	kph.body_signature.data_size = 8192;
+	TestLoadKernel(VBERROR_INVALID_KERNEL_FOUND,
+		       "Compressed body too big for buffer");
+	TEST_EQ(decompress_finish_calls, 0, "  not started");
+
+	ResetMocks();
+	kph.header_version_minor = 4;
+	kph.flags = VB2_KERNEL_COMPRESSION_LZ4 <<
+		VB2_KERNEL_PREAMBLE_COMPRESSION_SHIFT;
+	kph.body_load_size = kph.body_signature.data_size;
+	decompress_start_fail = 1;
+	TestLoadKernel(VBERROR_INVALID_KERNEL_FOUND,
+		       "Compressed body unsupported");
+	TEST_EQ(decompress_finish_calls, 0, "  not started");
+
+	ResetMocks();
+	kph.header_version_minor = 4;
+	kph.flags = VB2_KERNEL_COMPRESSION_LZ4 <<
+		VB2_KERNEL_PREAMBLE_COMPRESSION_SHIFT;
+	kph.body_load_size = kph.body_signature.data_size;
+	decompress_feed_fail = 2;
+	TestLoadKernel(VBERROR_INVALID_KERNEL_FOUND,
+		       "Compressed body bad data");
+	TEST_EQ(decompress_finish_calls, 1, "  finished");
+
+	ResetMocks();
+	kph.header_version_minor = 4;
+	kph.flags = VB2_KERNEL_COMPRESSION_LZ4 <<
+		VB2_KERNEL_PREAMBLE_COMPRESSION_SHIFT;
+	kph.body_load_size = kph.body_signature.data_size;
+	disk_read_to_fail = 140;
+	TestLoadKernel(VBERROR_INVALID_KERNEL_FOUND,
+		       "Compressed body read fail");
+	TEST_EQ(decompress_finish_calls, 1, "  finished");
+
+	ResetMocks();
+	kph.header_version_minor = 4;
+	kph.flags = VB2_KERNEL_COMPRESSION_LZ4 <<
+		VB2_KERNEL_PREAMBLE_COMPRESSION_SHIFT;
+	kph.body_load_size = kph.body_signature.data_size;
+	verify_digest_fail = 1;
+	TestLoadKernel(VBERROR_INVALID_KERNEL_FOUND,
+		       "Compressed body bad signature");
+
+	/* Older preambles don't have digests */
+	ResetMocks();
+	kph.body_chunk_size = 32768;
+	verify_data_fail = 1;
+	TestLoadKernel(VBERROR_INVALID_KERNEL_FOUND, "Body digests need 2.3");
+
 	/* Check that EXTERNAL_GPT flag makes it down */
 	ResetMocks();
 	lkp.boot_flags |= BOOT_FLAG_EXTERNAL_GPT;
@@ -807,11 +1593,218 @@ static void LoadKernelTest(void)
 	TestLoadKernel(0, "Can't read disk");
 }
 
+/**
+ * Put the vblock on the mock disk, and set up an initialized context so
+ * LoadKernel() can keep its vblock verification cache in the work buffer.
+ */
+static void ResetCacheMocks(void)
+{
+	uint8_t *part = mock_disk + mock_parts[0].start * MOCK_SECTOR_SIZE;
+
+	ResetMocks();
+	memcpy(part, &kbh, sizeof(kbh));
+	memcpy(part + kbh.key_block_size, &kph, sizeof(kph));
+	ctx.workbuf_used = vb2_wb_round_up(sizeof(struct vb2_shared_data));
+}
+
+static int LastPartFlags(void)
+{
+	return shared->lk_calls[(shared->lk_call_count - 1) &
+				(VBSD_MAX_KERNEL_CALLS - 1)].parts[0].flags;
+}
+
+/* Call LoadKernel() again on the same disk */
+static void TestReloadKernel(int expect_retval, char *test_name)
+{
+	mock_part_next = 0;
+	TestLoadKernel(expect_retval, test_name);
+}
+
+/**
+ * Test the vblock verification cache across LoadKernel() calls
+ */
+static void VblockCacheTest(void)
+{
+	uint8_t *part;
+
+	ResetCacheMocks();
+	TestReloadKernel(0, "Cache first load");
+	TEST_EQ(key_block_verify_calls, 1, "  key block verified");
+	TEST_EQ(preamble_verify_calls, 1, "  preamble verified");
+	TEST_EQ(LastPartFlags() & VBSD_LKP_FLAG_VBLOCK_CACHED, 0,
+		"  not cached yet");
+	TestReloadKernel(0, "Cache hit");
+	TEST_EQ(key_block_verify_calls, 1, "  key block not reverified");
+	TEST_EQ(preamble_verify_calls, 1, "  preamble not reverified");
+	TEST_NEQ(LastPartFlags() & VBSD_LKP_FLAG_VBLOCK_CACHED, 0,
+		 "  cached flag");
+	TEST_NEQ(LastPartFlags() & VBSD_LKP_FLAG_KEY_BLOCK_VALID, 0,
+		 "  key block valid");
+	TEST_EQ(lkp.partition_number, 1, "  part num");
+
+	/* Rollback is still checked on a cache hit */
+	shared->kernel_version_tpm = 0x20002;
+	TestReloadKernel(VBERROR_INVALID_KERNEL_FOUND, "Cache hit rollback");
+	TEST_EQ(key_block_verify_calls, 1, "  key block not reverified");
+
+	/* Different disk misses the cache */
+	ResetCacheMocks();
+	TestReloadKernel(0, "Cache first load");
+	lkp.disk_handle = (VbExDiskHandle_t)2;
+	TestReloadKernel(0, "Cache other disk");
+	TEST_EQ(key_block_verify_calls, 2, "  key block verified");
+	TestReloadKernel(0, "Cache other disk again");
+	TEST_EQ(key_block_verify_calls, 2, "  key block not reverified");
+
+	/* Changed vblock misses the cache */
+	ResetCacheMocks();
+	TestReloadKernel(0, "Cache first load");
+	part = mock_disk + mock_parts[0].start * MOCK_SECTOR_SIZE;
+	part[kbh.key_block_size + kph.preamble_size - 1] ^= 0x01;
+	TestReloadKernel(0, "Cache changed vblock");
+	TEST_EQ(preamble_verify_calls, 2, "  preamble verified");
+
+	/* Bytes past the preamble aren't part of the vblock */
+	ResetCacheMocks();
+	TestReloadKernel(0, "Cache first load");
+	part = mock_disk + mock_parts[0].start * MOCK_SECTOR_SIZE;
+	part[kbh.key_block_size + kph.preamble_size] ^= 0x01;
+	TestReloadKernel(0, "Cache changed body");
+	TEST_EQ(preamble_verify_calls, 1, "  preamble not reverified");
+
+	/* Unparseable vblocks are not cached */
+	ResetMocks();
+	ctx.workbuf_used = vb2_wb_round_up(sizeof(struct vb2_shared_data));
+	TestReloadKernel(0, "Cache empty vblock");
+	TestReloadKernel(0, "  again");
+	TEST_EQ(key_block_verify_calls, 2, "  key block verified");
+
+	/* Self-signed keyblocks are not cached */
+	ResetCacheMocks();
+	ctx.flags |= VB2_CONTEXT_DEVELOPER_MODE;
+	key_block_verify_fail = 1;
+	TestReloadKernel(0, "Cache self-signed");
+	TestReloadKernel(0, "  again");
+	TEST_EQ(key_block_verify_calls, 2, "  key block verified");
+
+	/* Preamble failures are not cached */
+	ResetCacheMocks();
+	preamble_verify_fail = 1;
+	TestReloadKernel(VBERROR_INVALID_KERNEL_FOUND, "Cache bad preamble");
+	TestReloadKernel(VBERROR_INVALID_KERNEL_FOUND, "  again");
+	TEST_EQ(preamble_verify_calls, 2, "  preamble verified");
+}
+
+/* Number of times a string appears in the call log */
+static int CountCalls(const char *call)
+{
+	const char *p = call_log;
+	int count = 0;
+
+	while ((p = strstr(p, call))) {
+		count++;
+		p += strlen(call);
+	}
+	return count;
+}
+
+static VbSharedDataKernelPart *LastPart(int index)
+{
+	return shared->lk_calls[(shared->lk_call_count - 1) &
+				(VBSD_MAX_KERNEL_CALLS - 1)].parts + index;
+}
+
+/**
+ * Test checking the next candidate's vblock before loading a body
+ */
+static void PeekNextVblockTest(void)
+{
+	/* The next vblock is read before the body of the first kernel */
+	ResetMocks();
+	lkp.boot_flags |= BOOT_FLAG_PEEK_NEXT_VBLOCK;
+	mock_parts[1].start = 300;
+	mock_parts[1].size = 150;
+	TestLoadKernel(0, "Peek next vblock");
+	TEST_EQ(lkp.partition_number, 1, "  part num");
+	TEST_TRUE(strstr(call_log, "VbExDiskRead(h, 300, 8)\n"
+			 "VbExDiskRead(h, 100, 8)\n"
+			 "VbExDiskRead(h, 108, 137)\n") != NULL,
+		  "  reads");
+	TEST_STR_EQ(hints_log, "300: 0x1, 4096\n"
+		    "100: 0x3, 76800\n", "  stream hints");
+	TEST_EQ(key_block_verify_calls, 2, "  key blocks verified");
+
+	/* Nothing to peek at past the last kernel */
+	ResetMocks();
+	lkp.boot_flags |= BOOT_FLAG_PEEK_NEXT_VBLOCK;
+	TestLoadKernel(0, "Peek no next kernel");
+	TEST_EQ(key_block_verify_calls, 1, "  key block verified");
+
+	/* The rollback check of the next kernel uses the early check */
+	ResetMocks();
+	lkp.boot_flags |= BOOT_FLAG_PEEK_NEXT_VBLOCK;
+	kph.kernel_version = 2;
+	mock_parts[1].start = 300;
+	mock_parts[1].size = 150;
+	TestLoadKernel(0, "Peek then rollback check");
+	TEST_EQ(CountCalls("VbExDiskRead(h, 300, 8)\n"), 1,
+		"  next vblock read once");
+	TEST_EQ(key_block_verify_calls, 2, "  key blocks verified");
+	TEST_EQ(shared->kernel_version_tpm, 0x20002, "  shared version");
+
+	/* A bad body, then a bad vblock which isn't read again */
+	ResetMocks();
+	lkp.boot_flags |= BOOT_FLAG_PEEK_NEXT_VBLOCK;
+	key_block_verify_fail_call = 1;
+	verify_data_fail = 1;
+	mock_parts[1].start = 300;
+	mock_parts[1].size = 150;
+	TestLoadKernel(VBERROR_INVALID_KERNEL_FOUND, "Peek bad next vblock");
+	TEST_EQ(CountCalls("VbExDiskRead(h, 300, 8)\n"), 1,
+		"  next vblock read once");
+	TEST_EQ(key_block_verify_calls, 2, "  key blocks verified");
+	TEST_EQ(LastPart(0)->check_result, VBSD_LKP_CHECK_VERIFY_DATA,
+		"  first body bad");
+	TEST_EQ(LastPart(1)->check_result, VBSD_LKP_CHECK_SELF_SIGNED,
+		"  next key block bad");
+	TEST_EQ(LastPart(1)->gpt_index, 2, "  next gpt index");
+
+	/* A bad body, then a good kernel, peeking at the one after that */
+	ResetMocks();
+	lkp.boot_flags |= BOOT_FLAG_PEEK_NEXT_VBLOCK;
+	verify_data_fail_call = 1;
+	mock_parts[1].start = 300;
+	mock_parts[1].size = 150;
+	mock_parts[2].start = 500;
+	mock_parts[2].size = 150;
+	TestLoadKernel(0, "Peek good next kernel");
+	TEST_EQ(lkp.partition_number, 2, "  part num");
+	TEST_EQ(verify_data_calls, 2, "  bodies verified");
+	TEST_EQ(CountCalls("VbExDiskRead(h, 300, 8)\n"), 2,
+		"  next vblock read again to load it");
+	TEST_EQ(CountCalls("VbExDiskRead(h, 500, 8)\n"), 1,
+		"  one after that peeked at");
+	TEST_EQ(LastPart(1)->check_result, VBSD_LKP_CHECK_KERNEL_GOOD,
+		"  next kernel good");
+
+	/* A kernel found without peeking doesn't read any others */
+	ResetMocks();
+	mock_parts[1].start = 300;
+	mock_parts[1].size = 150;
+	TestLoadKernel(0, "No peek");
+	TEST_EQ(CountCalls("VbExDiskRead(h, 300"), 0, "  next not read");
+}
+
 int main(void)
 {
 	ReadWriteGptTest();
 	InvalidParamsTest();
+	LoadKernelRankTest();
+	PrefetchGptTest();
+	KernelHintTest();
 	LoadKernelTest();
+	VblockCacheTest();
+	PeekNextVblockTest();
 
 	return gTestSuccess ? 0 : 255;
 }
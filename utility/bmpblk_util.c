@@ -10,57 +10,42 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
-#include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
 
 #include "bmpblk_util.h"
 #include "eficompress.h"
+#include "host_jobs.h"
+#include "host_misc.h"
 #include "vboot_api.h"
 
-// Returns pointer to buffer containing entire file, sets length.
-static void *read_entire_file(const char *filename, size_t *length) {
-  int fd;
-  struct stat sbuf;
-  void *ptr;
-
+// Returns pointer to buffer containing entire file, sets length and the view
+// holding it.
+static void *read_entire_file(const char *filename, size_t *length,
+                              struct vb2_file_view **view) {
   *length = 0;                          // just in case
 
-  if (0 != stat(filename, &sbuf)) {
-    fprintf(stderr, "Unable to stat %s: %s\n", filename, strerror(errno));
+  if (vb2_file_view_open(filename, 0, view)) {
+    fprintf(stderr, "Unable to read %s: %s\n", filename, strerror(errno));
     return 0;
   }
 
-  if (!sbuf.st_size) {
+  if (!(*view)->size) {
     fprintf(stderr, "File %s is empty\n", filename);
+    vb2_file_view_put(*view);
+    *view = 0;
     return 0;
   }
 
-  fd = open(filename, O_RDONLY);
-  if (fd < 0) {
-    fprintf(stderr, "Unable to open %s: %s\n", filename, strerror(errno));
-    return 0;
-  }
-
-  ptr = mmap(0, sbuf.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
-  if (MAP_FAILED == ptr) {
-    fprintf(stderr, "Unable to mmap %s: %s\n", filename, strerror(errno));
-    close(fd);
-    return 0;
-  }
-
-  *length = sbuf.st_size;
-
-  close(fd);
-
-  return ptr;
+  *length = (*view)->size;
+  return (*view)->data;
 }
 
 
 // Reclaims buffer from read_entire_file().
-static void discard_file(void *ptr, size_t length) {
-  munmap(ptr, length);
+static void discard_file(struct vb2_file_view *view) {
+  vb2_file_view_put(view);
 }
 
 //////////////////////////////////////////////////////////////////////////////
@@ -186,10 +171,107 @@ static void *do_lzma_decompress(ImageInfo *img) {
 
 
 
+// Decompress one image and write it to todir, named for its offset.
+// Returns 0 on success, 1 on error.
+static int write_image(const char *todir, int overwrite, void *ptr,
+                       int offset) {
+  ImageInfo *img = (ImageInfo *)(ptr + offset);
+  char full_path_name[PATH_MAX];
+  void *data_ptr;
+  int free_data;
+  int bfd;
+  FILE *bfp;
+  int rv = 0;
+
+  sprintf(full_path_name, "%s/img_%08x.bmp", todir, offset);
+  bfd = open(full_path_name,
+             O_WRONLY | O_CREAT | O_TRUNC | (overwrite ? 0 : O_EXCL),
+             0666);
+  if (bfd < 0) {
+    fprintf(stderr, "Unable to open %s: %s\n", full_path_name,
+            strerror(errno));
+    return 1;
+  }
+  bfp = fdopen(bfd, "wb");
+  if (!bfp) {
+    fprintf(stderr, "Unable to fdopen %s: %s\n", full_path_name,
+            strerror(errno));
+    close(bfd);
+    return 1;
+  }
+  switch(img->compression) {
+  case COMPRESS_NONE:
+    data_ptr = ptr + offset + sizeof(ImageInfo);
+    free_data = 0;
+    break;
+  case COMPRESS_EFIv1:
+    data_ptr = do_efi_decompress(img);
+    free_data = 1;
+    break;
+  case COMPRESS_LZMA1:
+    data_ptr = do_lzma_decompress(img);
+    free_data = 1;
+    break;
+  default:
+    fprintf(stderr, "Unsupported compression method encountered.\n");
+    data_ptr = 0;
+    free_data = 0;
+    break;
+  }
+  if (!data_ptr) {
+    fclose(bfp);
+    return 1;
+  }
+  if (1 != fwrite(data_ptr, img->original_size, 1, bfp)) {
+    fprintf(stderr, "Unable to write %s: %s\n", full_path_name,
+            strerror(errno));
+    rv = 1;
+  }
+  fclose(bfp);
+  if (free_data)
+    free(data_ptr);
+  return rv;
+}
+
+// Work shared by the threads unpacking images.
+struct unpack_job {
+  const char *todir;
+  int overwrite;
+  void *ptr;
+  int *offsets;                 // offsets of the images to unpack
+  int failed;
+};
+
+static void unpack_one(void *ctx, int i) {
+  struct unpack_job *job = ctx;
+
+  if (write_image(job->todir, job->overwrite, job->ptr, job->offsets[i]))
+    __sync_fetch_and_or(&job->failed, 1);
+}
+
+// Unpack the images at the given offsets, one thread per CPU. Each image is
+// written to its own file, named for its offset, so the output doesn't depend
+// on the order the threads finish in. Returns 0 on success, 1 on error.
+static int unpack_images(const char *todir, int overwrite, void *ptr,
+                         int *offsets, int count) {
+  struct unpack_job job;
+
+  job.todir = todir;
+  job.overwrite = overwrite;
+  job.ptr = ptr;
+  job.offsets = offsets;
+  job.failed = 0;
+
+  vb2_run_jobs(unpack_one, &job, count, sysconf(_SC_NPROCESSORS_ONLN));
+
+  return job.failed;
+}
+
 // Show what's inside. If todir is NULL, just print. Otherwise unpack.
 int dump_bmpblock(const char *infile, int show_as_yaml,
                   const char *todir, int overwrite) {
-  void *ptr, *data_ptr;
+  struct vb2_file_view *view = 0;
+  void *ptr;
   size_t length = 0;
   BmpBlockHeader *hdr;
   ImageInfo *img;
@@ -198,33 +280,33 @@ int dump_bmpblock(const char *infile, int show_as_yaml,
   int screen_num;
   int i;
   int offset;
-  int free_data;
   char image_name[80];
   char full_path_name[PATH_MAX];
-  int yfd, bfd;
+  int yfd;
   FILE *yfp = stdout;
-  FILE *bfp = stdout;
+  int *images = NULL;
+  int num_images = 0;
 
-  ptr = (void *)read_entire_file(infile, &length);
+  ptr = read_entire_file(infile, &length, &view);
   if (!ptr)
     return 1;
 
   if (length < sizeof(BmpBlockHeader)) {
     fprintf(stderr, "File %s is too small to be a BMPBLOCK\n", infile);
-    discard_file(ptr, length);
+    discard_file(view);
     return 1;
   }
 
   if (0 != memcmp(ptr, BMPBLOCK_SIGNATURE, BMPBLOCK_SIGNATURE_SIZE)) {
     fprintf(stderr, "File %s is not a BMPBLOCK\n", infile);
-    discard_file(ptr, length);
+    discard_file(view);
     return 1;
   }
 
   if (todir) {
     // Unpacking everything. Create the output directory if needed.
     if (0 != require_dir(todir)) {
-      discard_file(ptr, length);
+      discard_file(view);
       return 1;
     }
 
@@ -238,7 +320,7 @@ int dump_bmpblock(const char *infile, int show_as_yaml,
     if (yfd < 0) {
       fprintf(stderr, "Unable to open %s: %s\n", full_path_name,
               strerror(errno));
-      discard_file(ptr, length);
+      discard_file(view);
       return 1;
     }
 
@@ -247,7 +329,7 @@ int dump_bmpblock(const char *infile, int show_as_yaml,
       fprintf(stderr, "Unable to fdopen %s: %s\n", full_path_name,
               strerror(errno));
       close(yfd);
-      discard_file(ptr, length);
+      discard_file(view);
       return 1;
     }
   }
@@ -260,7 +342,7 @@ int dump_bmpblock(const char *infile, int show_as_yaml,
     printf("  %d screens\n", hdr->number_of_screenlayouts);
     printf("  %d localizations\n", hdr->number_of_localizations);
     printf("  %d discrete images\n", hdr->number_of_imageinfos);
-    discard_file(ptr, length);
+    discard_file(view);
     return 0;
   }
 
@@ -282,6 +364,16 @@ int dump_bmpblock(const char *infile, int show_as_yaml,
   if (img->compression)
     fprintf(yfp, "compression: %d\n", img->compression);
   fprintf(yfp, "images:\n");
+  if (todir) {
+    // Note which images to unpack, to do them all at once afterwards.
+    images = calloc(hdr->number_of_imageinfos, sizeof(*images));
+    if (!images && hdr->number_of_imageinfos) {
+      fprintf(stderr, "Can't allocate image list\n");
+      fclose(yfp);
+      discard_file(view);
+      return 1;
+    }
+  }
   for(i=0; i<hdr->number_of_imageinfos; i++) {
     img = (ImageInfo *)(ptr + offset);
     if (img->compressed_size) {
@@ -305,71 +397,8 @@ int dump_bmpblock(const char *infile, int show_as_yaml,
                 img->compressed_size, img->original_size,
                 img->tag, img->format);
       }
-      if (todir) {
-        sprintf(full_path_name, "%s/%s", todir, image_name);
-        bfd = open(full_path_name,
-                   O_WRONLY | O_CREAT | O_TRUNC | (overwrite ? 0 : O_EXCL),
-                   0666);
-        if (bfd < 0) {
-          fprintf(stderr, "Unable to open %s: %s\n", full_path_name,
-                  strerror(errno));
-          fclose(yfp);
-          discard_file(ptr, length);
-          return 1;
-        }
-        bfp = fdopen(bfd, "wb");
-        if (!bfp) {
-          fprintf(stderr, "Unable to fdopen %s: %s\n", full_path_name,
-                  strerror(errno));
-          close(bfd);
-          fclose(yfp);
-          discard_file(ptr, length);
-          return 1;
-        }
-        switch(img->compression) {
-        case COMPRESS_NONE:
-          data_ptr = ptr + offset + sizeof(ImageInfo);
-          free_data = 0;
-          break;
-        case COMPRESS_EFIv1:
-          data_ptr = do_efi_decompress(img);
-          if (!data_ptr) {
-            fclose(bfp);
-            fclose(yfp);
-            discard_file(ptr, length);
-            return 1;
-          }
-          free_data = 1;
-          break;
-        case COMPRESS_LZMA1:
-          data_ptr = do_lzma_decompress(img);
-          if (!data_ptr) {
-            fclose(bfp);
-            fclose(yfp);
-            discard_file(ptr, length);
-            return 1;
-          }
-          free_data = 1;
-          break;
-        default:
-          fprintf(stderr, "Unsupported compression method encountered.\n");
-          fclose(bfp);
-          fclose(yfp);
-          discard_file(ptr, length);
-          return 1;
-        }
-        if (1 != fwrite(data_ptr, img->original_size, 1, bfp)) {
-          fprintf(stderr, "Unable to write %s: %s\n", full_path_name,
-                  strerror(errno));
-          fclose(bfp);
-          fclose(yfp);
-          discard_file(ptr, length);
-          return 1;
-        }
-        fclose(bfp);
-        if (free_data)
-          free(data_ptr);
-      }
+      if (todir)
+        images[num_images++] = offset;
     }
     offset += sizeof(ImageInfo);
     offset += img->compressed_size;
@@ -377,6 +406,15 @@ int dump_bmpblock(const char *infile, int show_as_yaml,
     if ((offset & 3) > 0)
       offset = (offset & ~3) + 4;
   }
+  if (todir) {
+    i = unpack_images(todir, overwrite, ptr, images, num_images);
+    free(images);
+    if (i) {
+      fclose(yfp);
+      discard_file(view);
+      return 1;
+    }
+  }
   fprintf(yfp, "screens:\n");
   for(loc_num = 0;
       loc_num < hdr->number_of_localizations;
@@ -448,7 +486,7 @@ int dump_bmpblock(const char *infile, int show_as_yaml,
   if (todir)
     fclose(yfp);
 
-  discard_file(ptr, length);
+  discard_file(view);
 
   return 0;
 }
@@ -9,21 +9,34 @@
 #include <errno.h>
 #include <getopt.h>
 #include <lzma.h>
+#include <pthread.h>
 #include <stdarg.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 #include <yaml.h>
 
+#include <set>
+
 #include "bmpblk_utility.h"
 #include "image_types.h"
 #include "vboot_api.h"
 
 extern "C" {
+#include "2sysincludes.h"
+#include "2common.h"
+#include "2sha.h"
 #include "eficompress.h"
+#include "host_jobs.h"
+#include "host_misc.h"
 }
 
+// Bump this whenever the compressed output for the same input changes, so
+// that older entries in a cache directory are no longer used.
+#define IMAGE_CACHE_VERSION 1
+
 
 static void error(const char *format, ...) {
   va_list ap;
@@ -51,10 +64,12 @@ namespace vboot_reference {
     set_compression_ = false;
     compression_ = COMPRESS_NONE;
     debug_ = debug;
+    job_compress_ = false;
     render_hwid_ = true;
     support_font_ = true;
     got_font_ = false;
     got_rtol_font_ = false;
+    cache_dir_.clear();
   }
 
   BmpBlockUtil::~BmpBlockUtil() {
@@ -65,6 +80,10 @@ namespace vboot_reference {
     set_compression_ = true;
   }
 
+  void BmpBlockUtil::use_cache(const char *dirname) {
+    cache_dir_ = dirname;
+  }
+
   void BmpBlockUtil::load_from_config(const char *filename) {
     load_yaml_config(filename);
     fill_bmpblock_header();
@@ -385,7 +404,27 @@ namespace vboot_reference {
     }
   }
 
+  // Orders images by their contents, so that identical files compare equal.
+  struct ContentLess {
+    bool operator()(const ImageConfig *a, const ImageConfig *b) const {
+      return a->raw_content < b->raw_content;
+    }
+  };
+
+  // Orders images by what would be stored for them in the BMPBLOCK, so that
+  // images which can share one copy compare equal.
+  struct StoredLess {
+    bool operator()(const ImageConfig *a, const ImageConfig *b) const {
+      int r = memcmp(&a->data, &b->data, sizeof(a->data));
+      if (r)
+        return r < 0;
+      return a->compressed_content < b->compressed_content;
+    }
+  };
+
   void BmpBlockUtil::load_all_image_files() {
+    vector<ImageConfig *> images;
+    std::set<ImageConfig *> listed;
     for (unsigned int i = 0; i < config_.image_names.size(); i++) {
       StrImageConfigMap::iterator it =
         config_.images_map.find(config_.image_names[i]);
@@ -394,73 +433,197 @@ namespace vboot_reference {
                config_.image_names[i].c_str(),
                it->second.filename.c_str());
       }
-      const string &content = read_image_file(it->second.filename.c_str());
-      it->second.raw_content = content;
-      it->second.data.original_size = content.size();
-      it->second.data.format =
-        identify_image_type(content.c_str(),
-                            (uint32_t)content.size(), &it->second.data);
-      if (FORMAT_INVALID == it->second.data.format) {
-        error("Unsupported image format in %s\n", it->second.filename.c_str());
-      }
-      switch(compression_) {
-      case COMPRESS_NONE:
-        it->second.data.compression = compression_;
-        it->second.compressed_content = content;
-        it->second.data.compressed_size = content.size();
-        break;
-      case COMPRESS_EFIv1:
-      {
-        // The content will always compress smaller (so sez the docs).
-        uint32_t tmpsize = content.size();
-        uint8_t *tmpbuf = (uint8_t *)malloc(tmpsize);
-        // The size of the compressed content is also returned.
-        if (EFI_SUCCESS != EfiCompress((uint8_t *)content.c_str(), tmpsize,
-                                       tmpbuf, &tmpsize)) {
-          error("Unable to compress!\n");
-        }
-        it->second.data.compression = compression_;
-        it->second.compressed_content.assign((const char *)tmpbuf, tmpsize);
-        it->second.data.compressed_size = tmpsize;
-        free(tmpbuf);
-      }
-      break;
-      case COMPRESS_LZMA1:
-      {
-        // Calculate the worst case of buffer size.
-        uint32_t tmpsize = lzma_stream_buffer_bound(content.size());
-        uint8_t *tmpbuf = (uint8_t *)malloc(tmpsize);
-        lzma_stream stream = LZMA_STREAM_INIT;
-        lzma_options_lzma options;
-        lzma_ret result;
-
-        lzma_lzma_preset(&options, 9);
-        result = lzma_alone_encoder(&stream, &options);
-        if (result != LZMA_OK) {
-          error("Unable to initialize easy encoder (error: %d)!\n", result);
-        }
+      if (listed.insert(&it->second).second)
+        images.push_back(&it->second);
+    }
+    run_image_jobs(images, false);
+
+    /* The same file is often listed under several names, for different
+     * locales. Compress each distinct image only once. */
+    typedef map<ImageConfig *, ImageConfig *, ContentLess> ContentMap;
+    ContentMap first_copy;
+    vector<ImageConfig *> unique;
+    for (unsigned int i = 0; i < images.size(); i++) {
+      if (first_copy.insert(std::make_pair(images[i], images[i])).second)
+        unique.push_back(images[i]);
+    }
+    if (debug_)
+      printf("compressing %zd distinct images of %zd\n",
+             unique.size(), images.size());
+    run_image_jobs(unique, true);
+
+    for (unsigned int i = 0; i < images.size(); i++) {
+      ImageConfig *orig = first_copy[images[i]];
+      if (orig == images[i])
+        continue;
+      images[i]->compressed_content = orig->compressed_content;
+      images[i]->data.compression = orig->data.compression;
+      images[i]->data.compressed_size = orig->data.compressed_size;
+    }
+  }
 
-        stream.next_in = (uint8_t *)content.data();
-        stream.avail_in = content.size();
-        stream.next_out = tmpbuf;
-        stream.avail_out = tmpsize;
-        result = lzma_code(&stream, LZMA_FINISH);
-        if (result != LZMA_STREAM_END) {
-          error("Unable to encode data (error: %d)!\n", result);
-        }
+  void BmpBlockUtil::load_image(ImageConfig &image) {
+    const string &content = read_image_file(image.filename.c_str());
+    image.raw_content = content;
+    image.data.original_size = content.size();
+    image.data.format =
+      identify_image_type(content.c_str(),
+                          (uint32_t)content.size(), &image.data);
+    if (FORMAT_INVALID == image.data.format) {
+      error("Unsupported image format in %s\n", image.filename.c_str());
+    }
+  }
+
+  const string BmpBlockUtil::cache_file_name(const ImageConfig &image) {
+    uint8_t digest[VB2_SHA256_DIGEST_SIZE];
+    char name[2 * sizeof(digest) + 32];
 
-        it->second.data.compression = compression_;
-        it->second.compressed_content.assign((const char *)tmpbuf,
-                                             tmpsize - stream.avail_out);
-        it->second.data.compressed_size = tmpsize - stream.avail_out;
-        lzma_end(&stream);
-        free(tmpbuf);
+    if (vb2_digest_buffer((const uint8_t *)image.raw_content.data(),
+                          image.raw_content.size(), VB2_HASH_SHA256,
+                          digest, sizeof(digest))) {
+      error("Unable to hash %s\n", image.filename.c_str());
+    }
+    for (unsigned int i = 0; i < sizeof(digest); i++)
+      sprintf(name + 2 * i, "%02x", digest[i]);
+    sprintf(name + 2 * sizeof(digest), ".z%u.v%d", compression_,
+            IMAGE_CACHE_VERSION);
+    return cache_dir_ + "/" + name;
+  }
+
+  bool BmpBlockUtil::read_cached_image(const string &cache_file,
+                                       ImageConfig &image) {
+    uint8_t *data;
+    uint32_t size;
+
+    // A missing or empty entry just means compressing it again.
+    if (access(cache_file.c_str(), R_OK) ||
+        vb2_read_file(cache_file.c_str(), &data, &size))
+      return false;
+    if (!size) {
+      free(data);
+      return false;
+    }
+
+    image.data.compression = compression_;
+    image.compressed_content.assign((const char *)data, size);
+    image.data.compressed_size = size;
+    free(data);
+    return true;
+  }
+
+  void BmpBlockUtil::write_cached_image(const string &cache_file,
+                                        const ImageConfig &image) {
+    char suffix[64];
+
+    // Write it under a name of its own, so that other builds sharing the
+    // cache never see half an entry.
+    snprintf(suffix, sizeof(suffix), ".tmp.%d.%lx", (int)getpid(),
+             (unsigned long)pthread_self());
+    string tmp_file = cache_file + suffix;
+    if (vb2_write_file(tmp_file.c_str(), image.compressed_content.data(),
+                       image.compressed_content.size()) ||
+        rename(tmp_file.c_str(), cache_file.c_str())) {
+      // The cache is only an optimization, so carry on without it.
+      fprintf(stderr, "WARNING: unable to cache %s in %s\n",
+              image.filename.c_str(), cache_dir_.c_str());
+      unlink(tmp_file.c_str());
+    }
+  }
+
+  void BmpBlockUtil::compress_image(ImageConfig &image) {
+    const string &content = image.raw_content;
+    string cache_file;
+
+    // Uncompressed images are just copied, so there's nothing to cache.
+    if (!cache_dir_.empty() && compression_ != COMPRESS_NONE) {
+      cache_file = cache_file_name(image);
+      if (read_cached_image(cache_file, image)) {
+        if (debug_)
+          printf("using cached \"%s\" for \"%s\"\n",
+                 cache_file.c_str(), image.filename.c_str());
+        return;
       }
+    }
+
+    switch(compression_) {
+    case COMPRESS_NONE:
+      image.data.compression = compression_;
+      image.compressed_content = content;
+      image.data.compressed_size = content.size();
       break;
-      default:
-        error("Unsupported compression method attempted.\n");
+    case COMPRESS_EFIv1:
+    {
+      // The content will always compress smaller (so sez the docs).
+      uint32_t tmpsize = content.size();
+      uint8_t *tmpbuf = (uint8_t *)malloc(tmpsize);
+      // The size of the compressed content is also returned.
+      if (EFI_SUCCESS != EfiCompress((uint8_t *)content.c_str(), tmpsize,
+                                     tmpbuf, &tmpsize)) {
+        error("Unable to compress!\n");
+      }
+      image.data.compression = compression_;
+      image.compressed_content.assign((const char *)tmpbuf, tmpsize);
+      image.data.compressed_size = tmpsize;
+      free(tmpbuf);
+    }
+    break;
+    case COMPRESS_LZMA1:
+    {
+      // Calculate the worst case of buffer size.
+      uint32_t tmpsize = lzma_stream_buffer_bound(content.size());
+      uint8_t *tmpbuf = (uint8_t *)malloc(tmpsize);
+      lzma_stream stream = LZMA_STREAM_INIT;
+      lzma_options_lzma options;
+      lzma_ret result;
+
+      lzma_lzma_preset(&options, 9);
+      result = lzma_alone_encoder(&stream, &options);
+      if (result != LZMA_OK) {
+        error("Unable to initialize easy encoder (error: %d)!\n", result);
+      }
+
+      stream.next_in = (uint8_t *)content.data();
+      stream.avail_in = content.size();
+      stream.next_out = tmpbuf;
+      stream.avail_out = tmpsize;
+      result = lzma_code(&stream, LZMA_FINISH);
+      if (result != LZMA_STREAM_END) {
+        error("Unable to encode data (error: %d)!\n", result);
       }
+
+      image.data.compression = compression_;
+      image.compressed_content.assign((const char *)tmpbuf,
+                                      tmpsize - stream.avail_out);
+      image.data.compressed_size = tmpsize - stream.avail_out;
+      lzma_end(&stream);
+      free(tmpbuf);
     }
+    break;
+    default:
+      error("Unsupported compression method attempted.\n");
+    }
+
+    if (!cache_file.empty())
+      write_cached_image(cache_file, image);
+  }
+
+  void BmpBlockUtil::image_worker(void *ctx, int index) {
+    BmpBlockUtil *util = static_cast<BmpBlockUtil *>(ctx);
+
+    // Each image has its own buffers and encoder state.
+    if (util->job_compress_)
+      util->compress_image(*util->job_images_[index]);
+    else
+      util->load_image(*util->job_images_[index]);
+  }
+
+  void BmpBlockUtil::run_image_jobs(const vector<ImageConfig *> &images,
+                                    bool compress) {
+    job_images_ = images;
+    job_compress_ = compress;
+    vb2_run_jobs(image_worker, this, images.size(),
+                 sysconf(_SC_NPROCESSORS_ONLN));
+    job_images_.clear();
   }
 
   const string BmpBlockUtil::read_image_file(const char *filename) {
@@ -504,21 +667,36 @@ namespace vboot_reference {
       assert(config_.header.number_of_screenlayouts ==
              config_.localizations[i].size());
     }
-    config_.header.number_of_imageinfos = config_.images_map.size();
+    config_.header.number_of_imageinfos = 0; // Filled by pack_bmpblock()
     config_.header.locale_string_offset = 0; // Filled by pack_bmpblock()
   }
 
   void BmpBlockUtil::pack_bmpblock() {
     bmpblock_.clear();
 
-    /* Compute the ImageInfo offsets from start of BMPBLOCK. */
+    /* Compute the ImageInfo offsets from start of BMPBLOCK. Images that
+     * would be stored exactly alike are only stored once, and the screens
+     * using them all point at the same copy. */
     uint32_t current_offset = sizeof(BmpBlockHeader) +
       sizeof(ScreenLayout) * (config_.header.number_of_localizations *
                               config_.header.number_of_screenlayouts);
+    map<const ImageConfig *, uint32_t, StoredLess> stored;
+    config_.header.number_of_imageinfos = 0;
     for (StrImageConfigMap::iterator it = config_.images_map.begin();
          it != config_.images_map.end();
          ++it) {
-      it->second.offset = current_offset;
+      std::pair<map<const ImageConfig *, uint32_t, StoredLess>::iterator,
+                bool> r = stored.insert(std::make_pair(&it->second,
+                                                       current_offset));
+      it->second.offset = r.first->second;
+      it->second.stored = r.second;
+      if (!r.second) {
+        if (debug_)
+          printf("  \"%s\": same as image at offset 0x%x\n",
+                 it->first.c_str(), it->second.offset);
+        continue;
+      }
+      config_.header.number_of_imageinfos++;
       if (debug_)
         printf("  \"%s\": filename=\"%s\" offset=0x%x tag=%d fmt=%d\n",
                it->first.c_str(),
@@ -583,6 +761,8 @@ namespace vboot_reference {
     for (StrImageConfigMap::iterator it = config_.images_map.begin();
          it != config_.images_map.end();
          ++it) {
+      if (!it->second.stored)
+        continue;
       current_filled = bmpblock_.begin() + it->second.offset;
       current_offset = it->second.offset;
       if (debug_)
@@ -649,12 +829,14 @@ namespace vboot_reference {
       "\n"
       "To create a new BMPBLOCK file using config from YAML file:\n"
       "\n"
-      "  %s [-z NUM] -c YAML BMPBLOCK\n"
+      "  %s [-z NUM] [-C DIR] -c YAML BMPBLOCK\n"
       "\n"
       "    -z NUM  = compression algorithm to use\n"
       "              0 = none\n"
       "              1 = EFIv1\n"
       "              2 = LZMA1\n"
+      "    -C DIR  = reuse compressed images cached in DIR from earlier\n"
+      "              runs, and add any new ones to it\n"
       "\n", prog_name);
     printf(
       "To display the contents of a BMPBLOCK:\n"
@@ -689,6 +871,7 @@ namespace vboot_reference {
     int compression = 0;
     int set_compression = 0;
     const char *config_fn = 0, *bmpblock_fn = 0, *extract_dir = ".";
+    const char *cache_dir = 0;
     int show_as_yaml = 0;
     bool debug = false;
 
@@ -696,11 +879,14 @@ namespace vboot_reference {
     opterr = 0;                           // quiet
     int errorcnt = 0;
     char *e = 0;
-    while ((opt = getopt(argc, argv, ":c:xz:fd:yD")) != -1) {
+    while ((opt = getopt(argc, argv, ":c:C:xz:fd:yD")) != -1) {
       switch (opt) {
       case 'c':
         config_fn = optarg;
         break;
+      case 'C':
+        cache_dir = optarg;
+        break;
       case 'x':
         extract_mode = 1;
         break;
@@ -760,6 +946,8 @@ namespace vboot_reference {
     if (config_fn) {
       if (set_compression)
         util.force_compression(compression);
+      if (cache_dir)
+        util.use_cache(cache_dir);
       util.load_from_config(config_fn);
       util.pack_bmpblock();
       util.write_to_bmpblock(bmpblock_fn);
@@ -101,6 +101,10 @@ const Param sys_param_list[] = {
   {"vdat_lkdebug", IS_STRING|NO_PRINT_ALL,
    "LoadKernel() debug data (not in print-all)"},
   {"vdat_timers", IS_STRING, "Timer values from VbSharedData"},
+  {"vdat_timestamps", IS_STRING|NO_PRINT_ALL,
+   "Boot timestamps from VbSharedData (not in print-all)"},
+  {"vdat_tpm_stats", IS_STRING|NO_PRINT_ALL,
+   "TPM command latencies from VbSharedData (not in print-all)"},
   {"wipeout_request", CAN_WRITE, "Firmware requested factory reset (wipeout)"},
   {"wpsw_boot", 0, "Firmware write protect hardware switch position at boot"},
   {"wpsw_cur", 0, "Firmware write protect hardware switch current position"},
@@ -267,7 +271,9 @@ int main(int argc, char* argv[]) {
     return 0;
   }
 
-  /* Otherwise, loop through params and get/set them */
+  /* Otherwise, loop through params and get/set them.  NV storage changes
+   * are written together at the end. */
+  VbBeginSystemPropertyTransaction();
   for (i = 1; i < argc && retval == 0; i++) {
     char* has_set = strchr(argv[i], '=');
     char* has_expect = strchr(argv[i], '?');
@@ -279,14 +285,16 @@ int main(int argc, char* argv[]) {
     if (!name || has_set == argv[i] || has_expect == argv[i]) {
       fprintf(stderr, "Poorly formed parameter\n");
       PrintHelp(progname);
-      return 1;
+      retval = 1;
+      break;
     }
     if (!value)
       value=""; /* Allow setting/checking an empty string ('foo=' or 'foo?') */
     if (has_set && has_expect) {
       fprintf(stderr, "Use either = or ? in a parameter, but not both.\n");
       PrintHelp(progname);
-      return 1;
+      retval = 1;
+      break;
     }
 
     /* Find the parameter */
@@ -294,7 +302,8 @@ int main(int argc, char* argv[]) {
     if (!p) {
       fprintf(stderr, "Invalid parameter name: %s\n", name);
       PrintHelp(progname);
-      return 1;
+      retval = 1;
+      break;
     }
 
     if (i > 1)
@@ -310,5 +319,12 @@ int main(int argc, char* argv[]) {
       retval = PrintParam(p);
   }
 
+  /* Earlier changes are still written if a later param fails, as they were
+   * when each one was written on its own. */
+  if (VbCommitSystemPropertyTransaction()) {
+    fprintf(stderr, "Unable to write NV storage\n");
+    retval = 1;
+  }
+
   return retval;
 }
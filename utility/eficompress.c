@@ -51,13 +51,14 @@ typedef INT16             NODE;
 #define WNDBIT            13
 #define WNDSIZ            (1U << WNDBIT)
 #define MAXMATCH          256
-#define PERC_FLAG         0x8000U
 #define CODE_BIT          16
-#define NIL               0
-#define MAX_HASH_VAL      (3 * WNDSIZ + (WNDSIZ / 512 + 1) * UINT8_MAX)
-#define HASH(p, c)        ((p) + ((c) << (WNDBIT - 9)) + WNDSIZ * 2)
+#define HASH_BIT          15
+#define HASH_SIZE         (1U << HASH_BIT)
+#define HASH3(p)          ((((UINT32)(p)[0] << 16 | (p)[1] << 8 | (p)[2]) * \
+                            2654435761U) >> (32 - HASH_BIT))
+#define DEFAULT_DEPTH     128
 #define CRCPOLY           0xA001
-#define UPDATE_CRC(c)     mCrc = mCrcTable[(mCrc ^ (c)) & 0xFF] ^ (mCrc >> UINT8_BIT)
+#define UPDATE_CRC(c)     S->mCrc = S->mCrcTable[(S->mCrc ^ (c)) & 0xFF] ^ (S->mCrc >> UINT8_BIT)
 
 //
 // C: the Char&Len Set; P: the Position Set; T: the exTra Set
@@ -75,80 +76,108 @@ typedef INT16             NODE;
   #define                 NPT NP
 #endif
 
+//
+// Compression state, so several buffers can be compressed at once
+//
+
+typedef struct {
+  UINT8  *mSrc, *mDst, *mSrcUpperLimit, *mDstUpperLimit;
+
+  UINT8  *mText, *mBuf, mCLen[NC], mPTLen[NPT], *mLen;
+  INT16  mHeap[NC + 1];
+  INT32  mRemainder, mMatchLen, mBitCount, mHeapSize, mN, mDepth;
+  UINT32 mBufSiz, mOutputPos, mOutputMask, mSubBitBuf, mCrc, mCPos;
+  UINT32 mCompSize, mOrigSize;
+
+  UINT16 *mFreq, *mSortPtr, mLenCnt[17], mLeft[2 * NC - 1], mRight[2 * NC - 1],
+         mCrcTable[UINT8_MAX + 1], mCFreq[2 * NC - 1], mCCode[NC],
+         mPFreq[2 * NP - 1], mPTCode[NPT], mTFreq[2 * NT - 1];
+
+  NODE   mPos, mMatchPos;
+
+  //
+  // Hash chains: mHead holds the newest position with each hash, and
+  // mChain the position before it with the same hash.  Positions are
+  // mText indexes plus mSlide, so they survive sliding the window.
+  //
+  UINT32 *mHead, *mChain, mSlide, mMaxDepth;
+} EFI_COMPRESS_STATE;
+
 //
 // Function Prototypes
 //
 
 STATIC
 VOID
-PutDword(
+PutDword (
+  IN EFI_COMPRESS_STATE *S,
   IN UINT32 Data
   );
 
 STATIC
 EFI_STATUS
 AllocateMemory (
+  IN EFI_COMPRESS_STATE *S
   );
 
 STATIC
 VOID
 FreeMemory (
+  IN EFI_COMPRESS_STATE *S
   );
 
 STATIC
 VOID
 InitSlide (
-  );
-
-STATIC
-NODE
-Child (
-  IN NODE q,
-  IN UINT8 c
+  IN EFI_COMPRESS_STATE *S
   );
 
 STATIC
 VOID
-MakeChild (
-  IN NODE q,
-  IN UINT8 c,
-  IN NODE r
+InsertString (
+  IN EFI_COMPRESS_STATE *S
   );
 
 STATIC
 VOID
-Split (
-  IN NODE Old
+FindMatch (
+  IN EFI_COMPRESS_STATE *S
   );
 
 STATIC
 VOID
-InsertNode (
+AdvancePos (
+  IN EFI_COMPRESS_STATE *S
   );
 
 STATIC
 VOID
-DeleteNode (
+GetNextMatch (
+  IN EFI_COMPRESS_STATE *S
   );
 
 STATIC
 VOID
-GetNextMatch (
+SkipString (
+  IN EFI_COMPRESS_STATE *S
   );
 
 STATIC
 EFI_STATUS
 Encode (
+  IN EFI_COMPRESS_STATE *S
   );
 
 STATIC
 VOID
 CountTFreq (
+  IN EFI_COMPRESS_STATE *S
   );
 
 STATIC
 VOID
 WritePTLen (
+  IN EFI_COMPRESS_STATE *S,
   IN INT32 n,
   IN INT32 nbit,
   IN INT32 Special
@@ -157,28 +186,33 @@ WritePTLen (
 STATIC
 VOID
 WriteCLen (
+  IN EFI_COMPRESS_STATE *S
   );
 
 STATIC
 VOID
 EncodeC (
+  IN EFI_COMPRESS_STATE *S,
   IN INT32 c
   );
 
 STATIC
 VOID
 EncodeP (
+  IN EFI_COMPRESS_STATE *S,
   IN UINT32 p
   );
 
 STATIC
 VOID
 SendBlock (
+  IN EFI_COMPRESS_STATE *S
   );
 
 STATIC
 VOID
 Output (
+  IN EFI_COMPRESS_STATE *S,
   IN UINT32 c,
   IN UINT32 p
   );
@@ -186,21 +220,25 @@ Output (
 STATIC
 VOID
 HufEncodeStart (
+  IN EFI_COMPRESS_STATE *S
   );
 
 STATIC
 VOID
 HufEncodeEnd (
+  IN EFI_COMPRESS_STATE *S
   );
 
 STATIC
 VOID
 MakeCrcTable (
+  IN EFI_COMPRESS_STATE *S
   );
 
 STATIC
 VOID
 PutBits (
+  IN EFI_COMPRESS_STATE *S,
   IN INT32 n,
   IN UINT32 x
   );
@@ -208,6 +246,7 @@ PutBits (
 STATIC
 INT32
 FreadCrc (
+  IN EFI_COMPRESS_STATE *S,
   OUT UINT8 *p,
   IN  INT32 n
   );
@@ -215,29 +254,34 @@ FreadCrc (
 STATIC
 VOID
 InitPutBits (
+  IN EFI_COMPRESS_STATE *S
   );
 
 STATIC
 VOID
 CountLen (
+  IN EFI_COMPRESS_STATE *S,
   IN INT32 i
   );
 
 STATIC
 VOID
 MakeLen (
+  IN EFI_COMPRESS_STATE *S,
   IN INT32 Root
   );
 
 STATIC
 VOID
 DownHeap (
+  IN EFI_COMPRESS_STATE *S,
   IN INT32 i
   );
 
 STATIC
 VOID
 MakeCode (
+  IN EFI_COMPRESS_STATE *S,
   IN  INT32 n,
   IN  UINT8 Len[],
   OUT UINT16 Code[]
@@ -246,6 +290,7 @@ MakeCode (
 STATIC
 INT32
 MakeTree (
+  IN EFI_COMPRESS_STATE *S,
   IN  INT32   NParm,
   IN  UINT16  FreqParm[],
   OUT UINT8   LenParm[],
@@ -254,40 +299,58 @@ MakeTree (
 
 
 //
-//  Global Variables
+// functions
 //
 
-STATIC UINT8  *mSrc, *mDst, *mSrcUpperLimit, *mDstUpperLimit;
+EFI_STATUS
+EfiCompress (
+  IN      UINT8   *SrcBuffer,
+  IN      UINT32  SrcSize,
+  IN      UINT8   *DstBuffer,
+  IN OUT  UINT32  *DstSize
+  )
+/*++
 
-STATIC UINT8  *mLevel, *mText, *mChildCount, *mBuf, mCLen[NC], mPTLen[NPT], *mLen;
-STATIC INT16  mHeap[NC + 1];
-STATIC INT32  mRemainder, mMatchLen, mBitCount, mHeapSize, mN;
-STATIC UINT32 mBufSiz = 0, mOutputPos, mOutputMask, mSubBitBuf, mCrc;
-STATIC UINT32 mCompSize, mOrigSize;
+Routine Description:
 
-STATIC UINT16 *mFreq, *mSortPtr, mLenCnt[17], mLeft[2 * NC - 1], mRight[2 * NC - 1],
-              mCrcTable[UINT8_MAX + 1], mCFreq[2 * NC - 1], mCCode[NC],
-              mPFreq[2 * NP - 1], mPTCode[NPT], mTFreq[2 * NT - 1];
+  The main compression routine.
 
-STATIC NODE   mPos, mMatchPos, mAvail, *mPosition, *mParent, *mPrev, *mNext = NULL;
+Arguments:
 
+  SrcBuffer   - The buffer storing the source data
+  SrcSize     - The size of source data
+  DstBuffer   - The buffer to store the compressed data
+  DstSize     - On input, the size of DstBuffer; On output,
+                the size of the actual compressed data.
 
-//
-// functions
-//
+Returns:
+
+  EFI_BUFFER_TOO_SMALL  - The DstBuffer is too small. In this case,
+                DstSize contains the size needed.
+  EFI_SUCCESS           - Compression is successful.
+
+--*/
+{
+  return EfiCompressWithDepth (SrcBuffer, SrcSize, DstBuffer, DstSize,
+                               DEFAULT_DEPTH);
+}
 
 EFI_STATUS
-EfiCompress (
+EfiCompressWithDepth (
   IN      UINT8   *SrcBuffer,
   IN      UINT32  SrcSize,
   IN      UINT8   *DstBuffer,
-  IN OUT  UINT32  *DstSize
+  IN OUT  UINT32  *DstSize,
+  IN      UINT32  MaxDepth
   )
 /*++
 
 Routine Description:
 
-  The main compression routine.
+  Compress like EfiCompress, comparing at most MaxDepth earlier strings
+  when looking for each match.  Smaller depths are faster, larger ones
+  may find longer matches.  Each call has its own state, so calls may
+  run in parallel.
 
 Arguments:
 
@@ -296,84 +359,83 @@ Arguments:
   DstBuffer   - The buffer to store the compressed data
   DstSize     - On input, the size of DstBuffer; On output,
                 the size of the actual compressed data.
+  MaxDepth    - The most hash chain entries to compare for each match
 
 Returns:
 
   EFI_BUFFER_TOO_SMALL  - The DstBuffer is too small. In this case,
                 DstSize contains the size needed.
+  EFI_OUT_OF_RESOURCES  - Memory allocation failed.
   EFI_SUCCESS           - Compression is successful.
 
 --*/
 {
-  EFI_STATUS Status = EFI_SUCCESS;
+  EFI_STATUS         Status = EFI_SUCCESS;
+  EFI_COMPRESS_STATE *S;
 
   //
   // Initializations
   //
-  mBufSiz = 0;
-  mBuf = NULL;
-  mText       = NULL;
-  mLevel      = NULL;
-  mChildCount = NULL;
-  mPosition   = NULL;
-  mParent     = NULL;
-  mPrev       = NULL;
-  mNext       = NULL;
+  S = calloc (1, sizeof(*S));
+  if (S == NULL) {
+    return EFI_OUT_OF_RESOURCES;
+  }
+  S->mMaxDepth = MaxDepth ? MaxDepth : 1;
 
 
-  mSrc = SrcBuffer;
-  mSrcUpperLimit = mSrc + SrcSize;
-  mDst = DstBuffer;
-  mDstUpperLimit = mDst + *DstSize;
+  S->mSrc = SrcBuffer;
+  S->mSrcUpperLimit = S->mSrc + SrcSize;
+  S->mDst = DstBuffer;
+  S->mDstUpperLimit = S->mDst + *DstSize;
 
-  PutDword(0L);
-  PutDword(0L);
+  PutDword(S, 0L);
+  PutDword(S, 0L);
 
-  MakeCrcTable ();
+  MakeCrcTable(S);
 
-  mOrigSize = mCompSize = 0;
-  mCrc = INIT_CRC;
+  S->mOrigSize = S->mCompSize = 0;
+  S->mCrc = INIT_CRC;
 
   //
   // Compress it
   //
 
-  Status = Encode();
+  Status = Encode(S);
   if (EFI_ERROR (Status)) {
+    free (S);
     return EFI_OUT_OF_RESOURCES;
   }
 
   //
   // Null terminate the compressed data
   //
-  if (mDst < mDstUpperLimit) {
-    *mDst++ = 0;
+  if (S->mDst < S->mDstUpperLimit) {
+    *S->mDst++ = 0;
   }
 
   //
   // Fill in compressed size and original size
   //
-  mDst = DstBuffer;
-  PutDword(mCompSize+1);
-  PutDword(mOrigSize);
+  S->mDst = DstBuffer;
+  PutDword(S, S->mCompSize+1);
+  PutDword(S, S->mOrigSize);
 
   //
   // Return
   //
 
-  if (mCompSize + 1 + 8 > *DstSize) {
-    *DstSize = mCompSize + 1 + 8;
-    return EFI_BUFFER_TOO_SMALL;
-  } else {
-    *DstSize = mCompSize + 1 + 8;
-    return EFI_SUCCESS;
+  if (S->mCompSize + 1 + 8 > *DstSize) {
+    Status = EFI_BUFFER_TOO_SMALL;
   }
-
+  *DstSize = S->mCompSize + 1 + 8;
+  free (S);
+  return Status;
 }
 
 STATIC
 VOID
-PutDword(
+PutDword (
+  IN EFI_COMPRESS_STATE *S,
   IN UINT32 Data
   )
 /*++
@@ -390,26 +452,28 @@ Returns: (VOID)
 
 --*/
 {
-  if (mDst < mDstUpperLimit) {
-    *mDst++ = (UINT8)(((UINT8)(Data        )) & 0xff);
+  if (S->mDst < S->mDstUpperLimit) {
+    *S->mDst++ = (UINT8)(((UINT8)(Data        )) & 0xff);
   }
 
-  if (mDst < mDstUpperLimit) {
-    *mDst++ = (UINT8)(((UINT8)(Data >> 0x08)) & 0xff);
+  if (S->mDst < S->mDstUpperLimit) {
+    *S->mDst++ = (UINT8)(((UINT8)(Data >> 0x08)) & 0xff);
   }
 
-  if (mDst < mDstUpperLimit) {
-    *mDst++ = (UINT8)(((UINT8)(Data >> 0x10)) & 0xff);
+  if (S->mDst < S->mDstUpperLimit) {
+    *S->mDst++ = (UINT8)(((UINT8)(Data >> 0x10)) & 0xff);
   }
 
-  if (mDst < mDstUpperLimit) {
-    *mDst++ = (UINT8)(((UINT8)(Data >> 0x18)) & 0xff);
+  if (S->mDst < S->mDstUpperLimit) {
+    *S->mDst++ = (UINT8)(((UINT8)(Data >> 0x18)) & 0xff);
   }
 }
 
 STATIC
 EFI_STATUS
-AllocateMemory ()
+AllocateMemory (
+  IN EFI_COMPRESS_STATE *S
+  )
 /*++
 
 Routine Description:
@@ -425,34 +489,30 @@ Returns:
 
 --*/
 {
-  UINT32      i;
+  S->mText       = calloc (WNDSIZ * 2 + MAXMATCH, 1);
 
-  mText       = malloc (WNDSIZ * 2 + MAXMATCH);
-  for (i = 0 ; i < WNDSIZ * 2 + MAXMATCH; i ++) {
-    mText[i] = 0;
+  S->mHead       = malloc (HASH_SIZE * sizeof(*S->mHead));
+  S->mChain      = malloc (WNDSIZ * sizeof(*S->mChain));
+  if (!S->mText || !S->mHead || !S->mChain) {
+    return EFI_OUT_OF_RESOURCES;
   }
 
-  mLevel      = malloc ((WNDSIZ + UINT8_MAX + 1) * sizeof(*mLevel));
-  mChildCount = malloc ((WNDSIZ + UINT8_MAX + 1) * sizeof(*mChildCount));
-  mPosition   = malloc ((WNDSIZ + UINT8_MAX + 1) * sizeof(*mPosition));
-  mParent     = malloc (WNDSIZ * 2 * sizeof(*mParent));
-  mPrev       = malloc (WNDSIZ * 2 * sizeof(*mPrev));
-  mNext       = malloc ((MAX_HASH_VAL + 1) * sizeof(*mNext));
-
-  mBufSiz = 16 * 1024U;
-  while ((mBuf = malloc(mBufSiz)) == NULL) {
-    mBufSiz = (mBufSiz / 10U) * 9U;
-    if (mBufSiz < 4 * 1024U) {
+  S->mBufSiz = 16 * 1024U;
+  while ((S->mBuf = malloc(S->mBufSiz)) == NULL) {
+    S->mBufSiz = (S->mBufSiz / 10U) * 9U;
+    if (S->mBufSiz < 4 * 1024U) {
       return EFI_OUT_OF_RESOURCES;
     }
   }
-  mBuf[0] = 0;
+  S->mBuf[0] = 0;
 
   return EFI_SUCCESS;
 }
 
 VOID
-FreeMemory ()
+FreeMemory (
+  IN EFI_COMPRESS_STATE *S
+  )
 /*++
 
 Routine Description:
@@ -465,36 +525,20 @@ Returns: (VOID)
 
 --*/
 {
-  if (mText) {
-    free (mText);
+  if (S->mText) {
+    free (S->mText);
   }
 
-  if (mLevel) {
-    free (mLevel);
+  if (S->mHead) {
+    free (S->mHead);
   }
 
-  if (mChildCount) {
-    free (mChildCount);
+  if (S->mChain) {
+    free (S->mChain);
   }
 
-  if (mPosition) {
-    free (mPosition);
-  }
-
-  if (mParent) {
-    free (mParent);
-  }
-
-  if (mPrev) {
-    free (mPrev);
-  }
-
-  if (mNext) {
-    free (mNext);
-  }
-
-  if (mBuf) {
-    free (mBuf);
+  if (S->mBuf) {
+    free (S->mBuf);
   }
 
   return;
@@ -503,7 +547,9 @@ Returns: (VOID)
 
 STATIC
 VOID
-InitSlide ()
+InitSlide (
+  IN EFI_COMPRESS_STATE *S
+  )
 /*++
 
 Routine Description:
@@ -516,141 +562,97 @@ Returns: (VOID)
 
 --*/
 {
-  NODE i;
-
-  for (i = WNDSIZ; i <= WNDSIZ + UINT8_MAX; i++) {
-    mLevel[i] = 1;
-    mPosition[i] = NIL;  /* sentinel */
-  }
-  for (i = WNDSIZ; i < WNDSIZ * 2; i++) {
-    mParent[i] = NIL;
-  }
-  mAvail = 1;
-  for (i = 1; i < WNDSIZ - 1; i++) {
-    mNext[i] = (NODE)(i + 1);
-  }
-
-  mNext[WNDSIZ - 1] = NIL;
-  for (i = WNDSIZ * 2; i <= MAX_HASH_VAL; i++) {
-    mNext[i] = NIL;
-  }
-}
-
-
-STATIC
-NODE
-Child (
-  IN NODE q,
-  IN UINT8 c
-  )
-/*++
-
-Routine Description:
-
-  Find child node given the parent node and the edge character
-
-Arguments:
-
-  q       - the parent node
-  c       - the edge character
-
-Returns:
-
-  The child node (NIL if not found)
-
---*/
-{
-  NODE r;
-
-  r = mNext[HASH(q, c)];
-  mParent[NIL] = q;  /* sentinel */
-  while (mParent[r] != q) {
-    r = mNext[r];
-  }
-
-  return r;
+  memset(S->mHead, 0, HASH_SIZE * sizeof(*S->mHead));
+  S->mSlide = 0;
 }
 
 STATIC
 VOID
-MakeChild (
-  IN NODE q,
-  IN UINT8 c,
-  IN NODE r
+InsertString (
+  IN EFI_COMPRESS_STATE *S
   )
 /*++
 
 Routine Description:
 
-  Create a new child for a given parent node.
-
-Arguments:
+  Add the string at the current position to its hash chain.
 
-  q       - the parent node
-  c       - the edge character
-  r       - the child node
+Arguments: (VOID)
 
 Returns: (VOID)
 
 --*/
 {
-  NODE h, t;
-
-  h = (NODE)HASH(q, c);
-  t = mNext[h];
-  mNext[h] = r;
-  mNext[r] = t;
-  mPrev[t] = r;
-  mPrev[r] = h;
-  mParent[r] = q;
-  mChildCount[q]++;
+  UINT32 Abs, h;
+
+  Abs = S->mPos + S->mSlide;
+  h = HASH3(&S->mText[S->mPos]);
+  S->mChain[Abs & (WNDSIZ - 1)] = S->mHead[h];
+  S->mHead[h] = Abs;
 }
 
 STATIC
 VOID
-Split (
-  NODE Old
+FindMatch (
+  IN EFI_COMPRESS_STATE *S
   )
 /*++
 
 Routine Description:
 
-  Split a node.
+  Find the longest match for the string at the current position among
+  the earlier strings with the same hash, then add the current position
+  to its hash chain.
 
-Arguments:
+  Only the newest mMaxDepth strings on the chain are compared, and
+  matches stay within WNDSIZ - 1 bytes, as they did in the binary tree
+  this replaces.
 
-  Old     - the node to split
+Arguments: (VOID)
 
 Returns: (VOID)
 
 --*/
 {
-  NODE New, t;
-
-  New = mAvail;
-  mAvail = mNext[New];
-  mChildCount[New] = 0;
-  t = mPrev[Old];
-  mPrev[New] = t;
-  mNext[t] = New;
-  t = mNext[Old];
-  mNext[New] = t;
-  mPrev[t] = New;
-  mParent[New] = mParent[Old];
-  mLevel[New] = (UINT8)mMatchLen;
-  mPosition[New] = mPos;
-  MakeChild(New, mText[mMatchPos + mMatchLen], Old);
-  MakeChild(New, mText[mPos + mMatchLen], mPos);
+  UINT8  *Scan, *Match;
+  UINT32 Abs, Cand, Depth;
+  INT32  Len;
+
+  Scan = &S->mText[S->mPos];
+  Abs = S->mPos + S->mSlide;
+  Cand = S->mHead[HASH3(Scan)];
+  Depth = S->mMaxDepth;
+  S->mMatchLen = 0;
+
+  while (Cand != 0 && Abs - Cand < WNDSIZ && Depth-- > 0) {
+    Match = &S->mText[Cand - S->mSlide];
+    if (Match[S->mMatchLen] == Scan[S->mMatchLen]) {
+      for (Len = 0; Len < MAXMATCH && Match[Len] == Scan[Len]; Len++) {
+      }
+      if (Len > S->mMatchLen) {
+        S->mMatchLen = Len;
+        S->mMatchPos = (NODE)(Cand - S->mSlide);
+        if (Len >= MAXMATCH) {
+          break;
+        }
+      }
+    }
+    Cand = S->mChain[Cand & (WNDSIZ - 1)];
+  }
+
+  InsertString(S);
 }
 
 STATIC
 VOID
-InsertNode ()
+AdvancePos (
+  IN EFI_COMPRESS_STATE *S
+  )
 /*++
 
 Routine Description:
 
-  Insert string info for current position into the String Info Log
+  Advance the current position (read in new data if needed).
 
 Arguments: (VOID)
 
@@ -658,115 +660,28 @@ Returns: (VOID)
 
 --*/
 {
-  NODE q, r, j, t;
-  UINT8 c, *t1, *t2;
-
-  if (mMatchLen >= 4) {
-
-    //
-    // We have just got a long match, the target tree
-    // can be located by MatchPos + 1. Travese the tree
-    // from bottom up to get to a proper starting point.
-    // The usage of PERC_FLAG ensures proper node deletion
-    // in DeleteNode() later.
-    //
-
-    mMatchLen--;
-    r = (INT16)((mMatchPos + 1) | WNDSIZ);
-    while ((q = mParent[r]) == NIL) {
-      r = mNext[r];
-    }
-    while (mLevel[q] >= mMatchLen) {
-      r = q;  q = mParent[q];
-    }
-    t = q;
-    while (mPosition[t] < 0) {
-      mPosition[t] = mPos;
-      t = mParent[t];
-    }
-    if (t < WNDSIZ) {
-      mPosition[t] = (NODE)(mPos | PERC_FLAG);
-    }
-  } else {
-
-    //
-    // Locate the target tree
-    //
+  INT32 n;
 
-    q = (INT16)(mText[mPos] + WNDSIZ);
-    c = mText[mPos + 1];
-    if ((r = Child(q, c)) == NIL) {
-      MakeChild(q, c, mPos);
-      mMatchLen = 1;
-      return;
-    }
-    mMatchLen = 2;
+  S->mRemainder--;
+  if (++S->mPos == WNDSIZ * 2) {
+    memmove(&S->mText[0], &S->mText[WNDSIZ], WNDSIZ + MAXMATCH);
+    n = FreadCrc(S, &S->mText[WNDSIZ + MAXMATCH], WNDSIZ);
+    S->mRemainder += n;
+    S->mPos = WNDSIZ;
+    S->mSlide += WNDSIZ;
   }
-
-  //
-  // Traverse down the tree to find a match.
-  // Update Position value along the route.
-  // Node split or creation is involved.
-  //
-
-  for ( ; ; ) {
-    if (r >= WNDSIZ) {
-      j = MAXMATCH;
-      mMatchPos = r;
-    } else {
-      j = mLevel[r];
-      mMatchPos = (NODE)(mPosition[r] & ~PERC_FLAG);
-    }
-    if (mMatchPos >= mPos) {
-      mMatchPos -= WNDSIZ;
-    }
-    t1 = &mText[mPos + mMatchLen];
-    t2 = &mText[mMatchPos + mMatchLen];
-    while (mMatchLen < j) {
-      if (*t1 != *t2) {
-        Split(r);
-        return;
-      }
-      mMatchLen++;
-      t1++;
-      t2++;
-    }
-    if (mMatchLen >= MAXMATCH) {
-      break;
-    }
-    mPosition[r] = mPos;
-    q = r;
-    if ((r = Child(q, *t1)) == NIL) {
-      MakeChild(q, *t1, mPos);
-      return;
-    }
-    mMatchLen++;
-  }
-  t = mPrev[r];
-  mPrev[mPos] = t;
-  mNext[t] = mPos;
-  t = mNext[r];
-  mNext[mPos] = t;
-  mPrev[t] = mPos;
-  mParent[mPos] = q;
-  mParent[r] = NIL;
-
-  //
-  // Special usage of 'next'
-  //
-  mNext[r] = mPos;
-
 }
 
 STATIC
 VOID
-DeleteNode ()
+GetNextMatch (
+  IN EFI_COMPRESS_STATE *S
+  )
 /*++
 
 Routine Description:
 
-  Delete outdated string info. (The Usage of PERC_FLAG
-  ensures a clean deletion)
+  Advance the current position and find a match string for it.
 
 Arguments: (VOID)
 
@@ -774,73 +689,21 @@ Returns: (VOID)
 
 --*/
 {
-  NODE q, r, s, t, u;
-
-  if (mParent[mPos] == NIL) {
-    return;
-  }
-
-  r = mPrev[mPos];
-  s = mNext[mPos];
-  mNext[r] = s;
-  mPrev[s] = r;
-  r = mParent[mPos];
-  mParent[mPos] = NIL;
-  if (r >= WNDSIZ || --mChildCount[r] > 1) {
-    return;
-  }
-  t = (NODE)(mPosition[r] & ~PERC_FLAG);
-  if (t >= mPos) {
-    t -= WNDSIZ;
-  }
-  s = t;
-  q = mParent[r];
-  while ((u = mPosition[q]) & PERC_FLAG) {
-    u &= ~PERC_FLAG;
-    if (u >= mPos) {
-      u -= WNDSIZ;
-    }
-    if (u > s) {
-      s = u;
-    }
-    mPosition[q] = (INT16)(s | WNDSIZ);
-    q = mParent[q];
-  }
-  if (q < WNDSIZ) {
-    if (u >= mPos) {
-      u -= WNDSIZ;
-    }
-    if (u > s) {
-      s = u;
-    }
-    mPosition[q] = (INT16)(s | WNDSIZ | PERC_FLAG);
-  }
-  s = Child(r, mText[t + mLevel[r]]);
-  t = mPrev[s];
-  u = mNext[s];
-  mNext[t] = u;
-  mPrev[u] = t;
-  t = mPrev[r];
-  mNext[t] = s;
-  mPrev[s] = t;
-  t = mNext[r];
-  mPrev[t] = s;
-  mNext[s] = t;
-  mParent[s] = mParent[r];
-  mParent[r] = NIL;
-  mNext[r] = mAvail;
-  mAvail = r;
+  AdvancePos(S);
+  FindMatch(S);
 }
 
 STATIC
 VOID
-GetNextMatch ()
+SkipString (
+  IN EFI_COMPRESS_STATE *S
+  )
 /*++
 
 Routine Description:
 
-  Advance the current position (read in new data if needed).
-  Delete outdated string info. Find a match string for current position.
+  Advance the current position without looking for a match, for
+  positions covered by a pointer which was just output.
 
 Arguments: (VOID)
 
@@ -848,22 +711,15 @@ Returns: (VOID)
 
 --*/
 {
-  INT32 n;
-
-  mRemainder--;
-  if (++mPos == WNDSIZ * 2) {
-    memmove(&mText[0], &mText[WNDSIZ], WNDSIZ + MAXMATCH);
-    n = FreadCrc(&mText[WNDSIZ + MAXMATCH], WNDSIZ);
-    mRemainder += n;
-    mPos = WNDSIZ;
-  }
-  DeleteNode();
-  InsertNode();
+  AdvancePos(S);
+  InsertString(S);
 }
 
 STATIC
 EFI_STATUS
-Encode ()
+Encode (
+  IN EFI_COMPRESS_STATE *S
+  )
 /*++
 
 Routine Description:
@@ -883,65 +739,73 @@ Returns:
   INT32       LastMatchLen;
   NODE        LastMatchPos;
 
-  Status = AllocateMemory();
+  Status = AllocateMemory(S);
   if (EFI_ERROR(Status)) {
-    FreeMemory();
+    FreeMemory(S);
     return Status;
   }
 
-  InitSlide();
+  InitSlide(S);
 
-  HufEncodeStart();
+  HufEncodeStart(S);
 
-  mRemainder = FreadCrc(&mText[WNDSIZ], WNDSIZ + MAXMATCH);
+  S->mRemainder = FreadCrc(S, &S->mText[WNDSIZ], WNDSIZ + MAXMATCH);
 
-  mMatchLen = 0;
-  mPos = WNDSIZ;
-  InsertNode();
-  if (mMatchLen > mRemainder) {
-    mMatchLen = mRemainder;
+  S->mMatchLen = 0;
+  S->mPos = WNDSIZ;
+  FindMatch(S);
+  if (S->mMatchLen > S->mRemainder) {
+    S->mMatchLen = S->mRemainder;
   }
-  while (mRemainder > 0) {
-    LastMatchLen = mMatchLen;
-    LastMatchPos = mMatchPos;
-    GetNextMatch();
-    if (mMatchLen > mRemainder) {
-      mMatchLen = mRemainder;
+  while (S->mRemainder > 0) {
+    LastMatchLen = S->mMatchLen;
+    LastMatchPos = S->mMatchPos;
+    GetNextMatch(S);
+    if (S->mMatchLen > S->mRemainder) {
+      S->mMatchLen = S->mRemainder;
     }
 
-    if (mMatchLen > LastMatchLen || LastMatchLen < THRESHOLD) {
+    if (S->mMatchLen > LastMatchLen || LastMatchLen < THRESHOLD) {
 
       //
       // Not enough benefits are gained by outputting a pointer,
       // so just output the original character
       //
 
-      Output(mText[mPos - 1], 0);
+      Output(S, S->mText[S->mPos - 1], 0);
     } else {
 
       //
       // Outputting a pointer is beneficial enough, do it.
       //
 
-      Output(LastMatchLen + (UINT8_MAX + 1 - THRESHOLD),
-             (mPos - LastMatchPos - 2) & (WNDSIZ - 1));
-      while (--LastMatchLen > 0) {
-        GetNextMatch();
+      Output(S, LastMatchLen + (UINT8_MAX + 1 - THRESHOLD),
+             (S->mPos - LastMatchPos - 2) & (WNDSIZ - 1));
+      //
+      // Only the match for the last position covered by the pointer
+      // is used, so don't search at the ones before it.
+      //
+
+      while (--LastMatchLen > 1) {
+        SkipString(S);
       }
-      if (mMatchLen > mRemainder) {
-        mMatchLen = mRemainder;
+      GetNextMatch(S);
+      if (S->mMatchLen > S->mRemainder) {
+        S->mMatchLen = S->mRemainder;
       }
     }
   }
 
-  HufEncodeEnd();
-  FreeMemory();
+  HufEncodeEnd(S);
+  FreeMemory(S);
   return EFI_SUCCESS;
 }
 
 STATIC
 VOID
-CountTFreq ()
+CountTFreq (
+  IN EFI_COMPRESS_STATE *S
+  )
 /*++
 
 Routine Description:
@@ -957,33 +821,33 @@ Returns: (VOID)
   INT32 i, k, n, Count;
 
   for (i = 0; i < NT; i++) {
-    mTFreq[i] = 0;
+    S->mTFreq[i] = 0;
   }
   n = NC;
-  while (n > 0 && mCLen[n - 1] == 0) {
+  while (n > 0 && S->mCLen[n - 1] == 0) {
     n--;
   }
   i = 0;
   while (i < n) {
-    k = mCLen[i++];
+    k = S->mCLen[i++];
     if (k == 0) {
       Count = 1;
-      while (i < n && mCLen[i] == 0) {
+      while (i < n && S->mCLen[i] == 0) {
         i++;
         Count++;
       }
       if (Count <= 2) {
-        mTFreq[0] = (UINT16)(mTFreq[0] + Count);
+        S->mTFreq[0] = (UINT16)(S->mTFreq[0] + Count);
       } else if (Count <= 18) {
-        mTFreq[1]++;
+        S->mTFreq[1]++;
       } else if (Count == 19) {
-        mTFreq[0]++;
-        mTFreq[1]++;
+        S->mTFreq[0]++;
+        S->mTFreq[1]++;
       } else {
-        mTFreq[2]++;
+        S->mTFreq[2]++;
       }
     } else {
-      mTFreq[k + 2]++;
+      S->mTFreq[k + 2]++;
     }
   }
 }
@@ -991,6 +855,7 @@ Returns: (VOID)
 STATIC
 VOID
 WritePTLen (
+  IN EFI_COMPRESS_STATE *S,
   IN INT32 n,
   IN INT32 nbit,
   IN INT32 Special
@@ -1013,30 +878,32 @@ Returns: (VOID)
 {
   INT32 i, k;
 
-  while (n > 0 && mPTLen[n - 1] == 0) {
+  while (n > 0 && S->mPTLen[n - 1] == 0) {
     n--;
   }
-  PutBits(nbit, n);
+  PutBits(S, nbit, n);
   i = 0;
   while (i < n) {
-    k = mPTLen[i++];
+    k = S->mPTLen[i++];
     if (k <= 6) {
-      PutBits(3, k);
+      PutBits(S, 3, k);
     } else {
-      PutBits(k - 3, (1U << (k - 3)) - 2);
+      PutBits(S, k - 3, (1U << (k - 3)) - 2);
     }
     if (i == Special) {
-      while (i < 6 && mPTLen[i] == 0) {
+      while (i < 6 && S->mPTLen[i] == 0) {
         i++;
       }
-      PutBits(2, (i - 3) & 3);
+      PutBits(S, 2, (i - 3) & 3);
     }
   }
 }
 
 STATIC
 VOID
-WriteCLen ()
+WriteCLen (
+  IN EFI_COMPRESS_STATE *S
+  )
 /*++
 
 Routine Description:
@@ -1052,36 +919,36 @@ Returns: (VOID)
   INT32 i, k, n, Count;
 
   n = NC;
-  while (n > 0 && mCLen[n - 1] == 0) {
+  while (n > 0 && S->mCLen[n - 1] == 0) {
     n--;
   }
-  PutBits(CBIT, n);
+  PutBits(S, CBIT, n);
   i = 0;
   while (i < n) {
-    k = mCLen[i++];
+    k = S->mCLen[i++];
     if (k == 0) {
       Count = 1;
-      while (i < n && mCLen[i] == 0) {
+      while (i < n && S->mCLen[i] == 0) {
         i++;
         Count++;
       }
       if (Count <= 2) {
         for (k = 0; k < Count; k++) {
-          PutBits(mPTLen[0], mPTCode[0]);
+          PutBits(S, S->mPTLen[0], S->mPTCode[0]);
         }
       } else if (Count <= 18) {
-        PutBits(mPTLen[1], mPTCode[1]);
-        PutBits(4, Count - 3);
+        PutBits(S, S->mPTLen[1], S->mPTCode[1]);
+        PutBits(S, 4, Count - 3);
       } else if (Count == 19) {
-        PutBits(mPTLen[0], mPTCode[0]);
-        PutBits(mPTLen[1], mPTCode[1]);
-        PutBits(4, 15);
+        PutBits(S, S->mPTLen[0], S->mPTCode[0]);
+        PutBits(S, S->mPTLen[1], S->mPTCode[1]);
+        PutBits(S, 4, 15);
       } else {
-        PutBits(mPTLen[2], mPTCode[2]);
-        PutBits(CBIT, Count - 20);
+        PutBits(S, S->mPTLen[2], S->mPTCode[2]);
+        PutBits(S, CBIT, Count - 20);
       }
     } else {
-      PutBits(mPTLen[k + 2], mPTCode[k + 2]);
+      PutBits(S, S->mPTLen[k + 2], S->mPTCode[k + 2]);
     }
   }
 }
@@ -1089,15 +956,17 @@ Returns: (VOID)
 STATIC
 VOID
 EncodeC (
+  IN EFI_COMPRESS_STATE *S,
   IN INT32 c
   )
 {
-  PutBits(mCLen[c], mCCode[c]);
+  PutBits(S, S->mCLen[c], S->mCCode[c]);
 }
 
 STATIC
 VOID
 EncodeP (
+  IN EFI_COMPRESS_STATE *S,
   IN UINT32 p
   )
 {
@@ -1109,15 +978,17 @@ EncodeP (
     q >>= 1;
     c++;
   }
-  PutBits(mPTLen[c], mPTCode[c]);
+  PutBits(S, S->mPTLen[c], S->mPTCode[c]);
   if (c > 1) {
-    PutBits(c - 1, p & (0xFFFFU >> (17 - c)));
+    PutBits(S, c - 1, p & (0xFFFFU >> (17 - c)));
   }
 }
 
 STATIC
 VOID
-SendBlock ()
+SendBlock (
+  IN EFI_COMPRESS_STATE *S
+  )
 /*++
 
 Routine Description:
@@ -1133,53 +1004,53 @@ Returns: (VOID)
   UINT32 i, k, Flags, Root, Pos, Size;
   Flags = 0;
 
-  Root = MakeTree(NC, mCFreq, mCLen, mCCode);
-  Size = mCFreq[Root];
-  PutBits(16, Size);
+  Root = MakeTree(S, NC, S->mCFreq, S->mCLen, S->mCCode);
+  Size = S->mCFreq[Root];
+  PutBits(S, 16, Size);
   if (Root >= NC) {
-    CountTFreq();
-    Root = MakeTree(NT, mTFreq, mPTLen, mPTCode);
+    CountTFreq(S);
+    Root = MakeTree(S, NT, S->mTFreq, S->mPTLen, S->mPTCode);
     if (Root >= NT) {
-      WritePTLen(NT, TBIT, 3);
+      WritePTLen(S, NT, TBIT, 3);
     } else {
-      PutBits(TBIT, 0);
-      PutBits(TBIT, Root);
+      PutBits(S, TBIT, 0);
+      PutBits(S, TBIT, Root);
     }
-    WriteCLen();
+    WriteCLen(S);
   } else {
-    PutBits(TBIT, 0);
-    PutBits(TBIT, 0);
-    PutBits(CBIT, 0);
-    PutBits(CBIT, Root);
+    PutBits(S, TBIT, 0);
+    PutBits(S, TBIT, 0);
+    PutBits(S, CBIT, 0);
+    PutBits(S, CBIT, Root);
   }
-  Root = MakeTree(NP, mPFreq, mPTLen, mPTCode);
+  Root = MakeTree(S, NP, S->mPFreq, S->mPTLen, S->mPTCode);
   if (Root >= NP) {
-    WritePTLen(NP, PBIT, -1);
+    WritePTLen(S, NP, PBIT, -1);
   } else {
-    PutBits(PBIT, 0);
-    PutBits(PBIT, Root);
+    PutBits(S, PBIT, 0);
+    PutBits(S, PBIT, Root);
   }
   Pos = 0;
   for (i = 0; i < Size; i++) {
     if (i % UINT8_BIT == 0) {
-      Flags = mBuf[Pos++];
+      Flags = S->mBuf[Pos++];
     } else {
       Flags <<= 1;
     }
     if (Flags & (1U << (UINT8_BIT - 1))) {
-      EncodeC(mBuf[Pos++] + (1U << UINT8_BIT));
-      k = mBuf[Pos++] << UINT8_BIT;
-      k += mBuf[Pos++];
-      EncodeP(k);
+      EncodeC(S, S->mBuf[Pos++] + (1U << UINT8_BIT));
+      k = S->mBuf[Pos++] << UINT8_BIT;
+      k += S->mBuf[Pos++];
+      EncodeP(S, k);
     } else {
-      EncodeC(mBuf[Pos++]);
+      EncodeC(S, S->mBuf[Pos++]);
     }
   }
   for (i = 0; i < NC; i++) {
-    mCFreq[i] = 0;
+    S->mCFreq[i] = 0;
   }
   for (i = 0; i < NP; i++) {
-    mPFreq[i] = 0;
+    S->mPFreq[i] = 0;
   }
 }
 
@@ -1187,6 +1058,7 @@ Returns: (VOID)
 STATIC
 VOID
 Output (
+  IN EFI_COMPRESS_STATE *S,
   IN UINT32 c,
   IN UINT32 p
   )
@@ -1205,59 +1077,61 @@ Returns: (VOID)
 
 --*/
 {
-  STATIC UINT32 CPos;
-
-  if ((mOutputMask >>= 1) == 0) {
-    mOutputMask = 1U << (UINT8_BIT - 1);
-    if (mOutputPos >= mBufSiz - 3 * UINT8_BIT) {
-      SendBlock();
-      mOutputPos = 0;
+  if ((S->mOutputMask >>= 1) == 0) {
+    S->mOutputMask = 1U << (UINT8_BIT - 1);
+    if (S->mOutputPos >= S->mBufSiz - 3 * UINT8_BIT) {
+      SendBlock(S);
+      S->mOutputPos = 0;
     }
-    CPos = mOutputPos++;
-    mBuf[CPos] = 0;
+    S->mCPos = S->mOutputPos++;
+    S->mBuf[S->mCPos] = 0;
   }
-  mBuf[mOutputPos++] = (UINT8) c;
-  mCFreq[c]++;
+  S->mBuf[S->mOutputPos++] = (UINT8) c;
+  S->mCFreq[c]++;
   if (c >= (1U << UINT8_BIT)) {
-    mBuf[CPos] |= mOutputMask;
-    mBuf[mOutputPos++] = (UINT8)(p >> UINT8_BIT);
-    mBuf[mOutputPos++] = (UINT8) p;
+    S->mBuf[S->mCPos] |= S->mOutputMask;
+    S->mBuf[S->mOutputPos++] = (UINT8)(p >> UINT8_BIT);
+    S->mBuf[S->mOutputPos++] = (UINT8) p;
     c = 0;
     while (p) {
       p >>= 1;
       c++;
     }
-    mPFreq[c]++;
+    S->mPFreq[c]++;
   }
 }
 
 STATIC
 VOID
-HufEncodeStart ()
+HufEncodeStart (
+  IN EFI_COMPRESS_STATE *S
+  )
 {
   INT32 i;
 
   for (i = 0; i < NC; i++) {
-    mCFreq[i] = 0;
+    S->mCFreq[i] = 0;
   }
   for (i = 0; i < NP; i++) {
-    mPFreq[i] = 0;
+    S->mPFreq[i] = 0;
   }
-  mOutputPos = mOutputMask = 0;
-  InitPutBits();
+  S->mOutputPos = S->mOutputMask = 0;
+  InitPutBits(S);
   return;
 }
 
 STATIC
 VOID
-HufEncodeEnd ()
+HufEncodeEnd (
+  IN EFI_COMPRESS_STATE *S
+  )
 {
-  SendBlock();
+  SendBlock(S);
 
   //
   // Flush remaining bits
   //
-  PutBits(UINT8_BIT - 1, 0);
+  PutBits(S, UINT8_BIT - 1, 0);
 
   return;
 }
@@ -1265,7 +1139,9 @@ HufEncodeEnd ()
 
 STATIC
 VOID
-MakeCrcTable ()
+MakeCrcTable (
+  IN EFI_COMPRESS_STATE *S
+  )
 {
   UINT32 i, j, r;
 
@@ -1278,13 +1154,14 @@ MakeCrcTable ()
         r >>= 1;
       }
     }
-    mCrcTable[i] = (UINT16)r;
+    S->mCrcTable[i] = (UINT16)r;
   }
 }
 
 STATIC
 VOID
 PutBits (
+  IN EFI_COMPRESS_STATE *S,
   IN INT32 n,
   IN UINT32 x
   )
@@ -1305,27 +1182,27 @@ Returns: (VOID)
 {
   UINT8 Temp;
 
-  if (n < mBitCount) {
-    mSubBitBuf |= x << (mBitCount -= n);
+  if (n < S->mBitCount) {
+    S->mSubBitBuf |= x << (S->mBitCount -= n);
   } else {
 
-    Temp = (UINT8)(mSubBitBuf | (x >> (n -= mBitCount)));
-    if (mDst < mDstUpperLimit) {
-      *mDst++ = Temp;
+    Temp = (UINT8)(S->mSubBitBuf | (x >> (n -= S->mBitCount)));
+    if (S->mDst < S->mDstUpperLimit) {
+      *S->mDst++ = Temp;
     }
-    mCompSize++;
+    S->mCompSize++;
 
     if (n < UINT8_BIT) {
-      mSubBitBuf = x << (mBitCount = UINT8_BIT - n);
+      S->mSubBitBuf = x << (S->mBitCount = UINT8_BIT - n);
     } else {
 
       Temp = (UINT8)(x >> (n - UINT8_BIT));
-      if (mDst < mDstUpperLimit) {
-        *mDst++ = Temp;
+      if (S->mDst < S->mDstUpperLimit) {
+        *S->mDst++ = Temp;
       }
-      mCompSize++;
+      S->mCompSize++;
 
-      mSubBitBuf = x << (mBitCount = 2 * UINT8_BIT - n);
+      S->mSubBitBuf = x << (S->mBitCount = 2 * UINT8_BIT - n);
     }
   }
 }
@@ -1333,6 +1210,7 @@ Returns: (VOID)
 STATIC
 INT32
 FreadCrc (
+  IN EFI_COMPRESS_STATE *S,
   OUT UINT8 *p,
   IN  INT32 n
   )
@@ -1355,13 +1233,13 @@ Returns:
 {
   INT32 i;
 
-  for (i = 0; mSrc < mSrcUpperLimit && i < n; i++) {
-    *p++ = *mSrc++;
+  for (i = 0; S->mSrc < S->mSrcUpperLimit && i < n; i++) {
+    *p++ = *S->mSrc++;
   }
   n = i;
 
   p -= n;
-  mOrigSize += n;
+  S->mOrigSize += n;
   while (--i >= 0) {
     UPDATE_CRC(*p++);
   }
@@ -1371,15 +1249,18 @@ Returns:
 
 STATIC
 VOID
-InitPutBits ()
+InitPutBits (
+  IN EFI_COMPRESS_STATE *S
+  )
 {
-  mBitCount = UINT8_BIT;
-  mSubBitBuf = 0;
+  S->mBitCount = UINT8_BIT;
+  S->mSubBitBuf = 0;
 }
 
 STATIC
 VOID
 CountLen (
+  IN EFI_COMPRESS_STATE *S,
   IN INT32 i
   )
 /*++
@@ -1396,21 +1277,20 @@ Returns: (VOID)
 
 --*/
 {
-  STATIC INT32 Depth = 0;
-
-  if (i < mN) {
-    mLenCnt[(Depth < 16) ? Depth : 16]++;
+  if (i < S->mN) {
+    S->mLenCnt[(S->mDepth < 16) ? S->mDepth : 16]++;
   } else {
-    Depth++;
-    CountLen(mLeft [i]);
-    CountLen(mRight[i]);
-    Depth--;
+    S->mDepth++;
+    CountLen(S, S->mLeft [i]);
+    CountLen(S, S->mRight[i]);
+    S->mDepth--;
   }
 }
 
 STATIC
 VOID
 MakeLen (
+  IN EFI_COMPRESS_STATE *S,
   IN INT32 Root
   )
 /*++
@@ -1429,9 +1309,9 @@ Arguments:
   UINT32 Cum;
 
   for (i = 0; i <= 16; i++) {
-    mLenCnt[i] = 0;
+    S->mLenCnt[i] = 0;
   }
-  CountLen(Root);
+  CountLen(S, Root);
 
   //
   // Adjust the length count array so that
@@ -1440,23 +1320,23 @@ Arguments:
 
   Cum = 0;
   for (i = 16; i > 0; i--) {
-    Cum += mLenCnt[i] << (16 - i);
+    Cum += S->mLenCnt[i] << (16 - i);
   }
   while (Cum != (1U << 16)) {
-    mLenCnt[16]--;
+    S->mLenCnt[16]--;
     for (i = 15; i > 0; i--) {
-      if (mLenCnt[i] != 0) {
-        mLenCnt[i]--;
-        mLenCnt[i+1] += 2;
+      if (S->mLenCnt[i] != 0) {
+        S->mLenCnt[i]--;
+        S->mLenCnt[i+1] += 2;
         break;
       }
     }
     Cum--;
   }
   for (i = 16; i > 0; i--) {
-    k = mLenCnt[i];
+    k = S->mLenCnt[i];
     while (--k >= 0) {
-      mLen[*mSortPtr++] = (UINT8)i;
+      S->mLen[*S->mSortPtr++] = (UINT8)i;
     }
   }
 }
@@ -1464,6 +1344,7 @@ Arguments:
 STATIC
 VOID
 DownHeap (
+  IN EFI_COMPRESS_STATE *S,
   IN INT32 i
   )
 {
@@ -1473,23 +1354,24 @@ DownHeap (
   // priority queue: send i-th entry down heap
   //
 
-  k = mHeap[i];
-  while ((j = 2 * i) <= mHeapSize) {
-    if (j < mHeapSize && mFreq[mHeap[j]] > mFreq[mHeap[j + 1]]) {
+  k = S->mHeap[i];
+  while ((j = 2 * i) <= S->mHeapSize) {
+    if (j < S->mHeapSize && S->mFreq[S->mHeap[j]] > S->mFreq[S->mHeap[j + 1]]) {
       j++;
     }
-    if (mFreq[k] <= mFreq[mHeap[j]]) {
+    if (S->mFreq[k] <= S->mFreq[S->mHeap[j]]) {
       break;
     }
-    mHeap[i] = mHeap[j];
+    S->mHeap[i] = S->mHeap[j];
     i = j;
   }
-  mHeap[i] = (INT16)k;
+  S->mHeap[i] = (INT16)k;
 }
 
 STATIC
 VOID
 MakeCode (
+  IN EFI_COMPRESS_STATE *S,
   IN  INT32 n,
   IN  UINT8 Len[],
   OUT UINT16 Code[]
@@ -1515,7 +1397,7 @@ Returns: (VOID)
 
   Start[1] = 0;
   for (i = 1; i <= 16; i++) {
-    Start[i + 1] = (UINT16)((Start[i] + mLenCnt[i]) << 1);
+    Start[i + 1] = (UINT16)((Start[i] + S->mLenCnt[i]) << 1);
   }
   for (i = 0; i < n; i++) {
     Code[i] = Start[Len[i]]++;
@@ -1525,6 +1407,7 @@ Returns: (VOID)
 STATIC
 INT32
 MakeTree (
+  IN EFI_COMPRESS_STATE *S,
   IN  INT32   NParm,
   IN  UINT16  FreqParm[],
   OUT UINT8   LenParm[],
@@ -1555,52 +1438,52 @@ Returns:
   // make tree, calculate len[], return root
   //
 
-  mN = NParm;
-  mFreq = FreqParm;
-  mLen = LenParm;
-  Avail = mN;
-  mHeapSize = 0;
-  mHeap[1] = 0;
-  for (i = 0; i < mN; i++) {
-    mLen[i] = 0;
-    if (mFreq[i]) {
-      mHeap[++mHeapSize] = (INT16)i;
+  S->mN = NParm;
+  S->mFreq = FreqParm;
+  S->mLen = LenParm;
+  Avail = S->mN;
+  S->mHeapSize = 0;
+  S->mHeap[1] = 0;
+  for (i = 0; i < S->mN; i++) {
+    S->mLen[i] = 0;
+    if (S->mFreq[i]) {
+      S->mHeap[++S->mHeapSize] = (INT16)i;
     }
   }
-  if (mHeapSize < 2) {
-    CodeParm[mHeap[1]] = 0;
-    return mHeap[1];
+  if (S->mHeapSize < 2) {
+    CodeParm[S->mHeap[1]] = 0;
+    return S->mHeap[1];
   }
-  for (i = mHeapSize / 2; i >= 1; i--) {
+  for (i = S->mHeapSize / 2; i >= 1; i--) {
 
     //
     // make priority queue
     //
-    DownHeap(i);
+    DownHeap(S, i);
   }
-  mSortPtr = CodeParm;
+  S->mSortPtr = CodeParm;
   do {
-    i = mHeap[1];
-    if (i < mN) {
-      *mSortPtr++ = (UINT16)i;
+    i = S->mHeap[1];
+    if (i < S->mN) {
+      *S->mSortPtr++ = (UINT16)i;
     }
-    mHeap[1] = mHeap[mHeapSize--];
-    DownHeap(1);
-    j = mHeap[1];
-    if (j < mN) {
-      *mSortPtr++ = (UINT16)j;
+    S->mHeap[1] = S->mHeap[S->mHeapSize--];
+    DownHeap(S, 1);
+    j = S->mHeap[1];
+    if (j < S->mN) {
+      *S->mSortPtr++ = (UINT16)j;
     }
     k = Avail++;
-    mFreq[k] = (UINT16)(mFreq[i] + mFreq[j]);
-    mHeap[1] = (INT16)k;
-    DownHeap(1);
-    mLeft[k] = (UINT16)i;
-    mRight[k] = (UINT16)j;
-  } while (mHeapSize > 1);
-
-  mSortPtr = CodeParm;
-  MakeLen(k);
-  MakeCode(NParm, LenParm, CodeParm);
+    S->mFreq[k] = (UINT16)(S->mFreq[i] + S->mFreq[j]);
+    S->mHeap[1] = (INT16)k;
+    DownHeap(S, 1);
+    S->mLeft[k] = (UINT16)i;
+    S->mRight[k] = (UINT16)j;
+  } while (S->mHeapSize > 1);
+
+  S->mSortPtr = CodeParm;
+  MakeLen(S, k);
+  MakeCode(S, NParm, LenParm, CodeParm);
 
   //
   // return root
@@ -39,7 +39,18 @@ Abstract:
 //
 // Decompression algorithm begins here
 //
+// With EFI_TABLE_DECODE, the bit buffer is 64 bits and is refilled a byte
+// at a time only when it runs low, and pairs of literals which fit in the
+// 12-bit Char&Len table are decoded with one lookup.  Otherwise this is the
+// original decoder.
+//
+#ifdef EFI_TABLE_DECODE
+typedef UINT64 BITBUF;
+#define BITBUFSIZ 64
+#else
+typedef UINT32 BITBUF;
 #define BITBUFSIZ 32
+#endif
 #define MAXMATCH  256
 #define THRESHOLD 3
 #define CODE_BIT  16
@@ -67,7 +78,7 @@ typedef struct {
   UINT32  mInBuf;
 
   UINT16  mBitCount;
-  UINT32  mBitBuf;
+  BITBUF  mBitBuf;
   UINT32  mSubBitBuf;
   UINT16  mBlockSize;
   UINT32  mCompSize;
@@ -82,6 +93,15 @@ typedef struct {
   UINT16  mCTable[4096];
   UINT16  mPTTable[256];
 
+#ifdef EFI_TABLE_DECODE
+  //
+  // Two literals whose codes fit together in a mCTable index: the code
+  // length of both in bits 16 and up, the second literal in bits 8-15 and
+  // the first in bits 0-7.  Zero if the index doesn't start with a pair.
+  //
+  UINT32  mCPair[4096];
+#endif
+
   //
   // The length of the field 'Position Set Code Length Array Size' in Block Header.
   // For EFI 1.1 de/compression algorithm, mPBit = 4
@@ -111,6 +131,26 @@ Returns: (VOID)
 
 --*/
 {
+#ifdef EFI_TABLE_DECODE
+  //
+  // mBitCount is the number of bits in mBitBuf read from the source, and
+  // is always more than BITBUFSIZ - 8 after this, so callers can look at
+  // up to 57 bits.  mSubBitBuf isn't used.
+  //
+  Sd->mBitBuf <<= NumOfBits;
+  Sd->mBitCount = (UINT16) (Sd->mBitCount - NumOfBits);
+
+  while (Sd->mBitCount <= BITBUFSIZ - 8) {
+    if (Sd->mCompSize > 0) {
+      Sd->mCompSize--;
+      Sd->mBitBuf |= (BITBUF) Sd->mSrcBase[Sd->mInBuf++] << (BITBUFSIZ - 8 - Sd->mBitCount);
+    }
+    //
+    // After the end of the source, this pads with zero bits.
+    //
+    Sd->mBitCount = (UINT16) (Sd->mBitCount + 8);
+  }
+#else
   Sd->mBitBuf = (UINT32) (Sd->mBitBuf << NumOfBits);
 
   while (NumOfBits > Sd->mBitCount) {
@@ -138,6 +178,7 @@ Returns: (VOID)
 
   Sd->mBitCount = (UINT16) (Sd->mBitCount - NumOfBits);
   Sd->mBitBuf |= Sd->mSubBitBuf >> Sd->mBitCount;
+#endif
 }
 
 STATIC
@@ -309,6 +350,60 @@ Returns:
   return 0;
 }
 
+#ifdef EFI_TABLE_DECODE
+STATIC
+VOID
+MakePairTable (
+  IN  SCRATCH_DATA  *Sd
+  )
+/*++
+
+Routine Description:
+
+  Fills mCPair from mCTable and mCLen.
+
+Arguments:
+
+  Sd    - The global scratch data
+
+Returns: (VOID)
+
+--*/
+{
+  UINT16  Index;
+  UINT16  Char;
+  UINT16  Next;
+  UINT16  Len;
+
+  for (Index = 0; Index < 4096; Index++) {
+    Sd->mCPair[Index] = 0;
+
+    Char = Sd->mCTable[Index];
+    if (Char >= 256) {
+      continue;
+    }
+
+    Len = Sd->mCLen[Char];
+    if (Len == 0 || Len >= 12) {
+      continue;
+    }
+
+    //
+    // The bits after the first code are the top of the next index.  The
+    // rest of that index is zeros, so its symbol is only right if its
+    // code fits in what's left.
+    //
+    Next = Sd->mCTable[(Index << Len) & 0xfff];
+    if (Next >= 256 || Sd->mCLen[Next] == 0 ||
+        Len + Sd->mCLen[Next] > 12) {
+      continue;
+    }
+
+    Sd->mCPair[Index] = ((UINT32) (Len + Sd->mCLen[Next]) << 16) | (Next << 8) | Char;
+  }
+}
+#endif
+
 STATIC
 UINT32
 DecodeP (
@@ -331,13 +426,13 @@ Returns:
 --*/
 {
   UINT16  Val;
-  UINT32  Mask;
+  BITBUF  Mask;
   UINT32  Pos;
 
   Val = Sd->mPTTable[Sd->mBitBuf >> (BITBUFSIZ - 8)];
 
   if (Val >= MAXNP) {
-    Mask = 1U << (BITBUFSIZ - 1 - 8);
+    Mask = (BITBUF) 1 << (BITBUFSIZ - 1 - 8);
 
     do {
 
@@ -394,7 +489,7 @@ Returns:
   UINT16  Number;
   UINT16  CharC;
   UINT16  Index;
-  UINT32  Mask;
+  BITBUF  Mask;
 
   Number = (UINT16) GetBits (Sd, nbit);
 
@@ -419,7 +514,7 @@ Returns:
     CharC = (UINT16) (Sd->mBitBuf >> (BITBUFSIZ - 3));
 
     if (CharC == 7) {
-      Mask = 1U << (BITBUFSIZ - 1 - 3);
+      Mask = (BITBUF) 1 << (BITBUFSIZ - 1 - 3);
       while (Mask & Sd->mBitBuf) {
         Mask >>= 1;
         CharC += 1;
@@ -467,7 +562,7 @@ Returns: (VOID)
   UINT16  Number;
   UINT16  CharC;
   UINT16  Index;
-  UINT32  Mask;
+  BITBUF  Mask;
 
   Number = (UINT16) GetBits (Sd, CBIT);
 
@@ -490,7 +585,7 @@ Returns: (VOID)
 
     CharC = Sd->mPTTable[Sd->mBitBuf >> (BITBUFSIZ - 8)];
     if (CharC >= NT) {
-      Mask = 1U << (BITBUFSIZ - 1 - 8);
+      Mask = (BITBUF) 1 << (BITBUFSIZ - 1 - 8);
 
       do {
 
@@ -561,7 +656,7 @@ Returns:
 --*/
 {
   UINT16  Index2;
-  UINT32  Mask;
+  BITBUF  Mask;
 
   if (Sd->mBlockSize == 0) {
     //
@@ -574,6 +669,9 @@ Returns:
     }
 
     ReadCLen (Sd);
+#ifdef EFI_TABLE_DECODE
+    MakePairTable (Sd);
+#endif
 
     Sd->mBadTableFlag = ReadPTLen (Sd, MAXNP, Sd->mPBit, (UINT16) (-1));
     if (Sd->mBadTableFlag != 0) {
@@ -585,7 +683,7 @@ Returns:
   Index2 = Sd->mCTable[Sd->mBitBuf >> (BITBUFSIZ - 12)];
 
   if (Index2 >= NC) {
-    Mask = 1U << (BITBUFSIZ - 1 - 12);
+    Mask = (BITBUF) 1 << (BITBUFSIZ - 1 - 12);
 
     do {
       if (Sd->mBitBuf & Mask) {
@@ -626,13 +724,33 @@ Returns: (VOID)
 {
   UINT16  BytesRemain;
   UINT32  DataIdx;
+  UINT32  Pos;
   UINT16  CharC;
+#ifdef EFI_TABLE_DECODE
+  UINT32  Pair;
+#endif
 
   BytesRemain = (UINT16) (-1);
 
   DataIdx     = 0;
 
   for (;;) {
+#ifdef EFI_TABLE_DECODE
+    //
+    // Once a block has started, take two literals at a time when they
+    // fit in the block and in the destination.
+    //
+    if (Sd->mBlockSize >= 2 && Sd->mOutBuf + 2 <= Sd->mOrigSize) {
+      Pair = Sd->mCPair[Sd->mBitBuf >> (BITBUFSIZ - 12)];
+      if (Pair != 0) {
+        Sd->mDstBase[Sd->mOutBuf++] = (UINT8) Pair;
+        Sd->mDstBase[Sd->mOutBuf++] = (UINT8) (Pair >> 8);
+        Sd->mBlockSize = (UINT16) (Sd->mBlockSize - 2);
+        FillBuf (Sd, (UINT16) (Pair >> 16));
+        continue;
+      }
+    }
+#endif
     CharC = DecodeC (Sd);
     if (Sd->mBadTableFlag != 0) {
       return ;
@@ -656,7 +774,16 @@ Returns: (VOID)
 
       BytesRemain = CharC;
 
-      DataIdx     = Sd->mOutBuf - DecodeP (Sd) - 1;
+      Pos         = DecodeP (Sd);
+      if (Pos >= Sd->mOutBuf) {
+        //
+        // Points before the start of the data
+        //
+        Sd->mBadTableFlag = 1;
+        return ;
+      }
+
+      DataIdx     = Sd->mOutBuf - Pos - 1;
 
       BytesRemain--;
       while ((INT16) (BytesRemain) >= 0) {
@@ -822,7 +949,11 @@ Returns:
   //
   // Fill the first BITBUFSIZ bits
   //
+#ifdef EFI_TABLE_DECODE
+  FillBuf (Sd, 0);
+#else
   FillBuf (Sd, BITBUFSIZ);
+#endif
 
   //
   // Decompress it
@@ -29,6 +29,7 @@ typedef struct ImageConfig {
   string raw_content;
   string compressed_content;
   uint32_t offset;
+  bool stored;          /* false if it shares another image's copy */
 } ImageConfig;
 
 /* Internal struct for contructing ScreenLayout. */
@@ -68,15 +69,32 @@ class BmpBlockUtil {
   /* What compression to use for the images */
   void force_compression(uint32_t compression);
 
+  /* Keep compressed images in a directory, keyed by their contents, the
+   * compression and the compressor version, so that later runs only
+   * compress new or changed images. */
+  void use_cache(const char *dirname);
+
  private:
   /* Elemental function called from load_from_config.
    * Load the config file (yaml format) and parse it. */
   void load_yaml_config(const char *filename);
 
   /* Elemental function called from load_from_config.
-   * Load all image files into the internal variables. */
+   * Load all image files into the internal variables. The images are read
+   * and compressed on one thread per CPU, and identical images are only
+   * compressed once. */
   void load_all_image_files();
 
+  /* Helper functions for load_all_image_files. These may run on any thread,
+   * each on a different image. */
+  void load_image(ImageConfig &image);
+  void compress_image(ImageConfig &image);
+  static void image_worker(void *ctx, int index);
+  const string cache_file_name(const ImageConfig &image);
+  bool read_cached_image(const string &cache_file, ImageConfig &image);
+  void write_cached_image(const string &cache_file, const ImageConfig &image);
+  void run_image_jobs(const vector<ImageConfig *> &images, bool compress);
+
   /* Elemental function called from load_from_config.
    * Contruct the BmpBlockHeader struct. */
   void fill_bmpblock_header();
@@ -118,6 +136,13 @@ class BmpBlockUtil {
   /* Internal variables to determine whether or not to specify compression */
   bool set_compression_;                // true if we force it
   uint32_t compression_;                // what we force it to
+
+  /* Directory of compressed images from earlier runs, or empty for none */
+  string cache_dir_;
+
+  /* The images run_image_jobs() is working on, and what to do with them */
+  vector<ImageConfig *> job_images_;
+  bool job_compress_;
 };
 
 }  // namespace vboot_reference
@@ -11,6 +11,7 @@
 #define UINT8 uint8_t
 #define INT32 int32_t
 #define UINT32 uint32_t
+#define UINT64 uint64_t
 #define STATIC static
 #define IN /**/
 #define OUT /**/
@@ -65,6 +66,15 @@ EfiCompress (
   IN OUT  UINT32  *DstSize
   );
 
+EFI_STATUS
+EfiCompressWithDepth (
+  IN      UINT8   *SrcBuffer,
+  IN      UINT32  SrcSize,
+  IN      UINT8   *DstBuffer,
+  IN OUT  UINT32  *DstSize,
+  IN      UINT32  MaxDepth
+  );
+
 EFI_STATUS
 EFIAPI
 EfiGetInfo (
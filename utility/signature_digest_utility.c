@@ -13,6 +13,8 @@
 
 #include "2sysincludes.h"
 #include "2common.h"
+#include "2sha.h"
+#include "file_keys.h"
 #include "host_common.h"
 #include "host_signature2.h"
 #include "signature_digest.h"
@@ -20,9 +22,8 @@
 int main(int argc, char* argv[])
 {
 	int error_code = -1;
-	uint8_t *buf = NULL;
+	uint8_t digest[VB2_MAX_DIGEST_SIZE];
 	uint8_t *signature_digest = NULL;
-	uint32_t len;
 
 	if (argc != 3) {
 		fprintf(stderr, "Usage: %s <alg_id> <file>", argv[0]);
@@ -35,12 +36,14 @@ int main(int argc, char* argv[])
 		goto cleanup;
 	}
 
-	if (VB2_SUCCESS != vb2_read_file(argv[2], &buf, &len)) {
-		fprintf(stderr, "Could not read file: %s\n", argv[2]);
+	/* Hash the file as it's read, so its size doesn't matter */
+	enum vb2_hash_algorithm hash_alg = vb2_crypto_to_hash(algorithm);
+	if (VB2_SUCCESS != DigestFile(argv[2], hash_alg, digest,
+				      sizeof(digest))) {
+		fprintf(stderr, "Could not digest file: %s\n", argv[2]);
 		goto cleanup;
 	}
 
-	enum vb2_hash_algorithm hash_alg = vb2_crypto_to_hash(algorithm);
 	uint32_t digest_size = vb2_digest_size(hash_alg);
 	uint32_t digestinfo_size = 0;
 	const uint8_t *digestinfo = NULL;
@@ -49,13 +52,12 @@ int main(int argc, char* argv[])
 		goto cleanup;
 
 	uint32_t signature_digest_len = digest_size + digestinfo_size;
-	signature_digest = SignatureDigest(buf, len, algorithm);
+	signature_digest = PrependDigestInfo(hash_alg, digest);
 	if(signature_digest &&
 	   fwrite(signature_digest, signature_digest_len, 1, stdout) == 1)
 		error_code = 0;
 
 cleanup:
 	free(signature_digest);
-	free(buf);
 	return error_code;
 }
@@ -56,7 +56,7 @@ typedef struct Command {
 static void AddVisibleField(Command* cmd, const char* name, int offset) {
   Field* fld = (Field*) calloc(1, sizeof(Field));
   if (cmd->fields != NULL) {
-    assert(offset > fn->offset);
+    assert(offset > cmd->fields->offset);
   }
   fld->next = cmd->fields;
   cmd->fields = fld;
@@ -578,10 +578,11 @@ int OutputBytes_(Command* cmd, Field* fld) {
   return cursor;
 }
 
-/* Helper to output a structure initializer.
+/* Helper to output a structure initializer.  Returns the number of bytes
+ * initialized, after which the buffer is all zeroes.
  */
-void OutputBytes(Command* cmd) {
-  (void) OutputBytes_(cmd, cmd->fields);
+int OutputBytes(Command* cmd) {
+  return OutputBytes_(cmd, cmd->fields);
 }
 
 void OutputFieldPointers(Command* cmd, Field* fld) {
@@ -595,20 +596,55 @@ void OutputFieldPointers(Command* cmd, Field* fld) {
   }
 }
 
+/* Returns the offset of the last visible field of a command, or -1 if it has
+ * none.
+ */
+int LastFieldOffset(Field* fld) {
+  int offset = -1;
+  for (; fld != NULL; fld = fld->next) {
+    if (fld->visible && fld->offset > offset) {
+      offset = fld->offset;
+    }
+  }
+  return offset;
+}
+
+/* Outputs a helper which builds a command with visible fields directly in a
+ * caller's buffer, so the run time can patch the fields in place instead of
+ * copying the whole structure first.  Only the initialized bytes are copied,
+ * and the rest is zeroed.  For variable-length commands, bytes past the last
+ * field are left to the caller.
+ */
+void OutputBuilder(Command* cmd, int initialized) {
+  int last = LastFieldOffset(cmd->fields);
+  int end = cmd->size == 0 ? last : cmd->size;
+  if (last < 0) {
+    return;
+  }
+  printf("static inline uint8_t* %s_build(uint8_t* buffer) {\n", cmd->name);
+  printf("  memcpy(buffer, %s.buffer, %d);\n", cmd->name, initialized);
+  if (end > initialized) {
+    printf("  memset(buffer + %d, 0, %d);\n", initialized, end - initialized);
+  }
+  printf("  return buffer;\n}\n\n");
+}
+
 /* Outputs the structure initializers for all commands.
  */
 void OutputCommands(Command* cmd) {
   if (cmd == NULL) {
     return;
   } else {
+    int initialized;
     printf("const struct s_%s{\n  uint8_t buffer[%d];\n",
            cmd->name, cmd->size == 0 ? cmd->max_size : cmd->size);
     OutputFields(cmd->fields);
     printf("} %s = {{", cmd->name);
-    OutputBytes(cmd);
+    initialized = OutputBytes(cmd);
     printf("},\n");
     OutputFieldPointers(cmd, cmd->fields);
     printf("};\n\n");
+    OutputBuilder(cmd, initialized);
   }
   OutputCommands(cmd->next);
 }
@@ -7,9 +7,13 @@
  *
  * The exit code is 0 for success, the TPM error code for TPM errors, and 255
  * for other errors.
+ *
+ * "tpmc batch" runs a command per line of stdin, with the TPM opened only
+ * once, and prints a JSON result line after the output of each command.
  */
 
 #include <inttypes.h>
+#include <setjmp.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <stdio.h>
@@ -62,6 +66,12 @@ typedef struct command_record {
 int nargs;
 char** args;
 
+/* Set while "tpmc batch" runs a command, so that a bad command gives up on
+ * itself instead of on the whole batch.
+ */
+static int in_batch;
+static jmp_buf batch_abort;
+
 /* Converts a string in the form 0x[0-9a-f]+ to a 32-bit value.  Returns 0 for
  * success, non-zero for failure.
  */
@@ -128,6 +138,16 @@ uint8_t ErrorCheck(uint32_t result, const char* cmd) {
   }
 }
 
+/* Gives up on the current command, which failed for some reason other than
+ * the TPM returning an error.
+ */
+static void __attribute__((noreturn)) OtherError(void) {
+  if (in_batch) {
+    longjmp(batch_abort, 1);
+  }
+  exit(OTHER_ERROR);
+}
+
 /* Handler functions.  These wouldn't exist if C had closures.
  */
 static uint32_t HandlerTpmVersion(void) {
@@ -139,7 +159,7 @@ static uint32_t HandlerTpmVersion(void) {
 #ifdef TPM2_MODE
 static uint32_t HandlerGetFlags(void) {
   fprintf(stderr, "getflags not implemented for TPM2\n");
-  exit(OTHER_ERROR);
+  OtherError();
 }
 #else
 static uint32_t HandlerGetFlags(void) {
@@ -169,14 +189,14 @@ static uint32_t HandlerDefineSpace(void) {
   uint32_t index, size, perm;
   if (nargs != 5) {
     fprintf(stderr, "usage: tpmc def <index> <size> <perm>\n");
-    exit(OTHER_ERROR);
+    OtherError();
   }
   if (HexStringToUint32(args[2], &index) != 0 ||
       HexStringToUint32(args[3], &size) != 0 ||
       HexStringToUint32(args[4], &perm) != 0) {
     fprintf(stderr, "<index>, <size>, and <perm> must be "
             "32-bit hex (0x[0-9a-f]+)\n");
-    exit(OTHER_ERROR);
+    OtherError();
   }
   return TlclDefineSpace(index, perm, size);
 }
@@ -188,16 +208,16 @@ static uint32_t HandlerWrite(void) {
   int i;
   if (nargs < 3) {
     fprintf(stderr, "usage: tpmc write <index> [<byte0> <byte1> ...]\n");
-    exit(OTHER_ERROR);
+    OtherError();
   }
   if (HexStringToUint32(args[2], &index) != 0) {
     fprintf(stderr, "<index> must be 32-bit hex (0x[0-9a-f]+)\n");
-    exit(OTHER_ERROR);
+    OtherError();
   }
   size = nargs - 3;
   if (size > sizeof(value)) {
     fprintf(stderr, "byte array too large\n");
-    exit(OTHER_ERROR);
+    OtherError();
   }
 
   byteargs = args + 3;
@@ -205,7 +225,7 @@ static uint32_t HandlerWrite(void) {
     if (HexStringToUint8(byteargs[i], &value[i]) != 0) {
       fprintf(stderr, "invalid byte %s, should be [0-9a-f][0-9a-f]?\n",
               byteargs[i]);
-      exit(OTHER_ERROR);
+      OtherError();
     }
   }
 
@@ -214,7 +234,7 @@ static uint32_t HandlerWrite(void) {
     if (index == TPM_NV_INDEX_LOCK) {
       fprintf(stderr, "This would set the nvLocked bit. "
               "Use \"tpmc setnv\" instead.\n");
-      exit(OTHER_ERROR);
+      OtherError();
     }
 #endif
     printf("warning: zero-length write\n");
@@ -232,11 +252,11 @@ static uint32_t HandlerPCRRead(void) {
   int i;
   if (nargs != 3) {
     fprintf(stderr, "usage: tpmc pcrread <index>\n");
-    exit(OTHER_ERROR);
+    OtherError();
   }
   if (HexStringToUint32(args[2], &index) != 0) {
     fprintf(stderr, "<index> must be 32-bit hex (0x[0-9a-f]+)\n");
-    exit(OTHER_ERROR);
+    OtherError();
   }
   result = TlclPCRRead(index, value, sizeof(value));
   if (result == 0) {
@@ -253,15 +273,15 @@ static uint32_t HandlerPCRExtend(void) {
   uint8_t value[TPM_PCR_DIGEST];
   if (nargs != 4) {
     fprintf(stderr, "usage: tpmc pcrextend <index> <extend_hash>\n");
-    exit(OTHER_ERROR);
+    OtherError();
   }
   if (HexStringToUint32(args[2], &index) != 0) {
     fprintf(stderr, "<index> must be 32-bit hex (0x[0-9a-f]+)\n");
-    exit(OTHER_ERROR);
+    OtherError();
   }
   if (HexStringToArray(args[3], value, TPM_PCR_DIGEST)) {
     fprintf(stderr, "<extend_hash> must be a 20-byte hex string\n");
-    exit(OTHER_ERROR);
+    OtherError();
   }
   return TlclExtend(index, value, value);
 }
@@ -273,16 +293,16 @@ static uint32_t HandlerRead(void) {
   int i;
   if (nargs != 4) {
     fprintf(stderr, "usage: tpmc read <index> <size>\n");
-    exit(OTHER_ERROR);
+    OtherError();
   }
   if (HexStringToUint32(args[2], &index) != 0 ||
       HexStringToUint32(args[3], &size) != 0) {
     fprintf(stderr, "<index> and <size> must be 32-bit hex (0x[0-9a-f]+)\n");
-    exit(OTHER_ERROR);
+    OtherError();
   }
   if (size > sizeof(value)) {
     fprintf(stderr, "size of read (0x%x) is too big\n", size);
-    exit(OTHER_ERROR);
+    OtherError();
   }
   result = TlclRead(index, value, size);
   if (result == 0 && size > 0) {
@@ -298,11 +318,11 @@ static uint32_t HandlerGetPermissions(void) {
   uint32_t index, permissions, result;
   if (nargs != 3) {
     fprintf(stderr, "usage: tpmc getp <index>\n");
-    exit(OTHER_ERROR);
+    OtherError();
   }
   if (HexStringToUint32(args[2], &index) != 0) {
     fprintf(stderr, "<index> must be 32-bit hex (0x[0-9a-f]+)\n");
-    exit(OTHER_ERROR);
+    OtherError();
   }
   result = TlclGetPermissions(index, &permissions);
   if (result == 0) {
@@ -316,7 +336,7 @@ static uint32_t HandlerGetOwnership(void) {
   uint32_t result;
   if (nargs != 2) {
     fprintf(stderr, "usage: tpmc getownership\n");
-    exit(OTHER_ERROR);
+    OtherError();
   }
   result = TlclGetOwnership(&owned);
   if (result == 0) {
@@ -332,16 +352,16 @@ static uint32_t HandlerGetRandom(void) {
   int i;
   if (nargs != 3) {
     fprintf(stderr, "usage: tpmc getrandom <size>\n");
-    exit(OTHER_ERROR);
+    OtherError();
   }
   if (HexStringToUint32(args[2], &length) != 0) {
     fprintf(stderr, "<size> must be 32-bit hex (0x[0-9a-f]+)\n");
-    exit(OTHER_ERROR);
+    OtherError();
   }
   bytes = calloc(1, length);
   if (bytes == NULL) {
     perror("calloc");
-    exit(OTHER_ERROR);
+    OtherError();
   }
   result = TlclGetRandom(bytes, length, &size);
   if (result == 0 && size > 0) {
@@ -424,19 +444,19 @@ static uint32_t HandlerSendRaw(void) {
   int i;
   if (nargs == 2) {
     fprintf(stderr, "usage: tpmc sendraw <hex byte 0> ... <hex byte N>\n");
-    exit(OTHER_ERROR);
+    OtherError();
   }
   for (i = 0; i < nargs - 2 && i < sizeof(request); i++) {
     if (HexStringToUint8(args[2 + i], &request[i]) != 0) {
       fprintf(stderr, "bad byte value \"%s\"\n", args[2 + i]);
-      exit(OTHER_ERROR);
+      OtherError();
     }
   }
   size = TlclPacketSize(request);
   if (size != i) {
     fprintf(stderr, "bad request: size field is %d, but packet has %d bytes\n",
             size, i);
-    exit(OTHER_ERROR);
+    OtherError();
   }
   bzero(response, sizeof(response));
   result = TlclSendReceive(request, response, sizeof(response));
@@ -446,7 +466,7 @@ static uint32_t HandlerSendRaw(void) {
   size = TlclPacketSize(response);
   if (size < 10 || size > sizeof(response)) {
     fprintf(stderr, "unexpected response size %d\n", size);
-    exit(OTHER_ERROR);
+    OtherError();
   }
   for (i = 0; i < size; i++) {
     printf("0x%02x ", response[i]);
@@ -526,7 +546,7 @@ static uint32_t HandlerDoNothingForTPM2(void) {
 
 static uint32_t HandlerNotImplementedForTPM2(void) {
   fprintf(stderr, "%s: not implemented for TPM2.0\n", args[1]);
-  exit(OTHER_ERROR);
+  OtherError();
 }
 #endif
 
@@ -609,6 +629,197 @@ command_record command_table[] = {
 
 static int n_commands = sizeof(command_table) / sizeof(command_table[0]);
 
+/* Returns the command named or abbreviated |cmd|, or NULL if there isn't one.
+ */
+static command_record* FindCommand(const char* cmd) {
+  command_record* c;
+  for (c = command_table; c < command_table + n_commands; c++) {
+    if (strcmp(cmd, c->name) == 0 || strcmp(cmd, c->abbr) == 0) {
+      return c;
+    }
+  }
+  return NULL;
+}
+
+/* A line of "tpmc batch" input, split into words.  Like the command line,
+ * args[0] is the program name and args[1] the command.
+ */
+typedef struct batch_line {
+  int line_num;
+  int nargs;
+  char** args;
+  char* buf;
+} batch_line;
+
+/* Reads the whole of |fp| into |*lines|, skipping blank lines and comments.
+ * Returns the number of lines, or -1 if out of memory.
+ */
+static int ReadBatch(FILE* fp, char* progname, batch_line** lines) {
+  batch_line* l = NULL;
+  int count = 0;
+  int line_num = 0;
+  char* buf = NULL;
+  size_t buf_size = 0;
+
+  while (getline(&buf, &buf_size, fp) >= 0) {
+    char* word;
+    char** a;
+    batch_line* more;
+    line_num++;
+
+    if (strchr(buf, '#')) {
+      *strchr(buf, '#') = '\0';
+    }
+    word = strtok(buf, " \t\r\n");
+    if (!word) {
+      continue;
+    }
+
+    more = realloc(l, (count + 1) * sizeof(*l));
+    if (!more) {
+      return -1;
+    }
+    l = more;
+    l[count].line_num = line_num;
+    l[count].buf = buf;
+    l[count].nargs = 1;
+    l[count].args = malloc(2 * sizeof(char*));
+    if (!l[count].args) {
+      return -1;
+    }
+    l[count].args[0] = progname;
+    for (; word; word = strtok(NULL, " \t\r\n")) {
+      a = realloc(l[count].args, (l[count].nargs + 2) * sizeof(char*));
+      if (!a) {
+        return -1;
+      }
+      l[count].args = a;
+      l[count].args[l[count].nargs++] = word;
+    }
+    l[count].args[l[count].nargs] = NULL;
+    count++;
+
+    /* The words point into buf, so the next line needs a new one */
+    buf = NULL;
+    buf_size = 0;
+  }
+  free(buf);
+
+  *lines = l;
+  return count;
+}
+
+/* Queues the reads and getp commands starting at |l|, up to |count| lines,
+ * and sends them to the TPM back to back.  TlclRead() and
+ * TlclGetPermissions() then take their answers from the batch as the
+ * handlers run them, in order.  Returns the number of lines covered.
+ */
+static int SendBatch(const batch_line* l, int count) {
+  uint32_t index, size;
+  int n;
+
+  for (n = 0; n < count; n++, l++) {
+    const command_record* c = FindCommand(l->args[1]);
+    if (c && c->handler == HandlerRead && l->nargs == 4 &&
+        HexStringToUint32(l->args[2], &index) == 0 &&
+        HexStringToUint32(l->args[3], &size) == 0) {
+      if (TlclBatchRead(index, size) != 0) {
+        break;
+      }
+    } else if (c && c->handler == HandlerGetPermissions && l->nargs == 3 &&
+               HexStringToUint32(l->args[2], &index) == 0) {
+      if (TlclBatchGetPermissions(index) != 0) {
+        break;
+      }
+    } else {
+      break;
+    }
+  }
+
+  /* A failed send just means each command goes to the TPM by itself */
+  if (n > 1) {
+    TlclBatchSend();
+  }
+  return n;
+}
+
+static void PrintJsonString(const char* str) {
+  putchar('"');
+  for (; *str; str++) {
+    if (*str == '"' || *str == '\\') {
+      printf("\\%c", *str);
+    } else if ((unsigned char)*str < 0x20) {
+      printf("\\u%04x", (unsigned char)*str);
+    } else {
+      putchar(*str);
+    }
+  }
+  putchar('"');
+}
+
+/* Runs the commands on stdin, one per line, with the TPM opened once.  Each
+ * command's output is followed by a line of JSON giving its result, which is
+ * the exit code the command would have had by itself.  Returns the exit code
+ * of the first command that failed, or 0 if none did.
+ */
+static int RunBatch(char* progname) {
+  batch_line* lines = NULL;
+  int count, i;
+  int batched = 0;
+  int exit_code = 0;
+  uint32_t result;
+
+  count = ReadBatch(stdin, progname, &lines);
+  if (count < 0) {
+    fprintf(stderr, "out of memory reading commands\n");
+    return OTHER_ERROR;
+  }
+
+  result = TlclLibInit();
+  if (result) {
+    fprintf(stderr, "initialization failed with code %d\n", result);
+    return result > OTHER_ERROR ? OTHER_ERROR : result;
+  }
+
+  for (i = 0; i < count; i++) {
+    const batch_line* l = lines + i;
+    const command_record* c = FindCommand(l->args[1]);
+    volatile uint8_t code = OTHER_ERROR;
+
+    if (!c) {
+      fprintf(stderr, "%s: line %d: unknown command: %s\n",
+              progname, l->line_num, l->args[1]);
+    } else {
+      if (i >= batched) {
+        batched = i + SendBatch(l, count - i);
+      }
+      nargs = l->nargs;
+      args = l->args;
+      in_batch = 1;
+      if (!setjmp(batch_abort)) {
+        code = ErrorCheck(c->handler(), l->args[1]);
+      }
+      in_batch = 0;
+    }
+
+    printf("{\"line\":%d,\"command\":", l->line_num);
+    PrintJsonString(l->args[1]);
+    printf(",\"result\":%d}\n", code);
+    fflush(stdout);
+    if (code && !exit_code) {
+      exit_code = code;
+    }
+  }
+
+  TlclLibClose();
+  for (i = 0; i < count; i++) {
+    free(lines[i].args);
+    free(lines[i].buf);
+  }
+  free(lines);
+  return exit_code;
+}
+
 int main(int argc, char* argv[]) {
   char *progname;
   uint32_t result;
@@ -620,8 +831,8 @@ int main(int argc, char* argv[]) {
     progname = argv[0];
 
   if (argc < 2) {
-    fprintf(stderr, "usage: %s <TPM command> [args]\n   or: %s help\n",
-            progname, progname);
+    fprintf(stderr, "usage: %s <TPM command> [args]\n   or: %s help\n"
+            "   or: %s batch < commands\n", progname, progname, progname);
     return OTHER_ERROR;
   } else {
     command_record* c;
@@ -635,11 +846,20 @@ int main(int argc, char* argv[]) {
       for (c = command_table; c < command_table + n_commands; c++) {
         printf("%26s %7s  %s\n", c->name, c->abbr, c->description);
       }
+      printf("%26s %7s  %s\n", "batch", "",
+             "run the commands on stdin, one per line");
       return 0;
     }
     if (!strcmp(cmd, "tpmversion") || !strcmp(cmd, "tpmver")) {
       return HandlerTpmVersion();
     }
+    if (strcmp(cmd, "batch") == 0) {
+      if (argc != 2) {
+        fprintf(stderr, "usage: %s batch < commands\n", progname);
+        return OTHER_ERROR;
+      }
+      return RunBatch(progname);
+    }
 
     result = TlclLibInit();
     if (result) {
@@ -647,10 +867,9 @@ int main(int argc, char* argv[]) {
       return result > OTHER_ERROR ? OTHER_ERROR : result;
     }
 
-    for (c = command_table; c < command_table + n_commands; c++) {
-      if (strcmp(cmd, c->name) == 0 || strcmp(cmd, c->abbr) == 0) {
-        return ErrorCheck(c->handler(), cmd);
-      }
+    c = FindCommand(cmd);
+    if (c) {
+      return ErrorCheck(c->handler(), cmd);
     }
 
     /* No command matched. */